@@ -0,0 +1,1497 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file obuspa_bench.c
+ *
+ * Micro-benchmarks of the core data structures, path resolver and USP message serialization
+ * The benchmarks are run against the USP Agent data model, extended by a synthetic schema (Device.X_BENCH) scaled to a
+ * specified number of nodes. This file replaces main.c and the vendor layer when linked (see obuspa_bench in Makefile.am)
+ *
+ * Usage: obuspa_bench [num-nodes]
+ *   If num-nodes is not specified, then the benchmarks are run for synthetic schemas of 1000, 10000 and 100000 nodes
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "vendor_api.h"
+#include "data_model.h"
+#include "database.h"
+#include "dm_exec.h"
+#include "mtp_exec.h"
+#include "bdc_exec.h"
+#include "os_utils.h"
+#include "sync_timer.h"
+#include "retry_wait.h"
+#include "path_resolver.h"
+#include "dm_inst_vector.h"
+#include "str_vector.h"
+#include "kv_vector.h"
+#include "text_utils.h"
+#include "dm_trans.h"
+#include "msg_handler.h"
+#include "proto_codec.h"
+#include "handle_get.h"
+#include "handle_set.h"
+#include "usp-msg.pb-c.h"
+#include "usp-record.pb-c.h"
+
+//------------------------------------------------------------------------------
+// Number of nodes in each of the synthetic schemas which the benchmarks are run against, if not specified on the command line
+static int default_scales[] = { 1000, 10000, 100000 };
+
+// Each benchmark is repeated, doubling the number of iterations, until it has run for at least this long
+#define BENCH_MIN_TIME_NS  (200*1000*1000LL)
+
+// Maximum number of iterations of each benchmark
+#define BENCH_MAX_ITERATIONS  (1 << 24)
+
+// Number of parameters in each single instance object of the synthetic schema (Device.X_BENCH.Scale.Group{n}.Param{n})
+#define PARAMS_PER_GROUP  9
+
+// Number of entries added to the string and key-value vectors, in the vector benchmarks
+#define NUM_VECTOR_ENTRIES  100
+
+// Number of object instances added (each with TRANS_PARAMS_PER_INSTANCE parameters set) in the transaction journal benchmark
+#define TRANS_INSTANCES  1000
+#define TRANS_PARAMS_PER_INSTANCE  3
+
+// Number of object instances (each with DB_TABLE_PARAMS database parameters) added then deleted in the add/delete benchmark
+#define DB_TABLE_INSTANCES  100
+#define DB_TABLE_PARAMS  8
+
+// Number of bytes in the binary value converted from hexadecimal, in the hex string benchmark
+#define HEX_VALUE_BYTES  64
+
+// Maximum number of objects in the Set request and Set response benchmarks, and number of arguments in the Notify Event benchmark
+#define SET_OBJECTS  100
+#define EVENT_ARGS  8
+
+// Root of the synthetic schema
+#define BENCH_ROOT "Device.X_BENCH"
+#define BENCH_TABLE_ROOT BENCH_ROOT ".Table.{i}"
+#define BENCH_DB_TABLE_ROOT BENCH_ROOT ".DbTable.{i}"
+#define BENCH_GROUPED_PARAM BENCH_ROOT ".GroupedParam"
+
+// Group of vendor parameters containing BENCH_GROUPED_PARAM
+#define BENCH_GROUP_ID 0
+
+//------------------------------------------------------------------------------
+// Variables defining the synthetic schema, and the data used by the benchmarks
+static int num_groups;                  // Number of Device.X_BENCH.Scale.Group{n} objects
+static int num_table_instances;         // Number of instances of Device.X_BENCH.Table.{i}
+static char vector_keys[NUM_VECTOR_ENTRIES][32];
+static char hex_value[2*HEX_VALUE_BYTES+1];   // Hexadecimal string, as used for hexBinary parameter values
+static char *query_value = "Device.DeviceInfo.X_BENCH.Description=Bulk data report for device 1 (see https://example.com/a?b=c&d=e)";
+static char *escaped_value = "Device.LocalAgent.Controller.1.EndpointID%3Dproto%3A%3Acontroller-1%20%28primary%29";
+static char node_path[MAX_DM_PATH];     // Parameter in the middle of the synthetic schema
+static char table_path[MAX_DM_PATH];    // Object instance in the middle of Device.X_BENCH.Table.{i}
+static char search_path[MAX_DM_PATH];   // Search expression selecting half of the instances of Device.X_BENCH.Table.{i}
+static char unique_key_path[MAX_DM_PATH]; // Unique key expression selecting one instance of Device.X_BENCH.Table.{i}
+static dm_node_t *table_node;
+static dm_instances_t table_inst;
+static char table_param_path[MAX_DM_PATH]; // Parameter in the object instance in the middle of Device.X_BENCH.Table.{i}
+static dm_node_t *table_param_node;
+static Usp__Msg *get_resp;              // Get response containing all parameters in Device.X_BENCH.Table.{i}
+static unsigned char *get_resp_pbuf;
+static int get_resp_len;
+static Usp__Msg *get_req;               // Get request containing a wildcard and a search path
+static unsigned char get_req_pbuf[256];
+static int get_req_len;
+
+// USP message used by the protobuf serialization benchmarks, in both unpacked and packed form
+typedef struct
+{
+    Usp__Msg *msg;
+    unsigned char *pbuf;
+    int len;
+} bench_msg_t;
+
+static bench_msg_t set_req;             // Set request updating the Value parameter of instances of Device.X_BENCH.Table.{i}
+static bench_msg_t set_resp;            // Set response for set_req
+static bench_msg_t notify_req;          // Notify request containing an Event
+static UspRecord__Record *record;       // USP record encapsulating the Get response
+static unsigned char *record_pbuf;
+static int record_len;
+static kv_vector_t grouped_sets;        // Parameters passed to the most recent call to Set_BenchGroup()
+static int num_grouped_set_calls;       // Number of times Set_BenchGroup() has been called
+
+//------------------------------------------------------------------------------
+// Variables replacing those defined in main.c
+bool enable_callstack_debug = false;
+
+//------------------------------------------------------------------------------
+// Typedef for a function implementing one iteration of a benchmark
+typedef void (*bench_fn_t)(void);
+
+//--------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+int RunAtScale(int num_nodes);
+int StartAgent(char *db_file);
+void PrepareBenchmarks(void);
+void PrepareCodecBenchmarks(void);
+void PackBenchMsg(bench_msg_t *bm);
+int VerifyProtoCodec(void);
+int VerifyBenchMsg(char *name, Usp__Msg *msg);
+int VerifyGroupedSet(void);
+void RunBenchmark(char *name, bench_fn_t fn);
+long long TimeNs(void);
+int Get_BenchScaleParam(dm_req_t *req, char *buf, int len);
+int Get_BenchTableName(dm_req_t *req, char *buf, int len);
+int Get_BenchTableValue(dm_req_t *req, char *buf, int len);
+int Get_BenchTableEnable(dm_req_t *req, char *buf, int len);
+int Get_BenchGroup(int group_id, kv_vector_t *params);
+int Set_BenchGroup(int group_id, kv_vector_t *params);
+void Bench_StrVector(void);
+void Bench_StrVectorDedup(void);
+void Bench_StrSetDedup(void);
+void Bench_KvVector(void);
+void Bench_KvVectorReplace(void);
+void Bench_KvVectorReplaceIndexed(void);
+void Bench_CalcHash(void);
+void Bench_CalcHash64(void);
+void Bench_CalcWordHash64(void);
+void Bench_StringToBinary(void);
+void Bench_PercentEncode(void);
+void Bench_PercentDecode(void);
+void Bench_PercentDecodeUnescaped(void);
+void Bench_PathToSchemaForm(void);
+void Bench_GetNodeFromPath(void);
+void Bench_InstExists(void);
+void Bench_GetInstances(void);
+void Bench_ResolveWildcard(void);
+void Bench_ResolveSearch(void);
+void Bench_ResolveUniqueKey(void);
+void Bench_ResolvePartialPath(void);
+void Bench_GetWildcard(void);
+void Bench_PackGetReq(void);
+void Bench_UnpackGetReq(void);
+void Bench_PackGetResp(void);
+void Bench_UnpackGetResp(void);
+void Bench_PackGetReqSpecialized(void);
+void Bench_UnpackGetReqSpecialized(void);
+void Bench_PackGetRespSpecialized(void);
+void Bench_UnpackGetRespSpecialized(void);
+void Bench_PackSetReq(void);
+void Bench_PackSetReqSpecialized(void);
+void Bench_UnpackSetReq(void);
+void Bench_UnpackSetReqSpecialized(void);
+void Bench_PackSetResp(void);
+void Bench_PackSetRespSpecialized(void);
+void Bench_PackNotifyReq(void);
+void Bench_PackNotifyReqSpecialized(void);
+void Bench_UnpackNotifyReq(void);
+void Bench_UnpackNotifyReqSpecialized(void);
+void Bench_PackRecord(void);
+void Bench_PackRecordSpecialized(void);
+void Bench_UnpackRecord(void);
+void Bench_UnpackRecordSpecialized(void);
+void Bench_TransJournal(void);
+void Bench_AddDeleteDbTable(void);
+void ResolveAndDestroy(char *path);
+
+/*********************************************************************//**
+**
+** main
+**
+** Main function of the benchmark program
+**
+** \param   argc - Number of command line arguments
+** \param   argv - Array of pointers to command line argument strings
+**
+** \return  0 if all benchmarks ran successfully, otherwise 1
+**
+**************************************************************************/
+int main(int argc, char *argv[])
+{
+    int i;
+    int status;
+    pid_t pid;
+    int result = 0;
+
+    // Run the benchmarks at the specified scale, if one was given
+    if (argc > 1)
+    {
+        return RunAtScale(atoi(argv[1]));
+    }
+
+    // Otherwise run the benchmarks at each of the default scales
+    // NOTE: Each scale is run in a separate process, because the data model schema can only be registered once per process
+    for (i=0; i < NUM_ELEM(default_scales); i++)
+    {
+        fflush(stdout);
+        pid = fork();
+        if (pid == 0)
+        {
+            exit(RunAtScale(default_scales[i]));
+        }
+
+        if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || (!WIFEXITED(status)) || (WEXITSTATUS(status) != 0))
+        {
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+/*********************************************************************//**
+**
+** RunAtScale
+**
+** Starts the data model with a synthetic schema of the specified size, then runs all benchmarks against it
+**
+** \param   num_nodes - number of nodes to add to the data model in the synthetic schema
+**
+** \return  0 if all benchmarks ran successfully, otherwise 1
+**
+**************************************************************************/
+int RunAtScale(int num_nodes)
+{
+    char db_file[64];
+    int err;
+
+    // Exit if the number of nodes is invalid
+    if (num_nodes < 100)
+    {
+        fprintf(stderr, "ERROR: Number of nodes (%d) must be at least 100\n", num_nodes);
+        return 1;
+    }
+
+    num_groups = num_nodes / (PARAMS_PER_GROUP+1);
+    num_table_instances = num_nodes / 100;
+
+    // Exit if unable to start the data model, using a new database
+    USP_SNPRINTF(db_file, sizeof(db_file), "/tmp/obuspa_bench_%d.db", (int)getpid());
+    unlink(db_file);
+    // NOTE: The database file is kept until the benchmarks have completed, as some benchmarks write to it
+    err = StartAgent(db_file);
+    if (err != USP_ERR_OK)
+    {
+        unlink(db_file);
+        fprintf(stderr, "ERROR: Failed to start data model (%s)\n", USP_ERR_GetMessage());
+        return 1;
+    }
+
+    PrepareBenchmarks();
+
+    // Exit if the specialized protobuf serialization code does not produce the same results as protobuf-c
+    if (VerifyProtoCodec() != USP_ERR_OK)
+    {
+        unlink(db_file);
+        return 1;
+    }
+
+    // Exit if a grouped vendor parameter is not set correctly outside of a transaction
+    if (VerifyGroupedSet() != USP_ERR_OK)
+    {
+        unlink(db_file);
+        return 1;
+    }
+
+    printf("\nSynthetic schema: %d nodes (%d objects of %d parameters), table of %d instances\n",
+           num_groups*(PARAMS_PER_GROUP+1), num_groups, PARAMS_PER_GROUP, num_table_instances);
+    printf("%-48s %10s %14s\n", "Benchmark", "Iterations", "ns/op");
+
+    RunBenchmark("STR_VECTOR Add+Find+Destroy (100 entries)", Bench_StrVector);
+    RunBenchmark("STR_VECTOR_Add_IfNotExist (100 entries)", Bench_StrVectorDedup);
+    RunBenchmark("STR_SET_AddIfNotExist (100 entries)", Bench_StrSetDedup);
+    RunBenchmark("KV_VECTOR Add+Get+Destroy (100 entries)", Bench_KvVector);
+    RunBenchmark("KV_VECTOR_Replace or Add (100 entries)", Bench_KvVectorReplace);
+    RunBenchmark("KV_VECTOR_ReplaceIndexed or Add (100 entries)", Bench_KvVectorReplaceIndexed);
+    RunBenchmark("TEXT_UTILS_CalcHash", Bench_CalcHash);
+    RunBenchmark("TEXT_UTILS_CalcHash64", Bench_CalcHash64);
+    RunBenchmark("TEXT_UTILS_CalcWordHash64", Bench_CalcWordHash64);
+    RunBenchmark("TEXT_UTILS_StringToBinary (64 bytes)", Bench_StringToBinary);
+    RunBenchmark("TEXT_UTILS_PercentEncodeString", Bench_PercentEncode);
+    RunBenchmark("TEXT_UTILS_PercentDecodeString (escaped)", Bench_PercentDecode);
+    RunBenchmark("TEXT_UTILS_PercentDecodeString (unescaped)", Bench_PercentDecodeUnescaped);
+    RunBenchmark("TEXT_UTILS_PathToSchemaForm", Bench_PathToSchemaForm);
+    RunBenchmark("DM_PRIV_GetNodeFromPath", Bench_GetNodeFromPath);
+    RunBenchmark("DM_INST_VECTOR_IsExist", Bench_InstExists);
+    RunBenchmark("DM_INST_VECTOR_GetInstances", Bench_GetInstances);
+    RunBenchmark("PATH_RESOLVER wildcard (Table.*.Value)", Bench_ResolveWildcard);
+    RunBenchmark("PATH_RESOLVER search (Table.[Value>n].Name)", Bench_ResolveSearch);
+    RunBenchmark("PATH_RESOLVER unique key (Table.[Name==x].Value)", Bench_ResolveUniqueKey);
+    RunBenchmark("PATH_RESOLVER partial path (Scale.)", Bench_ResolvePartialPath);
+    RunBenchmark("Get (Table.*.)", Bench_GetWildcard);
+    RunBenchmark("Pack Get request", Bench_PackGetReq);
+    RunBenchmark("Unpack Get request", Bench_UnpackGetReq);
+    RunBenchmark("Pack Get response (Table.*.)", Bench_PackGetResp);
+    RunBenchmark("Unpack Get response (Table.*.)", Bench_UnpackGetResp);
+    RunBenchmark("Pack Get request (specialized)", Bench_PackGetReqSpecialized);
+    RunBenchmark("Unpack Get request (specialized)", Bench_UnpackGetReqSpecialized);
+    RunBenchmark("Pack Get response (specialized)", Bench_PackGetRespSpecialized);
+    RunBenchmark("Unpack Get response (specialized)", Bench_UnpackGetRespSpecialized);
+    RunBenchmark("Pack Set request", Bench_PackSetReq);
+    RunBenchmark("Pack Set request (specialized)", Bench_PackSetReqSpecialized);
+    RunBenchmark("Unpack Set request", Bench_UnpackSetReq);
+    RunBenchmark("Unpack Set request (specialized)", Bench_UnpackSetReqSpecialized);
+    RunBenchmark("Pack Set response", Bench_PackSetResp);
+    RunBenchmark("Pack Set response (specialized)", Bench_PackSetRespSpecialized);
+    RunBenchmark("Pack Notify Event request", Bench_PackNotifyReq);
+    RunBenchmark("Pack Notify Event request (specialized)", Bench_PackNotifyReqSpecialized);
+    RunBenchmark("Unpack Notify Event request", Bench_UnpackNotifyReq);
+    RunBenchmark("Unpack Notify Event request (specialized)", Bench_UnpackNotifyReqSpecialized);
+    RunBenchmark("Pack USP record (Get response)", Bench_PackRecord);
+    RunBenchmark("Pack USP record (specialized)", Bench_PackRecordSpecialized);
+    RunBenchmark("Unpack USP record in place", Bench_UnpackRecord);
+    RunBenchmark("Unpack USP record in place (specialized)", Bench_UnpackRecordSpecialized);
+    RunBenchmark("DM_TRANS journal (1000 adds, 3000 sets)", Bench_TransJournal);
+    RunBenchmark("Add+Delete 100 instances of 8 DB params", Bench_AddDeleteDbTable);
+
+    unlink(db_file);
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** StartAgent
+**
+** Initialises and starts the data model (without starting any MTP connections or threads)
+**
+** \param   db_file - pointer to name of database file to create
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartAgent(char *db_file)
+{
+    int err;
+
+    // Determine a handle for the data model thread (this thread)
+    OS_UTILS_SetDataModelThread();
+
+    // Exit if unable to initialise basic subsystems
+    USP_LOG_Init();
+    usp_log_level = kLogLevel_Error;
+    USP_ERR_Init();
+    err = USP_MEM_Init();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    SYNC_TIMER_Init();
+
+    // Exit if an error occurred when initialising the database
+    err = DATABASE_Init(db_file);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if an error occurred when initialising any of the the message queues used by the threads
+    err = DM_EXEC_Init();
+    err |= MTP_EXEC_Init();
+    err |= BDC_EXEC_Init();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    RETRY_WAIT_Init();
+
+    // Exit if unable to add all schema paths to the data model
+    err = DATA_MODEL_Init();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return DATA_MODEL_Start();
+}
+
+/*********************************************************************//**
+**
+** PrepareBenchmarks
+**
+** Sets up the data used by the benchmarks
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PrepareBenchmarks(void)
+{
+    int i;
+    bool is_qualified_instance;
+    dm_instances_t param_inst;
+    Usp__Header *header;
+    Usp__Body *body;
+    Usp__Request *request;
+    Usp__Get *get;
+    static char *get_req_paths[] = { BENCH_ROOT ".Table.*.Value", BENCH_ROOT ".Table.[Enable==true].Name" };
+
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        USP_SNPRINTF(vector_keys[i], sizeof(vector_keys[i]), "Device.X_BENCH.Key%d", i);
+    }
+
+    for (i=0; i < HEX_VALUE_BYTES; i++)
+    {
+        USP_SNPRINTF(&hex_value[2*i], 3, "%02x", (i*37) & 0xFF);
+    }
+
+    USP_SNPRINTF(node_path, sizeof(node_path), "%s.Scale.Group%d.Param%d", BENCH_ROOT, num_groups/2, PARAMS_PER_GROUP/2);
+    USP_SNPRINTF(table_path, sizeof(table_path), "%s.Table.%d", BENCH_ROOT, (num_table_instances+1)/2);
+    USP_SNPRINTF(search_path, sizeof(search_path), "%s.Table.[Value>%d].Name", BENCH_ROOT, num_table_instances/2);
+    USP_SNPRINTF(unique_key_path, sizeof(unique_key_path), "%s.Table.[Name==\"Entry%d\"].Value", BENCH_ROOT, (num_table_instances+1)/2);
+
+    table_node = DM_PRIV_GetNodeFromPath(table_path, &table_inst, &is_qualified_instance);
+    USP_ASSERT(table_node != NULL);
+
+    USP_SNPRINTF(table_param_path, sizeof(table_param_path), "%s.Name", table_path);
+    table_param_node = DM_PRIV_GetNodeFromPath(table_param_path, &param_inst, &is_qualified_instance);
+    USP_ASSERT(table_param_node != NULL);
+
+    // Form a Get response containing all parameters in the table, in both unpacked and packed form
+    get_resp = CreateGetResp("bench-get-resp");
+    GetSinglePath(get_resp, BENCH_ROOT ".Table.*.", NULL);
+    get_resp_len = usp__msg__get_packed_size(get_resp);
+    get_resp_pbuf = USP_MALLOC(get_resp_len);
+    usp__msg__pack(get_resp, get_resp_pbuf);
+
+    // Form a Get request in unpacked form, then pack it
+    get_req = USP_MALLOC(sizeof(Usp__Msg));
+    header = USP_MALLOC(sizeof(Usp__Header));
+    body = USP_MALLOC(sizeof(Usp__Body));
+    request = USP_MALLOC(sizeof(Usp__Request));
+    get = USP_MALLOC(sizeof(Usp__Get));
+    usp__msg__init(get_req);
+    usp__header__init(header);
+    usp__body__init(body);
+    usp__request__init(request);
+    usp__get__init(get);
+
+    get_req->header = header;
+    header->msg_id = "bench-get-req";
+    header->msg_type = USP__HEADER__MSG_TYPE__GET;
+    get_req->body = body;
+    body->msg_body_case = USP__BODY__MSG_BODY_REQUEST;
+    body->request = request;
+    request->req_type_case = USP__REQUEST__REQ_TYPE_GET;
+    request->get = get;
+    get->n_param_paths = NUM_ELEM(get_req_paths);
+    get->param_paths = get_req_paths;
+
+    get_req_len = usp__msg__get_packed_size(get_req);
+    USP_ASSERT(get_req_len <= sizeof(get_req_pbuf));
+    usp__msg__pack(get_req, get_req_pbuf);
+
+    PrepareCodecBenchmarks();
+}
+
+/*********************************************************************//**
+**
+** PrepareCodecBenchmarks
+**
+** Sets up the USP messages and USP record used by the protobuf serialization benchmarks
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PrepareCodecBenchmarks(void)
+{
+    int i;
+    int num_objects;
+    char path[MAX_DM_PATH];
+    char value[32];
+    Usp__Header *header;
+    Usp__Body *body;
+    Usp__Request *request;
+    Usp__Set *set;
+    Usp__Set__UpdateObject *obj;
+    Usp__Set__UpdateParamSetting *ps;
+    Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *oper_success;
+    Usp__SetResp__UpdatedInstanceResult *inst_result;
+    UspRecord__NoSessionContextRecord *nsc;
+    kv_vector_t args;
+
+    // Form a Set request updating the Value parameter of (up to SET_OBJECTS) instances of the table, and the Set response for it
+    num_objects = MIN(num_table_instances, SET_OBJECTS);
+    set_req.msg = USP_MALLOC(sizeof(Usp__Msg));
+    header = USP_MALLOC(sizeof(Usp__Header));
+    body = USP_MALLOC(sizeof(Usp__Body));
+    request = USP_MALLOC(sizeof(Usp__Request));
+    set = USP_MALLOC(sizeof(Usp__Set));
+    usp__msg__init(set_req.msg);
+    usp__header__init(header);
+    usp__body__init(body);
+    usp__request__init(request);
+    usp__set__init(set);
+
+    set_req.msg->header = header;
+    header->msg_id = "bench-set-req";
+    header->msg_type = USP__HEADER__MSG_TYPE__SET;
+    set_req.msg->body = body;
+    body->msg_body_case = USP__BODY__MSG_BODY_REQUEST;
+    body->request = request;
+    request->req_type_case = USP__REQUEST__REQ_TYPE_SET;
+    request->set = set;
+    set->allow_partial = true;
+    set->n_update_objs = num_objects;
+    set->update_objs = USP_MALLOC(num_objects * sizeof(Usp__Set__UpdateObject *));
+
+    set_resp.msg = CreateSetResp("bench-set-req");
+    for (i=0; i < num_objects; i++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "%s.Table.%d.", BENCH_ROOT, i+1);
+        USP_SNPRINTF(value, sizeof(value), "%d", i);
+
+        obj = USP_MALLOC(sizeof(Usp__Set__UpdateObject));
+        ps = USP_MALLOC(sizeof(Usp__Set__UpdateParamSetting));
+        usp__set__update_object__init(obj);
+        usp__set__update_param_setting__init(ps);
+        obj->obj_path = USP_STRDUP(path);
+        obj->n_param_settings = 1;
+        obj->param_settings = USP_MALLOC(sizeof(Usp__Set__UpdateParamSetting *));
+        obj->param_settings[0] = ps;
+        ps->param = "Value";
+        ps->value = USP_STRDUP(value);
+        ps->required = true;
+        set->update_objs[i] = obj;
+
+        oper_success = AddSetResp_OperSuccess(set_resp.msg->body->response->set_resp, path);
+        inst_result = AddOperSuccess_UpdatedInstRes(oper_success, path);
+        AddUpdatedInstRes_ParamsEntry(inst_result, "Value", value);
+    }
+    PackBenchMsg(&set_req);
+    PackBenchMsg(&set_resp);
+
+    // Form a Notify request containing an Event with arguments
+    KV_VECTOR_Init(&args);
+    for (i=0; i < EVENT_ARGS; i++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "Arg%d", i);
+        KV_VECTOR_Add(&args, path, hex_value);
+    }
+    notify_req.msg = MSG_HANDLER_CreateNotifyReq_Event(BENCH_ROOT ".Table.1.Changed!", &args, "bench-subscription", true);
+    KV_VECTOR_Destroy(&args);
+    PackBenchMsg(&notify_req);
+
+    // Form a USP record encapsulating the Get response, then pack it
+    record = USP_MALLOC(sizeof(UspRecord__Record));
+    nsc = USP_MALLOC(sizeof(UspRecord__NoSessionContextRecord));
+    usp_record__record__init(record);
+    usp_record__no_session_context_record__init(nsc);
+    record->version = "1.3";
+    record->to_id = "proto::controller-1";
+    record->from_id = "os::012345-bench";
+    record->payload_security = USP_RECORD__RECORD__PAYLOAD_SECURITY__PLAINTEXT;
+    record->record_type_case = USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT;
+    record->no_session_context = nsc;
+    nsc->payload.data = get_resp_pbuf;
+    nsc->payload.len = get_resp_len;
+
+    record_len = usp_record__record__get_packed_size(record);
+    record_pbuf = USP_MALLOC(record_len);
+    usp_record__record__pack(record, record_pbuf);
+}
+
+/*********************************************************************//**
+**
+** PackBenchMsg
+**
+** Packs the USP message used by a protobuf serialization benchmark, using protobuf-c
+**
+** \param   bm - pointer to USP message to pack
+**
+** \return  None
+**
+**************************************************************************/
+void PackBenchMsg(bench_msg_t *bm)
+{
+    bm->len = usp__msg__get_packed_size(bm->msg);
+    bm->pbuf = USP_MALLOC(bm->len);
+    usp__msg__pack(bm->msg, bm->pbuf);
+}
+
+/*********************************************************************//**
+**
+** VerifyProtoCodec
+**
+** Checks that the specialized protobuf serialization code (proto_codec.c) produces the same results as protobuf-c
+** for all of the messages used by the benchmarks
+**
+** \param   None
+**
+** \return  USP_ERR_OK if the results are identical
+**
+**************************************************************************/
+int VerifyProtoCodec(void)
+{
+    int err = USP_ERR_OK;
+    unsigned char *pbuf;
+    UspRecord__Record *rec;
+    size_t len;
+
+    err |= VerifyBenchMsg("Get request", get_req);
+    err |= VerifyBenchMsg("Get response", get_resp);
+    err |= VerifyBenchMsg("Set request", set_req.msg);
+    err |= VerifyBenchMsg("Set response", set_resp.msg);
+    err |= VerifyBenchMsg("Notify request", notify_req.msg);
+
+    // Check that the USP record packs identically
+    pbuf = USP_MALLOC(record_len);
+    len = PROTO_CODEC_PackRecord(record, pbuf);
+    if ((len != record_len) || (memcmp(pbuf, record_pbuf, len) != 0))
+    {
+        fprintf(stderr, "ERROR: Specialized pack of USP record differs from protobuf-c\n");
+        err = USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Check that the USP record unpacks identically (by packing the unpacked record using protobuf-c)
+    rec = PROTO_CODEC_UnpackRecord(pbuf_allocator, record_len, record_pbuf);
+    if ((rec == NULL) || (usp_record__record__get_packed_size(rec) != record_len) ||
+        (usp_record__record__pack(rec, pbuf) != record_len) || (memcmp(pbuf, record_pbuf, record_len) != 0))
+    {
+        fprintf(stderr, "ERROR: Specialized unpack of USP record differs from protobuf-c\n");
+        err = USP_ERR_INTERNAL_ERROR;
+    }
+    usp_record__record__free_unpacked(rec, pbuf_allocator);
+    USP_FREE(pbuf);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** VerifyBenchMsg
+**
+** Checks that the specialized protobuf serialization code (proto_codec.c) produces the same results as protobuf-c
+** for the specified USP message
+**
+** \param   name - name of the USP message (used in error messages)
+** \param   msg - pointer to USP message to check
+**
+** \return  USP_ERR_OK if the results are identical
+**
+**************************************************************************/
+int VerifyBenchMsg(char *name, Usp__Msg *msg)
+{
+    int err = USP_ERR_OK;
+    unsigned char *expected;
+    unsigned char *pbuf;
+    Usp__Msg *usp;
+    size_t len;
+
+    len = usp__msg__get_packed_size(msg);
+    expected = USP_MALLOC(len);
+    pbuf = USP_MALLOC(len);
+    usp__msg__pack(msg, expected);
+
+    // Check that the message packs identically
+    if ((PROTO_CODEC_GetMsgPackedSize(msg) != len) || (PROTO_CODEC_PackMsg(msg, pbuf) != len) || (memcmp(pbuf, expected, len) != 0))
+    {
+        fprintf(stderr, "ERROR: Specialized pack of %s differs from protobuf-c\n", name);
+        err = USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Check that the message unpacks identically (by packing the unpacked message using protobuf-c)
+    usp = PROTO_CODEC_UnpackMsg(pbuf_allocator, len, expected);
+    if ((usp == NULL) || (usp__msg__get_packed_size(usp) != len) ||
+        (usp__msg__pack(usp, pbuf) != len) || (memcmp(pbuf, expected, len) != 0))
+    {
+        fprintf(stderr, "ERROR: Specialized unpack of %s differs from protobuf-c\n", name);
+        err = USP_ERR_INTERNAL_ERROR;
+    }
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+
+    USP_FREE(expected);
+    USP_FREE(pbuf);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** VerifyGroupedSet
+**
+** Checks that setting a grouped vendor parameter outside of a transaction calls the group's set callback immediately,
+** with just that parameter
+**
+** \param   None
+**
+** \return  USP_ERR_OK if the set callback was called correctly
+**
+**************************************************************************/
+int VerifyGroupedSet(void)
+{
+    int err;
+
+    KV_VECTOR_Init(&grouped_sets);
+    num_grouped_set_calls = 0;
+
+    USP_ASSERT(DM_TRANS_IsWithinTransaction()==false);
+    err = USP_DM_SetParameterValue(BENCH_GROUPED_PARAM, "42");
+    if (err != USP_ERR_OK)
+    {
+        fprintf(stderr, "ERROR: Failed to set %s outside of a transaction (%s)\n", BENCH_GROUPED_PARAM, USP_ERR_GetMessage());
+        goto exit;
+    }
+
+    if ((num_grouped_set_calls != 1) || (grouped_sets.num_entries != 1) ||
+        (strcmp(grouped_sets.vector[0].key, BENCH_GROUPED_PARAM) != 0) || (strcmp(grouped_sets.vector[0].value, "42") != 0))
+    {
+        fprintf(stderr, "ERROR: Set of %s outside of a transaction did not call the group set callback with just that parameter\n", BENCH_GROUPED_PARAM);
+        err = USP_ERR_INTERNAL_ERROR;
+        goto exit;
+    }
+
+exit:
+    KV_VECTOR_Destroy(&grouped_sets);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** RunBenchmark
+**
+** Runs the specified benchmark, doubling the number of iterations until it runs for long enough to be timed accurately
+** Then prints the time taken per iteration
+**
+** \param   name - name of the benchmark
+** \param   fn - pointer to function implementing one iteration of the benchmark
+**
+** \return  None
+**
+**************************************************************************/
+void RunBenchmark(char *name, bench_fn_t fn)
+{
+    int i;
+    int iterations = 1;
+    long long start_time;
+    long long elapsed;
+
+    while (FOREVER)
+    {
+        start_time = TimeNs();
+        for (i=0; i < iterations; i++)
+        {
+            fn();
+        }
+        elapsed = TimeNs() - start_time;
+
+        if ((elapsed >= BENCH_MIN_TIME_NS) || (iterations >= BENCH_MAX_ITERATIONS))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    printf("%-48s %10d %14.1f\n", name, iterations, (double)elapsed / iterations);
+    fflush(stdout);
+}
+
+/*********************************************************************//**
+**
+** TimeNs
+**
+** Returns the current value of the monotonic clock
+**
+** \param   None
+**
+** \return  Number of nano-seconds
+**
+**************************************************************************/
+long long TimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+/*********************************************************************//**
+**
+** Bench_xxx
+**
+** Functions implementing one iteration of each benchmark
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void Bench_StrVector(void)
+{
+    int i;
+    str_vector_t sv;
+
+    STR_VECTOR_Init(&sv);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        STR_VECTOR_Add(&sv, vector_keys[i]);
+    }
+
+    STR_VECTOR_Find(&sv, vector_keys[NUM_VECTOR_ENTRIES-1]);
+    STR_VECTOR_Destroy(&sv);
+}
+
+void Bench_StrVectorDedup(void)
+{
+    int i;
+    str_vector_t sv;
+
+    STR_VECTOR_Init(&sv);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        STR_VECTOR_Add_IfNotExist(&sv, vector_keys[i]);
+    }
+    STR_VECTOR_Destroy(&sv);
+}
+
+void Bench_StrSetDedup(void)
+{
+    int i;
+    str_vector_t sv;
+    str_set_t ss;
+
+    STR_VECTOR_Init(&sv);
+    STR_SET_Init(&ss);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        STR_SET_AddIfNotExist(&ss, &sv, vector_keys[i]);
+    }
+    STR_SET_Destroy(&ss);
+    STR_VECTOR_Destroy(&sv);
+}
+
+void Bench_KvVector(void)
+{
+    int i;
+    kv_vector_t kvv;
+
+    KV_VECTOR_Init(&kvv);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        KV_VECTOR_Add(&kvv, vector_keys[i], "value");
+    }
+
+    KV_VECTOR_Get(&kvv, vector_keys[NUM_VECTOR_ENTRIES-1], NULL, 0);
+    KV_VECTOR_Destroy(&kvv);
+}
+
+void Bench_KvVectorReplace(void)
+{
+    int i;
+    kv_vector_t kvv;
+
+    KV_VECTOR_Init(&kvv);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        if (KV_VECTOR_Replace(&kvv, vector_keys[i], "value") == false)
+        {
+            KV_VECTOR_Add(&kvv, vector_keys[i], "value");
+        }
+    }
+    KV_VECTOR_Destroy(&kvv);
+}
+
+void Bench_KvVectorReplaceIndexed(void)
+{
+    int i;
+    kv_vector_t kvv;
+    str_set_t ss;
+
+    KV_VECTOR_Init(&kvv);
+    STR_SET_Init(&ss);
+    for (i=0; i < NUM_VECTOR_ENTRIES; i++)
+    {
+        if (KV_VECTOR_ReplaceIndexed(&kvv, &ss, vector_keys[i], "value") == false)
+        {
+            KV_VECTOR_Add(&kvv, vector_keys[i], "value");
+        }
+    }
+    STR_SET_Destroy(&ss);
+    KV_VECTOR_Destroy(&kvv);
+}
+
+void Bench_CalcHash(void)
+{
+    TEXT_UTILS_CalcHash(node_path);
+}
+
+void Bench_CalcHash64(void)
+{
+    TEXT_UTILS_CalcHash64(node_path);
+}
+
+void Bench_CalcWordHash64(void)
+{
+    TEXT_UTILS_CalcWordHash64(node_path);
+}
+
+void Bench_StringToBinary(void)
+{
+    unsigned char buf[HEX_VALUE_BYTES];
+    int bytes_written;
+
+    TEXT_UTILS_StringToBinary(hex_value, buf, sizeof(buf), &bytes_written);
+}
+
+void Bench_PercentEncode(void)
+{
+    char buf[MAX_DM_PATH];
+
+    TEXT_UTILS_PercentEncodeString(query_value, buf, sizeof(buf), '/');
+}
+
+void Bench_PercentDecode(void)
+{
+    char buf[MAX_DM_PATH];
+
+    USP_STRNCPY(buf, escaped_value, sizeof(buf));
+    TEXT_UTILS_PercentDecodeString(buf);
+}
+
+void Bench_PercentDecodeUnescaped(void)
+{
+    char buf[MAX_DM_PATH];
+
+    USP_STRNCPY(buf, query_value, sizeof(buf));
+    TEXT_UTILS_PercentDecodeString(buf);
+}
+
+void Bench_PathToSchemaForm(void)
+{
+    char buf[MAX_DM_PATH];
+
+    TEXT_UTILS_PathToSchemaForm(table_param_path, buf, sizeof(buf));
+}
+
+void Bench_GetNodeFromPath(void)
+{
+    dm_instances_t inst;
+    bool is_qualified_instance;
+
+    DM_PRIV_GetNodeFromPath(node_path, &inst, &is_qualified_instance);
+}
+
+void Bench_InstExists(void)
+{
+    DM_INST_VECTOR_IsExist(&table_inst);
+}
+
+void Bench_GetInstances(void)
+{
+    int_vector_t iv;
+    dm_instances_t inst;
+
+    INT_VECTOR_Init(&iv);
+    memset(&inst, 0, sizeof(inst));
+    DM_INST_VECTOR_GetInstances(table_node, &inst, &iv);
+    INT_VECTOR_Destroy(&iv);
+}
+
+void Bench_ResolveWildcard(void)
+{
+    ResolveAndDestroy(BENCH_ROOT ".Table.*.Value");
+}
+
+void Bench_ResolveSearch(void)
+{
+    ResolveAndDestroy(search_path);
+}
+
+void Bench_ResolveUniqueKey(void)
+{
+    ResolveAndDestroy(unique_key_path);
+}
+
+void Bench_ResolvePartialPath(void)
+{
+    ResolveAndDestroy(BENCH_ROOT ".Scale.");
+}
+
+void Bench_GetWildcard(void)
+{
+    Usp__Msg *resp;
+
+    resp = CreateGetResp("bench-get");
+    GetSinglePath(resp, BENCH_ROOT ".Table.*.", NULL);
+    usp__msg__free_unpacked(resp, pbuf_allocator);
+}
+
+void Bench_TransJournal(void)
+{
+    int i;
+    int j;
+    dm_trans_vector_t trans;
+    dm_instances_t inst;
+    dm_val_union_t val_union;
+
+    // Journal the operations of a large AddRequest (as the object instances do not exist, the transaction is aborted)
+    memset(&val_union, 0, sizeof(val_union));
+    memcpy(&inst, &table_inst, sizeof(inst));
+    DM_TRANS_Start(&trans);
+    for (i=0; i < TRANS_INSTANCES; i++)
+    {
+        inst.instances[0] = num_table_instances + 1 + i;
+        DM_TRANS_Add(kDMOp_Add, table_path, NULL, NULL, table_node, &inst);
+        for (j=0; j < TRANS_PARAMS_PER_INSTANCE; j++)
+        {
+            DM_TRANS_Add(kDMOp_Set, table_param_path, "", &val_union, table_param_node, &inst);
+        }
+    }
+    USP_ASSERT(trans.num_entries == TRANS_INSTANCES);
+    DM_TRANS_Abort();
+}
+
+void Bench_AddDeleteDbTable(void)
+{
+    int i;
+    int instance;
+    char path[MAX_DM_PATH];
+    str_vector_t paths;
+    dm_trans_vector_t trans;
+
+    // Add all instances in a single transaction, as an AddRequest with allow_partial=false would
+    STR_VECTOR_Init(&paths);
+    DM_TRANS_Start(&trans);
+    for (i=0; i < DB_TABLE_INSTANCES; i++)
+    {
+        DATA_MODEL_AddInstance(BENCH_ROOT ".DbTable", &instance, 0);
+        USP_SNPRINTF(path, sizeof(path), "%s.DbTable.%d", BENCH_ROOT, instance);
+        STR_VECTOR_Add(&paths, path);
+    }
+    DM_TRANS_Commit();
+
+    // Then delete the whole table in a single transaction
+    DM_TRANS_Start(&trans);
+    DATA_MODEL_DeleteInstances(&paths, 0);
+    DM_TRANS_Commit();
+    STR_VECTOR_Destroy(&paths);
+}
+
+void Bench_PackGetReq(void)
+{
+    usp__msg__pack(get_req, get_req_pbuf);
+}
+
+void Bench_UnpackGetReq(void)
+{
+    Usp__Msg *usp;
+
+    usp = usp__msg__unpack(pbuf_allocator, get_req_len, get_req_pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackGetResp(void)
+{
+    usp__msg__pack(get_resp, get_resp_pbuf);
+}
+
+void Bench_UnpackGetResp(void)
+{
+    Usp__Msg *usp;
+
+    usp = usp__msg__unpack(pbuf_allocator, get_resp_len, get_resp_pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackGetReqSpecialized(void)
+{
+    PROTO_CODEC_PackMsg(get_req, get_req_pbuf);
+}
+
+void Bench_UnpackGetReqSpecialized(void)
+{
+    Usp__Msg *usp;
+
+    usp = PROTO_CODEC_UnpackMsg(pbuf_allocator, get_req_len, get_req_pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackGetRespSpecialized(void)
+{
+    PROTO_CODEC_PackMsg(get_resp, get_resp_pbuf);
+}
+
+void Bench_UnpackGetRespSpecialized(void)
+{
+    Usp__Msg *usp;
+
+    usp = PROTO_CODEC_UnpackMsg(pbuf_allocator, get_resp_len, get_resp_pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackSetReq(void)
+{
+    usp__msg__pack(set_req.msg, set_req.pbuf);
+}
+
+void Bench_PackSetReqSpecialized(void)
+{
+    PROTO_CODEC_PackMsg(set_req.msg, set_req.pbuf);
+}
+
+void Bench_UnpackSetReq(void)
+{
+    Usp__Msg *usp;
+
+    usp = usp__msg__unpack(pbuf_allocator, set_req.len, set_req.pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_UnpackSetReqSpecialized(void)
+{
+    Usp__Msg *usp;
+
+    usp = PROTO_CODEC_UnpackMsg(pbuf_allocator, set_req.len, set_req.pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackSetResp(void)
+{
+    usp__msg__pack(set_resp.msg, set_resp.pbuf);
+}
+
+void Bench_PackSetRespSpecialized(void)
+{
+    PROTO_CODEC_PackMsg(set_resp.msg, set_resp.pbuf);
+}
+
+void Bench_PackNotifyReq(void)
+{
+    usp__msg__pack(notify_req.msg, notify_req.pbuf);
+}
+
+void Bench_PackNotifyReqSpecialized(void)
+{
+    PROTO_CODEC_PackMsg(notify_req.msg, notify_req.pbuf);
+}
+
+void Bench_UnpackNotifyReq(void)
+{
+    Usp__Msg *usp;
+
+    usp = usp__msg__unpack(pbuf_allocator, notify_req.len, notify_req.pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_UnpackNotifyReqSpecialized(void)
+{
+    Usp__Msg *usp;
+
+    usp = PROTO_CODEC_UnpackMsg(pbuf_allocator, notify_req.len, notify_req.pbuf);
+    usp__msg__free_unpacked(usp, pbuf_allocator);
+}
+
+void Bench_PackRecord(void)
+{
+    usp_record__record__pack(record, record_pbuf);
+}
+
+void Bench_PackRecordSpecialized(void)
+{
+    PROTO_CODEC_PackRecord(record, record_pbuf);
+}
+
+void Bench_UnpackRecord(void)
+{
+    UspRecord__Record *rec;
+
+    // NOTE: The per-message arena allocator is used, as the payload references the packed record
+    USP_MEM_MsgArenaBegin();
+    rec = (UspRecord__Record *) protobuf_c_message_unpack_in_place(&usp_record__record__descriptor, pbuf_msg_allocator, record_len, record_pbuf);
+    usp_record__record__free_unpacked(rec, pbuf_msg_allocator);
+    USP_MEM_MsgArenaEnd();
+}
+
+void Bench_UnpackRecordSpecialized(void)
+{
+    UspRecord__Record *rec;
+
+    USP_MEM_MsgArenaBegin();
+    rec = PROTO_CODEC_UnpackRecordInPlace(pbuf_msg_allocator, record_len, record_pbuf);
+    usp_record__record__free_unpacked(rec, pbuf_msg_allocator);
+    USP_MEM_MsgArenaEnd();
+}
+
+/*********************************************************************//**
+**
+** ResolveAndDestroy
+**
+** Resolves the specified path expression into a vector of paths, then frees the vector
+**
+** \param   path - path expression to resolve
+**
+** \return  None
+**
+**************************************************************************/
+void ResolveAndDestroy(char *path)
+{
+    str_vector_t sv;
+
+    STR_VECTOR_Init(&sv);
+    PATH_RESOLVER_ResolvePath(path, &sv, kResolveOp_Get, NULL, INTERNAL_ROLE, 0);
+    STR_VECTOR_Destroy(&sv);
+}
+
+/*********************************************************************//**
+**
+** MAIN_Stop
+**
+** Replaces the function in main.c, which is called when the data model thread exits
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MAIN_Stop(void)
+{
+    DM_EXEC_Destroy();
+}
+
+/*********************************************************************//**
+**
+** VENDOR_Init
+**
+** Registers the synthetic schema which the benchmarks are run against
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int VENDOR_Init(void)
+{
+    int i, j;
+    int err = USP_ERR_OK;
+    char path[MAX_DM_PATH];
+    char *unique_keys[] = { "Name" };
+
+    // Device.X_BENCH.Scale.Group{n}.Param{n}
+    for (i=0; i < num_groups; i++)
+    {
+        for (j=0; j < PARAMS_PER_GROUP; j++)
+        {
+            USP_SNPRINTF(path, sizeof(path), "%s.Scale.Group%d.Param%d", BENCH_ROOT, i, j);
+            err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_BenchScaleParam, DM_STRING);
+        }
+    }
+
+    // Device.X_BENCH.Table.{i}
+    err |= USP_REGISTER_Object(BENCH_TABLE_ROOT, USP_HOOK_DenyAddInstance, NULL, NULL,
+                                                 USP_HOOK_DenyDeleteInstance, NULL, NULL);
+    err |= USP_REGISTER_VendorParam_ReadOnly(BENCH_TABLE_ROOT ".Name", Get_BenchTableName, DM_STRING);
+    err |= USP_REGISTER_VendorParam_ReadOnly(BENCH_TABLE_ROOT ".Value", Get_BenchTableValue, DM_UINT);
+    err |= USP_REGISTER_VendorParam_ReadOnly(BENCH_TABLE_ROOT ".Enable", Get_BenchTableEnable, DM_BOOL);
+    err |= USP_REGISTER_Object_UniqueKey(BENCH_TABLE_ROOT, unique_keys, NUM_ELEM(unique_keys));
+
+    // Device.X_BENCH.DbTable.{i}
+    err |= USP_REGISTER_Object(BENCH_DB_TABLE_ROOT, NULL, NULL, NULL, NULL, NULL, NULL);
+    for (j=0; j < DB_TABLE_PARAMS; j++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "%s.Param%d", BENCH_DB_TABLE_ROOT, j);
+        err |= USP_REGISTER_DBParam_ReadWrite(path, "default", NULL, NULL, DM_STRING);
+    }
+
+    // Device.X_BENCH.GroupedParam
+    err |= USP_REGISTER_GroupedVendorParam_ReadWrite(BENCH_GROUP_ID, BENCH_GROUPED_PARAM, DM_STRING);
+    err |= USP_REGISTER_GroupVendorHooks(BENCH_GROUP_ID, Get_BenchGroup, Set_BenchGroup);
+
+    // Exit if any errors occurred
+    if (err != USP_ERR_OK)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** VENDOR_Start
+**
+** Seeds the instances of the synthetic table
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int VENDOR_Start(void)
+{
+    int i;
+    int err;
+    char path[MAX_DM_PATH];
+
+    for (i=1; i <= num_table_instances; i++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "%s.Table.%d", BENCH_ROOT, i);
+        err = USP_DM_InformInstance(path);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** VENDOR_Stop
+**
+** Called when stopping the data model
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int VENDOR_Stop(void)
+{
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** VENDOR_GetFactoryResetParams
+**
+** Returns no factory reset parameters, as the benchmarks do not use any MTPs or controllers
+**
+** \param   kvv - pointer to key value vector structure in which to return the factory reset parameter settings
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int VENDOR_GetFactoryResetParams(kv_vector_t *kvv)
+{
+    USP_ARG_Init(kvv);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_BenchXXX
+**
+** Get callbacks for the parameters in the synthetic schema
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_BenchScaleParam(dm_req_t *req, char *buf, int len)
+{
+    USP_STRNCPY(buf, "value", len);
+    return USP_ERR_OK;
+}
+
+int Get_BenchTableName(dm_req_t *req, char *buf, int len)
+{
+    USP_SNPRINTF(buf, len, "Entry%d", inst1);
+    return USP_ERR_OK;
+}
+
+int Get_BenchTableValue(dm_req_t *req, char *buf, int len)
+{
+    val_uint = inst1;
+    return USP_ERR_OK;
+}
+
+int Get_BenchTableEnable(dm_req_t *req, char *buf, int len)
+{
+    val_bool = ((inst1 % 2) == 1);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_BenchGroup
+**
+** Get callback for the group of vendor parameters containing Device.X_BENCH.GroupedParam
+**
+** \param   group_id - group that all of the parameters belong to
+** \param   params - key-value vector containing the paths of the parameters to get, and in which to return their values
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_BenchGroup(int group_id, kv_vector_t *params)
+{
+    int i;
+
+    for (i=0; i < params->num_entries; i++)
+    {
+        USP_FREE(params->vector[i].value);
+        params->vector[i].value = USP_STRDUP("value");
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Set_BenchGroup
+**
+** Set callback for the group of vendor parameters containing Device.X_BENCH.GroupedParam
+** Records the parameters passed to it, so that VerifyGroupedSet() can check them
+**
+** \param   group_id - group that all of the parameters belong to
+** \param   params - key-value vector containing the paths of the parameters to set, and their new values
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Set_BenchGroup(int group_id, kv_vector_t *params)
+{
+    int i;
+
+    num_grouped_set_calls++;
+    KV_VECTOR_Destroy(&grouped_sets);
+    for (i=0; i < params->num_entries; i++)
+    {
+        KV_VECTOR_Add(&grouped_sets, params->vector[i].key, params->vector[i].value);
+    }
+
+    return USP_ERR_OK;
+}
@@ -0,0 +1,1720 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file obuspa_load.c
+ *
+ * End-to-end load generator, measuring the USP message throughput and latency of a running USP Agent
+ * This program acts as a STOMP broker stub on the loopback interface, which the agent connects to. Over this connection,
+ * it plays the role of a number of concurrent controllers, each sending a configurable mix of USP messages to the agent.
+ * At the end of the run, it reports the throughput, the p50/p99 latency of each message type, and the agent's memory
+ * high-water mark (read from Device.LocalAgent.X_VENDOR_Stats, which is implemented using USP_MEM)
+ *
+ * The agent must be configured with a controller (with a STOMP MTP) for each of the load generator's controllers.
+ * A factory reset file containing this configuration may be written using the '-w' option. Example:
+ *    obuspa_load -w load_reset.txt -c 4
+ *    obuspa -p -v 1 -f /tmp/load.db -r load_reset.txt &
+ *    obuspa_load -c 4 -n 10000 -m get=70,set=20,add=10
+ *
+ * Message types:
+ *   get    - Get of all parameters of the controller's own Device.LocalAgent.Controller.{i} object
+ *   set    - Set of the controller's Device.LocalAgent.Controller.{i}.ControllerCode
+ *   add    - Add of a Device.LocalAgent.Subscription.{i} instance
+ *            Each created instance is immediately deleted by the controller (these are reported as delete messages)
+ *   notify - Set of the controller's Device.LocalAgent.Controller.{i}.ProvisioningCode. The latency is measured from
+ *            sending the Set to receiving the ValueChange notification for the new value (and the Set response)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "usp-msg.pb-c.h"
+#include "usp-record.pb-c.h"
+
+//------------------------------------------------------------------------------
+// Default values of command line options
+#define DEFAULT_PORT                61613
+#define DEFAULT_NUM_CONTROLLERS     4
+#define DEFAULT_NUM_MESSAGES        1000
+#define DEFAULT_OUTSTANDING         1
+#define DEFAULT_MIX                 "get=100"
+
+// Maximum number of concurrent controllers, and messages outstanding per controller
+#define MAX_CONTROLLERS             64
+#define MAX_OUTSTANDING             32
+
+// Time (in milliseconds) to wait for the agent to connect, and for any response, before giving up
+#define CONNECT_TIMEOUT_MS          (60*1000)
+#define RESPONSE_TIMEOUT_MS         (10*1000)
+
+// Prefix of the endpoint ID of each controller. The controller number is appended to it.
+#define CONTROLLER_ENDPOINT_PREFIX  "self::obuspa-load-"
+
+// STOMP destination which the agent subscribes to. Also used as the prefix of each controller's destination.
+#define AGENT_DESTINATION           "obuspa-load-agent"
+#define CONTROLLER_DESTINATION      "obuspa-load-controller-"
+
+// Message ID used for the Get of the agent's memory statistics
+#define MEM_STATS_MSG_ID            "mem-stats"
+#define MEM_STATS_PATH              "Device.LocalAgent.X_VENDOR_Stats."
+
+//------------------------------------------------------------------------------
+// Types of messages which may be sent by each controller
+typedef enum
+{
+    kLoadMsg_Get,
+    kLoadMsg_Set,
+    kLoadMsg_Add,
+    kLoadMsg_Delete,        // Not selectable in the mix. Sent after each successful Add, to delete the created instance
+    kLoadMsg_Notify,
+
+    kLoadMsg_Max
+} load_msg_t;
+
+static char *load_msg_names[kLoadMsg_Max] =
+{
+    "get",      // kLoadMsg_Get
+    "set",      // kLoadMsg_Set
+    "add",      // kLoadMsg_Add
+    "delete",   // kLoadMsg_Delete
+    "notify",   // kLoadMsg_Notify
+};
+
+//------------------------------------------------------------------------------
+// Structure representing a message sent by a controller, that has not been completed yet
+typedef struct
+{
+    bool in_use;                // Set if this slot contains an outstanding message
+    load_msg_t type;            // Type of message
+    int seq;                    // Sequence number of the message (unique within the controller)
+    long long start_time;       // Time (in nanoseconds) at which the message was sent
+    bool awaiting_resp;         // Set if the response to the message has not been received yet
+    bool awaiting_notify;       // Set if the ValueChange notification caused by the message has not been received yet
+} pending_msg_t;
+
+// Structure representing each controller
+typedef struct
+{
+    int num_sent;                               // Number of messages (excluding deletes) sent by this controller
+    int next_seq;                               // Sequence number to use for the next message sent by this controller
+    int num_outstanding;                        // Number of outstanding messages in pending[]
+    pending_msg_t pending[MAX_OUTSTANDING];     // Messages that have been sent and not completed yet
+    char **delete_paths;                        // Paths of instances created by this controller, which need deleting
+    int num_delete_paths;
+    unsigned rand_state;                        // State of the random number generator used to select the message type
+} controller_t;
+
+// Latencies (in nanoseconds) collected for each type of message
+typedef struct
+{
+    long long *latencies;
+    int num_latencies;
+    int max_latencies;
+} latency_stats_t;
+
+//------------------------------------------------------------------------------
+// Command line options
+static int port = DEFAULT_PORT;
+static int num_controllers = DEFAULT_NUM_CONTROLLERS;
+static int num_messages = DEFAULT_NUM_MESSAGES;
+static int max_outstanding = DEFAULT_OUTSTANDING;
+static char *agent_endpoint = NULL;             // Endpoint ID of the agent. If not specified, taken from the STOMP CONNECT frame
+
+// Weight of each type of message in the message mix. The weights do not need to total 100.
+static int mix_weights[kLoadMsg_Max];
+static int mix_total_weight = 0;
+
+static controller_t controllers[MAX_CONTROLLERS];
+static latency_stats_t latency_stats[kLoadMsg_Max];
+static int num_errors = 0;                      // Number of messages which received an error response
+static int num_unexpected = 0;                  // Number of USP messages received which did not correlate with any sent message
+
+// STOMP connection with the agent
+static int agent_sock = -1;
+static unsigned char *rx_buf = NULL;
+static int rx_buf_len = 0;                      // Number of bytes of received data in rx_buf[]
+static int rx_buf_size = 0;                     // Size of rx_buf[]
+static int tx_message_id = 0;                   // Used to generate the message-id header of MESSAGE frames sent to the agent
+
+//------------------------------------------------------------------------------
+// Forward declarations
+void Usage(void);
+int ParseMix(char *mix);
+int WriteFactoryResetFile(char *filename);
+int AcceptAgent(void);
+int RunLoad(void);
+void FillController(int c);
+void SendNextMessage(int c);
+void SendUspMsg(int c, char *msg_id, Usp__Header__MsgType msg_type, Usp__Request *req);
+void SendStompFrame(char *hdrs, unsigned char *body, int body_len);
+void HandleUspRecord(unsigned char *buf, int len);
+void HandleResponse(Usp__Msg *msg);
+void HandleNotify(int c, Usp__Notify *notify);
+void CompletePendingMsg(int c, pending_msg_t *pm);
+pending_msg_t *FindPendingMsg(int c, int seq);
+bool IsErrorResponse(Usp__Msg *msg);
+void PrintMemStats(Usp__Msg *msg, char *prefix);
+int RequestMemStats(char *prefix);
+int ReadStompFrame(int timeout_ms, char **command, char **hdrs, unsigned char **body, int *body_len);
+char *GetStompHeader(char *hdrs, char *name, char *buf, int len);
+void AddLatency(load_msg_t type, long long latency);
+void PrintReport(long long elapsed);
+int CompareLatency(const void *entry1, const void *entry2);
+long long GetTimeNs(void);
+int ControllerFromEndpoint(char *endpoint_id);
+void *LoadMalloc(int size);
+void *LoadRealloc(void *ptr, int size);
+
+/*********************************************************************//**
+**
+** main
+**
+** Main function of the load generator
+**
+** \param   argc - Number of command line arguments
+** \param   argv - Array of pointers to command line argument strings
+**
+** \return  0 if the load test completed successfully, otherwise 1
+**
+**************************************************************************/
+int main(int argc, char *argv[])
+{
+    char *reset_file = NULL;
+    char *mix = DEFAULT_MIX;
+    int opt;
+    int err;
+
+    while ((opt = getopt(argc, argv, "w:p:a:c:n:o:m:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'w':
+                reset_file = optarg;
+                break;
+
+            case 'p':
+                port = atoi(optarg);
+                break;
+
+            case 'a':
+                agent_endpoint = optarg;
+                break;
+
+            case 'c':
+                num_controllers = atoi(optarg);
+                break;
+
+            case 'n':
+                num_messages = atoi(optarg);
+                break;
+
+            case 'o':
+                max_outstanding = atoi(optarg);
+                break;
+
+            case 'm':
+                mix = optarg;
+                break;
+
+            default:
+                Usage();
+                return 1;
+        }
+    }
+
+    // Exit if any of the options are out of range
+    if ((num_controllers < 1) || (num_controllers > MAX_CONTROLLERS) ||
+        (max_outstanding < 1) || (max_outstanding > MAX_OUTSTANDING) ||
+        (num_messages < 1) || (port <= 0) || (port > 65535))
+    {
+        Usage();
+        return 1;
+    }
+
+    // Exit if only writing the factory reset file
+    if (reset_file != NULL)
+    {
+        err = WriteFactoryResetFile(reset_file);
+        return (err == 0) ? 0 : 1;
+    }
+
+    // Exit if the message mix is invalid
+    err = ParseMix(mix);
+    if (err != 0)
+    {
+        return 1;
+    }
+
+    // Exit if the agent did not connect
+    err = AcceptAgent();
+    if (err != 0)
+    {
+        return 1;
+    }
+
+    err = RunLoad();
+    close(agent_sock);
+
+    return (err == 0) ? 0 : 1;
+}
+
+/*********************************************************************//**
+**
+** Usage
+**
+** Prints the command line options of this program
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void Usage(void)
+{
+    printf("Usage: obuspa_load [options]\n");
+    printf("  -w file   Write a factory reset file configuring the agent for the load test, then exit\n");
+    printf("  -p port   Port to listen on for the agent's STOMP connection (default %d)\n", DEFAULT_PORT);
+    printf("  -a id     Endpoint ID of the agent (default: taken from the agent's STOMP CONNECT frame)\n");
+    printf("  -c num    Number of concurrent controllers, 1-%d (default %d)\n", MAX_CONTROLLERS, DEFAULT_NUM_CONTROLLERS);
+    printf("  -n num    Number of messages sent by each controller (default %d)\n", DEFAULT_NUM_MESSAGES);
+    printf("  -o num    Number of messages outstanding per controller, 1-%d (default %d)\n", MAX_OUTSTANDING, DEFAULT_OUTSTANDING);
+    printf("  -m mix    Weighted message mix of get, set, add and notify (default '%s'). Example: get=70,set=20,add=10\n", DEFAULT_MIX);
+}
+
+/*********************************************************************//**
+**
+** ParseMix
+**
+** Parses the message mix specified on the command line (eg 'get=70,set=20,add=10') into mix_weights[]
+**
+** \param   mix - string containing the message mix
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int ParseMix(char *mix)
+{
+    char buf[256];
+    char *saveptr = NULL;
+    char *entry;
+    char *equals;
+    int weight;
+    int i;
+
+    memset(mix_weights, 0, sizeof(mix_weights));
+    mix_total_weight = 0;
+
+    snprintf(buf, sizeof(buf), "%s", mix);
+    entry = strtok_r(buf, ",", &saveptr);
+    while (entry != NULL)
+    {
+        // Determine the weight of this message type (defaulting to 1, if not specified)
+        weight = 1;
+        equals = strchr(entry, '=');
+        if (equals != NULL)
+        {
+            *equals = '\0';
+            weight = atoi(&equals[1]);
+        }
+
+        // Find the message type (deletes are not selectable, as they are sent automatically after each add)
+        for (i=0; i < kLoadMsg_Max; i++)
+        {
+            if ((i != kLoadMsg_Delete) && (strcmp(entry, load_msg_names[i])==0))
+            {
+                break;
+            }
+        }
+
+        // Exit if the message type or weight is invalid
+        if ((i == kLoadMsg_Max) || (weight < 0))
+        {
+            fprintf(stderr, "Invalid message mix entry '%s'\n", entry);
+            return -1;
+        }
+
+        mix_weights[i] += weight;
+        mix_total_weight += weight;
+        entry = strtok_r(NULL, ",", &saveptr);
+    }
+
+    // Exit if no messages would be sent
+    if (mix_total_weight == 0)
+    {
+        fprintf(stderr, "Message mix '%s' does not select any messages\n", mix);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** WriteFactoryResetFile
+**
+** Writes a factory reset file configuring the agent to connect to this program, with a controller (and a
+** ValueChange subscription on the controller's ProvisioningCode, used by notify messages) for each of this program's controllers
+**
+** \param   filename - name of the factory reset file to write
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int WriteFactoryResetFile(char *filename)
+{
+    FILE *fp;
+    int c;
+
+    // Exit if unable to create the file
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to create %s (%s)\n", filename, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "#\n# Factory reset file for the obuspa_load load generator (%d controllers, STOMP broker stub on port %d)\n#\n", num_controllers, port);
+    fprintf(fp, "Device.LocalAgent.MTP.1.Alias \"cpe-1\"\n");
+    fprintf(fp, "Device.LocalAgent.MTP.1.Enable \"true\"\n");
+    fprintf(fp, "Device.LocalAgent.MTP.1.Protocol \"STOMP\"\n");
+    fprintf(fp, "Device.LocalAgent.MTP.1.STOMP.Reference \"Device.STOMP.Connection.1\"\n");
+    fprintf(fp, "Device.LocalAgent.MTP.1.STOMP.Destination \"%s\"\n", AGENT_DESTINATION);
+    fprintf(fp, "Device.STOMP.Connection.1.Alias \"cpe-1\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.Enable \"true\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.Host \"127.0.0.1\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.Port \"%d\"\n", port);
+    fprintf(fp, "Device.STOMP.Connection.1.Username \"\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.Password \"\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.X_ARRIS-COM_EnableEncryption \"false\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.VirtualHost \"/\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.EnableHeartbeats \"false\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.ServerRetryInitialInterval \"1\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.ServerRetryIntervalMultiplier \"1000\"\n");
+    fprintf(fp, "Device.STOMP.Connection.1.ServerRetryMaxInterval \"1\"\n");
+
+    for (c=1; c <= num_controllers; c++)
+    {
+        fprintf(fp, "Device.LocalAgent.Controller.%d.EndpointID \"%s%d\"\n", c, CONTROLLER_ENDPOINT_PREFIX, c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.Alias \"load-%d\"\n", c, c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.Enable \"true\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.AssignedRole \"Device.LocalAgent.ControllerTrust.Role.1\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.PeriodicNotifInterval \"86400\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.PeriodicNotifTime \"0001-01-01T00:00:00Z\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.USPRetryMinimumWaitInterval \"5\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.USPRetryIntervalMultiplier \"2000\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.ControllerCode \"\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.ProvisioningCode \"\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.MTP.1.Alias \"cpe-1\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.MTP.1.Enable \"true\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.MTP.1.Protocol \"STOMP\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.MTP.1.STOMP.Reference \"Device.STOMP.Connection.1\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Controller.%d.MTP.1.STOMP.Destination \"%s%d\"\n", c, CONTROLLER_DESTINATION, c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.Enable \"true\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.ID \"load-%d\"\n", c, c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.Recipient \"Device.LocalAgent.Controller.%d\"\n", c, c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.NotifType \"ValueChange\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.ReferenceList \"Device.LocalAgent.Controller.%d.ProvisioningCode\"\n", c, c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.Persistent \"true\"\n", c);
+        fprintf(fp, "Device.LocalAgent.Subscription.%d.NotifRetry \"false\"\n", c);
+    }
+
+    fprintf(fp, "Internal.Reboot.Cause \"LocalFactoryReset\"\n");
+    fclose(fp);
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** AcceptAgent
+**
+** Waits for the agent to connect to the STOMP broker stub, then performs the STOMP handshake with it
+**
+** \param   None
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int AcceptAgent(void)
+{
+    int listen_sock;
+    struct sockaddr_in addr;
+    struct pollfd pfd;
+    int enable = 1;
+    char *command;
+    char *hdrs;
+    unsigned char *body;
+    int body_len;
+    char endpoint_id[256];
+    static char connected_frame[] = "CONNECTED\nversion:1.2\nheart-beat:0,0\nsubscribe-dest:" AGENT_DESTINATION "\n\n";
+    int err;
+
+    // Exit if unable to listen on the loopback interface
+    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listen_sock, 1) != 0))
+    {
+        fprintf(stderr, "Unable to listen on port %d (%s)\n", port, strerror(errno));
+        close(listen_sock);
+        return -1;
+    }
+
+    // Exit if the agent did not connect in time
+    printf("Waiting for agent to connect on port %d\n", port);
+    pfd.fd = listen_sock;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) != 1)
+    {
+        fprintf(stderr, "Timed out waiting for agent to connect\n");
+        close(listen_sock);
+        return -1;
+    }
+
+    agent_sock = accept(listen_sock, NULL, NULL);
+    close(listen_sock);
+    if (agent_sock < 0)
+    {
+        fprintf(stderr, "Unable to accept agent connection (%s)\n", strerror(errno));
+        return -1;
+    }
+    setsockopt(agent_sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    // Exit if the agent did not send a CONNECT frame
+    err = ReadStompFrame(RESPONSE_TIMEOUT_MS, &command, &hdrs, &body, &body_len);
+    if ((err != 0) || ((strcmp(command, "CONNECT") != 0) && (strcmp(command, "STOMP") != 0)))
+    {
+        fprintf(stderr, "Expected STOMP CONNECT frame from agent\n");
+        return -1;
+    }
+
+    // Determine the agent's endpoint ID, if not specified on the command line
+    if (agent_endpoint == NULL)
+    {
+        if (GetStompHeader(hdrs, "endpoint-id", endpoint_id, sizeof(endpoint_id)) == NULL)
+        {
+            fprintf(stderr, "Agent did not send its endpoint ID. Use the -a option to specify it\n");
+            return -1;
+        }
+        agent_endpoint = strdup(endpoint_id);
+    }
+
+    SendStompFrame(connected_frame, NULL, 0);
+
+    // Exit if the agent did not subscribe to its destination
+    err = ReadStompFrame(RESPONSE_TIMEOUT_MS, &command, &hdrs, &body, &body_len);
+    if ((err != 0) || (strcmp(command, "SUBSCRIBE") != 0))
+    {
+        fprintf(stderr, "Expected STOMP SUBSCRIBE frame from agent\n");
+        return -1;
+    }
+
+    printf("Agent %s connected\n", agent_endpoint);
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** RunLoad
+**
+** Sends the configured number of messages from each controller to the agent, handling the responses
+** and notifications, then reports the results
+**
+** \param   None
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int RunLoad(void)
+{
+    int c;
+    int err;
+    long long start_time;
+    long long elapsed;
+    bool is_complete;
+    char *command;
+    char *hdrs;
+    unsigned char *body;
+    int body_len;
+
+    // Allocate space for the latency of every message (deletes are bounded by the number of adds)
+    for (c=0; c < kLoadMsg_Max; c++)
+    {
+        latency_stats[c].max_latencies = num_controllers * num_messages;
+        latency_stats[c].latencies = LoadMalloc(latency_stats[c].max_latencies * sizeof(long long));
+        latency_stats[c].num_latencies = 0;
+    }
+
+    // Exit if unable to read the agent's memory usage before the load is applied
+    err = RequestMemStats("Before");
+    if (err != 0)
+    {
+        return -1;
+    }
+
+    memset(controllers, 0, sizeof(controllers));
+    for (c=0; c < num_controllers; c++)
+    {
+        controllers[c].rand_state = c + 1;
+    }
+
+    printf("Sending %d messages from each of %d controllers (%d outstanding per controller)\n", num_messages, num_controllers, max_outstanding);
+    start_time = GetTimeNs();
+    for (c=0; c < num_controllers; c++)
+    {
+        FillController(c);
+    }
+
+    while (true)
+    {
+        // Exit the loop if all controllers have completed all of their messages
+        is_complete = true;
+        for (c=0; c < num_controllers; c++)
+        {
+            if ((controllers[c].num_outstanding != 0) || (controllers[c].num_sent < num_messages) || (controllers[c].num_delete_paths != 0))
+            {
+                is_complete = false;
+                break;
+            }
+        }
+
+        if (is_complete)
+        {
+            break;
+        }
+
+        // Exit if the agent stopped responding
+        err = ReadStompFrame(RESPONSE_TIMEOUT_MS, &command, &hdrs, &body, &body_len);
+        if (err != 0)
+        {
+            fprintf(stderr, "Timed out waiting for responses from agent\n");
+            return -1;
+        }
+
+        if (strcmp(command, "SEND") == 0)
+        {
+            HandleUspRecord(body, body_len);
+        }
+    }
+    elapsed = GetTimeNs() - start_time;
+
+    PrintReport(elapsed);
+
+    // Exit if unable to read the agent's memory usage after the load was applied
+    err = RequestMemStats("After");
+    if (err != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** FillController
+**
+** Sends messages from the specified controller until it has the maximum number of messages outstanding
+**
+** \param   c - index of the controller
+**
+** \return  None
+**
+**************************************************************************/
+void FillController(int c)
+{
+    controller_t *ctrl = &controllers[c];
+
+    while ((ctrl->num_outstanding < max_outstanding) && ((ctrl->num_sent < num_messages) || (ctrl->num_delete_paths > 0)))
+    {
+        SendNextMessage(c);
+    }
+}
+
+/*********************************************************************//**
+**
+** SendNextMessage
+**
+** Sends the next message from the specified controller
+** Instances created by earlier adds are deleted first, otherwise the type of message is selected from the message mix
+**
+** \param   c - index of the controller
+**
+** \return  None
+**
+**************************************************************************/
+void SendNextMessage(int c)
+{
+    controller_t *ctrl = &controllers[c];
+    pending_msg_t *pm;
+    Usp__Request req = USP__REQUEST__INIT;
+    Usp__Get get = USP__GET__INIT;
+    Usp__Set set = USP__SET__INIT;
+    Usp__Set__UpdateObject upd_obj = USP__SET__UPDATE_OBJECT__INIT;
+    Usp__Set__UpdateObject *upd_objs[1] = { &upd_obj };
+    Usp__Set__UpdateParamSetting upd_param = USP__SET__UPDATE_PARAM_SETTING__INIT;
+    Usp__Set__UpdateParamSetting *upd_params[1] = { &upd_param };
+    Usp__Add add = USP__ADD__INIT;
+    Usp__Add__CreateObject create_obj = USP__ADD__CREATE_OBJECT__INIT;
+    Usp__Add__CreateObject *create_objs[1] = { &create_obj };
+    Usp__Delete del = USP__DELETE__INIT;
+    Usp__Header__MsgType msg_type;
+    char msg_id[64];
+    char obj_path[256];
+    char value[64];
+    char *path;
+    int choice;
+    int i;
+
+    // Find a free slot to hold the outstanding message
+    for (i=0; i < max_outstanding; i++)
+    {
+        if (ctrl->pending[i].in_use == false)
+        {
+            break;
+        }
+    }
+    pm = &ctrl->pending[i];
+
+    // Determine the type of message to send
+    if (ctrl->num_delete_paths > 0)
+    {
+        pm->type = kLoadMsg_Delete;
+    }
+    else
+    {
+        choice = rand_r(&ctrl->rand_state) % mix_total_weight;
+        for (i=0; i < kLoadMsg_Max-1; i++)
+        {
+            if (choice < mix_weights[i])
+            {
+                break;
+            }
+            choice -= mix_weights[i];
+        }
+        pm->type = i;
+        ctrl->num_sent++;
+    }
+
+    pm->in_use = true;
+    pm->seq = ctrl->next_seq++;
+    pm->awaiting_resp = true;
+    pm->awaiting_notify = false;
+    ctrl->num_outstanding++;
+    snprintf(msg_id, sizeof(msg_id), "c%d-%d", c+1, pm->seq);
+
+    // Form the request
+    switch(pm->type)
+    {
+        case kLoadMsg_Get:
+            snprintf(obj_path, sizeof(obj_path), "Device.LocalAgent.Controller.%d.", c+1);
+            path = obj_path;
+            get.n_param_paths = 1;
+            get.param_paths = &path;
+            req.req_type_case = USP__REQUEST__REQ_TYPE_GET;
+            req.get = &get;
+            msg_type = USP__HEADER__MSG_TYPE__GET;
+            break;
+
+        case kLoadMsg_Set:
+        case kLoadMsg_Notify:
+            snprintf(obj_path, sizeof(obj_path), "Device.LocalAgent.Controller.%d.", c+1);
+            if (pm->type == kLoadMsg_Set)
+            {
+                upd_param.param = "ControllerCode";
+                snprintf(value, sizeof(value), "code-%d", pm->seq);
+            }
+            else
+            {
+                // NOTE: The notification is correlated with this message by the value, so it must be unique
+                upd_param.param = "ProvisioningCode";
+                snprintf(value, sizeof(value), "load-%d-%d", c+1, pm->seq);
+                pm->awaiting_notify = true;
+            }
+            upd_param.value = value;
+            upd_param.required = true;
+            upd_obj.obj_path = obj_path;
+            upd_obj.n_param_settings = 1;
+            upd_obj.param_settings = upd_params;
+            set.allow_partial = false;
+            set.n_update_objs = 1;
+            set.update_objs = upd_objs;
+            req.req_type_case = USP__REQUEST__REQ_TYPE_SET;
+            req.set = &set;
+            msg_type = USP__HEADER__MSG_TYPE__SET;
+            break;
+
+        case kLoadMsg_Add:
+            create_obj.obj_path = "Device.LocalAgent.Subscription.";
+            add.allow_partial = false;
+            add.n_create_objs = 1;
+            add.create_objs = create_objs;
+            req.req_type_case = USP__REQUEST__REQ_TYPE_ADD;
+            req.add = &add;
+            msg_type = USP__HEADER__MSG_TYPE__ADD;
+            break;
+
+        case kLoadMsg_Delete:
+            ctrl->num_delete_paths--;
+            path = ctrl->delete_paths[ctrl->num_delete_paths];
+            del.allow_partial = false;
+            del.n_obj_paths = 1;
+            del.obj_paths = &path;
+            req.req_type_case = USP__REQUEST__REQ_TYPE_DELETE;
+            req.delete_ = &del;
+            msg_type = USP__HEADER__MSG_TYPE__DELETE;
+            break;
+
+        default:
+            fprintf(stderr, "Unexpected message type %d\n", pm->type);
+            exit(1);
+            break;
+    }
+
+    pm->start_time = GetTimeNs();
+    SendUspMsg(c, msg_id, msg_type, &req);
+
+    if (pm->type == kLoadMsg_Delete)
+    {
+        free(path);
+    }
+}
+
+/*********************************************************************//**
+**
+** SendUspMsg
+**
+** Serializes the specified USP request into a USP record, and sends it to the agent from the specified controller
+**
+** \param   c - index of the controller
+** \param   msg_id - message ID of the USP message
+** \param   msg_type - type of the USP message
+** \param   req - pointer to the request to send
+**
+** \return  None
+**
+**************************************************************************/
+void SendUspMsg(int c, char *msg_id, Usp__Header__MsgType msg_type, Usp__Request *req)
+{
+    Usp__Msg msg = USP__MSG__INIT;
+    Usp__Header header = USP__HEADER__INIT;
+    Usp__Body body = USP__BODY__INIT;
+    UspRecord__Record rec = USP_RECORD__RECORD__INIT;
+    UspRecord__NoSessionContextRecord ctx = USP_RECORD__NO_SESSION_CONTEXT_RECORD__INIT;
+    char endpoint_id[64];
+    char hdrs[512];
+    unsigned char *msg_buf;
+    unsigned char *rec_buf;
+    int msg_len;
+    int rec_len;
+
+    // Serialize the USP message
+    header.msg_id = msg_id;
+    header.msg_type = msg_type;
+    body.msg_body_case = USP__BODY__MSG_BODY_REQUEST;
+    body.request = req;
+    msg.header = &header;
+    msg.body = &body;
+    msg_len = usp__msg__get_packed_size(&msg);
+    msg_buf = LoadMalloc(msg_len);
+    usp__msg__pack(&msg, msg_buf);
+
+    // Serialize the USP record containing it
+    snprintf(endpoint_id, sizeof(endpoint_id), "%s%d", CONTROLLER_ENDPOINT_PREFIX, c+1);
+    rec.version = "1.0";
+    rec.to_id = agent_endpoint;
+    rec.from_id = endpoint_id;
+    rec.payload_security = USP_RECORD__RECORD__PAYLOAD_SECURITY__PLAINTEXT;
+    rec.record_type_case = USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT;
+    ctx.payload.data = msg_buf;
+    ctx.payload.len = msg_len;
+    rec.no_session_context = &ctx;
+    rec_len = usp_record__record__get_packed_size(&rec);
+    rec_buf = LoadMalloc(rec_len);
+    usp_record__record__pack(&rec, rec_buf);
+
+    // Send the USP record in a STOMP MESSAGE frame
+    snprintf(hdrs, sizeof(hdrs), "MESSAGE\ndestination:%s\ncontent-type:application/vnd.bbf.usp.msg\nreply-to-dest:%s%d\n"
+                                 "subscription:0\nmessage-id:%d\ncontent-length:%d\n\n",
+                                 AGENT_DESTINATION, CONTROLLER_DESTINATION, c+1, tx_message_id++, rec_len);
+    SendStompFrame(hdrs, rec_buf, rec_len);
+
+    free(msg_buf);
+    free(rec_buf);
+}
+
+/*********************************************************************//**
+**
+** SendStompFrame
+**
+** Sends a STOMP frame to the agent, terminating this program if the connection failed
+**
+** \param   hdrs - command and headers of the frame, including the blank line terminating the headers
+** \param   body - pointer to the body of the frame, or NULL if the frame has no body
+** \param   body_len - number of bytes in the body of the frame
+**
+** \return  None
+**
+**************************************************************************/
+void SendStompFrame(char *hdrs, unsigned char *body, int body_len)
+{
+    struct iovec iov[3];
+    struct msghdr mh;
+    static char terminator = '\0';
+    int total_len;
+    int sent;
+    int i;
+
+    iov[0].iov_base = hdrs;
+    iov[0].iov_len = strlen(hdrs);
+    iov[1].iov_base = body;
+    iov[1].iov_len = body_len;
+    iov[2].iov_base = &terminator;
+    iov[2].iov_len = 1;
+    total_len = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 3;
+    while (total_len > 0)
+    {
+        // Terminate if the agent disconnected
+        sent = sendmsg(agent_sock, &mh, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "Failed to send to agent (%s)\n", strerror(errno));
+            exit(1);
+        }
+
+        // Skip over the data which has been sent, in case this was a partial send
+        total_len -= sent;
+        for (i=0; (i < (int)mh.msg_iovlen) && (sent > 0); i++)
+        {
+            if (sent >= (int)mh.msg_iov[i].iov_len)
+            {
+                sent -= mh.msg_iov[i].iov_len;
+                mh.msg_iov[i].iov_len = 0;
+            }
+            else
+            {
+                mh.msg_iov[i].iov_base = (char *)mh.msg_iov[i].iov_base + sent;
+                mh.msg_iov[i].iov_len -= sent;
+                sent = 0;
+            }
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleUspRecord
+**
+** Handles a USP record received from the agent, correlating it with the outstanding message that caused it
+**
+** \param   buf - pointer to buffer containing the serialized USP record
+** \param   len - number of bytes in the USP record
+**
+** \return  None
+**
+**************************************************************************/
+void HandleUspRecord(unsigned char *buf, int len)
+{
+    UspRecord__Record *rec;
+    Usp__Msg *msg;
+    int c;
+
+    // Exit if the record or the message in it could not be unpacked
+    rec = usp_record__record__unpack(NULL, len, buf);
+    if ((rec == NULL) || (rec->record_type_case != USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT))
+    {
+        num_unexpected++;
+        goto exit;
+    }
+
+    msg = usp__msg__unpack(NULL, rec->no_session_context->payload.len, rec->no_session_context->payload.data);
+    if ((msg == NULL) || (msg->header == NULL) || (msg->body == NULL))
+    {
+        num_unexpected++;
+        goto exit_msg;
+    }
+
+    // Notifications are correlated with the Set that caused them by the value of the parameter
+    c = ControllerFromEndpoint(rec->to_id);
+    if ((msg->body->msg_body_case == USP__BODY__MSG_BODY_REQUEST) && (msg->body->request->req_type_case == USP__REQUEST__REQ_TYPE_NOTIFY))
+    {
+        HandleNotify(c, msg->body->request->notify);
+    }
+    else
+    {
+        HandleResponse(msg);
+    }
+
+exit_msg:
+    if (msg != NULL)
+    {
+        usp__msg__free_unpacked(msg, NULL);
+    }
+
+exit:
+    if (rec != NULL)
+    {
+        usp_record__record__free_unpacked(rec, NULL);
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleResponse
+**
+** Handles a response (or error) received from the agent, correlating it with the outstanding message by its message ID
+**
+** \param   msg - pointer to the unpacked USP message
+**
+** \return  None
+**
+**************************************************************************/
+void HandleResponse(Usp__Msg *msg)
+{
+    controller_t *ctrl;
+    pending_msg_t *pm;
+    Usp__AddResp *add_resp;
+    Usp__AddResp__CreatedObjectResult__OperationStatus *status;
+    char path[256];
+    int c;
+    int seq;
+
+    // Exit if the response's message ID does not correlate with any outstanding message
+    if ((sscanf(msg->header->msg_id, "c%d-%d", &c, &seq) != 2) || (c < 1) || (c > num_controllers))
+    {
+        num_unexpected++;
+        return;
+    }
+    c--;
+    ctrl = &controllers[c];
+
+    pm = FindPendingMsg(c, seq);
+    if ((pm == NULL) || (pm->awaiting_resp == false))
+    {
+        num_unexpected++;
+        return;
+    }
+
+    if (IsErrorResponse(msg))
+    {
+        // If the message failed, then do not wait for the notification it would have caused
+        num_errors++;
+        pm->awaiting_notify = false;
+    }
+    else if (pm->type == kLoadMsg_Add)
+    {
+        // Queue the created instance for deletion
+        add_resp = msg->body->response->add_resp;
+        if ((add_resp != NULL) && (add_resp->n_created_obj_results == 1))
+        {
+            status = add_resp->created_obj_results[0]->oper_status;
+            if ((status != NULL) && (status->oper_status_case == USP__ADD_RESP__CREATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_SUCCESS))
+            {
+                snprintf(path, sizeof(path), "%s", status->oper_success->instantiated_path);
+                ctrl->delete_paths = LoadRealloc(ctrl->delete_paths, (ctrl->num_delete_paths+1)*sizeof(char *));
+                ctrl->delete_paths[ctrl->num_delete_paths] = strdup(path);
+                ctrl->num_delete_paths++;
+            }
+        }
+    }
+
+    pm->awaiting_resp = false;
+    CompletePendingMsg(c, pm);
+}
+
+/*********************************************************************//**
+**
+** HandleNotify
+**
+** Handles a notification received from the agent, correlating it with the outstanding Set that caused it
+** NOTE: If the parameter was set again before the agent processed the value change, then the agent only notifies
+**       the latest value. So the notification also completes any earlier outstanding Sets of the parameter.
+**
+** \param   c - index of the controller which the notification was sent to, or -1 if not one of the load generator's controllers
+** \param   notify - pointer to the notification
+**
+** \return  None
+**
+**************************************************************************/
+void HandleNotify(int c, Usp__Notify *notify)
+{
+    pending_msg_t *pm;
+    int notify_c;
+    int seq;
+    int i;
+    bool is_match = false;
+
+    // Exit if this is not a ValueChange notification caused by a notify message sent by the controller
+    if ((c == -1) || (notify->notification_case != USP__NOTIFY__NOTIFICATION_VALUE_CHANGE) ||
+        (sscanf(notify->value_change->param_value, "load-%d-%d", &notify_c, &seq) != 2) || (notify_c != c+1))
+    {
+        num_unexpected++;
+        return;
+    }
+
+    for (i=0; i < max_outstanding; i++)
+    {
+        pm = &controllers[c].pending[i];
+        if ((pm->in_use) && (pm->awaiting_notify) && (pm->seq <= seq))
+        {
+            pm->awaiting_notify = false;
+            is_match = true;
+            CompletePendingMsg(c, pm);
+        }
+    }
+
+    // Count the notification as unexpected, if it did not correlate with any outstanding message (eg a duplicate notification)
+    if (is_match == false)
+    {
+        num_unexpected++;
+    }
+}
+
+/*********************************************************************//**
+**
+** CompletePendingMsg
+**
+** Records the latency of an outstanding message, if it has completed, then sends the controller's next message
+**
+** \param   c - index of the controller
+** \param   pm - pointer to the outstanding message
+**
+** \return  None
+**
+**************************************************************************/
+void CompletePendingMsg(int c, pending_msg_t *pm)
+{
+    // Exit if the message is still awaiting its response or notification
+    if ((pm->awaiting_resp) || (pm->awaiting_notify))
+    {
+        return;
+    }
+
+    AddLatency(pm->type, GetTimeNs() - pm->start_time);
+    pm->in_use = false;
+    controllers[c].num_outstanding--;
+
+    FillController(c);
+}
+
+/*********************************************************************//**
+**
+** FindPendingMsg
+**
+** Finds the outstanding message of the specified controller with the specified sequence number
+**
+** \param   c - index of the controller
+** \param   seq - sequence number of the message
+**
+** \return  pointer to the outstanding message, or NULL if no match was found
+**
+**************************************************************************/
+pending_msg_t *FindPendingMsg(int c, int seq)
+{
+    int i;
+    pending_msg_t *pm;
+
+    for (i=0; i < max_outstanding; i++)
+    {
+        pm = &controllers[c].pending[i];
+        if ((pm->in_use) && (pm->seq == seq))
+        {
+            return pm;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** IsErrorResponse
+**
+** Determines whether the specified USP message is an error, or a response indicating that the request failed
+**
+** \param   msg - pointer to the unpacked USP message
+**
+** \return  true if the request failed
+**
+**************************************************************************/
+bool IsErrorResponse(Usp__Msg *msg)
+{
+    Usp__Response *resp;
+    Usp__SetResp *set_resp;
+    Usp__DeleteResp *del_resp;
+    Usp__GetResp *get_resp;
+
+    // Exit if this is an error message
+    if (msg->body->msg_body_case != USP__BODY__MSG_BODY_RESPONSE)
+    {
+        return true;
+    }
+
+    resp = msg->body->response;
+    switch(resp->resp_type_case)
+    {
+        case USP__RESPONSE__RESP_TYPE_GET_RESP:
+            get_resp = resp->get_resp;
+            return ((get_resp->n_req_path_results != 1) || (get_resp->req_path_results[0]->err_code != 0));
+
+        case USP__RESPONSE__RESP_TYPE_SET_RESP:
+            set_resp = resp->set_resp;
+            return ((set_resp->n_updated_obj_results != 1) ||
+                    (set_resp->updated_obj_results[0]->oper_status->oper_status_case != USP__SET_RESP__UPDATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_SUCCESS));
+
+        case USP__RESPONSE__RESP_TYPE_ADD_RESP:
+            // NOTE: Failure of the add is detected when the created instance is queued for deletion
+            return false;
+
+        case USP__RESPONSE__RESP_TYPE_DELETE_RESP:
+            del_resp = resp->delete_resp;
+            return ((del_resp->n_deleted_obj_results != 1) ||
+                    (del_resp->deleted_obj_results[0]->oper_status->oper_status_case != USP__DELETE_RESP__DELETED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_SUCCESS));
+
+        default:
+            return true;
+    }
+}
+
+/*********************************************************************//**
+**
+** RequestMemStats
+**
+** Reads the agent's memory statistics (from Device.LocalAgent.X_VENDOR_Stats) using a Get from the first controller
+**
+** \param   prefix - string to print before the memory statistics
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int RequestMemStats(char *prefix)
+{
+    Usp__Request req = USP__REQUEST__INIT;
+    Usp__Get get = USP__GET__INIT;
+    char *path = MEM_STATS_PATH;
+    UspRecord__Record *rec;
+    Usp__Msg *msg;
+    char *command;
+    char *hdrs;
+    unsigned char *body;
+    int body_len;
+    int err;
+
+    get.n_param_paths = 1;
+    get.param_paths = &path;
+    req.req_type_case = USP__REQUEST__REQ_TYPE_GET;
+    req.get = &get;
+    SendUspMsg(0, MEM_STATS_MSG_ID, USP__HEADER__MSG_TYPE__GET, &req);
+
+    while (true)
+    {
+        // Exit if the agent did not respond
+        err = ReadStompFrame(RESPONSE_TIMEOUT_MS, &command, &hdrs, &body, &body_len);
+        if (err != 0)
+        {
+            fprintf(stderr, "Timed out waiting for agent's memory statistics\n");
+            return -1;
+        }
+
+        // Skip frames that are not the response to the Get (eg notifications sent when the agent started)
+        if (strcmp(command, "SEND") != 0)
+        {
+            continue;
+        }
+
+        rec = usp_record__record__unpack(NULL, body_len, body);
+        if (rec == NULL)
+        {
+            continue;
+        }
+
+        msg = NULL;
+        if (rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT)
+        {
+            msg = usp__msg__unpack(NULL, rec->no_session_context->payload.len, rec->no_session_context->payload.data);
+        }
+        usp_record__record__free_unpacked(rec, NULL);
+
+        if ((msg != NULL) && (msg->header != NULL) && (strcmp(msg->header->msg_id, MEM_STATS_MSG_ID)==0))
+        {
+            PrintMemStats(msg, prefix);
+            usp__msg__free_unpacked(msg, NULL);
+            return 0;
+        }
+
+        if (msg != NULL)
+        {
+            usp__msg__free_unpacked(msg, NULL);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** PrintMemStats
+**
+** Prints the memory statistics contained in the response to the Get of Device.LocalAgent.X_VENDOR_Stats
+**
+** \param   msg - pointer to the unpacked USP message containing the response
+** \param   prefix - string to print before the memory statistics
+**
+** \return  None
+**
+**************************************************************************/
+void PrintMemStats(Usp__Msg *msg, char *prefix)
+{
+    Usp__GetResp *get_resp;
+    Usp__GetResp__RequestedPathResult *rpr;
+    Usp__GetResp__ResolvedPathResult *res;
+    char *in_use = "unknown";
+    char *hwm = "unknown";
+    int i;
+
+    // Exit if the agent did not return its memory statistics
+    if ((IsErrorResponse(msg)) || (msg->body->response->resp_type_case != USP__RESPONSE__RESP_TYPE_GET_RESP))
+    {
+        printf("%s: Agent did not return its memory statistics\n", prefix);
+        return;
+    }
+
+    get_resp = msg->body->response->get_resp;
+    rpr = get_resp->req_path_results[0];
+    if (rpr->n_resolved_path_results > 0)
+    {
+        res = rpr->resolved_path_results[0];
+        for (i=0; i < res->n_result_params; i++)
+        {
+            if (strcmp(res->result_params[i]->key, "MemoryInUse")==0)
+            {
+                in_use = res->result_params[i]->value;
+            }
+            else if (strcmp(res->result_params[i]->key, "MemoryHighWaterMark")==0)
+            {
+                hwm = res->result_params[i]->value;
+            }
+        }
+    }
+
+    printf("%s: agent memory in use=%s bytes, high-water mark=%s bytes\n", prefix, in_use, hwm);
+}
+
+/*********************************************************************//**
+**
+** ReadStompFrame
+**
+** Reads the next STOMP frame sent by the agent, skipping heartbeats
+** NOTE: The returned pointers are only valid until the next call to this function
+**
+** \param   timeout_ms - maximum time (in milliseconds) to wait for the frame
+** \param   command - pointer to variable in which to return the command of the frame
+** \param   hdrs - pointer to variable in which to return the headers of the frame (newline separated)
+** \param   body - pointer to variable in which to return a pointer to the body of the frame
+** \param   body_len - pointer to variable in which to return the number of bytes in the body of the frame
+**
+** \return  0 if successful, otherwise -1 (if timed out, or the agent disconnected)
+**
+**************************************************************************/
+int ReadStompFrame(int timeout_ms, char **command, char **hdrs, unsigned char **body, int *body_len)
+{
+    static int consumed = 0;            // Number of bytes at the start of rx_buf[] used by the frame returned by the last call
+    unsigned char *hdr_end;
+    unsigned char *terminator;
+    char value[32];
+    int hdr_len;
+    int frame_len;
+    int content_len;
+    int skip;
+    int len;
+    struct pollfd pfd;
+
+    // Remove the frame returned by the last call from the buffer
+    memmove(rx_buf, &rx_buf[consumed], rx_buf_len - consumed);
+    rx_buf_len -= consumed;
+    consumed = 0;
+
+    while (true)
+    {
+        // Skip heartbeats
+        for (skip=0; (skip < rx_buf_len) && ((rx_buf[skip] == '\n') || (rx_buf[skip] == '\r')); skip++)
+        {
+        }
+        memmove(rx_buf, &rx_buf[skip], rx_buf_len - skip);
+        rx_buf_len -= skip;
+
+        // Determine whether a complete frame has been received
+        hdr_end = (rx_buf_len > 0) ? memmem(rx_buf, rx_buf_len, "\n\n", 2) : NULL;
+        if (hdr_end != NULL)
+        {
+            hdr_len = hdr_end - rx_buf;
+            *hdr_end = '\0';
+            if (GetStompHeader((char *)rx_buf, "content-length", value, sizeof(value)) != NULL)
+            {
+                content_len = atoi(value);
+                frame_len = hdr_len + 2 + content_len + 1;
+            }
+            else
+            {
+                terminator = memchr(&hdr_end[1], '\0', rx_buf_len - hdr_len - 1);
+                content_len = (terminator != NULL) ? terminator - &hdr_end[2] : 0;
+                frame_len = (terminator != NULL) ? hdr_len + 2 + content_len + 1 : rx_buf_len + 1;
+            }
+            *hdr_end = '\n';
+
+            // Exit if a complete frame has been received
+            if (rx_buf_len >= frame_len)
+            {
+                *hdr_end = '\0';
+                *command = (char *)rx_buf;
+                *hdrs = strchr((char *)rx_buf, '\n');
+                if (*hdrs != NULL)
+                {
+                    **hdrs = '\0';
+                    (*hdrs)++;
+                }
+                else
+                {
+                    *hdrs = (char *)hdr_end;
+                }
+                *body = &hdr_end[2];
+                *body_len = content_len;
+                consumed = frame_len;
+                return 0;
+            }
+        }
+
+        // Grow the buffer, if necessary
+        if (rx_buf_size - rx_buf_len < 65536)
+        {
+            rx_buf_size = (rx_buf_size == 0) ? 262144 : rx_buf_size * 2;
+            rx_buf = LoadRealloc(rx_buf, rx_buf_size);
+        }
+
+        // Exit if timed out waiting for more data
+        pfd.fd = agent_sock;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout_ms) != 1)
+        {
+            return -1;
+        }
+
+        // Exit if the agent disconnected
+        len = recv(agent_sock, &rx_buf[rx_buf_len], rx_buf_size - rx_buf_len - 1, 0);
+        if (len <= 0)
+        {
+            if ((len < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            fprintf(stderr, "Agent disconnected\n");
+            return -1;
+        }
+        rx_buf_len += len;
+    }
+}
+
+/*********************************************************************//**
+**
+** GetStompHeader
+**
+** Gets the value of the specified header in a STOMP frame, removing the STOMP escaping of special characters
+**
+** \param   hdrs - NULL terminated string containing the newline separated headers (optionally preceded by the command)
+** \param   name - name of the header to get
+** \param   buf - pointer to buffer in which to return the value of the header
+** \param   len - length of buffer
+**
+** \return  pointer to buf, or NULL if the header was not present
+**
+**************************************************************************/
+char *GetStompHeader(char *hdrs, char *name, char *buf, int len)
+{
+    char *p;
+    int name_len;
+    int i;
+
+    name_len = strlen(name);
+    p = hdrs;
+    while (p != NULL)
+    {
+        if ((strncmp(p, name, name_len)==0) && (p[name_len] == ':'))
+        {
+            // Copy the value, converting escape sequences (eg '\c' for ':') back to the characters they represent
+            p = &p[name_len+1];
+            for (i=0; (*p != '\0') && (*p != '\n') && (i < len-1); i++)
+            {
+                if ((p[0] == '\\') && (p[1] != '\0'))
+                {
+                    p++;
+                    buf[i] = (*p == 'c') ? ':' : (*p == 'n') ? '\n' : (*p == 'r') ? '\r' : *p;
+                }
+                else
+                {
+                    buf[i] = *p;
+                }
+                p++;
+            }
+            buf[i] = '\0';
+            return buf;
+        }
+
+        p = strchr(p, '\n');
+        if (p != NULL)
+        {
+            p++;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** AddLatency
+**
+** Records the latency of a completed message
+**
+** \param   type - type of message
+** \param   latency - time (in nanoseconds) between sending the message and it completing
+**
+** \return  None
+**
+**************************************************************************/
+void AddLatency(load_msg_t type, long long latency)
+{
+    latency_stats_t *ls = &latency_stats[type];
+
+    if (ls->num_latencies < ls->max_latencies)
+    {
+        ls->latencies[ls->num_latencies] = latency;
+        ls->num_latencies++;
+    }
+}
+
+/*********************************************************************//**
+**
+** PrintReport
+**
+** Prints the throughput, and the latencies of each type of message
+**
+** \param   elapsed - time (in nanoseconds) taken to send all messages and receive all responses
+**
+** \return  None
+**
+**************************************************************************/
+void PrintReport(long long elapsed)
+{
+    latency_stats_t all;
+    latency_stats_t *ls;
+    int i;
+    int total = 0;
+
+    for (i=0; i < kLoadMsg_Max; i++)
+    {
+        total += latency_stats[i].num_latencies;
+    }
+
+    all.latencies = LoadMalloc((total + 1) * sizeof(long long));
+    all.num_latencies = 0;
+
+    printf("Completed %d messages in %.3f s: %.1f msgs/s (%d errors, %d unexpected)\n", total, elapsed / 1e9,
+           (elapsed > 0) ? total * 1e9 / elapsed : 0.0, num_errors, num_unexpected);
+    printf("%-8s %10s %12s %12s %12s\n", "Type", "Count", "p50 (us)", "p99 (us)", "max (us)");
+    for (i=0; i <= kLoadMsg_Max; i++)
+    {
+        if (i < kLoadMsg_Max)
+        {
+            // Exit if no messages of this type were sent
+            ls = &latency_stats[i];
+            if (ls->num_latencies == 0)
+            {
+                continue;
+            }
+
+            memcpy(&all.latencies[all.num_latencies], ls->latencies, ls->num_latencies * sizeof(long long));
+            all.num_latencies += ls->num_latencies;
+        }
+        else
+        {
+            ls = &all;
+            if (ls->num_latencies == 0)
+            {
+                break;
+            }
+        }
+
+        qsort(ls->latencies, ls->num_latencies, sizeof(long long), CompareLatency);
+        printf("%-8s %10d %12.1f %12.1f %12.1f\n", (i < kLoadMsg_Max) ? load_msg_names[i] : "all", ls->num_latencies,
+               ls->latencies[ls->num_latencies / 2] / 1e3,
+               ls->latencies[(ls->num_latencies * 99) / 100] / 1e3,
+               ls->latencies[ls->num_latencies - 1] / 1e3);
+    }
+
+    free(all.latencies);
+}
+
+/*********************************************************************//**
+**
+** CompareLatency
+**
+** qsort() comparison function, used to sort latencies into ascending order
+**
+** \param   entry1 - pointer to first latency to compare
+** \param   entry2 - pointer to second latency to compare
+**
+** \return  -1, 0 or 1, depending on whether entry1 is less than, equal to, or greater than entry2
+**
+**************************************************************************/
+int CompareLatency(const void *entry1, const void *entry2)
+{
+    long long l1 = *(const long long *)entry1;
+    long long l2 = *(const long long *)entry2;
+
+    return (l1 > l2) - (l1 < l2);
+}
+
+/*********************************************************************//**
+**
+** GetTimeNs
+**
+** Returns the current monotonic time in nanoseconds
+**
+** \param   None
+**
+** \return  current time in nanoseconds
+**
+**************************************************************************/
+long long GetTimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*********************************************************************//**
+**
+** ControllerFromEndpoint
+**
+** Determines which of the load generator's controllers has the specified endpoint ID
+**
+** \param   endpoint_id - endpoint ID of the controller
+**
+** \return  index of the controller, or -1 if the endpoint ID is not one of the load generator's controllers
+**
+**************************************************************************/
+int ControllerFromEndpoint(char *endpoint_id)
+{
+    int prefix_len;
+    int c;
+
+    prefix_len = sizeof(CONTROLLER_ENDPOINT_PREFIX)-1;
+    if (strncmp(endpoint_id, CONTROLLER_ENDPOINT_PREFIX, prefix_len) != 0)
+    {
+        return -1;
+    }
+
+    c = atoi(&endpoint_id[prefix_len]);
+    if ((c < 1) || (c > num_controllers))
+    {
+        return -1;
+    }
+
+    return c-1;
+}
+
+/*********************************************************************//**
+**
+** LoadMalloc
+**
+** Wrapper around malloc() that terminates this program if out of memory
+**
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *LoadMalloc(int size)
+{
+    return LoadRealloc(NULL, size);
+}
+
+/*********************************************************************//**
+**
+** LoadRealloc
+**
+** Wrapper around realloc() that terminates this program if out of memory
+**
+** \param   ptr - pointer to memory to reallocate, or NULL
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *LoadRealloc(void *ptr, int size)
+{
+    void *new_ptr;
+
+    // Terminate if out of memory
+    new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL)
+    {
+        fprintf(stderr, "realloc(%d bytes) failed\n", size);
+        exit(1);
+    }
+
+    return new_ptr;
+}
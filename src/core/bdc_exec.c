@@ -42,6 +42,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include <openssl/ssl.h>
 
@@ -65,10 +66,15 @@ typedef struct
     char *query_string;
     char *username;
     char *password;
-    unsigned char *report;
+    char *report_format;
+    bdc_report_chunk_t *report;
     int report_len;
     unsigned flags;
     struct curl_slist *headers;
+
+    // Position in the report of the next data to pass to curl
+    bdc_report_chunk_t *cur_chunk;  // Chunk containing the next data to send, or NULL if all data has been sent
+    int cur_offset;                 // Offset of the next data to send, within cur_chunk
 } bdc_connection_t;
 
 static bdc_connection_t bdc_connection[BULKDATA_MAX_PROFILES];
@@ -91,9 +97,15 @@ typedef struct
     char *query_string;      // HTTP query string, sent to the BDC server
     char *username;          // username for HTTP authentication
     char *password;          // password for HTTP authentication
-    unsigned char *report;   // pointer to buffer containing the report (compressed or not)
-    int report_len;          // length of buffer containing the report
+    char *report_format;     // format of the report, sent to the BDC server in the BBF-Report-Format header eg 'NameValuePair'
+    bdc_report_chunk_t *report; // pointer to linked list of chunks containing the report (compressed or not)
+    int report_len;          // total length of the report (summed over all chunks)
     unsigned flags;          // bitmask of options for sending eg whether to use PUT instead of POST, whether the contents are Gzipped, whether to include
+
+    // If the report has not been generated yet (report is NULL), the snapshot from which the BDC thread generates it
+    void *snapshot;          // opaque snapshot of the values collected by the data model thread, or NULL if report has already been generated
+    bdc_generate_report_cb_t generate_cb;   // called on the BDC thread to generate the report from the snapshot
+    bdc_free_snapshot_cb_t free_cb;         // called on the BDC thread to free the snapshot
 } bdc_exec_msg_t;
 
 //------------------------------------------------------------------------------
@@ -104,6 +116,12 @@ static bool show_curl_debug = false;
 // Curl multi-interface handle. Used to send multiple reports simultaneously
 static CURLM *curl_multi_ctx;
 
+//------------------------------------------------------------------------------
+// Curl share handle. Used to share the DNS cache and TLS session cache between all reports
+// NOTE: Connections are cached by the multi-interface handle, and are reused by later reports
+// to the same BDC server. No locking is required, as the share handle is only used by the BDC thread
+static CURLSH *curl_share_ctx;
+
 // Number of curl easy interface handles that have been added to the curl multi-interface handle
 static int num_transfers_in_progress = 0;
 
@@ -113,7 +131,12 @@ void UpdateBdcSockSet(socket_set_t *set);
 void ProcessBdcMessageQueueSocketActivity(socket_set_t *set);
 int StartSendingReport(bdc_connection_t *bc);
 void FreeBdcExecMsgContents(bdc_exec_msg_t *msg);
+int PostBdcExecMsg(bdc_exec_msg_t *msg);
+int GenerateReportFromSnapshot(bdc_exec_msg_t *msg);
 size_t bulkdata_curl_null_sink(void *buffer, size_t size, size_t nmemb, void *userp);
+size_t BdcReadReportCallback(char *buffer, size_t size, size_t nitems, void *userp);
+int BdcSeekReportCallback(void *userp, curl_off_t offset, int origin);
+int BdcCloseSocketCallback(void *clientp, curl_socket_t item);
 void PerformSendingReports(void);
 void HandleBdcTransferComplete(CURL *curl_ctx, CURLcode curl_res);
 bdc_transfer_result_t CalcBdcTransferResult(CURL *curl_ctx, CURLcode curl_res, int profile_id);
@@ -171,17 +194,17 @@ int BDC_EXEC_Init(void)
 ** \param   query_string - HTTP query string, sent to the BDC server
 ** \param   username - username for HTTP authentication
 ** \param   password - password for HTTP authentication
-** \param   report - pointer to buffer containing the report (compressed or not)
-** \param   report_len - length of buffer containing the report
+** \param   report_format - format of the report eg 'NameValuePair' or 'ParameterPerRow'
+** \param   report - pointer to linked list of chunks containing the report (compressed or not)
+** \param   report_len - total length of the report (summed over all chunks)
 ** \param   flags - bitmask of options for sending eg whether to use PUT instead of POST, whether the contents are Gzipped, whether to include
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, unsigned char *report, int report_len, unsigned flags)
+int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, char *report_format, bdc_report_chunk_t *report, int report_len, unsigned flags)
 {
     bdc_exec_msg_t  msg;
-    int bytes_sent;
 
     // Form message (do this first, so that we can free message contents if a failure occurs)
     memset(&msg, 0, sizeof(msg));
@@ -190,27 +213,90 @@ int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string
     msg.query_string = query_string;
     msg.username = username;
     msg.password = password;
+    msg.report_format = report_format;
     msg.report = report;
     msg.report_len = report_len;
     msg.flags = flags;
 
+    return PostBdcExecMsg(&msg);
+}
+
+/*********************************************************************//**
+**
+** BDC_EXEC_PostSnapshotToSend
+**
+** Posts a message to BDC Exec thread to cause it to generate a BDC report from a snapshot of collected values, then send it to a BDC server
+** This allows the (potentially lengthy) serialization and compression of the report to occur on the BDC thread, rather than the data model thread
+** NOTE: All dynamically allocated memory passed to this function as input arguments (including the snapshot)
+**       changes to be owned by BDC Exec. The snapshot is always freed using free_cb, even if an error occurs
+**
+** \param   profile_id - Instance number of profile in Device.Bulkdata.Profile.{i}
+** \param   full_url - URL of the BDC server to post the report to
+** \param   query_string - HTTP query string, sent to the BDC server
+** \param   username - username for HTTP authentication
+** \param   password - password for HTTP authentication
+** \param   report_format - format of the report eg 'NameValuePair' or 'ParameterPerRow'
+** \param   snapshot - opaque snapshot of collected values, from which generate_cb generates the report
+** \param   generate_cb - callback called on the BDC thread to generate the report
+** \param   free_cb - callback called on the BDC thread to free the snapshot
+** \param   flags - bitmask of options for sending. These may be modified by generate_cb
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int BDC_EXEC_PostSnapshotToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, char *report_format, void *snapshot, bdc_generate_report_cb_t generate_cb, bdc_free_snapshot_cb_t free_cb, unsigned flags)
+{
+    bdc_exec_msg_t  msg;
+
+    // Form message (do this first, so that we can free message contents if a failure occurs)
+    memset(&msg, 0, sizeof(msg));
+    msg.profile_id = profile_id;
+    msg.full_url = full_url;
+    msg.query_string = query_string;
+    msg.username = username;
+    msg.password = password;
+    msg.report_format = report_format;
+    msg.flags = flags;
+    msg.snapshot = snapshot;
+    msg.generate_cb = generate_cb;
+    msg.free_cb = free_cb;
+
+    return PostBdcExecMsg(&msg);
+}
+
+/*********************************************************************//**
+**
+** PostBdcExecMsg
+**
+** Posts the specified message to the BDC Exec thread
+** NOTE: If an error occurs, all dynamically allocated memory owned by the message is freed
+**
+** \param   msg - pointer to message to post
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PostBdcExecMsg(bdc_exec_msg_t *msg)
+{
+    int bytes_sent;
+
     // Exit if message queue is not setup yet
     if (mq_tx_socket == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
-        FreeBdcExecMsgContents(&msg);
+        FreeBdcExecMsgContents(msg);
         return USP_ERR_INTERNAL_ERROR;
     }
 
     // Exit if unable to send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
+    bytes_sent = send(mq_tx_socket, msg, sizeof(bdc_exec_msg_t), 0);
+    if (bytes_sent != sizeof(bdc_exec_msg_t))
     {
         char buf[USP_ERR_MAXLEN];
         USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
 
         // Free all buffers whose ownership has passed to BDC exec
-        FreeBdcExecMsgContents(&msg);
+        FreeBdcExecMsgContents(msg);
         return USP_ERR_INTERNAL_ERROR;
     }
 
@@ -218,6 +304,30 @@ int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** BDC_EXEC_FreeReport
+**
+** Frees all chunks of the specified report
+**
+** \param   report - pointer to linked list of chunks containing the report, or NULL if there is no report
+**
+** \return  None
+**
+**************************************************************************/
+void BDC_EXEC_FreeReport(bdc_report_chunk_t *report)
+{
+    bdc_report_chunk_t *next;
+
+    while (report != NULL)
+    {
+        next = report->next;
+        free(report->data);
+        free(report);
+        report = next;
+    }
+}
+
 /*********************************************************************//**
 **
 ** BDC_EXEC_Main
@@ -242,6 +352,19 @@ void *BDC_EXEC_Main(void *args)
         return NULL;
     }
 
+    // Limit the number of connections kept open (idle) for reuse, to one per profile
+    curl_multi_setopt(curl_multi_ctx, CURLMOPT_MAXCONNECTS, (long)BULKDATA_MAX_PROFILES);
+
+    // Exit if unable to create a curl share handle
+    curl_share_ctx = curl_share_init();
+    if (curl_share_ctx == NULL)
+    {
+        USP_LOG_Error("%s: curl_share_init() failed", __FUNCTION__);
+        return NULL;
+    }
+    curl_share_setopt(curl_share_ctx, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(curl_share_ctx, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
     // Main loop which multiplexes the message queue with sending reports
     while(FOREVER)
     {
@@ -275,7 +398,7 @@ void *BDC_EXEC_Main(void *args)
         }
     }
 
-    // NOTE: If this thread ever exited, it should call curl_multi_cleanup(curl_multi_ctx);
+    // NOTE: If this thread ever exited, it should call curl_multi_cleanup(curl_multi_ctx) and curl_share_cleanup(curl_share_ctx);
 }
 
 /*********************************************************************//**
@@ -295,18 +418,40 @@ void UpdateBdcSockSet(socket_set_t *set)
 {
     CURLMcode res;
     long timeout;      // in ms
+    fd_set readfds;
+    fd_set writefds;
+    fd_set execfds;
+    int maxfd = -1;
+    int fd;
 
     // Start from no sockets in the set
     SOCKET_SET_Clear(set);
 
     // Skip curl sockets if unable to determine the socket sets that curl wants to select on
-    res = curl_multi_fdset(curl_multi_ctx, &set->readfds, &set->writefds, &set->execfds, &set->numfds);
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_ZERO(&execfds);
+    res = curl_multi_fdset(curl_multi_ctx, &readfds, &writefds, &execfds, &maxfd);
     if (res != CURLM_OK)
     {
         USP_LOG_Error("%s: curl_multi_fdset() failed (%s)", __FUNCTION__, curl_multi_strerror(res));
         goto exit;
     }
 
+    // Add the sockets that curl wants to the socket set
+    for (fd=0; fd <= maxfd; fd++)
+    {
+        if (FD_ISSET(fd, &readfds))
+        {
+            SOCKET_SET_AddSocketToReceiveFrom(fd, MAX_SOCKET_TIMEOUT, set);
+        }
+
+        if (FD_ISSET(fd, &writefds))
+        {
+            SOCKET_SET_AddSocketToSendTo(fd, MAX_SOCKET_TIMEOUT, set);
+        }
+    }
+
     // Skip curl sockets if unable to determine the timeout (in ms) that curl wants to use
     res = curl_multi_timeout(curl_multi_ctx, &timeout);
     if (res != CURLM_OK)
@@ -322,7 +467,8 @@ void UpdateBdcSockSet(socket_set_t *set)
     }
 
     // Set the timeout that curl wants
-    SOCKET_SET_UpdateTimeout(timeout, set);
+    // NOTE: If no transfers are in progress, the timeout is only for curl's housekeeping, so it may be coalesced with other timer events
+    SOCKET_SET_UpdateTimeoutWithSlack(timeout, (maxfd == -1) ? BDC_IDLE_TIMEOUT_SLACK : 0, set);
 
 exit:
     // Add the message queue receiving socket to the socket set
@@ -370,6 +516,18 @@ void ProcessBdcMessageQueueSocketActivity(socket_set_t *set)
         return;
     }
 
+    // Exit if unable to generate the report from the snapshot of collected values (if the data model thread did not generate it)
+    if (msg.snapshot != NULL)
+    {
+        err = GenerateReportFromSnapshot(&msg);
+        if (err != USP_ERR_OK)
+        {
+            FreeBdcExecMsgContents(&msg);
+            DM_EXEC_NotifyBdcTransferResult(msg.profile_id, kBDCTransferResult_Failure_Other);
+            return;
+        }
+    }
+
     // Fill in the connection slot
     // Ownership of dynamically allocated buffers moves from the BdcExecMsg to the Bdc connection slot
     bc->profile_id = msg.profile_id;
@@ -378,10 +536,13 @@ void ProcessBdcMessageQueueSocketActivity(socket_set_t *set)
     bc->query_string = msg.query_string;
     bc->username = msg.username;
     bc->password = msg.password;
+    bc->report_format = msg.report_format;
     bc->report = msg.report;
     bc->report_len = msg.report_len;
     bc->flags = msg.flags;
     bc->headers = NULL;
+    bc->cur_chunk = msg.report;
+    bc->cur_offset = 0;
 
     // Attempt to start sending the report
     err = StartSendingReport(bc);
@@ -392,6 +553,32 @@ void ProcessBdcMessageQueueSocketActivity(socket_set_t *set)
     }
 }
 
+/*********************************************************************//**
+**
+**  GenerateReportFromSnapshot
+**
+**  Generates the report from the snapshot contained in the specified message, then frees the snapshot
+**
+** \param   msg - pointer to BDC Exec message containing the snapshot. On return, this contains the report instead
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int GenerateReportFromSnapshot(bdc_exec_msg_t *msg)
+{
+    msg->report = msg->generate_cb(msg->snapshot, &msg->report_len, &msg->flags);
+    msg->free_cb(msg->snapshot);
+    msg->snapshot = NULL;
+
+    if (msg->report == NULL)
+    {
+        USP_LOG_Error("%s: Failed to generate report for profile %d", __FUNCTION__, msg->profile_id);
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 **  StartSendingReport
@@ -419,9 +606,14 @@ int StartSendingReport(bdc_connection_t *bc)
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Set options for PUT or POST    
-    curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDS, (char *)bc->report);
-    curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDSIZE, bc->report_len);
+    // Set options for PUT or POST
+    // NOTE: The report is passed to curl from its chunks by a read callback, rather than being copied into one contiguous buffer
+    curl_easy_setopt(curl_ctx, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl_ctx, CURLOPT_POSTFIELDSIZE, (long)bc->report_len);
+    curl_easy_setopt(curl_ctx, CURLOPT_READFUNCTION, BdcReadReportCallback);
+    curl_easy_setopt(curl_ctx, CURLOPT_READDATA, bc);
+    curl_easy_setopt(curl_ctx, CURLOPT_SEEKFUNCTION, BdcSeekReportCallback);
+    curl_easy_setopt(curl_ctx, CURLOPT_SEEKDATA, bc);
     if (bc->flags & BDC_FLAG_PUT)
     {
         // Curl defaults to POST, set to PUT here
@@ -443,6 +635,9 @@ int StartSendingReport(bdc_connection_t *bc)
     // Set URL
     curl_easy_setopt(curl_ctx, CURLOPT_URL, bc->full_url);
 
+    // Ensure that sockets closed by curl are removed from this thread's socket set
+    curl_easy_setopt(curl_ctx, CURLOPT_CLOSESOCKETFUNCTION, BdcCloseSocketCallback);
+
     // Set authentication (if required)
     use_authentication = ((bc->username[0] != '\0') && (bc->password[0] != '\0'));
     if (use_authentication)
@@ -460,12 +655,31 @@ int StartSendingReport(bdc_connection_t *bc)
     curl_easy_setopt(curl_ctx, CURLOPT_SSL_CTX_FUNCTION, *LoadBulkDataTrustStore);
     curl_easy_setopt(curl_ctx, CURLOPT_CONNECTTIMEOUT, BULKDATA_CONNECT_TIMEOUT);
     curl_easy_setopt(curl_ctx, CURLOPT_TIMEOUT, BULKDATA_TOTAL_TIMEOUT);
-    curl_easy_setopt(curl_ctx, CURLOPT_FORBID_REUSE, 1);
+
+    // Allow the connection to be reused by the next report sent to the same BDC server, avoiding the cost of
+    // DNS lookup, TCP connect and TLS handshake every reporting interval
+    // NOTE: If the server closes the connection before then, the TLS session can still be resumed, as the TLS session cache is shared
+    curl_easy_setopt(curl_ctx, CURLOPT_SHARE, curl_share_ctx);
+    curl_easy_setopt(curl_ctx, CURLOPT_TCP_KEEPALIVE, 1L);
+#if (LIBCURL_VERSION_NUM >= 0x074100)
+    // CURLOPT_MAXAGE_CONN was added in Curl version 7.65.0
+    curl_easy_setopt(curl_ctx, CURLOPT_MAXAGE_CONN, (long)BULKDATA_MAX_CONNECTION_IDLE_TIME);
+#endif
 
     // Set the list of headers
     bc->headers = NULL;
-    bc->headers = curl_slist_append(bc->headers, "Content-Type: application/json; charset=UTF-8");
-    bc->headers = curl_slist_append(bc->headers, "BBF-Report-Format: NameValuePair");
+    if (bc->flags & BDC_FLAG_CSV)
+    {
+        bc->headers = curl_slist_append(bc->headers, "Content-Type: text/csv; charset=UTF-8");
+    }
+    else
+    {
+        bc->headers = curl_slist_append(bc->headers, "Content-Type: application/json; charset=UTF-8");
+    }
+
+    #define BBF_REPORT_FORMAT_STR "BBF-Report-Format: "
+    USP_SNPRINTF(buf, sizeof(buf), "%s%s", BBF_REPORT_FORMAT_STR, bc->report_format);
+    bc->headers = curl_slist_append(bc->headers, buf);
     if (bc->flags & BDC_FLAG_GZIP)
     {
         bc->headers = curl_slist_append(bc->headers, "Content-Encoding: gzip");
@@ -724,6 +938,108 @@ size_t bulkdata_curl_null_sink(void *buffer, size_t size, size_t nmemb, void *us
     return nmemb*size;
 }
 
+/*********************************************************************//**
+**
+**  BdcReadReportCallback
+**
+**  Registered callback for curl read function
+**  This function is called by curl to obtain the next part of the report to send to the BDC server
+**  The report is copied out of its chunks, starting from the current position in the report
+**
+** \param   buffer - pointer to buffer in which to return the report data
+** \param   size - size of an element of data
+** \param   nitems - maximum number of elements of data to return
+** \param   userp - pointer to BDC connection slot containing the report being sent
+**          
+** \return  number of bytes copied into the buffer, or 0 if all of the report has been sent
+**
+**************************************************************************/
+size_t BdcReadReportCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    bdc_connection_t *bc = (bdc_connection_t *) userp;
+    bdc_report_chunk_t *chunk;
+    size_t max_len;
+    size_t len;
+    size_t bytes_copied = 0;
+
+    // Iterate over chunks, copying as much of the report as will fit into the buffer
+    max_len = size*nitems;
+    while ((bytes_copied < max_len) && (bc->cur_chunk != NULL))
+    {
+        chunk = bc->cur_chunk;
+        len = MIN(max_len - bytes_copied, (size_t)(chunk->len - bc->cur_offset));
+        memcpy(&buffer[bytes_copied], &chunk->data[bc->cur_offset], len);
+        bytes_copied += len;
+        bc->cur_offset += len;
+
+        // Move to the next chunk, if all of this chunk has been sent
+        if (bc->cur_offset >= chunk->len)
+        {
+            bc->cur_chunk = chunk->next;
+            bc->cur_offset = 0;
+        }
+    }
+
+    return bytes_copied;
+}
+
+/*********************************************************************//**
+**
+**  BdcSeekReportCallback
+**
+**  Registered callback for curl seek function
+**  This function is called by curl if it needs to resend the report eg after an HTTP authentication challenge or redirect
+**
+** \param   userp - pointer to BDC connection slot containing the report being sent
+** \param   offset - offset in the report to seek to
+** \param   origin - position in the report that offset is relative to. Only SEEK_SET is used by curl
+**          
+** \return  CURL_SEEKFUNC_OK if successful, CURL_SEEKFUNC_FAIL if the offset is outside of the report
+**
+**************************************************************************/
+int BdcSeekReportCallback(void *userp, curl_off_t offset, int origin)
+{
+    bdc_connection_t *bc = (bdc_connection_t *) userp;
+    bdc_report_chunk_t *chunk;
+
+    // Exit if the seek is not an absolute position within the report
+    if ((origin != SEEK_SET) || (offset < 0) || (offset > bc->report_len))
+    {
+        return CURL_SEEKFUNC_FAIL;
+    }
+
+    // Skip over all chunks before the one containing the offset
+    chunk = bc->report;
+    while ((chunk != NULL) && (offset >= chunk->len))
+    {
+        offset -= chunk->len;
+        chunk = chunk->next;
+    }
+
+    bc->cur_chunk = chunk;
+    bc->cur_offset = (int)offset;
+    return CURL_SEEKFUNC_OK;
+}
+
+/*********************************************************************//**
+**
+**  BdcCloseSocketCallback
+**
+**  Registered callback for curl close socket function
+**  This function removes the socket from the socket set, before closing it
+**
+** \param   clientp - pointer to user context (we do not register any)
+** \param   item - socket which curl wants to close
+**          
+** \return  0 if the socket was closed successfully, otherwise non-zero
+**
+**************************************************************************/
+int BdcCloseSocketCallback(void *clientp, curl_socket_t item)
+{
+    SOCKET_SET_ForgetSocket(item);
+    return close(item);
+}
+
 /*********************************************************************//**
 **
 **  FindFreeBdcConnection
@@ -804,11 +1120,9 @@ void FreeBdcConnection(bdc_connection_t *bc)
     USP_SAFE_FREE(bc->query_string);
     USP_SAFE_FREE(bc->username);
     USP_SAFE_FREE(bc->password);
+    USP_SAFE_FREE(bc->report_format);
 
-    if (bc->report != NULL)
-    {
-        free(bc->report);
-    }
+    BDC_EXEC_FreeReport(bc->report);
     
     // Free curl headers
     if (bc->headers != NULL)
@@ -838,10 +1152,14 @@ void FreeBdcExecMsgContents(bdc_exec_msg_t *msg)
     USP_SAFE_FREE(msg->query_string);
     USP_SAFE_FREE(msg->username);
     USP_SAFE_FREE(msg->password);
+    USP_SAFE_FREE(msg->report_format);
+
+    BDC_EXEC_FreeReport(msg->report);
 
-    if (msg->report != NULL)
+    if (msg->snapshot != NULL)
     {
-        free(msg->report);
+        msg->free_cb(msg->snapshot);
+        msg->snapshot = NULL;
     }
 }
 
@@ -41,10 +41,31 @@
 #ifndef BDC_EXEC_H
 #define BDC_EXEC_H
 
+//------------------------------------------------------------------------------
+// Chunk of a report passed to BDC_EXEC_PostReportToSend()
+// Reports are stored as a linked list of chunks, so that a compressed report can be generated incrementally
+// without ever needing a single contiguous buffer to hold it
+// NOTE: Both the chunk and its data are allocated with malloc() (not USP_MALLOC), as they are freed by the BDC thread
+typedef struct bdc_report_chunk_tag
+{
+    struct bdc_report_chunk_tag *next;  // Next chunk in the report, or NULL if this is the last chunk
+    unsigned char *data;                // Buffer containing this chunk's part of the report
+    int len;                            // Number of bytes of the report stored in this chunk
+} bdc_report_chunk_t;
+
+//------------------------------------------------------------------------------
+// Callbacks passed to BDC_EXEC_PostSnapshotToSend(). These are called on the BDC thread, so must not access the data model
+// The generate callback returns the report generated from the snapshot (or NULL if it could not be generated), and may modify the flags (eg to clear BDC_FLAG_GZIP)
+// The free callback is always called exactly once for each snapshot posted, after which the snapshot must not be accessed
+typedef bdc_report_chunk_t *(*bdc_generate_report_cb_t)(void *snapshot, int *p_report_len, unsigned *flags);
+typedef void (*bdc_free_snapshot_cb_t)(void *snapshot);
+
 //------------------------------------------------------------------------------
 // API functions
 int BDC_EXEC_Init(void);
-int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, unsigned char *report, int report_len, unsigned flags);
+int BDC_EXEC_PostReportToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, char *report_format, bdc_report_chunk_t *report, int report_len, unsigned flags);
+int BDC_EXEC_PostSnapshotToSend(int profile_id, char *full_url, char *query_string, char *username, char *password, char *report_format, void *snapshot, bdc_generate_report_cb_t generate_cb, bdc_free_snapshot_cb_t free_cb, unsigned flags);
+void BDC_EXEC_FreeReport(bdc_report_chunk_t *report);
 void *BDC_EXEC_Main(void *args);
 
 //------------------------------------------------------------------------------
@@ -52,6 +73,7 @@ void *BDC_EXEC_Main(void *args);
 #define BDC_FLAG_PUT            0x00000001  // If set, HTTP PUT should be used instead of HTTP POST when sending the report to the BDC server
 #define BDC_FLAG_GZIP           0x00000002  // If set, the reports contants are Gzipped
 #define BDC_FLAG_DATE_HEADER    0x00000004  // If set, the date header should be included in the HTTP post.
+#define BDC_FLAG_CSV            0x00000008  // If set, the report is CSV encoded, rather than JSON encoded
 
 
 #endif
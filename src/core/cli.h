@@ -44,6 +44,9 @@
 #include "socket_set.h"
 
 #define MAX_CLI_CMD_LEN  1024           // The maximum allowed size of a CLI command. The limit is arbitrary.
+#define MAX_CLI_BATCH_LEN  (1024*1024)  // The maximum allowed size of the unprocessed commands of a CLI batch (ie all commands of an atomic batch). The limit is arbitrary.
+#define MAX_CLI_RESPONSE_LEN  (16*1024*1024)  // The maximum size of a response buffered for a CLI client. Longer responses are truncated. The limit is arbitrary.
+#define MAX_CLI_CLIENTS  4              // The maximum number of CLI clients which are serviced concurrently. Further clients wait to be serviced.
 #define CLI_SEPARATOR '\xFF'            // Used to separate command and args in stream passed from client to server.
                                         // Used instead of a simple space, because args themselves might contain spaces
 
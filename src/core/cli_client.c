@@ -46,6 +46,7 @@
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -65,6 +66,8 @@ bool is_running_cli_local_command = false;
 //------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int HandleCliCommandRemotely(char *cmd_buf);
+int HandleCliBatchRemotely(char *cmd_buf);
+int ConnectToCliServer(void);
 int HandleCliCommandLocally(char *cmd_buf, char *db_file);
 
 /*********************************************************************//**
@@ -127,6 +130,11 @@ int CLI_CLIENT_ExecCommand(int argc, char *argv[], char *db_file)
         // Database commands handled locally - this allows us to fix incorrect connection parameters in the DB
         err = HandleCliCommandLocally(buf, db_file);
     }
+    else if (strcmp(argv[0], "batch")==0)
+    {
+        // Batch sessions stream the commands read from stdin to the active USP Agent
+        err = HandleCliBatchRemotely(buf);
+    }
     else
     {
         // All other commands sent to the active USP Agent
@@ -152,31 +160,15 @@ int HandleCliCommandRemotely(char *cmd_buf)
 {
     int err;
     int sock;
-    struct sockaddr_un sa;
     int bytes_sent;
     int bytes_received;
     int len;
     char buf[256];
 
-    // Exit if unable to create a blocking socket to send the CLI command on
-    sock = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sock == -1)
-    {
-        USP_ERR_ERRNO("socket", errno);
-        return USP_ERR_INTERNAL_ERROR;
-    }
-
-    // Fill in sockaddr structure
-    memset(&sa, 0, sizeof(sa));
-    sa.sun_family = AF_UNIX;
-    USP_STRNCPY(sa.sun_path, CLI_UNIX_DOMAIN_FILE, sizeof(sa.sun_path));
-
-    // Exit if unable to bind the socket to the unix domain file
-    err = connect(sock, (struct sockaddr *) &sa, sizeof(struct sockaddr_un));
-    if (err == -1)
+    // Exit if unable to connect to the CLI server
+    sock = ConnectToCliServer();
+    if (sock == INVALID)
     {
-        USP_ERR_ERRNO("connect", errno);
-        close(sock);
         return USP_ERR_INTERNAL_ERROR;
     }
 
@@ -220,6 +212,203 @@ int HandleCliCommandRemotely(char *cmd_buf)
     return err;
 }
 
+/*********************************************************************//**
+**
+** HandleCliBatchRemotely
+**
+** Runs a batch session on the active USP Agent. The commands of the batch are read from stdin (one per line)
+** and streamed to the CLI server, whilst the results (one line of JSON per command) are printed as they are received back
+** NOTE: The socket is non-blocking, so that sending commands cannot deadlock with the server sending back results
+**
+** \param   cmd_buf - batch command and arguments, to send to the active USP Agent
+**
+** \return  Error code that this executable should return
+**
+**************************************************************************/
+int HandleCliBatchRemotely(char *cmd_buf)
+{
+    int err;
+    int sock;
+    int len;
+    int num_sockets;
+    fd_set readfds;
+    fd_set writefds;
+    char out_buf[MAX_CLI_CMD_LEN];
+    int out_len = 0;
+    int out_pos = 0;
+    bool is_input_eof = false;
+    bool is_shutdown = false;
+    char buf[256];
+
+    // Exit if unable to connect to the CLI server
+    sock = ConnectToCliServer();
+    if (sock == INVALID)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to send the command which starts the batch session
+    len = strlen(cmd_buf);
+    if (send(sock, cmd_buf, len, 0) == -1)
+    {
+        USP_ERR_ERRNO("send", errno);
+        close(sock);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to set the socket as non blocking
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1)
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        close(sock);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    err = USP_ERR_OK;
+    while (true)
+    {
+        // Signal the end of the batch to the server, once all commands have been sent
+        if ((is_input_eof) && (out_pos == out_len) && (is_shutdown == false))
+        {
+            shutdown(sock, SHUT_WR);
+            is_shutdown = true;
+        }
+
+        // Wait for results from the server, and either for more commands from stdin, or to be able to send the commands already read
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_SET(sock, &readfds);
+        if (out_pos < out_len)
+        {
+            FD_SET(sock, &writefds);
+        }
+        else if (is_input_eof == false)
+        {
+            FD_SET(STDIN_FILENO, &readfds);
+        }
+
+        num_sockets = select(MAX(sock, STDIN_FILENO) + 1, &readfds, &writefds, NULL, NULL);
+        if (num_sockets == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Exit loop if an unexpected error occurred
+            USP_ERR_ERRNO("select", errno);
+            err = USP_ERR_INTERNAL_ERROR;
+            break;
+        }
+
+        // Read more commands from stdin
+        if (FD_ISSET(STDIN_FILENO, &readfds))
+        {
+            len = read(STDIN_FILENO, out_buf, sizeof(out_buf));
+            if (len <= 0)
+            {
+                is_input_eof = true;
+            }
+            else
+            {
+                out_len = len;
+                out_pos = 0;
+            }
+        }
+
+        // Send commands to the server
+        if (FD_ISSET(sock, &writefds))
+        {
+            len = send(sock, &out_buf[out_pos], out_len - out_pos, 0);
+            if (len == -1)
+            {
+                // Exit loop if an unexpected error occurred (eg server closed the connection after rejecting the batch command)
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                {
+                    USP_ERR_ERRNO("send", errno);
+                    err = USP_ERR_INTERNAL_ERROR;
+                    break;
+                }
+            }
+            else
+            {
+                out_pos += len;
+            }
+        }
+
+        // Print results received back from the server
+        if (FD_ISSET(sock, &readfds))
+        {
+            len = recv(sock, buf, sizeof(buf)-1, 0);
+            if (len == -1)
+            {
+                // Exit loop if an unexpected error occurred
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                {
+                    USP_ERR_ERRNO("recv", errno);
+                    err = USP_ERR_INTERNAL_ERROR;
+                    break;
+                }
+            }
+            else if (len == 0)
+            {
+                // Exit loop if the server has sent all results
+                break;
+            }
+            else
+            {
+                buf[len] = '\0';     // Ensure that string received is NULL terminated
+                printf("%s", buf);
+            }
+        }
+    }
+
+    close(sock);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** ConnectToCliServer
+**
+** Connects to the CLI server running on the active USP Agent
+**
+** \param   None
+**
+** \return  blocking socket connected to the CLI server, or INVALID if unable to connect
+**
+**************************************************************************/
+int ConnectToCliServer(void)
+{
+    int err;
+    int sock;
+    struct sockaddr_un sa;
+
+    // Exit if unable to create a blocking socket to send the CLI command on
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+    {
+        USP_ERR_ERRNO("socket", errno);
+        return INVALID;
+    }
+
+    // Fill in sockaddr structure
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    USP_STRNCPY(sa.sun_path, CLI_UNIX_DOMAIN_FILE, sizeof(sa.sun_path));
+
+    // Exit if unable to bind the socket to the unix domain file
+    err = connect(sock, (struct sockaddr *) &sa, sizeof(struct sockaddr_un));
+    if (err == -1)
+    {
+        USP_ERR_ERRNO("connect", errno);
+        close(sock);
+        return INVALID;
+    }
+
+    return sock;
+}
+
 /*********************************************************************//**
 **
 ** HandleCliCommandLocally
@@ -64,10 +64,47 @@
 #include "text_utils.h"
 #include "version.h"
 #include "stomp.h"
+#include "dm_exec.h"
+#include "task_pool.h"
+#include "mtp_exec.h"
+#include "json.h"
+#include "replay.h"
+
+//------------------------------------------------------------------------------
+// Structure containing the state of a connection from a CLI client
+// NOTE: Responses are buffered, then sent non-blockingly when the socket becomes writable, so that a slow or stuck
+// CLI client (eg output piped into 'less') cannot stall the data model thread
+typedef struct
+{
+    int sock;                       // Socket used to receive CLI commands on and respond back with data. INVALID if this slot is unused
+    char cmd_buf[MAX_CLI_CMD_LEN];  // Buffer used to build up the command to process
+    int cmd_buf_len;
+    char *out_buf;                  // Buffer containing the response to send back to the client
+    int out_len;                    // Number of bytes in out_buf
+    int out_size;                   // Size of out_buf
+    int out_pos;                    // Number of bytes of out_buf which have been sent
+    bool is_out_truncated;          // Set if the response exceeded MAX_CLI_RESPONSE_LEN, and so has been truncated
+    bool is_closing;                // Set if the connection should be closed, once all of the response has been sent
+
+    // State of a batch session, started by the 'batch' CLI command
+    // In a batch session, the client streams many commands (one per line) over the connection, and the result of each command
+    // is sent back as a single line of JSON. The session ends when the client shuts down its side of the connection
+    bool is_batch;                  // Set if the client is running a batch session
+    bool is_batch_atomic;           // Set if the commands of the batch are performed in a single transaction, once all have been received
+    char *batch_buf;                // Commands received from the client, which have not been performed yet
+    int batch_buf_len;
+    int batch_buf_size;
+    int batch_num_cmds;             // Number of commands performed in the batch session
+    int batch_num_errors;           // Number of commands in the batch session which failed
+} cli_client_t;
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
-void CloseCliServerSock(void);
+void CloseCliClient(cli_client_t *cc);
+void ProcessCliClientActivity(cli_client_t *cc);
+void SendCliClientOutput(cli_client_t *cc);
+void AppendCliClientOutput(cli_client_t *cc, char *buf, int len);
+cli_client_t *FindUnusedCliClient(void);
 void SendCliResponse_InvalidValue(char *arg, char *usage);
 int SplitArgs(char *args, int num_args, char *usage, char **arg1, char **arg2);
 void RemoveSeparators(char *buf);
@@ -85,9 +122,26 @@ int ExecuteCli_Perm(char *arg1, char *arg2, char *usage);
 int ExecuteCli_DbGet(char *param, char *arg2, char *usage);
 int ExecuteCli_DbSet(char *param, char *value, char *usage);
 int ExecuteCli_DbDel(char *param, char *arg2, char *usage);
+int ExecuteCli_DbExport(char *file, char *arg2, char *usage);
+int ExecuteCli_DbImport(char *file, char *arg2, char *usage);
 int ExecuteCli_Verbose(char *level, char *arg2, char *usage);
 int ExecuteCli_ProtoTrace(char *level, char *arg2, char *usage);
+int ExecuteCli_MemProfile(char *rate, char *arg2, char *usage);
+int ExecuteCli_CbStats(char *enable, char *arg2, char *usage);
 int ExecuteCli_Stop(char *arg1, char *arg2, char *usage);
+int ExecuteCli_Batch(char *arg1, char *arg2, char *usage);
+void ProcessCliBatchActivity(cli_client_t *cc);
+int AppendCliBatchData(cli_client_t *cc, char *buf, int len);
+int ProcessCliBatchCommands(cli_client_t *cc, bool is_final, bool stop_on_error);
+int ExecuteCliBatchCommand(cli_client_t *cc, char *line);
+void FinishCliBatch(cli_client_t *cc);
+void SendCliBatchLine(cli_client_t *cc, JsonNode *node);
+JsonNode *GetCliBatchResultMember(char *name, bool is_array);
+void SendCliParamResponse(char *path, char *value);
+void SendCliObjectResponse(char *action, char *path);
+int StartCliTransaction(dm_trans_vector_t *trans);
+int CommitCliTransaction(void);
+void AbortCliTransaction(void);
 char *SplitOffTrailingNumber(char *s);
 int SplitSetExpression(char *expr, char *search_path, int search_path_len, char *param_name, int param_name_len);
 void SendCliResponse(char *fmt, ...);
@@ -97,13 +151,17 @@ void SendCliResponse(char *fmt, ...);
 static int cli_listen_sock = INVALID;
 
 //------------------------------------------------------------------------------
-// Socket used to receive CLI command on and respond back with data
-static int cli_server_sock = INVALID;
+// Connections from CLI clients which are currently being serviced
+static cli_client_t cli_clients[MAX_CLI_CLIENTS];
 
 //------------------------------------------------------------------------------
-// Buffer used to build up the command to process
-static char cmd_buf[MAX_CLI_CMD_LEN];
-static int cmd_buf_len = 0;
+// Client whose command is currently being executed. Responses to the command are added to this client's output buffer
+static cli_client_t *cur_cli_client = NULL;
+
+//------------------------------------------------------------------------------
+// State of the batch command currently being performed
+static bool is_cli_batch_trans_active = false;  // Set whilst the commands of an atomic batch are being performed within the batch's transaction
+static JsonNode *batch_result = NULL;           // Result of the batch command currently being performed. NULL if not performing a batch command
 
 //------------------------------------------------------------------------------
 // Variable used to redirect dump logging back to the CLI client
@@ -114,35 +172,44 @@ bool dump_to_cli = false;
 #define RUN_LOCALLY     true
 #define RUN_REMOTELY    false
 
+#define IN_BATCH        true
+#define NOT_IN_BATCH    false
+
 typedef struct
 {
     char *name;
     int num_args;
     bool run_locally;
+    bool allowed_in_batch;
     int (*exec_cmd)(char *arg1, char *arg2, char *usage);
     char *usage;
 } cli_cmd_t;
 
 cli_cmd_t cli_commands[] = 
 {
-//    Name    NumArgs  RunLocal?  Exec callback     Usage String
-    { "help",    0, RUN_LOCALLY,  ExecuteCli_Help,  "help" },
-    { "version", 0, RUN_LOCALLY,  ExecuteCli_Version, "version" },
-    { "get",     1, RUN_REMOTELY, ExecuteCli_Get,   "get [path-expr]" },
-    { "set",     2, RUN_REMOTELY, ExecuteCli_Set,   "set [path-expr] [value]"},
-    { "add",     1, RUN_REMOTELY, ExecuteCli_Add,   "add [object]"},
-    { "del",     1, RUN_REMOTELY, ExecuteCli_Del,   "del [path-expr]"},
-    { "operate", 1, RUN_REMOTELY, ExecuteCli_Operate,"operate [operation]"},
-    { "instances", 1, RUN_REMOTELY, ExecuteCli_GetInstances,   "instances [path-expr]" },
-    { "show",    1, RUN_LOCALLY,  ExecuteCli_Show,  "show ['datamodel' | 'database' ]"},
-    { "dump",    1, RUN_REMOTELY, ExecuteCli_Dump,  "dump ['memory' | 'mdelta' | 'subscriptions' | 'instances' ]"},
-    { "perm",    1, RUN_REMOTELY, ExecuteCli_Perm,  "perm [parameter or object]"},
-    { "dbget",   1, RUN_LOCALLY,  ExecuteCli_DbGet, "dbget [parameter]"},
-    { "dbset",   2, RUN_LOCALLY,  ExecuteCli_DbSet, "dbset [parameter] [value]"},
-    { "dbdel",   1, RUN_LOCALLY,  ExecuteCli_DbDel, "dbdel [parameter]"},
-    { "verbose", 1, RUN_REMOTELY, ExecuteCli_Verbose, "verbose [level]"},
-    { "prototrace", 1, RUN_REMOTELY, ExecuteCli_ProtoTrace, "prototrace [enable]"},
-    { "stop",    0, RUN_REMOTELY, ExecuteCli_Stop, "stop"},
+//    Name    NumArgs  RunLocal?     InBatch?      Exec callback     Usage String
+    { "help",    0, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_Help,  "help" },
+    { "version", 0, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_Version, "version" },
+    { "get",     1, RUN_REMOTELY, IN_BATCH,     ExecuteCli_Get,   "get [path-expr]" },
+    { "set",     2, RUN_REMOTELY, IN_BATCH,     ExecuteCli_Set,   "set [path-expr] [value]"},
+    { "add",     1, RUN_REMOTELY, IN_BATCH,     ExecuteCli_Add,   "add [object]"},
+    { "del",     1, RUN_REMOTELY, IN_BATCH,     ExecuteCli_Del,   "del [path-expr]"},
+    { "operate", 1, RUN_REMOTELY, IN_BATCH,     ExecuteCli_Operate,"operate [operation]"},
+    { "instances", 1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_GetInstances,   "instances [path-expr]" },
+    { "batch",   1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_Batch, "batch ['atomic' | 'nonatomic'] (reads commands from stdin, one per line)" },
+    { "show",    1, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_Show,  "show ['datamodel' | 'database' ]"},
+    { "dump",    1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_Dump,  "dump ['memory' | 'mdelta' | 'memprofile' | 'subscriptions' | 'instances' | 'dbcache' | 'msgstats' | 'slowest' | 'getcache' | 'tasks' | 'membudget' | 'boot' | 'replay' ]"},
+    { "perm",    1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_Perm,  "perm [parameter or object]"},
+    { "dbget",   1, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_DbGet, "dbget [parameter]"},
+    { "dbset",   2, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_DbSet, "dbset [parameter] [value]"},
+    { "dbdel",   1, RUN_LOCALLY,  NOT_IN_BATCH, ExecuteCli_DbDel, "dbdel [parameter]"},
+    { "dbexport", 1, RUN_LOCALLY, NOT_IN_BATCH, ExecuteCli_DbExport, "dbexport [file] (writes a binary snapshot of the database)"},
+    { "dbimport", 1, RUN_LOCALLY, NOT_IN_BATCH, ExecuteCli_DbImport, "dbimport [file] (replaces the database with a snapshot)"},
+    { "verbose", 1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_Verbose, "verbose [level]"},
+    { "prototrace", 1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_ProtoTrace, "prototrace [enable]"},
+    { "memprofile", 1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_MemProfile, "memprofile [sample-rate]"},
+    { "cbstats", 1, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_CbStats, "cbstats [enable]"},
+    { "stop",    0, RUN_REMOTELY, NOT_IN_BATCH, ExecuteCli_Stop, "stop"},
 };
 
 /*********************************************************************//**
@@ -158,10 +225,18 @@ cli_cmd_t cli_commands[] =
 **************************************************************************/
 int CLI_SERVER_Init(void)
 {
+    int i;
     int sock;
     int err;
     struct sockaddr_un sa;
 
+    // Mark all CLI client slots as unused
+    memset(cli_clients, 0, sizeof(cli_clients));
+    for (i=0; i<MAX_CLI_CLIENTS; i++)
+    {
+        cli_clients[i].sock = INVALID;
+    }
+
     // Exit if unable to remove the unix domain socket from the filing system
     err = remove(CLI_UNIX_DOMAIN_FILE);
     if ((err == -1) && (errno != ENOENT))
@@ -202,8 +277,7 @@ int CLI_SERVER_Init(void)
     }
 
     // Exit if unable to set the socket in listening mode
-    #define CLI_SERVER_BACKLOG  1
-    err = listen(sock, CLI_SERVER_BACKLOG);
+    err = listen(sock, MAX_CLI_CLIENTS);
     if (err == -1)
     {
         USP_ERR_ERRNO("listen", errno);
@@ -229,14 +303,34 @@ int CLI_SERVER_Init(void)
 **************************************************************************/
 void CLI_SERVER_UpdateSocketSet(socket_set_t *set)
 {
-    if (cli_listen_sock != INVALID)
+    int i;
+    cli_client_t *cc;
+
+    // Only accept connections from CLI clients, if there is a free slot to service them in
+    // NOTE: Further clients wait in the listen backlog
+    if ((cli_listen_sock != INVALID) && (FindUnusedCliClient() != NULL))
     {
         SOCKET_SET_AddSocketToReceiveFrom(cli_listen_sock, MAX_SOCKET_TIMEOUT, set);
     }
 
-    if (cli_server_sock != INVALID)
+    for (i=0; i<MAX_CLI_CLIENTS; i++)
     {
-        SOCKET_SET_AddSocketToReceiveFrom(cli_server_sock, MAX_SOCKET_TIMEOUT, set);
+        cc = &cli_clients[i];
+        if (cc->sock != INVALID)
+        {
+            if (cc->out_pos < cc->out_len)
+            {
+                // Wait to send the rest of the response
+                SOCKET_SET_AddSocketToSendTo(cc->sock, MAX_SOCKET_TIMEOUT, set);
+            }
+            else if (cc->is_closing == false)
+            {
+                // Wait for the next command (or fragment of it)
+                // NOTE: Commands are only received once the response to the previous command has been sent, so that a batch
+                // client which does not read its results cannot make the response buffer grow without limit
+                SOCKET_SET_AddSocketToReceiveFrom(cc->sock, MAX_SOCKET_TIMEOUT, set);
+            }
+        }
     }
 }
 
@@ -253,64 +347,120 @@ void CLI_SERVER_UpdateSocketSet(socket_set_t *set)
 **************************************************************************/
 void CLI_SERVER_ProcessSocketActivity(socket_set_t *set)
 {
+    int i;
+    int sock;
+    int err;
     struct sockaddr sa;
     socklen_t sa_len;
-    char buf[MAX_CLI_CMD_LEN];
-    int msg_len;
-    char *cmd_end;
+    cli_client_t *cc;
 
-    // Accept remote connections from CLI clients
-    if (cli_listen_sock != INVALID)
+    // Service all connected CLI clients
+    for (i=0; i<MAX_CLI_CLIENTS; i++)
     {
-        if (SOCKET_SET_IsReadyToRead(cli_listen_sock, set))
+        cc = &cli_clients[i];
+        if (cc->sock == INVALID)
         {
-            sa_len = sizeof(sa);
-            cli_server_sock = accept(cli_listen_sock, &sa, &sa_len);
-            if (cli_server_sock == -1)
-            {
-                // If an error occurred, just log it
-                USP_ERR_ERRNO("accept", errno);
-            }
+            continue;
+        }
 
-            // Exit to allow cli_server_sock to be added to the socket set, before attempting to read it
-            return;
+        if ((cc->out_pos < cc->out_len) && (SOCKET_SET_IsReadyToWrite(cc->sock, set)))
+        {
+            SendCliClientOutput(cc);
+        }
+        else if (SOCKET_SET_IsReadyToRead(cc->sock, set))
+        {
+            ProcessCliClientActivity(cc);
         }
     }
 
-    // Exit if no client currently connected
-    if (cli_server_sock == INVALID)
+    // Accept remote connections from CLI clients
+    if ((cli_listen_sock != INVALID) && (SOCKET_SET_IsReadyToRead(cli_listen_sock, set)))
     {
-        return;
+        // Exit if there is no free slot to service the client in (the client stays in the listen backlog)
+        cc = FindUnusedCliClient();
+        if (cc == NULL)
+        {
+            return;
+        }
+
+        // Exit if an error occurred (just log it)
+        sa_len = sizeof(sa);
+        sock = accept(cli_listen_sock, &sa, &sa_len);
+        if (sock == -1)
+        {
+            USP_ERR_ERRNO("accept", errno);
+            return;
+        }
+
+        // Exit if unable to set the socket as non blocking, so that a stuck client cannot block sending a response back
+        err = fcntl(sock, F_SETFL, O_NONBLOCK);
+        if (err == -1)
+        {
+            USP_ERR_ERRNO("fcntl", errno);
+            close(sock);
+            return;
+        }
+
+        // NOTE: The socket is added to the socket set, before attempting to read it
+        cc->sock = sock;
     }
+}
 
-    // Exit if the client has not sent anything to us
-    if (SOCKET_SET_IsReadyToRead(cli_server_sock, set) == 0)
+/*********************************************************************//**
+**
+** ProcessCliClientActivity
+**
+** Receives a command (or fragment of a command) from a CLI client, and executes it once all of it has been received
+**
+** \param   cc - pointer to CLI client which has sent data
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void ProcessCliClientActivity(cli_client_t *cc)
+{
+    int msg_len;
+    char *cmd_end;
+    int err;
+
+    // Exit if the client is running a batch session. The commands of a batch are handled separately
+    if (cc->is_batch)
     {
+        ProcessCliBatchActivity(cc);
         return;
     }
 
     // Append command fragment from client to buffer
-    msg_len = recv(cli_server_sock, &cmd_buf[cmd_buf_len], sizeof(buf)-cmd_buf_len, 0);
+    // NOTE: One byte is left free in the buffer for the NULL terminator
+    msg_len = recv(cc->sock, &cc->cmd_buf[cc->cmd_buf_len], sizeof(cc->cmd_buf)-1-cc->cmd_buf_len, 0);
     if (msg_len == -1)
     {
         // Exit if an error occurred
         USP_ERR_ERRNO("recv", errno);
-        CloseCliServerSock();
+        CloseCliClient(cc);
+        return;
+    }
+
+    // Exit if the client closed the connection without sending a full command
+    if (msg_len == 0)
+    {
+        CloseCliClient(cc);
         return;
     }
-    cmd_buf_len += msg_len;
+    cc->cmd_buf_len += msg_len;
+    cc->cmd_buf[cc->cmd_buf_len] = '\0';
 
     // Determine whether a full command has been received (terminated by LF)
-    cmd_end = strchr(cmd_buf, '\n');
+    cmd_end = strchr(cc->cmd_buf, '\n');
 
     // Exit if the full command has not been received yet
     if (cmd_end == NULL)
     {
         // Close the socket if buffer is full, but still no full command received
-        if (cmd_buf_len == sizeof(cmd_buf))
+        if (cc->cmd_buf_len == sizeof(cc->cmd_buf)-1)
         {
             USP_ERR_SetMessage("%s: Received a CLI command that was not terminated by a LF", __FUNCTION__);
-            CloseCliServerSock();
+            CloseCliClient(cc);
         }
         return;
     }
@@ -318,10 +468,160 @@ void CLI_SERVER_ProcessSocketActivity(socket_set_t *set)
     // If the code gets here, a full command has been received, so process it
     *cmd_end = '\0';            // Make command into a string
 
-    CLI_SERVER_ExecuteCliCommand(cmd_buf);
+    // CLI commands may modify the data model, so wait until no Get worker thread is accessing it
+    DM_EXEC_WaitForGetWorkers();
+    cur_cli_client = cc;
+    CLI_SERVER_ExecuteCliCommand(cc->cmd_buf);
+
+    if (cc->is_batch)
+    {
+        // If the command started a batch session, then keep the socket open, performing any commands of the batch
+        // which were received in the same fragment as the command which started the batch session
+        msg_len = &cc->cmd_buf[cc->cmd_buf_len] - &cmd_end[1];
+        err = AppendCliBatchData(cc, &cmd_end[1], msg_len);
+        if ((err == USP_ERR_OK) && (cc->is_batch_atomic == false))
+        {
+            ProcessCliBatchCommands(cc, false, false);
+        }
+    }
+    else
+    {
+        // Close the socket, once the response to the command has been sent
+        cc->is_closing = true;
+    }
+    cur_cli_client = NULL;
+
+    // Start sending the response
+    SendCliClientOutput(cc);
+}
+
+/*********************************************************************//**
+**
+** SendCliClientOutput
+**
+** Sends as much of the buffered response to a CLI client as the socket will accept without blocking
+** The rest of the response is sent when the socket becomes writable again
+** The socket is closed once all of the response has been sent, if the connection is closing
+**
+** \param   cc - pointer to CLI client to send the response to
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void SendCliClientOutput(cli_client_t *cc)
+{
+    int bytes_sent;
+
+    while (cc->out_pos < cc->out_len)
+    {
+        bytes_sent = send(cc->sock, &cc->out_buf[cc->out_pos], cc->out_len - cc->out_pos, 0);
+        if (bytes_sent == -1)
+        {
+            // Exit if the socket will not accept any more of the response at present
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return;
+            }
+
+            // Exit if an error occurred (eg client closed the connection)
+            if (errno != EPIPE)
+            {
+                USP_ERR_ERRNO("send", errno);
+            }
+            CloseCliClient(cc);
+            return;
+        }
+
+        cc->out_pos += bytes_sent;
+    }
+
+    // If the code gets here, all of the response has been sent
+    cc->out_len = 0;
+    cc->out_pos = 0;
+    if (cc->is_closing)
+    {
+        CloseCliClient(cc);
+    }
+}
+
+/*********************************************************************//**
+**
+** AppendCliClientOutput
+**
+** Appends the specified response fragment to the buffered response to send to a CLI client
+** NOTE: If the response exceeds MAX_CLI_RESPONSE_LEN, then it is truncated
+**
+** \param   cc - pointer to CLI client to send the response to
+** \param   buf - pointer to response fragment
+** \param   len - number of bytes in the response fragment
+**
+** \return  None
+**
+**************************************************************************/
+void AppendCliClientOutput(cli_client_t *cc, char *buf, int len)
+{
+    int new_size;
+    static char truncated_msg[] = "\nERROR: Response truncated\n";
+
+    // Discard the part of the response which has already been sent
+    if (cc->out_pos > 0)
+    {
+        cc->out_len -= cc->out_pos;
+        memmove(cc->out_buf, &cc->out_buf[cc->out_pos], cc->out_len);
+        cc->out_pos = 0;
+    }
+
+    // Exit if the response has already been truncated
+    if (cc->is_out_truncated)
+    {
+        return;
+    }
+
+    // Truncate the response, if it is too large
+    if (cc->out_len + len > MAX_CLI_RESPONSE_LEN)
+    {
+        cc->is_out_truncated = true;
+        buf = truncated_msg;
+        len = sizeof(truncated_msg)-1;
+    }
+
+    // Increase the size of the buffer, if necessary
+    new_size = cc->out_len + len;
+    if (new_size > cc->out_size)
+    {
+        cc->out_size = MAX(new_size, 2*cc->out_size);
+        cc->out_size = MAX(cc->out_size, MAX_CLI_CMD_LEN);
+        cc->out_buf = USP_REALLOC(cc->out_buf, cc->out_size);
+    }
+
+    memcpy(&cc->out_buf[cc->out_len], buf, len);
+    cc->out_len += len;
+}
+
+/*********************************************************************//**
+**
+** FindUnusedCliClient
+**
+** Finds a free CLI client slot
+**
+** \param   None
+**
+** \return  pointer to free slot, or NULL if all slots are in use
+**
+**************************************************************************/
+cli_client_t *FindUnusedCliClient(void)
+{
+    int i;
+
+    for (i=0; i<MAX_CLI_CLIENTS; i++)
+    {
+        if (cli_clients[i].sock == INVALID)
+        {
+            return &cli_clients[i];
+        }
+    }
 
-    // Since we have sent the respone to the command, close the socket
-    CloseCliServerSock();
+    return NULL;
 }
 
 /*********************************************************************//**
@@ -330,6 +630,7 @@ void CLI_SERVER_ProcessSocketActivity(socket_set_t *set)
 **
 ** Sends the specified response fragment to the CLI client
 ** NOTE: This function may be called many times to build up the response sent back to the client
+** NOTE: The response is buffered, and sent from the data model thread's socket set, once the command has been executed
 **
 ** \param   s - string to send to the CLI client
 **
@@ -338,9 +639,9 @@ void CLI_SERVER_ProcessSocketActivity(socket_set_t *set)
 **************************************************************************/
 void CLI_SERVER_SendResponse(char *s)
 {
-    if (dump_to_cli)
+    if ((dump_to_cli) && (cur_cli_client != NULL))
     {
-        send(cli_server_sock, s, strlen(s), 0);
+        AppendCliClientOutput(cur_cli_client, s, strlen(s));
     }
     else
     {
@@ -448,21 +749,24 @@ int CLI_SERVER_ExecuteCliCommand(char *command)
 
 /*********************************************************************//**
 **
-** CloseCliServerSock
+** CloseCliClient
 **
-** Closes the socket on which CLI command is received and the response sent back on
+** Closes the socket on which CLI commands are received from a client and the response sent back on, freeing the client's slot
 **
-** \param   None
+** \param   cc - pointer to CLI client
 **
 ** \return  None
 **
 **************************************************************************/
-void CloseCliServerSock(void)
+void CloseCliClient(cli_client_t *cc)
 {
-    close(cli_server_sock);
-    cli_server_sock = INVALID;
-    cmd_buf[0] = '\0';
-    cmd_buf_len = 0;
+    SOCKET_SET_ForgetSocket(cc->sock);
+    close(cc->sock);
+
+    USP_SAFE_FREE(cc->out_buf);
+    USP_SAFE_FREE(cc->batch_buf);
+    memset(cc, 0, sizeof(cli_client_t));
+    cc->sock = INVALID;
 }
 
 /*********************************************************************//**
@@ -695,7 +999,7 @@ int ExecuteCli_Get(char *arg1, char *arg2, char *usage)
         }
     
         // Since successful, send back the value of the parameter
-        SendCliResponse("%s => %s\n", param, value);
+        SendCliParamResponse(param, value);
     }
 
     err = USP_ERR_OK;
@@ -746,7 +1050,7 @@ int ExecuteCli_Set(char *arg1, char *arg2, char *usage)
     }
 
     // Exit if unable to start a transaction
-    err = DM_TRANS_Start(&trans);
+    err = StartCliTransaction(&trans);
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -760,13 +1064,13 @@ int ExecuteCli_Set(char *arg1, char *arg2, char *usage)
         err = DATA_MODEL_SetParameterValue(path, arg2, CHECK_WRITABLE);
         if (err != USP_ERR_OK)
         {
-            DM_TRANS_Abort();
+            AbortCliTransaction();
             goto exit;
         }
     }
 
     // Exit if unable to commit the transaction
-    err = DM_TRANS_Commit();
+    err = CommitCliTransaction();
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -778,7 +1082,8 @@ int ExecuteCli_Set(char *arg1, char *arg2, char *usage)
     // Since successful, send back the value of all parameters set
     for (i=0; i < objects.num_entries; i++)
     {
-        SendCliResponse("%s.%s => %s\n", objects.vector[i], param_name, arg2);
+        USP_SNPRINTF(path, sizeof(path), "%s.%s", objects.vector[i], param_name);
+        SendCliParamResponse(path, arg2);
     }
 
     err = USP_ERR_OK;
@@ -829,7 +1134,7 @@ int ExecuteCli_Add(char *arg1, char *arg2, char *usage)
     }
 
     // Exit if unable to start a transaction
-    err = DM_TRANS_Start(&trans);
+    err = StartCliTransaction(&trans);
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -847,7 +1152,7 @@ int ExecuteCli_Add(char *arg1, char *arg2, char *usage)
             err = DATA_MODEL_AddInstance(path, NULL, CHECK_CREATABLE);  // We need the check, otherwise the validate function is not called for a vendor object
             if (err != USP_ERR_OK)
             {
-                DM_TRANS_Abort();
+                AbortCliTransaction();
                 goto exit;
             }
         }
@@ -858,14 +1163,14 @@ int ExecuteCli_Add(char *arg1, char *arg2, char *usage)
             err = DATA_MODEL_AddInstance(objects.vector[i], &instance_number, CHECK_CREATABLE);  // We need the check, otherwise the validate function is not called for a vendor object
             if (err != USP_ERR_OK)
             {
-                DM_TRANS_Abort();
+                AbortCliTransaction();
                 goto exit;
             }
         }
     }
 
     // Exit if unable to commit the transaction
-    err = DM_TRANS_Commit();
+    err = CommitCliTransaction();
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -876,12 +1181,13 @@ int ExecuteCli_Add(char *arg1, char *arg2, char *usage)
     {
         if (instance_str != NULL)
         {
-            SendCliResponse("Added %s.%s\n", objects.vector[i], instance_str);
+            USP_SNPRINTF(path, sizeof(path), "%s.%s", objects.vector[i], instance_str);
         }
         else
         {
-            SendCliResponse("Added %s.%d\n", objects.vector[i], instance_number);
+            USP_SNPRINTF(path, sizeof(path), "%s.%d", objects.vector[i], instance_number);
         }
+        SendCliObjectResponse("Added", path);
     }
 
     err = USP_ERR_OK;
@@ -921,26 +1227,22 @@ int ExecuteCli_Del(char *arg1, char *arg2, char *usage)
     }
 
     // Exit if unable to start a transaction
-    err = DM_TRANS_Start(&trans);
+    err = StartCliTransaction(&trans);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
 
-    // Iterate over all objects to delete
-    for (i=0; i < objects.num_entries; i++)
+    // Exit if unable to delete all of the specified instances
+    err = DATA_MODEL_DeleteInstances(&objects, CHECK_DELETABLE);  // We need the check, otherwise the validate function is not called for a vendor object
+    if (err != USP_ERR_OK)
     {
-        // Exit if unable to delete the specified instance
-        err = DATA_MODEL_DeleteInstance(objects.vector[i], CHECK_DELETABLE);  // We need the check, otherwise the validate function is not called for a vendor object
-        if (err != USP_ERR_OK)
-        {
-            DM_TRANS_Abort();
-            goto exit;
-        }
+        AbortCliTransaction();
+        goto exit;
     }
 
     // Exit if unable to commit the transaction
-    err = DM_TRANS_Commit();
+    err = CommitCliTransaction();
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -949,7 +1251,7 @@ int ExecuteCli_Del(char *arg1, char *arg2, char *usage)
     // Since successful, print out the list of objects deleted
     for (i=0; i < objects.num_entries; i++)
     {
-        SendCliResponse("Deleted %s\n", objects.vector[i]);
+        SendCliObjectResponse("Deleted", objects.vector[i]);
     }
 
     err = USP_ERR_OK;
@@ -1038,7 +1340,7 @@ int ExecuteCli_Operate(char *arg1, char *arg2, char *usage)
     for (i=0; i < operations.num_entries; i++)
     {
         // Exit if unable to start a transaction
-        err = DM_TRANS_Start(&trans);
+        err = StartCliTransaction(&trans);
         if (err != USP_ERR_OK)
         {
             goto exit;
@@ -1050,9 +1352,24 @@ int ExecuteCli_Operate(char *arg1, char *arg2, char *usage)
         if (err != USP_ERR_OK)
         {
             SendCliResponse("ERROR: Operation failed");
-            DM_TRANS_Abort();
+            AbortCliTransaction();
             goto exit;
         }
+        else if (batch_result != NULL)
+        {
+            // Batch commands return the request object of an asynchronous operation, or the output arguments of a synchronous operation
+            if (instance != INVALID)
+            {
+                USP_SNPRINTF(path, sizeof(path), "Device.LocalAgent.Request.%d", instance);
+                SendCliObjectResponse("Created", path);
+            }
+
+            for (j=0; j<output_args.num_entries; j++)
+            {
+                kv = &output_args.vector[j];
+                SendCliParamResponse(kv->key, kv->value);
+            }
+        }
         else
         {
             if (instance != INVALID)
@@ -1076,7 +1393,7 @@ int ExecuteCli_Operate(char *arg1, char *arg2, char *usage)
         }
 
         // Exit if unable to commit the transaction
-        err = DM_TRANS_Commit();
+        err = CommitCliTransaction();
         if (err != USP_ERR_OK)
         {
             goto exit;
@@ -1207,6 +1524,13 @@ int ExecuteCli_Dump(char *arg1, char *arg2, char *usage)
         return USP_ERR_OK;
     }
 
+    // Show the heap profile collected by the sampling heap profiler
+    if (strcmp(arg1, "memprofile")==0)
+    {
+        USP_MEM_PrintProfile();
+        return USP_ERR_OK;
+    }
+
     // Show the contents of the internal subscription array
     if (strcmp(arg1, "subscriptions")==0)
     {
@@ -1221,6 +1545,62 @@ int ExecuteCli_Dump(char *arg1, char *arg2, char *usage)
         return USP_ERR_OK;
     }
 
+    // Show the statistics of the database cache, if required
+    if (strcmp(arg1, "dbcache")==0)
+    {
+        DATABASE_DumpCache();
+        return USP_ERR_OK;
+    }
+
+    // Show the per message type latency statistics, if required
+    if (strcmp(arg1, "msgstats")==0)
+    {
+        DEVICE_MSG_STATS_Dump();
+        return USP_ERR_OK;
+    }
+
+    // Show the data model nodes with the slowest vendor callbacks, if required
+    if (strcmp(arg1, "slowest")==0)
+    {
+        DATA_MODEL_DumpSlowestCallbacks();
+        return USP_ERR_OK;
+    }
+
+    // Show the statistics of the cache of vendor parameter values, if required
+    if (strcmp(arg1, "getcache")==0)
+    {
+        DATA_MODEL_DumpValueCache();
+        return USP_ERR_OK;
+    }
+
+    // Show the state of the pool of worker threads running tasks (eg asynchronous operations), if required
+    if (strcmp(arg1, "tasks")==0)
+    {
+        TASK_POOL_Dump();
+        return USP_ERR_OK;
+    }
+
+    // Show the counters of the memory budgets of the message pipeline, if required
+    if (strcmp(arg1, "membudget")==0)
+    {
+        USP_MEM_PrintBudgets();
+        return USP_ERR_OK;
+    }
+
+    // Show the time taken by each phase of the startup of the agent, if required
+    if (strcmp(arg1, "boot")==0)
+    {
+        DEVICE_MSG_STATS_DumpBootTiming();
+        return USP_ERR_OK;
+    }
+
+    // Show the latency statistics of USP records replayed from a protocol capture file, if required
+    if (strcmp(arg1, "replay")==0)
+    {
+        REPLAY_Dump();
+        return USP_ERR_OK;
+    }
+
     // If the code gets here, there is an unknown value for arg1
     SendCliResponse_InvalidValue(arg1, usage);
     return USP_ERR_INVALID_ARGUMENTS;
@@ -1312,12 +1692,12 @@ int ExecuteCli_DbGet(char *param, char *arg2, char *usage)
 {
     int err;
     dm_hash_t hash;
-    char instances[MAX_DM_PATH];
+    dm_instances_t inst;
     char value[MAX_DM_VALUE_LEN];
     unsigned path_flags;
     
     // Exit if parameter path is incorrect
-    err = DM_PRIV_FormDB_FromPath(param, &hash, instances, sizeof(instances));
+    err = DM_PRIV_FormDB_FromPath(param, &hash, &inst);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -1333,7 +1713,7 @@ int ExecuteCli_DbGet(char *param, char *arg2, char *usage)
 
     // Exit if unable to get value of parameter from DB
     USP_ERR_ClearMessage();
-    err = DATABASE_GetParameterValue(param, hash, instances, value, sizeof(value), 0);
+    err = DATABASE_GetParameterValue(param, hash, &inst, value, sizeof(value), 0);
     if (err != USP_ERR_OK)
     {
         USP_ERR_ReplaceEmptyMessage("Parameter %s exists in the schema, but does not exist in the database", param);
@@ -1394,10 +1774,10 @@ int ExecuteCli_DbDel(char *param, char *arg2, char *usage)
 {
     int err;
     dm_hash_t hash;
-    char instances[MAX_DM_PATH];
+    dm_instances_t inst;
     
     // Exit if parameter path is incorrect
-    err = DM_PRIV_FormDB_FromPath(param, &hash, instances, sizeof(instances));
+    err = DM_PRIV_FormDB_FromPath(param, &hash, &inst);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -1405,7 +1785,9 @@ int ExecuteCli_DbDel(char *param, char *arg2, char *usage)
 
     // Exit if unable to delete parameter from DB
     // NOTE: If the parameter already does not exist in the database, then this function will still return success
-    err = DATABASE_DeleteParameter(param, hash, instances);
+    // NOTE: Unique key indexes are marked as stale, as the parameter may be part of a unique key
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    err = DATABASE_DeleteParameter(param, hash, &inst);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -1417,6 +1799,68 @@ int ExecuteCli_DbDel(char *param, char *arg2, char *usage)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** ExecuteCli_DbExport
+**
+** Executes the dbexport CLI command
+**
+** \param   file - name of file to write the snapshot of the database to
+** \param   arg2 - unused
+** \param   usage - pointer to string containing usage info for this command
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCli_DbExport(char *file, char *arg2, char *usage)
+{
+    int err;
+    int num_rows;
+
+    // Exit if unable to write the snapshot
+    err = DATABASE_ExportSnapshot(file, &num_rows);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    SendCliResponse("Exported %d rows to %s\n", num_rows, file);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ExecuteCli_DbImport
+**
+** Executes the dbimport CLI command
+**
+** \param   file - name of file containing the snapshot to replace the database with
+** \param   arg2 - unused
+** \param   usage - pointer to string containing usage info for this command
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCli_DbImport(char *file, char *arg2, char *usage)
+{
+    int err;
+    int num_rows;
+
+    // Exit if unable to replace the database with the snapshot
+    // NOTE: Unique key indexes are marked as stale, as the values of unique keys may have changed
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    err = DATABASE_ImportSnapshot(file, true, &num_rows);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    SendCliResponse("Imported %d rows from %s\n", num_rows, file);
+
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** ExecuteCli_Verbose
@@ -1485,26 +1929,686 @@ int ExecuteCli_ProtoTrace(char *arg1, char *arg2, char *usage)
 
 /*********************************************************************//**
 **
-** ExecuteCli_stop
+** ExecuteCli_MemProfile
 **
-** Executes the stop CLI command
+** Executes the memprofile CLI command
 **
-** \param   arg1 - unused
+** \param   arg1 - average number of allocations per sampled allocation (1=sample all allocations, 0=disable the profiler)
 ** \param   arg2 - unused
 ** \param   usage - pointer to string containing usage info for this command
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int ExecuteCli_Stop(char *arg1, char *arg2, char *usage)
+int ExecuteCli_MemProfile(char *arg1, char *arg2, char *usage)
 {
-    // Signal that USP Agent should stop, once no queued messages to send
-    MTP_EXEC_ScheduleExit();
-    MTP_EXEC_ActivateScheduledActions();
-
-    SendCliResponse("Stopping USP Agent\n");
+    int err;
+    unsigned rate;
 
-    return USP_ERR_OK;
+    err = TEXT_UTILS_StringToUnsigned(arg1, &rate);
+    if ((err != USP_ERR_OK) || (rate > INT_MAX/2))
+    {
+        SendCliResponse("ERROR: Heap profiler sample rate (%s) is invalid or out of range\n", arg1);
+        err = USP_ERR_INVALID_ARGUMENTS;
+    }
+    else
+    {
+        USP_MEM_SetProfileRate(rate);
+        if (rate == 0)
+        {
+            SendCliResponse("Heap profiler has been disabled\n");
+        }
+        else
+        {
+            SendCliResponse("Heap profiler sampling 1 in %d allocations. Use 'dump memprofile' to display\n", rate);
+        }
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** ExecuteCli_CbStats
+**
+** Executes the cbstats CLI command
+**
+** \param   arg1 - Value setting whether the time spent in vendor callbacks is accounted per data model node (0=off, 1=enabled)
+** \param   arg2 - unused
+** \param   usage - pointer to string containing usage info for this command
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCli_CbStats(char *arg1, char *arg2, char *usage)
+{
+    int err;
+    unsigned enable;
+
+    err = TEXT_UTILS_StringToUnsigned(arg1, &enable);
+    if ((err != USP_ERR_OK) || (enable > 1))
+    {
+        SendCliResponse("ERROR: Cbstats enable (%s) is invalid\n", arg1);
+        err = USP_ERR_INVALID_ARGUMENTS;
+    }
+    else
+    {
+        DATA_MODEL_EnableCallbackStats((bool) enable);
+        if (enable)
+        {
+            SendCliResponse("Vendor callback statistics have been reset and enabled. Use 'dump slowest' to display\n");
+        }
+        else
+        {
+            SendCliResponse("Vendor callback statistics have been disabled\n");
+        }
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** ExecuteCli_stop
+**
+** Executes the stop CLI command
+**
+** \param   arg1 - unused
+** \param   arg2 - unused
+** \param   usage - pointer to string containing usage info for this command
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCli_Stop(char *arg1, char *arg2, char *usage)
+{
+    // Signal that USP Agent should stop, once no queued messages to send
+    MTP_EXEC_ScheduleExit();
+    MTP_EXEC_ActivateScheduledActions();
+
+    SendCliResponse("Stopping USP Agent\n");
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ExecuteCli_Batch
+**
+** Executes the batch CLI command, which starts a batch session on the current connection
+** The client then sends the commands of the batch, one per line, in the form '<command> <path> [<value>]'
+** where the last argument of a command extends to the end of the line. Blank lines and lines starting with '#' are ignored.
+** The result of each command is sent back as a single line of JSON, followed by a final line summarising the batch.
+** In an 'atomic' batch, the commands are performed in a single transaction once the client has sent all of them
+** (ie shut down its side of the connection), and the transaction is aborted if any of the commands fail.
+** In a 'nonatomic' batch, each command is performed (in its own transaction) as soon as it has been received.
+**
+** \param   arg1 - 'atomic' or 'nonatomic'
+** \param   arg2 - unused
+** \param   usage - pointer to string containing usage info for this command
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCli_Batch(char *arg1, char *arg2, char *usage)
+{
+    cli_client_t *cc;
+    bool is_atomic;
+
+    // Exit if the batch mode is invalid
+    if (strcmp(arg1, "atomic")==0)
+    {
+        is_atomic = true;
+    }
+    else if (strcmp(arg1, "nonatomic")==0)
+    {
+        is_atomic = false;
+    }
+    else
+    {
+        SendCliResponse_InvalidValue(arg1, usage);
+        return USP_ERR_INVALID_ARGUMENTS;
+    }
+
+    // Exit if not executing the command on behalf of a CLI client
+    cc = cur_cli_client;
+    if (cc == NULL)
+    {
+        SendCliResponse("ERROR: Batch sessions must be run by a CLI client\n");
+        return USP_ERR_INVALID_ARGUMENTS;
+    }
+
+    // Start the batch session. The socket is kept open to receive the commands of the batch
+    cc->is_batch = true;
+    cc->is_batch_atomic = is_atomic;
+    cc->batch_buf_len = 0;
+    cc->batch_num_cmds = 0;
+    cc->batch_num_errors = 0;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ProcessCliBatchActivity
+**
+** Receives commands of the batch from the client, performing them if the batch is non-atomic
+** When the client has sent all commands, any commands remaining are performed and the batch summary is sent
+**
+** \param   cc - pointer to CLI client running the batch session
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void ProcessCliBatchActivity(cli_client_t *cc)
+{
+    char buf[MAX_CLI_CMD_LEN];
+    int msg_len;
+    int err;
+
+    // Exit if an error occurred
+    msg_len = recv(cc->sock, buf, sizeof(buf), 0);
+    if (msg_len == -1)
+    {
+        USP_ERR_ERRNO("recv", errno);
+        CloseCliClient(cc);
+        return;
+    }
+
+    // CLI commands may modify the data model, so wait until no Get worker thread is accessing it
+    DM_EXEC_WaitForGetWorkers();
+    cur_cli_client = cc;
+
+    if (msg_len == 0)
+    {
+        // The client has sent all commands of the batch, so close the socket once the results have been sent
+        FinishCliBatch(cc);
+        cc->is_closing = true;
+    }
+    else
+    {
+        // Commands in a non-atomic batch are performed as soon as they have been received
+        err = AppendCliBatchData(cc, buf, msg_len);
+        if ((err == USP_ERR_OK) && (cc->is_batch_atomic == false))
+        {
+            ProcessCliBatchCommands(cc, false, false);
+        }
+    }
+    cur_cli_client = NULL;
+
+    // Start sending the results
+    SendCliClientOutput(cc);
+}
+
+/*********************************************************************//**
+**
+** AppendCliBatchData
+**
+** Appends data received from the client to the buffer of commands of the batch, which have yet to be performed
+** NOTE: If the batch is too large, then an error is sent to the client and the connection is closed
+**
+** \param   cc - pointer to CLI client running the batch session
+** \param   buf - pointer to data received from the client
+** \param   len - number of bytes of data received
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int AppendCliBatchData(cli_client_t *cc, char *buf, int len)
+{
+    JsonNode *node;
+    int new_size;
+
+    // Exit if nothing to append
+    if (len == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if the batch is too large
+    new_size = cc->batch_buf_len + len + 1;    // Plus 1 to include the NULL terminator of the last command
+    if (new_size > MAX_CLI_BATCH_LEN)
+    {
+        node = json_mkobject();
+        json_append_member(node, "status", json_mkstring("error"));
+        json_append_member(node, "message", json_mkstring("Batch exceeds maximum size"));
+        SendCliBatchLine(cc, node);
+        json_delete(node);
+        cc->is_batch = false;
+        cc->is_closing = true;
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    // Increase the size of the buffer, if necessary
+    if (new_size > cc->batch_buf_size)
+    {
+        cc->batch_buf_size = MAX(new_size, 2*cc->batch_buf_size);
+        cc->batch_buf_size = MIN(cc->batch_buf_size, MAX_CLI_BATCH_LEN);
+        cc->batch_buf = USP_REALLOC(cc->batch_buf, cc->batch_buf_size);
+    }
+
+    memcpy(&cc->batch_buf[cc->batch_buf_len], buf, len);
+    cc->batch_buf_len += len;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ProcessCliBatchCommands
+**
+** Performs all complete commands in the buffer of commands received from the client
+** Any partially received command is kept in the buffer, until the rest of it has been received
+**
+** \param   cc - pointer to CLI client running the batch session
+** \param   is_final - Set if the client has sent all commands, so the last command need not be terminated by a LF
+** \param   stop_on_error - Set if no further commands should be performed after a command fails
+**
+** \return  USP_ERR_OK if all commands were successful, otherwise the error of the first command to fail
+**
+**************************************************************************/
+int ProcessCliBatchCommands(cli_client_t *cc, bool is_final, bool stop_on_error)
+{
+    char *line;
+    char *line_end;
+    char *buf_end;
+    int err;
+    int result = USP_ERR_OK;
+
+    // Exit if there are no commands to perform
+    if (cc->batch_buf_len == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    line = cc->batch_buf;
+    buf_end = &cc->batch_buf[cc->batch_buf_len];
+    while (line < buf_end)
+    {
+        // Exit loop if the rest of the command has not been received yet
+        line_end = memchr(line, '\n', buf_end - line);
+        if (line_end == NULL)
+        {
+            if (is_final == false)
+            {
+                break;
+            }
+            line_end = buf_end;     // NOTE: The buffer always has space for the NULL terminator
+        }
+
+        // Perform the command
+        *line_end = '\0';
+        err = ExecuteCliBatchCommand(cc, line);
+        line = &line_end[1];
+
+        // Exit loop if the command failed, and no further commands should be performed
+        if (err != USP_ERR_OK)
+        {
+            if (result == USP_ERR_OK)
+            {
+                result = err;
+            }
+
+            if (stop_on_error)
+            {
+                line = buf_end;
+                break;
+            }
+        }
+    }
+
+    // Move any partially received command to the start of the buffer
+    if (line < buf_end)
+    {
+        cc->batch_buf_len = buf_end - line;
+        memmove(cc->batch_buf, line, cc->batch_buf_len);
+    }
+    else
+    {
+        cc->batch_buf_len = 0;
+    }
+
+    return result;
+}
+
+/*********************************************************************//**
+**
+** ExecuteCliBatchCommand
+**
+** Performs a single command of the batch, sending back its result as a line of JSON
+** NOTE: This function alters the input buffer pointed to by line
+**
+** \param   cc - pointer to CLI client running the batch session
+** \param   line - command and its arguments, separated by spaces. The last argument extends to the end of the line
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ExecuteCliBatchCommand(cli_client_t *cc, char *line)
+{
+    int i;
+    int err;
+    int len;
+    char *command;
+    char *args;
+    char *arg1 = NULL;
+    char *arg2 = NULL;
+    cli_cmd_t *cli_cmd = NULL;
+
+    // Remove any trailing CR (if the batch file has DOS line endings)
+    len = strlen(line);
+    if ((len > 0) && (line[len-1] == '\r'))
+    {
+        line[len-1] = '\0';
+    }
+
+    // Exit if the line is blank or is a comment
+    command = TEXT_UTILS_TrimBuffer(line);
+    if ((*command == '\0') || (*command == '#'))
+    {
+        return USP_ERR_OK;
+    }
+
+    // Split the command from its arguments
+    args = strchr(command, ' ');
+    if (args != NULL)
+    {
+        *args = '\0';
+        args = TEXT_UTILS_TrimBuffer(&args[1]);
+    }
+
+    cc->batch_num_cmds++;
+    batch_result = json_mkobject();
+    json_append_member(batch_result, "id", json_mknumber(cc->batch_num_cmds));
+    json_append_member(batch_result, "cmd", json_mkstring(command));
+    USP_ERR_ClearMessage();
+
+    // Exit if the command is not allowed in a batch
+    for (i=0; i<NUM_ELEM(cli_commands); i++)
+    {
+        if (strcmp(command, cli_commands[i].name)==0)
+        {
+            cli_cmd = &cli_commands[i];
+            break;
+        }
+    }
+
+    if ((cli_cmd == NULL) || (cli_cmd->allowed_in_batch == false))
+    {
+        USP_ERR_SetMessage("%s: Command '%s' is not supported in a batch", __FUNCTION__, command);
+        err = USP_ERR_INVALID_ARGUMENTS;
+        goto exit;
+    }
+
+    // Exit if the command's arguments are missing
+    if ((args == NULL) || (*args == '\0'))
+    {
+        USP_ERR_SetMessage("%s: Missing arguments. Usage: %s", __FUNCTION__, cli_cmd->usage);
+        err = USP_ERR_INVALID_ARGUMENTS;
+        goto exit;
+    }
+
+    // Split off the value (for the set command). The value may contain spaces, and may be empty
+    arg1 = args;
+    if (cli_cmd->num_args == 2)
+    {
+        arg2 = strchr(args, ' ');
+        if (arg2 == NULL)
+        {
+            USP_ERR_SetMessage("%s: Missing arguments. Usage: %s", __FUNCTION__, cli_cmd->usage);
+            err = USP_ERR_INVALID_ARGUMENTS;
+            goto exit;
+        }
+        *arg2 = '\0';
+        arg2++;
+    }
+
+    err = cli_cmd->exec_cmd(arg1, arg2, cli_cmd->usage);
+
+exit:
+    // Send back the result of the command
+    if (err == USP_ERR_OK)
+    {
+        json_prepend_member(batch_result, "status", json_mkstring("ok"));
+    }
+    else
+    {
+        cc->batch_num_errors++;
+        json_prepend_member(batch_result, "status", json_mkstring("error"));
+        json_append_member(batch_result, "err", json_mknumber(err));
+        json_append_member(batch_result, "message", json_mkstring(USP_ERR_GetMessage()));
+    }
+
+    SendCliBatchLine(cc, batch_result);
+    json_delete(batch_result);
+    batch_result = NULL;
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** FinishCliBatch
+**
+** Called when the client has sent all commands of the batch
+** Performs all remaining commands (for an atomic batch, this is all commands, in a single transaction)
+** then sends a final line of JSON summarising the batch
+**
+** \param   cc - pointer to CLI client running the batch session
+**
+** \return  None
+**
+**************************************************************************/
+void FinishCliBatch(cli_client_t *cc)
+{
+    int err;
+    dm_trans_vector_t trans;
+    JsonNode *node;
+    char *status;
+
+    if (cc->is_batch_atomic)
+    {
+        // Exit if unable to start the transaction containing all commands of the batch
+        err = DM_TRANS_Start(&trans);
+        if (err == USP_ERR_OK)
+        {
+            is_cli_batch_trans_active = true;
+            err = ProcessCliBatchCommands(cc, true, true);
+            is_cli_batch_trans_active = false;
+
+            // Commit the transaction only if all commands were successful
+            if (err == USP_ERR_OK)
+            {
+                err = DM_TRANS_Commit();
+            }
+            else
+            {
+                DM_TRANS_Abort();
+            }
+        }
+
+        // Activate all STOMP reconnects or scheduled exits
+        if (err == USP_ERR_OK)
+        {
+            MTP_EXEC_ActivateScheduledActions();
+        }
+        status = (err == USP_ERR_OK) ? "committed" : "aborted";
+    }
+    else
+    {
+        ProcessCliBatchCommands(cc, true, false);
+        status = "complete";
+    }
+
+    // Send back the summary of the batch
+    node = json_mkobject();
+    json_append_member(node, "status", json_mkstring(status));
+    json_append_member(node, "commands", json_mknumber(cc->batch_num_cmds));
+    json_append_member(node, "errors", json_mknumber(cc->batch_num_errors));
+    SendCliBatchLine(cc, node);
+    json_delete(node);
+}
+
+/*********************************************************************//**
+**
+** SendCliBatchLine
+**
+** Sends the specified JSON object to the CLI client, as a single line
+**
+** \param   cc - pointer to CLI client to send the JSON object to
+** \param   node - JSON object to send
+**
+** \return  None
+**
+**************************************************************************/
+void SendCliBatchLine(cli_client_t *cc, JsonNode *node)
+{
+    char *buf;
+
+    buf = json_encode(node);
+    AppendCliClientOutput(cc, buf, strlen(buf));
+    AppendCliClientOutput(cc, "\n", 1);
+    free(buf);      // NOTE: json_encode() allocates using malloc
+}
+
+/*********************************************************************//**
+**
+** GetCliBatchResultMember
+**
+** Gets the specified member of the result of the batch command currently being performed, creating it if it does not exist yet
+**
+** \param   name - name of the member
+** \param   is_array - Set if the member is a JSON array, otherwise it is a JSON object
+**
+** \return  pointer to member
+**
+**************************************************************************/
+JsonNode *GetCliBatchResultMember(char *name, bool is_array)
+{
+    JsonNode *member;
+
+    member = json_find_member(batch_result, name);
+    if (member == NULL)
+    {
+        member = (is_array) ? json_mkarray() : json_mkobject();
+        json_append_member(batch_result, name, member);
+    }
+
+    return member;
+}
+
+/*********************************************************************//**
+**
+** SendCliParamResponse
+**
+** Sends back the value of a parameter to the CLI client
+** If performing a batch command, the parameter is added to the 'result' object of the command's JSON result
+**
+** \param   path - data model path of the parameter
+** \param   value - value of the parameter
+**
+** \return  None
+**
+**************************************************************************/
+void SendCliParamResponse(char *path, char *value)
+{
+    if (batch_result != NULL)
+    {
+        json_append_member(GetCliBatchResultMember("result", false), path, json_mkstring(value));
+        return;
+    }
+
+    SendCliResponse("%s => %s\n", path, value);
+}
+
+/*********************************************************************//**
+**
+** SendCliObjectResponse
+**
+** Sends back the path of an object which was added or deleted to the CLI client
+** If performing a batch command, the path is added to the 'objects' array of the command's JSON result
+**
+** \param   action - description of what happened to the object (eg 'Added', 'Deleted')
+** \param   path - data model path of the object
+**
+** \return  None
+**
+**************************************************************************/
+void SendCliObjectResponse(char *action, char *path)
+{
+    if (batch_result != NULL)
+    {
+        json_append_element(GetCliBatchResultMember("objects", true), json_mkstring(path));
+        return;
+    }
+
+    SendCliResponse("%s %s\n", action, path);
+}
+
+/*********************************************************************//**
+**
+** StartCliTransaction
+**
+** Starts a transaction for a CLI command which modifies the data model
+** If performing the commands of an atomic batch, then the command is already within the batch's transaction, so nothing is done
+**
+** \param   trans - pointer to vector to use when building up the transaction
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartCliTransaction(dm_trans_vector_t *trans)
+{
+    if (is_cli_batch_trans_active)
+    {
+        return USP_ERR_OK;
+    }
+
+    return DM_TRANS_Start(trans);
+}
+
+/*********************************************************************//**
+**
+** CommitCliTransaction
+**
+** Commits the transaction of a CLI command which modifies the data model
+** If performing the commands of an atomic batch, then the batch's transaction is committed later, once all commands have been performed
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int CommitCliTransaction(void)
+{
+    if (is_cli_batch_trans_active)
+    {
+        return USP_ERR_OK;
+    }
+
+    return DM_TRANS_Commit();
+}
+
+/*********************************************************************//**
+**
+** AbortCliTransaction
+**
+** Aborts the transaction of a CLI command which modifies the data model
+** If performing the commands of an atomic batch, then the batch's transaction is aborted later, as the command's error causes the batch to fail
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void AbortCliTransaction(void)
+{
+    if (is_cli_batch_trans_active)
+    {
+        return;
+    }
+
+    DM_TRANS_Abort();
 }
 
 /*********************************************************************//**
@@ -1646,6 +2750,7 @@ void SendCliResponse(char *fmt, ...)
 {
     va_list ap;
     char buf[USP_ERR_MAXLEN];
+    int len;
 
     // Write the USP error message into the local store
     va_start(ap, fmt);
@@ -1653,6 +2758,18 @@ void SendCliResponse(char *fmt, ...)
     buf[sizeof(buf)-1] = '\0';
     va_end(ap);
 
+    // If performing a batch command, then the message is returned as part of the command's JSON result
+    if (batch_result != NULL)
+    {
+        len = strlen(buf);
+        if ((len > 0) && (buf[len-1] == '\n'))
+        {
+            buf[len-1] = '\0';
+        }
+        json_append_element(GetCliBatchResultMember("messages", true), json_mkstring(buf));
+        return;
+    }
+
     CLI_SERVER_SendResponse(buf);
 }
 
@@ -62,12 +62,17 @@
 #include "msg_handler.h"
 #include "os_utils.h"
 #include "dllist.h"
+#include "mtp_send_queue.h"
 #include "dm_exec.h"
 #include "retry_wait.h"
 #include "usp_coap.h"
 #include "text_utils.h"
 #include "nu_ipaddr.h"
+#include "dns_cache.h"
 #include "iso8601.h"
+#include "device.h"
+#include "uptime.h"
+#include "usp_probe.h"
 
 
 //------------------------------------------------------------------------
@@ -82,6 +87,7 @@ typedef struct
     int mtp_instance;            // Instance number of the MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
     bool enable_encryption;      // Set if encryption should be enabled for this client
     double_linked_list_t send_queue; // Queue of messages to send on this CoAP connection
+    int send_queue_len;          // Number of messages in send_queue
 
     int socket_fd;               // When sending to a controller, this socket sends CoAP BLOCKs and receives CoAP ACKs
     nu_ipaddr_t  peer_addr;      // IP Address of USP controller that socket_fd is sending to
@@ -105,9 +111,11 @@ typedef struct
     int reconnect_timeout_ms;    // Timeout to next trying to reconnect
     time_t reconnect_time;       // Time at which we try to connect the socket again. This is used if we're unable to resolve the server IP address
                                  // This variable is only valid if socket_fd==INVALID
+    bool is_resolving_host;      // Set if waiting for the (asynchronous) DNS lookup of the controller's hostname to complete. Only valid if socket_fd==INVALID
     int reconnect_count;         // Count of number of times that we've tried reconnecting. NOTE: This also includes a count of the retransmission counter
     time_t linger_time;          // time at which we close the connection because we have no more USP Records to send
 
+    int send_credits[kMtpSendPriority_Max]; // Weighted round robin credits remaining for each send priority (see MTP_SEND_QUEUE_SelectPriority)
 } coap_client_t;
 
 
@@ -121,6 +129,7 @@ typedef struct
     Usp__Header__MsgType usp_msg_type;  // Type of USP message contained within pbuf
     unsigned char *pbuf;    // Protobuf format message to send in binary format
     int pbuf_len;           // Length of protobuf message to send
+    unsigned digest;        // Hash of the protobuf message. Used to speed up detection of duplicate messages in the queue
     char *host;             // Hostname of the controller to send to
     coap_config_t config;   // Port, resource and whether encryption is enabled
     bool coap_reset_session_hint;       // Set if an existing DTLS session with this host should be reset. 
@@ -129,6 +138,9 @@ typedef struct
                                         // the CoAP retry mechanism will cause the DTLS session to restart, but it is a while
                                         // before the retry is triggered, so this hint speeds up communications
     time_t expiry_time;     // Time at which this message should be removed from the queue
+    unsigned long long queued_time;     // Time (in microseconds, from tu_uptime_usecs()) at which this message was added to the queue
+    unsigned long long send_start_time; // Time (in microseconds, from tu_uptime_usecs()) at which this message started to be sent
+    mtp_send_priority_t priority;       // Send priority of this message
 
 } coap_send_item_t;
 
@@ -164,7 +176,9 @@ coap_client_t *FindUnusedCoapClient(void);
 coap_client_t *FindCoapClientByInstance(int cont_instance, int mtp_instance);
 void CloseCoapClientSocket(coap_client_t *cc);
 void FreeCoapSendItem(coap_client_t *cc, coap_send_item_t *csi);
-bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len);
+bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len, unsigned digest);
+bool DropQueuedCoapMessage(coap_client_t *cc, mtp_send_priority_t priority, time_t expiry_time);
+void ScheduleCoapUspRecord(coap_client_t *cc);
 int PerformClientDtlsConnect(coap_client_t *cc, struct sockaddr_storage *remote_addr);
 void HandleCoapClientConnectionError(coap_client_t *cc);
 void RemoveExpiredCoapMessages(coap_client_t *cc);
@@ -296,6 +310,7 @@ int COAP_CLIENT_Start(int cont_instance, int mtp_instance, char *endpoint_id)
     cc->socket_fd = INVALID;
     cc->message_id = rand_r(&mtp_thread_random_seed) & 0xFFFF;
     cc->reconnect_time = INVALID_TIME;
+    cc->is_resolving_host = false;
     cc->reconnect_count = 0;
     cc->reconnect_timeout_ms = CalcCoapInitialTimeout();
     
@@ -408,7 +423,10 @@ void COAP_CLIENT_UpdateAllSockSet(socket_set_t *set)
                 timeout = MAX_SOCKET_TIMEOUT_SECONDS;
                 if (cc->linger_time != INVALID_TIME)
                 {
+                    // NOTE: The end of the linger period is added separately, so that it may be coalesced with other timer events
                     CALC_TIMEOUT(timeout, cc->linger_time);
+                    SOCKET_SET_UpdateTimeoutWithSlack(timeout*1000, COAP_LINGER_SLACK, set);
+                    timeout = MAX_SOCKET_TIMEOUT_SECONDS;
                 }
                 else if (cc->ack_timeout_time != INVALID_TIME)
                 {
@@ -424,7 +442,7 @@ void COAP_CLIENT_UpdateAllSockSet(socket_set_t *set)
                 if (cc->reconnect_time != INVALID_TIME)
                 {
                     CALC_TIMEOUT(timeout, cc->reconnect_time);
-                    SOCKET_SET_UpdateTimeout(timeout*1000, set);
+                    SOCKET_SET_UpdateTimeoutWithSlack(timeout*1000, MTP_RETRY_SLACK, set);
                 }
             }
         }
@@ -482,6 +500,11 @@ void COAP_CLIENT_ProcessAllSocketActivity(socket_set_t *set)
                 {
                     StartSendingCoapUspRecord(cc, RETRY_CURRENT);
                 }
+                else if (cc->is_resolving_host)
+                {
+                    // Continue sending, if the lookup of the controller's IP address has completed
+                    StartSendingCoapUspRecord(cc, RETRY_CURRENT);
+                }
             }
         }
     }
@@ -498,7 +521,7 @@ void COAP_CLIENT_ProcessAllSocketActivity(socket_set_t *set)
 ** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
 ** \param   pbuf - pointer to buffer containing binary protobuf message. Ownership of this buffer passes to this code, if successful
 ** \param   pbuf_len - length of buffer containing protobuf binary message
-** \param   mrt - pointer to structure containing CoAP parameters describing CoAP destination to send to
+** \param   mrt - pointer to structure containing CoAP parameters describing CoAP destination to send to, and the send priority of the USP message
 ** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
 **
 ** \return  USP_ERR_OK if successful
@@ -510,6 +533,8 @@ int COAP_CLIENT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int cont_i
     coap_send_item_t *csi;
     int err;
     bool is_duplicate;
+    bool is_dropped;
+    unsigned digest;
 
     COAP_LockMutex();
 
@@ -532,9 +557,12 @@ int COAP_CLIENT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int cont_i
 
     // Do not add this message to the queue, if it is already present in the queue
     // This situation could occur if a notify is being retried to be sent, but is already held up in the queue pending sending
-    is_duplicate = IsUspRecordInCoapQueue(cc, pbuf, pbuf_len);
+    // NOTE: Ownership of pbuf has passed to this code, so it must be freed here
+    digest = TEXT_UTILS_CalcBufferHash(pbuf, pbuf_len);
+    is_duplicate = IsUspRecordInCoapQueue(cc, pbuf, pbuf_len, digest);
     if (is_duplicate)
     {
+        USP_FREE(pbuf);
         err = USP_ERR_OK;
         goto exit;
     }
@@ -542,19 +570,47 @@ int COAP_CLIENT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int cont_i
     // Remove any queued messages that have expired (apart from the first message, which mustn't be removed because it is currently being sent out)
     RemoveExpiredCoapMessages(cc);
 
+    // Exit if the queue is full, and this message is less important than all of the queued messages
+    // (otherwise the least important queued message is dropped to make room for this one)
+    if (cc->send_queue_len >= MAX_COAP_CLIENT_QUEUED_MSGS)
+    {
+        is_dropped = DropQueuedCoapMessage(cc, mrt->send_priority, expiry_time);
+        if (is_dropped == false)
+        {
+            USP_LOG_Warning("%s: CoAP send queue full. Dropping %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(usp_msg_type));
+            USP_FREE(pbuf);
+            err = USP_ERR_OK;
+            goto exit;
+        }
+    }
+
+    // Exit if the MTP send queues have used up their memory budget, and this message is a low priority notification
+    if (MTP_SEND_QUEUE_ChargeBudget(mrt->send_priority, pbuf_len) == false)
+    {
+        USP_LOG_Warning("%s: MTP send queue memory budget exceeded. Dropping %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(usp_msg_type));
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
     // Add the item to the queue
     csi = USP_MALLOC(sizeof(coap_send_item_t));
     csi->usp_msg_type = usp_msg_type;
     csi->pbuf = pbuf;
     csi->pbuf_len = pbuf_len;
+    csi->digest = digest;
     csi->host = USP_STRDUP(mrt->coap_host);
     csi->config.port = mrt->coap_port;
     csi->config.resource = USP_STRDUP(mrt->coap_resource);
     csi->config.enable_encryption = mrt->coap_encryption;
     csi->coap_reset_session_hint = mrt->coap_reset_session_hint;
     csi->expiry_time = expiry_time;
+    csi->queued_time = tu_uptime_usecs();
+    csi->send_start_time = 0;
+    csi->priority = mrt->send_priority;
 
     DLLIST_LinkToTail(&cc->send_queue, csi);
+    cc->send_queue_len++;
 
     // If the queue was empty, then this will be the first item in the queue
     // So send out this item
@@ -679,15 +735,22 @@ exit:
     // Handle sending the next block
     if (action_flags & SEND_NEXT_BLOCK)
     {
-        cc->cur_block++;
         cc->bytes_sent += cc->block_size;
         cc->message_id = NEXT_MESSAGE_ID(cc->message_id);
         cc->ack_timeout_ms = CalcCoapInitialTimeout();
         cc->retransmission_counter = 0;
     
         // Change the size of the next blocks being sent out, if the receiver requested it, 
-        //and the size they requested is less than our current (otherwise ignore the request)
-        cc->block_size = MIN(cc->block_size, pp.block_size);
+        // and the size they requested is less than our current (otherwise ignore the request)
+        if (pp.block_size < cc->block_size)
+        {
+            USP_PROTOCOL("%s: Receiver requested smaller block size (block_size=%d, previously=%d)", __FUNCTION__, pp.block_size, cc->block_size);
+            cc->block_size = pp.block_size;
+        }
+
+        // Calculate the number of the next block, in terms of the (possibly reduced) block size (RFC7959 section 2.3)
+        // NOTE: This is exact because block sizes are powers of 2, so bytes_sent is always a multiple of the new block size
+        cc->cur_block = cc->bytes_sent / cc->block_size;
     
         // Send the next block
         err = SendCoapBlock(cc);
@@ -818,6 +881,7 @@ unsigned CalcCoapClientActions(coap_client_t *cc, parsed_pdu_t *pp)
 
         USP_PROTOCOL("%s: Received CoAP ACK 'Changed' (MID=%d)", __FUNCTION__, pp->message_id);
         USP_PROTOCOL("%s: USP Message sent successfully", __FUNCTION__);
+        DEVICE_MSG_STATS_Record(csi->usp_msg_type, kMsgStat_WireSend, csi->send_start_time);
         return SEND_NEXT_USP_RECORD;
     }
 
@@ -918,6 +982,7 @@ void StartSendingCoapUspRecord(coap_client_t *cc, unsigned flags)
     coap_send_item_t *csi;
     nu_ipaddr_t csi_peer_addr;
     bool prefer_ipv6;
+    bool is_pending;
 
     // Drop the current queued USP Record (if required)
     if (flags & SEND_NEXT)
@@ -929,6 +994,7 @@ void StartSendingCoapUspRecord(coap_client_t *cc, unsigned flags)
     cc->ack_timeout_time = INVALID_TIME;
     cc->reconnect_time = INVALID_TIME;
     cc->linger_time = INVALID_TIME;
+    cc->is_resolving_host = false;
 
     // Reset the reconnect count, if this is not a connect retry
     if ((flags & RETRY_CURRENT) == 0)
@@ -940,6 +1006,12 @@ void StartSendingCoapUspRecord(coap_client_t *cc, unsigned flags)
     // First remove all expired messages from the queue
     RemoveExpiredCoapMessages(cc);
 
+    // If moving on to the next USP Record, then select it in send priority order
+    if (flags & SEND_NEXT)
+    {
+        ScheduleCoapUspRecord(cc);
+    }
+
     // Exit if no more USP Records to send, starting a linger timer to keep the socket
     // connected for a while, in case a USP Record becomes ready to send soon
     csi = (coap_send_item_t *)cc->send_queue.head;
@@ -949,10 +1021,13 @@ void StartSendingCoapUspRecord(coap_client_t *cc, unsigned flags)
         return;
     }
 
-    // Log the message, if we are not resending it
+    // Log the message (and record how long it was queued for), if we are not resending it
     if ((flags & RETRY_CURRENT) == 0)
     {
         MSG_HANDLER_LogMessageToSend(csi->usp_msg_type, csi->pbuf, csi->pbuf_len, kMtpProtocol_CoAP, csi->host, NULL, kMtpContentType_UspRecord);
+        csi->send_start_time = tu_uptime_usecs();
+        DEVICE_MSG_STATS_RecordDuration(csi->usp_msg_type, kMsgStat_SendQueueWait,
+                                        (csi->send_start_time > csi->queued_time) ? csi->send_start_time - csi->queued_time : 0);
     }
 
     // Attempt to interpret the host as an IP literal address (ie no DNS lookup required)
@@ -966,12 +1041,21 @@ void StartSendingCoapUspRecord(coap_client_t *cc, unsigned flags)
         prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
     
         // Exit if unable to lookup the IP address of the USP controller to send to
-        err = tw_ulib_diags_lookup_host(csi->host, AF_UNSPEC, prefer_ipv6, NULL, &csi_peer_addr);
+        err = DNS_CACHE_LookupHost(csi->host, AF_UNSPEC, prefer_ipv6, NULL, &csi_peer_addr, &is_pending);
         if (err != USP_ERR_OK)
         {
             RetryClientSendLater(cc, 0);
             return;
         }
+
+        // Exit if the IP address of the USP controller is still being looked up
+        // Sending is retried when the DNS cache wakes up this thread after the lookup completes
+        if (is_pending)
+        {
+            StopSendingToController(cc);
+            cc->is_resolving_host = true;
+            return;
+        }
     }
 
     // Close the socket, if the next message needs to send to a different IP address/port or the request was received on a new DTLS session
@@ -1197,6 +1281,7 @@ void StopSendingToController(coap_client_t *cc)
     cc->ack_timeout_time = INVALID_TIME;
     cc->reconnect_time = INVALID_TIME;
     cc->linger_time = INVALID_TIME;
+    cc->is_resolving_host = false;
 }
 
 /*********************************************************************//**
@@ -1366,6 +1451,8 @@ int SendCoapBlock(coap_client_t *cc)
         return err;
     }
 
+    USP_PROBE3(mtp_write, kMtpProtocol_CoAP, ((coap_send_item_t *)cc->send_queue.head)->host, len);
+
     return USP_ERR_OK;
 }
 
@@ -1613,6 +1700,7 @@ void CloseCoapClientSocket(coap_client_t *cc)
     }
 
     // Close the socket
+    SOCKET_SET_ForgetSocket(cc->socket_fd);
     close(cc->socket_fd);
 
     // Zero out all state associated with the socket
@@ -1680,10 +1768,12 @@ void FreeCoapSendItem(coap_client_t *cc, coap_send_item_t *csi)
     USP_ASSERT(csi != NULL);
 
     // Remove and free the specified item in the queue
+    MTP_SEND_QUEUE_ReleaseBudget(csi->pbuf_len);
     USP_FREE(csi->pbuf);
     USP_FREE(csi->host);
     USP_FREE(csi->config.resource);
     DLLIST_Unlink(&cc->send_queue, csi);
+    cc->send_queue_len--;
     USP_FREE(csi);
 }
 
@@ -1697,11 +1787,12 @@ void FreeCoapSendItem(coap_client_t *cc, coap_send_item_t *csi)
 ** \param   cc - coap client which has USP records queued to send
 ** \param   pbuf - pointer to buffer containing USP Record to match against
 ** \param   pbuf_len - length of buffer containing USP Record to match against
+** \param   digest - hash of the USP Record to match against (calculated by TEXT_UTILS_CalcBufferHash)
 **
 ** \return  true if the message is already queued
 **
 **************************************************************************/
-bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len)
+bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len, unsigned digest)
 {
     coap_send_item_t *csi;
 
@@ -1710,7 +1801,8 @@ bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len
     while (csi != NULL)
     {
         // Exit if the USP record is already in the queue
-        if ((csi->pbuf_len == pbuf_len) && (memcmp(csi->pbuf, pbuf, pbuf_len)==0))
+        // NOTE: The digest is compared first, so that the full record only needs to be compared if it is very likely to match
+        if ((csi->digest == digest) && (csi->pbuf_len == pbuf_len) && (memcmp(csi->pbuf, pbuf, pbuf_len)==0))
         {
              return true;
         }
@@ -1723,6 +1815,111 @@ bool IsUspRecordInCoapQueue(coap_client_t *cc, unsigned char *pbuf, int pbuf_len
     return false;
 }
 
+/*********************************************************************//**
+**
+** DropQueuedCoapMessage
+**
+** Called when the CoAP client's send queue is full, to drop the least important queued message
+** Messages of the lowest send priority are dropped in preference to others (eg Periodic! notifications are dropped before
+** responses to controller requests), and messages of the same send priority are dropped soonest expiring first
+** NOTE: The message at the head of the queue is never dropped, because it is currently being sent out
+**
+** \param   cc - coap client which has USP records queued to send
+** \param   priority - send priority of the new USP message that is waiting to be queued
+** \param   expiry_time - time at which the new USP message would be removed from the queue
+**
+** \return  true if a queued message was dropped, false if the new message is the least important (and should be dropped instead)
+**
+**************************************************************************/
+bool DropQueuedCoapMessage(coap_client_t *cc, mtp_send_priority_t priority, time_t expiry_time)
+{
+    coap_send_item_t *csi;
+    coap_send_item_t *victim = NULL;
+
+    // Iterate over all queued messages (apart from the one currently being sent), finding the least important
+    csi = (coap_send_item_t *) cc->send_queue.head;
+    USP_ASSERT(csi != NULL);
+    csi = (coap_send_item_t *) csi->link.next;
+    while (csi != NULL)
+    {
+        if ((victim == NULL) ||
+            (csi->priority > victim->priority) ||
+            ((csi->priority == victim->priority) && (csi->expiry_time < victim->expiry_time)))
+        {
+            victim = csi;
+        }
+
+        csi = (coap_send_item_t *) csi->link.next;
+    }
+
+    // Exit if there is no queued message that can be dropped
+    if (victim == NULL)
+    {
+        return false;
+    }
+
+    // Exit if the new message is less important than the least important queued message
+    if ((priority > victim->priority) ||
+        ((priority == victim->priority) && (expiry_time < victim->expiry_time)))
+    {
+        return false;
+    }
+
+    USP_LOG_Warning("%s: CoAP send queue full. Dropping queued %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(victim->usp_msg_type));
+    FreeCoapSendItem(cc, victim);
+    return true;
+}
+
+/*********************************************************************//**
+**
+** ScheduleCoapUspRecord
+**
+** Selects the next USP Record to send (using the weighted round robin over the send priorities of the queued USP Records)
+** and moves it to the head of the queue, from where it is sent
+** NOTE: The CoAP client sends only one USP Record at a time (and its queue is short), so all send priorities share
+**       a single queue, and the USP Record to send is selected when the previous one has finished being sent
+**
+** \param   cc - coap client which has USP records queued to send
+**
+** \return  None
+**
+**************************************************************************/
+void ScheduleCoapUspRecord(coap_client_t *cc)
+{
+    coap_send_item_t *csi;
+    unsigned pending_mask;
+    mtp_send_priority_t priority;
+
+    // Determine which send priorities have USP Records queued
+    pending_mask = 0;
+    csi = (coap_send_item_t *) cc->send_queue.head;
+    while (csi != NULL)
+    {
+        pending_mask |= (1 << csi->priority);
+        csi = (coap_send_item_t *) csi->link.next;
+    }
+
+    // Exit if there are no USP Records queued
+    priority = MTP_SEND_QUEUE_SelectPriority(cc->send_credits, pending_mask);
+    if (priority == kMtpSendPriority_Max)
+    {
+        return;
+    }
+
+    // Move the oldest USP Record of the selected send priority to the head of the queue
+    csi = (coap_send_item_t *) cc->send_queue.head;
+    while (csi->priority != priority)
+    {
+        csi = (coap_send_item_t *) csi->link.next;
+    }
+
+    if (csi != (coap_send_item_t *) cc->send_queue.head)
+    {
+        DLLIST_Unlink(&cc->send_queue, csi);
+        DLLIST_LinkToHead(&cc->send_queue, csi);
+    }
+}
+
 
 
 
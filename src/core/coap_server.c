@@ -41,6 +41,9 @@
 
 #ifdef ENABLE_COAP  // NOTE: This isn't strictly necessary as this file is not included in the build if CoAP is disabled
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // for recvmmsg()
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <arpa/inet.h>
@@ -67,6 +70,7 @@
 #include "usp_coap.h"
 #include "text_utils.h"
 #include "nu_ipaddr.h"
+#include "dns_cache.h"
 #include "iso8601.h"
 
 //------------------------------------------------------------------------
@@ -99,6 +103,10 @@ typedef struct
     nu_ipaddr_t peer_addr;   // Current peer that sent the first block. Whilst building up a USP Record, only PDUs from this peer are accepted
     uint16_t peer_port;     // Port that peer is using to communicate with us
 
+    bool is_dtls_rx_seq_known;      // Set if the epoch and sequence number of the last DTLS application data record received on this session are known
+    unsigned dtls_rx_epoch;         // Epoch and sequence number of the last DTLS application data record received on this session
+    unsigned long long dtls_rx_seq; // These are used to identify the session, if the peer's address changes (see FindMigratingDtlsSession)
+
     unsigned char token[8]; // Token received in the first block. The server must use the same token for the rest of the blocks.
     int token_size;
 
@@ -150,9 +158,34 @@ SSL_CTX *coap_server_ssl_ctx = NULL;
 // Buffer containing the random secret that our CoAP server puts into cookies
 static unsigned char coap_hmac_key[16];
 
+//------------------------------------------------------------------------------
+// Context ID for DTLS sessions cached by our CoAP server. OpenSSL requires this to be set, in order to resume sessions whose peer was verified
+static unsigned char coap_session_id_context[] = "obuspa-coap";
+
+//------------------------------------------------------------------------------
+// Index of the ex_data slot in cached SSL_SESSION objects, which stores the controller trust determined during the full DTLS handshake
+// This is necessary because the certificate verify callback is not called when a DTLS session is resumed
+static int coap_session_trust_index = -1;
+
+//------------------------------------------------------------------------------
+// Definitions for the DTLS 1.2 record header (RFC6347 section 4.1), used to identify the session of a record received from a new peer address
+// NOTE: OpenSSL does not support the DTLS Connection ID extension (RFC9146), so the epoch and sequence number are used instead
+#define DTLS_RECORD_HEADER_LEN         13      // content_type(1), version(2), epoch(2), sequence_number(6), length(2)
+#define DTLS_CONTENT_TYPE_APP_DATA     23
+
+//------------------------------------------------------------------------------
+// Structure containing the controller trust stored with a cached DTLS session
+typedef struct
+{
+    ctrust_role_t role;             // Role granted by the CA cert in the chain of trust with the CoAP client
+    char *allowed_controllers;      // Pattern describing the endpoint_id of controllers which are granted access to this agent
+} coap_session_trust_t;
+
 //------------------------------------------------------------------------------
 // Variables associated with determining whether the listening IP address of our CoAP server has changed (used by UpdateCoapServerInterfaces)
-static time_t next_coap_server_if_poll_time = 0;   // Absolute time at which to next poll for IP address change
+static time_t next_coap_server_if_poll_time = 0;   // Absolute time at which to next poll for IP address change. Only used if coap_server_addr_change_sock is INVALID
+static int coap_server_addr_change_sock = INVALID; // Netlink socket notifying IP address changes, or INVALID if the IP addresses must be polled instead
+static bool is_coap_server_addr_changed = false;   // Set if coap_server_addr_change_sock has notified that an IP address has changed since it was last checked
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
@@ -160,6 +193,8 @@ int StartCoapListenSock(coap_server_t *cs);
 void InitCoapSession(coap_server_session_t *css);
 coap_server_session_t *FindCoapSession(coap_server_t *cs, nu_ipaddr_t *peer_addr);
 void ReceiveCoapBlock(coap_server_t *cs, coap_server_session_t *css);
+void ReceiveCoapBlockBatch(coap_server_t *cs, coap_server_session_t *css);
+void HandleCoapBlock(coap_server_t *cs, coap_server_session_t *css, unsigned char *buf, int len);
 void StartCoapSession(coap_server_t *cs);
 void StopCoapSession(coap_server_session_t *css);
 void FreeReceivedUspRecord(coap_server_session_t *css);
@@ -169,6 +204,8 @@ unsigned HandleSubsequentCoapBlock(coap_server_t *cs, coap_server_session_t *css
 unsigned AppendCoapPayload(coap_server_session_t *css, parsed_pdu_t *pp);
 int GetPeerAddr(int sock, nu_ipaddr_t *peer_addr, uint16_t *peer_port);
 bool IsReplyToValid(coap_server_session_t *css, parsed_pdu_t *pp);
+bool IsReplyToLookupPending(coap_server_session_t *css, parsed_pdu_t *pp);
+int LookupReplyToHost(coap_server_session_t *css, parsed_pdu_t *pp, char *host, int host_len, nu_ipaddr_t *reply_addr, bool *is_pending);
 int SendCoapRstFromServer(coap_server_session_t *css, parsed_pdu_t *pp);
 int SendCoapAck(coap_server_session_t *css, parsed_pdu_t *pp, unsigned action_flags);
 int WriteCoapAck(unsigned char *buf, int len, parsed_pdu_t *pp, unsigned action_flags);
@@ -182,6 +219,12 @@ int UpdateCoapServerInterfaces(void);
 int PerformSessionDtlsConnect(coap_server_session_t *css);
 int CalcCoapServerCookie(SSL *ssl, unsigned char *buf, unsigned int *p_len);
 int VerifyCoapServerCookie(SSL *ssl, SSL_CONST unsigned char *buf, unsigned int len);
+void SaveCoapSessionTrust(coap_server_session_t *css);
+int RestoreCoapSessionTrust(coap_server_session_t *css);
+void FreeCoapSessionTrust(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp);
+bool PeekDtlsAppDataRecord(int sock, unsigned *epoch, unsigned long long *seq);
+coap_server_session_t *FindMigratingDtlsSession(coap_server_t *cs, nu_ipaddr_t *peer_addr, unsigned epoch, unsigned long long seq);
+void MigrateDtlsSession(coap_server_t *cs, coap_server_session_t *css, nu_ipaddr_t *peer_addr, uint16_t peer_port);
 
 /*********************************************************************//**
 **
@@ -246,8 +289,25 @@ int COAP_SERVER_InitStart(void)
 	SSL_CTX_set_cookie_generate_cb(coap_server_ssl_ctx, CalcCoapServerCookie);
 	SSL_CTX_set_cookie_verify_cb(coap_server_ssl_ctx, VerifyCoapServerCookie);
 
-	SSL_CTX_set_session_cache_mode(coap_server_ssl_ctx, SSL_SESS_CACHE_OFF);
+    // Enable DTLS session resumption, so that a controller which reconnects does not have to perform a full handshake
+    // NOTE: Session tickets are disabled, so that sessions are resumed from our server-side cache, which also stores the controller trust
+    // (ex_data is not carried in session tickets)
+    coap_session_trust_index = SSL_SESSION_get_ex_new_index(0, NULL, NULL, NULL, FreeCoapSessionTrust);
+    if (coap_session_trust_index == -1)
+    {
+        USP_LOG_Error("%s: SSL_SESSION_get_ex_new_index() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    SSL_CTX_set_session_id_context(coap_server_ssl_ctx, coap_session_id_context, sizeof(coap_session_id_context)-1);
+    SSL_CTX_set_session_cache_mode(coap_server_ssl_ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(coap_server_ssl_ctx, COAP_DTLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(coap_server_ssl_ctx, COAP_DTLS_SESSION_LIFETIME);
+    SSL_CTX_set_options(coap_server_ssl_ctx, SSL_OP_NO_TICKET);
 
+    // Subscribe to notifications of IP address changes, so that the CoAP servers can be restarted on the new IP address
+    // NOTE: If this fails, UpdateCoapServerInterfaces() polls for IP address changes instead
+    coap_server_addr_change_sock = nu_ipaddr_open_addr_change_socket();
 
     return USP_ERR_OK;
 }
@@ -278,6 +338,12 @@ void COAP_SERVER_Destroy(void)
         }
     }
 
+    // Close the socket notifying IP address changes
+    if (coap_server_addr_change_sock != INVALID)
+    {
+        close(coap_server_addr_change_sock);
+        coap_server_addr_change_sock = INVALID;
+    }
 }
 
 /*********************************************************************//**
@@ -479,9 +545,13 @@ void COAP_SERVER_UpdateAllSockSet(socket_set_t *set)
     coap_server_session_t *css;
     int timeout;        // timeout in milliseconds
 
-    // Determine whether IP address of any of CoAP servers has changed (if time to poll it)
+    // Determine whether IP address of any of CoAP servers has changed (if notified of a change, or time to poll it)
     timeout = UpdateCoapServerInterfaces();
-    SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);
+    SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, MGMT_IF_POLL_SLACK, set);
+    if (coap_server_addr_change_sock != INVALID)
+    {
+        SOCKET_SET_AddSocketToReceiveFrom(coap_server_addr_change_sock, MAX_SOCKET_TIMEOUT, set);
+    }
 
     // Iterate over all CoAP servers
     for (i=0; i<MAX_COAP_SERVERS; i++)
@@ -525,6 +595,15 @@ void COAP_SERVER_ProcessAllSocketActivity(socket_set_t *set)
     coap_server_t *cs;
     coap_server_session_t *css;
 
+    // Read any notifications of IP address changes. These are acted on by UpdateCoapServerInterfaces()
+    if ((coap_server_addr_change_sock != INVALID) && (SOCKET_SET_IsReadyToRead(coap_server_addr_change_sock, set)))
+    {
+        if (nu_ipaddr_read_addr_change_socket(coap_server_addr_change_sock))
+        {
+            is_coap_server_addr_changed = true;
+        }
+    }
+
     // Service all CoAP server sockets (these receive CoAP BLOCK packets from the controller)
     for (i=0; i<MAX_COAP_SERVERS; i++)
     {
@@ -722,6 +801,8 @@ void StartCoapSession(coap_server_t *cs)
     struct sockaddr_storage saddr;
     socklen_t saddr_len;
     char buf[NU_IPADDRSTRLEN];
+    unsigned epoch;
+    unsigned long long seq;
 
     // Exit if unable to determine the address of the peer sending a CoAP PDU
     err = GetPeerAddr(cs->listen_sock, &peer_addr, &peer_port);
@@ -729,12 +810,25 @@ void StartCoapSession(coap_server_t *cs)
     {
         // Restart the listening socket, if an error occurred whilst getting the peer address
         // (as this would have been caused by an error on the listening socket)
+        SOCKET_SET_ForgetSocket(cs->listen_sock);
         close(cs->listen_sock);
         cs->listen_sock = INVALID;
         StartCoapListenSock(cs);     // NOTE: We can ignore any errors, as UpdateCoapServerInterfaces() will retry later
         return;
     }
 
+    // Exit if the PDU is a DTLS record belonging to an existing session, whose peer has changed address (eg NAT rebinding)
+    // moving the session to the new address, rather than performing a new DTLS handshake
+    if ((cs->enable_encryption) && (PeekDtlsAppDataRecord(cs->listen_sock, &epoch, &seq)))
+    {
+        css = FindMigratingDtlsSession(cs, &peer_addr, epoch, seq);
+        if (css != NULL)
+        {
+            MigrateDtlsSession(cs, css, &peer_addr, peer_port);
+            return;
+        }
+    }
+
     // Find a CoAP session slot, possibly killing an existing session if one is not free otherwise
     css = FindCoapSession(cs, &peer_addr);
     USP_ASSERT(css != NULL)
@@ -804,6 +898,9 @@ void InitCoapSession(coap_server_session_t *css)
     css->role = ROLE_DEFAULT;    // Set default role, if not determined from SSL certs
     memset(&css->peer_addr, 0, sizeof(css->peer_addr));
     css->peer_port = INVALID;
+    css->is_dtls_rx_seq_known = false;
+    css->dtls_rx_epoch = 0;
+    css->dtls_rx_seq = 0;
     memset(&css->token, 0, sizeof(css->token));
     css->token_size = 0;
     css->block_count = 0;
@@ -877,9 +974,6 @@ coap_server_session_t *FindCoapSession(coap_server_t *cs, nu_ipaddr_t *peer_addr
 {
     int j;
     coap_server_session_t *css;
-    time_t cur_time;
-    int score;
-    int max_score = 0;
     coap_server_session_t *chosen_css = NULL;
 
     // Exit if there is an existing unused session
@@ -892,38 +986,28 @@ coap_server_session_t *FindCoapSession(coap_server_t *cs, nu_ipaddr_t *peer_addr
         }
     }
 
-    // Iterate over all existing sessions, choosing the one with the highest score
-    cur_time = time(NULL);
+    // Iterate over all existing sessions, choosing the least recently active one (LRU)
+    // but prioritizing reuse of a session with the same peer (since the peer has evidently abandoned it)
     for (j=0; j<MAX_COAP_SERVER_SESSIONS; j++)
     {
         css = &cs->sessions[j];
-        if (css->socket_fd != INVALID)
+        USP_ASSERT(css->last_block_time > (time_t)0);
+        if (memcmp(peer_addr, &css->peer_addr, sizeof(css->peer_addr))==0)
         {
-            // Choose to reuse sessions with longest inactive time
-            #define MAX_INACTIVE_TIME 3600          // Maximum amount of time before we consider the session to be completely inactive
-            USP_ASSERT(css->last_block_time > (time_t)0);
-            score = cur_time - css->last_block_time;
-            if (score > MAX_INACTIVE_TIME)
-            {
-                score = MAX_INACTIVE_TIME;
-            }
-
-            // Prioritize reuse of sessions with the same peer
-            if (memcmp(peer_addr, &css->peer_addr, sizeof(css->peer_addr))==0)
-            {
-                score += MAX_INACTIVE_TIME+1;
-            }
+            chosen_css = css;
+            break;
+        }
 
-            if (score >= max_score)  // NOTE: Use >=, so that it always finds at least one match (even if score==0)
-            {
-                max_score = score;
-                chosen_css = css;
-            }
+        if ((chosen_css == NULL) || (css->last_block_time < chosen_css->last_block_time))
+        {
+            chosen_css = css;
         }
     }
 
     // Stop the existing session
+    // NOTE: If the evicted controller reconnects later, it may resume its DTLS session from the session cache
     USP_ASSERT(chosen_css != NULL);
+    USP_PROTOCOL("%s: All CoAP sessions in use. Reusing session %d", __FUNCTION__, chosen_css->index);
     StopCoapSession(chosen_css);
 
     return chosen_css;
@@ -1029,6 +1113,14 @@ int PerformSessionDtlsConnect(coap_server_session_t *css)
         return USP_ERR_INTERNAL_ERROR;
     }
 
+    // Exit if the controller resumed a previous DTLS session, restoring the trust determined when that session was first established
+    // NOTE: The certificate verify callback is not called for resumed sessions, so there is no certificate chain to determine the role from
+    if (SSL_session_reused(css->ssl))
+    {
+        USP_PROTOCOL("%s: Resumed DTLS session (abbreviated handshake)", __FUNCTION__);
+        return RestoreCoapSessionTrust(css);
+    }
+
     // If we have a certificate chain, then determine which role to allow for controllers on this CoAP connection
     if (css->cert_chain != NULL)
     {
@@ -1041,10 +1133,264 @@ int PerformSessionDtlsConnect(coap_server_session_t *css)
         }
     }
 
+    // Store the trust with the DTLS session, so that it is available if the controller resumes this session later
+    SaveCoapSessionTrust(css);
+
     return USP_ERR_OK;
 }
 
 
+/*********************************************************************//**
+**
+** SaveCoapSessionTrust
+**
+** Stores the controller trust determined by the full DTLS handshake with the DTLS session
+** so that it can be restored if the controller resumes the session on a later connection
+**
+** \param   css - pointer to structure describing coap session
+**
+** \return  None
+**
+**************************************************************************/
+void SaveCoapSessionTrust(coap_server_session_t *css)
+{
+    SSL_SESSION *session;
+    coap_session_trust_t *trust;
+
+    // Exit if there is no session to store the trust with (this should never happen after a successful handshake)
+    session = SSL_get_session(css->ssl);
+    if (session == NULL)
+    {
+        return;
+    }
+
+    trust = USP_MALLOC(sizeof(coap_session_trust_t));
+    trust->role = css->role;
+    trust->allowed_controllers = (css->allowed_controllers != NULL) ? USP_STRDUP(css->allowed_controllers) : NULL;
+
+    // Exit if unable to store the trust. The session will still work, but cannot be resumed
+    if (SSL_SESSION_set_ex_data(session, coap_session_trust_index, trust) != 1)
+    {
+        USP_LOG_Warning("%s: SSL_SESSION_set_ex_data() failed. DTLS session will not be resumable", __FUNCTION__);
+        FreeCoapSessionTrust(NULL, trust, NULL, 0, 0, NULL);
+        SSL_CTX_remove_session(coap_server_ssl_ctx, session);
+    }
+}
+
+/*********************************************************************//**
+**
+** RestoreCoapSessionTrust
+**
+** Sets the controller trust for a CoAP session from the DTLS session that the controller resumed
+**
+** \param   css - pointer to structure describing coap session
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int RestoreCoapSessionTrust(coap_server_session_t *css)
+{
+    SSL_SESSION *session;
+    coap_session_trust_t *trust = NULL;
+
+    session = SSL_get_session(css->ssl);
+    if (session != NULL)
+    {
+        trust = SSL_SESSION_get_ex_data(session, coap_session_trust_index);
+    }
+
+    // Exit if the resumed session has no trust stored with it
+    if (trust == NULL)
+    {
+        USP_LOG_Error("%s: Resumed DTLS session has no controller trust. Resetting CoAP session", __FUNCTION__);
+        SSL_CTX_remove_session(coap_server_ssl_ctx, session);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    css->role = trust->role;
+    css->allowed_controllers = (trust->allowed_controllers != NULL) ? USP_STRDUP(trust->allowed_controllers) : NULL;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** FreeCoapSessionTrust
+**
+** Called back from OpenSSL when a cached DTLS session is freed, to free the controller trust stored with it
+**
+** \param   parent - pointer to SSL_SESSION being freed (unused)
+** \param   ptr - pointer to coap_session_trust_t structure to free, or NULL if none was stored
+** \param   ad, idx, argl, argp - unused
+**
+** \return  None
+**
+**************************************************************************/
+void FreeCoapSessionTrust(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp)
+{
+    coap_session_trust_t *trust = (coap_session_trust_t *) ptr;
+
+    if (trust == NULL)
+    {
+        return;
+    }
+
+    USP_SAFE_FREE(trust->allowed_controllers);
+    USP_FREE(trust);
+}
+
+/*********************************************************************//**
+**
+** PeekDtlsAppDataRecord
+**
+** Determines whether the datagram pending on the specified socket is a DTLS application data record
+** (ie a record sent on an established DTLS session, rather than a handshake record), and if so, its epoch and sequence number
+** NOTE: The datagram is not removed from the socket
+**
+** \param   sock - socket that has a datagram pending
+** \param   epoch - pointer to variable in which to return the epoch of the DTLS record
+** \param   seq - pointer to variable in which to return the sequence number of the DTLS record
+**
+** \return  true if the pending datagram is a DTLS application data record
+**
+**************************************************************************/
+bool PeekDtlsAppDataRecord(int sock, unsigned *epoch, unsigned long long *seq)
+{
+    unsigned char hdr[DTLS_RECORD_HEADER_LEN];
+    int len;
+    int i;
+
+    // Exit if the pending datagram is not a DTLS application data record
+    len = recv(sock, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT);
+    if ((len != sizeof(hdr)) || (hdr[0] != DTLS_CONTENT_TYPE_APP_DATA))
+    {
+        return false;
+    }
+
+    *epoch = (hdr[3] << 8) | hdr[4];
+    *seq = 0;
+    for (i=5; i<11; i++)
+    {
+        *seq = (*seq << 8) | hdr[i];
+    }
+
+    // Application data is only ever sent after the handshake (ie epoch 0 is only used for the handshake)
+    return (*epoch != 0) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** FindMigratingDtlsSession
+**
+** Finds the DTLS session which a DTLS application data record received from a new peer address belongs to
+** The record belongs to a session if it continues that session's record sequence (within COAP_DTLS_MIGRATION_SEQ_WINDOW)
+** Sessions with the same peer IP address (ie only the port has changed) are preferred, then the session whose sequence is closest
+** NOTE: If the wrong session is chosen, the record fails authentication and is discarded by OpenSSL. The session is then
+**       migrated back when its peer next sends a record from its original address
+**
+** \param   cs - pointer to coap server
+** \param   peer_addr - IP address of peer that sent the DTLS record
+** \param   epoch - epoch of the DTLS record
+** \param   seq - sequence number of the DTLS record
+**
+** \return  pointer to coap session, or NULL if the DTLS record does not belong to any existing session
+**
+**************************************************************************/
+coap_server_session_t *FindMigratingDtlsSession(coap_server_t *cs, nu_ipaddr_t *peer_addr, unsigned epoch, unsigned long long seq)
+{
+    int j;
+    coap_server_session_t *css;
+    coap_server_session_t *chosen_css = NULL;
+    unsigned long long gap;
+    unsigned long long chosen_gap = 0;
+    bool is_same_addr;
+    bool is_chosen_same_addr = false;
+
+    for (j=0; j<MAX_COAP_SERVER_SESSIONS; j++)
+    {
+        // Skip sessions which the record cannot belong to
+        css = &cs->sessions[j];
+        if ((css->ssl == NULL) || (css->is_dtls_rx_seq_known == false) ||
+            (css->dtls_rx_epoch != epoch) || (seq <= css->dtls_rx_seq) || (seq - css->dtls_rx_seq > COAP_DTLS_MIGRATION_SEQ_WINDOW))
+        {
+            continue;
+        }
+
+        gap = seq - css->dtls_rx_seq;
+        is_same_addr = (memcmp(peer_addr, &css->peer_addr, sizeof(css->peer_addr))==0) ? true : false;
+        if ((chosen_css == NULL) ||
+            ((is_same_addr) && (is_chosen_same_addr == false)) ||
+            ((is_same_addr == is_chosen_same_addr) && (gap < chosen_gap)))
+        {
+            chosen_css = css;
+            chosen_gap = gap;
+            is_chosen_same_addr = is_same_addr;
+        }
+    }
+
+    return chosen_css;
+}
+
+/*********************************************************************//**
+**
+** MigrateDtlsSession
+**
+** Moves an established DTLS session to the new address of its peer, keeping its DTLS state (so no new handshake is required)
+** and its CoAP state (so a partially received USP record is not lost)
+** The listening socket (which the peer's record is pending on) replaces the session's socket, in the same way as StartCoapSession()
+**
+** \param   cs - pointer to coap server
+** \param   css - pointer to structure describing coap session to migrate
+** \param   peer_addr - new IP address of the peer
+** \param   peer_port - new port of the peer
+**
+** \return  None
+**
+**************************************************************************/
+void MigrateDtlsSession(coap_server_t *cs, coap_server_session_t *css, nu_ipaddr_t *peer_addr, uint16_t peer_port)
+{
+    int err;
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    char old_buf[NU_IPADDRSTRLEN];
+    char new_buf[NU_IPADDRSTRLEN];
+
+    USP_PROTOCOL("%s: Migrating CoAP session %d from %s, port %d to %s, port %d", __FUNCTION__, css->index,
+                 nu_ipaddr_str(&css->peer_addr, old_buf, sizeof(old_buf)), css->peer_port,
+                 nu_ipaddr_str(peer_addr, new_buf, sizeof(new_buf)), peer_port);
+
+    // Close the session's socket, and move the listening socket into this session
+    SOCKET_SET_ForgetSocket(css->socket_fd);
+    close(css->socket_fd);
+    css->socket_fd = cs->listen_sock;
+    cs->listen_sock = INVALID;
+
+    // Create a new listening socket to replace the one we moved to the session
+    StartCoapListenSock(cs);     // NOTE: We can ignore any errors, as UpdateCoapServerInterfaces() will retry later
+
+    // Convert peer address and port to a sockaddr structure
+    err = nu_ipaddr_to_sockaddr(peer_addr, peer_port, &saddr, &saddr_len);
+    USP_ASSERT(err == USP_ERR_OK);
+
+    // Exit if unable to explicitly connect the session socket to the remote peer
+    err = connect(css->socket_fd, (struct sockaddr *) &saddr, saddr_len);
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("connect", errno);
+        StopCoapSession(css);
+        return;
+    }
+
+    // Point the DTLS BIOs at the new socket and peer
+    BIO_set_fd(css->rbio, css->socket_fd, BIO_NOCLOSE);
+    BIO_set_fd(css->wbio, css->socket_fd, BIO_NOCLOSE);
+    BIO_ctrl(css->rbio, BIO_CTRL_DGRAM_SET_CONNECTED, 0, &saddr);
+    BIO_ctrl(css->wbio, BIO_CTRL_DGRAM_SET_CONNECTED, 0, &saddr);
+
+    memcpy(&css->peer_addr, peer_addr, sizeof(css->peer_addr));
+    css->peer_port = peer_port;
+}
+
 /*********************************************************************//**
 **
 ** StopCoapSession
@@ -1097,6 +1443,7 @@ void StopCoapSession(coap_server_session_t *css)
     }
 
     // Close the socket
+    SOCKET_SET_ForgetSocket(css->socket_fd);
     close(css->socket_fd);
     css->socket_fd = INVALID;
 }
@@ -1144,9 +1491,19 @@ void ReceiveCoapBlock(coap_server_t *cs, coap_server_session_t *css)
 {
     unsigned char buf[MAX_COAP_PDU_SIZE];
     int len;
-    parsed_pdu_t pp;
-    unsigned action_flags;
-    int err;
+    bool is_app_data;
+    unsigned epoch;
+    unsigned long long seq;
+
+    // Exit if this is an unencrypted session, reading all PDUs pending on the socket in a single system call
+    if (css->ssl == NULL)
+    {
+        ReceiveCoapBlockBatch(cs, css);
+        return;
+    }
+
+    // Determine the position of the DTLS record about to be read in the peer's record sequence
+    is_app_data = PeekDtlsAppDataRecord(css->socket_fd, &epoch, &seq);
 
     // Exit if the connection has been closed by the peer
     len = COAP_ReceivePdu(css->ssl, css->rbio, css->socket_fd, buf, sizeof(buf));
@@ -1171,6 +1528,131 @@ void ReceiveCoapBlock(coap_server_t *cs, coap_server_session_t *css)
         return;
     }
 
+    // Record the position of the last authenticated DTLS record received, so that the session can be identified if the peer's address changes
+    // NOTE: This is only updated after SSL_read() has successfully decrypted the record, so that it cannot be advanced by spoofed records
+    if (is_app_data)
+    {
+        css->is_dtls_rx_seq_known = true;
+        css->dtls_rx_epoch = epoch;
+        css->dtls_rx_seq = seq;
+    }
+
+    HandleCoapBlock(cs, css, buf, len);
+}
+
+/*********************************************************************//**
+**
+** ReceiveCoapBlockBatch
+**
+** Reads all of the CoAP PDUs pending on an unencrypted CoAP session's socket (up to COAP_SERVER_RX_BATCH_SIZE)
+** using a single call to recvmmsg(), then processes each of them in turn
+** This avoids a select() wakeup and recv() call per PDU when PDUs have queued up on the socket (eg retransmissions from the peer)
+** NOTE: Any PDUs which were queued on the socket before it was connected to the peer (ie when it was the listening socket)
+**       but were sent by a different peer, are discarded
+**
+** \param   cs - pointer to structure describing coap server
+** \param   css - pointer to structure describing coap session
+**
+** \return  None
+**
+**************************************************************************/
+void ReceiveCoapBlockBatch(coap_server_t *cs, coap_server_session_t *css)
+{
+    static unsigned char bufs[COAP_SERVER_RX_BATCH_SIZE][MAX_COAP_PDU_SIZE];  // NOTE: static to avoid a large stack frame. Only accessed by the MTP thread
+    struct mmsghdr msgs[COAP_SERVER_RX_BATCH_SIZE];
+    struct iovec iovecs[COAP_SERVER_RX_BATCH_SIZE];
+    struct sockaddr_storage saddrs[COAP_SERVER_RX_BATCH_SIZE];
+    nu_ipaddr_t src_addr;
+    uint16_t src_port;
+    bool is_equal;
+    int num_msgs;
+    int i;
+    int err;
+
+    // Setup the array of receive buffers
+    memset(msgs, 0, sizeof(msgs));
+    for (i=0; i<COAP_SERVER_RX_BATCH_SIZE; i++)
+    {
+        iovecs[i].iov_base = bufs[i];
+        iovecs[i].iov_len = sizeof(bufs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &saddrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(saddrs[i]);
+    }
+
+    // Exit if unable to read any PDUs (the connection has been closed by the peer)
+    // NOTE: MSG_DONTWAIT ensures that this call does not block waiting for more PDUs, once those already pending have been read
+    num_msgs = recvmmsg(css->socket_fd, msgs, COAP_SERVER_RX_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (num_msgs == -1)
+    {
+        // Exit if there was nothing to read
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return;
+        }
+
+        USP_ERR_ERRNO("recvmmsg", errno);
+        if (css->usp_buf_len != 0)
+        {
+            USP_LOG_Error("%s: Connection closed by peer or error. Dropping partially received USP Record (%d bytes)", __FUNCTION__, css->usp_buf_len);
+        }
+        StopCoapSession(css);
+        return;
+    }
+
+    // Process all PDUs that were read
+    for (i=0; i<num_msgs; i++)
+    {
+        // Skip PDUs that were not sent by the peer of this session
+        err = nu_ipaddr_from_sockaddr_storage(&saddrs[i], &src_addr, &src_port);
+        if (err == USP_ERR_OK)
+        {
+            err = nu_ipaddr_equal(&src_addr, &css->peer_addr, &is_equal);
+        }
+        if ((err != USP_ERR_OK) || (is_equal == false) || (src_port != css->peer_port))
+        {
+            USP_PROTOCOL("%s: Discarding CoAP PDU not sent by the peer of session %d", __FUNCTION__, css->index);
+            continue;
+        }
+
+        // Skip empty datagrams
+        if (msgs[i].msg_len == 0)
+        {
+            continue;
+        }
+
+        HandleCoapBlock(cs, css, bufs[i], msgs[i].msg_len);
+
+        // Exit if the session was stopped whilst processing the PDU
+        if (css->socket_fd == INVALID)
+        {
+            return;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleCoapBlock
+**
+** Processes a CoAP PDU received on a CoAP session, sending the ACK or RST
+** and posting the USP record to the data model thread, if it is complete
+**
+** \param   cs - pointer to structure describing coap server
+** \param   css - pointer to structure describing coap session
+** \param   buf - pointer to buffer containing the received CoAP PDU
+** \param   len - length of the received CoAP PDU
+**
+** \return  None
+**
+**************************************************************************/
+void HandleCoapBlock(coap_server_t *cs, coap_server_session_t *css, unsigned char *buf, int len)
+{
+    parsed_pdu_t pp;
+    unsigned action_flags;
+    int err;
+
     css->last_block_time = time(NULL);
 
     // Exit if an error occurred whilst parsing the PDU
@@ -1322,6 +1804,14 @@ unsigned CalcCoapServerActions(coap_server_t *cs, coap_server_session_t *css, pa
         return SEND_ACK | INDICATE_BAD_METHOD;
     }
 
+    // Exit if the host in the 'reply-to' is still being looked up (the lookup is started by the first PDU received containing it)
+    // The PDU is intentionally not acknowledged, so that the controller retransmits it. By then, the lookup has normally completed
+    if (IsReplyToLookupPending(css, pp))
+    {
+        USP_PROTOCOL("%s: Received CoAP PDU (MID=%d) whilst looking up the reply-to host. Not acknowledging it, so that it is retransmitted", __FUNCTION__, pp->message_id);
+        return COAP_NO_ERROR;
+    }
+
     // Handle the block, updating state and determining what to do at the end of this function
     if (css->block_count == 0)
     {
@@ -1512,8 +2002,10 @@ unsigned HandleSubsequentCoapBlock(coap_server_t *cs, coap_server_session_t *css
     if (pp->block_size != css->block_size)
     {
         // Calculate the new count of number of blocks we've received, based on the new block size
+        // NOTE: This is exact because block sizes are powers of 2, and all blocks received so far were full blocks
         USP_PROTOCOL("%s: Received CoAP PDU (MID=%d) has dynamically changed block size (block_size=%d, previously=%d)", __FUNCTION__, pp->message_id, pp->block_size, css->block_size);
         css->block_size = pp->block_size;
+        css->block_count = css->usp_buf_len / css->block_size;
     }
 
     // Exit if this block is an earlier block that we've already received
@@ -1603,41 +2095,24 @@ bool IsReplyToValid(coap_server_session_t *css, parsed_pdu_t *pp)
 {
     int err;
     nu_ipaddr_t reply_addr;
-    nu_ipaddr_t interface_addr;
-    bool prefer_ipv6;
+    bool is_pending;
     char buf[NU_IPADDRSTRLEN];
     char host[MAX_COAP_URI_QUERY];
 
-    // Percent decode the received host name
-    USP_STRNCPY(host, pp->mtp_reply_to.coap_host, sizeof(host));
-    TEXT_UTILS_PercentDecodeString(host);
-
-    // Attempt to interpret the host as an IP literal address (ie no DNS lookup required)
-    err = nu_ipaddr_from_str(host, &reply_addr);
-
-    // If this fails, then assume that host is a DNS hostname
+    // Exit if unable to lookup hostname
+    err = LookupReplyToHost(css, pp, host, sizeof(host), &reply_addr, &is_pending);
     if (err != USP_ERR_OK)
     {
-        // Get the preference for IPv4 or IPv6, if dual stack
-        prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
-
-        // Determine address of interface that the packet was received on
-        // We want to lookup a hostname on the same IPv4 or IPv6 protocol
-        // NOTE: We lookup css->peer_addr, rather than use cs->listen_addr directly, because we might be listening on "any"
-        // (in which case listen_addr does not contain the IP address of the interface which received the packet)
-        err = nu_ipaddr_get_interface_addr_from_dest_addr(&css->peer_addr, &interface_addr);
-        if (err != USP_ERR_OK)
-        {
-            return false;
-        }        
+        USP_LOG_Error("%s: Ignoring USP message. Unable to lookup Host address in URI Query option (%s)", __FUNCTION__, host);
+        return false;
+    }
 
-        // Exit if unable to lookup hostname
-        err = tw_ulib_diags_lookup_host(host, AF_UNSPEC, prefer_ipv6, &interface_addr, &reply_addr);
-        if (err != USP_ERR_OK)
-        {
-            USP_LOG_Error("%s: Ignoring USP message. Unable to lookup Host address in URI Query option (%s)", __FUNCTION__, host);
-            return false;
-        }
+    // Exit if the hostname is still being looked up
+    // NOTE: This is unlikely, as the lookup is started when the first block of the USP record is received, and blocks are not acknowledged until it completes
+    if (is_pending)
+    {
+        USP_LOG_Error("%s: Ignoring USP message. Host address in URI Query option (%s) is still being looked up", __FUNCTION__, host);
+        return false;
     }
 
     // Exit if the address given in the reply-to does not match the address of the USP controller 
@@ -1652,6 +2127,95 @@ bool IsReplyToValid(coap_server_session_t *css, parsed_pdu_t *pp)
     return true;
 }
 
+/*********************************************************************//**
+**
+** IsReplyToLookupPending
+**
+** Determines whether the host in the URI query Option's 'reply-to' is still being looked up
+** NOTE: If the host is not in the DNS cache, then this function starts looking it up
+**
+** \param   css - pointer to CoAP session which received the PDU
+** \param   pp - pointer to parsed CoAP PDU
+**
+** \return  true if the lookup is in progress. Otherwise false, including if the lookup failed (this is reported by IsReplyToValid)
+**
+**************************************************************************/
+bool IsReplyToLookupPending(coap_server_session_t *css, parsed_pdu_t *pp)
+{
+    int err;
+    nu_ipaddr_t reply_addr;
+    bool is_pending;
+    char host[MAX_COAP_URI_QUERY];
+
+    // Exit if the PDU does not contain a 'reply-to'. The error is reported when handling the block
+    if (pp->mtp_reply_to.is_reply_to_specified == false)
+    {
+        return false;
+    }
+
+    err = LookupReplyToHost(css, pp, host, sizeof(host), &reply_addr, &is_pending);
+    if (err != USP_ERR_OK)
+    {
+        return false;
+    }
+
+    return is_pending;
+}
+
+/*********************************************************************//**
+**
+** LookupReplyToHost
+**
+** Determines the IP address of the host in the URI query Option's 'reply-to'
+** This function does not block if the host is a DNS hostname which is not already resolved. Instead is_pending is set
+**
+** \param   css - pointer to CoAP session which received the PDU
+** \param   pp - pointer to parsed CoAP PDU
+** \param   host - pointer to buffer in which to return the (percent decoded) host in the 'reply-to'
+** \param   host_len - length of buffer in which to return the host
+** \param   reply_addr - pointer to variable in which to return the IP address of the host
+** \param   is_pending - pointer to variable in which to return whether the lookup of the host is still in progress
+**
+** \return  USP_ERR_OK if successful, or the lookup is in progress
+**
+**************************************************************************/
+int LookupReplyToHost(coap_server_session_t *css, parsed_pdu_t *pp, char *host, int host_len, nu_ipaddr_t *reply_addr, bool *is_pending)
+{
+    int err;
+    nu_ipaddr_t interface_addr;
+    bool prefer_ipv6;
+
+    *is_pending = false;
+
+    // Percent decode the received host name
+    USP_STRNCPY(host, pp->mtp_reply_to.coap_host, host_len);
+    TEXT_UTILS_PercentDecodeString(host);
+
+    // Exit if the host is an IP literal address (ie no DNS lookup required)
+    err = nu_ipaddr_from_str(host, reply_addr);
+    if (err == USP_ERR_OK)
+    {
+        return USP_ERR_OK;
+    }
+
+    // If the code gets here, then assume that host is a DNS hostname
+    // Get the preference for IPv4 or IPv6, if dual stack
+    prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
+
+    // Determine address of interface that the packet was received on
+    // We want to lookup a hostname on the same IPv4 or IPv6 protocol
+    // NOTE: We lookup css->peer_addr, rather than use cs->listen_addr directly, because we might be listening on "any"
+    // (in which case listen_addr does not contain the IP address of the interface which received the packet)
+    err = nu_ipaddr_get_interface_addr_from_dest_addr(&css->peer_addr, &interface_addr);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = DNS_CACHE_LookupHost(host, AF_UNSPEC, prefer_ipv6, &interface_addr, reply_addr, is_pending);
+    return err;
+}
+
 /*********************************************************************//**
 **
 ** SendCoapRstFromServer
@@ -2234,7 +2798,8 @@ void LogRxedCoapPdu(parsed_pdu_t *pp)
 ** UpdateCoapServerInterfaces
 **
 ** Called to determine whether the IP address used for any of our CoAP servers has changed
-** NOTE: This function only checks the IP address periodically
+** NOTE: This function only checks the IP address after a netlink notification that an IP address has changed,
+**       or periodically if netlink notifications are not available
 **
 ** \param   None
 **
@@ -2256,10 +2821,22 @@ int UpdateCoapServerInterfaces(void)
     cur_time = time(NULL);
     if (is_first_time == false)
     {
-        timeout = next_coap_server_if_poll_time - cur_time;
-        if (timeout > 0)
+        if (coap_server_addr_change_sock != INVALID)
+        {
+            // Exit if not notified of any IP address change
+            timeout = MAX_SOCKET_TIMEOUT_SECONDS;
+            if (is_coap_server_addr_changed == false)
+            {
+                goto exit;
+            }
+        }
+        else
         {
-            goto exit;
+            timeout = next_coap_server_if_poll_time - cur_time;
+            if (timeout > 0)
+            {
+                goto exit;
+            }
         }
     }
 
@@ -2280,6 +2857,7 @@ int UpdateCoapServerInterfaces(void)
                 }
 
                 // Attempt to restart CoAP listening socket for this server
+                SOCKET_SET_ForgetSocket(cs->listen_sock);
                 close(cs->listen_sock);
                 cs->listen_sock = INVALID;
                 StartCoapListenSock(cs);     // NOTE: We can ignore any errors, as UpdateCoapServerInterfaces() will retry later
@@ -2287,11 +2865,12 @@ int UpdateCoapServerInterfaces(void)
         }
     }
 
-    // Set next time to poll for IP address change
+    // Set next time to poll for IP address change (if not notified of IP address changes)
     #define COAP_SERVER_IP_ADDR_POLL_PERIOD 5
-    timeout = COAP_SERVER_IP_ADDR_POLL_PERIOD;
+    timeout = (coap_server_addr_change_sock != INVALID) ? MAX_SOCKET_TIMEOUT_SECONDS : COAP_SERVER_IP_ADDR_POLL_PERIOD;
     next_coap_server_if_poll_time = cur_time + timeout;
     is_first_time = false;
+    is_coap_server_addr_changed = false;
 
 exit:
     return timeout;
@@ -77,6 +77,9 @@ extern int USP_SNPRINTF(char *dest, size_t size, const char *fmt, ...) __attribu
 // Used to make while loops that do not have an outer level exit condition, readable
 #define FOREVER 1
 
+// Factor by which the arrays of STR, KV and INT vectors grow when full (see USP_MEM_Reserve)
+#define VECTOR_GROWTH_FACTOR 2
+
 //------------------------------------------------------------------------------
 // Common defines for time
 #define SECONDS 1000   // 1 second in milliseconds
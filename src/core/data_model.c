@@ -41,6 +41,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "common_defs.h"
 #include "data_model.h"
@@ -50,15 +52,25 @@
 #include "dm_inst_vector.h"
 #include "dm_trans.h"
 #include "dm_access.h"
+#include "path_resolver.h"
+#include "expr_vector.h"
 #include "cli.h"
 #include "vendor_api.h"
 #include "text_utils.h"
 #include "iso8601.h"
+#include "sync_timer.h"
+#include "usp_probe.h"
+#include "uptime.h"
+#include "os_utils.h"
 
 #ifdef ENABLE_COAP
 #include "usp_coap.h"
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+#include "wsclient.h"
+#endif
+
 
 //--------------------------------------------------------------------
 // Boolean that allows us to control which scope the USP_REGISTER_XXX() functions can be called in
@@ -72,6 +84,16 @@ typedef struct
     dm_node_type_t type;
 } dm_path_segment;
 
+//--------------------------------------------------------------------
+// Token describing a segment of a data model path e.g. "LocalAgent", in place within the path string
+// The segment is not NULL terminated in the path (it is terminated by '.'), hence its length is stored
+typedef struct
+{
+    char *name;     // pointer to the start of the segment within the path
+    int len;        // number of characters in the segment
+    int hash;       // hash of the segment, calculated by TEXT_UTILS_CalcHash() semantics
+} dm_path_token_t;
+
 //--------------------------------------------------------------------
 // Array to convert from enumeration to string
 char *dm_node_type_to_str[kDMNodeType_Max] =
@@ -101,37 +123,168 @@ char *dm_node_type_to_str[kDMNodeType_Max] =
 static dm_node_t *root_device_node;
 static dm_node_t *root_internal_node;
 
+//--------------------------------------------------------------------
+// Permissions queued whilst the controller trust permissions are being registered at startup
+// Rather than each registered permission being applied by walking the subtree of its target (recalculating
+// the combined permissions of every node in the subtree each time), all permissions are applied in a single walk of the schema
+typedef struct
+{
+    dm_node_t *node;                    // Target node of the permission
+    ctrust_role_t role;                 // Role that the permission applies to
+    unsigned short permission_bitmask;  // Bitmask of permissions to apply to the target node and all of its children
+    int order;                          // Order in which the permission was registered. Later permissions override earlier ones
+} queued_permission_t;
+
+static queued_permission_t *queued_permissions = NULL;
+static int num_queued_permissions = 0;
+static bool is_permission_batch_active = false;
+
 //--------------------------------------------------------------------
 // Structure for looking up a data model parameter node in the data model, based on it's hash
 typedef struct
 {
-    dm_hash_t hash;
+    dm_hash_t hash;         // NOTE: A hash of 0 denotes an unused slot in the table. Database parameters never have a hash of 0
     dm_node_t *node;
 } node_lookup_t;
 
 
-// This vector is used when reading the database at startup to determine which parameters (in the DB) to delete and which to add
-// based on the current schema
+// This open addressing hash table is used when reading the database at startup to determine which parameters (in the DB) to delete and which to add
+// based on the current schema. It is also used whenever a database row needs to be converted back into a data model path
 static node_lookup_t *node_lookup = NULL;
-static int node_lookup_count = 0;
+static int node_lookup_count = 0;       // Number of nodes in the table
+static int node_lookup_size = 0;        // Number of slots in the table (always a power of 2)
+
+// Minimum number of slots allocated in the node lookup table. The table is resized to keep it at most half full.
+#define NODE_LOOKUP_MIN_SIZE 1024
+
+//--------------------------------------------------------------------
+// Defines controlling the hash table of child nodes that is allocated for nodes with many children
+// Nodes with fewer children than this threshold are searched linearly (which is faster for small numbers of children)
+#define CHILD_TABLE_THRESHOLD 8
+
+// Minimum number of slots allocated in a child table. The table is resized to keep it at most half full.
+#define CHILD_TABLE_MIN_SIZE  32
 
 //--------------------------------------------------------------------
-// Typedef for the compare callback
-typedef int (*dm_cmp_cb_t)(char *lhs, expr_op_t op, char *rhs, bool *result);
+// Table converting the type of a node in a static schema table (see DM_PRIV_AddStaticSchema) to the type of data model node
+// NOTE: Alias parameters are DB parameters whose value is populated automatically (see USP_REGISTER_DBParam_Alias)
+static const dm_node_type_t static_node_type_to_dm_type[] =
+{
+    [kStaticNode_Object_SingleInstance] = kDMNodeType_Object_SingleInstance,
+    [kStaticNode_Object_MultiInstance]  = kDMNodeType_Object_MultiInstance,
+    [kStaticNode_Param_Constant]        = kDMNodeType_Param_ConstantValue,
+    [kStaticNode_Param_NumEntries]      = kDMNodeType_Param_NumEntries,
+    [kStaticNode_DBParam_ReadWrite]     = kDMNodeType_DBParam_ReadWrite,
+    [kStaticNode_DBParam_ReadOnly]      = kDMNodeType_DBParam_ReadOnly,
+    [kStaticNode_DBParam_Secure]        = kDMNodeType_DBParam_Secure,
+    [kStaticNode_DBParam_ReadOnlyAuto]  = kDMNodeType_DBParam_ReadOnlyAuto,
+    [kStaticNode_DBParam_ReadWriteAuto] = kDMNodeType_DBParam_ReadWriteAuto,
+    [kStaticNode_DBParam_Alias]         = kDMNodeType_DBParam_ReadWriteAuto,
+    [kStaticNode_VendorParam_ReadOnly]  = kDMNodeType_VendorParam_ReadOnly,
+    [kStaticNode_VendorParam_ReadWrite] = kDMNodeType_VendorParam_ReadWrite,
+    [kStaticNode_SyncOperation]         = kDMNodeType_SyncOperation,
+    [kStaticNode_AsyncOperation]        = kDMNodeType_AsyncOperation,
+    [kStaticNode_Event]                 = kDMNodeType_Event,
+};
+
+//--------------------------------------------------------------------
+// Arena from which all schema nodes, and their name and path strings, are allocated
+// The schema is only ever freed as a whole (when the data model is stopped), so rather than allocating each
+// node and string individually, they are packed contiguously into large blocks. This reduces the number of
+// heap allocations made whilst registering the schema, and the per-allocation heap overhead
+typedef struct schema_arena_block_tag
+{
+    struct schema_arena_block_tag *next;   // Next block in the list of all allocated blocks
+    int size;                              // Number of bytes available in data[]
+    int used;                              // Number of bytes of data[] that have been allocated
+    char data[];
+} schema_arena_block_t;
+
+static schema_arena_block_t *schema_arena = NULL;   // Block currently being allocated from (head of linked list of all blocks)
+static int schema_arena_total = 0;                  // Total number of bytes allocated from the arena
+static int schema_num_nodes = 0;                    // Number of nodes in the schema
+
+// Open addressing hash table of all node names allocated from the arena, keyed by name hash
+// Node names are interned, because the same names (e.g. 'Enable', 'Alias', 'Status') are used by many nodes in the schema
+static char **schema_names = NULL;
+static int schema_names_count = 0;                  // Number of names in the table
+static int schema_names_size = 0;                   // Number of slots in the table (always a power of 2)
+
+// Minimum number of slots allocated in the table of interned names. The table is resized to keep it at most half full.
+#define SCHEMA_NAMES_MIN_SIZE 256
+
+//--------------------------------------------------------------------
+// Set if the time spent in vendor callbacks should be accounted against each data model node (see dm_cb_stats_t)
+static bool is_cb_stats_enabled = false;
+
+//--------------------------------------------------------------------
+// Cache of the values returned by the get callbacks of vendor parameters registered with a cache period (see USP_REGISTER_VendorParam_CachePeriod)
+// The cache is direct mapped: each parameter instance hashes to a single slot, replacing any other parameter instance cached in that slot
+typedef struct
+{
+    dm_node_t *node;                // Parameter whose value is cached in this slot, or NULL if the slot is unused
+    int order;                      // Number of instance numbers in the path of the parameter
+    int instances[MAX_DM_INSTANCE_ORDER];
+    unsigned generation;            // Generation of the object instances when the value was cached (see DM_INST_VECTOR_GetGeneration)
+    unsigned long long expiry_time; // Uptime (in microseconds) at which the cached value becomes stale
+    bool is_native;                 // Set if the value was returned by the get callback in its native type (in native), rather than as a string (in value)
+    dm_val_union_t native;
+    char *value;
+} value_cache_entry_t;
+
+static value_cache_entry_t value_cache[VENDOR_GET_CACHE_SIZE];
+static unsigned value_cache_hits = 0;
+static unsigned value_cache_misses = 0;
+static unsigned value_cache_invalidations = 0;
+
+#if NUM_GET_WORKER_THREADS > 0
+// Mutex protecting the cache, as vendor parameters may also be read by the Get worker threads
+static pthread_mutex_t value_cache_mutex;
+#endif
+
+// Maximum number of data model nodes listed by DATA_MODEL_DumpSlowestCallbacks()
+#define MAX_SLOWEST_CALLBACKS 25
+
+// Maximum number of attempts to read a consistent value from a shared memory statistics region (see USP_REGISTER_SharedMemStats)
+// An attempt fails if the writer is updating the region at the same time
+#define SHM_STATS_MAX_READ_ATTEMPTS 100
+
+// Size of each block allocated for the arena. Allocations larger than this get a block to themselves.
+#define SCHEMA_ARENA_BLOCK_SIZE (32*1024)
+
+// Alignment of each allocation made from the arena
+#define SCHEMA_ARENA_ALIGN (sizeof(void *))
 
 //--------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void SerializeNativeValue(dm_req_t *req, dm_node_t *node, char *buf, int len);
-void FormInstanceString(dm_instances_t *inst, char *buf, int len);
+bool IsNativeValueReturned(dm_req_t *req, dm_node_t *node, char *buf);
+int GetParameterValueFromNode(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, unsigned flags, dm_val_union_t *native, bool *is_native);
+long double NativeValueToNumber(dm_val_union_t *native, unsigned type_flags);
+void NativeValueToString(dm_val_union_t *native, unsigned type_flags, char *buf, int len);
+int CallGroupGetCallback(int group_id, kv_vector_t *params);
+int CallGroupSetCallback(int group_id, char *path, char *new_value);
+int GetParameterValuesInternal(kv_vector_t *params, dm_resolved_path_t *resolved, unsigned flags);
+void CalcCombinedPermissions(dm_node_t *node);
+int GetGroupedParameterValue(dm_node_t *node, char *path, char *buf, int len);
+int GetShmStatsValue(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, dm_val_union_t *native, bool *is_native);
+bool IsCompiledExprOpTrue(expr_op_t op, int cmp);
 dm_node_t *CreateNode(char *name, dm_node_type_t type, char *schema_path);
+dm_node_t *CreateStaticNode(const usp_static_node_t *sn, dm_node_type_t type);
+int AddNodeHash(dm_node_t *node, dm_hash_t hash);
 int ParseSchemaPath(char *path, char *path_segments, int path_segment_len, dm_node_type_t type, dm_path_segment *segments, int max_segments);
-int ParsePath(char *path, char *path_segments, int path_segment_len, char *segments[], int max_segments, dm_instances_t *inst);
+int ParsePath(char *path, dm_path_token_t *tokens, int max_tokens, dm_instances_t *inst);
+dm_node_t *FindMatchingChildToken(dm_node_t *parent, dm_path_token_t *token);
+bool IsNodeMatchingToken(dm_node_t *node, dm_path_token_t *token);
 dm_node_t *FindNodeFromHash(dm_hash_t hash);
-int ParseInstanceString(char *instances, dm_instances_t *inst);
-char *ParseInstanceInteger(char *p, int *p_value);
 int AddChildParamsDefaultValues(char *path, int path_len, dm_node_t *node, dm_instances_t *inst);
-int DeleteChildParams(char *path, int path_len, dm_node_t *node, dm_instances_t *inst);
-int DeleteChildParams_MultiInstanceObject(char *path, int path_len, dm_node_t *node, dm_instances_t *inst);
+int StartInstanceDelete(char *path, unsigned flags, dm_node_t **p_node, dm_instances_t *inst);
+int DeleteInstanceParams(char *path, dm_node_t *node, dm_instances_t *inst);
+void GetChildDbParamHashes(dm_node_t *node, dm_hash_t **hashes, int *num_hashes);
+int CompareDbHashMapping(const void *p1, const void *p2);
+void AddChildDeletesToTrans(char *path, int path_len, dm_node_t *node, dm_instances_t *inst);
+void AddChildDeletesToTrans_MultiInstanceObject(char *path, int path_len, dm_node_t *node, dm_instances_t *inst);
+bool IsWholeTableDelete(dm_node_t **nodes, dm_instances_t *insts, int num_paths, dm_instances_t *parent);
 int strncpy_path_segments(char *dst, char *src, int maxlen);
 void DumpSchemaFromRoot(dm_node_t *root, char *name);
 void AddChildNodes(dm_node_t *parent, str_vector_t *sv);
@@ -140,7 +293,35 @@ int RegisterDefaultControllerTrust(void);
 void DestroySchemaRecursive(dm_node_t *parent);
 void DestroyInstanceVectorRecursive(dm_node_t *parent);
 void DumpInstanceVectorRecursive(dm_node_t *parent);
+void StartPermissionBatch(void);
+void ApplyPermissionBatch(void);
+void ApplyQueuedPermissionsRecursive(dm_node_t *node, unsigned short *parent_bitmask, int *parent_order);
+int ComparePermissionTarget(const void *p1, const void *p2);
 void GetAllInstancePathsRecursive(dm_node_t *node, dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role);
+void AddChildNode(dm_node_t *parent, dm_node_t *child);
+void InsertIntoChildTable(dm_node_t **table, int table_size, dm_node_t *child);
+void ResizeChildTable(dm_node_t *parent, int new_size);
+void AddNodeLookup(dm_node_t *node);
+void InsertIntoNodeLookup(node_lookup_t *table, int table_size, dm_node_t *node);
+void *SchemaArenaAlloc(int size);
+char *SchemaArenaStrdup(char *str);
+unsigned long long StartCallbackTimer(void);
+void StopCallbackTimer(dm_node_t *node, unsigned long long start_time);
+void ResetCallbackStatsRecursive(dm_node_t *parent);
+void AddTimedNodesRecursive(dm_node_t *parent, dm_node_t **nodes, int *num_nodes);
+int CompareCallbackTotalTime(const void *p1, const void *p2);
+char *SchemaArenaIntern(char *str, int hash);
+void InsertIntoSchemaNames(char **table, int table_size, char *name);
+void FreeSchemaArena(void);
+int ValidateAddedInstance(char *path, dm_instances_t *inst);
+value_cache_entry_t *FindValueCacheSlot(dm_node_t *node, dm_instances_t *inst);
+bool IsSameValueCacheKey(value_cache_entry_t *entry, dm_node_t *node, dm_instances_t *inst);
+bool GetCachedValue(dm_node_t *node, dm_instances_t *inst, char *buf, int len, dm_val_union_t *native, bool *is_native);
+void CacheValue(dm_node_t *node, dm_instances_t *inst, char *value, dm_val_union_t *native);
+void InvalidateCachedValue(dm_node_t *node, dm_instances_t *inst);
+void FreeValueCache(void);
+void LockValueCache(void);
+void UnlockValueCache(void);
 
 /*********************************************************************//**
 **
@@ -156,8 +337,19 @@ void GetAllInstancePathsRecursive(dm_node_t *node, dm_instances_t *inst, str_vec
 int DATA_MODEL_Init(void)
 {
     int err;
+    long long start_time;
+
+#if NUM_GET_WORKER_THREADS > 0
+    // Exit if unable to create mutex protecting the cache of vendor parameter values
+    err = OS_UTILS_InitMutex(&value_cache_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+#endif
 
     // Allocate the root nodes for the data model
+    start_time = SYNC_TIMER_TimeMs();
     #define DEVICE_NODE_NAME "Device"
     root_device_node = CreateNode(DEVICE_NODE_NAME, kDMNodeType_Object_SingleInstance, DEVICE_NODE_NAME);
 
@@ -169,6 +361,11 @@ int DATA_MODEL_Init(void)
     COAP_Init();
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    // Initialise WebSocket client protocol layer
+    WSCLIENT_Init();
+#endif
+
     // Register core implemented nodes in the schema
     is_executing_within_dm_init = true;
     err = USP_ERR_OK;
@@ -177,11 +374,15 @@ int DATA_MODEL_Init(void)
     err |= DEVICE_CONTROLLER_Init();
     err |= DEVICE_MTP_Init();
     err |= DEVICE_STOMP_Init();
+#ifdef ENABLE_MQTT
+    err |= DEVICE_MQTT_Init();
+#endif
     err |= DEVICE_SUBSCRIPTION_Init();
     err |= DEVICE_SECURITY_Init();
     err |= DEVICE_CTRUST_Init();
     err |= DEVICE_REQUEST_Init();
     err |= DEVICE_BULKDATA_Init();
+    err |= DEVICE_MSG_STATS_Init();
 
 
 
@@ -205,6 +406,15 @@ int DATA_MODEL_Init(void)
         return err;
     }
 
+    // Register the schema fragments of vendor modules which were prepared in parallel (see USP_REGISTER_StagedInit)
+    err = USP_REGISTER_CompleteStagedInits();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    USP_LOG_Info("%s: Registered schema (%d nodes, %d bytes) in %lld ms", __FUNCTION__, schema_num_nodes, schema_arena_total, SYNC_TIMER_TimeMs() - start_time);
+
     // Exit if unable to potentially perform a programmatic factory reset of the parameters in the database
     // NOTE: This must be performed before DEVICE_LOCAL_AGENT_SetDefaults(), but after VENDOR_Init()
     err = DATABASE_Start();
@@ -248,8 +458,12 @@ int DATA_MODEL_Start(void)
     int err;
     dm_trans_vector_t trans;
     register_controller_trust_cb_t   register_controller_trust_cb;
+    long long start_time;
+    long long seed_time;
+    long long trust_time;
 
     // Seed data model with instance numbers from the database    
+    start_time = SYNC_TIMER_TimeMs();
     if (is_running_cli_local_command == false)
     {
         err = DATABASE_ReadDataModelInstanceNumbers(false);
@@ -259,6 +473,8 @@ int DATA_MODEL_Start(void)
         }
     }
 
+    seed_time = SYNC_TIMER_TimeMs();
+
     // Determine function to call to register controller trust
     register_controller_trust_cb = vendor_hook_callbacks.register_controller_trust_cb;
     if (register_controller_trust_cb == NULL)
@@ -269,13 +485,17 @@ int DATA_MODEL_Start(void)
     // Set all roles and permissions
     // NOTE: This must be done before any transaction is started otherwise object deletion notifications are not sent 
     // (because we are unable to generate the list of objects in a deletion subscription because of lack of permissions)
+    StartPermissionBatch();
     err = register_controller_trust_cb();
+    ApplyPermissionBatch();
     if (err != USP_ERR_OK)
     {
         USP_ERR_SetMessage("%s: register_controller_trust_cb() failed", __FUNCTION__);
         return err;
     }
 
+    trust_time = SYNC_TIMER_TimeMs();
+
     // As most start routines also clean the database, start a transaction
     err = DM_TRANS_Start(&trans);
     if (err != USP_ERR_OK)
@@ -294,11 +514,18 @@ int DATA_MODEL_Start(void)
     err |= DEVICE_STOMP_Start();          // NOTE: This must come after DEVICE_SECURITY_Start(), as it assumes the trust store and client certs have been locally cached
 #ifdef ENABLE_COAP
     err |= COAP_Start();                  // NOTE: This must come after DEVICE_SECURITY_Start(), as it assumes the trust store and client certs have been locally cached
+#endif
+#ifdef ENABLE_WEBSOCKETS
+    err |= WSCLIENT_Start();              // NOTE: This must come after DEVICE_SECURITY_Start(), as it assumes the trust store and client certs have been locally cached
+#endif
+#ifdef ENABLE_MQTT
+    err |= DEVICE_MQTT_Start();           // NOTE: This must come after DEVICE_SECURITY_Start(), as it assumes the trust store and client certs have been locally cached
 #endif
     err |= DEVICE_MTP_Start();            // NOTE: This must come after COAP_Start, as it assumes that the CoAP SSL contexts have been created
     err |= DEVICE_SUBSCRIPTION_Start();   // NOTE: This must come after DEVICE_LOCAL_AGENT_Start(), as it calls DEVICE_LOCAL_AGENT_GetRebootInfo()
     err |= DEVICE_CTRUST_Start();
     err |= DEVICE_BULKDATA_Start();
+    err |= DEVICE_MSG_STATS_Start();
 
 
 
@@ -318,6 +545,10 @@ exit:
         DM_TRANS_Abort(); // Ignore error from this - we want to return the error from the body of this function instead
     }
 
+    // Log the time taken by each phase of starting the data model
+    USP_LOG_Info("%s: Seeded instances in %lld ms, registered controller trust in %lld ms, started components in %lld ms", __FUNCTION__,
+                 seed_time - start_time, trust_time - seed_time, SYNC_TIMER_TimeMs() - trust_time);
+
     return err;
 }
 
@@ -339,14 +570,18 @@ void DATA_MODEL_Stop(void)
     DEVICE_CONTROLLER_Stop();
     DEVICE_MTP_Stop();
     DEVICE_STOMP_Stop();
+#ifdef ENABLE_MQTT
+    DEVICE_MQTT_Stop();
+#endif
     DEVICE_CTRUST_Stop();
     DEVICE_SECURITY_Stop();
     DEVICE_LOCAL_AGENT_Stop();
 
 
-    // Free the instance vectors here, so that they are not reported as a memory leak
+    // Free the instance vectors and cached vendor parameter values here, so that they are not reported as a memory leak
     DestroyInstanceVectorRecursive(root_device_node);
     DestroyInstanceVectorRecursive(root_internal_node);
+    FreeValueCache();
 
     // Stop all checking of memory allocations
     // This is necessary because the data model schema was allocated before memory checking was turned on.
@@ -356,7 +591,10 @@ void DATA_MODEL_Stop(void)
     // Free all allocations that occurred before mem info collection was turned on    
     DestroySchemaRecursive(root_device_node);
     DestroySchemaRecursive(root_internal_node);
+    FreeSchemaArena();
     USP_SAFE_FREE(node_lookup);
+    node_lookup_count = 0;
+    node_lookup_size = 0;
 
     // If logging memory usage, print out all memory still in use, after attempting to free all known references
     USP_MEM_PrintLeakReport();
@@ -379,17 +617,8 @@ void DATA_MODEL_Stop(void)
 int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags)
 {
     dm_node_t *node;
-    dm_node_t *table_node;
-    dm_get_value_cb_t get_cb;
-    int err;
     dm_instances_t inst;
-    char instances[MAX_DM_PATH];
-    bool exists;
-    dm_req_t req;
     bool is_qualified_instance;
-    int num_instances;
-    char *default_value;
-    unsigned db_flags = 0;          // Default to database not unobfuscating values. NOTE Only secure nodes are obfuscated
 
     // Exit if unable to get node associated with parameter
     // This could occur if the parameter is not present in the schema, or if the specified instance does not exist
@@ -400,12 +629,170 @@ int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags)
     }
 
     // NOTE: We do not check 'is_qualified_instance' here, because the only time it would be unqualified, is if the
-    //       path represented a multi-instance object. If path does represent this, then it will be caught below (switch statement)
+    //       path represented a multi-instance object. If path does represent this, then it will be caught by DATA_MODEL_GetParameterValueFromNode()
+    return DATA_MODEL_GetParameterValueFromNode(node, path, &inst, buf, len, flags);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetParameterValueFromNode
+**
+** Gets a single parameter from the data model, given its node and instance numbers
+** This allows callers which have already located the parameter's node to avoid looking it up again
+**
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   path - pointer to string containing complete data model path to the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_GetParameterValueFromNode(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, unsigned flags)
+{
+    return GetParameterValueFromNode(node, path, inst, buf, len, flags, NULL, NULL);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetParameterValueAlloc
+**
+** Gets a single parameter from the data model, given its node and instance numbers, returning it in a dynamically allocated string
+** This avoids callers which keep the value (eg in a response message or key-value vector) needing a MAX_DM_VALUE_LEN buffer
+** on their stack, and copying the value out of it
+** NOTE: Database parameter values are copied directly from the database cache into the returned string
+**
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   path - pointer to string containing complete data model path to the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   value - pointer to variable in which to return a pointer to the dynamically allocated value of the parameter
+**                  NOTE: Ownership of the string passes to the caller. This is only set if successful
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_GetParameterValueAlloc(dm_node_t *node, char *path, dm_instances_t *inst, char **value, unsigned flags)
+{
+    static __thread char value_buf[MAX_DM_VALUE_LEN];   // Scratch buffer for values which are not read from the database
+    static __thread bool is_value_buf_in_use = false;   // Set if value_buf is being used by an outer call to this function (eg from a vendor get callback)
+    unsigned db_flags = 0;
+    char *default_value;
+    char *buf;
+    int err;
+
+    switch(node->type)
+    {
+        case kDMNodeType_DBParam_Secure:
+            // Secure parameters are read from the database only if the special flag is set
+            if ((flags & SHOW_PASSWORD)==0)
+            {
+                break;
+            }
+            db_flags = OBFUSCATED_VALUE;
+            // Intentional fall through to code below
+
+        case kDMNodeType_DBParam_ReadWrite:
+        case kDMNodeType_DBParam_ReadOnly:
+        case kDMNodeType_DBParam_ReadOnlyAuto:
+        case kDMNodeType_DBParam_ReadWriteAuto:
+            // Exit if the parsed object instance numbers do not exist in the data model
+            if ((inst->order > 0) && (DM_INST_VECTOR_IsExist(inst) == false))
+            {
+                USP_ERR_SetMessage("%s: Path %s: Instance numbers do not exist", __FUNCTION__, path);
+                return USP_ERR_OBJECT_DOES_NOT_EXIST;
+            }
+
+            // Exit if the value was read from the database, or an error occurred
+            err = DATABASE_GetParameterValueAlloc(path, node->hash, inst, value, db_flags);
+            if (err != USP_ERR_OBJECT_DOES_NOT_EXIST)
+            {
+                return err;
+            }
+
+            // No entry present in the database, use the default value
+            default_value = node->registered.param_info.default_value;
+            *value = USP_STRDUP((default_value != NULL) ? default_value : "");
+            return USP_ERR_OK;
+            break;
+
+        default:
+            break;
+    }
+
+    // All other types of parameter are read into a buffer, because vendor get callbacks write into a caller supplied buffer
+    // NOTE: The scratch buffer is per-thread, so that Get requests processed by worker threads do not share it
+    if (is_value_buf_in_use)
+    {
+        buf = USP_MALLOC(MAX_DM_VALUE_LEN);
+        err = GetParameterValueFromNode(node, path, inst, buf, MAX_DM_VALUE_LEN, flags, NULL, NULL);
+        if (err == USP_ERR_OK)
+        {
+            *value = USP_REALLOC(buf, strlen(buf)+1);
+            return USP_ERR_OK;
+        }
+        USP_FREE(buf);
+        return err;
+    }
+
+    is_value_buf_in_use = true;
+    err = GetParameterValueFromNode(node, path, inst, value_buf, sizeof(value_buf), flags, NULL, NULL);
+    if (err == USP_ERR_OK)
+    {
+        *value = USP_STRDUP(value_buf);
+    }
+    is_value_buf_in_use = false;
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** GetParameterValueFromNode
+**
+** Gets a single parameter from the data model, given its node and instance numbers
+** Optionally, the value may be returned in its native type (rather than as a textual string), if it was obtained in its native type
+** (eg the number of entries in a table, or a vendor get callback returning the value in val_union). This avoids formatting
+** the value as a string, only for the caller to parse it back again
+**
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   path - pointer to string containing complete data model path to the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD)
+** \param   native - pointer to union in which to return the value of the parameter in its native type,
+**                   or NULL if the value must always be returned as a textual string
+** \param   is_native - pointer to variable in which to return whether the value was returned in native (rather than buf)
+**                      NOTE: This argument is only used if native is not NULL
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int GetParameterValueFromNode(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, unsigned flags, dm_val_union_t *native, bool *is_native)
+{
+    dm_node_t *table_node;
+    dm_get_value_cb_t get_cb;
+    int err;
+    bool exists;
+    dm_req_t req;
+    unsigned long long start_time;
+    int num_instances;
+    int cache_period;
+    char *default_value;
+    unsigned db_flags = 0;          // Default to database not unobfuscating values. NOTE Only secure nodes are obfuscated
+
+    if (native != NULL)
+    {
+        *is_native = false;
+    }
 
     // Validate that the parsed object instance numbers exist in the data model (if parameter contains multi-instance objects in it's path)
-    if (inst.order > 0)
+    if (inst->order > 0)
     {
-        exists = DM_INST_VECTOR_IsExist(&inst);
+        exists = DM_INST_VECTOR_IsExist(inst);
         if (exists == false)
         {
             USP_ERR_SetMessage("%s: Path %s: Instance numbers do not exist", __FUNCTION__, path);
@@ -434,8 +821,7 @@ int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags)
         case kDMNodeType_DBParam_ReadOnly:
         case kDMNodeType_DBParam_ReadOnlyAuto:
         case kDMNodeType_DBParam_ReadWriteAuto:
-            FormInstanceString(&inst, instances, sizeof(instances));
-            err = DATABASE_GetParameterValue(path, node->hash, instances, buf, len, db_flags);
+            err = DATABASE_GetParameterValue(path, node->hash, inst, buf, len, db_flags);
             if (err == USP_ERR_OBJECT_DOES_NOT_EXIST)
             {
                 // No entry present in the database, use the default value
@@ -458,30 +844,87 @@ int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags)
 
         case kDMNodeType_Param_NumEntries:
             table_node = node->registered.param_info.table_node;
-            num_instances = DM_INST_VECTOR_GetNumInstances(table_node, &inst);
+            num_instances = DM_INST_VECTOR_GetNumInstances(table_node, inst);
+            if (native != NULL)
+            {
+                // NOTE: NumberOfEntries parameters are registered as DM_UINT
+                native->value_uint = num_instances;
+                *is_native = true;
+                *buf = '\0';
+                break;
+            }
             USP_SNPRINTF(buf, len, "%d", num_instances);
             break;
 
             
         case kDMNodeType_VendorParam_ReadOnly:
         case kDMNodeType_VendorParam_ReadWrite:
+            // Exit if unable to read the value of the parameter from a shared memory statistics region
+            if (IsShmStatsParam(node))
+            {
+                err = GetShmStatsValue(node, path, inst, buf, len, native, is_native);
+                if (err != USP_ERR_OK)
+                {
+                    return err;
+                }
+                break;
+            }
+
+            // Exit if unable to get the value of a grouped vendor parameter from the group's get callback
+            if (node->registered.param_info.group_id != NON_GROUPED)
+            {
+                err = GetGroupedParameterValue(node, path, buf, len);
+                if (err != USP_ERR_OK)
+                {
+                    return err;
+                }
+                break;
+            }
+
             get_cb = node->registered.param_info.get_cb;
             USP_ASSERT(get_cb != NULL)
 
+            // Exit if the value was returned from the cache of vendor parameter values
+            cache_period = node->registered.param_info.cache_period;
+            if ((cache_period > 0) && (GetCachedValue(node, inst, buf, len, native, is_native)))
+            {
+                break;
+            }
+
             // Exit if unable to get the value from the vendor code
-            DM_PRIV_RequestInit(&req, node, path, &inst);
+            DM_PRIV_RequestInit(&req, node, path, inst);
             USP_ERR_ClearMessage();
             buf[0] = '\0';
 
+            USP_PROBE1(vendor_get_entry, path);
+            start_time = StartCallbackTimer();
             err = get_cb(&req, buf, len);
+            StopCallbackTimer(node, start_time);
+            USP_PROBE2(vendor_get_exit, path, err);
             if (err != USP_ERR_OK)
             {
                 USP_ERR_ReplaceEmptyMessage("%s: Get callback for path %s returned error %d", __FUNCTION__, path, err);
                 return err;
             }
 
+            // Exit if the parameter value was returned as a native value (in val_union), and the caller accepts native values
+            if ((native != NULL) && (IsNativeValueReturned(&req, node, buf)))
+            {
+                *native = req.val_union;
+                *is_native = true;
+                if (cache_period > 0)
+                {
+                    CacheValue(node, inst, NULL, native);
+                }
+                break;
+            }
+
             // If the parameter value was returned as a native value (in val_union), then convert it to a string
             SerializeNativeValue(&req, node, buf, len);
+            if (cache_period > 0)
+            {
+                CacheValue(node, inst, buf, NULL);
+            }
             break;
 
         case kDMNodeType_Object_MultiInstance:
@@ -517,58 +960,261 @@ int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags)
 
 /*********************************************************************//**
 **
-** DATA_MODEL_SetParameterValue
+** DATA_MODEL_GetParameterValues
 **
-** Sets a single named parameter in the data model
+** Gets the values of a number of parameters from the data model
+** Grouped vendor parameters belonging to the same group are obtained using a single call to the group's get callback
 **
-** \param   path - pointer to string containing complete path
-** \param   new_value - pointer to buffer containing value to set
-** \param   flags - options to control execution of this function (eg CHECK_WRITABLE)
+** \param   params - key-value vector containing the paths of the parameters to get (as keys)
+**                   On return, the value of each parameter is filled in
+**                   NOTE: Parameters which already have a value are left unchanged (their value is not got from the data model)
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD, IGNORE_GET_ERRORS)
 **
-** \return  USP_ERR_OK if successful
+** \return  USP_ERR_OK if successful, or the error code of the first parameter which could not be read
+**          NOTE: If IGNORE_GET_ERRORS is set, then this function always succeeds, returning an empty string for parameters which could not be read
 **
 **************************************************************************/
-int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
+int DATA_MODEL_GetParameterValues(kv_vector_t *params, unsigned flags)
 {
-    dm_node_t *node;
+    return GetParameterValuesInternal(params, NULL, flags);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetResolvedParameterValues
+**
+** Gets the values of a number of parameters which have already been resolved by the path resolver
+** This is the same as DATA_MODEL_GetParameterValues(), except that the node and instance numbers of each parameter
+** are taken from the resolved paths, rather than being parsed from the path of the parameter again
+**
+** \param   params - key-value vector containing the paths of the parameters to get (as keys)
+**                   On return, the value of each parameter is filled in
+**                   NOTE: Parameters which already have a value are left unchanged (their value is not got from the data model)
+** \param   resolved - array of resolved paths, containing one entry for each entry in params (in the same order)
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD, IGNORE_GET_ERRORS)
+**
+** \return  USP_ERR_OK if successful, or the error code of the first parameter which could not be read
+**          NOTE: If IGNORE_GET_ERRORS is set, then this function always succeeds, returning an empty string for parameters which could not be read
+**
+**************************************************************************/
+int DATA_MODEL_GetResolvedParameterValues(kv_vector_t *params, dm_resolved_path_t *resolved, unsigned flags)
+{
+    return GetParameterValuesInternal(params, resolved, flags);
+}
+
+/*********************************************************************//**
+**
+** GetParameterValuesInternal
+**
+** Gets the values of a number of parameters from the data model
+** Grouped vendor parameters belonging to the same group are obtained using a single call to the group's get callback
+**
+** \param   params - key-value vector containing the paths of the parameters to get (as keys)
+**                   On return, the value of each parameter is filled in
+**                   NOTE: Parameters which already have a value are left unchanged (their value is not got from the data model)
+** \param   resolved - array containing the node and instance numbers of each parameter in params (in the same order)
+**                     or NULL if the node and instance numbers should be parsed from the path of each parameter
+** \param   flags - options to control execution of this function (eg SHOW_PASSWORD, IGNORE_GET_ERRORS)
+**
+** \return  USP_ERR_OK if successful, or the error code of the first parameter which could not be read
+**
+**************************************************************************/
+int GetParameterValuesInternal(kv_vector_t *params, dm_resolved_path_t *resolved, unsigned flags)
+{
+    int i;
     int err;
-    dm_instances_t inst;
-    char instances[MAX_DM_PATH];
-    dm_validate_value_cb_t validate_cb;
-    dm_set_value_cb_t set_cb;
-    dm_req_t req;
+    int result = USP_ERR_OK;
+    int group_id;
+    int *param_groups;
+    int group_err[MAX_VENDOR_PARAM_GROUPS];
+    int group_index[MAX_VENDOR_PARAM_GROUPS];
+    kv_vector_t group_params[MAX_VENDOR_PARAM_GROUPS];
+    kv_pair_t *pair;
+    kv_pair_t *group_pair;
+    dm_node_t *node;
+    dm_instances_t parsed_inst;
+    dm_instances_t *inst;
     bool is_qualified_instance;
-    bool exists;
-    unsigned db_flags = 0;          // Default to database not unobfuscating values. NOTE Only secure nodes are obfuscated
 
-    USP_ASSERT(DM_TRANS_IsWithinTransaction()==true);
-
-    // Exit if unable to get node associated with parameter
-    // This could occur if the parameter is not present in the schema
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
-    if (node == NULL)
+    // Exit if there is nothing to get
+    if (params->num_entries == 0)
     {
-        return USP_ERR_UNSUPPORTED_PARAM;
+        return USP_ERR_OK;
     }
 
-    // NOTE: We do not check 'is_qualified_instance' here, because the only time it would be unqualified, is if the
-    //       path represented a multi-instance object. If path does represent this, then it will be caught below
-
-
-    // Exit if trying to set the value of something which is not a parameter
-    if (IsParam(node) == false)
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
     {
-        USP_ERR_SetMessage("%s: Trying to perform a parameter set on something which is not a parameter (%s)", __FUNCTION__, path);
-        return USP_ERR_INVALID_PATH;
+        KV_VECTOR_Init(&group_params[i]);
+        group_err[i] = USP_ERR_OK;
+        group_index[i] = 0;
     }
-    
-    // Validate that the parsed object instance numbers exist in the data model (if parameter contains multi-instance objects in it's path)
-    if (inst.order > 0)
+
+    // Sort all grouped vendor parameters into their groups
+    param_groups = USP_MALLOC(params->num_entries*sizeof(int));
+    for (i=0; i < params->num_entries; i++)
     {
-        exists = DM_INST_VECTOR_IsExist(&inst);
-        if (exists == false)
+        pair = &params->vector[i];
+        param_groups[i] = NON_GROUPED;
+
+        // Skip parameters which already have a value
+        if (pair->value != NULL)
         {
-            USP_ERR_SetMessage("%s: Path %s: Instance numbers do not exist", __FUNCTION__, path);
+            continue;
+        }
+
+        // Skip parameters which are not grouped vendor parameters
+        // NOTE: Parameters whose instance numbers do not exist are also skipped, so that DATA_MODEL_GetParameterValue() reports the error for them
+        if (resolved != NULL)
+        {
+            node = resolved[i].node;
+            inst = &resolved[i].inst;
+        }
+        else
+        {
+            node = DM_PRIV_GetNodeFromPath(pair->key, &parsed_inst, &is_qualified_instance);
+            inst = &parsed_inst;
+        }
+
+        if ((node == NULL) || 
+            (IsGroupedVendorParam(node) == false) ||
+            ((inst->order > 0) && (DM_INST_VECTOR_IsExist(inst) == false)))
+        {
+            continue;
+        }
+
+        group_id = node->registered.param_info.group_id;
+        param_groups[i] = group_id;
+        KV_VECTOR_Add(&group_params[group_id], pair->key, "");
+    }
+
+    // Get the values of all grouped vendor parameters, using a single call to each group's get callback
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
+    {
+        if (group_params[i].num_entries > 0)
+        {
+            group_err[i] = CallGroupGetCallback(i, &group_params[i]);
+        }
+    }
+
+    // Iterate over all parameters, filling in their value
+    for (i=0; i < params->num_entries; i++)
+    {
+        pair = &params->vector[i];
+        if (pair->value != NULL)
+        {
+            continue;
+        }
+
+        group_id = param_groups[i];
+        if (group_id != NON_GROUPED)
+        {
+            // Move the value of the grouped vendor parameter from the group's vector (the group's vector is in the same order as params)
+            group_pair = &group_params[group_id].vector[group_index[group_id]];
+            group_index[group_id]++;
+            err = group_err[group_id];
+            if (err == USP_ERR_OK)
+            {
+                pair->value = group_pair->value;
+                group_pair->value = NULL;
+            }
+        }
+        else
+        {
+            // Get the value of the parameter individually
+            if (resolved != NULL)
+            {
+                err = DATA_MODEL_GetParameterValueAlloc(resolved[i].node, pair->key, &resolved[i].inst, &pair->value, flags);
+            }
+            else
+            {
+                // NOTE: We do not check 'is_qualified_instance' here, for the same reason as DATA_MODEL_GetParameterValue()
+                node = DM_PRIV_GetNodeFromPath(pair->key, &parsed_inst, &is_qualified_instance);
+                err = (node != NULL) ? DATA_MODEL_GetParameterValueAlloc(node, pair->key, &parsed_inst, &pair->value, flags) : USP_ERR_INVALID_PATH;
+            }
+        }
+
+        // Handle errors getting the value of the parameter
+        if (err != USP_ERR_OK)
+        {
+            if (flags & IGNORE_GET_ERRORS)
+            {
+                pair->value = USP_STRDUP("");
+            }
+            else
+            {
+                // Exit if unable to get the value of this parameter
+                result = err;
+                goto exit;
+            }
+        }
+    }
+
+exit:
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
+    {
+        KV_VECTOR_Destroy(&group_params[i]);
+    }
+    USP_FREE(param_groups);
+
+    return result;
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_SetParameterValue
+**
+** Sets a single named parameter in the data model
+**
+** \param   path - pointer to string containing complete path
+** \param   new_value - pointer to buffer containing value to set
+** \param   flags - options to control execution of this function (eg CHECK_WRITABLE)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
+{
+    dm_node_t *node;
+    int err;
+    dm_instances_t inst;
+    dm_validate_value_cb_t validate_cb;
+    dm_set_value_cb_t set_cb;
+    dm_req_t req;
+    unsigned long long start_time;
+    bool is_qualified_instance;
+    bool exists;
+    unsigned db_flags = 0;          // Default to database not unobfuscating values. NOTE Only secure nodes are obfuscated
+
+    // Exit if unable to get node associated with parameter
+    // This could occur if the parameter is not present in the schema
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    if (node == NULL)
+    {
+        return USP_ERR_UNSUPPORTED_PARAM;
+    }
+
+    // Only grouped vendor parameters may be set outside of a transaction (they are set immediately in that case)
+    USP_ASSERT((DM_TRANS_IsWithinTransaction()==true) ||
+               ((node->type == kDMNodeType_VendorParam_ReadWrite) && (node->registered.param_info.group_id != NON_GROUPED)));
+
+    // NOTE: We do not check 'is_qualified_instance' here, because the only time it would be unqualified, is if the
+    //       path represented a multi-instance object. If path does represent this, then it will be caught below
+
+
+    // Exit if trying to set the value of something which is not a parameter
+    if (IsParam(node) == false)
+    {
+        USP_ERR_SetMessage("%s: Trying to perform a parameter set on something which is not a parameter (%s)", __FUNCTION__, path);
+        return USP_ERR_INVALID_PATH;
+    }
+    
+    // Validate that the parsed object instance numbers exist in the data model (if parameter contains multi-instance objects in it's path)
+    if (inst.order > 0)
+    {
+        exists = DM_INST_VECTOR_IsExist(&inst);
+        if (exists == false)
+        {
+            USP_ERR_SetMessage("%s: Path %s: Instance numbers do not exist", __FUNCTION__, path);
             return USP_ERR_INVALID_PATH;
         }
     }
@@ -611,12 +1257,48 @@ int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
     switch(node->type)
     {
         case kDMNodeType_VendorParam_ReadWrite:
+            // Grouped vendor parameters are set when the transaction is committed, so that all parameters in the same group are set in a single call to the vendor
+            // If there is no transaction, then the group's set callback is called immediately, for just this parameter
+            if (node->registered.param_info.group_id != NON_GROUPED)
+            {
+                if (DM_TRANS_IsWithinTransaction())
+                {
+                    DM_TRANS_AddGroupedSet(node->registered.param_info.group_id, path, new_value);
+                    break;
+                }
+
+                err = CallGroupSetCallback(node->registered.param_info.group_id, path, new_value);
+
+                // The cached value of the parameter (if any) is now stale
+                if (node->registered.param_info.cache_period > 0)
+                {
+                    InvalidateCachedValue(node, &inst);
+                }
+
+                if (err != USP_ERR_OK)
+                {
+                    return err;
+                }
+                break;
+            }
+
             // Exit if unable to set the vendor parameter, aborting the transaction
             set_cb = node->registered.param_info.set_cb;
             if (set_cb != NULL)
             {
                 USP_ERR_ClearMessage();
+                USP_PROBE2(vendor_set_entry, path, new_value);
+                start_time = StartCallbackTimer();
                 err = set_cb(&req, new_value);
+                StopCallbackTimer(node, start_time);
+                USP_PROBE2(vendor_set_exit, path, err);
+
+                // The cached value of the parameter (if any) is now stale
+                if (node->registered.param_info.cache_period > 0)
+                {
+                    InvalidateCachedValue(node, &inst);
+                }
+
                 if (err != USP_ERR_OK)
                 {
                     USP_ERR_ReplaceEmptyMessage("%s: Failed to set (new value=%s) on (path=%s)", __FUNCTION__, new_value, path);
@@ -645,12 +1327,12 @@ int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
             }
         
             // Set the parameter to the new value in the database
-            FormInstanceString(&inst, instances, sizeof(instances));
-            err = DATABASE_SetParameterValue(path, node->hash, instances, new_value, db_flags);
+            err = DATABASE_SetParameterValue(path, node->hash, &inst, new_value, db_flags);
             if (err != USP_ERR_OK)
             {
                 return err;
             }
+            DEVICE_SUBSCRIPTION_NotifyDbParamChanged(path);
             break;
 
         case kDMNodeType_DBParam_ReadOnly:
@@ -658,12 +1340,12 @@ int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
             // Set the parameter to the new value in the database
             // Read-only parameters may be written internally by USP Agent when seeding read only tables
             // but writes initiated by a controller should never reach here
-            FormInstanceString(&inst, instances, sizeof(instances));
-            err = DATABASE_SetParameterValue(path, node->hash, instances, new_value, 0);
+            err = DATABASE_SetParameterValue(path, node->hash, &inst, new_value, 0);
             if (err != USP_ERR_OK)
             {
                 return err;
             }
+            DEVICE_SUBSCRIPTION_NotifyDbParamChanged(path);
             break;
 
         case kDMNodeType_Param_ConstantValue:
@@ -678,6 +1360,13 @@ int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
             break;
     }
     
+    // Unique key indexes are stale now that a unique key parameter has been set
+    // NOTE: This is not done before the set, as validation of the new value may use (and hence rebuild) the unique key indexes
+    if (node->registered.param_info.is_unique_key)
+    {
+        PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    }
+
     // Add this instance to the dm_instances_vector vector
     err = DM_INST_VECTOR_Add(&inst);
     if (err != USP_ERR_OK)
@@ -688,7 +1377,11 @@ int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags)
     // Add this parameter to the list of parameters which are pending notification to the vendor
     // They will be notified once the whole transaction has been completed successfully 
     // (or they will be forgotten if the transaction was aborted)
-    DM_TRANS_Add(kDMOp_Set, path, new_value, &req.val_union, node, &inst);
+    // NOTE: Grouped vendor parameters set outside of a transaction have already been set, and there is no transaction to add them to
+    if (DM_TRANS_IsWithinTransaction())
+    {
+        DM_TRANS_Add(kDMOp_Set, path, new_value, &req.val_union, node, &inst);
+    }
 
     // If code gets here, then value was set successfully
     return USP_ERR_OK;
@@ -921,111 +1614,107 @@ int DATA_MODEL_DeleteInstance(char *path, unsigned flags)
     dm_instances_t inst;
     dm_node_t *node;
     int err;
-    char child_path[MAX_DM_PATH];
-    dm_validate_del_cb_t validate_del;
-    dm_del_cb_t del;
-    dm_req_t req;
-    bool exists;
-    bool is_qualified_instance;
 
     USP_ASSERT(DM_TRANS_IsWithinTransaction()==true);
 
-    // Exit if unable to find node representing this object
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
-    if (node == NULL)
+    // Exit if this object instance cannot be deleted
+    err = StartInstanceDelete(path, flags, &node, &inst);
+    if ((err != USP_ERR_OK) || (node == NULL))
     {
-        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+        return err;
     }
 
-    // Exit if this object is not a fully qualified instance
-    if (is_qualified_instance == false)
+    // Now delete all child parameters of this instance and its child instances
+    err = DeleteInstanceParams(path, node, &inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SetMessage("%s: Path (%s) does not contain instance number of object to delete", __FUNCTION__, path);
-        return USP_ERR_OBJECT_NOT_CREATABLE;
+        return err;
     }
 
-    // Exit if the object instances in the path do not exist
-    exists = DM_INST_VECTOR_IsExist(&inst);
-    if (exists == false)
-    {
-        // Exit if we should silently ignore objects that have already been deleted
-        if (flags & IGNORE_NO_INSTANCE)
-        {
-            return USP_ERR_OK;
-        }
+    // DeRegister the instance number (and all child instance numbers) with the data model
+    // NOTE: This must be performed after StartInstanceDelete(), otherwise that function will not be aware of the child instance numbers to delete
+    DM_INST_VECTOR_Remove(&inst);
 
-        USP_ERR_SetMessage("%s: Object exists in schema, but instances are invalid: %s", __FUNCTION__, path);
-        return USP_ERR_OBJECT_DOES_NOT_EXIST;
-    }
+    return USP_ERR_OK;
+}
 
-    // Exit if we cannot add/delete instances of this object
-    if (node->type != kDMNodeType_Object_MultiInstance)
+/*********************************************************************//**
+**
+** DATA_MODEL_DeleteInstances
+**
+** Deletes all of the specified object instances (and their children) from the data model, within the current transaction
+** If the instances are all of the instances of a table, then the database parameters of the whole table are deleted in
+** bulk and the instances are deregistered with the data model at once, rather than one instance at a time
+**
+** \param   paths - pointer to vector containing the paths of the object instances to delete
+** \param   flags - options to control execution of this function (eg CHECK_DELETABLE)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_DeleteInstances(str_vector_t *paths, unsigned flags)
+{
+    int i;
+    int err;
+    dm_node_t **nodes;
+    dm_instances_t *insts;
+    dm_instances_t parent;
+
+    USP_ASSERT(DM_TRANS_IsWithinTransaction()==true);
+
+    // Exit if there is only one instance to delete (there is no benefit in the bulk delete path in this case)
+    if (paths->num_entries < 2)
     {
-        USP_ERR_SetMessage("%s: Cannot delete instances of %s. Not a multi-instance object.", __FUNCTION__, path);
-        return USP_ERR_OBJECT_NOT_CREATABLE;
+        return (paths->num_entries == 0) ? USP_ERR_OK : DATA_MODEL_DeleteInstance(paths->vector[0], flags);
     }
 
-    // Populate request structure passed to vendor hook functions
-    DM_PRIV_RequestInit(&req, node, path, &inst);
+    nodes = USP_MALLOC(paths->num_entries*sizeof(dm_node_t *));
+    insts = USP_MALLOC(paths->num_entries*sizeof(dm_instances_t));
 
-    // Exit if vendor hook is not allowing this instance to be deleted
-    // Typically this will be the case if the agent owns creation/deletion of the object
-    // NOTE: Read-only tables may be deleted internally by USP Agent
-    // but deletes initiated by a controller should always check whether the table is read only
-    if (flags & CHECK_DELETABLE)
+    // Exit if any of the object instances cannot be deleted
+    // NOTE: This calls the vendor hooks and adds the instances to the transaction, but does not yet delete the instances
+    for (i=0; i < paths->num_entries; i++)
     {
-        validate_del = node->registered.object_info.validate_del_cb;
-        if (validate_del != NULL)
+        err = StartInstanceDelete(paths->vector[i], flags, &nodes[i], &insts[i]);
+        if (err != USP_ERR_OK)
         {
-            USP_ERR_ClearMessage();
-    
-            err = validate_del(&req);
-            if (err != USP_ERR_OK)
-            {
-                USP_ERR_ReplaceEmptyMessage("%s: Cannot delete object=%s", __FUNCTION__, path);
-                return err;
-            }
+            goto exit;
         }
     }
-    
-    // Exit if delete vendor hook fails
-    // This vendor hook typically is used to delete a row in a vendor DB
-    // NOTE: The delete vendor hook needs to be separate from the validate and notify vendor hooks
-    // It needs to be separate from validate, because validate is not called for internal data model instance deletion
-    // It needs to be separate from notify because vendor DB changes need to be done in same transaction as USP DB changes
-    del = node->registered.object_info.del_cb;
-    if (del != NULL)
+
+    // If deleting all instances of a table, then delete the whole table at once
+    if (IsWholeTableDelete(nodes, insts, paths->num_entries, &parent))
     {
-        USP_ERR_ClearMessage();
-    
-        err = del(&req);
+        err = DeleteInstanceParams(paths->vector[0], nodes[0], &parent);
         if (err != USP_ERR_OK)
         {
-            USP_ERR_ReplaceEmptyMessage("%s: del vendor hook failed for path=%s", __FUNCTION__, path);
-            return err;
+            goto exit;
         }
-    }
 
-    // Add this object instance to the list of instances which are pending notification to the vendor
-    // They will be notified once the whole transaction has been completed successfully 
-    // (or they will be forgotten if the transaction was aborted)
-    // NOTE: This must be performed before the object is actually deleted from the data model, because 
-    // it determines the list of objects which will send ObjectDeletion notifies based on the objects currently in the data model
-    DM_TRANS_Add(kDMOp_Del, path, NULL, NULL, node, &inst);
+        DM_INST_VECTOR_RemoveAllInstances(nodes[0], &parent);
+        goto exit;
+    }
 
-    // Now delete all child parameters and instances
-    USP_STRNCPY(child_path, path, sizeof(child_path));
-    err = DeleteChildParams(child_path, strlen(child_path), node, &inst);
-    if (err != USP_ERR_OK)
+    // Otherwise delete each of the instances individually
+    for (i=0; i < paths->num_entries; i++)
     {
-        return err;
-    }
+        if (nodes[i] != NULL)
+        {
+            err = DeleteInstanceParams(paths->vector[i], nodes[i], &insts[i]);
+            if (err != USP_ERR_OK)
+            {
+                goto exit;
+            }
 
-    // DeRegister the instance number with the data model
-    // NOTE: This must be performed after DeleteChildParams(), otherwise that function will not be aware of the child instance numbers to delete
-    DM_INST_VECTOR_Remove(&inst);
+            DM_INST_VECTOR_Remove(&insts[i]);
+        }
+    }
+    err = USP_ERR_OK;
 
-    return USP_ERR_OK;
+exit:
+    USP_FREE(nodes);
+    USP_FREE(insts);
+    return err;
 }
 
 /*********************************************************************//**
@@ -1079,62 +1768,87 @@ int DATA_MODEL_GetPermissions(char *path, combined_role_t *combined_role, unsign
 int DATA_MODEL_NotifyInstanceAdded(char *path)
 {
     int err;
-    dm_node_t *node;
     dm_instances_t inst;
-    bool is_qualified_instance;
-    bool exists;
 
-    // Exit if unable to find node representing this object
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
-    if (node == NULL)
+    // Exit if the vendor signalled an instance which cannot be added
+    err = ValidateAddedInstance(path, &inst);
+    if (err != USP_ERR_OK)
     {
-        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+        return err;
     }
 
-    // Exit if the object the vendor signalled was not a multi-instance object
-    if (node->type != kDMNodeType_Object_MultiInstance)
+    // Register this new instance with the data model
+    err = DM_INST_VECTOR_Add(&inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SetMessage("%s: Path (%s) is not a multi-instance object.", __FUNCTION__, path);
-        return USP_ERR_OBJECT_NOT_CREATABLE;
+        return err;
     }
 
-    // Exit if this object is not a fully qualified instance
-    if (is_qualified_instance == false)
-    {
-        USP_ERR_SetMessage("%s: Path (%s) should contain instance number of object that was added", __FUNCTION__, path);
-        return USP_ERR_INVALID_ARGUMENTS;
-    }
+    return USP_ERR_OK;
+}
 
-    // Exit if instance already exists - nothing to do
-    exists = DM_INST_VECTOR_IsExist(&inst);
-    if (exists)
+/*********************************************************************//**
+**
+** DATA_MODEL_NotifyInstancesAdded
+**
+** Called if a vendor thread signals that a batch of instances have been added
+** All valid instances are registered with the data model in bulk, rather than being inserted one at a time
+** NOTE: This function does not have to be called within a transaction
+** NOTE: Paths of instances which could not be added are removed from the vector (and freed), so that on return
+**       the vector only contains the paths of the instances which were added (for which subscriptions should be consulted)
+**
+** \param   paths - pointer to vector containing the paths of the object instances that have been added by the vendor
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_NotifyInstancesAdded(str_vector_t *paths)
+{
+    int i;
+    int err;
+    int num_added = 0;
+    int num_insts = 0;
+    dm_instances_t *insts;
+    char *path;
+
+    // Exit if there are no instances to add
+    if (paths->num_entries == 0)
     {
-        USP_ERR_SetMessage("%s: Object (%s) already exists in the data model", __FUNCTION__, path);
-        return USP_ERR_CREATION_FAILURE;
+        return;
     }
 
-    // Exit if the parent object instances in the path do not exist
-    if (inst.order > 0)
+    insts = USP_MALLOC(paths->num_entries * sizeof(dm_instances_t));
+    for (i=0; i < paths->num_entries; i++)
     {
-        inst.order--;           // Temporarily remove the instance number of the object that was added,
-                                // so that structure indicates only parent instance numbers
-        exists = DM_INST_VECTOR_IsExist(&inst);
-        if (exists == false)
+        path = paths->vector[i];
+        err = ValidateAddedInstance(path, &insts[num_insts]);
+
+        // If the parent object did not exist, then it may be one of the instances pending in this batch,
+        // so register all pending instances and try again
+        if ((err == USP_ERR_OBJECT_DOES_NOT_EXIST) && (num_insts > 0))
         {
-            USP_ERR_SetMessage("%s: Parent objects in path (%s) do not exist", __FUNCTION__, path);
-            return USP_ERR_OBJECT_DOES_NOT_EXIST;
+            DM_INST_VECTOR_AddBulk(insts, num_insts);
+            num_insts = 0;
+            err = ValidateAddedInstance(path, &insts[num_insts]);
         }
-        inst.order++;           // Restore the structure, so that it indicates the instance number of the object that was added
-    }
 
-    // Register this new instance with the data model
-    err = DM_INST_VECTOR_Add(&inst);
-    if (err != USP_ERR_OK)
-    {
-        return err;
+        // Skip this path, if the instance could not be added
+        if (err != USP_ERR_OK)
+        {
+            USP_FREE(path);
+            continue;
+        }
+
+        // Keep this path, since it is now pending addition to the data model
+        num_insts++;
+        paths->vector[num_added] = path;
+        num_added++;
     }
+    paths->num_entries = num_added;
 
-    return USP_ERR_OK;
+    // Register all remaining instances with the data model
+    DM_INST_VECTOR_AddBulk(insts, num_insts);
+    USP_FREE(insts);
 }
 
 /*********************************************************************//**
@@ -1189,7 +1903,7 @@ int DATA_MODEL_NotifyInstanceDeleted(char *path)
     // Resolve the list of objects subscribed-to for deletion
     // NOTE: This must be done before the instance is removed from the data model, otherwise the subscription 
     // would not resolve to the object (because the object would have already been deleted)
-    DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths();
+    DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(path);
 
     // Remove this instance (and all children) from the data model
     DM_INST_VECTOR_Remove(&inst);
@@ -1197,6 +1911,45 @@ int DATA_MODEL_NotifyInstanceDeleted(char *path)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** DATA_MODEL_NotifyInstancesDeleted
+**
+** Called if a vendor thread signals that a batch of instances have been deleted
+** NOTE: This function does not have to be called within a transaction
+** NOTE: Paths of instances which could not be deleted are removed from the vector (and freed), so that on return
+**       the vector only contains the paths of the instances which were deleted (for which subscriptions should be consulted)
+**
+** \param   paths - pointer to vector containing the paths of the object instances that have been deleted by the vendor
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_NotifyInstancesDeleted(str_vector_t *paths)
+{
+    int i;
+    int err;
+    int num_deleted = 0;
+    char *path;
+
+    // NOTE: The object deletion paths of subscriptions are only resolved once for the whole batch,
+    // by the first call to DATA_MODEL_NotifyInstanceDeleted() which succeeds
+    for (i=0; i < paths->num_entries; i++)
+    {
+        path = paths->vector[i];
+        err = DATA_MODEL_NotifyInstanceDeleted(path);
+        if (err != USP_ERR_OK)
+        {
+            USP_FREE(path);
+            continue;
+        }
+
+        paths->vector[num_deleted] = path;
+        num_deleted++;
+    }
+    paths->num_entries = num_deleted;
+}
+
 /*********************************************************************//**
 **
 ** DATA_MODEL_Operate
@@ -1224,6 +1977,7 @@ int DATA_MODEL_Operate(char *path, kv_vector_t *input_args, kv_vector_t *output_
     bool exists;
     bool is_qualified_instance;
     dm_oper_info_t *info;
+    unsigned long long start_time;
 
     // Setup default return values
     KV_VECTOR_Init(output_args);
@@ -1271,7 +2025,9 @@ int DATA_MODEL_Operate(char *path, kv_vector_t *input_args, kv_vector_t *output_
             USP_ASSERT(sync_oper_cb != NULL);
 
             USP_ERR_ClearMessage();
+            start_time = StartCallbackTimer();
             err = sync_oper_cb(&req, command_key, input_args, output_args);
+            StopCallbackTimer(node, start_time);
             if (err != USP_ERR_OK)
             {
                 USP_ERR_ReplaceEmptyMessage("%s: Synchronous operation (%s) failed", __FUNCTION__, path);
@@ -1289,8 +2045,8 @@ int DATA_MODEL_Operate(char *path, kv_vector_t *input_args, kv_vector_t *output_
             break;
 
         case kDMNodeType_AsyncOperation:
-            // Create an entry in the Request Table
-            err = DEVICE_REQUEST_Add(path, command_key, instance);
+            // Create an entry in the Request Table (only persisting it, if this operation might be restarted at bootup)
+            err = DEVICE_REQUEST_Add(path, command_key, (info->restart_cb != NULL), instance);
             if (err != USP_ERR_OK)
             {
                 goto exit;
@@ -1311,7 +2067,9 @@ int DATA_MODEL_Operate(char *path, kv_vector_t *input_args, kv_vector_t *output_
             USP_ASSERT(async_oper_cb != NULL);
 
             USP_ERR_ClearMessage();
+            start_time = StartCallbackTimer();
             err = async_oper_cb(&req, input_args, *instance);
+            StopCallbackTimer(node, start_time);
             if (err != USP_ERR_OK)
             {
                 USP_ERR_ReplaceEmptyMessage("%s: Asynchronous operation (%s) failed to start", __FUNCTION__, path);
@@ -1427,6 +2185,7 @@ int DATA_MODEL_RestartAsyncOperation(char *path, kv_vector_t *input_args, int in
     bool exists;
     bool is_qualified_instance;
     dm_oper_info_t *info;
+    unsigned long long start_time;
 
     // Exit if unable to find node representing this object
     node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
@@ -1458,84 +2217,311 @@ int DATA_MODEL_RestartAsyncOperation(char *path, kv_vector_t *input_args, int in
     USP_ASSERT(node->type == kDMNodeType_AsyncOperation);
     async_oper_cb = info->async_oper_cb;
     USP_ASSERT(async_oper_cb != NULL);
+    start_time = StartCallbackTimer();
     err = async_oper_cb(&req, input_args, instance);
+    StopCallbackTimer(node, start_time);
 
     return err;
 }
 
 /*********************************************************************//**
 **
-** DATA_MODEL_CompareParameterValue
+** DATA_MODEL_CompileExpression
 **
-** Compares the value of the specified parameter with a given value
+** Compiles a search expression (eg 'Enable==true'), so that it can be efficiently evaluated against every instance of an object
+** The parameter's node and the role's permissions are looked up once, and the constant is converted to the parameter's type once
 **
-** \param   path - pointer to string containing complete data model path to the parameter
-** \param   op - operator to use for the comparison
-** \param   expr_constant - value to compare against
-** \param   result - pointer to variable in which to return the result of the comparision
+** \param   object - data model path of the object being searched, including trailing '.' (eg 'Device.WiFi.AccessPoint.')
+**                   NOTE: This string must persist for the lifetime of the compiled expression
+** \param   instance - instance number of any instance of the object. Used to locate the parameter's node
+** \param   param - path of the parameter in the expression, relative to the object instance
+**                  NOTE: This string must persist for the lifetime of the compiled expression
+** \param   op - operator in the expression
+** \param   constant - constant to compare the value of the parameter against
+**                     NOTE: This string must persist for the lifetime of the compiled expression
+** \param   combined_role - role used to access the parameter
+** \param   ce - pointer to structure in which to return the compiled expression
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int DATA_MODEL_CompareParameterValue(char *path, expr_op_t op, char *expr_constant, bool *result)
+int DATA_MODEL_CompileExpression(char *object, int instance, char *param, expr_op_t op, char *constant, combined_role_t *combined_role, dm_compiled_expr_t *ce)
 {
-    int err;
-    dm_node_t *node;
-    dm_instances_t inst;
+    char path[MAX_DM_PATH];
+    dm_instances_t obj_inst;
     bool is_qualified_instance;
-    dm_cmp_cb_t cmp_cb;
-    char buf[MAX_DM_SHORT_VALUE_LEN];
     unsigned type_flags;
+    int num_converted;
+    int len;
+    int err;
 
-    // Exit if unable to get the value of the parameter
-    // NOTE: Passwords will return empty string
-    err = DATA_MODEL_GetParameterValue(path, buf, sizeof(buf), 0);
-    if (err != USP_ERR_OK)
+    // Exit if unable to get node associated with the parameter
+    // This could occur if the parameter is not present in the schema
+    USP_SNPRINTF(path, sizeof(path), "%s%d.%s", object, instance, param);
+    ce->node = DM_PRIV_GetNodeFromPath(path, &ce->inst, &is_qualified_instance);
+    if (ce->node == NULL)
     {
-        return err;
+        return USP_ERR_INVALID_PATH;
     }
 
-    // Exit if unable to get node associated with the parameter
-    // NOTE: This should not fail, as we've already got the parameter's value
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
-    USP_ASSERT(node != NULL);
-    USP_ASSERT( ((node->type != kDMNodeType_Object_MultiInstance) &&
-                 (node->type != kDMNodeType_Object_SingleInstance) &&
-                 (node->type != kDMNodeType_SyncOperation) &&
-                 (node->type != kDMNodeType_AsyncOperation) &&
-                 (node->type != kDMNodeType_Event)) );
+    // Exit if the expression does not reference a parameter
+    if (IsParam(ce->node) == false)
+    {
+        USP_ERR_SetMessage("%s: Search expression references %s, which is not a parameter", __FUNCTION__, path);
+        return USP_ERR_INVALID_PATH;
+    }
 
-    // Determine the function to call to perform the comparison
-    type_flags = node->registered.param_info.type_flags;
+    // Determine which of the parameter's instance numbers is the instance number of the object being searched
+    // NOTE: The object's path (without trailing '.') contains one fewer instance numbers than the object's instances
+    len = strlen(object);
+    USP_ASSERT((len > 0) && (len < sizeof(path)));
+    memcpy(path, object, len-1);
+    path[len-1] = '\0';
+    DM_PRIV_GetNodeFromPath(path, &obj_inst, &is_qualified_instance);
+    ce->inst_index = obj_inst.order;
+    USP_ASSERT(ce->inst.instances[ce->inst_index] == instance);
+
+    ce->object = object;
+    ce->param = param;
+    ce->op = op;
+    ce->constant = constant;
+    ce->permission_bitmask = DM_PRIV_GetPermissions(ce->node, combined_role);
+
+    // Convert the constant to the type of the parameter, checking that the operator is valid for the type
+    type_flags = ce->node->registered.param_info.type_flags;
     if (type_flags & (DM_INT | DM_UINT | DM_ULONG))
     {
-        cmp_cb = DM_ACCESS_CompareNumber;
+        // Exit if the constant is not a number
+        ce->type = kCompiledExprType_Number;
+        num_converted = sscanf(constant, "%Lf", &ce->value.number);
+        if (num_converted != 1)
+        {
+            USP_ERR_SetMessage("%s: Expecting expression constant ('%s') to be a number", __FUNCTION__, constant);
+            return USP_ERR_INVALID_PATH_SYNTAX;
+        }
     }
     else if (type_flags & DM_BOOL)
     {
-        cmp_cb = DM_ACCESS_CompareBool;
+        // Exit if the constant is not a boolean
+        ce->type = kCompiledExprType_Bool;
+        err = TEXT_UTILS_StringToBool(constant, &ce->value.boolean);
+        if (err != USP_ERR_OK)
+        {
+            USP_ERR_SetMessage("%s: Expecting expression constant ('%s') to be a boolean", __FUNCTION__, constant);
+            return USP_ERR_INVALID_PATH_SYNTAX;
+        }
     }
     else if (type_flags & DM_DATETIME)
     {
-        cmp_cb = DM_ACCESS_CompareDateTime;
+        // Exit if the constant is not a date-time
+        ce->type = kCompiledExprType_DateTime;
+        err = TEXT_UTILS_StringToDateTime(constant, &ce->value.date_time);
+        if (err != USP_ERR_OK)
+        {
+            USP_ERR_SetMessage("%s: Expecting expression constant ('%s') to be an ISO8601 dateTime", __FUNCTION__, constant);
+            return USP_ERR_INVALID_PATH_SYNTAX;
+        }
     }
     else
     {
         // Default, and also for DM_STRING
-        cmp_cb = DM_ACCESS_CompareString;
+        ce->type = kCompiledExprType_String;
     }
-    
-    // Exit if an error occurred when comparing the values
-    // This could occur if the operator was invalid for the specified type, or type conversion failed
-    err = cmp_cb(buf, op, expr_constant, result);
-    if (err != USP_ERR_OK)
+
+    // Exit if the operator is not supported for the type of the parameter
+    if (((ce->type == kCompiledExprType_String) || (ce->type == kCompiledExprType_Bool)) &&
+        (op != kExprOp_Equal) && (op != kExprOp_NotEqual))
     {
-        return err;
+        USP_ERR_SetMessage("%s: Operator '%s' not supported for %s", __FUNCTION__, expr_op_2_str[op], (ce->type == kCompiledExprType_String) ? "strings" : "booleans");
+        return USP_ERR_INVALID_PATH_SYNTAX;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetCompiledExprValue
+**
+** Gets the value of the parameter in a compiled search expression, for the specified instance of the object being searched
+** NOTE: Passwords will return empty string
+**
+** \param   ce - pointer to compiled expression
+** \param   instance - instance number of the object to get the parameter's value for
+** \param   value - pointer to structure in which to return the value of the parameter
+** \param   is_native_allowed - set if the value may be returned in its native type, rather than as a textual string
+**                              (the value is always returned as a textual string, if the caller needs to use the string)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_GetCompiledExprValue(dm_compiled_expr_t *ce, int instance, dm_expr_value_t *value, bool is_native_allowed)
+{
+    char path[MAX_DM_PATH];
+
+    // NOTE: The path is still needed by the database and vendor get callbacks, but the node is not looked up from it again
+    USP_SNPRINTF(path, sizeof(path), "%s%d.%s", ce->object, instance, ce->param);
+    ce->inst.instances[ce->inst_index] = instance;
+
+    if (is_native_allowed == false)
+    {
+        value->is_native = false;
+        return GetParameterValueFromNode(ce->node, path, &ce->inst, value->str, sizeof(value->str), 0, NULL, NULL);
+    }
+
+    return GetParameterValueFromNode(ce->node, path, &ce->inst, value->str, sizeof(value->str), 0, &value->native, &value->is_native);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_EvaluateCompiledExpr
+**
+** Compares the value of the parameter in a compiled search expression with the expression's constant
+**
+** \param   ce - pointer to compiled expression
+** \param   value - value of the parameter, obtained from DATA_MODEL_GetCompiledExprValue()
+** \param   result - pointer to variable in which to return whether the expression is true
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_EvaluateCompiledExpr(dm_compiled_expr_t *ce, dm_expr_value_t *value, bool *result)
+{
+    char buf[MAX_DM_SHORT_VALUE_LEN];
+    char *str;
+    unsigned type_flags;
+    long double number;
+    bool boolean;
+    time_t date_time;
+    int num_converted;
+    int cmp;
+    int err;
+
+    // Compare the native value of the parameter against the (already converted) constant, without converting it to a string
+    if (value->is_native)
+    {
+        type_flags = ce->node->registered.param_info.type_flags;
+        switch(ce->type)
+        {
+            case kCompiledExprType_Number:
+                number = NativeValueToNumber(&value->native, type_flags);
+                cmp = (number > ce->value.number) - (number < ce->value.number);
+                *result = IsCompiledExprOpTrue(ce->op, cmp);
+                return USP_ERR_OK;
+
+            case kCompiledExprType_Bool:
+                cmp = (value->native.value_bool != ce->value.boolean);
+                *result = IsCompiledExprOpTrue(ce->op, cmp);
+                return USP_ERR_OK;
+
+            case kCompiledExprType_DateTime:
+                date_time = value->native.value_datetime;
+                cmp = (date_time > ce->value.date_time) - (date_time < ce->value.date_time);
+                *result = IsCompiledExprOpTrue(ce->op, cmp);
+                return USP_ERR_OK;
+
+            default:
+                // Otherwise the type of the constant does not match the native type of the value, so compare them as strings
+                NativeValueToString(&value->native, type_flags, buf, sizeof(buf));
+                break;
+        }
+        str = buf;
+    }
+    else
+    {
+        str = value->str;
+    }
+
+    // Convert the value of the parameter to its type, then compare it against the (already converted) constant
+    // NOTE: Conversion of the value is not expected to fail, as the value has been read from the data model
+    switch(ce->type)
+    {
+        case kCompiledExprType_String:
+            cmp = strcmp(str, ce->constant);
+            break;
+
+        case kCompiledExprType_Number:
+            num_converted = sscanf(str, "%Lf", &number);
+            if (num_converted != 1)
+            {
+                USP_ERR_SetMessage("%s: Expecting expression parameter's value ('%s') to be a number", __FUNCTION__, str);
+                return USP_ERR_INTERNAL_ERROR;
+            }
+            cmp = (number > ce->value.number) - (number < ce->value.number);
+            break;
+
+        case kCompiledExprType_Bool:
+            err = TEXT_UTILS_StringToBool(str, &boolean);
+            if (err != USP_ERR_OK)
+            {
+                USP_ERR_SetMessage("%s: Expecting expression parameter's value ('%s') to be a boolean", __FUNCTION__, str);
+                return USP_ERR_INTERNAL_ERROR;
+            }
+            cmp = (boolean != ce->value.boolean);
+            break;
+
+        case kCompiledExprType_DateTime:
+            err = TEXT_UTILS_StringToDateTime(str, &date_time);
+            if (err != USP_ERR_OK)
+            {
+                USP_ERR_SetMessage("%s: Expecting expression parameter's value ('%s') to be an ISO8601 dateTime", __FUNCTION__, str);
+                return USP_ERR_INTERNAL_ERROR;
+            }
+            cmp = (date_time > ce->value.date_time) - (date_time < ce->value.date_time);
+            break;
+
+        default:
+            TERMINATE_BAD_CASE(ce->type);
+            cmp = 0;
+            break;
     }
 
+    *result = IsCompiledExprOpTrue(ce->op, cmp);
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** IsCompiledExprOpTrue
+**
+** Determines whether an expression's operator is satisfied, given the result of comparing the parameter's value against the constant
+**
+** \param   op - operator in the expression
+** \param   cmp - result of the comparison: negative if the value is less than the constant, 0 if equal, positive if greater
+**
+** \return  true if the expression is true
+**
+**************************************************************************/
+bool IsCompiledExprOpTrue(expr_op_t op, int cmp)
+{
+    switch(op)
+    {
+        case kExprOp_Equal:
+            return (cmp == 0);
+
+        case kExprOp_NotEqual:
+            return (cmp != 0);
+
+        case kExprOp_LessThanOrEqual:
+            return (cmp <= 0);
+
+        case kExprOp_GreaterThanOrEqual:
+            return (cmp >= 0);
+
+        case kExprOp_LessThan:
+            return (cmp < 0);
+
+        case kExprOp_GreaterThan:
+            return (cmp > 0);
+
+        default:
+            TERMINATE_BAD_CASE(op);
+            break;
+    }
+
+    return false;
+}
+
 /*********************************************************************//**
 **
 ** DATA_MODEL_GetPathProperties
@@ -1558,8 +2544,34 @@ unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role
 {
     dm_node_t *node;
     dm_instances_t inst;
-    bool exists;
     bool is_qualified_instance;
+
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    return DATA_MODEL_GetNodePathProperties(node, &inst, is_qualified_instance, combined_role, permission_bitmask);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetNodePathProperties
+**
+** Determines the properties of a path which has already been parsed into its node and instance numbers
+** This allows callers which need the node of the path as well as its properties (eg the path resolver), to parse the path only once
+**
+** \param   node - pointer to node in the data model schema representing the path, or NULL if the path does not exist in the schema
+** \param   inst - pointer to instance numbers parsed from the path
+** \param   is_qualified_instance - set if the path was fully qualified with instance numbers
+** \param   role - pointer to role used to access this path. If set to INTERNAL_ROLE(=NULL), then full permissions are always returned
+** \param   permission_bitmask - pointer to variable in which to return the permissions associated with this path
+**                               If this parameter is NULL, then the caller is not interested in the permissions for this node,
+**                               and the role argument is ignored
+**
+** \return  flag variable containing the path's properties
+**
+**************************************************************************/
+unsigned DATA_MODEL_GetNodePathProperties(dm_node_t *node, dm_instances_t *inst, bool is_qualified_instance, combined_role_t *combined_role, unsigned short *permission_bitmask)
+{
+    dm_instances_t parent_inst;
+    bool exists;
     unsigned flags = 0;               // default return value
 
     // Default return value for permissions
@@ -1569,13 +2581,11 @@ unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role
     }
     
     // Exit if path does not exist in the schema
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
     if (node == NULL)
     {
         return flags;
     }
     flags |= PP_EXISTS_IN_SCHEMA;
-
     // Setup permissions to return
     if (permission_bitmask != NULL)
     {
@@ -1599,13 +2609,16 @@ unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role
         case kDMNodeType_DBParam_Secure:
             flags |= PP_IS_SECURE_PARAM;
             // Intentional fall through
-            
-        case kDMNodeType_Param_ConstantValue:
-        case kDMNodeType_Param_NumEntries:
+
         case kDMNodeType_DBParam_ReadWrite:
         case kDMNodeType_DBParam_ReadOnly:
         case kDMNodeType_DBParam_ReadOnlyAuto:
         case kDMNodeType_DBParam_ReadWriteAuto:
+            flags |= PP_IS_DB_PARAM;
+            // Intentional fall through
+            
+        case kDMNodeType_Param_ConstantValue:
+        case kDMNodeType_Param_NumEntries:
         case kDMNodeType_VendorParam_ReadOnly:
         case kDMNodeType_VendorParam_ReadWrite:
             flags |= PP_IS_PARAMETER;
@@ -1630,7 +2643,7 @@ unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role
 
     // Determine if the specified object instances of the parameter/object exist
     // NOTE: If the path is to an unqualified multi-instance object, then this checks the parent instances of the object
-    exists = DM_INST_VECTOR_IsExist(&inst);
+    exists = DM_INST_VECTOR_IsExist(inst);
     if (exists)
     {
         flags |= (PP_INSTANCE_NUMBERS_EXIST | PP_PARENT_INSTANCE_NUMBERS_EXIST);
@@ -1641,14 +2654,16 @@ unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role
         // (This flag is used by SetRequest:auto-create objects)
         if (is_qualified_instance)
         {
-            if (inst.order == 1)
+            if (inst->order == 1)
             {
                 flags |= PP_PARENT_INSTANCE_NUMBERS_EXIST;
             }
-            else if (inst.order > 1)
+            else if (inst->order > 1)
             {
-                inst.order--;
-                exists = DM_INST_VECTOR_IsExist(&inst);
+                // NOTE: A copy of the instance numbers is used, as the caller's instance numbers must not be modified
+                memcpy(&parent_inst, inst, sizeof(parent_inst));
+                parent_inst.order--;
+                exists = DM_INST_VECTOR_IsExist(&parent_inst);
                 if (exists)
                 {
                     flags |= PP_PARENT_INSTANCE_NUMBERS_EXIST;
@@ -1748,81 +2763,161 @@ int DATA_MODEL_InformInstance(char *path)
 
 /*********************************************************************//**
 **
-** DATA_MODEL_AddParameterInstances
+** DATA_MODEL_RefreshInstance
 **
-** Adds the specified object instances for the parameter to the internal data model instance arrays
-** NOTE: This function is called at bootup by the database startup code to seed the model with the
-**       object instances contained in the database
-** NOTE: The instance is not added again, if it already exists
+** Informs the data model that an instance of the specified object exists, whilst its instances are being
+** re-read by its refresh instances callback (see USP_REGISTER_Object_RefreshInstances)
 **
-** \param   hash - hash identifying data model parameter
-** \param   instances - string containing the instance numbers of the multi-instance objects in the path of the parameter
+** \param   path - path to instance which exists
 **
 ** \return  USP_ERR_OK if successful
-**          USP_ERR_INTERNAL_ERROR if the parameter does not exist in the data model or the
-**          instance numbers are not correct (invalid, too many or not enough for the object's path)
 **
 **************************************************************************/
-int DATA_MODEL_AddParameterInstances(dm_hash_t hash, char *instances)
+int DATA_MODEL_RefreshInstance(char *path)
 {
     dm_node_t *node;
     dm_instances_t inst;
-    int err;
+    bool is_qualified_instance;
 
-    // Exit if parameter does not exist in the data model
-    node = FindNodeFromHash(hash);
+    // Exit if unable to get node associated with the object
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
     if (node == NULL)
     {
-        USP_ERR_SetMessage("%s: WARNING: Parameter (hash=%d) does not exist in the data model schema", __FUNCTION__, hash);
         return USP_ERR_INVALID_PATH;
     }
 
-    // Exit if unable to parse the instance numbers from the string
-    memset(&inst, 0, sizeof(inst));
-    err = ParseInstanceString(instances, &inst);
-    if (err != USP_ERR_OK)
-    {
-        USP_ERR_SetMessage("%s: Instance numbers ('%s') for hash=%d are invalid", __FUNCTION__, instances, hash);
-        return USP_ERR_INTERNAL_ERROR;
-    }
-
-    // Exit if the number of object instances in this string do not match the data model schema
-    if (inst.order != node->order)
-    {
-        USP_ERR_SetMessage("%s: Number of instance numbers ('%s') for hash=%d does not match the number expected (%d)", __FUNCTION__, instances, hash, node->order);
-        return USP_ERR_INTERNAL_ERROR;
-    }
-
-    // Since they match, copy across the instance nodes which are the data model objects associated with the parsed instance numbers
-    memcpy(inst.nodes, node->instance_nodes, inst.order*sizeof(dm_node_t *));
-
-    // Finally add this instance to the dm_instances_vector vector
-    err = DM_INST_VECTOR_Add(&inst);
-    if (err != USP_ERR_OK)
+    // Exit if the specified path does not represent a qualified multi-instance object
+    if ((is_qualified_instance == false) || (inst.order == 0) || (node->type != kDMNodeType_Object_MultiInstance))
     {
-        return err;
+        USP_ERR_SetMessage("%s: path %s does not represent a fully qualified multi-instance object", __FUNCTION__, path);
+        return USP_ERR_INVALID_PATH;
     }
 
-    return USP_ERR_OK;
+    return DM_INST_VECTOR_RefreshInstance(&inst);
 }
 
 /*********************************************************************//**
 **
-** DATA_MODEL_GetUniqueKeys
+** DATA_MODEL_ResolveParameterInstances
 **
-** Gets all the unique keys for the specified multi-instance object
+** Validates the instance numbers read from the database for the specified parameter, and forms the
+** full instance structure (instance numbers and associated multi-instance object nodes) for them
+** NOTE: This function is called at bootup by the database startup code, which then adds all resolved
+**       object instances to the data model in bulk using DM_INST_VECTOR_AddBulk()
 **
-** \param   path - pointer to string containing complete path to multi-instance object
-** \param   ukv - pointer to variable in which to return a vector containing the unique keys
+** \param   hash - hash identifying data model parameter
+** \param   db_inst - pointer to instance numbers of the multi-instance objects in the path of the parameter (as read from the database)
+**                    NOTE: Only the order and instance numbers are used
+** \param   inst - pointer to variable in which to return the resolved instance structure
 **
 ** \return  USP_ERR_OK if successful
+**          USP_ERR_INVALID_PATH if the parameter does not exist in the data model
+**          USP_ERR_INTERNAL_ERROR if the instance numbers are not correct (too many or not enough for the object's path)
 **
 **************************************************************************/
-int DATA_MODEL_GetUniqueKeys(char *path, dm_unique_key_vector_t *ukv)
+int DATA_MODEL_ResolveParameterInstances(dm_hash_t hash, dm_instances_t *db_inst, dm_instances_t *inst)
 {
     dm_node_t *node;
-    dm_instances_t inst;
-    bool is_qualified_instance;
+
+    // Exit if parameter does not exist in the data model
+    node = FindNodeFromHash(hash);
+    if (node == NULL)
+    {
+        USP_ERR_SetMessage("%s: WARNING: Parameter (hash=%lld) does not exist in the data model schema", __FUNCTION__, (long long)hash);
+        return USP_ERR_INVALID_PATH;
+    }
+
+    // Exit if the number of object instances do not match the data model schema
+    if (db_inst->order != node->order)
+    {
+        USP_ERR_SetMessage("%s: Number of instance numbers (%d) for hash=%lld does not match the number expected (%d)", __FUNCTION__, db_inst->order, (long long)hash, node->order);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Copy the instance numbers
+    // NOTE: The whole structure is cleared first, as instance structures are compared using memcmp()
+    memset(inst, 0, sizeof(dm_instances_t));
+    inst->order = db_inst->order;
+    memcpy(inst->instances, db_inst->instances, inst->order*sizeof(int));
+
+    // Since they match, copy across the instance nodes which are the data model objects associated with the parsed instance numbers
+    memcpy(inst->nodes, node->instance_nodes, inst->order*sizeof(dm_node_t *));
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetDbHashMapping
+**
+** Returns a table mapping the hash of every database parameter in the schema in the specified hash format,
+** to its hash in the selected hash format. This is used to migrate the keys of the database between hash formats
+** NOTE: If more than one parameter has the same hash in the old format, then the parameter in the database
+**       cannot be identified, so the mappings for that old hash have a new_hash of 0
+**
+** \param   old_format - hash format to map from (eg DB_HASH_FORMAT_32BIT)
+** \param   p_mapping - pointer to variable in which to return a dynamically allocated array of mappings, sorted by old_hash
+**                      NOTE: The caller must free this array
+**
+** \return  number of entries in the array
+**
+**************************************************************************/
+int DATA_MODEL_GetDbHashMapping(int old_format, dm_hash_mapping_t **p_mapping)
+{
+    dm_hash_mapping_t *mapping;
+    dm_hash_mapping_t *m;
+    int num_mappings = 0;
+    int i;
+
+    // Calculate the hash in the old format, of all database parameters in the node lookup table
+    mapping = USP_MALLOC((node_lookup_count+1)*sizeof(dm_hash_mapping_t));   // Plus 1 to avoid a zero size allocation
+    for (i=0; i < node_lookup_size; i++)
+    {
+        if (node_lookup[i].hash != 0)
+        {
+            m = &mapping[num_mappings];
+            m->old_hash = DM_PRIV_CalcDbHash(node_lookup[i].node->path, old_format);
+            m->new_hash = node_lookup[i].hash;
+            num_mappings++;
+        }
+    }
+    USP_ASSERT(num_mappings == node_lookup_count);
+
+    // Sort the mappings, so that they can be searched using a binary search, and so that duplicate old hashes are adjacent
+    qsort(mapping, num_mappings, sizeof(dm_hash_mapping_t), CompareDbHashMapping);
+
+    // Mark all mappings whose old hash is ambiguous
+    for (i=1; i < num_mappings; i++)
+    {
+        if (mapping[i].old_hash == mapping[i-1].old_hash)
+        {
+            USP_LOG_Warning("%s: Parameters with hash=%lld in the old database hash format cannot be distinguished", __FUNCTION__, (long long)mapping[i].old_hash);
+            mapping[i].new_hash = 0;
+            mapping[i-1].new_hash = 0;
+        }
+    }
+
+    *p_mapping = mapping;
+    return num_mappings;
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_GetUniqueKeys
+**
+** Gets all the unique keys for the specified multi-instance object
+**
+** \param   path - pointer to string containing complete path to multi-instance object
+** \param   ukv - pointer to variable in which to return a vector containing the unique keys
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATA_MODEL_GetUniqueKeys(char *path, dm_unique_key_vector_t *ukv)
+{
+    dm_node_t *node;
+    dm_instances_t inst;
+    bool is_qualified_instance;
 
     // Exit if path does not exist in the schema
     node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
@@ -1975,6 +3070,146 @@ void DATA_MODEL_DumpInstances(void)
     DumpInstanceVectorRecursive(root_internal_node);
 }
 
+/*********************************************************************//**
+**
+** DATA_MODEL_EnableCallbackStats
+**
+** Enables or disables accounting of the time spent in the vendor callbacks registered for each data model node
+** Enabling the accounting resets the statistics of all nodes, so that they cover only the period that they were enabled for
+**
+** \param   enable - set if the time spent in vendor callbacks should be accounted
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_EnableCallbackStats(bool enable)
+{
+    if (enable)
+    {
+        ResetCallbackStatsRecursive(root_device_node);
+        ResetCallbackStatsRecursive(root_internal_node);
+    }
+
+    __atomic_store_n(&is_cb_stats_enabled, enable, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_InvalidateCachedValue
+**
+** Discards the cached value of the specified vendor parameter (if any)
+** This is called when the vendor signals that the value of the parameter has changed
+**
+** \param   path - path of the parameter whose cached value is stale
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_InvalidateCachedValue(char *path)
+{
+    dm_node_t *node;
+    dm_instances_t inst;
+    bool is_qualified_instance;
+
+    // Exit if the path does not represent a parameter whose value is cached
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    if ((node == NULL) || ((node->type != kDMNodeType_VendorParam_ReadOnly) && (node->type != kDMNodeType_VendorParam_ReadWrite)))
+    {
+        return;
+    }
+
+    if (node->registered.param_info.cache_period == 0)
+    {
+        return;
+    }
+
+    InvalidateCachedValue(node, &inst);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_DumpValueCache
+**
+** Logs the statistics of the cache of vendor parameter values
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_DumpValueCache(void)
+{
+    int i;
+    int count = 0;
+    unsigned hits;
+    unsigned misses;
+    unsigned long long total;
+
+    LockValueCache();
+    for (i=0; i < VENDOR_GET_CACHE_SIZE; i++)
+    {
+        if (value_cache[i].node != NULL)
+        {
+            count++;
+        }
+    }
+    hits = value_cache_hits;
+    misses = value_cache_misses;
+    UnlockValueCache();
+
+    total = (unsigned long long)hits + (unsigned long long)misses;
+    USP_DUMP("Vendor parameter value cache: %d entries (table size=%d)", count, VENDOR_GET_CACHE_SIZE);
+    USP_DUMP("Hits: %u", hits);
+    USP_DUMP("Misses: %u", misses);
+    USP_DUMP("Hit rate: %llu%%", (total == 0) ? 0 : (100*(unsigned long long)hits)/total);
+    USP_DUMP("Invalidations: %u", value_cache_invalidations);
+}
+
+/*********************************************************************//**
+**
+** DATA_MODEL_DumpSlowestCallbacks
+**
+** Logs the data model nodes whose vendor callbacks have taken the most time in total, slowest first
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DATA_MODEL_DumpSlowestCallbacks(void)
+{
+    dm_node_t **nodes;
+    dm_cb_stats_t *cs;
+    int num_nodes = 0;
+    unsigned long long count;
+    int i;
+
+    // Form an array of all nodes whose vendor callbacks have been timed, sorted by total time spent in the callbacks
+    nodes = USP_MALLOC(schema_num_nodes*sizeof(dm_node_t *));
+    AddTimedNodesRecursive(root_device_node, nodes, &num_nodes);
+    AddTimedNodesRecursive(root_internal_node, nodes, &num_nodes);
+    qsort(nodes, num_nodes, sizeof(dm_node_t *), CompareCallbackTotalTime);
+
+    // Exit if no vendor callbacks have been timed
+    if (num_nodes == 0)
+    {
+        USP_DUMP("No vendor callbacks have been timed%s", (is_cb_stats_enabled) ? "" : ". Use 'cbstats 1' to enable vendor callback statistics");
+        USP_FREE(nodes);
+        return;
+    }
+
+    USP_DUMP("%-10s %12s %10s %10s  %s", "Count", "Total(us)", "Mean(us)", "Max(us)", "Path");
+    for (i=0; (i < num_nodes) && (i < MAX_SLOWEST_CALLBACKS); i++)
+    {
+        cs = &nodes[i]->cb_stats;
+        count = __atomic_load_n(&cs->count, __ATOMIC_RELAXED);
+        USP_DUMP("%-10llu %12llu %10llu %10llu  %s", count, __atomic_load_n(&cs->total_time, __ATOMIC_RELAXED),
+                 __atomic_load_n(&cs->total_time, __ATOMIC_RELAXED) / count, __atomic_load_n(&cs->max_time, __ATOMIC_RELAXED), nodes[i]->path);
+    }
+
+    USP_FREE(nodes);
+}
+
 /*********************************************************************//**
 **
 ** DATA_MODEL_GetNumInstances
@@ -2122,13 +3357,16 @@ int DATA_MODEL_GetInstances(char *path, int_vector_t *iv)
 ** \param   path - path of the object. NOTE: This is not a schema path (ie no '{i}' in the path. Use a partial path).
 ** \param   sv - pointer to structure in which to return the paths to the instances
 **               NOTE: The caller must initialise this structure. This function adds to this structure, it does not initialise it.
+** \param   ss - pointer to hash index of sv, used to avoid adding paths which are already present in sv
+**               or NULL if the caller does not maintain an index of sv. In this case a temporary index is used
 ** \param   combined_role - role to use to check that object instances may be returned.  If set to INTERNAL_ROLE, then full permissions are always returned
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, combined_role_t *combined_role)
+int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, str_set_t *ss, combined_role_t *combined_role)
 {
+    str_set_t local_ss;
     int_vector_t iv;
     dm_instances_t inst;
     bool is_qualified_instance;
@@ -2140,6 +3378,11 @@ int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, combined_role_t *c
     unsigned short permission_bitmask;
 
     INT_VECTOR_Init(&iv);
+    STR_SET_Init(&local_ss);
+    if (ss == NULL)
+    {
+        ss = &local_ss;
+    }
 
     // Exit if unable to find node representing this object
     node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
@@ -2159,14 +3402,15 @@ int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, combined_role_t *c
     // NOTE: This case is not used when resolving add/delete object subscriptions, but is used for GetInstances
     if (node->type != kDMNodeType_Object_MultiInstance)
     {
-        STR_VECTOR_Add_IfNotExist(sv, path);
-        return USP_ERR_OK;
+        STR_SET_AddIfNotExist(ss, sv, path);
+        err = USP_ERR_OK;
+        goto exit;
     }
 
     // Exit if this object is a fully qualified instance, putting it in the returned string vector
     if (is_qualified_instance)
     {
-        STR_VECTOR_Add_IfNotExist(sv, path);
+        STR_SET_AddIfNotExist(ss, sv, path);
     }
 
     // Get an array of instances for this specific object
@@ -2177,18 +3421,20 @@ int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, combined_role_t *c
     }
 
     // Iterate over all instances of this object
+    STR_VECTOR_Reserve(sv, iv.num_entries);
     for (i=0; i < iv.num_entries; i++)
     {
         // Form the path to this instance
         instance = iv.vector[i];
         USP_SNPRINTF(buf, sizeof(buf), "%s.%d", path, instance);
-        STR_VECTOR_Add_IfNotExist(sv, buf);
+        STR_SET_AddIfNotExist(ss, sv, buf);
     }
 
     err = USP_ERR_OK;
 
 exit:
     INT_VECTOR_Destroy(&iv);
+    STR_SET_Destroy(&local_ss);
     return err;
 }
 
@@ -2283,6 +3529,35 @@ char DATA_MODEL_GetJSONParameterType(char *path)
     return type;
 }
 
+/*********************************************************************//**
+**
+** DATA_MODEL_GetParameterType
+**
+** Obtains the registered type of the specified parameter
+** NOTE: This function MUST only ever be called on parameter (not object) paths that have already been validated
+**
+** \param   path - full data model path of the parameter
+**
+** \return  type of the parameter eg DM_STRING, DM_UINT etc
+**
+**************************************************************************/
+unsigned DATA_MODEL_GetParameterType(char *path)
+{
+    dm_instances_t inst;            // unused
+    bool is_qualified_instance;     // unused
+    dm_node_t *node;
+
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    USP_ASSERT(node != NULL);  // because the path we queried was generated by the path resolver, so we expect it to exist
+    USP_ASSERT( ((node->type != kDMNodeType_Object_MultiInstance) &&
+                 (node->type != kDMNodeType_Object_SingleInstance) &&
+                 (node->type != kDMNodeType_SyncOperation) &&
+                 (node->type != kDMNodeType_AsyncOperation) &&
+                 (node->type != kDMNodeType_Event)) );
+
+    return node->registered.param_info.type_flags;
+}
+
 /*********************************************************************//**
 **
 ** DATA_MODEL_SetParameterInDatabase
@@ -2300,12 +3575,12 @@ int DATA_MODEL_SetParameterInDatabase(char *path, char *value)
 {
     int err;
     dm_hash_t hash;
-    char instances[MAX_DM_PATH];
+    dm_instances_t inst;
     unsigned path_flags;
     unsigned db_flags;
     
     // Exit if parameter path is incorrect
-    err = DM_PRIV_FormDB_FromPath(path, &hash, instances, sizeof(instances));
+    err = DM_PRIV_FormDB_FromPath(path, &hash, &inst);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -2316,11 +3591,14 @@ int DATA_MODEL_SetParameterInDatabase(char *path, char *value)
     db_flags = (path_flags & PP_IS_SECURE_PARAM) ? OBFUSCATED_VALUE : 0;
 
     // Exit if unable to set value of parameter in DB
-    err = DATABASE_SetParameterValue(path, hash, instances, value, db_flags);
+    // NOTE: Unique key indexes are marked as stale, as the parameter may be part of a unique key
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    err = DATABASE_SetParameterValue(path, hash, &inst, value, db_flags);
     if (err != USP_ERR_OK)
     {
         return err;
     }
+    DEVICE_SUBSCRIPTION_NotifyDbParamChanged(path);
 
     return USP_ERR_OK;
 }
@@ -2467,24 +3745,23 @@ dm_node_t *DM_PRIV_GetNodeFromPath(char *path, dm_instances_t *inst, bool *is_qu
 {
     dm_node_t *parent;        // This pointer walks through the data model tree
     dm_node_t *child;         // This pointer walks through the children of the parent node
-    char *segments[MAX_PATH_SEGMENTS];
+    dm_path_token_t tokens[MAX_PATH_SEGMENTS];
     int num_segments;
-    char path_segments[MAX_DM_PATH];
     int i;
 
     // Exit if there were too many or not enough segments in the path
-    num_segments = ParsePath(path, path_segments, sizeof(path_segments), segments, MAX_PATH_SEGMENTS, inst);
+    num_segments = ParsePath(path, tokens, MAX_PATH_SEGMENTS, inst);
     if (num_segments < 1)
     {
         return NULL;
     }
 
     // Exit if first segment was not one of the the root data model nodes
-    if (strcmp(segments[0], root_device_node->name) == 0)
+    if (IsNodeMatchingToken(root_device_node, &tokens[0]))
     {
         parent = root_device_node;
     }
-    else if (strcmp(segments[0], root_internal_node->name) == 0)
+    else if (IsNodeMatchingToken(root_internal_node, &tokens[0]))
     {
         parent = root_internal_node;
     }
@@ -2497,7 +3774,7 @@ dm_node_t *DM_PRIV_GetNodeFromPath(char *path, dm_instances_t *inst, bool *is_qu
     // Iterate over subsequent segments, using them to traverse the data model tree
     for (i=1; i<num_segments; i++)
     {
-        child = DM_PRIV_FindMatchingChild(parent, segments[i]);
+        child = FindMatchingChildToken(parent, &tokens[i]);
         if (child == NULL)
         {
             USP_ERR_SetMessage("%s: Path is invalid: %s", __FUNCTION__, path);
@@ -2627,7 +3904,7 @@ dm_node_t *DM_PRIV_AddSchemaPath(char *path, dm_node_type_t type, unsigned flags
             }
 
             // Add the node to it's parent
-            DLLIST_LinkToTail(&parent->child_nodes, child);
+            AddChildNode(parent, child);
 
             // Add this node to the instance node array, if it is a multi-instance object
             if (seg->type == kDMNodeType_Object_MultiInstance)
@@ -2637,7 +3914,16 @@ dm_node_t *DM_PRIV_AddSchemaPath(char *path, dm_node_type_t type, unsigned flags
             }
 
             // Save the instance nodes for this object
-            memcpy(child->instance_nodes, &inst.nodes, inst.order*sizeof(dm_node_t *));
+            // NOTE: If this node has the same instance nodes as its parent, then the parent's array is shared
+            if (inst.order == parent->order)
+            {
+                child->instance_nodes = parent->instance_nodes;
+            }
+            else
+            {
+                child->instance_nodes = SchemaArenaAlloc(inst.order*sizeof(dm_node_t *));
+                memcpy(child->instance_nodes, &inst.nodes, inst.order*sizeof(dm_node_t *));
+            }
             child->order = inst.order;
         }
         else
@@ -2690,6 +3976,141 @@ dm_node_t *DM_PRIV_AddSchemaPath(char *path, dm_node_type_t type, unsigned flags
     return parent;
 }        
 
+/*********************************************************************//**
+**
+** DM_PRIV_AddStaticSchema
+**
+** Allocates and initialises the data model nodes of a static schema table (generated by obuspa_schemac)
+** This performs the same function as calling DM_PRIV_AddSchemaPath() for each node in the table, but without
+** parsing the paths, or calculating the hashes of each node, since these have been precomputed at build time
+** NOTE: The name and path of each node point directly to the strings in the table, rather than being copied
+** NOTE: The registered information of each node is not filled in by this function. This is left to the caller
+**
+** \param   schema - pointer to static schema table
+** \param   nodes - pointer to array in which to return the data model node corresponding to each node in the table
+** \param   pre_existing - pointer to array in which to return whether each node already existed in the data model
+**                         (in which case its registered information must not be overwritten)
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if the table conflicts with nodes already in the data model
+**
+**************************************************************************/
+int DM_PRIV_AddStaticSchema(const usp_static_schema_t *schema, dm_node_t **nodes, bool *pre_existing)
+{
+    int i;
+    const usp_static_node_t *sn;
+    dm_node_t *parent;
+    dm_node_t *child;
+    dm_node_type_t type;
+    dm_hash_t hash;
+    bool is_hash_checked = false;
+    int size;
+
+    // Exit if the first node in the table is not one of the root data model nodes
+    sn = &schema->nodes[0];
+    if ((schema->num_nodes < 1) || (sn->parent != -1))
+    {
+        USP_ERR_SetMessage("%s: Static schema table does not start with a root node", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    if (strcmp(sn->name, root_device_node->name) == 0)
+    {
+        nodes[0] = root_device_node;
+    }
+    else if (strcmp(sn->name, root_internal_node->name) == 0)
+    {
+        nodes[0] = root_internal_node;
+    }
+    else
+    {
+        USP_ERR_SetMessage("%s: Invalid root node %s", __FUNCTION__, sn->name);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    pre_existing[0] = true;
+
+    // Iterate over all other nodes in the table, adding them to the data model
+    // NOTE: Parents always precede their children in the table
+    for (i=1; i < schema->num_nodes; i++)
+    {
+        sn = &schema->nodes[i];
+        USP_ASSERT((sn->parent >= 0) && (sn->parent < i));
+        USP_ASSERT(sn->type < NUM_ELEM(static_node_type_to_dm_type));
+        parent = nodes[sn->parent];
+        type = static_node_type_to_dm_type[sn->type];
+
+        // Only nodes whose parent already existed in the data model need to be checked against the existing children
+        if (pre_existing[sn->parent])
+        {
+            child = DM_PRIV_FindMatchingChild(parent, sn->name);
+            if (child != NULL)
+            {
+                // Exit if the node already exists, unless it is an object which is only in the table because it is in the path to other nodes
+                if ((sn->is_implicit == false) || (child->type != type))
+                {
+                    USP_ERR_SetMessage("%s: Path %s already exists in schema", __FUNCTION__, sn->path);
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+
+                nodes[i] = child;
+                pre_existing[i] = true;
+                continue;
+            }
+        }
+
+        // Check once per table that the precomputed hashes match those that the data model calculates
+        // This guards against registering a table generated by a version of obuspa_schemac using different hash functions
+        hash = (DB_HASH_FORMAT == DB_HASH_FORMAT_64BIT) ? (dm_hash_t)sn->db_hash64 : (dm_hash_t)sn->db_hash32;
+        if ((is_hash_checked == false) && (hash != 0))
+        {
+            if ((hash != DM_PRIV_CalcDbHash(sn->path, DB_HASH_FORMAT)) || (sn->name_hash != TEXT_UTILS_CalcHash(sn->name)))
+            {
+                USP_ERR_SetMessage("%s: Precomputed hashes of %s are incorrect. Regenerate the table using obuspa_schemac", __FUNCTION__, sn->path);
+                return USP_ERR_INTERNAL_ERROR;
+            }
+            is_hash_checked = true;
+        }
+
+        // Exit if unable to create the node
+        child = CreateStaticNode(sn, type);
+        if (child == NULL)
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+        AddChildNode(parent, child);
+        nodes[i] = child;
+        pre_existing[i] = false;
+
+        // Save the instance nodes for this object
+        // NOTE: If this node has the same instance nodes as its parent, then the parent's array is shared
+        if (type == kDMNodeType_Object_MultiInstance)
+        {
+            child->order = parent->order + 1;
+            child->instance_nodes = SchemaArenaAlloc(child->order*sizeof(dm_node_t *));
+            memcpy(child->instance_nodes, parent->instance_nodes, parent->order*sizeof(dm_node_t *));
+            child->instance_nodes[parent->order] = child;
+        }
+        else
+        {
+            child->order = parent->order;
+            child->instance_nodes = parent->instance_nodes;
+        }
+
+        // Size the hash table of children up front, since the number of children is known
+        if (sn->num_children >= CHILD_TABLE_THRESHOLD)
+        {
+            size = CHILD_TABLE_MIN_SIZE;
+            while (size < 2*sn->num_children)
+            {
+                size *= 2;
+            }
+            ResizeChildTable(child, size);
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** DM_PRIV_FormPath_FromDM
@@ -2751,29 +4172,27 @@ char *DM_PRIV_FormPath_FromDM(dm_node_t *node, dm_instances_t *inst, char *buf,
 **
 ** DM_PRIV_FormDB_FromPath
 **
-** Forms the hash and instance string of the specified parameter path
+** Forms the hash and instance numbers of the specified parameter path
 ** This function is called by the 'dbset' and 'dbget' CLI commands
 ** NOTE: This function is not intended to support objects, as they are not represented in the database directly)
 **
 ** \param   path - path to parameter in the data model 
 ** \param   hash - pointer to variable in which to store the hash identifying the data model parameter
-** \param   instances - pointer to buffer to return a string containing the instance numbers of the multi-instance objects in the path
-** \param   len - length of the buffer
+** \param   inst - pointer to structure in which to return the instance numbers of the multi-instance objects in the path
 **
 ** \return  USP_ERR_OK if successful
 **          USP_ERR_INTERNAL_ERROR if the parameter does not exist in the data model or the
 **          instance numbers are not correct (invalid, too many or not enough for the object's path)
 **
 **************************************************************************/
-int DM_PRIV_FormDB_FromPath(char *path, dm_hash_t *hash, char *instances, int len)
+int DM_PRIV_FormDB_FromPath(char *path, dm_hash_t *hash, dm_instances_t *inst)
 {
     dm_node_t *node;
-    dm_instances_t inst;
     bool is_qualified_instance; // unused (as only relevant for objects)
 
     // Exit if parameter does not exist in the data model
     // or parameter is specified with incorrect instance order
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    node = DM_PRIV_GetNodeFromPath(path, inst, &is_qualified_instance);
     if (node == NULL)
     {
         return USP_ERR_INVALID_PATH;
@@ -2795,55 +4214,72 @@ int DM_PRIV_FormDB_FromPath(char *path, dm_hash_t *hash, char *instances, int le
     USP_ASSERT(node->hash != 0);
 
     *hash = node->hash;
-    FormInstanceString(&inst, instances, len);
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** DM_PRIV_CalcDbHash
+**
+** Calculates the hash used as the key of the specified database parameter in the database
+**
+** \param   schema_path - schema path of the parameter (containing '{i}' instead of instance numbers)
+** \param   format - hash format to calculate the hash in (eg DB_HASH_FORMAT_32BIT)
+**
+** \return  hash value
+**
+**************************************************************************/
+dm_hash_t DM_PRIV_CalcDbHash(char *schema_path, int format)
+{
+    if (format == DB_HASH_FORMAT_64BIT)
+    {
+        return (dm_hash_t) TEXT_UTILS_CalcWordHash64(schema_path);
+    }
+
+    // NOTE: The 32 bit hash is sign extended, as this is how it has always been stored in the database
+    return (dm_hash_t) TEXT_UTILS_CalcHash(schema_path);
+}
+
 /*********************************************************************//**
 **
 ** DM_PRIV_FormPath_FromDB
 **
-** Forms a data model path string from hash and instance string
+** Forms a data model path string from hash and instance numbers
 ** This function is called by the database code to dump the contents of the database
 **
 ** \param   hash - hash identifying data model parameter
-** \param   instances - string containing the instance numbers of the multi-instance objects in the path of the parameter
+** \param   db_inst - pointer to instance numbers of the multi-instance objects in the path of the parameter (as read from the database)
 ** \param   buf - pointer to buffer in which to store the parameter
+** \param   len - length of the buffer
 **
 ** \return  USP_ERR_OK if successful
 **          USP_ERR_INTERNAL_ERROR if the parameter does not exist in the data model or the
 **          instance numbers are not correct (invalid, too many or not enough for the object's path)
 **
 **************************************************************************/
-int DM_PRIV_FormPath_FromDB(dm_hash_t hash, char *instances, char *buf, int len)
+int DM_PRIV_FormPath_FromDB(dm_hash_t hash, dm_instances_t *db_inst, char *buf, int len)
 {
     dm_node_t *node;
     dm_instances_t inst;
-    int err;
 
     // Exit if parameter does not exist in the data model
     node = FindNodeFromHash(hash);
     if (node == NULL)
     {
-        USP_ERR_SetMessage("%s: Parameter (hash=%d) does not exist in the data model schema", __FUNCTION__, hash);
+        USP_ERR_SetMessage("%s: Parameter (hash=%lld) does not exist in the data model schema", __FUNCTION__, (long long)hash);
         return USP_ERR_INVALID_PATH;
     }
 
-    // Exit if unable to parse the instance numbers from the string
-    memset(&inst, 0, sizeof(inst));
-    err = ParseInstanceString(instances, &inst);
-    if (err != USP_ERR_OK)
+    // Exit if the number of object instances do not match the data model schema
+    if (db_inst->order != node->order)
     {
-        USP_ERR_SetMessage("%s: Instance numbers ('%s') for hash=%d are invalid", __FUNCTION__, instances, hash);
+        USP_ERR_SetMessage("%s: Number of instance numbers (%d) for hash=%lld does not match the number expected (%d)", __FUNCTION__, db_inst->order, (long long)hash, node->order);
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Exit if the number of object instances in this string do not match the data model schema
-    if (inst.order != node->order)
-    {
-        USP_ERR_SetMessage("%s: Number of instance numbers ('%s') for hash=%d does not match the number expected (%d)", __FUNCTION__, instances, hash, node->order);
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    memset(&inst, 0, sizeof(inst));
+    inst.order = db_inst->order;
+    memcpy(inst.instances, db_inst->instances, inst.order*sizeof(int));
 
     DM_PRIV_FormPath_FromDM(node, &inst, buf, len);
     return USP_ERR_OK;
@@ -2862,14 +4298,61 @@ int DM_PRIV_FormPath_FromDB(dm_hash_t hash, char *instances, char *buf, int len)
 **
 **************************************************************************/
 dm_node_t *DM_PRIV_FindMatchingChild(dm_node_t *parent, char *name)
+{
+    dm_path_token_t token;
+
+    token.name = name;
+    token.len = strlen(name);
+    token.hash = TEXT_UTILS_CalcHash(name);
+
+    return FindMatchingChildToken(parent, &token);
+}
+
+/*********************************************************************//**
+**
+** FindMatchingChildToken
+**
+** Finds the data model child node matching the specified path segment token, given a parent node
+**
+** \param   parent - pointer to data model node to find child node for
+** \param   token - pointer to path segment token (name, length and hash) of the child node
+**
+** \return  pointer to matching child node, or NULL if no match was found
+**
+**************************************************************************/
+dm_node_t *FindMatchingChildToken(dm_node_t *parent, dm_path_token_t *token)
 {
     dm_node_t *child;
-    
+    unsigned mask;
+    unsigned index;
+
+    // If this node has many children, then look up the child in the hash table
+    if (parent->child_table != NULL)
+    {
+        mask = parent->child_table_size - 1;
+        index = ((unsigned)token->hash) & mask;
+        child = parent->child_table[index];
+        while (child != NULL)
+        {
+            if (IsNodeMatchingToken(child, token))
+            {
+                // Found a match
+                return child;
+            }
+
+            // Move to the next slot in the table (linear probing)
+            index = (index + 1) & mask;
+            child = parent->child_table[index];
+        }
+
+        return NULL;
+    }
+
     // Iterate over list of children, seeing if any match
     child = (dm_node_t *) parent->child_nodes.head;
     while (child != NULL)
     {
-        if (strcmp(child->name, name)==0)
+        if (IsNodeMatchingToken(child, token))
         {
             // Found a match
             return child;
@@ -2883,6 +4366,29 @@ dm_node_t *DM_PRIV_FindMatchingChild(dm_node_t *parent, char *name)
     return NULL;
 }
 
+/*********************************************************************//**
+**
+** IsNodeMatchingToken
+**
+** Determines whether the name of the specified data model node matches the specified path segment token
+**
+** \param   node - pointer to data model node to compare
+** \param   token - pointer to path segment token to compare against
+**
+** \return  true if the node's name matches the token
+**
+**************************************************************************/
+bool IsNodeMatchingToken(dm_node_t *node, dm_path_token_t *token)
+{
+    // Exit early (without comparing strings) if the hashes are different
+    if (node->name_hash != token->hash)
+    {
+        return false;
+    }
+
+    return (strncmp(node->name, token->name, token->len)==0) && (node->name[token->len] == '\0');
+}
+
 /*********************************************************************//**
 **
 ** DM_PRIV_AddUniqueKey
@@ -2926,22 +4432,30 @@ void DM_PRIV_AddUniqueKey(dm_node_t *node, dm_unique_key_t *unique_key)
 void DM_PRIV_ApplyPermissions(dm_node_t *node, ctrust_role_t role, unsigned short permission_bitmask)
 {
     dm_node_t *child;
+    queued_permission_t *qp;
+
+    // Exit if the permissions are being registered at startup, queuing them to be applied later by ApplyPermissionBatch()
+    if (is_permission_batch_active)
+    {
+        queued_permissions = USP_REALLOC(queued_permissions, (num_queued_permissions+1)*sizeof(queued_permission_t));
+        qp = &queued_permissions[num_queued_permissions];
+        qp->node = node;
+        qp->role = role;
+        qp->permission_bitmask = permission_bitmask;
+        qp->order = num_queued_permissions;
+        num_queued_permissions++;
+        return;
+    }
 
     // Apply permissions to this node
     node->permissions[role] = permission_bitmask;
+    CalcCombinedPermissions(node);
     
-    // Iterate over list of children
+    // Iterate over list of children, applying permissions to each child and all of its children
     child = (dm_node_t *) node->child_nodes.head;
     while (child != NULL)
     {
-        // Apply permissions to child node
-        child->permissions[role] = permission_bitmask;
-        
-        // Apply permissions to all children of the child node
-        if (child->child_nodes.head != NULL)
-        {
-            DM_PRIV_ApplyPermissions(child, role, permission_bitmask);
-        }
+        DM_PRIV_ApplyPermissions(child, role, permission_bitmask);
 
         // Move to next sibling in the data model tree
         child = (dm_node_t *) child->link.next;
@@ -2950,610 +4464,1179 @@ void DM_PRIV_ApplyPermissions(dm_node_t *node, ctrust_role_t role, unsigned shor
 
 /*********************************************************************//**
 **
-** DM_PRIV_ReRegister_DBParam_Default
+** StartPermissionBatch
 **
-** Registers a new default value for a USP DB parameter
+** Starts queuing all permissions applied by DM_PRIV_ApplyPermissions(), until ApplyPermissionBatch() is called
 **
-** \param   path - full data model path for the parameter
-** \param   value - new default value for the parameter
+** \param   None
 **
-** \return  USP_ERR_OK if successful
+** \return  None
 **
 **************************************************************************/
-int DM_PRIV_ReRegister_DBParam_Default(char *path, char *value)
+void StartPermissionBatch(void)
 {
-    dm_node_t *node;
-    dm_instances_t inst;
-    bool is_qualified_instance; // unused (as only relevant for objects)
-    dm_param_info_t *info;
+    is_permission_batch_active = true;
+    num_queued_permissions = 0;
+}
 
-    // Exit if parameter does not exist in the data model
-    // or parameter is specified with incorrect instance order
-    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
-    if (node == NULL)
-    {
-        return USP_ERR_INVALID_PATH;
-    }
+/*********************************************************************//**
+**
+** ApplyPermissionBatch
+**
+** Applies all permissions queued since StartPermissionBatch() to the schema, in a single walk of the schema
+** The result is the same as if each permission had been applied, in order, by DM_PRIV_ApplyPermissions()
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void ApplyPermissionBatch(void)
+{
+    unsigned short bitmask[kCTrustRole_Max];
+    int order[kCTrustRole_Max];
+    int i;
 
-    // Exit if path is not to a parameter
-    if (IsParam(node)==false)
+    is_permission_batch_active = false;
+
+    // Exit if no permissions were queued
+    if (num_queued_permissions == 0)
     {
-        USP_ERR_SetMessage("%s: Path (%s) is an object. Expecting a parameter.", __FUNCTION__, path);
-        return USP_ERR_INVALID_PATH;
+        return;
     }
 
-    // Exit if path is not to a database parameter
-    if (IsDbParam(node)==false)
+    // Sort the queued permissions by target node (and by order for the same node), so that the permissions targeting each node can be found by binary search
+    qsort(queued_permissions, num_queued_permissions, sizeof(queued_permission_t), ComparePermissionTarget);
+
+    // Walk the schema once, applying the queued permissions
+    // NOTE: An order of INVALID denotes that no queued permission applies to the role (so the node's current permission is left unchanged)
+    for (i=0; i<kCTrustRole_Max; i++)
     {
-        USP_ERR_SetMessage("%s: Parameter (%s) is not stored in the database.", __FUNCTION__, path);
-        return USP_ERR_INVALID_PATH_SYNTAX;
+        bitmask[i] = 0;
+        order[i] = INVALID;
     }
-    USP_ASSERT(node->hash != 0);
-
-    // Free the old default value and replace it with the new one
-    info = &node->registered.param_info;
-    USP_SAFE_FREE(info->default_value);
-    info->default_value = USP_STRDUP(value);
+    ApplyQueuedPermissionsRecursive(root_device_node, bitmask, order);
+    ApplyQueuedPermissionsRecursive(root_internal_node, bitmask, order);
 
-    return USP_ERR_OK;
+    USP_FREE(queued_permissions);
+    queued_permissions = NULL;
+    num_queued_permissions = 0;
 }
 
 /*********************************************************************//**
 **
-** SerializeNativeValue
+** ApplyQueuedPermissionsRecursive
 **
-** If val_union was modified by the Get vendor hook (instead of the buffer), then write the returned value into the buffer
-** This function facilitates the vendor hook returning a parameter's value in native format seamlessly
+** Applies the queued permissions to the specified node and all of its children
+** For each role, the permission of a node is the last registered permission targeting either the node or one of its ancestors
+** NOTE: This function is recursive
 **
-** \param   req - pointer to structure identifying the parameter
-** \param   node - pointer to node representing the parameter or object
-** \param   buf - pointer to buffer into which to return the value contained in req->val_union (as a textual string)
-** \param   len - length of buffer in which to return the value of the parameter
+** \param   node - Node to apply permissions to
+** \param   parent_bitmask - array (indexed by role) of the permissions applied to the parent of this node
+** \param   parent_order - array (indexed by role) of the registration order of the permissions applied to the parent of this node
 **
-** \return  Permissions bitmask associated with the specified node and role
+** \return  None
 **
 **************************************************************************/
-void SerializeNativeValue(dm_req_t *req, dm_node_t *node, char *buf, int len)
+void ApplyQueuedPermissionsRecursive(dm_node_t *node, unsigned short *parent_bitmask, int *parent_order)
 {
-    unsigned type_flags;
-    
-    type_flags = node->registered.param_info.type_flags;
+    unsigned short bitmask[kCTrustRole_Max];
+    int order[kCTrustRole_Max];
+    queued_permission_t key;
+    queued_permission_t *qp;
+    queued_permission_t *end;
+    dm_node_t *child;
+    bool is_changed = false;
+    int i;
 
-    // Exit if the type of the parameter is a string. Strings are always returned using the buffer.
-    if (type_flags & DM_STRING)
-    {
-        return;
-    }
+    memcpy(bitmask, parent_bitmask, sizeof(bitmask));
+    memcpy(order, parent_order, sizeof(order));
 
-    // Exit if the vendor has written a value to the buffer. We will use the value in the buffer, not the native value.
-    if (*buf != '\0')
+    // Find the first queued permission targeting this node (if any)
+    key.node = node;
+    key.order = INVALID;
+    qp = bsearch(&key, queued_permissions, num_queued_permissions, sizeof(queued_permission_t), ComparePermissionTarget);
+    if (qp != NULL)
     {
-        return;
-    }
+        while ((qp > queued_permissions) && (qp[-1].node == node))
+        {
+            qp--;
+        }
 
-    // Convert the string to its native type
-    if (type_flags & DM_DATETIME)
-    {
-        iso8601_from_unix_time(req->val_union.value_datetime, buf, len);
-    }
-    else if (type_flags & DM_BOOL)
-    {
-        USP_SNPRINTF(buf, len, "%s", TEXT_UTILS_BoolToString(req->val_union.value_bool) );
+        // Override the permissions inherited from the parent with any registered later that target this node
+        end = &queued_permissions[num_queued_permissions];
+        while ((qp < end) && (qp->node == node))
+        {
+            if (qp->order > order[qp->role])
+            {
+                bitmask[qp->role] = qp->permission_bitmask;
+                order[qp->role] = qp->order;
+            }
+            qp++;
+        }
     }
-    else if (type_flags & DM_INT)
+
+    // Apply the permissions to this node
+    for (i=0; i<kCTrustRole_Max; i++)
     {
-        USP_SNPRINTF(buf, len, "%d", req->val_union.value_int);
+        if (order[i] != INVALID)
+        {
+            node->permissions[i] = bitmask[i];
+            is_changed = true;
+        }
     }
-    else if (type_flags & DM_UINT)
+
+    if (is_changed)
     {
-        USP_SNPRINTF(buf, len, "%u", req->val_union.value_uint);
+        CalcCombinedPermissions(node);
     }
-    else if (type_flags & DM_ULONG)
+
+    // Iterate over list of children, applying permissions to each child and all of its children
+    child = (dm_node_t *) node->child_nodes.head;
+    while (child != NULL)
     {
-        USP_SNPRINTF(buf, len, "%llu", req->val_union.value_ulong);
+        ApplyQueuedPermissionsRecursive(child, bitmask, order);
+        child = (dm_node_t *) child->link.next;
     }
 }
 
 /*********************************************************************//**
 **
-** DM_PRIV_GetPermissions
+** ComparePermissionTarget
 **
-** Returns the permissions for the specified data model node, given the specified role
+** qsort/bsearch comparison function, used to order queued permissions by target node, then by registration order
+** NOTE: When used by bsearch, the key has an order of INVALID, so any queued permission targeting the node matches
 **
-** \param   node - Node to get permissions for
-** \param   combined_role - role to get permissions for.  If set to INTERNAL_ROLE, then full permissions are always returned
+** \param   p1 - pointer to first queued permission to compare
+** \param   p2 - pointer to second queued permission to compare
 **
-** \return  Permissions bitmask associated with the specified node and role
+** \return  <0 if p1 should be ordered before p2, >0 if after, 0 if equal
 **
 **************************************************************************/
-unsigned short DM_PRIV_GetPermissions(dm_node_t *node, combined_role_t *combined_role)
+int ComparePermissionTarget(const void *p1, const void *p2)
 {
-    unsigned short permissions = 0;
-    ctrust_role_t role;
-    
-    // If using the internal role, then this overrides all permissions setup and permits all
-    // This is necessary because at startup the permission bitmask in the data model is not setup, but we still need to ensure that we can do everything
-    if (combined_role == INTERNAL_ROLE)
-    {
-        return PERMIT_ALL;
-    }
+    const queued_permission_t *qp1 = (const queued_permission_t *) p1;
+    const queued_permission_t *qp2 = (const queued_permission_t *) p2;
 
-    // Add permissions from inherited role
-    role = combined_role->inherited;
-    if ((role < kCTrustRole_Max) && (role != INVALID_ROLE))
+    if (qp1->node != qp2->node)
     {
-        permissions |= node->permissions[ role ];
+        return ((uintptr_t)qp1->node < (uintptr_t)qp2->node) ? -1 : 1;
     }
 
-    // Add permissions from assigned role
-    role = combined_role->assigned;
-    if ((role < kCTrustRole_Max) && (role != INVALID_ROLE))
+    // Exit if this is a bsearch() key, matching any queued permission for the node
+    if ((qp1->order == INVALID) || (qp2->order == INVALID))
     {
-        permissions |= node->permissions[ role ];
+        return 0;
     }
 
-    return permissions;
+    return qp1->order - qp2->order;
 }
 
 /*********************************************************************//**
 **
-** FormInstanceString
+** CalcCombinedPermissions
 **
-** Forms a string containing the instance numbers which have previously been parsed into the inst structure
-** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+** Calculates the effective permissions of the specified node for every combination of inherited and assigned role
+** This avoids having to combine the permissions of the two roles every time that the permissions of a node are checked
 **
-** \param   inst - pointer to instances structure
-** \param   buf - pointer to buffer into which to return the instnace string
-** \param   len - length of buffer in which to return the instance string
+** \param   node - Node to calculate the combined permissions of
 **
 ** \return  None
 **
 **************************************************************************/
-void FormInstanceString(dm_instances_t *inst, char *buf, int len)
+void CalcCombinedPermissions(dm_node_t *node)
 {
-    int i;
-    int offset;
-    int count;
+    unsigned short permissions;
+    int inherited;
+    int assigned;
 
-    offset = 0;
-    *buf = '\0';        // If no instances, make the buffer NULL terminated
-    
-    // Iterate over all instance numbers in the instance structure, building up the instance staing
-    for (i=0; i < inst->order; i++)
+    // NOTE: Role values of kCTrustRole_Max (=INVALID_ROLE) contribute no permissions
+    for (inherited=0; inherited <= kCTrustRole_Max; inherited++)
     {
-        // Append the instance number to the string
-        if (i==0)
+        for (assigned=0; assigned <= kCTrustRole_Max; assigned++)
         {
-            count = USP_SNPRINTF(&buf[offset], len, "%d", inst->instances[i]);  // First instance number, no separator
-        }
-        else
-        {
-            count = USP_SNPRINTF(&buf[offset], len, ".%d", inst->instances[i]); // Additional instance numbers need separator
-        }
+            permissions = 0;
+            if (inherited < kCTrustRole_Max)
+            {
+                permissions |= node->permissions[inherited];
+            }
 
-        // Exit USP Agent if USP_SNPRINTF failed
-        if (count <= 0)
-        {
-            USP_ERR_Terminate("%s(%d): USP_SNPRINTF failed", __FUNCTION__, __LINE__);
-        }
+            if (assigned < kCTrustRole_Max)
+            {
+                permissions |= node->permissions[assigned];
+            }
 
-        // Move to where we write the next instance number
-        offset += count;
-        len -= count;
+            node->combined_permissions[ COMBINED_ROLE_INDEX(inherited, assigned) ] = permissions;
+        }
     }
 }
 
 /*********************************************************************//**
 **
-** ParseInstanceString
+** DM_PRIV_ReRegister_DBParam_Default
 **
-** Parses a string containing the instance numbers into the inst structure
-** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+** Registers a new default value for a USP DB parameter
 **
-** \param   instances - pointer to string containing instances to parse
-** \param   inst - pointer to instances structure in which to return the parsed object instances
+** \param   path - full data model path for the parameter
+** \param   value - new default value for the parameter
 **
-** \return  USP_ERR_OK if successful, USP_ERR_INTERNAL_ERROR otherwise
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int ParseInstanceString(char *instances, dm_instances_t *inst)
+int DM_PRIV_ReRegister_DBParam_Default(char *path, char *value)
 {
-    char *p;
-    int value;
+    dm_node_t *node;
+    dm_instances_t inst;
+    bool is_qualified_instance; // unused (as only relevant for objects)
+    dm_param_info_t *info;
 
-    // Clear instances structure
-    memset(inst, 0, sizeof(dm_instances_t));
+    // Exit if parameter does not exist in the data model
+    // or parameter is specified with incorrect instance order
+    node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+    if (node == NULL)
+    {
+        return USP_ERR_INVALID_PATH;
+    }
 
-    // Exit if instance string is empty
-    if ((instances == NULL) || (*instances == '\0'))
+    // Exit if path is not to a parameter
+    if (IsParam(node)==false)
     {
-        return USP_ERR_OK;
+        USP_ERR_SetMessage("%s: Path (%s) is an object. Expecting a parameter.", __FUNCTION__, path);
+        return USP_ERR_INVALID_PATH;
     }
 
-    // Iterate over all instance numbers in the string
-    p = instances;
-    while (*p != '\0')
+    // Exit if path is not to a database parameter
+    if (IsDbParam(node)==false)
     {
-        // Exit if an error in parsing the next integer in the instance string
-        p = ParseInstanceInteger(p, &value);
-        if (p == NULL)
-        {
-            return USP_ERR_INTERNAL_ERROR;
-        }
-        
-        // Store this instance number in the array
-        inst->instances[ inst->order++ ] = value;
+        USP_ERR_SetMessage("%s: Parameter (%s) is not stored in the database.", __FUNCTION__, path);
+        return USP_ERR_INVALID_PATH_SYNTAX;
     }
+    USP_ASSERT(node->hash != 0);
+
+    // Free the old default value and replace it with the new one
+    info = &node->registered.param_info;
+    USP_SAFE_FREE(info->default_value);
+    info->default_value = USP_STRDUP(value);
 
-    // If the code gets here, the instances string was parsed successfully
     return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** ParseInstanceInteger
+** CallGroupGetCallback
 **
-** Parses the next integer in the instance string
-** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+** Calls the get callback of a group of vendor parameters, to get the values of the specified parameters
 **
-** \param   p - pointer to string containing the next integer
-** \param   p_value - pointer to variable in which to store the parsed value
+** \param   group_id - group that all of the parameters belong to
+** \param   params - key-value vector containing the paths of the parameters to get (as keys), and in which to return their values
+**                   NOTE: On input, the values are all empty strings
 **
-** \return  pointer to next integer to parse in the string (after this one), or NULL if an error occurred in conversion
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-char *ParseInstanceInteger(char *p, int *p_value)
+int CallGroupGetCallback(int group_id, kv_vector_t *params)
 {
-    int value = 0;
-    char c;
+    int err;
+    int num_entries;
+    dm_get_group_cb_t get_group_cb;
 
-    // Iterate over all characters in the integer, converting them and building up the integer value
-    c = *p;
-    while ((c != '\0') && (c != '.'))
+    // Exit if no get callback has been registered for the group
+    USP_ASSERT((group_id >= 0) && (group_id < MAX_VENDOR_PARAM_GROUPS));
+    get_group_cb = group_get_callbacks[group_id];
+    if (get_group_cb == NULL)
     {
-        // Exit if number contains characters other than digits
-        if ((c < '0') || (c > '9'))
-        {
-            return NULL;
-        }
-
-        value = value*10 + (c - '0');
+        USP_ERR_SetMessage("%s: No get callback registered for group %d (path=%s)", __FUNCTION__, group_id, params->vector[0].key);
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-        // Move to next character in the string
-        p++;
-        c = *p;
+    // Exit if unable to get the values from the vendor code
+    USP_ERR_ClearMessage();
+    num_entries = params->num_entries;
+    err = get_group_cb(group_id, params);
+    if (err != USP_ERR_OK)
+    {
+        USP_ERR_ReplaceEmptyMessage("%s: Get callback for group %d returned error %d", __FUNCTION__, group_id, err);
+        return err;
     }
 
-    // If the code gets here, then it has reached the end of the string, or a '.' separator
-    // Skip the '.' separator
-    if (c == '.')
+    // Exit if the vendor code added or removed parameters
+    if (params->num_entries != num_entries)
     {
-        p++;
+        USP_ERR_SetMessage("%s: Get callback for group %d changed the number of parameters (from %d to %d)", __FUNCTION__, group_id, num_entries, params->num_entries);
+        return USP_ERR_INTERNAL_ERROR;
     }
 
-    *p_value = value;
-    return p;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** CreateNode
+** CallGroupSetCallback
 **
-** Allocates and initialises a data model node
+** Calls the set callback of a group of vendor parameters, to set a single parameter
+** This is used when the parameter is set outside of a transaction, so there are no other sets in the group to batch with it
 **
-** \param   name - portion of the data model path that this node represents
-** \param   type - type of node (eg object or parameter)
-** \param   schema_path - path in the data model to this node. Used to calculate the hash for parameter nodes
-**                      eg 'Device.Controller.{i}.Enable'
+** \param   group_id - group that the parameter belongs to
+** \param   path - path of the parameter to set
+** \param   new_value - value to set the parameter to
 **
-** \return  pointer to created node
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-dm_node_t *CreateNode(char *name, dm_node_type_t type, char *schema_path)
+int CallGroupSetCallback(int group_id, char *path, char *new_value)
 {
-    dm_node_t *node;
-    dm_node_t *n;
-    node_lookup_t *nl;
-    dm_hash_t hash;
-    int size;
-    
-    // Allocate memory for the node
-    node = USP_MALLOC(sizeof(dm_node_t));
-    memset(node, 0, sizeof(dm_node_t));     // NOTE: All roles start from zero permissions
+    int err;
+    kv_vector_t params;
+    dm_set_group_cb_t set_group_cb;
 
-    node->link.next = NULL;
-    node->link.prev = NULL;
-    node->type = type;
-    node->name = USP_STRDUP(name);
-    node->path = USP_STRDUP(schema_path);
-    DLLIST_Init(&node->child_nodes);
+    // Exit if no set callback has been registered for the group
+    USP_ASSERT((group_id >= 0) && (group_id < MAX_VENDOR_PARAM_GROUPS));
+    set_group_cb = group_set_callbacks[group_id];
+    if (set_group_cb == NULL)
+    {
+        USP_ERR_SetMessage("%s: No set callback registered for group %d (path=%s)", __FUNCTION__, group_id, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-    // Calculate hash of node (for use in database lookups) if node is a DB parameter
-    if ((type==kDMNodeType_DBParam_ReadWrite) || 
-        (type==kDMNodeType_DBParam_ReadOnly)  ||
-        (type==kDMNodeType_DBParam_ReadOnlyAuto) ||
-        (type==kDMNodeType_DBParam_ReadWriteAuto) ||
-        (type==kDMNodeType_DBParam_Secure))
-    {
-        hash = TEXT_UTILS_CalcHash(schema_path);
-        USP_ASSERT(hash != 0);
-
-        // Exit if we have a hash collision
-        n = FindNodeFromHash(hash);
-        if (n != NULL)
-        {
-            USP_ERR_SetMessage("%s: Failed to add node %s because it's node hash conflicted with %s", __FUNCTION__, schema_path, n->name);
-            return NULL;
-        }
-        node->hash = hash;
+    // Set the parameter using the vendor code
+    KV_VECTOR_Init(&params);
+    KV_VECTOR_Add(&params, path, new_value);
+    USP_ERR_ClearMessage();
+    err = set_group_cb(group_id, &params);
+    KV_VECTOR_Destroy(&params);
 
-        // Append hash to node lookup
-        size = (node_lookup_count+1) * sizeof(node_lookup_t);
-        node_lookup = USP_REALLOC(node_lookup, size);
-
-        nl = &node_lookup[node_lookup_count];
-        nl->hash = node->hash;
-        nl->node = node;
-        node_lookup_count++;
+    if (err != USP_ERR_OK)
+    {
+        USP_ERR_ReplaceEmptyMessage("%s: Set callback for group %d returned error %d (path=%s)", __FUNCTION__, group_id, err, path);
+        return err;
     }
 
-    return node;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** ParseSchemaPath
+** GetGroupedParameterValue
 **
-** Splits the given data model schema path into path segments which have a 1-to-1 correspondence with nodes in the data model tree
-** This function differs from ParsePath(), in that it works on paths containing '{i}' instead of instance numbers
-** NOTE: This function ignores duplicate '.' separators and also trailing '.' (for partial paths)
+** Gets the value of a single grouped vendor parameter, using the get callback of its group
 **
-** \param   path - full data model path to split (not altered by this function)
-** \param   path_segments - pointer to buffer in which to store the path segment strings
-** \param   path_segment_len - length of buffer in which to store path segment strings
-** \param   type - type of the last node in the path (eg object or parameter)
-** \param   segment - pointer to array containing the segments
-** \param   max_segments - maximum number of segments allowed in the array
+** \param   node - pointer to node in the data model representing the parameter
+** \param   path - path of the parameter to get
+** \param   buf - pointer to buffer into which to return the value of the parameter
+** \param   len - length of buffer in which to return the value of the parameter
 **
-** \return  number of segments in the path, or -1 if array was not large enough
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int ParseSchemaPath(char *path, char *path_segments, int path_segment_len, dm_node_type_t type, dm_path_segment *segments, int max_segments)
+int GetGroupedParameterValue(dm_node_t *node, char *path, char *buf, int len)
 {
-    int num_segments = 0;
-    char *segment_start;
-    dm_path_segment *seg;
-    int len;
-    char last_char;
-    int i;
-
-    // Setup default return values
-    memset(segments, 0, sizeof(segments[0])*max_segments);
+    int err;
+    kv_vector_t params;
 
-    // Create path segment strings
-    len = strncpy_path_segments(path_segments, path, path_segment_len);
+    KV_VECTOR_Init(&params);
+    KV_VECTOR_Add(&params, path, "");
 
-    // Scan the path, storing each segment found
-    num_segments = 0;
-    last_char = '\0';
-    for (i=0; i<len; i++)
+    err = CallGroupGetCallback(node->registered.param_info.group_id, &params);
+    if (err == USP_ERR_OK)
     {
-        // See if found the start of a new segment
-        if ((last_char == '\0') && (path_segments[i] != '\0'))
-        {
-            segment_start = &path_segments[i];
+        USP_STRNCPY(buf, params.vector[0].value, len);
+    }
 
-            if ( (strcmp(segment_start, MULTI_SEPARATOR)==0) || ((*segment_start>='0') && (*segment_start<='9')) )
-            {
-                // Special case of last separator was a multi instance object
-                segments[num_segments-1].type = kDMNodeType_Object_MultiInstance;
-            }
-            else
-            {
-                // Normal case, add a segment to the end of the array
-                if (*segment_start != '\0')             // Ignore empty segments (these are ones that use more than on '.' as separator)
-                {
-                    if (num_segments == max_segments)
-                    {
-                        USP_ERR_SetMessage("%s: More than %d path segments in path=%s", __FUNCTION__, max_segments, path);
-                        return -1;
-                    }
-    
-                    seg = &segments[num_segments];
-                    seg->name = segment_start;
-                    seg->type = kDMNodeType_Object_SingleInstance;  // Assume a single instance object until overridden by trailing '{i}'
+    KV_VECTOR_Destroy(&params);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** SerializeNativeValue
+**
+** If val_union was modified by the Get vendor hook (instead of the buffer), then write the returned value into the buffer
+** This function facilitates the vendor hook returning a parameter's value in native format seamlessly
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   node - pointer to node representing the parameter or object
+** \param   buf - pointer to buffer into which to return the value contained in req->val_union (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  Permissions bitmask associated with the specified node and role
+**
+**************************************************************************/
+void SerializeNativeValue(dm_req_t *req, dm_node_t *node, char *buf, int len)
+{
+    unsigned type_flags;
     
-                    num_segments++;
-                }
-            }
-        }
+    type_flags = node->registered.param_info.type_flags;
 
-        last_char = path_segments[i];
+    // Exit if the type of the parameter is a string. Strings are always returned using the buffer.
+    if (type_flags & DM_STRING)
+    {
+        return;
     }
 
-    // If this path represents a parameter, then override the last segment's type
-    if ((type != kDMNodeType_Object_MultiInstance) && (num_segments > 0))
+    // Exit if the vendor has written a value to the buffer. We will use the value in the buffer, not the native value.
+    if (*buf != '\0')
     {
-        seg = &segments[num_segments-1];
-        seg->type = type;
+        return;
     }
 
-    return num_segments;
+    // Convert the native value to a string
+    NativeValueToString(&req->val_union, type_flags, buf, len);
 }
 
-
 /*********************************************************************//**
 **
-** ParsePath
+** GetShmStatsValue
 **
-** Splits the given data model path into path segments which have a 1-to-1 correspondence with nodes in the data model tree
-** This function differs from ParseSchemaPath(), in that it works on paths containing instance numbers instead of '{i}'
-** NOTE: This function ignores duplicate '.' separators and also trailing '.' (for partial paths)
+** Reads the value of a parameter directly from the shared memory statistics region that it was registered with (see USP_REGISTER_SharedMemStats)
+** The read is retried if the writer was updating the region at the same time (detected using the region's seqlock sequence number)
+** NOTE: This function may be called from any thread
 **
-** \param   path - full data model path to split
-** \param   path_segments - pointer to buffer in which to store the path segment strings
-** \param   path_segment_len - length of buffer in which to store path segment strings
-** \param   segment - pointer to array containing the segments
-** \param   max_segments - maximum number of segments allowed in the array
-** \param   inst - pointer to instances structure to fill in from the parsed path
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   path - pointer to string containing complete data model path to the parameter
+** \param   inst - pointer to instance numbers of the parameter. The last instance number selects the record in the region
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+** \param   native - pointer to union in which to return the value of the parameter in its native type,
+**                   or NULL if the value must be returned as a textual string
+** \param   is_native - pointer to variable in which to return whether the value was returned in native (rather than buf)
 **
-** \return  number of segments in the path, or -1 if array was not large enough
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int ParsePath(char *path, char *path_segments, int path_segment_len, char *segments[], int max_segments, dm_instances_t *inst)
+int GetShmStatsValue(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, dm_val_union_t *native, bool *is_native)
 {
-    int num_segments = 0;
-    char *segment_start;
-    int len;
+    dm_param_info_t *info;
+    usp_shm_region_t *sr;
+    unsigned type_flags;
+    unsigned *seq_ptr;
+    unsigned seq1;
+    unsigned seq2;
+    char *value_ptr;
+    dm_val_union_t val;
+    unsigned char bool_value = 0;
+    int instance;
     int i;
-    char last_char;
 
-    // Setup default return values
-    memset(inst, 0, sizeof(dm_instances_t));
-    memset(segments, 0, sizeof(segments[0])*max_segments);
+    info = &node->registered.param_info;
+    sr = info->shm_region;
+    type_flags = info->type_flags;
 
-    // Create path segment strings
-    len = strncpy_path_segments(path_segments, path, path_segment_len);
+    // Exit if the region does not contain a record for this instance
+    instance = (inst->order > 0) ? inst->instances[inst->order-1] : 1;
+    if ((instance < 1) || (instance > sr->num_records))
+    {
+        USP_ERR_SetMessage("%s: Shared memory region does not contain a record for %s", __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-    // Scan the path segment strings, storing each segment found
-    num_segments = 0;
-    last_char = '\0';
-    for (i=0; i<len; i++)
+    seq_ptr = (unsigned *)((char *)sr->base + sr->seq_offset);
+    value_ptr = (char *)sr->base + sr->records_offset + (instance-1)*sr->record_size + info->shm_offset;
+    memset(&val, 0, sizeof(val));
+
+    // Read the value, retrying if the writer was updating the region (sequence number odd), or updated it whilst the value was being read (sequence number changed)
+    for (i=0; i<SHM_STATS_MAX_READ_ATTEMPTS; i++)
     {
-        // See if found the start of a new segment
-        if ((last_char == '\0') && (path_segments[i] != '\0'))
+        seq1 = __atomic_load_n(seq_ptr, __ATOMIC_ACQUIRE);
+        if ((seq1 & 1) == 0)
         {
-            segment_start = &path_segments[i];
-
-            if (IS_NUMERIC(*segment_start))
+            if (type_flags & DM_ULONG)
             {
-                // Special case of this segment represents an instance number
-                if (inst->order == MAX_DM_INSTANCE_ORDER)
-                {
-                    USP_ERR_SetMessage("%s: More than %d instance numbers in path", __FUNCTION__, MAX_DM_INSTANCE_ORDER);
-                    return -1;
-                }
-                inst->instances[ inst->order ] = atoi(segment_start);
-                inst->order++;
+                memcpy(&val.value_ulong, value_ptr, sizeof(uint64_t));
+            }
+            else if (type_flags & DM_UINT)
+            {
+                memcpy(&val.value_uint, value_ptr, sizeof(uint32_t));
+            }
+            else if (type_flags & DM_INT)
+            {
+                memcpy(&val.value_int, value_ptr, sizeof(int32_t));
             }
             else
             {
-                // Normal case, add a segment to the end of the array
-                if (num_segments == max_segments)
-                {
-                    USP_ERR_SetMessage("%s: More than %d path segments in path", __FUNCTION__, max_segments);
-                    return -1;
-                }
-    
-                segments[num_segments] = segment_start;
-                num_segments++;
+                bool_value = *(volatile unsigned char *)value_ptr;
+            }
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            seq2 = __atomic_load_n(seq_ptr, __ATOMIC_RELAXED);
+            if (seq1 == seq2)
+            {
+                break;
             }
         }
 
-        last_char = path_segments[i];
+        sched_yield();
     }
 
-    // Set USP error message, if no path segments found
-    if (num_segments == 0)
+    // Exit if a consistent value could not be read (eg the writer died whilst updating the region)
+    if (i == SHM_STATS_MAX_READ_ATTEMPTS)
     {
-        USP_ERR_SetMessage("%s: Invalid path %s", __FUNCTION__, path);
+        USP_ERR_SetMessage("%s: Unable to read a consistent value for %s from shared memory", __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
     }
-    
-    return num_segments;
+
+    if (type_flags & DM_BOOL)
+    {
+        val.value_bool = (bool_value != 0);
+    }
+
+    // Return the value in its native type, if the caller accepts native values
+    if (native != NULL)
+    {
+        *native = val;
+        *is_native = true;
+        *buf = '\0';
+        return USP_ERR_OK;
+    }
+
+    NativeValueToString(&val, type_flags, buf, len);
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** strncpy_path_segments
+** NativeValueToString
 **
-** Copy from src to dst, replacing all '.' characters with NULL terminators, and counting the total number of characters copied
-** NOTE: If the src ends in a '.', then it is discarded
+** Converts the native value of a parameter to a textual string
 **
-** \param   src - pointer to source path to copy
-** \param   dst - buffer to contain destination path segment strings
-** \param   maxlen - maximum number of characters in the destination buffer
+** \param   native - pointer to union containing the native value of the parameter
+** \param   type_flags - type of the parameter, determining which member of the union contains the value
+** \param   buf - pointer to buffer into which to return the value (as a textual string)
+** \param   len - length of buffer in which to return the value
 **
-** \return  number of characters copied into the destination
+** \return  None
 **
 **************************************************************************/
-int strncpy_path_segments(char *dst, char *src, int maxlen)
+void NativeValueToString(dm_val_union_t *native, unsigned type_flags, char *buf, int len)
 {
-    int len;
-    char c;
-
-    len = 0;
-    c = *src++;
-    while ((c != '\0') && (len < maxlen-1))
+    if (type_flags & DM_DATETIME)
     {
-        // Convert '.' to NULL terminator
-        if (c == '.')
-        {
-            c = '\0';
-        }
-
-        // Copy from src to destination
-        *dst++ = c;
-        len++;
-
-        c = *src++;
+        iso8601_from_unix_time(native->value_datetime, buf, len);
     }
-
-    // Ensure destination is always NULL terminated
-    *dst = '\0';
-
-    // Discard a trailing '.' from the length returned (the '.' will have already been changed into a '\0')
-    if ((len > 0) && (dst[-1] == '\0'))
+    else if (type_flags & DM_BOOL)
     {
-        len--;
+        USP_SNPRINTF(buf, len, "%s", TEXT_UTILS_BoolToString(native->value_bool) );
+    }
+    else if (type_flags & DM_INT)
+    {
+        USP_SNPRINTF(buf, len, "%d", native->value_int);
+    }
+    else if (type_flags & DM_UINT)
+    {
+        USP_SNPRINTF(buf, len, "%u", native->value_uint);
+    }
+    else if (type_flags & DM_ULONG)
+    {
+        USP_SNPRINTF(buf, len, "%llu", native->value_ulong);
     }
-
-    return len;
 }
 
 /*********************************************************************//**
 **
-** AddChildParamsDefaultValues
+** NativeValueToNumber
 **
-** Adds the default values for all children of the specified node into the database
-** NOTE: This function is recursive
+** Converts the native value of a numeric parameter to the type used to evaluate search expressions against it
 **
-** \param   path - path of the object instance to add children to. This code will modify the buffer pointed to by this path
-**                 NOTE: path is only actually needed for debug and error reporting purposes
-** \param   path_len - length of path (position to append child node names)
-** \param   node - Node to add defaulted children to
-** \param   inst - pointer to instance structure locating the parent node
+** \param   native - pointer to union containing the native value of the parameter
+** \param   type_flags - type of the parameter, determining which member of the union contains the value
 **
-** \return  USP_ERR_OK if successful
+** \return  value of the parameter
 **
 **************************************************************************/
-int AddChildParamsDefaultValues(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+long double NativeValueToNumber(dm_val_union_t *native, unsigned type_flags)
 {
-    int err;
-    dm_node_t *child;
-    
-    // Iterate over list of children
-    child = (dm_node_t *) node->child_nodes.head;
-    while (child != NULL)
+    if (type_flags & DM_INT)
     {
-        switch(child->type)
-        {
-            case kDMNodeType_DBParam_ReadWrite:
-            case kDMNodeType_DBParam_Secure:
-                {
-                    char instances[MAX_DM_PATH];
-                    char *new_value;
+        return (long double) native->value_int;
+    }
+    else if (type_flags & DM_UINT)
+    {
+        return (long double) native->value_uint;
+    }
 
-                    // Append the name of this parameter to the parent path
-                    USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+    return (long double) native->value_ulong;
+}
 
-                    // Set the parameter to the new value in the database
-                    new_value = child->registered.param_info.default_value;
-                    FormInstanceString(inst, instances, sizeof(instances));
-                    err = DATABASE_SetParameterValue(path, child->hash, instances, new_value, 0);
-                    if (err != USP_ERR_OK)
+/*********************************************************************//**
+**
+** IsNativeValueReturned
+**
+** Determines whether the Get vendor hook returned the parameter's value in native format (in val_union), rather than in the buffer
+** NOTE: The same rules are used as SerializeNativeValue()
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   node - pointer to node representing the parameter
+** \param   buf - pointer to buffer which the vendor hook may have written the value of the parameter into
+**
+** \return  true if the value of the parameter is in req->val_union
+**
+**************************************************************************/
+bool IsNativeValueReturned(dm_req_t *req, dm_node_t *node, char *buf)
+{
+    unsigned type_flags;
+
+    // Exit if the vendor has written a value to the buffer
+    if (*buf != '\0')
+    {
+        return false;
+    }
+
+    // Strings (and types without a member in val_union) are always returned using the buffer
+    type_flags = node->registered.param_info.type_flags;
+    if (type_flags & DM_STRING)
+    {
+        return false;
+    }
+
+    return (type_flags & (DM_DATETIME | DM_BOOL | DM_INT | DM_UINT | DM_ULONG)) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** DM_PRIV_GetPermissions
+**
+** Returns the permissions for the specified data model node, given the specified role
+**
+** \param   node - Node to get permissions for
+** \param   combined_role - role to get permissions for.  If set to INTERNAL_ROLE, then full permissions are always returned
+**
+** \return  Permissions bitmask associated with the specified node and role
+**
+**************************************************************************/
+unsigned short DM_PRIV_GetPermissions(dm_node_t *node, combined_role_t *combined_role)
+{
+    unsigned inherited;
+    unsigned assigned;
+    
+    // If using the internal role, then this overrides all permissions setup and permits all
+    // This is necessary because at startup the permission bitmask in the data model is not setup, but we still need to ensure that we can do everything
+    if (combined_role == INTERNAL_ROLE)
+    {
+        return PERMIT_ALL;
+    }
+
+    // Treat roles which are out of bounds as granting no permissions
+    inherited = (unsigned) combined_role->inherited;
+    assigned = (unsigned) combined_role->assigned;
+    if (inherited > INVALID_ROLE)
+    {
+        inherited = INVALID_ROLE;
+    }
+
+    if (assigned > INVALID_ROLE)
+    {
+        assigned = INVALID_ROLE;
+    }
+
+    // Look up the effective permissions of the combined role, which were precalculated when the permissions were applied
+    return node->combined_permissions[ COMBINED_ROLE_INDEX(inherited, assigned) ];
+}
+
+/*********************************************************************//**
+**
+** CreateNode
+**
+** Allocates and initialises a data model node
+**
+** \param   name - portion of the data model path that this node represents
+** \param   type - type of node (eg object or parameter)
+** \param   schema_path - path in the data model to this node. Used to calculate the hash for parameter nodes
+**                      eg 'Device.Controller.{i}.Enable'
+**
+** \return  pointer to created node
+**
+**************************************************************************/
+dm_node_t *CreateNode(char *name, dm_node_type_t type, char *schema_path)
+{
+    dm_node_t *node;
+    dm_hash_t hash;
+    int err;
+    
+    // Allocate memory for the node
+    node = SchemaArenaAlloc(sizeof(dm_node_t));
+    memset(node, 0, sizeof(dm_node_t));     // NOTE: All roles start from zero permissions
+
+    node->link.next = NULL;
+    node->link.prev = NULL;
+    node->type = type;
+    node->name_hash = TEXT_UTILS_CalcHash(name);
+    node->name = SchemaArenaIntern(name, node->name_hash);
+    node->path = SchemaArenaStrdup(schema_path);
+    DLLIST_Init(&node->child_nodes);
+    schema_num_nodes++;
+
+    // Calculate hash of node (for use in database lookups) if node is a DB parameter
+    if ((type==kDMNodeType_DBParam_ReadWrite) || 
+        (type==kDMNodeType_DBParam_ReadOnly)  ||
+        (type==kDMNodeType_DBParam_ReadOnlyAuto) ||
+        (type==kDMNodeType_DBParam_ReadWriteAuto) ||
+        (type==kDMNodeType_DBParam_Secure))
+    {
+        hash = DM_PRIV_CalcDbHash(schema_path, DB_HASH_FORMAT);
+        err = AddNodeHash(node, hash);
+        if (err != USP_ERR_OK)
+        {
+            return NULL;
+        }
+    }
+
+    return node;
+}
+
+/*********************************************************************//**
+**
+** CreateStaticNode
+**
+** Allocates and initialises a data model node from a node in a static schema table
+** NOTE: Unlike CreateNode(), the name and path are not copied, and the hashes are not calculated
+**
+** \param   sn - pointer to node in static schema table
+** \param   type - type of data model node to create
+**
+** \return  pointer to created node, or NULL if the node's hash conflicted with another node
+**
+**************************************************************************/
+dm_node_t *CreateStaticNode(const usp_static_node_t *sn, dm_node_type_t type)
+{
+    dm_node_t *node;
+    int err;
+
+    // Allocate memory for the node
+    node = SchemaArenaAlloc(sizeof(dm_node_t));
+    memset(node, 0, sizeof(dm_node_t));     // NOTE: All roles start from zero permissions
+
+    node->type = type;
+    node->name_hash = sn->name_hash;
+    node->name = sn->name;
+    node->path = sn->path;
+    DLLIST_Init(&node->child_nodes);
+    schema_num_nodes++;
+
+    // Add the node to the lookup table of nodes by hash, if it is a DB parameter
+    if (IsDbParam(node))
+    {
+        err = AddNodeHash(node, (DB_HASH_FORMAT == DB_HASH_FORMAT_64BIT) ? (dm_hash_t)sn->db_hash64 : (dm_hash_t)sn->db_hash32);
+        if (err != USP_ERR_OK)
+        {
+            return NULL;
+        }
+    }
+
+    return node;
+}
+
+/*********************************************************************//**
+**
+** AddNodeHash
+**
+** Sets the hash (used as the key of the parameter in the database) of the specified DB parameter node,
+** and adds the node to the lookup table of nodes by hash
+**
+** \param   node - pointer to DB parameter node
+** \param   hash - hash of the schema path of the node, in the selected database hash format
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if the hash conflicts with that of another node
+**
+**************************************************************************/
+int AddNodeHash(dm_node_t *node, dm_hash_t hash)
+{
+    dm_node_t *n;
+
+    USP_ASSERT(hash != 0);
+
+    // Exit if we have a hash collision
+    n = FindNodeFromHash(hash);
+    if (n != NULL)
+    {
+#ifdef DATABASE_HASH_64BIT
+        USP_ERR_SetMessage("%s: Failed to add node %s because it's node hash conflicted with %s", __FUNCTION__, node->path, n->path);
+#else
+        USP_ERR_SetMessage("%s: Failed to add node %s because it's node hash conflicted with %s (define DATABASE_HASH_64BIT to use 64 bit hashes)", __FUNCTION__, node->path, n->path);
+#endif
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    node->hash = hash;
+
+    // Add hash to node lookup table
+    AddNodeLookup(node);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** AddChildNode
+**
+** Adds the specified node as a child of the specified parent node
+** The child is added to the tail of the parent's linked list of children, and also to the parent's
+** hash table of children, if the parent has enough children to warrant one
+**
+** \param   parent - pointer to node to add the child to
+** \param   child - pointer to node to add
+**
+** \return  None
+**
+**************************************************************************/
+void AddChildNode(dm_node_t *parent, dm_node_t *child)
+{
+    DLLIST_LinkToTail(&parent->child_nodes, child);
+    parent->num_children++;
+
+    // Exit if this node does not have enough children to warrant a hash table
+    // NOTE: The table may have been allocated up front (see DM_PRIV_AddStaticSchema), in which case all children must be added to it
+    if ((parent->num_children < CHILD_TABLE_THRESHOLD) && (parent->child_table == NULL))
+    {
+        return;
+    }
+
+    // Allocate or grow the hash table, if necessary, keeping it at most half full
+    // NOTE: Resizing the table adds all children in the linked list, including this child
+    if (2*parent->num_children > parent->child_table_size)
+    {
+        ResizeChildTable(parent, (parent->child_table_size == 0) ? CHILD_TABLE_MIN_SIZE : 2*parent->child_table_size);
+        return;
+    }
+
+    InsertIntoChildTable(parent->child_table, parent->child_table_size, child);
+}
+
+/*********************************************************************//**
+**
+** ResizeChildTable
+**
+** (Re)allocates the hash table of child nodes for the specified node, and populates it with all of its children
+**
+** \param   parent - pointer to node to resize the child table of
+** \param   new_size - number of slots in the new table. This must be a power of 2
+**
+** \return  None
+**
+**************************************************************************/
+void ResizeChildTable(dm_node_t *parent, int new_size)
+{
+    dm_node_t *child;
+    dm_node_t **table;
+
+    USP_ASSERT((new_size & (new_size-1)) == 0);
+    table = USP_MALLOC(new_size*sizeof(dm_node_t *));
+    memset(table, 0, new_size*sizeof(dm_node_t *));
+
+    child = (dm_node_t *) parent->child_nodes.head;
+    while (child != NULL)
+    {
+        InsertIntoChildTable(table, new_size, child);
+        child = (dm_node_t *) child->link.next;
+    }
+
+    USP_SAFE_FREE(parent->child_table);
+    parent->child_table = table;
+    parent->child_table_size = new_size;
+}
+
+/*********************************************************************//**
+**
+** InsertIntoChildTable
+**
+** Inserts the specified child node into a child hash table, using linear probing
+** NOTE: The table must have at least one free slot
+**
+** \param   table - pointer to hash table of child nodes
+** \param   table_size - number of slots in the table (a power of 2)
+** \param   child - pointer to node to insert
+**
+** \return  None
+**
+**************************************************************************/
+void InsertIntoChildTable(dm_node_t **table, int table_size, dm_node_t *child)
+{
+    unsigned mask;
+    unsigned index;
+
+    mask = table_size - 1;
+    index = ((unsigned)child->name_hash) & mask;
+    while (table[index] != NULL)
+    {
+        index = (index + 1) & mask;
+    }
+
+    table[index] = child;
+}
+
+/*********************************************************************//**
+**
+** ParseSchemaPath
+**
+** Splits the given data model schema path into path segments which have a 1-to-1 correspondence with nodes in the data model tree
+** This function differs from ParsePath(), in that it works on paths containing '{i}' instead of instance numbers
+** NOTE: This function ignores duplicate '.' separators and also trailing '.' (for partial paths)
+**
+** \param   path - full data model path to split (not altered by this function)
+** \param   path_segments - pointer to buffer in which to store the path segment strings
+** \param   path_segment_len - length of buffer in which to store path segment strings
+** \param   type - type of the last node in the path (eg object or parameter)
+** \param   segment - pointer to array containing the segments
+** \param   max_segments - maximum number of segments allowed in the array
+**
+** \return  number of segments in the path, or -1 if array was not large enough
+**
+**************************************************************************/
+int ParseSchemaPath(char *path, char *path_segments, int path_segment_len, dm_node_type_t type, dm_path_segment *segments, int max_segments)
+{
+    int num_segments = 0;
+    char *segment_start;
+    dm_path_segment *seg;
+    int len;
+    char last_char;
+    int i;
+
+    // Setup default return values
+    memset(segments, 0, sizeof(segments[0])*max_segments);
+
+    // Create path segment strings
+    len = strncpy_path_segments(path_segments, path, path_segment_len);
+
+    // Scan the path, storing each segment found
+    num_segments = 0;
+    last_char = '\0';
+    for (i=0; i<len; i++)
+    {
+        // See if found the start of a new segment
+        if ((last_char == '\0') && (path_segments[i] != '\0'))
+        {
+            segment_start = &path_segments[i];
+
+            if ( (strcmp(segment_start, MULTI_SEPARATOR)==0) || ((*segment_start>='0') && (*segment_start<='9')) )
+            {
+                // Special case of last separator was a multi instance object
+                segments[num_segments-1].type = kDMNodeType_Object_MultiInstance;
+            }
+            else
+            {
+                // Normal case, add a segment to the end of the array
+                if (*segment_start != '\0')             // Ignore empty segments (these are ones that use more than on '.' as separator)
+                {
+                    if (num_segments == max_segments)
                     {
-                        return err;
+                        USP_ERR_SetMessage("%s: More than %d path segments in path=%s", __FUNCTION__, max_segments, path);
+                        return -1;
                     }
+    
+                    seg = &segments[num_segments];
+                    seg->name = segment_start;
+                    seg->type = kDMNodeType_Object_SingleInstance;  // Assume a single instance object until overridden by trailing '{i}'
+    
+                    num_segments++;
+                }
+            }
+        }
+
+        last_char = path_segments[i];
+    }
+
+    // If this path represents a parameter, then override the last segment's type
+    if ((type != kDMNodeType_Object_MultiInstance) && (num_segments > 0))
+    {
+        seg = &segments[num_segments-1];
+        seg->type = type;
+    }
+
+    return num_segments;
+}
+
+
+/*********************************************************************//**
+**
+** ParsePath
+**
+** Splits the given data model path into path segments which have a 1-to-1 correspondence with nodes in the data model tree
+** This function differs from ParseSchemaPath(), in that it works on paths containing instance numbers instead of '{i}'
+** The path is tokenized in place (without being copied), and the hash of each segment is calculated during the same scan
+** NOTE: This function ignores duplicate '.' separators and also trailing '.' (for partial paths)
+**
+** \param   path - full data model path to split
+** \param   tokens - pointer to array in which to return the tokens describing each path segment
+** \param   max_tokens - maximum number of tokens allowed in the array
+** \param   inst - pointer to instances structure to fill in from the parsed path
+**
+** \return  number of segments in the path, or -1 if array was not large enough
+**
+**************************************************************************/
+int ParsePath(char *path, dm_path_token_t *tokens, int max_tokens, dm_instances_t *inst)
+{
+    int num_segments = 0;
+    dm_path_token_t *token;
+    char *p;
+    char *end;
+    unsigned hash;
+    int value;
+
+    // Setup default return values
+    memset(inst, 0, sizeof(dm_instances_t));
+
+    // Only consider the same number of characters in the path, as would fit in a MAX_DM_PATH buffer
+    p = path;
+    end = path + strnlen(path, MAX_DM_PATH-1);
+
+    // Scan the path, storing each segment found
+    while (p < end)
+    {
+        // Skip '.' separators (including duplicate and trailing separators)
+        if (*p == '.')
+        {
+            p++;
+            continue;
+        }
+
+        if (IS_NUMERIC(*p))
+        {
+            // Special case of this segment represents an instance number
+            if (inst->order == MAX_DM_INSTANCE_ORDER)
+            {
+                USP_ERR_SetMessage("%s: More than %d instance numbers in path", __FUNCTION__, MAX_DM_INSTANCE_ORDER);
+                return -1;
+            }
+
+            // Convert the leading digits of the segment, ignoring any trailing characters (as atoi() would)
+            value = 0;
+            while ((p < end) && IS_NUMERIC(*p))
+            {
+                value = value*10 + (*p - '0');
+                p++;
+            }
+
+            while ((p < end) && (*p != '.'))
+            {
+                p++;
+            }
+
+            inst->instances[ inst->order ] = value;
+            inst->order++;
+        }
+        else
+        {
+            // Normal case, add a segment to the end of the array
+            if (num_segments == max_tokens)
+            {
+                USP_ERR_SetMessage("%s: More than %d path segments in path", __FUNCTION__, max_tokens);
+                return -1;
+            }
+
+            token = &tokens[num_segments];
+            token->name = p;
+            hash = TEXT_UTILS_HASH_INIT;
+            while ((p < end) && (*p != '.'))
+            {
+                hash = TEXT_UTILS_HASH_ADD(hash, *p);
+                p++;
+            }
+            token->len = p - token->name;
+            token->hash = (int)hash;
+            num_segments++;
+        }
+    }
+
+    // Set USP error message, if no path segments found
+    if (num_segments == 0)
+    {
+        USP_ERR_SetMessage("%s: Invalid path %s", __FUNCTION__, path);
+    }
+
+    return num_segments;
+}
+
+/*********************************************************************//**
+**
+** strncpy_path_segments
+**
+** Copy from src to dst, replacing all '.' characters with NULL terminators, and counting the total number of characters copied
+** NOTE: If the src ends in a '.', then it is discarded
+**
+** \param   src - pointer to source path to copy
+** \param   dst - buffer to contain destination path segment strings
+** \param   maxlen - maximum number of characters in the destination buffer
+**
+** \return  number of characters copied into the destination
+**
+**************************************************************************/
+int strncpy_path_segments(char *dst, char *src, int maxlen)
+{
+    int len;
+    char c;
+
+    len = 0;
+    c = *src++;
+    while ((c != '\0') && (len < maxlen-1))
+    {
+        // Convert '.' to NULL terminator
+        if (c == '.')
+        {
+            c = '\0';
+        }
+
+        // Copy from src to destination
+        *dst++ = c;
+        len++;
+
+        c = *src++;
+    }
+
+    // Ensure destination is always NULL terminated
+    *dst = '\0';
+
+    // Discard a trailing '.' from the length returned (the '.' will have already been changed into a '\0')
+    if ((len > 0) && (dst[-1] == '\0'))
+    {
+        len--;
+    }
+
+    return len;
+}
+
+/*********************************************************************//**
+**
+** AddChildParamsDefaultValues
+**
+** Adds the default values for all children of the specified node into the database
+** NOTE: This function is recursive
+**
+** \param   path - path of the object instance to add children to. This code will modify the buffer pointed to by this path
+**                 NOTE: path is only actually needed for debug and error reporting purposes
+** \param   path_len - length of path (position to append child node names)
+** \param   node - Node to add defaulted children to
+** \param   inst - pointer to instance structure locating the parent node
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int AddChildParamsDefaultValues(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+{
+    int err;
+    dm_node_t *child;
+    
+    // Iterate over list of children
+    child = (dm_node_t *) node->child_nodes.head;
+    while (child != NULL)
+    {
+        switch(child->type)
+        {
+            case kDMNodeType_DBParam_ReadWrite:
+            case kDMNodeType_DBParam_Secure:
+                {
+                    char *new_value;
+
+                    // Append the name of this parameter to the parent path
+                    USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+
+                    // Set the parameter to the new value in the database
+                    new_value = child->registered.param_info.default_value;
+                    err = DATABASE_SetParameterValue(path, child->hash, inst, new_value, 0);
+                    if (err != USP_ERR_OK)
+                    {
+                        return err;
+                    }
+
+                    // Value change subscriptions may hold a value for this parameter, if the instance was re-created
+                    DEVICE_SUBSCRIPTION_NotifyDbParamChanged(path);
                 
                     // Intentionally not intending to notify vendor of params which are defaulted,
                     // as we have a notify for when the whole instance has been added anyway
@@ -3562,536 +5645,1491 @@ int AddChildParamsDefaultValues(char *path, int path_len, dm_node_t *node, dm_in
                 }
                 break;
 
-            case kDMNodeType_DBParam_ReadOnlyAuto:
-            case kDMNodeType_DBParam_ReadWriteAuto:
-                {
-                    char instances[MAX_DM_PATH];
-                    char new_value[MAX_DM_VALUE_LEN];
-                    dm_get_value_cb_t get_cb;
-                    dm_req_t req;
+            case kDMNodeType_DBParam_ReadOnlyAuto:
+            case kDMNodeType_DBParam_ReadWriteAuto:
+                {
+                    char new_value[MAX_DM_VALUE_LEN];
+                    dm_get_value_cb_t get_cb;
+                    dm_req_t req;
+                    unsigned long long start_time;
+
+                    get_cb = child->registered.param_info.get_cb;
+                    USP_ASSERT(get_cb != NULL)
+        
+                    // Append the name of this parameter to the parent path
+                    USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+
+                    // Exit if unable to get the automatically populated value from the vendor code
+                    DM_PRIV_RequestInit(&req, child, path, inst);
+                    USP_ERR_ClearMessage();
+                    new_value[0] = '\0';
+
+                    start_time = StartCallbackTimer();
+                    err = get_cb(&req, new_value, sizeof(new_value));
+                    StopCallbackTimer(child, start_time);
+                    if (err != USP_ERR_OK)
+                    {
+                        USP_ERR_ReplaceEmptyMessage("%s: GetAuto callback for path %s returned error %d", __FUNCTION__, path, err);
+                        return err;
+                    }
+
+                    // If the parameter value was returned as a native value (in val_union), then convert it to a string
+                    SerializeNativeValue(&req, child, new_value, sizeof(new_value));
+
+                    // Set the parameter to the new value in the database
+                    err = DATABASE_SetParameterValue(path, child->hash, inst, new_value, 0);
+                    if (err != USP_ERR_OK)
+                    {
+                        return err;
+                    }
+                    DEVICE_SUBSCRIPTION_NotifyDbParamChanged(path);
+                }
+                break;
+
+            // For single instance child object nodes, ensure that all of their children have their default value set
+            case kDMNodeType_Object_SingleInstance:
+                {
+                    int len;
+                    len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+                    err = AddChildParamsDefaultValues(path, path_len+len, child, inst);
+                    if (err != USP_ERR_OK)
+                    {
+                        return err;
+                    }
+                }
+                break;
+
+            // Nothing to do for non database writable parameters
+            default:
+            case kDMNodeType_DBParam_ReadOnly:
+            case kDMNodeType_VendorParam_ReadOnly:
+            case kDMNodeType_VendorParam_ReadWrite:
+            case kDMNodeType_Param_ConstantValue:
+            case kDMNodeType_Param_NumEntries:
+            case kDMNodeType_SyncOperation:
+            case kDMNodeType_AsyncOperation:
+            case kDMNodeType_Event:
+            case kDMNodeType_Object_MultiInstance:  // A child Multi-instance object needs an instance creating before we can populate it
+                break;
+        }
+
+        // Move to next sibling in the data model tree
+        child = (dm_node_t *) child->link.next;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** StartInstanceDelete
+**
+** Checks that the specified object instance can be deleted, calls the vendor hooks associated with deleting it,
+** and adds it (and all of its child object instances) to the list of instances pending notification in the current transaction
+** NOTE: This function does not delete the instance's parameters from the database, or deregister its instance numbers
+**
+** \param   path - path of the object instance to delete
+** \param   flags - options to control execution of this function (eg CHECK_DELETABLE, IGNORE_NO_INSTANCE)
+** \param   p_node - pointer to variable in which to return the node of the object instance to delete
+**                   or NULL if the instance does not exist and IGNORE_NO_INSTANCE was specified (nothing to delete)
+** \param   inst - pointer to structure in which to return the instance numbers of the object instance to delete
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartInstanceDelete(char *path, unsigned flags, dm_node_t **p_node, dm_instances_t *inst)
+{
+    dm_node_t *node;
+    int err;
+    char child_path[MAX_DM_PATH];
+    dm_validate_del_cb_t validate_del;
+    dm_del_cb_t del;
+    dm_req_t req;
+    bool exists;
+    bool is_qualified_instance;
+
+    *p_node = NULL;
+
+    // Exit if unable to find node representing this object
+    node = DM_PRIV_GetNodeFromPath(path, inst, &is_qualified_instance);
+    if (node == NULL)
+    {
+        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+    }
+
+    // Exit if this object is not a fully qualified instance
+    if (is_qualified_instance == false)
+    {
+        USP_ERR_SetMessage("%s: Path (%s) does not contain instance number of object to delete", __FUNCTION__, path);
+        return USP_ERR_OBJECT_NOT_CREATABLE;
+    }
+
+    // Exit if the object instances in the path do not exist
+    exists = DM_INST_VECTOR_IsExist(inst);
+    if (exists == false)
+    {
+        // Exit if we should silently ignore objects that have already been deleted
+        if (flags & IGNORE_NO_INSTANCE)
+        {
+            return USP_ERR_OK;
+        }
+
+        USP_ERR_SetMessage("%s: Object exists in schema, but instances are invalid: %s", __FUNCTION__, path);
+        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+    }
+
+    // Exit if we cannot add/delete instances of this object
+    if (node->type != kDMNodeType_Object_MultiInstance)
+    {
+        USP_ERR_SetMessage("%s: Cannot delete instances of %s. Not a multi-instance object.", __FUNCTION__, path);
+        return USP_ERR_OBJECT_NOT_CREATABLE;
+    }
+
+    // Populate request structure passed to vendor hook functions
+    DM_PRIV_RequestInit(&req, node, path, inst);
+
+    // Exit if vendor hook is not allowing this instance to be deleted
+    // Typically this will be the case if the agent owns creation/deletion of the object
+    // NOTE: Read-only tables may be deleted internally by USP Agent
+    // but deletes initiated by a controller should always check whether the table is read only
+    if (flags & CHECK_DELETABLE)
+    {
+        validate_del = node->registered.object_info.validate_del_cb;
+        if (validate_del != NULL)
+        {
+            USP_ERR_ClearMessage();
+    
+            err = validate_del(&req);
+            if (err != USP_ERR_OK)
+            {
+                USP_ERR_ReplaceEmptyMessage("%s: Cannot delete object=%s", __FUNCTION__, path);
+                return err;
+            }
+        }
+    }
+    
+    // Exit if delete vendor hook fails
+    // This vendor hook typically is used to delete a row in a vendor DB
+    // NOTE: The delete vendor hook needs to be separate from the validate and notify vendor hooks
+    // It needs to be separate from validate, because validate is not called for internal data model instance deletion
+    // It needs to be separate from notify because vendor DB changes need to be done in same transaction as USP DB changes
+    del = node->registered.object_info.del_cb;
+    if (del != NULL)
+    {
+        USP_ERR_ClearMessage();
+    
+        err = del(&req);
+        if (err != USP_ERR_OK)
+        {
+            USP_ERR_ReplaceEmptyMessage("%s: del vendor hook failed for path=%s", __FUNCTION__, path);
+            return err;
+        }
+    }
+
+    // Add this object instance to the list of instances which are pending notification to the vendor
+    // They will be notified once the whole transaction has been completed successfully 
+    // (or they will be forgotten if the transaction was aborted)
+    // NOTE: This must be performed before the object is actually deleted from the data model, because 
+    // it determines the list of objects which will send ObjectDeletion notifies based on the objects currently in the data model
+    DM_TRANS_Add(kDMOp_Del, path, NULL, NULL, node, inst);
+
+    // Add all child object instances to the list of instances which are pending notification
+    USP_STRNCPY(child_path, path, sizeof(child_path));
+    AddChildDeletesToTrans(child_path, strlen(child_path), node, inst);
+
+    *p_node = node;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DeleteInstanceParams
+**
+** Deletes all database parameters of the specified object instance and all of its child object instances
+** NOTE: If the instance structure identifies the parent of the object (ie its order is one less than that of the object),
+**       then the parameters of all instances of the object are deleted
+**
+** \param   path - path of the object instance being deleted (used for debug only)
+** \param   node - pointer to multi-instance object in data model
+** \param   inst - pointer to instance numbers prefixing the instances of the parameters to delete
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DeleteInstanceParams(char *path, dm_node_t *node, dm_instances_t *inst)
+{
+    int err;
+    dm_hash_t *hashes = NULL;
+    int num_hashes = 0;
+
+    // Get the hashes of all database parameters in the object (and in its child objects)
+    GetChildDbParamHashes(node, &hashes, &num_hashes);
+
+    // Delete all instances of these parameters prefixed by the specified instance numbers
+    err = DATABASE_DeleteInstanceParams(path, hashes, num_hashes, inst);
+
+    USP_SAFE_FREE(hashes);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** GetChildDbParamHashes
+**
+** Adds the hashes of all database parameters which are children of the specified node (including those in child objects)
+** NOTE: This function is recursive
+**
+** \param   node - Node to get the child database parameters of
+** \param   hashes - pointer to dynamically allocated array, which is grown to add the hashes
+** \param   num_hashes - pointer to variable containing the number of hashes in the array
+**
+** \return  None
+**
+**************************************************************************/
+void GetChildDbParamHashes(dm_node_t *node, dm_hash_t **hashes, int *num_hashes)
+{
+    dm_node_t *child;
+
+    // Iterate over list of children
+    child = (dm_node_t *) node->child_nodes.head;
+    while (child != NULL)
+    {
+        switch(child->type)
+        {
+            case kDMNodeType_DBParam_ReadOnly:
+            case kDMNodeType_DBParam_ReadWrite:
+            case kDMNodeType_DBParam_ReadOnlyAuto:
+            case kDMNodeType_DBParam_ReadWriteAuto:
+            case kDMNodeType_DBParam_Secure:
+                *hashes = USP_REALLOC(*hashes, (*num_hashes + 1)*sizeof(dm_hash_t));
+                (*hashes)[*num_hashes] = child->hash;
+                (*num_hashes)++;
+                break;
+
+            case kDMNodeType_Object_SingleInstance:
+            case kDMNodeType_Object_MultiInstance:
+                GetChildDbParamHashes(child, hashes, num_hashes);
+                break;
+                
+            // Nothing to do for non database parameters
+            case kDMNodeType_VendorParam_ReadOnly:
+            case kDMNodeType_VendorParam_ReadWrite:
+            case kDMNodeType_Param_ConstantValue:
+            case kDMNodeType_Param_NumEntries:
+            case kDMNodeType_SyncOperation:
+            case kDMNodeType_AsyncOperation:
+            case kDMNodeType_Event:
+                break;
+
+            default:
+                TERMINATE_BAD_CASE(child->type);
+                break;
+        }
+
+        // Move to next sibling in the data model tree
+        child = (dm_node_t *) child->link.next;
+    }
+}
+
+/*********************************************************************//**
+**
+** AddChildDeletesToTrans
+**
+** Adds all child object instances of the specified node to the list of instances pending notification in the current transaction
+** NOTE: This function is recursive
+**
+** \param   path - path of the object instance being deleted. This code will modify the buffer pointed to by this path
+** \param   path_len - length of path (position to append child node names)
+** \param   node - Node to add the child object instances of
+** \param   inst - pointer to instance structure locating the parent node
+**
+** \return  None
+**
+**************************************************************************/
+void AddChildDeletesToTrans(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+{
+    dm_node_t *child;
+    int len;
+    
+    // Iterate over list of child objects
+    child = (dm_node_t *) node->child_nodes.head;
+    while (child != NULL)
+    {
+        switch(child->type)
+        {
+            // For single instance child object nodes, ensure that all of their child object instances are added
+            case kDMNodeType_Object_SingleInstance:
+                len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+                AddChildDeletesToTrans(path, path_len+len, child, inst);
+                break;
+
+            // For multi-instance child objects, ensure that all instances of them and their children are added
+            case kDMNodeType_Object_MultiInstance:
+                len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+                AddChildDeletesToTrans_MultiInstanceObject(path, path_len+len, child, inst);
+                break;
+                
+            default:
+                break;
+        }
+
+        // Move to next sibling in the data model tree
+        child = (dm_node_t *) child->link.next;
+    }
+}
+
+/*********************************************************************//**
+**
+** AddChildDeletesToTrans_MultiInstanceObject
+**
+** Iterates over all instances of a multi-instance object, adding them (and their child object instances)
+** to the list of instances pending notification in the current transaction
+** NOTE: This function is recursive
+**
+** \param   path - path of the object. This code will modify the buffer pointed to by this path
+** \param   path_len - length of path (position to append child node names)
+** \param   node - multi-instance object node to add the instances of
+** \param   inst - pointer to instance structure locating the parent node
+**
+** \return  None
+**
+**************************************************************************/
+void AddChildDeletesToTrans_MultiInstanceObject(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+{
+    int_vector_t iv;
+    int instance;
+    int len;
+    int order;
+    int i;
+    int err;
+
+    // Exit if unable to get an array of instances for this specific object
+    err = DM_INST_VECTOR_GetInstances(node, inst, &iv);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    // Update instance structure in readiness to populate it with the instance number
+    order = inst->order;
+    USP_ASSERT(order < MAX_DM_INSTANCE_ORDER);
+    inst->nodes[order] = node;
+    inst->order = order+1;
+
+    // Iterate over all instances of this object
+    for (i=0; i < iv.num_entries; i++)
+    {
+        // Form the path to this instance
+        instance = iv.vector[i];
+        len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%d", instance);
+
+        // Add all child object instances of this object first, then this object instance
+        inst->instances[order] = instance;
+        AddChildDeletesToTrans(path, path_len+len, node, inst);
+        DM_TRANS_Add(kDMOp_Del, path, NULL, NULL, node, inst);
+    }
+
+    // Put the instance structure back to the way it was
+    inst->nodes[order] = NULL;
+    inst->instances[order] = 0;
+    inst->order = order;
+
+    INT_VECTOR_Destroy(&iv);
+}
+
+/*********************************************************************//**
+**
+** IsWholeTableDelete
+**
+** Determines whether the specified object instances comprise all instances of a single table (given its parent instances)
+**
+** \param   nodes - array of nodes of the object instances to delete (NULL entries are ignored)
+** \param   insts - array of instance numbers of the object instances to delete
+** \param   num_paths - number of entries in the arrays
+** \param   parent - pointer to structure in which to return the instance numbers of the parent of the table
+**
+** \return  true if all instances of the table are being deleted
+**
+**************************************************************************/
+bool IsWholeTableDelete(dm_node_t **nodes, dm_instances_t *insts, int num_paths, dm_instances_t *parent)
+{
+    int i;
+    int first = INVALID;
+    int count = 0;
+    int order;
+
+    // Exit if any of the instances are not of the same table and parent instances as the first instance
+    for (i=0; i < num_paths; i++)
+    {
+        if (nodes[i] == NULL)
+        {
+            continue;
+        }
+
+        if (first == INVALID)
+        {
+            first = i;
+        }
+        else if ((nodes[i] != nodes[first]) || (insts[i].order != insts[first].order) ||
+                 (memcmp(insts[i].instances, insts[first].instances, (insts[i].order-1)*sizeof(int)) != 0))
+        {
+            return false;
+        }
+        count++;
+    }
+
+    // Exit if there were not enough instances to benefit from a whole table delete
+    if (count < 2)
+    {
+        return false;
+    }
+
+    // Form the instance numbers of the parent of the table
+    order = insts[first].order - 1;
+    memcpy(parent, &insts[first], sizeof(dm_instances_t));
+    parent->instances[order] = 0;
+    parent->nodes[order] = NULL;
+    parent->order = order;
+
+    // Exit if the table contains more instances than are being deleted
+    return (DM_INST_VECTOR_GetNumInstances(nodes[first], parent) == count) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** DestroySchemaRecursive
+**
+** Recursively frees all memory associated with the specified data model node
+**
+** \param   parent - pointer to node to recursively destroy
+**
+** \return  None
+**
+**************************************************************************/
+void DestroySchemaRecursive(dm_node_t *parent)
+{
+    dm_node_t *child;
+    dm_node_t *next_child;
+
+    // First destroy all child nodes
+    child = (dm_node_t *) parent->child_nodes.head;
+    while (child != NULL)
+    {
+        // Save off next child in the data model tree, before we delete this child (and loose the reference)
+        next_child = (dm_node_t *) child->link.next;
+
+        DestroySchemaRecursive(child);
+
+        child = next_child;
+    }
+
+    // Then destroy this node
+    // Free extra information contained in the 'registered' union
+    switch (parent->type)
+    {
+        case kDMNodeType_Object_MultiInstance:
+            // NOTE: No need to free the unique keys in the vector - the pointers are to static const strings, so cannot be freed
+            USP_SAFE_FREE(parent->registered.object_info.unique_keys.vector);
+//            DM_INST_VECTOR_Destroy(&parent->registered.object_info.inst_vector); // This should already have been freed by the time this function is called
+            break;
+
+        case kDMNodeType_Param_ConstantValue:
+        case kDMNodeType_DBParam_ReadWrite:
+        case kDMNodeType_DBParam_ReadOnly:
+        case kDMNodeType_DBParam_Secure:
+        case kDMNodeType_DBParam_ReadOnlyAuto:
+        case kDMNodeType_DBParam_ReadWriteAuto:
+            USP_FREE(parent->registered.param_info.default_value);
+            break;
+
+        default:
+        case kDMNodeType_Param_NumEntries:
+        case kDMNodeType_Object_SingleInstance:
+        case kDMNodeType_VendorParam_ReadOnly:
+        case kDMNodeType_VendorParam_ReadWrite:
+        case kDMNodeType_Event:
+            // These types of nodes do not allocate anything extra in the 'registered' union
+            break;
+
+        case kDMNodeType_SyncOperation:
+        case kDMNodeType_AsyncOperation:
+            {
+                dm_oper_info_t *info;
+            
+                info = &parent->registered.oper_info;
+                STR_VECTOR_Destroy(&info->input_args);
+                STR_VECTOR_Destroy(&info->output_args);
+            }
+            break;
+    }
+
+    // Finally free the child table of this node
+    // NOTE: The node itself, and its name and path strings, are freed along with the schema arena
+    USP_SAFE_FREE(parent->child_table);
+}
+
+/*********************************************************************//**
+**
+** DestroyInstanceVectorRecursive
+**
+** Recursively frees all memory containing the instance vectors of all top level multi-instance objects
+**
+** \param   parent - pointer to node to recursively free all instance vectors of
+**
+** \return  None
+**
+**************************************************************************/
+void DestroyInstanceVectorRecursive(dm_node_t *parent)
+{
+    dm_node_t *child;
+
+    if (parent->type == kDMNodeType_Object_MultiInstance)
+    {
+        // This node is a top level multi instance node, storing it's instances and all instances of its children
+        // So free the instance vector it holds, then exit
+        // NOTE: we do not have to recurse to its children because their instances are stored here
+        DM_INST_VECTOR_Destroy(&parent->registered.object_info.inst_vector);
+        return;
+    }
+
+    // Recurse to free all child node instance vectors
+    child = (dm_node_t *) parent->child_nodes.head;
+    while (child != NULL)
+    {
+        DestroyInstanceVectorRecursive(child);
+
+        child = (dm_node_t *) child->link.next;
+    }
+}
+
+/*********************************************************************//**
+**
+** DumpInstanceVectorRecursive
+**
+** Recursively prints out instances stored in the data model
+**
+** \param   parent - pointer to node to recursively dump
+**
+** \return  None
+**
+**************************************************************************/
+void DumpInstanceVectorRecursive(dm_node_t *parent)
+{
+    dm_node_t *child;
+
+    if (parent->type == kDMNodeType_Object_MultiInstance)
+    {
+        // This node is a top level multi instance node, storing it's instances and all instances of its children
+        // So print the instances it holds, then exit
+        // NOTE: we do not have to recurse to its children because their instances are stored here
+        DM_INST_VECTOR_Dump(&parent->registered.object_info.inst_vector);
+        return;
+    }
+
+    // Recurse to dump all child node instance vectors
+    child = (dm_node_t *) parent->child_nodes.head;
+    while (child != NULL)
+    {
+        DumpInstanceVectorRecursive(child);
+
+        child = (dm_node_t *) child->link.next;
+    }
+}
+
+/*********************************************************************//**
+**
+** DumpSchemaFromRoot
+**
+** Dumps the schema, starting at the specified root node
+**
+** \param   root - pointer to root data model node to dump from
+** \param   name - name of the data model root node
+**
+** \return  None
+**
+**************************************************************************/
+void DumpSchemaFromRoot(dm_node_t *root, char *name)
+{
+    int i;
+    str_vector_t sv;
+
+    USP_DUMP("\nDumping %s Schema...", name);
+    STR_VECTOR_Init(&sv);
+
+    // Build up the paths of all elements in the schema in a string vector
+    AddChildNodes(root, &sv);
+
+    // Sort the paths into alphabetical order
+    qsort(sv.vector, sv.num_entries, sizeof(char *), SortSchemaPath);
+    
+    // Print the sorted schema paths
+    for (i=0; i < sv.num_entries; i++)
+    {
+        USP_DUMP("%s", sv.vector[i]);        
+    }
+    
+    STR_VECTOR_Destroy(&sv);
+}
+
+/*********************************************************************//**
+**
+** CompareDbHashMapping
+**
+** Comparator function used by qsort() to sort the database hash mappings by their old hash
+**
+** \param   p1 - pointer to first mapping to compare
+** \param   p2 - pointer to second mapping to compare
+**
+** \return  -1 if the first mapping sorts before the second, 1 if after, 0 if they have the same old hash
+**
+**************************************************************************/
+int CompareDbHashMapping(const void *p1, const void *p2)
+{
+    const dm_hash_mapping_t *m1 = p1;
+    const dm_hash_mapping_t *m2 = p2;
+
+    if (m1->old_hash < m2->old_hash)
+    {
+        return -1;
+    }
+
+    return (m1->old_hash > m2->old_hash) ? 1 : 0;
+}
+
+/*********************************************************************//**
+**
+** SortSchemaPath
+**
+** Function used by quicksort to sort a list of schema paths
+**
+** \param   p1 - pointer to first element in a string array to compare
+** \param   p1 - pointer to second element in a string array to compare
+**
+** \return  None
+**
+**************************************************************************/
+int SortSchemaPath(const void *p1, const void *p2)
+{
+    // qsort passes in pointers to the elements in the array to be compared
+    // Hence we need to dereference the elements to get to the strings they point to
+    char *s1 = * (char **) p1;
+    char *s2 = * (char **) p2;
+
+    return strcmp(s1, s2);
+}
+
+/*********************************************************************//**
+**
+** AddChildNodes
+**
+** Function called recursively to add the schema paths of all nodes to a string vector
+**
+** \param   parent - pointer to data model node to add
+** \param   sv - pointer to string vector in which to add the schema paths
+**
+** \return  None
+**
+**************************************************************************/
+void AddChildNodes(dm_node_t *parent, str_vector_t *sv)
+{
+    dm_node_t *child;
+
+    STR_VECTOR_Add(sv, parent->path);
+
+    // Iterate over list of children
+    child = (dm_node_t *) parent->child_nodes.head;
+    while (child != NULL)
+    {
+        AddChildNodes(child, sv);
+
+        // Move to next sibling in the data model tree
+        child = (dm_node_t *) child->link.next;
+    }
+}
+
+/*********************************************************************//**
+**
+** FindNodeFromHash
+**
+** Finds the node that matches the specified hash value
+**
+** \param   hash - hash value of the node path of the node to find
+**
+** \return  pointer to node matching hash in the data model, or NULL if no match
+**
+**************************************************************************/
+dm_node_t *FindNodeFromHash(dm_hash_t hash)
+{
+    node_lookup_t *nl;
+    unsigned mask;
+    unsigned index;
+
+    // Exit if no nodes have been added yet, or the hash is one that is never used
+    if ((node_lookup == NULL) || (hash == 0))
+    {
+        return NULL;
+    }
+
+    // Probe the hash table, starting at the slot given by the hash
+    mask = node_lookup_size - 1;
+    index = ((unsigned)hash) & mask;
+    nl = &node_lookup[index];
+    while (nl->hash != 0)
+    {
+        if (nl->hash == hash)
+        {
+            return nl->node;
+        }
+
+        index = (index + 1) & mask;
+        nl = &node_lookup[index];
+    }
+
+    // if the code gets here, then no matching node was found
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** AddNodeLookup
+**
+** Adds the specified database parameter node to the node lookup hash table
+** growing the table if necessary, to keep it at most half full
+** NOTE: The caller must have already checked that the node's hash is not already present in the table
+**
+** \param   node - pointer to node to add. The node's hash must be set
+**
+** \return  None
+**
+**************************************************************************/
+void AddNodeLookup(dm_node_t *node)
+{
+    node_lookup_t *table;
+    node_lookup_t *nl;
+    int new_size;
+    int i;
+
+    // Grow the table if adding this node would make it more than half full
+    if (2*(node_lookup_count+1) > node_lookup_size)
+    {
+        new_size = (node_lookup_size == 0) ? NODE_LOOKUP_MIN_SIZE : 2*node_lookup_size;
+        table = USP_MALLOC(new_size*sizeof(node_lookup_t));
+        memset(table, 0, new_size*sizeof(node_lookup_t));
+
+        // Rehash all existing entries into the new table
+        for (i=0; i<node_lookup_size; i++)
+        {
+            nl = &node_lookup[i];
+            if (nl->hash != 0)
+            {
+                InsertIntoNodeLookup(table, new_size, nl->node);
+            }
+        }
+
+        USP_SAFE_FREE(node_lookup);
+        node_lookup = table;
+        node_lookup_size = new_size;
+    }
+
+    InsertIntoNodeLookup(node_lookup, node_lookup_size, node);
+    node_lookup_count++;
+}
+
+/*********************************************************************//**
+**
+** InsertIntoNodeLookup
+**
+** Inserts the specified node into a node lookup hash table, using linear probing
+** NOTE: The table must have at least one free slot
+**
+** \param   table - pointer to node lookup hash table
+** \param   table_size - number of slots in the table (a power of 2)
+** \param   node - pointer to node to insert
+**
+** \return  None
+**
+**************************************************************************/
+void InsertIntoNodeLookup(node_lookup_t *table, int table_size, dm_node_t *node)
+{
+    unsigned mask;
+    unsigned index;
+
+    mask = table_size - 1;
+    index = ((unsigned)node->hash) & mask;
+    while (table[index].hash != 0)
+    {
+        index = (index + 1) & mask;
+    }
+
+    table[index].hash = node->hash;
+    table[index].node = node;
+}
+
+/*********************************************************************//**
+**
+** RegisterDefaultControllerTrust
+**
+** This function is called if no vendor hook overrides it
+** Registers all controller trust roles and permissions 
+** This function is called inbetween VENDOR_Init() and VENDOR_Start()
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int RegisterDefaultControllerTrust(void)
+{
+    int err = USP_ERR_OK;
+
+    // Currently, it is important that the first role registered is full access, as all controllers
+    // inherit the first role in this table, and we currently want all controllers to have full access
+    err |= USP_DM_RegisterRoleName(kCTrustRole_FullAccess, "Full Access");
+    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_FullAccess, "Device.", PERMIT_ALL);
+
+    err |= USP_DM_RegisterRoleName(kCTrustRole_Untrusted,  "Untrusted");
+    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_Untrusted, "Device.", PERMIT_NONE);
+    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_Untrusted, "Device.DeviceInfo.", PERMIT_GET | PERMIT_OBJ_INFO);
+
+    if (err != USP_ERR_OK)
+    {
+        USP_ERR_SetMessage("%s() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-                    get_cb = child->registered.param_info.get_cb;
-                    USP_ASSERT(get_cb != NULL)
-        
-                    // Append the name of this parameter to the parent path
-                    USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+    return USP_ERR_OK;
+}
 
-                    // Exit if unable to get the automatically populated value from the vendor code
-                    DM_PRIV_RequestInit(&req, child, path, inst);
-                    USP_ERR_ClearMessage();
-                    new_value[0] = '\0';
+/*********************************************************************//**
+**
+** SchemaArenaAlloc
+**
+** Allocates memory from the schema arena
+** NOTE: Memory allocated from the arena cannot be freed individually. It is freed by FreeSchemaArena()
+**
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *SchemaArenaAlloc(int size)
+{
+    schema_arena_block_t *block;
+    int block_size;
+    void *ptr;
 
-                    err = get_cb(&req, new_value, sizeof(new_value));
-                    if (err != USP_ERR_OK)
-                    {
-                        USP_ERR_ReplaceEmptyMessage("%s: GetAuto callback for path %s returned error %d", __FUNCTION__, path, err);
-                        return err;
-                    }
+    // Round up the size, so that all allocations from the arena are suitably aligned
+    size = (size + SCHEMA_ARENA_ALIGN - 1) & ~(SCHEMA_ARENA_ALIGN - 1);
 
-                    // If the parameter value was returned as a native value (in val_union), then convert it to a string
-                    SerializeNativeValue(&req, child, new_value, sizeof(new_value));
+    // Allocate a new block, if there is not enough space left in the current block
+    block = schema_arena;
+    if ((block == NULL) || (block->used + size > block->size))
+    {
+        block_size = MAX(size, SCHEMA_ARENA_BLOCK_SIZE);
+        block = USP_MALLOC(sizeof(schema_arena_block_t) + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = schema_arena;
+        schema_arena = block;
+    }
 
-                    // Set the parameter to the new value in the database
-                    FormInstanceString(inst, instances, sizeof(instances));
-                    err = DATABASE_SetParameterValue(path, child->hash, instances, new_value, 0);
-                    if (err != USP_ERR_OK)
-                    {
-                        return err;
-                    }
-                
-                }
-                break;
+    ptr = &block->data[block->used];
+    block->used += size;
+    schema_arena_total += size;
 
-            // For single instance child object nodes, ensure that all of their children have their default value set
-            case kDMNodeType_Object_SingleInstance:
-                {
-                    int len;
-                    len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
-                    err = AddChildParamsDefaultValues(path, path_len+len, child, inst);
-                    if (err != USP_ERR_OK)
-                    {
-                        return err;
-                    }
-                }
-                break;
+    return ptr;
+}
 
-            // Nothing to do for non database writable parameters
-            default:
-            case kDMNodeType_DBParam_ReadOnly:
-            case kDMNodeType_VendorParam_ReadOnly:
-            case kDMNodeType_VendorParam_ReadWrite:
-            case kDMNodeType_Param_ConstantValue:
-            case kDMNodeType_Param_NumEntries:
-            case kDMNodeType_SyncOperation:
-            case kDMNodeType_AsyncOperation:
-            case kDMNodeType_Event:
-            case kDMNodeType_Object_MultiInstance:  // A child Multi-instance object needs an instance creating before we can populate it
-                break;
-        }
+/*********************************************************************//**
+**
+** SchemaArenaStrdup
+**
+** Copies the specified string into memory allocated from the schema arena
+**
+** \param   str - pointer to string to copy
+**
+** \return  pointer to copy of the string
+**
+**************************************************************************/
+char *SchemaArenaStrdup(char *str)
+{
+    int len;
+    char *copy;
 
-        // Move to next sibling in the data model tree
-        child = (dm_node_t *) child->link.next;
-    }
+    len = strlen(str) + 1;   // Plus 1 to include the NULL terminator
+    copy = SchemaArenaAlloc(len);
+    memcpy(copy, str, len);
 
-    return USP_ERR_OK;
+    return copy;
 }
 
 /*********************************************************************//**
 **
-** DeleteChildParams
+** SchemaArenaIntern
 **
-** Deletes all child parameters and object instances of the specified node
-** NOTE: This function is recursive
+** Returns a copy of the specified string allocated from the schema arena, sharing an existing copy if one has already been made
 **
-** \param   path - path of the object instance to delete children from. This code will modify the buffer pointed to by this path
-**                 NOTE: path is only actually needed for debug and error reporting purposes
-** \param   path_len - length of path (position to append child node names)
-** \param   node - Node to delete children of
-** \param   inst - pointer to instance structure locating the parent node
+** \param   str - pointer to string to intern
+** \param   hash - hash of the string (calculated using TEXT_UTILS_CalcHash)
 **
-** \return  USP_ERR_OK if successful
+** \return  pointer to interned copy of the string
 **
 **************************************************************************/
-int DeleteChildParams(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+char *SchemaArenaIntern(char *str, int hash)
 {
-    int err;
-    dm_node_t *child;
-    
-    // Iterate over list of children
-    child = (dm_node_t *) node->child_nodes.head;
-    while (child != NULL)
+    unsigned mask;
+    unsigned index;
+    char **old_table;
+    int old_size;
+    char *name;
+    int i;
+
+    // Exit if the string has already been interned
+    if (schema_names != NULL)
     {
-        switch(child->type)
+        mask = schema_names_size - 1;
+        index = ((unsigned) hash) & mask;
+        while (schema_names[index] != NULL)
         {
-            case kDMNodeType_DBParam_ReadOnly:
-            case kDMNodeType_DBParam_ReadWrite:
-            case kDMNodeType_DBParam_ReadOnlyAuto:
-            case kDMNodeType_DBParam_ReadWriteAuto:
-            case kDMNodeType_DBParam_Secure:
-                {
-                    char instances[MAX_DM_PATH];
+            if (strcmp(schema_names[index], str) == 0)
+            {
+                return schema_names[index];
+            }
+            index = (index + 1) & mask;
+        }
+    }
 
-                    // Append the name of this parameter to the parent path
-                    USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
+    // Resize the table, if adding this name would make the table more than half full
+    if (2*(schema_names_count+1) > schema_names_size)
+    {
+        old_table = schema_names;
+        old_size = schema_names_size;
 
-                    FormInstanceString(inst, instances, sizeof(instances));
-                    err = DATABASE_DeleteParameter(path, child->hash, instances);
-                    if (err != USP_ERR_OK)
-                    {
-                        return err;
-                    }
-                }
-                break;
+        schema_names_size = (old_size == 0) ? SCHEMA_NAMES_MIN_SIZE : 2*old_size;
+        schema_names = USP_MALLOC(schema_names_size * sizeof(char *));
+        memset(schema_names, 0, schema_names_size * sizeof(char *));
 
-            // For single instance child object nodes, ensure that all of their children are deleted
-            case kDMNodeType_Object_SingleInstance:
-                {
-                    int len;
-                    len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
-                    err = DeleteChildParams(path, path_len+len, child, inst);
-                    if (err != USP_ERR_OK)
-                    {
-                        return err;
-                    }
-                }
-                break;
+        for (i=0; i < old_size; i++)
+        {
+            if (old_table[i] != NULL)
+            {
+                InsertIntoSchemaNames(schema_names, schema_names_size, old_table[i]);
+            }
+        }
+        USP_SAFE_FREE(old_table);
+    }
 
-            // For multi-instance child objects, ensure that all instances of all of their children are deleted
-            case kDMNodeType_Object_MultiInstance:
-                {
-                    int len;
-                    len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
-                    err = DeleteChildParams_MultiInstanceObject(path, path_len+len, child, inst);
-                    if (err != USP_ERR_OK)
-                    {
-                        return err;
-                    }
-                }
-                break;
-                
-            // Nothing to do for non database parameters
-            case kDMNodeType_VendorParam_ReadOnly:
-            case kDMNodeType_VendorParam_ReadWrite:
-            case kDMNodeType_Param_ConstantValue:
-            case kDMNodeType_Param_NumEntries:
-            case kDMNodeType_SyncOperation:
-            case kDMNodeType_AsyncOperation:
-            case kDMNodeType_Event:
-                break;
+    // Copy the string into the arena, and add it to the table
+    name = SchemaArenaStrdup(str);
+    InsertIntoSchemaNames(schema_names, schema_names_size, name);
+    schema_names_count++;
 
-            default:
-                TERMINATE_BAD_CASE(child->type);
-                break;
-        }
+    return name;
+}
 
-        // Move to next sibling in the data model tree
-        child = (dm_node_t *) child->link.next;
+/*********************************************************************//**
+**
+** InsertIntoSchemaNames
+**
+** Inserts the specified name into the specified open addressing hash table of interned names
+** NOTE: The caller must ensure that the table has a free slot
+**
+** \param   table - pointer to table of interned names
+** \param   table_size - number of slots in the table (always a power of 2)
+** \param   name - pointer to name to insert
+**
+** \return  None
+**
+**************************************************************************/
+void InsertIntoSchemaNames(char **table, int table_size, char *name)
+{
+    unsigned mask;
+    unsigned index;
+
+    mask = table_size - 1;
+    index = ((unsigned) TEXT_UTILS_CalcHash(name)) & mask;
+    while (table[index] != NULL)
+    {
+        index = (index + 1) & mask;
     }
 
-    return USP_ERR_OK;
+    table[index] = name;
 }
 
 /*********************************************************************//**
 **
-** DeleteChildParams_MultiInstanceObject
+** FreeSchemaArena
 **
-** Iterates over all instances of a multi-instance object, deleting Deletes all child parameters and child object instances
-** NOTE: This function is recursive
+** Frees all memory allocated from the schema arena
 **
-** \param   path - path of the object to delete children from. This code will modify the buffer pointed to by this path
-**                 NOTE: path is only actually needed for debug and error reporting purposes
-** \param   path_len - length of path (position to append child node names)
-** \param   node - Node to delete children of
-** \param   inst - pointer to instance structure locating the parent node
+** \param   None
 **
-** \return  USP_ERR_OK if successful
+** \return  None
 **
 **************************************************************************/
-int DeleteChildParams_MultiInstanceObject(char *path, int path_len, dm_node_t *node, dm_instances_t *inst)
+void FreeSchemaArena(void)
 {
-    int_vector_t iv;
-    int instance;
-    int len;
-    int order;
-    int i;
-    int err;
+    schema_arena_block_t *block;
+    schema_arena_block_t *next;
 
-    // Get an array of instances for this specific object
-    err = DM_INST_VECTOR_GetInstances(node, inst, &iv);
-    if (err != USP_ERR_OK)
+    block = schema_arena;
+    while (block != NULL)
     {
-        goto exit;
+        next = block->next;
+        USP_FREE(block);
+        block = next;
     }
 
-    // Update instance structure in readiness to populate it with the instance number
-    order = inst->order;
-    USP_ASSERT(order < MAX_DM_INSTANCE_ORDER);
-    inst->nodes[order] = node;
-    inst->order = order+1;
+    schema_arena = NULL;
+    schema_arena_total = 0;
+    schema_num_nodes = 0;
 
-    // Iterate over all instances of this object
-    for (i=0; i < iv.num_entries; i++)
+    USP_SAFE_FREE(schema_names);
+    schema_names_count = 0;
+    schema_names_size = 0;
+}
+
+/*********************************************************************//**
+**
+** ValidateAddedInstance
+**
+** Determines whether the instance signalled as added by the vendor can be registered with the data model
+**
+** \param   path - path of the object instance that has been added by the vendor
+** \param   inst - pointer to structure in which to return the instance numbers of the object instance
+**
+** \return  USP_ERR_OK if the instance can be registered with the data model
+**          USP_ERR_OBJECT_DOES_NOT_EXIST if the object (or the parent instances of it) do not exist
+**
+**************************************************************************/
+int ValidateAddedInstance(char *path, dm_instances_t *inst)
+{
+    dm_node_t *node;
+    bool is_qualified_instance;
+    bool exists;
+
+    // Exit if unable to find node representing this object
+    node = DM_PRIV_GetNodeFromPath(path, inst, &is_qualified_instance);
+    if (node == NULL)
     {
-        // Form the path to this instance
-        instance = iv.vector[i];
-        len = USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%d", instance);
+        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+    }
 
-        // Delete all child parameters of this object
-        inst->instances[order] = instance;
-        err = DeleteChildParams(path, path_len+len, node, inst);
-        if (err != USP_ERR_OK)
-        {
-            goto exit;
-        }
+    // Exit if the object the vendor signalled was not a multi-instance object
+    if (node->type != kDMNodeType_Object_MultiInstance)
+    {
+        USP_ERR_SetMessage("%s: Path (%s) is not a multi-instance object.", __FUNCTION__, path);
+        return USP_ERR_OBJECT_NOT_CREATABLE;
+    }
 
-        // De-register this object from the data model
-        DM_INST_VECTOR_Remove(inst);
+    // Exit if this object is not a fully qualified instance
+    if (is_qualified_instance == false)
+    {
+        USP_ERR_SetMessage("%s: Path (%s) should contain instance number of object that was added", __FUNCTION__, path);
+        return USP_ERR_INVALID_ARGUMENTS;
+    }
 
-        // Add this object instance to the list of instances which are pending notification to the vendor
-        DM_TRANS_Add(kDMOp_Del, path, NULL, NULL, node, inst);
+    // Exit if instance already exists - nothing to do
+    exists = DM_INST_VECTOR_IsExist(inst);
+    if (exists)
+    {
+        USP_ERR_SetMessage("%s: Object (%s) already exists in the data model", __FUNCTION__, path);
+        return USP_ERR_CREATION_FAILURE;
     }
 
-    // Put the instance structure back to the way it was
-    inst->nodes[order] = NULL;
-    inst->instances[order] = 0;
-    inst->order = order;
-    err = USP_ERR_OK;
+    // Exit if the parent object instances in the path do not exist
+    if (inst->order > 0)
+    {
+        inst->order--;          // Temporarily remove the instance number of the object that was added,
+                                // so that structure indicates only parent instance numbers
+        exists = DM_INST_VECTOR_IsExist(inst);
+        if (exists == false)
+        {
+            USP_ERR_SetMessage("%s: Parent objects in path (%s) do not exist", __FUNCTION__, path);
+            return USP_ERR_OBJECT_DOES_NOT_EXIST;
+        }
+        inst->order++;          // Restore the structure, so that it indicates the instance number of the object that was added
+    }
 
-exit:
-    INT_VECTOR_Destroy(&iv);
-    return err;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** DestroySchemaRecursive
+** StartCallbackTimer
 **
-** Recursively frees all memory associated with the specified data model node
+** Starts timing a call to a vendor callback, if vendor callback statistics are enabled
 **
-** \param   parent - pointer to node to recursively destroy
+** \param   None
 **
-** \return  None
+** \return  Time (in microseconds) at which the call started, or 0 if the call is not being timed
 **
 **************************************************************************/
-void DestroySchemaRecursive(dm_node_t *parent)
+unsigned long long StartCallbackTimer(void)
 {
-    dm_node_t *child;
-    dm_node_t *next_child;
-
-    // First destroy all child nodes
-    child = (dm_node_t *) parent->child_nodes.head;
-    while (child != NULL)
+    if (__atomic_load_n(&is_cb_stats_enabled, __ATOMIC_RELAXED) == false)
     {
-        // Save off next child in the data model tree, before we delete this child (and loose the reference)
-        next_child = (dm_node_t *) child->link.next;
+        return 0;
+    }
 
-        DestroySchemaRecursive(child);
+    return tu_uptime_usecs();
+}
 
-        child = next_child;
-    }
+/*********************************************************************//**
+**
+** StopCallbackTimer
+**
+** Accounts the time spent in a call to a vendor callback against the data model node that the callback was registered for
+**
+** \param   node - pointer to data model node that the vendor callback was registered for
+** \param   start_time - time (in microseconds) at which the call started, as returned by StartCallbackTimer()
+**
+** \return  None
+**
+**************************************************************************/
+void StopCallbackTimer(dm_node_t *node, unsigned long long start_time)
+{
+    dm_cb_stats_t *cs;
+    unsigned long long duration;
+    unsigned long long max_time;
 
-    // Then destroy this node
-    // Free extra information contained in the 'registered' union
-    switch (parent->type)
+    // Exit if this call was not timed
+    if (start_time == 0)
     {
-        case kDMNodeType_Object_MultiInstance:
-            // NOTE: No need to free the unique keys in the vector - the pointers are to static const strings, so cannot be freed
-            USP_SAFE_FREE(parent->registered.object_info.unique_keys.vector);
-//            DM_INST_VECTOR_Destroy(&parent->registered.object_info.inst_vector); // This should already have been freed by the time this function is called
-            break;
-
-        case kDMNodeType_Param_ConstantValue:
-        case kDMNodeType_DBParam_ReadWrite:
-        case kDMNodeType_DBParam_ReadOnly:
-        case kDMNodeType_DBParam_Secure:
-        case kDMNodeType_DBParam_ReadOnlyAuto:
-        case kDMNodeType_DBParam_ReadWriteAuto:
-            USP_FREE(parent->registered.param_info.default_value);
-            break;
+        return;
+    }
 
-        default:
-        case kDMNodeType_Param_NumEntries:
-        case kDMNodeType_Object_SingleInstance:
-        case kDMNodeType_VendorParam_ReadOnly:
-        case kDMNodeType_VendorParam_ReadWrite:
-        case kDMNodeType_Event:
-            // These types of nodes do not allocate anything extra in the 'registered' union
-            break;
+    duration = tu_uptime_usecs() - start_time;
+    cs = &node->cb_stats;
+    __atomic_fetch_add(&cs->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cs->total_time, duration, __ATOMIC_RELAXED);
 
-        case kDMNodeType_SyncOperation:
-        case kDMNodeType_AsyncOperation:
-            {
-                dm_oper_info_t *info;
-            
-                info = &parent->registered.oper_info;
-                STR_VECTOR_Destroy(&info->input_args);
-                STR_VECTOR_Destroy(&info->output_args);
-            }
+    // Update the maximum duration, retrying if another thread updated it at the same time
+    max_time = __atomic_load_n(&cs->max_time, __ATOMIC_RELAXED);
+    while (duration > max_time)
+    {
+        if (__atomic_compare_exchange_n(&cs->max_time, &max_time, duration, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
             break;
+        }
     }
-
-    // Finally free this node itself
-    USP_FREE(parent->path);
-    USP_FREE(parent->name);    
-    USP_FREE(parent);    
 }
 
 /*********************************************************************//**
 **
-** DestroyInstanceVectorRecursive
+** ResetCallbackStatsRecursive
 **
-** Recursively frees all memory containing the instance vectors of all top level multi-instance objects
+** Resets the vendor callback statistics of the specified node and all of its children
 **
-** \param   parent - pointer to node to recursively free all instance vectors of
+** \param   parent - pointer to data model node to reset the statistics of
 **
 ** \return  None
 **
 **************************************************************************/
-void DestroyInstanceVectorRecursive(dm_node_t *parent)
+void ResetCallbackStatsRecursive(dm_node_t *parent)
 {
     dm_node_t *child;
 
-    if (parent->type == kDMNodeType_Object_MultiInstance)
-    {
-        // This node is a top level multi instance node, storing it's instances and all instances of its children
-        // So free the instance vector it holds, then exit
-        // NOTE: we do not have to recurse to its children because their instances are stored here
-        DM_INST_VECTOR_Destroy(&parent->registered.object_info.inst_vector);
-        return;
-    }
+    __atomic_store_n(&parent->cb_stats.count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&parent->cb_stats.total_time, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&parent->cb_stats.max_time, 0, __ATOMIC_RELAXED);
 
-    // Recurse to free all child node instance vectors
     child = (dm_node_t *) parent->child_nodes.head;
     while (child != NULL)
     {
-        DestroyInstanceVectorRecursive(child);
-
+        ResetCallbackStatsRecursive(child);
         child = (dm_node_t *) child->link.next;
     }
 }
 
 /*********************************************************************//**
 **
-** DumpInstanceVectorRecursive
+** AddTimedNodesRecursive
 **
-** Recursively prints out instances stored in the data model
+** Adds the specified node and all of its children whose vendor callbacks have been timed to an array
 **
-** \param   parent - pointer to node to recursively dump
+** \param   parent - pointer to data model node to add
+** \param   nodes - array (with an entry for every node in the schema) in which to add the nodes
+** \param   num_nodes - pointer to variable containing the number of nodes in the array. This is updated by this function
 **
 ** \return  None
 **
 **************************************************************************/
-void DumpInstanceVectorRecursive(dm_node_t *parent)
+void AddTimedNodesRecursive(dm_node_t *parent, dm_node_t **nodes, int *num_nodes)
 {
     dm_node_t *child;
 
-    if (parent->type == kDMNodeType_Object_MultiInstance)
+    if (__atomic_load_n(&parent->cb_stats.count, __ATOMIC_RELAXED) != 0)
     {
-        // This node is a top level multi instance node, storing it's instances and all instances of its children
-        // So print the instances it holds, then exit
-        // NOTE: we do not have to recurse to its children because their instances are stored here
-        DM_INST_VECTOR_Dump(&parent->registered.object_info.inst_vector);
-        return;
+        USP_ASSERT(*num_nodes < schema_num_nodes);
+        nodes[*num_nodes] = parent;
+        (*num_nodes)++;
     }
 
-    // Recurse to dump all child node instance vectors
     child = (dm_node_t *) parent->child_nodes.head;
     while (child != NULL)
     {
-        DumpInstanceVectorRecursive(child);
-
+        AddTimedNodesRecursive(child, nodes, num_nodes);
         child = (dm_node_t *) child->link.next;
     }
 }
 
 /*********************************************************************//**
 **
-** DumpSchemaFromRoot
+** CompareCallbackTotalTime
 **
-** Dumps the schema, starting at the specified root node
+** qsort comparison function used to order data model nodes by the total time spent in their vendor callbacks (largest first)
 **
-** \param   root - pointer to root data model node to dump from
-** \param   name - name of the data model root node
+** \param   p1 - pointer to first element in an array of node pointers to compare
+** \param   p2 - pointer to second element in an array of node pointers to compare
 **
-** \return  None
+** \return  negative if the first node should be ordered before the second
 **
 **************************************************************************/
-void DumpSchemaFromRoot(dm_node_t *root, char *name)
+int CompareCallbackTotalTime(const void *p1, const void *p2)
 {
-    int i;
-    str_vector_t sv;
+    unsigned long long t1 = (* (dm_node_t **) p1)->cb_stats.total_time;
+    unsigned long long t2 = (* (dm_node_t **) p2)->cb_stats.total_time;
 
-    USP_DUMP("\nDumping %s Schema...", name);
-    STR_VECTOR_Init(&sv);
+    return (t1 < t2) - (t1 > t2);
+}
 
-    // Build up the paths of all elements in the schema in a string vector
-    AddChildNodes(root, &sv);
+/*********************************************************************//**
+**
+** FindValueCacheSlot
+**
+** Returns the slot in the cache of vendor parameter values, which the specified parameter instance is cached in
+**
+** \param   node - pointer to data model node of the parameter
+** \param   inst - pointer to instance numbers of the parameter
+**
+** \return  pointer to slot in the cache
+**
+**************************************************************************/
+value_cache_entry_t *FindValueCacheSlot(dm_node_t *node, dm_instances_t *inst)
+{
+    int i;
+    unsigned hash;
 
-    // Sort the paths into alphabetical order
-    qsort(sv.vector, sv.num_entries, sizeof(char *), SortSchemaPath);
-    
-    // Print the sorted schema paths
-    for (i=0; i < sv.num_entries; i++)
+    // NOTE: The node pointer is shifted to remove the bits which are always zero due to alignment
+    hash = (unsigned)((uintptr_t)node >> 4);
+    for (i=0; i < inst->order; i++)
     {
-        USP_DUMP("%s", sv.vector[i]);        
+        hash = hash*31 + (unsigned)inst->instances[i];
     }
-    
-    STR_VECTOR_Destroy(&sv);
+    hash ^= (hash >> 16);
+
+    return &value_cache[hash & (VENDOR_GET_CACHE_SIZE-1)];
 }
 
 /*********************************************************************//**
 **
-** SortSchemaPath
+** IsSameValueCacheKey
 **
-** Function used by quicksort to sort a list of schema paths
+** Determines whether the specified slot in the cache of vendor parameter values contains the specified parameter instance
 **
-** \param   p1 - pointer to first element in a string array to compare
-** \param   p1 - pointer to second element in a string array to compare
+** \param   entry - pointer to slot in the cache
+** \param   node - pointer to data model node of the parameter
+** \param   inst - pointer to instance numbers of the parameter
 **
-** \return  None
+** \return  true if the slot contains the specified parameter instance
 **
 **************************************************************************/
-int SortSchemaPath(const void *p1, const void *p2)
+bool IsSameValueCacheKey(value_cache_entry_t *entry, dm_node_t *node, dm_instances_t *inst)
 {
-    // qsort passes in pointers to the elements in the array to be compared
-    // Hence we need to dereference the elements to get to the strings they point to
-    char *s1 = * (char **) p1;
-    char *s2 = * (char **) p2;
+    if ((entry->node != node) || (entry->order != inst->order))
+    {
+        return false;
+    }
 
-    return strcmp(s1, s2);
+    return (memcmp(entry->instances, inst->instances, inst->order*sizeof(int)) == 0) ? true : false;
 }
 
 /*********************************************************************//**
 **
-** AddChildNodes
+** GetCachedValue
 **
-** Function called recursively to add the schema paths of all nodes to a string vector
+** Gets the value of the specified vendor parameter from the cache of vendor parameter values, if it has not become stale
 **
-** \param   parent - pointer to data model node to add
-** \param   sv - pointer to string vector in which to add the schema paths
+** \param   node - pointer to data model node of the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+** \param   native - pointer to union in which to return the value of the parameter in its native type,
+**                   or NULL if the value must always be returned as a textual string
+** \param   is_native - pointer to variable in which to return whether the value was returned in native (rather than buf)
+**                      NOTE: This argument is only used if native is not NULL
 **
-** \return  None
+** \return  true if the value was returned from the cache
 **
 **************************************************************************/
-void AddChildNodes(dm_node_t *parent, str_vector_t *sv)
+bool GetCachedValue(dm_node_t *node, dm_instances_t *inst, char *buf, int len, dm_val_union_t *native, bool *is_native)
 {
-    dm_node_t *child;
+    value_cache_entry_t *entry;
+    bool is_hit = false;
 
-    STR_VECTOR_Add(sv, parent->path);
+    LockValueCache();
 
-    // Iterate over list of children
-    child = (dm_node_t *) parent->child_nodes.head;
-    while (child != NULL)
+    // Exit if the value is not in the cache, or is stale
+    entry = FindValueCacheSlot(node, inst);
+    if ((IsSameValueCacheKey(entry, node, inst) == false) || (entry->generation != DM_INST_VECTOR_GetGeneration()) ||
+        (tu_uptime_usecs() >= entry->expiry_time))
     {
-        AddChildNodes(child, sv);
+        value_cache_misses++;
+        goto exit;
+    }
 
-        // Move to next sibling in the data model tree
-        child = (dm_node_t *) child->link.next;
+    // Return the cached value, in its native type if the caller accepts it
+    if (entry->is_native)
+    {
+        if (native != NULL)
+        {
+            *native = entry->native;
+            *is_native = true;
+            *buf = '\0';
+        }
+        else
+        {
+            NativeValueToString(&entry->native, node->registered.param_info.type_flags, buf, len);
+        }
+    }
+    else
+    {
+        USP_STRNCPY(buf, entry->value, len);
     }
+
+    value_cache_hits++;
+    is_hit = true;
+
+exit:
+    UnlockValueCache();
+    return is_hit;
 }
 
 /*********************************************************************//**
 **
-** FindNodeFromHash
+** CacheValue
 **
-** Finds the node that matches the specified hash value
+** Stores the value returned by the get callback of a vendor parameter in the cache of vendor parameter values
 **
-** \param   hash - hash value of the node path of the node to find
+** \param   node - pointer to data model node of the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   value - value of the parameter as a textual string, or NULL if the value was returned in its native type
+** \param   native - pointer to the value of the parameter in its native type, or NULL if the value was returned as a string
 **
-** \return  pointer to node matching hash in the data model, or NULL if no match
+** \return  None
 **
 **************************************************************************/
-dm_node_t *FindNodeFromHash(dm_hash_t hash)
+void CacheValue(dm_node_t *node, dm_instances_t *inst, char *value, dm_val_union_t *native)
 {
-    node_lookup_t *nl;
-    int i;
+    value_cache_entry_t *entry;
+
+    LockValueCache();
 
-    // Iterate over all nodes in the node lookup vector, looking for a match
-    for (i=0; i<node_lookup_count; i++)
+    // Replace whatever was previously cached in the slot
+    entry = FindValueCacheSlot(node, inst);
+    USP_SAFE_FREE(entry->value);
+    entry->node = node;
+    entry->order = inst->order;
+    memcpy(entry->instances, inst->instances, inst->order*sizeof(int));
+    entry->generation = DM_INST_VECTOR_GetGeneration();
+    entry->expiry_time = tu_uptime_usecs() + 1000*(unsigned long long)node->registered.param_info.cache_period;
+
+    if (value == NULL)
     {
-        nl = &node_lookup[i];
-        if (nl->hash == hash)
-        {
-            return nl->node;
-        }
+        entry->is_native = true;
+        entry->native = *native;
+    }
+    else
+    {
+        entry->is_native = false;
+        entry->value = USP_STRDUP(value);
     }
 
-    // if the code gets here, then no matching node was found
-    return NULL;
+    UnlockValueCache();
 }
 
 /*********************************************************************//**
 **
-** RegisterDefaultControllerTrust
+** InvalidateCachedValue
 **
-** This function is called if no vendor hook overrides it
-** Registers all controller trust roles and permissions 
-** This function is called inbetween VENDOR_Init() and VENDOR_Start()
+** Discards the cached value of the specified vendor parameter instance (if any)
 **
-** \param   None
+** \param   node - pointer to data model node of the parameter
+** \param   inst - pointer to instance numbers of the parameter
 **
-** \return  USP_ERR_OK if successful
+** \return  None
 **
 **************************************************************************/
-int RegisterDefaultControllerTrust(void)
+void InvalidateCachedValue(dm_node_t *node, dm_instances_t *inst)
 {
-    int err = USP_ERR_OK;
+    value_cache_entry_t *entry;
 
-    // Currently, it is important that the first role registered is full access, as all controllers
-    // inherit the first role in this table, and we currently want all controllers to have full access
-    err |= USP_DM_RegisterRoleName(kCTrustRole_FullAccess, "Full Access");
-    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_FullAccess, "Device.", PERMIT_ALL);
+    LockValueCache();
+    entry = FindValueCacheSlot(node, inst);
+    if (IsSameValueCacheKey(entry, node, inst))
+    {
+        USP_SAFE_FREE(entry->value);
+        entry->node = NULL;
+        value_cache_invalidations++;
+    }
+    UnlockValueCache();
+}
 
-    err |= USP_DM_RegisterRoleName(kCTrustRole_Untrusted,  "Untrusted");
-    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_Untrusted, "Device.", PERMIT_NONE);
-    err |= USP_DM_AddControllerTrustPermission(kCTrustRole_Untrusted, "Device.DeviceInfo.", PERMIT_GET | PERMIT_OBJ_INFO);
+/*********************************************************************//**
+**
+** FreeValueCache
+**
+** Frees all values held in the cache of vendor parameter values
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreeValueCache(void)
+{
+    int i;
 
-    if (err != USP_ERR_OK)
+    for (i=0; i < VENDOR_GET_CACHE_SIZE; i++)
     {
-        USP_ERR_SetMessage("%s() failed", __FUNCTION__);
-        return USP_ERR_INTERNAL_ERROR;
+        USP_SAFE_FREE(value_cache[i].value);
+        value_cache[i].node = NULL;
     }
+}
 
-    return USP_ERR_OK;
+/*********************************************************************//**
+**
+** LockValueCache
+**
+** Takes the mutex protecting the cache of vendor parameter values, if the cache may be accessed by Get worker threads
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void LockValueCache(void)
+{
+#if NUM_GET_WORKER_THREADS > 0
+    OS_UTILS_LockMutex(&value_cache_mutex);
+#endif
 }
 
+/*********************************************************************//**
+**
+** UnlockValueCache
+**
+** Releases the mutex protecting the cache of vendor parameter values
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void UnlockValueCache(void)
+{
+#if NUM_GET_WORKER_THREADS > 0
+    OS_UTILS_UnlockMutex(&value_cache_mutex);
+#endif
+}
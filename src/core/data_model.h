@@ -41,6 +41,9 @@
 #ifndef DATA_MODEL_H
 #define DATA_MODEL_H
 
+#include <stdint.h>
+
+#include "vendor_defs.h"  // for DATABASE_HASH_64BIT
 #include "usp_api.h"
 #include "dllist.h"
 #include "str_vector.h"
@@ -105,10 +108,12 @@ typedef struct
 
 //-----------------------------------------------------------------------------------------
 // Typedef for structure containing all object instances for a top level multi-instance node and its children
+// NOTE: The vector is kept sorted (see CompareInstances() in dm_inst_vector.c), so that instances can be found using a binary search
 typedef struct
 {
     dm_instances_t *vector;
     int num_entries;
+    int max_entries;    // Number of entries allocated in the vector
 } dm_instances_vector_t;
 
 //-----------------------------------------------------------------------------------------
@@ -123,8 +128,17 @@ typedef struct
     dm_set_value_cb_t set_cb;
     unsigned type_flags;                  // type of the parameter
     struct dm_node_tag *table_node;       // database node representing the table which we need to get the number of entries in (for kDMNodeType_Param_NumEntries)
+    int group_id;                         // Group whose get callback is used to get the value of this parameter, or NON_GROUPED (for vendor params only)
+    bool is_unique_key;                   // Set if this parameter is part of a unique key of its parent object
+    int cache_period;                     // Number of milliseconds for which the value returned by get_cb is cached, or 0 if not cached (vendor params only)
+    dm_async_get_cb_t async_get_cb;       // Callback used by Get requests to start getting the value of the parameter asynchronously, or NULL if get_cb is always used
+    usp_shm_region_t *shm_region;         // Shared memory region containing the value of the parameter, or NULL if get_cb is used (see USP_REGISTER_SharedMemStats)
+    int shm_offset;                       // Offset of the value within each record of shm_region
 } dm_param_info_t;
 
+// Value of group_id (in dm_param_info_t) for vendor parameters whose value is obtained using their own get callback
+#define NON_GROUPED (-1)
+
 // Information registered in the data model for objects
 typedef struct
 {
@@ -136,6 +150,9 @@ typedef struct
     dm_notify_del_cb_t   notify_del_cb;
     dm_unique_key_vector_t unique_keys;
     dm_instances_vector_t inst_vector;
+    dm_refresh_instances_cb_t refresh_instances_cb; // Called to re-read the instances of a top level vendor object, or NULL if its instances are informed by the vendor
+    time_t refresh_expiry_time;     // Time at which the instances last read by refresh_instances_cb become stale
+    unsigned refresh_epoch;         // Value of the refresh epoch when the expiry of the instances was last checked (see DM_INST_VECTOR_NextRefreshEpoch)
 } dm_object_info_t;
 
 // Information registered in the data model for operations
@@ -161,30 +178,80 @@ typedef struct
 
 //-----------------------------------------------------------------------------------------
 // Typedef for hash of generic path to data model parameter
-typedef int dm_hash_t;
+// NOTE: This is the key of each parameter in the database. Whether it contains a 32 bit or a 64 bit hash is
+//       determined by the database hash format (see DATABASE_HASH_64BIT in vendor_defs.h)
+typedef int64_t dm_hash_t;
+
+//-----------------------------------------------------------------------------------------
+// Formats of the hash used as the key of each parameter in the database
+#define DB_HASH_FORMAT_32BIT  0     // 32 bit FNV hash (TEXT_UTILS_CalcHash). All databases written before 64 bit hashes were supported use this
+#define DB_HASH_FORMAT_64BIT  1     // 64 bit hash (TEXT_UTILS_CalcWordHash64)
+
+#ifdef DATABASE_HASH_64BIT
+#define DB_HASH_FORMAT  DB_HASH_FORMAT_64BIT
+#else
+#define DB_HASH_FORMAT  DB_HASH_FORMAT_32BIT
+#endif
+
+//-----------------------------------------------------------------------------------------
+// Structure mapping the hash of a database parameter in another hash format, to its hash in the selected format
+// Used when migrating the database between hash formats (see DATA_MODEL_GetDbHashMapping)
+typedef struct
+{
+    dm_hash_t old_hash;         // Hash of the parameter in the hash format being migrated from
+    dm_hash_t new_hash;         // Hash of the parameter in the selected format, or 0 if more than one parameter has the same old_hash
+} dm_hash_mapping_t;
+
+//-----------------------------------------------------------------------------------------
+// Statistics of the time spent in the vendor callbacks (get, set, operate) registered for a data model node
+// NOTE: These are only collected when enabled by DATA_MODEL_EnableCallbackStats()
+//       They are updated atomically, as get callbacks may also be called by the Get worker threads
+typedef struct
+{
+    unsigned long long count;           // Number of calls to the node's vendor callbacks
+    unsigned long long total_time;      // Sum of the time (in microseconds) spent in all calls
+    unsigned long long max_time;        // Longest call (in microseconds)
+} dm_cb_stats_t;
 
 //-----------------------------------------------------------------------------------------
 // Structure describing each data model node
+// NOTE: The fields are ordered so that those accessed when traversing the schema tree (resolving a path segment
+//       to a child node) are grouped together at the start of the structure, with the fields only used once the
+//       node has been found (and the registered information, which is only used for some node types) following them
+//------------------------------------------------------------------------------
+// Index of a combination of inherited and assigned role (each of which may also be INVALID_ROLE) in dm_node_t combined_permissions[]
+#define NUM_COMBINED_ROLES ((kCTrustRole_Max+1) * (kCTrustRole_Max+1))
+#define COMBINED_ROLE_INDEX(inherited, assigned) ((inherited)*(kCTrustRole_Max+1) + (assigned))
+
 typedef struct dm_node_tag
 {
-    double_link_t link;         // Link to siblings in the data model tree
-    char *path;                 // Schema path for this node. Used for debug, passed to the vendor hooks and with GetSupportedDM
-
-    char *name;                 // Part of the path that this node implements
+    // Hot fields - used when traversing the schema tree
+    double_link_t link;         // Link to siblings in the data model tree. NOTE: Must be the first field, as this structure is used in double linked lists
+    int name_hash;              // Hash of the name. Used to speed up matching path segments against child nodes
     dm_node_type_t type;
+    char *name;                 // Part of the path that this node implements. NOTE: Interned, so may be shared with other nodes
     double_linked_list_t child_nodes;
+    struct dm_node_tag **child_table; // Open addressing hash table of the child nodes, keyed by name_hash. Only allocated for nodes with many children.
+                                      // The child_nodes linked list is still used for ordered iteration over the children
+    int child_table_size;       // Number of slots in child_table (always a power of 2), or 0 if child_table has not been allocated
+    int num_children;           // Number of nodes in the child_nodes linked list
 
     dm_hash_t hash;             // If this is a parameter (not object), contains hash of the node path to this parameter
-
     int order;                   // Number of instance separators in the path to this node
                                  // e.g. Device.Wifi.{i}.Interface.{i}.Enable would have an order of 2
                                  // And would contain pointers to the 2 nodes 'Device.Wifi' and 
                                  // 'Device.Wifi.{i}.Interface' in the instance_nodes[] array
                                  // For nodes which are objects, if the node is a multi-instance object, then 
                                  // it's instance separator is included e.g. Device.Wifi.{i}.Interface.{i} would have an order of 2
-    struct dm_node_tag *instance_nodes[MAX_DM_INSTANCE_ORDER]; // See 'order' above
-
     unsigned short permissions[kCTrustRole_Max];    // Bitmask of permissions for each role
+    unsigned short combined_permissions[NUM_COMBINED_ROLES]; // Bitmask of effective permissions for each combination of inherited and assigned role
+                                                             // Indexed by COMBINED_ROLE_INDEX(). Calculated from permissions[] whenever it changes
+
+    // Cold fields - used once the node has been found
+    char *path;                 // Schema path for this node. Used for debug, passed to the vendor hooks and with GetSupportedDM
+    struct dm_node_tag **instance_nodes;  // Array of 'order' nodes. See 'order' above
+                                          // NOTE: This array is shared with the parent node, if the parent has the same order
+    dm_cb_stats_t cb_stats;     // Time spent in the vendor callbacks registered for this node
 
     union
     {
@@ -200,10 +267,19 @@ typedef struct dm_node_tag
 // Structure containing the vendor hook callbacks
 extern vendor_hook_cb_t vendor_hook_callbacks;
 
+//------------------------------------------------------------------------------
+// Arrays of get and set callbacks for each group of vendor parameters, indexed by group_id
+extern dm_get_group_cb_t group_get_callbacks[MAX_VENDOR_PARAM_GROUPS];
+extern dm_set_group_cb_t group_set_callbacks[MAX_VENDOR_PARAM_GROUPS];
+
 //------------------------------------------------------------------------------
 // Boolean that allows us to control which scope the USP_REGISTER_XXX() functions can be called in
 extern bool is_executing_within_dm_init;
 
+//------------------------------------------------------------------------------
+// Function called by DATA_MODEL_Init() to wait for all staged vendor registrations to be prepared, then register them (see USP_REGISTER_StagedInit)
+int USP_REGISTER_CompleteStagedInits(void);
+
 //------------------------------------------------------------------------------
 // Data model path to parameter recording the cause of the last reset (Internal.Reboot.Cause)
 extern char *reboot_cause_path;
@@ -220,6 +296,65 @@ extern char *reboot_cause_path;
 #define PP_PARENT_INSTANCE_NUMBERS_EXIST  0x00000080   // If the path represents a multi-instance object with a trailing instance number that does not exist, then if this bit is set, the parent instance numbers are instantiated in the model
 #define PP_IS_MULTI_INSTANCE_OBJECT       0x00000100   // Set if the path represents a multi-instance object
 #define PP_IS_SECURE_PARAM                0x00000200   // Set if the path represents a secure parameter
+#define PP_IS_DB_PARAM                    0x00000400   // Set if the path represents a parameter stored in the database
+
+//------------------------------------------------------------------------------
+// Type of comparison performed by a compiled search expression (determined by the type of the parameter in the expression)
+typedef enum
+{
+    kCompiledExprType_String,
+    kCompiledExprType_Number,
+    kCompiledExprType_Bool,
+    kCompiledExprType_DateTime,
+} compiled_expr_type_t;
+
+//------------------------------------------------------------------------------
+// Structure containing a search expression (eg 'Enable==true'), compiled so that it can be evaluated against each instance
+// of an object without looking up the parameter's node, or converting the expression's constant, for every instance
+typedef struct
+{
+    char *object;           // Data model path of the object being searched, including trailing '.' (not owned by this structure)
+    char *param;            // Path of the parameter in the expression, relative to the object instance (not owned by this structure)
+    dm_node_t *node;        // Node representing the parameter in the data model schema
+    dm_instances_t inst;    // Instance numbers of the parameter. The object's instance number is updated for each instance evaluated
+    int inst_index;         // Index in inst.instances[] of the object's instance number
+    unsigned short permission_bitmask;  // Permissions of the role performing the search, for the parameter
+    expr_op_t op;           // Operator in the expression
+    compiled_expr_type_t type;
+    char *constant;         // Constant in the expression (not owned by this structure)
+    union
+    {
+        long double number;
+        bool boolean;
+        time_t date_time;
+    } value;                // Constant in the expression, converted to the type of the parameter (not used for strings)
+} dm_compiled_expr_t;
+
+//------------------------------------------------------------------------------
+// Value of the parameter in a compiled search expression, for an instance of the object being searched
+// NOTE: If the value was obtained in its native type (eg from a vendor get callback returning val_union), then it is not converted to a string
+typedef struct
+{
+    bool is_native;                     // Set if the value is in native, rather than str
+    dm_val_union_t native;              // Value of the parameter in its native type (see type_flags of the parameter)
+    char str[MAX_DM_SHORT_VALUE_LEN];   // Value of the parameter as a textual string
+} dm_expr_value_t;
+
+//------------------------------------------------------------------------------
+// Path found by the path resolver, along with the node and instance numbers that the path resolver parsed from it
+// This allows the value of a resolved parameter to be obtained without parsing its path again
+typedef struct
+{
+    char *path;             // Data model path (owned by this structure)
+    dm_node_t *node;        // Node representing the path in the data model schema
+    dm_instances_t inst;    // Instance numbers in the path
+} dm_resolved_path_t;
+
+typedef struct dm_resolved_path_vector_tag
+{
+    dm_resolved_path_t *vector;
+    int num_entries;
+} dm_resolved_path_vector_t;
 
 //------------------------------------------------------------------------------
 // Convenience macros
@@ -237,9 +372,18 @@ extern char *reboot_cause_path;
                           (node->type == kDMNodeType_DBParam_ReadWriteAuto) || \
                           (node->type == kDMNodeType_DBParam_Secure))
 
+#define IsGroupedVendorParam(node)  (((node->type == kDMNodeType_VendorParam_ReadOnly) || (node->type == kDMNodeType_VendorParam_ReadWrite)) && \
+                                     (node->registered.param_info.group_id != NON_GROUPED))
+
+#define IsShmStatsParam(node)  ((node->type == kDMNodeType_VendorParam_ReadOnly) && (node->registered.param_info.shm_region != NULL))
+
+#define IsAsyncGetVendorParam(node)  (((node->type == kDMNodeType_VendorParam_ReadOnly) || (node->type == kDMNodeType_VendorParam_ReadWrite)) && \
+                                      (node->registered.param_info.async_get_cb != NULL))
+
 //------------------------------------------------------------------------------
 // Definitions for flags in DATA_MODEL_GetParameterValue()
 #define SHOW_PASSWORD 0x00000001        // Used internally by USP Agent to get the actual value of passwords (default behaviour is to return an empty string)
+#define IGNORE_GET_ERRORS 0x00000002    // Used by DATA_MODEL_GetParameterValues() to return an empty string for parameters which could not be read (default behaviour is to fail the whole get)
 
 //------------------------------------------------------------------------------
 // Definitions for flags in DATA_MODEL_SetParameterValue()
@@ -269,38 +413,57 @@ int DATA_MODEL_Start(void);
 void DATA_MODEL_Stop(void);
 int DATA_MODEL_GetNumInstances(char *path, int *num_instances);
 int DATA_MODEL_GetInstances(char *path, int_vector_t *iv);
-int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, combined_role_t *combined_role);
+int DATA_MODEL_GetInstancePaths(char *path, str_vector_t *sv, str_set_t *ss, combined_role_t *combined_role);
 int DATA_MODEL_GetAllInstancePaths(char *path, str_vector_t *sv, combined_role_t *combined_role);
 int DATA_MODEL_AddInstance(char *path, int *instance, unsigned flags);
 int DATA_MODEL_DeleteInstance(char *path, unsigned flags);
+int DATA_MODEL_DeleteInstances(str_vector_t *paths, unsigned flags);
 int DATA_MODEL_GetPermissions(char *path, combined_role_t *combined_role, unsigned short *perm);
 int DATA_MODEL_NotifyInstanceAdded(char *path);
 int DATA_MODEL_NotifyInstanceDeleted(char *path);
+void DATA_MODEL_NotifyInstancesAdded(str_vector_t *paths);
+void DATA_MODEL_NotifyInstancesDeleted(str_vector_t *paths);
 int DATA_MODEL_GetParameterValue(char *path, char *buf, int len, unsigned flags);
+int DATA_MODEL_GetParameterValueFromNode(dm_node_t *node, char *path, dm_instances_t *inst, char *buf, int len, unsigned flags);
+int DATA_MODEL_GetParameterValueAlloc(dm_node_t *node, char *path, dm_instances_t *inst, char **value, unsigned flags);
+int DATA_MODEL_GetParameterValues(kv_vector_t *params, unsigned flags);
+int DATA_MODEL_GetResolvedParameterValues(kv_vector_t *params, dm_resolved_path_t *resolved, unsigned flags);
 int DATA_MODEL_SetParameterValue(char *path, char *new_value, unsigned flags);
 int DATA_MODEL_Operate(char *path, kv_vector_t *input_args, kv_vector_t *output_args, char *command_key, int *instance);
 int DATA_MODEL_ShouldOperationRestart(char *path, int instance, bool *is_restart, int *err_code, char *err_msg, int err_msg_len, kv_vector_t *output_args);
 int DATA_MODEL_RestartAsyncOperation(char *path, kv_vector_t *input_args, int instance);
-int DATA_MODEL_CompareParameterValue(char *path, expr_op_t op, char *expr_constant, bool *result);
+int DATA_MODEL_CompileExpression(char *object, int instance, char *param, expr_op_t op, char *constant, combined_role_t *combined_role, dm_compiled_expr_t *ce);
+int DATA_MODEL_GetCompiledExprValue(dm_compiled_expr_t *ce, int instance, dm_expr_value_t *value, bool is_native_allowed);
+int DATA_MODEL_EvaluateCompiledExpr(dm_compiled_expr_t *ce, dm_expr_value_t *value, bool *result);
 unsigned DATA_MODEL_GetPathProperties(char *path, combined_role_t *combined_role, unsigned short *permission_bitmask);
+unsigned DATA_MODEL_GetNodePathProperties(dm_node_t *node, dm_instances_t *inst, bool is_qualified_instance, combined_role_t *combined_role, unsigned short *permission_bitmask);
 int DATA_MODEL_SplitPath(char *path, char **schema_path, dm_req_instances_t *instances, bool *instances_exist);
 int DATA_MODEL_InformInstance(char *path);
-int DATA_MODEL_AddParameterInstances(dm_hash_t hash, char *instances);
+int DATA_MODEL_RefreshInstance(char *path);
+int DATA_MODEL_ResolveParameterInstances(dm_hash_t hash, dm_instances_t *db_inst, dm_instances_t *inst);
+int DATA_MODEL_GetDbHashMapping(int old_format, dm_hash_mapping_t **p_mapping);
 int DATA_MODEL_GetUniqueKeys(char *path, dm_unique_key_vector_t *ukv);
 int DATA_MODEL_GetUniqueKeyParams(char *obj_path, kv_vector_t *params, combined_role_t *combined_role);
 void DATA_MODEL_DumpSchema(void);
 void DATA_MODEL_DumpInstances(void);
+void DATA_MODEL_EnableCallbackStats(bool enable);
+void DATA_MODEL_InvalidateCachedValue(char *path);
+void DATA_MODEL_DumpValueCache(void);
+void DATA_MODEL_DumpSlowestCallbacks(void);
 char DATA_MODEL_GetJSONParameterType(char *path);
+unsigned DATA_MODEL_GetParameterType(char *path);
 int DATA_MODEL_SetParameterInDatabase(char *path, char *value);
 
 int DM_PRIV_InitSetRequest(dm_req_t *req, dm_node_t *node, char *path, dm_instances_t *inst, char *new_value);
 void DM_PRIV_RequestInit(dm_req_t *req, dm_node_t *node, char *path, dm_instances_t *inst);
 char *DM_PRIV_FormPath_FromDM(dm_node_t *node, dm_instances_t *inst, char *buf, int len);
 dm_node_t *DM_PRIV_AddSchemaPath(char *path, dm_node_type_t type, unsigned flags);
-int DM_PRIV_FormDB_FromPath(char *path, dm_hash_t *hash, char *instances, int len);
-int DM_PRIV_FormPath_FromDB(dm_hash_t hash, char *instances, char *buf, int len);
+int DM_PRIV_AddStaticSchema(const usp_static_schema_t *schema, dm_node_t **nodes, bool *pre_existing);
+int DM_PRIV_FormDB_FromPath(char *path, dm_hash_t *hash, dm_instances_t *inst);
+int DM_PRIV_FormPath_FromDB(dm_hash_t hash, dm_instances_t *db_inst, char *buf, int len);
 dm_node_t *DM_PRIV_GetNodeFromPath(char *path, dm_instances_t *inst, bool *is_qualified_instance);
 dm_node_t *DM_PRIV_FindMatchingChild(dm_node_t *parent, char *name);
+dm_hash_t DM_PRIV_CalcDbHash(char *schema_path, int format);
 void DM_PRIV_AddUniqueKey(dm_node_t *node, dm_unique_key_t *unique_key);
 void DM_PRIV_ApplyPermissions(dm_node_t *node, ctrust_role_t role, unsigned short permission_bitmask);
 unsigned short DM_PRIV_GetPermissions(dm_node_t *node, combined_role_t *combined_role);
@@ -52,6 +52,10 @@
 #include "os_utils.h"
 #include "text_utils.h"
 #include "vendor_api.h"
+#include "sync_timer.h"
+#include "cli.h"
+#include "usp_probe.h"
+#include "uptime.h"
 
 //--------------------------------------------------------------------
 // Prepared SQL statements
@@ -60,6 +64,7 @@ typedef enum
     kSqlStmt_Get=0,
     kSqlStmt_Set,
     kSqlStmt_Del,
+    kSqlStmt_DelRange,
 
     kSqlStmt_Max            // Always last in the enumeration - used to size arrays
 } sql_stmt_t;
@@ -72,7 +77,8 @@ static char *prepared_stmt_sql[kSqlStmt_Max] =
 {
     "select value from data_model where hash = ?1 and instances = ?2;",           // kSqlStmt_Get
     "insert or replace into data_model(hash,instances,value) values(?1, ?2, ?3);", // kSqlStmt_Set
-    "delete from data_model where hash = ?1 and instances = ?2;"                  // kSqlStmt_Del
+    "delete from data_model where hash = ?1 and instances = ?2;",                 // kSqlStmt_Del
+    "delete from data_model where hash = ?1 and (instances = ?2 or substr(instances, 1, ?4) = ?3);" // kSqlStmt_DelRange
 };
 
 //--------------------------------------------------------------------
@@ -94,6 +100,123 @@ static bool schedule_factory_reset_init = false;
 // String, set by '-r' command line option to specify a text file containing the factory reset database parameters
 char *factory_reset_text_file = NULL;
 
+//--------------------------------------------------------------------
+// String, set by '-R' command line option to specify a prebuilt SQLite database to restore when the database is factory reset
+char *factory_reset_db_file = FACTORY_RESET_FILE;
+
+//--------------------------------------------------------------------
+// In-memory cache of the data_model table, keyed by (hash, instance numbers)
+// The whole table is loaded into the cache the first time that a parameter is read, after which reads never access SQLite
+// Writes are written through to SQLite and the cache. Whilst a transaction is active, the previous cached values are
+// kept in an undo log, so that the cache can be restored if the transaction is aborted
+typedef struct
+{
+    bool in_use;            // Set if this slot in the cache table is used
+    dm_hash_t hash;
+    int order;              // Number of instance numbers in instances[]
+    int instances[MAX_DM_INSTANCE_ORDER];
+    char *value;            // Value exactly as stored in the database (ie obfuscated, if the parameter is obfuscated)
+                            // In the undo log, NULL indicates that the parameter was not present in the database
+    int value_len;
+} db_cache_entry_t;
+
+#define MIN_DB_CACHE_TABLE_SIZE 256         // Must be a power of 2
+
+static db_cache_entry_t *db_cache_table = NULL;
+static int db_cache_table_size = 0;
+static int db_cache_count = 0;
+static bool is_db_cache_loaded = false;
+
+static db_cache_entry_t *db_cache_undo = NULL;
+static int num_db_cache_undo = 0;
+static int max_db_cache_undo = 0;
+static bool is_db_transaction_active = false;
+
+//--------------------------------------------------------------------
+// Set whilst parameters are being written which should only be held in memory (in the cache), and not written to SQLite
+// Used for data model objects which must not survive a reboot, and which are written too frequently to store in flash
+// NOTE: Deleting these parameters still issues SQLite deletes, but these do not modify the database file, as there are no rows to delete
+static bool is_volatile_writes = false;
+
+static unsigned db_cache_hits = 0;          // Number of reads satisfied with a value from the cache
+static unsigned db_cache_misses = 0;        // Number of reads of parameters not present in the database (answered by the cache)
+static unsigned db_cache_loads = 0;         // Number of times the cache has been loaded from SQLite
+
+//--------------------------------------------------------------------
+// Formats used to store the instance numbers of a parameter in the instances column of the data_model table
+// The format of the database is recorded in its user_version, so that it can be migrated when the selected format changes
+#define DB_INSTANCES_FORMAT_TEXT  0     // Text string of instance numbers separated by '.' (eg "1.3.7")
+#define DB_INSTANCES_FORMAT_BLOB  1     // Blob of 32 bit big endian integers (one per instance number)
+
+#ifdef DATABASE_INSTANCES_AS_BLOB
+static int db_instances_format = DB_INSTANCES_FORMAT_BLOB;
+#else
+static int db_instances_format = DB_INSTANCES_FORMAT_TEXT;
+#endif
+
+// Format of the hash column of the data_model table (see DM_PRIV_CalcDbHash)
+static int db_hash_format = DB_HASH_FORMAT;
+
+// The user_version of the database contains the format of the instances column in its least significant byte,
+// and the format of the hash column in the next byte. Databases written before the hash format was recorded have a
+// hash format of 0 (DB_HASH_FORMAT_32BIT)
+#define DB_VERSION(instances_format, hash_format)  ((instances_format) | ((hash_format) << 8))
+#define DB_VERSION_INSTANCES_FORMAT(version)  ((version) & 0xFF)
+#define DB_VERSION_HASH_FORMAT(version)  ((version) >> 8)
+
+//--------------------------------------------------------------------
+// State of commit coalescing (see DB_COMMIT_COALESCE_PERIOD)
+// When coalescing, an outer SQLite transaction is kept open for up to DB_COMMIT_COALESCE_PERIOD ms. DM transactions are
+// implemented as savepoints within it, and parameters set outside of a DM transaction are also written within it
+static bool is_coalesced_trans_open = false;
+static bool is_coalesce_timer_added = false;
+static unsigned num_coalesced_commits = 0;  // Number of DM transactions committed within the open outer transaction
+
+//--------------------------------------------------------------------
+// Parameter values set within a transaction, which have not been written to SQLite yet (see DB_BATCH_INSERT_ROWS)
+// These are written in bulk using multi-row insert statements, rather than one row at a time. The values are written to
+// the cache immediately, so the pending values are only written to SQLite before it is next accessed, or when the transaction commits
+static db_cache_entry_t *pending_sets = NULL;
+static int num_pending_sets = 0;
+static int max_pending_sets = 0;
+static sqlite3_stmt *batch_set_stmt = NULL;     // Prepared multi-row insert statement, created when first needed
+
+// Prepared multi-row insert statements used to write the values left over once all full multi-row insert statements have been written
+// tail_set_stmts[k] inserts 2^k rows (k>=1), so that the remaining values are written in at most log2(DB_BATCH_INSERT_ROWS) steps,
+// rather than one row at a time. The statements are created when first needed
+#define MAX_TAIL_SET_STMTS 8
+static sqlite3_stmt *tail_set_stmts[MAX_TAIL_SET_STMTS];
+
+//--------------------------------------------------------------------
+// Format of the binary snapshot written by DATABASE_ExportSnapshot(). All integers are big endian
+// Header: SNAPSHOT_MAGIC, 32 bit SNAPSHOT_FORMAT, 32 bit hash format (DB_HASH_FORMAT_XXX)
+// Each row: 8 bit number of instance numbers, 64 bit hash, 32 bit instance numbers, 32 bit length of value, value (as stored in the database)
+// Trailer: 8 bit SNAPSHOT_END_OF_ROWS, 32 bit number of rows
+#define SNAPSHOT_MAGIC          "OBUSPDB\x1A"
+#define SNAPSHOT_MAGIC_LEN      8
+#define SNAPSHOT_FORMAT         1
+#define SNAPSHOT_END_OF_ROWS    0xFF
+
+// Number of rows read from a snapshot before they are written to SQLite in bulk
+#define SNAPSHOT_IMPORT_ROWS    (16*DB_BATCH_INSERT_ROWS)
+
+//--------------------------------------------------------------------
+// Latency statistics collected by the storage benchmark (see DB_STARTUP_BENCHMARK_ROWS)
+typedef struct
+{
+    unsigned long long min;     // All latencies are in microseconds
+    unsigned long long max;
+    unsigned long long total;
+    int count;
+} db_latency_t;
+
+#if NUM_GET_WORKER_THREADS > 0
+//--------------------------------------------------------------------
+// Mutex serialising reads of the database by the Get worker threads
+// NOTE: Writes do not need to take this mutex, as the data model thread only modifies the database whilst no Get worker thread is active
+static pthread_mutex_t db_read_mutex;
+#endif
+
 //--------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int PrepareSQLStatements(void);
@@ -102,7 +225,53 @@ void ObfuscatedCopy(unsigned char *dest, unsigned char *src, int len);
 int CopyFactoryResetDatabase(char *reset_file, char *db_file);
 int ResetFactoryParameters(void);
 int ResetFactoryParametersFromFile(char *file);
+int GetParameterValueFromDb(char *path, dm_hash_t hash, dm_instances_t *inst, char *buf, int buflen, unsigned flags);
+int GetParameterValueFromDbAlloc(char *path, dm_hash_t hash, dm_instances_t *inst, char **value, unsigned flags);
 void LogSQLStatement(char *op, char *path, sqlite3_stmt *stmt);
+void CopyDbValue(char *buf, int buflen, const unsigned char *value, int value_len, unsigned flags);
+int LoadDbCache(void);
+void FreeDbCache(void);
+unsigned CalcDbCacheHash(dm_hash_t hash, dm_instances_t *inst);
+unsigned CalcDbCacheKeyHash(db_cache_entry_t *entry);
+bool IsSameDbKey(db_cache_entry_t *entry, dm_hash_t hash, dm_instances_t *inst);
+void SetDbKey(db_cache_entry_t *entry, dm_hash_t hash, dm_instances_t *inst);
+void GetDbKey(db_cache_entry_t *entry, dm_instances_t *inst);
+db_cache_entry_t *FindDbCacheEntry(dm_hash_t hash, dm_instances_t *inst);
+void InsertDbCacheEntry(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len);
+void RemoveDbCacheEntry(dm_hash_t hash, dm_instances_t *inst);
+void RemoveDbCacheRange(dm_hash_t *hashes, int num_hashes, dm_instances_t *inst);
+bool IsDbKeyWithinPrefix(db_cache_entry_t *entry, dm_instances_t *inst);
+void GrowDbCacheTable(void);
+void UpdateDbCache(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len);
+void AddDbCacheUndo(dm_hash_t hash, dm_instances_t *inst);
+void ApplyDbCacheUndo(void);
+void FreeDbCacheUndo(void);
+bool IsCommitCoalescingEnabled(void);
+int OpenCoalescedTransaction(void);
+void CoalescedCommitTimerExpired(int id);
+void AddPendingSet(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len);
+int FlushPendingSets(void);
+int PrepareMultiRowSetStmt(sqlite3_stmt **p_stmt, int num_rows);
+int WritePendingSets(sqlite3_stmt *stmt, db_cache_entry_t *rows, int num_rows);
+void FreePendingSets(void);
+int BindInstances(sqlite3_stmt *stmt, int index, int format, dm_instances_t *inst);
+int BindInstancePrefix(sqlite3_stmt *stmt, int index, int format, dm_instances_t *inst, int *prefix_len);
+int ReadInstancesColumn(sqlite3_stmt *stmt, int col, int format, dm_instances_t *inst);
+void FormInstanceString(dm_instances_t *inst, char *buf, int len);
+int ParseInstanceString(char *instances, dm_instances_t *inst);
+char *ParseInstanceInteger(char *p, int *p_value);
+int MigrateInstancesFormat(void);
+int MigrateHashFormat(void);
+dm_hash_mapping_t *FindDbHashMapping(dm_hash_mapping_t *mapping, int num_mappings, dm_hash_t old_hash);
+int GetDatabaseVersion(int *version);
+void WriteSnapshotInteger(FILE *fp, unsigned long long value, int num_bytes);
+int ReadSnapshotInteger(FILE *fp, int num_bytes, unsigned long long *value);
+int ApplyStorageProfile(void);
+int SetDatabasePragma(char *name, char *value);
+void GetDatabasePragma(char *name, char *buf, int len);
+void LogStorageProfile(void);
+void RunStorageBenchmark(int num_rows);
+void AddLatencySample(db_latency_t *stats, unsigned long long usecs);
 
 /*********************************************************************//**
 **
@@ -119,7 +288,7 @@ int DATABASE_Init(char *db_file)
 {
     int err;
     FILE *fp;
-    char *factory_reset_file = FACTORY_RESET_FILE;
+    char *factory_reset_file = factory_reset_db_file;
 
     // Keep a copy of the database filename, this will be needed when performing a controller initiated factory reset
     USP_STRNCPY(database_filename, db_file, sizeof(database_filename));
@@ -129,7 +298,7 @@ int DATABASE_Init(char *db_file)
     if (fp == NULL)
     {
         // Copy across the factory reset database (if specified)
-        if (factory_reset_file[0] != '\0')
+        if ((factory_reset_file != NULL) && (factory_reset_file[0] != '\0'))
         {
             USP_LOG_Info("%s: No database file exists at %s", __FUNCTION__, db_file);
             USP_LOG_Info("%s: Copying from factory reset database (%s)", __FUNCTION__, factory_reset_file);
@@ -148,6 +317,15 @@ int DATABASE_Init(char *db_file)
         fclose(fp);
     }
 
+#if NUM_GET_WORKER_THREADS > 0
+    // Exit if unable to create mutex serialising reads of the database by the Get worker threads
+    err = OS_UTILS_InitMutex(&db_read_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+#endif
+
     // Exit if unable to open the database    
     USP_LOG_Info("%s: Opening database %s", __FUNCTION__, db_file);
     err = OpenUspDatabase(db_file);
@@ -156,6 +334,16 @@ int DATABASE_Init(char *db_file)
         return err;
     }
 
+    // Report the storage profile, and how it performs on this platform (if required)
+    if (is_running_cli_local_command == false)
+    {
+        LogStorageProfile();
+        if (DB_STARTUP_BENCHMARK_ROWS > 0)
+        {
+            RunStorageBenchmark(DB_STARTUP_BENCHMARK_ROWS);
+        }
+    }
+
     return USP_ERR_OK;
 }
 
@@ -175,6 +363,14 @@ int DATABASE_Start(void)
 {
     int err;
 
+    // Exit if unable to convert the hashes stored in the database to the selected hash format
+    // NOTE: This cannot be performed when the database is opened, as it needs the fully registered data model schema
+    err = MigrateHashFormat();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
     // Initialise the database with it's factory reset parameters (if required)
     if (schedule_factory_reset_init)
     {
@@ -219,6 +415,12 @@ void DATABASE_Destroy(void)
     int err;
     int i;
 
+    // Ensure that all coalesced commits are written to the database file before closing it
+    DATABASE_Flush();
+
+    // Free the cached values, as they will be reloaded from the database, if it is reopened
+    FreeDbCache();
+
     // Iterate over the prepared SQL statements, finalizing them
     for (i=0; i<NUM_ELEM(prepared_stmts); i++)
     {
@@ -229,6 +431,18 @@ void DATABASE_Destroy(void)
         }
     }
 
+    // NOTE: Finalizing a NULL statement is harmless, if no multi-row insert statement was prepared
+    sqlite3_finalize(batch_set_stmt);
+    batch_set_stmt = NULL;
+    for (i=0; i<MAX_TAIL_SET_STMTS; i++)
+    {
+        sqlite3_finalize(tail_set_stmts[i]);
+        tail_set_stmts[i] = NULL;
+    }
+    FreePendingSets();
+    USP_SAFE_FREE(pending_sets);
+    max_pending_sets = 0;
+
     // Close the database
     err = sqlite3_close(db_handle);
     if (err != SQLITE_OK)
@@ -269,7 +483,8 @@ void DATABASE_PerformFactoryReset_ControllerInitiated(void)
     }
 
     // Copy across the factory reset database (which has reboot cause set to "LocalFactoryReset")
-    CopyFactoryResetDatabase(FACTORY_RESET_FILE, db_file);
+    // NOTE: The database file is atomically replaced by the factory reset database
+    CopyFactoryResetDatabase(factory_reset_db_file, db_file);
 
     // Exit if unable to open the database    
     err = OpenUspDatabase(db_file);
@@ -347,8 +562,8 @@ int PrepareSQLStatements(void)
 **
 ** \param   path - data model path to parameter to get (only used for debug)
 ** \param   hash - hash identifying the data model parameter to get
-** \param   instances - string identifying which instance of the data model parameter to get
-**                      If the object is a single instance object, then this parameter should point to an empty string
+** \param   inst - pointer to instance numbers identifying which instance of the data model parameter to get
+**                 If the object is a single instance object, then the order of the instances structure is 0
 ** \param   buf - pointer to buffer in which to return the value
 ** \param   buflen - length of buffer in which to return the value
 ** \param   flags - flags controlling getting the value (eg OBFUSCATED_VALUE)
@@ -358,7 +573,147 @@ int PrepareSQLStatements(void)
 **          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-int DATABASE_GetParameterValue(char *path, dm_hash_t hash, char *instances, char *buf, int buflen, unsigned flags)
+int DATABASE_GetParameterValue(char *path, dm_hash_t hash, dm_instances_t *inst, char *buf, int buflen, unsigned flags)
+{
+    int err;
+
+    // Exit if this function is not being called from the data model thread
+    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+#if NUM_GET_WORKER_THREADS > 0
+    OS_UTILS_LockMutex(&db_read_mutex);
+    err = GetParameterValueFromDb(path, hash, inst, buf, buflen, flags);
+    OS_UTILS_UnlockMutex(&db_read_mutex);
+#else
+    err = GetParameterValueFromDb(path, hash, inst, buf, buflen, flags);
+#endif
+
+    USP_PROBE2(db_get, path, err);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_GetParameterValueAlloc
+**
+** Gets the value of the specified parameter, returning it in a dynamically allocated string
+** This avoids the caller having to copy the value from a buffer, if it is going to keep the value
+**
+** \param   path - data model path to parameter to get (only used for debug)
+** \param   hash - hash identifying the data model parameter to get
+** \param   inst - pointer to instance numbers identifying which instance of the data model parameter to get
+**                 If the object is a single instance object, then the order of the instances structure is 0
+** \param   value - pointer to variable in which to return a pointer to the dynamically allocated value
+**                  NOTE: Ownership of the string passes to the caller. This is only set if successful
+** \param   flags - flags controlling getting the value (eg OBFUSCATED_VALUE)
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_OBJECT_DOES_NOT_EXIST if no entry in the database
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int DATABASE_GetParameterValueAlloc(char *path, dm_hash_t hash, dm_instances_t *inst, char **value, unsigned flags)
+{
+    int err;
+
+    // Exit if this function is not being called from the data model thread
+    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+#if NUM_GET_WORKER_THREADS > 0
+    OS_UTILS_LockMutex(&db_read_mutex);
+    err = GetParameterValueFromDbAlloc(path, hash, inst, value, flags);
+    OS_UTILS_UnlockMutex(&db_read_mutex);
+#else
+    err = GetParameterValueFromDbAlloc(path, hash, inst, value, flags);
+#endif
+
+    USP_PROBE2(db_get, path, err);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** GetParameterValueFromDbAlloc
+**
+** Gets the value of a parameter from the database cache (or from SQLite, if the cache could not be loaded),
+** returning it in a dynamically allocated string
+** NOTE: Values are truncated to the same length as when they are read into a buffer of MAX_DM_VALUE_LEN
+**
+** \param   path - path of the parameter (used only for debug)
+** \param   hash - hash of the data model path of the parameter
+** \param   inst - pointer to instance structure locating the parameter in the data model
+** \param   value - pointer to variable in which to return a pointer to the dynamically allocated value
+** \param   flags - flags controlling getting the value (eg OBFUSCATED_VALUE)
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_OBJECT_DOES_NOT_EXIST if no entry in the database
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int GetParameterValueFromDbAlloc(char *path, dm_hash_t hash, dm_instances_t *inst, char **value, unsigned flags)
+{
+    db_cache_entry_t *entry;
+    char *buf;
+    int len;
+    int err;
+
+    // Exit if the cache could not be loaded, reading the value from SQLite instead
+    err = LoadDbCache();
+    if (err != USP_ERR_OK)
+    {
+        buf = USP_MALLOC(MAX_DM_VALUE_LEN);
+        err = GetParameterValueFromDb(path, hash, inst, buf, MAX_DM_VALUE_LEN, flags);
+        if (err != USP_ERR_OK)
+        {
+            USP_FREE(buf);
+            return err;
+        }
+
+        *value = USP_REALLOC(buf, strlen(buf)+1);
+        return USP_ERR_OK;
+    }
+
+    // Exit if no entry exists (yet) in the database. The data model will use the registered default value.
+    entry = FindDbCacheEntry(hash, inst);
+    if (entry == NULL)
+    {
+        db_cache_misses++;
+        return USP_ERR_OBJECT_DOES_NOT_EXIST;
+    }
+
+    // Copy the value directly from the cache into an exactly sized string
+    db_cache_hits++;
+    len = MIN(entry->value_len, MAX_DM_VALUE_LEN-1);
+    *value = USP_MALLOC(len+1);
+    CopyDbValue(*value, len+1, (unsigned char *)entry->value, entry->value_len, flags);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** GetParameterValueFromDb
+**
+** Gets the value of a parameter from the database cache (or from SQLite, if the cache could not be loaded)
+**
+** \param   path - path of the parameter (used only for debug)
+** \param   hash - hash of the data model path of the parameter
+** \param   inst - pointer to instance structure locating the parameter in the data model
+** \param   buf - pointer to buffer in which to return the value
+** \param   buflen - length of return buffer
+** \param   flags - flags controlling getting the value (eg OBFUSCATED_VALUE)
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_OBJECT_DOES_NOT_EXIST if no entry in the database
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int GetParameterValueFromDb(char *path, dm_hash_t hash, dm_instances_t *inst, char *buf, int buflen, unsigned flags)
 {
     sqlite3_stmt *stmt;
     int value_len;
@@ -366,12 +721,26 @@ int DATABASE_GetParameterValue(char *path, dm_hash_t hash, char *instances, char
     int err;
     int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
 
-    // Exit if this function is not being called from the data model thread
-    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    db_cache_entry_t *entry;
+
+    // Exit if the value was read from the cache
+    err = LoadDbCache();
+    if (err == USP_ERR_OK)
     {
-        return USP_ERR_INTERNAL_ERROR;
+        entry = FindDbCacheEntry(hash, inst);
+        if (entry == NULL)
+        {
+            // No entry exists (yet) in the database. The data model will use the registered default value.
+            db_cache_misses++;
+            return USP_ERR_OBJECT_DOES_NOT_EXIST;
+        }
+
+        db_cache_hits++;
+        CopyDbValue(buf, buflen, (unsigned char *)entry->value, entry->value_len, flags);
+        return USP_ERR_OK;
     }
 
+    // If the code gets here, the cache could not be loaded, so fallback to reading the value from SQLite
     // Decide which prepared statement to use
     stmt = prepared_stmts[kSqlStmt_Get];
 
@@ -385,10 +754,9 @@ int DATABASE_GetParameterValue(char *path, dm_hash_t hash, char *instances, char
     }
 
     // Exit if unable to set the instance numbers for the parameter
-    err = sqlite3_bind_text(stmt, 2, instances, SQLITE_ZERO_TERMINATED, SQLITE_STATIC);
-    if (err != SQLITE_OK)
+    err = BindInstances(stmt, 2, db_instances_format, inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_text");
         result = USP_ERR_INTERNAL_ERROR;
         goto exit;
     }
@@ -412,32 +780,10 @@ int DATABASE_GetParameterValue(char *path, dm_hash_t hash, char *instances, char
         goto exit;
     }
 
-    // Determine the length of the value string to copy into the return buffer, truncating it, if it is too long    
-    value_len = sqlite3_column_bytes(stmt, 0);
-    value_len = MIN(value_len, buflen-1);
-
-    // Get a pointer to the data
-    value = sqlite3_column_text(stmt, 0);
-
     // Copy the value into the return buffer
-    if ((value != NULL) && (value_len >0))
-    {
-        if (flags & OBFUSCATED_VALUE)
-        {
-            // Unobfuscate value
-            ObfuscatedCopy((unsigned char *)buf, (unsigned char *)value, value_len);
-        }
-        else
-        {
-            // Normal case: value is not obfuscated (or we don't want to return an unobfuscated value)
-            memcpy(buf, value, value_len);
-        }
-        buf[value_len] = '\0'; // Ensure return buffer is always zero terminated
-    }
-    else
-    {
-        *buf = '\0';        // Case of value set to NULL in DB
-    }
+    value = sqlite3_column_text(stmt, 0);
+    value_len = sqlite3_column_bytes(stmt, 0);
+    CopyDbValue(buf, buflen, value, value_len, flags);
 
     // If the code gets here, then the parameter has been successfully retrieved from the database
     result = USP_ERR_OK;
@@ -461,8 +807,8 @@ exit:
 **
 ** \param   path - data model path to parameter to set (only used for debug)
 ** \param   hash - hash identifying the data model parameter to set
-** \param   instances - string identifying which instance of the data model parameter to set.
-**                      If the object is a single instance object, then this parameter should point to an empty string
+** \param   inst - pointer to instance numbers identifying which instance of the data model parameter to set
+**                 If the object is a single instance object, then the order of the instances structure is 0
 ** \param   new_value - pointer to buffer containing the value to set
 ** \param   flags - flags controlling setting the value (eg OBFUSCATED_VALUE)
 **
@@ -470,7 +816,7 @@ exit:
 **          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char *new_value, unsigned flags)
+int DATABASE_SetParameterValue(char *path, dm_hash_t hash, dm_instances_t *inst, char *new_value, unsigned flags)
 {
     sqlite3_stmt *stmt;
     int err;
@@ -497,6 +843,32 @@ int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char
         value_to_bind = new_value;
     }
 
+    // Exit if the value should only be held in memory, storing it in the cache but not in SQLite
+    // NOTE: The cache must be loaded first, otherwise the value would be lost
+    if (is_volatile_writes)
+    {
+        err = LoadDbCache();
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+
+        UpdateDbCache(hash, inst, value_to_bind, len);
+        USP_PROBE3(db_set, path, value_to_bind, USP_ERR_OK);
+        return USP_ERR_OK;
+    }
+
+#if DB_BATCH_INSERT_ROWS > 1
+    // If a transaction is active, then defer writing the value to SQLite, so that it can be written in bulk with other values
+    if (is_db_transaction_active)
+    {
+        AddPendingSet(hash, inst, value_to_bind, len);
+        UpdateDbCache(hash, inst, value_to_bind, len);
+        USP_PROBE3(db_set, path, value_to_bind, USP_ERR_OK);
+        return USP_ERR_OK;
+    }
+#endif
+
     // Exit if unable to set the value of the hash in the prepared statement
     stmt = prepared_stmts[kSqlStmt_Set];
     err = sqlite3_bind_int64(stmt, 1, hash);
@@ -507,10 +879,9 @@ int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char
     }
 
     // Exit if unable to set the value of the instances in the prepared statement
-    err = sqlite3_bind_text(stmt, 2, instances, SQLITE_ZERO_TERMINATED, SQLITE_STATIC);
-    if (err != SQLITE_OK)
+    err = BindInstances(stmt, 2, db_instances_format, inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_text");
         goto exit;
     }
 
@@ -524,6 +895,13 @@ int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char
 
     //LogSQLStatement("SET", path, stmt);
 
+    // Exit if unable to add this write to the coalesced transaction (if not part of a DM transaction)
+    err = OpenCoalescedTransaction();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // Exit if unable to perform the set
     err = sqlite3_step(stmt);
     if (err != SQLITE_DONE)     // We are not expecting any rows
@@ -533,6 +911,7 @@ int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char
     }
 
     // If the code gets here, then the parameter has been successfully set in the database
+    UpdateDbCache(hash, inst, value_to_bind, len);
     result = USP_ERR_OK;
 
 exit:
@@ -542,7 +921,8 @@ exit:
     {
         USP_ERR_SQL_PARAM(db_handle, "sqlite3_reset");
     }
-    
+
+    USP_PROBE3(db_set, path, value_to_bind, result);
     return result;
 }
 
@@ -554,14 +934,14 @@ exit:
 **
 ** \param   path - data model path to parameter to delete (only used for debug)
 ** \param   hash - hash identifying the data model parameter to delete
-** \param   instances - string identifying which instance of the data model parameter to delete.
-**                      If the object is a single instance object, then this parameter should point to an empty string
+** \param   inst - pointer to instance numbers identifying which instance of the data model parameter to delete
+**                 If the object is a single instance object, then the order of the instances structure is 0
 **
 ** \return  USP_ERR_OK if successful
 **          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-int DATABASE_DeleteParameter(char *path, dm_hash_t hash, char *instances)
+int DATABASE_DeleteParameter(char *path, dm_hash_t hash, dm_instances_t *inst)
 {
     sqlite3_stmt *stmt;
     int err;
@@ -573,6 +953,13 @@ int DATABASE_DeleteParameter(char *path, dm_hash_t hash, char *instances)
         return USP_ERR_INTERNAL_ERROR;
     }
 
+    // Exit if unable to write any pending values to SQLite first, as they may include this parameter
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
     stmt = prepared_stmts[kSqlStmt_Del];
 
     // Exit if unable to set the value of the hash in the prepared statement
@@ -584,15 +971,21 @@ int DATABASE_DeleteParameter(char *path, dm_hash_t hash, char *instances)
     }
 
     // Exit if unable to set the value of the instances in the prepared statement
-    err = sqlite3_bind_text(stmt, 2, instances, SQLITE_ZERO_TERMINATED, SQLITE_STATIC);
-    if (err != SQLITE_OK)
+    err = BindInstances(stmt, 2, db_instances_format, inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_text");
         goto exit;
     }
 
     //LogSQLStatement("DEL", path, stmt);
 
+    // Exit if unable to add this delete to the coalesced transaction (if not part of a DM transaction)
+    err = OpenCoalescedTransaction();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // Exit if unable to perform the delete
     // NOTE: If the parameter is not present in the DB, then SQLite still returns OK
     err = sqlite3_step(stmt);
@@ -603,6 +996,11 @@ int DATABASE_DeleteParameter(char *path, dm_hash_t hash, char *instances)
     }
 
     // If the code gets here, then the parameter has been successfully deleted from the database
+    if (is_db_cache_loaded)
+    {
+        AddDbCacheUndo(hash, inst);
+        RemoveDbCacheEntry(hash, inst);
+    }
     result = USP_ERR_OK;
 
 exit:
@@ -618,65 +1016,232 @@ exit:
 
 /*********************************************************************//**
 **
-** DATABASE_StartTransaction
+** DATABASE_DeleteInstanceParams
 **
-** Starts a transaction for subsequent set parameter values
+** Deletes all database parameters (from the specified set) belonging to the specified object instance and its child instances
+** This is used when deleting whole object instances, as it issues only one delete statement per parameter in the set,
+** regardless of how many child object instances are being deleted
 **
-** \param   None
+** \param   path - path of the object instance being deleted (used for debug only)
+** \param   hashes - array of hashes identifying the data model parameters to delete
+** \param   num_hashes - number of hashes in the array
+** \param   inst - pointer to instance numbers prefixing the instances of the parameters to delete
+**                 NOTE: If the order of the instances structure is 0, then all instances of the parameters are deleted
 **
 ** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-int DATABASE_StartTransaction(void)
+int DATABASE_DeleteInstanceParams(char *path, dm_hash_t *hashes, int num_hashes, dm_instances_t *inst)
 {
+    sqlite3_stmt *stmt;
     int err;
-    
+    int i;
+    int prefix_len;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+
     // Exit if this function is not being called from the data model thread
     if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
     {
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
-    if (err != SQLITE_OK)
+    // Exit if there are no parameters to delete
+    if (num_hashes == 0)
     {
-        USP_ERR_SQL(db_handle,"sqlite3_exec");
-        return USP_ERR_INTERNAL_ERROR;
+        return USP_ERR_OK;
     }
 
-    return USP_ERR_OK;
-}
-
-/*********************************************************************//**
-**
-** DATABASE_CommitTransaction
-**
-** Commits the current set parameter values transaction
-**
-** \param   None
-**
-** \return  USP_ERR_OK if successful
-**
-**************************************************************************/
-int DATABASE_CommitTransaction(void)
-{
-    int err;
-    
-    // Exit if this function is not being called from the data model thread
-    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    // Exit if unable to write any pending values to SQLite first, as they may include these parameters
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
     {
-        return USP_ERR_INTERNAL_ERROR;
+        return err;
     }
 
-    err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
-    if (err != SQLITE_OK)
+    stmt = prepared_stmts[kSqlStmt_DelRange];
+
+    // Exit if unable to set the value of the instances in the prepared statement
+    // NOTE: The instances remain bound for all hashes in the set
+    err = BindInstances(stmt, 2, db_instances_format, inst);
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SQL(db_handle,"sqlite3_exec");
-        return USP_ERR_INTERNAL_ERROR;
+        goto exit;
     }
 
-    return USP_ERR_OK;
-}
+    // Exit if unable to set the prefix of the instances of child objects in the prepared statement
+    err = BindInstancePrefix(stmt, 3, db_instances_format, inst, &prefix_len);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    err = sqlite3_bind_int(stmt, 4, prefix_len);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_int");
+        goto exit;
+    }
+
+    // Exit if unable to add this delete to the coalesced transaction (if not part of a DM transaction)
+    err = OpenCoalescedTransaction();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Iterate over all parameters, deleting all of their instances within the prefix
+    for (i=0; i < num_hashes; i++)
+    {
+        // Exit if unable to set the value of the hash in the prepared statement
+        err = sqlite3_bind_int64(stmt, 1, hashes[i]);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_int");
+            goto exit;
+        }
+
+        //LogSQLStatement("DEL", path, stmt);
+
+        // Exit if unable to perform the delete
+        // NOTE: If none of the parameter's instances are present in the DB, then SQLite still returns OK
+        err = sqlite3_step(stmt);
+        if (err != SQLITE_DONE)     // We are not expecting any rows
+        {
+            USP_ERR_SQL_PARAM(db_handle, "sqlite3_step");
+            goto exit;
+        }
+
+        // Exit if unable to reset the statement in preparation for the next hash
+        // NOTE: Resetting the statement does not clear the bound instances
+        err = sqlite3_reset(stmt);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL_PARAM(db_handle, "sqlite3_reset");
+            goto exit;
+        }
+    }
+
+    // If the code gets here, then the parameters have been successfully deleted from the database
+    if (is_db_cache_loaded)
+    {
+        RemoveDbCacheRange(hashes, num_hashes, inst);
+    }
+    result = USP_ERR_OK;
+
+exit:
+    // Always reset the statement in preparation for next time, even if an error occurred
+    err = sqlite3_reset(stmt);
+    if ((err != SQLITE_OK) && (result == USP_ERR_OK))
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_reset");
+    }
+
+    return result;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_StartTransaction
+**
+** Starts a transaction for subsequent set parameter values
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATABASE_StartTransaction(void)
+{
+    int err;
+    
+    // Exit if this function is not being called from the data model thread
+    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    if (IsCommitCoalescingEnabled())
+    {
+        // Exit if unable to start the outer transaction that this transaction is coalesced into
+        err = OpenCoalescedTransaction();
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+
+        // Exit if unable to start a savepoint within the outer transaction
+        err = sqlite3_exec(db_handle, "savepoint dm_trans;", NULL, NULL, NULL);
+    }
+    else
+    {
+        err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
+    }
+
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Start recording the previous cached values of all parameters modified during the transaction
+    FreeDbCacheUndo();
+    is_db_transaction_active = true;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_CommitTransaction
+**
+** Commits the current set parameter values transaction
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATABASE_CommitTransaction(void)
+{
+    int err;
+    
+    // Exit if this function is not being called from the data model thread
+    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to write the values set during the transaction to SQLite
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // If coalescing, the transaction is only committed to the database file when the outer transaction is flushed
+    if (is_coalesced_trans_open)
+    {
+        err = sqlite3_exec(db_handle, "release savepoint dm_trans;", NULL, NULL, NULL);
+        num_coalesced_commits++;
+    }
+    else
+    {
+        err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
+    }
+
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // The cache now matches the committed database, so the previous values are no longer needed
+    FreeDbCacheUndo();
+    is_db_transaction_active = false;
+
+    return USP_ERR_OK;
+}
 
 /*********************************************************************//**
 **
@@ -697,19 +1262,110 @@ int DATABASE_AbortTransaction(void)
         return USP_ERR_INTERNAL_ERROR;
     }
 
+    // Values set during the transaction which have not been written to SQLite yet, do not need to be written
+    FreePendingSets();
+
     // Intentionally ignoring errors because if the database has already been rolled back because of an error
     // whilst writing the transactions, then an error will be returned here
-    sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+    if (is_coalesced_trans_open)
+    {
+        // Only rollback the changes made since the start of this transaction, keeping those of previous coalesced transactions
+        sqlite3_exec(db_handle, "rollback to savepoint dm_trans;", NULL, NULL, NULL);
+        sqlite3_exec(db_handle, "release savepoint dm_trans;", NULL, NULL, NULL);
+    }
+    else
+    {
+        sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+    }
+
+    // Restore the cache to the values that it had before the transaction started
+    ApplyDbCacheUndo();
+    is_db_transaction_active = false;
+
+    // If SQLite rolled back the whole outer transaction (because of an error), then the changes of previous
+    // coalesced transactions have also been lost, so the cache must be reloaded from the database
+    if ((is_coalesced_trans_open) && (sqlite3_get_autocommit(db_handle) != 0))
+    {
+        USP_LOG_Error("%s: Lost %u coalesced database commits, due to an error", __FUNCTION__, num_coalesced_commits);
+        is_coalesced_trans_open = false;
+        num_coalesced_commits = 0;
+        FreeDbCache();
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_Flush
+**
+** Durability barrier: Commits all coalesced commits to the database file
+** This is called before the agent stops, reboots or factory resets
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATABASE_Flush(void)
+{
+    int err;
+
+    // Write any values set in a still active DM transaction to SQLite. This only occurs if the agent is stopping
+    FlushPendingSets();
+
+    // Exit if there are no coalesced commits to flush
+    if (is_coalesced_trans_open == false)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Stop the timer which would otherwise flush the commits
+    if (is_coalesce_timer_added)
+    {
+        SYNC_TIMER_Reload(CoalescedCommitTimerExpired, 0, END_OF_TIME);
+    }
+
+    // NOTE: If a DM transaction is still active, then it is committed too. This only occurs if the agent is stopping
+    is_coalesced_trans_open = false;
+    num_coalesced_commits = 0;
+    err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+        FreeDbCache();
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** DATABASE_SetVolatileWrites
+**
+** Sets whether subsequent parameter sets are only held in memory (in the cache), rather than being written to SQLite
+** Parameters written whilst this is enabled do not survive a restart of the agent
+**
+** \param   enable - set to hold subsequently set parameters only in memory, clear to write them to SQLite again
+**
+** \return  None
+**
+**************************************************************************/
+void DATABASE_SetVolatileWrites(bool enable)
+{
+    is_volatile_writes = enable;
+}
+
 /*********************************************************************//**
 **
 ** DATABASE_ReadDataModelInstanceNumbers
 **
 ** Reads the instance numbers of all objects in the database, and adds them to the data model
 ** This function also removes all unknown (not in schema) parameters from the database
+** NOTE: The database is read in a single scan, collecting all object instances, which are then
+**       added to the data model in bulk (rather than one at a time, which is slow for large databases)
 **
 ** \param   remove_unknown_params - set to true if unknown parameters should be cleaned from the database
 **
@@ -723,11 +1379,22 @@ int DATABASE_ReadDataModelInstanceNumbers(bool remove_unknown_params)
     int sql_err;
     int err;
     int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
-    char *instances;
+    dm_instances_t db_inst;
     dm_hash_t hash;
+    sqlite3_int64 rowid;
+    char sql[64];
+    dm_instances_t *insts = NULL;
+    int num_insts = 0;
+    int max_insts = 0;
+    int num_rows = 0;
+    long long start_time;
+    long long scan_time;
 
     // Exit if unable to prepare the SQL statement
-    #define SELECT_ALL_INST_STR   "select hash,instances from data_model;"
+    // NOTE: Ordering by hash allows SQLite to read the rows from the (hash, instances) primary key index,
+    //       which covers all of the columns selected, without having to read the parameter values
+    #define SELECT_ALL_INST_STR   "select hash,instances,rowid from data_model order by hash;"
+    start_time = SYNC_TIMER_TimeMs();
     sql_err = sqlite3_prepare_v2(db_handle, SELECT_ALL_INST_STR, SQLITE_ZERO_TERMINATED, &stmt, NULL);
     if (sql_err != SQLITE_OK)
     {
@@ -753,21 +1420,50 @@ int DATABASE_ReadDataModelInstanceNumbers(bool remove_unknown_params)
             result = USP_ERR_INTERNAL_ERROR;
             break;
         }
+        num_rows++;
+
+        // Determine the hash and the instance numbers of the parameter in the database
+        hash = sqlite3_column_int64(stmt, 0);
+        err = ReadInstancesColumn(stmt, 1, db_instances_format, &db_inst);
+        if (err != USP_ERR_OK)
+        {
+            // Remove this parameter from the database, as its instance numbers are invalid (so it cannot be deleted by key)
+            if (remove_unknown_params)
+            {
+                rowid = sqlite3_column_int64(stmt, 2);
+                USP_LOG_Warning("Removing parameter with invalid instance numbers (hash=%lld) from the database", (long long)hash);
+                USP_SNPRINTF(sql, sizeof(sql), "delete from data_model where rowid=%lld;", (long long)rowid);
+                sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+            }
+            continue;
+        }
 
-        // Determine the hash and the instances string of the parameter in the database
-        hash = sqlite3_column_int(stmt, 0);
-        instances = (char *)sqlite3_column_text(stmt, 1);
-        instances = (instances == NULL) ? "" : instances;   // Ensure that instances variable points to a string
+        // Increase the size of the array of collected instances, if there is no space left in it
+        if (num_insts == max_insts)
+        {
+            max_insts = (max_insts == 0) ? 256 : 2*max_insts;
+            insts = USP_REALLOC(insts, max_insts*sizeof(dm_instances_t));
+        }
 
-        // Add the object instances (if this parameter has any instances) to the data model
-        // NOTE: DATA_MODEL_AddParameterInstances() is called even if we know that the object has no instances,
+        // Form the object instances (if this parameter has any instances) to add to the data model
+        // NOTE: DATA_MODEL_ResolveParameterInstances() is called even if we know that the object has no instances,
         //       as we use the return code to delete the parameter if it does not exist in the schema
-        err = DATA_MODEL_AddParameterInstances(hash, instances);
-        if ((err != USP_ERR_OK) && (remove_unknown_params))
+        err = DATA_MODEL_ResolveParameterInstances(hash, &db_inst, &insts[num_insts]);
+        if (err != USP_ERR_OK)
+        {
+            if (remove_unknown_params)
+            {
+                // Remove this parameter from the database. It is no longer in the data model schema.
+                USP_LOG_Warning("Removing unknown parameter (hash=%lld, order=%d) from the database", (long long)hash, db_inst.order);
+                DATABASE_DeleteParameter("Unknown", hash, &db_inst);
+            }
+            continue;
+        }
+
+        // Only keep the object instances, if this parameter has any
+        if (insts[num_insts].order > 0)
         {
-            // Remove this parameter from the database. It is no longer in the data model schema.
-            USP_LOG_Warning("Removing unknown parameter (hash=%d, instances='%s') from the database", hash, instances);
-            DATABASE_DeleteParameter("Unknown", hash, instances);
+            num_insts++;
         }
     }
 
@@ -778,7 +1474,17 @@ int DATABASE_ReadDataModelInstanceNumbers(bool remove_unknown_params)
         USP_ERR_SQL(db_handle,"sqlite3_finalize");
         result = USP_ERR_INTERNAL_ERROR;
     }
-    
+
+    // Add all object instances read from the database to the data model in one go
+    scan_time = SYNC_TIMER_TimeMs();
+    if (result == USP_ERR_OK)
+    {
+        DM_INST_VECTOR_AddBulk(insts, num_insts);
+        USP_LOG_Info("%s: Read %d rows in %lld ms, added instances in %lld ms", __FUNCTION__, num_rows, scan_time - start_time, SYNC_TIMER_TimeMs() - scan_time);
+    }
+
+    USP_SAFE_FREE(insts);
+
     return result;
 }
 
@@ -799,7 +1505,7 @@ void DATABASE_Dump(void)
     int err;
     int result;
     char path[MAX_DM_PATH];
-    char *instances;
+    dm_instances_t inst;
     char *value;
     dm_hash_t hash;
 
@@ -830,11 +1536,14 @@ void DATABASE_Dump(void)
         }
 
         // Print out this parameter and its value
-        hash = sqlite3_column_int(stmt, 0);
-        instances = (char *)sqlite3_column_text(stmt, 1);
+        hash = sqlite3_column_int64(stmt, 0);
         value = (char *)sqlite3_column_text(stmt, 2);
-        
-        result = DM_PRIV_FormPath_FromDB(hash, instances, path, sizeof(path));
+        result = ReadInstancesColumn(stmt, 1, db_instances_format, &inst);
+        if (result == USP_ERR_OK)
+        {
+            result = DM_PRIV_FormPath_FromDB(hash, &inst, path, sizeof(path));
+        }
+
         if (result == USP_ERR_OK)
         {
             USP_DUMP("%s => %s", path, value);
@@ -851,319 +1560,2858 @@ void DATABASE_Dump(void)
 
 /*********************************************************************//**
 **
-** OpenUspDatabase
+** DATABASE_DumpCache
 **
-** Opens the USP database, ensures the table is created in it and the SQL statements prepared
+** Logs the statistics of the in-memory cache of the database
 **
-** \param   db_file - path to file to use for the database
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DATABASE_DumpCache(void)
+{
+    USP_DUMP("Database cache: %s", (is_db_cache_loaded) ? "loaded" : "not loaded");
+    USP_DUMP("Entries: %d (table size=%d)", db_cache_count, db_cache_table_size);
+    USP_DUMP("Hits: %u", db_cache_hits);
+    USP_DUMP("Misses (not in database): %u", db_cache_misses);
+    USP_DUMP("Loads from SQLite: %u", db_cache_loads);
+}
+
+/*********************************************************************//**
+**
+** DATABASE_ExportSnapshot
+**
+** Writes a binary snapshot of the contents of the database to the specified file (eg for backup)
+** The rows are written exactly as they are stored (ie with the hash of the parameter, and obfuscated values still obfuscated),
+** so that no data model paths need to be formed. See SNAPSHOT_XXX for the format of the file
+** NOTE: The snapshot is written to a temporary file, which is renamed once complete, so that an existing file is not left partially overwritten
+**
+** \param   file - name of file to write the snapshot to
+** \param   num_rows - pointer to variable in which to return the number of rows written, or NULL if this is not required
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int OpenUspDatabase(char *db_file)
+int DATABASE_ExportSnapshot(char *file, int *num_rows)
 {
+    sqlite3_stmt *stmt = NULL;
+    FILE *fp = NULL;
     int err;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    char tmp_file[256];
+    char buf[128];
+    dm_instances_t inst;
+    const unsigned char *value;
+    int value_len;
+    int count = 0;
+    int i;
 
-    // Exit if unable to open the database
-    err = sqlite3_open(db_file, &db_handle);
-    if (err != SQLITE_OK)
+    // Exit if unable to write any pending values to SQLite first, as the snapshot is read from SQLite
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
     {
-        USP_ERR_SQL(db_handle,"sqlite3_open");
-        return USP_ERR_INTERNAL_ERROR;
+        return err;
     }
 
-    // Exit if unable to create the data model parameter table (if it does not already exist)
-    #define CREATE_TABLE_STR "create table if not exists data_model (hash integer, instances text, value text, primary key (hash, instances));"
-    err = sqlite3_exec(db_handle, CREATE_TABLE_STR, NULL, NULL, NULL);
+    // Exit if unable to prepare the SQL statement
+    #define SELECT_ALL_SNAPSHOT_STR   "select hash,instances,value from data_model;"
+    err = sqlite3_prepare_v2(db_handle, SELECT_ALL_SNAPSHOT_STR, SQLITE_ZERO_TERMINATED, &stmt, NULL);
     if (err != SQLITE_OK)
     {
-        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Exit if unable to prepare all SQL statements to be used
-    err = PrepareSQLStatements();
-    if (err != USP_ERR_OK)
+    // Exit if unable to open the temporary file to write the snapshot to
+    USP_SNPRINTF(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+    fp = fopen(tmp_file, "w");
+    if (fp == NULL)
     {
-        return USP_ERR_INTERNAL_ERROR;
+        USP_ERR_SetMessage("%s: Failed to open %s for writing: %s", __FUNCTION__, tmp_file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        goto exit;
     }
 
-    return USP_ERR_OK;
-}
+    // Write the header
+    fwrite(SNAPSHOT_MAGIC, 1, SNAPSHOT_MAGIC_LEN, fp);
+    WriteSnapshotInteger(fp, SNAPSHOT_FORMAT, 4);
+    WriteSnapshotInteger(fp, db_hash_format, 4);
 
-/*********************************************************************//**
-**
-** CopyFactoryResetDatabase
-**
-** Performs a factory reset of the database, by copying a factory reset database file
-** NOTE: The factory reset database will have been generated with the reboot cause set to "LocalFactoryReset"
-** NOTE: This function must only be called when the database is not open
-**
-** \param   reset_file - filename of the file containing the SQLite factory reset database
-**                       NOTE: This maybe an empty string or NULL if factory reset is not implemented by a static file
+    // Iterate over all rows, writing them to the file
+    while (1)
+    {
+        err = sqlite3_step(stmt);
+        if (err == SQLITE_DONE)
+        {
+            // Exit loop if we have processed all rows
+            break;
+        }
+        else if (err != SQLITE_ROW)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
+            goto exit;
+        }
+
+        // Skip rows with invalid instance numbers. These are removed by DATABASE_ReadDataModelInstanceNumbers()
+        if (ReadInstancesColumn(stmt, 1, db_instances_format, &inst) != USP_ERR_OK)
+        {
+            continue;
+        }
+
+        value = sqlite3_column_text(stmt, 2);
+        value_len = sqlite3_column_bytes(stmt, 2);
+        WriteSnapshotInteger(fp, inst.order, 1);
+        WriteSnapshotInteger(fp, (unsigned long long)sqlite3_column_int64(stmt, 0), 8);
+        for (i=0; i < inst.order; i++)
+        {
+            WriteSnapshotInteger(fp, (unsigned)inst.instances[i], 4);
+        }
+        WriteSnapshotInteger(fp, value_len, 4);
+        if (value_len > 0)
+        {
+            fwrite(value, 1, value_len, fp);
+        }
+        count++;
+    }
+
+    // Write the trailer, which allows a truncated snapshot to be detected when it is imported
+    WriteSnapshotInteger(fp, SNAPSHOT_END_OF_ROWS, 1);
+    WriteSnapshotInteger(fp, count, 4);
+
+    // Exit if an error occurred whilst writing the file
+    if ((ferror(fp) != 0) || (fclose(fp) != 0))
+    {
+        fp = NULL;
+        USP_ERR_SetMessage("%s: Failed to write snapshot to %s", __FUNCTION__, tmp_file);
+        goto exit;
+    }
+    fp = NULL;
+
+    // Exit if unable to replace the snapshot file with the one just written
+    if (rename(tmp_file, file) != 0)
+    {
+        USP_ERR_SetMessage("%s: Failed to rename %s to %s: %s", __FUNCTION__, tmp_file, file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        goto exit;
+    }
+
+    if (num_rows != NULL)
+    {
+        *num_rows = count;
+    }
+    result = USP_ERR_OK;
+
+exit:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+
+    if (result != USP_ERR_OK)
+    {
+        remove(tmp_file);
+    }
+
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_ImportSnapshot
+**
+** Writes the rows contained in a snapshot file (see DATABASE_ExportSnapshot) into the database, in a single transaction
+** The rows are written in bulk using multi-row insert statements, and no data model paths need to be parsed
+** NOTE: The data model instances of a running agent are not updated. The database should be imported whilst the agent is not running,
+**       or as part of factory reset (before the instance numbers are read from the database)
+**
+** \param   file - name of file containing the snapshot
+** \param   replace - set if the contents of the database should be replaced by the snapshot,
+**                    otherwise the rows in the snapshot are merged into the database (overwriting existing values)
+** \param   num_rows - pointer to variable in which to return the number of rows imported, or NULL if this is not required
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DATABASE_ImportSnapshot(char *file, bool replace, int *num_rows)
+{
+    FILE *fp;
+    int err;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    char buf[128];
+    char magic[SNAPSHOT_MAGIC_LEN];
+    unsigned long long value;
+    unsigned long long hash;
+    unsigned long long order;
+    unsigned long long value_len;
+    dm_instances_t inst;
+    char *row_value = NULL;
+    int count = 0;
+    int i;
+    bool is_trans_started = false;
+
+    // Exit if unable to open the snapshot file
+    fp = fopen(file, "r");
+    if (fp == NULL)
+    {
+        USP_ERR_SetMessage("%s: Failed to open %s for reading: %s", __FUNCTION__, file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the file is not a snapshot
+    if ((fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) || (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) ||
+        (ReadSnapshotInteger(fp, 4, &value) != USP_ERR_OK) || (value != SNAPSHOT_FORMAT))
+    {
+        USP_ERR_SetMessage("%s: %s is not a database snapshot (or uses an unsupported format)", __FUNCTION__, file);
+        goto exit;
+    }
+
+    // Exit if the hashes in the snapshot are not in the same format as the database
+    if ((ReadSnapshotInteger(fp, 4, &value) != USP_ERR_OK) || (value != (unsigned long long)db_hash_format))
+    {
+        USP_ERR_SetMessage("%s: Snapshot %s uses a different hash format to the database", __FUNCTION__, file);
+        goto exit;
+    }
+
+    // Exit if unable to commit any outstanding coalesced writes, as the import is performed in its own transaction
+    err = DATABASE_Flush();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to start the transaction
+    err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        goto exit;
+    }
+    is_trans_started = true;
+
+    // NOTE: Marking the transaction as active prevents FlushPendingSets() from opening a coalesced transaction
+    is_db_transaction_active = true;
+
+    // Exit if unable to remove the current contents of the database
+    if (replace)
+    {
+        err = sqlite3_exec(db_handle, "delete from data_model;", NULL, NULL, NULL);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_exec");
+            goto exit;
+        }
+    }
+
+    // Iterate over all rows in the snapshot
+    while (1)
+    {
+        // Exit if the snapshot is truncated
+        if (ReadSnapshotInteger(fp, 1, &order) != USP_ERR_OK)
+        {
+            USP_ERR_SetMessage("%s: Snapshot %s is truncated", __FUNCTION__, file);
+            goto exit;
+        }
+
+        // Exit loop if all rows have been read
+        if (order == SNAPSHOT_END_OF_ROWS)
+        {
+            break;
+        }
+
+        // Exit if the row is invalid
+        if (order > MAX_DM_INSTANCE_ORDER)
+        {
+            USP_ERR_SetMessage("%s: Row %d of snapshot %s is invalid or truncated", __FUNCTION__, count+1, file);
+            goto exit;
+        }
+
+        // Exit if unable to read the key of the row
+        inst.order = (int)order;
+        err = ReadSnapshotInteger(fp, 8, &hash);
+        for (i=0; (i < inst.order) && (err == USP_ERR_OK); i++)
+        {
+            err = ReadSnapshotInteger(fp, 4, &value);
+            inst.instances[i] = (int)value;
+        }
+        if ((err == USP_ERR_OK) && (inst.order < MAX_DM_INSTANCE_ORDER))
+        {
+            inst.instances[inst.order] = 0;
+        }
+
+        // Exit if unable to read the value of the row
+        if (err == USP_ERR_OK)
+        {
+            err = ReadSnapshotInteger(fp, 4, &value_len);
+        }
+
+        if ((err != USP_ERR_OK) || (value_len > MAX_DM_VALUE_LEN))
+        {
+            USP_ERR_SetMessage("%s: Row %d of snapshot %s is invalid or truncated", __FUNCTION__, count+1, file);
+            goto exit;
+        }
+
+        row_value = USP_REALLOC(row_value, value_len+1);
+        if (fread(row_value, 1, value_len, fp) != value_len)
+        {
+            USP_ERR_SetMessage("%s: Snapshot %s is truncated", __FUNCTION__, file);
+            goto exit;
+        }
+
+        // Write the rows to SQLite in bulk, once enough have been read
+        AddPendingSet((dm_hash_t)hash, &inst, row_value, (int)value_len);
+        count++;
+        if (num_pending_sets >= SNAPSHOT_IMPORT_ROWS)
+        {
+            err = FlushPendingSets();
+            if (err != USP_ERR_OK)
+            {
+                goto exit;
+            }
+        }
+    }
+
+    // Exit if the number of rows in the snapshot does not match the trailer
+    if ((ReadSnapshotInteger(fp, 4, &value) != USP_ERR_OK) || (value != (unsigned long long)count))
+    {
+        USP_ERR_SetMessage("%s: Snapshot %s is corrupt (expected %llu rows, read %d)", __FUNCTION__, file, value, count);
+        goto exit;
+    }
+
+    // Exit if unable to write the remaining rows
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to commit the transaction
+    err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        goto exit;
+    }
+    is_trans_started = false;
+
+    if (num_rows != NULL)
+    {
+        *num_rows = count;
+    }
+    result = USP_ERR_OK;
+
+exit:
+    FreePendingSets();
+    if (is_trans_started)
+    {
+        sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+    }
+    is_db_transaction_active = false;
+
+    // The cache no longer matches the database, so it is reloaded when it is next read
+    FreeDbCache();
+
+    USP_SAFE_FREE(row_value);
+    fclose(fp);
+    return result;
+}
+
+/*********************************************************************//**
+**
+** DATABASE_IsSnapshotFile
+**
+** Determines whether the specified file contains a snapshot of the database (rather than eg a factory reset text file)
+**
+** \param   file - name of file to test
+**
+** \return  true if the file starts with the snapshot signature
+**
+**************************************************************************/
+bool DATABASE_IsSnapshotFile(char *file)
+{
+    FILE *fp;
+    char magic[SNAPSHOT_MAGIC_LEN];
+    bool is_snapshot = false;
+
+    fp = fopen(file, "r");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    if ((fread(magic, 1, sizeof(magic), fp) == sizeof(magic)) && (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0))
+    {
+        is_snapshot = true;
+    }
+
+    fclose(fp);
+    return is_snapshot;
+}
+
+/*********************************************************************//**
+**
+** WriteSnapshotInteger
+**
+** Writes an unsigned integer to a snapshot file, in big endian order
+**
+** \param   fp - file to write to
+** \param   value - value to write
+** \param   num_bytes - number of bytes to write the value in
+**
+** \return  None (errors are detected using ferror(), once the snapshot has been written)
+**
+**************************************************************************/
+void WriteSnapshotInteger(FILE *fp, unsigned long long value, int num_bytes)
+{
+    unsigned char bytes[8];
+    int i;
+
+    USP_ASSERT(num_bytes <= sizeof(bytes));
+    for (i=num_bytes-1; i>=0; i--)
+    {
+        bytes[i] = value & 0xFF;
+        value >>= 8;
+    }
+
+    fwrite(bytes, 1, num_bytes, fp);
+}
+
+/*********************************************************************//**
+**
+** ReadSnapshotInteger
+**
+** Reads an unsigned big endian integer from a snapshot file
+**
+** \param   fp - file to read from
+** \param   num_bytes - number of bytes containing the value
+** \param   value - pointer to variable in which to return the value
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if the end of the file was reached
+**
+**************************************************************************/
+int ReadSnapshotInteger(FILE *fp, int num_bytes, unsigned long long *value)
+{
+    unsigned char bytes[8];
+    int i;
+
+    USP_ASSERT(num_bytes <= sizeof(bytes));
+    if (fread(bytes, 1, num_bytes, fp) != num_bytes)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    *value = 0;
+    for (i=0; i<num_bytes; i++)
+    {
+        *value = (*value << 8) | bytes[i];
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** OpenUspDatabase
+**
+** Opens the USP database, ensures the table is created in it and the SQL statements prepared
+**
+** \param   db_file - path to file to use for the database
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int OpenUspDatabase(char *db_file)
+{
+    int err;
+    char sql[160];
+
+    // Exit if unable to open the database
+    err = sqlite3_open(db_file, &db_handle);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_open");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to apply the storage profile selected for this platform
+    err = ApplyStorageProfile();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to create the data model parameter table (if it does not already exist)
+    #define CREATE_TABLE_STR "create table if not exists data_model (hash integer, instances %s, value text, primary key (hash, instances));"
+    USP_SNPRINTF(sql, sizeof(sql), CREATE_TABLE_STR, (db_instances_format == DB_INSTANCES_FORMAT_BLOB) ? "blob" : "text");
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to convert the instance numbers stored in the database to the selected format
+    err = MigrateInstancesFormat();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to prepare all SQL statements to be used
+    err = PrepareSQLStatements();
+    if (err != USP_ERR_OK)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ApplyStorageProfile
+**
+** Applies the SQLite settings selected by the storage profile (see DB_JOURNAL_MODE etc in vendor_defs.h) to the database
+** NOTE: This must be called before the data model table is created, as the page size can only be set before the database file is populated
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ApplyStorageProfile(void)
+{
+    int err;
+    char value[32];
+    char *journal_mode = DB_JOURNAL_MODE;
+
+    // Set the page size first, as it cannot be changed once the database is in WAL journal mode
+    // NOTE: The page size of an existing database file is not altered (that would require a vacuum)
+    if (DB_PAGE_SIZE > 0)
+    {
+        USP_SNPRINTF(value, sizeof(value), "%d", DB_PAGE_SIZE);
+        err = SetDatabasePragma("page_size", value);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    // Select WAL journal mode when coalescing commits (if no journal mode was specified),
+    // as it only needs a single sync of the flash per commit
+    if ((*journal_mode == '\0') && (IsCommitCoalescingEnabled()))
+    {
+        journal_mode = "WAL";
+    }
+
+    if (*journal_mode != '\0')
+    {
+        err = SetDatabasePragma("journal_mode", journal_mode);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    if (DB_SYNCHRONOUS[0] != '\0')
+    {
+        err = SetDatabasePragma("synchronous", DB_SYNCHRONOUS);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    if (DB_MMAP_SIZE > 0)
+    {
+        USP_SNPRINTF(value, sizeof(value), "%lld", (long long)DB_MMAP_SIZE);
+        err = SetDatabasePragma("mmap_size", value);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    if (DB_CACHE_SIZE != 0)
+    {
+        USP_SNPRINTF(value, sizeof(value), "%d", DB_CACHE_SIZE);
+        err = SetDatabasePragma("cache_size", value);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+#ifdef DB_TEMP_STORE_MEMORY
+    err = SetDatabasePragma("temp_store", "MEMORY");
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+#endif
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** SetDatabasePragma
+**
+** Sets the value of an SQLite pragma on the database
+**
+** \param   name - name of the pragma
+** \param   value - value to set the pragma to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int SetDatabasePragma(char *name, char *value)
+{
+    int err;
+    char sql[96];
+
+    USP_SNPRINTF(sql, sizeof(sql), "pragma %s=%s;", name, value);
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_LOG_Error("%s: Failed to set %s=%s: %s", __FUNCTION__, name, value, sqlite3_errmsg(db_handle));
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** GetDatabasePragma
+**
+** Gets the current value of an SQLite pragma on the database, as a string
+**
+** \param   name - name of the pragma
+** \param   buf - pointer to buffer in which to return the value
+** \param   len - length of buffer in which to return the value
+**
+** \return  None (an empty string is returned if the value could not be read)
+**
+**************************************************************************/
+void GetDatabasePragma(char *name, char *buf, int len)
+{
+    sqlite3_stmt *stmt;
+    char sql[64];
+    const unsigned char *value;
+
+    *buf = '\0';
+    USP_SNPRINTF(sql, sizeof(sql), "pragma %s;", name);
+    if (sqlite3_prepare_v2(db_handle, sql, SQLITE_ZERO_TERMINATED, &stmt, NULL) != SQLITE_OK)
+    {
+        return;
+    }
+
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        value = sqlite3_column_text(stmt, 0);
+        if (value != NULL)
+        {
+            USP_STRNCPY(buf, (char *)value, len);
+        }
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+/*********************************************************************//**
+**
+** LogStorageProfile
+**
+** Logs the SQLite settings in use by the database
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void LogStorageProfile(void)
+{
+    int i;
+    char value[32];
+    char msg[256];
+    int len = 0;
+    static char *pragmas[] = { "journal_mode", "synchronous", "page_size", "cache_size", "mmap_size", "temp_store" };
+
+    for (i=0; i<NUM_ELEM(pragmas); i++)
+    {
+        GetDatabasePragma(pragmas[i], value, sizeof(value));
+        len += USP_SNPRINTF(&msg[len], sizeof(msg)-len, "%s%s=%s", (i==0) ? "" : ", ", pragmas[i], value);
+    }
+
+    USP_LOG_Info("%s: %s", __FUNCTION__, msg);
+}
+
+/*********************************************************************//**
+**
+** RunStorageBenchmark
+**
+** Measures the latency of commits and reads of the database using the selected storage profile, and logs the results
+** The benchmark uses its own table, which is removed afterwards, so the data model parameters are not affected
+**
+** \param   num_rows - number of rows to write (each in its own commit) and then read back
+**
+** \return  None
+**
+**************************************************************************/
+void RunStorageBenchmark(int num_rows)
+{
+    sqlite3_stmt *insert_stmt = NULL;
+    sqlite3_stmt *select_stmt = NULL;
+    db_latency_t commits;
+    db_latency_t reads;
+    unsigned long long start;
+    char value[64];
+    int i;
+    int err;
+
+    memset(&commits, 0, sizeof(commits));
+    memset(&reads, 0, sizeof(reads));
+
+    // Exit if unable to create a clean table for the benchmark
+    err = sqlite3_exec(db_handle, "create table if not exists db_benchmark (key integer primary key, value text); delete from db_benchmark;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return;
+    }
+
+    // Exit if unable to prepare the statements used by the benchmark
+    if ((sqlite3_prepare_v2(db_handle, "insert or replace into db_benchmark(key,value) values(?1,?2);", SQLITE_ZERO_TERMINATED, &insert_stmt, NULL) != SQLITE_OK) ||
+        (sqlite3_prepare_v2(db_handle, "select value from db_benchmark where key = ?1;", SQLITE_ZERO_TERMINATED, &select_stmt, NULL) != SQLITE_OK))
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
+        goto exit;
+    }
+
+    // Write each row in its own commit, in the same way that parameters set outside of a transaction are committed
+    USP_SNPRINTF(value, sizeof(value), "%s", "Device.LocalAgent.Controller.1.PeriodicNotifInterval");
+    for (i=0; i<num_rows; i++)
+    {
+        start = tu_uptime_usecs();
+        sqlite3_bind_int(insert_stmt, 1, i);
+        sqlite3_bind_text(insert_stmt, 2, value, SQLITE_ZERO_TERMINATED, SQLITE_STATIC);
+        err = sqlite3_step(insert_stmt);
+        sqlite3_reset(insert_stmt);
+        if (err != SQLITE_DONE)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
+            goto exit;
+        }
+        AddLatencySample(&commits, tu_uptime_usecs() - start);
+    }
+
+    // Read back each row
+    for (i=0; i<num_rows; i++)
+    {
+        start = tu_uptime_usecs();
+        sqlite3_bind_int(select_stmt, 1, i);
+        err = sqlite3_step(select_stmt);
+        sqlite3_reset(select_stmt);
+        if (err != SQLITE_ROW)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
+            goto exit;
+        }
+        AddLatencySample(&reads, tu_uptime_usecs() - start);
+    }
+
+    USP_LOG_Info("%s: %d commits: min=%lluus avg=%lluus max=%lluus", __FUNCTION__, commits.count, commits.min, commits.total/commits.count, commits.max);
+    USP_LOG_Info("%s: %d reads: min=%lluus avg=%lluus max=%lluus", __FUNCTION__, reads.count, reads.min, reads.total/reads.count, reads.max);
+
+exit:
+    sqlite3_finalize(insert_stmt);
+    sqlite3_finalize(select_stmt);
+    sqlite3_exec(db_handle, "drop table if exists db_benchmark;", NULL, NULL, NULL);
+}
+
+/*********************************************************************//**
+**
+** AddLatencySample
+**
+** Adds a measured latency to the statistics collected by the storage benchmark
+**
+** \param   stats - pointer to statistics to update
+** \param   usecs - measured latency (in microseconds)
+**
+** \return  None
+**
+**************************************************************************/
+void AddLatencySample(db_latency_t *stats, unsigned long long usecs)
+{
+    if ((stats->count == 0) || (usecs < stats->min))
+    {
+        stats->min = usecs;
+    }
+
+    if (usecs > stats->max)
+    {
+        stats->max = usecs;
+    }
+
+    stats->total += usecs;
+    stats->count++;
+}
+
+/*********************************************************************//**
+**
+** CopyFactoryResetDatabase
+**
+** Performs a factory reset of the database, by restoring a prebuilt factory reset database image
+** The image is copied using the SQLite online backup API into a temporary file, which then atomically replaces
+** the database file. This validates the image (a corrupt image never replaces the database), copies it sequentially
+** in a single pass, and ensures that a power failure during the copy leaves either the old or the new database intact
+** NOTE: The factory reset database will have been generated with the reboot cause set to "LocalFactoryReset"
+** NOTE: This function must only be called when the database is not open
+**
+** \param   reset_file - filename of the file containing the SQLite factory reset database
+**                       NOTE: This maybe an empty string or NULL if factory reset is not implemented by a static file
 ** \param   db_file - filename
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int CopyFactoryResetDatabase(char *reset_file, char *db_file)
+int CopyFactoryResetDatabase(char *reset_file, char *db_file)
+{
+    sqlite3 *src = NULL;
+    sqlite3 *dest = NULL;
+    sqlite3_backup *backup;
+    char tmp_file[sizeof(database_filename)+8];
+    char buf[128];
+    int err;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+
+    // Exit if no file containing the factory reset database has been specified
+    // NOTE: This is not an error, as it could be the case if the database is supposed to be generated programatically
+    if ((reset_file == NULL) || (*reset_file == '\0'))
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to open the factory reset database for reading
+    err = sqlite3_open_v2(reset_file, &src, SQLITE_OPEN_READONLY, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_LOG_Error("%s: Failed to open factory reset database %s for reading: %s", __FUNCTION__, reset_file, sqlite3_errmsg(src));
+        goto exit;
+    }
+
+    // Exit if unable to create the temporary file to restore the factory reset database into
+    USP_SNPRINTF(tmp_file, sizeof(tmp_file), "%s.tmp", db_file);
+    remove(tmp_file);
+    err = sqlite3_open_v2(tmp_file, &dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_LOG_Error("%s: Failed to open destination database %s for writing: %s", __FUNCTION__, tmp_file, sqlite3_errmsg(dest));
+        goto exit;
+    }
+
+    // Exit if unable to copy all pages of the factory reset database in a single step
+    backup = sqlite3_backup_init(dest, "main", src, "main");
+    if (backup == NULL)
+    {
+        USP_LOG_Error("%s: Failed to start restoring factory reset database %s: %s", __FUNCTION__, reset_file, sqlite3_errmsg(dest));
+        goto exit;
+    }
+
+    sqlite3_backup_step(backup, -1);
+    err = sqlite3_backup_finish(backup);
+    if (err != SQLITE_OK)
+    {
+        USP_LOG_Error("%s: Failed to restore factory reset database %s: %s", __FUNCTION__, reset_file, sqlite3_errmsg(dest));
+        goto exit;
+    }
+
+    // Exit if unable to close the restored database, as it must be complete on disk before it replaces the database
+    err = sqlite3_close(dest);
+    dest = NULL;
+    if (err != SQLITE_OK)
+    {
+        USP_LOG_Error("%s: Failed to close restored database %s", __FUNCTION__, tmp_file);
+        goto exit;
+    }
+
+    // Remove any journal files left by the previous database, so that they are not applied to the restored database
+    USP_SNPRINTF(buf, sizeof(buf), "%s-wal", db_file);
+    remove(buf);
+    USP_SNPRINTF(buf, sizeof(buf), "%s-shm", db_file);
+    remove(buf);
+    USP_SNPRINTF(buf, sizeof(buf), "%s-journal", db_file);
+    remove(buf);
+
+    // Exit if unable to atomically replace the database file with the restored factory reset database
+    if (rename(tmp_file, db_file) != 0)
+    {
+        USP_LOG_Error("%s: Failed to rename %s to %s: %s", __FUNCTION__, tmp_file, db_file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        goto exit;
+    }
+
+    // If the code gets here, then the factory reset database has been restored successfully
+    result = USP_ERR_OK;
+
+exit:
+    // NOTE: Closing a NULL database handle is harmless
+    sqlite3_close(dest);
+    sqlite3_close(src);
+
+    if (result != USP_ERR_OK)
+    {
+        remove(tmp_file);
+    }
+
+    return result;
+}
+
+#ifdef INCLUDE_PROGRAMMATIC_FACTORY_RESET
+/*********************************************************************//**
+**
+** ResetFactoryParameters
+**
+** Sets the parameters specified by VENDOR_GetFactoryResetParams()
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ResetFactoryParameters(void)
+{
+    int i;
+    int err;
+    kv_vector_t params;
+    kv_pair_t *kv;
+
+    // Exit if unable to get the factory reset parameters
+    KV_VECTOR_Init(&params);
+    err = VENDOR_GetFactoryResetParams(&params);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    USP_LOG_Info("%s: Setting factory reset parameters", __FUNCTION__);
+
+    // Exit if unable to start a transaction, so that all parameters are written to the database file at once
+    err = DATABASE_StartTransaction();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Set all factory reset parameters provided by the vendor in the database
+    for (i=0; i<params.num_entries; i++)
+    {
+        kv = &params.vector[i];
+
+        // Exit if a parameter was not in the data model or failed to set    
+        err = DATA_MODEL_SetParameterInDatabase(kv->key, kv->value);
+        if (err != USP_ERR_OK)
+        {
+            DATABASE_AbortTransaction();
+            goto exit;
+        }
+    }
+
+    // Exit if unable to commit the parameters to the database
+    err = DATABASE_CommitTransaction();
+    if (err != USP_ERR_OK)
+    {
+        DATABASE_AbortTransaction();
+    }
+
+exit:
+    // Ensure that the parameters signalled by the vendor are freed
+    KV_VECTOR_Destroy(&params);
+
+    return err;
+}
+#endif // INCLUDE_PROGRAMMATIC_FACTORY_RESET
+
+/*********************************************************************//**
+**
+** ResetFactoryParametersFromFile
+**
+** Sets the data model parameters specified in the file
+** The file may be either a text file containing 'parameter value' lines, or a snapshot written by DATABASE_ExportSnapshot()
+**
+** \param   file - name of file containing parameters to set
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ResetFactoryParametersFromFile(char *file)
+{
+    FILE *fp;
+    char *result;
+    char buf[MAX_DM_PATH + MAX_DM_VALUE_LEN + 4]; // Plus 4 to allow for separator, line ending characters and NULL terminator
+    int err;
+    char *key;
+    char *value;
+    int line_number = 1;
+
+    // If the file is a snapshot of a database (see DATABASE_ExportSnapshot), then merge its rows into the database
+    if (DATABASE_IsSnapshotFile(file))
+    {
+        err = DATABASE_ImportSnapshot(file, false, NULL);
+        if (err != USP_ERR_OK)
+        {
+            USP_LOG_Error("%s: Failed to import factory reset snapshot (%s): %s", __FUNCTION__, file, USP_ERR_GetMessage());
+        }
+        return err;
+    }
+
+    // Exit if unable to open the file containing factory reset parameters
+    fp = fopen(file, "r");
+    if (fp == NULL)
+    {
+        USP_LOG_Error("%s: Failed to open factory reset file (%s)", __FUNCTION__, file);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to start a transaction, so that all parameters are written to the database file at once
+    err = DATABASE_StartTransaction();
+    if (err != USP_ERR_OK)
+    {
+        fclose(fp);
+        return err;
+    }
+
+    // Iterate over all lines in the file
+    result = fgets(buf, sizeof(buf), fp);
+    while (result != NULL)
+    {
+        // Exit if an error occurred when parsing this line
+        err = TEXT_UTILS_KeyValueFromString(buf, &key, &value);
+        if (err != USP_ERR_OK)
+        {
+            USP_LOG_Error("%s: Syntax error in %s at line %d", __FUNCTION__, file, line_number);
+            goto exit;
+        }
+
+        // Set the parameter (if the line was not blank or a comment)
+        if ((key != NULL) & (value != NULL))
+        {
+            err = DATA_MODEL_SetParameterInDatabase(key, value);
+            if (err != USP_ERR_OK)
+            {
+                USP_LOG_Error("%s: Failed to set parameter at line %d of %s", __FUNCTION__, line_number, file);
+                goto exit;
+            }
+        }
+        
+        // Get the next line
+        line_number++;
+        result = fgets(buf, sizeof(buf), fp);
+    }
+
+    // If the code gets here, then all parameters in the file have been set successfully
+    err = DATABASE_CommitTransaction();
+
+exit:
+    if (err != USP_ERR_OK)
+    {
+        DATABASE_AbortTransaction();
+    }
+    fclose(fp);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** LogSQLStatement
+**
+** Logs the SQL Statement used for the specified operation
+** This is useful for debugging purposes
+**
+** \param   op - string representing the operation being performed
+** \param   path - data model path involved in the operation
+** \param   stmt - prepared statement with bound values
+**
+** \return  None
+**
+**************************************************************************/
+void LogSQLStatement(char *op, char *path, sqlite3_stmt *stmt)
+{
+#if SQLITE_VERSION_NUMBER >= 3014000
+    char *sql_str;
+
+    sql_str = sqlite3_expanded_sql(stmt);
+    USP_LOG_Info("%s(%s): %s", op, path, sql_str);
+    sqlite3_free(sql_str);
+#endif // SQLITE_VERSION_NUMBER
+
+    // Ensure that compiler does not complain about unused arguments if SQLITE_VERSION_NUMBER < 3014000
+    (void)op;
+    (void)path;
+    (void)stmt;
+}
+
+/*********************************************************************//**
+**
+** ObfuscatedCopy
+**
+** Copies the specified source value into the destination buffer, 
+** whilst obfuscating/unobfuscating it
+** NOTE: Obfuscation may result in embedded NULLs within the destination, or
+**       be the cause of embedded NULLs in the src
+**
+** \param   dest - pointer to buffer in which to copy the unobfuscated value
+** \param   src - pointer to value to unobfuscate
+** \param   len - length of value
+**
+** \return  None
+**
+**************************************************************************/
+void ObfuscatedCopy(unsigned char *dest, unsigned char *src, int len)
+{
+    int i;
+
+    unsigned char *key = (unsigned char *) PASSWORD_OBFUSCATION_KEY;
+    int key_len;
+
+    key_len = strlen((char *) key);
+    for (i=0; i<len; i++)
+    {
+        *dest = (*src) ^ key[ i % key_len ];
+        dest++;
+        src++;
+    }
+}
+
+/*********************************************************************//**
+**
+** CopyDbValue
+**
+** Copies a value read from the database into the return buffer, unobfuscating it if necessary
+**
+** \param   buf - pointer to buffer in which to return the value
+** \param   buflen - length of buffer in which to return the value
+** \param   value - pointer to value, as stored in the database. May be NULL
+** \param   value_len - length of value (in bytes)
+** \param   flags - flags controlling getting the value (eg OBFUSCATED_VALUE)
+**
+** \return  None
+**
+**************************************************************************/
+void CopyDbValue(char *buf, int buflen, const unsigned char *value, int value_len, unsigned flags)
+{
+    // Determine the length of the value string to copy into the return buffer, truncating it, if it is too long
+    value_len = MIN(value_len, buflen-1);
+
+    // Copy the value into the return buffer
+    if ((value != NULL) && (value_len >0))
+    {
+        if (flags & OBFUSCATED_VALUE)
+        {
+            // Unobfuscate value
+            ObfuscatedCopy((unsigned char *)buf, (unsigned char *)value, value_len);
+        }
+        else
+        {
+            // Normal case: value is not obfuscated (or we don't want to return an unobfuscated value)
+            memcpy(buf, value, value_len);
+        }
+        buf[value_len] = '\0'; // Ensure return buffer is always zero terminated
+    }
+    else
+    {
+        *buf = '\0';        // Case of value set to NULL in DB
+    }
+}
+
+/*********************************************************************//**
+**
+** LoadDbCache
+**
+** Loads all parameters in the database into the cache, if they have not been loaded already
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if the cache could not be loaded
+**
+**************************************************************************/
+int LoadDbCache(void)
+{
+    sqlite3_stmt *stmt;
+    int err;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    dm_instances_t inst;
+    char *value;
+    int value_len;
+    dm_hash_t hash;
+
+    // Exit if the cache has already been loaded
+    if (is_db_cache_loaded)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to write any pending values to SQLite first, as the cache is loaded from SQLite
+    err = FlushPendingSets();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to prepare the SQL statement
+    #define SELECT_ALL_CACHE_STR   "select hash,instances,value from data_model;"
+    err = sqlite3_prepare_v2(db_handle, SELECT_ALL_CACHE_STR, SQLITE_ZERO_TERMINATED, &stmt, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Iterate over all rows, adding them to the cache
+    err = SQLITE_ROW;
+    while (err == SQLITE_ROW)
+    {
+        err = sqlite3_step(stmt);
+        if (err == SQLITE_DONE)
+        {
+            // Exit loop if we have processed all rows
+            result = USP_ERR_OK;
+            break;
+        }
+        else if (err != SQLITE_ROW)
+        {
+            // An error occurred
+            USP_ERR_SQL(db_handle,"sqlite3_step");
+            break;
+        }
+
+        // Skip rows with invalid instance numbers. These are removed by DATABASE_ReadDataModelInstanceNumbers()
+        hash = sqlite3_column_int64(stmt, 0);
+        if (ReadInstancesColumn(stmt, 1, db_instances_format, &inst) != USP_ERR_OK)
+        {
+            continue;
+        }
+
+        value = (char *)sqlite3_column_text(stmt, 2);
+        value_len = sqlite3_column_bytes(stmt, 2);
+        InsertDbCacheEntry(hash, &inst, value, value_len);
+    }
+
+    err = sqlite3_finalize(stmt);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_finalize");
+        result = USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the cache could not be fully loaded, discarding the partially loaded cache
+    if (result != USP_ERR_OK)
+    {
+        FreeDbCache();
+        return result;
+    }
+
+    is_db_cache_loaded = true;
+    db_cache_loads++;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** FreeDbCache
+**
+** Frees all entries in the cache, and the undo log
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreeDbCache(void)
+{
+    int i;
+    db_cache_entry_t *entry;
+
+    for (i=0; i < db_cache_table_size; i++)
+    {
+        entry = &db_cache_table[i];
+        if (entry->in_use)
+        {
+            USP_SAFE_FREE(entry->value);
+        }
+    }
+
+    USP_SAFE_FREE(db_cache_table);
+    db_cache_table_size = 0;
+    db_cache_count = 0;
+    is_db_cache_loaded = false;
+
+    FreeDbCacheUndo();
+    USP_SAFE_FREE(db_cache_undo);
+    max_db_cache_undo = 0;
+}
+
+/*********************************************************************//**
+**
+** CalcDbCacheHash
+**
+** Calculates the hash used to index the cache table, from the key of a database row
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  hash of the key
+**
+**************************************************************************/
+unsigned CalcDbCacheHash(dm_hash_t hash, dm_instances_t *inst)
+{
+    unsigned h;
+    int i;
+
+    // FNV-1a over the instance numbers, seeded with the parameter's hash
+    h = 2166136261u ^ (unsigned)hash ^ (unsigned)(hash >> 32);
+    for (i=0; i < inst->order; i++)
+    {
+        h ^= (unsigned)inst->instances[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+/*********************************************************************//**
+**
+** IsSameDbKey
+**
+** Determines whether the specified cache entry is for the specified parameter
+**
+** \param   entry - pointer to cache entry (which must be in use)
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  true if the cache entry is for the specified parameter
+**
+**************************************************************************/
+bool IsSameDbKey(db_cache_entry_t *entry, dm_hash_t hash, dm_instances_t *inst)
+{
+    if ((entry->hash != hash) || (entry->order != inst->order))
+    {
+        return false;
+    }
+
+    return (memcmp(entry->instances, inst->instances, inst->order*sizeof(int)) == 0);
+}
+
+/*********************************************************************//**
+**
+** FindDbCacheEntry
+**
+** Finds the cache entry for the specified parameter
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  pointer to cache entry, or NULL if the parameter is not present in the database
+**
+**************************************************************************/
+db_cache_entry_t *FindDbCacheEntry(dm_hash_t hash, dm_instances_t *inst)
+{
+    unsigned mask;
+    unsigned index;
+    db_cache_entry_t *entry;
+
+    // Exit if the cache is empty
+    if (db_cache_count == 0)
+    {
+        return NULL;
+    }
+
+    mask = db_cache_table_size - 1;
+    index = CalcDbCacheHash(hash, inst) & mask;
+    while (FOREVER)
+    {
+        entry = &db_cache_table[index];
+        if (entry->in_use == false)
+        {
+            return NULL;
+        }
+
+        if (IsSameDbKey(entry, hash, inst))
+        {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+/*********************************************************************//**
+**
+** InsertDbCacheEntry
+**
+** Adds or replaces the value of the specified parameter in the cache
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+** \param   value - pointer to value, as stored in the database. May be NULL
+** \param   value_len - length of value (in bytes)
+**
+** \return  None
+**
+**************************************************************************/
+void InsertDbCacheEntry(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len)
+{
+    unsigned mask;
+    unsigned index;
+    db_cache_entry_t *entry;
+
+    // Ensure that the table is at most 75% full
+    if (4*(db_cache_count+1) > 3*db_cache_table_size)
+    {
+        GrowDbCacheTable();
+    }
+
+    // Find the slot for this parameter
+    mask = db_cache_table_size - 1;
+    index = CalcDbCacheHash(hash, inst) & mask;
+    while (FOREVER)
+    {
+        entry = &db_cache_table[index];
+        if (entry->in_use == false)
+        {
+            SetDbKey(entry, hash, inst);
+            db_cache_count++;
+            break;
+        }
+
+        if (IsSameDbKey(entry, hash, inst))
+        {
+            USP_SAFE_FREE(entry->value);
+            break;
+        }
+
+        index = (index + 1) & mask;
+    }
+
+    // Copy the value (NOTE: obfuscated values may contain embedded NULs, so a length is stored)
+    entry->value = NULL;
+    entry->value_len = 0;
+    if (value != NULL)
+    {
+        entry->value = USP_MALLOC(value_len+1);
+        memcpy(entry->value, value, value_len);
+        entry->value[value_len] = '\0';
+        entry->value_len = value_len;
+    }
+}
+
+/*********************************************************************//**
+**
+** RemoveDbCacheEntry
+**
+** Removes the specified parameter from the cache
+** NOTE: The following entries in the probe sequence are shifted backwards, so that lookups do not need tombstones
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveDbCacheEntry(dm_hash_t hash, dm_instances_t *inst)
+{
+    unsigned mask;
+    unsigned hole;
+    unsigned index;
+    unsigned home;
+    db_cache_entry_t *entry;
+
+    // Exit if the parameter is not in the cache
+    entry = FindDbCacheEntry(hash, inst);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    USP_SAFE_FREE(entry->value);
+    entry->in_use = false;
+    db_cache_count--;
+
+    // Shift back following entries which would no longer be reachable
+    mask = db_cache_table_size - 1;
+    hole = entry - db_cache_table;
+    index = (hole + 1) & mask;
+    while (db_cache_table[index].in_use)
+    {
+        home = CalcDbCacheKeyHash(&db_cache_table[index]) & mask;
+        if (((index - home) & mask) >= ((index - hole) & mask))
+        {
+            db_cache_table[hole] = db_cache_table[index];
+            db_cache_table[index].in_use = false;
+            db_cache_table[index].value = NULL;
+            hole = index;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+/*********************************************************************//**
+**
+** RemoveDbCacheRange
+**
+** Removes all entries for the specified parameters that belong to the specified object instance (or its child instances)
+** from the cache, recording their previous values in the undo log
+**
+** \param   hashes - array of hashes identifying the data model parameters to remove
+** \param   num_hashes - number of hashes in the array
+** \param   inst - pointer to instance numbers prefixing the instances of the parameters to remove
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveDbCacheRange(dm_hash_t *hashes, int num_hashes, dm_instances_t *inst)
+{
+    int i;
+    int j;
+    db_cache_entry_t *entry;
+    dm_instances_t *keys;
+    dm_hash_t *key_hashes;
+    int num_keys;
+
+    // Collect the keys of all matching entries first, as removing an entry may move other entries within the table
+    keys = NULL;
+    key_hashes = NULL;
+    num_keys = 0;
+    for (i=0; i < db_cache_table_size; i++)
+    {
+        entry = &db_cache_table[i];
+        if ((entry->in_use == false) || (IsDbKeyWithinPrefix(entry, inst) == false))
+        {
+            continue;
+        }
+
+        for (j=0; j < num_hashes; j++)
+        {
+            if (entry->hash == hashes[j])
+            {
+                keys = USP_REALLOC(keys, (num_keys+1)*sizeof(dm_instances_t));
+                key_hashes = USP_REALLOC(key_hashes, (num_keys+1)*sizeof(dm_hash_t));
+                GetDbKey(entry, &keys[num_keys]);
+                key_hashes[num_keys] = entry->hash;
+                num_keys++;
+                break;
+            }
+        }
+    }
+
+    // Remove all matching entries
+    for (i=0; i < num_keys; i++)
+    {
+        AddDbCacheUndo(key_hashes[i], &keys[i]);
+        RemoveDbCacheEntry(key_hashes[i], &keys[i]);
+    }
+
+    USP_SAFE_FREE(keys);
+    USP_SAFE_FREE(key_hashes);
+}
+
+/*********************************************************************//**
+**
+** IsDbKeyWithinPrefix
+**
+** Determines whether the instance numbers of the specified cache entry start with the specified instance numbers
+**
+** \param   entry - pointer to cache entry
+** \param   inst - pointer to instance numbers to match against
+**
+** \return  true if the instance numbers of the cache entry start with the specified instance numbers
+**
+**************************************************************************/
+bool IsDbKeyWithinPrefix(db_cache_entry_t *entry, dm_instances_t *inst)
+{
+    if (entry->order < inst->order)
+    {
+        return false;
+    }
+
+    return (memcmp(entry->instances, inst->instances, inst->order*sizeof(int)) == 0) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** GrowDbCacheTable
+**
+** Doubles the size of the cache table, rehashing all entries into it
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void GrowDbCacheTable(void)
+{
+    db_cache_entry_t *old_table;
+    int old_size;
+    int i;
+    unsigned mask;
+    unsigned index;
+    db_cache_entry_t *entry;
+
+    old_table = db_cache_table;
+    old_size = db_cache_table_size;
+
+    db_cache_table_size = (old_size == 0) ? MIN_DB_CACHE_TABLE_SIZE : 2*old_size;
+    db_cache_table = USP_MALLOC(db_cache_table_size*sizeof(db_cache_entry_t));
+    memset(db_cache_table, 0, db_cache_table_size*sizeof(db_cache_entry_t));
+
+    // Move all entries into the new table
+    mask = db_cache_table_size - 1;
+    for (i=0; i < old_size; i++)
+    {
+        entry = &old_table[i];
+        if (entry->in_use)
+        {
+            index = CalcDbCacheKeyHash(entry) & mask;
+            while (db_cache_table[index].in_use)
+            {
+                index = (index + 1) & mask;
+            }
+            db_cache_table[index] = *entry;
+        }
+    }
+
+    USP_SAFE_FREE(old_table);
+}
+
+/*********************************************************************//**
+**
+** UpdateDbCache
+**
+** Writes through the new value of a parameter (which has been set in the database) into the cache
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+** \param   value - pointer to value, as stored in the database
+** \param   value_len - length of value (in bytes)
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateDbCache(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len)
+{
+    // Exit if the cache has not been loaded yet. It will contain the new value when it is loaded
+    if (is_db_cache_loaded == false)
+    {
+        return;
+    }
+
+    AddDbCacheUndo(hash, inst);
+    InsertDbCacheEntry(hash, inst, value, value_len);
+}
+
+/*********************************************************************//**
+**
+** AddDbCacheUndo
+**
+** Records the current cached value of the specified parameter, if a transaction is active,
+** so that it can be restored if the transaction is aborted
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  None
+**
+**************************************************************************/
+void AddDbCacheUndo(dm_hash_t hash, dm_instances_t *inst)
+{
+    db_cache_entry_t *entry;
+    db_cache_entry_t *undo;
+
+    // Exit if no transaction is active. Changes are committed immediately in this case
+    if (is_db_transaction_active == false)
+    {
+        return;
+    }
+
+    // Increase the size of the undo log, if required
+    if (num_db_cache_undo == max_db_cache_undo)
+    {
+        max_db_cache_undo = (max_db_cache_undo == 0) ? 16 : 2*max_db_cache_undo;
+        db_cache_undo = USP_REALLOC(db_cache_undo, max_db_cache_undo*sizeof(db_cache_entry_t));
+    }
+
+    undo = &db_cache_undo[num_db_cache_undo];
+    num_db_cache_undo++;
+    SetDbKey(undo, hash, inst);
+    undo->value = NULL;
+    undo->value_len = 0;
+
+    // Copy the current value, if the parameter is present in the database
+    entry = FindDbCacheEntry(hash, inst);
+    if (entry != NULL)
+    {
+        undo->value = USP_MALLOC(entry->value_len+1);
+        if (entry->value != NULL)
+        {
+            memcpy(undo->value, entry->value, entry->value_len);
+        }
+        undo->value[entry->value_len] = '\0';
+        undo->value_len = entry->value_len;
+    }
+}
+
+/*********************************************************************//**
+**
+** ApplyDbCacheUndo
+**
+** Restores the cache to the state it was in before the current transaction started
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void ApplyDbCacheUndo(void)
+{
+    int i;
+    db_cache_entry_t *undo;
+    dm_instances_t inst;
+
+    // Iterate over the undo log in reverse order, so that the oldest value of each parameter is restored last
+    for (i=num_db_cache_undo-1; i>=0; i--)
+    {
+        undo = &db_cache_undo[i];
+        GetDbKey(undo, &inst);
+        if (undo->value == NULL)
+        {
+            RemoveDbCacheEntry(undo->hash, &inst);
+        }
+        else
+        {
+            InsertDbCacheEntry(undo->hash, &inst, undo->value, undo->value_len);
+        }
+    }
+
+    FreeDbCacheUndo();
+}
+
+/*********************************************************************//**
+**
+** FreeDbCacheUndo
+**
+** Frees all entries in the undo log
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreeDbCacheUndo(void)
+{
+    int i;
+    db_cache_entry_t *undo;
+
+    for (i=0; i < num_db_cache_undo; i++)
+    {
+        undo = &db_cache_undo[i];
+        USP_SAFE_FREE(undo->value);
+    }
+
+    num_db_cache_undo = 0;
+}
+
+/*********************************************************************//**
+**
+** CalcDbCacheKeyHash
+**
+** Calculates the hash used to index the cache table, from the key stored in a cache entry
+**
+** \param   entry - pointer to cache entry
+**
+** \return  hash of the key
+**
+**************************************************************************/
+unsigned CalcDbCacheKeyHash(db_cache_entry_t *entry)
+{
+    dm_instances_t inst;
+
+    GetDbKey(entry, &inst);
+    return CalcDbCacheHash(entry->hash, &inst);
+}
+
+/*********************************************************************//**
+**
+** SetDbKey
+**
+** Stores the key of a database row in a cache (or undo log) entry
+**
+** \param   entry - pointer to cache entry
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  None
+**
+**************************************************************************/
+void SetDbKey(db_cache_entry_t *entry, dm_hash_t hash, dm_instances_t *inst)
+{
+    USP_ASSERT(inst->order <= MAX_DM_INSTANCE_ORDER);
+    entry->in_use = true;
+    entry->hash = hash;
+    entry->order = inst->order;
+    memcpy(entry->instances, inst->instances, inst->order*sizeof(int));
+}
+
+/*********************************************************************//**
+**
+** GetDbKey
+**
+** Retrieves the instance numbers stored in a cache (or undo log) entry
+**
+** \param   entry - pointer to cache entry
+** \param   inst - pointer to structure in which to return the instance numbers
+**
+** \return  None
+**
+**************************************************************************/
+void GetDbKey(db_cache_entry_t *entry, dm_instances_t *inst)
+{
+    inst->order = entry->order;
+    memcpy(inst->instances, entry->instances, entry->order*sizeof(int));
+}
+
+/*********************************************************************//**
+**
+** IsCommitCoalescingEnabled
+**
+** Determines whether database commits should be coalesced
+** NOTE: Commits are never coalesced when running a local CLI command (eg dbset), as there is no timer to flush them
+**
+** \param   None
+**
+** \return  true if commits should be coalesced
+**
+**************************************************************************/
+bool IsCommitCoalescingEnabled(void)
+{
+    return ((DB_COMMIT_COALESCE_PERIOD > 0) && (is_running_cli_local_command == false));
+}
+
+/*********************************************************************//**
+**
+** OpenCoalescedTransaction
+**
+** Starts the outer transaction that commits are coalesced into, if it is not already open
+** Also starts the timer which will flush the coalesced commits to the database file
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful (or commits are not being coalesced)
+**
+**************************************************************************/
+int OpenCoalescedTransaction(void)
+{
+    int err;
+    long long flush_time;
+
+    // Exit if commits are not being coalesced, or if the write is part of a DM transaction (so already within the outer transaction)
+    if ((IsCommitCoalescingEnabled() == false) || (is_db_transaction_active))
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if the outer transaction is already open
+    if (is_coalesced_trans_open)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to start the outer transaction
+    err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    is_coalesced_trans_open = true;
+
+    // Start the timer to flush the coalesced commits
+    flush_time = SYNC_TIMER_TimeMs() + DB_COMMIT_COALESCE_PERIOD;
+    if (is_coalesce_timer_added)
+    {
+        SYNC_TIMER_ReloadMs(CoalescedCommitTimerExpired, 0, flush_time);
+    }
+    else
+    {
+        SYNC_TIMER_AddMs(CoalescedCommitTimerExpired, 0, flush_time);
+        is_coalesce_timer_added = true;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** CoalescedCommitTimerExpired
+**
+** Called when the coalescing period has expired, to flush the coalesced commits to the database file
+**
+** \param   id - (unused) identifier of the sync timer which caused this callback
+**
+** \return  None
+**
+**************************************************************************/
+void CoalescedCommitTimerExpired(int id)
+{
+    // If a DM transaction is in progress, then delay flushing until it has completed
+    if (is_db_transaction_active)
+    {
+        SYNC_TIMER_ReloadMs(CoalescedCommitTimerExpired, 0, SYNC_TIMER_TimeMs() + DB_COMMIT_COALESCE_PERIOD);
+        return;
+    }
+
+    DATABASE_Flush();
+}
+
+/*********************************************************************//**
+**
+** AddPendingSet
+**
+** Adds the specified parameter value to the list of values which are pending being written to SQLite
+**
+** \param   hash - hash identifying the data model parameter
+** \param   inst - pointer to instance numbers of the data model parameter
+** \param   value - value exactly as it should be stored in the database (ie obfuscated, if the parameter is obfuscated)
+** \param   value_len - length of the value
+**
+** \return  None
+**
+**************************************************************************/
+void AddPendingSet(dm_hash_t hash, dm_instances_t *inst, char *value, int value_len)
+{
+    db_cache_entry_t *entry;
+
+    // Increase the size of the pending list, if required
+    if (num_pending_sets == max_pending_sets)
+    {
+        max_pending_sets = (max_pending_sets == 0) ? DB_BATCH_INSERT_ROWS : 2*max_pending_sets;
+        pending_sets = USP_REALLOC(pending_sets, max_pending_sets*sizeof(db_cache_entry_t));
+    }
+
+    entry = &pending_sets[num_pending_sets];
+    num_pending_sets++;
+    SetDbKey(entry, hash, inst);
+    entry->value = USP_MALLOC(value_len+1);
+    memcpy(entry->value, value, value_len);
+    entry->value[value_len] = '\0';
+    entry->value_len = value_len;
+}
+
+/*********************************************************************//**
+**
+** FlushPendingSets
+**
+** Writes all parameter values which are pending being written to SQLite, using multi-row insert statements
+** NOTE: Any trailing values which do not fill a multi-row insert statement are written using smaller multi-row insert statements
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int FlushPendingSets(void)
+{
+    int i;
+    int k;
+    int err;
+    int num_rows;
+    sqlite3_stmt *stmt;
+
+    // Exit if there are no values to write
+    if (num_pending_sets == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to add these writes to the coalesced transaction (if not part of a DM transaction)
+    err = OpenCoalescedTransaction();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Write the values in batches, whilst there are enough left to fill a multi-row insert statement
+    i = 0;
+    while (num_pending_sets - i >= DB_BATCH_INSERT_ROWS)
+    {
+        err = PrepareMultiRowSetStmt(&batch_set_stmt, DB_BATCH_INSERT_ROWS);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+
+        err = WritePendingSets(batch_set_stmt, &pending_sets[i], DB_BATCH_INSERT_ROWS);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+        i += DB_BATCH_INSERT_ROWS;
+    }
+
+    // Write the remaining values, using the largest multi-row insert statement (of a power of two rows) which fits each time
+    while (i < num_pending_sets)
+    {
+        k = 0;
+        while (((2 << k) <= num_pending_sets - i) && (k+1 < MAX_TAIL_SET_STMTS))
+        {
+            k++;
+        }
+        num_rows = 1 << k;
+
+        if (k == 0)
+        {
+            stmt = prepared_stmts[kSqlStmt_Set];
+        }
+        else
+        {
+            err = PrepareMultiRowSetStmt(&tail_set_stmts[k], num_rows);
+            if (err != USP_ERR_OK)
+            {
+                goto exit;
+            }
+            stmt = tail_set_stmts[k];
+        }
+
+        err = WritePendingSets(stmt, &pending_sets[i], num_rows);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+        i += num_rows;
+    }
+    err = USP_ERR_OK;
+
+exit:
+    FreePendingSets();
+    return err;
+}
+
+/*********************************************************************//**
+**
+** PrepareMultiRowSetStmt
+**
+** Prepares a statement which inserts the specified number of rows into the data model table, if it has not been prepared already
+**
+** \param   p_stmt - pointer to variable containing the prepared statement (or NULL, if it has not been prepared yet)
+** \param   num_rows - number of rows of (hash, instances, value) that the statement inserts
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int PrepareMultiRowSetStmt(sqlite3_stmt **p_stmt, int num_rows)
+{
+    int i;
+    int err;
+    int len;
+    char sql[64 + DB_BATCH_INSERT_ROWS*12];
+
+    // Exit if the statement has already been prepared
+    if (*p_stmt != NULL)
+    {
+        return USP_ERR_OK;
+    }
+
+    USP_ASSERT(num_rows <= DB_BATCH_INSERT_ROWS);
+    len = USP_SNPRINTF(sql, sizeof(sql), "insert or replace into data_model(hash,instances,value) values(?,?,?)");
+    for (i=1; i < num_rows; i++)
+    {
+        len += USP_SNPRINTF(&sql[len], sizeof(sql)-len, ",(?,?,?)");
+    }
+    USP_SNPRINTF(&sql[len], sizeof(sql)-len, ";");
+
+    err = sqlite3_prepare_v2(db_handle, sql, SQLITE_ZERO_TERMINATED, p_stmt, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
+        *p_stmt = NULL;
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** WritePendingSets
+**
+** Writes the specified pending parameter values to SQLite, using an insert statement containing the same number of rows
+**
+** \param   stmt - prepared insert statement containing num_rows rows of (hash, instances, value)
+** \param   rows - pointer to array of pending values to write
+** \param   num_rows - number of pending values to write
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int WritePendingSets(sqlite3_stmt *stmt, db_cache_entry_t *rows, int num_rows)
+{
+    int i;
+    int err;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    dm_instances_t inst;
+
+    // Iterate over all rows, binding their values to the prepared statement
+    for (i=0; i < num_rows; i++)
+    {
+        // Exit if unable to set the value of the hash in the prepared statement
+        err = sqlite3_bind_int64(stmt, 3*i+1, rows[i].hash);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_int");
+            goto exit;
+        }
+
+        // Exit if unable to set the value of the instances in the prepared statement
+        GetDbKey(&rows[i], &inst);
+        err = BindInstances(stmt, 3*i+2, db_instances_format, &inst);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+
+        // Exit if unable to set the new value of the parameter in the prepared statement
+        // NOTE: The value remains allocated until after the statement has been reset
+        err = sqlite3_bind_text(stmt, 3*i+3, rows[i].value, rows[i].value_len, SQLITE_STATIC);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind_text");
+            goto exit;
+        }
+    }
+
+    // Exit if unable to perform the inserts
+    err = sqlite3_step(stmt);
+    if (err != SQLITE_DONE)     // We are not expecting any rows
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_step");
+        goto exit;
+    }
+    result = USP_ERR_OK;
+
+exit:
+    // Always reset the statement in preparation for next time, even if an error occurred
+    err = sqlite3_reset(stmt);
+    if ((err != SQLITE_OK) && (result == USP_ERR_OK))
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_reset");
+    }
+
+    return result;
+}
+
+/*********************************************************************//**
+**
+** FreePendingSets
+**
+** Frees all parameter values pending being written to SQLite
+** NOTE: The memory allocated for the list itself is kept, to be reused by the next transaction
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreePendingSets(void)
+{
+    int i;
+
+    for (i=0; i < num_pending_sets; i++)
+    {
+        USP_SAFE_FREE(pending_sets[i].value);
+    }
+    num_pending_sets = 0;
+}
+
+/*********************************************************************//**
+**
+** BindInstances
+**
+** Binds the instance numbers of a parameter to a parameter of a prepared statement, using the specified format
+**
+** \param   stmt - prepared statement
+** \param   index - index of the parameter in the prepared statement
+** \param   format - format to use for the instance numbers (DB_INSTANCES_FORMAT_XXX)
+** \param   inst - pointer to instance numbers of the data model parameter
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int BindInstances(sqlite3_stmt *stmt, int index, int format, dm_instances_t *inst)
+{
+    int err;
+    int i;
+    unsigned value;
+    char text[MAX_DM_PATH];
+    unsigned char blob[MAX_DM_INSTANCE_ORDER*sizeof(int)];
+
+    if (format == DB_INSTANCES_FORMAT_BLOB)
+    {
+        // Pack the instance numbers as big endian integers, so that rows sort by instance number
+        USP_ASSERT(inst->order <= MAX_DM_INSTANCE_ORDER);
+        for (i=0; i < inst->order; i++)
+        {
+            value = (unsigned)inst->instances[i];
+            blob[4*i+0] = (value >> 24) & 0xFF;
+            blob[4*i+1] = (value >> 16) & 0xFF;
+            blob[4*i+2] = (value >> 8) & 0xFF;
+            blob[4*i+3] = value & 0xFF;
+        }
+        err = sqlite3_bind_blob(stmt, index, blob, 4*inst->order, SQLITE_TRANSIENT);
+    }
+    else
+    {
+        FormInstanceString(inst, text, sizeof(text));
+        err = sqlite3_bind_text(stmt, index, text, SQLITE_ZERO_TERMINATED, SQLITE_TRANSIENT);
+    }
+
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** BindInstancePrefix
+**
+** Binds the value which prefixes the instances column of all child instances of the specified object instance, using the specified format
+** NOTE: In text format, the prefix includes the trailing '.' separator, so that (for example) instance 1 does not match instance 10
+**
+** \param   stmt - prepared statement to bind the value to
+** \param   index - index of the parameter in the prepared statement
+** \param   format - format of the instance numbers in the column (DB_INSTANCES_FORMAT_XXX)
+** \param   inst - pointer to instance numbers of the object instance
+** \param   prefix_len - pointer to variable in which to return the length (in bytes) of the bound prefix
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int BindInstancePrefix(sqlite3_stmt *stmt, int index, int format, dm_instances_t *inst, int *prefix_len)
+{
+    int err;
+    char text[MAX_DM_PATH];
+
+    // In blob format each instance number is a fixed size, so the prefix is the same as the instances of the object itself
+    if (format == DB_INSTANCES_FORMAT_BLOB)
+    {
+        *prefix_len = 4*inst->order;
+        return BindInstances(stmt, index, format, inst);
+    }
+
+    FormInstanceString(inst, text, sizeof(text));
+    if (inst->order > 0)
+    {
+        USP_STRNCPY(&text[strlen(text)], ".", sizeof(text)-strlen(text));
+    }
+    *prefix_len = strlen(text);
+
+    err = sqlite3_bind_text(stmt, index, text, SQLITE_ZERO_TERMINATED, SQLITE_TRANSIENT);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL_PARAM(db_handle, "sqlite3_bind");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ReadInstancesColumn
+**
+** Reads the instance numbers of a parameter from a column of the current row of a statement, using the specified format
+**
+** \param   stmt - statement, positioned on a row
+** \param   col - index of the column containing the instance numbers
+** \param   format - format of the instance numbers in the column (DB_INSTANCES_FORMAT_XXX)
+** \param   inst - pointer to structure in which to return the instance numbers
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if the instance numbers are invalid
+**
+**************************************************************************/
+int ReadInstancesColumn(sqlite3_stmt *stmt, int col, int format, dm_instances_t *inst)
+{
+    const unsigned char *blob;
+    char *text;
+    int len;
+    int i;
+
+    if (format == DB_INSTANCES_FORMAT_BLOB)
+    {
+        // Exit if the blob does not contain a whole number of instance numbers
+        blob = sqlite3_column_blob(stmt, col);
+        len = sqlite3_column_bytes(stmt, col);
+        if (((len % 4) != 0) || (len > 4*MAX_DM_INSTANCE_ORDER))
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        inst->order = len/4;
+        for (i=0; i < inst->order; i++)
+        {
+            inst->instances[i] = (int)( ((unsigned)blob[4*i+0] << 24) | ((unsigned)blob[4*i+1] << 16) |
+                                        ((unsigned)blob[4*i+2] << 8) | (unsigned)blob[4*i+3] );
+        }
+        return USP_ERR_OK;
+    }
+
+    text = (char *)sqlite3_column_text(stmt, col);
+    return ParseInstanceString(text, inst);
+}
+
+/*********************************************************************//**
+**
+** FormInstanceString
+**
+** Forms a string containing the instance numbers which have previously been parsed into the inst structure
+** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+**
+** \param   inst - pointer to instances structure
+** \param   buf - pointer to buffer into which to return the instnace string
+** \param   len - length of buffer in which to return the instance string
+**
+** \return  None
+**
+**************************************************************************/
+void FormInstanceString(dm_instances_t *inst, char *buf, int len)
+{
+    int i;
+    int offset;
+    int count;
+
+    offset = 0;
+    *buf = '\0';        // If no instances, make the buffer NULL terminated
+    
+    // Iterate over all instance numbers in the instance structure, building up the instance staing
+    for (i=0; i < inst->order; i++)
+    {
+        // Append the instance number to the string
+        if (i==0)
+        {
+            count = USP_SNPRINTF(&buf[offset], len, "%d", inst->instances[i]);  // First instance number, no separator
+        }
+        else
+        {
+            count = USP_SNPRINTF(&buf[offset], len, ".%d", inst->instances[i]); // Additional instance numbers need separator
+        }
+
+        // Exit USP Agent if USP_SNPRINTF failed
+        if (count <= 0)
+        {
+            USP_ERR_Terminate("%s(%d): USP_SNPRINTF failed", __FUNCTION__, __LINE__);
+        }
+
+        // Move to where we write the next instance number
+        offset += count;
+        len -= count;
+    }
+}
+
+/*********************************************************************//**
+**
+** ParseInstanceString
+**
+** Parses a string containing the instance numbers into the inst structure
+** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+**
+** \param   instances - pointer to string containing instances to parse
+** \param   inst - pointer to instances structure in which to return the parsed object instances
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INTERNAL_ERROR otherwise
+**
+**************************************************************************/
+int ParseInstanceString(char *instances, dm_instances_t *inst)
+{
+    char *p;
+    int value;
+
+    // Clear instances structure
+    inst->order = 0;
+
+    // Exit if instance string is empty
+    if ((instances == NULL) || (*instances == '\0'))
+    {
+        return USP_ERR_OK;
+    }
+
+    // Iterate over all instance numbers in the string
+    p = instances;
+    while (*p != '\0')
+    {
+        // Exit if too many instance numbers in the string
+        if (inst->order == MAX_DM_INSTANCE_ORDER)
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        // Exit if an error in parsing the next integer in the instance string
+        p = ParseInstanceInteger(p, &value);
+        if (p == NULL)
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+        
+        // Store this instance number in the array
+        inst->instances[ inst->order++ ] = value;
+    }
+
+    // If the code gets here, the instances string was parsed successfully
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ParseInstanceInteger
+**
+** Parses the next integer in the instance string
+** eg Device.WiFi.EndPoint.1.Profile.5.Enable would have an instance string of "1.5"
+**
+** \param   p - pointer to string containing the next integer
+** \param   p_value - pointer to variable in which to store the parsed value
+**
+** \return  pointer to next integer to parse in the string (after this one), or NULL if an error occurred in conversion
+**
+**************************************************************************/
+char *ParseInstanceInteger(char *p, int *p_value)
+{
+    int value = 0;
+    char c;
+
+    // Iterate over all characters in the integer, converting them and building up the integer value
+    c = *p;
+    while ((c != '\0') && (c != '.'))
+    {
+        // Exit if number contains characters other than digits
+        if ((c < '0') || (c > '9'))
+        {
+            return NULL;
+        }
+
+        value = value*10 + (c - '0');
+
+        // Move to next character in the string
+        p++;
+        c = *p;
+    }
+
+    // If the code gets here, then it has reached the end of the string, or a '.' separator
+    // Skip the '.' separator
+    if (c == '.')
+    {
+        p++;
+    }
+
+    *p_value = value;
+    return p;
+}
+
+/*********************************************************************//**
+**
+** MigrateInstancesFormat
+**
+** Converts the instances column of all rows in the data_model table to the selected format, if the database is in
+** a different format. The conversion is performed within a single transaction, so is never left partially completed
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int MigrateInstancesFormat(void)
 {
-    #define CHUNK_SIZE 1024             // source and destination files are read and written in byte sized chunks
-    unsigned char chunk[CHUNK_SIZE];
-    FILE *src = NULL;
-    FILE *dest = NULL;
-    char buf[128];
     int err;
-    int bytes_read;
-    int bytes_written;
+    int version;
+    int instances_format;
+    int hash_format;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    sqlite3_stmt *select_stmt = NULL;
+    sqlite3_stmt *insert_stmt = NULL;
+    dm_instances_t inst;
+    char sql[160];
+    int num_rows = 0;
 
-    // Exit if no file containing the factory reset database has been specified
-    // NOTE: This is not an error, as it could be the case if the database is supposed to be generated programatically
-    if ((reset_file == NULL) || (*reset_file == '\0'))
+    // Exit if unable to determine the format of the database
+    err = GetDatabaseVersion(&version);
+    if (err != USP_ERR_OK)
     {
-        err = USP_ERR_OK;
-        goto exit;
+        return err;
     }
 
-    // Exit if unable to open the factory reset file for reading
-    src = fopen(reset_file, "r");
-    if (src == NULL)
+    // Exit if the database was written in an unknown format
+    instances_format = DB_VERSION_INSTANCES_FORMAT(version);
+    hash_format = DB_VERSION_HASH_FORMAT(version);
+    if (((instances_format != DB_INSTANCES_FORMAT_TEXT) && (instances_format != DB_INSTANCES_FORMAT_BLOB)) ||
+        ((hash_format != DB_HASH_FORMAT_32BIT) && (hash_format != DB_HASH_FORMAT_64BIT)))
     {
-        USP_LOG_Error("%s: Failed to open factory reset database %s for reading: %s", __FUNCTION__, reset_file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        err = USP_ERR_INTERNAL_ERROR;
-        goto exit;
+        USP_ERR_SetMessage("%s: Database has unknown format (user_version=%d)", __FUNCTION__, version);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the database is already in the selected format
+    if (instances_format == db_instances_format)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to start the transaction containing the migration
+    err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Exit if unable to open the target database file for writing
-    dest = fopen(db_file, "w");
-    if (src == NULL)
+    // Exit if unable to create the table to copy the converted rows into
+    #define CREATE_MIGRATE_TABLE_STR "create table data_model_migrate (hash integer, instances %s, value text, primary key (hash, instances));"
+    USP_SNPRINTF(sql, sizeof(sql), CREATE_MIGRATE_TABLE_STR, (db_instances_format == DB_INSTANCES_FORMAT_BLOB) ? "blob" : "text");
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
     {
-        USP_LOG_Error("%s: Failed to open destination database %s for writing: %s", __FUNCTION__, db_file, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        err = USP_ERR_INTERNAL_ERROR;
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
         goto exit;
     }
 
-    // Exit if an error occurred whilst reading the first chunk of the source file
-    bytes_read = fread(chunk, 1, sizeof(chunk), src);
-    if (ferror(src) != 0)
+    // Exit if unable to prepare the statements used to copy the rows
+    err = sqlite3_prepare_v2(db_handle, "select hash,instances,value from data_model;", SQLITE_ZERO_TERMINATED, &select_stmt, NULL);
+    if (err == SQLITE_OK)
+    {
+        err = sqlite3_prepare_v2(db_handle, "insert into data_model_migrate(hash,instances,value) values(?1, ?2, ?3);", SQLITE_ZERO_TERMINATED, &insert_stmt, NULL);
+    }
+
+    if (err != SQLITE_OK)
     {
-        USP_LOG_Error("%s: Failed to read factory reset database %s", __FUNCTION__, reset_file);
-        err = USP_ERR_INTERNAL_ERROR;
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
         goto exit;
     }
 
-    // Write the destination file in chunks, exiting the loop when we've reached the end of the source file
-    while (bytes_read > 0)
+    // Iterate over all rows, converting the instance numbers into the selected format
+    while (FOREVER)
     {
-        // Exit if an error occurred whilst writing a chunk of the destination file
-        bytes_written = fwrite(chunk, 1, bytes_read, dest);
-        if (bytes_written != bytes_read)
+        err = sqlite3_step(select_stmt);
+        if (err == SQLITE_DONE)
+        {
+            break;
+        }
+        else if (err != SQLITE_ROW)
         {
-            USP_LOG_Error("%s: Failed to write destination database %s", __FUNCTION__, db_file);
-            err = USP_ERR_INTERNAL_ERROR;
+            USP_ERR_SQL(db_handle,"sqlite3_step");
             goto exit;
         }
 
-        // Exit if an error occurred whilst reading a chunk of the source file
-        bytes_read = fread(chunk, 1, sizeof(chunk), src);
-        if (ferror(src) != 0)
+        // Skip rows with invalid instance numbers, dropping them from the database
+        if (ReadInstancesColumn(select_stmt, 1, instances_format, &inst) != USP_ERR_OK)
         {
-            USP_LOG_Error("%s: Failed to read factory reset database %s", __FUNCTION__, reset_file);
-            err = USP_ERR_INTERNAL_ERROR;
+            USP_LOG_Warning("%s: Dropping parameter with invalid instance numbers (hash=%lld)", __FUNCTION__, (long long)sqlite3_column_int64(select_stmt, 0));
+            continue;
+        }
+
+        // Exit if unable to copy the row
+        err = sqlite3_bind_int64(insert_stmt, 1, sqlite3_column_int64(select_stmt, 0));
+        if ((err != SQLITE_OK) || (BindInstances(insert_stmt, 2, db_instances_format, &inst) != USP_ERR_OK) ||
+            (sqlite3_bind_value(insert_stmt, 3, sqlite3_column_value(select_stmt, 2)) != SQLITE_OK) ||
+            (sqlite3_step(insert_stmt) != SQLITE_DONE))
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
             goto exit;
         }
+        sqlite3_reset(insert_stmt);
+        num_rows++;
     }
 
-    // If the code gets here, then the factory reset database has been copied successfully
-    err = USP_ERR_OK;
+    // Exit if unable to replace the original table with the converted table
+    USP_SNPRINTF(sql, sizeof(sql), "drop table data_model; alter table data_model_migrate rename to data_model; pragma user_version=%d;", DB_VERSION(db_instances_format, hash_format));
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        goto exit;
+    }
+
+    result = USP_ERR_OK;
 
 exit:
-    if (dest != NULL)
+    sqlite3_finalize(select_stmt);     // NOTE: Passing NULL to sqlite3_finalize() is harmless
+    sqlite3_finalize(insert_stmt);
+
+    // Commit the migration if successful, otherwise leave the database unchanged
+    if (result == USP_ERR_OK)
     {
-        fclose(dest);
+        err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_exec");
+            result = USP_ERR_INTERNAL_ERROR;
+        }
     }
 
-    if (src != NULL)
+    if (result != USP_ERR_OK)
     {
-        fclose(src);
+        sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+        return result;
     }
 
-    return err;
+    USP_LOG_Info("%s: Converted %d database rows to %s instance numbers", __FUNCTION__, num_rows, (db_instances_format == DB_INSTANCES_FORMAT_BLOB) ? "blob" : "text");
+    return USP_ERR_OK;
 }
 
-#ifdef INCLUDE_PROGRAMMATIC_FACTORY_RESET
 /*********************************************************************//**
 **
-** ResetFactoryParameters
+** MigrateHashFormat
 **
-** Sets the parameters specified by VENDOR_GetFactoryResetParams()
+** Converts the hash column of all rows in the data_model table to the selected hash format, if the database is in
+** a different hash format. The conversion is performed within a single transaction, so is never left partially completed
+** NOTE: Rows for parameters which are not in the schema (or which cannot be identified because their old hash is
+**       shared by more than one parameter) are dropped, as there is no way to determine their hash in the new format
 **
 ** \param   None
 **
 ** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-int ResetFactoryParameters(void)
+int MigrateHashFormat(void)
 {
-    int i;
     int err;
-    kv_vector_t params;
-    kv_pair_t *kv;
+    int version;
+    int hash_format;
+    int result = USP_ERR_INTERNAL_ERROR;        // Assume an error
+    sqlite3_stmt *select_stmt = NULL;
+    sqlite3_stmt *insert_stmt = NULL;
+    dm_hash_mapping_t *mapping = NULL;
+    dm_hash_mapping_t *m;
+    int num_mappings;
+    dm_hash_t old_hash;
+    char sql[160];
+    int num_rows = 0;
+    int num_dropped = 0;
 
-    // Exit if unable to get the factory reset parameters
-    KV_VECTOR_Init(&params);
-    err = VENDOR_GetFactoryResetParams(&params);
+    // Exit if unable to determine the format of the database
+    err = GetDatabaseVersion(&version);
     if (err != USP_ERR_OK)
     {
         return err;
     }
 
-    USP_LOG_Info("%s: Setting factory reset parameters", __FUNCTION__);
-
-    // Set all factory reset parameters provided by the vendor in the database
-    for (i=0; i<params.num_entries; i++)
+    // Exit if the database is already in the selected hash format
+    // NOTE: The format of the database has already been validated by MigrateInstancesFormat()
+    hash_format = DB_VERSION_HASH_FORMAT(version);
+    if (hash_format == db_hash_format)
     {
-        kv = &params.vector[i];
+        return USP_ERR_OK;
+    }
 
-        // Exit if a parameter was not in the data model or failed to set    
-        err = DATA_MODEL_SetParameterInDatabase(kv->key, kv->value);
-        if (err != USP_ERR_OK)
-        {
-            goto exit;
-        }
+    // Exit if unable to commit any coalesced writes, as the migration must be performed in its own transaction
+    err = DATABASE_Flush();
+    if (err != USP_ERR_OK)
+    {
+        return err;
     }
 
-exit:
-    // Ensure that the parameters signalled by the vendor are freed
-    KV_VECTOR_Destroy(&params);
+    // Exit if unable to start the transaction containing the migration
+    err = sqlite3_exec(db_handle, "begin transaction;", NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-    return err;
-}
-#endif // INCLUDE_PROGRAMMATIC_FACTORY_RESET
+    // Exit if unable to create the table to copy the converted rows into
+    USP_SNPRINTF(sql, sizeof(sql), CREATE_MIGRATE_TABLE_STR, (db_instances_format == DB_INSTANCES_FORMAT_BLOB) ? "blob" : "text");
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        goto exit;
+    }
 
-/*********************************************************************//**
-**
-** ResetFactoryParametersFromFile
-**
-** Sets the data model parameters specified in the file
-**
-** \param   file - name of file containing parameters to set
-**
-** \return  USP_ERR_OK if successful
-**
-**************************************************************************/
-int ResetFactoryParametersFromFile(char *file)
-{
-    FILE *fp;
-    char *result;
-    char buf[MAX_DM_PATH + MAX_DM_VALUE_LEN + 4]; // Plus 4 to allow for separator, line ending characters and NULL terminator
-    int err;
-    char *key;
-    char *value;
-    int line_number = 1;
+    // Exit if unable to prepare the statements used to copy the rows
+    err = sqlite3_prepare_v2(db_handle, "select hash,instances,value from data_model;", SQLITE_ZERO_TERMINATED, &select_stmt, NULL);
+    if (err == SQLITE_OK)
+    {
+        err = sqlite3_prepare_v2(db_handle, "insert into data_model_migrate(hash,instances,value) values(?1, ?2, ?3);", SQLITE_ZERO_TERMINATED, &insert_stmt, NULL);
+    }
 
-    // Exit if unable to open the file containing factory reset parameters
-    fp = fopen(file, "r");
-    if (fp == NULL)
+    if (err != SQLITE_OK)
     {
-        USP_LOG_Error("%s: Failed to open factory reset file (%s)", __FUNCTION__, file);
-        return USP_ERR_INTERNAL_ERROR;
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
+        goto exit;
     }
 
-    // Iterate over all lines in the file
-    result = fgets(buf, sizeof(buf), fp);
-    while (result != NULL)
+    // Iterate over all rows, converting the hash of each parameter into the selected hash format
+    num_mappings = DATA_MODEL_GetDbHashMapping(hash_format, &mapping);
+    while (FOREVER)
     {
-        // Exit if an error occurred when parsing this line
-        err = TEXT_UTILS_KeyValueFromString(buf, &key, &value);
-        if (err != USP_ERR_OK)
+        err = sqlite3_step(select_stmt);
+        if (err == SQLITE_DONE)
         {
-            USP_LOG_Error("%s: Syntax error in %s at line %d", __FUNCTION__, file, line_number);
+            break;
+        }
+        else if (err != SQLITE_ROW)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
             goto exit;
         }
 
-        // Set the parameter (if the line was not blank or a comment)
-        if ((key != NULL) & (value != NULL))
+        // Skip rows which cannot be converted, dropping them from the database
+        old_hash = sqlite3_column_int64(select_stmt, 0);
+        m = FindDbHashMapping(mapping, num_mappings, old_hash);
+        if ((m == NULL) || (m->new_hash == 0))
         {
-            err = DATA_MODEL_SetParameterInDatabase(key, value);
-            if (err != USP_ERR_OK)
-            {
-                USP_LOG_Error("%s: Failed to set parameter at line %d of %s", __FUNCTION__, line_number, file);
-                goto exit;
-            }
+            USP_LOG_Warning("%s: Dropping unknown parameter (hash=%lld)", __FUNCTION__, (long long)old_hash);
+            num_dropped++;
+            continue;
         }
-        
-        // Get the next line
-        line_number++;
-        result = fgets(buf, sizeof(buf), fp);
+
+        // Exit if unable to copy the row
+        // NOTE: The instances column is copied unchanged, as it has already been converted to the selected format
+        err = sqlite3_bind_int64(insert_stmt, 1, m->new_hash);
+        if ((err != SQLITE_OK) || (sqlite3_bind_value(insert_stmt, 2, sqlite3_column_value(select_stmt, 1)) != SQLITE_OK) ||
+            (sqlite3_bind_value(insert_stmt, 3, sqlite3_column_value(select_stmt, 2)) != SQLITE_OK) ||
+            (sqlite3_step(insert_stmt) != SQLITE_DONE))
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_step");
+            goto exit;
+        }
+        sqlite3_reset(insert_stmt);
+        num_rows++;
     }
 
-    // If the code gets here, then all parameters in the file have been set successfully
-    err = USP_ERR_OK;
+    // Exit if unable to replace the original table with the converted table
+    USP_SNPRINTF(sql, sizeof(sql), "drop table data_model; alter table data_model_migrate rename to data_model; pragma user_version=%d;", DB_VERSION(db_instances_format, db_hash_format));
+    err = sqlite3_exec(db_handle, sql, NULL, NULL, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_exec");
+        goto exit;
+    }
+
+    result = USP_ERR_OK;
 
 exit:
-    fclose(fp);
-    return err;
+    sqlite3_finalize(select_stmt);     // NOTE: Passing NULL to sqlite3_finalize() is harmless
+    sqlite3_finalize(insert_stmt);
+    USP_SAFE_FREE(mapping);
+
+    // Commit the migration if successful, otherwise leave the database unchanged
+    if (result == USP_ERR_OK)
+    {
+        err = sqlite3_exec(db_handle, "commit transaction;", NULL, NULL, NULL);
+        if (err != SQLITE_OK)
+        {
+            USP_ERR_SQL(db_handle,"sqlite3_exec");
+            result = USP_ERR_INTERNAL_ERROR;
+        }
+    }
+
+    if (result != USP_ERR_OK)
+    {
+        sqlite3_exec(db_handle, "rollback;", NULL, NULL, NULL);
+        return result;
+    }
+
+    // Discard any values cached before the migration, as they are keyed by the old hashes
+    FreeDbCache();
+
+    USP_LOG_Info("%s: Converted %d database rows to %s hashes (dropped %d rows)", __FUNCTION__, num_rows, (db_hash_format == DB_HASH_FORMAT_64BIT) ? "64 bit" : "32 bit", num_dropped);
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** LogSQLStatement
+** FindDbHashMapping
 **
-** Logs the SQL Statement used for the specified operation
-** This is useful for debugging purposes
+** Finds the mapping for the specified old hash, using a binary search
 **
-** \param   op - string representing the operation being performed
-** \param   path - data model path involved in the operation
-** \param   stmt - prepared statement with bound values
+** \param   mapping - pointer to array of mappings, sorted by old hash (see DATA_MODEL_GetDbHashMapping)
+** \param   num_mappings - number of entries in the array
+** \param   old_hash - hash in the old hash format to find
 **
-** \return  None
+** \return  pointer to mapping, or NULL if no mapping was found
 **
 **************************************************************************/
-void LogSQLStatement(char *op, char *path, sqlite3_stmt *stmt)
+dm_hash_mapping_t *FindDbHashMapping(dm_hash_mapping_t *mapping, int num_mappings, dm_hash_t old_hash)
 {
-#if SQLITE_VERSION_NUMBER >= 3014000
-    char *sql_str;
+    int low = 0;
+    int high = num_mappings - 1;
+    int mid;
 
-    sql_str = sqlite3_expanded_sql(stmt);
-    USP_LOG_Info("%s(%s): %s", op, path, sql_str);
-    sqlite3_free(sql_str);
-#endif // SQLITE_VERSION_NUMBER
+    while (low <= high)
+    {
+        mid = low + (high - low)/2;
+        if (mapping[mid].old_hash == old_hash)
+        {
+            return &mapping[mid];
+        }
 
-    // Ensure that compiler does not complain about unused arguments if SQLITE_VERSION_NUMBER < 3014000
-    (void)op;
-    (void)path;
-    (void)stmt;
+        if (mapping[mid].old_hash < old_hash)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return NULL;
 }
 
 /*********************************************************************//**
 **
-** ObfuscatedCopy
+** GetDatabaseVersion
 **
-** Copies the specified source value into the destination buffer, 
-** whilst obfuscating/unobfuscating it
-** NOTE: Obfuscation may result in embedded NULLs within the destination, or
-**       be the cause of embedded NULLs in the src
+** Reads the user_version of the database, which identifies the format of the instances and hash columns in the data_model table
 **
-** \param   dest - pointer to buffer in which to copy the unobfuscated value
-** \param   src - pointer to value to unobfuscate
-** \param   len - length of value
+** \param   version - pointer to variable in which to return the version
 **
-** \return  None
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
 **
 **************************************************************************/
-void ObfuscatedCopy(unsigned char *dest, unsigned char *src, int len)
+int GetDatabaseVersion(int *version)
 {
-    int i;
+    sqlite3_stmt *stmt;
+    int err;
+    int result = USP_ERR_INTERNAL_ERROR;
 
-    unsigned char *key = (unsigned char *) PASSWORD_OBFUSCATION_KEY;
-    int key_len;
+    err = sqlite3_prepare_v2(db_handle, "pragma user_version;", SQLITE_ZERO_TERMINATED, &stmt, NULL);
+    if (err != SQLITE_OK)
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_prepare_v2");
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-    key_len = strlen((char *) key);
-    for (i=0; i<len; i++)
+    err = sqlite3_step(stmt);
+    if (err == SQLITE_ROW)
     {
-        *dest = (*src) ^ key[ i % key_len ];
-        dest++;
-        src++;
+        *version = sqlite3_column_int(stmt, 0);
+        result = USP_ERR_OK;
+    }
+    else
+    {
+        USP_ERR_SQL(db_handle,"sqlite3_step");
     }
+
+    sqlite3_finalize(stmt);
+    return result;
 }
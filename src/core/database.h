@@ -49,19 +49,31 @@
 // String, set by '-r' command line option to specify a text file containing the factory reset database parameters
 extern char *factory_reset_text_file;
 
+//------------------------------------------------------------------------------
+// String, set by '-R' command line option to specify a prebuilt SQLite database to restore when the database is factory reset
+extern char *factory_reset_db_file;
+
 //------------------------------------------------------------------------------
 // API
 int DATABASE_Init(char *db_file);
 int DATABASE_Start(void);
 void DATABASE_Destroy(void);
 void DATABASE_PerformFactoryReset_ControllerInitiated(void);
-int DATABASE_GetParameterValue(char *path, dm_hash_t hash, char *instances, char *buf, int buflen, unsigned flags);
-int DATABASE_SetParameterValue(char *path, dm_hash_t hash, char *instances, char *new_value, unsigned flags);
-int DATABASE_DeleteParameter(char *path, dm_hash_t hash, char *instances);
+int DATABASE_GetParameterValue(char *path, dm_hash_t hash, dm_instances_t *inst, char *buf, int buflen, unsigned flags);
+int DATABASE_GetParameterValueAlloc(char *path, dm_hash_t hash, dm_instances_t *inst, char **value, unsigned flags);
+int DATABASE_SetParameterValue(char *path, dm_hash_t hash, dm_instances_t *inst, char *new_value, unsigned flags);
+int DATABASE_DeleteParameter(char *path, dm_hash_t hash, dm_instances_t *inst);
+int DATABASE_DeleteInstanceParams(char *path, dm_hash_t *hashes, int num_hashes, dm_instances_t *inst);
 int DATABASE_StartTransaction(void);
 int DATABASE_CommitTransaction(void);
 int DATABASE_AbortTransaction(void);
+int DATABASE_Flush(void);
+void DATABASE_SetVolatileWrites(bool enable);
 void DATABASE_Dump(void);
+void DATABASE_DumpCache(void);
+int DATABASE_ExportSnapshot(char *file, int *num_rows);
+int DATABASE_ImportSnapshot(char *file, bool replace, int *num_rows);
+bool DATABASE_IsSnapshotFile(char *file);
 int DATABASE_ReadDataModelInstanceNumbers(bool remove_unknown_params);
 
 #endif
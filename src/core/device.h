@@ -82,6 +82,39 @@ typedef struct
     bool is_firmware_updated;       // whether the last reboot caused a different firmware image to run
 } reboot_info_t;
 
+//------------------------------------------------------------------------------
+// Enumeration of the stages in the lifetime of a USP message, which are timed by the message statistics
+typedef enum
+{
+    kMsgStat_QueueWait,         // Time from the MTP receiving the USP record, until it starts to be processed
+    kMsgStat_Handle,            // Time taken to process the received USP message (including generating the response)
+    kMsgStat_Serialize,         // Time taken to serialize the USP message being sent into its USP record
+    kMsgStat_SendQueueWait,     // Time from the USP record being queued on the MTP, until the MTP starts to send it
+    kMsgStat_WireSend,          // Time taken by the MTP to send the USP record (for CoAP, until the last block is acknowledged)
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kMsgStat_Max
+} msg_stat_t;
+
+//------------------------------------------------------------------------------
+// Enumeration of the times recorded during startup of the agent
+// Phases of the startup sequence are recorded as durations. Milestones are recorded as the time since the agent process started.
+typedef enum
+{
+    kBootTime_Libraries,            // Phase: Initialising libraries (eg curl)
+    kBootTime_Database,             // Phase: Opening the database
+    kBootTime_MsgQueues,            // Phase: Initialising the message queues used by the threads
+    kBootTime_DataModelInit,        // Phase: Registering the data model schema
+    kBootTime_DataModelStart,       // Phase: Starting all data model components
+    kBootTime_MtpStart,             // Phase: Starting the STOMP connections and MQTT clients
+    kBootTime_Threads,              // Phase: Starting the MTP, BDC and Get worker threads
+    kBootTime_FirstMtpConnected,    // Milestone: First STOMP, MQTT or WebSocket client connection to a controller (or broker) is up
+    kBootTime_BootEventSent,        // Milestone: First Boot! event notification has been queued for sending
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kBootTime_Max
+} boot_time_t;
+
 //------------------------------------------------------------------------------
 // Structure specifying the destination that a response to a USP message must be sent
 typedef struct
@@ -104,6 +137,16 @@ typedef struct
                                         // that the USP response must be sent back on a new DTLS session also. Wihout this, 
                                         // the CoAP retry mechanism will cause the DTLS session to restart, but it is a while
                                         // before the retry is triggered, so this hint speeds up communications
+
+    // Following member variables only set if USP message was received over MQTT
+    int mqtt_instance;                  // Instance number of the MQTT client in Device.MQTT.Client.{i} that the USP message was received on
+    char *mqtt_topic;                   // Response Topic specified in the received PUBLISH packet (only set if reply_to was specified)
+
+    unsigned long long rx_time;         // Time (in microseconds, from tu_uptime_usecs()) at which the USP record was received, or 0 if not known
+    unsigned replay_id;                 // Identifies the USP record being replayed from a protocol capture file (see REPLAY_Init), or 0 if not replayed
+
+    mtp_send_priority_t send_priority;  // Priority of the USP message in the MTP send queue. This is only specified by the caller for notifications
+                                        // (see MTP_SEND_QUEUE_CalcPriority). If unspecified (zero) a notification is sent with kMtpSendPriority_Event
 } mtp_reply_to_t;
 
 //------------------------------------------------------------------------------
@@ -132,6 +175,7 @@ int DEVICE_CONTROLLER_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, char
 char *DEVICE_CONTROLLER_FindEndpointIdByInstance(int instance);
 int DEVICE_CONTROLLER_GetCombinedRole(int instance, combined_role_t *combined_role);
 int DEVICE_CONTROLLER_GetCombinedRoleByEndpointId(char *endpoint_id, combined_role_t *combined_role);
+unsigned DEVICE_CONTROLLER_GetRoleGeneration(void);
 void DEVICE_CONTROLLER_SetRolesFromStomp(int stomp_instance, ctrust_role_t role, char *allowed_controllers);
 int DEVICE_CONTROLLER_GetSubsRetryParams(char *endpoint_id, unsigned *min_wait_interval, unsigned *interval_multiplier);
 void DEVICE_CONTROLLER_NotifyStompConnDeleted(int stomp_instance);
@@ -147,19 +191,38 @@ int DEVICE_STOMP_Init(void);
 int DEVICE_STOMP_Start(void);
 void DEVICE_STOMP_Stop(void);
 int DEVICE_STOMP_StartAllConnections(void);
-int DEVICE_STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, char *err_id_header, time_t expiry_time);
+int DEVICE_STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, char *err_id_header, mtp_send_priority_t priority, time_t expiry_time);
 void DEVICE_STOMP_ScheduleReconnect(int instance);
 mtp_status_t DEVICE_STOMP_GetMtpStatus(int instance);
 int DEVICE_STOMP_CountEnabledConnections(void);
 void DEVICE_STOMP_GetDestinationFromServer(int instance, char *buf, int len);
+#ifdef ENABLE_MQTT
+int DEVICE_MQTT_Init(void);
+int DEVICE_MQTT_Start(void);
+void DEVICE_MQTT_Stop(void);
+int DEVICE_MQTT_StartAllClients(void);
+int DEVICE_MQTT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *topic, unsigned char *pbuf, int pbuf_len, mtp_send_priority_t priority, time_t expiry_time);
+void DEVICE_MQTT_ScheduleReconnect(int instance);
+mtp_status_t DEVICE_MQTT_GetMtpStatus(int instance);
+void DEVICE_CONTROLLER_NotifyMqttClientDeleted(int mqtt_instance);
+int DEVICE_MTP_ValidateMqttReference(dm_req_t *req, char *value);
+int DEVICE_MTP_GetMqttReference(char *path, int *mqtt_client_instance);
+char *DEVICE_MTP_GetAgentMqttResponseTopic(int mqtt_instance);
+void DEVICE_MTP_NotifyMqttClientDeleted(int mqtt_instance);
+#endif
 int DEVICE_SUBSCRIPTION_Init(void);
 int DEVICE_SUBSCRIPTION_Start(void);
 void DEVICE_SUBSCRIPTION_Stop(void);
 void DEVICE_SUBSCRIPTION_Update(int id);
 void DEVICE_SUBSCRIPTION_ProcessAllOperationCompleteSubscriptions(char *command, char *command_key, int err_code, char *err_msg, kv_vector_t *output_args);
-void DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(void);
+void DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(char *obj_path);
 void DEVICE_SUBSCRIPTION_NotifyObjectLifeEvent(char *obj_path, subs_notify_t notify_type);
+void DEVICE_SUBSCRIPTION_NotifyObjectLifeEvents(str_vector_t *obj_paths, subs_notify_t notify_type);
 void DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions(void);
+bool DEVICE_SUBSCRIPTION_AreEventsPending(void);
+void DEVICE_SUBSCRIPTION_NotifyDbParamChanged(char *path);
+void DEVICE_SUBSCRIPTION_ProcessDbValueChanges(void);
+void DEVICE_SUBSCRIPTION_NotifyValueChanged(char *path, char *value);
 void DEVICE_SUBSCRIPTION_ProcessAllEventCompleteSubscriptions(char *event_name, kv_vector_t *output_args);
 void DEVICE_SUBSCRIPTION_SendPeriodicEvent(int cont_instance);
 void DEVICE_SUBSCRIPTION_Dump(void);
@@ -183,7 +246,7 @@ ctrust_role_t DEVICE_CTRUST_GetRoleFromInstance(int instance);
 int DEVICE_CTRUST_AddPermissions(ctrust_role_t role, char *path, unsigned short permission_bitmask);
 void DEVICE_CTRUST_RegisterRoleName(ctrust_role_t role, char *name);
 int DEVICE_REQUEST_Init(void);
-int DEVICE_REQUEST_Add(char *path, char *command_key, int *instance);
+int DEVICE_REQUEST_Add(char *path, char *command_key, bool persist, int *instance);
 void DEVICE_REQUEST_OperationComplete(int instance, int err_code, char *err_msg, kv_vector_t *output_args);
 void DEVICE_REQUEST_UpdateOperationStatus(int instance, char *status);
 int DEVICE_REQUEST_RestartAsyncOperations(void);
@@ -192,6 +255,15 @@ int DEVICE_BULKDATA_Init(void);
 int DEVICE_BULKDATA_Start(void);
 void DEVICE_BULKDATA_Stop(void);
 void DEVICE_BULKDATA_NotifyTransferResult(int profile_id, bdc_transfer_result_t transfer_result);
+int DEVICE_MSG_STATS_Init(void);
+int DEVICE_MSG_STATS_Start(void);
+void DEVICE_MSG_STATS_Record(Usp__Header__MsgType msg_type, msg_stat_t stat, unsigned long long start_time);
+void DEVICE_MSG_STATS_RecordDuration(Usp__Header__MsgType msg_type, msg_stat_t stat, unsigned long long duration);
+void DEVICE_MSG_STATS_Dump(void);
+void DEVICE_MSG_STATS_StartBootTiming(void);
+void DEVICE_MSG_STATS_RecordBootPhase(boot_time_t phase, unsigned long long start_time);
+void DEVICE_MSG_STATS_RecordBootMilestone(boot_time_t milestone);
+void DEVICE_MSG_STATS_DumpBootTiming(void);
 #ifndef REMOVE_SELF_TEST_DIAG_EXAMPLE
 int DEVICE_SELF_TEST_Init(void);
 #endif
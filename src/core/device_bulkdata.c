@@ -51,12 +51,13 @@
 #include "msg_handler.h"
 #include "path_resolver.h"
 #include "dm_access.h"
-#include "json.h"
 #include "sync_timer.h"
 #include "iso8601.h"
 #include "text_utils.h"
 #include "retry_wait.h"
 #include "bdc_exec.h"
+#include "dllist.h"
+#include "device.h"
 
 //------------------------------------------------------------------------------
 // String versions of defines in vendor_defs.h
@@ -65,16 +66,35 @@
 
 //------------------------------------------------------------------------------
 // Definitions for formats that we support
-#define BULKDATA_PROTOCOL "HTTP"
-#define BULKDATA_ENCODING_TYPE "JSON"
+#define BULKDATA_PROTOCOL_HTTP "HTTP"
+#define BULKDATA_PROTOCOL_USP_EVENT "USPEventNotif"
+#define BULKDATA_PROTOCOL BULKDATA_PROTOCOL_HTTP
+#define BULKDATA_PROTOCOLS_SUPPORTED BULKDATA_PROTOCOL_HTTP "," BULKDATA_PROTOCOL_USP_EVENT
+#define BULKDATA_ENCODING_TYPE_JSON "JSON"
+#define BULKDATA_ENCODING_TYPE_CSV  "CSV"
+#define BULKDATA_ENCODING_TYPE BULKDATA_ENCODING_TYPE_JSON
+#define BULKDATA_ENCODING_TYPES_SUPPORTED BULKDATA_ENCODING_TYPE_CSV "," BULKDATA_ENCODING_TYPE_JSON
 #define BULKDATA_JSON_REPORT_FORMAT "NameValuePair"
 
+// Definitions for Device.BulkData.Profile.{i}.JSONEncoding.ReportFormat
+#define BULKDATA_JSON_REPORT_FORMAT_NAME_VALUE_PAIR   BULKDATA_JSON_REPORT_FORMAT
+#define BULKDATA_JSON_REPORT_FORMAT_OBJECT_HIERARCHY  "ObjectHierarchy"
+
 
 // Definitions for Device.BulkData.Profile.{i}.JSONEncoding.ReportTimestamp
 #define BULKDATA_JSON_TIMESTAMP_FORMAT_EPOCH   "Unix-Epoch"
 #define BULKDATA_JSON_TIMESTAMP_FORMAT_ISO8601 "ISO-8601"
 #define BULKDATA_JSON_TIMESTAMP_FORMAT_NONE    "None"
 
+// Definitions for Device.BulkData.Profile.{i}.CSVEncoding.ReportFormat
+#define BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_ROW     "ParameterPerRow"
+#define BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_COLUMN  "ParameterPerColumn"
+
+// Default values for Device.BulkData.Profile.{i}.CSVEncoding. These are XML escaped, as specified by TR-181
+#define BULKDATA_CSV_DEFAULT_FIELD_SEPARATOR   ","
+#define BULKDATA_CSV_DEFAULT_ROW_SEPARATOR     "&#13;&#10;"
+#define BULKDATA_CSV_DEFAULT_ESCAPE_CHARACTER  "&quot;"
+
 // Definitions for Device.BulkData.Profile.{i}.HTTP.Method
 #define BULKDATA_HTTP_METHOD_POST       "POST"
 #define BULKDATA_HTTP_METHOD_PUT        "PUT"
@@ -83,12 +103,33 @@
 
 //---------------------------------------------------------------------------------------------
 // Structure representing a report
+// NOTE: The report map's vector, keys and values are all packed into the same allocation as this structure (see bulkdata_pack_report)
+//       to minimise the memory overhead of retaining reports. So the report map must not be destroyed with KV_VECTOR_Destroy()
 typedef struct
 {
+    double_link_t link;         // Doubly linked list pointers. These must always be first in this structure
     time_t collection_time;     // time at which the report was collected
-    kv_vector_t  report_map;    // Map containing parameter path vs JSON type+parameter value
+    kv_vector_t  report_map;    // Map containing parameter path vs type code+parameter value
+    int mem_size;               // Number of bytes allocated to store this report. This is counted against BULKDATA_MAX_RETAINED_REPORTS_MEMORY
 } report_t;
 
+// Type codes stored as the first character of each value in a report map
+// These determine how the value is written in JSON reports, and the ParameterType written in CSV reports
+#define BULKDATA_TYPE_STRING        'S'
+#define BULKDATA_TYPE_DATETIME      'D'
+#define BULKDATA_TYPE_BOOL          'B'
+#define BULKDATA_TYPE_INT           'I'
+#define BULKDATA_TYPE_UINT          'U'
+#define BULKDATA_TYPE_ULONG         'L'
+
+//---------------------------------------------------------------------------------------------
+// Digest of a parameter in a report. Used in delta mode to only report the parameters which have changed since the last report that was sent successfully
+typedef struct
+{
+    uint64_t name_hash;         // 64 bit hash of the name of the parameter in the report (see TEXT_UTILS_CalcHash64)
+    uint64_t value_hash;        // 64 bit hash of the type code and value of the parameter
+} bulkdata_digest_t;
+
 //---------------------------------------------------------------------------------------------
 // Structure representing enabled profiles
 typedef struct
@@ -100,36 +141,100 @@ typedef struct
     // Cached versions of parameters from the data model for this profile
     int reporting_interval;
     time_t time_reference;
+    time_t stagger_offset;          // Number of seconds that reports are delayed from the times given by time_reference (see BULKDATA_STAGGER_WINDOW)
     bool retry_enable;
     unsigned retry_minimum_wait_interval;
     unsigned retry_interval_multiplier;
 
     // The following variables are only used when the profile is started (ie enabled)
-    report_t reports[BULKDATA_MAX_RETAINED_FAILED_REPORTS+1]; // Plus 1 because this array includes failed reports + current report
+    double_linked_list_t reports;   // Linked list of retained failed reports + current report (oldest first)
     int num_retained_reports;
     unsigned retry_count;           // Number of failed attempts. Count of what the next retry attempt will be. After a failed send, this starts counting from 1.
 
+    // The following variables are only used in delta mode (see Device.BulkData.Profile.{i}.X_ARRIS-COM_DeltaEnable)
+    bulkdata_digest_t *acked_digests;   // Digests of all parameters at the time of the last report that was sent successfully, sorted by name_hash
+    int num_acked_digests;
+    bulkdata_digest_t *pending_digests; // Digests of all parameters at the time of the last report generated. These become the acked digests once the report has been sent successfully
+    int num_pending_digests;
+    time_t pending_time;            // Collection time of the last report generated, or 0 if there are no pending digests
+    bool is_pending_full;           // Set if the last report generated contained all parameters (rather than only those which had changed)
+    time_t last_full_report_time;   // Collection time of the last full report that was sent successfully, or 0 if none has been sent since the profile started
+
 } bulkdata_profile_t;
 
 //---------------------------------------------------------------------------------------------
 // Bulkdata library global context
 static bulkdata_profile_t bulkdata_profiles[BULKDATA_MAX_PROFILES];
 
+// Number of bytes used to store reports, summed across all profiles
+static int bulkdata_reports_mem_used = 0;
+
 //---------------------------------------------------------------------------------------------
 // Structure containing retrieved controlling parameters for a specific profile
 // String sizes are taken from TR-181
 typedef struct
 {
     int num_retained_failed_reports;
-    char report_timestamp[33];
+    char protocol[17];
+    char encoding_type[9];
+    char report_format[33];     // JSONEncoding.ReportFormat or CSVEncoding.ReportFormat, depending on encoding_type
+    char report_timestamp[33];  // JSONEncoding.ReportTimestamp or CSVEncoding.RowTimestamp, depending on encoding_type
+    char csv_field_separator[3];// CSV separator and escape characters, with XML escaping removed. Only used for CSV encoding
+    char csv_row_separator[3];
+    char csv_escape_char[3];
     char url[1025];
     char username[257];
     char password[257];
     char compression[9];
     char method[9];
     bool use_date_header;
+    bool delta_enable;              // Set if only parameters which have changed since the last successfully sent report should be reported
+    unsigned full_report_interval;  // In delta mode, minimum number of seconds between reports containing all parameters. 0 = only the first report after the profile starts
 } profile_ctrl_params_t;
 
+//---------------------------------------------------------------------------------------------
+// Immutable snapshot of a profile's reports, passed from the data model thread to the BDC thread
+// The BDC thread generates (and compresses) the report from the snapshot, so that serialization does not block the data model thread
+// NOTE: The reports in the snapshot are copies, because the profile's retained reports may be freed by the data model thread whilst the BDC thread is generating the report
+typedef struct
+{
+    double_linked_list_t reports;   // Copies of all reports (retained + current) of the profile (oldest first)
+    profile_ctrl_params_t ctrl;     // Copy of the controlling parameters of the profile, at the time the snapshot was taken
+} bulkdata_snapshot_t;
+
+//---------------------------------------------------------------------------------------------
+// Structure used to write the report directly into a growable output buffer (without building a JSON tree first)
+// If compressing, the report text is instead deflated into a list of fixed size chunks as it is written, and buf is only a staging buffer
+typedef struct
+{
+    char *buf;          // Buffer containing the NULL terminated report text written so far (or not yet compressed). Allocated with malloc() (not USP_MALLOC) because it is passed to the BDC thread
+                        // NOTE: buf is set to NULL if an allocation or compression fails, after which all further writes are ignored
+    int len;            // Number of characters written into buf (excluding the NULL terminator)
+    int max_len;        // Allocated size of buf
+    bool is_compressing;            // Set if the report text is being compressed into chunks as it is written
+    z_stream zlib_ctx;              // zlib context used to compress the report text. Only used if is_compressing
+    bdc_report_chunk_t *chunks;     // Linked list of chunks containing the compressed report. Only used if is_compressing
+    bdc_report_chunk_t *last_chunk; // Last chunk in the linked list. This is the chunk currently being filled by zlib
+} report_writer_t;
+
+// Size of each chunk of a compressed report, and of the staging buffer holding report text waiting to be compressed
+#define BULKDATA_REPORT_CHUNK_SIZE 16384
+
+// Current time (in seconds), as seen by the sync timer
+// NOTE: time() may lag the clock used by the sync timer by a few milliseconds, so scheduling a profile's
+// sync timer relative to time() could cause it to fire again immediately after a report has been sent synchronously
+#define BULKDATA_CUR_TIME()  ((time_t)(SYNC_TIMER_TimeMs()/1000))
+
+// Maximum depth of nested objects in an ObjectHierarchy format report. Each path segment (including instance numbers) is a level.
+#define MAX_JSON_OBJECT_DEPTH (2*MAX_PATH_SEGMENTS)
+
+//------------------------------------------------------------------------------
+// Array of arguments sent in Device.BulkData.Profile.{i}.Push! event
+static char *push_event_args[] =
+{
+    "Data",
+};
+
 //------------------------------------------------------------------------------
 // Global enable for all collection profiles (Device.BulkData.Enable)
 static bool global_enable = false;
@@ -155,6 +260,11 @@ int Validate_AddBulkDataProfile(dm_req_t *req);
 int Validate_NumberOfRetainedFailedReports(dm_req_t *req, char *value);
 int Validate_BulkDataProtocol(dm_req_t *req, char *value);
 int Validate_BulkDataEncodingType(dm_req_t *req, char *value);
+int Validate_BulkDataCSVReportFormat(dm_req_t *req, char *value);
+int Validate_BulkDataCSVFieldSeparator(dm_req_t *req, char *value);
+int Validate_BulkDataCSVRowSeparator(dm_req_t *req, char *value);
+int Validate_BulkDataCSVEscapeCharacter(dm_req_t *req, char *value);
+int bulkdata_unescape_csv_char(char *value, char *buf, int len);
 int Validate_BulkDataReportingInterval(dm_req_t *req, char *value);
 int Validate_BulkDataReference(dm_req_t *req, char *value);
 int Validate_BulkDataReportFormat(dm_req_t *req, char *value);
@@ -180,22 +290,58 @@ void ProcessBulkDataProfileDeleted(bulkdata_profile_t *bp);
 int bulkdata_stop_profile(bulkdata_profile_t *bp);
 void bulkdata_process_profile(int id);
 void bulkdata_process_profile_work(bulkdata_profile_t *bp);
+void bulkdata_send_push_event(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl);
 bulkdata_profile_t *bulkdata_find_free_profile(void);
 bulkdata_profile_t *bulkdata_find_profile(int profile_id);
 int bulkdata_calc_report_map(bulkdata_profile_t *bp, kv_vector_t *report_map);
 int bulkdata_append_to_result_map(char *origin_path, char *alt_name, kv_vector_t *param_values, kv_vector_t *report_map);
+char bulkdata_calc_param_type_code(char *path);
+char *bulkdata_param_type_code_to_str(char type);
 int bulkdata_reduce_to_alt_name(char *spec, char *path, char *alt_name, char *out_buf, int buf_len);
-char *bulkdata_generate_json_report(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl);
-unsigned char *bulkdata_compress_report(profile_ctrl_params_t *ctrl, char *input_buf, int input_len, int *p_output_len);
-int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profile_t *bp, unsigned char *json_report, int report_len);
+bdc_report_chunk_t *bulkdata_generate_report(double_linked_list_t *reports, profile_ctrl_params_t *ctrl, bool compress, int *p_report_len);
+void bulkdata_write_json_report(report_writer_t *jw, double_linked_list_t *reports, profile_ctrl_params_t *ctrl);
+void bulkdata_write_csv_report(report_writer_t *jw, double_linked_list_t *reports, profile_ctrl_params_t *ctrl);
+void bulkdata_csv_write_timestamp(report_writer_t *jw, profile_ctrl_params_t *ctrl, time_t collection_time);
+void bulkdata_csv_write_header(report_writer_t *jw, profile_ctrl_params_t *ctrl, kv_vector_t *report_map);
+bool bulkdata_csv_is_same_columns(kv_vector_t *map1, kv_vector_t *map2);
+void bulkdata_csv_write_field(report_writer_t *jw, profile_ctrl_params_t *ctrl, char *str, bool is_first);
+int bulkdata_writer_init(report_writer_t *jw, int max_len, bool compress);
+bdc_report_chunk_t *bulkdata_writer_finish(report_writer_t *jw, int *p_report_len);
+void bulkdata_writer_abort(report_writer_t *jw);
+void bulkdata_writer_deflate(report_writer_t *jw, char *str, int len, int flush);
+void bulkdata_json_write_object_hierarchy(report_writer_t *jw, kv_vector_t *report_map, int indent, bool *is_first);
+bool bulkdata_json_write_member(report_writer_t *jw, char *key, int key_len, char *param_type_value, int indent, bool *is_first);
+void bulkdata_json_open_member(report_writer_t *jw, char *key, int key_len, int indent, bool *is_first);
+void bulkdata_json_close(report_writer_t *jw, char close_char, int indent, bool is_empty);
+void bulkdata_json_write_string(report_writer_t *jw, char *str, int len);
+void bulkdata_json_write_number(report_writer_t *jw, double value);
+void bulkdata_json_write_indent(report_writer_t *jw, int indent);
+void bulkdata_writer_puts(report_writer_t *jw, char *str, int len);
+int bulkdata_compare_report_keys(const void *entry1, const void *entry2);
+bdc_report_chunk_t *bulkdata_compress_report(char *input_buf, int input_len, int *p_output_len);
+int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profile_t *bp, bulkdata_snapshot_t *snapshot);
+bulkdata_snapshot_t *bulkdata_take_snapshot(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl);
+bdc_report_chunk_t *bulkdata_generate_snapshot_report(void *snapshot, int *p_report_len, unsigned *flags);
+void bulkdata_free_snapshot(void *snapshot);
 int bulkdata_start_profile(bulkdata_profile_t *bp);
 int bulkdata_resync_profile(bulkdata_profile_t *bp, int *delta_time);
 unsigned bulkdata_calc_waittime_to_next_send(bulkdata_profile_t *bp);
 unsigned bulkdata_calc_waittime_to_next_reporting_interval(time_t interval, time_t time_reference);
+time_t bulkdata_calc_stagger_offset(int profile_id);
 void bulkdata_clear_retained_reports(bulkdata_profile_t *bp);
+void bulkdata_calc_delta_report(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl, kv_vector_t *report_map, time_t collection_time);
+void bulkdata_commit_digests(bulkdata_profile_t *bp);
+void bulkdata_free_digests(bulkdata_profile_t *bp);
+int bulkdata_compare_digests(const void *entry1, const void *entry2);
+report_t *bulkdata_pack_report(kv_vector_t *report_map, time_t collection_time);
+report_t *bulkdata_clone_report(report_t *src);
+void bulkdata_add_report(bulkdata_profile_t *bp, report_t *report);
+void bulkdata_free_report(bulkdata_profile_t *bp, report_t *report);
 void bulkdata_drop_oldest_retained_reports(bulkdata_profile_t *bp, int num_reports_to_keep);
 int bulkdata_platform_get_uri_query_name_map(int profile_id, kv_vector_t *name_map);
+int bulkdata_platform_get_csv_control_params(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl_params);
 int bulkdata_platform_calc_uri_query_escaped_map(kv_vector_t *name_map, kv_vector_t *escaped_map);
+int bulkdata_platform_get_resolved_param(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg);
 char *bulkdata_platform_calc_uri_query_string(kv_vector_t *escaped_map);
 
 /*********************************************************************//**
@@ -228,8 +374,8 @@ int DEVICE_BULKDATA_Init(void)
     err = USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Enable", "false", NULL, NotifyChange_BulkDataGlobalEnable, DM_BOOL);
     err |= USP_REGISTER_VendorParam_ReadOnly("Device.BulkData.Status", Get_BulkDataGlobalStatus, DM_STRING);
     err |= USP_REGISTER_Param_Constant("Device.BulkData.MinReportingInterval", BULKDATA_MINIMUM_REPORTING_INTERVAL_STR, DM_UINT);
-    err |= USP_REGISTER_Param_Constant("Device.BulkData.Protocols", BULKDATA_PROTOCOL, DM_STRING);
-    err |= USP_REGISTER_Param_Constant("Device.BulkData.EncodingTypes", BULKDATA_ENCODING_TYPE, DM_STRING);
+    err |= USP_REGISTER_Param_Constant("Device.BulkData.Protocols", BULKDATA_PROTOCOLS_SUPPORTED, DM_STRING);
+    err |= USP_REGISTER_Param_Constant("Device.BulkData.EncodingTypes", BULKDATA_ENCODING_TYPES_SUPPORTED, DM_STRING);
     err |= USP_REGISTER_Param_Constant("Device.BulkData.ParameterWildCardSupported", "true", DM_BOOL);
     err |= USP_REGISTER_Param_Constant("Device.BulkData.MaxNumberOfProfiles", BULKDATA_MAX_PROFILES_STR, DM_INT);
     err |= USP_REGISTER_Param_Constant("Device.BulkData.MaxNumberOfParameterReferences", "-1", DM_INT);
@@ -247,6 +393,10 @@ int DEVICE_BULKDATA_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.EncodingType", BULKDATA_ENCODING_TYPE, Validate_BulkDataEncodingType, NULL, DM_STRING);
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.ReportingInterval", "86400", Validate_BulkDataReportingInterval, NotifyChange_BulkDataReportingInterval, DM_UINT);
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.TimeReference", UNKNOWN_TIME_STR, NULL, NotifyChange_BulkDataTimeReference, DM_DATETIME);
+    err |= USP_REGISTER_Event("Device.BulkData.Profile.{i}.Push!");
+    err |= USP_REGISTER_EventArguments("Device.BulkData.Profile.{i}.Push!", push_event_args, NUM_ELEM(push_event_args));
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.X_ARRIS-COM_DeltaEnable", "false", NULL, NULL, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.X_ARRIS-COM_FullReportInterval", "86400", NULL, NULL, DM_UINT);
 
     // Device.BulkData.Profile.{i}.Parameter.{i}
     err |= USP_REGISTER_Object("Device.BulkData.Profile.{i}.Parameter.{i}", NULL, NULL, NULL,
@@ -259,6 +409,13 @@ int DEVICE_BULKDATA_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.JSONEncoding.ReportFormat", BULKDATA_JSON_REPORT_FORMAT, Validate_BulkDataReportFormat, NULL, DM_STRING);
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.JSONEncoding.ReportTimestamp", BULKDATA_JSON_TIMESTAMP_FORMAT_EPOCH, Validate_BulkDataReportTimestamp, NULL, DM_STRING);
 
+    // Device.BulkData.Profile.{i}.CSVEncoding
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.CSVEncoding.FieldSeparator", BULKDATA_CSV_DEFAULT_FIELD_SEPARATOR, Validate_BulkDataCSVFieldSeparator, NULL, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.CSVEncoding.RowSeparator", BULKDATA_CSV_DEFAULT_ROW_SEPARATOR, Validate_BulkDataCSVRowSeparator, NULL, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.CSVEncoding.EscapeCharacter", BULKDATA_CSV_DEFAULT_ESCAPE_CHARACTER, Validate_BulkDataCSVEscapeCharacter, NULL, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.CSVEncoding.ReportFormat", BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_COLUMN, Validate_BulkDataCSVReportFormat, NULL, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.CSVEncoding.RowTimestamp", BULKDATA_JSON_TIMESTAMP_FORMAT_EPOCH, Validate_BulkDataReportTimestamp, NULL, DM_STRING);
+
     // Device.BulkData.Profile.{i}.HTTP
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.HTTP.URL", "", NULL, NotifyChange_BulkDataURL, DM_STRING);
     err |= USP_REGISTER_DBParam_ReadWrite("Device.BulkData.Profile.{i}.HTTP.Username", "", NULL, NULL, DM_STRING);
@@ -290,6 +447,211 @@ int DEVICE_BULKDATA_Init(void)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** Validate_BulkDataCSVReportFormat
+**
+** Validates Device.BulkData.Profile.{i}.CSVEncoding.ReportFormat
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   value - value that the controller would like to set the parameter to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_BulkDataCSVReportFormat(dm_req_t *req, char *value)
+{
+    // Exit if trying to set a value outside of the range we accept
+    if ((strcmp(value, BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_ROW) != 0) && (strcmp(value, BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_COLUMN) != 0))
+    {
+        USP_ERR_SetMessage("%s: CSV Report Format must be one of '%s' or '%s'", __FUNCTION__, BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_ROW, BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_COLUMN);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_BulkDataCSVFieldSeparator
+**
+** Validates Device.BulkData.Profile.{i}.CSVEncoding.FieldSeparator
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   value - value that the controller would like to set the parameter to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_BulkDataCSVFieldSeparator(dm_req_t *req, char *value)
+{
+    char buf[3];
+    int err;
+
+    // Exit if the value is not a single (possibly XML escaped) character
+    err = bulkdata_unescape_csv_char(value, buf, sizeof(buf));
+    if ((err != USP_ERR_OK) || (strlen(buf) != 1))
+    {
+        USP_ERR_SetMessage("%s: FieldSeparator must be a single character (eg '&#44;' or ',')", __FUNCTION__);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_BulkDataCSVRowSeparator
+**
+** Validates Device.BulkData.Profile.{i}.CSVEncoding.RowSeparator
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   value - value that the controller would like to set the parameter to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_BulkDataCSVRowSeparator(dm_req_t *req, char *value)
+{
+    char buf[3];
+    int err;
+
+    // Exit if the value is not one or two (possibly XML escaped) characters
+    err = bulkdata_unescape_csv_char(value, buf, sizeof(buf));
+    if ((err != USP_ERR_OK) || (buf[0] == '\0'))
+    {
+        USP_ERR_SetMessage("%s: RowSeparator must be one or two characters (eg '&#13;&#10;' or '&#10;')", __FUNCTION__);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_BulkDataCSVEscapeCharacter
+**
+** Validates Device.BulkData.Profile.{i}.CSVEncoding.EscapeCharacter
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   value - value that the controller would like to set the parameter to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_BulkDataCSVEscapeCharacter(dm_req_t *req, char *value)
+{
+    char buf[3];
+    int err;
+
+    // Exit if the value is not empty or a single (possibly XML escaped) character
+    err = bulkdata_unescape_csv_char(value, buf, sizeof(buf));
+    if ((err != USP_ERR_OK) || (strlen(buf) > 1))
+    {
+        USP_ERR_SetMessage("%s: EscapeCharacter must be empty or a single character (eg '&quot;')", __FUNCTION__);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** bulkdata_unescape_csv_char
+**
+** Removes the XML escaping from the value of a CSVEncoding separator or escape character parameter
+** TR-181 specifies that these parameters are XML escaped eg '&#13;&#10;' for CR LF
+** Supports numeric character references (decimal and hex) and the predefined XML entities
+**
+** \param   value - XML escaped value of the parameter
+** \param   buf - pointer to buffer in which to return the unescaped characters
+** \param   len - length of the buffer in which to return the unescaped characters
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INVALID_VALUE if the value cannot be unescaped or is too long
+**
+**************************************************************************/
+int bulkdata_unescape_csv_char(char *value, char *buf, int len)
+{
+    char *p;
+    char *end;
+    char *num_end;
+    long c;
+    int num_chars = 0;
+
+    p = value;
+    while (*p != '\0')
+    {
+        if (*p == '&')
+        {
+            // Exit if the XML reference is not terminated
+            end = strchr(p, ';');
+            if (end == NULL)
+            {
+                return USP_ERR_INVALID_VALUE;
+            }
+
+            if (p[1] == '#')
+            {
+                // Numeric character reference (eg '&#13;' or '&#x0D;')
+                if ((p[2] == 'x') || (p[2] == 'X'))
+                {
+                    c = strtol(&p[3], &num_end, 16);
+                }
+                else
+                {
+                    c = strtol(&p[2], &num_end, 10);
+                }
+
+                // Exit if the number is not terminated by ';' or is outside of the ASCII range
+                if ((num_end != end) || (c <= 0) || (c > 127))
+                {
+                    return USP_ERR_INVALID_VALUE;
+                }
+            }
+            else if (strncmp(p, "&quot;", end-p+1)==0)
+            {
+                c = '\"';
+            }
+            else if (strncmp(p, "&apos;", end-p+1)==0)
+            {
+                c = '\'';
+            }
+            else if (strncmp(p, "&amp;", end-p+1)==0)
+            {
+                c = '&';
+            }
+            else if (strncmp(p, "&lt;", end-p+1)==0)
+            {
+                c = '<';
+            }
+            else if (strncmp(p, "&gt;", end-p+1)==0)
+            {
+                c = '>';
+            }
+            else
+            {
+                // Exit if the XML entity is not recognised
+                return USP_ERR_INVALID_VALUE;
+            }
+            p = end + 1;
+        }
+        else
+        {
+            c = *p++;
+        }
+
+        // Exit if there is no space left in the buffer (leaving space for the NULL terminator)
+        if (num_chars >= len-1)
+        {
+            return USP_ERR_INVALID_VALUE;
+        }
+        buf[num_chars++] = (char)c;
+    }
+
+    buf[num_chars] = '\0';
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** DEVICE_BULKDATA_Start
@@ -407,7 +769,9 @@ void DEVICE_BULKDATA_NotifyTransferResult(int profile_id, bdc_transfer_result_t
     if (transfer_result == kBDCTransferResult_Success)
     {
         // Report(s) have been successfully sent, so don't retain them
+        // and (in delta mode) calculate the next report relative to the parameter values in the report just sent
         bulkdata_clear_retained_reports(bp);
+        bulkdata_commit_digests(bp);
     }
     else
     {
@@ -505,9 +869,9 @@ int Validate_NumberOfRetainedFailedReports(dm_req_t *req, char *value)
 int Validate_BulkDataProtocol(dm_req_t *req, char *value)
 {
     // Exit if trying to set a value outside of the range we accept
-    if (strcmp(value, BULKDATA_PROTOCOL) != 0)
+    if ((strcmp(value, BULKDATA_PROTOCOL_HTTP) != 0) && (strcmp(value, BULKDATA_PROTOCOL_USP_EVENT) != 0))
     {
-        USP_ERR_SetMessage("%s: Only Protocol supported is '%s'", __FUNCTION__, BULKDATA_PROTOCOL);
+        USP_ERR_SetMessage("%s: Protocol must be one of '%s' or '%s'", __FUNCTION__, BULKDATA_PROTOCOL_HTTP, BULKDATA_PROTOCOL_USP_EVENT);
         return USP_ERR_INVALID_VALUE;
     }
 
@@ -529,9 +893,9 @@ int Validate_BulkDataProtocol(dm_req_t *req, char *value)
 int Validate_BulkDataEncodingType(dm_req_t *req, char *value)
 {
     // Exit if trying to set a value outside of the range we accept
-    if (strcmp(value, BULKDATA_ENCODING_TYPE) != 0)
+    if ((strcmp(value, BULKDATA_ENCODING_TYPE_JSON) != 0) && (strcmp(value, BULKDATA_ENCODING_TYPE_CSV) != 0))
     {
-        USP_ERR_SetMessage("%s: Only EncodingType supported is '%s'", __FUNCTION__, BULKDATA_ENCODING_TYPE);
+        USP_ERR_SetMessage("%s: EncodingType must be one of '%s' or '%s'", __FUNCTION__, BULKDATA_ENCODING_TYPE_JSON, BULKDATA_ENCODING_TYPE_CSV);
         return USP_ERR_INVALID_VALUE;
     }
 
@@ -601,9 +965,9 @@ int Validate_BulkDataReference(dm_req_t *req, char *value)
 int Validate_BulkDataReportFormat(dm_req_t *req, char *value)
 {
     // Exit if trying to set a value outside of the range we accept
-    if (strcmp(value, BULKDATA_JSON_REPORT_FORMAT) != 0)
+    if ((strcmp(value, BULKDATA_JSON_REPORT_FORMAT_NAME_VALUE_PAIR) != 0) && (strcmp(value, BULKDATA_JSON_REPORT_FORMAT_OBJECT_HIERARCHY) != 0))
     {
-        USP_ERR_SetMessage("%s: Only JSON Report Format supported is '%s'", __FUNCTION__, BULKDATA_JSON_REPORT_FORMAT);
+        USP_ERR_SetMessage("%s: JSON Report Format must be one of '%s' or '%s'", __FUNCTION__, BULKDATA_JSON_REPORT_FORMAT_NAME_VALUE_PAIR, BULKDATA_JSON_REPORT_FORMAT_OBJECT_HIERARCHY);
         return USP_ERR_INVALID_VALUE;
     }
 
@@ -1219,6 +1583,7 @@ int ProcessBulkDataProfileAdded(int instance)
         return err;
     }
     bp->time_reference = RETRY_WAIT_UseRandomBaseIfUnknownTime(base);
+    bp->stagger_offset = bulkdata_calc_stagger_offset(instance);
 
     // Exit if unable to get RetryMinimumWaitInterval for this profile
     USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.HTTP.RetryMinimumWaitInterval", instance);
@@ -1650,6 +2015,7 @@ exit:
 **
 ** Obtains the values of all parameters given in the path expression
 ** This is a map of (key=param_path, value=param_value)
+** NOTE: The value of each parameter is obtained as soon as the path resolver has resolved it
 **
 ** \param   path_expr - Path expression describing parameters to obtain the values of
 **                      (from Device.BulkData.Profile.{i}.Parameter.{i}.Reference)
@@ -1660,46 +2026,31 @@ exit:
 **************************************************************************/
 int bulkdata_platform_get_parameter_values(char *path, kv_vector_t *param_values)
 {
-    int i;
     int err;
-    str_vector_t params;
-    char value[MAX_DM_VALUE_LEN];
-    char *cur_path;
     combined_role_t combined_role;
 
-    STR_VECTOR_Init(&params);
     KV_VECTOR_Init(param_values);
 
-    // Exit if unable to get the resolved paths
+    // Exit if unable to get the resolved paths and their values
     // NOTE: We can safely use the FullAccess role here, because we have already validated the path expression against the controller's role
     combined_role.inherited = kCTrustRole_FullAccess;
     combined_role.assigned = kCTrustRole_FullAccess;
-    err = PATH_RESOLVER_ResolveDevicePath(path, &params, kResolveOp_GetBulkData, NULL, &combined_role, 0);
+    err = PATH_RESOLVER_ResolveDevicePathWithCallback(path, bulkdata_platform_get_resolved_param, param_values, kResolveOp_GetBulkData, &combined_role, 0);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
 
-    // Iterate over all parameter paths found
-    for (i=0; i<params.num_entries; i++)
+    // Exit if unable to get the values of the grouped vendor parameters found
+    // NOTE: Getting all values at once allows grouped vendor parameters to be obtained using a single call to the vendor
+    // NOTE: Parameters which already have a value are skipped by DATA_MODEL_GetParameterValues()
+    err = DATA_MODEL_GetParameterValues(param_values, 0);
+    if (err != USP_ERR_OK)
     {
-        // Exit if unable to get the value of the parameter
-        cur_path = params.vector[i];
-        err = DATA_MODEL_GetParameterValue(cur_path, value, sizeof(value), 0);
-        if (err != USP_ERR_OK)
-        {
-            goto exit;
-        }
-
-        // Add the parameter to the map
-        KV_VECTOR_Add(param_values, cur_path, value);
+        goto exit;
     }
 
-    err = USP_ERR_OK;
-
 exit:
-    STR_VECTOR_Destroy(&params);
-
     if (err != USP_ERR_OK)
     {
         KV_VECTOR_Destroy(param_values);
@@ -1708,6 +2059,48 @@ exit:
     return err;
 }
 
+/*********************************************************************//**
+**
+** bulkdata_platform_get_resolved_param
+**
+** Called by the path resolver for each parameter resolved from a bulk data parameter reference
+** Gets the value of the parameter, adding it to the map of parameters and their values
+**
+** \param   path - full data model path of the parameter
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   separator_split - unused
+** \param   cb_arg - pointer to map of parameters and their values to add to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int bulkdata_platform_get_resolved_param(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg)
+{
+    int err;
+    char *value;
+    kv_vector_t *param_values = (kv_vector_t *) cb_arg;
+
+    // Grouped vendor parameters are added without a value. Their values are obtained after the path expression has been resolved
+    if (IsGroupedVendorParam(node))
+    {
+        KV_VECTOR_Add(param_values, path, NULL);
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to get the value of the parameter
+    err = DATA_MODEL_GetParameterValueAlloc(node, path, inst, &value, 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Add the parameter, passing ownership of its value to the map
+    KV_VECTOR_Add(param_values, path, NULL);
+    param_values->vector[param_values->num_entries-1].value = value;
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** bulkdata_platform_get_profile_control_params
@@ -1740,6 +2133,14 @@ int bulkdata_platform_get_profile_control_params(bulkdata_profile_t *bp, profile
         ctrl_params->num_retained_failed_reports = BULKDATA_MAX_RETAINED_FAILED_REPORTS;
     }
 
+    // Exit if unable to get Protocol
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.Protocol", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->protocol, sizeof(ctrl_params->protocol), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
     // Exit if unable to get UseDateHeader
     USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.HTTP.UseDateHeader", bp->profile_id);
     err = DM_ACCESS_GetBool(path, &ctrl_params->use_date_header);
@@ -1757,7 +2158,8 @@ int bulkdata_platform_get_profile_control_params(bulkdata_profile_t *bp, profile
     }
 
     // Exit if URL has not been setup by the ACS
-    if (ctrl_params->url[0] == '\0')
+    // NOTE: The URL is not needed if the report is sent in a USP Push! event
+    if ((ctrl_params->url[0] == '\0') && (strcmp(ctrl_params->protocol, BULKDATA_PROTOCOL_HTTP)==0))
     {
         USP_LOG_Error("%s: Profile %d started but it's URL has not been setup", __FUNCTION__, bp->profile_id);
         bp->is_working = false;
@@ -1796,90 +2198,208 @@ int bulkdata_platform_get_profile_control_params(bulkdata_profile_t *bp, profile
         return err;
     }
 
-    // Exit if unable to get ReportTimestamp
-    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.JSONEncoding.ReportTimestamp", bp->profile_id);
-    err = DATA_MODEL_GetParameterValue(path, ctrl_params->report_timestamp, sizeof(ctrl_params->report_timestamp), 0);
+    // Exit if unable to get X_ARRIS-COM_DeltaEnable
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.X_ARRIS-COM_DeltaEnable", bp->profile_id);
+    err = DM_ACCESS_GetBool(path, &ctrl_params->delta_enable);
     if (err != USP_ERR_OK)
     {
         return err;
     }
 
-    return USP_ERR_OK;
-}
+    // Exit if unable to get X_ARRIS-COM_FullReportInterval
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.X_ARRIS-COM_FullReportInterval", bp->profile_id);
+    err = DM_ACCESS_GetUnsigned(path, &ctrl_params->full_report_interval);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
 
-/*********************************************************************//**
-**
-**  bulkdata_start_profile
-**
-**  Starts the specified bulk data profile
-**
-** \param   bp - pointer to profile
-**          
-** \return  USP_ERR_OK if operation completed successfully
-**
-**************************************************************************/
-int bulkdata_start_profile(bulkdata_profile_t *bp)
-{
-    int err;
-    int wait_time;
-    profile_ctrl_params_t ctrl;
+    // Exit if unable to get EncodingType
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.EncodingType", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->encoding_type, sizeof(ctrl_params->encoding_type), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
 
+    // Get the parameters specific to CSV encoding
+    if (strcmp(ctrl_params->encoding_type, BULKDATA_ENCODING_TYPE_CSV)==0)
+    {
+        return bulkdata_platform_get_csv_control_params(bp, ctrl_params);
+    }
 
-    // Exit if unable to obtain the control parameters for this profile
-    err = bulkdata_platform_get_profile_control_params(bp, &ctrl);
+    // Exit if unable to get ReportFormat
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.JSONEncoding.ReportFormat", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->report_format, sizeof(ctrl_params->report_format), 0);
     if (err != USP_ERR_OK)
     {
         return err;
     }
 
-    // Determine the time until the timer should next fire
-    wait_time = bulkdata_calc_waittime_to_next_reporting_interval(bp->reporting_interval, bp->time_reference);
-
-    // Exit if unable to start this profile's sync timer
-    err = SYNC_TIMER_Add(bulkdata_process_profile, bp->profile_id, time(NULL) + wait_time);
+    // Exit if unable to get ReportTimestamp
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.JSONEncoding.ReportTimestamp", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->report_timestamp, sizeof(ctrl_params->report_timestamp), 0);
     if (err != USP_ERR_OK)
     {
         return err;
     }
-    
+
     return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-**  bulkdata_resync_profile
+** bulkdata_platform_get_csv_control_params
 **
-**  Called to update the time until the profile is next serviced
-**  (either to send a new report, or retry sending an old report)
+** Gets the parameters controlling the generation of a CSV encoded report for the specified profile
+** NOTE: The separator and escape characters are returned with their XML escaping removed
 **
-** \param   bp - pointer to profile
-** \param   delta_time - pointer to variable in which to return the amount of time until this timer next fires, or NULL if unused by called
-**          
-** \return  USP_ERR_OK if operation completed successfully
+** \param   bp - pointer to bulk data profile
+** \param   ctrl_params - pointer to structure in which to return the parameters
+**
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int bulkdata_resync_profile(bulkdata_profile_t *bp, int *delta_time)
+int bulkdata_platform_get_csv_control_params(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl_params)
 {
     int err;
-    int wait_time;
-
-    // Calculate the amount of time until this profile is next serviced (either to send a new report or resend an old report)
-    wait_time = bulkdata_calc_waittime_to_next_send(bp);
+    char path[MAX_DM_PATH];
+    char value[MAX_DM_SHORT_VALUE_LEN];
 
-    // Save the wait time for the caller, if the caller wants it
-    if (delta_time != NULL)
+    // Exit if unable to get ReportFormat
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.CSVEncoding.ReportFormat", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->report_format, sizeof(ctrl_params->report_format), 0);
+    if (err != USP_ERR_OK)
     {
-        *delta_time = wait_time;
+        return err;
     }
 
-    // Exit if the profile is not enabled (as it will not have a registered sync timer to reload).
+    // Exit if unable to get RowTimestamp
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.CSVEncoding.RowTimestamp", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, ctrl_params->report_timestamp, sizeof(ctrl_params->report_timestamp), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to get FieldSeparator
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.CSVEncoding.FieldSeparator", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, value, sizeof(value), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = bulkdata_unescape_csv_char(value, ctrl_params->csv_field_separator, sizeof(ctrl_params->csv_field_separator));
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to get RowSeparator
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.CSVEncoding.RowSeparator", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, value, sizeof(value), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = bulkdata_unescape_csv_char(value, ctrl_params->csv_row_separator, sizeof(ctrl_params->csv_row_separator));
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to get EscapeCharacter
+    USP_SNPRINTF(path, sizeof(path), "Device.BulkData.Profile.%d.CSVEncoding.EscapeCharacter", bp->profile_id);
+    err = DATA_MODEL_GetParameterValue(path, value, sizeof(value), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = bulkdata_unescape_csv_char(value, ctrl_params->csv_escape_char, sizeof(ctrl_params->csv_escape_char));
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_start_profile
+**
+**  Starts the specified bulk data profile
+**
+** \param   bp - pointer to profile
+**          
+** \return  USP_ERR_OK if operation completed successfully
+**
+**************************************************************************/
+int bulkdata_start_profile(bulkdata_profile_t *bp)
+{
+    int err;
+    int wait_time;
+    profile_ctrl_params_t ctrl;
+
+
+    // Exit if unable to obtain the control parameters for this profile
+    err = bulkdata_platform_get_profile_control_params(bp, &ctrl);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Determine the time until the timer should next fire
+    wait_time = bulkdata_calc_waittime_to_next_reporting_interval(bp->reporting_interval, bp->time_reference + bp->stagger_offset);
+
+    // Exit if unable to start this profile's sync timer
+    err = SYNC_TIMER_Add(bulkdata_process_profile, bp->profile_id, BULKDATA_CUR_TIME() + wait_time);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+    
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_resync_profile
+**
+**  Called to update the time until the profile is next serviced
+**  (either to send a new report, or retry sending an old report)
+**
+** \param   bp - pointer to profile
+** \param   delta_time - pointer to variable in which to return the amount of time until this timer next fires, or NULL if unused by called
+**          
+** \return  USP_ERR_OK if operation completed successfully
+**
+**************************************************************************/
+int bulkdata_resync_profile(bulkdata_profile_t *bp, int *delta_time)
+{
+    int err;
+    int wait_time;
+
+    // Calculate the amount of time until this profile is next serviced (either to send a new report or resend an old report)
+    wait_time = bulkdata_calc_waittime_to_next_send(bp);
+
+    // Save the wait time for the caller, if the caller wants it
+    if (delta_time != NULL)
+    {
+        *delta_time = wait_time;
+    }
+
+    // Exit if the profile is not enabled (as it will not have a registered sync timer to reload).
     if ((global_enable == false) || (bp->is_enabled==false))
     {
         return USP_ERR_OK;
     }
     
     // Exit if unable to restart the sync timer with the time until the next reporting interval (or retry)
-    err = SYNC_TIMER_Reload(bulkdata_process_profile, bp->profile_id, time(NULL) + wait_time);
+    err = SYNC_TIMER_Reload(bulkdata_process_profile, bp->profile_id, BULKDATA_CUR_TIME() + wait_time);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -1906,7 +2426,7 @@ unsigned bulkdata_calc_waittime_to_next_send(bulkdata_profile_t *bp)
     unsigned retry_time;
 
     // By default the time until we next send a report is the next scheduled time
-    wait_time = bulkdata_calc_waittime_to_next_reporting_interval(bp->reporting_interval, bp->time_reference);
+    wait_time = bulkdata_calc_waittime_to_next_reporting_interval(bp->reporting_interval, bp->time_reference + bp->stagger_offset);
 
     // However if we are retrying to send a report, then the retry might come first
     if (bp->retry_count != 0)
@@ -1944,7 +2464,7 @@ unsigned bulkdata_calc_waittime_to_next_reporting_interval(time_t interval, time
     time_t cur_time;
     time_t wait_time;
 
-    cur_time = time(NULL);
+    cur_time = BULKDATA_CUR_TIME();
     wait_time = interval - ((cur_time - time_reference) % interval);
     if (wait_time > interval)          // Needed if time_ref > cur_time
     {        
@@ -1954,6 +2474,45 @@ unsigned bulkdata_calc_waittime_to_next_reporting_interval(time_t interval, time
     return wait_time;
 }
 
+/*********************************************************************//**
+**
+**  bulkdata_calc_stagger_offset
+**
+**  Determines the number of seconds that the reports of the specified profile are delayed from the times given by its TimeReference
+**  The delay is a hash of the agent's EndpointID and the profile's instance number, so that it is the same every time the
+**  agent restarts, but differs between devices (and between the profiles of a device), spreading them across BULKDATA_STAGGER_WINDOW
+**
+** \param   profile_id - Instance number of profile in Device.Bulkdata.Profile.{i}
+**
+** \return  Number of seconds to delay reports by, or 0 if staggering is disabled
+**
+**************************************************************************/
+time_t bulkdata_calc_stagger_offset(int profile_id)
+{
+#if (BULKDATA_STAGGER_WINDOW > 0)
+    unsigned hash = 2166136261u;     // FNV-1a offset basis
+    char *p;
+    int i;
+
+    // Hash the EndpointID
+    p = DEVICE_LOCAL_AGENT_GetEndpointID();
+    while (*p != '\0')
+    {
+        hash = (hash ^ (unsigned char)*p++) * 16777619u;    // FNV-1a prime
+    }
+
+    // Then hash the profile's instance number
+    for (i=0; i < sizeof(profile_id); i++)
+    {
+        hash = (hash ^ ((profile_id >> (8*i)) & 0xFF)) * 16777619u;
+    }
+
+    return (time_t)(hash % BULKDATA_STAGGER_WINDOW);
+#else
+    return 0;
+#endif
+}
+
 /*********************************************************************//**
 **
 **  bulkdata_stop_profile
@@ -1972,6 +2531,7 @@ int bulkdata_stop_profile(bulkdata_profile_t *bp)
 
     // Free all dynamic memory associated with this profile
     bulkdata_clear_retained_reports(bp);
+    bulkdata_free_digests(bp);
 
     // Exit if unable to stop the sync timer
     err = SYNC_TIMER_Remove(bulkdata_process_profile, bp->profile_id);
@@ -2025,11 +2585,11 @@ void bulkdata_process_profile_work(bulkdata_profile_t *bp)
 {
     int err;
     report_t *cur_report;    
-    char *json_report;
+    kv_vector_t report_map;
+    bulkdata_snapshot_t *snapshot;
     profile_ctrl_params_t ctrl;
-    unsigned char *compressed_report;
-    int compressed_len;
     char buf[48];
+    time_t collection_time;
 
     // Exit if unable to obtain the control parameters for this profile
     err = bulkdata_platform_get_profile_control_params(bp, &ctrl);
@@ -2047,52 +2607,97 @@ void bulkdata_process_profile_work(bulkdata_profile_t *bp)
             bulkdata_drop_oldest_retained_reports(bp, ctrl.num_retained_failed_reports);
         }
     
-        // Append the report map for this reporting interval
-        cur_report = &bp->reports[bp->num_retained_reports];
-        cur_report->collection_time = time(NULL);
-
-        KV_VECTOR_Init(&cur_report->report_map);
-
         // Exit if unable to get the map containing the report contents
-        err = bulkdata_calc_report_map(bp, &cur_report->report_map);
+        KV_VECTOR_Init(&report_map);
+        err = bulkdata_calc_report_map(bp, &report_map);
         if (err != USP_ERR_OK)
         {
             USP_ERR_SetMessage("%s: bulkdata_calc_report_map failed", __FUNCTION__);
+            KV_VECTOR_Destroy(&report_map);
             return;
         }
-        bp->num_retained_reports++;
+
+        // In delta mode, remove the parameters which have not changed since the last report that was sent successfully
+        collection_time = time(NULL);
+        bulkdata_calc_delta_report(bp, &ctrl, &report_map, collection_time);
+
+        // Append the report for this reporting interval, storing it packed into a single allocation
+        cur_report = bulkdata_pack_report(&report_map, collection_time);
+        KV_VECTOR_Destroy(&report_map);
+        bulkdata_add_report(bp, cur_report);
     }
 
-    // Exit if unable to generate the report
-    json_report = bulkdata_generate_json_report(bp, &ctrl);
-    if (json_report == NULL)
+    // Send the report in a USP Push! event, if configured to use the USP Agent's existing MTP connections, rather than HTTP
+    if (strcmp(ctrl.protocol, BULKDATA_PROTOCOL_USP_EVENT)==0)
     {
-        USP_ERR_SetMessage("%s: bulkdata_generate_json_report failed", __FUNCTION__);
+        bulkdata_send_push_event(bp, &ctrl);
         return;
     }
 
-    // Print out the JSON report, if debugging is enabled
+    // Take a snapshot of the reports to send. The report is generated (and compressed) from the snapshot by the BDC thread
+    snapshot = bulkdata_take_snapshot(bp, &ctrl);
+
     USP_LOG_Info("\nBULK DATA: %sing at time %s, to url=%s", ctrl.method, iso8601_cur_time(buf, sizeof(buf)), ctrl.url);
     USP_LOG_Info("BULK DATA: using compression method=%s", ctrl.compression);
-    if (enable_protocol_trace)
+
+    // Exit if failed to tell BDC thread to send the report
+    err = bulkdata_schedule_sending_report(&ctrl, bp, snapshot);
+    if (err != USP_ERR_OK)
     {
-        USP_LOG_String(kLogType_Protocol, json_report);
+        DEVICE_BULKDATA_NotifyTransferResult(bp->profile_id, kBDCTransferResult_Failure_Other);
     }
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_send_push_event
+**
+**  Sends the report (containing all retained reports) to all subscribed controllers in a Device.BulkData.Profile.{i}.Push! event
+**  The event is sent over the existing MTP connections to the controllers, so the HTTP parameters are not used
+**  NOTE: The report is never compressed, because it is carried as a string in the Data argument of the event
+**
+** \param   bp - pointer to bulk data profile to send the report for
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_send_push_event(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl)
+{
+    bdc_report_chunk_t *report;
+    int report_len;
+    char event_name[MAX_DM_PATH];
+    kv_pair_t data_arg;
+    kv_vector_t event_args;
+    char buf[48];
 
-    // Compress the report, if enabled
-    compressed_report = bulkdata_compress_report(&ctrl, json_report, strlen(json_report), &compressed_len);
-    if (compressed_report != (unsigned char *)json_report)
+    // Exit if unable to generate the report
+    report = bulkdata_generate_report(&bp->reports, ctrl, false, &report_len);
+    if (report == NULL)
     {
-        free(json_report);
+        USP_ERR_SetMessage("%s: bulkdata_generate_report failed", __FUNCTION__);
+        DEVICE_BULKDATA_NotifyTransferResult(bp->profile_id, kBDCTransferResult_Failure_Other);
+        return;
     }
-    // NOTE: From this point on, only the compressed_report exists
 
-    // Exit if failed to tell BDC thread to send the report
-    err = bulkdata_schedule_sending_report(&ctrl, bp, compressed_report, compressed_len);
-    if (err != USP_ERR_OK)
+    USP_SNPRINTF(event_name, sizeof(event_name), "Device.BulkData.Profile.%d.Push!", bp->profile_id);
+    USP_LOG_Info("\nBULK DATA: Sending %s at time %s", event_name, iso8601_cur_time(buf, sizeof(buf)));
+    if (enable_protocol_trace)
     {
-        DEVICE_BULKDATA_NotifyTransferResult(bp->profile_id, kBDCTransferResult_Failure_Other);
+        USP_LOG_String(kLogType_Protocol, (char *)report->data);
     }
+
+    // Send the event directly to all subscribers, as we are already running on the data model thread
+    // NOTE: The event argument points directly to the report text (which is always NULL terminated when uncompressed), to avoid copying it
+    data_arg.key = "Data";
+    data_arg.value = (char *)report->data;
+    event_args.vector = &data_arg;
+    event_args.num_entries = 1;
+    DEVICE_SUBSCRIPTION_ProcessAllEventCompleteSubscriptions(event_name, &event_args);
+    BDC_EXEC_FreeReport(report);
+
+    // Once the event has been queued on the MTPs, its delivery is governed by the subscription's NotifRetry, so the retained reports are no longer needed
+    DEVICE_BULKDATA_NotifyTransferResult(bp->profile_id, kBDCTransferResult_Success);
 }
 
 /*********************************************************************//**
@@ -2109,23 +2714,11 @@ void bulkdata_process_profile_work(bulkdata_profile_t *bp)
 **************************************************************************/
 void bulkdata_drop_oldest_retained_reports(bulkdata_profile_t *bp, int num_reports_to_keep)
 {
-    int i;
-    int reports_to_destroy;
-
-    // Destroy the oldest report maps    
-    reports_to_destroy = bp->num_retained_reports - num_reports_to_keep;
-    for (i=0; i<reports_to_destroy; i++)
-    {
-        KV_VECTOR_Destroy(&bp->reports[i].report_map);
-    }
-
-    // Move down the reports to keep
-    if (num_reports_to_keep > 0)
+    // Destroy the oldest reports
+    while (bp->num_retained_reports > num_reports_to_keep)
     {
-        memmove(&bp->reports[0], &bp->reports[reports_to_destroy], num_reports_to_keep*sizeof(report_t));
+        bulkdata_free_report(bp, (report_t *) bp->reports.head);
     }
-    
-    bp->num_retained_reports = num_reports_to_keep;
 }
 
 /*********************************************************************//**
@@ -2141,123 +2734,454 @@ void bulkdata_drop_oldest_retained_reports(bulkdata_profile_t *bp, int num_repor
 **************************************************************************/
 void bulkdata_clear_retained_reports(bulkdata_profile_t *bp)
 {
-    int i;
-    report_t *r;
-    
-    for (i=0; i < bp->num_retained_reports; i++)
-    {
-        r = &bp->reports[i];
-        KV_VECTOR_Destroy(&r->report_map);
-        r->collection_time = 0;
-    }
-
-    bp->num_retained_reports = 0;
+    bulkdata_drop_oldest_retained_reports(bp, 0);
     bp->retry_count = 0;
 }
 
 /*********************************************************************//**
 **
-**  bulkdata_calc_report_map
+**  bulkdata_calc_delta_report
 **
-**  Calculates the map containing {parameter name vs type/value} for the specified profile
+**  In delta mode, removes the parameters from the report map whose values have not changed since the last report that was sent successfully
+**  A full report (containing all parameters) is generated if no report has been sent successfully since the profile started,
+**  or if X_ARRIS-COM_FullReportInterval has elapsed since the last full report. This also allows the collector to learn of deleted parameters.
+**  The digests of all parameters are retained as pending, and become the baseline for the next report once this report has been sent successfully.
+**  If this report fails to be sent, the next report is still calculated relative to the last report that was sent successfully,
+**  so it contains all changes, even if the retained failed reports containing them are dropped
 **
-** \param   context - pointer to global bulkdata context
-** \param   bp - pointer to bulk data profile to get the report map for
-** \param   report_map - initialised map in which to return the report map
-**          
-** \return  USP_ERR_OK if successful
+** \param   bp - pointer to bulk data profile
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile
+** \param   report_map - map of parameter name vs type code+value. On return, this only contains the parameters to report
+** \param   collection_time - time at which the parameters in the report were collected
+**
+** \return  None
 **
 **************************************************************************/
-int bulkdata_calc_report_map(bulkdata_profile_t *bp, kv_vector_t *report_map)
+void bulkdata_calc_delta_report(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl, kv_vector_t *report_map, time_t collection_time)
 {
-    int err;
     int i;
-    char *path;
-    char *alt_name;
-    kv_vector_t param_refs;    // Map of all parameter references {parameter path vs alternative name} (from Device.BulkData.Profile.{i}.Parameter.*)
-    kv_vector_t param_values; // Map of {parameter path vs value} for a single parameter reference. There will be multiple entries in this map if the parameter reference contains wildcards or a partial path
+    int num_entries;
+    int num_digests;
     kv_pair_t *kv;
-    
-    KV_VECTOR_Init(&param_values);
-    KV_VECTOR_Init(&param_refs);
-    
-    // Get the paths and alternative names of all parameters that are to be posted from this profile
-    err = bulkdata_platform_get_parameter_paths(bp->profile_id, &param_refs);
-    if (err != USP_ERR_OK)
+    bulkdata_digest_t *digests = NULL;
+    bulkdata_digest_t *acked;
+    bool is_full;
+
+    // Exit if not in delta mode, discarding any digests, so that a full report is sent if delta mode is subsequently enabled
+    if (ctrl->delta_enable == false)
     {
-        USP_ERR_SetMessage("%s: bulkdata_platform_get_parameter_paths() failed", __FUNCTION__);
-        goto exit;
+        bulkdata_free_digests(bp);
+        return;
     }
 
-    // Iterate over each parameter to get it's values
-    for (i=0; i < param_refs.num_entries; i++)
+    // Calculate the digests of all parameters in this report
+    num_digests = report_map->num_entries;
+    if (num_digests > 0)
     {
-        // Clear the map into which we place the expanded paths and values for this path
-        KV_VECTOR_Destroy(&param_values);
-
-        // Skip this path if it is blank
-        kv = &param_refs.vector[i];
-        path = kv->key;
-        alt_name = kv->value;
-        if (*path == '\0')
+        digests = USP_MALLOC(num_digests * sizeof(bulkdata_digest_t));
+        for (i=0; i < num_digests; i++)
         {
-            continue;
+            kv = &report_map->vector[i];
+            digests[i].name_hash = TEXT_UTILS_CalcHash64(kv->key);
+            digests[i].value_hash = TEXT_UTILS_CalcHash64(kv->value);
         }
+    }
 
-        // Get the expanded paths and values into the 'param_values' map
-        err = bulkdata_platform_get_parameter_values(path, &param_values);
-        if (err != USP_ERR_OK)
-        {
-            // Skip this parameter if an error occurred. Continue building up other parameters
-            USP_LOG_Warning("%s: bulkdata_platform_get_parameter_values(%s) failed", __FUNCTION__, path);
-            continue;
-        }
-        
-        // Append the obtained parameters to the report map, performing reduction of their name if an alternative_name is given
-        err = bulkdata_append_to_result_map(path, alt_name, &param_values, report_map); 
-        if (err != USP_ERR_OK)
+    // Determine whether this report should contain all parameters
+    is_full = (bp->last_full_report_time == 0) ||
+              ((ctrl->full_report_interval != 0) && (collection_time - bp->last_full_report_time >= (time_t)ctrl->full_report_interval));
+
+    // Remove all parameters whose values are the same as in the last report that was sent successfully
+    if (is_full == false)
+    {
+        num_entries = 0;
+        for (i=0; i < report_map->num_entries; i++)
         {
-            // Skip this parameter if an error occurred. Continue building up other parameters
-            USP_LOG_Warning("%s: bulkdata_append_to_result_map(%s) failed", __FUNCTION__, path);
-            continue;
+            kv = &report_map->vector[i];
+            acked = bsearch(&digests[i], bp->acked_digests, bp->num_acked_digests, sizeof(bulkdata_digest_t), bulkdata_compare_digests);
+            if ((acked != NULL) && (acked->value_hash == digests[i].value_hash))
+            {
+                USP_FREE(kv->key);
+                USP_FREE(kv->value);
+            }
+            else
+            {
+                report_map->vector[num_entries++] = *kv;
+            }
         }
+        report_map->num_entries = num_entries;
     }
 
-    err = USP_ERR_OK;
+    // Retain the digests of all parameters, sorted so that they can be searched when calculating the next report
+    if (digests != NULL)
+    {
+        qsort(digests, num_digests, sizeof(bulkdata_digest_t), bulkdata_compare_digests);
+    }
 
-exit:
-    KV_VECTOR_Destroy(&param_refs);
-    KV_VECTOR_Destroy(&param_values);
-    return err;
+    USP_SAFE_FREE(bp->pending_digests);
+    bp->pending_digests = digests;
+    bp->num_pending_digests = num_digests;
+    bp->pending_time = collection_time;
+    bp->is_pending_full = is_full;
 }
 
 /*********************************************************************//**
 **
-**  bulkdata_append_to_result_map
+**  bulkdata_commit_digests
 **
-**  Appends the parameters contained in a map to the results map
-**  When doing this, take account of alternative name, and type of each parameter
+**  Called when the report(s) have been sent successfully, to make the digests of the last report generated
+**  the baseline against which the next report is calculated in delta mode
 **
-** \param   origin_path - original path to parameter to get (This may be a partial path, or contain wildcards)
-** \param   alt_name - alternative name for the above path
-** \param   param_values - map containing {parameter path vs parameter value} obtained from expansion of the 'path'
-** \param   report_map - map which this function appends the 'param_values' map to
-**          
-** \return  USP_ERR_OK if successful
+** \param   bp - pointer to bulk data profile
+**
+** \return  None
 **
 **************************************************************************/
-int bulkdata_append_to_result_map(char *origin_path, char *alt_name, kv_vector_t *param_values, kv_vector_t *report_map)
+void bulkdata_commit_digests(bulkdata_profile_t *bp)
 {
-    int err;
-    int i;
-    char *path;
-    char reduced_path[MAX_DM_PATH];
-    char param_type_value[MAX_DM_VALUE_LEN+1];       // plus 1 to include leading JSON type character
-    char type;
-    char *value;
-    kv_pair_t *kv;
-
-    // Iterate over each parameter, adding it to the result map
+    // Exit if there are no pending digests (ie not in delta mode)
+    if (bp->pending_time == 0)
+    {
+        return;
+    }
+
+    USP_SAFE_FREE(bp->acked_digests);
+    bp->acked_digests = bp->pending_digests;
+    bp->num_acked_digests = bp->num_pending_digests;
+    if (bp->is_pending_full)
+    {
+        bp->last_full_report_time = bp->pending_time;
+    }
+
+    bp->pending_digests = NULL;
+    bp->num_pending_digests = 0;
+    bp->pending_time = 0;
+    bp->is_pending_full = false;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_free_digests
+**
+**  Frees all digests used by delta mode, so that the next report in delta mode contains all parameters
+**
+** \param   bp - pointer to bulk data profile
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_free_digests(bulkdata_profile_t *bp)
+{
+    USP_SAFE_FREE(bp->acked_digests);
+    USP_SAFE_FREE(bp->pending_digests);
+    bp->num_acked_digests = 0;
+    bp->num_pending_digests = 0;
+    bp->pending_time = 0;
+    bp->is_pending_full = false;
+    bp->last_full_report_time = 0;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_compare_digests
+**
+**  qsort/bsearch comparison function, ordering digests by the hash of the parameter name
+**
+** \param   entry1 - pointer to first digest to compare
+** \param   entry2 - pointer to second digest to compare
+**
+** \return  -1, 0 or 1 depending on the ordering of the digests
+**
+**************************************************************************/
+int bulkdata_compare_digests(const void *entry1, const void *entry2)
+{
+    const bulkdata_digest_t *d1 = (const bulkdata_digest_t *) entry1;
+    const bulkdata_digest_t *d2 = (const bulkdata_digest_t *) entry2;
+
+    if (d1->name_hash < d2->name_hash)
+    {
+        return -1;
+    }
+
+    return (d1->name_hash > d2->name_hash) ? 1 : 0;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_pack_report
+**
+**  Creates a report, packing the report map's vector, keys and values into the same allocation as the report
+**  This avoids the memory overhead of allocating each key and value separately, which is significant when reports are retained
+**
+** \param   report_map - pointer to report map to copy into the report. This is not modified by this function
+** \param   collection_time - time at which the report was collected
+**          
+** \return  pointer to dynamically allocated report
+**
+**************************************************************************/
+report_t *bulkdata_pack_report(kv_vector_t *report_map, time_t collection_time)
+{
+    report_t *report;
+    kv_pair_t *src;
+    kv_pair_t *dest;
+    char *p;
+    int mem_size;
+    int len;
+    int i;
+
+    // Calculate the size of the allocation needed to hold the report and all of its keys and values (including NULL terminators)
+    mem_size = sizeof(report_t) + report_map->num_entries*sizeof(kv_pair_t);
+    for (i=0; i < report_map->num_entries; i++)
+    {
+        src = &report_map->vector[i];
+        mem_size += strlen(src->key) + strlen(src->value) + 2;
+    }
+
+    report = USP_MALLOC(mem_size);
+    memset(report, 0, sizeof(report_t));
+    report->collection_time = collection_time;
+    report->mem_size = mem_size;
+    report->report_map.num_entries = report_map->num_entries;
+    report->report_map.vector = (report_map->num_entries > 0) ? (kv_pair_t *)&report[1] : NULL;
+
+    // Copy the keys and values into the space after the vector
+    p = (char *)&report[1] + report_map->num_entries*sizeof(kv_pair_t);
+    for (i=0; i < report_map->num_entries; i++)
+    {
+        src = &report_map->vector[i];
+        dest = &report->report_map.vector[i];
+
+        len = strlen(src->key) + 1;
+        memcpy(p, src->key, len);
+        dest->key = p;
+        p += len;
+
+        len = strlen(src->value) + 1;
+        memcpy(p, src->value, len);
+        dest->value = p;
+        p += len;
+    }
+
+    return report;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_clone_report
+**
+**  Creates a copy of the specified packed report, relocating the report map's pointers into the copy
+**  NOTE: The copy is not linked into any list, and is not counted against BULKDATA_MAX_RETAINED_REPORTS_MEMORY
+**
+** \param   src - pointer to report to copy
+**
+** \return  pointer to dynamically allocated copy of the report
+**
+**************************************************************************/
+report_t *bulkdata_clone_report(report_t *src)
+{
+    report_t *dest;
+    kv_pair_t *src_kv;
+    kv_pair_t *dest_kv;
+    int i;
+
+    dest = USP_MALLOC(src->mem_size);
+    memcpy(dest, src, src->mem_size);
+    memset(&dest->link, 0, sizeof(dest->link));
+    dest->report_map.vector = (src->report_map.num_entries > 0) ? (kv_pair_t *)&dest[1] : NULL;
+
+    // Relocate the keys and values, which are at the same offsets in the copy, as in the original
+    for (i=0; i < src->report_map.num_entries; i++)
+    {
+        src_kv = &src->report_map.vector[i];
+        dest_kv = &dest->report_map.vector[i];
+        dest_kv->key = (char *)dest + (src_kv->key - (char *)src);
+        dest_kv->value = (char *)dest + (src_kv->value - (char *)src);
+    }
+
+    return dest;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_add_report
+**
+**  Adds the specified report as the newest report of the specified profile
+**  If storing the report would exceed the memory limit for reports, then the oldest retained reports
+**  (across all profiles) are dropped until it does not
+**
+** \param   bp - pointer to bulk data profile to add the report to
+** \param   report - pointer to report to add. Ownership of this passes to the profile
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_add_report(bulkdata_profile_t *bp, report_t *report)
+{
+    int i;
+    bulkdata_profile_t *p;
+    bulkdata_profile_t *oldest_bp;
+    report_t *oldest;
+    report_t *r;
+
+    // Drop the oldest retained reports, until there is enough memory to store this report
+    while (bulkdata_reports_mem_used + report->mem_size > BULKDATA_MAX_RETAINED_REPORTS_MEMORY)
+    {
+        // Find the oldest retained report (across all profiles)
+        // NOTE: The oldest report of each profile is at the head of its list
+        oldest = NULL;
+        oldest_bp = NULL;
+        for (i=0; i<BULKDATA_MAX_PROFILES; i++)
+        {
+            p = &bulkdata_profiles[i];
+            r = (report_t *) p->reports.head;
+            if ((p->profile_id != INVALID) && (r != NULL) && ((oldest == NULL) || (r->collection_time < oldest->collection_time)))
+            {
+                oldest = r;
+                oldest_bp = p;
+            }
+        }
+
+        // Exit loop if there are no retained reports left to drop. In this case the report is stored anyway, as it is the current report
+        if (oldest == NULL)
+        {
+            USP_LOG_Warning("%s: WARNING: Bulk data report for profile %d (%d bytes) exceeds BULKDATA_MAX_RETAINED_REPORTS_MEMORY", __FUNCTION__, bp->profile_id, report->mem_size);
+            break;
+        }
+
+        USP_LOG_Warning("%s: Dropping retained report for profile %d, to limit memory used by retained reports", __FUNCTION__, oldest_bp->profile_id);
+        bulkdata_free_report(oldest_bp, oldest);
+    }
+
+    DLLIST_LinkToTail(&bp->reports, report);
+    bp->num_retained_reports++;
+    bulkdata_reports_mem_used += report->mem_size;
+    USP_MEM_BudgetForceCharge(kMemBudget_BulkData, report->mem_size);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_free_report
+**
+**  Removes the specified report from the specified profile, and frees it
+**
+** \param   bp - pointer to bulk data profile containing the report
+** \param   report - pointer to report to free
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_free_report(bulkdata_profile_t *bp, report_t *report)
+{
+    DLLIST_Unlink(&bp->reports, report);
+    bp->num_retained_reports--;
+    bulkdata_reports_mem_used -= report->mem_size;
+    USP_MEM_BudgetRelease(kMemBudget_BulkData, report->mem_size);
+    USP_FREE(report);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_calc_report_map
+**
+**  Calculates the map containing {parameter name vs type/value} for the specified profile
+**
+** \param   context - pointer to global bulkdata context
+** \param   bp - pointer to bulk data profile to get the report map for
+** \param   report_map - initialised map in which to return the report map
+**          
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int bulkdata_calc_report_map(bulkdata_profile_t *bp, kv_vector_t *report_map)
+{
+    int err;
+    int i;
+    char *path;
+    char *alt_name;
+    kv_vector_t param_refs;    // Map of all parameter references {parameter path vs alternative name} (from Device.BulkData.Profile.{i}.Parameter.*)
+    kv_vector_t param_values; // Map of {parameter path vs value} for a single parameter reference. There will be multiple entries in this map if the parameter reference contains wildcards or a partial path
+    kv_pair_t *kv;
+    
+    KV_VECTOR_Init(&param_values);
+    KV_VECTOR_Init(&param_refs);
+    
+    // Get the paths and alternative names of all parameters that are to be posted from this profile
+    err = bulkdata_platform_get_parameter_paths(bp->profile_id, &param_refs);
+    if (err != USP_ERR_OK)
+    {
+        USP_ERR_SetMessage("%s: bulkdata_platform_get_parameter_paths() failed", __FUNCTION__);
+        goto exit;
+    }
+
+    // Iterate over each parameter to get it's values
+    for (i=0; i < param_refs.num_entries; i++)
+    {
+        // Clear the map into which we place the expanded paths and values for this path
+        KV_VECTOR_Destroy(&param_values);
+
+        // Skip this path if it is blank
+        kv = &param_refs.vector[i];
+        path = kv->key;
+        alt_name = kv->value;
+        if (*path == '\0')
+        {
+            continue;
+        }
+
+        // Get the expanded paths and values into the 'param_values' map
+        err = bulkdata_platform_get_parameter_values(path, &param_values);
+        if (err != USP_ERR_OK)
+        {
+            // Skip this parameter if an error occurred. Continue building up other parameters
+            USP_LOG_Warning("%s: bulkdata_platform_get_parameter_values(%s) failed", __FUNCTION__, path);
+            continue;
+        }
+        
+        // Append the obtained parameters to the report map, performing reduction of their name if an alternative_name is given
+        err = bulkdata_append_to_result_map(path, alt_name, &param_values, report_map); 
+        if (err != USP_ERR_OK)
+        {
+            // Skip this parameter if an error occurred. Continue building up other parameters
+            USP_LOG_Warning("%s: bulkdata_append_to_result_map(%s) failed", __FUNCTION__, path);
+            continue;
+        }
+    }
+
+    err = USP_ERR_OK;
+
+exit:
+    KV_VECTOR_Destroy(&param_refs);
+    KV_VECTOR_Destroy(&param_values);
+    return err;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_append_to_result_map
+**
+**  Appends the parameters contained in a map to the results map
+**  When doing this, take account of alternative name, and type of each parameter
+**
+** \param   origin_path - original path to parameter to get (This may be a partial path, or contain wildcards)
+** \param   alt_name - alternative name for the above path
+** \param   param_values - map containing {parameter path vs parameter value} obtained from expansion of the 'path'
+** \param   report_map - map which this function appends the 'param_values' map to
+**          
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int bulkdata_append_to_result_map(char *origin_path, char *alt_name, kv_vector_t *param_values, kv_vector_t *report_map)
+{
+    int err;
+    int i;
+    char *path;
+    char reduced_path[MAX_DM_PATH];
+    char param_type_value[MAX_DM_VALUE_LEN+1];       // plus 1 to include leading type code character
+    char type;
+    char *value;
+    kv_pair_t *kv;
+
+    // Iterate over each parameter, adding it to the result map
     for (i=0; i < param_values->num_entries; i++)
     {
         kv = &param_values->vector[i];
@@ -2272,10 +3196,10 @@ int bulkdata_append_to_result_map(char *origin_path, char *alt_name, kv_vector_t
             continue; // Skip this parameter, if an error occurred
         }
 
-        // Calculate the JSON type of the parameter
-        type = DATA_MODEL_GetJSONParameterType(path);
+        // Calculate the type of the parameter
+        type = bulkdata_calc_param_type_code(path);
 
-        // Form the value string containing JSON type character, followed by actual value
+        // Form the value string containing type code character, followed by actual value
         param_type_value[0] = type;
         USP_STRNCPY(&param_type_value[1], value, sizeof(param_type_value)-1);
 
@@ -2286,6 +3210,84 @@ int bulkdata_append_to_result_map(char *origin_path, char *alt_name, kv_vector_t
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+**  bulkdata_calc_param_type_code
+**
+**  Calculates the type code to store in the report map for the specified parameter
+**
+** \param   path - full data model path of the parameter
+**          
+** \return  type code of the parameter eg BULKDATA_TYPE_STRING
+**
+**************************************************************************/
+char bulkdata_calc_param_type_code(char *path)
+{
+    unsigned type_flags;
+
+    type_flags = DATA_MODEL_GetParameterType(path);
+    if (type_flags & DM_INT)
+    {
+        return BULKDATA_TYPE_INT;
+    }
+    else if (type_flags & DM_UINT)
+    {
+        return BULKDATA_TYPE_UINT;
+    }
+    else if (type_flags & DM_ULONG)
+    {
+        return BULKDATA_TYPE_ULONG;
+    }
+    else if (type_flags & DM_BOOL)
+    {
+        return BULKDATA_TYPE_BOOL;
+    }
+    else if (type_flags & DM_DATETIME)
+    {
+        return BULKDATA_TYPE_DATETIME;
+    }
+
+    // Default, and also for DM_STRING
+    return BULKDATA_TYPE_STRING;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_param_type_code_to_str
+**
+**  Converts the type code stored in the report map to the name of the TR-106 data type
+**  This is written in the ParameterType column of CSV ParameterPerRow reports
+**
+** \param   type - type code of the parameter eg BULKDATA_TYPE_STRING
+**          
+** \return  pointer to string containing the name of the data type
+**
+**************************************************************************/
+char *bulkdata_param_type_code_to_str(char type)
+{
+    switch(type)
+    {
+        case BULKDATA_TYPE_DATETIME:
+            return "dateTime";
+
+        case BULKDATA_TYPE_BOOL:
+            return "boolean";
+
+        case BULKDATA_TYPE_INT:
+            return "int";
+
+        case BULKDATA_TYPE_UINT:
+            return "unsignedInt";
+
+        case BULKDATA_TYPE_ULONG:
+            return "unsignedLong";
+
+        default:
+        case BULKDATA_TYPE_STRING:
+            return "string";
+    }
+}
+
 /*********************************************************************//**
 **
 **  bulkdata_reduce_to_alt_name
@@ -2424,214 +3426,1098 @@ int bulkdata_reduce_to_alt_name(char *spec, char *path, char *alt_name, char *ou
 
 /*********************************************************************//**
 **
-**  bulkdata_generate_json_report
+**  bulkdata_generate_report
 **
-**  Generates a JSON name-value pair format report
-**  NOTE: The report contains all retained failed reports, as well as the current report
-**  See TR-157 section A.4.2 (end) for an example, and section A.3.5.2 for layout of content containing failed report transmissions
+**  Generates a JSON or CSV report, optionally compressing it (with GZIP) as it is generated
+**  When compressing, the uncompressed report is never held in memory in its entirety
 **
-** \param   bp - pointer to bulk data profile containing all reports (current and retained)
+** \param   reports - pointer to list of all reports to include (current and retained)
 ** \param   ctrl - pointer to structure containing the controlling parameters for the profile we are generating a report for
+** \param   compress - set if the report should be compressed
+** \param   p_report_len - pointer to variable in which to return the length of the report (summed over all chunks)
 **          
-** \return  pointer to NULL terminated dynamically allocated buffer containing the serialized report to send
+** \return  pointer to linked list of chunks containing the report, or NULL if out of memory or compression failed
+**          NOTE: If not compressed, the report is returned in a single chunk, containing NULL terminated report text
 **
 **************************************************************************/
-char *bulkdata_generate_json_report(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl)
+bdc_report_chunk_t *bulkdata_generate_report(double_linked_list_t *reports, profile_ctrl_params_t *ctrl, bool compress, int *p_report_len)
 {
-    JsonNode *top;          // top of report
-    JsonNode *array;        // array of reports (retained + current)
-    JsonNode *element;      // element of json array, containing an individual report
-    char *param_path;
-    char *param_type_value;
-    char param_type;
-    char *param_value;
-    kv_vector_t *report_map;
+    report_writer_t jw;
     report_t *report;
-    double value_as_number;
-    bool value_as_bool;
-    char *result;
-    int i, j;
-    char buf[32];
+    kv_vector_t *report_map;
     kv_pair_t *kv;
+    int j;
     int err;
+    int size_estimate;
+
+    // Estimate the size of the report, to avoid reallocating the output buffer in most cases
+    // NOTE: When compressing, only a fixed size staging buffer is needed
+    #define JSON_MEMBER_OVERHEAD 16   // Number of characters added to each parameter by the JSON format (quotes, colon, indent etc). This is also a reasonable estimate for CSV
+    size_estimate = 64;
+    for (report = (report_t *) reports->head; (report != NULL) && (compress == false); report = (report_t *) report->link.next)
+    {
+        report_map = &report->report_map;
+        for (j=0; j < report_map->num_entries; j++)
+        {
+            kv = &report_map->vector[j];
+            size_estimate += strlen(kv->key) + strlen(kv->value) + JSON_MEMBER_OVERHEAD;
+        }
+    }
+
+    // Exit if unable to initialise the report writer
+    err = bulkdata_writer_init(&jw, (compress) ? BULKDATA_REPORT_CHUNK_SIZE : size_estimate, compress);
+    if (err != USP_ERR_OK)
+    {
+        return NULL;
+    }
+
+    if (strcmp(ctrl->encoding_type, BULKDATA_ENCODING_TYPE_CSV)==0)
+    {
+        bulkdata_write_csv_report(&jw, reports, ctrl);
+    }
+    else
+    {
+        bulkdata_write_json_report(&jw, reports, ctrl);
+    }
+
+    return bulkdata_writer_finish(&jw, p_report_len);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_write_json_report
+**
+**  Writes a JSON report in either NameValuePair or ObjectHierarchy format
+**  The report is written directly into the JSON writer, rather than building a JSON tree then serializing it
+**  NOTE: The report contains all retained failed reports, as well as the current report
+**  See TR-157 section A.4.2 (end) for an example, and section A.3.5.2 for layout of content containing failed report transmissions
+**
+** \param   jw - pointer to JSON writer
+** \param   reports - pointer to list of all reports to write (current and retained)
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile we are generating a report for
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_write_json_report(report_writer_t *jw, double_linked_list_t *reports, profile_ctrl_params_t *ctrl)
+{
+    kv_vector_t *report_map;
+    report_t *report;
+    kv_pair_t *kv;
+    char *result;
+    char buf[32];
+    int j;
+    bool is_first_report = true;
+    bool is_first_member;
+    bool is_object_hierarchy;
+
+    is_object_hierarchy = (strcmp(ctrl->report_format, BULKDATA_JSON_REPORT_FORMAT_OBJECT_HIERARCHY)==0);
+
+    // NOTE: The layout of the report (including whitespace) is the same as that generated by json_stringify(top, " ")
+    bulkdata_writer_puts(jw, "{\n \"Report\": [", -1);
+
+    // Iterate over all reports adding them to the JSON array
+    for (report = (report_t *) reports->head; report != NULL; report = (report_t *) report->link.next)
+    {
+        report_map = &report->report_map;
+
+        bulkdata_writer_puts(jw, (is_first_report) ? "\n" : ",\n", -1);
+        bulkdata_json_write_indent(jw, 2);
+        bulkdata_writer_puts(jw, "{", 1);
+        is_first_report = false;
+        is_first_member = true;
+
+        // Add Collection time to each json report element (only if specified and not 'None')
+        if (strcmp(ctrl->report_timestamp, "Unix-Epoch")==0)
+        {
+            bulkdata_json_open_member(jw, "CollectionTime", -1, 3, &is_first_member);
+            bulkdata_json_write_number(jw, (double)report->collection_time);
+        } 
+        else if (strcmp(ctrl->report_timestamp, "ISO-8601")==0)
+        {
+            result = iso8601_from_unix_time(report->collection_time, buf, sizeof(buf));
+            if (result != NULL)
+            {
+                bulkdata_json_open_member(jw, "CollectionTime", -1, 3, &is_first_member);
+                bulkdata_json_write_string(jw, buf, -1);
+            }
+        }
+
+        // Add each parameter to the json element
+        if (is_object_hierarchy)
+        {
+            bulkdata_json_write_object_hierarchy(jw, report_map, 3, &is_first_member);
+        }
+        else
+        {
+            for (j=0; j < report_map->num_entries; j++)
+            {
+                kv = &report_map->vector[j];
+                bulkdata_json_write_member(jw, kv->key, -1, kv->value, 3, &is_first_member);
+            }
+        }
+
+        bulkdata_json_close(jw, '}', 2, is_first_member);
+    }
+
+    // Finally close the array and report top level
+    bulkdata_json_close(jw, ']', 1, is_first_report);
+    bulkdata_writer_puts(jw, "\n}", -1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_write_csv_report
+**
+**  Writes a CSV report in either ParameterPerRow or ParameterPerColumn format
+**  NOTE: The report contains all retained failed reports, as well as the current report
+**  See TR-157 Annex A (CSV Encoding) for the layout of CSV reports
+**
+** \param   jw - pointer to report writer
+** \param   reports - pointer to list of all reports to write (current and retained)
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile we are generating a report for
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_write_csv_report(report_writer_t *jw, double_linked_list_t *reports, profile_ctrl_params_t *ctrl)
+{
+    kv_vector_t *report_map;
+    kv_vector_t *prev_report_map = NULL;
+    report_t *report;
+    kv_pair_t *kv;
+    int j;
+    bool is_per_row;
+    bool has_timestamp;
+
+    is_per_row = (strcmp(ctrl->report_format, BULKDATA_CSV_REPORT_FORMAT_PARAMETER_PER_ROW)==0);
+    has_timestamp = (strcmp(ctrl->report_timestamp, BULKDATA_JSON_TIMESTAMP_FORMAT_NONE) != 0);
+
+    // ParameterPerRow reports have a fixed header row, then a row for every parameter in every report
+    if (is_per_row)
+    {
+        if (has_timestamp)
+        {
+            bulkdata_csv_write_field(jw, ctrl, "ReportTimestamp", true);
+        }
+        bulkdata_csv_write_field(jw, ctrl, "ParameterName", !has_timestamp);
+        bulkdata_csv_write_field(jw, ctrl, "ParameterValue", false);
+        bulkdata_csv_write_field(jw, ctrl, "ParameterType", false);
+        bulkdata_writer_puts(jw, ctrl->csv_row_separator, -1);
+
+        for (report = (report_t *) reports->head; report != NULL; report = (report_t *) report->link.next)
+        {
+            report_map = &report->report_map;
+            for (j=0; j < report_map->num_entries; j++)
+            {
+                kv = &report_map->vector[j];
+                if (has_timestamp)
+                {
+                    bulkdata_csv_write_timestamp(jw, ctrl, report->collection_time);
+                }
+                bulkdata_csv_write_field(jw, ctrl, kv->key, !has_timestamp);
+                bulkdata_csv_write_field(jw, ctrl, &kv->value[1], false);  // NOTE: Skip the leading type code
+                bulkdata_csv_write_field(jw, ctrl, bulkdata_param_type_code_to_str(kv->value[0]), false);
+                bulkdata_writer_puts(jw, ctrl->csv_row_separator, -1);
+            }
+        }
+        return;
+    }
+
+    // ParameterPerColumn reports have a header row containing the parameter names, then a row of values for every report
+    // NOTE: A new header row is written if the parameters differ from those of the previous report (eg if an object was added)
+    for (report = (report_t *) reports->head; report != NULL; report = (report_t *) report->link.next)
+    {
+        report_map = &report->report_map;
+        if ((prev_report_map == NULL) || (bulkdata_csv_is_same_columns(prev_report_map, report_map) == false))
+        {
+            bulkdata_csv_write_header(jw, ctrl, report_map);
+        }
+        prev_report_map = report_map;
+
+        if (has_timestamp)
+        {
+            bulkdata_csv_write_timestamp(jw, ctrl, report->collection_time);
+        }
+
+        for (j=0; j < report_map->num_entries; j++)
+        {
+            kv = &report_map->vector[j];
+            bulkdata_csv_write_field(jw, ctrl, &kv->value[1], ((j==0) && (has_timestamp == false)) );  // NOTE: Skip the leading type code
+        }
+        bulkdata_writer_puts(jw, ctrl->csv_row_separator, -1);
+    }
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_csv_write_timestamp
+**
+**  Writes the collection time of a report as the first field of a CSV row, in the format given by RowTimestamp
+**
+** \param   jw - pointer to report writer
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile
+** \param   collection_time - time at which the report was collected
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_csv_write_timestamp(report_writer_t *jw, profile_ctrl_params_t *ctrl, time_t collection_time)
+{
+    char buf[32];
+    char *result;
+
+    if (strcmp(ctrl->report_timestamp, BULKDATA_JSON_TIMESTAMP_FORMAT_ISO8601)==0)
+    {
+        result = iso8601_from_unix_time(collection_time, buf, sizeof(buf));
+        if (result == NULL)
+        {
+            buf[0] = '\0';
+        }
+    }
+    else
+    {
+        USP_SNPRINTF(buf, sizeof(buf), "%ld", (long)collection_time);
+    }
 
-    top = json_mkobject();
-    array = json_mkarray();
+    bulkdata_csv_write_field(jw, ctrl, buf, true);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_csv_write_header
+**
+**  Writes the header row of a ParameterPerColumn CSV report, containing the names of all parameters in the report map
+**
+** \param   jw - pointer to report writer
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile
+** \param   report_map - pointer to report map containing the parameters
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_csv_write_header(report_writer_t *jw, profile_ctrl_params_t *ctrl, kv_vector_t *report_map)
+{
+    int i;
+    bool has_timestamp;
+
+    has_timestamp = (strcmp(ctrl->report_timestamp, BULKDATA_JSON_TIMESTAMP_FORMAT_NONE) != 0);
+    if (has_timestamp)
+    {
+        bulkdata_csv_write_field(jw, ctrl, "ReportTimestamp", true);
+    }
+
+    for (i=0; i < report_map->num_entries; i++)
+    {
+        bulkdata_csv_write_field(jw, ctrl, report_map->vector[i].key, ((i==0) && (has_timestamp == false)) );
+    }
+
+    bulkdata_writer_puts(jw, ctrl->csv_row_separator, -1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_csv_is_same_columns
+**
+**  Determines whether two report maps contain the same parameters (in the same order)
+**  and hence can share the same header row in a ParameterPerColumn CSV report
+**
+** \param   map1 - pointer to first report map
+** \param   map2 - pointer to second report map
+**
+** \return  true if the report maps contain the same parameters
+**
+**************************************************************************/
+bool bulkdata_csv_is_same_columns(kv_vector_t *map1, kv_vector_t *map2)
+{
+    int i;
+
+    if (map1->num_entries != map2->num_entries)
+    {
+        return false;
+    }
+
+    for (i=0; i < map1->num_entries; i++)
+    {
+        if (strcmp(map1->vector[i].key, map2->vector[i].key) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_csv_write_field
+**
+**  Writes a field of a CSV row, preceded by the field separator (unless it is the first field in the row)
+**  If the field contains the field separator, row separator or escape character, then it is enclosed
+**  in the escape character, and any escape characters within it are doubled (as described in RFC 4180)
+**
+** \param   jw - pointer to report writer
+** \param   ctrl - pointer to structure containing the separator and escape characters to use
+** \param   str - pointer to NULL terminated contents of the field
+** \param   is_first - set if this is the first field in the row
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_csv_write_field(report_writer_t *jw, profile_ctrl_params_t *ctrl, char *str, bool is_first)
+{
+    char escape_char;
+    char *p;
+    char *start;
+
+    if (is_first == false)
+    {
+        bulkdata_writer_puts(jw, ctrl->csv_field_separator, -1);
+    }
+
+    // Write the field unescaped, if escaping is disabled or not required
+    escape_char = ctrl->csv_escape_char[0];
+    if ((escape_char == '\0') ||
+        ((strpbrk(str, ctrl->csv_field_separator) == NULL) && (strpbrk(str, ctrl->csv_row_separator) == NULL) && (strchr(str, escape_char) == NULL)))
+    {
+        bulkdata_writer_puts(jw, str, -1);
+        return;
+    }
+
+    // Otherwise enclose the field in the escape character, doubling any escape characters within the field
+    bulkdata_writer_puts(jw, &escape_char, 1);
+    start = str;
+    p = strchr(start, escape_char);
+    while (p != NULL)
+    {
+        bulkdata_writer_puts(jw, start, p - start + 1);    // Plus 1 to include the escape character
+        bulkdata_writer_puts(jw, &escape_char, 1);
+        start = p + 1;
+        p = strchr(start, escape_char);
+    }
+    bulkdata_writer_puts(jw, start, -1);
+    bulkdata_writer_puts(jw, &escape_char, 1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_write_object_hierarchy
+**
+**  Writes the parameters in the report map as nested JSON objects (TR-157 ObjectHierarchy format)
+**  eg Device.IP.Interface.1.Status is written as "Device": { "IP": { "Interface": { "1": { "Status": "Up" } } } }
+**  NOTE: The report map is sorted (by pointer, not copied), so that all parameters within the same object are adjacent.
+**        This allows each object to be opened and closed exactly once, without building a JSON tree
+**
+** \param   jw - pointer to JSON writer
+** \param   report_map - pointer to report map containing the parameters to write
+** \param   indent - indent level of the members of the enclosing report object
+** \param   is_first - pointer to variable indicating whether no members have been written to the enclosing report object yet
+**                     On return, this is updated
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_write_object_hierarchy(report_writer_t *jw, kv_vector_t *report_map, int indent, bool *is_first)
+{
+    kv_pair_t **sorted;
+    bool is_first_stack[MAX_JSON_OBJECT_DEPTH+1];  // Whether no members have been written yet to each currently open object. [0] is the report object
+    char *prev_key = NULL;
+    int open_depth = 0;     // Number of objects currently open (below the report object)
+    int key_depth;          // Number of object segments in the current key (ie excluding the parameter name)
+    int common;
+    char *p;
+    char *q;
+    char *seg_end;
+    int len;
+    int i;
+
+    // Exit if there are no parameters to write
+    if (report_map->num_entries == 0)
+    {
+        return;
+    }
+
+    // Sort pointers to the parameters, so that all parameters in the same object are adjacent
+    sorted = USP_MALLOC(report_map->num_entries * sizeof(kv_pair_t *));
+    for (i=0; i < report_map->num_entries; i++)
+    {
+        sorted[i] = &report_map->vector[i];
+    }
+    qsort(sorted, report_map->num_entries, sizeof(kv_pair_t *), bulkdata_compare_report_keys);
+
+    is_first_stack[0] = *is_first;
+    for (i=0; i < report_map->num_entries; i++)
+    {
+        // Count the number of object segments in this key
+        key_depth = 0;
+        for (p = sorted[i]->key; *p != '\0'; p++)
+        {
+            if (*p == '.')
+            {
+                key_depth++;
+            }
+        }
+
+        // Skip this parameter if it is nested too deeply
+        if (key_depth > MAX_JSON_OBJECT_DEPTH)
+        {
+            USP_LOG_Warning("%s: Skipping %s (too many path segments for ObjectHierarchy format)", __FUNCTION__, sorted[i]->key);
+            continue;
+        }
+
+        // Determine how many of the currently open objects are in this key's path
+        common = 0;
+        p = prev_key;
+        q = sorted[i]->key;
+        while ((common < open_depth) && (common < key_depth))
+        {
+            seg_end = strchr(q, '.');
+            len = seg_end - q;
+            if ((strncmp(p, q, len) != 0) || (p[len] != '.'))
+            {
+                break;
+            }
+            p += len + 1;
+            q += len + 1;
+            common++;
+        }
+
+        // Close the open objects which are not in this key's path
+        while (open_depth > common)
+        {
+            bulkdata_json_close(jw, '}', indent + open_depth - 1, is_first_stack[open_depth]);
+            open_depth--;
+        }
+
+        // Open the objects in this key's path which are not already open
+        while (open_depth < key_depth)
+        {
+            seg_end = strchr(q, '.');
+            len = seg_end - q;
+            bulkdata_json_open_member(jw, q, len, indent + open_depth, &is_first_stack[open_depth]);
+            bulkdata_writer_puts(jw, "{", 1);
+            open_depth++;
+            is_first_stack[open_depth] = true;
+            q += len + 1;
+        }
+
+        // Write the parameter in its object
+        bulkdata_json_write_member(jw, q, -1, sorted[i]->value, indent + open_depth, &is_first_stack[open_depth]);
+        prev_key = sorted[i]->key;
+    }
+
+    // Close all objects which are still open
+    while (open_depth > 0)
+    {
+        bulkdata_json_close(jw, '}', indent + open_depth - 1, is_first_stack[open_depth]);
+        open_depth--;
+    }
+
+    *is_first = is_first_stack[0];
+    USP_FREE(sorted);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_compare_report_keys
+**
+**  qsort() comparison function used to sort pointers to report map entries by key
+**
+** \param   entry1 - pointer to pointer to first report map entry to compare
+** \param   entry2 - pointer to pointer to second report map entry to compare
+**          
+** \return  less than, equal to, or greater than zero, in the same way as strcmp()
+**
+**************************************************************************/
+int bulkdata_compare_report_keys(const void *entry1, const void *entry2)
+{
+    kv_pair_t *kv1 = *((kv_pair_t **)entry1);
+    kv_pair_t *kv2 = *((kv_pair_t **)entry2);
+
+    return strcmp(kv1->key, kv2->key);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_write_member
+**
+**  Writes a parameter from the report map as a member of the currently open JSON object
+**  taking account of the parameter's type
+**
+** \param   jw - pointer to JSON writer
+** \param   key - name of the member to write
+** \param   key_len - number of characters in the key, or -1 if the key is NULL terminated
+** \param   param_type_value - type and value of the parameter (first character denotes the type, subsequent characters the value)
+** \param   indent - indent level of the member
+** \param   is_first - pointer to variable indicating whether this will be the first member of the object. On return, this is updated
+**          
+** \return  true if the member was written, false if it was skipped because its value could not be converted
+**
+**************************************************************************/
+bool bulkdata_json_write_member(report_writer_t *jw, char *key, int key_len, char *param_type_value, int indent, bool *is_first)
+{
+    char param_type;
+    char *param_value;
+    bool value_as_bool;
+    int err;
+
+    param_type = param_type_value[0];           // First character denotes the type of the parameter
+    param_value = &param_type_value[1];         // Subsequent characters contain the parameter's value
+
+    switch (param_type)
+    {
+        case BULKDATA_TYPE_STRING:
+        case BULKDATA_TYPE_DATETIME:
+            bulkdata_json_open_member(jw, key, key_len, indent, is_first);
+            bulkdata_json_write_string(jw, param_value, -1);
+            break;
+
+        case BULKDATA_TYPE_INT:
+        case BULKDATA_TYPE_UINT:
+        case BULKDATA_TYPE_ULONG:
+            bulkdata_json_open_member(jw, key, key_len, indent, is_first);
+            bulkdata_json_write_number(jw, atof(param_value));
+            break;
+
+        case BULKDATA_TYPE_BOOL:
+            // Exit if the value could not be converted to a boolean
+            err = TEXT_UTILS_StringToBool(param_value, &value_as_bool);
+            if (err != USP_ERR_OK)
+            {
+                return false;
+            }
+            bulkdata_json_open_member(jw, key, key_len, indent, is_first);
+            bulkdata_writer_puts(jw, (value_as_bool) ? "true" : "false", -1);
+            break;
+
+        default:
+            USP_ERR_SetMessage("%s: Invalid parameter type ('%c') in report map for %s", __FUNCTION__, param_type, key);
+            return false;
+            break;
+    }
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_open_member
+**
+**  Writes the separator, indent and key of a new member of the currently open JSON object
+**  The caller must then write the member's value
+**
+** \param   jw - pointer to JSON writer
+** \param   key - name of the member to write
+** \param   key_len - number of characters in the key, or -1 if the key is NULL terminated
+** \param   indent - indent level of the member
+** \param   is_first - pointer to variable indicating whether this will be the first member of the object. On return, this is cleared
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_open_member(report_writer_t *jw, char *key, int key_len, int indent, bool *is_first)
+{
+    bulkdata_writer_puts(jw, (*is_first) ? "\n" : ",\n", -1);
+    bulkdata_json_write_indent(jw, indent);
+    bulkdata_json_write_string(jw, key, key_len);
+    bulkdata_writer_puts(jw, ": ", 2);
+    *is_first = false;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_close
+**
+**  Closes the currently open JSON object or array
+**
+** \param   jw - pointer to JSON writer
+** \param   close_char - character closing the object ('}') or array (']')
+** \param   indent - indent level of the object or array being closed
+** \param   is_empty - set if no members or elements were written to the object or array
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_close(report_writer_t *jw, char close_char, int indent, bool is_empty)
+{
+    if (is_empty == false)
+    {
+        bulkdata_writer_puts(jw, "\n", 1);
+        bulkdata_json_write_indent(jw, indent);
+    }
+    bulkdata_writer_puts(jw, &close_char, 1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_write_string
+**
+**  Writes a quoted, escaped JSON string
+**  NOTE: Characters outside of the ASCII range are written unescaped (as UTF-8), in the same way as json_stringify()
+**
+** \param   jw - pointer to JSON writer
+** \param   str - string to write
+** \param   len - number of characters to write, or -1 if the string is NULL terminated
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_write_string(report_writer_t *jw, char *str, int len)
+{
+    char buf[8];
+    char *start;
+    char *p;
+    char *end;
+    unsigned char c;
 
-    // Iterate over all reports adding them to the JSON array
-    for (i=0; i < bp->num_retained_reports; i++)
+    if (len == -1)
     {
-        report = &bp->reports[i];
-        report_map = &report->report_map;
+        len = strlen(str);
+    }
 
-        // Add Collection time to each json report element (only if specified and not 'None')
-        element = json_mkobject();
-        if (strcmp(ctrl->report_timestamp, "Unix-Epoch")==0)
-        {
-            json_append_member(element, "CollectionTime", json_mknumber(report->collection_time));
-        } 
-        else if (strcmp(ctrl->report_timestamp, "ISO-8601")==0)
+    bulkdata_writer_puts(jw, "\"", 1);
+
+    // Iterate over the string, writing runs of characters which do not need escaping in a single call
+    start = str;
+    end = &str[len];
+    for (p = str; p < end; p++)
+    {
+        c = (unsigned char) *p;
+        if ((c >= 0x20) && (c != '"') && (c != '\\'))
         {
-            result = iso8601_from_unix_time(report->collection_time, buf, sizeof(buf));
-            if (result != NULL)
-            {
-                json_append_member(element, "CollectionTime", json_mkstring(buf));
-            }
+            continue;
         }
 
-        // Iterate over each parameter, adding it to the json element. Take account of the parameter's type
-        for (j=0; j < report_map->num_entries; j++)
-        {
-            kv = &report_map->vector[j];
-            param_path = kv->key;
-            param_type_value = kv->value;
-            param_type = param_type_value[0];           // First character denotes the type of the parameter
-            param_value = &param_type_value[1];         // Subsequent characters contain the parameter's value
+        bulkdata_writer_puts(jw, start, p - start);
+        start = p + 1;
 
-            switch (param_type)
-            {
-                case 'S':
-                    json_append_member(element, param_path, json_mkstring(param_value) );
-                    break;
-
-                case 'N':
-                    value_as_number = atof(param_value);
-                    json_append_member(element, param_path, json_mknumber(value_as_number) );
-                    break;
-
-                case 'B':
-                    err = TEXT_UTILS_StringToBool(param_value, &value_as_bool);
-                    if (err == USP_ERR_OK)
-                    {
-                        json_append_member(element, param_path, json_mkbool(value_as_bool) );
-                    }
-                    break;
-
-                default:
-                    USP_ERR_SetMessage("%s: Invalid JSON parameter type ('%c') in report map for %s", __FUNCTION__, param_type_value[0], param_path);
-                    break;
-            }
+        switch (c)
+        {
+            case '"':   bulkdata_writer_puts(jw, "\\\"", 2);  break;
+            case '\\':  bulkdata_writer_puts(jw, "\\\\", 2);  break;
+            case '\b':  bulkdata_writer_puts(jw, "\\b", 2);   break;
+            case '\f':  bulkdata_writer_puts(jw, "\\f", 2);   break;
+            case '\n':  bulkdata_writer_puts(jw, "\\n", 2);   break;
+            case '\r':  bulkdata_writer_puts(jw, "\\r", 2);   break;
+            case '\t':  bulkdata_writer_puts(jw, "\\t", 2);   break;
+            default:
+                USP_SNPRINTF(buf, sizeof(buf), "\\u%04X", c);
+                bulkdata_writer_puts(jw, buf, 6);
+                break;
         }
+    }
+    bulkdata_writer_puts(jw, start, end - start);
+
+    bulkdata_writer_puts(jw, "\"", 1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_write_number
+**
+**  Writes a JSON number, using the same formatting as json_stringify()
+**
+** \param   jw - pointer to JSON writer
+** \param   value - value to write
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_write_number(report_writer_t *jw, double value)
+{
+    char buf[64];
+
+    // JSON cannot represent infinity or NaN
+    if (isfinite(value) == 0)
+    {
+        bulkdata_writer_puts(jw, "null", 4);
+        return;
+    }
+
+    USP_SNPRINTF(buf, sizeof(buf), "%.16g", value);
+    bulkdata_writer_puts(jw, buf, -1);
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_json_write_indent
+**
+**  Writes the whitespace indenting a JSON member or element
+**
+** \param   jw - pointer to JSON writer
+** \param   indent - indent level (one space per level)
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_json_write_indent(report_writer_t *jw, int indent)
+{
+    static char spaces[] = "                                                                ";  // 64 spaces
+    int len;
+
+    while (indent > 0)
+    {
+        len = MIN(indent, (int)sizeof(spaces)-1);
+        bulkdata_writer_puts(jw, spaces, len);
+        indent -= len;
+    }
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_writer_puts
+**
+**  Appends characters to the report writer's output buffer, growing it if necessary
+**  If compressing, the output buffer is instead compressed (to empty it) when full
+**  If unable to grow the buffer, then the buffer is freed, and all further writes are ignored
+**
+** \param   jw - pointer to report writer
+** \param   str - characters to append
+** \param   len - number of characters to append, or -1 if str is NULL terminated
+**          
+** \return  None
+**
+**************************************************************************/
+void bulkdata_writer_puts(report_writer_t *jw, char *str, int len)
+{
+    char *new_buf;
+    int new_max_len;
+
+    // Exit if a previous allocation failed
+    if (jw->buf == NULL)
+    {
+        return;
+    }
 
-        // Add the json element to the json array
-        json_append_element(array, element);
+    if (len == -1)
+    {
+        len = strlen(str);
     }
 
-    // Finally add the array to the report top level
-    json_append_member(top, "Report", array);
+    // If compressing, empty the staging buffer into zlib, if there is not enough space for the characters and NULL terminator
+    if ((jw->is_compressing) && (jw->len + len + 1 > jw->max_len))
+    {
+        bulkdata_writer_deflate(jw, jw->buf, jw->len, Z_NO_FLUSH);
+        if (jw->buf == NULL)
+        {
+            return;
+        }
+        jw->len = 0;
 
-    // Serialize the JSON tree
-    result = json_stringify(top, " ");
+        // Compress the characters directly, if they would not fit in the staging buffer anyway
+        if (len + 1 > jw->max_len)
+        {
+            bulkdata_writer_deflate(jw, str, len, Z_NO_FLUSH);
+            return;
+        }
+    }
 
-    // Clean up the JSON tree
-    json_delete(top);        // Other JsonNodes which are children of this top level tree will be deleted 
+    // Grow the buffer (doubling its size), if there is not enough space for the characters and NULL terminator
+    if (jw->len + len + 1 > jw->max_len)
+    {
+        new_max_len = MAX(2*jw->max_len, jw->len + len + 1);
+        new_buf = realloc(jw->buf, new_max_len);
+        if (new_buf == NULL)
+        {
+            free(jw->buf);
+            jw->buf = NULL;
+            return;
+        }
+        jw->buf = new_buf;
+        jw->max_len = new_max_len;
+    }
 
-    return result;
+    memcpy(&jw->buf[jw->len], str, len);
+    jw->len += len;
+    jw->buf[jw->len] = '\0';
 }
 
 /*********************************************************************//**
 **
 **  bulkdata_compress_report
 **
-**  Compresses the report to send
+**  Compresses the report to send, using GZIP
 **
-** \param   ctrl - parameters controlling the profile e.g. type of compression to use
 ** \param   input_buf - pointer to buffer containing the uncompressed report
 ** \param   input_len - length of the data in the buffer containing the uncompressed report
 ** \param   p_output_len - pointer to variable in which to return the length of the compressed report
-**          
-** \return  pointer to compressed report to send
-**          NOTE: if compression is not required or fails, the uncompressed report is returned
+**
+** \return  pointer to linked list of chunks containing the compressed report, or NULL if compression failed
+**
+**************************************************************************/
+bdc_report_chunk_t *bulkdata_compress_report(char *input_buf, int input_len, int *p_output_len)
+{
+    report_writer_t jw;
+    bdc_report_chunk_t *report;
+    int err;
+
+    // Exit if unable to start compression
+    err = bulkdata_writer_init(&jw, BULKDATA_REPORT_CHUNK_SIZE, true);
+    if (err != USP_ERR_OK)
+    {
+        USP_LOG_Warning("%s: WARNING: Unable to start compression. Falling back to sending uncompressed data", __FUNCTION__);
+        return NULL;
+    }
+
+    // Exit if compression failed
+    bulkdata_writer_puts(&jw, input_buf, input_len);
+    report = bulkdata_writer_finish(&jw, p_output_len);
+    if (report == NULL)
+    {
+        USP_LOG_Warning("%s: WARNING: Compression failed. Falling back to sending uncompressed data", __FUNCTION__);
+        return NULL;
+    }
+
+    return report;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_writer_init
+**
+**  Initialises a report writer, optionally starting GZIP compression of the report text written to it
+**
+** \param   jw - pointer to report writer to initialise
+** \param   max_len - initial size of the output buffer (or size of the staging buffer, if compressing)
+** \param   compress - set if the report text should be compressed as it is written
+**
+** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-unsigned char *bulkdata_compress_report(profile_ctrl_params_t *ctrl, char *input_buf, int input_len, int *p_output_len)
+int bulkdata_writer_init(report_writer_t *jw, int max_len, bool compress)
 {
-    z_stream zlib_ctx;
     int err;
-    int output_len;
-    unsigned char *output_buf;
 
-    // Exit if not GZIP compression - in this case we just don't compress the report
-    if (strcmp(ctrl->compression, "GZIP") !=0)
+    memset(jw, 0, sizeof(report_writer_t));
+
+    // Exit if unable to allocate the output buffer
+    // NOTE: Use malloc because an uncompressed report is passed to the BDC thread, which frees it with free()
+    jw->buf = malloc(max_len);
+    if (jw->buf == NULL)
     {
-        *p_output_len = input_len;
-        return (unsigned char *)input_buf;
+        return USP_ERR_RESOURCES_EXCEEDED;
     }
+    jw->buf[0] = '\0';
+    jw->len = 0;
+    jw->max_len = max_len;
 
-    // Initialise the zlib context
-    memset(&zlib_ctx, 0, sizeof(zlib_ctx));
-    zlib_ctx.zalloc = Z_NULL;
-    zlib_ctx.zfree = Z_NULL;
-    zlib_ctx.opaque = NULL;
+    // Exit if not compressing
+    if (compress == false)
+    {
+        return USP_ERR_OK;
+    }
 
     // Exit if unable to start deflate
     #define WINDOW_BITS  (15+16)  // Plus 16 to get a gzip wrapper, as suggested by the zlib documentation
     #define MEM_LEVEL 8           // This is the default value, as suggested by the zlib documentation
-    err = deflateInit2(&zlib_ctx, Z_DEFAULT_COMPRESSION, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    jw->zlib_ctx.zalloc = Z_NULL;
+    jw->zlib_ctx.zfree = Z_NULL;
+    jw->zlib_ctx.opaque = NULL;
+    err = deflateInit2(&jw->zlib_ctx, Z_DEFAULT_COMPRESSION, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY);
     if (err != Z_OK)
     {
-        USP_LOG_Warning("%s: WARNING: deflateInit2 returned %d. Falling back to sending uncompressed data", __FUNCTION__, err);
-        *p_output_len = input_len;
-        return (unsigned char *)input_buf;
+        USP_LOG_Warning("%s: WARNING: deflateInit2 returned %d", __FUNCTION__, err);
+        free(jw->buf);
+        jw->buf = NULL;
+        return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Allocate a worst case buffer to hold the compressed data
-    output_len = (int)deflateBound(&zlib_ctx, input_len);
-    output_buf = malloc(output_len);  // Use malloc because the uncompressed report was generated with malloc() and this needs to be consistent
-    if (output_buf == NULL)
+    jw->is_compressing = true;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_writer_finish
+**
+**  Completes writing the report text, returning it as a report which may be sent by the BDC thread
+**  If compressing, this flushes all remaining report text through zlib and ends compression
+**
+** \param   jw - pointer to report writer
+** \param   p_report_len - pointer to variable in which to return the length of the report (summed over all chunks)
+**
+** \return  pointer to linked list of chunks containing the report, or NULL if an earlier allocation or compression failed
+**          NOTE: If not compressing, the report is returned in a single chunk, containing NULL terminated report text
+**
+**************************************************************************/
+bdc_report_chunk_t *bulkdata_writer_finish(report_writer_t *jw, int *p_report_len)
+{
+    bdc_report_chunk_t *chunk;
+    int err;
+
+    // Exit if an earlier allocation or compression failed
+    if (jw->buf == NULL)
     {
-        USP_LOG_Warning("%s: WARNING: malloc failed. Falling back to sending uncompressed data", __FUNCTION__);
-        deflateEnd(&zlib_ctx);
-        *p_output_len = input_len;
-        return (unsigned char *)input_buf;
+        bulkdata_writer_abort(jw);
+        return NULL;
     }
 
-    // Initialise the zlib context for this compression
-    zlib_ctx.next_in  = (unsigned char *)input_buf;
-    zlib_ctx.avail_in = input_len;
-    zlib_ctx.next_out = output_buf;
-    zlib_ctx.avail_out= output_len;
+    // If not compressing, wrap the output buffer in a single chunk
+    if (jw->is_compressing == false)
+    {
+        chunk = malloc(sizeof(bdc_report_chunk_t));
+        if (chunk == NULL)
+        {
+            bulkdata_writer_abort(jw);
+            return NULL;
+        }
+
+        chunk->next = NULL;
+        chunk->data = (unsigned char *)jw->buf;
+        chunk->len = jw->len;
+        *p_report_len = jw->len;
+        return chunk;
+    }
 
-    // Exit if compression failed
-    err = deflate(&zlib_ctx, Z_FINISH);
-    if (err != Z_STREAM_END)
+    // Exit if unable to compress the remaining report text
+    bulkdata_writer_deflate(jw, jw->buf, jw->len, Z_FINISH);
+    if (jw->buf == NULL)
     {
-        USP_LOG_Warning("%s: WARNING: deflate failed (err=%d). Falling back to sending uncompressed data", __FUNCTION__, err);
-        deflateEnd(&zlib_ctx);
-        free(output_buf);
-        *p_output_len = input_len;
-        return (unsigned char *)input_buf;
+        bulkdata_writer_abort(jw);
+        return NULL;
     }
 
     // Deallocate all compression state stored in the zlib context
     // NOTE: We ignore errors from this and just log them
-    err = deflateEnd(&zlib_ctx);
+    err = deflateEnd(&jw->zlib_ctx);
     if (err != Z_OK)
     {
-        USP_LOG_Warning("%s: WARNING: deflateEnd failed (err=%d, %s). Ignoring error.", __FUNCTION__, err, zlib_ctx.msg);
+        USP_LOG_Warning("%s: WARNING: deflateEnd failed (err=%d, %s). Ignoring error.", __FUNCTION__, err, jw->zlib_ctx.msg);
+    }
+
+    USP_LOG_Info("%s: BulkDataReport(uncompressed size=%lu, compressed size=%lu)", __FUNCTION__, jw->zlib_ctx.total_in, jw->zlib_ctx.total_out);
+    free(jw->buf);
+    *p_report_len = jw->zlib_ctx.total_out;
+    return jw->chunks;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_writer_abort
+**
+**  Frees all memory held by the report writer, ending compression (if in progress)
+**
+** \param   jw - pointer to report writer
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_writer_abort(report_writer_t *jw)
+{
+    if (jw->buf != NULL)
+    {
+        free(jw->buf);
+        jw->buf = NULL;
+    }
+
+    if (jw->is_compressing)
+    {
+        deflateEnd(&jw->zlib_ctx);
+        BDC_EXEC_FreeReport(jw->chunks);
+        jw->chunks = NULL;
+        jw->last_chunk = NULL;
+        jw->is_compressing = false;
+    }
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_writer_deflate
+**
+**  Compresses the specified report text, appending the compressed output to the report writer's list of chunks
+**  If unable to allocate a chunk or compression fails, then the staging buffer is freed, and all further writes are ignored
+**
+** \param   jw - pointer to report writer
+** \param   str - pointer to report text to compress
+** \param   len - number of characters of report text to compress
+** \param   flush - zlib flush mode: Z_NO_FLUSH whilst generating the report, or Z_FINISH for the last report text in the report
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_writer_deflate(report_writer_t *jw, char *str, int len, int flush)
+{
+    z_stream *zs = &jw->zlib_ctx;
+    bdc_report_chunk_t *chunk;
+    int err;
+
+    zs->next_in = (unsigned char *)str;
+    zs->avail_in = len;
+    do
+    {
+        // Start a new chunk, if there is no space left in the current one
+        chunk = jw->last_chunk;
+        if ((chunk == NULL) || (chunk->len == BULKDATA_REPORT_CHUNK_SIZE))
+        {
+            chunk = malloc(sizeof(bdc_report_chunk_t));
+            if (chunk != NULL)
+            {
+                chunk->data = malloc(BULKDATA_REPORT_CHUNK_SIZE);
+                if (chunk->data == NULL)
+                {
+                    free(chunk);
+                    chunk = NULL;
+                }
+            }
+
+            // Exit if unable to allocate the chunk
+            if (chunk == NULL)
+            {
+                USP_LOG_Warning("%s: WARNING: malloc failed", __FUNCTION__);
+                goto exit;
+            }
+            chunk->next = NULL;
+            chunk->len = 0;
+
+            if (jw->last_chunk == NULL)
+            {
+                jw->chunks = chunk;
+            }
+            else
+            {
+                jw->last_chunk->next = chunk;
+            }
+            jw->last_chunk = chunk;
+        }
+
+        // Compress into the remaining space in the chunk
+        zs->next_out = &chunk->data[chunk->len];
+        zs->avail_out = BULKDATA_REPORT_CHUNK_SIZE - chunk->len;
+        err = deflate(zs, flush);
+        chunk->len = BULKDATA_REPORT_CHUNK_SIZE - zs->avail_out;
+
+        // Exit if compression failed
+        if ((err != Z_OK) && (err != Z_STREAM_END))
+        {
+            USP_LOG_Warning("%s: WARNING: deflate failed (err=%d)", __FUNCTION__, err);
+            goto exit;
+        }
     }
+    while ((zs->avail_in > 0) || ((flush == Z_FINISH) && (err != Z_STREAM_END)));
 
-    USP_LOG_Info("%s: BulkDataReport(uncompressed size=%d, compressed size=%lu)", __FUNCTION__, input_len, zlib_ctx.total_out);
-    *p_output_len = zlib_ctx.total_out;
-    return output_buf;
+    return;
+
+exit:
+    // Free the staging buffer. This causes all further writes to be ignored, and bulkdata_writer_finish() to fail
+    free(jw->buf);
+    jw->buf = NULL;
 }
 
 /*********************************************************************//**
 **
 **  bulkdata_schedule_sending_report
 **
-**  Tells the BDC thread to send the report
-**  NOTE: Ownership of full_url passes to bulkdata_send_report_inner()
+**  Tells the BDC thread to generate the report from the snapshot, then send it
+**  NOTE: Ownership of the snapshot passes to the BDC thread, even if an error occurs
 **
 ** \param   ctrl - parameters controlling the profile e.g. URL to upload report to
 ** \param   bp - pointer to bulk data profile to get the report map for
-** \param   report - pointer to buffer containing the report to send (which may be compressed)
-** \param   report_len - length of json_report
+** \param   snapshot - pointer to snapshot of the reports to send
 **          
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profile_t *bp, unsigned char *report, int report_len)
+int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profile_t *bp, bulkdata_snapshot_t *snapshot)
 {
     char *query_string = NULL;
     char *full_url = NULL;
@@ -2639,12 +4525,14 @@ int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profi
     int err;
     char *username;
     char *password;
+    char *report_format;
 
     // Exit if unable to generate the URI query string
     query_string = bulkdata_platform_get_uri_query_params(bp->profile_id);
     if (query_string == NULL)
     {
         USP_ERR_SetMessage("%s: bulkdata_platform_get_uri_query_params failed", __FUNCTION__);
+        bulkdata_free_snapshot(snapshot);
         return USP_ERR_INTERNAL_ERROR;
     }
 
@@ -2653,9 +4541,10 @@ int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profi
     strcpy(full_url, ctrl->url);
     strcat(full_url, query_string);
 
-    // Create a copy of the auth credentials, to pass ownership to the BDC thread
+    // Create a copy of the auth credentials and report format, to pass ownership to the BDC thread
     username = USP_STRDUP(ctrl->username);
     password = USP_STRDUP(ctrl->password);
+    report_format = USP_STRDUP(ctrl->report_format);
 
     // Form the flags controlling various BDC options
     flags = 0;
@@ -2664,6 +4553,7 @@ int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profi
         flags |= BDC_FLAG_PUT;
     }
 
+    // NOTE: The BDC thread clears this flag, if it fails to generate a compressed report
     if (strcmp(ctrl->compression, "GZIP")==0)
     {
         flags |= BDC_FLAG_GZIP;
@@ -2674,9 +4564,15 @@ int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profi
         flags |= BDC_FLAG_DATE_HEADER;
     }
 
+    if (strcmp(ctrl->encoding_type, BULKDATA_ENCODING_TYPE_CSV)==0)
+    {
+        flags |= BDC_FLAG_CSV;
+    }
+
     // Exit if failed to post a message to BDC thread
-    // NOTE: Ownership of full_url, query_string, report, username and password passes to bulkdata_send_report_inner
-    err = BDC_EXEC_PostReportToSend(bp->profile_id, full_url, query_string, username, password, report, report_len, flags);
+    // NOTE: Ownership of full_url, query_string, snapshot, username, password and report_format passes to the BDC thread
+    err = BDC_EXEC_PostSnapshotToSend(bp->profile_id, full_url, query_string, username, password, report_format,
+                                      snapshot, bulkdata_generate_snapshot_report, bulkdata_free_snapshot, flags);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -2685,6 +4581,133 @@ int bulkdata_schedule_sending_report(profile_ctrl_params_t *ctrl, bulkdata_profi
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+**  bulkdata_take_snapshot
+**
+**  Takes an immutable snapshot of all reports (current and retained) of the specified profile
+**  and of its controlling parameters, for the BDC thread to generate the report from
+**  NOTE: Copying the packed reports is cheap compared to serializing them, which is why it is done on the data model thread
+**
+** \param   bp - pointer to bulk data profile to take a snapshot of
+** \param   ctrl - pointer to structure containing the controlling parameters for the profile
+**
+** \return  pointer to dynamically allocated snapshot
+**
+**************************************************************************/
+bulkdata_snapshot_t *bulkdata_take_snapshot(bulkdata_profile_t *bp, profile_ctrl_params_t *ctrl)
+{
+    bulkdata_snapshot_t *snapshot;
+    report_t *report;
+
+    snapshot = USP_MALLOC(sizeof(bulkdata_snapshot_t));
+    DLLIST_Init(&snapshot->reports);
+    memcpy(&snapshot->ctrl, ctrl, sizeof(profile_ctrl_params_t));
+
+    for (report = (report_t *) bp->reports.head; report != NULL; report = (report_t *) report->link.next)
+    {
+        DLLIST_LinkToTail(&snapshot->reports, bulkdata_clone_report(report));
+    }
+
+    return snapshot;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_generate_snapshot_report
+**
+**  Generates the report to send from the specified snapshot, compressing it if enabled
+**  NOTE: This function is called on the BDC thread, so must not access the data model or the profile
+**
+** \param   snapshot - pointer to snapshot (bulkdata_snapshot_t) to generate the report from
+** \param   p_report_len - pointer to variable in which to return the length of the report (summed over all chunks)
+** \param   flags - pointer to bitmask of options for sending. BDC_FLAG_GZIP is cleared if the report could not be compressed
+**
+** \return  pointer to linked list of chunks containing the report, or NULL if out of memory
+**
+**************************************************************************/
+bdc_report_chunk_t *bulkdata_generate_snapshot_report(void *snapshot, int *p_report_len, unsigned *flags)
+{
+    bulkdata_snapshot_t *ss = (bulkdata_snapshot_t *) snapshot;
+    bdc_report_chunk_t *report;
+    int report_len;
+    bdc_report_chunk_t *compressed_report;
+    int compressed_len;
+    bool is_compressed;
+
+    // Generate the report, compressing it as it is generated if GZIP compression is enabled
+    // NOTE: If protocol trace is enabled, the report is generated uncompressed (and compressed afterwards), so that it can be logged
+    is_compressed = ((*flags & BDC_FLAG_GZIP) != 0) && (enable_protocol_trace == false);
+    report = bulkdata_generate_report(&ss->reports, &ss->ctrl, is_compressed, &report_len);
+    if ((report == NULL) && (is_compressed))
+    {
+        USP_LOG_Warning("%s: WARNING: Failed to generate compressed report. Falling back to sending uncompressed data", __FUNCTION__);
+        is_compressed = false;
+        report = bulkdata_generate_report(&ss->reports, &ss->ctrl, false, &report_len);
+    }
+
+    // Exit if unable to generate the report
+    if (report == NULL)
+    {
+        return NULL;
+    }
+
+    // Print out the report, if debugging is enabled
+    if (enable_protocol_trace)
+    {
+        // NOTE: An uncompressed report is always stored in a single NULL terminated chunk
+        USP_LOG_String(kLogType_Protocol, (char *)report->data);
+
+        // Compress the report, if enabled. If compression fails, the uncompressed report is sent
+        if (*flags & BDC_FLAG_GZIP)
+        {
+            compressed_report = bulkdata_compress_report((char *)report->data, report_len, &compressed_len);
+            if (compressed_report != NULL)
+            {
+                BDC_EXEC_FreeReport(report);
+                report = compressed_report;
+                report_len = compressed_len;
+                is_compressed = true;
+            }
+        }
+    }
+
+    if (is_compressed == false)
+    {
+        *flags &= ~BDC_FLAG_GZIP;
+    }
+
+    *p_report_len = report_len;
+    return report;
+}
+
+/*********************************************************************//**
+**
+**  bulkdata_free_snapshot
+**
+**  Frees the specified snapshot, and all reports within it
+**  NOTE: This function is called on the BDC thread
+**
+** \param   snapshot - pointer to snapshot (bulkdata_snapshot_t) to free
+**
+** \return  None
+**
+**************************************************************************/
+void bulkdata_free_snapshot(void *snapshot)
+{
+    bulkdata_snapshot_t *ss = (bulkdata_snapshot_t *) snapshot;
+    report_t *report;
+
+    while (ss->reports.head != NULL)
+    {
+        report = (report_t *) ss->reports.head;
+        DLLIST_Unlink(&ss->reports, report);
+        USP_FREE(report);
+    }
+
+    USP_FREE(ss);
+}
+
 /*********************************************************************//**
 **
 **  bulkdata_find_free_profile
@@ -51,6 +51,7 @@
 #include "dm_access.h"
 #include "dm_trans.h"
 #include "mtp_exec.h"
+#include "mtp_send_queue.h"
 #include "msg_handler.h"
 #include "text_utils.h"
 #include "iso8601.h"
@@ -58,6 +59,15 @@
 
 #ifdef ENABLE_COAP
 #include "usp_coap.h"
+#include "notify_spool.h"
+#endif
+
+#ifdef ENABLE_WEBSOCKETS
+#include "wsclient.h"
+#endif
+
+#ifdef ENABLE_MQTT
+#include "mqtt.h"
 #endif
 //------------------------------------------------------------------------------
 // Location of the controller table within the data model
@@ -86,6 +96,15 @@ typedef struct
     coap_config_t coap;
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    wsclient_config_t websocket;
+#endif
+
+#ifdef ENABLE_MQTT
+    int mqtt_client_instance;       // Instance number of the client in Device.MQTT.Client.{i} used to reach this controller, or INVALID if none
+    char *mqtt_controller_topic;    // Topic that the controller subscribes to
+#endif
+
 } controller_mtp_t;
 
 //------------------------------------------------------------------------------
@@ -96,7 +115,8 @@ typedef struct
                        // This value will be marked as INVALID, if the entry is not currently being used
     bool enable;
     char *endpoint_id;
-    controller_mtp_t mtps[MAX_CONTROLLER_MTPS];  // Array of controller MTPs
+    controller_mtp_t **mtps;    // Array of pointers to controller MTPs. Grown on demand, up to MAX_CONTROLLER_MTPS entries
+    int mtps_size;              // Number of entries allocated in the mtps array
 
     time_t periodic_base;
     unsigned periodic_interval;
@@ -108,8 +128,36 @@ typedef struct
 
 } controller_t;
 
-// Array of controllers
-static controller_t controllers[MAX_CONTROLLERS];
+// Array of pointers to controllers. Grown on demand, up to MAX_CONTROLLERS entries
+// NOTE: Each controller is allocated individually, so that pointers to it remain valid when the array is grown
+static controller_t **controllers = NULL;
+static int controllers_size = 0;
+
+// Minimum number of entries allocated, when the controller or controller MTP arrays are first grown
+#define MIN_CONTROLLERS_ALLOC     4
+#define MIN_CONTROLLER_MTPS_ALLOC 2
+
+//------------------------------------------------------------------------------
+// Hash index of controllers, keyed by EndpointID. Used to avoid a linear scan of the controller table
+// whenever a USP message is received or the uniqueness of an EndpointID is validated
+// The index is an open addressing hash table with linear probing. Its size is always a power of 2, and it is kept at most half full
+// NOTE: The index is only ever rebuilt on the data model thread, whilst the Get worker threads are idle, so lookups need no lock
+typedef struct
+{
+    controller_t *cont;     // Controller in this slot, or NULL if the slot is empty
+    unsigned hash;          // Hash of the controller's EndpointID
+} cont_index_entry_t;
+
+#define CONT_INDEX_MIN_SIZE 16
+static cont_index_entry_t *cont_index = NULL;
+static int cont_index_size = 0;      // Number of slots in cont_index (a power of 2)
+
+//------------------------------------------------------------------------------
+// Generation count of the mapping from EndpointID to controller instance and combined role
+// This is incremented whenever a controller is added or deleted, or its EndpointID, Enable, inherited role or AssignedRole changes
+// The message handler caches the controller instance and combined role per thread, and uses this to invalidate its cache
+// NOTE: Starts at 1, so that a cache which has never been filled in (generation 0) is never valid
+static unsigned controller_role_generation = 1;
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
@@ -149,6 +197,9 @@ controller_mtp_t *FindFirstEnabledMtp(controller_t *cont, mtp_protocol_t preferr
 controller_mtp_t *FindControllerMtpByInstance(controller_t *cont, int mtp_instance);
 void DestroyController(controller_t *cont);
 void DestroyControllerMtp(controller_mtp_t *mtp);
+void RebuildControllerIndex(void);
+void InvalidateControllerRoles(void);
+controller_t *LookupControllerIndex(char *endpoint_id, int skip_instance, bool enabled_only);
 int ValidateStompMtpUniquenessReq(dm_req_t *req);
 int ValidateStompMtpUniqueness(controller_t *cont, int mtp_instance);
 int ValidateEndpointIdUniqueness(char *endpoint_id, int instance);
@@ -165,6 +216,18 @@ int Notify_ControllerMtpCoapPath(dm_req_t *req, char *value);
 int Notify_ControllerMtpCoapEncryption(dm_req_t *req, char *value);
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+int Notify_ControllerMtpWebSocketParam(dm_req_t *req, char *value);
+int Get_ControllerMtpWebSocketRetryCount(dm_req_t *req, char *buf, int len);
+int GetControllerMtpWebSocketConfig(controller_t *cont, controller_mtp_t *mtp);
+int StartControllerMtpWebSocket(controller_t *cont, controller_mtp_t *mtp);
+#endif
+
+#ifdef ENABLE_MQTT
+int Notify_ControllerMtpMqttReference(dm_req_t *req, char *value);
+int Notify_ControllerMtpMqttTopic(dm_req_t *req, char *value);
+#endif
+
 /*********************************************************************//**
 **
 ** DEVICE_CONTROLLER_Init
@@ -179,27 +242,17 @@ int Notify_ControllerMtpCoapEncryption(dm_req_t *req, char *value);
 int DEVICE_CONTROLLER_Init(void)
 {
     int err = USP_ERR_OK;
-    int i, j;
-    controller_t *cont;
-    controller_mtp_t *mtp;
 
     // Add timer to be called back when first periodic notification fires
     first_periodic_notification_time = END_OF_TIME;
     SYNC_TIMER_Add(PeriodicNotificationExec, 0, first_periodic_notification_time);
+    SYNC_TIMER_SetSlack(PeriodicNotificationExec, 0, PERIODIC_NOTIFY_SLACK);
 
-    // Mark all controller and mtp slots as unused
-    memset(controllers, 0, sizeof(controllers));
-    for (i=0; i<MAX_CONTROLLERS; i++)
-    {
-        cont = &controllers[i];
-        cont->instance = INVALID;
-
-        for (j=0; j<MAX_CONTROLLER_MTPS; j++)
-        {
-            mtp = &cont->mtps[j];
-            mtp->instance = INVALID;
-        }
-    }
+    // Controller and mtp slots are allocated on demand, as controllers are added
+    controllers = NULL;
+    controllers_size = 0;
+    cont_index = NULL;
+    cont_index_size = 0;
 
     // Register parameters implemented by this component
     err |= USP_REGISTER_Object(DEVICE_CONT_ROOT ".{i}", ValidateAdd_Controller, NULL, Notify_ControllerAdded, 
@@ -239,6 +292,22 @@ int DEVICE_CONTROLLER_Init(void)
 
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.Host", "", NULL, Notify_ControllerMtpWebSocketParam, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.Port", "443", DM_ACCESS_ValidatePort, Notify_ControllerMtpWebSocketParam, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.Path", "", NULL, Notify_ControllerMtpWebSocketParam, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.EnableEncryption", "true", NULL, Notify_ControllerMtpWebSocketParam, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.KeepAliveInterval", "30", NULL, Notify_ControllerMtpWebSocketParam, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.SessionRetryMinimumWaitInterval", "5", Validate_ControllerRetryMinimumWaitInterval, Notify_ControllerMtpWebSocketParam, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.SessionRetryIntervalMultiplier", "2000", Validate_ControllerRetryIntervalMultiplier, Notify_ControllerMtpWebSocketParam, DM_UINT);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_CONT_ROOT ".{i}.MTP.{i}.WebSocket.CurrentRetryCount", Get_ControllerMtpWebSocketRetryCount, DM_UINT);
+#endif
+
+#ifdef ENABLE_MQTT
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.MQTT.Reference", "", DEVICE_MTP_ValidateMqttReference, Notify_ControllerMtpMqttReference, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_CONT_ROOT ".{i}.MTP.{i}.MQTT.Topic", "", NULL, Notify_ControllerMtpMqttTopic, DM_STRING);
+#endif
+
     // Register unique keys for all tables
     char *cont_unique_keys[] = { "EndpointID" };
     err |= USP_REGISTER_Object_UniqueKey(DEVICE_CONT_ROOT ".{i}", cont_unique_keys, NUM_ELEM(cont_unique_keys));
@@ -246,6 +315,9 @@ int DEVICE_CONTROLLER_Init(void)
     char *mtp_unique_keys[] = { "Protocol" };
     err |= USP_REGISTER_Object_UniqueKey(DEVICE_CONT_ROOT ".{i}.MTP.{i}", mtp_unique_keys, NUM_ELEM(mtp_unique_keys));
 
+    // Load all notifications spooled to flash before the agent was last stopped
+    err |= NOTIFY_SPOOL_Init();
+
     // Exit if any errors occurred
     if (err != USP_ERR_OK)
     {
@@ -333,18 +405,37 @@ exit:
 **************************************************************************/
 void DEVICE_CONTROLLER_Stop(void)
 {
-    int i;
+    int i, j;
     controller_t *cont;
 
     // Iterate over all controllers, freeing all memory used by them
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance != INVALID)
         {
             DestroyController(cont);
         }
     }
+
+    // Then free the controller and MTP slots themselves
+    for (i=0; i<controllers_size; i++)
+    {
+        cont = controllers[i];
+        for (j=0; j<cont->mtps_size; j++)
+        {
+            USP_FREE(cont->mtps[j]);
+        }
+        USP_SAFE_FREE(cont->mtps);
+        USP_FREE(cont);
+    }
+
+    USP_SAFE_FREE(controllers);
+    controllers_size = 0;
+    USP_SAFE_FREE(cont_index);
+    cont_index_size = 0;
+
+    NOTIFY_SPOOL_Destroy();
 }
 
 /*********************************************************************//**
@@ -467,6 +558,23 @@ int DEVICE_CONTROLLER_GetCombinedRole(int instance, combined_role_t *combined_ro
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** DEVICE_CONTROLLER_GetRoleGeneration
+**
+** Returns the generation count of the mapping from EndpointID to controller instance and combined role
+** If this has not changed, then the controller instance and combined role previously determined for an EndpointID are still valid
+**
+** \param   None
+**
+** \return  generation count (never 0)
+**
+**************************************************************************/
+unsigned DEVICE_CONTROLLER_GetRoleGeneration(void)
+{
+    return __atomic_load_n(&controller_role_generation, __ATOMIC_ACQUIRE);
+}
+
 /*********************************************************************//**
 **
 ** DEVICE_CONTROLLER_GetCombinedRoleByEndpointId
@@ -516,15 +624,15 @@ void DEVICE_CONTROLLER_SetRolesFromStomp(int stomp_instance, ctrust_role_t role,
     controller_mtp_t *mtp;
 
     // Iterate over all enabled controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
-        cont = &controllers[i];
+        cont = controllers[i];
         if ((cont->instance != INVALID) && (cont->enable))
         {
             // Iterate over all enabled MTP slots for this controller
-            for (j=0; j<MAX_CONTROLLER_MTPS; j++)
+            for (j=0; j<cont->mtps_size; j++)
             {
-                mtp = &cont->mtps[j];
+                mtp = cont->mtps[j];
                 if ((mtp->instance != INVALID) && (mtp->enable))
                 {
                     // If this controller is connected to the specified STOMP connection, then set its inherited role
@@ -536,6 +644,8 @@ void DEVICE_CONTROLLER_SetRolesFromStomp(int stomp_instance, ctrust_role_t role,
             }
         }
     }
+
+    InvalidateControllerRoles();
 }
 
 /*********************************************************************//**
@@ -549,7 +659,7 @@ void DEVICE_CONTROLLER_SetRolesFromStomp(int stomp_instance, ctrust_role_t role,
 ** \param   pbuf - pointer to buffer containing binary protobuf message. Ownership of this buffer passes to protocol handler, if successful
 ** \param   pbuf_len - length of buffer containing protobuf binary message
 ** \param   usp_msg_id - pointer to string containing the msg_id of the serialized USP Message
-** \param   mrt - details of where this USP response message should be sent
+** \param   mrt - details of where this USP response message should be sent, and the send priority of notifications
 ** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
 ** 
 ** \return  USP_ERR_OK if successful
@@ -568,6 +678,7 @@ int DEVICE_CONTROLLER_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, char
     // Take a copy of the MTP destination parameters we've been given
     // because we may modify it (and we don't want the caller to free anything we put in it, as they are owned by the data model)
     memcpy(&dest, mrt, sizeof(dest));
+    dest.send_priority = MTP_SEND_QUEUE_CalcPriority(usp_msg_type, mrt->send_priority);
 
     // Exit if unable to find the specified controller
     cont = FindEnabledControllerByEndpointId(endpoint_id);
@@ -613,6 +724,24 @@ int DEVICE_CONTROLLER_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, char
                 dest.coap_reset_session_hint = false;
                 break;
 #endif    
+#ifdef ENABLE_WEBSOCKETS
+            case kMtpProtocol_WebSockets:
+                dest.protocol = kMtpProtocol_WebSockets;
+                break;
+#endif
+#ifdef ENABLE_MQTT
+            case kMtpProtocol_MQTT:
+                if (mtp->mqtt_client_instance == INVALID)
+                {
+                    USP_ERR_SetMessage("%s: No MQTT client in controller MTP to send to endpoint_id=%s", __FUNCTION__, endpoint_id);
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+
+                dest.protocol = kMtpProtocol_MQTT;
+                dest.mqtt_instance = mtp->mqtt_client_instance;
+                dest.mqtt_topic = mtp->mqtt_controller_topic;
+                break;
+#endif
             default:
                 TERMINATE_BAD_CASE(mtp->protocol);
                 break;
@@ -629,13 +758,32 @@ int DEVICE_CONTROLLER_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, char
             USP_SNPRINTF(raw_err_id_header, sizeof(raw_err_id_header), "%s/%s", endpoint_id, usp_msg_id);
             TEXT_UTILS_ReplaceCharInString(raw_err_id_header, ':', "\\c", err_id_header, sizeof(err_id_header));
 
-            err = DEVICE_STOMP_QueueBinaryMessage(usp_msg_type, dest.stomp_instance, dest.stomp_dest, agent_queue, pbuf, pbuf_len, err_id_header, expiry_time);
+            // Spool notifications to flash instead, if the STOMP connection is down or has a backlog of USP records to send
+            // NOTE: If spooled, ownership of the buffer passes to the spool
+            if ((usp_msg_type == USP__HEADER__MSG_TYPE__NOTIFY) &&
+                (NOTIFY_SPOOL_Queue(endpoint_id, dest.stomp_instance, usp_msg_type, pbuf, pbuf_len, usp_msg_id, dest.send_priority, expiry_time)))
+            {
+                err = USP_ERR_OK;
+                break;
+            }
+
+            err = DEVICE_STOMP_QueueBinaryMessage(usp_msg_type, dest.stomp_instance, dest.stomp_dest, agent_queue, pbuf, pbuf_len, err_id_header, dest.send_priority, expiry_time);
             break;
 
 #ifdef ENABLE_COAP
         case kMtpProtocol_CoAP:
             err = COAP_CLIENT_QueueBinaryMessage(usp_msg_type, cont->instance, mtp->instance, pbuf, pbuf_len, &dest, expiry_time);
             break;
+#endif
+#ifdef ENABLE_WEBSOCKETS
+        case kMtpProtocol_WebSockets:
+            err = WSCLIENT_QueueBinaryMessage(usp_msg_type, cont->instance, mtp->instance, pbuf, pbuf_len, &dest, expiry_time);
+            break;
+#endif
+#ifdef ENABLE_MQTT
+        case kMtpProtocol_MQTT:
+            err = DEVICE_MQTT_QueueBinaryMessage(usp_msg_type, dest.mqtt_instance, dest.mqtt_topic, pbuf, pbuf_len, dest.send_priority, expiry_time);
+            break;
 #endif
         default:
             TERMINATE_BAD_CASE(mrt->protocol);
@@ -666,15 +814,15 @@ void DEVICE_CONTROLLER_NotifyStompConnDeleted(int stomp_instance)
     char path[MAX_DM_PATH];
 
     // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
         // Iterate over all MTP slots for this controller, clearing out all references to the deleted STOMP connection
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance != INVALID)
         {
-            for (j=0; j<MAX_CONTROLLER_MTPS; j++)
+            for (j=0; j<cont->mtps_size; j++)
             {
-                mtp = &cont->mtps[j];
+                mtp = cont->mtps[j];
                 if ((mtp->instance != INVALID) && (mtp->protocol == kMtpProtocol_STOMP) && (mtp->stomp_connection_instance == stomp_instance))
                 {
                     USP_SNPRINTF(path, sizeof(path), "Device.LocalAgent.Controller.%d.MTP.%d.STOMP.Reference", cont->instance, mtp->instance);
@@ -685,6 +833,48 @@ void DEVICE_CONTROLLER_NotifyStompConnDeleted(int stomp_instance)
     }
 }
 
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** DEVICE_CONTROLLER_NotifyMqttClientDeleted
+**
+** Called when an MQTT client is deleted
+** This code unpicks all references to the MQTT client existing in the Controller MTP table
+**
+** \param   mqtt_instance - instance in Device.MQTT.Client which has been deleted
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_CONTROLLER_NotifyMqttClientDeleted(int mqtt_instance)
+{
+    int i;
+    int j;
+    controller_t *cont;
+    controller_mtp_t *mtp;
+    char path[MAX_DM_PATH];
+
+    // Iterate over all controllers
+    for (i=0; i<controllers_size; i++)
+    {
+        // Iterate over all MTP slots for this controller, clearing out all references to the deleted MQTT client
+        cont = controllers[i];
+        if (cont->instance != INVALID)
+        {
+            for (j=0; j<cont->mtps_size; j++)
+            {
+                mtp = cont->mtps[j];
+                if ((mtp->instance != INVALID) && (mtp->mqtt_client_instance == mqtt_instance))
+                {
+                    USP_SNPRINTF(path, sizeof(path), "Device.LocalAgent.Controller.%d.MTP.%d.MQTT.Reference", cont->instance, mtp->instance);
+                    DATA_MODEL_SetParameterValue(path, "", 0);
+                }
+            }
+        }
+    }
+}
+#endif
+
 /*********************************************************************//**
 **
 ** PeriodicNotificationExec
@@ -708,10 +898,10 @@ void PeriodicNotificationExec(int id)
     USP_ASSERT(cur_time >= first_periodic_notification_time);
 
     // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
         // Skip this entry if it is unused
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance == INVALID)
         {
             continue;
@@ -829,6 +1019,18 @@ int Notify_ControllerDeleted(dm_req_t *req)
         return USP_ERR_OK;
     }
 
+#ifdef ENABLE_WEBSOCKETS
+    // Stop all WebSocket connections to this controller
+    int i;
+    for (i=0; i<cont->mtps_size; i++)
+    {
+        if (cont->mtps[i]->instance != INVALID)
+        {
+            WSCLIENT_StopClient(cont->instance, cont->mtps[i]->instance);
+        }
+    }
+#endif
+
     // Delete the controller from the array
     DestroyController(cont);
 
@@ -906,6 +1108,14 @@ int Notify_ControllerMtpDeleted(dm_req_t *req)
     }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    // Stop the WebSocket connection to this controller, if it is WebSocket
+    if ((mtp->protocol == kMtpProtocol_WebSockets) && (mtp->enable) && (cont->enable))
+    {
+        WSCLIENT_StopClient(cont->instance, mtp->instance);
+    }
+#endif
+
     // Delete the controller MTP from the array
     DestroyControllerMtp(mtp);
 
@@ -1123,16 +1333,17 @@ int Notify_ControllerEnable(dm_req_t *req, char *value)
 
     // Save the new value
     cont->enable = val_bool;
+    InvalidateControllerRoles();
 
 #ifdef ENABLE_COAP
     // Iterate over all MTPs for this controller, starting or stopping its associated CoAP MTPs
     int i;
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
         int err;
         controller_mtp_t *mtp;
 
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
         if ((mtp->instance != INVALID) && (mtp->protocol == kMtpProtocol_CoAP))
         {
             if ((mtp->enable) && (cont->enable))
@@ -1152,6 +1363,34 @@ int Notify_ControllerEnable(dm_req_t *req, char *value)
     }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    // Iterate over all MTPs for this controller, starting or stopping its associated WebSocket connections
+    int j;
+    for (j=0; j<cont->mtps_size; j++)
+    {
+        int ws_err;
+        controller_mtp_t *ws_mtp;
+
+        ws_mtp = cont->mtps[j];
+        if ((ws_mtp->instance != INVALID) && (ws_mtp->protocol == kMtpProtocol_WebSockets))
+        {
+            if ((ws_mtp->enable) && (cont->enable))
+            {
+                // Exit if unable to start client
+                ws_err = StartControllerMtpWebSocket(cont, ws_mtp);
+                if (ws_err != USP_ERR_OK)
+                {
+                    return ws_err;
+                }
+            }
+            else
+            {
+                WSCLIENT_StopClient(cont->instance, ws_mtp->instance);
+            }
+        }
+    }
+#endif
+
     return USP_ERR_OK;
 }
 
@@ -1176,10 +1415,16 @@ int Notify_ControllerEndpointID(dm_req_t *req, char *value)
     cont = FindControllerByInstance(inst1);
     USP_ASSERT(cont != NULL);
 
+    // Responses cached for replay to the old EndpointID will never be replayed
+    MSG_HANDLER_FreeControllerReplayCache(cont->endpoint_id);
+
     // Set the new value
     USP_SAFE_FREE(cont->endpoint_id);
     cont->endpoint_id = USP_STRDUP(value);
 
+    // Rehash the controller under its new EndpointID
+    RebuildControllerIndex();
+
     return USP_ERR_OK;
 }
 
@@ -1260,6 +1505,27 @@ int Notify_ControllerMtpEnable(dm_req_t *req, char *value)
         }
     }
 #endif
+
+#ifdef ENABLE_WEBSOCKETS
+    // Start or stop WebSocket connection based on new value
+    if (mtp->protocol == kMtpProtocol_WebSockets)
+    {
+        if ((mtp->enable) && (cont->enable))
+        {
+            // Exit if unable to start client
+            int ws_err;
+            ws_err = StartControllerMtpWebSocket(cont, mtp);
+            if (ws_err != USP_ERR_OK)
+            {
+                return ws_err;
+            }
+        }
+        else
+        {
+            WSCLIENT_StopClient(cont->instance, mtp->instance);
+        }
+    }
+#endif
     // NOTE: We do not have to do anything for STOMP, as these parameters are only searched when we send
 
     return USP_ERR_OK;
@@ -1288,7 +1554,7 @@ int Notify_ControllerMtpProtocol(dm_req_t *req, char *value)
     mtp = FindControllerMtpFromReq(req, &cont);
     USP_ASSERT(mtp != NULL);
 
-#ifdef ENABLE_COAP
+#if defined(ENABLE_COAP) || defined(ENABLE_WEBSOCKETS)
     mtp_protocol_t old_protocol;
     old_protocol = mtp->protocol;
 #endif
@@ -1333,6 +1599,26 @@ int Notify_ControllerMtpProtocol(dm_req_t *req, char *value)
     }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    int ws_err;
+
+    // Stop the old WebSocket connection, if we've moved from WebSocket
+    if (old_protocol == kMtpProtocol_WebSockets)
+    {
+        WSCLIENT_StopClient(cont->instance, mtp->instance);
+    }
+
+    // Start the new WebSocket connection, if we've moved to WebSocket, exiting if an error occurred
+    if (new_protocol == kMtpProtocol_WebSockets)
+    {
+        ws_err = StartControllerMtpWebSocket(cont, mtp);
+        if (ws_err != USP_ERR_OK)
+        {
+            return ws_err;
+        }
+    }
+#endif
+
     // NOTE: We don't need to do anything explicitly for STOMP
     
     return USP_ERR_OK;
@@ -1399,6 +1685,69 @@ int Notify_ControllerMtpStompDestination(dm_req_t *req, char *value)
     return USP_ERR_OK;
 }
 
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** Notify_ControllerMtpMqttReference
+**
+** Function called when Device.LocalAgent.Controller.{i}.MTP.{i}.MQTT.Reference is modified
+** This function updates the value of the mqtt_client_instance stored in the controller array
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Notify_ControllerMtpMqttReference(dm_req_t *req, char *value)
+{
+    controller_t *cont;
+    controller_mtp_t *mtp;
+    char path[MAX_DM_PATH];
+    int err;
+
+    // Determine MTP to be updated
+    mtp = FindControllerMtpFromReq(req, &cont);
+    USP_ASSERT(mtp != NULL);
+
+    // Set the new value
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MTP.%d.MQTT.Reference", device_cont_root, cont->instance, mtp->instance);
+
+    err = DEVICE_MTP_GetMqttReference(path, &mtp->mqtt_client_instance);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** Notify_ControllerMtpMqttTopic
+**
+** Function called when Device.LocalAgent.Controller.{i}.MTP.{i}.MQTT.Topic is modified
+** This function updates the value of the mqtt_controller_topic stored in the controller array
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Notify_ControllerMtpMqttTopic(dm_req_t *req, char *value)
+{
+    controller_t *cont;
+    controller_mtp_t *mtp;
+
+    // Determine MTP to be updated
+    mtp = FindControllerMtpFromReq(req, &cont);
+    USP_ASSERT(mtp != NULL);
+
+    // Set the new value
+    USP_SAFE_FREE(mtp->mqtt_controller_topic);
+    mtp->mqtt_controller_topic = USP_STRDUP(value);
+
+    return USP_ERR_OK;
+}
+#endif
+
 #ifdef ENABLE_COAP
 /*********************************************************************//**
 **
@@ -1523,6 +1872,205 @@ int Notify_ControllerMtpCoapEncryption(dm_req_t *req, char *value)
 }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+/*********************************************************************//**
+**
+** Notify_ControllerMtpWebSocketParam
+**
+** Function called when any of the writable Device.LocalAgent.Controller.{i}.MTP.{i}.WebSocket parameters are modified
+** Unlike CoAP, the WebSocket connection is persistent, so the new configuration is propagated to the WebSocket client immediately
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Notify_ControllerMtpWebSocketParam(dm_req_t *req, char *value)
+{
+    controller_t *cont;
+    controller_mtp_t *mtp;
+    wsclient_config_t *config;
+    char *name;
+    bool was_started;
+
+    // Determine MTP to be updated
+    mtp = FindControllerMtpFromReq(req, &cont);
+    USP_ASSERT(mtp != NULL);
+
+    // Determine whether the WebSocket client was started (see StartControllerMtpWebSocket)
+    config = &mtp->websocket;
+    was_started = ((mtp->protocol == kMtpProtocol_WebSockets) && (mtp->enable) && (cont->enable) && (config->host != NULL) && (config->host[0] != '\0'));
+
+    // Set the new value, based on the name of the parameter which was modified
+    name = strrchr(req->path, '.');
+    USP_ASSERT(name != NULL);
+    name++;
+
+    if (strcmp(name, "Host")==0)
+    {
+        USP_SAFE_FREE(config->host);
+        config->host = USP_STRDUP(value);
+    }
+    else if (strcmp(name, "Port")==0)
+    {
+        config->port = val_uint;
+    }
+    else if (strcmp(name, "Path")==0)
+    {
+        USP_SAFE_FREE(config->path);
+        config->path = USP_STRDUP(value);
+    }
+    else if (strcmp(name, "EnableEncryption")==0)
+    {
+        config->enable_encryption = val_bool;
+    }
+    else if (strcmp(name, "KeepAliveInterval")==0)
+    {
+        config->keep_alive_interval = val_uint;
+    }
+    else if (strcmp(name, "SessionRetryMinimumWaitInterval")==0)
+    {
+        config->retry_min_wait_interval = val_uint;
+    }
+    else if (strcmp(name, "SessionRetryIntervalMultiplier")==0)
+    {
+        config->retry_interval_multiplier = val_uint;
+    }
+    else
+    {
+        TERMINATE_BAD_CASE(name[0]);
+    }
+
+    // Propagate the new configuration to the WebSocket client if it is running, otherwise start it if it has just become configured
+    if (was_started)
+    {
+        WSCLIENT_UpdateConfig(cont->instance, mtp->instance, config);
+    }
+    else if ((mtp->protocol == kMtpProtocol_WebSockets) && (mtp->enable) && (cont->enable))
+    {
+        return StartControllerMtpWebSocket(cont, mtp);
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_ControllerMtpWebSocketRetryCount
+**
+** Function called to get the value of Device.LocalAgent.Controller.{i}.MTP.{i}.WebSocket.CurrentRetryCount
+**
+** \param   req - pointer to structure identifying the path
+** \param   buf - pointer to buffer in which to return the value
+** \param   len - length of return buffer
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_ControllerMtpWebSocketRetryCount(dm_req_t *req, char *buf, int len)
+{
+    val_uint = WSCLIENT_GetRetryCount(inst1, inst2);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** GetControllerMtpWebSocketConfig
+**
+** Reads the configuration of the WebSocket connection to the specified controller MTP from the DB
+**
+** \param   cont - pointer to controller
+** \param   mtp - pointer to controller MTP
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int GetControllerMtpWebSocketConfig(controller_t *cont, controller_mtp_t *mtp)
+{
+    int err;
+    char path[MAX_DM_PATH];
+    wsclient_config_t *config = &mtp->websocket;
+
+    #define WS_PARAM_PATH(name) USP_SNPRINTF(path, sizeof(path), "%s.%d.MTP.%d.WebSocket.%s", device_cont_root, cont->instance, mtp->instance, name)
+
+    WS_PARAM_PATH("Host");
+    err = DM_ACCESS_GetString(path, &config->host);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("Port");
+    err = DM_ACCESS_GetUnsigned(path, &config->port);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("Path");
+    err = DM_ACCESS_GetString(path, &config->path);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("EnableEncryption");
+    err = DM_ACCESS_GetBool(path, &config->enable_encryption);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("KeepAliveInterval");
+    err = DM_ACCESS_GetUnsigned(path, &config->keep_alive_interval);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("SessionRetryMinimumWaitInterval");
+    err = DM_ACCESS_GetUnsigned(path, &config->retry_min_wait_interval);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    WS_PARAM_PATH("SessionRetryIntervalMultiplier");
+    err = DM_ACCESS_GetUnsigned(path, &config->retry_interval_multiplier);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** StartControllerMtpWebSocket
+**
+** Starts the WebSocket connection to the specified controller MTP
+**
+** \param   cont - pointer to controller
+** \param   mtp - pointer to controller MTP
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartControllerMtpWebSocket(controller_t *cont, controller_mtp_t *mtp)
+{
+    // Exit if the controller's WebSocket server has not been configured yet. The connection is started when Host is set
+    if ((mtp->websocket.host == NULL) || (mtp->websocket.host[0] == '\0'))
+    {
+        USP_LOG_Warning("%s: Not connecting to WebSocket server of controller %s: Host is not set", __FUNCTION__, cont->endpoint_id);
+        return USP_ERR_OK;
+    }
+
+    return WSCLIENT_StartClient(cont->instance, mtp->instance, cont->endpoint_id, &mtp->websocket);
+}
+#endif
+
 /*********************************************************************//**
 **
 ** Notify_PeriodicNotifInterval
@@ -1699,6 +2247,8 @@ int Get_ControllerInheritedRole(dm_req_t *req, char *buf, int len)
 int ProcessControllerAdded(int cont_instance)
 {
     controller_t *cont;
+    controller_mtp_t **mtps;
+    int mtps_size;
     int err;
     int i;
     int_vector_t iv;
@@ -1715,16 +2265,20 @@ int ProcessControllerAdded(int cont_instance)
         return USP_ERR_RESOURCES_EXCEEDED;        
     }
 
-    // Initialise to defaults
+    // Initialise to defaults (preserving the controller's MTP slots, which are reused)
     INT_VECTOR_Init(&iv);
+    mtps = cont->mtps;
+    mtps_size = cont->mtps_size;
     memset(cont, 0, sizeof(controller_t));
+    cont->mtps = mtps;
+    cont->mtps_size = mtps_size;
     cont->instance = cont_instance;
     cont->combined_role.inherited = ROLE_DEFAULT;
     cont->combined_role.assigned = ROLE_DEFAULT;
     
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
-        cont->mtps[i].instance = INVALID;
+        cont->mtps[i]->instance = INVALID;
     }
 
     // Exit if unable to determine whether this controller was enabled or not
@@ -1791,12 +2345,15 @@ int ProcessControllerAdded(int cont_instance)
         goto exit;
     }
 
+    // Add this controller to the EndpointID hash index
+    RebuildControllerIndex();
+
     // Exit if unable to get the assigned role of this controller
     USP_SNPRINTF(path, sizeof(path), "%s.%d.AssignedRole", device_cont_root, cont_instance);
     err = DATA_MODEL_GetParameterValue(path, reference, sizeof(reference), 0);
     if (err != USP_ERR_OK)
     {
-        return err;
+        goto exit;
     }
 
     // Exit if the value was incorrectly set
@@ -1811,7 +2368,7 @@ int ProcessControllerAdded(int cont_instance)
     err = DATA_MODEL_GetInstances(path, &iv);
     if (err != USP_ERR_OK)
     {
-        return err;
+        goto exit;
     }
 
     // Exit, issuing a warning, if no MTPs for this controller are present in database
@@ -1972,6 +2529,44 @@ int ProcessControllerMtpAdded(controller_t *cont, int mtp_instance)
     }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+    // Exit if unable to get the configuration of the WebSocket connection to this controller
+    err = GetControllerMtpWebSocketConfig(cont, mtp);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Start a WebSocket connection to this controller (if required)
+    if ((mtp->protocol == kMtpProtocol_WebSockets) && (mtp->enable) && (cont->enable))
+    {
+        err = StartControllerMtpWebSocket(cont, mtp);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+#endif
+
+#ifdef ENABLE_MQTT
+    // Exit if there was an error in the reference to the entry in the MQTT client table
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MTP.%d.MQTT.Reference", device_cont_root, cont->instance, mtp_instance);
+    err = DEVICE_MTP_GetMqttReference(path, &mtp->mqtt_client_instance);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the name of the controller's MQTT topic
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MTP.%d.MQTT.Topic", device_cont_root, cont->instance, mtp_instance);
+    USP_ASSERT(mtp->mqtt_controller_topic == NULL);
+    err = DM_ACCESS_GetString(path, &mtp->mqtt_controller_topic);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+#endif
+
     err = USP_ERR_OK;
 
 exit:
@@ -2005,6 +2600,7 @@ int UpdateAssignedRole(controller_t *cont, char *reference)
     if (*reference == '\0')
     {
         cont->combined_role.assigned = INVALID_ROLE;
+        InvalidateControllerRoles();
         return USP_ERR_OK;
     }
     
@@ -2023,6 +2619,7 @@ int UpdateAssignedRole(controller_t *cont, char *reference)
     }
 
     cont->combined_role.assigned = role;
+    InvalidateControllerRoles();
     
     return USP_ERR_OK;
 }
@@ -2041,22 +2638,49 @@ int UpdateAssignedRole(controller_t *cont, char *reference)
 controller_t *FindUnusedController(void)
 {
     int i;
+    int new_size;
     controller_t *cont;
 
     // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
         // Exit if found an unused controller
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance == INVALID)
         {
             return cont;
         }
     }
 
-    // If the code gets here, then no free controller slot has been found
-    USP_ERR_SetMessage("%s: Only %d controllers are supported.", __FUNCTION__, MAX_CONTROLLERS);
-    return NULL;
+    // Exit if the controller array cannot be grown any further
+    if (controllers_size >= MAX_CONTROLLERS)
+    {
+        USP_ERR_SetMessage("%s: Only %d controllers are supported.", __FUNCTION__, MAX_CONTROLLERS);
+        return NULL;
+    }
+
+    // Otherwise grow the controller array (doubling its size), marking all new slots as unused
+    new_size = (controllers_size == 0) ? MIN_CONTROLLERS_ALLOC : 2*controllers_size;
+    if (new_size > MAX_CONTROLLERS)
+    {
+        new_size = MAX_CONTROLLERS;
+    }
+
+    controllers = USP_REALLOC(controllers, new_size*sizeof(controller_t *));
+    for (i=controllers_size; i<new_size; i++)
+    {
+        cont = USP_MALLOC(sizeof(controller_t));
+        memset(cont, 0, sizeof(controller_t));
+        cont->instance = INVALID;
+        cont->mtps = NULL;
+        cont->mtps_size = 0;
+        controllers[i] = cont;
+    }
+
+    // Return the first of the new slots
+    cont = controllers[controllers_size];
+    controllers_size = new_size;
+    return cont;
 }
 
 /*********************************************************************//**
@@ -2073,22 +2697,47 @@ controller_t *FindUnusedController(void)
 controller_mtp_t *FindUnusedControllerMtp(controller_t *cont)
 {
     int i;
+    int new_size;
     controller_mtp_t *mtp;
 
     // Iterate over all MTP slots for this controller
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
         // Exit if found an unused controller MTP
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
         if (mtp->instance == INVALID)
         {
             return mtp;
         }
     }
 
-    // If the code gets here, then no free MTP slot has been found for this controller
-    USP_ERR_SetMessage("%s: Only %d MTPs are supported per controller.", __FUNCTION__, MAX_CONTROLLER_MTPS);
-    return NULL;
+    // Exit if the MTP array for this controller cannot be grown any further
+    if (cont->mtps_size >= MAX_CONTROLLER_MTPS)
+    {
+        USP_ERR_SetMessage("%s: Only %d MTPs are supported per controller.", __FUNCTION__, MAX_CONTROLLER_MTPS);
+        return NULL;
+    }
+
+    // Otherwise grow the MTP array (doubling its size), marking all new slots as unused
+    new_size = (cont->mtps_size == 0) ? MIN_CONTROLLER_MTPS_ALLOC : 2*cont->mtps_size;
+    if (new_size > MAX_CONTROLLER_MTPS)
+    {
+        new_size = MAX_CONTROLLER_MTPS;
+    }
+
+    cont->mtps = USP_REALLOC(cont->mtps, new_size*sizeof(controller_mtp_t *));
+    for (i=cont->mtps_size; i<new_size; i++)
+    {
+        mtp = USP_MALLOC(sizeof(controller_mtp_t));
+        memset(mtp, 0, sizeof(controller_mtp_t));
+        mtp->instance = INVALID;
+        cont->mtps[i] = mtp;
+    }
+
+    // Return the first of the new slots
+    mtp = cont->mtps[cont->mtps_size];
+    cont->mtps_size = new_size;
+    return mtp;
 }
 
 /*********************************************************************//**
@@ -2147,10 +2796,10 @@ controller_t *FindControllerByInstance(int cont_instance)
     controller_t *cont;
 
     // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
         // Exit if found a controller that matches the instance number
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance == cont_instance)
         {
             return cont;
@@ -2174,23 +2823,7 @@ controller_t *FindControllerByInstance(int cont_instance)
 **************************************************************************/
 controller_t *FindControllerByEndpointId(char *endpoint_id)
 {
-    int i;
-    controller_t *cont;
-
-    // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
-    {
-        // Exit if found an enabled controller that matches the endpoint_id
-        cont = &controllers[i];
-        if ((cont->instance != INVALID) && 
-            (strcmp(cont->endpoint_id, endpoint_id)==0))
-        {
-            return cont;
-        }
-    }
-
-    // If the code gets here, then no matching controller was found
-    return NULL;
+    return LookupControllerIndex(endpoint_id, INVALID, false);
 }
 
 /*********************************************************************//**
@@ -2206,23 +2839,7 @@ controller_t *FindControllerByEndpointId(char *endpoint_id)
 **************************************************************************/
 controller_t *FindEnabledControllerByEndpointId(char *endpoint_id)
 {
-    int i;
-    controller_t *cont;
-
-    // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
-    {
-        // Exit if found an enabled controller that matches the endpoint_id
-        cont = &controllers[i];
-        if ((cont->instance != INVALID) && (cont->enable == true) && 
-            (strcmp(cont->endpoint_id, endpoint_id)==0))
-        {
-            return cont;
-        }
-    }
-
-    // If the code gets here, then no matching controller was found
-    return NULL;
+    return LookupControllerIndex(endpoint_id, INVALID, true);
 }
 
 /*********************************************************************//**
@@ -2244,9 +2861,9 @@ controller_mtp_t *FindFirstEnabledMtp(controller_t *cont, mtp_protocol_t preferr
     controller_mtp_t *first_mtp = NULL;
     
     // Iterate over all enabled MTPs for this controller, finding the first enabled MTP for this controller
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
 
         if ((mtp->instance != INVALID) && (mtp->enable == true))
         {
@@ -2285,10 +2902,10 @@ controller_mtp_t *FindControllerMtpByInstance(controller_t *cont, int mtp_instan
     controller_mtp_t *mtp;
 
     // Iterate over all MTPs for this controller
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
         // Exit if found an MTP that matches the instance number
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
         if (mtp->instance == mtp_instance)
         {
             return mtp;
@@ -2317,13 +2934,17 @@ void DestroyController(controller_t *cont)
     
     cont->instance = INVALID;      // Mark controller slot as free
     cont->enable = false;
+    MSG_HANDLER_FreeControllerReplayCache(cont->endpoint_id);
     USP_SAFE_FREE(cont->endpoint_id);
 
-    for (i=0; i<MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
         DestroyControllerMtp(mtp);
     }
+
+    // Remove this controller from the EndpointID hash index
+    RebuildControllerIndex();
 }
 
 /*********************************************************************//**
@@ -2350,6 +2971,17 @@ void DestroyControllerMtp(controller_mtp_t *mtp)
     USP_SAFE_FREE(mtp->coap.resource);
     mtp->coap.port = 0;
 #endif
+
+#ifdef ENABLE_WEBSOCKETS
+    USP_SAFE_FREE(mtp->websocket.host);
+    USP_SAFE_FREE(mtp->websocket.path);
+    memset(&mtp->websocket, 0, sizeof(mtp->websocket));
+#endif
+
+#ifdef ENABLE_MQTT
+    mtp->mqtt_client_instance = INVALID;
+    USP_SAFE_FREE(mtp->mqtt_controller_topic);
+#endif
 }
 
 /*********************************************************************//**
@@ -2403,9 +3035,9 @@ int ValidateStompMtpUniqueness(controller_t *cont, int mtp_instance)
     controller_mtp_t *mtp;
 
     // Iterate over all MTPs, seeing if any (other than the one currently being set) is enabled and a STOMP connection
-    for (i=0; i < MAX_CONTROLLER_MTPS; i++)
+    for (i=0; i<cont->mtps_size; i++)
     {
-        mtp = &cont->mtps[i];
+        mtp = cont->mtps[i];
 
         // Skip this entry if not in use
         if (mtp->instance == INVALID)
@@ -2446,36 +3078,154 @@ int ValidateStompMtpUniqueness(controller_t *cont, int mtp_instance)
 **
 **************************************************************************/
 int ValidateEndpointIdUniqueness(char *endpoint_id, int cont_instance)
+{
+    controller_t *cont;
+
+    // Exit if the specified endpointID is already used by another controller
+    // NOTE: The instance which is having it's EndpointID altered is skipped
+    cont = LookupControllerIndex(endpoint_id, cont_instance, false);
+    if (cont != NULL)
+    {
+        USP_ERR_SetMessage("%s: EndpointID is not unique (matches %s.%d)", __FUNCTION__, device_cont_root, cont->instance);
+        return USP_ERR_UNIQUE_KEY_CONFLICT;
+    }
+
+    // If the code gets here, then the specified endpointID is unique among all controllers
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** RebuildControllerIndex
+**
+** Rebuilds the hash index of controllers keyed by EndpointID
+** This is called whenever a controller is added or deleted, or its EndpointID changes
+** NOTE: This function is only called from the data model thread, whilst the Get worker threads are idle
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void RebuildControllerIndex(void)
 {
     int i;
+    int slot;
+    int count;
+    int new_size;
+    unsigned hash;
     controller_t *cont;
 
-    // Interate over all controllers, checking that none match the new EndpointID
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    // Count the number of controllers which need to be indexed
+    count = 0;
+    for (i=0; i<controllers_size; i++)
     {
-        // Skip unused controller slots
-        cont = &controllers[i];
-        if (cont->instance == INVALID)
+        cont = controllers[i];
+        if ((cont->instance != INVALID) && (cont->endpoint_id != NULL))
         {
-            continue;
+            count++;
         }
+    }
 
-        // Skip the instance which is having it's EndpointID altered
-        if (cont->instance == cont_instance)
+    // Size the index so that it is at most half full, growing it if necessary
+    new_size = (cont_index_size == 0) ? CONT_INDEX_MIN_SIZE : cont_index_size;
+    while (new_size < 2*count)
+    {
+        new_size *= 2;
+    }
+
+    if (new_size != cont_index_size)
+    {
+        USP_SAFE_FREE(cont_index);
+        cont_index = USP_MALLOC(new_size*sizeof(cont_index_entry_t));
+        cont_index_size = new_size;
+    }
+    memset(cont_index, 0, cont_index_size*sizeof(cont_index_entry_t));
+
+    // Insert all controllers into the index, using linear probing to resolve collisions
+    for (i=0; i<controllers_size; i++)
+    {
+        cont = controllers[i];
+        if ((cont->instance == INVALID) || (cont->endpoint_id == NULL))
         {
             continue;
         }
 
-        // Exit if the specified endpointID is already used by another controller
-        if (strcmp(cont->endpoint_id, endpoint_id)==0)
+        hash = (unsigned) TEXT_UTILS_CalcHash(cont->endpoint_id);
+        slot = hash & (cont_index_size-1);
+        while (cont_index[slot].cont != NULL)
         {
-            USP_ERR_SetMessage("%s: EndpointID is not unique (matches %s.%d)", __FUNCTION__, device_cont_root, cont->instance);
-            return USP_ERR_UNIQUE_KEY_CONFLICT;
+            slot = (slot + 1) & (cont_index_size-1);
         }
+
+        cont_index[slot].cont = cont;
+        cont_index[slot].hash = hash;
     }
 
-    // If the code gets here, then the specified endpointID is unique among all controllers
-    return USP_ERR_OK;
+    // The controller instance associated with an EndpointID may have changed
+    InvalidateControllerRoles();
+}
+
+/*********************************************************************//**
+**
+** InvalidateControllerRoles
+**
+** Invalidates the controller instance and combined role cached (per thread) by the message handler for each EndpointID
+** This must be called whenever a change is made which alters the controller or combined role associated with an EndpointID
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void InvalidateControllerRoles(void)
+{
+    __atomic_add_fetch(&controller_role_generation, 1, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************//**
+**
+** LookupControllerIndex
+**
+** Finds the controller matching the specified endpoint_id, using the hash index
+**
+** \param   endpoint_id - name of the controller to find
+** \param   skip_instance - instance number of a controller to ignore, or INVALID if no controller should be ignored
+** \param   enabled_only - set if only enabled controllers should match
+**
+** \return  pointer to controller entry within the controllers array, or NULL if controller was not found
+**
+**************************************************************************/
+controller_t *LookupControllerIndex(char *endpoint_id, int skip_instance, bool enabled_only)
+{
+    int slot;
+    unsigned hash;
+    controller_t *cont;
+
+    // Exit if no controllers have been indexed yet
+    if ((cont_index == NULL) || (endpoint_id == NULL))
+    {
+        return NULL;
+    }
+
+    // Probe from the home slot until an empty slot is found
+    hash = (unsigned) TEXT_UTILS_CalcHash(endpoint_id);
+    slot = hash & (cont_index_size-1);
+    while (cont_index[slot].cont != NULL)
+    {
+        cont = cont_index[slot].cont;
+        if ((cont_index[slot].hash == hash) && (cont->instance != skip_instance) &&
+            ((enabled_only == false) || (cont->enable == true)) &&
+            (strcmp(cont->endpoint_id, endpoint_id)==0))
+        {
+            return cont;
+        }
+
+        slot = (slot + 1) & (cont_index_size-1);
+    }
+
+    // If the code gets here, then no matching controller was found
+    return NULL;
 }
 
 /*********************************************************************//**
@@ -2535,10 +3285,10 @@ void UpdateFirstPeriodicNotificationTime(void)
     time_t first = END_OF_TIME;
 
     // Iterate over all controllers
-    for (i=0; i<MAX_CONTROLLERS; i++)
+    for (i=0; i<controllers_size; i++)
     {
         // Skip this entry if it is unused
-        cont = &controllers[i];
+        cont = controllers[i];
         if (cont->instance == INVALID)
         {
             continue;
@@ -134,11 +134,25 @@ int DEVICE_LOCAL_AGENT_Init(void)
 
     // Determine which protocol is used
     #ifdef ENABLE_COAP
-        #define SUPPORTED_PROTOCOLS      "STOMP, CoAP"
+        #define SUPPORTED_PROTOCOLS_COAP ", CoAP"
     #else
-        #define SUPPORTED_PROTOCOLS      "STOMP"
+        #define SUPPORTED_PROTOCOLS_COAP ""
     #endif
 
+    #ifdef ENABLE_WEBSOCKETS
+        #define SUPPORTED_PROTOCOLS_WS   ", WebSocket"
+    #else
+        #define SUPPORTED_PROTOCOLS_WS   ""
+    #endif
+
+    #ifdef ENABLE_MQTT
+        #define SUPPORTED_PROTOCOLS_MQTT ", MQTT"
+    #else
+        #define SUPPORTED_PROTOCOLS_MQTT ""
+    #endif
+
+    #define SUPPORTED_PROTOCOLS      "STOMP" SUPPORTED_PROTOCOLS_COAP SUPPORTED_PROTOCOLS_WS SUPPORTED_PROTOCOLS_MQTT
+
     err |= USP_REGISTER_Param_Constant("Device.LocalAgent.SupportedProtocols", SUPPORTED_PROTOCOLS, DM_STRING);
     err |= USP_REGISTER_Param_Constant("Device.LocalAgent.SoftwareVersion", AGENT_SOFTWARE_VERSION, DM_STRING);
 
@@ -0,0 +1,1424 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2017-2019  CommScope, Inc
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file device_mqtt.c
+ *
+ * Implements the Device.MQTT data model object
+ *
+ */
+
+#ifdef ENABLE_MQTT
+
+#include <time.h>
+#include <string.h>
+#include <limits.h>
+
+#include "common_defs.h"
+#include "data_model.h"
+#include "usp_api.h"
+#include "dm_access.h"
+#include "dm_trans.h"
+#include "mtp_exec.h"
+#include "device.h"
+#include "text_utils.h"
+#include "mqtt.h"
+
+//------------------------------------------------------------------------------
+// Location of the MQTT client table within the data model
+#define DEVICE_MQTT_CLIENT_ROOT "Device.MQTT.Client"
+static const char device_mqtt_client_root[] = DEVICE_MQTT_CLIENT_ROOT;
+
+//------------------------------------------------------------------------------
+// Cache of the parameters in the Device.MQTT.Client table
+static mqtt_client_params_t mqtt_client_params[MAX_MQTT_CLIENTS];
+
+//------------------------------------------------------------------------------
+// Table to convert Device.MQTT.Client.{i}.TransportProtocol to and from whether the connection is encrypted
+const enum_entry_t mqtt_transport_protocols[] =
+{
+    { false, "TCP/IP" },
+    { true,  "TLS" },
+};
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+int ValidateAdd_MqttClient(dm_req_t *req);
+int Notify_MqttClientAdded(dm_req_t *req);
+int Notify_MqttClientDeleted(dm_req_t *req);
+int Get_MqttClientStatus(dm_req_t *req, char *buf, int len);
+int Get_MqttResponseInformation(dm_req_t *req, char *buf, int len);
+int Validate_MqttTransportProtocol(dm_req_t *req, char *value);
+int Validate_MqttKeepAliveTime(dm_req_t *req, char *value);
+int Validate_MqttTopicAliasMaximum(dm_req_t *req, char *value);
+int Validate_MqttPublishQoS(dm_req_t *req, char *value);
+int Validate_MqttRetryInitialInterval(dm_req_t *req, char *value);
+int Validate_MqttRetryIntervalMultiplier(dm_req_t *req, char *value);
+int Validate_MqttRetryMaxInterval(dm_req_t *req, char *value);
+int NotifyChange_MqttEnable(dm_req_t *req, char *value);
+int NotifyChange_MqttBrokerAddress(dm_req_t *req, char *value);
+int NotifyChange_MqttBrokerPort(dm_req_t *req, char *value);
+int NotifyChange_MqttTransportProtocol(dm_req_t *req, char *value);
+int NotifyChange_MqttClientID(dm_req_t *req, char *value);
+int NotifyChange_MqttUsername(dm_req_t *req, char *value);
+int NotifyChange_MqttPassword(dm_req_t *req, char *value);
+int NotifyChange_MqttKeepAliveTime(dm_req_t *req, char *value);
+int NotifyChange_MqttCleanStart(dm_req_t *req, char *value);
+int NotifyChange_MqttSessionExpiryInterval(dm_req_t *req, char *value);
+int NotifyChange_MqttTopicAliasMaximum(dm_req_t *req, char *value);
+int NotifyChange_MqttPublishQoS(dm_req_t *req, char *value);
+int NotifyChange_MqttRetryInitialInterval(dm_req_t *req, char *value);
+int NotifyChange_MqttRetryIntervalMultiplier(dm_req_t *req, char *value);
+int NotifyChange_MqttRetryMaxInterval(dm_req_t *req, char *value);
+int ProcessMqttClientAdded(int instance);
+mqtt_client_params_t *FindUnusedMqttParams(void);
+void DestroyMqttClient(mqtt_client_params_t *mp);
+mqtt_client_params_t *FindMqttParamsByInstance(int instance);
+int EnableMqttClient(mqtt_client_params_t *mp);
+void ScheduleMqttReconnect(mqtt_client_params_t *mp);
+void UpdateMqttStringParam(mqtt_client_params_t *mp, char **param, char *value);
+void UpdateMqttUnsignedParam(mqtt_client_params_t *mp, unsigned *param, unsigned value);
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_Init
+**
+** Initialises this component, and registers all parameters which it implements
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MQTT_Init(void)
+{
+    int err = USP_ERR_OK;
+    int i;
+    mqtt_client_params_t *mp;
+
+    // Exit if unable to initialise the lower level MQTT component
+    err = MQTT_Init();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Mark all MQTT params slots as unused
+    memset(mqtt_client_params, 0, sizeof(mqtt_client_params));
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mp = &mqtt_client_params[i];
+        mp->instance = INVALID;
+    }
+
+    // Register parameters implemented by this component
+    err |= USP_REGISTER_Object(DEVICE_MQTT_CLIENT_ROOT ".{i}", ValidateAdd_MqttClient, NULL, Notify_MqttClientAdded,
+                                                               NULL, NULL, Notify_MqttClientDeleted);
+    err |= USP_REGISTER_Param_NumEntries("Device.MQTT.ClientNumberOfEntries", DEVICE_MQTT_CLIENT_ROOT ".{i}");
+    err |= USP_REGISTER_DBParam_Alias(DEVICE_MQTT_CLIENT_ROOT ".{i}.Alias", NULL);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MQTT_CLIENT_ROOT ".{i}.Status", Get_MqttClientStatus, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadOnly(DEVICE_MQTT_CLIENT_ROOT ".{i}.ProtocolVersion", "5.0", DM_STRING);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MQTT_CLIENT_ROOT ".{i}.ResponseInformation", Get_MqttResponseInformation, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.Enable", "false", NULL, NotifyChange_MqttEnable, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.BrokerAddress", "", NULL, NotifyChange_MqttBrokerAddress, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.BrokerPort", "1883", DM_ACCESS_ValidatePort, NotifyChange_MqttBrokerPort, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.TransportProtocol", "TCP/IP", Validate_MqttTransportProtocol, NotifyChange_MqttTransportProtocol, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.ClientID", "", NULL, NotifyChange_MqttClientID, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.Username", "", NULL, NotifyChange_MqttUsername, DM_STRING);
+    err |=    USP_REGISTER_DBParam_Secure(DEVICE_MQTT_CLIENT_ROOT ".{i}.Password", "", NULL, NotifyChange_MqttPassword);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.KeepAliveTime", "60", Validate_MqttKeepAliveTime, NotifyChange_MqttKeepAliveTime, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.CleanStart", "false", NULL, NotifyChange_MqttCleanStart, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.SessionExpiryInterval", "3600", NULL, NotifyChange_MqttSessionExpiryInterval, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.TopicAliasMaximum", "16", Validate_MqttTopicAliasMaximum, NotifyChange_MqttTopicAliasMaximum, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.PublishQoS", "1", Validate_MqttPublishQoS, NotifyChange_MqttPublishQoS, DM_UINT);
+
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.ConnectRetryTime", "5", Validate_MqttRetryInitialInterval, NotifyChange_MqttRetryInitialInterval, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.ConnectRetryIntervalMultiplier", "2000", Validate_MqttRetryIntervalMultiplier, NotifyChange_MqttRetryIntervalMultiplier, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_MQTT_CLIENT_ROOT ".{i}.ConnectRetryMaxInterval", "30720", Validate_MqttRetryMaxInterval, NotifyChange_MqttRetryMaxInterval, DM_UINT);
+
+    // Exit if any errors occurred
+    if (err != USP_ERR_OK)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // If the code gets here, then registration was successful
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_Start
+**
+** Initialises the MQTT client array from the DB
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MQTT_Start(void)
+{
+    int i;
+    int err;
+    int_vector_t iv;
+    int instance;
+    char path[MAX_DM_PATH];
+
+    // Exit if unable to get the object instance numbers present in the MQTT client table
+    err = DATA_MODEL_GetInstances(DEVICE_MQTT_CLIENT_ROOT, &iv);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Add all MQTT clients to the MQTT client array
+    for (i=0; i < iv.num_entries; i++)
+    {
+        instance = iv.vector[i];
+        err = ProcessMqttClientAdded(instance);
+        if (err != USP_ERR_OK)
+        {
+            // Exit if unable to delete an MQTT client with bad parameters from the DB
+            USP_SNPRINTF(path, sizeof(path), "%s.%d", device_mqtt_client_root, instance);
+            USP_LOG_Warning("%s: Deleting %s as it contained invalid parameters.", __FUNCTION__, path);
+            err = DATA_MODEL_DeleteInstance(path, 0);
+            if (err != USP_ERR_OK)
+            {
+                goto exit;
+            }
+        }
+    }
+
+    // Exit if unable to create the SSL context to be used by MQTT
+    err = MQTT_Start();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    err = USP_ERR_OK;
+
+exit:
+    // Destroy the vector of instance numbers for the table
+    INT_VECTOR_Destroy(&iv);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_Stop
+**
+** Frees up all memory associated with this module
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MQTT_Stop(void)
+{
+    int i;
+    mqtt_client_params_t *mp;
+
+    // Iterate over all MQTT clients, freeing all memory used by it
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mp = &mqtt_client_params[i];
+        if (mp->instance != INVALID)
+        {
+            DestroyMqttClient(mp);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_StartAllClients
+**
+** Starts all MQTT clients
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MQTT_StartAllClients(void)
+{
+    int i;
+    mqtt_client_params_t *mp;
+    int err;
+
+    // Iterate over all MQTT clients, starting the ones that are enabled
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mp = &mqtt_client_params[i];
+        if ((mp->instance != INVALID) && (mp->enable == true))
+        {
+            // Exit if no free slots to enable the client. (Enable is successful, even if the client is trying to reconnect)
+            err = EnableMqttClient(mp);
+            if (err != USP_ERR_OK)
+            {
+                return err;
+            }
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_QueueBinaryMessage
+**
+** Function called to queue a message on the specified MQTT client
+**
+** \param   usp_msg_type - Type of USP message contained in pbuf. This is used for debug logging when the message is sent by the MTP.
+** \param   instance - instance number of the MQTT client in Device.MQTT.Client.{i}
+** \param   topic - name of MQTT topic to publish this message to
+** \param   pbuf - pointer to buffer containing binary protobuf message. Ownership of this buffer passes to this code, if successful
+** \param   pbuf_len - length of buffer containing protobuf binary message
+** \param   priority - send priority of the USP message (selects the queue that the USP message is added to)
+** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MQTT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *topic, unsigned char *pbuf, int pbuf_len, mtp_send_priority_t priority, time_t expiry_time)
+{
+    mqtt_client_params_t *mp;
+
+    // Exit if unable to find the specified MQTT client
+    mp = FindMqttParamsByInstance(instance);
+    if ((mp == NULL) || (mp->enable == false))
+    {
+        USP_ERR_SetMessage("%s: No internal MQTT client matching Device.MQTT.Client.%d", __FUNCTION__, instance);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if no topic to publish to
+    if ((topic == NULL) || (*topic == '\0'))
+    {
+        USP_ERR_SetMessage("%s: No MQTT topic to publish to on Device.MQTT.Client.%d", __FUNCTION__, instance);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return MQTT_QueueBinaryMessage(usp_msg_type, instance, topic, pbuf, pbuf_len, priority, expiry_time);
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_ScheduleReconnect
+**
+** Schedules a reconnect of the specified MQTT client, once that client has finished sending any response
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MQTT_ScheduleReconnect(int instance)
+{
+    mqtt_client_params_t *mp;
+
+    // Exit if unable to find the specified MQTT client
+    mp = FindMqttParamsByInstance(instance);
+    if (mp == NULL)
+    {
+        return;
+    }
+
+    // Schedule a reconnect if this MQTT client is enabled
+    if (mp->enable)
+    {
+        ScheduleMqttReconnect(mp);
+    }
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MQTT_GetMtpStatus
+**
+** Function called to get the value of Device.LocalAgent.MTP.{i}.Status for an MQTT client
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  Status of the MQTT client
+**
+**************************************************************************/
+mtp_status_t DEVICE_MQTT_GetMtpStatus(int instance)
+{
+    mqtt_client_params_t *mp;
+
+    // Exit if unable to find the specified MQTT client
+    // NOTE: This could occur if the client was disabled, or the client reference was incorrect
+    mp = FindMqttParamsByInstance(instance);
+    if ((mp == NULL) || (mp->enable == false))
+    {
+        return kMtpStatus_Down;
+    }
+
+    return MQTT_GetMtpStatus(mp->instance);
+}
+
+/*********************************************************************//**
+**
+** ValidateAdd_MqttClient
+**
+** Function called to determine whether a new MQTT client may be added
+**
+** \param   req - pointer to structure identifying the MQTT client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ValidateAdd_MqttClient(dm_req_t *req)
+{
+    mqtt_client_params_t *mp;
+
+    // Exit if unable to find a free MQTT client slot
+    mp = FindUnusedMqttParams();
+    if (mp == NULL)
+    {
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Notify_MqttClientAdded
+**
+** Function called when an MQTT client has been added to Device.MQTT.Client.{i}
+**
+** \param   req - pointer to structure identifying the MQTT client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Notify_MqttClientAdded(dm_req_t *req)
+{
+    int err;
+    mqtt_client_params_t *mp;
+
+    // Exit if failed to copy from DB into MQTT client array
+    err = ProcessMqttClientAdded(inst1);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Start the client (if enabled)
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);         // As we had just successfully added it
+    if (mp->enable == true)
+    {
+        // Exit if no free slots to enable the client. (Enable is successful, even if the client is trying to reconnect)
+        err = EnableMqttClient(mp);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Notify_MqttClientDeleted
+**
+** Function called when an MQTT client has been deleted from Device.MQTT.Client.{i}
+**
+** \param   req - pointer to structure identifying the client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Notify_MqttClientDeleted(dm_req_t *req)
+{
+    mqtt_client_params_t *mp;
+
+    // Exit if client already deleted
+    // NOTE: We might not find it if it was never added. This could occur if deleting from the DB at startup when we detected that the database params were invalid
+    mp = FindMqttParamsByInstance(inst1);
+    if (mp == NULL)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Delete the client from the array, if it has not already been deleted
+    DestroyMqttClient(mp);
+
+    // Unpick references to this client
+    DEVICE_CONTROLLER_NotifyMqttClientDeleted(inst1);
+    DEVICE_MTP_NotifyMqttClientDeleted(inst1);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MqttClientStatus
+**
+** Gets the value of Device.MQTT.Client.{i}.Status
+**
+** \param   req - pointer to structure identifying the path
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MqttClientStatus(dm_req_t *req, char *buf, int len)
+{
+    mqtt_client_params_t *mp;
+    char *status;
+
+    // Determine MQTT client to be read
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    if (mp->enable == false)
+    {
+        status = "Disabled";
+    }
+    else
+    {
+        status = MQTT_GetClientStatus(mp->instance);
+    }
+
+    USP_STRNCPY(buf, status, len);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MqttResponseInformation
+**
+** Gets the value of Device.MQTT.Client.{i}.ResponseInformation
+** This is the Response Information that the broker returned in the CONNACK (if any)
+**
+** \param   req - pointer to structure identifying the path
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MqttResponseInformation(dm_req_t *req, char *buf, int len)
+{
+    MQTT_GetResponseInformation(inst1, buf, len);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttTransportProtocol
+**
+** Function called to validate Device.MQTT.Client.{i}.TransportProtocol
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttTransportProtocol(dm_req_t *req, char *value)
+{
+    int protocol;
+
+    // Exit if the transport protocol was invalid
+    protocol = TEXT_UTILS_StringToEnum(value, mqtt_transport_protocols, NUM_ELEM(mqtt_transport_protocols));
+    if (protocol == INVALID)
+    {
+        USP_ERR_SetMessage("%s: Invalid transport protocol %s", __FUNCTION__, value);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttKeepAliveTime
+**
+** Function called to validate Device.MQTT.Client.{i}.KeepAliveTime
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttKeepAliveTime(dm_req_t *req, char *value)
+{
+    // NOTE: The Keep Alive field in the CONNECT packet is a two byte integer. 0 disables keep alive PINGREQs
+    return DM_ACCESS_ValidateRange_Unsigned(req, 0, 65535);
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttTopicAliasMaximum
+**
+** Function called to validate Device.MQTT.Client.{i}.TopicAliasMaximum
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttTopicAliasMaximum(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 0, MAX_MQTT_TOPIC_ALIASES);
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttPublishQoS
+**
+** Function called to validate Device.MQTT.Client.{i}.PublishQoS
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttPublishQoS(dm_req_t *req, char *value)
+{
+    // NOTE: QoS 2 is not supported
+    return DM_ACCESS_ValidateRange_Unsigned(req, 0, 1);
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttRetryInitialInterval
+**
+** Function called to validate Device.MQTT.Client.{i}.ConnectRetryTime
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttRetryInitialInterval(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 1, 65535);
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttRetryIntervalMultiplier
+**
+** Function called to validate Device.MQTT.Client.{i}.ConnectRetryIntervalMultiplier
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttRetryIntervalMultiplier(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 1000, 65535);
+}
+
+/*********************************************************************//**
+**
+** Validate_MqttRetryMaxInterval
+**
+** Function called to validate Device.MQTT.Client.{i}.ConnectRetryMaxInterval
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_MqttRetryMaxInterval(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 1, UINT_MAX);
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttEnable
+**
+** Function called when Device.MQTT.Client.{i}.Enable is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttEnable(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+    bool old_value;
+    int err;
+
+    // Determine MQTT client to be updated
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+    old_value = mp->enable;
+
+    // Stop the client if it has been disabled
+    // NOTE: As for STOMP, this code does not support sending a response back to a controller that disables its own MQTT client
+    if ((old_value == true) && (val_bool == false))
+    {
+        MQTT_DisableClient(mp->instance);
+    }
+
+    // Set the new value, we do this inbetween stopping and starting the client because both must have the enable set to true
+    mp->enable = val_bool;
+
+    // Start the client if it has been enabled
+    if ((old_value == false) && (val_bool == true))
+    {
+        // Exit if no free slots to enable the client. (Enable is successful, even if the client is trying to reconnect)
+        err = EnableMqttClient(mp);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttBrokerAddress
+**
+** Function called when Device.MQTT.Client.{i}.BrokerAddress is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttBrokerAddress(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttStringParam(mp, &mp->broker_address, value);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttBrokerPort
+**
+** Function called when Device.MQTT.Client.{i}.BrokerPort is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttBrokerPort(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttUnsignedParam(mp, &mp->broker_port, val_uint);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttTransportProtocol
+**
+** Function called when Device.MQTT.Client.{i}.TransportProtocol is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttTransportProtocol(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+    bool enable_encryption;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    // NOTE: The value has already been validated
+    enable_encryption = (bool) TEXT_UTILS_StringToEnum(value, mqtt_transport_protocols, NUM_ELEM(mqtt_transport_protocols));
+    if (enable_encryption != mp->enable_encryption)
+    {
+        mp->enable_encryption = enable_encryption;
+        if (mp->enable)
+        {
+            ScheduleMqttReconnect(mp);
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttClientID
+**
+** Function called when Device.MQTT.Client.{i}.ClientID is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttClientID(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttStringParam(mp, &mp->client_id, value);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttUsername
+**
+** Function called when Device.MQTT.Client.{i}.Username is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttUsername(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttStringParam(mp, &mp->username, value);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttPassword
+**
+** Function called when Device.MQTT.Client.{i}.Password is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttPassword(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttStringParam(mp, &mp->password, value);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttKeepAliveTime
+**
+** Function called when Device.MQTT.Client.{i}.KeepAliveTime is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttKeepAliveTime(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttUnsignedParam(mp, &mp->keep_alive_time, val_uint);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttCleanStart
+**
+** Function called when Device.MQTT.Client.{i}.CleanStart is modified
+** NOTE: This does not cause a reconnect. The new value is used the next time the client connects
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttCleanStart(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    mp->clean_start = val_bool;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttSessionExpiryInterval
+**
+** Function called when Device.MQTT.Client.{i}.SessionExpiryInterval is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttSessionExpiryInterval(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttUnsignedParam(mp, &mp->session_expiry_interval, val_uint);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttTopicAliasMaximum
+**
+** Function called when Device.MQTT.Client.{i}.TopicAliasMaximum is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttTopicAliasMaximum(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttUnsignedParam(mp, &mp->topic_alias_maximum, val_uint);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttPublishQoS
+**
+** Function called when Device.MQTT.Client.{i}.PublishQoS is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttPublishQoS(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    UpdateMqttUnsignedParam(mp, &mp->publish_qos, val_uint);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttRetryInitialInterval
+**
+** Function called when Device.MQTT.Client.{i}.ConnectRetryTime is modified
+** NOTE: This does not cause a reconnect. The new value is used the next time the client retries
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttRetryInitialInterval(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    mp->retry_initial_interval = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttRetryIntervalMultiplier
+**
+** Function called when Device.MQTT.Client.{i}.ConnectRetryIntervalMultiplier is modified
+** NOTE: This does not cause a reconnect. The new value is used the next time the client retries
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttRetryIntervalMultiplier(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    mp->retry_interval_multiplier = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_MqttRetryMaxInterval
+**
+** Function called when Device.MQTT.Client.{i}.ConnectRetryMaxInterval is modified
+** NOTE: This does not cause a reconnect. The new value is used the next time the client retries
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_MqttRetryMaxInterval(dm_req_t *req, char *value)
+{
+    mqtt_client_params_t *mp;
+
+    mp = FindMqttParamsByInstance(inst1);
+    USP_ASSERT(mp != NULL);
+
+    mp->retry_max_interval = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ProcessMqttClientAdded
+**
+** Reads the parameters for the specified MQTT client from the database and processes them
+**
+** \param   instance - instance number of the MQTT client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int ProcessMqttClientAdded(int instance)
+{
+    mqtt_client_params_t *mp;
+    int err;
+    int transport_protocol;
+    char path[MAX_DM_PATH];
+
+    // Exit if unable to add another MQTT client
+    mp = FindUnusedMqttParams();
+    if (mp == NULL)
+    {
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    // Initialise to defaults
+    memset(mp, 0, sizeof(mqtt_client_params_t));
+    mp->instance = instance;
+
+    // Exit if unable to get the enable for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.Enable", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetBool(path, &mp->enable);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the broker address for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.BrokerAddress", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetString(path, &mp->broker_address);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the broker port for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.BrokerPort", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->broker_port);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the transport protocol for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.TransportProtocol", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetEnum(path, &transport_protocol, mqtt_transport_protocols, NUM_ELEM(mqtt_transport_protocols));
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+    mp->enable_encryption = (bool) transport_protocol;
+
+    // Exit if unable to get the client identifier for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.ClientID", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetString(path, &mp->client_id);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the username for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.Username", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetString(path, &mp->username);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the password for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.Password", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetPassword(path, &mp->password);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the keep alive time for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.KeepAliveTime", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->keep_alive_time);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the clean start for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.CleanStart", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetBool(path, &mp->clean_start);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the session expiry interval for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.SessionExpiryInterval", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->session_expiry_interval);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the topic alias maximum for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.TopicAliasMaximum", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->topic_alias_maximum);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the publish QoS for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.PublishQoS", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->publish_qos);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the connect retry time for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.ConnectRetryTime", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->retry_initial_interval);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the connect retry interval multiplier for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.ConnectRetryIntervalMultiplier", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->retry_interval_multiplier);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the connect retry max interval for this MQTT client
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.ConnectRetryMaxInterval", device_mqtt_client_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &mp->retry_max_interval);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // If the code gets here, then we successfully retrieved all data about the MQTT client
+    err = USP_ERR_OK;
+
+exit:
+    if (err != USP_ERR_OK)
+    {
+        DestroyMqttClient(mp);
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** FindUnusedMqttParams
+**
+** Finds the first free MQTT params slot
+**
+** \param   None
+**
+** \return  Pointer to first free slot, or NULL if no slot was found
+**
+**************************************************************************/
+mqtt_client_params_t *FindUnusedMqttParams(void)
+{
+    int i;
+    mqtt_client_params_t *mp;
+
+    // Iterate over all MQTT clients
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        // Exit if found an unused slot
+        mp = &mqtt_client_params[i];
+        if (mp->instance == INVALID)
+        {
+            return mp;
+        }
+    }
+
+    // If the code gets here, then no free slot has been found
+    USP_ERR_SetMessage("%s: Only %d MQTT clients are supported.", __FUNCTION__, MAX_MQTT_CLIENTS);
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** DestroyMqttClient
+**
+** Frees all memory associated with the specified MQTT client slot
+**
+** \param   mp - pointer to MQTT client to free
+**
+** \return  None
+**
+**************************************************************************/
+void DestroyMqttClient(mqtt_client_params_t *mp)
+{
+    // Disable the lower level client (if previously enabled)
+    if (mp->enable)
+    {
+        MQTT_DisableClient(mp->instance);
+    }
+
+    // Free and DeInitialise the slot
+    mp->instance = INVALID;      // Mark slot as free
+    mp->enable = false;
+    mp->broker_port = 0;
+    USP_SAFE_FREE(mp->broker_address);
+    USP_SAFE_FREE(mp->client_id);
+    USP_SAFE_FREE(mp->username);
+    USP_SAFE_FREE(mp->password);
+}
+
+/*********************************************************************//**
+**
+** FindMqttParamsByInstance
+**
+** Finds the MQTT params slot by it's data model instance number
+**
+** \param   instance - instance number of the MQTT client in the data model
+**
+** \return  pointer to slot, or NULL if slot was not found
+**
+**************************************************************************/
+mqtt_client_params_t *FindMqttParamsByInstance(int instance)
+{
+    int i;
+    mqtt_client_params_t *mp;
+
+    // Iterate over all MQTT clients
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        // Exit if found an MQTT client that matches the instance number
+        mp = &mqtt_client_params[i];
+        if (mp->instance == instance)
+        {
+            return mp;
+        }
+    }
+
+    // If the code gets here, then no matching slot was found
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** EnableMqttClient
+**
+** Wrapper function to enable an MQTT client with the current client parameters
+**
+** \param   mp - MQTT client parameters
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int EnableMqttClient(mqtt_client_params_t *mp)
+{
+    int err;
+    char *agent_topic;
+
+    agent_topic = DEVICE_MTP_GetAgentMqttResponseTopic(mp->instance);
+    err = MQTT_EnableClient(mp, agent_topic);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** ScheduleMqttReconnect
+**
+** Wrapper function to schedule an MQTT reconnect with the current client parameters
+**
+** \param   mp - MQTT client parameters
+**
+** \return  None
+**
+**************************************************************************/
+void ScheduleMqttReconnect(mqtt_client_params_t *mp)
+{
+    char *agent_topic;
+
+    agent_topic = DEVICE_MTP_GetAgentMqttResponseTopic(mp->instance);
+    MQTT_ScheduleReconnect(mp, agent_topic);
+}
+
+/*********************************************************************//**
+**
+** UpdateMqttStringParam
+**
+** Stores the new value of a string parameter of an MQTT client,
+** scheduling a reconnect (after the present response has been sent) if the value has changed
+**
+** \param   mp - MQTT client parameters
+** \param   param - pointer to the member of mp to update
+** \param   value - new value of the parameter
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateMqttStringParam(mqtt_client_params_t *mp, char **param, char *value)
+{
+    bool schedule_reconnect = false;
+
+    // Determine whether to schedule a reconnect
+    if ((strcmp(*param, value) != 0) && (mp->enable))
+    {
+        schedule_reconnect = true;
+    }
+
+    // Set the new value. This must be done before scheduling a reconnect, so that the reconnect uses the correct values
+    USP_SAFE_FREE(*param);
+    *param = USP_STRDUP(value);
+
+    if (schedule_reconnect)
+    {
+        ScheduleMqttReconnect(mp);
+    }
+}
+
+/*********************************************************************//**
+**
+** UpdateMqttUnsignedParam
+**
+** Stores the new value of an unsigned parameter of an MQTT client,
+** scheduling a reconnect (after the present response has been sent) if the value has changed
+**
+** \param   mp - MQTT client parameters
+** \param   param - pointer to the member of mp to update
+** \param   value - new value of the parameter
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateMqttUnsignedParam(mqtt_client_params_t *mp, unsigned *param, unsigned value)
+{
+    bool schedule_reconnect = false;
+
+    // Determine whether to schedule a reconnect
+    if ((*param != value) && (mp->enable))
+    {
+        schedule_reconnect = true;
+    }
+
+    // Set the new value. This must be done before scheduling a reconnect, so that the reconnect uses the correct values
+    *param = value;
+
+    if (schedule_reconnect)
+    {
+        ScheduleMqttReconnect(mp);
+    }
+}
+
+#endif // ENABLE_MQTT
@@ -0,0 +1,786 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file device_msg_stats.c
+ *
+ * Implements the Device.LocalAgent.X_VENDOR_Stats data model object
+ * This contains per USP message type counters and latency histograms for each stage in the lifetime of a USP message
+ * and the time taken by each phase of the startup of the agent
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common_defs.h"
+#include "data_model.h"
+#include "usp_api.h"
+#include "device.h"
+#include "msg_handler.h"
+#include "uptime.h"
+#include "socket_set.h"
+
+//------------------------------------------------------------------------------
+// Location of the message statistics table within the data model
+#define DEVICE_MSG_STATS_ROOT "Device.LocalAgent.X_VENDOR_Stats"
+#define DEVICE_MSG_TYPE_STATS_ROOT DEVICE_MSG_STATS_ROOT ".MsgType.{i}"
+
+//------------------------------------------------------------------------------
+// Number of buckets in each latency histogram
+// Bucket 0 counts durations less than MSG_STATS_FIRST_BUCKET_LIMIT microseconds, and the upper limit of each following bucket
+// is double that of the previous bucket. The last bucket counts all durations which do not fit in the other buckets.
+#define MSG_STATS_NUM_BUCKETS  20
+#define MSG_STATS_FIRST_BUCKET_LIMIT  16
+
+// Number of USP message types. Instance number (in the data model) of each message type is its Usp__Header__MsgType value plus one
+#define NUM_USP_MSG_TYPES  (USP__HEADER__MSG_TYPE__GET_SUPPORTED_PROTO_RESP + 1)
+
+//------------------------------------------------------------------------------
+// Statistics for one stage in the lifetime of a USP message type
+// NOTE: These are updated atomically, as they are updated by the data model thread, Get worker threads and MTP threads
+typedef struct
+{
+    unsigned long long count;           // Number of USP messages timed
+    unsigned long long total_time;      // Sum of durations (in microseconds) of all USP messages timed
+    unsigned long long max_time;        // Longest duration (in microseconds)
+    unsigned long long histogram[MSG_STATS_NUM_BUCKETS];
+} msg_stat_counters_t;
+
+static msg_stat_counters_t msg_stats[NUM_USP_MSG_TYPES][kMsgStat_Max];
+
+//------------------------------------------------------------------------------
+// Names of the stages, used to form the names of the data model parameters for each stage
+static char *msg_stat_names[kMsgStat_Max] =
+{
+    "QueueWait",        // kMsgStat_QueueWait
+    "Handle",           // kMsgStat_Handle
+    "Serialize",        // kMsgStat_Serialize
+    "SendQueueWait",    // kMsgStat_SendQueueWait
+    "WireSend",         // kMsgStat_WireSend
+};
+
+//------------------------------------------------------------------------------
+// Times (in microseconds) recorded during startup of the agent. 0 indicates that the time has not been recorded yet
+// NOTE: The milestones are recorded atomically, as they are recorded by the MTP threads
+static unsigned long long boot_start_time = 0;      // Time (from tu_uptime_usecs()) at which the agent process started
+static unsigned long long boot_times[kBootTime_Max];
+
+// Names of the startup times, used to form the names of the data model parameters for each time
+static char *boot_time_names[kBootTime_Max] =
+{
+    "Libraries",            // kBootTime_Libraries
+    "Database",             // kBootTime_Database
+    "MsgQueues",            // kBootTime_MsgQueues
+    "DataModelInit",        // kBootTime_DataModelInit
+    "DataModelStart",       // kBootTime_DataModelStart
+    "MtpStart",             // kBootTime_MtpStart
+    "Threads",              // kBootTime_Threads
+    "FirstMtpConnected",    // kBootTime_FirstMtpConnected
+    "EventSent",            // kBootTime_BootEventSent
+};
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+int Get_MsgTypeNumEntries(dm_req_t *req, char *buf, int len);
+int Get_MsgTypeName(dm_req_t *req, char *buf, int len);
+int Get_MsgStatCount(dm_req_t *req, char *buf, int len);
+int Get_MsgStatTotalTime(dm_req_t *req, char *buf, int len);
+int Get_MsgStatMaxTime(dm_req_t *req, char *buf, int len);
+int Get_MsgStatHistogram(dm_req_t *req, char *buf, int len);
+int Get_MemoryInUse(dm_req_t *req, char *buf, int len);
+int Get_MemoryHighWaterMark(dm_req_t *req, char *buf, int len);
+int Get_Wakeups(dm_req_t *req, char *buf, int len);
+int Get_WakeupsPerMinute(dm_req_t *req, char *buf, int len);
+int Get_BootTime(dm_req_t *req, char *buf, int len);
+msg_stat_counters_t *CalcMsgStatFromReq(dm_req_t *req);
+int CalcHistogramBucket(unsigned long long duration);
+void FormHistogramString(unsigned long long *histogram, char *buf, int len);
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_Init
+**
+** Initialises this component, and registers all parameters which it implements
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int DEVICE_MSG_STATS_Init(void)
+{
+    int err = USP_ERR_OK;
+    int i;
+    char path[MAX_DM_PATH];
+    char limits[MAX_DM_SHORT_VALUE_LEN];
+    int limits_len;
+    unsigned long long limit;
+
+    memset(msg_stats, 0, sizeof(msg_stats));
+
+    // Form the list of the upper limits (in microseconds) of all histogram buckets except the last (which has no upper limit)
+    limits[0] = '\0';
+    limits_len = 0;
+    limit = MSG_STATS_FIRST_BUCKET_LIMIT;
+    for (i=0; i < MSG_STATS_NUM_BUCKETS-1; i++)
+    {
+        limits_len += USP_SNPRINTF(&limits[limits_len], sizeof(limits)-limits_len, "%s%llu", (i==0) ? "" : ",", limit);
+        limit *= 2;
+    }
+
+    // Register parameters implemented by this component
+    // Device.LocalAgent.X_VENDOR_Stats
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_STATS_ROOT ".MsgTypeNumberOfEntries", Get_MsgTypeNumEntries, DM_UINT);
+    err |= USP_REGISTER_Param_Constant(DEVICE_MSG_STATS_ROOT ".HistogramBucketLimits", limits, DM_STRING);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_STATS_ROOT ".MemoryInUse", Get_MemoryInUse, DM_ULONG);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_STATS_ROOT ".MemoryHighWaterMark", Get_MemoryHighWaterMark, DM_ULONG);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_STATS_ROOT ".Wakeups", Get_Wakeups, DM_ULONG);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_STATS_ROOT ".WakeupsPerMinute", Get_WakeupsPerMinute, DM_UINT);
+
+    for (i=0; i < kBootTime_Max; i++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "%s.Boot%sTime", DEVICE_MSG_STATS_ROOT, boot_time_names[i]);
+        err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_BootTime, DM_ULONG);
+    }
+
+    // Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}
+    err |= USP_REGISTER_Object(DEVICE_MSG_TYPE_STATS_ROOT, USP_HOOK_DenyAddInstance, NULL, NULL,   // This table is read only
+                                                           USP_HOOK_DenyDeleteInstance, NULL, NULL);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_MSG_TYPE_STATS_ROOT ".Name", Get_MsgTypeName, DM_STRING);
+
+    for (i=0; i < kMsgStat_Max; i++)
+    {
+        USP_SNPRINTF(path, sizeof(path), "%s.%sCount", DEVICE_MSG_TYPE_STATS_ROOT, msg_stat_names[i]);
+        err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_MsgStatCount, DM_ULONG);
+
+        USP_SNPRINTF(path, sizeof(path), "%s.%sTotalTime", DEVICE_MSG_TYPE_STATS_ROOT, msg_stat_names[i]);
+        err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_MsgStatTotalTime, DM_ULONG);
+
+        USP_SNPRINTF(path, sizeof(path), "%s.%sMaxTime", DEVICE_MSG_TYPE_STATS_ROOT, msg_stat_names[i]);
+        err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_MsgStatMaxTime, DM_ULONG);
+
+        USP_SNPRINTF(path, sizeof(path), "%s.%sHistogram", DEVICE_MSG_TYPE_STATS_ROOT, msg_stat_names[i]);
+        err |= USP_REGISTER_VendorParam_ReadOnly(path, Get_MsgStatHistogram, DM_STRING);
+    }
+
+    // Register unique keys for tables
+    char *name_unique_key[]  = { "Name" };
+    err |= USP_REGISTER_Object_UniqueKey(DEVICE_MSG_TYPE_STATS_ROOT, name_unique_key, NUM_ELEM(name_unique_key));
+
+    // Exit if any errors occurred
+    if (err != USP_ERR_OK)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // If the code gets here, then registration was successful
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_Start
+**
+** Starts this component, adding all instances to the data model
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MSG_STATS_Start(void)
+{
+    int i;
+    int err;
+    char path[MAX_DM_PATH];
+
+    // Inform all message type instances to the data model
+    for (i=0; i < NUM_USP_MSG_TYPES; i++)
+    {
+        // Exit if unable to add message type instance into the data model
+        USP_SNPRINTF(path, sizeof(path), DEVICE_MSG_STATS_ROOT ".MsgType.%d", i+1);
+        err = DATA_MODEL_InformInstance(path);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_Record
+**
+** Records the duration of a stage in the lifetime of a USP message, which started at the specified time and ends now
+** This function may be called from any thread
+**
+** \param   msg_type - type of the USP message
+** \param   stat - stage in the lifetime of the USP message being timed
+** \param   start_time - time (in microseconds, from tu_uptime_usecs()) at which the stage started
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_Record(Usp__Header__MsgType msg_type, msg_stat_t stat, unsigned long long start_time)
+{
+    unsigned long long now;
+
+    now = tu_uptime_usecs();
+    DEVICE_MSG_STATS_RecordDuration(msg_type, stat, (now > start_time) ? now - start_time : 0);
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_RecordDuration
+**
+** Records the duration of a stage in the lifetime of a USP message
+** This function may be called from any thread
+**
+** \param   msg_type - type of the USP message
+** \param   stat - stage in the lifetime of the USP message being timed
+** \param   duration - duration (in microseconds) of the stage
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_RecordDuration(Usp__Header__MsgType msg_type, msg_stat_t stat, unsigned long long duration)
+{
+    msg_stat_counters_t *ms;
+    unsigned long long max_time;
+
+    // Exit if the message type is not known (eg sent by a controller supporting a later version of USP)
+    if (((unsigned)msg_type >= NUM_USP_MSG_TYPES) || ((unsigned)stat >= kMsgStat_Max))
+    {
+        return;
+    }
+
+    ms = &msg_stats[msg_type][stat];
+    __atomic_fetch_add(&ms->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ms->total_time, duration, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ms->histogram[CalcHistogramBucket(duration)], 1, __ATOMIC_RELAXED);
+
+    // Update the maximum duration, retrying if another thread updated it at the same time
+    max_time = __atomic_load_n(&ms->max_time, __ATOMIC_RELAXED);
+    while (duration > max_time)
+    {
+        if (__atomic_compare_exchange_n(&ms->max_time, &max_time, duration, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_Dump
+**
+** Logs the message statistics for all USP message types which have been timed
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_Dump(void)
+{
+    int i, j;
+    msg_stat_counters_t *ms;
+    unsigned long long count;
+    char histogram[MAX_DM_SHORT_VALUE_LEN];
+
+    USP_DUMP("Wakeups: total=%llu, last minute=%u", SOCKET_SET_GetWakeups(), SOCKET_SET_GetWakeupsPerMinute());
+    USP_DUMP("Histogram bucket limits (us): first=%d, doubling for %d buckets", MSG_STATS_FIRST_BUCKET_LIMIT, MSG_STATS_NUM_BUCKETS);
+    USP_DUMP("%-26s %-14s %10s %10s %10s  %s", "MsgType", "Stage", "Count", "Mean(us)", "Max(us)", "Histogram");
+    for (i=0; i < NUM_USP_MSG_TYPES; i++)
+    {
+        for (j=0; j < kMsgStat_Max; j++)
+        {
+            // Skip stages which have not been timed for this message type
+            ms = &msg_stats[i][j];
+            count = __atomic_load_n(&ms->count, __ATOMIC_RELAXED);
+            if (count == 0)
+            {
+                continue;
+            }
+
+            FormHistogramString(ms->histogram, histogram, sizeof(histogram));
+            USP_DUMP("%-26s %-14s %10llu %10llu %10llu  %s", MSG_HANDLER_UspMsgTypeToString(i), msg_stat_names[j], count,
+                     __atomic_load_n(&ms->total_time, __ATOMIC_RELAXED) / count, __atomic_load_n(&ms->max_time, __ATOMIC_RELAXED), histogram);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_StartBootTiming
+**
+** Records the time at which the agent process started, which the startup milestones are measured from
+** This must be called at the start of main()
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_StartBootTiming(void)
+{
+    boot_start_time = tu_uptime_usecs();
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_RecordBootPhase
+**
+** Records the duration of a phase of the startup of the agent, which started at the specified time and ends now
+**
+** \param   phase - phase of the startup being timed
+** \param   start_time - time (in microseconds, from tu_uptime_usecs()) at which the phase started
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_RecordBootPhase(boot_time_t phase, unsigned long long start_time)
+{
+    unsigned long long now;
+
+    USP_ASSERT((phase >= 0) && (phase < kBootTime_FirstMtpConnected));
+    now = tu_uptime_usecs();
+    boot_times[phase] = (now > start_time) ? now - start_time : 0;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_RecordBootMilestone
+**
+** Records the time (since the agent process started) at which a startup milestone was reached
+** Only the first time that the milestone is reached is recorded. This function may be called from any thread
+**
+** \param   milestone - startup milestone which has just been reached
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_RecordBootMilestone(boot_time_t milestone)
+{
+    unsigned long long now;
+    unsigned long long expected = 0;
+
+    USP_ASSERT((milestone >= kBootTime_FirstMtpConnected) && (milestone < kBootTime_Max));
+
+    // Exit if this milestone has already been recorded
+    if (__atomic_load_n(&boot_times[milestone], __ATOMIC_RELAXED) != 0)
+    {
+        return;
+    }
+
+    // NOTE: The time is at least 1, so that it is distinguished from a milestone which has not been reached
+    now = tu_uptime_usecs();
+    now = (now > boot_start_time) ? now - boot_start_time : 1;
+    __atomic_compare_exchange_n(&boot_times[milestone], &expected, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MSG_STATS_DumpBootTiming
+**
+** Logs the times recorded during startup of the agent
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MSG_STATS_DumpBootTiming(void)
+{
+    int i;
+    unsigned long long total = 0;
+
+    USP_DUMP("Startup phases (us):-");
+    for (i=0; i < kBootTime_FirstMtpConnected; i++)
+    {
+        USP_DUMP("   %-20s %10llu", boot_time_names[i], boot_times[i]);
+        total += boot_times[i];
+    }
+    USP_DUMP("   %-20s %10llu", "Total", total);
+
+    USP_DUMP("Startup milestones (us since process start, 0=not reached):-");
+    for (i=kBootTime_FirstMtpConnected; i < kBootTime_Max; i++)
+    {
+        USP_DUMP("   %-20s %10llu", boot_time_names[i], __atomic_load_n(&boot_times[i], __ATOMIC_RELAXED));
+    }
+}
+
+/*********************************************************************//**
+**
+** Get_MsgTypeNumEntries
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgTypeNumberOfEntries
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgTypeNumEntries(dm_req_t *req, char *buf, int len)
+{
+    val_uint = NUM_USP_MSG_TYPES;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MemoryInUse
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MemoryInUse
+** This is the number of bytes currently allocated by USP Agent (using USP_MALLOC etc)
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MemoryInUse(dm_req_t *req, char *buf, int len)
+{
+    val_ulong = USP_MEM_GetInUse();
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MemoryHighWaterMark
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MemoryHighWaterMark
+** This is the maximum number of bytes allocated by USP Agent (using USP_MALLOC etc) at any one time
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MemoryHighWaterMark(dm_req_t *req, char *buf, int len)
+{
+    val_ulong = USP_MEM_GetHighWaterMark();
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_Wakeups
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.Wakeups
+** This is the number of times that USP Agent's threads have woken up from waiting for socket activity or timers
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_Wakeups(dm_req_t *req, char *buf, int len)
+{
+    val_ulong = SOCKET_SET_GetWakeups();
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_WakeupsPerMinute
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.WakeupsPerMinute
+** This is the number of times that USP Agent's threads woke up during the last complete minute. Use this to verify idle power consumption
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_WakeupsPerMinute(dm_req_t *req, char *buf, int len)
+{
+    val_uint = SOCKET_SET_GetWakeupsPerMinute();
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MsgTypeName
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}.Name
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgTypeName(dm_req_t *req, char *buf, int len)
+{
+    USP_STRNCPY(buf, MSG_HANDLER_UspMsgTypeToString(inst1-1), len);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MsgStatCount
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}.{Stage}Count
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgStatCount(dm_req_t *req, char *buf, int len)
+{
+    msg_stat_counters_t *ms;
+
+    ms = CalcMsgStatFromReq(req);
+    val_ulong = __atomic_load_n(&ms->count, __ATOMIC_RELAXED);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MsgStatTotalTime
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}.{Stage}TotalTime
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgStatTotalTime(dm_req_t *req, char *buf, int len)
+{
+    msg_stat_counters_t *ms;
+
+    ms = CalcMsgStatFromReq(req);
+    val_ulong = __atomic_load_n(&ms->total_time, __ATOMIC_RELAXED);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MsgStatMaxTime
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}.{Stage}MaxTime
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgStatMaxTime(dm_req_t *req, char *buf, int len)
+{
+    msg_stat_counters_t *ms;
+
+    ms = CalcMsgStatFromReq(req);
+    val_ulong = __atomic_load_n(&ms->max_time, __ATOMIC_RELAXED);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_MsgStatHistogram
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.MsgType.{i}.{Stage}Histogram
+** This is a comma separated list of the number of USP messages in each bucket of the histogram
+** The upper limit of each bucket is given by Device.LocalAgent.X_VENDOR_Stats.HistogramBucketLimits
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_MsgStatHistogram(dm_req_t *req, char *buf, int len)
+{
+    msg_stat_counters_t *ms;
+
+    ms = CalcMsgStatFromReq(req);
+    FormHistogramString(ms->histogram, buf, len);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_BootTime
+**
+** Gets the value of Device.LocalAgent.X_VENDOR_Stats.Boot{name}Time
+** Phases are returned as a duration, and milestones as the time since the agent process started (0 if not reached yet)
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_BootTime(dm_req_t *req, char *buf, int len)
+{
+    int i;
+    char *name;
+    char expected[MAX_DM_PATH];
+
+    // Determine the startup time from the name of the parameter
+    name = strrchr(req->path, '.');
+    USP_ASSERT(name != NULL);
+    name++;
+    for (i=0; i < kBootTime_Max; i++)
+    {
+        USP_SNPRINTF(expected, sizeof(expected), "Boot%sTime", boot_time_names[i]);
+        if (strcmp(name, expected)==0)
+        {
+            break;
+        }
+    }
+    USP_ASSERT(i < kBootTime_Max);
+
+    val_ulong = __atomic_load_n(&boot_times[i], __ATOMIC_RELAXED);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** CalcMsgStatFromReq
+**
+** Gets a pointer to the statistics for the message type and stage identified by the specified parameter
+** The message type is given by the instance number, and the stage by the start of the parameter name
+**
+** \param   req - pointer to structure identifying the parameter
+**
+** \return  pointer to statistics for the message type and stage
+**
+**************************************************************************/
+msg_stat_counters_t *CalcMsgStatFromReq(dm_req_t *req)
+{
+    int index;
+    int i;
+    char *name;
+
+    index = inst1 - 1;
+    USP_ASSERT(index < NUM_USP_MSG_TYPES);
+    USP_ASSERT(index >= 0);
+
+    // Determine the stage from the name of the parameter
+    name = strrchr(req->path, '.');
+    USP_ASSERT(name != NULL);
+    name++;
+    for (i=0; i < kMsgStat_Max; i++)
+    {
+        if (strncmp(name, msg_stat_names[i], strlen(msg_stat_names[i]))==0)
+        {
+            break;
+        }
+    }
+    USP_ASSERT(i < kMsgStat_Max);
+
+    return &msg_stats[index][i];
+}
+
+/*********************************************************************//**
+**
+** CalcHistogramBucket
+**
+** Determines which histogram bucket the specified duration should be counted in
+**
+** \param   duration - duration (in microseconds)
+**
+** \return  index of the histogram bucket
+**
+**************************************************************************/
+int CalcHistogramBucket(unsigned long long duration)
+{
+    int bucket;
+
+    // Bucket is one more than the number of times the first bucket limit must be doubled for the duration to be less than it.
+    if (duration < MSG_STATS_FIRST_BUCKET_LIMIT)
+    {
+        return 0;
+    }
+
+    bucket = 64 - __builtin_clzll(duration / MSG_STATS_FIRST_BUCKET_LIMIT);
+    if (bucket >= MSG_STATS_NUM_BUCKETS)
+    {
+        bucket = MSG_STATS_NUM_BUCKETS - 1;
+    }
+
+    return bucket;
+}
+
+/*********************************************************************//**
+**
+** FormHistogramString
+**
+** Forms a comma separated list of the counts in each bucket of the specified histogram
+**
+** \param   histogram - array of counts for each bucket of the histogram
+** \param   buf - pointer to buffer in which to return the string
+** \param   len - length of buffer in which to return the string
+**
+** \return  None
+**
+**************************************************************************/
+void FormHistogramString(unsigned long long *histogram, char *buf, int len)
+{
+    int i;
+    int offset = 0;
+
+    buf[0] = '\0';
+    for (i=0; (i < MSG_STATS_NUM_BUCKETS) && (offset < len); i++)
+    {
+        offset += USP_SNPRINTF(&buf[offset], len-offset, "%s%llu", (i==0) ? "" : ",", __atomic_load_n(&histogram[i], __ATOMIC_RELAXED));
+    }
+}
+
@@ -78,6 +78,11 @@ typedef struct
 #ifdef ENABLE_COAP
     coap_config_t  coap;     // Configuration settings for CoAP server
 #endif
+
+#ifdef ENABLE_MQTT
+    int mqtt_client_instance;   // Instance number of the MQTT client which this MTP refers to (ie Device.MQTT.Client.{i})
+    char *mqtt_response_topic;  // name of the topic on the above MQTT client, on which this agent listens
+#endif
 } agent_mtp_t;
 
 // Array of agent MTPs
@@ -92,6 +97,12 @@ const enum_entry_t mtp_protocols[kMtpProtocol_Max] =
 #ifdef ENABLE_COAP
     { kMtpProtocol_CoAP, "CoAP" },
 #endif
+#ifdef ENABLE_WEBSOCKETS
+    { kMtpProtocol_WebSockets, "WebSocket" },
+#endif
+#ifdef ENABLE_MQTT
+    { kMtpProtocol_MQTT, "MQTT" },
+#endif
 };
 
 //------------------------------------------------------------------------------
@@ -134,6 +145,11 @@ int ControlCoapServer(agent_mtp_t *mtp, control_coapserver_t control_coapserver)
 int Get_CoapInterfaces(dm_req_t *req, char *buf, int len);
 #endif
 
+#ifdef ENABLE_MQTT
+int NotifyChange_AgentMtpMqttReference(dm_req_t *req, char *value);
+int NotifyChange_AgentMtpMqttResponseTopic(dm_req_t *req, char *value);
+#endif
+
 /*********************************************************************//**
 **
 ** DEVICE_MTP_Init
@@ -175,6 +191,10 @@ int DEVICE_MTP_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_AGENT_MTP_ROOT ".{i}.CoAP.Path", "", NULL, NotifyChange_AgentMtpCoAPPath, DM_STRING);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_AGENT_MTP_ROOT ".{i}.CoAP.EnableEncryption", "true", NULL, NotifyChange_AgentMtpCoAPEncryption, DM_BOOL);
     err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_AGENT_MTP_ROOT ".{i}.CoAP.Interfaces", Get_CoapInterfaces, DM_STRING);
+#endif
+#ifdef ENABLE_MQTT
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_AGENT_MTP_ROOT ".{i}.MQTT.Reference", "", DEVICE_MTP_ValidateMqttReference, NotifyChange_AgentMtpMqttReference, DM_STRING);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_AGENT_MTP_ROOT ".{i}.MQTT.ResponseTopicConfigured", "", NULL, NotifyChange_AgentMtpMqttResponseTopic, DM_STRING);
 #endif
     err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_AGENT_MTP_ROOT ".{i}.Status", Get_MtpStatus, DM_STRING);
 
@@ -313,6 +333,41 @@ char *DEVICE_MTP_GetAgentStompQueue(int instance)
     return NULL;
 }
 
+#ifdef ENABLE_MQTT
+/******************************************************************//**
+**
+** DEVICE_MTP_GetAgentMqttResponseTopic
+**
+** Gets the name of the MQTT topic to use for this agent on a particular MQTT client
+**
+** \param   mqtt_instance - instance number of the MQTT client in the Device.MQTT.Client.{i} table
+**
+** \return  pointer to topic name, or NULL if no enabled agent MTP configures a topic for the MQTT client
+**          NOTE: If NULL, the topic is taken from the Response Information sent by the broker in the CONNACK
+**
+**************************************************************************/
+char *DEVICE_MTP_GetAgentMqttResponseTopic(int mqtt_instance)
+{
+    int i;
+    agent_mtp_t *mtp;
+
+    // Iterate over all agent MTPs, finding the first one that matches the specified MQTT client
+    for (i=0; i<MAX_AGENT_MTPS; i++)
+    {
+        mtp = &agent_mtps[i];
+        if ((mtp->instance != INVALID) && (mtp->enable == true) &&
+            (mtp->mqtt_client_instance == mqtt_instance) && (mtp->protocol == kMtpProtocol_MQTT) &&
+            (mtp->mqtt_response_topic[0] != '\0'))
+        {
+            return mtp->mqtt_response_topic;
+        }
+    }
+
+    // If the code gets here, then no match has been found
+    return NULL;
+}
+#endif
+
 /******************************************************************//**
 **
 ** DEVICE_MTP_EnumToString
@@ -437,6 +492,114 @@ void DEVICE_MTP_NotifyStompConnDeleted(int stomp_instance)
     }
 }
 
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** DEVICE_MTP_ValidateMqttReference
+**
+** Validates Device.LocalAgent.Controller.{i}.MTP.{i}.MQTT.Reference
+** and       Device.LocalAgent.MTP.{i}.MQTT.Reference
+** by checking that it refers to a valid reference in the Device.MQTT.Client table
+**
+** \param   req - pointer to structure identifying the parameter
+** \param   value - value that the controller would like to set the parameter to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MTP_ValidateMqttReference(dm_req_t *req, char *value)
+{
+    int err;
+    int mqtt_client_instance;
+
+    // Exit if the MQTT Reference refers to nothing. This can occur if an MQTT client being referred to is deleted.
+    if (*value == '\0')
+    {
+        return USP_ERR_OK;
+    }
+
+    err = DM_ACCESS_ValidateReference(value, "Device.MQTT.Client.{i}", &mqtt_client_instance);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MTP_GetMqttReference
+**
+** Gets the instance number in the MQTT client table by dereferencing the specified path
+** NOTE: If the path is invalid, or the instance does not exist, then INVALID is
+**       returned for the instance number, along with an error
+**
+** \param   path - path of parameter which contains the reference
+** \param   mqtt_client_instance - pointer to variable in which to return the instance number in the MQTT client table
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DEVICE_MTP_GetMqttReference(char *path, int *mqtt_client_instance)
+{
+    int err;
+    char value[MAX_DM_PATH];
+
+    // Set default return value
+    *mqtt_client_instance = INVALID;
+
+    // Exit if unable to get the reference to the entry in the MQTT client table
+    // NOTE: This will return the default of an empty string if not present in the DB
+    err = DATA_MODEL_GetParameterValue(path, value, sizeof(value), 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if the reference has not been setup yet
+    if (*value == '\0')
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to determine MQTT client table reference
+    err = DM_ACCESS_ValidateReference(value, "Device.MQTT.Client.{i}", mqtt_client_instance);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_MTP_NotifyMqttClientDeleted
+**
+** Called when an MQTT client is deleted
+** This code unpicks all references to the MQTT client existing in the LocalAgent MTP table
+**
+** \param   mqtt_instance - instance in Device.MQTT.Client which has been deleted
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_MTP_NotifyMqttClientDeleted(int mqtt_instance)
+{
+    int i;
+    agent_mtp_t *mtp;
+    char path[MAX_DM_PATH];
+
+    // Iterate over all agent MTPs, clearing out all references to the deleted MQTT client
+    for (i=0; i<MAX_AGENT_MTPS; i++)
+    {
+        mtp = &agent_mtps[i];
+        if ((mtp->instance != INVALID) && (mtp->mqtt_client_instance == mqtt_instance))
+        {
+            USP_SNPRINTF(path, sizeof(path), "Device.LocalAgent.MTP.%d.MQTT.Reference", mtp->instance);
+            DATA_MODEL_SetParameterValue(path, "", 0);
+        }
+    }
+}
+#endif
+
 /*********************************************************************//**
 **
 ** ValidateAdd_AgentMtp
@@ -527,6 +690,17 @@ int Notify_AgentMtpDeleted(dm_req_t *req)
             ControlCoapServer(mtp, COAP_SERVER_Stop);
             break;
 #endif
+
+#ifdef ENABLE_MQTT
+        case kMtpProtocol_MQTT:
+            // Mark the MTP as disabled, so that the reconnect does not pick up this MTP's response topic
+            mtp->enable = false;
+            if (mtp->mqtt_client_instance != INVALID)
+            {
+                DEVICE_MQTT_ScheduleReconnect(mtp->mqtt_client_instance);
+            }
+            break;
+#endif
         default:
             break;
     }
@@ -562,6 +736,15 @@ int Validate_AgentMtpProtocol(dm_req_t *req, char *value)
         return USP_ERR_INVALID_VALUE;
     }
 
+#ifdef ENABLE_WEBSOCKETS
+    // Exit if the protocol is WebSocket. The agent only connects to controllers as a WebSocket client (see Device.LocalAgent.Controller.{i}.MTP.{i}.WebSocket)
+    if (protocol == kMtpProtocol_WebSockets)
+    {
+        USP_ERR_SetMessage("%s: Agent WebSocket server is not supported", __FUNCTION__);
+        return USP_ERR_INVALID_VALUE;
+    }
+#endif
+
     return USP_ERR_OK;
 }
 
@@ -633,6 +816,26 @@ int NotifyChange_AgentMtpEnable(dm_req_t *req, char *value)
 }
             break;
 #endif
+
+#ifdef ENABLE_WEBSOCKETS
+        case kMtpProtocol_WebSockets:
+            // NOTE: Agent WebSocket servers are not supported (see Validate_AgentMtpProtocol), so there is nothing to start or stop
+            mtp->enable = val_bool;
+            break;
+#endif
+
+#ifdef ENABLE_MQTT
+        case kMtpProtocol_MQTT:
+            // Store the new value
+            mtp->enable = val_bool;
+
+            // Schedule a reconnect for the affected MQTT client, so that it picks up (or drops) this MTP's response topic
+            if (mtp->mqtt_client_instance != INVALID)
+            {
+                DEVICE_MQTT_ScheduleReconnect(mtp->mqtt_client_instance);
+            }
+            break;
+#endif
  
         default:
             TERMINATE_BAD_CASE(mtp->protocol);
@@ -705,6 +908,14 @@ int NotifyChange_AgentMtpProtocol(dm_req_t *req, char *value)
         DEVICE_STOMP_ScheduleReconnect(mtp->stomp_connection_instance);
     }
 
+#ifdef ENABLE_MQTT
+    // Schedule the affected MQTT client to reconnect (because it might have lost or gained a response topic to subscribe to)
+    if ((mtp->enable) && (mtp->mqtt_client_instance != INVALID))
+    {
+        DEVICE_MQTT_ScheduleReconnect(mtp->mqtt_client_instance);
+    }
+#endif
+
 #ifdef ENABLE_COAP
     // If the new protocol is CoAP, start its server
     if (new_protocol == kMtpProtocol_CoAP)
@@ -1116,6 +1327,99 @@ int NotifyChange_AgentMtpStompDestination(dm_req_t *req, char *value)
     return USP_ERR_OK;
 }
 
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** NotifyChange_AgentMtpMqttReference
+**
+** Function called when Device.LocalAgent.MTP.{i}.MQTT.Reference is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_AgentMtpMqttReference(dm_req_t *req, char *value)
+{
+    int err;
+    agent_mtp_t *mtp;
+    char path[MAX_DM_PATH];
+    int last_client_instance;
+    int new_client_instance;
+
+    // Determine MTP to be updated
+    mtp = FindAgentMtpByInstance(inst1);
+    USP_ASSERT(mtp != NULL);
+
+    // Exit if unable to extract the new value
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MQTT.Reference", device_agent_mtp_root, inst1);
+    err = DEVICE_MTP_GetMqttReference(path, &new_client_instance);
+    if (err != USP_ERR_OK)
+    {
+        mtp->mqtt_client_instance = INVALID;
+        return err;
+    }
+
+    // Set the new value. This is done before scheduling a reconnect so that the reconnect uses these parameters
+    last_client_instance = mtp->mqtt_client_instance;
+    mtp->mqtt_client_instance = new_client_instance;
+
+    // Schedule a reconnect after the present response has been sent, if the value has changed
+    if ((mtp->enable == true) && (mtp->protocol == kMtpProtocol_MQTT) &&
+        (last_client_instance != new_client_instance))
+    {
+        if (last_client_instance != INVALID)
+        {
+            DEVICE_MQTT_ScheduleReconnect(last_client_instance);
+        }
+
+        if (new_client_instance != INVALID)
+        {
+            DEVICE_MQTT_ScheduleReconnect(new_client_instance);
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_AgentMtpMqttResponseTopic
+**
+** Function called when Device.LocalAgent.MTP.{i}.MQTT.ResponseTopicConfigured is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_AgentMtpMqttResponseTopic(dm_req_t *req, char *value)
+{
+    agent_mtp_t *mtp;
+    bool is_changed;
+
+    // Determine MTP to be updated
+    mtp = FindAgentMtpByInstance(inst1);
+    USP_ASSERT(mtp != NULL);
+
+    // Set the new value. This is done before scheduling a reconnect so that the reconnect subscribes to the new topic
+    is_changed = (strcmp(mtp->mqtt_response_topic, value) != 0) ? true : false;
+    USP_SAFE_FREE(mtp->mqtt_response_topic);
+    mtp->mqtt_response_topic = USP_STRDUP(value);
+
+    // Schedule a reconnect after the present response has been sent, if the value has changed
+    if ((is_changed) && (mtp->enable == true) && (mtp->protocol == kMtpProtocol_MQTT) &&
+        (mtp->mqtt_client_instance != INVALID))
+    {
+        DEVICE_MQTT_ScheduleReconnect(mtp->mqtt_client_instance);
+    }
+
+    return USP_ERR_OK;
+}
+#endif
+
 /*********************************************************************//**
 **
 ** Get_MtpStatus
@@ -1154,6 +1458,12 @@ int Get_MtpStatus(dm_req_t *req, char *buf, int len)
                 break;
 #endif
 
+#ifdef ENABLE_MQTT
+            case kMtpProtocol_MQTT:
+                status = DEVICE_MQTT_GetMtpStatus(mtp->mqtt_client_instance);
+                break;
+#endif
+
             default:
                 // NOTE: The code should never get here, as we only allow valid MTPs to be set
                 status = kMtpStatus_Error;
@@ -1235,6 +1545,9 @@ int ProcessAgentMtpAdded(int instance)
     mtp->instance = instance;
     mtp->stomp_connection_instance = INVALID;
     mtp->instance = instance;
+#ifdef ENABLE_MQTT
+    mtp->mqtt_client_instance = INVALID;
+#endif
 
     // Exit if unable to determine whether this agent MTP was enabled or not
     USP_SNPRINTF(path, sizeof(path), "%s.%d.Enable", device_agent_mtp_root, instance);
@@ -1308,6 +1621,24 @@ int ProcessAgentMtpAdded(int instance)
     }
 #endif
 
+#ifdef ENABLE_MQTT
+    // Exit if there was an error in the reference to the entry in the MQTT client table
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MQTT.Reference", device_agent_mtp_root, instance);
+    err = DEVICE_MTP_GetMqttReference(path, &mtp->mqtt_client_instance);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the name of the agent's MQTT response topic
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.MQTT.ResponseTopicConfigured", device_agent_mtp_root, instance);
+    err = DM_ACCESS_GetString(path, &mtp->mqtt_response_topic);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+#endif
+
     // If the code gets here, then we successfully retrieved all data about the MTP
     err = USP_ERR_OK;
 
@@ -1323,6 +1654,14 @@ exit:
         DEVICE_STOMP_ScheduleReconnect(mtp->stomp_connection_instance);
     }
 
+#ifdef ENABLE_MQTT
+    // Schedule an MQTT reconnect, if this MTP affects an existing MQTT client
+    if ((mtp->enable) && (mtp->protocol==kMtpProtocol_MQTT) && (mtp->mqtt_client_instance != INVALID))
+    {
+        DEVICE_MQTT_ScheduleReconnect(mtp->mqtt_client_instance);
+    }
+#endif
+
     return err;
 }
 
@@ -1381,7 +1720,11 @@ void DestroyAgentMtp(agent_mtp_t *mtp)
     USP_SAFE_FREE(mtp->coap.resource);
     mtp->coap.port = 0;
 #endif
-    
+
+#ifdef ENABLE_MQTT
+    mtp->mqtt_client_instance = INVALID;
+    USP_SAFE_FREE(mtp->mqtt_response_topic);
+#endif
 }
 
 /*********************************************************************//**
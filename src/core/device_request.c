@@ -50,6 +50,8 @@
 #include "dm_access.h"
 #include "dm_trans.h"
 #include "msg_handler.h"
+#include "database.h"
+#include "int_vector.h"
 
 
 //------------------------------------------------------------------------------
@@ -57,12 +59,19 @@
 #define DEVICE_REQ_ROOT "Device.LocalAgent.Request"
 char *device_req_root = DEVICE_REQ_ROOT;
 
+//------------------------------------------------------------------------------
+// Instance numbers of the requests in the request table which are only held in memory (not persisted in the database)
+// See VOLATILE_NON_RESTARTABLE_REQUESTS
+static int_vector_t volatile_requests;
+
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 bool IsRequestInstanceValid(int instance);
 int RestartAsyncOperation(char *path, int instance);
 int ReadOperationArgs(int instance, kv_vector_t *args, char *prefix);
 int DeleteRequestArgs(dm_req_t *req);
+int WriteRequestInstance(char *path, char *command_key, int *instance);
+bool IsVolatileRequest(int instance);
 
 /*********************************************************************//**
 **
@@ -79,6 +88,7 @@ int DEVICE_REQUEST_Init(void)
 {
     int err = USP_ERR_OK;
 
+    INT_VECTOR_Init(&volatile_requests);
 
     err |= USP_REGISTER_Object(DEVICE_REQ_ROOT ".{i}", 
                               USP_HOOK_DenyAddInstance, NULL, NULL,
@@ -115,12 +125,51 @@ int DEVICE_REQUEST_Init(void)
 **
 ** \param   path - pointer to string representing the command
 ** \param   command_key - pointer to string used by controller to identify the operation in a notification
+** \param   persist - set if the request must be stored in the database (because the operation may be restarted after a reboot)
+**                    If not set, the request is only held in memory (if VOLATILE_NON_RESTARTABLE_REQUESTS is enabled)
 ** \param   instance - pointer to variable in which to return the instance number of the request added to the table
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int DEVICE_REQUEST_Add(char *path, char *command_key, int *instance)
+int DEVICE_REQUEST_Add(char *path, char *command_key, bool persist, int *instance)
+{
+    int err;
+
+    // Exit if the request must be stored in the database
+    if ((persist) || (VOLATILE_NON_RESTARTABLE_REQUESTS == 0))
+    {
+        err = WriteRequestInstance(path, command_key, instance);
+        return err;
+    }
+
+    // Otherwise hold the request only in memory
+    DATABASE_SetVolatileWrites(true);
+    err = WriteRequestInstance(path, command_key, instance);
+    DATABASE_SetVolatileWrites(false);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    INT_VECTOR_Add(&volatile_requests, *instance);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** WriteRequestInstance
+**
+** Adds a new instance to the Request table, and writes its parameters
+**
+** \param   path - pointer to string representing the command
+** \param   command_key - pointer to string used by controller to identify the operation in a notification
+** \param   instance - pointer to variable in which to return the instance number of the request added to the table
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int WriteRequestInstance(char *path, char *command_key, int *instance)
 {
     int err;
     char param[MAX_DM_PATH];
@@ -304,9 +353,11 @@ void DEVICE_REQUEST_UpdateOperationStatus(int instance, char *status)
         return;
     }
 
-    // Set the status of this operation
+    // Set the status of this operation (only in memory, if the request is not persisted in the database)
     USP_SNPRINTF(path, sizeof(path), "%s.%d.Status", device_req_root, instance);
+    DATABASE_SetVolatileWrites(IsVolatileRequest(instance));
     err = DATA_MODEL_SetParameterValue(path, status, 0);
+    DATABASE_SetVolatileWrites(false);
     if (err != USP_ERR_OK)
     {
         return;
@@ -623,8 +674,17 @@ int ReadOperationArgs(int instance, kv_vector_t *args, char *prefix)
 int DeleteRequestArgs(dm_req_t *req)
 {
     int err;
+    int index;
     char path[MAX_DM_PATH];
 
+    // Forget that the request was only held in memory
+    index = INT_VECTOR_Find(&volatile_requests, inst1);
+    if (index != INVALID)
+    {
+        volatile_requests.vector[index] = volatile_requests.vector[volatile_requests.num_entries-1];
+        volatile_requests.num_entries--;
+    }
+
     // Exit if unable to delete the shadow object
     USP_SNPRINTF(path, sizeof(path), "Internal.Request.%d", inst1);
     err = DATA_MODEL_DeleteInstance(path, IGNORE_NO_INSTANCE);
@@ -632,3 +692,18 @@ int DeleteRequestArgs(dm_req_t *req)
     return err;    
 }
 
+/*********************************************************************//**
+**
+** IsVolatileRequest
+**
+** Determines whether the specified request is only held in memory (rather than persisted in the database)
+**
+** \param   instance - instance number of operation in Device.LocalAgent.Request table
+**
+** \return  true if the request is only held in memory
+**
+**************************************************************************/
+bool IsVolatileRequest(int instance)
+{
+    return (INT_VECTOR_Find(&volatile_requests, instance) != INVALID);
+}
@@ -106,12 +106,21 @@ typedef struct
     time_t last_modif;
     char *subject_alt;          // Free with USP_FREE()
     char *signature_algorithm;  // Free with USP_FREE()
-    unsigned hash;          // Hash of the DER (binary) form of the certificate
+    ctrust_role_t role;         // Role associated with the certificate in Device.LocalAgent.ControllerTrust.Credential.{i}
+                                // NOTE: Cached here, so that the role can be determined without a table search on every TLS handshake
 } trust_cert_t;
 
 static trust_cert_t *trust_certs = NULL;
 static int num_trust_certs = 0;
 
+//------------------------------------------------------------------------------
+// X509 store containing all trust certs, shared (by reference count) between the SSL contexts of all MTPs and bulk data collection
+// This avoids each SSL context building its own copy of the trust store's lookup tables
+// NOTE: The shared store is created at startup and is not modified afterwards, so it may safely be used by all threads
+#if OPENSSL_VERSION_NUMBER >= 0x1010000FL // SSL version 1.1.0
+static X509_STORE *shared_trust_store = NULL;
+#endif
+
 //------------------------------------------------------------------------------
 // Array holding trust store certificates, parsed from a file that was specified by the '-t' command line option
 // This overrides any certificates specified by the get_trust_store_cb vendor hook
@@ -133,6 +142,8 @@ int GetTrustCert_SignatureAlgorithm(dm_req_t *req, char *buf, int len);
 trust_cert_t *FindTrustCertByReq(dm_req_t *req);
 int LoadTrustStore(void);
 int LoadTrustCert(const unsigned char *cert_data, int cert_len, ctrust_role_t role);
+int CreateSharedTrustStore(void);
+int AddTrustCertsToStore(X509_STORE *trust_store);
 int LoadClientCert(SSL_CTX *ctx);
 int GetClientCert(X509 **p_cert, EVP_PKEY **p_pkey);
 int GetClientCertFromFile(char *cert_file, X509 **p_cert, EVP_PKEY **p_pkey);
@@ -148,8 +159,7 @@ int ParseCert_NotAfter(X509 *cert, time_t *not_after);
 time_t Asn1Time_To_UnixTime(ASN1_TIME *cert_time);
 int ParseCert_SubjectAlt(X509 *cert, char **p_subject_alt);
 int ParseCert_SignatureAlg(X509 *cert, char **p_sig_alg);
-int CalcCertHash(X509 *cert, unsigned *p_hash);
-int FindMatchingTrustCert(unsigned hash);
+int FindMatchingTrustCert(X509 *cert);
 bool IsSystemTimeReliable(void);
 void LogCertChain(STACK_OF(X509) *cert_chain);
 void LogTrustCerts(void);
@@ -233,6 +243,13 @@ int DEVICE_SECURITY_Start(void)
         goto exit;
     }
 
+    // Exit if unable to create the X509 store shared by all SSL contexts
+    err = CreateSharedTrustStore();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // Exit if unable to create a temporary SSL context.
     // This is necessary because the load_agent_cert vendor hook only loads into an SSL context
     temp_ssl_ctx = SSL_CTX_new(SSLv23_client_method());
@@ -311,6 +328,15 @@ void DEVICE_SECURITY_Stop(void)
     }
     USP_SAFE_FREE(trust_certs);
 
+#if OPENSSL_VERSION_NUMBER >= 0x1010000FL // SSL version 1.1.0
+    // Release our reference to the shared trust store. It is freed once all SSL contexts using it have also been freed
+    if (shared_trust_store != NULL)
+    {
+        X509_STORE_free(shared_trust_store);
+        shared_trust_store = NULL;
+    }
+#endif
+
     // Free the client certificate
     if (agent_cert != NULL)
     {
@@ -360,8 +386,8 @@ int DEVICE_SECURITY_GetControllerTrust(STACK_OF_X509 *cert_chain, ctrust_role_t
     unsigned num_certs;
     X509 *ca_cert;
     X509 *broker_cert;
-    unsigned hash;
     int instance;
+    trust_cert_t *tc;
 
     // The cert at position[0] will be the STOMP broker cert
     // The cert at position[1] will be the CA cert that validates the broker cert
@@ -399,16 +425,9 @@ int DEVICE_SECURITY_GetControllerTrust(STACK_OF_X509 *cert_chain, ctrust_role_t
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Exit if unable to calculate the hash of the trust store cert
-    err = CalcCertHash(ca_cert, &hash);
-    if (err != USP_ERR_OK)
-    {
-        return err;
-    }
-
     // Exit if unable to find the entry in Device.Security.Certificate.{i} that matches the trust store cert in our SSL chain of trust
     // NOTE: This should never occur, as we load the trust certs that Open SSL uses
-    instance = FindMatchingTrustCert(hash);
+    instance = FindMatchingTrustCert(ca_cert);
     if (instance == INVALID)
     {
         USP_LOG_Error("%s: CA cert in chain of trust, not found in Device.Security.Certificate", __FUNCTION__);
@@ -418,7 +437,8 @@ int DEVICE_SECURITY_GetControllerTrust(STACK_OF_X509 *cert_chain, ctrust_role_t
     }
 
     // Exit if unable to get a role associated with the certificate
-    *role = DEVICE_CTRUST_GetCertRole(instance);
+    tc = &trust_certs[instance-1];
+    *role = tc->role;
     if (*role == INVALID_ROLE)
     {
         USP_LOG_Error("%s: CA cert in chain of trust (Instance=%d) did not have an associated role in Device.LocalAgent.ControllerTrust.Credential.{i}", __FUNCTION__, instance);
@@ -492,8 +512,6 @@ int DEVICE_SECURITY_LoadTrustStore(SSL_CTX *ssl_ctx, int verify_mode, ssl_verify
 {
     X509_STORE *trust_store;
     load_agent_cert_cb_t load_agent_cert_cb;
-    trust_cert_t *tc;
-    int i;
     int err;
 
     // Exit if unable to obtain the SSL context's trust store object
@@ -504,15 +522,26 @@ int DEVICE_SECURITY_LoadTrustStore(SSL_CTX *ssl_ctx, int verify_mode, ssl_verify
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Add all certificates in our trust store to the SSL context's trust store
-    for (i=0; i<num_trust_certs; i++)
+#if OPENSSL_VERSION_NUMBER >= 0x1010000FL // SSL version 1.1.0
+    if (shared_trust_store != NULL)
     {
-        tc = &trust_certs[i];
-        err = X509_STORE_add_cert(trust_store, tc->cert);
-        if (err == 0)
+        // Preserve any verification flags that the owner of the SSL context has already set on its trust store (eg curl sets X509_V_FLAG_PARTIAL_CHAIN)
+        // by moving them to the SSL context's verify params, as the shared trust store must not be modified
+        X509_VERIFY_PARAM_set_flags(SSL_CTX_get0_param(ssl_ctx), X509_VERIFY_PARAM_get_flags(X509_STORE_get0_param(trust_store)));
+
+        // Replace the SSL context's trust store with (a reference to) the shared trust store
+        // NOTE: SSL_CTX_set_cert_store() frees the SSL context's previous trust store, and takes ownership of the reference
+        X509_STORE_up_ref(shared_trust_store);
+        SSL_CTX_set_cert_store(ssl_ctx, shared_trust_store);
+    }
+    else
+#endif
+    {
+        // Exit if unable to add all certificates in our trust store to the SSL context's trust store
+        err = AddTrustCertsToStore(trust_store);
+        if (err != USP_ERR_OK)
         {
-            USP_LOG_Error("%s: X509_STORE_add_cert() failed", __FUNCTION__);
-            return USP_ERR_INTERNAL_ERROR;
+            return err;
         }
     }
 
@@ -1410,6 +1439,7 @@ int AddTrustCert(X509 *cert, ctrust_role_t role)
 
     // Add this certificate into the vector
     tc->cert = cert;
+    tc->role = role;
 
     // Extract the details of the specified certificate
     err = USP_ERR_OK;
@@ -1421,7 +1451,6 @@ int AddTrustCert(X509 *cert, ctrust_role_t role)
     err |= ParseCert_NotAfter(cert, &tc->not_after);
     err |= ParseCert_SubjectAlt(cert, &tc->subject_alt);
     err |= ParseCert_SignatureAlg(cert, &tc->signature_algorithm);
-    err |= CalcCertHash(cert, &tc->hash);
 
     // Exit if any error occurred when parsing
     if (err != USP_ERR_OK)
@@ -2029,49 +2058,70 @@ exit:
 
 /*********************************************************************//**
 **
-** CalcCertHash
+** CreateSharedTrustStore
 **
-** Implements a 32 bit hash of the DER (binary) form of the specified certificate
-** Implemented using the FNV1a algorithm
-** NOTE: This function is called from the MTP thread, so it should only log errors (not call USP_ERR_SetMessage)
+** Creates the X509 store containing all trust certs, which is shared by all SSL contexts
+** NOTE: If the version of OpenSSL does not support reference counted X509 stores, then each SSL context has its own copy of the trust certs
 **
-** \param   cert - pointer to the certificate structure to calculate a hash of
-** \param   p_hash - pointer to variable in which to return the hash
+** \param   None
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int CalcCertHash(X509 *cert, unsigned *p_hash)
+int CreateSharedTrustStore(void)
 {
-    #define OFFSET_BASIS (0x811C9DC5)
-    #define FNV_PRIME (0x1000193)
-    int i;
-    unsigned hash = OFFSET_BASIS;
-    int len;
-    unsigned char *buf = NULL;
-    unsigned char *p;
+#if OPENSSL_VERSION_NUMBER >= 0x1010000FL // SSL version 1.1.0
+    int err;
 
-    // Exit if unable to convert the X509 structure to DER form
-    // NOTE: OpenSSL allocates memory for the DER form, and stores the pointer to this memory in 'buf'
-    len = i2d_X509(cert, &buf);
-    if ((len < 0) || (buf == NULL))
+    // Exit if unable to create the shared trust store
+    shared_trust_store = X509_STORE_new();
+    if (shared_trust_store == NULL)
     {
-        USP_LOG_Error("%s: i2d_X509() failed", __FUNCTION__);
+        USP_ERR_SetMessage("%s: X509_STORE_new() failed", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Calculate a hash of the certificate
-    p = buf;
-    for (i=0; i < len; i++)
+    // Exit if unable to add the trust certs to it
+    err = AddTrustCertsToStore(shared_trust_store);
+    if (err != USP_ERR_OK)
     {
-        hash = hash * FNV_PRIME;
-        hash = hash ^ (*p++);
+        X509_STORE_free(shared_trust_store);
+        shared_trust_store = NULL;
+        return err;
     }
+#endif
 
-    // Free the memory allocated by OpenSSL to store the DER form of the cert
-    OPENSSL_free(buf);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** AddTrustCertsToStore
+**
+** Adds all certificates in our trust store to the specified X509 store
+**
+** \param   trust_store - pointer to X509 store to add the trust certs to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int AddTrustCertsToStore(X509_STORE *trust_store)
+{
+    int i;
+    int err;
+    trust_cert_t *tc;
+
+    for (i=0; i<num_trust_certs; i++)
+    {
+        tc = &trust_certs[i];
+        err = X509_STORE_add_cert(trust_store, tc->cert);
+        if (err == 0)
+        {
+            USP_LOG_Error("%s: X509_STORE_add_cert() failed", __FUNCTION__);
+            return USP_ERR_INTERNAL_ERROR;
+        }
+    }
 
-    *p_hash = hash;
     return USP_ERR_OK;
 }
 
@@ -2079,24 +2129,36 @@ int CalcCertHash(X509 *cert, unsigned *p_hash)
 **
 ** FindMatchingTrustCert
 **
-** Finds the certificate in our trust store that matches the given hash
+** Finds the certificate in our trust store that matches the given certificate
+** NOTE: The root cert of a verified chain is normally the same X509 object that we added to the SSL context's X509 store,
+**       so a pointer comparison usually finds it. Otherwise X509_cmp() is used, which compares the digests that OpenSSL
+**       caches in each certificate, avoiding re-encoding the certificate to DER form on every TLS handshake
 **
-** \param   hash - hash of the trusted cert we want to find
+** \param   cert - pointer to the certificate to find in our trust store
 **
-** \return  Instance number of the certificate within Device.Security.Certificate.{i} table, or INVALID if not found
+** \return  instance number of the matching cert in Device.Security.Certificate.{i}, or INVALID if no match was found
 **
 **************************************************************************/
-int FindMatchingTrustCert(unsigned hash)
+int FindMatchingTrustCert(X509 *cert)
 {
     int i;
     trust_cert_t *tc;
 
-    // Iterate over all certificates in our trust store
+    // Exit if the certificate is one of the objects in our trust store
+    for (i=0; i<num_trust_certs; i++)
+    {
+        tc = &trust_certs[i];
+        if (tc->cert == cert)
+        {
+            return i+1;
+        }
+    }
+
+    // Otherwise compare the contents of the certificates
     for (i=0; i<num_trust_certs; i++)
     {
-        // Exit if we've found a matching certificate
         tc = &trust_certs[i];
-        if (tc->hash == hash)
+        if (X509_cmp(tc->cert, cert) == 0)
         {
             return i+1;
         }
@@ -2106,7 +2168,6 @@ int FindMatchingTrustCert(unsigned hash)
     return INVALID;
 }
 
-
 /*********************************************************************//**
 **
 ** Read_TrustStoreFromFile
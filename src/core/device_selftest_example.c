@@ -46,7 +46,6 @@
 #include "common_defs.h"
 #include "usp_api.h"
 #include "dm_access.h"
-#include "os_utils.h"
 
 #ifndef REMOVE_SELF_TEST_DIAG_EXAMPLE
 //------------------------------------------------------------------------------------
@@ -82,7 +81,7 @@ static char *selftest_output_args[] =
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int DEVICE_SELF_TEST_Operate(dm_req_t *req, kv_vector_t *input_args, int instance);
-void *SelfTestDiagThreadMain(void *param);
+void SelfTestDiagTask(void *param);
 int ExecuteSelfTestDiagnostic(selftest_input_cond_t *cond, selftest_output_res_t *res);
 
 /*********************************************************************//**
@@ -121,7 +120,7 @@ int DEVICE_SELF_TEST_Init(void)
 **
 ** Starts the asynchronous SelfTestDiagnostics operation
 ** Checks that all mandatory parameters are present and valid, defaults non-mandatory parameters,
-** then starts a thread to perform the operation
+** then queues a task on the core pool of worker threads to perform the operation
 **
 ** \param   req - pointer to structure identifying the operation in the data model
 ** \param   input_args - vector containing input arguments and their values
@@ -153,9 +152,9 @@ int DEVICE_SELF_TEST_Operate(dm_req_t *req, kv_vector_t *input_args, int instanc
     USP_LOG_Info("=== SelfTestDiagnostics Conditions ===");
     USP_LOG_Info("test_number: %d", cond->test_number);
 
-    // Exit if unable to start a thread to perform this operation
-    // NOTE: ownership of input conditions passes to the thread
-    err = OS_UTILS_CreateThread(SelfTestDiagThreadMain, cond);
+    // Exit if unable to queue a task to perform this operation
+    // NOTE: ownership of input conditions passes to the task
+    err = USP_TASK_Queue(SelfTestDiagTask, cond, kUspTaskPriority_Normal);
     if (err != USP_ERR_OK)
     {
         err = USP_ERR_COMMAND_FAILURE;
@@ -170,22 +169,22 @@ exit:
         return USP_ERR_COMMAND_FAILURE;
     }
 
-    // Ownership of the input conditions has passed to the thread
+    // Ownership of the input conditions has passed to the task
     return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** SelfTestDiagThreadMain
+** SelfTestDiagTask
 **
-** Main function for Self Test Diagnostics operation thread
+** Performs the Self Test Diagnostics operation, on a thread from the core pool of worker threads
 **
 ** \param   param - pointer to input conditions
 **
-** \return  NULL
+** \return  None
 **
 **************************************************************************/
-void *SelfTestDiagThreadMain(void *param)
+void SelfTestDiagTask(void *param)
 {
     selftest_input_cond_t *cond = (selftest_input_cond_t *) param;
     selftest_output_res_t results;
@@ -224,8 +223,6 @@ exit:
 
     // Free the input conditions
     USP_FREE(cond);
-
-    return NULL;
 }
 
 /*********************************************************************//**
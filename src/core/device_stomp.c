@@ -64,6 +64,14 @@ static const char device_stomp_conn_root[] = DEVICE_STOMP_CONN_ROOT;
 // Cache of the parameters in the Device.STOMP.Connection table
 static stomp_conn_params_t stomp_conn_params[MAX_STOMP_CONNECTIONS];
 
+//------------------------------------------------------------------------------
+// Table to convert Device.STOMP.Connection.{i}.X_ARRIS-COM_ServerRetryAlgorithm to and from an enumeration
+const enum_entry_t retry_algorithms[] =
+{
+    { kRetryAlgorithm_Standard,           "Standard" },
+    { kRetryAlgorithm_DecorrelatedJitter, "DecorrelatedJitter" },
+};
+
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int ValidateAdd_StompConn(dm_req_t *req);
@@ -72,10 +80,17 @@ int Notify_StompConnDeleted(dm_req_t *req);
 int Get_StompConnectionStatus(dm_req_t *req, char *buf, int len);
 int Get_StompLastChangeDate(dm_req_t *req, char *buf, int len);
 int Get_StompIsEncrypted(dm_req_t *req, char *buf, int len);
+int Get_StompTlsFullHandshakes(dm_req_t *req, char *buf, int len);
+int Get_StompTlsResumedHandshakes(dm_req_t *req, char *buf, int len);
 int Validate_HeartbeatPeriod(dm_req_t *req, char *value);
 int Validate_RetryInitialInterval(dm_req_t *req, char *value);
 int Validate_RetryIntervalMultiplier(dm_req_t *req, char *value);
 int Validate_RetryMaxInterval(dm_req_t *req, char *value);
+int Validate_RetryAlgorithm(dm_req_t *req, char *value);
+int Validate_TcpUserTimeout(dm_req_t *req, char *value);
+int Validate_TcpKeepAliveTime(dm_req_t *req, char *value);
+int Validate_TcpKeepAliveCount(dm_req_t *req, char *value);
+int Validate_TcpBufferSize(dm_req_t *req, char *value);
 int NotifyChange_StompEnable(dm_req_t *req, char *value);
 int NotifyChange_StompHost(dm_req_t *req, char *value);
 int NotifyChange_StompPort(dm_req_t *req, char *value);
@@ -93,6 +108,15 @@ int NotifyChange_IncomingHeartbeat(dm_req_t *req, char *value);
 int NotifyChange_RetryInitialInterval(dm_req_t *req, char *value);
 int NotifyChange_RetryIntervalMultiplier(dm_req_t *req, char *value);
 int NotifyChange_RetryMaxInterval(dm_req_t *req, char *value);
+int NotifyChange_RetryAlgorithm(dm_req_t *req, char *value);
+int NotifyChange_StompTCPNoDelay(dm_req_t *req, char *value);
+int NotifyChange_StompTCPUserTimeout(dm_req_t *req, char *value);
+int NotifyChange_StompTCPKeepAlive(dm_req_t *req, char *value);
+int NotifyChange_StompTCPKeepAliveIdle(dm_req_t *req, char *value);
+int NotifyChange_StompTCPKeepAliveInterval(dm_req_t *req, char *value);
+int NotifyChange_StompTCPKeepAliveCount(dm_req_t *req, char *value);
+int NotifyChange_StompTCPSendBufferSize(dm_req_t *req, char *value);
+int NotifyChange_StompTCPReceiveBufferSize(dm_req_t *req, char *value);
 int EnableStompConnection(stomp_conn_params_t *sp);
 void ScheduleStompReconnect(stomp_conn_params_t *sp);
 
@@ -142,6 +166,8 @@ int DEVICE_STOMP_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.Username", "", NULL, NotifyChange_StompUsername, DM_STRING);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_EnableEncryption", "true", NULL, NotifyChange_StompEnableEncryption, DM_BOOL);
     err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_STOMP_CONN_ROOT ".{i}.IsEncrypted", Get_StompIsEncrypted, DM_BOOL);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TLSFullHandshakes", Get_StompTlsFullHandshakes, DM_UINT);
+    err |= USP_REGISTER_VendorParam_ReadOnly(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TLSResumedHandshakes", Get_StompTlsResumedHandshakes, DM_UINT);
     err |=    USP_REGISTER_DBParam_Secure(DEVICE_STOMP_CONN_ROOT ".{i}.Password", "", NULL, NotifyChange_StompPassword);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.VirtualHost", "/", NULL, NotifyChange_VirtualHost, DM_STRING); // NOTE: RabbitMQ doesn't allow the virtual host be be an empty string
 
@@ -152,6 +178,16 @@ int DEVICE_STOMP_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.ServerRetryInitialInterval", "60", Validate_RetryInitialInterval, NotifyChange_RetryInitialInterval, DM_UINT);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.ServerRetryIntervalMultiplier", "2000", Validate_RetryIntervalMultiplier, NotifyChange_RetryIntervalMultiplier, DM_UINT);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.ServerRetryMaxInterval", "30720", Validate_RetryMaxInterval, NotifyChange_RetryMaxInterval, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_ServerRetryAlgorithm", "Standard", Validate_RetryAlgorithm, NotifyChange_RetryAlgorithm, DM_STRING);
+
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPNoDelay", "true", NULL, NotifyChange_StompTCPNoDelay, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPUserTimeout", "0", Validate_TcpUserTimeout, NotifyChange_StompTCPUserTimeout, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPKeepAlive", "false", NULL, NotifyChange_StompTCPKeepAlive, DM_BOOL);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPKeepAliveIdle", "60", Validate_TcpKeepAliveTime, NotifyChange_StompTCPKeepAliveIdle, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPKeepAliveInterval", "10", Validate_TcpKeepAliveTime, NotifyChange_StompTCPKeepAliveInterval, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPKeepAliveCount", "5", Validate_TcpKeepAliveCount, NotifyChange_StompTCPKeepAliveCount, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPSendBufferSize", "0", Validate_TcpBufferSize, NotifyChange_StompTCPSendBufferSize, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_STOMP_CONN_ROOT ".{i}.X_ARRIS-COM_TCPReceiveBufferSize", "0", Validate_TcpBufferSize, NotifyChange_StompTCPReceiveBufferSize, DM_UINT);
 
 
     // Register unique keys for tables
@@ -224,7 +260,7 @@ int DEVICE_STOMP_Start(void)
     err = STOMP_Start();
     if (err != USP_ERR_OK)
     {
-        return err;
+        goto exit;
     }
 
     err = USP_ERR_OK;
@@ -311,12 +347,13 @@ int DEVICE_STOMP_StartAllConnections(void)
 ** \param   pbuf - pointer to buffer containing binary protobuf message. Ownership of this buffer passes to this code, if successful
 ** \param   pbuf_len - length of buffer containing protobuf binary message
 ** \param   err_id_header - pointer to string containing the STOMP usp-err-id header
+** \param   priority - send priority of the USP message (selects the queue that the USP message is added to)
 ** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int DEVICE_STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, char *err_id_header, time_t expiry_time)
+int DEVICE_STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, char *err_id_header, mtp_send_priority_t priority, time_t expiry_time)
 {
     stomp_conn_params_t *sp;
 
@@ -328,7 +365,7 @@ int DEVICE_STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int insta
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    STOMP_QueueBinaryMessage(usp_msg_type, instance, controller_queue, agent_queue, pbuf, pbuf_len, kMtpContentType_UspRecord, err_id_header, expiry_time);
+    STOMP_QueueBinaryMessage(usp_msg_type, instance, controller_queue, agent_queue, pbuf, pbuf_len, kMtpContentType_UspRecord, err_id_header, priority, expiry_time);
     
     return USP_ERR_OK;
 }
@@ -635,6 +672,54 @@ int Get_StompIsEncrypted(dm_req_t *req, char *buf, int len)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** Get_StompTlsFullHandshakes
+**
+** Gets the value of Device.STOMP.Connection.{i}.X_ARRIS-COM_TLSFullHandshakes
+**
+** \param   req - pointer to structure identifying the path
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_StompTlsFullHandshakes(dm_req_t *req, char *buf, int len)
+{
+    unsigned full;
+    unsigned resumed;
+
+    STOMP_GetTlsHandshakeStats(inst1, &full, &resumed);
+    val_uint = full;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Get_StompTlsResumedHandshakes
+**
+** Gets the value of Device.STOMP.Connection.{i}.X_ARRIS-COM_TLSResumedHandshakes
+**
+** \param   req - pointer to structure identifying the path
+** \param   buf - pointer to buffer into which to return the value of the parameter (as a textual string)
+** \param   len - length of buffer in which to return the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Get_StompTlsResumedHandshakes(dm_req_t *req, char *buf, int len)
+{
+    unsigned full;
+    unsigned resumed;
+
+    STOMP_GetTlsHandshakeStats(inst1, &full, &resumed);
+    val_uint = resumed;
+
+    return USP_ERR_OK;
+}
+
 
 /*********************************************************************//**
 **
@@ -713,6 +798,101 @@ int Validate_RetryMaxInterval(dm_req_t *req, char *value)
     return DM_ACCESS_ValidateRange_Unsigned(req, 1, UINT_MAX);
 }
 
+/*********************************************************************//**
+**
+** Validate_RetryAlgorithm
+**
+** Function called to validate Device.STOMP.Connection.{i}.X_ARRIS-COM_ServerRetryAlgorithm
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_RetryAlgorithm(dm_req_t *req, char *value)
+{
+    int algorithm;
+
+    // Exit if the retry algorithm was invalid
+    algorithm = TEXT_UTILS_StringToEnum(value, retry_algorithms, NUM_ELEM(retry_algorithms));
+    if (algorithm == INVALID)
+    {
+        USP_ERR_SetMessage("%s: Invalid retry algorithm %s", __FUNCTION__, value);
+        return USP_ERR_INVALID_VALUE;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** Validate_TcpUserTimeout
+**
+** Function called to validate Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPUserTimeout
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_TcpUserTimeout(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 0, INT_MAX);
+}
+
+/*********************************************************************//**
+**
+** Validate_TcpKeepAliveTime
+**
+** Function called to validate Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveIdle and Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveInterval
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_TcpKeepAliveTime(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 1, 32767);
+}
+
+/*********************************************************************//**
+**
+** Validate_TcpKeepAliveCount
+**
+** Function called to validate Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveCount
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_TcpKeepAliveCount(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 1, 127);
+}
+
+/*********************************************************************//**
+**
+** Validate_TcpBufferSize
+**
+** Function called to validate Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPSendBufferSize and Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPReceiveBufferSize
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_TcpBufferSize(dm_req_t *req, char *value)
+{
+    return DM_ACCESS_ValidateRange_Unsigned(req, 0, INT_MAX);
+}
+
 /*********************************************************************//**
 **
 ** NotifyChange_StompEnable
@@ -1179,6 +1359,242 @@ int NotifyChange_RetryMaxInterval(dm_req_t *req, char *value)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** NotifyChange_RetryAlgorithm
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_ServerRetryAlgorithm
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_RetryAlgorithm(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value and notify it to the MTP
+    // NOTE: The value has already been validated, so is guaranteed to convert to an enum
+    sp->retry.algorithm = TEXT_UTILS_StringToEnum(value, retry_algorithms, NUM_ELEM(retry_algorithms));
+    STOMP_UpdateRetryParams(inst1, &sp->retry);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPNoDelay
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPNoDelay is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPNoDelay(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.no_delay = val_bool;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPUserTimeout
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPUserTimeout is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPUserTimeout(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.user_timeout = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPKeepAlive
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAlive is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPKeepAlive(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.enable_keepalive = val_bool;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPKeepAliveIdle
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveIdle is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPKeepAliveIdle(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.keepalive_idle = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPKeepAliveInterval
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveInterval is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPKeepAliveInterval(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.keepalive_interval = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPKeepAliveCount
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPKeepAliveCount is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPKeepAliveCount(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.keepalive_count = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPSendBufferSize
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPSendBufferSize is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPSendBufferSize(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.send_buffer_size = val_uint;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_StompTCPReceiveBufferSize
+**
+** Function called when Device.STOMP.Connection.{i}.X_ARRIS-COM_TCPReceiveBufferSize is modified
+**
+** \param   req - pointer to structure identifying the path
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_StompTCPReceiveBufferSize(dm_req_t *req, char *value)
+{
+    stomp_conn_params_t *sp;
+
+    // Determine stomp connection to be updated
+    sp = FindStompParamsByInstance(inst1);
+    USP_ASSERT(sp != NULL);
+
+    // Set the new value
+    // NOTE: We purposefully do not schedule a reconnect. This change takes effect, the next time USP Agent connects to the STOMP server
+    sp->tcp.receive_buffer_size = val_uint;
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** ProcessStompConnAdded
@@ -1333,6 +1749,78 @@ int ProcessStompConnAdded(int instance)
         goto exit;
     }
 
+    // Exit if unable to get the server retry algorithm for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_ServerRetryAlgorithm", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetEnum(path, &sp->retry.algorithm, retry_algorithms, NUM_ELEM(retry_algorithms));
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP no delay for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPNoDelay", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetBool(path, &sp->tcp.no_delay);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP user timeout for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPUserTimeout", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.user_timeout);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP keepalive enable for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPKeepAlive", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetBool(path, &sp->tcp.enable_keepalive);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP keepalive idle time for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPKeepAliveIdle", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.keepalive_idle);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP keepalive interval for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPKeepAliveInterval", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.keepalive_interval);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP keepalive probe count for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPKeepAliveCount", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.keepalive_count);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP send buffer size for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPSendBufferSize", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.send_buffer_size);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if unable to get the TCP receive buffer size for this STOMP connection
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.X_ARRIS-COM_TCPReceiveBufferSize", device_stomp_conn_root, instance);
+    err = DM_ACCESS_GetUnsigned(path, &sp->tcp.receive_buffer_size);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // If the code gets here, then we successfully retrieved all data about the STOMP connection
     err = USP_ERR_OK;
 
@@ -43,6 +43,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "common_defs.h"
 #include "dm_trans.h"
@@ -56,9 +57,14 @@
 #include "database.h"
 #include "sync_timer.h"
 #include "subs_retry.h"
+#include "notify_spool.h"
 #include "text_utils.h"
+#include "usp_probe.h"
 #include "expr_vector.h"
 #include "json.h"
+#include "int_vector.h"
+#include "dm_inst_vector.h"
+#include "proto_codec.h"
 
 //------------------------------------------------------------------------------
 // List of notification types that USP Agent currently supports
@@ -97,11 +103,108 @@ typedef struct
 
 obj_life_event_vector_t object_life_events;
 
+//------------------------------------------------------------------------------
+// Structure passed to the path resolver callback, when determining whether a subscription matches an operation/event
+typedef struct
+{
+    char *event_name;   // Path of the operation/event in the data model that has occurred
+    bool is_match;      // Set if the operation/event was resolved from the subscription's ReferenceList
+} event_match_t;
+
+//------------------------------------------------------------------------------
+// Vector of database parameters which have been written to since the last time DEVICE_SUBSCRIPTION_ProcessDbValueChanges() was called
+// Value change subscriptions are driven by this vector for database parameters, rather than by polling
+// NOTE: Only the paths are stored. The current value is read back from the database when processing the vector,
+//       so that writes which were subsequently aborted (or which did not actually change the value) do not generate notifications
+//       Each path is only stored once (using the hash index db_value_changes_set), however many times it is written to
+static str_vector_t db_value_changes;
+static str_set_t db_value_changes_set;
+
+// Boolean that is set once value change notifications have been started (see DEVICE_SUBSCRIPTION_Update)
+// Until then, database value changes are queued, but not processed
+static bool is_value_change_started = false;
+
+//------------------------------------------------------------------------------
+// Reverse index from parameter path to the enabled value change subscriptions which hold a last value for that parameter
+// This allows a change to a database parameter to be dispatched only to the subscriptions which reference it
+// The index is an open addressing hash table (keyed by hash of the parameter path) which may contain multiple entries
+// for the same parameter (one for each subscription referencing it)
+// NOTE: The index is rebuilt lazily (the next time that it is needed) after it has been marked as stale
+typedef struct
+{
+    char *path;         // Path of the parameter. NOTE: This points to the path in the subscription's last_values vector (it is not owned by the index)
+                        // A NULL path denotes an unused slot in the table
+    int path_hash;      // Hash of the path
+    int sub_index;      // Index of the subscription in the subscriptions vector
+    int param_index;    // Index of the parameter in the subscription's last_values vector
+} vc_index_entry_t;
+
+static vc_index_entry_t *vc_index = NULL;
+static int vc_index_size = 0;           // Number of slots in the table (always a power of 2, or 0 if the table has not been allocated)
+static bool is_vc_index_stale = true;   // Set if the subscriptions have changed since the index was last built
+
+// Minimum number of slots allocated in the index. The table is sized to keep it at most half full.
+#define VC_INDEX_MIN_SIZE 64
+
+//------------------------------------------------------------------------------
+// Indexes from schema node to the path expressions (in the ReferenceList of enabled subscriptions) which reference that node
+// These allow an object life event or an operation/event to be matched against only the path expressions which could match it,
+// rather than resolving the ReferenceList of every subscription of that type each time
+// Only path expressions containing just instance numbers and wildcards are indexed. Path expressions containing
+// search expressions or reference following are still resolved, as the paths that they match depend on parameter values
+// Each index is an open addressing hash table (keyed by the schema node) which may contain multiple entries
+// for the same node (one for each path expression referencing it)
+// NOTE: The indexes are rebuilt lazily (the next time that they are needed) after they have been marked as stale
+typedef struct
+{
+    dm_node_t *node;    // Node referenced by the path expression. A NULL node denotes an unused slot in the table
+    int sub_index;      // Index of the subscription in the subscriptions vector
+    int order;          // Number of instance numbers in the path expression. This is one less than the node's order if the path expression references a multi-instance object unqualified
+    int instances[MAX_DM_INSTANCE_ORDER];   // Instance numbers in the path expression, or SUBS_INDEX_ANY_INSTANCE for wildcards
+} subs_index_entry_t;
+
+typedef struct
+{
+    subs_notify_t notify_types[2];  // Types of the subscriptions contained in this index
+    subs_index_entry_t *table;
+    int size;                       // Number of slots in the table (always a power of 2, or 0 if the table has not been allocated)
+    bool is_stale;                  // Set if the subscriptions have changed since the index was last built
+    int_vector_t unindexed_subs;    // Indexes (in the subscriptions vector) of the subscriptions containing path expressions which are not in the index
+    int_vector_t device_subs;       // Indexes (in the subscriptions vector) of the Event/OperationComplete subscriptions which reference 'Device.'
+                                    // These match all operations/events that the controller has permission for
+} subs_index_t;
+
+// Index of ObjectCreation and ObjectDeletion subscriptions
+static subs_index_t ole_index = { { kSubNotifyType_ObjectCreation, kSubNotifyType_ObjectDeletion }, NULL, 0, true };
+
+// Index of Event and OperationComplete subscriptions
+static subs_index_t event_index = { { kSubNotifyType_Event, kSubNotifyType_OperationComplete }, NULL, 0, true };
+
+// Value stored in subs_index_entry_t.instances[] for a wildcard
+#define SUBS_INDEX_ANY_INSTANCE (-1)
+
+// Minimum number of slots allocated in an index. The table is sized to keep it at most half full.
+#define SUBS_INDEX_MIN_SIZE 16
+
+//------------------------------------------------------------------------------
+// Value change poll scheduler
+// Each subscription is polled once every poll period, in a bucket (one second tick) determined by its instance number
+// This spreads the polling of subscriptions evenly across the poll period, rather than polling all subscriptions at once
+#define VALUE_CHANGE_POLL_TICK 1        // Period (in seconds) between ticks of the scheduler
+
+// Index of the subscription (in the subscriptions vector) at which to start the next tick
+// This ensures that subscriptions deferred (because the budget ran out) are polled first in the next tick
+static int poll_cursor = 0;
+
 //------------------------------------------------------------------------------
 // Boolean which is used by an assert to check that we always call DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths()
 // before deleting an object from the data model. This is needed so that ObjectDeletion subscriptions work correctly
 static bool object_deletion_paths_resolved = false;
 
+// Set if the paths of all ObjectDeletion subscriptions which are not in the object life event index have been resolved
+// for the current USP message. Until then, each object deletion only resolves the paths of the subscriptions which it could match
+static bool all_deletion_paths_resolved = false;
+
 //------------------------------------------------------------------------------
 // Location of the subscriptions object within the data model
 #define DEVICE_SUBS_ROOT "Device.LocalAgent.Subscription"
@@ -134,6 +237,8 @@ int NotifyChange_SubsRefList(dm_req_t *req, char *value);
 int NotifyChange_SubsTimeToLive(dm_req_t *req, char *value);
 int NotifyChange_NotifRetry(dm_req_t *req, char *value);
 int NotifyChange_NotifExpiration(dm_req_t *req, char *value);
+int NotifyChange_PollPeriod(dm_req_t *req, char *value);
+int NotifyChange_CoalesceWindow(dm_req_t *req, char *value);
 int Validate_SubsID(dm_req_t *req, char *value);
 int Validate_SubsNotifType(dm_req_t *req, char *value);
 int Validate_SubsRefList_Inner(subs_notify_t notify_type, char *ref_list);
@@ -146,19 +251,47 @@ void DeleteExpiredSubscriptions(void);
 int DeleteNonPersistentSubscriptions(void);
 void ProcessAllBootSubscriptions(void);
 void SendBootNotify(subs_t *sub);
-void ProcessObjectLifeEventSubscription(subs_t *sub);
-void ProcessAllValueChangeSubscriptions(void);
+void ProcessAllValueChangeSubscriptions(time_t cur_time);
+time_t CalcNextPollTime(subs_t *sub, time_t cur_time);
 void ProcessValueChangeSubscription(subs_t *sub);
 void SendValueChangeNotify(subs_t *sub, char *path, char *value);
+void CoalesceValueChange(subs_t *sub, char *path, char *value);
+void SendAllCoalescedValueChanges(time_t cur_time);
+void SendCoalescedValueChanges(subs_t *sub);
 void ResolveAllPathExpressions(char *source_path, str_vector_t *path_expressions, str_vector_t *resolved_paths, resolve_op_t op, int cont_instance);
+void ResolveAllPathExpressionsToNodes(char *source_path, str_vector_t *path_expressions, dm_resolved_path_vector_t *rpv, resolve_op_t op, int cont_instance);
 void GetAllPathExpressionParameterValues(subs_t *sub, str_vector_t *path_expressions, kv_vector_t *param_values, char *source_path);
+dm_resolved_path_vector_t *GetValueChangeParams(subs_t *sub, char *source_path);
+void InitValueChangeDigests(subs_t *sub, char *source_path);
+void CalcValueDigest(char *value, value_digest_t *digest);
+bool IsValueDigestMatch(value_digest_t *digest, char *value);
+int FindValueDigest(value_digest_vector_t *vdv, char *path, int hint_index);
+bool IsAnyValueChangeSubscriptionEnabled(void);
+void InvalidateValueChangeIndex(void);
+void RebuildValueChangeIndex(void);
+bool IsParamInValueChangeIndex(char *path, int path_hash);
+void ProcessIndexedValueChange(char *path, int path_hash, char *value);
+bool IsValueChangePushed(dm_node_t *node);
+void ProcessObjectLifeEvent(obj_life_event_t *ole);
+void ResolveUnindexedPathExpressions(subs_t *sub, resolve_op_t op);
+void MatchEventSubscriptions(char *event_name, subs_notify_t notify_type, int_vector_t *matches);
+void InvalidateSubscriptionIndexes(void);
+void RebuildSubscriptionIndex(subs_index_t *index);
+void DestroySubscriptionIndex(subs_index_t *index);
+void MatchSubscriptionIndex(subs_index_t *index, char *path, subs_notify_t notify_type, int_vector_t *matches);
+bool IsSubscriptionPermitted(subs_t *sub, dm_node_t *node, unsigned short required_permission);
+bool IsPathExpressionIndexable(char *expr);
+bool CouldObjectDeletionMatch(subs_t *sub, char *obj_path);
+bool CompileSubscriptionPath(char *expr, subs_notify_t notify_type, subs_index_entry_t *entry);
+unsigned CalcSubscriptionIndexSlot(dm_node_t *node, unsigned mask);
+int CompareSubsIndex(const void *p1, const void *p2);
 char *SerializeToJSONObject(kv_vector_t *param_values);
-void SendOperationCompleteNotify(subs_t *sub, char *command, char *command_key, int err_code, char *err_msg, kv_vector_t *output_args);
+Usp__Msg *CreateOperationCompleteNotify(subs_t *sub, char *command, char *command_key, int err_code, char *err_msg, kv_vector_t *output_args);
 void SendNotify(Usp__Msg *req, subs_t *sub, char *path);
+mtp_send_priority_t CalcNotifySendPriority(subs_t *sub, char *path);
 void SeedLastValueChangeValues(void);
-bool DoesSubscriptionSendNotification(subs_t *sub, char *event_name);
 bool DoesSubscriptionMatchEvent(subs_t *subs, char *event_name);
-bool HasControllerGotEventPermission(int cont_instance, char *event_name);
+int MatchResolvedEvent(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg);
 
 
 /*********************************************************************//**
@@ -193,6 +326,8 @@ int DEVICE_SUBSCRIPTION_Init(void)
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_SUBS_ROOT ".{i}.TimeToLive", "0", NULL, NotifyChange_SubsTimeToLive, DM_UINT);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_SUBS_ROOT ".{i}.NotifRetry", "false", NULL, NotifyChange_NotifRetry, DM_BOOL);
     err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_SUBS_ROOT ".{i}.NotifExpiration", "0", NULL, NotifyChange_NotifExpiration, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_SUBS_ROOT ".{i}." VALUE_CHANGE_POLL_PERIOD_PARAM, "0", NULL, NotifyChange_PollPeriod, DM_UINT);
+    err |= USP_REGISTER_DBParam_ReadWrite(DEVICE_SUBS_ROOT ".{i}." VALUE_CHANGE_COALESCE_WINDOW_PARAM, "0", NULL, NotifyChange_CoalesceWindow, DM_UINT);
 
     // Register unique keys for Subscription table
     char *unique_keys[] = { "ID", "Recipient" };
@@ -222,6 +357,8 @@ int DEVICE_SUBSCRIPTION_Init(void)
     
     SUBS_VECTOR_Init(&subscriptions);
     SUBS_RETRY_Init();
+    STR_VECTOR_Init(&db_value_changes);
+    STR_SET_Init(&db_value_changes_set);
 
     // Initialise ordered vector of object additions/deletions which need to be processed against the subscriptions
     object_life_events.vector = NULL;
@@ -230,6 +367,7 @@ int DEVICE_SUBSCRIPTION_Init(void)
     // Create a timer which will be used to periodically poll for value change
     // NOTE: We create it here so that it is included in the base memory (before USP_MEM_StartCollection is called)
     SYNC_TIMER_Add(DEVICE_SUBSCRIPTION_Update, 0, END_OF_TIME);
+    SYNC_TIMER_SetSlack(DEVICE_SUBSCRIPTION_Update, 0, VALUE_CHANGE_POLL_SLACK);
 
     // If the code gets here, then registration was successful
     return USP_ERR_OK;
@@ -304,6 +442,13 @@ void DEVICE_SUBSCRIPTION_Stop(void)
 {
     SUBS_RETRY_Stop();
     SUBS_VECTOR_Destroy(&subscriptions);
+    STR_VECTOR_Destroy(&db_value_changes);
+    STR_SET_Destroy(&db_value_changes_set);
+    USP_SAFE_FREE(vc_index);
+    vc_index_size = 0;
+    is_vc_index_stale = true;
+    DestroySubscriptionIndex(&ole_index);
+    DestroySubscriptionIndex(&event_index);
 }
 
 /*********************************************************************//**
@@ -322,7 +467,6 @@ void DEVICE_SUBSCRIPTION_Update(int id)
 {
     static bool boot_subs_processed = false;
     time_t cur_time;
-    int poll_period;
 
     // Delete all subscriptions which have expired
     DeleteExpiredSubscriptions();
@@ -338,15 +482,20 @@ void DEVICE_SUBSCRIPTION_Update(int id)
         DeleteNonPersistentSubscriptions();
     }
 
-    // Poll all value change subscriptions for change
-    ProcessAllValueChangeSubscriptions();
+    // Process all database parameters which have changed since value change notifications were last processed
+    // NOTE: The first time this function is called, this processes all changes that occurred since the subscriptions were seeded
+    is_value_change_started = true;
+    DEVICE_SUBSCRIPTION_ProcessDbValueChanges();
 
-    // Determine the period for value change polling
-    poll_period = VALUE_CHANGE_POLL_PERIOD;
+    // Poll all value change subscriptions which are due in this tick for change
+    // NOTE: This only needs to get the values of non-database parameters, as changes to database parameters are processed as they occur
+    ProcessAllValueChangeSubscriptions(cur_time);
 
-    
-    // Restart the timer to cause this function to be called periodically
-    SYNC_TIMER_Reload(DEVICE_SUBSCRIPTION_Update, 0, cur_time + poll_period);
+    // Send all coalesced value changes whose coalescing window has expired
+    SendAllCoalescedValueChanges(cur_time);
+
+    // Restart the timer to cause this function to be called on the next tick of the poll scheduler
+    SYNC_TIMER_Reload(DEVICE_SUBSCRIPTION_Update, 0, cur_time + VALUE_CHANGE_POLL_TICK);
 }
 
 /*********************************************************************//**
@@ -368,21 +517,35 @@ void DEVICE_SUBSCRIPTION_ProcessAllOperationCompleteSubscriptions(char *command,
 {
     int i;
     subs_t *sub;
+    Usp__Msg *req;
+    int_vector_t matches;
 
-    // Iterate over all enabled subscriptions, processing each operation complete subscription that matches
+    // Send the operation complete to all subscriptions that match it
     // (there may be more than one subscriber)
-    for (i=0; i < subscriptions.num_entries; i++)
+    MatchEventSubscriptions(command, kSubNotifyType_OperationComplete, &matches);
+    req = NULL;
+    for (i=0; i < matches.num_entries; i++)
     {
-        sub = &subscriptions.vector[i];
-        if ((sub->enable) && (sub->notify_type == kSubNotifyType_OperationComplete))
+        // Create the notify message for the first subscription, then readdress it for each subsequent subscription
+        sub = &subscriptions.vector[ matches.vector[i] ];
+        if (req == NULL)
         {
-            // Send the event, if it matches this subscription
-            if (DoesSubscriptionSendNotification(sub, command))
-            {
-                SendOperationCompleteNotify(sub, command, command_key, err_code, err_msg, output_args);
-            }
+            req = CreateOperationCompleteNotify(sub, command, command_key, err_code, err_msg, output_args);
+        }
+        else
+        {
+            MSG_HANDLER_ReaddressNotifyReq(req, sub->subscription_id, sub->notification_retry);
         }
+
+        // Send the Notify Request
+        SendNotify(req, sub, command);
+    }
+
+    if (req != NULL)
+    {
+        usp__msg__free_unpacked(req, pbuf_allocator);
     }
+    INT_VECTOR_Destroy(&matches);
 }
 
 /*********************************************************************//**
@@ -402,6 +565,7 @@ void DEVICE_SUBSCRIPTION_ProcessAllEventCompleteSubscriptions(char *event_name,
     int i;
     subs_t *sub;
     Usp__Msg *req;
+    int_vector_t matches;
 
 #ifdef VALIDATE_OUTPUT_ARG_NAMES
     if (output_args != NULL)
@@ -425,69 +589,93 @@ void DEVICE_SUBSCRIPTION_ProcessAllEventCompleteSubscriptions(char *event_name,
     }
 #endif
 
-    // Iterate over all enabled subscriptions, processing each event complete subscription that matches
+    // Send the event to all subscriptions that match it
     // (there may be more than one subscriber)
-    for (i=0; i < subscriptions.num_entries; i++)
+    MatchEventSubscriptions(event_name, kSubNotifyType_Event, &matches);
+    req = NULL;
+    for (i=0; i < matches.num_entries; i++)
     {
-        sub = &subscriptions.vector[i];
-        if ((sub->enable) && (sub->notify_type == kSubNotifyType_Event))
+        // Create the notify message for the first subscription, then readdress it for each subsequent subscription
+        sub = &subscriptions.vector[ matches.vector[i] ];
+        if (req == NULL)
         {
-            // Send the event, if it matches this subscription
-            if (DoesSubscriptionSendNotification(sub, event_name))
-            {
-                // Create the notify message
-                req = MSG_HANDLER_CreateNotifyReq_Event(event_name, output_args, sub->subscription_id, sub->notification_retry);
-
-                // Send the Notify Request
-                SendNotify(req, sub, event_name);
-                usp__msg__free_unpacked(req, pbuf_allocator);
-            }
+            req = MSG_HANDLER_CreateNotifyReq_Event(event_name, output_args, sub->subscription_id, sub->notification_retry);
+        }
+        else
+        {
+            MSG_HANDLER_ReaddressNotifyReq(req, sub->subscription_id, sub->notification_retry);
         }
+
+        // Send the Notify Request
+        SendNotify(req, sub, event_name);
+    }
+
+    if (req != NULL)
+    {
+        usp__msg__free_unpacked(req, pbuf_allocator);
     }
+    INT_VECTOR_Destroy(&matches);
 }
 
 /*********************************************************************//**
 **
 ** DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths
 **
-** Resolves (and caches) the paths of all subscriptions for ObjectDeletion
+** Resolves (and caches) the paths of the subscriptions for ObjectDeletion which are not in the object life event index
+** and which could match the specified object (or its children)
 ** This needs to be done BEFORE the objects are deleted from the data model.
 ** If it was done after the object had been deleted, then the object would not exist
 ** in the resolved path, and hence would not match any of the resolved paths,
 ** and so the notify would not be sent
+** NOTE: Each subscription's paths are resolved at most once per USP message, so a USP message deleting many objects
+**       does not re-resolve them for every object deleted
 **
-** \param   None
+** \param   obj_path - path of the object instance about to be deleted, or NULL to resolve the paths of all ObjectDeletion subscriptions
 **
 ** \return  None
 **
 **************************************************************************/
-void DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(void)
+void DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(char *obj_path)
 {
     int i;
     subs_t *sub;
+    bool is_all_resolved = true;
 
-    // Exit if the object deletion paths have already been resolved for the current USP message
-    if (object_deletion_paths_resolved == true)
+    // Exit if the object deletion paths of all subscriptions have already been resolved for the current USP message
+    if (all_deletion_paths_resolved == true)
     {
         return;
     }
 
-    // Iterate over all enabled subscriptions
-    for (i=0; i < subscriptions.num_entries; i++)
+    // Ensure that the index of path expressions referenced by life event subscriptions is up to date
+    // NOTE: Indexed path expressions do not need resolving, as they are matched against the path of the deleted object directly
+    if (ole_index.is_stale)
     {
-        // See if this subscription is active, and is an object deletion notification
-        sub = &subscriptions.vector[i];
-        if ((sub->enable) && (sub->notify_type == kSubNotifyType_ObjectDeletion))
+        RebuildSubscriptionIndex(&ole_index);
+    }
+
+    // Iterate over all enabled object deletion subscriptions containing path expressions which are not indexed
+    for (i=0; i < ole_index.unindexed_subs.num_entries; i++)
+    {
+        sub = &subscriptions.vector[ ole_index.unindexed_subs.vector[i] ];
+        if ((sub->notify_type == kSubNotifyType_ObjectDeletion) && (sub->is_deletion_resolved == false))
         {
-            // Create a list of all objects which are referenced by this subscription
-            // NOTE: We use kResolveOp_SubsDel because we want to determine all current instances of objects with the path expression
-            if (sub->notify_type == kSubNotifyType_ObjectDeletion)
+            // Skip subscriptions which could not match the object being deleted. These are resolved later, if a subsequent deletion could match them
+            // NOTE: Objects which have already been deleted in this USP message could not match them either, so do not need to be in their resolved paths
+            if ((obj_path != NULL) && (CouldObjectDeletionMatch(sub, obj_path) == false))
             {
-                ResolveAllPathExpressions(DEVICE_SUBS_ROOT, &sub->path_expressions, &sub->resolved_paths, kResolveOp_SubsDel, sub->cont_instance);
+                is_all_resolved = false;
+                continue;
             }
+
+            // Create a list of all objects which are referenced by this subscription
+            // NOTE: We use kResolveOp_SubsDel because we want to determine all current instances of objects with the path expression
+            ResolveUnindexedPathExpressions(sub, kResolveOp_SubsDel);
+            sub->is_deletion_resolved = true;
         }
     }
 
+    all_deletion_paths_resolved = is_all_resolved;
     object_deletion_paths_resolved = true;
 }
 
@@ -529,6 +717,49 @@ void DEVICE_SUBSCRIPTION_NotifyObjectLifeEvent(char *obj_path, subs_notify_t not
     object_life_events.num_entries = new_num_entries;
 }
 
+/*********************************************************************//**
+**
+** DEVICE_SUBSCRIPTION_NotifyObjectLifeEvents
+**
+** Called to notify this module that a batch of object instances have been added or deleted from the data model
+** This is equivalent to calling DEVICE_SUBSCRIPTION_NotifyObjectLifeEvent() for each object, but only
+** resizes the queue of object life events once
+**
+** \param   obj_paths - pointer to vector of paths to objects successfully added/deleted in the data model
+** \param   notify_type - type of object life event (creation/deletion) that occurred for these objects
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_SUBSCRIPTION_NotifyObjectLifeEvents(str_vector_t *obj_paths, subs_notify_t notify_type)
+{
+    int i;
+    int new_num_entries;
+    obj_life_event_t *ole;
+
+    // Exit if there are no object life events to queue
+    if (obj_paths->num_entries == 0)
+    {
+        return;
+    }
+
+    // See DEVICE_SUBSCRIPTION_NotifyObjectLifeEvent()
+    USP_ASSERT((notify_type != kSubNotifyType_ObjectDeletion) || (object_deletion_paths_resolved == true));
+
+    // Queue the object life events for later processing (by ProcessAllLifeEventSubscriptions)
+    new_num_entries = object_life_events.num_entries + obj_paths->num_entries;
+    object_life_events.vector = USP_REALLOC(object_life_events.vector, new_num_entries*sizeof(obj_life_event_t));
+
+    for (i=0; i < obj_paths->num_entries; i++)
+    {
+        ole = &object_life_events.vector[ object_life_events.num_entries + i ];
+        ole->obj_path = USP_STRDUP(obj_paths->vector[i]);
+        ole->notify_type = notify_type;
+    }
+
+    object_life_events.num_entries = new_num_entries;
+}
+
 /*********************************************************************//**
 **
 ** DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions
@@ -548,18 +779,43 @@ void DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions(void)
     subs_t *sub;
     obj_life_event_t *ole;
 
-    // Iterate over all enabled subscriptions
-    for (i=0; i < subscriptions.num_entries; i++)
+    if (object_life_events.num_entries > 0)
     {
-        // See if this subscription is active, and is an object life event notification
-        sub = &subscriptions.vector[i];
-        if ( (sub->enable) &&
-             ((sub->notify_type == kSubNotifyType_ObjectCreation) || (sub->notify_type == kSubNotifyType_ObjectDeletion)) )
+        // Ensure that the index of path expressions referenced by life event subscriptions is up to date
+        if (ole_index.is_stale)
+        {
+            RebuildSubscriptionIndex(&ole_index);
+        }
+
+        // Resolve the path expressions of all object creation subscriptions which are not indexed
+        // This must be done after the object has been added to the data model for the object to appear in the resolved paths list
+        // NOTE: We use kResolveOp_SubsAdd because this is the op that is used when validating the ReferenceList parameter of the Subscription table
+        for (i=0; i < ole_index.unindexed_subs.num_entries; i++)
         {
-            ProcessObjectLifeEventSubscription(sub);
+            sub = &subscriptions.vector[ ole_index.unindexed_subs.vector[i] ];
+            if (sub->notify_type == kSubNotifyType_ObjectCreation)
+            {
+                ResolveUnindexedPathExpressions(sub, kResolveOp_SubsAdd);
+            }
+        }
+
+        // Iterate over all object life events which have occurred recently, notifying the subscriptions which match them
+        for (i=0; i < object_life_events.num_entries; i++)
+        {
+            ole = &object_life_events.vector[i];
+            ProcessObjectLifeEvent(ole);
         }
     }
 
+    // Clear the lists of resolved paths
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        STR_VECTOR_Destroy(&sub->resolved_paths);
+        STR_SET_Destroy(&sub->resolved_paths_index);
+        sub->is_deletion_resolved = false;
+    }
+
     // Clear the list of object life events, since we have queued any notification messages which they matched
     for (i=0; i < object_life_events.num_entries; i++)
     {
@@ -573,6 +829,206 @@ void DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions(void)
     // Reset the flag that allows us to check that the ObjectDeletion paths have been 
     // resolved before the object has been deleted from the data model
     object_deletion_paths_resolved = false;
+    all_deletion_paths_resolved = false;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_SUBSCRIPTION_AreEventsPending
+**
+** Determines whether there are any object life events or database value changes queued for processing
+** by DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions() and DEVICE_SUBSCRIPTION_ProcessDbValueChanges()
+**
+** \param   None
+**
+** \return  true if there are events pending
+**
+**************************************************************************/
+bool DEVICE_SUBSCRIPTION_AreEventsPending(void)
+{
+    return ((object_life_events.num_entries > 0) || (db_value_changes.num_entries > 0)) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** DEVICE_SUBSCRIPTION_NotifyDbParamChanged
+**
+** Called when a database parameter has been written to, so that value change subscriptions
+** on the parameter can be processed without polling. The change is queued for later processing
+** by DEVICE_SUBSCRIPTION_ProcessDbValueChanges(), so that notifications are sent after the
+** response to the USP message which caused the change
+**
+** \param   path - data model path of the database parameter which was written to
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_SUBSCRIPTION_NotifyDbParamChanged(char *path)
+{
+    // Exit if there are no value change subscriptions which could be interested in this change
+    if (IsAnyValueChangeSubscriptionEnabled() == false)
+    {
+        return;
+    }
+
+    // Exit if no value change subscription references this parameter
+    // NOTE: If the index is stale, then we cannot tell, so we queue the change regardless
+    if ((is_vc_index_stale == false) && (IsParamInValueChangeIndex(path, TEXT_UTILS_CalcHash(path)) == false))
+    {
+        return;
+    }
+
+    STR_SET_AddIfNotExist(&db_value_changes_set, &db_value_changes, path);
+}
+
+/*********************************************************************//**
+**
+** DEVICE_SUBSCRIPTION_ProcessDbValueChanges
+**
+** Sends value change notifications for all database parameters which have changed value
+** since the last time that this function was called
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_SUBSCRIPTION_ProcessDbValueChanges(void)
+{
+    int i;
+    int err;
+    char *path;
+    int path_hash;
+    char value[MAX_DM_VALUE_LEN];
+
+    // Exit if value change notifications have not been started yet, or there is nothing to process
+    if ((is_value_change_started == false) || (db_value_changes.num_entries == 0))
+    {
+        return;
+    }
+
+    // Ensure that the index of parameters referenced by value change subscriptions is up to date
+    if (is_vc_index_stale)
+    {
+        RebuildValueChangeIndex();
+    }
+
+    // Iterate over all database parameters which have been written to
+    for (i=0; i < db_value_changes.num_entries; i++)
+    {
+        // Skip this parameter, if it is not referenced by any value change subscription
+        path = db_value_changes.vector[i];
+        path_hash = TEXT_UTILS_CalcHash(path);
+        if (IsParamInValueChangeIndex(path, path_hash) == false)
+        {
+            continue;
+        }
+
+        // Skip this parameter, if unable to get its current value (eg the object containing it has since been deleted)
+        err = DATA_MODEL_GetParameterValue(path, value, sizeof(value), 0);
+        if (err != USP_ERR_OK)
+        {
+            continue;
+        }
+
+        ProcessIndexedValueChange(path, path_hash, value);
+    }
+
+    STR_VECTOR_Destroy(&db_value_changes);
+    STR_SET_Destroy(&db_value_changes_set);
+}
+
+/*********************************************************************//**
+**
+** DEVICE_SUBSCRIPTION_NotifyValueChanged
+**
+** Called when the vendor has signalled (using USP_SIGNAL_ValueChanged) that the value of a parameter has changed
+** Value change notifications are sent immediately for all subscriptions referencing the parameter, if its value
+** differs from the value last notified. This allows vendor parameters registered with DM_PUSH_NOTIFIED to be
+** excluded from value change polling.
+**
+** \param   path - data model path of the parameter which has changed value
+** \param   value - new value of the parameter
+**
+** \return  None
+**
+**************************************************************************/
+void DEVICE_SUBSCRIPTION_NotifyValueChanged(char *path, char *value)
+{
+    int path_hash;
+
+    // Exit if value change notifications have not been started yet
+    // NOTE: The initial values of parameters are obtained when value change notifications are started
+    if (is_value_change_started == false)
+    {
+        return;
+    }
+
+    // Exit if there are no value change subscriptions which could be interested in this change
+    if (IsAnyValueChangeSubscriptionEnabled() == false)
+    {
+        return;
+    }
+
+    // Ensure that the index of parameters referenced by value change subscriptions is up to date
+    if (is_vc_index_stale)
+    {
+        RebuildValueChangeIndex();
+    }
+
+    // Exit if no value change subscription references this parameter
+    path_hash = TEXT_UTILS_CalcHash(path);
+    if (IsParamInValueChangeIndex(path, path_hash) == false)
+    {
+        return;
+    }
+
+    ProcessIndexedValueChange(path, path_hash, value);
+}
+
+/*********************************************************************//**
+**
+** ProcessIndexedValueChange
+**
+** Sends a value change notification for all subscriptions in the index referencing the specified parameter,
+** if the value of the parameter has changed since it was last notified (or polled) for each subscription
+** NOTE: The caller must ensure that the index is up to date
+**
+** \param   path - data model path of the parameter
+** \param   path_hash - hash of the path of the parameter (see TEXT_UTILS_CalcHash)
+** \param   value - current value of the parameter
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessIndexedValueChange(char *path, int path_hash, char *value)
+{
+    unsigned mask;
+    unsigned index;
+    vc_index_entry_t *entry;
+    subs_t *sub;
+    value_digest_t *digest;
+
+    // Iterate over all subscriptions referencing this parameter, sending a notification if the value has changed since it was last notified
+    mask = vc_index_size - 1;
+    index = ((unsigned)path_hash) & mask;
+    entry = &vc_index[index];
+    while (entry->path != NULL)
+    {
+        if ((entry->path_hash == path_hash) && (strcmp(entry->path, path)==0))
+        {
+            sub = &subscriptions.vector[entry->sub_index];
+            digest = &sub->last_values.vector[entry->param_index];
+            if (IsValueDigestMatch(digest, value) == false)
+            {
+                SendValueChangeNotify(sub, path, value);
+                CalcValueDigest(value, digest);
+            }
+        }
+
+        index = (index + 1) & mask;
+        entry = &vc_index[index];
+    }
 }
 
 /*********************************************************************//**
@@ -592,29 +1048,39 @@ void DEVICE_SUBSCRIPTION_SendPeriodicEvent(int cont_instance)
     subs_t *sub;
     Usp__Msg *req;
     kv_vector_t output_args;
+    int_vector_t matches;
 
     // Output arguments for the Periodic event are empty
     KV_VECTOR_Init(&output_args);
 
-    // Iterate over all enabled subscriptions, finding all enabled periodic subscriptions for the specified controller
-    for (i=0; i < subscriptions.num_entries; i++)
+    // Iterate over all enabled periodic event subscriptions, sending the event to those for the specified controller
+    MatchEventSubscriptions((char *)periodic_event_str, kSubNotifyType_Event, &matches);
+    req = NULL;
+    for (i=0; i < matches.num_entries; i++)
     {
-        sub = &subscriptions.vector[i];
-        if ((sub->enable) && (sub->notify_type == kSubNotifyType_Event) &&
-            (sub->cont_instance == cont_instance))
+        sub = &subscriptions.vector[ matches.vector[i] ];
+        if (sub->cont_instance == cont_instance)
         {
-            // Send the event, if it matches this subscription
-            if (DoesSubscriptionSendNotification(sub, (char *)periodic_event_str))
+            // Create the notify message for the first subscription, then readdress it for each subsequent subscription
+            if (req == NULL)
             {
-                // Create the notify message
                 req = MSG_HANDLER_CreateNotifyReq_Event((char *)periodic_event_str, &output_args, sub->subscription_id, sub->notification_retry);
-
-                // Send the Notify Request
-                SendNotify(req, sub, (char *)periodic_event_str);
-                usp__msg__free_unpacked(req, pbuf_allocator);
             }
+            else
+            {
+                MSG_HANDLER_ReaddressNotifyReq(req, sub->subscription_id, sub->notification_retry);
+            }
+
+            // Send the Notify Request
+            SendNotify(req, sub, (char *)periodic_event_str);
         }
     }
+
+    if (req != NULL)
+    {
+        usp__msg__free_unpacked(req, pbuf_allocator);
+    }
+    INT_VECTOR_Destroy(&matches);
 }
 
 /*********************************************************************//**
@@ -631,6 +1097,8 @@ void DEVICE_SUBSCRIPTION_SendPeriodicEvent(int cont_instance)
 void DEVICE_SUBSCRIPTION_Dump(void)
 {
     SUBS_VECTOR_Dump(&subscriptions);
+    SUBS_RETRY_Dump();
+    NOTIFY_SPOOL_Dump();
 }
 
 /*********************************************************************//**
@@ -655,8 +1123,10 @@ int ProcessSubscriptionAdded(int instance)
     // Initialise the structure representing this subscription
     memset(&sub, 0, sizeof(sub));
     sub.instance = instance;
-    KV_VECTOR_Init(&sub.last_values);
+    KV_VECTOR_Init(&sub.coalesced_changes);
+    STR_SET_Init(&sub.coalesced_changes_index);
     STR_VECTOR_Init(&sub.resolved_paths);
+    STR_SET_Init(&sub.resolved_paths_index);
 
     // Exit if unable to calculate the expiry time for this subscription    
     // NOTE: The subscription is not deleted by this function, but by the polling mechanism
@@ -738,6 +1208,22 @@ int ProcessSubscriptionAdded(int instance)
         goto exit;
     }
 
+    // Get the value change poll period
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.%s", device_subs_root, instance, VALUE_CHANGE_POLL_PERIOD_PARAM);
+    err = DM_ACCESS_GetUnsigned(path, &sub.poll_period);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Get the value change coalescing window
+    USP_SNPRINTF(path, sizeof(path), "%s.%d.%s", device_subs_root, instance, VALUE_CHANGE_COALESCE_WINDOW_PARAM);
+    err = DM_ACCESS_GetUnsigned(path, &sub.coalesce_window);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // If the code gets here, then we successfully retrieved all data about the subscription
     err = USP_ERR_OK;
 
@@ -748,13 +1234,15 @@ exit:
         if ((sub.enable==true) && (sub.notify_type == kSubNotifyType_ValueChange))
         {
             USP_SNPRINTF(path, sizeof(path), "%s.%d", device_subs_root, sub.instance);
-            GetAllPathExpressionParameterValues(&sub, &sub.path_expressions, &sub.last_values, path);
+            InitValueChangeDigests(&sub, path);
         }
 
         // We have successfully retrieved a subscription, so add it to the vector
         // NOTE: Ownership of the dynamically allocated memory referenced by the temp subscriber structure(sub) passes to the vector
         // So we do not have to call SUBS_VECTOR_DestroySubscriber(&sub)
         SUBS_VECTOR_Add(&subscriptions, &sub);
+        InvalidateValueChangeIndex();
+        InvalidateSubscriptionIndexes();
     }
     else
     {
@@ -859,6 +1347,8 @@ int NotifySubsDeleted(dm_req_t *req)
     {
         SUBS_RETRY_Delete(sub->instance);
         SUBS_VECTOR_Remove(&subscriptions, sub);
+        InvalidateValueChangeIndex();
+        InvalidateSubscriptionIndexes();
     }
 
     return USP_ERR_OK;
@@ -886,14 +1376,22 @@ int NotifyChange_SubsEnable(dm_req_t *req, char *value)
     sub = SUBS_VECTOR_GetSubsByInstance(&subscriptions, inst1);
     if (sub != NULL)
     {
+        // Send any value changes held back by the coalescing window, before the subscription is disabled
         cur_enable = sub->enable;
+        if ((cur_enable == true) && (val_bool == false))
+        {
+            SendCoalescedValueChanges(sub);
+        }
+
         sub->enable = val_bool;
+        InvalidateValueChangeIndex();
+        InvalidateSubscriptionIndexes();
 
         // Get the initial value of all parameters, if this is a value change subscription that has just been enabled
         if ((cur_enable == false) && (val_bool == true) && (sub->notify_type == kSubNotifyType_ValueChange))
         {
             USP_SNPRINTF(source_path, sizeof(source_path), "%s.%d", device_subs_root, sub->instance);
-            GetAllPathExpressionParameterValues(sub, &sub->path_expressions, &sub->last_values, source_path);
+            InitValueChangeDigests(sub, source_path);
         }
     }
 
@@ -928,15 +1426,23 @@ int NotifyChange_NotifyType(dm_req_t *req, char *value)
     // If the subscription is already enabled, then change it's notify type value
     if (sub != NULL)
     {
+        // Send any value changes held back by the coalescing window, before the subscription stops being a value change subscription
         cur_notify_type = sub->notify_type;
+        if ((cur_notify_type == kSubNotifyType_ValueChange) && (new_notify_type != kSubNotifyType_ValueChange))
+        {
+            SendCoalescedValueChanges(sub);
+        }
+
         sub->notify_type = new_notify_type;
+        InvalidateValueChangeIndex();
+        InvalidateSubscriptionIndexes();
 
         // Get the initial value of all parameters, if this is an enabled subscription which has just changed to be a value change subscription
         if ((sub->enable == true) && (cur_notify_type != kSubNotifyType_ValueChange)
                                   && (new_notify_type == kSubNotifyType_ValueChange))
         {
             USP_SNPRINTF(source_path, sizeof(source_path), "%s.%d", device_subs_root, sub->instance);
-            GetAllPathExpressionParameterValues(sub, &sub->path_expressions, &sub->last_values, source_path);
+            InitValueChangeDigests(sub, source_path);
         }
 
     }
@@ -997,6 +1503,8 @@ int NotifyChange_SubsRefList(dm_req_t *req, char *value)
     // Then add this new set of path expressions
     // These will take effect at the next poll interval
     TEXT_UTILS_SplitString(value, &sub->path_expressions, ",");
+    SUBS_VECTOR_DestroyResolvedParams(sub);
+    InvalidateSubscriptionIndexes();
 
     return USP_ERR_OK;
 }
@@ -1098,24 +1606,84 @@ int NotifyChange_NotifExpiration(dm_req_t *req, char *value)
 
 /*********************************************************************//**
 **
-** Validate_SubsID
+** NotifyChange_PollPeriod
 **
-** Validates that the Subscription ID being added is unique for the recipient
+** Function called when the value change poll period for a subscription is changed
 **
 ** \param   req - pointer to structure identifying the subscription
-** \param   value - value that the controller would like to set the Subscription ID to
+** \param   value - new value of this parameter
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int Validate_SubsID(dm_req_t *req, char *value)
+int NotifyChange_PollPeriod(dm_req_t *req, char *value)
 {
-    char controller_path[MAX_DM_PATH];
-    char path[MAX_DM_PATH];
-    int i;
-    int err;
     subs_t *sub;
-    int controller_instance;
+    int err;
+
+    // Determine which subscription this change affects
+    sub = SUBS_VECTOR_GetSubsByInstance(&subscriptions, inst1);
+    USP_ASSERT(sub != NULL);
+    
+    // Update the poll_period for this subscription, and reschedule it on the next tick of the poll scheduler
+    err = TEXT_UTILS_StringToUnsigned(value, &sub->poll_period);
+    sub->next_poll_time = 0;
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** NotifyChange_CoalesceWindow
+**
+** Function called when the value change coalescing window for a subscription is changed
+**
+** \param   req - pointer to structure identifying the subscription
+** \param   value - new value of this parameter
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NotifyChange_CoalesceWindow(dm_req_t *req, char *value)
+{
+    subs_t *sub;
+    int err;
+
+    // Determine which subscription this change affects
+    sub = SUBS_VECTOR_GetSubsByInstance(&subscriptions, inst1);
+    USP_ASSERT(sub != NULL);
+
+    // Update the coalescing window for this subscription
+    // NOTE: Value changes already being coalesced are sent at the end of the current window, unless coalescing has been disabled
+    err = TEXT_UTILS_StringToUnsigned(value, &sub->coalesce_window);
+    if (sub->coalesce_window == 0)
+    {
+        SendCoalescedValueChanges(sub);
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** Validate_SubsID
+**
+** Validates that the Subscription ID being added is unique for the recipient
+**
+** \param   req - pointer to structure identifying the subscription
+** \param   value - value that the controller would like to set the Subscription ID to
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int Validate_SubsID(dm_req_t *req, char *value)
+{
+    char controller_path[MAX_DM_PATH];
+    char path[MAX_DM_PATH];
+    int i;
+    int err;
+    subs_t *sub;
+    int controller_instance;
 
     // Exit if unable to get the recipient for this entry in the subscription table
     USP_SNPRINTF(path, sizeof(path), "%s.%d.Recipient", device_subs_root, inst1);
@@ -1593,118 +2161,263 @@ void ProcessAllBootSubscriptions(void)
 {
     int i;
     subs_t *sub;
+    int_vector_t matches;
 
-    // Iterate over all enabled subscriptions, processing each boot event subscription that matches
+    // Send the boot event to all subscriptions that match it
     // (there may be more than one subscriber)
-    for (i=0; i < subscriptions.num_entries; i++)
+    MatchEventSubscriptions((char *)device_boot_event, kSubNotifyType_Event, &matches);
+    for (i=0; i < matches.num_entries; i++)
     {
-        sub = &subscriptions.vector[i];
-        if ((sub->enable) && (sub->notify_type == kSubNotifyType_Event))
-        {
-            // Send the event, if it matches this subscription
-            if (DoesSubscriptionSendNotification(sub, (char *)device_boot_event))
-            {
-                SendBootNotify(sub);
-            }
-        }
+        sub = &subscriptions.vector[ matches.vector[i] ];
+        SendBootNotify(sub);
     }
+    INT_VECTOR_Destroy(&matches);
 }
 
 /*********************************************************************//**
 **
-** ProcessObjectLifeEventSubscription
+** ProcessObjectLifeEvent
 **
-** Process a single life event subscription, seeing if it matches any of the recent object life events
-** If it does, then send a USP notification message
+** Process a single object life event, seeing if it matches any of the enabled life event subscriptions
+** If it does, then send a USP notification message for each subscription that it matches
 **
-** \param   None
+** \param   ole - pointer to object life event to process
 **
 ** \return  None
 **
 **************************************************************************/
-void ProcessObjectLifeEventSubscription(subs_t *sub)
+void ProcessObjectLifeEvent(obj_life_event_t *ole)
 {
     int i;
-    int index;
+    int sub_index;
+    subs_t *sub;
     Usp__Msg *req;
-    obj_life_event_t *ole;
+    int_vector_t matches;
 
-    // Exit if no object life events occurred, freeing the memory used by any resolved paths
-    if (object_life_events.num_entries == 0)
+    // Determine the subscriptions whose indexed path expressions match this object
+    INT_VECTOR_Init(&matches);
+    MatchSubscriptionIndex(&ole_index, ole->obj_path, ole->notify_type, &matches);
+
+    // Add the subscriptions whose resolved (unindexed) path expressions match this object
+    for (i=0; i < ole_index.unindexed_subs.num_entries; i++)
     {
-        goto exit;
+        sub_index = ole_index.unindexed_subs.vector[i];
+        sub = &subscriptions.vector[sub_index];
+        if ((sub->notify_type == ole->notify_type) &&
+            (STR_SET_Find(&sub->resolved_paths_index, &sub->resolved_paths, ole->obj_path) != INVALID) &&
+            (INT_VECTOR_Find(&matches, sub_index) == INVALID))
+        {
+            INT_VECTOR_Add(&matches, sub_index);
+        }
     }
 
-    // Create a list of all objects which are referenced by this subscription
-    // For an add operation, this must be done after the object has been added to the data model
-    // for the object to appear in the resolved paths list
-    // NOTE: We use kResolveOp_SubsAdd because this is the op that is used when validating the ReferenceList parameter of the Subscription table
-    if (sub->notify_type == kSubNotifyType_ObjectCreation)
+    // Send the notifications in the order of the subscriptions vector
+    if (matches.num_entries > 1)
     {
-        ResolveAllPathExpressions(DEVICE_SUBS_ROOT, &sub->path_expressions, &sub->resolved_paths, kResolveOp_SubsAdd, sub->cont_instance);
+        qsort(matches.vector, matches.num_entries, sizeof(int), CompareSubsIndex);
     }
-    
-    // Iterate over all object life events which have occurred recently
-    for (i=0; i < object_life_events.num_entries; i++)
+
+    // NOTE: All matching subscriptions are of the same notification type, so the NotifyRequest message is formed once
+    // (for the first subscription), then readdressed to each subsequent subscription
+    req = NULL;
+    for (i=0; i < matches.num_entries; i++)
     {
-        // Skip this life event, if it does not match the subscription notify type
-        ole = &object_life_events.vector[i];
-        if (ole->notify_type != sub->notify_type)
+        // Form the NotifyRequest message as a protobuf structure
+        sub = &subscriptions.vector[ matches.vector[i] ];
+        if (req != NULL)
+        {
+            MSG_HANDLER_ReaddressNotifyReq(req, sub->subscription_id, sub->notification_retry);
+        }
+        else if (sub->notify_type == kSubNotifyType_ObjectCreation)
+        {
+            req = MSG_HANDLER_CreateNotifyReq_ObjectCreation(ole->obj_path, sub->subscription_id, sub->notification_retry);
+        }
+        else
+        {
+            req = MSG_HANDLER_CreateNotifyReq_ObjectDeletion(ole->obj_path, sub->subscription_id, sub->notification_retry);
+        }
+
+        // Send the Notify Request
+        SendNotify(req, sub, ole->obj_path);
+    }
+
+    if (req != NULL)
+    {
+        usp__msg__free_unpacked(req, pbuf_allocator);
+    }
+
+    INT_VECTOR_Destroy(&matches);
+}
+
+/*********************************************************************//**
+**
+** ResolveUnindexedPathExpressions
+**
+** Resolves the path expressions of a life event subscription which are not in the index,
+** storing the resolved objects in the subscription's resolved_paths vector
+**
+** \param   sub - pointer to subscription whose path expressions should be resolved
+** \param   op - Operation being performed (kResolveOp_SubsAdd or kResolveOp_SubsDel)
+**
+** \return  None
+**
+**************************************************************************/
+void ResolveUnindexedPathExpressions(subs_t *sub, resolve_op_t op)
+{
+    char *expr;
+    int i;
+    int err;
+    combined_role_t combined_role;
+
+    // Default to no resolved paths
+    STR_VECTOR_Destroy(&sub->resolved_paths);
+    STR_SET_Destroy(&sub->resolved_paths_index);
+
+    // Exit if we cannot retrieve the role to use for this endpoint
+    err = DEVICE_CONTROLLER_GetCombinedRole(sub->cont_instance, &combined_role);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    for (i=0; i < sub->path_expressions.num_entries; i++)
+    {
+        // Skip path expressions which are matched using the index
+        expr = sub->path_expressions.vector[i];
+        if (IsPathExpressionIndexable(expr))
         {
             continue;
         }
 
-        // If this object life event matches an object referenced by this subscription,
-        // then send a notification to the subscribing controller
-        index = STR_VECTOR_Find(&sub->resolved_paths, ole->obj_path);
-        if (index != INVALID)
+        err = PATH_RESOLVER_ResolveDevicePath(expr, &sub->resolved_paths, op, NULL, &combined_role, 0);
+        if (err != USP_ERR_OK)
         {
-            // Form the NotifyRequest message as a protobuf structure
-            if (sub->notify_type == kSubNotifyType_ObjectCreation)
-            {
-                req = MSG_HANDLER_CreateNotifyReq_ObjectCreation(ole->obj_path, sub->subscription_id, sub->notification_retry);
-            }
-            else
-            {
-                req = MSG_HANDLER_CreateNotifyReq_ObjectDeletion(ole->obj_path, sub->subscription_id, sub->notification_retry);
-            }
-            
-            // Send the Notify Request
-            SendNotify(req, sub, ole->obj_path);
-            usp__msg__free_unpacked(req, pbuf_allocator);
+            // NOTE: Just logging the error, but ignoring it. It should not have occured (should have been caught by Validate_SubsRefList call)
+            USP_LOG_Warning("%s: Path expression (%s) contained in %s.%d is invalid", __FUNCTION__, expr, device_subs_root, sub->instance);
         }
     }
+}
 
-exit:
-    // Clear the list of resolved paths
-    STR_VECTOR_Destroy(&sub->resolved_paths);
+/*********************************************************************//**
+**
+** CompareSubsIndex
+**
+** qsort comparison function used to sort the indexes of the subscriptions matching an object life event
+**
+** \param   p1 - pointer to first index to compare
+** \param   p2 - pointer to second index to compare
+**
+** \return  negative, zero or positive, depending on whether the first index is less than, equal to, or greater than the second
+**
+**************************************************************************/
+int CompareSubsIndex(const void *p1, const void *p2)
+{
+    return *((const int *)p1) - *((const int *)p2);
 }
 
 /*********************************************************************//**
 **
 ** ProcessAllValueChangeSubscriptions
 **
-** Called to Periodically poll all value change notifications
+** Called on every tick of the poll scheduler, to poll all value change subscriptions which are due
+** NOTE: The number of parameters polled in each tick is limited by VALUE_CHANGE_POLL_MAX_PARAMS_PER_TICK
+**       Due subscriptions which do not fit within this budget are deferred to the next tick
 **
-** \param   timer - pointer to timer which initiated this call
+** \param   cur_time - current time
 **
 ** \return  None
 **
 **************************************************************************/
-void ProcessAllValueChangeSubscriptions(void)
+void ProcessAllValueChangeSubscriptions(time_t cur_time)
 {
     int i;
+    int count;
+    int num_params_polled;
     subs_t *sub;
 
-    // Iterate over all enabled subscriptions, processing each value change subscription
-    for (i=0; i < subscriptions.num_entries; i++)
+    // Exit if there are no subscriptions
+    if (subscriptions.num_entries == 0)
+    {
+        poll_cursor = 0;
+        return;
+    }
+
+    // Iterate over all enabled value change subscriptions, starting from the one after the last subscription polled in the previous tick
+    num_params_polled = 0;
+    if (poll_cursor >= subscriptions.num_entries)
+    {
+        poll_cursor = 0;
+    }
+
+    i = poll_cursor;
+    for (count=0; count < subscriptions.num_entries; count++)
     {
         sub = &subscriptions.vector[i];
+        i = (i + 1) % subscriptions.num_entries;
+
         if ((sub->enable) && (sub->notify_type == kSubNotifyType_ValueChange))
         {
+            // Schedule this subscription in its bucket, if it has not been scheduled yet
+            if (sub->next_poll_time == 0)
+            {
+                sub->next_poll_time = CalcNextPollTime(sub, cur_time);
+            }
+
+            // Skip this subscription if it is not due to be polled yet
+            if (sub->next_poll_time > cur_time)
+            {
+                continue;
+            }
+
+            // Exit if polling this subscription would exceed the budget for this tick (deferring it to the next tick)
+            // NOTE: At least one subscription is always polled in each tick, so that subscriptions with many parameters are not deferred forever
+            if ((VALUE_CHANGE_POLL_MAX_PARAMS_PER_TICK > 0) && (num_params_polled > 0) &&
+                (num_params_polled + sub->last_values.num_entries > VALUE_CHANGE_POLL_MAX_PARAMS_PER_TICK))
+            {
+                poll_cursor = (i + subscriptions.num_entries - 1) % subscriptions.num_entries;
+                return;
+            }
+
+            num_params_polled += sub->last_values.num_entries;
             ProcessValueChangeSubscription(sub);
+            sub->next_poll_time = CalcNextPollTime(sub, cur_time);
         }
     }
+
+    poll_cursor = i;
+}
+
+/*********************************************************************//**
+**
+** CalcNextPollTime
+**
+** Calculates the next time at which the specified subscription should be polled for value change
+** Each subscription is polled in a bucket of the poll period determined by its instance number,
+** so that subscriptions are spread across the poll period
+**
+** \param   sub - pointer to subscription
+** \param   cur_time - current time
+**
+** \return  time at which the subscription should next be polled
+**
+**************************************************************************/
+time_t CalcNextPollTime(subs_t *sub, time_t cur_time)
+{
+    time_t period;
+    time_t next_time;
+
+    period = (sub->poll_period != 0) ? sub->poll_period : VALUE_CHANGE_POLL_PERIOD;
+
+    // Calculate the time of this subscription's bucket in the current poll period
+    next_time = cur_time - (cur_time % period) + (sub->instance % period);
+
+    // If the bucket has already passed, then use the bucket in the next poll period
+    if (next_time <= cur_time)
+    {
+        next_time += period;
+    }
+
+    return next_time;
 }
 
 /*********************************************************************//**
@@ -1712,6 +2425,9 @@ void ProcessAllValueChangeSubscriptions(void)
 ** ProcessValueChangeSubscription
 **
 ** Processes one enabled subscription for value change
+** The current value of each parameter is compared against the digest of its value from last time, and only the
+** digests of parameters which have changed value are updated. The vector of digests is only rebuilt if the set of
+** parameters referenced by the subscription has changed since last time (eg because objects have been added or deleted)
 **
 ** \param   sub - pointer to subscription to poll
 **
@@ -1720,132 +2436,486 @@ void ProcessAllValueChangeSubscriptions(void)
 **************************************************************************/
 void ProcessValueChangeSubscription(subs_t *sub)
 {
-    int i;
-    kv_vector_t cur_values;
-    kv_pair_t *pair;
+    int i, j;
     int index;
     int hint_index;
+    int *last_indexes;
+    int *get_indexes;
+    bool is_same_params;
+    dm_resolved_path_vector_t *rpv;
+    dm_resolved_path_t *rp;
+    dm_resolved_path_t *get_paths;
+    kv_vector_t get_values;
+    value_digest_vector_t new_values;
+    value_digest_t *digests;
+    value_digest_t *digest;
     char *value;
     char source_path[MAX_DM_PATH];
 
-    // Get the current values of all parameters associated with this subscription
+    // Get the vector of all parameters currently referenced by this subscription, along with their nodes and instance numbers
     USP_SNPRINTF(source_path, sizeof(source_path), "%s.%d", device_subs_root, sub->instance);
-    GetAllPathExpressionParameterValues(sub, &sub->path_expressions, &cur_values, source_path);
-    
-    // Determine whether any of the values have changed from last time
+    rpv = GetValueChangeParams(sub, source_path);
+
+    // Exit if the subscription does not currently reference any parameters
+    if (rpv->num_entries == 0)
+    {
+        if (sub->last_values.num_entries != 0)
+        {
+            SUBS_VECTOR_DestroyValueDigests(&sub->last_values);
+            InvalidateValueChangeIndex();
+        }
+        return;
+    }
+
+    // Find the digest from last time matching each parameter
+    // NOTE: We pass in a hint based on where we expect to find the matching parameter
+    // This hint will be a perfect match if the list of parameters generated by the path expressions have not changed since last time
+    last_indexes = USP_MALLOC(rpv->num_entries*sizeof(int));
+    is_same_params = (rpv->num_entries == sub->last_values.num_entries) ? true : false;
     hint_index = 0;
-    for (i=0; i < cur_values.num_entries; i++)
+    for (i=0; i < rpv->num_entries; i++)
     {
-        pair = &cur_values.vector[i];
+        index = FindValueDigest(&sub->last_values, rpv->vector[i].path, hint_index);
+        last_indexes[i] = index;
+        if (index != i)
+        {
+            is_same_params = false;
+        }
 
-        // Find the index in the last_values vector matching this parameter
-        // NOTE: We pass in a hint based on where we expect to find the matching parameter
-        // This hint will be a perfect match if the list of parameters generated by the path expressions have not changed since last time
-        index = KV_VECTOR_FindKey(&sub->last_values, pair->key, hint_index);
         if (index != INVALID)
         {
             hint_index = index + 1;         // Calculate index for next hint
-            value = sub->last_values.vector[index].value;
+        }
+    }
 
-            if (strcmp(value, pair->value) != 0)
-            {
-                // The value has changed since last time, so send a Value Change NotifyRequest
-                SendValueChangeNotify(sub, pair->key, pair->value);
-            }
+    // Form the list of parameters to get the value of
+    // This excludes parameters which already have a digest and whose changes are pushed to us (see IsValueChangePushed),
+    // as their digests are kept up to date without polling
+    // NOTE: The keys in get_values point to the paths in the resolved paths vector (they are not owned by get_values)
+    get_values.vector = USP_MALLOC(rpv->num_entries*sizeof(kv_pair_t));
+    get_values.num_entries = 0;
+    get_paths = USP_MALLOC(rpv->num_entries*sizeof(dm_resolved_path_t));
+    get_indexes = USP_MALLOC(rpv->num_entries*sizeof(int));
+    for (i=0; i < rpv->num_entries; i++)
+    {
+        rp = &rpv->vector[i];
+        if ((last_indexes[i] == INVALID) || (IsValueChangePushed(rp->node) == false))
+        {
+            j = get_values.num_entries;
+            get_values.vector[j].key = rp->path;
+            get_values.vector[j].value = NULL;
+            memcpy(&get_paths[j], rp, sizeof(dm_resolved_path_t));
+            get_indexes[j] = i;
+            get_values.num_entries++;
         }
-        else
+    }
+
+    // Get the values of the parameters, using the nodes and instance numbers found by the path resolver
+    // NOTE: Getting all values at once allows grouped vendor parameters to be obtained using a single call to the vendor
+    // NOTE: Intentionally ignoring errors by returning an empty string if they occur
+    DATA_MODEL_GetResolvedParameterValues(&get_values, get_paths, IGNORE_GET_ERRORS);
+
+    // Determine the vector of digests to update
+    if (is_same_params)
+    {
+        // The set of parameters has not changed, so update the existing digests in place
+        digests = sub->last_values.vector;
+    }
+    else
+    {
+        // The set of parameters has changed, so form a new vector of digests, carrying over the digests from last time
+        // NOTE: The paths are copied, as the resolved paths vector may be cached for subsequent polls
+        new_values.vector = USP_MALLOC(rpv->num_entries*sizeof(value_digest_t));
+        new_values.num_entries = rpv->num_entries;
+        for (i=0; i < rpv->num_entries; i++)
+        {
+            digest = &new_values.vector[i];
+            rp = &rpv->vector[i];
+            digest->path = USP_STRDUP(rp->path);
+
+            index = last_indexes[i];
+            digest->hash = (index != INVALID) ? sub->last_values.vector[index].hash : 0;
+            digest->len = (index != INVALID) ? sub->last_values.vector[index].len : 0;
+        }
+        digests = new_values.vector;
+    }
+
+    // Determine whether any of the values have changed from last time, updating the digests of those that have
+    for (j=0; j < get_values.num_entries; j++)
+    {
+        i = get_indexes[j];
+        value = get_values.vector[j].value;
+        digest = &digests[i];
+        if (last_indexes[i] == INVALID)
         {
             // If we do not have a value for the parameter from last time, then this does not trigger a value change
+            CalcValueDigest(value, digest);
+        }
+        else if (IsValueDigestMatch(digest, value) == false)
+        {
+            // The value has changed since last time, so send a Value Change NotifyRequest
+            SendValueChangeNotify(sub, digest->path, value);
+            CalcValueDigest(value, digest);
         }
+    }
 
+    // Replace the digests from last time, if the set of parameters has changed
+    if (is_same_params == false)
+    {
+        SUBS_VECTOR_DestroyValueDigests(&sub->last_values);
+        memcpy(&sub->last_values, &new_values, sizeof(new_values));
+        InvalidateValueChangeIndex();
     }
 
-    // Finally, replace the last set of values with the current set
-    KV_VECTOR_Destroy(&sub->last_values);
-    memcpy(&sub->last_values, &cur_values, sizeof(kv_vector_t));
+    // Clean up (the keys in get_values are not owned by it)
+    for (j=0; j < get_values.num_entries; j++)
+    {
+        USP_SAFE_FREE(get_values.vector[j].value);
+    }
+    USP_FREE(get_values.vector);
+    USP_FREE(get_paths);
+    USP_FREE(get_indexes);
+    USP_FREE(last_indexes);
 }
 
 /*********************************************************************//**
 **
-** GetAllPathExpressionParameterValues
+** GetValueChangeParams
 **
-** Gets all of the parameters and their values associated with a set of path expressions
+** Returns the vector of parameters (along with their nodes and instance numbers) referenced by the specified
+** value change subscription. The vector is cached in the subscription between polls, and is only resolved again if
+** object instances have been added to or deleted from the data model, or the role of the recipient controller has changed.
+** NOTE: Path expressions containing search expressions or reference following are resolved on every poll, because
+**       the parameters that they reference depend on the values of other parameters
 **
 ** \param   sub - pointer to subscription
-** \param   path_expressions - vector of path expressions to get the values of
-** \param   param_values - vector in which parameter values are returned (key=parameter name, value=parameter value)
-**                         NOTE: This function overwrites any contents in this vector
-** \param   source_path - string naming the table entry that the path expression came from. Used only for debug.
+** \param   source_path - string naming the table entry that the path expressions came from. Used only for debug.
 **
-** \return  None
+** \return  pointer to vector of resolved parameters. NOTE: This is owned by the subscription
 **
 **************************************************************************/
-void GetAllPathExpressionParameterValues(subs_t *sub, str_vector_t *path_expressions, kv_vector_t *param_values, char *source_path)
+dm_resolved_path_vector_t *GetValueChangeParams(subs_t *sub, char *source_path)
 {
     int i;
     int err;
-    str_vector_t params;
-    kv_pair_t *pair;
-    char buf[MAX_DM_VALUE_LEN];
+    unsigned generation;
+    combined_role_t combined_role;
+    bool is_cacheable;
 
-    // Form a vector list containing all the parameters to get the value of
-    ResolveAllPathExpressions(source_path, path_expressions, &params, kResolveOp_SubsValChange, sub->cont_instance);
+    // Exit if the cached parameters are still valid
+    generation = DM_INST_VECTOR_GetGeneration();
+    err = DEVICE_CONTROLLER_GetCombinedRole(sub->cont_instance, &combined_role);
+    if ((sub->resolved_params != NULL) && (sub->resolved_params_generation == generation) && (err == USP_ERR_OK) &&
+        (sub->resolved_params_inherited_role == combined_role.inherited) && (sub->resolved_params_assigned_role == combined_role.assigned))
+    {
+        return sub->resolved_params;
+    }
 
-    // Convert the vector list into the keys in a key-value pair vector.
-    // NOTE: We do not have to call STR_VECTOR_Destroy(&params) because STR_VECTOR_ConvertToKeyValueVector() destroys the string vector
-    STR_VECTOR_ConvertToKeyValueVector(&params, param_values);
+    // Resolve all path expressions again
+    SUBS_VECTOR_DestroyResolvedParams(sub);
+    sub->resolved_params = USP_MALLOC(sizeof(dm_resolved_path_vector_t));
+    ResolveAllPathExpressionsToNodes(source_path, &sub->path_expressions, sub->resolved_params, kResolveOp_SubsValChange, sub->cont_instance);
 
-    // Iterate over all parameters in the key-value pair vector, getting their values from the data model
-    for (i=0; i < param_values->num_entries; i++)
+    // Determine whether the resolved parameters only depend on the object instances present in the data model
+    is_cacheable = (err == USP_ERR_OK) ? true : false;
+    for (i=0; i < sub->path_expressions.num_entries; i++)
     {
-        pair = &param_values->vector[i];
-        USP_ASSERT(pair->value == NULL);
-
-        // Get the value of the parameter.
-        buf[0] = '\0';
-        err = DATA_MODEL_GetParameterValue(pair->key, buf, sizeof(buf), 0);
-        if (err == USP_ERR_OK)
-        {
-            pair->value = USP_STRDUP(buf);
-        }
-        else
+        if (IsPathExpressionIndexable(sub->path_expressions.vector[i]) == false)
         {
-            // Intentionally ignoring errors by returning an empty string if they occur
-            pair->value = USP_STRDUP("");
+            is_cacheable = false;
+            break;
         }
     }
+
+    // Mark the cache as valid, if the resolved parameters can be reused by subsequent polls
+    if (is_cacheable)
+    {
+        sub->resolved_params_generation = generation;
+        sub->resolved_params_inherited_role = combined_role.inherited;
+        sub->resolved_params_assigned_role = combined_role.assigned;
+    }
+
+    return sub->resolved_params;
 }
 
 /*********************************************************************//**
 **
-** ResolveAllPathExpressions
+** IsValueChangePushed
 **
-** Creates a single list of resolved paths, given a list of path expressions
+** Determines whether changes to the value of the specified parameter are signalled to the subscription engine,
+** rather than having to be detected by polling. This is the case for database parameters (see DEVICE_SUBSCRIPTION_NotifyDbParamChanged)
+** and for vendor parameters registered with DM_PUSH_NOTIFIED (see DEVICE_SUBSCRIPTION_NotifyValueChanged)
 **
-** \param   source_path - string naming the table entry that the path expression came from. Used only for debug.
-** \param   path_expressions - list of path expressions to resolve
-** \param   resolved_paths - pointer to string vector in which to return all resolved path expressions
-** \param   op - Operation being performed
-** \param   cont_instance - Controller Instance number - used to determine the role to use for the recipient controller
+** \param   node - pointer to node of the parameter in the data model schema
 **
-** \return  None
+** \return  true if the parameter does not need to be polled for value changes
 **
 **************************************************************************/
-void ResolveAllPathExpressions(char *source_path, str_vector_t *path_expressions, str_vector_t *resolved_paths, resolve_op_t op, int cont_instance)
+bool IsValueChangePushed(dm_node_t *node)
 {
-    char *expr;
-    int i;
-    int err;
-    combined_role_t combined_role;
-
-    // Default to no resolved paths
-    STR_VECTOR_Init(resolved_paths);
-
-    // Exit if we cannot retrieve the role to use for this endpoint
-    err = DEVICE_CONTROLLER_GetCombinedRole(cont_instance, &combined_role);
-    if (err != USP_ERR_OK)
+    if (IsDbParam(node))
     {
-        return;
+        return true;
+    }
+
+    return (node->registered.param_info.type_flags & DM_PUSH_NOTIFIED) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** InitValueChangeDigests
+**
+** Replaces the digests of the last values of all parameters referenced by the specified value change subscription
+** with digests of their current values. Called when a value change subscription becomes active.
+**
+** \param   sub - pointer to subscription
+** \param   source_path - string naming the table entry that the path expressions came from. Used only for debug.
+**
+** \return  None
+**
+**************************************************************************/
+void InitValueChangeDigests(subs_t *sub, char *source_path)
+{
+    int i;
+    kv_vector_t cur_values;
+    kv_pair_t *pair;
+    value_digest_t *digest;
+
+    // Get the current values of all parameters associated with this subscription
+    GetAllPathExpressionParameterValues(sub, &sub->path_expressions, &cur_values, source_path);
+
+    // Replace the digests from last time with digests of the current values
+    // NOTE: Ownership of the parameter paths passes from cur_values to the vector of digests
+    SUBS_VECTOR_DestroyValueDigests(&sub->last_values);
+    if (cur_values.num_entries > 0)
+    {
+        sub->last_values.vector = USP_MALLOC(cur_values.num_entries*sizeof(value_digest_t));
+        sub->last_values.num_entries = cur_values.num_entries;
+        for (i=0; i < cur_values.num_entries; i++)
+        {
+            pair = &cur_values.vector[i];
+            digest = &sub->last_values.vector[i];
+            digest->path = pair->key;
+            CalcValueDigest(pair->value, digest);
+            USP_FREE(pair->value);
+        }
+    }
+    USP_SAFE_FREE(cur_values.vector);
+
+    // The index of parameters referenced by subscriptions is now out of date
+    InvalidateValueChangeIndex();
+}
+
+/*********************************************************************//**
+**
+** CalcValueDigest
+**
+** Calculates the digest of the specified parameter value, storing it in the specified digest
+** NOTE: Only a digest of the value is stored, rather than the value itself, so that memory usage is
+**       independent of the length of the values of the parameters being monitored
+**
+** \param   value - value of the parameter
+** \param   digest - pointer to digest to update. NOTE: The path stored in the digest is not modified
+**
+** \return  None
+**
+**************************************************************************/
+void CalcValueDigest(char *value, value_digest_t *digest)
+{
+    digest->hash = TEXT_UTILS_CalcHash64(value);
+    digest->len = strlen(value);
+}
+
+/*********************************************************************//**
+**
+** IsValueDigestMatch
+**
+** Determines whether the specified parameter value matches the specified digest
+** NOTE: The length is compared first, as it cheaply rules out most changed values
+**
+** \param   digest - pointer to digest of the last value of the parameter
+** \param   value - current value of the parameter
+**
+** \return  true if the value is (with extremely high probability) the same as the one used to calculate the digest
+**
+**************************************************************************/
+bool IsValueDigestMatch(value_digest_t *digest, char *value)
+{
+    if (digest->len != strlen(value))
+    {
+        return false;
+    }
+
+    return (digest->hash == TEXT_UTILS_CalcHash64(value)) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** FindValueDigest
+**
+** Finds the digest of the specified parameter in the vector of digests
+**
+** \param   vdv - pointer to vector of digests to search
+** \param   path - path of the parameter to find
+** \param   hint_index - index at which to start searching. The search wraps around to the start of the vector.
+**
+** \return  index of the matching digest, or INVALID if no match was found
+**
+**************************************************************************/
+int FindValueDigest(value_digest_vector_t *vdv, char *path, int hint_index)
+{
+    int i;
+
+    // Search from the hint to the end of the vector
+    if ((hint_index < 0) || (hint_index >= vdv->num_entries))
+    {
+        hint_index = 0;
+    }
+
+    for (i=hint_index; i < vdv->num_entries; i++)
+    {
+        if (strcmp(vdv->vector[i].path, path)==0)
+        {
+            return i;
+        }
+    }
+
+    // Then search from the start of the vector up to the hint
+    for (i=0; i < hint_index; i++)
+    {
+        if (strcmp(vdv->vector[i].path, path)==0)
+        {
+            return i;
+        }
+    }
+
+    return INVALID;
+}
+
+/*********************************************************************//**
+**
+** GetAllPathExpressionParameterValues
+**
+** Gets all of the parameters and their values associated with a set of path expressions
+**
+** \param   sub - pointer to subscription
+** \param   path_expressions - vector of path expressions to get the values of
+** \param   param_values - vector in which parameter values are returned (key=parameter name, value=parameter value)
+**                         NOTE: This function overwrites any contents in this vector
+** \param   source_path - string naming the table entry that the path expression came from. Used only for debug.
+**
+** \return  None
+**
+**************************************************************************/
+void GetAllPathExpressionParameterValues(subs_t *sub, str_vector_t *path_expressions, kv_vector_t *param_values, char *source_path)
+{
+    int i;
+    dm_resolved_path_vector_t rpv;
+    dm_resolved_path_t *rp;
+    kv_pair_t *pair;
+
+    // Form a vector containing all the parameters to get the value of, along with their nodes and instance numbers
+    ResolveAllPathExpressionsToNodes(source_path, path_expressions, &rpv, kResolveOp_SubsValChange, sub->cont_instance);
+
+    // Move the paths of the parameters into the keys of a key-value pair vector
+    // NOTE: The path stored in each resolved path is set to NULL, as it is now owned by the key-value pair vector
+    KV_VECTOR_Init(param_values);
+    if (rpv.num_entries > 0)
+    {
+        param_values->vector = USP_MALLOC(rpv.num_entries*sizeof(kv_pair_t));
+        param_values->num_entries = rpv.num_entries;
+        for (i=0; i < rpv.num_entries; i++)
+        {
+            rp = &rpv.vector[i];
+            pair = &param_values->vector[i];
+            pair->key = rp->path;
+            pair->value = NULL;
+            rp->path = NULL;
+        }
+    }
+
+    // Get the values of all parameters, using the nodes and instance numbers found by the path resolver
+    // NOTE: Getting all values at once allows grouped vendor parameters to be obtained using a single call to the vendor
+    // NOTE: Intentionally ignoring errors by returning an empty string if they occur
+    DATA_MODEL_GetResolvedParameterValues(param_values, rpv.vector, IGNORE_GET_ERRORS);
+    PATH_RESOLVER_DestroyResolvedPaths(&rpv);
+}
+
+/*********************************************************************//**
+**
+** ResolveAllPathExpressionsToNodes
+**
+** Creates a single list of resolved paths (along with their nodes and instance numbers), given a list of path expressions
+**
+** \param   source_path - string naming the table entry that the path expression came from. Used only for debug.
+** \param   path_expressions - list of path expressions to resolve
+** \param   rpv - pointer to vector in which to return all resolved paths
+** \param   op - Operation being performed
+** \param   cont_instance - Controller Instance number - used to determine the role to use for the recipient controller
+**
+** \return  None
+**
+**************************************************************************/
+void ResolveAllPathExpressionsToNodes(char *source_path, str_vector_t *path_expressions, dm_resolved_path_vector_t *rpv, resolve_op_t op, int cont_instance)
+{
+    char *expr;
+    int i;
+    int err;
+    combined_role_t combined_role;
+
+    // Default to no resolved paths
+    PATH_RESOLVER_InitResolvedPaths(rpv);
+
+    // Exit if we cannot retrieve the role to use for this endpoint
+    err = DEVICE_CONTROLLER_GetCombinedRole(cont_instance, &combined_role);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    // Form a vector list containing all the parameters to get the value of
+    for (i=0; i < path_expressions->num_entries; i++)
+    {
+        expr = path_expressions->vector[i];
+        err = PATH_RESOLVER_ResolveDevicePathToNodes(expr, rpv, op, &combined_role, 0);
+        if (err != USP_ERR_OK)
+        {
+            // NOTE: Just logging the error, but ignoring it. It should not have occured (should have been caught by Validate_SubsRefList call)
+            USP_LOG_Warning("%s: Path expression (%s) contained in %s is invalid", __FUNCTION__, expr, source_path);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** ResolveAllPathExpressions
+**
+** Creates a single list of resolved paths, given a list of path expressions
+**
+** \param   source_path - string naming the table entry that the path expression came from. Used only for debug.
+** \param   path_expressions - list of path expressions to resolve
+** \param   resolved_paths - pointer to string vector in which to return all resolved path expressions
+** \param   op - Operation being performed
+** \param   cont_instance - Controller Instance number - used to determine the role to use for the recipient controller
+**
+** \return  None
+**
+**************************************************************************/
+void ResolveAllPathExpressions(char *source_path, str_vector_t *path_expressions, str_vector_t *resolved_paths, resolve_op_t op, int cont_instance)
+{
+    char *expr;
+    int i;
+    int err;
+    combined_role_t combined_role;
+
+    // Default to no resolved paths
+    STR_VECTOR_Init(resolved_paths);
+
+    // Exit if we cannot retrieve the role to use for this endpoint
+    err = DEVICE_CONTROLLER_GetCombinedRole(cont_instance, &combined_role);
+    if (err != USP_ERR_OK)
+    {
+        return;
     }
 
     // Form a vector list containing all the parameters to get the value of
@@ -1878,6 +2948,13 @@ void SendValueChangeNotify(subs_t *sub, char *path, char *value)
 {
     Usp__Msg *req;
 
+    // Exit if the notification is held back by the subscription's coalescing window
+    if (sub->coalesce_window != 0)
+    {
+        CoalesceValueChange(sub, path, value);
+        return;
+    }
+
     // Form the ValueChange NotifyRequest message as a protobuf structure
     req = MSG_HANDLER_CreateNotifyReq_ValueChange(path, value, sub->subscription_id, sub->notification_retry);
 
@@ -1886,6 +2963,105 @@ void SendValueChangeNotify(subs_t *sub, char *path, char *value)
     usp__msg__free_unpacked(req, pbuf_allocator);
 }
 
+/*********************************************************************//**
+**
+** CoalesceValueChange
+**
+** Holds back a value change notification until the subscription's coalescing window expires
+** If the parameter changes value again within the window, then only its latest value is notified
+**
+** \param   sub - pointer to subscription
+** \param   path - data model path of parameter which has changed value
+** \param   value - value of data model parameter (that has changed)
+**
+** \return  None
+**
+**************************************************************************/
+void CoalesceValueChange(subs_t *sub, char *path, char *value)
+{
+    bool is_replaced;
+
+    // Start the coalescing window, if this is the first value change held back
+    if (sub->coalesced_changes.num_entries == 0)
+    {
+        sub->coalesce_send_time = time(NULL) + sub->coalesce_window;
+    }
+
+    // Replace the value of the parameter, if it has already changed within this window
+    is_replaced = KV_VECTOR_ReplaceIndexed(&sub->coalesced_changes, &sub->coalesced_changes_index, path, value);
+    if (is_replaced == false)
+    {
+        KV_VECTOR_Add(&sub->coalesced_changes, path, value);
+    }
+}
+
+/*********************************************************************//**
+**
+** SendAllCoalescedValueChanges
+**
+** Sends the value change notifications held back by all subscriptions whose coalescing window has expired
+**
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void SendAllCoalescedValueChanges(time_t cur_time)
+{
+    int i;
+    subs_t *sub;
+
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->coalesced_changes.num_entries > 0) && (sub->coalesce_send_time <= cur_time))
+        {
+            SendCoalescedValueChanges(sub);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** SendCoalescedValueChanges
+**
+** Sends the value change notifications held back by the specified subscription, in the order that the parameters first changed
+**
+** \param   sub - pointer to subscription
+**
+** \return  None
+**
+**************************************************************************/
+void SendCoalescedValueChanges(subs_t *sub)
+{
+    int i;
+    kv_pair_t *pair;
+    kv_vector_t changes;
+    Usp__Msg *req;
+
+    // Exit if there are no value changes held back
+    if (sub->coalesced_changes.num_entries == 0)
+    {
+        return;
+    }
+
+    // Take ownership of the held back value changes, before sending them
+    memcpy(&changes, &sub->coalesced_changes, sizeof(changes));
+    KV_VECTOR_Init(&sub->coalesced_changes);
+    STR_SET_Destroy(&sub->coalesced_changes_index);
+
+    USP_LOG_Info("Sending %d coalesced value changes for %s.%d", changes.num_entries, device_subs_root, sub->instance);
+    for (i=0; i < changes.num_entries; i++)
+    {
+        pair = &changes.vector[i];
+        req = MSG_HANDLER_CreateNotifyReq_ValueChange(pair->key, pair->value, sub->subscription_id, sub->notification_retry);
+        SendNotify(req, sub, pair->key);
+        usp__msg__free_unpacked(req, pbuf_allocator);
+    }
+
+    KV_VECTOR_Destroy(&changes);
+}
+
 /*********************************************************************//**
 **
 ** SendBootNotify
@@ -1989,6 +3165,7 @@ void SendBootNotify(subs_t *sub)
     // Send the Notify Request
     SendNotify(req, sub, path);
     usp__msg__free_unpacked(req, pbuf_allocator);
+    DEVICE_MSG_STATS_RecordBootMilestone(kBootTime_BootEventSent);
 }
 
 /*********************************************************************//**
@@ -2057,9 +3234,9 @@ char *SerializeToJSONObject(kv_vector_t *param_values)
 
 /*********************************************************************//**
 **
-** SendOperationCompleteNotify
+** CreateOperationCompleteNotify
 **
-** Sends an operation complete notify request message
+** Creates an operation complete notify request message
 **
 ** \param   sub - pointer to subscription that caused this notify to be triggered
 ** \param   command - path to operation in the data model
@@ -2068,10 +3245,10 @@ char *SerializeToJSONObject(kv_vector_t *param_values)
 ** \param   err_msg - error message if the operation failed
 ** \param   output_args - results of the completed operation (if successful)
 **
-** \return  None
+** \return  pointer to the USP notify request message. This must be freed by the caller
 **
 **************************************************************************/
-void SendOperationCompleteNotify(subs_t *sub, char *command, char *command_key, int err_code, char *err_msg, kv_vector_t *output_args)
+Usp__Msg *CreateOperationCompleteNotify(subs_t *sub, char *command, char *command_key, int err_code, char *err_msg, kv_vector_t *output_args)
 {
     Usp__Msg *req;
 
@@ -2087,9 +3264,7 @@ void SendOperationCompleteNotify(subs_t *sub, char *command, char *command_key,
                                                               sub->subscription_id, sub->notification_retry);
     }
 
-    // Send the Notify Request
-    SendNotify(req, sub, command);
-    usp__msg__free_unpacked(req, pbuf_allocator);
+    return req;
 }
 
 /*********************************************************************//**
@@ -2125,12 +3300,14 @@ void SendNotify(Usp__Msg *req, subs_t *sub, char *path)
     }
 
     // Serialize the protobuf structure into a binary format buffer
-    pbuf_len = usp__msg__get_packed_size(req);
+    pbuf_len = PROTO_CODEC_MSG_GET_PACKED_SIZE(req);
     pbuf = USP_MALLOC(pbuf_len);
-    size = usp__msg__pack(req, pbuf);
+    size = PROTO_CODEC_MSG_PACK(req, pbuf);
     USP_ASSERT(size == pbuf_len);          // If these are not equal, then we may have had a buffer overrun, so terminate
 
     USP_LOG_Info("Sending NotifyRequest (%s for path=%s)", TEXT_UTILS_EnumToString(sub->notify_type, notify_types, NUM_ELEM(notify_types)), path);
+    mtp_reply_to.send_priority = CalcNotifySendPriority(sub, path);
+    USP_PROBE3(notify_send, sub->instance, sub->notify_type, path);
 
     // Determine the time at which we should give up retrying, or expire the message in the MTP's send queue
     retry_expiry_time = END_OF_TIME;       // default to never expire
@@ -2152,7 +3329,7 @@ void SendNotify(Usp__Msg *req, subs_t *sub, char *path)
         // NOTE: Ownership of the serialized USP message passes to the subs retry module
         msg_id = req->header->msg_id;
         SUBS_RETRY_Add(sub->instance, msg_id, sub->subscription_id, dest_endpoint, path, 
-                       pbuf, pbuf_len, retry_expiry_time);
+                       pbuf, pbuf_len, mtp_reply_to.send_priority, retry_expiry_time);
     }
     else
     {
@@ -2163,21 +3340,52 @@ void SendNotify(Usp__Msg *req, subs_t *sub, char *path)
 
 /*********************************************************************//**
 **
-** SeedLastValueChangeValues
+** CalcNotifySendPriority
 **
-** Called at bootup to seed all ValueChange subscriptions with values from before the current boot cycle
-** This function ensures that a ValueChange will fire on SoftwareVersion changing across a power cycle
-** Currently no other parameter in the data model works this way (nor is intended to).
+** Determines the priority with which a notification is sent, relative to other USP messages queued in the MTP
 **
-** \param   None
+** \param   sub - pointer to subscription that caused the notify to be triggered
+** \param   path - data model path of parameter, operation or event which we are notifying
 **
-** \return  None
+** \return  send priority of the notification
 **
 **************************************************************************/
-void SeedLastValueChangeValues(void)
+mtp_send_priority_t CalcNotifySendPriority(subs_t *sub, char *path)
 {
-    int i;
-    subs_t *sub;
+    switch(sub->notify_type)
+    {
+        case kSubNotifyType_OperationComplete:
+            return kMtpSendPriority_OperComplete;
+
+        case kSubNotifyType_ValueChange:
+            return kMtpSendPriority_ValueChange;
+
+        case kSubNotifyType_Event:
+            return (strcmp(path, periodic_event_str)==0) ? kMtpSendPriority_Periodic : kMtpSendPriority_Event;
+
+        default:
+            return kMtpSendPriority_Event;
+    }
+}
+
+/*********************************************************************//**
+**
+** SeedLastValueChangeValues
+**
+** Called at bootup to seed all ValueChange subscriptions with values from before the current boot cycle
+** This function ensures that a ValueChange will fire on SoftwareVersion changing across a power cycle
+** Currently no other parameter in the data model works this way (nor is intended to).
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void SeedLastValueChangeValues(void)
+{
+    int i;
+    int index;
+    subs_t *sub;
     reboot_info_t info;
 
     // Get the last software version
@@ -2190,40 +3398,56 @@ void SeedLastValueChangeValues(void)
         sub = &subscriptions.vector[i];
         if ((sub->enable) && (sub->notify_type == kSubNotifyType_ValueChange))
         {
-            KV_VECTOR_Replace(&sub->last_values, "Device.DeviceInfo.SoftwareVersion", info.last_software_version);
+            index = FindValueDigest(&sub->last_values, "Device.DeviceInfo.SoftwareVersion", 0);
+            if (index != INVALID)
+            {
+                CalcValueDigest(info.last_software_version, &sub->last_values.vector[index]);
+            }
         }
     }
 }
 
 /*********************************************************************//**
 **
-** DoesSubscriptionSendNotification
+** MatchEventSubscriptions
 **
-** Determines whether the specified subscription matches the specified operation/event
+** Determines all enabled subscriptions of the specified type which match the specified operation/event
 **
-** \param   sub - pointer to subscription to match
 ** \param   event_name - path of operation/event in the data model that has occurred
+** \param   notify_type - type of subscriptions to match (kSubNotifyType_Event or kSubNotifyType_OperationComplete)
+** \param   matches - pointer to vector in which to return the indexes (in the subscriptions vector) of the matching subscriptions
+**                    NOTE: The indexes are returned in ascending order, and the vector must be destroyed by the caller
 **
-** \return  true if the specified subscription
+** \return  None
 **
 **************************************************************************/
-bool DoesSubscriptionSendNotification(subs_t *sub, char *event_name)
+void MatchEventSubscriptions(char *event_name, subs_notify_t notify_type, int_vector_t *matches)
 {
-    bool send_notification;
+    int i;
+    int sub_index;
+    subs_t *sub;
 
-    if (STR_VECTOR_Find(&sub->path_expressions, "Device.") == INVALID)
+    // Determine the subscriptions whose indexed path expressions match this operation/event
+    INT_VECTOR_Init(matches);
+    MatchSubscriptionIndex(&event_index, event_name, notify_type, matches);
+
+    // Add the subscriptions whose unindexed path expressions resolve to this operation/event
+    for (i=0; i < event_index.unindexed_subs.num_entries; i++)
     {
-        // Normal case (not a subscription on "Device.") - Resolve the subscription path and see if any of the resolved paths match
-        send_notification = DoesSubscriptionMatchEvent(sub, event_name);
+        sub_index = event_index.unindexed_subs.vector[i];
+        sub = &subscriptions.vector[sub_index];
+        if ((sub->notify_type == notify_type) && (INT_VECTOR_Find(matches, sub_index) == INVALID) &&
+            (DoesSubscriptionMatchEvent(sub, event_name)))
+        {
+            INT_VECTOR_Add(matches, sub_index);
+        }
     }
-    else
+
+    // Ensure that notifications are sent in the order of the subscriptions vector
+    if (matches->num_entries > 1)
     {
-        // If the subscription is for 'Device.' then the subscription will fire if
-        // the controller has permissions for the specified event
-        send_notification = HasControllerGotEventPermission(sub->cont_instance, event_name);
+        qsort(matches->vector, matches->num_entries, sizeof(int), CompareSubsIndex);
     }
-
-    return send_notification;
 }
 
 /*********************************************************************//**
@@ -2231,8 +3455,10 @@ bool DoesSubscriptionSendNotification(subs_t *sub, char *event_name)
 ** DoesSubscriptionMatchEvent
 **
 ** Determines whether the specified subscription is for the specified operation/event
-** by forming a list of all data model paths that the subscription identifies
-** and seeing if the specified path exists in this list
+** by resolving all data model paths that the subscription's unindexed path expressions identify
+** and seeing if the specified path is one of them
+** NOTE: The resolved paths are compared against the event as they are resolved, rather than being collected into a list
+** NOTE: Indexed path expressions are matched by MatchSubscriptionIndex() instead
 **
 ** \param   sub - pointer to subscription to match
 ** \param   event_name - path of operation/event in the data model that has occurred
@@ -2243,23 +3469,47 @@ bool DoesSubscriptionSendNotification(subs_t *sub, char *event_name)
 bool DoesSubscriptionMatchEvent(subs_t *sub, char *event_name)
 {
     resolve_op_t op;
-    str_vector_t resolved_paths;
-    int index;
+    event_match_t em;
+    combined_role_t combined_role;
+    char *expr;
+    int i;
+    int err;
 
     // Determine the operation to be resolved by the path resolver
     USP_ASSERT((sub->notify_type == kSubNotifyType_OperationComplete) || (sub->notify_type == kSubNotifyType_Event));
     op = (sub->notify_type == kSubNotifyType_Event) ? kResolveOp_SubsEvent : kResolveOp_SubsOper;
 
-    // Resolve a list of paths that the subscription references
-    // NOTE: Resolution excludes paths for which the controller does not have permission to be notified of events
-    ResolveAllPathExpressions(DEVICE_SUBS_ROOT, &sub->path_expressions, &resolved_paths, op, sub->cont_instance);
+    // Exit if we cannot retrieve the role to use for this endpoint
+    err = DEVICE_CONTROLLER_GetCombinedRole(sub->cont_instance, &combined_role);
+    if (err != USP_ERR_OK)
+    {
+        return false;
+    }
 
-    // Exit if the specified path is present in the subscription
-    index = STR_VECTOR_Find(&resolved_paths, event_name);
-    STR_VECTOR_Destroy(&resolved_paths);
-    if (index != INVALID)
+    // Iterate over all paths that the subscription references, exiting if the specified path is one of them
+    // NOTE: Resolution excludes paths for which the controller does not have permission to be notified of events
+    em.event_name = event_name;
+    em.is_match = false;
+    for (i=0; i < sub->path_expressions.num_entries; i++)
     {
-        return true;
+        // Skip path expressions which are matched using the index
+        expr = sub->path_expressions.vector[i];
+        if (IsPathExpressionIndexable(expr))
+        {
+            continue;
+        }
+
+        err = PATH_RESOLVER_ResolveDevicePathWithCallback(expr, MatchResolvedEvent, &em, op, &combined_role, 0);
+        if (err != USP_ERR_OK)
+        {
+            // NOTE: Just logging the error, but ignoring it. It should not have occured (should have been caught by Validate_SubsRefList call)
+            USP_LOG_Warning("%s: Path expression (%s) contained in %s is invalid", __FUNCTION__, expr, DEVICE_SUBS_ROOT);
+        }
+
+        if (em.is_match)
+        {
+            return true;
+        }
     }
 
     // If the code gets here, then the subscription did not match
@@ -2268,42 +3518,769 @@ bool DoesSubscriptionMatchEvent(subs_t *sub, char *event_name)
 
 /*********************************************************************//**
 **
-** HasControllerGotEventPermission
+** MatchResolvedEvent
 **
-** Determines whether the specified controller has permission to send notification
-** events for the specified operation/event
+** Called by the path resolver for each operation/event resolved from a subscription's ReferenceList
+** Determines whether the resolved path is that of the operation/event which has occurred
 **
-** \param   sub - pointer to subscription to match
-** \param   event_name - path of operation/event in the data model that has occurred
+** \param   path - full data model path of the resolved operation/event
+** \param   node - unused
+** \param   inst - unused
+** \param   separator_split - unused
+** \param   cb_arg - pointer to structure containing the operation/event which has occurred, and in which to return whether it matched
 **
-** \return  true if the specified subscription
+** \return  USP_ERR_OK always
+**
+**************************************************************************/
+int MatchResolvedEvent(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg)
+{
+    event_match_t *em = (event_match_t *) cb_arg;
+
+    if (strcmp(path, em->event_name)==0)
+    {
+        em->is_match = true;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** IsAnyValueChangeSubscriptionEnabled
+**
+** Determines whether any value change subscriptions are currently enabled
+**
+** \param   None
+**
+** \return  true if at least one value change subscription is enabled
+**
+**************************************************************************/
+bool IsAnyValueChangeSubscriptionEnabled(void)
+{
+    int i;
+    subs_t *sub;
+
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->enable) && (sub->notify_type == kSubNotifyType_ValueChange))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** InvalidateValueChangeIndex
+**
+** Marks the index of parameters referenced by value change subscriptions as out of date
+** This must be called whenever the subscriptions vector, or the last_values vector of any subscription is modified
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void InvalidateValueChangeIndex(void)
+{
+    is_vc_index_stale = true;
+}
+
+/*********************************************************************//**
+**
+** RebuildValueChangeIndex
+**
+** Rebuilds the index of parameters referenced by enabled value change subscriptions
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void RebuildValueChangeIndex(void)
+{
+    int i, j;
+    int count;
+    int new_size;
+    unsigned mask;
+    unsigned index;
+    subs_t *sub;
+    vc_index_entry_t *entry;
+
+    // Count the number of entries that the index will hold
+    count = 0;
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->enable) && (sub->notify_type == kSubNotifyType_ValueChange))
+        {
+            count += sub->last_values.num_entries;
+        }
+    }
+
+    // Size the table so that it is at most half full
+    new_size = VC_INDEX_MIN_SIZE;
+    while (new_size < 2*count)
+    {
+        new_size *= 2;
+    }
+
+    // (Re)allocate the table, if its size has changed
+    if (new_size != vc_index_size)
+    {
+        USP_SAFE_FREE(vc_index);
+        vc_index = USP_MALLOC(new_size*sizeof(vc_index_entry_t));
+        vc_index_size = new_size;
+    }
+    memset(vc_index, 0, vc_index_size*sizeof(vc_index_entry_t));
+
+    // Add all parameters referenced by each enabled value change subscription
+    mask = vc_index_size - 1;
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->enable) && (sub->notify_type == kSubNotifyType_ValueChange))
+        {
+            for (j=0; j < sub->last_values.num_entries; j++)
+            {
+                // Find a free slot in the table (using linear probing)
+                index = ((unsigned)TEXT_UTILS_CalcHash(sub->last_values.vector[j].path)) & mask;
+                while (vc_index[index].path != NULL)
+                {
+                    index = (index + 1) & mask;
+                }
+
+                entry = &vc_index[index];
+                entry->path = sub->last_values.vector[j].path;
+                entry->path_hash = TEXT_UTILS_CalcHash(entry->path);
+                entry->sub_index = i;
+                entry->param_index = j;
+            }
+        }
+    }
+
+    is_vc_index_stale = false;
+}
+
+/*********************************************************************//**
+**
+** IsParamInValueChangeIndex
+**
+** Determines whether the specified parameter is referenced by any enabled value change subscription
+** NOTE: The caller must ensure that the index is not stale before calling this function
+**
+** \param   path - path of the parameter to look up
+** \param   path_hash - hash of the path of the parameter
+**
+** \return  true if the parameter is referenced by at least one value change subscription
+**
+**************************************************************************/
+bool IsParamInValueChangeIndex(char *path, int path_hash)
+{
+    unsigned mask;
+    unsigned index;
+    vc_index_entry_t *entry;
+
+    // Exit if the index has not been allocated
+    if (vc_index == NULL)
+    {
+        return false;
+    }
+
+    mask = vc_index_size - 1;
+    index = ((unsigned)path_hash) & mask;
+    entry = &vc_index[index];
+    while (entry->path != NULL)
+    {
+        if ((entry->path_hash == path_hash) && (strcmp(entry->path, path)==0))
+        {
+            return true;
+        }
+
+        index = (index + 1) & mask;
+        entry = &vc_index[index];
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** InvalidateSubscriptionIndexes
+**
+** Marks the indexes of path expressions referenced by subscriptions as out of date
+** This must be called whenever the subscriptions vector, or the Enable, ReferenceList or NotifType of any subscription is modified
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void InvalidateSubscriptionIndexes(void)
+{
+    ole_index.is_stale = true;
+    event_index.is_stale = true;
+}
+
+/*********************************************************************//**
+**
+** RebuildSubscriptionIndex
+**
+** Rebuilds the index of path expressions referenced by the enabled subscriptions of the types held in the specified index
+** and the lists of those subscriptions which cannot be matched using the index
+**
+** \param   index - pointer to index to rebuild
+**
+** \return  None
+**
+**************************************************************************/
+void RebuildSubscriptionIndex(subs_index_t *index)
+{
+    int i, j;
+    int count;
+    int new_size;
+    unsigned mask;
+    unsigned slot;
+    subs_t *sub;
+    char *expr;
+    bool is_unindexed;
+    subs_index_entry_t entry;
+
+    // Count the maximum number of entries that the index will hold
+    count = 0;
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->enable) && ((sub->notify_type == index->notify_types[0]) || (sub->notify_type == index->notify_types[1])))
+        {
+            count += sub->path_expressions.num_entries;
+        }
+    }
+
+    // Size the table so that it is at most half full
+    new_size = SUBS_INDEX_MIN_SIZE;
+    while (new_size < 2*count)
+    {
+        new_size *= 2;
+    }
+
+    // (Re)allocate the table, if its size has changed
+    if (new_size != index->size)
+    {
+        USP_SAFE_FREE(index->table);
+        index->table = USP_MALLOC(new_size*sizeof(subs_index_entry_t));
+        index->size = new_size;
+    }
+    memset(index->table, 0, index->size*sizeof(subs_index_entry_t));
+    INT_VECTOR_Destroy(&index->unindexed_subs);
+    INT_VECTOR_Destroy(&index->device_subs);
+
+    // Add all path expressions referenced by each enabled subscription of the types held in this index
+    mask = index->size - 1;
+    for (i=0; i < subscriptions.num_entries; i++)
+    {
+        sub = &subscriptions.vector[i];
+        if ((sub->enable == false) || ((sub->notify_type != index->notify_types[0]) && (sub->notify_type != index->notify_types[1])))
+        {
+            continue;
+        }
+
+        // Operation/Event subscriptions on 'Device.' match all operations/events that the controller has permission for
+        // so their other path expressions need not be considered
+        if (((sub->notify_type == kSubNotifyType_Event) || (sub->notify_type == kSubNotifyType_OperationComplete)) &&
+            (STR_VECTOR_Find(&sub->path_expressions, "Device.") != INVALID))
+        {
+            INT_VECTOR_Add(&index->device_subs, i);
+            continue;
+        }
+
+        is_unindexed = false;
+        for (j=0; j < sub->path_expressions.num_entries; j++)
+        {
+            // Skip path expressions which must be resolved
+            expr = sub->path_expressions.vector[j];
+            if (IsPathExpressionIndexable(expr) == false)
+            {
+                is_unindexed = true;
+                continue;
+            }
+
+            // Skip path expressions which do not reference a node of the right type for the subscription
+            // NOTE: Just logging the error, but ignoring it. It should not have occured (should have been caught by Validate_SubsRefList call)
+            if (CompileSubscriptionPath(expr, sub->notify_type, &entry) == false)
+            {
+                USP_LOG_Warning("%s: Path expression (%s) contained in %s.%d is invalid", __FUNCTION__, expr, device_subs_root, sub->instance);
+                continue;
+            }
+
+            // Find a free slot in the table (using linear probing)
+            slot = CalcSubscriptionIndexSlot(entry.node, mask);
+            while (index->table[slot].node != NULL)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            entry.sub_index = i;
+            memcpy(&index->table[slot], &entry, sizeof(entry));
+        }
+
+        if (is_unindexed)
+        {
+            INT_VECTOR_Add(&index->unindexed_subs, i);
+        }
+    }
+
+    index->is_stale = false;
+}
+
+/*********************************************************************//**
+**
+** DestroySubscriptionIndex
+**
+** Frees all memory used by the specified index
+**
+** \param   index - pointer to index to destroy
+**
+** \return  None
+**
+**************************************************************************/
+void DestroySubscriptionIndex(subs_index_t *index)
+{
+    USP_SAFE_FREE(index->table);
+    index->size = 0;
+    index->is_stale = true;
+    INT_VECTOR_Destroy(&index->unindexed_subs);
+    INT_VECTOR_Destroy(&index->device_subs);
+}
+
+/*********************************************************************//**
+**
+** MatchSubscriptionIndex
+**
+** Determines the subscriptions of the specified type whose indexed path expressions match the specified path,
+** and whose recipient controller has permission to be notified of it
+** Path expressions for object life events must reference the object itself, whilst path expressions for
+** operations/events may also be partial paths referencing any object containing the operation/event
+** NOTE: Subscriptions containing path expressions which are not indexed must be matched separately by the caller
+**
+** \param   index - pointer to index to search
+** \param   path - path of the object instance or operation/event which has occurred
+** \param   notify_type - type of subscriptions to match
+** \param   matches - pointer to vector in which to add the indexes (in the subscriptions vector) of the matching subscriptions
+**
+** \return  None
+**
+**************************************************************************/
+void MatchSubscriptionIndex(subs_index_t *index, char *path, subs_notify_t notify_type, int_vector_t *matches)
+{
+    int i, j;
+    char buf[MAX_DM_PATH];
+    char *segment;
+    char *saveptr;
+    dm_node_t *node;
+    dm_node_t *nodes[MAX_PATH_SEGMENTS];
+    int num_nodes;
+    int first_node;
+    dm_instances_t inst;
+    bool is_qualified_instance;
+    bool is_match;
+    unsigned short required_permission;
+    unsigned mask;
+    unsigned slot;
+    subs_index_entry_t *entry;
+    subs_t *sub;
+
+    // Ensure that the index is up to date
+    if (index->is_stale)
+    {
+        RebuildSubscriptionIndex(index);
+    }
+
+    // Exit if the path does not start from the root of the data model
+    USP_STRNCPY(buf, path, sizeof(buf));
+    segment = strtok_r(buf, ".", &saveptr);
+    if ((segment == NULL) || (strcmp(segment, "Device") != 0))
+    {
+        return;
+    }
+    node = DM_PRIV_GetNodeFromPath(segment, &inst, &is_qualified_instance);
+    if (node == NULL)
+    {
+        return;
+    }
+
+    // Walk the schema from the root of the data model to the node of the path, noting the nodes along the way
+    num_nodes = 0;
+    nodes[num_nodes++] = node;
+    segment = strtok_r(NULL, ".", &saveptr);
+    while (segment != NULL)
+    {
+        if (IS_NUMERIC(*segment))
+        {
+            // Exit if there are too many instance numbers in the path
+            if (inst.order == MAX_DM_INSTANCE_ORDER)
+            {
+                return;
+            }
+            inst.instances[inst.order] = atoi(segment);
+            inst.order++;
+        }
+        else
+        {
+            // Exit if the path is not present in the schema
+            node = DM_PRIV_FindMatchingChild(node, segment);
+            if ((node == NULL) || (num_nodes == MAX_PATH_SEGMENTS))
+            {
+                return;
+            }
+            nodes[num_nodes++] = node;
+        }
+
+        segment = strtok_r(NULL, ".", &saveptr);
+    }
+
+    // Exit if the path does not have the right number of instance numbers
+    if (inst.order != node->order)
+    {
+        return;
+    }
+
+    if (inst.order > 0)
+    {
+        memcpy(inst.nodes, node->instance_nodes, (inst.order)*sizeof(dm_node_t *));
+    }
+
+    // Exit if the path is not of the type expected for the subscription, determining the permission required to be notified of it
+    switch(notify_type)
+    {
+        case kSubNotifyType_ObjectCreation:
+            required_permission = PERMIT_SUBS_OBJ_ADD;
+            is_match = (node->type == kDMNodeType_Object_MultiInstance);
+            break;
+
+        case kSubNotifyType_ObjectDeletion:
+            required_permission = PERMIT_SUBS_OBJ_DEL;
+            is_match = (node->type == kDMNodeType_Object_MultiInstance);
+            break;
+
+        case kSubNotifyType_Event:
+            required_permission = PERMIT_SUBS_EVT_OPER_COMP;
+            is_match = (node->type == kDMNodeType_Event);
+            break;
+
+        case kSubNotifyType_OperationComplete:
+            required_permission = PERMIT_SUBS_EVT_OPER_COMP;
+            is_match = (node->type == kDMNodeType_AsyncOperation);
+            break;
+
+        default:
+            TERMINATE_BAD_CASE(notify_type);
+            return;
+    }
+
+    if (is_match == false)
+    {
+        return;
+    }
+
+    // Subscriptions on 'Device.' match all operations/events that the controller has permission for
+    for (i=0; i < index->device_subs.num_entries; i++)
+    {
+        sub = &subscriptions.vector[ index->device_subs.vector[i] ];
+        if ((sub->notify_type == notify_type) && (IsSubscriptionPermitted(sub, node, required_permission)))
+        {
+            INT_VECTOR_Add(matches, index->device_subs.vector[i]);
+        }
+    }
+
+    // Exit if the instances in the path do not exist (unless the object has just been deleted)
+    // NOTE: This matches the behaviour of the path resolver, which only resolves to object instances which exist
+    if ((notify_type != kSubNotifyType_ObjectDeletion) && (DM_INST_VECTOR_IsExist(&inst) == false))
+    {
+        return;
+    }
+
+    // Iterate over the nodes in the path, matching the path expressions which reference each of them
+    // NOTE: Only the last node is considered for object life events, as their path expressions must reference the object itself
+    first_node = ((notify_type == kSubNotifyType_ObjectCreation) || (notify_type == kSubNotifyType_ObjectDeletion)) ? num_nodes-1 : 0;
+    mask = index->size - 1;
+    for (i=first_node; i < num_nodes; i++)
+    {
+        slot = CalcSubscriptionIndexSlot(nodes[i], mask);
+        entry = &index->table[slot];
+        while (entry->node != NULL)
+        {
+            sub = &subscriptions.vector[entry->sub_index];
+            if ((entry->node == nodes[i]) && (sub->notify_type == notify_type) && (INT_VECTOR_Find(matches, entry->sub_index) == INVALID))
+            {
+                // Determine whether the instance numbers in the path expression match those in the path
+                // NOTE: If the path expression references a multi-instance object unqualified, then it matches all instances of that object
+                is_match = true;
+                for (j=0; j < entry->order; j++)
+                {
+                    if ((entry->instances[j] != SUBS_INDEX_ANY_INSTANCE) && (entry->instances[j] != inst.instances[j]))
+                    {
+                        is_match = false;
+                        break;
+                    }
+                }
+
+                if ((is_match) && (IsSubscriptionPermitted(sub, node, required_permission)))
+                {
+                    INT_VECTOR_Add(matches, entry->sub_index);
+                }
+            }
+
+            slot = (slot + 1) & mask;
+            entry = &index->table[slot];
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** IsSubscriptionPermitted
+**
+** Determines whether the recipient controller of the specified subscription has the specified permission on a node
+** NOTE: The permissions of each combined role are cached in the node, so this does not require any path resolution
+**
+** \param   sub - pointer to subscription
+** \param   node - pointer to node in the data model that the controller is to be notified of
+** \param   required_permission - permission bit required for the notification
+**
+** \return  true if the controller has permission to be notified
 **
 **************************************************************************/
-bool HasControllerGotEventPermission(int cont_instance, char *event_name)
+bool IsSubscriptionPermitted(subs_t *sub, dm_node_t *node, unsigned short required_permission)
 {
     combined_role_t combined_role;
-    unsigned short perm;
+    unsigned short permission_bitmask;
     int err;
 
     // Exit if unable to determine role used by the controller that set this subscription
     // NOTE: This could occur if the controller doesn't exist in the controller table anymore
-    err = DEVICE_CONTROLLER_GetCombinedRole(cont_instance, &combined_role);
+    err = DEVICE_CONTROLLER_GetCombinedRole(sub->cont_instance, &combined_role);
     if (err != USP_ERR_OK)
     {
         return false;
     }
-    
-    // Determine permissions that this controller has for the operation that occurred
-    // NOTE: Ignoring error messgae. If the event is not present in the data model, then the controller will not have permissions anyway
-    DATA_MODEL_GetPermissions(event_name, &combined_role, &perm);
 
-    // Exit if controller has permission for this notification
-    if (perm & PERMIT_SUBS_EVT_OPER_COMP)
+    permission_bitmask = DM_PRIV_GetPermissions(node, &combined_role);
+    return (permission_bitmask & required_permission) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** CouldObjectDeletionMatch
+**
+** Determines whether deleting the specified object instance (and hence all of its children) could match
+** any of the path expressions of the specified subscription which are not in the object life event index
+** This compares the path of the object against the literal part of each path expression before its first wildcard or search expression
+** NOTE: This function may return true, even though the path expression does not match any of the objects being deleted
+**
+** \param   sub - pointer to subscription
+** \param   obj_path - path of the object instance about to be deleted
+**
+** \return  true if the deletion could match the subscription
+**
+**************************************************************************/
+bool CouldObjectDeletionMatch(subs_t *sub, char *obj_path)
+{
+    int i;
+    char *expr;
+    int prefix_len;
+    int obj_len;
+
+    obj_len = strlen(obj_path);
+    for (i=0; i < sub->path_expressions.num_entries; i++)
     {
-        return true;
+        // Skip path expressions which are matched using the index
+        expr = sub->path_expressions.vector[i];
+        if (IsPathExpressionIndexable(expr))
+        {
+            continue;
+        }
+
+        // Path expressions containing reference following could match objects anywhere in the data model
+        if (strchr(expr, '+') != NULL)
+        {
+            return true;
+        }
+
+        // Skip path expressions whose literal prefix diverges from the path of the object
+        prefix_len = strcspn(expr, "*[#");
+        if (strncmp(expr, obj_path, MIN(prefix_len, obj_len)) != 0)
+        {
+            continue;
+        }
+
+        // The path expression could match, if the object is within the literal prefix,
+        // or the literal prefix is within the object (ie it is not just a longer instance number, eg 'Host.12' vs 'Host.1')
+        if ((prefix_len <= obj_len) || (expr[obj_len] == '.'))
+        {
+            return true;
+        }
     }
 
-    // If the code gets here, then the controller did not have permission for the event
     return false;
 }
 
+/*********************************************************************//**
+**
+** IsPathExpressionIndexable
+**
+** Determines whether the specified subscription path expression can be matched using an index
+** Path expressions containing search expressions (or unique keys) and reference following cannot be indexed,
+** because the paths that they match depend on the values of parameters at the time of the notification
+**
+** \param   expr - path expression to test
+**
+** \return  true if the path expression only contains instance numbers and wildcards
+**
+**************************************************************************/
+bool IsPathExpressionIndexable(char *expr)
+{
+    return (strpbrk(expr, "[+#") == NULL) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** CompileSubscriptionPath
+**
+** Converts a path expression containing only instance numbers and wildcards into an index entry
+** e.g. 'Device.LocalAgent.Controller.*.BootParameter.' references the 'Device.LocalAgent.Controller.{i}.BootParameter.{i}'
+** node, with the controller's instance number matching any instance, and (being unqualified) any BootParameter instance
+**
+** \param   expr - path expression to compile
+** \param   notify_type - type of subscription containing the path expression
+** \param   entry - pointer to index entry in which to return the compiled path expression (excluding the sub_index)
+**
+** \return  true if the path expression references a node of the right type for the subscription
+**
+**************************************************************************/
+bool CompileSubscriptionPath(char *expr, subs_notify_t notify_type, subs_index_entry_t *entry)
+{
+    char buf[MAX_DM_PATH];
+    char *segment;
+    char *saveptr;
+    dm_node_t *node;
+    dm_instances_t inst;
+    bool is_qualified_instance;
+    bool is_instance_expected;
+    bool is_partial_path;
+    int len;
+
+    memset(entry, 0, sizeof(subs_index_entry_t));
+    USP_STRNCPY(buf, expr, sizeof(buf));
+    len = strlen(expr);
+    is_partial_path = ((len > 0) && (expr[len-1] == '.')) ? true : false;
+
+    // Exit if the path expression does not start from the root of the data model
+    segment = strtok_r(buf, ".", &saveptr);
+    if ((segment == NULL) || (strcmp(segment, "Device") != 0))
+    {
+        return false;
+    }
+    node = DM_PRIV_GetNodeFromPath(segment, &inst, &is_qualified_instance);
+    if (node == NULL)
+    {
+        return false;
+    }
+
+    // Iterate over the remaining path segments, walking the schema
+    is_instance_expected = false;
+    segment = strtok_r(NULL, ".", &saveptr);
+    while (segment != NULL)
+    {
+        if ((IS_NUMERIC(*segment)) || (strcmp(segment, "*")==0))
+        {
+            // Exit if an instance number does not follow a multi-instance object
+            if (is_instance_expected == false)
+            {
+                return false;
+            }
+
+            entry->instances[entry->order] = (*segment == '*') ? SUBS_INDEX_ANY_INSTANCE : atoi(segment);
+            entry->order++;
+            is_instance_expected = false;
+        }
+        else
+        {
+            // Exit if the instance number of a multi-instance object has been omitted, or the child node does not exist
+            if (is_instance_expected)
+            {
+                return false;
+            }
+
+            node = DM_PRIV_FindMatchingChild(node, segment);
+            if (node == NULL)
+            {
+                return false;
+            }
+            is_instance_expected = (node->type == kDMNodeType_Object_MultiInstance) ? true : false;
+        }
+
+        segment = strtok_r(NULL, ".", &saveptr);
+    }
+
+    // Exit if the path expression does not reference a node of the right type for the subscription
+    switch(notify_type)
+    {
+        case kSubNotifyType_ObjectCreation:
+        case kSubNotifyType_ObjectDeletion:
+            // Object life event subscriptions must reference a multi-instance object
+            if (node->type != kDMNodeType_Object_MultiInstance)
+            {
+                return false;
+            }
+            break;
+
+        case kSubNotifyType_Event:
+        case kSubNotifyType_OperationComplete:
+            // Operation/Event subscriptions must reference either an object containing the operation/event (using a partial path)
+            // or the operation/event itself
+            if (is_partial_path)
+            {
+                if (IsObject(node) == false)
+                {
+                    return false;
+                }
+            }
+            else if (node->type != ((notify_type == kSubNotifyType_Event) ? kDMNodeType_Event : kDMNodeType_AsyncOperation))
+            {
+                return false;
+            }
+            break;
+
+        default:
+            return false;
+            break;
+    }
+
+    entry->node = node;
+    return true;
+}
+
+/*********************************************************************//**
+**
+** CalcSubscriptionIndexSlot
+**
+** Calculates the slot in an index at which to start probing for the specified schema node
+**
+** \param   node - pointer to schema node
+** \param   mask - mask to apply to the hash to obtain a slot in the table (size of the table - 1)
+**
+** \return  slot in the index
+**
+**************************************************************************/
+unsigned CalcSubscriptionIndexSlot(dm_node_t *node, unsigned mask)
+{
+    unsigned hash;
+
+    // Fibonacci hash of the node's address, discarding the low order bits (which are always zero due to alignment)
+    hash = ((unsigned)(((uintptr_t)node) >> 3)) * 2654435761u;
+    return (hash ^ (hash >> 16)) & mask;
+}
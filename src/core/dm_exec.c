@@ -41,6 +41,8 @@
 
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <errno.h>
 
 #include "common_defs.h"
@@ -51,6 +53,7 @@
 #include "cli.h"
 #include "data_model.h"
 #include "dm_access.h"
+#include "dm_inst_vector.h"
 #include "device.h"
 #include "msg_handler.h"
 #include "os_utils.h"
@@ -58,18 +61,14 @@
 #include "dm_trans.h"
 #include "nu_ipaddr.h"
 #include "stomp.h"
+#include "uptime.h"
+#include "notify_spool.h"
+#include "replay.h"
 
 #ifdef ENABLE_COAP
 #include "usp_coap.h"
 #endif
 
-//------------------------------------------------------------------------------
-// Unix domain socket pair used to implement a message queue
-// One socket is always used for sending, and the other always used for receiving
-static int dm_mq_sockets[2] = {-1, -1};
-
-#define mq_rx_socket  dm_mq_sockets[0]
-#define mq_tx_socket  dm_mq_sockets[1]
 
 //-------------------------------------------------------------------------
 // Type of message on data model's message queue
@@ -80,6 +79,10 @@ typedef enum
     kDmExecMsg_EventComplete,      // Sent from a thread to signal that an event has occurred
     kDmExecMsg_ObjAdded,           // Sent from a thread to signal that an object has been added by the vendor
     kDmExecMsg_ObjDeleted,         // Sent from a thread to signal that an object has been deleted by the vendor
+    kDmExecMsg_ObjsAdded,          // Sent from a thread to signal that a batch of objects have been added by the vendor
+    kDmExecMsg_ObjsDeleted,        // Sent from a thread to signal that a batch of objects have been deleted by the vendor
+    kDmExecMsg_ValueChanged,       // Sent from a thread to signal that the value of a parameter has been changed by the vendor
+    kDmExecMsg_GetValueComplete,   // Sent from a thread to return the value of a parameter requested by an asynchronous vendor get callback
     kDmExecMsg_ProcessUspRecord,   // Sent from the MTP thread with a USP Record to process
     kDmExecMsg_StompHandshakeComplete, // Sent from the MTP thread to notify the controller trust role to use for all controllers connected to the specified stomp connection
     kDmExecMsg_MtpThreadExited,    // Sent to signal that the MTP thread has exited as requested by a scheduled exit
@@ -148,6 +151,33 @@ typedef struct
     char *path;
 } obj_deleted_msg_t;
 
+// Batch of objects added parameters in data model message
+typedef struct
+{
+    str_vector_t paths;
+} objs_added_msg_t;
+
+// Batch of objects deleted parameters in data model message
+typedef struct
+{
+    str_vector_t paths;
+} objs_deleted_msg_t;
+
+// Value changed parameters in data model message
+typedef struct
+{
+    char *path;
+    char *value;
+} value_changed_msg_t;
+
+// Asynchronous get complete parameters in data model message
+typedef struct
+{
+    int request_id;
+    int err_code;
+    char *value;
+} get_value_complete_msg_t;
+
 // Management IP address changed parameters in data model message
 typedef struct
 {
@@ -180,6 +210,10 @@ typedef struct
         activate_permission_msg_t activate_permission;
         obj_added_msg_t obj_added;
         obj_deleted_msg_t obj_deleted;
+        objs_added_msg_t objs_added;
+        objs_deleted_msg_t objs_deleted;
+        value_changed_msg_t value_changed;
+        get_value_complete_msg_t get_value_complete;
         process_usp_record_msg_t usp_record;
         stomp_complete_msg_t stomp_complete;
         mgmt_ip_addr_msg_t mgmt_ip_addr;
@@ -189,6 +223,28 @@ typedef struct
     
 } dm_exec_msg_t;
 
+//------------------------------------------------------------------------------
+// Node on the data model's message queue
+typedef struct dm_mq_node_s
+{
+    struct dm_mq_node_s *next;  // Next (newer) node in the queue, or NULL if this is currently the last node
+    dm_exec_msg_t msg;
+} dm_mq_node_t;
+
+//------------------------------------------------------------------------------
+// Lock-free multi-producer single-consumer message queue (intrusive linked list with a stub node)
+// Any thread may push onto the tail of the queue, but only the data model thread pops from the head
+// Producers never block, so an MTP thread posting a USP record cannot stall whilst holding its own mutex
+static dm_mq_node_t dm_mq_stub = { NULL };
+static dm_mq_node_t *dm_mq_head = &dm_mq_stub;          // Only accessed by the data model thread
+static dm_mq_node_t *dm_mq_tail = &dm_mq_stub;          // Atomically exchanged by producers
+
+//------------------------------------------------------------------------------
+// eventfd used to wake up the data model thread when messages are posted on the queue
+// and a flag (set by producers, cleared by the data model thread) used to avoid writing to the eventfd for every message
+static int dm_mq_eventfd = -1;
+static bool dm_mq_wakeup_pending = false;
+
 //------------------------------------------------------------------------------------
 // Mutex used to protect access to this component
 // This mutex is only really necessary for an orderly shutdown, to ensure the thread isn't doing anything when we free it's memory
@@ -198,11 +254,37 @@ static pthread_mutex_t dm_access_mutex;
 // Bitmask of MTP threads that have exited. Used to only shutdown the datamodel when all MTP threads have exited
 unsigned cumulative_mtp_threads_exited = 0;
 
+#if NUM_GET_WORKER_THREADS > 0
+//------------------------------------------------------------------------------
+// Queue of read-only USP records (Get, GetInstances, GetSupportedDM, GetSupportedProtocol) waiting to be processed by the Get worker threads
+// The data model thread waits until all outstanding read-only USP records have been processed (see DM_EXEC_WaitForGetWorkers)
+// before performing any processing which may modify the data model. Hence the Get worker threads may read the
+// data model concurrently with each other, without any further locking
+typedef struct get_job_tag
+{
+    struct get_job_tag *next;
+    process_usp_record_msg_t usp_record;
+} get_job_t;
+
+static pthread_mutex_t get_job_mutex;
+static pthread_cond_t get_job_available_cond;   // Signalled when a USP record has been added to the queue
+static pthread_cond_t get_jobs_complete_cond;   // Signalled when all outstanding USP records have been processed
+static get_job_t *get_job_head = NULL;
+static get_job_t *get_job_tail = NULL;
+static int num_outstanding_get_jobs = 0;        // Number of USP records either on the queue, or being processed by a Get worker thread
+#endif
+
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void UpdateSockSet(socket_set_t *set);
 void ProcessSocketActivity(socket_set_t *set);
 void ProcessMessageQueueSocketActivity(socket_set_t *set);
+void PostDmExecMsg(dm_exec_msg_t *msg);
+void PushDmExecQueue(dm_mq_node_t *node);
+dm_mq_node_t *PopDmExecQueue(void);
+void HandleDmExecMessage(dm_exec_msg_t *msg);
+void HandleUspRecordMsg(process_usp_record_msg_t *pur);
+bool DispatchToGetWorker(process_usp_record_msg_t *pur);
 void HandleScheduledExit(void);
 void ProcessBinaryUspRecord(unsigned char *pbuf, int pbuf_len, ctrust_role_t role, char *allowed_controllers, mtp_reply_to_t *mrt);
 
@@ -221,11 +303,11 @@ int DM_EXEC_Init(void)
 {
     int err;
 
-    // Exit if unable to initialize the unix domain socket pair used to implement a message queue
-    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, dm_mq_sockets);
-    if (err != 0)
+    // Exit if unable to create the eventfd used to wake up the data model thread when messages are queued for it
+    dm_mq_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dm_mq_eventfd == -1)
     {
-        USP_ERR_ERRNO("socketpair", errno);
+        USP_ERR_ERRNO("eventfd", errno);
         return USP_ERR_INTERNAL_ERROR;
     }
 
@@ -236,6 +318,27 @@ int DM_EXEC_Init(void)
         return err;
     }
 
+#if NUM_GET_WORKER_THREADS > 0
+    // Exit if unable to create the mutex and condition variables used to pass read-only USP records to the Get worker threads
+    err = OS_UTILS_InitMutex(&get_job_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = pthread_cond_init(&get_job_available_cond, NULL);
+    if (err == 0)
+    {
+        err = pthread_cond_init(&get_jobs_complete_cond, NULL);
+    }
+
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("pthread_cond_init", err);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+#endif
+
     return USP_ERR_OK;
 }
 
@@ -280,7 +383,6 @@ int USP_SIGNAL_OperationComplete(int instance, int err_code, char *err_msg, kv_v
 {
     dm_exec_msg_t  msg;
     oper_complete_msg_t *ocm;
-    int bytes_sent;
 
     // Exit if this function has been called with a mismatch between err_code and err_msg
     if ( ((err_code == USP_ERR_OK) && (err_msg != NULL)) || 
@@ -291,7 +393,7 @@ int USP_SIGNAL_OperationComplete(int instance, int err_code, char *err_msg, kv_v
     }
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -306,14 +408,8 @@ int USP_SIGNAL_OperationComplete(int instance, int err_code, char *err_msg, kv_v
     ocm->err_msg = (err_msg==NULL) ? NULL : USP_STRDUP(err_msg);
     ocm->output_args = output_args;
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 
     return USP_ERR_OK;
 }
@@ -339,10 +435,9 @@ int USP_SIGNAL_DataModelEvent(char *event_name, kv_vector_t *output_args)
 {
     dm_exec_msg_t  msg;
     event_complete_msg_t *ecm;
-    int bytes_sent;
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -355,14 +450,8 @@ int USP_SIGNAL_DataModelEvent(char *event_name, kv_vector_t *output_args)
     ecm->event_name = USP_STRDUP(event_name);
     ecm->output_args = output_args;
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 
     return USP_ERR_OK;
 }
@@ -387,7 +476,6 @@ int USP_SIGNAL_OperationStatus(int instance, char *status)
 {
     dm_exec_msg_t  msg;
     oper_status_msg_t *osm;
-    int bytes_sent;
 
     // Exit if this function has been called with invalid parameters
     if (status == NULL)
@@ -397,7 +485,7 @@ int USP_SIGNAL_OperationStatus(int instance, char *status)
     }
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -410,14 +498,8 @@ int USP_SIGNAL_OperationStatus(int instance, char *status)
     osm->instance = instance;
     osm->status = USP_STRDUP(status);
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 
     return USP_ERR_OK;
 }
@@ -438,7 +520,6 @@ int USP_SIGNAL_ObjectAdded(char *path)
 {
     dm_exec_msg_t  msg;
     obj_added_msg_t *oam;
-    int bytes_sent;
 
     // Exit if this function has been called with invalid parameters
     if (path == NULL)
@@ -448,7 +529,7 @@ int USP_SIGNAL_ObjectAdded(char *path)
     }
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -460,14 +541,8 @@ int USP_SIGNAL_ObjectAdded(char *path)
     oam = &msg.params.obj_added;
     oam->path = USP_STRDUP(path);
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 
     return USP_ERR_OK;
 }
@@ -488,7 +563,6 @@ int USP_SIGNAL_ObjectDeleted(char *path)
 {
     dm_exec_msg_t  msg;
     obj_deleted_msg_t *odm;
-    int bytes_sent;
 
     // Exit if this function has been called with invalid parameters
     if (path == NULL)
@@ -498,7 +572,7 @@ int USP_SIGNAL_ObjectDeleted(char *path)
     }
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -510,15 +584,203 @@ int USP_SIGNAL_ObjectDeleted(char *path)
     odm = &msg.params.obj_deleted;
     odm->path = USP_STRDUP(path);
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
+    // Post the message
+    PostDmExecMsg(&msg);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_SIGNAL_ObjectsAdded
+**
+** Signals to USP core that the vendor has added a batch of object instances to the data model
+** This is more efficient than calling USP_SIGNAL_ObjectAdded() for each object instance, as all
+** object instances are posted in a single message, and registered with the data model in bulk
+** This function may be called from any vendor thread
+**
+** \param   paths - pointer to vector containing the paths of objects that have been added
+**                  NOTE: The paths are copied by this function (ie ownership of the vector remains with the caller)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SIGNAL_ObjectsAdded(str_vector_t *paths)
+{
+    dm_exec_msg_t  msg;
+    objs_added_msg_t *oam;
+
+    // Exit if this function has been called with invalid parameters
+    if (paths == NULL)
     {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        USP_LOG_Error("%s: paths input argument must point to a string vector", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if message queue is not setup yet
+    if (dm_mq_eventfd == -1)
+    {
+        USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if there are no objects in the batch
+    if (paths->num_entries == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Form message
+    memset(&msg, 0, sizeof(msg));
+    msg.type = kDmExecMsg_ObjsAdded;
+    oam = &msg.params.objs_added;
+    STR_VECTOR_Clone(&oam->paths, paths->vector, paths->num_entries);
+
+    // Post the message
+    PostDmExecMsg(&msg);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_SIGNAL_ObjectsDeleted
+**
+** Signals to USP core that the vendor has deleted a batch of object instances from the data model
+** This is more efficient than calling USP_SIGNAL_ObjectDeleted() for each object instance, as all
+** object instances are posted in a single message
+** This function may be called from any vendor thread
+**
+** \param   paths - pointer to vector containing the paths of objects that have been deleted
+**                  NOTE: The paths are copied by this function (ie ownership of the vector remains with the caller)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SIGNAL_ObjectsDeleted(str_vector_t *paths)
+{
+    dm_exec_msg_t  msg;
+    objs_deleted_msg_t *odm;
+
+    // Exit if this function has been called with invalid parameters
+    if (paths == NULL)
+    {
+        USP_LOG_Error("%s: paths input argument must point to a string vector", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
     }
 
+    // Exit if message queue is not setup yet
+    if (dm_mq_eventfd == -1)
+    {
+        USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if there are no objects in the batch
+    if (paths->num_entries == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Form message
+    memset(&msg, 0, sizeof(msg));
+    msg.type = kDmExecMsg_ObjsDeleted;
+    odm = &msg.params.objs_deleted;
+    STR_VECTOR_Clone(&odm->paths, paths->vector, paths->num_entries);
+
+    // Post the message
+    PostDmExecMsg(&msg);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_SIGNAL_ValueChanged
+**
+** Signals to USP core that the value of a vendor parameter has changed, so that value change notifications
+** can be sent for it without it being polled. Vendor parameters which are always signalled using this function
+** should be registered with the DM_PUSH_NOTIFIED flag, so that value change subscriptions do not poll them
+** This function may be called from any vendor thread
+**
+** \param   path - path of the parameter whose value has changed
+** \param   value - new value of the parameter
+**                  NOTE: The path and value are copied by this function (ie ownership remains with the caller)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SIGNAL_ValueChanged(char *path, char *value)
+{
+    dm_exec_msg_t  msg;
+    value_changed_msg_t *vcm;
+
+    // Exit if this function has been called with invalid parameters
+    if ((path == NULL) || (value == NULL))
+    {
+        USP_LOG_Error("%s: path and value input arguments must point to strings", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if message queue is not setup yet
+    if (dm_mq_eventfd == -1)
+    {
+        USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Form message
+    memset(&msg, 0, sizeof(msg));
+    msg.type = kDmExecMsg_ValueChanged;
+    vcm = &msg.params.value_changed;
+    vcm->path = USP_STRDUP(path);
+    vcm->value = USP_STRDUP(value);
+
+    // Post the message
+    PostDmExecMsg(&msg);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_SIGNAL_GetValueComplete
+**
+** Returns the value of a parameter, which was requested by calling the parameter's asynchronous get callback
+** (see USP_REGISTER_VendorParam_AsyncGet)
+** This function may be called from any vendor thread
+**
+** \param   request_id - identifier of the request, passed to the asynchronous get callback
+** \param   err_code - USP_ERR_OK if the value of the parameter was obtained successfully
+** \param   value - value of the parameter, or an error message if err_code is not USP_ERR_OK (may be NULL)
+**                  NOTE: The value is copied by this function (ie ownership remains with the caller)
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SIGNAL_GetValueComplete(int request_id, int err_code, char *value)
+{
+    dm_exec_msg_t  msg;
+    get_value_complete_msg_t *gvc;
+
+    // Exit if message queue is not setup yet
+    if (dm_mq_eventfd == -1)
+    {
+        USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Form message
+    memset(&msg, 0, sizeof(msg));
+    msg.type = kDmExecMsg_GetValueComplete;
+    gvc = &msg.params.get_value_complete;
+    gvc->request_id = request_id;
+    gvc->err_code = err_code;
+    gvc->value = USP_STRDUP((value != NULL) ? value : "");
+
+    // Post the message
+    PostDmExecMsg(&msg);
+
     return USP_ERR_OK;
 }
 
@@ -542,15 +804,22 @@ void DM_EXEC_PostUspRecord(unsigned char *pbuf, int pbuf_len, ctrust_role_t role
 {
     dm_exec_msg_t  msg;
     process_usp_record_msg_t *pur;
-    int bytes_sent;
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return;
     }
 
+    // Exit if the USP records already waiting to be processed by the data model thread have used up the memory budget
+    // NOTE: The MTP threads normally stop reading from their sockets before this occurs (see USP_MEM_IsBudgetUnderPressure)
+    if (USP_MEM_BudgetCharge(kMemBudget_DmQueue, pbuf_len) == false)
+    {
+        USP_LOG_Warning("%s: WARNING: Data model queue memory budget exceeded. Dropping received USP record (%d bytes)", __FUNCTION__, pbuf_len);
+        return;
+    }
+
     // Form message
     memset(&msg, 0, sizeof(msg));
     msg.type = kDmExecMsg_ProcessUspRecord;
@@ -570,15 +839,13 @@ void DM_EXEC_PostUspRecord(unsigned char *pbuf, int pbuf_len, ctrust_role_t role
     pur->mtp_reply_to.coap_resource = USP_STRDUP(mrt->coap_resource);
     pur->mtp_reply_to.coap_encryption = mrt->coap_encryption;
     pur->mtp_reply_to.coap_reset_session_hint = mrt->coap_reset_session_hint;
+    pur->mtp_reply_to.mqtt_instance = mrt->mqtt_instance;
+    pur->mtp_reply_to.mqtt_topic = USP_STRDUP(mrt->mqtt_topic);
+    pur->mtp_reply_to.rx_time = tu_uptime_usecs();
+    pur->mtp_reply_to.replay_id = mrt->replay_id;
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 }
 
 /*********************************************************************//**
@@ -602,10 +869,9 @@ void DM_EXEC_PostStompHandshakeComplete(int stomp_instance, ctrust_role_t role,
 {
     dm_exec_msg_t  msg;
     stomp_complete_msg_t *scm;
-    int bytes_sent;
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return;
@@ -619,14 +885,8 @@ void DM_EXEC_PostStompHandshakeComplete(int stomp_instance, ctrust_role_t role,
     scm->role = role;
     scm->allowed_controllers = (allowed_controllers != NULL) ? USP_STRDUP(allowed_controllers) : NULL;
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 }
 
 /*********************************************************************//**
@@ -644,11 +904,10 @@ void DM_EXEC_PostStompHandshakeComplete(int stomp_instance, ctrust_role_t role,
 void DM_EXEC_PostMtpThreadExited(unsigned flags)
 {
     dm_exec_msg_t  msg;
-    int bytes_sent;
     mtp_thread_exited_msg_t *tem;
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return;
@@ -660,14 +919,8 @@ void DM_EXEC_PostMtpThreadExited(unsigned flags)
     tem = &msg.params.mtp_thread_exited;
     tem->flags = flags;
     
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return;
-    }
+    // Post the message
+    PostDmExecMsg(&msg);
 }
 
 
@@ -689,10 +942,9 @@ int DM_EXEC_NotifyBdcTransferResult(int profile_id, bdc_transfer_result_t transf
 {
     dm_exec_msg_t  msg;
     bdc_transfer_result_msg_t *btr;
-    int bytes_sent;
 
     // Exit if message queue is not setup yet
-    if (mq_tx_socket == -1)
+    if (dm_mq_eventfd == -1)
     {
         USP_LOG_Error("%s is being called before data model has been initialised", __FUNCTION__);
         return USP_ERR_INTERNAL_ERROR;
@@ -705,15 +957,8 @@ int DM_EXEC_NotifyBdcTransferResult(int profile_id, bdc_transfer_result_t transf
     btr->profile_id = profile_id;
     btr->transfer_result = transfer_result;
 
-    // Send the message
-    bytes_sent = send(mq_tx_socket, &msg, sizeof(msg), 0);
-    if (bytes_sent != sizeof(msg))
-    {
-        char buf[USP_ERR_MAXLEN];
-        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
-        return USP_ERR_INTERNAL_ERROR;
-    }
-
+    // Post the message
+    PostDmExecMsg(&msg);
 
     return USP_ERR_OK;
 }
@@ -805,8 +1050,16 @@ void *DM_EXEC_Main(void *args)
 
         OS_UTILS_LockMutex(&dm_access_mutex);
 
+        // Allow stale vendor object instances to be re-read by the processing performed in this iteration
+        DM_INST_VECTOR_NextRefreshEpoch();
+
         // Execute all timers which are ready to fire
-        SYNC_TIMER_Execute();
+        // NOTE: Timers may modify the data model, so first wait until no Get worker thread is accessing it
+        if (SYNC_TIMER_TimeToNext() == 0)
+        {
+            DM_EXEC_WaitForGetWorkers();
+            SYNC_TIMER_Execute();
+        }
 
         // Process socket activity
         switch(num_sockets)
@@ -827,9 +1080,18 @@ void *DM_EXEC_Main(void *args)
                 break;
         }
 
+        // Wait until no Get worker thread is accessing the data model, if there are any notifications to generate
+        if (DEVICE_SUBSCRIPTION_AreEventsPending())
+        {
+            DM_EXEC_WaitForGetWorkers();
+        }
+
         // Queue any object creation/deletion events which have been generated by the message or timer callbacks
         DEVICE_SUBSCRIPTION_ProcessAllObjectLifeEventSubscriptions();
 
+        // Queue any value change events for database parameters which have been changed by the message or timer callbacks
+        DEVICE_SUBSCRIPTION_ProcessDbValueChanges();
+
         // Print out any memory allocations that got added for this time around the loop
         //USP_MEM_Print();
     }
@@ -857,12 +1119,13 @@ void UpdateSockSet(socket_set_t *set)
     // Add the CLI server socket to the socket set
     CLI_SERVER_UpdateSocketSet(set);
 
-    // Add the message queue receiving socket to the socket set
-    SOCKET_SET_AddSocketToReceiveFrom(mq_rx_socket, MAX_SOCKET_TIMEOUT, set);
+    // Add the message queue's wakeup eventfd to the socket set
+    SOCKET_SET_AddSocketToReceiveFrom(dm_mq_eventfd, MAX_SOCKET_TIMEOUT, set);
 
     // Update socket timeout time with the time to the next timer
+    // NOTE: The slack allows the wait to be extended, so that timers which tolerate being late are coalesced (with each other and with the other threads)
     delay_ms = SYNC_TIMER_TimeToNext();
-    SOCKET_SET_UpdateTimeout(delay_ms, set);
+    SOCKET_SET_UpdateTimeoutWithSlack(delay_ms, SYNC_TIMER_LatestTimeToNext() - delay_ms, set);
 }
 
 /*********************************************************************//**
@@ -889,7 +1152,7 @@ void ProcessSocketActivity(socket_set_t *set)
 **
 ** ProcessMessageQueueSocketActivity
 **
-** Processes any activity on the message queue receiving socket
+** Processes all messages pending on the message queue, if the message queue's eventfd has been signalled
 **
 ** \param   set - pointer to socket set structure containing sockets with activity on them
 **
@@ -897,56 +1160,80 @@ void ProcessSocketActivity(socket_set_t *set)
 **
 **************************************************************************/
 void ProcessMessageQueueSocketActivity(socket_set_t *set)
+{
+    uint64_t count;
+    dm_mq_node_t *node;
+
+    // Exit if the message queue has not been signalled
+    if (SOCKET_SET_IsReadyToRead(dm_mq_eventfd, set) == 0)
+    {
+        return;
+    }
+
+    // Reset the eventfd, then clear the wakeup flag before draining the queue
+    // This ensures that any message posted after we have started draining the queue causes another wakeup
+    // NOTE: The return value is ignored, as the eventfd may have already been reset (EAGAIN)
+    (void)read(dm_mq_eventfd, &count, sizeof(count));
+    __atomic_store_n(&dm_mq_wakeup_pending, false, __ATOMIC_SEQ_CST);
+
+    // Process all messages currently on the queue
+    node = PopDmExecQueue();
+    while (node != NULL)
+    {
+        HandleDmExecMessage(&node->msg);
+        USP_FREE(node);
+        node = PopDmExecQueue();
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleDmExecMessage
+**
+** Processes a message that was posted on the data model's message queue, freeing all arguments contained in it
+**
+** \param   msg - pointer to message to process
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void HandleDmExecMessage(dm_exec_msg_t *msg)
 {
     int err;
-    int bytes_read;
-    dm_exec_msg_t  msg;
     oper_complete_msg_t *ocm;
     event_complete_msg_t *ecm;
     oper_status_msg_t *osm;
     obj_added_msg_t *oam;
     obj_deleted_msg_t *odm;
-    process_usp_record_msg_t *pur;
+    objs_added_msg_t *oams;
+    objs_deleted_msg_t *odms;
+    value_changed_msg_t *vcm;
+    get_value_complete_msg_t *gvc;
     stomp_complete_msg_t *scm;
     mtp_thread_exited_msg_t *tem;
     bdc_transfer_result_msg_t *btr;
-    mtp_reply_to_t *mrt;
 
-    // Exit if there is no activity on the message queue socket
-    if (SOCKET_SET_IsReadyToRead(mq_rx_socket, set) == 0)
+    // Exit if the USP record has been passed to a Get worker thread to process
+    if ((msg->type == kDmExecMsg_ProcessUspRecord) && (DispatchToGetWorker(&msg->params.usp_record)))
     {
         return;
     }
 
-    // Exit if unable to read the full message received
-    bytes_read = recv(mq_rx_socket, &msg, sizeof(msg), 0);
-    if (bytes_read != sizeof(msg))
-    {
-        USP_LOG_Error("%s: recv() did not return a full message", __FUNCTION__);
-        return;
-    }
+    // All other messages may modify the data model, so first wait until no Get worker thread is accessing it
+    DM_EXEC_WaitForGetWorkers();
 
-    switch(msg.type)
+    switch(msg->type)
     {
         case kDmExecMsg_ProcessUspRecord:
-            pur = &msg.params.usp_record;
-            mrt = &pur->mtp_reply_to;
-
-            ProcessBinaryUspRecord(pur->pbuf, pur->pbuf_len, pur->role, pur->allowed_controllers, mrt);
-
-            // Free all arguments passed in this message
-            USP_FREE(pur->pbuf);
-            USP_SAFE_FREE(pur->allowed_controllers);
-            USP_SAFE_FREE(mrt->stomp_dest);
-            USP_SAFE_FREE(mrt->stomp_err_id);
-            USP_SAFE_FREE(mrt->coap_host);
-            USP_SAFE_FREE(mrt->coap_resource);
+            DM_INST_VECTOR_NextRefreshEpoch();
+            HandleUspRecordMsg(&msg->params.usp_record);
             break;
 
         case kDmExecMsg_StompHandshakeComplete:
-            scm = &msg.params.stomp_complete;
+            scm = &msg->params.stomp_complete;
             DEVICE_CONTROLLER_SetRolesFromStomp(scm->stomp_instance, scm->role, scm->allowed_controllers);
             DM_EXEC_EnableNotifications();
+            NOTIFY_SPOOL_Replay();
     
             // Free all arguments passed in this message
             USP_SAFE_FREE(scm->allowed_controllers);
@@ -954,7 +1241,7 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             
 
         case kDmExecMsg_OperComplete:
-            ocm = &msg.params.oper_complete;
+            ocm = &msg->params.oper_complete;
             DEVICE_REQUEST_OperationComplete(ocm->instance, ocm->err_code, ocm->err_msg, ocm->output_args);
 
             // Free all arguments passed in this message
@@ -968,7 +1255,7 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             break;
 
         case kDmExecMsg_EventComplete:
-            ecm = &msg.params.event_complete;
+            ecm = &msg->params.event_complete;
             DEVICE_SUBSCRIPTION_ProcessAllEventCompleteSubscriptions(ecm->event_name, ecm->output_args);
 
             // Free all arguments passed in this message
@@ -982,7 +1269,7 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             break;
 
         case kDmExecMsg_OperStatus:
-            osm = &msg.params.oper_status;
+            osm = &msg->params.oper_status;
             USP_ASSERT(osm->status != NULL);
             DEVICE_REQUEST_UpdateOperationStatus(osm->instance, osm->status);
 
@@ -992,7 +1279,7 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
 
 
         case kDmExecMsg_ObjAdded:
-            oam = &msg.params.obj_added;
+            oam = &msg->params.obj_added;
             err = DATA_MODEL_NotifyInstanceAdded(oam->path);
             if (err == USP_ERR_OK)
             {
@@ -1005,7 +1292,7 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             break;
 
         case kDmExecMsg_ObjDeleted:
-            odm = &msg.params.obj_deleted;
+            odm = &msg->params.obj_deleted;
             err = DATA_MODEL_NotifyInstanceDeleted(odm->path);
             if (err == USP_ERR_OK)
             {
@@ -1017,8 +1304,48 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             USP_FREE(odm->path);
             break;
 
+        case kDmExecMsg_ObjsAdded:
+            oams = &msg->params.objs_added;
+            DATA_MODEL_NotifyInstancesAdded(&oams->paths);
+
+            // Send Object creation notifications for all objects which were added
+            DEVICE_SUBSCRIPTION_NotifyObjectLifeEvents(&oams->paths, kSubNotifyType_ObjectCreation);
+
+            // Free all arguments passed in this message
+            STR_VECTOR_Destroy(&oams->paths);
+            break;
+
+        case kDmExecMsg_ObjsDeleted:
+            odms = &msg->params.objs_deleted;
+            DATA_MODEL_NotifyInstancesDeleted(&odms->paths);
+
+            // Send Object deletion notifications for all objects which were deleted
+            DEVICE_SUBSCRIPTION_NotifyObjectLifeEvents(&odms->paths, kSubNotifyType_ObjectDeletion);
+
+            // Free all arguments passed in this message
+            STR_VECTOR_Destroy(&odms->paths);
+            break;
+
+        case kDmExecMsg_ValueChanged:
+            vcm = &msg->params.value_changed;
+            DATA_MODEL_InvalidateCachedValue(vcm->path);
+            DEVICE_SUBSCRIPTION_NotifyValueChanged(vcm->path, vcm->value);
+
+            // Free all arguments passed in this message
+            USP_FREE(vcm->path);
+            USP_FREE(vcm->value);
+            break;
+
+        case kDmExecMsg_GetValueComplete:
+            gvc = &msg->params.get_value_complete;
+            MSG_HANDLER_CompleteAsyncGet(gvc->request_id, gvc->err_code, gvc->value);
+
+            // Free all arguments passed in this message
+            USP_FREE(gvc->value);
+            break;
+
         case kDmExecMsg_MtpThreadExited:
-            tem = &msg.params.mtp_thread_exited;
+            tem = &msg->params.mtp_thread_exited;
             cumulative_mtp_threads_exited |= tem->flags;
             if (cumulative_mtp_threads_exited == ALL_MTP_EXITED)
             {
@@ -1027,16 +1354,307 @@ void ProcessMessageQueueSocketActivity(socket_set_t *set)
             break;
 
         case kDmExecMsg_BdcTransferResult:
-            btr = &msg.params.bdc_transfer_result;
+            btr = &msg->params.bdc_transfer_result;
             DEVICE_BULKDATA_NotifyTransferResult(btr->profile_id, btr->transfer_result);
             break;    
 
         default:
-            TERMINATE_BAD_CASE(msg.type);
+            TERMINATE_BAD_CASE(msg->type);
             break;
     }
 }
 
+/*********************************************************************//**
+**
+** HandleUspRecordMsg
+**
+** Processes a USP record that was posted on the data model's message queue, freeing all arguments passed with it
+** This function is called by the data model thread, or by a Get worker thread (for read-only USP records)
+**
+** \param   pur - pointer to parameters of the message containing the USP record
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void HandleUspRecordMsg(process_usp_record_msg_t *pur)
+{
+    mtp_reply_to_t *mrt;
+
+    mrt = &pur->mtp_reply_to;
+    ProcessBinaryUspRecord(pur->pbuf, pur->pbuf_len, pur->role, pur->allowed_controllers, mrt);
+
+    // Record the latency of the USP record, if it is being replayed from a protocol capture file
+    if (mrt->replay_id != 0)
+    {
+        REPLAY_RecordHandled(mrt->replay_id, mrt->rx_time);
+    }
+
+    // Free all arguments passed in this message
+    USP_FREE(pur->pbuf);
+    USP_MEM_BudgetRelease(kMemBudget_DmQueue, pur->pbuf_len);
+    USP_SAFE_FREE(pur->allowed_controllers);
+    USP_SAFE_FREE(mrt->stomp_dest);
+    USP_SAFE_FREE(mrt->stomp_err_id);
+    USP_SAFE_FREE(mrt->coap_host);
+    USP_SAFE_FREE(mrt->coap_resource);
+    USP_SAFE_FREE(mrt->mqtt_topic);
+}
+
+/*********************************************************************//**
+**
+** DispatchToGetWorker
+**
+** Passes the specified USP record to the Get worker threads to process, if it only reads the data model
+**
+** \param   pur - pointer to parameters of the message containing the USP record
+**                NOTE: If dispatched, ownership of all arguments passes to the Get worker thread
+**
+** \return  true if the USP record was dispatched, false if it must be processed by the data model thread
+**
+**************************************************************************/
+bool DispatchToGetWorker(process_usp_record_msg_t *pur)
+{
+#if NUM_GET_WORKER_THREADS > 0
+    get_job_t *job;
+
+    // Exit if the USP record contains a USP message which might modify the data model
+    if (MSG_HANDLER_IsReadOnlyRecord(pur->pbuf, pur->pbuf_len) == false)
+    {
+        return false;
+    }
+
+    // Exit if processing the USP message might re-read the instances of a vendor object (which modifies the data model)
+    if (DM_INST_VECTOR_IsRefreshDue())
+    {
+        return false;
+    }
+
+    // Add the USP record to the tail of the queue
+    job = USP_MALLOC(sizeof(get_job_t));
+    job->next = NULL;
+    memcpy(&job->usp_record, pur, sizeof(job->usp_record));
+
+    OS_UTILS_LockMutex(&get_job_mutex);
+    if (get_job_tail == NULL)
+    {
+        get_job_head = job;
+    }
+    else
+    {
+        get_job_tail->next = job;
+    }
+    get_job_tail = job;
+    num_outstanding_get_jobs++;
+    pthread_cond_signal(&get_job_available_cond);
+    OS_UTILS_UnlockMutex(&get_job_mutex);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*********************************************************************//**
+**
+** DM_EXEC_WaitForGetWorkers
+**
+** Waits until the Get worker threads have processed all read-only USP records dispatched to them
+** This must be called by the data model thread before performing any processing which may modify the data model
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DM_EXEC_WaitForGetWorkers(void)
+{
+#if NUM_GET_WORKER_THREADS > 0
+    OS_UTILS_LockMutex(&get_job_mutex);
+    while (num_outstanding_get_jobs > 0)
+    {
+        pthread_cond_wait(&get_jobs_complete_cond, &get_job_mutex);
+    }
+    OS_UTILS_UnlockMutex(&get_job_mutex);
+#endif
+}
+
+#if NUM_GET_WORKER_THREADS > 0
+/*********************************************************************//**
+**
+** DM_EXEC_GetWorkerMain
+**
+** Main loop of a Get worker thread
+** Each Get worker thread processes read-only USP records dispatched to it by the data model thread
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None, this thread never exits
+**
+**************************************************************************/
+void *DM_EXEC_GetWorkerMain(void *args)
+{
+    get_job_t *job;
+
+    // Allow this thread to call the data model API
+    OS_UTILS_SetDataModelWorkerThread();
+
+    while(FOREVER)
+    {
+        // Wait for a USP record to process, then remove it from the head of the queue
+        OS_UTILS_LockMutex(&get_job_mutex);
+        while (get_job_head == NULL)
+        {
+            pthread_cond_wait(&get_job_available_cond, &get_job_mutex);
+        }
+
+        job = get_job_head;
+        get_job_head = job->next;
+        if (get_job_head == NULL)
+        {
+            get_job_tail = NULL;
+        }
+        OS_UTILS_UnlockMutex(&get_job_mutex);
+
+        // Process the USP record
+        HandleUspRecordMsg(&job->usp_record);
+        USP_FREE(job);
+
+        // Unblock the data model thread, if this was the last outstanding USP record
+        OS_UTILS_LockMutex(&get_job_mutex);
+        num_outstanding_get_jobs--;
+        if (num_outstanding_get_jobs == 0)
+        {
+            pthread_cond_broadcast(&get_jobs_complete_cond);
+        }
+        OS_UTILS_UnlockMutex(&get_job_mutex);
+    }
+
+    return NULL;
+}
+#endif
+
+/*********************************************************************//**
+**
+** PostDmExecMsg
+**
+** Posts a copy of the specified message on the data model's message queue, and wakes up the data model thread if necessary
+** This function never blocks, so may be called from any thread (including the data model thread itself)
+**
+** \param   msg - pointer to message to post. Ownership of any dynamically allocated arguments passes to the data model thread
+**
+** \return  None
+**
+**************************************************************************/
+void PostDmExecMsg(dm_exec_msg_t *msg)
+{
+    dm_mq_node_t *node;
+    uint64_t count = 1;
+    bool was_pending;
+    int bytes_sent;
+
+    // Copy the message into a queue node, and push it onto the queue
+    node = USP_MALLOC(sizeof(dm_mq_node_t));
+    memcpy(&node->msg, msg, sizeof(node->msg));
+    PushDmExecQueue(node);
+
+    // Exit if the data model thread has already been signalled, and has not yet started draining the queue
+    was_pending = __atomic_exchange_n(&dm_mq_wakeup_pending, true, __ATOMIC_SEQ_CST);
+    if (was_pending)
+    {
+        return;
+    }
+
+    // Wake up the data model thread
+    bytes_sent = write(dm_mq_eventfd, &count, sizeof(count));
+    if (bytes_sent != sizeof(count))
+    {
+        char buf[USP_ERR_MAXLEN];
+        USP_LOG_Error("%s(%d): write failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+    }
+}
+
+/*********************************************************************//**
+**
+** PushDmExecQueue
+**
+** Pushes the specified node onto the tail of the data model's message queue
+** This function is lock-free and may be called concurrently by any number of threads
+**
+** \param   node - pointer to node to push onto the queue
+**
+** \return  None
+**
+**************************************************************************/
+void PushDmExecQueue(dm_mq_node_t *node)
+{
+    dm_mq_node_t *prev;
+
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&dm_mq_tail, node, __ATOMIC_ACQ_REL);
+
+    // NOTE: Between the exchange above and the store below, the node is not yet reachable from the head of the queue
+    // PopDmExecQueue() treats this as the queue being empty. The subsequent wakeup ensures that the node is processed
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************//**
+**
+** PopDmExecQueue
+**
+** Pops the oldest node from the head of the data model's message queue
+** This function must only be called by the data model thread
+**
+** \param   None
+**
+** \return  pointer to node popped from the queue, or NULL if the queue is empty (or a producer is part way through pushing)
+**
+**************************************************************************/
+dm_mq_node_t *PopDmExecQueue(void)
+{
+    dm_mq_node_t *head;
+    dm_mq_node_t *next;
+
+    // Skip the stub node, if it is at the head of the queue
+    head = dm_mq_head;
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (head == &dm_mq_stub)
+    {
+        // Exit if the queue is empty
+        if (next == NULL)
+        {
+            return NULL;
+        }
+
+        dm_mq_head = next;
+        head = next;
+        next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    }
+
+    // Exit if the head node is followed by another node
+    if (next != NULL)
+    {
+        dm_mq_head = next;
+        return head;
+    }
+
+    // Exit if a producer is part way through pushing a node after the head node
+    if (head != __atomic_load_n(&dm_mq_tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    // The head node is the last node in the queue, so push the stub node behind it, so that it can be popped
+    PushDmExecQueue(&dm_mq_stub);
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (next != NULL)
+    {
+        dm_mq_head = next;
+        return head;
+    }
+
+    return NULL;
+}
+
 /*********************************************************************//**
 **
 ** HandleScheduledExit
@@ -1158,7 +1776,7 @@ void ProcessBinaryUspRecord(unsigned char *pbuf, int pbuf_len, ctrust_role_t rol
     // Send a 'usp-err-id' STOMP frame
     // NOTE: The trailing NULL in the pbuf contents is not part of the final STOMP frame but is necessary for printing out the pbuf contents in MSG_HANDLER_LogMessageToSend
     agent_queue = DEVICE_MTP_GetAgentStompQueue(mrt->stomp_instance);
-    STOMP_QueueBinaryMessage(USP__HEADER__MSG_TYPE__ERROR, mrt->stomp_instance, mrt->stomp_dest, agent_queue, (unsigned char *)buf, len, kMtpContentType_Text, mrt->stomp_err_id, END_OF_TIME);
+    STOMP_QueueBinaryMessage(USP__HEADER__MSG_TYPE__ERROR, mrt->stomp_instance, mrt->stomp_dest, agent_queue, (unsigned char *)buf, len, kMtpContentType_Text, mrt->stomp_err_id, kMtpSendPriority_Response, END_OF_TIME);
 }
 
 
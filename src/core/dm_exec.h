@@ -46,12 +46,28 @@
 // Bitmask indicating which thread exited to DM_EXEC_PostMtpThreadExited()
 #define STOMP_EXITED 0x00000001
 #define COAP_EXITED  0x00000002
+#define WSCLIENT_EXITED 0x00000004
+#define MQTT_EXITED  0x00000008
 
 #ifdef ENABLE_COAP
-    #define ALL_MTP_EXITED    (STOMP_EXITED | COAP_EXITED)
+    #define COAP_MTP_EXITED   (COAP_EXITED)
 #else
-    #define ALL_MTP_EXITED    (STOMP_EXITED)
+    #define COAP_MTP_EXITED   (0)
 #endif
+
+#ifdef ENABLE_WEBSOCKETS
+    #define WSCLIENT_MTP_EXITED (WSCLIENT_EXITED)
+#else
+    #define WSCLIENT_MTP_EXITED (0)
+#endif
+
+#ifdef ENABLE_MQTT
+    #define MQTT_MTP_EXITED   (MQTT_EXITED)
+#else
+    #define MQTT_MTP_EXITED   (0)
+#endif
+
+#define ALL_MTP_EXITED    (STOMP_EXITED | COAP_MTP_EXITED | WSCLIENT_MTP_EXITED | MQTT_MTP_EXITED)
 //------------------------------------------------------------------------------
 // API functions
 int DM_EXEC_Init(void);
@@ -62,6 +78,8 @@ void DM_EXEC_PostMtpThreadExited(unsigned flags);
 void DM_EXEC_HandleStompHandshakeComplete(int stomp_instance, ctrust_role_t role, char *allowed_controllers);
 int DM_EXEC_NotifyBdcTransferResult(int profile_id, bdc_transfer_result_t transfer_result);
 void *DM_EXEC_Main(void *args);
+void *DM_EXEC_GetWorkerMain(void *args);
+void DM_EXEC_WaitForGetWorkers(void);
 //------------------------------------------------------------------------------
 
 #endif
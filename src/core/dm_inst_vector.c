@@ -42,17 +42,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "common_defs.h"
 #include "data_model.h"
 #include "int_vector.h"
 #include "dm_inst_vector.h"
+#include "path_resolver.h"
+#include "os_utils.h"
 
 
 //--------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void AddObjectInstanceIfPermitted(dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role);
-
+int CompareInstances(const void *p1, const void *p2);
+int ComparePrefix(dm_instances_t *oi, dm_instances_t *key, int order, bool match_last_instance);
+int FindInstanceRange(dm_instances_vector_t *div, dm_instances_t *key, int order, bool match_last_instance, int *end);
+bool InsertInstance(dm_instances_vector_t *div, dm_instances_t *inst);
+void EnsureInstVectorCapacity(dm_instances_vector_t *div, int num_entries);
+void IncrementInstanceGeneration(void);
+void RefreshInstancesIfExpired(dm_node_t *top_node);
+
+//------------------------------------------------------------------------------
+// Counter incremented whenever an object instance is added to or deleted from the data model
+// This allows callers to cache the results of resolving path expressions, and detect when those results may be stale
+static unsigned inst_generation = 1;
+
+//------------------------------------------------------------------------------
+// Top level multi-instance objects whose instances are read from the vendor by a refresh instances callback (see USP_REGISTER_Object_RefreshInstances)
+static dm_node_t **refresh_nodes = NULL;
+static int num_refresh_nodes = 0;
+
+// Counter incremented by the data model thread before processing each USP message (and each time around its main loop)
+// The instances of an object are refreshed at most once per epoch, so that they do not change part way through processing a message
+static unsigned refresh_epoch = 1;
+
+// Object whose refresh instances callback is currently being called, and the vector in which the instances are being collected
+// NOTE: Only accessed by the data model thread
+static dm_node_t *refreshing_node = NULL;
+static dm_instances_vector_t refreshed_vector;
 
 /*********************************************************************//**
 **
@@ -69,6 +98,7 @@ void DM_INST_VECTOR_Init(dm_instances_vector_t *div)
 {
     div->vector = NULL;
     div->num_entries = 0;
+    div->max_entries = 0;
 }
 
 /*********************************************************************//**
@@ -91,6 +121,7 @@ void DM_INST_VECTOR_Destroy(dm_instances_vector_t *div)
 
     div->vector = NULL;
     div->num_entries = 0;
+    div->max_entries = 0;
 }
 
 /*********************************************************************//**
@@ -108,11 +139,9 @@ void DM_INST_VECTOR_Destroy(dm_instances_vector_t *div)
 **************************************************************************/
 int DM_INST_VECTOR_Add(dm_instances_t *inst)
 {
-    int i;
-    int size;
-    dm_instances_t *oi;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
+    bool is_added;
 
     // Exit if there are no object instances to add
     // This is the case if this function is called for a parameter which does not have any object instances in it's path
@@ -128,28 +157,110 @@ int DM_INST_VECTOR_Add(dm_instances_t *inst)
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
     div = &top_node->registered.object_info.inst_vector;
 
-    // See if this instance already exists
-    for (i=0; i < div->num_entries; i++)
+    // Exit if this instance of the object already exists, nothing more to do
+    is_added = InsertInstance(div, inst);
+    if (is_added == false)
     {
-        // If this instance of the object already exists then exit, nothing more to do
-        oi = &div->vector[i];
-        if (memcmp(oi, inst, sizeof(dm_instances_t)) == 0)
-        {
-            return USP_ERR_OK;
-        }        
+        return USP_ERR_OK;
     }
 
-    // Otherwise, increase the size of the dm_instances_vector array
-    size = (div->num_entries+1) * sizeof(dm_instances_t);
-    div->vector = USP_REALLOC(div->vector, size);
-
-    // And store this object instance
-    memcpy(&div->vector[div->num_entries], inst, sizeof(dm_instances_t));
-    div->num_entries++;
+    // Instances held in the path resolver cache and unique key indexes are now stale
+    PATH_RESOLVER_InvalidateCache();
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    IncrementInstanceGeneration();
 
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_AddBulk
+**
+** Adds all of the specified object instances to the dm_instances_vectors of their top level multi-instance nodes
+** This is used at bootup to seed the data model with the instances read from the database, and avoids the
+** cost of inserting the instances into the sorted vectors one at a time
+** NOTE: The specified array is sorted in-place by this function
+** NOTE: Duplicate instances (in the array, or already in the data model) are only added once
+**
+** \param   insts - pointer to array of instance structures to add. All must have an order of at least 1.
+** \param   num_insts - number of entries in the array
+**
+** \return  None
+**
+**************************************************************************/
+void DM_INST_VECTOR_AddBulk(dm_instances_t *insts, int num_insts)
+{
+    int i;
+    int j;
+    int k;
+    int count;
+    int num_existing;
+    dm_node_t *top_node;
+    dm_instances_vector_t *div;
+
+    // Exit if there are no object instances to add
+    if (num_insts == 0)
+    {
+        return;
+    }
+
+    // Sort the instances, so that all instances for the same top level node are grouped together, and duplicates are adjacent
+    qsort(insts, num_insts, sizeof(dm_instances_t), CompareInstances);
+
+    // Iterate over all groups of instances sharing the same top level multi-instance node
+    i = 0;
+    while (i < num_insts)
+    {
+        USP_ASSERT(insts[i].order > 0);
+        top_node = insts[i].nodes[0];
+        USP_ASSERT(top_node != NULL);
+        USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+        div = &top_node->registered.object_info.inst_vector;
+
+        // Count the number of unique instances in this group
+        count = 0;
+        for (j=i; (j < num_insts) && (insts[j].nodes[0] == top_node); j++)
+        {
+            if ((j == i) || (CompareInstances(&insts[j-1], &insts[j]) != 0))
+            {
+                count++;
+            }
+        }
+
+        // Size the vector to hold all of the unique instances in one allocation
+        num_existing = div->num_entries;
+        EnsureInstVectorCapacity(div, num_existing + count);
+
+        // Copy the unique instances into the vector
+        for (k=i; k < j; k++)
+        {
+            if ((k != i) && (CompareInstances(&insts[k-1], &insts[k]) == 0))
+            {
+                continue;
+            }
+
+            if (num_existing == 0)
+            {
+                // The instances are already in sorted order, so can just be appended
+                memcpy(&div->vector[div->num_entries], &insts[k], sizeof(dm_instances_t));
+                div->num_entries++;
+            }
+            else
+            {
+                InsertInstance(div, &insts[k]);
+            }
+        }
+
+        // Move to the next group
+        i = j;
+    }
+
+    // Instances held in the path resolver cache and unique key indexes are now stale
+    PATH_RESOLVER_InvalidateCache();
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    IncrementInstanceGeneration();
+}
+
 /*********************************************************************//**
 **
 ** DM_INST_VECTOR_Remove
@@ -166,10 +277,8 @@ int DM_INST_VECTOR_Add(dm_instances_t *inst)
 **************************************************************************/
 void DM_INST_VECTOR_Remove(dm_instances_t *inst)
 {
-    int i;
-    int j;
-    int order;
-    dm_instances_t *oi;
+    int start;
+    int end;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -186,33 +295,68 @@ void DM_INST_VECTOR_Remove(dm_instances_t *inst)
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Find this instance and all child nested instances and delete them
-    j = 0;
-    order = inst->order;
-    for (i=0; i < div->num_entries; i++)
+    // Find this instance and all child nested instances. These are held contiguously in the sorted vector.
+    start = FindInstanceRange(div, inst, inst->order, true, &end);
+
+    // Delete them, by copying down later entries in the array
+    // NOTE: Don't bother reallocating the memory for the array (it could now be smaller).
+    if (end > start)
     {
-        oi = &div->vector[i];
-        if ((oi->order >= order) &&
-            (memcmp(oi->nodes, inst->nodes, order*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
-        {
-            // Delete this node. Nothing to do in this iteration of the loop - this value will be overwritten by further 
-        }
-        else
-        {
-            // Copy down later entries in the array, over ones which have been removed
-            if (j < i)
-            {
-                memcpy(&div->vector[j], oi, sizeof(dm_instances_t));
-            }
+        memmove(&div->vector[start], &div->vector[end], (div->num_entries - end)*sizeof(dm_instances_t));
+        div->num_entries -= (end - start);
+    }
 
-            j++;
-        }
+    // Instances held in the path resolver cache and unique key indexes are now stale
+    PATH_RESOLVER_InvalidateCache();
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    IncrementInstanceGeneration();
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_RemoveAllInstances
+**
+** Deletes all instances of the specified object (given it's parent instance numbers), including all of their child instances,
+** from the dm_instances_vector vector
+**
+** \param   node - pointer to multi-instance object in data model
+** \param   inst - pointer to instance structure specifying the object's parents and their instance numbers
+**
+** \return  None
+**
+**************************************************************************/
+void DM_INST_VECTOR_RemoveAllInstances(dm_node_t *node, dm_instances_t *inst)
+{
+    int start;
+    int end;
+    int order;
+    dm_node_t *top_node;
+    dm_instances_vector_t *div;
+
+    order = inst->order;            // NOTE: This may be 0 for a top level multi-instance node
+    USP_ASSERT(order < MAX_DM_INSTANCE_ORDER);
+    inst->nodes[order] = node;
+
+    // Determine which top level multi-instance node's DM instances array to remove from
+    top_node = inst->nodes[0];
+    USP_ASSERT(top_node != NULL);
+    USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    div = &top_node->registered.object_info.inst_vector;
+
+    // Find all instances of this object and all child nested instances. These are held contiguously in the sorted vector.
+    start = FindInstanceRange(div, inst, order+1, false, &end);
+    if (end > start)
+    {
+        memmove(&div->vector[start], &div->vector[end], (div->num_entries - end)*sizeof(dm_instances_t));
+        div->num_entries -= (end - start);
     }
 
-    // NOTE: Don't bother reallocating the memory for the array (it could now be smaller).
-    // It will be resized next time an instance is added.
-    div->num_entries = j;
+    inst->nodes[order] = NULL;          // Undo the changes made by this function to the inst array
+
+    // Instances held in the path resolver cache and unique key indexes are now stale
+    PATH_RESOLVER_InvalidateCache();
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    IncrementInstanceGeneration();
 }
 
 /*********************************************************************//**
@@ -229,8 +373,8 @@ void DM_INST_VECTOR_Remove(dm_instances_t *inst)
 **************************************************************************/
 bool DM_INST_VECTOR_IsExist(dm_instances_t *match)
 {
-    int i;
-    dm_instances_t *inst;
+    int start;
+    int end;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -245,25 +389,13 @@ bool DM_INST_VECTOR_IsExist(dm_instances_t *match)
     top_node = match->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the array of object instances which are present in the data model
-    for (i=0; i < div->num_entries; i++)
-    {
-        inst = &div->vector[i];
-        if (inst->order >= match->order)
-        {
-            if ( (memcmp(inst->nodes, match->nodes, (match->order)*sizeof(dm_node_t *)) == 0) &&
-                 (memcmp(inst->instances, match->instances, (match->order)*sizeof(int)) == 0) )
-            {
-                // All specified object instances match
-                return true;
-            }
-        }
-    }
+    // The object instances exist if any entries in the array match all of the specified object instances
+    start = FindInstanceRange(div, match, match->order, true, &end);
 
-    // If the code gets here, then no instances matched
-    return false;
+    return (end > start) ? true : false;
 }
 
 /*********************************************************************//**
@@ -283,8 +415,9 @@ bool DM_INST_VECTOR_IsExist(dm_instances_t *match)
 int DM_INST_VECTOR_GetNextInstance(dm_node_t *node, dm_instances_t *inst, int *next_instance)
 {
     int i;
+    int start;
+    int end;
     int order;
-    int instance;
     int highest_instance=0;       // highest instance number encountered so far
     dm_instances_t *oi;
     dm_node_t *top_node;
@@ -298,21 +431,19 @@ int DM_INST_VECTOR_GetNextInstance(dm_node_t *node, dm_instances_t *inst, int *n
     top_node = inst->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the table of instance numbers, determining the highest instance number for the specified object
-    for (i=0; i < div->num_entries; i++)
+    // Find the range of entries containing the instances of the specified object (and their children)
+    // Since the entries are sorted by instance number, the highest instance number is the last one in the range
+    start = FindInstanceRange(div, inst, order+1, false, &end);
+    for (i=end-1; i >= start; i--)
     {
         oi = &div->vector[i];
-        if ((oi->order == order+1) &&
-            (memcmp(oi->nodes, inst->nodes, (order+1)*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
+        if (oi->order == order+1)
         {
-            instance = oi->instances[order];
-            if (instance > highest_instance)
-            {
-                highest_instance = instance;
-            }
+            highest_instance = oi->instances[order];
+            break;
         }
     }
 
@@ -337,9 +468,10 @@ int DM_INST_VECTOR_GetNextInstance(dm_node_t *node, dm_instances_t *inst, int *n
 int DM_INST_VECTOR_GetNumInstances(dm_node_t *node, dm_instances_t *inst)
 {
     int i;
+    int start;
+    int end;
     int order;
     int count;
-    dm_instances_t *oi;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -351,16 +483,15 @@ int DM_INST_VECTOR_GetNumInstances(dm_node_t *node, dm_instances_t *inst)
     top_node = inst->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the table of instance numbers, determining the highest instance number for the specified object
+    // Iterate over the range of entries for the specified object, counting the instances of it (but not of its children)
     count = 0;
-    for (i=0; i < div->num_entries; i++)
+    start = FindInstanceRange(div, inst, order+1, false, &end);
+    for (i=start; i < end; i++)
     {
-        oi = &div->vector[i];
-        if ((oi->order == order+1) &&
-            (memcmp(oi->nodes, inst->nodes, (order+1)*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
+        if (div->vector[i].order == order+1)
         {
             count++;
         }
@@ -376,6 +507,7 @@ int DM_INST_VECTOR_GetNumInstances(dm_node_t *node, dm_instances_t *inst)
 ** DM_INST_VECTOR_GetInstances
 **
 ** Gets a vector of the instance numbers for the specified object (given it's parent instance numbers)
+** NOTE: The instance numbers are returned in ascending order
 **
 ** \param   node - pointer to object in data model
 ** \param   inst - pointer to instance structure specifying the object's parents and their instance numbers
@@ -387,11 +519,10 @@ int DM_INST_VECTOR_GetNumInstances(dm_node_t *node, dm_instances_t *inst)
 int DM_INST_VECTOR_GetInstances(dm_node_t *node, dm_instances_t *inst, int_vector_t *iv)
 {
     int i;
+    int start;
+    int end;
     int order;
     int instance;
-    dm_instances_t *oi;
-    int index;
-    int err;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -404,37 +535,174 @@ int DM_INST_VECTOR_GetInstances(dm_node_t *node, dm_instances_t *inst, int_vecto
     top_node = inst->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the instances array, finding the objects which match, and their instances
-    for (i=0; i < div->num_entries; i++)
+    // Exit if there are no instances of the specified object
+    start = FindInstanceRange(div, inst, order+1, false, &end);
+    if (end == start)
     {
-        oi = &div->vector[i];
-        if ((oi->order >= order+1) &&
-            (memcmp(oi->nodes, inst->nodes, (order+1)*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
-        {
-            instance = oi->instances[order];
+        goto exit;
+    }
 
-            // Add the instance to the array (if it has not been added already)
-            index = INT_VECTOR_Find(iv, instance);
-            if (index == INVALID)
-            {
-                // Exit if array is already full
-                err = INT_VECTOR_Add(iv, instance);
-                if (err != USP_ERR_OK)
-                {
-                    goto exit;
-                }
-            }
+    // Allocate the array of instance numbers in one go, sized for the worst case (every entry in the range being a different instance)
+    iv->vector = USP_MALLOC((end - start)*sizeof(int));
+
+    // Iterate over the range of entries for the specified object, finding its instances
+    for (i=start; i < end; i++)
+    {
+        instance = div->vector[i].instances[order];
+
+        // Add the instance to the array (if it has not been added already)
+        // NOTE: As the entries are sorted, duplicates of an instance number are adjacent
+        if ((iv->num_entries == 0) || (iv->vector[iv->num_entries-1] != instance))
+        {
+            iv->vector[iv->num_entries] = instance;
+            iv->num_entries++;
         }
     }
 
-    err = USP_ERR_OK;
-
 exit:
     inst->nodes[order] = NULL;          // Undo the changes made by this function to the inst array
-    return err;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_GetGeneration
+**
+** Returns the generation of the object instances in the data model
+** The generation changes whenever an object instance is added to or deleted from the data model
+**
+** \param   None
+**
+** \return  generation of the object instances (never 0, so callers may use 0 to denote 'not cached')
+**
+**************************************************************************/
+unsigned DM_INST_VECTOR_GetGeneration(void)
+{
+    return inst_generation;
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_RegisterRefresh
+**
+** Registers that the instances of the specified top level multi-instance object are read from the vendor
+** by its refresh instances callback, the first time that they are accessed after they have become stale
+**
+** \param   top_node - top level multi-instance object node, whose refresh_instances_cb has been registered
+**
+** \return  None
+**
+**************************************************************************/
+void DM_INST_VECTOR_RegisterRefresh(dm_node_t *top_node)
+{
+    int i;
+    dm_object_info_t *info;
+
+    USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    USP_ASSERT(top_node->order == 1);
+
+    // Ensure that the instances are read the first time that they are accessed
+    info = &top_node->registered.object_info;
+    info->refresh_expiry_time = 0;
+    info->refresh_epoch = 0;
+
+    // Exit if this object has already been registered
+    for (i=0; i < num_refresh_nodes; i++)
+    {
+        if (refresh_nodes[i] == top_node)
+        {
+            return;
+        }
+    }
+
+    refresh_nodes = USP_REALLOC(refresh_nodes, (num_refresh_nodes+1)*sizeof(dm_node_t *));
+    refresh_nodes[num_refresh_nodes] = top_node;
+    num_refresh_nodes++;
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_RefreshInstance
+**
+** Adds the specified instance to the set of instances being collected by the refresh instances callback currently being called
+**
+** \param   inst - pointer to instance structure to add
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if not called from within the refresh instances callback of the instance's top level object
+**
+**************************************************************************/
+int DM_INST_VECTOR_RefreshInstance(dm_instances_t *inst)
+{
+    // Exit if not called from within a refresh instances callback, or the instance is not part of the object being refreshed
+    if ((refreshing_node == NULL) || (inst->order == 0) || (inst->nodes[0] != refreshing_node))
+    {
+        USP_ERR_SetMessage("%s: Must only be called from within the refresh instances callback of the object", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    InsertInstance(&refreshed_vector, inst);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_NextRefreshEpoch
+**
+** Called by the data model thread before processing each USP message (and each time around its main loop)
+** This allows the instances of objects with a refresh instances callback to be re-read (if stale) by the next access to them
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DM_INST_VECTOR_NextRefreshEpoch(void)
+{
+    refresh_epoch++;
+    if (refresh_epoch == 0)
+    {
+        refresh_epoch = 1;
+    }
+}
+
+/*********************************************************************//**
+**
+** DM_INST_VECTOR_IsRefreshDue
+**
+** Determines whether the instances of any object with a refresh instances callback have become stale
+** This is used to prevent Get worker threads from processing a USP message, as they must not modify the data model
+**
+** \param   None
+**
+** \return  true if accessing the instances of an object might cause them to be re-read from the vendor
+**
+**************************************************************************/
+bool DM_INST_VECTOR_IsRefreshDue(void)
+{
+    int i;
+    time_t cur_time;
+
+    // Exit if no objects have a refresh instances callback
+    if (num_refresh_nodes == 0)
+    {
+        return false;
+    }
+
+    cur_time = time(NULL);
+    for (i=0; i < num_refresh_nodes; i++)
+    {
+        if (cur_time >= refresh_nodes[i]->registered.object_info.refresh_expiry_time)
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 /*********************************************************************//**
@@ -486,8 +754,9 @@ void DM_INST_VECTOR_Dump(dm_instances_vector_t *div)
 void DM_INST_VECTOR_GetAllInstancePaths_Unqualified(dm_node_t *node, dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role)
 {
     int i;
+    int start;
+    int end;
     int order;
-    dm_instances_t *oi;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -499,18 +768,14 @@ void DM_INST_VECTOR_GetAllInstancePaths_Unqualified(dm_node_t *node, dm_instance
     top_node = inst->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the instances array, finding all objects which match, and their instances
-    for (i=0; i < div->num_entries; i++)
+    // Iterate over the range of entries containing all instances of the object, and their children
+    start = FindInstanceRange(div, inst, order+1, false, &end);
+    for (i=start; i < end; i++)
     {
-        oi = &div->vector[i];
-        if ((oi->order >= order+1) &&
-            (memcmp(oi->nodes, inst->nodes, (order+1)*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
-        {
-            AddObjectInstanceIfPermitted(oi, sv, combined_role);
-        }
+        AddObjectInstanceIfPermitted(&div->vector[i], sv, combined_role);
     }
 
     // Undo the changes made by this function to the inst array
@@ -536,8 +801,9 @@ void DM_INST_VECTOR_GetAllInstancePaths_Unqualified(dm_node_t *node, dm_instance
 void DM_INST_VECTOR_GetAllInstancePaths_Qualified(dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role)
 {
     int i;
+    int start;
+    int end;
     int order;
-    dm_instances_t *oi;
     dm_node_t *top_node;
     dm_instances_vector_t *div;
 
@@ -549,18 +815,14 @@ void DM_INST_VECTOR_GetAllInstancePaths_Qualified(dm_instances_t *inst, str_vect
     top_node = inst->nodes[0];
     USP_ASSERT(top_node != NULL);
     USP_ASSERT(top_node->type == kDMNodeType_Object_MultiInstance);
+    RefreshInstancesIfExpired(top_node);
     div = &top_node->registered.object_info.inst_vector;
 
-    // Iterate over the instances array, finding all objects which match, and their instances
-    for (i=0; i < div->num_entries; i++)
+    // Iterate over the range of entries containing the specified instance, and its children
+    start = FindInstanceRange(div, inst, order, true, &end);
+    for (i=start; i < end; i++)
     {
-        oi = &div->vector[i];
-        if ((oi->order >= order) &&
-            (memcmp(oi->nodes, inst->nodes, order*sizeof(dm_node_t *)) == 0) &&
-            (memcmp(oi->instances, inst->instances, order*sizeof(int)) == 0))
-        {
-            AddObjectInstanceIfPermitted(oi, sv, combined_role);
-        }
+        AddObjectInstanceIfPermitted(&div->vector[i], sv, combined_role);
     }
 }
 
@@ -599,6 +861,328 @@ void AddObjectInstanceIfPermitted(dm_instances_t *inst, str_vector_t *sv, combin
     STR_VECTOR_Add(sv, path);
 }
 
+/*********************************************************************//**
+**
+** CompareInstances
+**
+** qsort comparison function used to order instance structures by top level node, then
+** by each multi-instance object node and instance number in the path (parents before their children)
+** NOTE: Two instance structures compare as equal only if their order, nodes and instance numbers are all identical
+**
+** \param   p1 - pointer to first instance structure to compare
+** \param   p2 - pointer to second instance structure to compare
+**
+** \return  -1 if p1 should be ordered before p2, 1 if after, 0 if they are the same
+**
+**************************************************************************/
+int CompareInstances(const void *p1, const void *p2)
+{
+    const dm_instances_t *a = (const dm_instances_t *) p1;
+    const dm_instances_t *b = (const dm_instances_t *) p2;
+    uintptr_t node1;
+    uintptr_t node2;
+    int order;
+    int i;
+
+    order = MIN(a->order, b->order);
+    for (i=0; i < order; i++)
+    {
+        node1 = (uintptr_t) a->nodes[i];
+        node2 = (uintptr_t) b->nodes[i];
+        if (node1 != node2)
+        {
+            return (node1 < node2) ? -1 : 1;
+        }
+
+        if (a->instances[i] != b->instances[i])
+        {
+            return (a->instances[i] < b->instances[i]) ? -1 : 1;
+        }
+    }
+
+    // If the code gets here, then one instance is a parent of the other (or they are the same)
+    if (a->order != b->order)
+    {
+        return (a->order < b->order) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** ComparePrefix
+**
+** Compares the specified instance structure against a prefix of the specified key, using the same ordering as CompareInstances()
+** All instance structures which match the prefix are held contiguously in a sorted dm_instances_vector
+**
+** \param   oi - pointer to instance structure to compare
+** \param   key - pointer to instance structure containing the prefix to compare against
+** \param   order - number of multi-instance object nodes in the prefix
+** \param   match_last_instance - set if the instance number of the last node in the prefix must also match
+**                                (if not set, then any instance of the last node in the prefix matches)
+**
+** \return  -1 if oi is ordered before all instances matching the prefix, 1 if after, 0 if it matches the prefix
+**
+**************************************************************************/
+int ComparePrefix(dm_instances_t *oi, dm_instances_t *key, int order, bool match_last_instance)
+{
+    uintptr_t node1;
+    uintptr_t node2;
+    int i;
+
+    for (i=0; i < order; i++)
+    {
+        // Instance structures which are parents of the prefix are ordered before it
+        if (i >= oi->order)
+        {
+            return -1;
+        }
+
+        node1 = (uintptr_t) oi->nodes[i];
+        node2 = (uintptr_t) key->nodes[i];
+        if (node1 != node2)
+        {
+            return (node1 < node2) ? -1 : 1;
+        }
+
+        if (((i < order-1) || match_last_instance) && (oi->instances[i] != key->instances[i]))
+        {
+            return (oi->instances[i] < key->instances[i]) ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** FindInstanceRange
+**
+** Finds the range of entries in the sorted dm_instances_vector which match the specified prefix, using a binary search
+**
+** \param   div - pointer to dm_instances vector structure to search
+** \param   key - pointer to instance structure containing the prefix to match
+** \param   order - number of multi-instance object nodes in the prefix
+** \param   match_last_instance - set if the instance number of the last node in the prefix must also match
+** \param   end - pointer to variable in which to return the index of the entry after the last matching entry
+**
+** \return  index of the first matching entry. This is equal to the end index if there are no matching entries.
+**
+**************************************************************************/
+int FindInstanceRange(dm_instances_vector_t *div, dm_instances_t *key, int order, bool match_last_instance, int *end)
+{
+    int low;
+    int high;
+    int mid;
+    int start;
+
+    // Find the first entry which is not ordered before the prefix
+    low = 0;
+    high = div->num_entries;
+    while (low < high)
+    {
+        mid = low + (high - low)/2;
+        if (ComparePrefix(&div->vector[mid], key, order, match_last_instance) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    start = low;
+
+    // Find the first entry which is ordered after the prefix
+    high = div->num_entries;
+    while (low < high)
+    {
+        mid = low + (high - low)/2;
+        if (ComparePrefix(&div->vector[mid], key, order, match_last_instance) <= 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    *end = low;
+
+    return start;
+}
+
+/*********************************************************************//**
+**
+** InsertInstance
+**
+** Inserts the specified instance structure into the sorted dm_instances_vector, if it is not already present
+**
+** \param   div - pointer to dm_instances vector structure to insert into
+** \param   inst - pointer to instance structure to insert
+**
+** \return  true if the instance was inserted, false if it was already present
+**
+**************************************************************************/
+bool InsertInstance(dm_instances_vector_t *div, dm_instances_t *inst)
+{
+    int low;
+    int high;
+    int mid;
+
+    // Find the first entry which is not ordered before the instance
+    low = 0;
+    high = div->num_entries;
+    while (low < high)
+    {
+        mid = low + (high - low)/2;
+        if (CompareInstances(&div->vector[mid], inst) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    // Exit if this instance already exists
+    if ((low < div->num_entries) && (CompareInstances(&div->vector[low], inst) == 0))
+    {
+        return false;
+    }
+
+    // Otherwise insert this instance at its sorted position
+    EnsureInstVectorCapacity(div, div->num_entries + 1);
+    memmove(&div->vector[low+1], &div->vector[low], (div->num_entries - low)*sizeof(dm_instances_t));
+    memcpy(&div->vector[low], inst, sizeof(dm_instances_t));
+    div->num_entries++;
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** EnsureInstVectorCapacity
+**
+** Ensures that the dm_instances_vector has space allocated for at least the specified number of entries
+** NOTE: The allocated size is grown geometrically, so that adding instances one at a time does not reallocate every time
+**
+** \param   div - pointer to dm_instances vector structure
+** \param   num_entries - number of entries which the vector must be able to hold
+**
+** \return  None
+**
+**************************************************************************/
+void EnsureInstVectorCapacity(dm_instances_vector_t *div, int num_entries)
+{
+    int new_max;
+
+    // Exit if the vector is already large enough
+    if (num_entries <= div->max_entries)
+    {
+        return;
+    }
+
+    #define MIN_INST_VECTOR_SIZE 8
+    new_max = (div->max_entries == 0) ? MIN_INST_VECTOR_SIZE : div->max_entries;
+    while (new_max < num_entries)
+    {
+        new_max *= 2;
+    }
+
+    div->vector = USP_REALLOC(div->vector, new_max*sizeof(dm_instances_t));
+    div->max_entries = new_max;
+}
+
+/*********************************************************************//**
+**
+** IncrementInstanceGeneration
+**
+** Increments the generation of the object instances in the data model, skipping 0 on wraparound
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void IncrementInstanceGeneration(void)
+{
+    inst_generation++;
+    if (inst_generation == 0)
+    {
+        inst_generation = 1;
+    }
+}
 
+/*********************************************************************//**
+**
+** RefreshInstancesIfExpired
+**
+** Re-reads the instances of the specified top level multi-instance object from the vendor, if they have become stale
+** NOTE: The instances are only checked once per refresh epoch, and never by the Get worker threads (which only read the data model)
+**
+** \param   top_node - top level multi-instance object node, containing the instance vector to refresh
+**
+** \return  None
+**
+**************************************************************************/
+void RefreshInstancesIfExpired(dm_node_t *top_node)
+{
+    int err;
+    int expiry_period;
+    time_t cur_time;
+    dm_object_info_t *info;
+    dm_instances_vector_t *div;
 
+    // Exit if the instances of this object are not read using a refresh instances callback
+    info = &top_node->registered.object_info;
+    if (info->refresh_instances_cb == NULL)
+    {
+        return;
+    }
 
+    // Exit if the instances have already been checked in this epoch, or are being refreshed by a refresh instances callback
+    // or this is a Get worker thread (which must not modify the data model)
+    if ((info->refresh_epoch == refresh_epoch) || (refreshing_node != NULL) || (OS_UTILS_IsDataModelWorkerThread()))
+    {
+        return;
+    }
+    info->refresh_epoch = refresh_epoch;
+
+    // Exit if the instances have not become stale yet
+    cur_time = time(NULL);
+    if (cur_time < info->refresh_expiry_time)
+    {
+        return;
+    }
+
+    // Collect the current instances of the object from the vendor
+    refreshing_node = top_node;
+    DM_INST_VECTOR_Init(&refreshed_vector);
+    expiry_period = 0;
+    err = info->refresh_instances_cb(top_node->path, &expiry_period);
+    refreshing_node = NULL;
+
+    // Exit if the vendor failed to provide the instances, leaving the previous instances in the data model
+    // NOTE: The instances will be re-read in the next epoch
+    if (err != USP_ERR_OK)
+    {
+        USP_LOG_Warning("%s: Refresh instances callback for %s failed (err=%d). Using previous instances.", __FUNCTION__, top_node->path, err);
+        DM_INST_VECTOR_Destroy(&refreshed_vector);
+        return;
+    }
+
+    // Replace the instances of the object with the refreshed instances
+    div = &info->inst_vector;
+    DM_INST_VECTOR_Destroy(div);
+    memcpy(div, &refreshed_vector, sizeof(dm_instances_vector_t));
+    DM_INST_VECTOR_Init(&refreshed_vector);
+    info->refresh_expiry_time = cur_time + ((expiry_period > 0) ? expiry_period : 0);
+
+    // Instances held in the path resolver cache and unique key indexes are now stale
+    PATH_RESOLVER_InvalidateCache();
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+    IncrementInstanceGeneration();
+}
@@ -48,11 +48,18 @@
 void DM_INST_VECTOR_Init(dm_instances_vector_t *div);
 void DM_INST_VECTOR_Destroy(dm_instances_vector_t *div);
 int DM_INST_VECTOR_Add(dm_instances_t *inst);
+void DM_INST_VECTOR_AddBulk(dm_instances_t *insts, int num_insts);
 void DM_INST_VECTOR_Remove(dm_instances_t *inst);
+void DM_INST_VECTOR_RemoveAllInstances(dm_node_t *node, dm_instances_t *inst);
 bool DM_INST_VECTOR_IsExist(dm_instances_t *match);
 int DM_INST_VECTOR_GetNextInstance(dm_node_t *node, dm_instances_t *inst, int *next_instance);
 int DM_INST_VECTOR_GetNumInstances(dm_node_t *node, dm_instances_t *inst);
 int DM_INST_VECTOR_GetInstances(dm_node_t *node, dm_instances_t *inst, int_vector_t *iv);
+unsigned DM_INST_VECTOR_GetGeneration(void);
+void DM_INST_VECTOR_RegisterRefresh(dm_node_t *top_node);
+int DM_INST_VECTOR_RefreshInstance(dm_instances_t *inst);
+void DM_INST_VECTOR_NextRefreshEpoch(void);
+bool DM_INST_VECTOR_IsRefreshDue(void);
 void DM_INST_VECTOR_GetAllInstancePaths_Unqualified(dm_node_t *node, dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role);
 void DM_INST_VECTOR_GetAllInstancePaths_Qualified(dm_instances_t *inst, str_vector_t *sv, combined_role_t *combined_role);
 void DM_INST_VECTOR_Dump(dm_instances_vector_t *div);
@@ -44,12 +44,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "common_defs.h"
 #include "dm_trans.h"
 #include "database.h"
 #include "device.h"
 #include "dm_inst_vector.h"
+#include "path_resolver.h"
 #include "vendor_api.h"
 
 
@@ -58,6 +60,12 @@
 // Current transaction to add operations to
 static dm_trans_vector_t *cur_transaction = NULL;
 
+//--------------------------------------------------------------------
+// Initial number of entries allocated in the transaction vector, and minimum number of slots in the table of added object instances
+// NOTE: The table of added object instances is sized to keep it at most half full
+#define MIN_TRANS_ENTRIES 16
+#define MIN_ADDED_SLOTS 32
+
 //--------------------------------------------------------------------
 // Array used to convert an enumeration to a string, for debug purposes
 static const char *op_to_str[kDMOp_Max] =
@@ -70,6 +78,10 @@ static const char *op_to_str[kDMOp_Max] =
 //--------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void ClearTransaction(dm_trans_vector_t *trans);
+int CommitGroupedSets(dm_trans_vector_t *trans);
+bool IsWithinAddedInstance(dm_trans_vector_t *trans, dm_instances_t *inst);
+void AddToAddedTable(dm_trans_vector_t *trans, int index);
+unsigned CalcAddedInstanceHash(dm_node_t *obj_node, int *instances, int order);
 
 /*********************************************************************//**
 **
@@ -85,12 +97,22 @@ void ClearTransaction(dm_trans_vector_t *trans);
 **************************************************************************/
 int DM_TRANS_Start(dm_trans_vector_t *trans)
 {
+    int i;
     int err;
     dm_vendor_start_trans_cb_t   start_trans_cb;
 
     // Initialise the vector of operations to notify
     trans->num_entries = 0;
+    trans->max_entries = 0;
     trans->vector = NULL;
+    trans->added_table = NULL;
+    trans->added_table_size = 0;
+    trans->num_added = 0;
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
+    {
+        KV_VECTOR_Init(&trans->group_sets[i]);
+        STR_SET_Init(&trans->group_sets_index[i]);
+    }
 
     // Save this vector - it will be used when adding all subsequent operations
     USP_ASSERT(cur_transaction == NULL);
@@ -146,48 +168,35 @@ int DM_TRANS_Start(dm_trans_vector_t *trans)
 **************************************************************************/
 void DM_TRANS_Add(dm_op_t op, char *path, char *value, dm_val_union_t *val_union, dm_node_t *node, dm_instances_t *inst)
 {
-    int new_num_entries;
+    int index;
     dm_trans_t *dt;
-    int i;
 
     USP_ASSERT(cur_transaction != NULL);
 
     // Do not add set operations, if they are part of a larger add operation - we only want to notify the add
     // NOTE: When processing a USP AddRequest message, default values are not added to the transaction, only the overridden default values (in the USP AddRequest message)
-    if (op == kDMOp_Set)
+    if ((op == kDMOp_Set) && (IsWithinAddedInstance(cur_transaction, inst)))
     {
-        // Iterate over all operations, seeing if any were an add operation
-        for (i=0; i < cur_transaction->num_entries; i++)
-        {
-            dt = &cur_transaction->vector[i];
-            if (dt->op == kDMOp_Add)
-            {
-                if (inst->order >= dt->inst.order)
-                {
-                    // If this set is for a parameter whose parent instances match that of the add, then do not add to transaction
-                    if ( (memcmp(inst->nodes, dt->node->instance_nodes, (dt->inst.order)*sizeof(dm_node_t *)) == 0) &&
-                         (memcmp(inst->instances, dt->inst.instances, (dt->inst.order)*sizeof(int)) == 0) )
-                    {
-                        return;
-                    }
-                }
-            }
-        }
+        return;
     }
 
     // For us to detect that a delete operation matches a resolved path, we need to resolve the list of
     // ObjectDeletion notify objects, whilst the objects are still in the data model
     if (op == kDMOp_Del)
     {
-        DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths();
+        DEVICE_SUBSCRIPTION_ResolveObjectDeletionPaths(path);
     }
 
-    // Increase the size of the current transaction vector
-    new_num_entries = cur_transaction->num_entries + 1;
-    cur_transaction->vector = USP_REALLOC(cur_transaction->vector, new_num_entries * sizeof(dm_trans_t));
+    // Increase the size of the current transaction vector, if it is full
+    if (cur_transaction->num_entries == cur_transaction->max_entries)
+    {
+        cur_transaction->max_entries = (cur_transaction->max_entries == 0) ? MIN_TRANS_ENTRIES : 2*cur_transaction->max_entries;
+        cur_transaction->vector = USP_REALLOC(cur_transaction->vector, cur_transaction->max_entries * sizeof(dm_trans_t));
+    }
 
     // And store this operation
-    dt = &cur_transaction->vector[ new_num_entries-1 ];
+    index = cur_transaction->num_entries;
+    dt = &cur_transaction->vector[index];
     dt->op = op;
     dt->path = USP_STRDUP(path);
     dt->node = node;
@@ -209,7 +218,44 @@ void DM_TRANS_Add(dm_op_t op, char *path, char *value, dm_val_union_t *val_union
         memset(&dt->val_union, 0, sizeof(dt->val_union));
     }
 
-    cur_transaction->num_entries = new_num_entries;
+    cur_transaction->num_entries = index + 1;
+
+    // Record added object instances, so that subsequent sets of their parameters are not added to the transaction
+    if (op == kDMOp_Add)
+    {
+        AddToAddedTable(cur_transaction, index);
+    }
+}
+
+/*********************************************************************//**
+**
+** DM_TRANS_AddGroupedSet
+**
+** Adds a set of a grouped vendor parameter to the current transaction
+** The set is applied (together with all other sets of parameters in the same group) when the transaction is committed
+**
+** \param   group_id - group that the parameter belongs to
+** \param   path - pointer to full data model path to parameter
+** \param   value - pointer to string containing the value to set
+**
+** \return  None
+**
+**************************************************************************/
+void DM_TRANS_AddGroupedSet(int group_id, char *path, char *value)
+{
+    kv_vector_t *group_sets;
+    bool is_replaced;
+
+    USP_ASSERT(cur_transaction != NULL);
+    USP_ASSERT((group_id >= 0) && (group_id < MAX_VENDOR_PARAM_GROUPS));
+
+    // Only the last value set for a parameter in the transaction is applied
+    group_sets = &cur_transaction->group_sets[group_id];
+    is_replaced = KV_VECTOR_ReplaceIndexed(group_sets, &cur_transaction->group_sets_index[group_id], path, value);
+    if (is_replaced == false)
+    {
+        KV_VECTOR_Add(group_sets, path, value);
+    }
 }
 
 /*********************************************************************//**
@@ -237,6 +283,14 @@ int DM_TRANS_Commit(void)
 
     USP_ASSERT(cur_transaction != NULL);
 
+    // Exit if unable to set the grouped vendor parameters, aborting the transaction
+    err = CommitGroupedSets(cur_transaction);
+    if (err != USP_ERR_OK)
+    {
+        DM_TRANS_Abort();
+        return err;
+    }
+
 #ifdef ENABLE_HIDL
     // Exit if unable to commit a HIDL client transaction 
     err = HIDL_CommitTransaction();
@@ -272,6 +326,7 @@ int DM_TRANS_Commit(void)
     // Exit if there are no operations in the transaction
     if (cur_transaction->num_entries == 0)
     {
+        ClearTransaction(cur_transaction);
         cur_transaction = NULL;
         return USP_ERR_OK;
     }
@@ -407,7 +462,7 @@ int DM_TRANS_Abort(void)
             // Form object instances array
             memset(&inst, 0, sizeof(inst));
             memcpy(&inst, &dt->inst, sizeof(dt->inst));
-            memcpy(&inst.nodes, &node->instance_nodes, node->order*sizeof(dm_node_t *));
+            memcpy(&inst.nodes, node->instance_nodes, node->order*sizeof(dm_node_t *));
     
             if (dt->op == kDMOp_Add)
             {
@@ -427,6 +482,9 @@ int DM_TRANS_Abort(void)
 
     cur_transaction = NULL;
 
+    // Unique key parameters set in the transaction revert to their previous values when the database transaction is rolled back
+    PATH_RESOLVER_InvalidateUniqueKeyIndexes();
+
 #ifdef ENABLE_HIDL
     // Exit if unable to abort a HIDL client transaction 
     err = HIDL_AbortTransaction();
@@ -497,6 +555,13 @@ void ClearTransaction(dm_trans_vector_t *trans)
     int i;
     dm_trans_t *dt;
 
+    // Free all pending sets of grouped vendor parameters
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
+    {
+        KV_VECTOR_Destroy(&trans->group_sets[i]);
+        STR_SET_Destroy(&trans->group_sets_index[i]);
+    }
+
     // Exit if nothing to do
     if (trans->vector == NULL)
     {
@@ -516,32 +581,213 @@ void ClearTransaction(dm_trans_vector_t *trans)
 
 exit:
     // Ensure queue is re-initialised to empty state
+    USP_SAFE_FREE(trans->added_table);
     trans->vector = NULL;
     trans->num_entries = 0;
+    trans->max_entries = 0;
+    trans->added_table_size = 0;
+    trans->num_added = 0;
 }
 
+/*********************************************************************//**
+**
+** CommitGroupedSets
+**
+** Applies all pending sets of grouped vendor parameters in the transaction,
+** calling each group's set callback once with all of the parameters set in that group
+** NOTE: If a group's set callback fails, the sets of groups which have already been applied are not undone
+**
+** \param   trans - transaction containing the pending sets
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int CommitGroupedSets(dm_trans_vector_t *trans)
+{
+    int i;
+    int err;
+    kv_vector_t *group_sets;
+    dm_set_group_cb_t set_group_cb;
 
+    for (i=0; i < MAX_VENDOR_PARAM_GROUPS; i++)
+    {
+        // Skip groups which have not been set in this transaction
+        group_sets = &trans->group_sets[i];
+        if (group_sets->num_entries == 0)
+        {
+            continue;
+        }
 
+        // Exit if no set callback has been registered for the group
+        set_group_cb = group_set_callbacks[i];
+        if (set_group_cb == NULL)
+        {
+            USP_ERR_SetMessage("%s: No set callback registered for group %d (path=%s)", __FUNCTION__, i, group_sets->vector[0].key);
+            return USP_ERR_INTERNAL_ERROR;
+        }
 
+        // Exit if unable to set the parameters in the vendor code
+        USP_ERR_ClearMessage();
+        err = set_group_cb(i, group_sets);
+        if (err != USP_ERR_OK)
+        {
+            USP_ERR_ReplaceEmptyMessage("%s: Set callback for group %d returned error %d", __FUNCTION__, i, err);
+            return err;
+        }
 
+        // Remove the sets which have been applied, so that they are not applied again
+        KV_VECTOR_Destroy(group_sets);
+        STR_SET_Destroy(&trans->group_sets_index[i]);
+    }
 
+    return USP_ERR_OK;
+}
 
+/*********************************************************************//**
+**
+** IsWithinAddedInstance
+**
+** Determines whether the specified instance numbers are within (or are) an object instance added in the transaction
+** ie whether a set of a parameter with these instance numbers is part of a larger add operation
+**
+** \param   trans - transaction containing the add operations
+** \param   inst - pointer to instance numbers (and their associated multi-instance object nodes) of a parameter
+**
+** \return  true if the parameter is in an object instance added in the transaction
+**
+**************************************************************************/
+bool IsWithinAddedInstance(dm_trans_vector_t *trans, dm_instances_t *inst)
+{
+    int order;
+    unsigned hash;
+    unsigned mask;
+    unsigned i;
+    dm_trans_added_slot_t *slot;
+    dm_trans_t *dt;
 
+    // Exit if no object instances have been added in this transaction
+    if (trans->num_added == 0)
+    {
+        return false;
+    }
 
+    // Iterate over all object instances which the parameter is within, seeing if any of them were added
+    // NOTE: As the multi-instance object node determines all of its parent multi-instance object nodes, only the last node needs to match
+    mask = trans->added_table_size - 1;
+    for (order=1; order <= inst->order; order++)
+    {
+        hash = CalcAddedInstanceHash(inst->nodes[order-1], inst->instances, order);
+        i = hash & mask;
+        slot = &trans->added_table[i];
+        while (slot->index != INVALID)
+        {
+            if (slot->hash == hash)
+            {
+                dt = &trans->vector[slot->index];
+                if ((dt->inst.order == order) && (dt->node->instance_nodes[order-1] == inst->nodes[order-1]) &&
+                    (memcmp(inst->instances, dt->inst.instances, order*sizeof(int)) == 0))
+                {
+                    return true;
+                }
+            }
 
+            i = (i + 1) & mask;
+            slot = &trans->added_table[i];
+        }
+    }
 
+    return false;
+}
 
+/*********************************************************************//**
+**
+** AddToAddedTable
+**
+** Adds an add operation to the hash table of object instances added in the transaction
+** The table is grown (and all add operations re-added) if it would become more than half full
+**
+** \param   trans - transaction containing the add operation
+** \param   index - index of the add operation in the transaction vector
+**
+** \return  None
+**
+**************************************************************************/
+void AddToAddedTable(dm_trans_vector_t *trans, int index)
+{
+    int i;
+    int new_size;
+    unsigned hash;
+    unsigned mask;
+    unsigned j;
+    dm_trans_t *dt;
+    dm_trans_added_slot_t *slot;
 
+    // Grow the table, if necessary, re-adding all add operations before this one
+    if (2*(trans->num_added+1) > trans->added_table_size)
+    {
+        new_size = (trans->added_table_size == 0) ? MIN_ADDED_SLOTS : 2*trans->added_table_size;
+        USP_SAFE_FREE(trans->added_table);
+        trans->added_table = USP_MALLOC(new_size*sizeof(dm_trans_added_slot_t));
+        trans->added_table_size = new_size;
+        trans->num_added = 0;
+        for (i=0; i < new_size; i++)
+        {
+            trans->added_table[i].index = INVALID;
+        }
 
+        for (i=0; i < index; i++)
+        {
+            if (trans->vector[i].op == kDMOp_Add)
+            {
+                AddToAddedTable(trans, i);
+            }
+        }
+    }
 
+    // Add the operation into the first unused slot
+    dt = &trans->vector[index];
+    USP_ASSERT(dt->inst.order > 0);
+    hash = CalcAddedInstanceHash(dt->node->instance_nodes[dt->inst.order-1], dt->inst.instances, dt->inst.order);
+    mask = trans->added_table_size - 1;
+    j = hash & mask;
+    slot = &trans->added_table[j];
+    while (slot->index != INVALID)
+    {
+        j = (j + 1) & mask;
+        slot = &trans->added_table[j];
+    }
 
+    slot->hash = hash;
+    slot->index = index;
+    trans->num_added++;
+}
 
+/*********************************************************************//**
+**
+** CalcAddedInstanceHash
+**
+** Calculates the hash of an object instance, used by the table of object instances added in the transaction
+**
+** \param   obj_node - pointer to multi-instance object node
+** \param   instances - array of instance numbers of the object instance (and its parents)
+** \param   order - number of instance numbers in the array
+**
+** \return  hash of the object instance
+**
+**************************************************************************/
+unsigned CalcAddedInstanceHash(dm_node_t *obj_node, int *instances, int order)
+{
+    int i;
+    unsigned hash;
 
+    // FNV-1a style hash, of the node pointer followed by the instance numbers
+    hash = 2166136261u ^ (unsigned)(((uintptr_t)obj_node) >> 4);
+    hash *= 16777619u;
+    for (i=0; i < order; i++)
+    {
+        hash ^= (unsigned)instances[i];
+        hash *= 16777619u;
+    }
 
-
-
-
-
-
-
-
+    return hash;
+}
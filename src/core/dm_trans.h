@@ -69,18 +69,34 @@ typedef struct
     dm_val_union_t val_union;  // Stores the native value of the parameter (only used by kTransType_Set). If the parameter is a string, then it will point to the 'value' parameter in this structure
 } dm_trans_t;
 
+//-----------------------------------------------------------------------
+// Slot in the hash table used to find whether an object instance has been added in the transaction
+typedef struct
+{
+    unsigned hash;      // Hash of the object node and instance numbers of the added object instance
+    int index;          // Index of the kDMOp_Add operation in the transaction vector, or INVALID if this slot is unused
+} dm_trans_added_slot_t;
+
 //-----------------------------------------------------------------------
 // Vector storing all operations made during a transaction
 typedef struct
 {
     int num_entries;
+    int max_entries;        // Number of entries allocated in the vector. The vector grows geometrically, so that adding operations takes amortised constant time
     dm_trans_t *vector;
+    dm_trans_added_slot_t *added_table;  // Open addressing hash table of the object instances added in this transaction, used to
+                                         // determine in constant time whether a set is of a parameter in an added object instance
+    int added_table_size;   // Number of slots in the table (always a power of 2, or 0 if the table has not been allocated)
+    int num_added;          // Number of kDMOp_Add operations in the table
+    kv_vector_t group_sets[MAX_VENDOR_PARAM_GROUPS];  // Pending sets of grouped vendor parameters (indexed by group_id). These are applied when the transaction is committed
+    str_set_t group_sets_index[MAX_VENDOR_PARAM_GROUPS]; // Hash index of the parameter paths in each of group_sets
 } dm_trans_vector_t;
 
 //-----------------------------------------------------------------------------------------
 // API
 int DM_TRANS_Start(dm_trans_vector_t *trans);
 void DM_TRANS_Add(dm_op_t op, char *path, char *value, dm_val_union_t *val_union, dm_node_t *node, dm_instances_t *inst);
+void DM_TRANS_AddGroupedSet(int group_id, char *path, char *value);
 int DM_TRANS_Commit(void);
 int DM_TRANS_Abort(void);
 bool DM_TRANS_IsWithinTransaction(void);
@@ -0,0 +1,560 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file dns_cache.c
+ *
+ * Implements a cache of the IP addresses of the hostnames of STOMP brokers and CoAP controllers
+ * Hostnames are resolved asynchronously (using c-ares) by a task running on the core pool of worker threads,
+ * so that a slow or unreachable DNS server does not stall the MTP threads. Whilst a lookup is in progress,
+ * DNS_CACHE_LookupHost() indicates that the lookup is pending. When the lookup completes, all MTP threads are woken up,
+ * so that they can retry the lookup (which is then satisfied from the cache)
+ * Results are cached for the TTL of the DNS records (clamped between DNS_CACHE_MIN_TTL and DNS_CACHE_MAX_TTL).
+ * Failed lookups are cached for DNS_CACHE_NEGATIVE_TTL, so that a failing DNS server is not hammered by retries
+ *
+ */
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <ares.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "os_utils.h"
+#include "mtp_exec.h"
+#include "dns_cache.h"
+
+//------------------------------------------------------------------------------
+// State of a cached hostname lookup
+typedef enum
+{
+    kDnsLookup_Unused,          // This cache entry is not in use
+    kDnsLookup_Pending,         // The hostname is currently being looked up by a worker thread
+    kDnsLookup_Resolved,        // The hostname was resolved successfully
+    kDnsLookup_Failed,          // The hostname could not be resolved
+} dns_lookup_state_t;
+
+//------------------------------------------------------------------------------
+// Cached result of looking up a hostname
+typedef struct
+{
+    dns_lookup_state_t state;
+    char *host;                 // Hostname that was looked up
+    nu_ipaddr_t addrs[NU_MAX_HOST_ADDRS]; // IP addresses of the host, in the order returned by the DNS lookup
+    int num_addrs;              // Number of IP addresses in addrs[]
+    int status;                 // c-ares status of the lookup. Used to report why a lookup failed
+    time_t expiry_time;         // Time at which the cached result expires, and the hostname must be looked up again. Not valid whilst pending
+    time_t last_used_time;      // Time at which this entry was last looked up. Used to choose which entry to evict when the cache is full
+} dns_cache_entry_t;
+
+static dns_cache_entry_t dns_cache[DNS_CACHE_ENTRIES];
+
+//------------------------------------------------------------------------------
+// Mutex protecting the cache. The cache is accessed by the MTP threads, the data model thread and the worker threads performing lookups
+static pthread_mutex_t dns_cache_mutex;
+
+//------------------------------------------------------------------------------
+// Result of a lookup, filled in by the c-ares callback
+typedef struct
+{
+    int status;
+    nu_ipaddr_t addrs[NU_MAX_HOST_ADDRS];
+    int num_addrs;
+    int ttl;
+} dns_lookup_result_t;
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+dns_cache_entry_t *FindDnsCacheEntry(const char *host);
+dns_cache_entry_t *AllocDnsCacheEntry(const char *host);
+int StartDnsLookup(dns_cache_entry_t *entry);
+void DnsLookupTask(void *arg);
+void ResolveHostname(char *host, dns_lookup_result_t *result);
+void DnsLookupCallback(void *arg, int status, int timeouts, struct ares_addrinfo *res);
+
+/*********************************************************************//**
+**
+** DNS_CACHE_Init
+**
+** Initialises the functionality in this module
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int DNS_CACHE_Init(void)
+{
+    int err;
+
+    memset(dns_cache, 0, sizeof(dns_cache));
+
+    // Exit if unable to create the mutex protecting the cache
+    err = OS_UTILS_InitMutex(&dns_cache_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if unable to initialise the c-ares library
+    err = ares_library_init(ARES_LIB_INIT_ALL);
+    if (err != ARES_SUCCESS)
+    {
+        USP_ERR_SetMessage("%s: ares_library_init() failed: %s", __FUNCTION__, ares_strerror(err));
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DNS_CACHE_LookupHost
+**
+** Looks up the specified hostname, converting it into a nu_ipaddr_t IP address structure
+** This function never blocks waiting for a DNS server. If the hostname is not in the cache (or its cached result has expired),
+** then a lookup is started on a worker thread, and is_pending is set. The caller should call this function again after
+** its MTP thread has been woken up (which occurs when the lookup completes)
+** See nu_ipaddr_order_host_addrs() for how the IP address is chosen, if the host has more than one
+** This function may be called from any thread
+**
+** \param   host - pointer to string containing hostname (or IP literal address) to lookup
+** \param   acs_family_pref - The address family that the ACS requires for the Hostname resolution (AF_UNSPEC = don't care)
+** \param   prefer_ipv6 - Set to true if we prefer an IPv6 address (and CPE is dual stack, so we have a choice)
+** \param   acs_ipaddr_to_bind_to - IP address that the ACS has specified that should be used to contact the remote host (don't care = NULL or the zero address)
+** \param   dst - pointer to structure in which to return the IP address of the remote host
+** \param   is_pending - pointer to variable in which to return whether the lookup is still in progress (in which case dst is not set)
+**
+** \return  USP_ERR_OK if successful, or the lookup is pending
+**
+**************************************************************************/
+int DNS_CACHE_LookupHost(const char *host, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *dst, bool *is_pending)
+{
+    int err;
+    nu_ipaddr_t ordered[NU_MAX_HOST_ADDRS];
+    int num_ordered;
+
+    err = DNS_CACHE_LookupHostAddrs(host, acs_family_pref, prefer_ipv6, acs_ipaddr_to_bind_to, ordered, &num_ordered, is_pending);
+    if ((err != USP_ERR_OK) || (*is_pending))
+    {
+        return err;
+    }
+
+    memcpy(dst, &ordered[0], sizeof(nu_ipaddr_t));
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DNS_CACHE_LookupHostAddrs
+**
+** Looks up the specified hostname, returning all of its IP addresses that may be used, in the order in which they should be tried
+** (see nu_ipaddr_order_host_addrs()). This is used by callers which race connections to several addresses (RFC 8305)
+** Like DNS_CACHE_LookupHost(), this function never blocks waiting for a DNS server
+**
+** \param   host - pointer to string containing hostname (or IP literal address) to lookup
+** \param   acs_family_pref - The address family that the ACS requires for the Hostname resolution (AF_UNSPEC = don't care)
+** \param   prefer_ipv6 - Set to true if we prefer an IPv6 address (and CPE is dual stack, so we have a choice)
+** \param   acs_ipaddr_to_bind_to - IP address that the ACS has specified that should be used to contact the remote host (don't care = NULL or the zero address)
+** \param   ordered - pointer to array (of at least NU_MAX_HOST_ADDRS entries) in which to return the IP addresses of the remote host
+** \param   num_ordered - pointer to variable in which to return the number of IP addresses returned (at least 1, if successful)
+** \param   is_pending - pointer to variable in which to return whether the lookup is still in progress (in which case no addresses are returned)
+**
+** \return  USP_ERR_OK if successful, or the lookup is pending
+**
+**************************************************************************/
+int DNS_CACHE_LookupHostAddrs(const char *host, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *ordered, int *num_ordered, bool *is_pending)
+{
+    int err;
+    dns_cache_entry_t *entry;
+    nu_ipaddr_t literal_addr;
+    nu_ipaddr_t addrs[NU_MAX_HOST_ADDRS];
+    int num_addrs;
+    int status;
+    time_t cur_time;
+
+    *is_pending = false;
+    *num_ordered = 0;
+
+    // Exit if the host is an IP literal address (ie no DNS lookup required)
+    err = nu_ipaddr_from_str(host, &literal_addr);
+    if (err == USP_ERR_OK)
+    {
+        return nu_ipaddr_order_host_addrs(host, &literal_addr, 1, acs_family_pref, prefer_ipv6, acs_ipaddr_to_bind_to, ordered, num_ordered);
+    }
+
+    OS_UTILS_LockMutex(&dns_cache_mutex);
+    cur_time = time(NULL);
+
+    // Start a lookup, if the hostname is not in the cache
+    entry = FindDnsCacheEntry(host);
+    if (entry == NULL)
+    {
+        entry = AllocDnsCacheEntry(host);
+        if (entry == NULL)
+        {
+            err = USP_ERR_RESOURCES_EXCEEDED;
+            goto exit;
+        }
+
+        err = StartDnsLookup(entry);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+    else if ((entry->state != kDnsLookup_Pending) && (cur_time >= entry->expiry_time))
+    {
+        // Start a new lookup (reusing the cache entry), if the cached result has expired
+        err = StartDnsLookup(entry);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+    entry->last_used_time = cur_time;
+
+    // Exit if the lookup is still in progress
+    if (entry->state == kDnsLookup_Pending)
+    {
+        *is_pending = true;
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Copy the cached result, so that the IP address can be chosen without holding the mutex
+    memcpy(addrs, entry->addrs, entry->num_addrs*sizeof(nu_ipaddr_t));
+    num_addrs = entry->num_addrs;
+    status = entry->status;
+    OS_UTILS_UnlockMutex(&dns_cache_mutex);
+
+    // Exit if the lookup failed
+    if (num_addrs == 0)
+    {
+        USP_ERR_SetMessage("%s(%s): failed to resolve: %s", __FUNCTION__, host, ares_strerror(status));
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Order the IP addresses to use from the results
+    return nu_ipaddr_order_host_addrs(host, addrs, num_addrs, acs_family_pref, prefer_ipv6, acs_ipaddr_to_bind_to, ordered, num_ordered);
+
+exit:
+    OS_UTILS_UnlockMutex(&dns_cache_mutex);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** FindDnsCacheEntry
+**
+** Finds the cache entry for the specified hostname
+** NOTE: This function must be called with the DNS cache mutex held
+**
+** \param   host - hostname to find
+**
+** \return  pointer to cache entry, or NULL if the hostname is not in the cache
+**
+**************************************************************************/
+dns_cache_entry_t *FindDnsCacheEntry(const char *host)
+{
+    int i;
+    dns_cache_entry_t *entry;
+
+    for (i=0; i<DNS_CACHE_ENTRIES; i++)
+    {
+        entry = &dns_cache[i];
+        if ((entry->state != kDnsLookup_Unused) && (strcmp(entry->host, host)==0))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** AllocDnsCacheEntry
+**
+** Allocates a cache entry for the specified hostname, evicting the least recently used completed lookup, if the cache is full
+** NOTE: This function must be called with the DNS cache mutex held
+**
+** \param   host - hostname which the cache entry is for
+**
+** \return  pointer to cache entry, or NULL if all cache entries have lookups in progress
+**
+**************************************************************************/
+dns_cache_entry_t *AllocDnsCacheEntry(const char *host)
+{
+    int i;
+    dns_cache_entry_t *entry;
+    dns_cache_entry_t *lru_entry = NULL;
+
+    // Find an unused entry, or failing that, the least recently used entry which does not have a lookup in progress
+    for (i=0; i<DNS_CACHE_ENTRIES; i++)
+    {
+        entry = &dns_cache[i];
+        if (entry->state == kDnsLookup_Unused)
+        {
+            lru_entry = entry;
+            break;
+        }
+
+        if ((entry->state != kDnsLookup_Pending) && ((lru_entry == NULL) || (entry->last_used_time < lru_entry->last_used_time)))
+        {
+            lru_entry = entry;
+        }
+    }
+
+    // Exit if all entries have lookups in progress
+    if (lru_entry == NULL)
+    {
+        USP_ERR_SetMessage("%s: Unable to lookup %s. Too many DNS lookups in progress (max=%d)", __FUNCTION__, host, DNS_CACHE_ENTRIES);
+        return NULL;
+    }
+
+    // Evict the entry which was previously using this slot
+    USP_SAFE_FREE(lru_entry->host);
+    memset(lru_entry, 0, sizeof(dns_cache_entry_t));
+    lru_entry->host = USP_STRDUP((char *)host);
+
+    return lru_entry;
+}
+
+/*********************************************************************//**
+**
+** StartDnsLookup
+**
+** Queues a task on the worker thread pool to lookup the hostname of the specified cache entry
+** NOTE: This function must be called with the DNS cache mutex held
+**
+** \param   entry - cache entry containing the hostname to lookup
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartDnsLookup(dns_cache_entry_t *entry)
+{
+    int err;
+    char *host;
+
+    // Exit if unable to queue the lookup. The failure is cached, so that the lookup is not retried immediately
+    host = USP_STRDUP(entry->host);
+    err = USP_TASK_Queue(DnsLookupTask, host, kUspTaskPriority_High);
+    if (err != USP_ERR_OK)
+    {
+        USP_FREE(host);
+        entry->state = kDnsLookup_Failed;
+        entry->num_addrs = 0;
+        entry->status = ARES_ENOMEM;
+        entry->expiry_time = time(NULL) + DNS_CACHE_NEGATIVE_TTL;
+        return err;
+    }
+
+    entry->state = kDnsLookup_Pending;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DnsLookupTask
+**
+** Task run on a worker thread to lookup a hostname, storing the result in the cache, then waking up the MTP threads
+**
+** \param   arg - hostname to lookup. Ownership of this string passes to this function
+**
+** \return  None
+**
+**************************************************************************/
+void DnsLookupTask(void *arg)
+{
+    char *host = (char *)arg;
+    dns_lookup_result_t result;
+    dns_cache_entry_t *entry;
+    int ttl;
+
+    // Perform the lookup, without holding the mutex
+    ResolveHostname(host, &result);
+
+    // Clamp the TTL of the result, or cache failures for a fixed period
+    if (result.num_addrs > 0)
+    {
+        ttl = MIN(MAX(result.ttl, DNS_CACHE_MIN_TTL), DNS_CACHE_MAX_TTL);
+        USP_LOG_Debug("%s: Resolved %s (%d addresses, ttl=%d)", __FUNCTION__, host, result.num_addrs, ttl);
+    }
+    else
+    {
+        ttl = DNS_CACHE_NEGATIVE_TTL;
+        USP_LOG_Warning("%s: Unable to resolve %s: %s", __FUNCTION__, host, ares_strerror(result.status));
+    }
+
+    // Store the result in the cache (if the cache entry still exists)
+    OS_UTILS_LockMutex(&dns_cache_mutex);
+    entry = FindDnsCacheEntry(host);
+    if ((entry != NULL) && (entry->state == kDnsLookup_Pending))
+    {
+        memcpy(entry->addrs, result.addrs, result.num_addrs*sizeof(nu_ipaddr_t));
+        entry->num_addrs = result.num_addrs;
+        entry->status = result.status;
+        entry->state = (result.num_addrs > 0) ? kDnsLookup_Resolved : kDnsLookup_Failed;
+        entry->expiry_time = time(NULL) + ttl;
+    }
+    OS_UTILS_UnlockMutex(&dns_cache_mutex);
+    USP_FREE(host);
+
+    // Cause all MTP threads to retry the lookups that they are waiting on
+    MTP_EXEC_WakeupAll();
+}
+
+/*********************************************************************//**
+**
+** ResolveHostname
+**
+** Looks up the IP addresses of the specified hostname, blocking until the lookup has completed
+** Each lookup uses its own c-ares channel, so that changes to the resolver configuration are picked up
+**
+** \param   host - hostname to lookup
+** \param   result - pointer to structure in which to return the result of the lookup
+**
+** \return  None. If the lookup failed, then result->num_addrs is 0, and result->status contains the reason
+**
+**************************************************************************/
+void ResolveHostname(char *host, dns_lookup_result_t *result)
+{
+    int err;
+    ares_channel channel;
+    struct ares_addrinfo_hints hints;
+    fd_set readfds;
+    fd_set writefds;
+    struct timeval tv;
+    struct timeval *tvp;
+    int nfds;
+
+    memset(result, 0, sizeof(dns_lookup_result_t));
+
+    // Exit if unable to create a channel to perform the lookup
+    err = ares_init(&channel);
+    if (err != ARES_SUCCESS)
+    {
+        result->status = err;
+        return;
+    }
+
+    // Lookup both IPv4 and IPv6 addresses. The address family to use is chosen by nu_ipaddr_select_host_addr()
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    ares_getaddrinfo(channel, host, NULL, &hints, DnsLookupCallback, result);
+
+    // Service the channel's sockets until the lookup has completed (or timed out)
+    while (FOREVER)
+    {
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        nfds = ares_fds(channel, &readfds, &writefds);
+        if (nfds == 0)
+        {
+            break;
+        }
+
+        tvp = ares_timeout(channel, NULL, &tv);
+        (void) select(nfds, &readfds, &writefds, NULL, tvp);
+        ares_process(channel, &readfds, &writefds);
+    }
+
+    // NOTE: This calls DnsLookupCallback() (with ARES_EDESTRUCTION) if the lookup has not already completed
+    ares_destroy(channel);
+}
+
+/*********************************************************************//**
+**
+** DnsLookupCallback
+**
+** Called by c-ares when a lookup has completed
+**
+** \param   arg - pointer to structure in which to return the result of the lookup
+** \param   status - c-ares status of the lookup
+** \param   timeouts - number of times that the lookup timed out
+** \param   res - pointer to linked list of results (NULL if the lookup failed). Ownership passes to this function
+**
+** \return  None
+**
+**************************************************************************/
+void DnsLookupCallback(void *arg, int status, int timeouts, struct ares_addrinfo *res)
+{
+    dns_lookup_result_t *result = (dns_lookup_result_t *)arg;
+    struct ares_addrinfo_node *node;
+    struct sockaddr_in *a;
+    struct sockaddr_in6 *a6;
+    int err;
+
+    result->status = status;
+    result->ttl = DNS_CACHE_MAX_TTL;
+
+    // Exit if the lookup failed
+    if ((status != ARES_SUCCESS) || (res == NULL))
+    {
+        return;
+    }
+
+    // Convert the results in the linked list into an array of IP addresses, determining the lowest TTL of them
+    for (node = res->nodes; (node != NULL) && (result->num_addrs < NU_MAX_HOST_ADDRS); node = node->ai_next)
+    {
+        switch (node->ai_family)
+        {
+            case AF_INET:
+                a = (struct sockaddr_in *) node->ai_addr;
+                err = nu_ipaddr_from_inaddr(&a->sin_addr, &result->addrs[result->num_addrs]);
+                break;
+
+            case AF_INET6:
+                a6 = (struct sockaddr_in6 *) node->ai_addr;
+                err = nu_ipaddr_from_in6addr(&a6->sin6_addr, &result->addrs[result->num_addrs]);
+                break;
+
+            default:
+                // Unexpected address family - Skip it
+                err = USP_ERR_INTERNAL_ERROR;
+                break;
+        }
+
+        if (err == USP_ERR_OK)
+        {
+            result->num_addrs++;
+            result->ttl = MIN(result->ttl, node->ai_ttl);
+        }
+    }
+
+    ares_freeaddrinfo(res);
+}
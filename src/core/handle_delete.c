@@ -195,18 +195,38 @@ int DeleteExpressionObjects(Usp__DeleteResp *del_resp, char *exp_path, bool allo
     // Add the OperationSuccess object (ie assume successful operation)
     oper_success = AddDeleteResp_OperSuccess(del_resp, exp_path);
 
-    // Iterate over all object paths resolved for this Object expression
+    // If failures in any object affect all others, then delete all objects at once
+    // NOTE: This allows whole tables to be deleted in bulk, rather than one instance at a time
+    if (allow_partial == false)
+    {
+        // Exit if the delete failed. Remove the success object and replace with a failure object.
+        // The failure object will get converted into the param_errs element of the Error Message
+        err = DATA_MODEL_DeleteInstances(&obj_paths, CHECK_DELETABLE);
+        if (err != USP_ERR_OK)
+        {
+            RemoveDeleteResp_LastDeletedObjResult(del_resp);
+            AddDeleteResp_OperFailure(del_resp, exp_path, err, USP_ERR_GetMessage());
+            goto exit;
+        }
+
+        // Since successful, add all objects to the list of objects successfully deleted
+        for (i=0; i < obj_paths.num_entries; i++)
+        {
+            AddOperSuccess_AffectedPath(oper_success, obj_paths.vector[i]);
+        }
+
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Otherwise, iterate over all object paths resolved for this Object expression, deleting each in its own transaction
     for (i=0; i < obj_paths.num_entries; i++)
     {
-        // Start a transaction here, if allow_partial is at the path expression level
-        if (allow_partial == true)
+        // Exit if unable to start a transaction. Note if this occurs, an error response is returned
+        err = DM_TRANS_Start(&trans);
+        if (err != USP_ERR_OK)
         {
-            // Exit if unable to start a transaction. Note if this occurs, an error response is returned
-            err = DM_TRANS_Start(&trans);
-            if (err != USP_ERR_OK)
-            {
-                return err;
-            }
+            return err;
         }
 
         // Delete the object
@@ -216,36 +236,20 @@ int DeleteExpressionObjects(Usp__DeleteResp *del_resp, char *exp_path, bool allo
             // No error occurred, so add to the list of objects successfully deleted
             AddOperSuccess_AffectedPath(oper_success, obj_paths.vector[i]);
 
-            // Commit the transaction here, if allow_partial is at the individual object level
-            if (allow_partial == true)
+            // Commit the transaction for the individual object
+            err = DM_TRANS_Commit();
+            if (err != USP_ERR_OK)
             {
-                err = DM_TRANS_Commit();
-                if (err != USP_ERR_OK)
-                {
-                    goto exit;
-                }
+                goto exit;
             }
         }
         else
         {
             // If the code gets here, the delete failed
-            // Abort transaction here, if allow_partial is at the path expression level
-            if (allow_partial == true)
-            {
-                // Signal back that we failed to delete this object, but continue with the next object in the loop
-                AddOperSuccess_UnaffectedPathError(oper_success, obj_paths.vector[i], err, USP_ERR_GetMessage());
-                DM_TRANS_Abort();          // Explicitly ignoring errors, as the error code we want to return is that of the
-                                           // original failure
-            }
-            else
-            {
-                // Exit if the delete failed, and we don't allow partial deletion of all objects
-                // Remove the success object and replace with a failure object.
-                // The failure object will get converted into the param_errs element of the Error Message
-                RemoveDeleteResp_LastDeletedObjResult(del_resp);
-                AddDeleteResp_OperFailure(del_resp, exp_path, err, USP_ERR_GetMessage());
-                goto exit;
-            }
+            // Signal back that we failed to delete this object, but continue with the next object in the loop
+            AddOperSuccess_UnaffectedPathError(oper_success, obj_paths.vector[i], err, USP_ERR_GetMessage());
+            DM_TRANS_Abort();          // Explicitly ignoring errors, as the error code we want to return is that of the
+                                       // original failure
         }
     }
 
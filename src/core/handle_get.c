@@ -51,13 +51,91 @@
 #include "path_resolver.h"
 #include "device.h"
 #include "text_utils.h"
+#include "os_utils.h"
+#include "sync_timer.h"
+#include "handle_get.h"
+
+//------------------------------------------------------------------------------
+// Slot in the hash table used to find the resolved_path_result for an object, when adding parameters to a requested_path_result
+typedef struct
+{
+    int hash;           // Hash of the object's path
+    int index;          // Index of the object's resolved_path_result in the requested_path_result, or INVALID if this slot is unused
+} resolved_path_slot_t;
+
+// Minimum number of slots in the hash table. The table is sized to keep it at most half full.
+#define MIN_RESOLVED_PATH_SLOTS 32
+
+//------------------------------------------------------------------------------
+// Vendor parameter whose value is obtained using its asynchronous get callback (see USP_REGISTER_VendorParam_AsyncGet)
+typedef struct
+{
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *entry;  // Result params entry to fill in with the value of the parameter
+    int req_path_index;         // Index of the requested path result containing the entry
+    dm_node_t *node;            // Node representing the parameter
+    char *path;                 // Path of the parameter
+    dm_instances_t inst;        // Instance numbers of the parameter
+    bool is_complete;           // Set once the value of the parameter has been returned (or failed)
+} async_get_param_t;
+
+//------------------------------------------------------------------------------
+// Vendor parameters resolved from all path expressions in a Get request, whose values are obtained asynchronously
+struct async_get_params_tag
+{
+    async_get_param_t *params;
+    int num_params;
+};
+
+//------------------------------------------------------------------------------
+// Get response which has been deferred until all asynchronous vendor get callbacks have returned their values
+typedef struct pending_get_tag
+{
+    struct pending_get_tag *next;   // Next pending Get response in the linked list
+    int id;                         // Identifier of this pending Get response (also used as the identifier of its deadline timer)
+    int first_request_id;           // Request identifier passed to the asynchronous get callback of the first parameter.
+                                    // Subsequent parameters have request identifiers numbered consecutively from this
+    Usp__Msg *resp;                 // Get response message
+    char *controller_endpoint;      // Controller to send the Get response to
+    mtp_reply_to_t mrt;             // Destination to send the Get response to
+    async_get_param_t *params;      // Parameters whose values are being obtained asynchronously
+    int num_params;
+    int num_outstanding;            // Number of parameters whose values have not been returned yet
+} pending_get_t;
+
+// Linked list of deferred Get responses. These are only accessed by the data model thread
+static pending_get_t *pending_gets = NULL;
+static int next_pending_get_id = 1;
+static int next_async_request_id = 1;
+
+//------------------------------------------------------------------------------
+// State used whilst adding the parameters resolved from a single path expression to the Get Response
+typedef struct
+{
+    Usp__GetResp__RequestedPathResult *req_path_result;  // Requested path result that the resolved parameters are added to
+    str_vector_t grouped_params;        // Paths of grouped vendor parameters. Their values are obtained after the path expression has been resolved,
+                                        // so that all parameters in the same group are obtained using a single call to the vendor
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry **grouped_entries;  // Result params entry for each grouped vendor parameter
+    resolved_path_slot_t *table;        // Open addressing hash table mapping object path to resolved_path_result, so that
+                                        // adding each parameter does not require searching all resolved_path_results
+    int table_size;                     // Number of slots in the table (always a power of 2, or 0 if the table has not been allocated)
+    async_get_params_t *async_params;   // Vendor parameters whose values are obtained asynchronously, or NULL if their get callbacks must be used
+    int req_path_index;                 // Index of req_path_result in the Get Response
+} get_path_state_t;
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
-void GetSinglePath(Usp__Msg *resp, char *path_expression);
-void AddResolvedPathResult(Usp__GetResp__RequestedPathResult *req_path_result, char *path, char *value, int separator_split);
-Usp__GetResp__ResolvedPathResult *FindResolvedPath(Usp__GetResp__RequestedPathResult *req_path_result, char *obj_path);
-Usp__Msg *CreateGetResp(char *msg_id);
+void StartAsyncGets(Usp__Msg *resp, char *controller_endpoint, mtp_reply_to_t *mrt, async_get_params_t *async_params);
+void CompleteAsyncGetParam(pending_get_t *pg, async_get_param_t *ap, int err_code, char *value);
+void AsyncGetTimeout(int id);
+void SendPendingGetResp(pending_get_t *pg);
+void FailReqPathResult(Usp__GetResp__RequestedPathResult *req_path_result, int err_code, char *err_msg);
+void RemoveAsyncGetParams(async_get_params_t *async_params, int req_path_index);
+int GetResolvedParam(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg);
+int GetGroupedParamValues(get_path_state_t *gs);
+Usp__GetResp__ResolvedPathResult__ResultParamsEntry *
+AddResolvedPathResult(get_path_state_t *gs, char *path, char *value, int separator_split);
+Usp__GetResp__ResolvedPathResult *FindResolvedPath(get_path_state_t *gs, char *obj_path, int hash);
+void AddResolvedPathToTable(get_path_state_t *gs, int hash, int index);
 Usp__GetResp__RequestedPathResult *AddGetResp_ReqPathRes(Usp__Msg *resp, char *requested_path, int err_code, char *err_msg);
 Usp__GetResp__ResolvedPathResult *AddReqPathRes_ResolvedPathResult(Usp__GetResp__RequestedPathResult *req_path_result, char *obj_path);
 
@@ -65,6 +143,7 @@ Usp__GetResp__ResolvedPathResult__ResultParamsEntry *
 AddResolvedPathRes_ParamsEntry(Usp__GetResp__ResolvedPathResult *resolved_path_res, char *param_name, char *value);
 void DestroyCurReqPathResult(Usp__Msg *resp, Usp__GetResp__RequestedPathResult *expected_req_path_result);
 void DestroyResolvedPathResult(Usp__GetResp__ResolvedPathResult *resolved_path_res_entry);
+void *GrowPtrArray(void *array, int num_entries);
 
 /*********************************************************************//**
 **
@@ -85,6 +164,8 @@ void MSG_HANDLER_HandleGet(Usp__Msg *usp, char *controller_endpoint, mtp_reply_t
     char **param_paths;
     int num_param_paths;
     Usp__Msg *resp = NULL;
+    async_get_params_t async_params;
+    async_get_params_t *p_async_params;
 
     // Exit if message is invalid or failed to parse
     // This code checks the parsed message enums and pointers for expectations and validity
@@ -109,10 +190,28 @@ void MSG_HANDLER_HandleGet(Usp__Msg *usp, char *controller_endpoint, mtp_reply_t
         goto exit;
     }
 
+    // Vendor parameters with an asynchronous get callback are only obtained asynchronously by the data model thread
+    // (as the deferred Get response is completed by the data model thread). Get worker threads use their get callback instead.
+    async_params.params = NULL;
+    async_params.num_params = 0;
+    p_async_params = (OS_UTILS_IsDataModelWorkerThread()) ? NULL : &async_params;
+
     // Iterate over all parameter paths in the get
+    // NOTE: The path resolver caches the instances of objects whilst processing this message, as many
+    //       path expressions typically share the same wildcarded prefix
+    PATH_RESOLVER_EnableCache();
     for (i=0; i<num_param_paths; i++)
     {
-        GetSinglePath(resp, param_paths[i]);
+        GetSinglePath(resp, param_paths[i], p_async_params);
+    }
+    PATH_RESOLVER_DisableCache();
+
+    // Exit if the Get response has been deferred until the values of all asynchronously obtained vendor parameters have been returned
+    // NOTE: Ownership of the Get response passes to the deferred Get response
+    if (async_params.num_params > 0)
+    {
+        StartAsyncGets(resp, controller_endpoint, mrt, &async_params);
+        return;
     }
 
 exit:
@@ -126,68 +225,502 @@ exit:
 **
 ** Resolves the specified path expression into multiple parameters, and gets the value of each,
 ** adding the results to the GetResponse object
+** NOTE: The value of each parameter is obtained as soon as the path resolver has resolved it, so that the
+**       resolved paths do not all have to be held in a vector, before being looked up again in the data model
 **
 ** \param   resp - pointer to GetResponse object
 ** \param   path_expression - pointer to a path expression string to resolve
+** \param   async_params - pointer to vector of vendor parameters whose values are obtained asynchronously,
+**                         or NULL if all parameters must be obtained synchronously
 **
 ** \return  None - This function handles all erors by putting error messages in the get response
 **
 **************************************************************************/
-void GetSinglePath(Usp__Msg *resp, char *path_expression)
+void GetSinglePath(Usp__Msg *resp, char *path_expression, async_get_params_t *async_params)
 {
-    int i;
     int err;
-    str_vector_t params;
     Usp__GetResp__RequestedPathResult *req_path_result;
-    char value[MAX_DM_VALUE_LEN];
-    int separator_split;
     combined_role_t combined_role;
+    get_path_state_t gs;
+
+    // Add a requested path result to the Get Response message. The parameters are added to it as they are resolved
+    // NOTE: If no matching parameters are found in the data model, then the get response contains an empty results list
+    gs.req_path_result = AddGetResp_ReqPathRes(resp, path_expression, USP_ERR_OK, "");
+    STR_VECTOR_Init(&gs.grouped_params);
+    gs.grouped_entries = NULL;
+    gs.table = NULL;
+    gs.table_size = 0;
+    gs.async_params = async_params;
+    gs.req_path_index = resp->body->response->get_resp->n_req_path_results - 1;
 
     // Exit if the search path is not in the schema or the search path was invalid or an error occured in evaluating the search path (eg a parameter get failed)
-    // The get response will contain an error message in this case
-    STR_VECTOR_Init(&params);
+    // The get response will contain only an error message in this case
     MSG_HANDLER_GetMsgRole(&combined_role);
-    err = PATH_RESOLVER_ResolveDevicePath(path_expression, &params, kResolveOp_Get, &separator_split, &combined_role, 0);
+    err = PATH_RESOLVER_ResolveDevicePathWithCallback(path_expression, GetResolvedParam, &gs, kResolveOp_Get, &combined_role, 0);
+    if (err == USP_ERR_OK)
+    {
+        err = GetGroupedParamValues(&gs);
+    }
+
     if (err != USP_ERR_OK)
     {
+        if (async_params != NULL)
+        {
+            RemoveAsyncGetParams(async_params, gs.req_path_index);
+        }
+        DestroyCurReqPathResult(resp, gs.req_path_result);
         req_path_result = AddGetResp_ReqPathRes(resp, path_expression, err, USP_ERR_GetMessage());
-        (void)req_path_result; // Keep Clang static analyser happy
-        goto exit;
+        (void)req_path_result;  // Keep Clang static analyser happy
+    }
+
+    STR_VECTOR_Destroy(&gs.grouped_params);
+    USP_SAFE_FREE(gs.grouped_entries);
+    USP_SAFE_FREE(gs.table);
+}
+
+/*********************************************************************//**
+**
+** GetResolvedParam
+**
+** Called by the path resolver for each parameter resolved from the path expression
+** Gets the value of the parameter, adding it to the requested path result
+**
+** \param   path - full data model path of the parameter
+** \param   node - pointer to node in the data model schema representing the parameter
+** \param   inst - pointer to instance numbers of the parameter
+** \param   separator_split - denotes where to split the parameter path into an object (that required resolution) and a sub path
+** \param   cb_arg - pointer to state used whilst adding the parameters resolved from the path expression
+**
+** \return  USP_ERR_OK if successful, or the error code if the value of the parameter could not be obtained
+**
+**************************************************************************/
+int GetResolvedParam(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg)
+{
+    int err;
+    int index;
+    char *value;
+    get_path_state_t *gs = (get_path_state_t *) cb_arg;
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *entry;
+    async_get_param_t *ap;
+
+    // Grouped vendor parameters are added to the requested path result now (to maintain the order of parameters), but their value is obtained later
+    if (IsGroupedVendorParam(node))
+    {
+        entry = AddResolvedPathResult(gs, path, USP_STRDUP(""), separator_split);
+        index = gs->grouped_params.num_entries;
+        STR_VECTOR_Add(&gs->grouped_params, path);
+        gs->grouped_entries = GrowPtrArray(gs->grouped_entries, index);
+        gs->grouped_entries[index] = entry;
+        return USP_ERR_OK;
     }
 
-    // Add a requested path result to the Get Response message
-    req_path_result = AddGetResp_ReqPathRes(resp, path_expression, USP_ERR_OK, "");
+    // Vendor parameters with an asynchronous get callback are added to the requested path result now, but their value is obtained
+    // after all path expressions in the Get request have been resolved, so that all values can be obtained concurrently
+    if ((gs->async_params != NULL) && (IsAsyncGetVendorParam(node)))
+    {
+        entry = AddResolvedPathResult(gs, path, USP_STRDUP(""), separator_split);
+        index = gs->async_params->num_params;
+        gs->async_params->params = USP_REALLOC(gs->async_params->params, (index+1)*sizeof(async_get_param_t));
+        ap = &gs->async_params->params[index];
+        ap->entry = entry;
+        ap->req_path_index = gs->req_path_index;
+        ap->node = node;
+        ap->path = USP_STRDUP(path);
+        memcpy(&ap->inst, inst, sizeof(dm_instances_t));
+        ap->is_complete = false;
+        gs->async_params->num_params++;
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to get the value of the parameter
+    err = DATA_MODEL_GetParameterValueAlloc(node, path, inst, &value, 0);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    AddResolvedPathResult(gs, path, value, separator_split);
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** GetGroupedParamValues
+**
+** Gets the values of all grouped vendor parameters resolved from the path expression, filling them into the requested path result
+** NOTE: Getting all values at once allows grouped vendor parameters to be obtained using a single call to the vendor
+**
+** \param   gs - pointer to state used whilst adding the parameters resolved from the path expression
+**
+** \return  USP_ERR_OK if successful, or the error code of the first parameter which could not be read
+**
+**************************************************************************/
+int GetGroupedParamValues(get_path_state_t *gs)
+{
+    int i;
+    int err;
+    kv_vector_t param_values;
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *entry;
+
+    // Exit if there are no grouped vendor parameters
+    if (gs->grouped_params.num_entries == 0)
+    {
+        return USP_ERR_OK;
+    }
 
-    // Exit if no matching parameters were found in the data model
-    if (params.num_entries==0)
+    // Exit if unable to get the value of all grouped vendor parameters
+    // NOTE: We do not have to call STR_VECTOR_Destroy(&gs->grouped_params) because STR_VECTOR_ConvertToKeyValueVector() destroys the string vector
+    STR_VECTOR_ConvertToKeyValueVector(&gs->grouped_params, &param_values);
+    err = DATA_MODEL_GetParameterValues(&param_values, 0);
+    if (err != USP_ERR_OK)
     {
-        // The get response should contain an empty results list in this case
-        // So do not set the error message
-        //USP_ERR_SetMessage("%s: Invalid instance number or no instances found of '%s'", __FUNCTION__, path_expression);
         goto exit;
     }
 
-    // Iterate over all resolved params adding their value to the result_params
-    for (i=0; i < params.num_entries; i++)
+    // Move the values into the result params entries
+    for (i=0; i < param_values.num_entries; i++)
     {
-        // Exit if unable to get the value of a parameter
-        // The get response will contain only an error message in this case
-        err = DATA_MODEL_GetParameterValue(params.vector[i], value, sizeof(value), 0);
+        entry = gs->grouped_entries[i];
+        USP_FREE(entry->value);
+        entry->value = param_values.vector[i].value;
+        param_values.vector[i].value = NULL;
+    }
+
+exit:
+    KV_VECTOR_Destroy(&param_values);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** MSG_HANDLER_CompleteAsyncGet
+**
+** Called by the data model thread when the vendor returns a value requested by an asynchronous get callback
+** Once all values for a deferred Get response have been returned, the Get response is sent
+**
+** \param   request_id - identifier of the request, passed to the asynchronous get callback
+** \param   err_code - USP_ERR_OK if the value of the parameter was obtained successfully
+** \param   value - value of the parameter, or an error message if err_code is not USP_ERR_OK
+**
+** \return  None
+**
+**************************************************************************/
+void MSG_HANDLER_CompleteAsyncGet(int request_id, int err_code, char *value)
+{
+    pending_get_t *pg;
+    async_get_param_t *ap;
+
+    // Find the deferred Get response which is waiting for the value
+    pg = pending_gets;
+    while (pg != NULL)
+    {
+        if ((request_id >= pg->first_request_id) && (request_id < pg->first_request_id + pg->num_params))
+        {
+            break;
+        }
+        pg = pg->next;
+    }
+
+    // Exit if the Get response is no longer waiting for the value (eg it has timed out, or the vendor returned the value twice)
+    if (pg == NULL)
+    {
+        USP_LOG_Warning("%s: Ignoring value for unknown (or timed out) asynchronous get request_id=%d", __FUNCTION__, request_id);
+        return;
+    }
+
+    ap = &pg->params[request_id - pg->first_request_id];
+    if (ap->is_complete)
+    {
+        return;
+    }
+
+    CompleteAsyncGetParam(pg, ap, err_code, value);
+
+    // Send the Get response, if this was the last value it was waiting for
+    if (pg->num_outstanding == 0)
+    {
+        SendPendingGetResp(pg);
+    }
+}
+
+/*********************************************************************//**
+**
+** StartAsyncGets
+**
+** Defers the Get response, and starts getting the values of all vendor parameters with asynchronous get callbacks
+** The Get response is sent once all values have been returned (see MSG_HANDLER_CompleteAsyncGet), or ASYNC_GET_TIMEOUT elapses
+**
+** \param   resp - pointer to GetResponse object. Ownership passes to this function
+** \param   controller_endpoint - endpoint which sent the Get request
+** \param   mrt - details of where the Get response should be sent
+** \param   async_params - pointer to vector of vendor parameters whose values are obtained asynchronously.
+**                         Ownership of the contents of the vector passes to this function
+**
+** \return  None
+**
+**************************************************************************/
+void StartAsyncGets(Usp__Msg *resp, char *controller_endpoint, mtp_reply_to_t *mrt, async_get_params_t *async_params)
+{
+    int i;
+    int err;
+    pending_get_t *pg;
+    async_get_param_t *ap;
+    dm_async_get_cb_t async_get_cb;
+    dm_req_t req;
+
+    // Create the deferred Get response
+    pg = USP_MALLOC(sizeof(pending_get_t));
+    memset(pg, 0, sizeof(pending_get_t));
+    pg->id = next_pending_get_id++;
+    pg->first_request_id = next_async_request_id;
+    next_async_request_id += async_params->num_params;
+    pg->resp = resp;
+    pg->controller_endpoint = USP_STRDUP(controller_endpoint);
+    pg->mrt.protocol = mrt->protocol;
+    pg->mrt.is_reply_to_specified = mrt->is_reply_to_specified;
+    pg->mrt.stomp_dest = USP_STRDUP(mrt->stomp_dest);
+    pg->mrt.stomp_instance = mrt->stomp_instance;
+    pg->mrt.stomp_err_id = USP_STRDUP(mrt->stomp_err_id);
+    pg->mrt.coap_host = USP_STRDUP(mrt->coap_host);
+    pg->mrt.coap_port = mrt->coap_port;
+    pg->mrt.coap_resource = USP_STRDUP(mrt->coap_resource);
+    pg->mrt.coap_encryption = mrt->coap_encryption;
+    pg->mrt.coap_reset_session_hint = mrt->coap_reset_session_hint;
+    pg->mrt.mqtt_instance = mrt->mqtt_instance;
+    pg->mrt.mqtt_topic = USP_STRDUP(mrt->mqtt_topic);
+    pg->mrt.rx_time = mrt->rx_time;
+    pg->params = async_params->params;
+    pg->num_params = async_params->num_params;
+    pg->num_outstanding = async_params->num_params;
+
+    pg->next = pending_gets;
+    pending_gets = pg;
+
+    // Start getting all values
+    for (i=0; i < pg->num_params; i++)
+    {
+        ap = &pg->params[i];
+        async_get_cb = ap->node->registered.param_info.async_get_cb;
+        DM_PRIV_RequestInit(&req, ap->node, ap->path, &ap->inst);
+        USP_ERR_ClearMessage();
+        err = async_get_cb(&req, pg->first_request_id + i);
         if (err != USP_ERR_OK)
         {
-            DestroyCurReqPathResult(resp, req_path_result);
-            req_path_result = AddGetResp_ReqPathRes(resp, path_expression, err, USP_ERR_GetMessage());
-            (void)req_path_result;  // Keep Clang static analyser happy
-            goto exit;
+            USP_ERR_ReplaceEmptyMessage("%s: Async get callback for path %s returned error %d", __FUNCTION__, ap->path, err);
+            CompleteAsyncGetParam(pg, ap, err, USP_ERR_GetMessage());
         }
+    }
 
-        // Add a param map entry to the requested path result
-        AddResolvedPathResult(req_path_result, params.vector[i], value, separator_split);
+    // Exit if all asynchronous get callbacks failed immediately, sending the Get response now
+    if (pg->num_outstanding == 0)
+    {
+        SendPendingGetResp(pg);
+        return;
     }
 
+    // Send the Get response with whatever values have been returned, if the vendor does not return all values in time
+    SYNC_TIMER_AddMs(AsyncGetTimeout, pg->id, SYNC_TIMER_TimeMs() + ASYNC_GET_TIMEOUT);
+}
 
-exit:
-    STR_VECTOR_Destroy(&params);
+/*********************************************************************//**
+**
+** CompleteAsyncGetParam
+**
+** Fills in the value of a vendor parameter in a deferred Get response, or fails its requested path result
+**
+** \param   pg - pointer to deferred Get response
+** \param   ap - pointer to the parameter whose value has been obtained (or failed)
+** \param   err_code - USP_ERR_OK if the value of the parameter was obtained successfully
+** \param   value - value of the parameter, or an error message if err_code is not USP_ERR_OK
+**
+** \return  None
+**
+**************************************************************************/
+void CompleteAsyncGetParam(pending_get_t *pg, async_get_param_t *ap, int err_code, char *value)
+{
+    int i;
+    Usp__GetResp *get_resp;
+
+    ap->is_complete = true;
+    pg->num_outstanding--;
+
+    // If the value was obtained, move it into its result params entry
+    if (err_code == USP_ERR_OK)
+    {
+        USP_FREE(ap->entry->value);
+        ap->entry->value = USP_STRDUP(value);
+        return;
+    }
+
+    // Otherwise (as for synchronously obtained parameters) the requested path result only contains the error,
+    // so no other parameters in it need to be waited for
+    get_resp = pg->resp->body->response->get_resp;
+    FailReqPathResult(get_resp->req_path_results[ap->req_path_index], err_code, value);
+    for (i=0; i < pg->num_params; i++)
+    {
+        if ((pg->params[i].req_path_index == ap->req_path_index) && (pg->params[i].is_complete == false))
+        {
+            pg->params[i].is_complete = true;
+            pg->num_outstanding--;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** AsyncGetTimeout
+**
+** Called if the vendor has not returned all values requested for a deferred Get response within ASYNC_GET_TIMEOUT
+** Fails the requested path results containing the outstanding parameters, then sends the Get response
+**
+** \param   id - identifier of the deferred Get response
+**
+** \return  None
+**
+**************************************************************************/
+void AsyncGetTimeout(int id)
+{
+    int i;
+    pending_get_t *pg;
+    async_get_param_t *ap;
+    char err_msg[MAX_DM_PATH+64];
+
+    // Exit if the deferred Get response has already been sent
+    pg = pending_gets;
+    while ((pg != NULL) && (pg->id != id))
+    {
+        pg = pg->next;
+    }
+
+    if (pg == NULL)
+    {
+        return;
+    }
+
+    for (i=0; i < pg->num_params; i++)
+    {
+        ap = &pg->params[i];
+        if (ap->is_complete == false)
+        {
+            USP_SNPRINTF(err_msg, sizeof(err_msg), "%s: Timed out getting value of %s", __FUNCTION__, ap->path);
+            CompleteAsyncGetParam(pg, ap, USP_ERR_INTERNAL_ERROR, err_msg);
+        }
+    }
+
+    SendPendingGetResp(pg);
+}
+
+/*********************************************************************//**
+**
+** SendPendingGetResp
+**
+** Sends a deferred Get response, then frees it
+**
+** \param   pg - pointer to deferred Get response. This is removed from the linked list of deferred Get responses and freed
+**
+** \return  None
+**
+**************************************************************************/
+void SendPendingGetResp(pending_get_t *pg)
+{
+    int i;
+    pending_get_t **pp;
+
+    // Remove the deferred Get response from the linked list
+    pp = &pending_gets;
+    while (*pp != pg)
+    {
+        pp = &(*pp)->next;
+    }
+    *pp = pg->next;
+
+    // Remove the deadline timer (if it was started)
+    SYNC_TIMER_Remove(AsyncGetTimeout, pg->id);
+
+    MSG_HANDLER_QueueMessage(pg->controller_endpoint, pg->resp, &pg->mrt);
+    MTP_EXEC_ActivateScheduledActions();
+
+    // Free the deferred Get response
+    usp__msg__free_unpacked(pg->resp, pbuf_allocator);
+    for (i=0; i < pg->num_params; i++)
+    {
+        USP_FREE(pg->params[i].path);
+    }
+    USP_SAFE_FREE(pg->params);
+    USP_FREE(pg->controller_endpoint);
+    USP_SAFE_FREE(pg->mrt.stomp_dest);
+    USP_SAFE_FREE(pg->mrt.stomp_err_id);
+    USP_SAFE_FREE(pg->mrt.coap_host);
+    USP_SAFE_FREE(pg->mrt.coap_resource);
+    USP_SAFE_FREE(pg->mrt.mqtt_topic);
+    USP_FREE(pg);
+}
+
+/*********************************************************************//**
+**
+** FailReqPathResult
+**
+** Removes all resolved path results from the specified requested path result, replacing them with an error
+**
+** \param   req_path_result - pointer to requested path result to fail
+** \param   err_code - error code to put in the requested path result
+** \param   err_msg - error message to put in the requested path result
+**
+** \return  None
+**
+**************************************************************************/
+void FailReqPathResult(Usp__GetResp__RequestedPathResult *req_path_result, int err_code, char *err_msg)
+{
+    int i;
+
+    for (i=0; i < req_path_result->n_resolved_path_results; i++)
+    {
+        DestroyResolvedPathResult(req_path_result->resolved_path_results[i]);
+    }
+    USP_SAFE_FREE(req_path_result->resolved_path_results);
+    req_path_result->n_resolved_path_results = 0;
+
+    USP_FREE(req_path_result->err_msg);
+    req_path_result->err_msg = USP_STRDUP(err_msg);
+    req_path_result->err_code = err_code;
+}
+
+/*********************************************************************//**
+**
+** RemoveAsyncGetParams
+**
+** Removes all vendor parameters belonging to the specified requested path result from the vector of parameters
+** whose values are obtained asynchronously. This is called if the requested path result fails before the values have been requested.
+**
+** \param   async_params - pointer to vector of vendor parameters whose values are obtained asynchronously
+** \param   req_path_index - index of the requested path result whose parameters should be removed
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveAsyncGetParams(async_get_params_t *async_params, int req_path_index)
+{
+    int i;
+    int count = 0;
+
+    for (i=0; i < async_params->num_params; i++)
+    {
+        if (async_params->params[i].req_path_index == req_path_index)
+        {
+            USP_FREE(async_params->params[i].path);
+        }
+        else
+        {
+            async_params->params[count] = async_params->params[i];
+            count++;
+        }
+    }
+
+    async_params->num_params = count;
+    if (count == 0)
+    {
+        USP_SAFE_FREE(async_params->params);
+    }
 }
 
 /*********************************************************************//**
@@ -198,34 +731,39 @@ exit:
 ** This function creates a resolved_path_result entry for the parent object
 ** of the parameter, before adding the parameter to the result_params
 **
-** \param   req_path_result - pointer to requested_path_result to add this entry to
+** \param   gs - pointer to state used whilst adding the parameters resolved from the path expression
 ** \param   path - full data model path of the parameter
-** \param   value - value of the parameter
+** \param   value - dynamically allocated value of the parameter. Ownership of the string passes to the result_params entry
 ** \param   separator_split - denotes where to split the parameter path based on the number of separators for the object that required resolution
 **                            The path is split into an object (that required resolution),
 **                            and a sub path which did not require resolution
 **
-** \return  None
+** \return  Pointer to the result_params entry added for the parameter
 **
 **************************************************************************/
-void AddResolvedPathResult(Usp__GetResp__RequestedPathResult *req_path_result, char *path, char *value, int separator_split)
+Usp__GetResp__ResolvedPathResult__ResultParamsEntry *
+AddResolvedPathResult(get_path_state_t *gs, char *path, char *value, int separator_split)
 {
     char obj_path[MAX_DM_PATH];
     char *param_name;
+    int hash;
+    Usp__GetResp__RequestedPathResult *req_path_result = gs->req_path_result;
     Usp__GetResp__ResolvedPathResult *resolved_path_res;
 
     // Split the parameter into the parent object path and the name of the parameter within the object
     param_name = TEXT_UTILS_SplitPathAtSeparator(path, obj_path, sizeof(obj_path), separator_split);
 
     // Add a resolved path result, if we don't alredy have one for the specified parent object
-    resolved_path_res = FindResolvedPath(req_path_result, obj_path);
+    hash = TEXT_UTILS_CalcHash(obj_path);
+    resolved_path_res = FindResolvedPath(gs, obj_path, hash);
     if (resolved_path_res == NULL)
     {
         resolved_path_res = AddReqPathRes_ResolvedPathResult(req_path_result, obj_path);
+        AddResolvedPathToTable(gs, hash, req_path_result->n_resolved_path_results-1);
     }
 
     // Add the parameter to the params
-    AddResolvedPathRes_ParamsEntry(resolved_path_res, param_name, value);
+    return AddResolvedPathRes_ParamsEntry(resolved_path_res, param_name, value);
 }
 
 /*********************************************************************//**
@@ -234,33 +772,114 @@ void AddResolvedPathResult(Usp__GetResp__RequestedPathResult *req_path_result, c
 **
 ** Searches for the resolved path object which represents the specified object_path
 **
-** \param   req_path_result - pointer to requested_path_result to look for the specified object path in
+** \param   gs - pointer to state used whilst adding the parameters resolved from the path expression
 ** \param   obj_path - path to object in data model
+** \param   hash - hash of obj_path
 **
 ** \return  Pointer to a ResolvedPath object, or NULL if no match was found
 **
 **************************************************************************/
-Usp__GetResp__ResolvedPathResult *FindResolvedPath(Usp__GetResp__RequestedPathResult *req_path_result, char *obj_path)
+Usp__GetResp__ResolvedPathResult *FindResolvedPath(get_path_state_t *gs, char *obj_path, int hash)
 {
-    int i;
     int num_entries;
+    unsigned mask;
+    unsigned i;
+    resolved_path_slot_t *slot;
     Usp__GetResp__ResolvedPathResult *resolved_path_result;
 
-    // Iterate over all resolved path results, trying to find the one which matches the specified object path
-    num_entries = req_path_result->n_resolved_path_results;
-    for (i=0; i<num_entries; i++)
+    // Exit if the object is the one which the last parameter was added to
+    // NOTE: This is the usual case, as the path resolver returns all parameters of an object together
+    num_entries = gs->req_path_result->n_resolved_path_results;
+    if (num_entries == 0)
     {
-        resolved_path_result = req_path_result->resolved_path_results[i];
-        if (strcmp(resolved_path_result->resolved_path, obj_path)==0)
+        return NULL;
+    }
+
+    resolved_path_result = gs->req_path_result->resolved_path_results[num_entries-1];
+    if (strcmp(resolved_path_result->resolved_path, obj_path)==0)
+    {
+        return resolved_path_result;
+    }
+
+    // Otherwise look up the object in the hash table
+    mask = gs->table_size - 1;
+    i = ((unsigned)hash) & mask;
+    slot = &gs->table[i];
+    while (slot->index != INVALID)
+    {
+        if (slot->hash == hash)
         {
-            return resolved_path_result;
+            resolved_path_result = gs->req_path_result->resolved_path_results[slot->index];
+            if (strcmp(resolved_path_result->resolved_path, obj_path)==0)
+            {
+                return resolved_path_result;
+            }
         }
+
+        i = (i + 1) & mask;
+        slot = &gs->table[i];
     }
 
     // If the code gets here, then no matching object path was found
     return NULL;
 }
 
+/*********************************************************************//**
+**
+** AddResolvedPathToTable
+**
+** Adds a resolved_path_result to the hash table used to find the resolved_path_result for an object
+** The table is grown (and all resolved_path_results re-added) if it would become more than half full
+**
+** \param   gs - pointer to state used whilst adding the parameters resolved from the path expression
+** \param   hash - hash of the object path of the resolved_path_result
+** \param   index - index of the resolved_path_result in the requested_path_result
+**
+** \return  None
+**
+**************************************************************************/
+void AddResolvedPathToTable(get_path_state_t *gs, int hash, int index)
+{
+    int i;
+    int new_size;
+    unsigned mask;
+    unsigned j;
+    resolved_path_slot_t *slot;
+    Usp__GetResp__ResolvedPathResult *resolved_path_result;
+
+    // Grow the table, if necessary, re-adding all resolved_path_results (apart from the one being added)
+    if (2*(index+1) > gs->table_size)
+    {
+        new_size = (gs->table_size == 0) ? MIN_RESOLVED_PATH_SLOTS : 2*gs->table_size;
+        USP_SAFE_FREE(gs->table);
+        gs->table = USP_MALLOC(new_size*sizeof(resolved_path_slot_t));
+        gs->table_size = new_size;
+        for (i=0; i < new_size; i++)
+        {
+            gs->table[i].index = INVALID;
+        }
+
+        for (i=0; i < index; i++)
+        {
+            resolved_path_result = gs->req_path_result->resolved_path_results[i];
+            AddResolvedPathToTable(gs, TEXT_UTILS_CalcHash(resolved_path_result->resolved_path), i);
+        }
+    }
+
+    // Add the resolved_path_result into the first unused slot
+    mask = gs->table_size - 1;
+    j = ((unsigned)hash) & mask;
+    slot = &gs->table[j];
+    while (slot->index != INVALID)
+    {
+        j = (j + 1) & mask;
+        slot = &gs->table[j];
+    }
+
+    slot->hash = hash;
+    slot->index = index;
+}
+
 /*********************************************************************//**
 **
 ** CreateGetResp
@@ -345,7 +964,7 @@ AddGetResp_ReqPathRes(Usp__Msg *resp, char *requested_path, int err_code, char *
     // Increase the size of the vector containing pointers to the requested_path_results
     get_resp = resp->body->response->get_resp;
     new_num = get_resp->n_req_path_results + 1;
-    get_resp->req_path_results = USP_REALLOC(get_resp->req_path_results, new_num*sizeof(void *));
+    get_resp->req_path_results = GrowPtrArray(get_resp->req_path_results, new_num-1);
     get_resp->n_req_path_results = new_num;
     get_resp->req_path_results[new_num-1] = req_path_result;
 
@@ -384,7 +1003,7 @@ Usp__GetResp__ResolvedPathResult *AddReqPathRes_ResolvedPathResult(Usp__GetResp_
 
     // Increase the size of the vector containing pointers to the map entries
     new_num = req_path_result->n_resolved_path_results + 1;
-    req_path_result->resolved_path_results = USP_REALLOC(req_path_result->resolved_path_results, new_num*sizeof(void *));
+    req_path_result->resolved_path_results = GrowPtrArray(req_path_result->resolved_path_results, new_num-1);
     req_path_result->n_resolved_path_results = new_num;
     req_path_result->resolved_path_results[new_num-1] = resolved_path_res_entry;
 
@@ -404,7 +1023,7 @@ Usp__GetResp__ResolvedPathResult *AddReqPathRes_ResolvedPathResult(Usp__GetResp_
 **
 ** \param   resolved_path_res - pointer to resolved_oath_result to add this entry to
 ** \param   param_name - name of the parameter (not including object path) of the parameter to add to the map
-** \param   value - value of the parameter
+** \param   value - dynamically allocated value of the parameter. Ownership of the string passes to the result_params entry
 **
 ** \return  Pointer to dynamically allocated result_params
 **          NOTE: If out of memory, USP Agent is terminated
@@ -423,13 +1042,13 @@ AddResolvedPathRes_ParamsEntry(Usp__GetResp__ResolvedPathResult *resolved_path_r
 
     // Increase the size of the vector containing pointers to the map entries
     new_num = resolved_path_res->n_result_params + 1;
-    resolved_path_res->result_params = USP_REALLOC(resolved_path_res->result_params, new_num*sizeof(void *));
+    resolved_path_res->result_params = GrowPtrArray(resolved_path_res->result_params, new_num-1);
     resolved_path_res->n_result_params = new_num;
     resolved_path_res->result_params[new_num-1] = res_params_entry;
 
     // Initialise the result_params_entry
     res_params_entry->key = USP_STRDUP(param_name);
-    res_params_entry->value = USP_STRDUP(value);
+    res_params_entry->value = value;
 
     return res_params_entry;
 }
@@ -502,6 +1121,37 @@ void DestroyResolvedPathResult(Usp__GetResp__ResolvedPathResult *resolved_path_r
     USP_FREE(resolved_path_res_entry);
 }
 
+/*********************************************************************//**
+**
+** GrowPtrArray
+**
+** Ensures that a dynamically allocated array of pointers has room for one more entry
+** The array's capacity is doubled whenever the number of entries reaches a power of 2, so that adding n entries
+** requires only O(log n) reallocations. This allows the capacity to be implied by the number of entries,
+** so it does not need to be stored in the protobuf structure containing the array
+** NOTE: The array may be freed (eg by usp__msg__free_unpacked) in the usual way, as it is a single block of memory
+**
+** \param   array - pointer to array to grow, or NULL if the array has not been allocated yet
+** \param   num_entries - number of entries currently in the array
+**
+** \return  pointer to the (possibly reallocated) array
+**
+**************************************************************************/
+void *GrowPtrArray(void *array, int num_entries)
+{
+    int new_size;
+
+    // Exit if the array already has room for another entry
+    // NOTE: The capacity of the array is always at least the smallest power of 2 which is greater than or equal to num_entries
+    if ((num_entries & (num_entries-1)) != 0)
+    {
+        return array;
+    }
+
+    new_size = (num_entries == 0) ? 1 : 2*num_entries;
+    return USP_REALLOC(array, new_size*sizeof(void *));
+}
+
 
 
 
@@ -59,6 +59,7 @@ Usp__Msg *CreateGetInstancesResp(char *msg_id);
 Usp__GetInstancesResp__RequestedPathResult *AddGetInstances_RequestedPathResult(Usp__GetInstancesResp *gi_resp, char *requested_path, int err, char *err_msg);
 void AddRequestedPathResult_CurrInstance(Usp__GetInstancesResp__RequestedPathResult *req_path_res, char *path, kv_vector_t *unique_keys);
 void RemoveAddResp_LastRequestedPathResult(Usp__GetInstancesResp *gi_resp);
+int CompareResolvedInstances(const void *p1, const void *p2);
 
 /*********************************************************************//**
 **
@@ -125,7 +126,7 @@ void ProcessRequestedPathInstances(char *requested_path, bool first_level_only,
     int i;
     int err;
     combined_role_t combined_role;
-    str_vector_t obj_paths;
+    dm_resolved_path_vector_t obj_paths;
     char *path;
     kv_vector_t unique_keys;
     Usp__GetInstancesResp__RequestedPathResult *req_path_res;
@@ -133,12 +134,13 @@ void ProcessRequestedPathInstances(char *requested_path, bool first_level_only,
 
     // Initialise variables used in this function
     MSG_HANDLER_GetMsgRole(&combined_role);
-    STR_VECTOR_Init(&obj_paths);
+    PATH_RESOLVER_InitResolvedPaths(&obj_paths);
     KV_VECTOR_Init(&unique_keys);
 
     // Exit if unable to resolve the requested path
+    // NOTE: The paths are resolved along with their nodes and instance numbers, so that they can be sorted without comparing the path strings
     flags = (first_level_only==false) ? GET_ALL_INSTANCES : 0;
-    err = PATH_RESOLVER_ResolveDevicePath(requested_path, &obj_paths, kResolveOp_Instances, NULL, &combined_role, flags);
+    err = PATH_RESOLVER_ResolveDevicePathToNodes(requested_path, &obj_paths, kResolveOp_Instances, &combined_role, flags);
     if (err != USP_ERR_OK)
     {
         AddGetInstances_RequestedPathResult(gi_resp, requested_path, err, USP_ERR_GetMessage());
@@ -147,7 +149,7 @@ void ProcessRequestedPathInstances(char *requested_path, bool first_level_only,
 
     // Sort the instances
 #ifndef DONT_SORT_GET_INSTANCES
-    STR_VECTOR_Sort(&obj_paths);
+    qsort(obj_paths.vector, obj_paths.num_entries, sizeof(dm_resolved_path_t), CompareResolvedInstances);
 #endif
 
     // Iterate over all resolved objects, obtaining their unique keys and adding to the LastRequestedPathResult
@@ -156,7 +158,7 @@ void ProcessRequestedPathInstances(char *requested_path, bool first_level_only,
     {
         // Exit if unable to obtain the unique keys for this object
         KV_VECTOR_Init(&unique_keys);  // not strictly necessary
-        path = obj_paths.vector[i];
+        path = obj_paths.vector[i].path;
         err = DATA_MODEL_GetUniqueKeyParams(path, &unique_keys, &combined_role);
         if (err != USP_ERR_OK)
         {
@@ -172,10 +174,58 @@ void ProcessRequestedPathInstances(char *requested_path, bool first_level_only,
     }
 
 exit:
-    STR_VECTOR_Destroy(&obj_paths);
+    PATH_RESOLVER_DestroyResolvedPaths(&obj_paths);
     KV_VECTOR_Destroy(&unique_keys);
 }
 
+/*********************************************************************//**
+**
+** CompareResolvedInstances
+**
+** qsort comparison function used to order the object instances returned in a GetInstancesResponse
+** The order is the same as a natural sort of their paths (ie 'Device.IP.Interface.2' comes before 'Device.IP.Interface.11'),
+** but is determined mostly by comparing instance numbers, only comparing schema paths where the objects differ
+**
+** \param   p1 - pointer to first resolved object instance to compare
+** \param   p2 - pointer to second resolved object instance to compare
+**
+** \return  negative number if p1 should be ordered before p2, positive number if after, 0 if they are the same
+**
+**************************************************************************/
+int CompareResolvedInstances(const void *p1, const void *p2)
+{
+    dm_resolved_path_t *a = (dm_resolved_path_t *) p1;
+    dm_resolved_path_t *b = (dm_resolved_path_t *) p2;
+    int order;
+    int i;
+
+    // Compare the multi-instance objects and instance numbers which the paths have in common, parents first
+    // NOTE: If the objects at the same level differ, then the paths can be ordered by the objects' schema paths,
+    //       since the paths only differ in object names, not instance numbers, up to the point at which these objects differ
+    order = MIN(a->inst.order, b->inst.order);
+    for (i=0; i < order; i++)
+    {
+        if (a->inst.nodes[i] != b->inst.nodes[i])
+        {
+            return TEXT_UTILS_NaturalStrCmp(a->inst.nodes[i]->path, b->inst.nodes[i]->path);
+        }
+
+        if (a->inst.instances[i] != b->inst.instances[i])
+        {
+            return (a->inst.instances[i] < b->inst.instances[i]) ? -1 : 1;
+        }
+    }
+
+    // If the code gets here, then all instance numbers in common are the same, so the paths only differ by the objects that they end in
+    // (eg a parent object and its child, or a single instance child object)
+    if (a->node == b->node)
+    {
+        return 0;
+    }
+
+    return TEXT_UTILS_NaturalStrCmp(a->node->path, b->node->path);
+}
+
 /*********************************************************************//**
 **
 ** CreateGetInstancesResp
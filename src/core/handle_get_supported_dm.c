@@ -51,6 +51,7 @@
 #include "path_resolver.h"
 #include "device.h"
 #include "text_utils.h"
+#include "str_vector.h"
 
 //------------------------------------------------------------------------------
 // Defines for bits in gs_flags variable
@@ -59,9 +60,35 @@
 #define RETURN_EVENTS    0x00000004
 #define RETURN_PARAMS    0x00000008
 
+//------------------------------------------------------------------------------
+// Cache of the serialized responses to recent GetSupportedDM requests
+// The response only depends on the requested paths, the flags and the role of the controller (since the schema does not change
+// once the agent has started), so controllers repeating the same request (eg on every reconnect) are answered from the cache
+// NOTE: Only the body of the response is cached. The header (containing the msg_id) is serialized separately for each response
+typedef struct
+{
+    str_vector_t obj_paths;         // Object paths requested. If num_entries is 0, then this cache entry is unused
+    unsigned gs_flags;              // Flags controlling what the response contains
+    combined_role_t combined_role;  // Role used for permissions when walking the schema
+    unsigned char *body;            // Serialized body of the USP response message
+    int body_len;                   // Number of bytes in body
+} gsdm_cache_entry_t;
+
+// NOTE: Each thread has its own cache, as GetSupportedDM may also be handled by the Get worker threads
+static __thread gsdm_cache_entry_t gsdm_cache[GET_SUPPORTED_DM_CACHE_ENTRIES];
+static __thread int gsdm_cache_next = 0;            // Index of the cache entry to replace next
+static __thread unsigned gsdm_cache_generation = 0; // Value of gsdm_generation when this thread's cache entries were added
+
+// Incremented whenever the cached responses of all threads become stale
+static unsigned gsdm_generation = 0;
+
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
-void ProcessSupportedPathInstances(char *schema_path, unsigned gs_flags, Usp__GetSupportedDMResp *gs_resp);
+void ProcessSupportedPathInstances(char *schema_path, unsigned gs_flags, combined_role_t *combined_role, Usp__GetSupportedDMResp *gs_resp);
+gsdm_cache_entry_t *FindCachedGetSupportedDMResp(Usp__GetSupportedDM *gs, unsigned gs_flags, combined_role_t *combined_role);
+void AddCachedGetSupportedDMResp(Usp__GetSupportedDM *gs, unsigned gs_flags, combined_role_t *combined_role, Usp__Msg *resp);
+int QueueCachedGetSupportedDMResp(gsdm_cache_entry_t *ce, char *msg_id, char *controller_endpoint, mtp_reply_to_t *mrt);
+void FreeGetSupportedDMCache(void);
 Usp__Msg *CreateGetSupportedDMResp(char *msg_id);
 void WalkSchema(dm_node_t *parent, Usp__GetSupportedDMResp__RequestedObjectResult *ror, unsigned gs_flags, combined_role_t *combined_role);
 dm_node_t *GetNodeFromSchemaPath(char *schema_path);
@@ -96,6 +123,8 @@ void MSG_HANDLER_HandleGetSupportedDM(Usp__Msg *usp, char *controller_endpoint,
     Usp__GetSupportedDM *gs;
     Usp__GetSupportedDMResp *gs_resp;
     unsigned gs_flags;
+    combined_role_t combined_role;
+    gsdm_cache_entry_t *ce;
 
     // Exit if message is invalid or failed to parse
     // This code checks the parsed message enums and pointers for expectations and validity
@@ -116,6 +145,17 @@ void MSG_HANDLER_HandleGetSupportedDM(Usp__Msg *usp, char *controller_endpoint,
     gs_flags |= (gs->return_events) ? RETURN_EVENTS : 0;
     gs_flags |= (gs->return_params) ? RETURN_PARAMS : 0;
 
+    // Get the role to use for permissions when walking the data model schema
+    MSG_HANDLER_GetMsgRole(&combined_role);
+
+    // Exit if the response to an identical request has been cached, sending the cached response
+    ce = FindCachedGetSupportedDMResp(gs, gs_flags, &combined_role);
+    if (ce != NULL)
+    {
+        QueueCachedGetSupportedDMResp(ce, usp->header->msg_id, controller_endpoint, mrt);
+        return;
+    }
+
     // Create a GetSupportedDM Response message
     resp = CreateGetSupportedDMResp(usp->header->msg_id);
     gs_resp = resp->body->response->get_supported_dm_resp;
@@ -123,9 +163,12 @@ void MSG_HANDLER_HandleGetSupportedDM(Usp__Msg *usp, char *controller_endpoint,
     // Iterate over all object paths in the request message
     for (i=0; i < gs->n_obj_paths; i++)
     {
-        ProcessSupportedPathInstances(gs->obj_paths[i], gs_flags, gs_resp);
+        ProcessSupportedPathInstances(gs->obj_paths[i], gs_flags, &combined_role, gs_resp);
     }
 
+    // Cache the response, so that it does not have to be built again for an identical request
+    AddCachedGetSupportedDMResp(gs, gs_flags, &combined_role, resp);
+
 exit:
     MSG_HANDLER_QueueMessage(controller_endpoint, resp, mrt);
     usp__msg__free_unpacked(resp, pbuf_allocator);
@@ -139,16 +182,16 @@ exit:
 **
 ** \param   schema_path - Data model schema path to query
 ** \param   gs_flags - flags controlling which artifacts to put in the response
+** \param   combined_role - role to use for permissions when walking the schema
 ** \param   gs_resp - pointer to GetSupportedDMResponse object of USP response message
 **
 ** \return  None - This code must handle any errors by reporting errors in the response message
 **
 **************************************************************************/
-void ProcessSupportedPathInstances(char *schema_path, unsigned gs_flags, Usp__GetSupportedDMResp *gs_resp)
+void ProcessSupportedPathInstances(char *schema_path, unsigned gs_flags, combined_role_t *combined_role, Usp__GetSupportedDMResp *gs_resp)
 {
     dm_node_t *node;
     Usp__GetSupportedDMResp__RequestedObjectResult *ror;
-    combined_role_t combined_role;
 
     // Exit if unable to find a node matching the specified schema path
     node = GetNodeFromSchemaPath(schema_path);
@@ -171,11 +214,204 @@ void ProcessSupportedPathInstances(char *schema_path, unsigned gs_flags, Usp__Ge
     // Add a requested object result, since we will have at least one object
     ror = AddGetSupportedDM_ReqObjResult(gs_resp, schema_path, USP_ERR_OK, "", BBF_DATA_MODEL_URI);
 
-    // Get the role to use for permissions when walking the data model schema
-    MSG_HANDLER_GetMsgRole(&combined_role);
-
     // Recurse through the schema, building up the response
-    WalkSchema(node, ror, gs_flags, &combined_role);
+    WalkSchema(node, ror, gs_flags, combined_role);
+}
+
+/*********************************************************************//**
+**
+** MSG_HANDLER_InvalidateGetSupportedDMCache
+**
+** Marks the cached GetSupportedDM responses of all threads as stale, causing them to be discarded the next time they are used
+** This is called whenever the data model schema or the permissions of a role are changed
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MSG_HANDLER_InvalidateGetSupportedDMCache(void)
+{
+    __atomic_add_fetch(&gsdm_generation, 1, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** FindCachedGetSupportedDMResp
+**
+** Finds the cached response to a GetSupportedDM request identical to the specified request
+**
+** \param   gs - pointer to GetSupportedDM request
+** \param   gs_flags - flags controlling which artifacts to put in the response
+** \param   combined_role - role to use for permissions when walking the schema
+**
+** \return  pointer to cache entry, or NULL if no identical request has been cached
+**
+**************************************************************************/
+gsdm_cache_entry_t *FindCachedGetSupportedDMResp(Usp__GetSupportedDM *gs, unsigned gs_flags, combined_role_t *combined_role)
+{
+    int i, j;
+    unsigned generation;
+    gsdm_cache_entry_t *ce;
+
+    // Discard all cached responses held by this thread, if they are stale
+    generation = __atomic_load_n(&gsdm_generation, __ATOMIC_RELAXED);
+    if (generation != gsdm_cache_generation)
+    {
+        FreeGetSupportedDMCache();
+        gsdm_cache_generation = generation;
+    }
+
+    // Exit if there are no paths in the request. Responses to these are not cached, as they contain nothing to walk
+    if (gs->n_obj_paths == 0)
+    {
+        return NULL;
+    }
+
+    for (i=0; i < GET_SUPPORTED_DM_CACHE_ENTRIES; i++)
+    {
+        // Skip this entry if it was for a different request
+        ce = &gsdm_cache[i];
+        if ((ce->obj_paths.num_entries != gs->n_obj_paths) || (ce->gs_flags != gs_flags) ||
+            (ce->combined_role.inherited != combined_role->inherited) || (ce->combined_role.assigned != combined_role->assigned))
+        {
+            continue;
+        }
+
+        // Exit if all requested paths match
+        for (j=0; j < gs->n_obj_paths; j++)
+        {
+            if (strcmp(ce->obj_paths.vector[j], gs->obj_paths[j]) != 0)
+            {
+                break;
+            }
+        }
+
+        if (j == gs->n_obj_paths)
+        {
+            return ce;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** AddCachedGetSupportedDMResp
+**
+** Adds the serialized body of a GetSupportedDM response to the cache, replacing the oldest cache entry
+**
+** \param   gs - pointer to GetSupportedDM request
+** \param   gs_flags - flags controlling which artifacts to put in the response
+** \param   combined_role - role used for permissions when walking the schema
+** \param   resp - pointer to GetSupportedDM response message
+**
+** \return  None
+**
+**************************************************************************/
+void AddCachedGetSupportedDMResp(Usp__GetSupportedDM *gs, unsigned gs_flags, combined_role_t *combined_role, Usp__Msg *resp)
+{
+    gsdm_cache_entry_t *ce;
+    Usp__Msg body_only;
+    int size;
+
+    // Exit if there are no paths in the request
+    if (gs->n_obj_paths == 0)
+    {
+        return;
+    }
+
+    // Free the cache entry being replaced
+    ce = &gsdm_cache[gsdm_cache_next];
+    STR_VECTOR_Destroy(&ce->obj_paths);
+    USP_SAFE_FREE(ce->body);
+    gsdm_cache_next = (gsdm_cache_next + 1) % GET_SUPPORTED_DM_CACHE_ENTRIES;
+
+    // Serialize just the body of the response message
+    // NOTE: protobuf-c omits NULL sub-messages, so this results in just the body field of the serialized USP message
+    body_only = *resp;
+    body_only.header = NULL;
+    ce->body_len = usp__msg__get_packed_size(&body_only);
+    ce->body = USP_MALLOC(ce->body_len);
+    size = usp__msg__pack(&body_only, ce->body);
+    USP_ASSERT(size == ce->body_len);          // If these are not equal, then we may have had a buffer overrun, so terminate
+
+    STR_VECTOR_Clone(&ce->obj_paths, gs->obj_paths, gs->n_obj_paths);
+    ce->gs_flags = gs_flags;
+    ce->combined_role = *combined_role;
+}
+
+/*********************************************************************//**
+**
+** QueueCachedGetSupportedDMResp
+**
+** Queues a GetSupportedDM response message, whose body has been cached, to be sent to a controller
+**
+** \param   ce - pointer to cache entry containing the serialized body of the response
+** \param   msg_id - msg_id of the request being responded to
+** \param   controller_endpoint - endpoint which sent the request
+** \param   mrt - details of where the response should be sent
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int QueueCachedGetSupportedDMResp(gsdm_cache_entry_t *ce, char *msg_id, char *controller_endpoint, mtp_reply_to_t *mrt)
+{
+    Usp__Msg header_only;
+    Usp__Header header;
+    unsigned char *pbuf;
+    int header_len;
+    int size;
+    int err;
+
+    // Serialize just the header of the response message
+    usp__msg__init(&header_only);
+    usp__header__init(&header);
+    header.msg_id = msg_id;
+    header.msg_type = USP__HEADER__MSG_TYPE__GET_SUPPORTED_DM_RESP;
+    header_only.header = &header;
+    header_len = usp__msg__get_packed_size(&header_only);
+
+    // Append the cached body to the header, forming the serialized USP message
+    // NOTE: The fields of a protobuf message may be serialized separately and concatenated
+    pbuf = USP_MALLOC(header_len + ce->body_len);
+    size = usp__msg__pack(&header_only, pbuf);
+    USP_ASSERT(size == header_len);
+    memcpy(&pbuf[header_len], ce->body, ce->body_len);
+
+    // Encapsulate this message in a USP record, then queue the record, to send to the controller
+    err = MSG_HANDLER_QueueUspRecord(USP__HEADER__MSG_TYPE__GET_SUPPORTED_DM_RESP, controller_endpoint, pbuf, header_len + ce->body_len, msg_id, mrt, END_OF_TIME);
+    USP_FREE(pbuf);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** FreeGetSupportedDMCache
+**
+** Frees all cached GetSupportedDM responses held by this thread
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreeGetSupportedDMCache(void)
+{
+    int i;
+    gsdm_cache_entry_t *ce;
+
+    for (i=0; i < GET_SUPPORTED_DM_CACHE_ENTRIES; i++)
+    {
+        ce = &gsdm_cache[i];
+        STR_VECTOR_Destroy(&ce->obj_paths);
+        USP_SAFE_FREE(ce->body);
+        ce->body_len = 0;
+    }
+
+    gsdm_cache_next = 0;
 }
 
 /*********************************************************************//**
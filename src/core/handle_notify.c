@@ -466,6 +466,66 @@ Usp__Msg *MSG_HANDLER_CreateNotifyReq_Event(char *event_name, kv_vector_t *param
     return req;
 }
 
+/*********************************************************************//**
+**
+** MSG_HANDLER_ReaddressNotifyReq
+**
+** Modifies a Notify message (created by one of the MSG_HANDLER_CreateNotifyReq_XXX() functions), so that it can be sent
+** for another subscription. This allows the body of a notification which matches many subscriptions to be created once,
+** since only the message id, subscription_id and send_resp differ between the messages sent for each subscription
+**
+** \param   req - pointer to Notify message to modify
+** \param   subscription_id - identifier string which was set by the controller to identify this notification (Device.LocalAgent.Subscription.{i}.ID)
+** \param   send_resp - Set to true if we require the controller to send a response (otherwise we keep retrying)
+**                      The value of this parameter was set by the controller (in Device.LocalAgent.Subscription.{i}.NotifRetry)
+**
+** \return  None
+**
+**************************************************************************/
+void MSG_HANDLER_ReaddressNotifyReq(Usp__Msg *req, char *subscription_id, bool send_resp)
+{
+    Usp__Notify *notify;
+    subs_notify_t notify_type;
+    char msg_id[MAX_NOTIFY_MSG_ID];
+
+    notify = req->body->request->notify;
+    switch(notify->notification_case)
+    {
+        case USP__NOTIFY__NOTIFICATION_EVENT:
+            notify_type = kSubNotifyType_Event;
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_VALUE_CHANGE:
+            notify_type = kSubNotifyType_ValueChange;
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_OBJ_CREATION:
+            notify_type = kSubNotifyType_ObjectCreation;
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_OBJ_DELETION:
+            notify_type = kSubNotifyType_ObjectDeletion;
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_OPER_COMPLETE:
+            notify_type = kSubNotifyType_OperationComplete;
+            break;
+
+        default:
+            TERMINATE_BAD_CASE(notify->notification_case);
+            return;
+    }
+
+    // Each message must have a unique message id
+    CalcMessageId(notify_type, msg_id, sizeof(msg_id));
+    USP_FREE(req->header->msg_id);
+    req->header->msg_id = USP_STRDUP(msg_id);
+
+    USP_FREE(notify->subscription_id);
+    notify->subscription_id = USP_STRDUP(subscription_id);
+    notify->send_resp = send_resp;
+}
+
 /*********************************************************************//**
 **
 ** CreateOperComplete
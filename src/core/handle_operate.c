@@ -116,6 +116,7 @@ void MSG_HANDLER_HandleOperate(Usp__Msg *usp, char *controller_endpoint, mtp_rep
 
     // Copy the operate arguments into a key value vector.
     // This is necessary to handle the freeing of this vector in a consistent way - whether it is constructed here, or after a power cycle retry
+    KV_VECTOR_Reserve(&input_args, oper->n_input_args);
     for (i=0; i < oper->n_input_args; i++)
     {
         // Exit if key-value pair is not present in USP input message
@@ -53,6 +53,7 @@
 #include "dm_trans.h"
 #include "path_resolver.h"
 #include "device.h"
+#include "handle_set.h"
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
@@ -63,15 +64,11 @@ int UpdateObject_Trans(char *obj_path,
 int UpdateObject(char *obj_path, 
                  Usp__SetResp *set_resp,
                  Usp__Set__UpdateObject *up);
-Usp__Msg *CreateSetResp(char *msg_id);
 Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *AddSetResp_OperFailure(Usp__SetResp *set_resp, char *path, int err_code, char *err_msg);
 Usp__SetResp__UpdatedInstanceFailure *
 AddOperFailure_UpdatedInstFailure(Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *oper_failure, char *path);
 Usp__SetResp__ParameterError *
 AddUpdatedInstFailure_ParamErr(Usp__SetResp__UpdatedInstanceFailure *updated_inst_failure, char *path, int err_code, char *err_msg);
-Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *AddSetResp_OperSuccess(Usp__SetResp *set_resp, char *path);
-Usp__SetResp__UpdatedInstanceResult *AddOperSuccess_UpdatedInstRes(Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *oper_success, char *path);
-Usp__SetResp__UpdatedInstanceResult__UpdatedParamsEntry *AddUpdatedInstRes_ParamsEntry(Usp__SetResp__UpdatedInstanceResult *updated_inst_result, char *key, char *value);
 Usp__SetResp__ParameterError *AddUpdatedInstRes_ParamErr(Usp__SetResp__UpdatedInstanceResult *updated_inst_result, char *path, int err_code, char *err_msg);
 void RemoveSetResp_LastUpdateObjResult(Usp__SetResp *set_resp);
 int ParamError_FromSetRespToErrResp(Usp__Msg *set_msg, Usp__Msg *err_msg);
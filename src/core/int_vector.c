@@ -57,6 +57,7 @@
 **************************************************************************/
 void INT_VECTOR_Init(int_vector_t *iv)
 {
+    iv->vector = NULL;
     iv->num_entries = 0;
 }
 
@@ -74,19 +75,42 @@ void INT_VECTOR_Init(int_vector_t *iv)
 **************************************************************************/
 int INT_VECTOR_Add(int_vector_t *iv, int number)
 {
-    // Exit if unable to add to the vector (array is already full)
-    if (iv->num_entries >= MAX_DM_INSTANCES)
-    {
-        USP_ERR_SetMessage("%s: More than %d instances of object", __FUNCTION__, MAX_DM_INSTANCES);
-        return USP_ERR_INTERNAL_ERROR;
-    }
+    // Increase the size of the vector, geometrically, so that building a vector of n integers requires only O(log n) reallocations
+    iv->vector = USP_RESERVE(iv->vector, (iv->num_entries+1)*sizeof(int), VECTOR_GROWTH_FACTOR*(iv->num_entries+1)*sizeof(int));
 
     // Add to the vector
-    iv->vector[ iv->num_entries ] = (short) number;
+    iv->vector[ iv->num_entries ] = number;
     iv->num_entries++;
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** INT_VECTOR_Reserve
+**
+** Ensures that the vector has room for the specified number of additional integers, without reallocating
+** This is used before adding a known number of integers, so that the array is allocated once at its final size
+**
+** \param   iv - pointer to structure to reserve room in
+** \param   num_extra - number of integers which are about to be added to the vector
+**
+** \return  None
+**
+**************************************************************************/
+void INT_VECTOR_Reserve(int_vector_t *iv, int num_extra)
+{
+    int size;
+
+    // Exit if there is nothing to reserve
+    if (num_extra <= 0)
+    {
+        return;
+    }
+
+    size = (iv->num_entries + num_extra)*sizeof(int);
+    iv->vector = USP_RESERVE(iv->vector, size, size);
+}
+
 /*********************************************************************//**
 **
 ** INT_VECTOR_Find
@@ -117,6 +141,34 @@ int INT_VECTOR_Find(int_vector_t *iv, int number)
     return INVALID;
 }
 
+/*********************************************************************//**
+**
+** INT_VECTOR_Clone
+**
+** Copies the integers in the source vector into the destination vector
+** NOTE: The destination vector is initialised by this function, and must be freed by the caller
+**
+** \param   dest - pointer to structure to copy the integers into
+** \param   src - pointer to structure to copy the integers from
+**
+** \return  None
+**
+**************************************************************************/
+void INT_VECTOR_Clone(int_vector_t *dest, int_vector_t *src)
+{
+    INT_VECTOR_Init(dest);
+
+    // Exit if there are no integers to copy
+    if (src->num_entries == 0)
+    {
+        return;
+    }
+
+    dest->vector = USP_MALLOC(src->num_entries*sizeof(int));
+    memcpy(dest->vector, src->vector, src->num_entries*sizeof(int));
+    dest->num_entries = src->num_entries;
+}
+
 /*********************************************************************//**
 **
 ** INT_VECTOR_Destroy
@@ -130,6 +182,7 @@ int INT_VECTOR_Find(int_vector_t *iv, int number)
 **************************************************************************/
 void INT_VECTOR_Destroy(int_vector_t *iv)
 {
+    USP_SAFE_FREE(iv->vector);
     iv->num_entries = 0;
 }
 
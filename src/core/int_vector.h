@@ -36,9 +36,8 @@
  * \file int_vector.h
  *
  * Implements a vector of integers
- * Unlike the other vector data structures, this has been re-implemented using a maximum fixed size array,
- * as this vector is only used to collect the instance numbers of an object.
- * Using a fixed size array minimizes the number of memory allocations, speeding up the code and minimising the risk of memory leaks
+ * This vector is used to collect the instance numbers of an object. It is dynamically allocated, so that
+ * there is no limit on the number of instances of an object, and hence must always be freed using INT_VECTOR_Destroy()
  *
  */
 
@@ -51,7 +50,9 @@
 // Int Vector API
 void INT_VECTOR_Init(int_vector_t *iv);
 int  INT_VECTOR_Add(int_vector_t *iv, int number);
+void INT_VECTOR_Reserve(int_vector_t *iv, int num_extra);
 int  INT_VECTOR_Find(int_vector_t *iv, int number);
+void INT_VECTOR_Clone(int_vector_t *dest, int_vector_t *src);
 void INT_VECTOR_Destroy(int_vector_t *iv);
 
 #endif
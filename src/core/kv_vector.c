@@ -50,7 +50,6 @@
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
-void AddKeyValueInternal(kv_vector_t *kvv, char *key, char *value);
 int FindMatchingKey(char *key, char **valid_keys, int num_valid_keys);
 
 /*********************************************************************//**
@@ -85,7 +84,64 @@ void KV_VECTOR_Init(kv_vector_t *kvv)
 **************************************************************************/
 void KV_VECTOR_Add(kv_vector_t *kvv, char *key, char *value)
 {
-    AddKeyValueInternal(kvv, USP_STRDUP(key), USP_STRDUP(value));
+    KV_VECTOR_AddAllocated(kvv, USP_STRDUP(key), USP_STRDUP(value));
+}
+
+/*********************************************************************//**
+**
+** KV_VECTOR_AddAllocated
+**
+** Adds a key value pair into the vector, where the key and value have already been dynamically allocated by the caller
+** The vector takes ownership of the key and value, avoiding the copies made by KV_VECTOR_Add()
+**
+** \param   kvv - pointer to structure to add the string to
+** \param   key - pointer to dynamically allocated string to attach
+** \param   value - pointer to dynamically allocated string to attach (or NULL)
+**
+** \return  None
+**
+**************************************************************************/
+void KV_VECTOR_AddAllocated(kv_vector_t *kvv, char *key, char *value)
+{
+    int new_num_entries;
+    kv_pair_t *pair;
+
+    // Grow the array geometrically, so that building a vector of n pairs requires only O(log n) reallocations
+    new_num_entries = kvv->num_entries + 1;
+    kvv->vector = USP_RESERVE(kvv->vector, new_num_entries*sizeof(kv_pair_t), VECTOR_GROWTH_FACTOR*new_num_entries*sizeof(kv_pair_t));
+
+    pair = &kvv->vector[ kvv->num_entries ];
+    pair->key = key;
+    pair->value = value;
+
+    kvv->num_entries = new_num_entries;
+}
+
+/*********************************************************************//**
+**
+** KV_VECTOR_Reserve
+**
+** Ensures that the vector has room for the specified number of additional key value pairs, without reallocating
+** This is used before adding a known number of pairs, so that the array is allocated once at its final size
+**
+** \param   kvv - pointer to structure to reserve room in
+** \param   num_extra - number of key value pairs which are about to be added to the vector
+**
+** \return  None
+**
+**************************************************************************/
+void KV_VECTOR_Reserve(kv_vector_t *kvv, int num_extra)
+{
+    int size;
+
+    // Exit if there is nothing to reserve
+    if (num_extra <= 0)
+    {
+        return;
+    }
+
+    size = (kvv->num_entries + num_extra)*sizeof(kv_pair_t);
+    kvv->vector = USP_RESERVE(kvv->vector, size, size);
 }
 
 /*********************************************************************//**
@@ -243,7 +299,7 @@ void KV_VECTOR_AddHexNumber(kv_vector_t *kvv, char *key, unsigned char *buf, int
     }
     *p = '\0';
     
-    AddKeyValueInternal(kvv, USP_STRDUP(key), value);
+    KV_VECTOR_AddAllocated(kvv, USP_STRDUP(key), value);
 }
 
 /*********************************************************************//**
@@ -345,7 +401,7 @@ int KV_VECTOR_FindKey(kv_vector_t *kvv, char *key, int start_index)
     }
 
     // Iterate from 0 to just before start_index
-    for (i=0; i < start_index-1; i++)
+    for (i=0; i < start_index; i++)
     {
         pair = &kvv->vector[i];
         if (strcmp(pair->key, key)==0)
@@ -358,6 +414,63 @@ int KV_VECTOR_FindKey(kv_vector_t *kvv, char *key, int start_index)
     return INVALID;
 }
 
+/*********************************************************************//**
+**
+** KV_VECTOR_FindKeyIndexed
+**
+** Finds the index of the specified key in the specified key-value pair vector, using a hash index of the vector's keys
+** This is equivalent to KV_VECTOR_FindKey(), but takes constant time for large vectors
+** NOTE: See the notes in str_vector.h for the lifetime of the hash index
+**
+** \param   kvv - pointer to key-value pair vector structure
+** \param   ss - pointer to hash index of the keys in the vector
+** \param   key - pointer to key to lookup
+**
+** \return  index of matching key-value pair in the vector or INVALID if no match was found
+**
+**************************************************************************/
+int KV_VECTOR_FindKeyIndexed(kv_vector_t *kvv, str_set_t *ss, char *key)
+{
+    char **keys;
+
+    keys = (kvv->vector != NULL) ? &kvv->vector[0].key : NULL;
+    return STR_SET_FindKey(ss, keys, sizeof(kv_pair_t), kvv->num_entries, key);
+}
+
+/*********************************************************************//**
+**
+** KV_VECTOR_ReplaceIndexed
+**
+** Replaces the value associated with the specified key, using a hash index of the vector's keys to find the key
+** This is equivalent to KV_VECTOR_Replace(), but takes constant time for large vectors
+**
+** \param   kvv - pointer to structure to replace the value in
+** \param   ss - pointer to hash index of the keys in the vector
+** \param   key - pointer to key, whose value we want to replace
+** \param   value - pointer to replacement value
+**
+** \return  true if the value was replaced, false if the key does not exist in the vector
+**
+**************************************************************************/
+bool KV_VECTOR_ReplaceIndexed(kv_vector_t *kvv, str_set_t *ss, char *key, char *value)
+{
+    int index;
+    kv_pair_t *pair;
+
+    // Exit if the key does not exist in the vector
+    index = KV_VECTOR_FindKeyIndexed(kvv, ss, key);
+    if (index == INVALID)
+    {
+        return false;
+    }
+
+    // Replace its value
+    pair = &kvv->vector[index];
+    USP_FREE( pair->value );
+    pair->value = USP_STRDUP(value);
+    return true;
+}
+
 /*********************************************************************//**
 **
 ** KV_VECTOR_Get
@@ -713,31 +826,3 @@ int FindMatchingKey(char *key, char **valid_keys, int num_valid_keys)
     return INVALID;
 }
 
-/*********************************************************************//**
-**
-** AddKeyValueInternal
-**
-** Adds a key value pair into the vector, where the key and value have already been dynamically allocated by the caller
-**
-** \param   kvv - pointer to structure to add the string to
-** \param   key - pointer to string to attach
-** \param   value - pointer to string to attach
-**
-** \return  None
-**
-**************************************************************************/
-void AddKeyValueInternal(kv_vector_t *kvv, char *key, char *value)
-{
-    int new_num_entries;
-    kv_pair_t *pair;
-
-    new_num_entries = kvv->num_entries + 1;
-    kvv->vector = USP_REALLOC(kvv->vector, new_num_entries*sizeof(kv_pair_t));
-
-    pair = &kvv->vector[ kvv->num_entries ];
-    pair->key = key;
-    pair->value = value;
-
-    kvv->num_entries = new_num_entries;
-}
-
@@ -60,6 +60,8 @@ typedef struct
 // Key-value pair Vector API
 void KV_VECTOR_Init(kv_vector_t *kvv);
 void KV_VECTOR_Add(kv_vector_t *kvv, char *key, char *value);
+void KV_VECTOR_AddAllocated(kv_vector_t *kvv, char *key, char *value);
+void KV_VECTOR_Reserve(kv_vector_t *kvv, int num_extra);
 bool KV_VECTOR_Replace(kv_vector_t *kvv, char *key, char *value);
 void KV_VECTOR_AddUnsigned(kv_vector_t *kvv, char *key, unsigned value);
 void KV_VECTOR_AddBool(kv_vector_t *kvv, char *key, bool value);
@@ -69,6 +71,8 @@ void KV_VECTOR_AddHexNumber(kv_vector_t *kvv, char *key, unsigned char *buf, int
 void KV_VECTOR_Destroy(kv_vector_t *kvv);
 void KV_VECTOR_Dump(kv_vector_t *kvv);
 int  KV_VECTOR_FindKey(kv_vector_t *kvv, char *key, int start_index);
+int  KV_VECTOR_FindKeyIndexed(kv_vector_t *kvv, str_set_t *ss, char *key);
+bool KV_VECTOR_ReplaceIndexed(kv_vector_t *kvv, str_set_t *ss, char *key, char *value);
 int KV_VECTOR_ValidateArguments(kv_vector_t *args, str_vector_t *expected_schema);
 
 char *KV_VECTOR_Get(kv_vector_t *kvv, char *key, char *default_value, int start_index);
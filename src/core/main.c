@@ -56,6 +56,10 @@
 #include "mtp_exec.h"
 #include "dm_exec.h"
 #include "bdc_exec.h"
+#include "task_pool.h"
+#include "dns_cache.h"
+#include "usp_session.h"
+#include "msg_handler.h"
 #include "data_model.h"
 #include "dm_access.h"
 #include "device.h"
@@ -68,6 +72,9 @@
 #include "stomp.h"
 #include "retry_wait.h"
 #include "nu_macaddr.h"
+#include "proto_trace.h"
+#include "uptime.h"
+#include "replay.h"
 
 #ifdef ENABLE_HIDL
 #include "hidl_server.h"
@@ -85,20 +92,26 @@ static struct option long_options[] =
     {"dbfile",     required_argument, NULL, 'f'},    // Sets the name of the path to use for the database file
     {"verbose",    required_argument, NULL, 'v'},    // Verbosity level for debug logging
     {"meminfo",    no_argument,       NULL, 'm'},    // Collects and prints information useful to debugging memory leaks
+    {"memprofile", required_argument, NULL, 's'},    // Enables the sampling heap profiler, sampling on average 1 in N allocations
     {"error",      no_argument,       NULL, 'e'},    // Prints the callstack whenever an error is detected
     {"prototrace" ,no_argument,       NULL, 'p'},    // Enables logging of the protocol trace
+    {"protocapture",required_argument, NULL, 'x'},   // Enables capturing of all USP records sent and received to the specified (pcap format) file
     {"command",    no_argument,       NULL, 'c'},    // The rest of the command line is a command to invoke on the active USP Agent.
                                                      // Using this option turns this executable into just a CLI for the active USP Agent.
     {"authcert",   no_argument,       NULL, 'a'},    // Specifies the location of a file containing the client certificate to use authenticating this device
     {"truststore", required_argument, NULL, 't'},    // Specifies the location of a file containing the trust store certificates to use
     {"resetfile",  required_argument, NULL, 'r'},    // Specifies the location of a text file containing factory reset parameters
+    {"resetdb",    required_argument, NULL, 'R'},    // Specifies the location of a prebuilt SQLite factory reset database
     {"interface",  required_argument, NULL, 'i'},    // Specifies the networking interface to use for communications
+    {"threadcfg",  required_argument, NULL, 'C'},    // Specifies the CPU affinity, scheduling policy and stack size of each class of thread
+    {"replay",     required_argument, NULL, 'y'},    // Replays the USP records received in the specified protocol capture file, reporting their latency
+    {"replayspeed",required_argument, NULL, 'Y'},    // Factor to accelerate the original timing of replayed USP records by (0=as fast as possible)
 
     {0, 0, 0, 0}
 };
 
 // In the string argument, the colons (after the option) mean that those options require arguments
-static char short_options[] = "hl:f:v:a:t:r:i:mepc";
+static char short_options[] = "hl:f:v:a:t:r:R:i:s:x:C:y:Y:mepc";
 
 //--------------------------------------------------------------------------------------
 // Variables set by command line arguments
@@ -127,9 +140,18 @@ int main(int argc, char *argv[])
 {
     int err;
     int c;
+    int i;
     int option_index = 0;
     char *db_file = DEFAULT_DATABASE_FILE;
     bool enable_mem_info = false;
+    unsigned sample_rate;
+    char *thread_config = THREAD_CONFIG;
+    char *replay_file = NULL;
+    unsigned replay_speed = 1;
+    unsigned long long phase_start;
+
+    // Record the time at which the agent started, which the startup milestones are measured from
+    DEVICE_MSG_STATS_StartBootTiming();
 
     // Determine a handle for the data model thread (this thread)
     OS_UTILS_SetDataModelThread();
@@ -182,6 +204,18 @@ int main(int argc, char *argv[])
                 enable_mem_info = true;
                 break;
 
+            case 's':
+                // Exit if the heap profiler sample rate is invalid, otherwise enable the heap profiler
+                err = TEXT_UTILS_StringToUnsigned(optarg, &sample_rate);
+                if ((err != USP_ERR_OK) || (sample_rate > INT_MAX/2))
+                {
+                    usp_log_level = kLogLevel_Error;
+                    USP_LOG_Error("ERROR: Heap profiler sample rate (%s) is invalid or out of range", optarg);
+                    goto exit;
+                }
+                USP_MEM_SetProfileRate(sample_rate);
+                break;
+
             case 'e':
                 // Enable callstack printing when an error occurs
                 enable_callstack_debug = true;
@@ -192,6 +226,17 @@ int main(int argc, char *argv[])
                 enable_protocol_trace = true;
                 break;
 
+            case 'x':
+                // Exit if unable to start capturing USP records to the specified file
+                err = PROTO_TRACE_StartCapture(optarg);
+                if (err != USP_ERR_OK)
+                {
+                    usp_log_level = kLogLevel_Error;
+                    USP_LOG_Error("ERROR: Unable to create protocol capture file '%s'", optarg);
+                    goto exit;
+                }
+                break;
+
             case 'a':
                 // Set the location of the client certificate file to use
                 auth_cert_file = optarg;
@@ -207,6 +252,11 @@ int main(int argc, char *argv[])
                 factory_reset_text_file = optarg;
                 break;
 
+            case 'R':
+                // Set the location of the prebuilt SQLite factory reset database
+                factory_reset_db_file = optarg;
+                break;
+
             case 'i':
                 // Set the networking interface to use for USP communication
                 if (nu_ipaddr_is_valid_interface(optarg) != true)
@@ -218,6 +268,27 @@ int main(int argc, char *argv[])
                 usp_interface = optarg;
                 break;
 
+            case 'C':
+                // Set the CPU affinity, scheduling policy and stack size of each class of thread
+                thread_config = optarg;
+                break;
+
+            case 'y':
+                // Set the protocol capture file to replay
+                replay_file = optarg;
+                break;
+
+            case 'Y':
+                // Exit if the replay speed is invalid
+                err = TEXT_UTILS_StringToUnsigned(optarg, &replay_speed);
+                if (err != USP_ERR_OK)
+                {
+                    usp_log_level = kLogLevel_Error;
+                    USP_LOG_Error("ERROR: Replay speed (%s) is invalid", optarg);
+                    goto exit;
+                }
+                break;
+
             case 'v':
                 // Verbosity level
                 err = TEXT_UTILS_StringToUnsigned(optarg, &usp_log_level);
@@ -259,6 +330,36 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Exit if the thread configuration is invalid
+    // NOTE: This must be set before any threads are started
+    err = OS_UTILS_SetThreadConfig(thread_config);
+    if (err != USP_ERR_OK)
+    {
+        usp_log_level = kLogLevel_Error;
+        USP_LOG_Error("ERROR: Thread configuration '%s' is invalid: %s", thread_config, USP_ERR_GetMessage());
+        goto exit;
+    }
+
+    // Exit if unable to load the USP records to replay
+    if (replay_file != NULL)
+    {
+        err = REPLAY_Init(replay_file, replay_speed);
+        if (err != USP_ERR_OK)
+        {
+            usp_log_level = kLogLevel_Error;
+            USP_LOG_Error("ERROR: Unable to load protocol capture file '%s' for replay: %s", replay_file, USP_ERR_GetMessage());
+            goto exit;
+        }
+    }
+
+    // Exit if unable to start writing out log messages asynchronously
+    // NOTE: This is only started when running as a daemon, so that the output of the CLI client is not reordered
+    err = USP_LOG_StartAsync();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
     // Following debug is only logged when running as a daemon (not when running as CLI client).
     syslog(LOG_INFO, "USP Agent starting...");
 
@@ -277,15 +378,35 @@ int main(int argc, char *argv[])
         goto exit;
     }
 
-    // Exit if unable to spawn off a thread to service the MTPs
-    err = OS_UTILS_CreateThread(MTP_EXEC_StompMain, NULL);
+    // Exit if unable to spawn off the threads to service the STOMP MTP
+    phase_start = tu_uptime_usecs();
+    for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+    {
+        err = OS_UTILS_CreateClassThread(kThreadClass_Mtp, MTP_EXEC_StompMain, (void *)(long)i);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+
+#ifdef ENABLE_COAP
+    err = OS_UTILS_CreateClassThread(kThreadClass_Mtp, MTP_EXEC_CoapMain, NULL);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
+#endif
 
-#ifdef ENABLE_COAP
-    err = OS_UTILS_CreateThread(MTP_EXEC_CoapMain, NULL);
+#ifdef ENABLE_WEBSOCKETS
+    err = OS_UTILS_CreateClassThread(kThreadClass_Mtp, MTP_EXEC_WsclientMain, NULL);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+#endif
+
+#ifdef ENABLE_MQTT
+    err = OS_UTILS_CreateClassThread(kThreadClass_Mtp, MTP_EXEC_MqttMain, NULL);
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -293,13 +414,36 @@ int main(int argc, char *argv[])
 #endif
 
     // Exit if unable to spawn off a thread to perform bulk data collection posts
-    err = OS_UTILS_CreateThread(BDC_EXEC_Main, NULL);
+    err = OS_UTILS_CreateClassThread(kThreadClass_Bdc, BDC_EXEC_Main, NULL);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
 
+#if NUM_GET_WORKER_THREADS > 0
+    // Exit if unable to spawn off the threads which process read-only USP messages
+    for (i=0; i<NUM_GET_WORKER_THREADS; i++)
+    {
+        err = OS_UTILS_CreateClassThread(kThreadClass_GetWorker, DM_EXEC_GetWorkerMain, NULL);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+#endif
+
+    // Exit if unable to spawn off the thread which replays USP records from a protocol capture file (if enabled)
+    err = REPLAY_Start();
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_Threads, phase_start);
+
     // Run the data model main loop of USP Agent (this function does not return)
+    // NOTE: The data model thread's scheduling configuration is applied last, so that it is not inherited by the threads started above
+    OS_UTILS_ApplyThreadConfig(kThreadClass_DataModel);
     DM_EXEC_Main(NULL);
 
 exit:
@@ -324,8 +468,10 @@ int MAIN_Start(char *db_file, bool enable_mem_info)
 {
     CURLcode curl_err;
     int err;
+    unsigned long long phase_start;
     
     // Exit if unable to initialise libraries which need to be initialised when running single threaded
+    phase_start = tu_uptime_usecs();
     curl_err = curl_global_init(CURL_GLOBAL_ALL);
     if (curl_err != 0)
     {
@@ -347,18 +493,25 @@ int MAIN_Start(char *db_file, bool enable_mem_info)
         return err;
     }
 #endif
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_Libraries, phase_start);
 
     // Exit if an error occurred when initialising the database
+    phase_start = tu_uptime_usecs();
     err = DATABASE_Init(db_file);
     if (err != USP_ERR_OK)
     {
         return err;
     }
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_Database, phase_start);
 
     // Exit if an error occurred when initialising any of the the message queues used by the threads
+    phase_start = tu_uptime_usecs();
     err = DM_EXEC_Init();
     err |= MTP_EXEC_Init();
     err |= BDC_EXEC_Init();
+    err |= TASK_POOL_Init();
+    err |= DNS_CACHE_Init();
+    err |= USP_SESSION_Init();
     if (err != USP_ERR_OK)
     {
         return err;
@@ -366,13 +519,16 @@ int MAIN_Start(char *db_file, bool enable_mem_info)
 
     // Initialise the random number generator seeds
     RETRY_WAIT_Init();
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_MsgQueues, phase_start);
 
     // Exit if unable to add all schema paths to the data model
+    phase_start = tu_uptime_usecs();
     err = DATA_MODEL_Init();
     if (err != USP_ERR_OK)
     {
         return err;
     }
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_DataModelInit, phase_start);
 
     // Start logging memory usage from now on (since the static data model schema allocations have completed)
     if (enable_mem_info)
@@ -381,20 +537,33 @@ int MAIN_Start(char *db_file, bool enable_mem_info)
     }
 
     // Exit if unable to start the datamodel objects
+    phase_start = tu_uptime_usecs();
     err = DATA_MODEL_Start();
     if (err != USP_ERR_OK)
     {
         return err;
     }
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_DataModelStart, phase_start);
 
     // Start the STOMP connections. This must be done here, before other parts of the data model that require stomp connections
     // to queue messages (eg object creation/deletion notifications)
+    phase_start = tu_uptime_usecs();
     err = DEVICE_STOMP_StartAllConnections();
     if (err != USP_ERR_OK)
     {
         return err;
     }
 
+#ifdef ENABLE_MQTT
+    // Start the MQTT clients, for the same reason
+    err = DEVICE_MQTT_StartAllClients();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+#endif
+    DEVICE_MSG_STATS_RecordBootPhase(kBootTime_MtpStart, phase_start);
+
     return USP_ERR_OK;
 }
 
@@ -414,6 +583,8 @@ void MAIN_Stop(void)
 {
     // Free all memory used by USP Agent
     DM_EXEC_Destroy();
+    USP_SESSION_Destroy();
+    MSG_HANDLER_DestroyReplayCache();
     curl_global_cleanup();
 }
 
@@ -436,11 +607,17 @@ void PrintUsage(void)
     printf("--dbfile (-f)     Sets the path of the file to store the database in (default=%s)\n", DEFAULT_DATABASE_FILE);
     printf("--verbose (-v)    Sets the debug verbosity log level: 0=Off, 1=Error(default), 2=Warning, 3=Info\n");
     printf("--prototrace (-p) Enables trace logging of the USP protocol messages\n");
+    printf("--protocapture (-x) Captures all USP records sent and received to the specified file (pcap format, decode offline)\n");
     printf("--authcert (-a)   Sets the path of the PEM formatted file containing a client certificate and private key to authenticate this device with\n");
     printf("--truststore (-t) Sets the path of the PEM formatted file containing trust store certificates\n");
     printf("--resetfile (-r)  Sets the path of the text file containing factory reset parameters\n");
+    printf("--resetdb (-R)    Sets the path of a prebuilt SQLite database to restore when the database is factory reset\n");
     printf("--interface (-i)  Sets the name of the networking interface to use for USP communication\n");
+    printf("--threadcfg (-C)  Sets the CPU affinity, scheduling policy and stack size of each class of thread (eg 'all:cpus=0x1;mtp:nice=5')\n");
+    printf("--replay (-y)     Replays the USP records received in the specified protocol capture file. Use '-c dump replay' to display latencies\n");
+    printf("--replayspeed (-Y) Factor to accelerate the original timing of replayed USP records by (default 1, 0=as fast as possible)\n");
     printf("--meminfo (-m)    Collects and prints information useful to debugging memory leaks\n");
+    printf("--memprofile (-s) Enables the sampling heap profiler, sampling on average 1 in N allocations. Use '-c dump memprofile' to display\n");
     printf("--error (-e)      Enables printing of the callstack whenever an error is detected\n");
     printf("--command (-c)    Sends a CLI command to the running USP Agent and prints the response\n");
     printf("                  To get a list of all CLI commands use '-c help'\n");
@@ -0,0 +1,3716 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2017-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * \file mqtt.c
+ *
+ * Implements the MQTT MTP, with the agent acting as an MQTT 5.0 client of each broker in Device.MQTT.Client.{i}
+ * USP records are carried in PUBLISH packets at QoS 0 or 1. QoS 1 PUBLISH packets are kept until the broker
+ * acknowledges them, and are resent after a reconnect. Sessions persist across reconnects (unless CleanStart is set),
+ * so when the broker reports that the session is present, the agent does not resubscribe to its topic. This avoids
+ * a storm of SUBSCRIBE packets hitting the broker when a large number of agents reconnect at the same time.
+ * Topic aliases are used to avoid sending the controller's topic name in each PUBLISH packet.
+ * USP records are sent directly from the buffer queued by the data model thread, and received USP records are
+ * passed to the data model thread directly from the receive buffer.
+ *
+ */
+
+#ifdef ENABLE_MQTT  // NOTE: This isn't strictly necessary as this file is not included in the build if MQTT is disabled
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include "common_defs.h"
+#include "mqtt.h"
+#include "usp_api.h"
+#include "msg_handler.h"
+#include "os_utils.h"
+#include "dllist.h"
+#include "mtp_send_queue.h"
+#include "mtp_exec.h"
+#include "dm_exec.h"
+#include "retry_wait.h"
+#include "text_utils.h"
+#include "nu_ipaddr.h"
+#include "dns_cache.h"
+#include "iso8601.h"
+#include "device.h"
+#include "uptime.h"
+#include "usp_probe.h"
+
+//------------------------------------------------------------------------
+// MQTT control packet types (MQTT 5.0 section 2.1.2), shifted into the top nibble of the first byte of the fixed header
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_PUBREC         0x50
+#define MQTT_PUBREL         0x60
+#define MQTT_PUBCOMP        0x70
+#define MQTT_SUBSCRIBE      0x82    // NOTE: Includes the reserved flags which must be set for this packet type
+#define MQTT_SUBACK         0x90
+#define MQTT_UNSUBSCRIBE    0xA2    // NOTE: Includes the reserved flags which must be set for this packet type
+#define MQTT_UNSUBACK       0xB0
+#define MQTT_PINGREQ        0xC0
+#define MQTT_PINGRESP       0xD0
+#define MQTT_DISCONNECT     0xE0
+#define MQTT_AUTH           0xF0
+
+//------------------------------------------------------------------------
+// Flags in the first byte of the fixed header of a PUBLISH packet
+#define MQTT_PUBLISH_DUP    0x08
+#define MQTT_PUBLISH_QOS_SHIFT 1
+#define MQTT_PUBLISH_RETAIN 0x01
+
+//------------------------------------------------------------------------
+// Flags in the CONNECT packet, and the CONNACK acknowledge flags
+#define MQTT_CONNECT_FLAG_USERNAME      0x80
+#define MQTT_CONNECT_FLAG_PASSWORD      0x40
+#define MQTT_CONNECT_FLAG_CLEAN_START   0x02
+#define MQTT_CONNACK_SESSION_PRESENT    0x01
+
+//------------------------------------------------------------------------
+// Property identifiers (MQTT 5.0 section 2.2.2.2)
+#define MQTT_PROP_PAYLOAD_FORMAT        0x01
+#define MQTT_PROP_MESSAGE_EXPIRY        0x02
+#define MQTT_PROP_CONTENT_TYPE          0x03
+#define MQTT_PROP_RESPONSE_TOPIC        0x08
+#define MQTT_PROP_CORRELATION_DATA      0x09
+#define MQTT_PROP_SUBSCRIPTION_ID       0x0B
+#define MQTT_PROP_SESSION_EXPIRY        0x11
+#define MQTT_PROP_ASSIGNED_CLIENT_ID    0x12
+#define MQTT_PROP_SERVER_KEEP_ALIVE     0x13
+#define MQTT_PROP_AUTH_METHOD           0x15
+#define MQTT_PROP_AUTH_DATA             0x16
+#define MQTT_PROP_REQUEST_PROBLEM_INFO  0x17
+#define MQTT_PROP_WILL_DELAY            0x18
+#define MQTT_PROP_REQUEST_RESPONSE_INFO 0x19
+#define MQTT_PROP_RESPONSE_INFO         0x1A
+#define MQTT_PROP_SERVER_REFERENCE      0x1C
+#define MQTT_PROP_REASON_STRING         0x1F
+#define MQTT_PROP_RECEIVE_MAXIMUM       0x21
+#define MQTT_PROP_TOPIC_ALIAS_MAXIMUM   0x22
+#define MQTT_PROP_TOPIC_ALIAS           0x23
+#define MQTT_PROP_MAXIMUM_QOS           0x24
+#define MQTT_PROP_RETAIN_AVAILABLE      0x25
+#define MQTT_PROP_USER_PROPERTY         0x26
+#define MQTT_PROP_MAXIMUM_PACKET_SIZE   0x27
+#define MQTT_PROP_WILDCARD_SUB          0x28
+#define MQTT_PROP_SUB_ID_AVAILABLE      0x29
+#define MQTT_PROP_SHARED_SUB            0x2A
+
+//------------------------------------------------------------------------
+// Reason codes (MQTT 5.0 section 2.4) used by this implementation
+#define MQTT_REASON_SUCCESS             0x00
+#define MQTT_REASON_FAILURE             0x80    // Reason codes at or above this value indicate failure
+
+//------------------------------------------------------------------------
+// Return value of MqttWritev() denoting that the operation could not progress yet, and must be retried when the socket is ready
+#define MQTT_IO_PENDING   (-2)
+
+//------------------------------------------------------------------------
+// Return value of ReadMqttVarInt() denoting that the variable byte integer has not been completely received yet
+#define MQTT_VARINT_INCOMPLETE  0
+
+//------------------------------------------------------------------------
+// State of an MQTT client connection
+typedef enum
+{
+    kMqttState_Idle,                // Client slot is not in use
+    kMqttState_ResolvingHost,       // Waiting for the (asynchronous) DNS lookup of the broker's hostname to complete
+    kMqttState_Connecting,          // Waiting for the (non-blocking) TCP connect to the broker to complete
+    kMqttState_AwaitingConnack,     // CONNECT packet is being sent, and the CONNACK packet has not been received yet
+    kMqttState_Running,             // MQTT connection is up, and USP records are being exchanged
+    kMqttState_Retrying,            // Waiting until retry_time before reconnecting
+} mqtt_state_t;
+
+//------------------------------------------------------------------------------
+// USP Record to send in the queue
+typedef struct
+{
+    double_link_t link;     // Doubly linked list pointers. These must always be first in this structure
+    Usp__Header__MsgType usp_msg_type;  // Type of USP message contained within pbuf
+    unsigned char *pbuf;    // Protobuf format USP record to send
+    int pbuf_len;           // Length of protobuf USP record to send
+    unsigned digest;        // Hash of the USP record. Used to speed up detection of duplicate USP records in the queue
+    char *topic;            // Topic to publish the USP record to (the controller's topic)
+    mtp_send_priority_t priority;       // Send priority of this USP record
+    time_t expiry_time;     // Time at which this USP record should be removed from the queue
+    unsigned long long queued_time;     // Time (in microseconds, from tu_uptime_usecs()) at which this USP record was added to the queue
+    unsigned long long send_start_time; // Time (in microseconds, from tu_uptime_usecs()) at which this USP record started to be sent
+    unsigned packet_id;     // Packet Identifier of the QoS 1 PUBLISH carrying this USP record, or 0 if not assigned yet
+    int qos;                // QoS of the PUBLISH carrying this USP record
+    bool is_sent;           // Set once the PUBLISH carrying this USP record has been completely sent (so it is marked as a duplicate if resent)
+} mqtt_send_item_t;
+
+//------------------------------------------------------------------------
+// Structure representing an MQTT client connection to a broker
+typedef struct
+{
+    int instance;                     // Instance number of the client in Device.MQTT.Client.{i}, or INVALID if this slot is unused
+    mqtt_client_params_t params;      // Parameters of the current connection
+    char *agent_topic;                // Topic that the agent subscribes to (Device.LocalAgent.MTP.{i}.MQTT.ResponseTopicConfigured), or NULL if not configured
+
+    scheduled_action_t schedule_reconnect; // Sets whether a reconnect is scheduled after the send queue has cleared
+    mqtt_client_params_t next_params; // Parameters to use after the scheduled reconnect
+    char *next_agent_topic;           // Agent topic to use after the scheduled reconnect
+
+    mqtt_state_t state;               // Current state of the connection
+    unsigned retry_count;             // Number of times that the connection has been tried, and has failed. Reset to 0 when CONNACK is received
+    time_t retry_time;                // If state is kMqttState_Retrying, the time at which the reconnect should be attempted
+    time_t state_timeout;             // Absolute time by which the TCP connect or the CONNACK must complete
+    bool is_broker_unreachable;       // Set if the last connection attempt failed before the TCP connection to the broker was established
+
+    int socket_fd;                    // Socket of the connection, or INVALID if not connected
+    SSL *ssl;                         // SSL object of the connection, or NULL if the connection is not encrypted
+    STACK_OF(X509) *cert_chain;       // Full SSL certificate chain of the broker, collected in the SSL verify callback
+    ctrust_role_t role;               // Role granted by the CA cert in the chain of trust with the broker
+    char *allowed_controllers;        // Pattern describing the endpoint_id of controllers which are granted access to this agent by the CA cert
+    int ssl_write_want;               // Set to SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE if the last SSL_write() must be retried with the same arguments. SSL_ERROR_NONE otherwise
+    bool is_ssl_write_ctrl;           // Set if the SSL_write() to retry was sending control packets, rather than a PUBLISH packet
+
+    // Session state. This is kept across reconnects, so that the session can be resumed
+    char *assigned_client_id;         // Client Identifier assigned by the broker (if the ClientID parameter is empty), or NULL
+    char *subscribed_topic;           // Topic that the session is subscribed to, or NULL if not subscribed
+    bool is_session_present;          // Set if the broker resumed an existing session on the current connection
+
+    // Values negotiated in the CONNACK
+    int send_quota;                   // Maximum number of unacknowledged QoS 1 PUBLISH packets (minimum of broker's Receive Maximum and MAX_MQTT_INFLIGHT)
+    int max_qos;                      // Maximum QoS supported by the broker
+    unsigned max_packet_size;         // Maximum Packet Size accepted by the broker, or 0 if unlimited
+    unsigned keep_alive;              // Keep alive in use (the broker may override the configured keep alive)
+    char *response_information;       // Response Information returned by the broker, or NULL
+    char *response_topic;             // Topic that the agent is listening on (sent as the Response Topic of each PUBLISH), or NULL
+
+    // Topic aliases. These only last for the lifetime of the network connection
+    int tx_alias_max;                 // Number of topic aliases that the agent may use when publishing
+    char *tx_aliases[MAX_MQTT_TOPIC_ALIASES];   // Topic name assigned to each outbound topic alias (alias N is tx_aliases[N-1])
+    int rx_alias_max;                 // Number of topic aliases that the broker may use when publishing to the agent
+    char *rx_aliases[MAX_MQTT_TOPIC_ALIASES];   // Topic name assigned to each inbound topic alias (alias N is rx_aliases[N-1])
+
+    unsigned next_packet_id;          // Packet Identifier to try to use for the next SUBSCRIBE, UNSUBSCRIBE or QoS 1 PUBLISH packet
+    unsigned subscribe_packet_id;     // Packet Identifier of the outstanding SUBSCRIBE, or 0 if none outstanding
+
+    mtp_send_queue_t send_queue;      // Queues (one for each send priority) of USP records waiting to be sent
+    double_linked_list_t resend_list; // USP records to send (in order) before any in the send queue. These were sent (or being sent) when the connection was lost
+    double_linked_list_t inflight;    // QoS 1 USP records which have been sent, and are waiting for a PUBACK
+    int num_inflight;                 // Number of USP records in the inflight list
+    mqtt_send_item_t *cur_msg;        // USP record currently being sent, or NULL if none
+    unsigned char *tx_hdr;            // Fixed header and variable header of the PUBLISH packet carrying cur_msg
+    int tx_hdr_size;                  // Size of tx_hdr allocated
+    int tx_hdr_len;                   // Length of tx_hdr, or 0 if the PUBLISH packet carrying cur_msg has not been started yet
+    int tx_sent;                      // Number of bytes of the PUBLISH packet carrying cur_msg (headers then payload) sent so far
+
+    unsigned char *ctrl_buf;          // Control packets (CONNECT, SUBSCRIBE, PUBACK, PINGREQ etc) waiting to be sent
+    int ctrl_buf_size;                // Size of ctrl_buf allocated
+    int ctrl_len;                     // Number of bytes in ctrl_buf
+    int ctrl_sent;                    // Number of bytes of ctrl_buf sent so far
+
+    unsigned char *rx_buf;            // Buffer containing bytes received from the broker which have not been processed yet. Packets are processed in place.
+    int rx_buf_size;                  // Size of rx_buf allocated
+    int rx_len;                       // Number of unprocessed bytes in rx_buf
+    int rx_packet_len;                // Total length of the (partially received) packet at the start of rx_buf, or 0 if not known yet
+
+    time_t last_tx_time;              // Time at which a packet was last sent to the broker
+    time_t ping_timeout;              // Absolute time by which a PINGRESP must be received, or INVALID_TIME if no PINGREQ is outstanding
+} mqtt_client_t;
+
+static mqtt_client_t mqtt_clients[MAX_MQTT_CLIENTS];
+
+//------------------------------------------------------------------------
+// Properties extracted from a received packet. String and binary properties point into the receive buffer, and are not NULL terminated
+typedef struct
+{
+    bool has_session_expiry;
+    unsigned session_expiry;
+    unsigned receive_maximum;         // 0 if not present
+    int maximum_qos;                  // INVALID if not present
+    unsigned maximum_packet_size;     // 0 if not present
+    unsigned topic_alias_maximum;     // 0 if not present
+    unsigned topic_alias;             // 0 if not present
+    int server_keep_alive;            // INVALID if not present
+    unsigned char *assigned_client_id;
+    int assigned_client_id_len;
+    unsigned char *response_topic;
+    int response_topic_len;
+    unsigned char *response_information;
+    int response_information_len;
+    unsigned char *reason_string;
+    int reason_string_len;
+} mqtt_props_t;
+
+//------------------------------------------------------------------------------
+// SSL context for MQTT connections (used only for encrypted connections)
+static SSL_CTX *mqtt_ssl_ctx = NULL;
+
+//------------------------------------------------------------------------------
+// Mutex used to protect access to this component
+static pthread_mutex_t mqtt_access_mutex;
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void UpdateMqttClientSockSet(mqtt_client_t *mc, socket_set_t *set, time_t cur_time);
+void ProcessMqttClientSocketActivity(mqtt_client_t *mc, socket_set_t *set, time_t cur_time);
+void StartMqttConnection(mqtt_client_t *mc);
+void ConnectMqttSocket(mqtt_client_t *mc);
+void CompleteMqttConnect(mqtt_client_t *mc);
+int PerformMqttSslConnect(mqtt_client_t *mc);
+void QueueMqttConnect(mqtt_client_t *mc);
+void QueueMqttSubscribe(mqtt_client_t *mc, char *topic);
+void QueueMqttUnsubscribe(mqtt_client_t *mc, char *topic);
+void QueueMqttPuback(mqtt_client_t *mc, unsigned packet_id);
+void QueueMqttControlPacket(mqtt_client_t *mc, int type, unsigned char *body, int body_len);
+void ReceiveMqttPackets(mqtt_client_t *mc);
+int ReadIntoMqttRxBuf(mqtt_client_t *mc);
+void ProcessMqttRxBuffer(mqtt_client_t *mc);
+int HandleMqttPacket(mqtt_client_t *mc, int type, unsigned char *body, int body_len);
+int HandleMqttConnack(mqtt_client_t *mc, unsigned char *body, int body_len);
+void StartMqttSession(mqtt_client_t *mc);
+int HandleMqttPublish(mqtt_client_t *mc, int flags, unsigned char *body, int body_len);
+int HandleMqttPuback(mqtt_client_t *mc, unsigned char *body, int body_len);
+int HandleMqttSuback(mqtt_client_t *mc, unsigned char *body, int body_len);
+int HandleMqttDisconnect(mqtt_client_t *mc, unsigned char *body, int body_len);
+int ParseMqttProperties(unsigned char **p_buf, int *p_len, mqtt_props_t *props);
+void PostMqttUspRecord(mqtt_client_t *mc, unsigned char *pbuf, int pbuf_len, char *response_topic);
+void TransmitMqttPackets(mqtt_client_t *mc);
+void StartNextMqttPublish(mqtt_client_t *mc);
+int FormMqttPublishHeader(mqtt_client_t *mc, mqtt_send_item_t *msi);
+int FindMqttTxTopicAlias(mqtt_client_t *mc, char *topic, bool *is_new);
+unsigned AllocMqttPacketId(mqtt_client_t *mc);
+bool IsMqttPacketIdInUse(mqtt_client_t *mc, unsigned packet_id);
+int MqttWritev(mqtt_client_t *mc, struct iovec *iov, int iovcnt);
+void SendMqttDisconnect(mqtt_client_t *mc);
+bool IsMqttDataPendingToSend(mqtt_client_t *mc);
+bool IsMqttPublishPending(mqtt_client_t *mc);
+bool AreAllMqttResponsesSent(mqtt_client_t *mc);
+void UpdateMqttKeepAlive(mqtt_client_t *mc, time_t cur_time);
+void HandleMqttClientError(mqtt_client_t *mc, char *reason);
+void CloseMqttClientSocket(mqtt_client_t *mc);
+void PerformScheduledMqttReconnect(mqtt_client_t *mc);
+void StopMqttClient(mqtt_client_t *mc);
+void CopyMqttParams(mqtt_client_params_t *dest, mqtt_client_params_t *src);
+void FreeMqttParams(mqtt_client_params_t *mp);
+mqtt_client_t *FindUnusedMqttClient(void);
+mqtt_client_t *FindMqttClientByInstance(int instance);
+void RemoveExpiredMqttMessages(mqtt_client_t *mc);
+void FreeMqttSendItem(mqtt_send_item_t *msi);
+bool IsUspRecordInMqttQueue(mqtt_client_t *mc, char *topic, unsigned char *pbuf, int pbuf_len, unsigned digest);
+int WriteMqttVarInt(unsigned char *buf, unsigned value);
+int ReadMqttVarInt(unsigned char *buf, int len, unsigned *value);
+int WriteMqttString(unsigned char *buf, char *str, int len);
+int CalcMqttVarIntLen(unsigned value);
+char *MqttStrndup(unsigned char *str, int len);
+
+/*********************************************************************//**
+**
+** MQTT_Init
+**
+** Initialises this component
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int MQTT_Init(void)
+{
+    int i;
+    mqtt_client_t *mc;
+    int err;
+
+    // Mark all MQTT client slots as unused
+    memset(mqtt_clients, 0, sizeof(mqtt_clients));
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        mc->instance = INVALID;
+        mc->socket_fd = INVALID;
+    }
+
+    // Exit if unable to create mutex protecting access to this subsystem
+    err = OS_UTILS_InitMutex(&mqtt_access_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** MQTT_Start
+**
+** Creates the SSL context used by this module
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int MQTT_Start(void)
+{
+    // Create the TLS client SSL context with trust store and client cert loaded
+    mqtt_ssl_ctx = DEVICE_SECURITY_CreateSSLContext(SSLv23_client_method(), SSL_VERIFY_PEER, DEVICE_SECURITY_TrustCertVerifyCallback);
+    if (mqtt_ssl_ctx == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** MQTT_Destroy
+**
+** Frees all memory used by this component
+** Called from the MQTT MTP thread, when it exits
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_Destroy(void)
+{
+    int i;
+    mqtt_client_t *mc;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Free all MQTT clients
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if (mc->instance != INVALID)
+        {
+            // Attempt to let the broker know that we are going away (it does not matter if this fails)
+            SendMqttDisconnect(mc);
+            StopMqttClient(mc);
+        }
+    }
+
+    if (mqtt_ssl_ctx != NULL)
+    {
+        SSL_CTX_free(mqtt_ssl_ctx);
+        mqtt_ssl_ctx = NULL;
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** MQTT_EnableClient
+**
+** Starts an MQTT client connection to the specified broker
+** NOTE: The connection is made by the MQTT MTP thread, not by the caller
+**
+** \param   mp - pointer to data model parameters of the client
+** \param   agent_topic - topic that the agent subscribes to, or NULL (or empty) to use the broker's Response Information
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int MQTT_EnableClient(mqtt_client_params_t *mp, char *agent_topic)
+{
+    mqtt_client_t *mc;
+    int err = USP_ERR_OK;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_mqtt_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return USP_ERR_OK;
+    }
+
+    USP_ASSERT(FindMqttClientByInstance(mp->instance)==NULL);
+
+    // Exit if unable to find a free MQTT client slot
+    mc = FindUnusedMqttClient();
+    if (mc == NULL)
+    {
+        USP_LOG_Error("%s: Out of MQTT clients for Device.MQTT.Client.%d", __FUNCTION__, mp->instance);
+        err = USP_ERR_RESOURCES_EXCEEDED;
+        goto exit;
+    }
+
+    mc->instance = mp->instance;
+    CopyMqttParams(&mc->params, mp);
+    mc->agent_topic = USP_STRDUP((agent_topic != NULL) ? agent_topic : "");
+    mc->schedule_reconnect = kScheduledAction_Off;
+    mc->socket_fd = INVALID;
+    mc->ssl_write_want = SSL_ERROR_NONE;
+    mc->ping_timeout = INVALID_TIME;
+    mc->next_packet_id = 1;
+    MTP_SEND_QUEUE_Init(&mc->send_queue);
+    DLLIST_Init(&mc->resend_list);
+    DLLIST_Init(&mc->inflight);
+
+    // Connect as soon as the MTP thread wakes up
+    mc->state = kMqttState_Retrying;
+    mc->retry_count = 0;
+    mc->retry_time = time(NULL);
+
+exit:
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that it starts the connection
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    if (err == USP_ERR_OK)
+    {
+        MTP_EXEC_MqttWakeup();
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** MQTT_DisableClient
+**
+** Stops the specified MQTT client, discarding all USP records queued to send on it
+** NOTE: It is safe to call this function, if the client has already been stopped
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_DisableClient(int instance)
+{
+    mqtt_client_t *mc;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_mqtt_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return;
+    }
+
+    // Exit if the client has already been stopped - nothing more to do
+    mc = FindMqttClientByInstance(instance);
+    if (mc == NULL)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return;
+    }
+
+    USP_LOG_Info("%s: Stopping MQTT client (Device.MQTT.Client.%d)", __FUNCTION__, instance);
+    SendMqttDisconnect(mc);
+    StopMqttClient(mc);
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that it stops waiting on the closed socket
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    MTP_EXEC_MqttWakeup();
+}
+
+/*********************************************************************//**
+**
+** MQTT_ScheduleReconnect
+**
+** Signals that the specified MQTT client should reconnect using new parameters, once all USP responses queued on it have been sent
+** The reconnect is activated by MQTT_ActivateScheduledActions(), after the USP response to the message which
+** caused the parameter change has been queued
+**
+** \param   mp - pointer to new data model parameters of the client
+** \param   agent_topic - new topic that the agent subscribes to, or NULL (or empty) to use the broker's Response Information
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_ScheduleReconnect(mqtt_client_params_t *mp, char *agent_topic)
+{
+    mqtt_client_t *mc;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_mqtt_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return;
+    }
+
+    // Exit if the client is not running - the new parameters will be used when it is enabled
+    mc = FindMqttClientByInstance(mp->instance);
+    if (mc == NULL)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return;
+    }
+
+    // Replace any previously scheduled parameters with the new ones
+    FreeMqttParams(&mc->next_params);
+    USP_SAFE_FREE(mc->next_agent_topic);
+    CopyMqttParams(&mc->next_params, mp);
+    mc->next_agent_topic = USP_STRDUP((agent_topic != NULL) ? agent_topic : "");
+    mc->schedule_reconnect = kScheduledAction_Signalled;
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** MQTT_ActivateScheduledActions
+**
+** Called when all USP response messages have been queued
+** This function activates all scheduled reconnects, so that they occur once the responses have been sent
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_ActivateScheduledActions(void)
+{
+    int i;
+    mqtt_client_t *mc;
+    bool wakeup = false;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_mqtt_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return;
+    }
+
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if ((mc->instance != INVALID) && (mc->schedule_reconnect == kScheduledAction_Signalled))
+        {
+            mc->schedule_reconnect = kScheduledAction_Activated;
+            wakeup = true;
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that it performs the reconnects
+    if (wakeup)
+    {
+        MTP_EXEC_MqttWakeup();
+    }
+}
+
+/*********************************************************************//**
+**
+** MQTT_UpdateAllSockSet
+**
+** Updates the set of all MQTT client socket fds to read/write from
+**
+** \param   set - pointer to socket set structure to update with sockets to wait for activity on
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_UpdateAllSockSet(socket_set_t *set)
+{
+    int i;
+    mqtt_client_t *mc;
+    time_t cur_time;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    cur_time = time(NULL);
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if (mc->instance != INVALID)
+        {
+            UpdateMqttClientSockSet(mc, set, cur_time);
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** MQTT_ProcessAllSocketActivity
+**
+** Processes the sockets of all MQTT clients
+**
+** \param   set - pointer to socket set structure containing the sockets which need processing
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_ProcessAllSocketActivity(socket_set_t *set)
+{
+    int i;
+    mqtt_client_t *mc;
+    time_t cur_time;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    cur_time = time(NULL);
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if (mc->instance != INVALID)
+        {
+            ProcessMqttClientSocketActivity(mc, set, cur_time);
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** MQTT_QueueBinaryMessage
+**
+** Function called to queue a USP record to publish to a controller's topic (over MQTT)
+**
+** \param   usp_msg_type - Type of USP message contained in pbuf. This is used for debug logging when the message is sent by the MTP.
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+** \param   topic - topic to publish the USP record to
+** \param   pbuf - pointer to buffer containing binary protobuf USP record. Ownership of this buffer passes to this code, if successful
+** \param   pbuf_len - length of buffer containing protobuf binary USP record
+** \param   priority - send priority of the USP record
+** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int MQTT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *topic, unsigned char *pbuf, int pbuf_len, mtp_send_priority_t priority, time_t expiry_time)
+{
+    mqtt_client_t *mc;
+    mqtt_send_item_t *msi;
+    unsigned digest;
+    int err;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_mqtt_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to find the MQTT client
+    mc = FindMqttClientByInstance(instance);
+    if (mc == NULL)
+    {
+        USP_ERR_SetMessage("%s: No enabled MQTT client for Device.MQTT.Client.%d", __FUNCTION__, instance);
+        err = USP_ERR_INTERNAL_ERROR;
+        goto exit;
+    }
+
+    // Exit if no topic to publish to
+    if ((topic == NULL) || (*topic == '\0'))
+    {
+        USP_ERR_SetMessage("%s: No topic to publish to (Device.MQTT.Client.%d)", __FUNCTION__, instance);
+        err = USP_ERR_INTERNAL_ERROR;
+        goto exit;
+    }
+
+    // Do not add this USP record to the queue, if it is already present in the queue
+    // This situation could occur if a notify is being retried to be sent, but is already held up in the queue pending sending
+    // NOTE: Ownership of pbuf has passed to this code, so it must be freed here
+    digest = TEXT_UTILS_CalcBufferHash(pbuf, pbuf_len);
+    if (IsUspRecordInMqttQueue(mc, topic, pbuf, pbuf_len, digest))
+    {
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Remove any queued USP records that have expired
+    RemoveExpiredMqttMessages(mc);
+
+    // Exit if the MTP send queues have used up their memory budget, and this USP record is a low priority notification
+    if (MTP_SEND_QUEUE_ChargeBudget(priority, pbuf_len) == false)
+    {
+        USP_LOG_Warning("%s: MTP send queue memory budget exceeded. Dropping %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(usp_msg_type));
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Add the USP record to the queue for its send priority
+    msi = USP_MALLOC(sizeof(mqtt_send_item_t));
+    memset(msi, 0, sizeof(mqtt_send_item_t));
+    msi->usp_msg_type = usp_msg_type;
+    msi->pbuf = pbuf;
+    msi->pbuf_len = pbuf_len;
+    msi->digest = digest;
+    msi->topic = USP_STRDUP(topic);
+    msi->priority = priority;
+    msi->expiry_time = expiry_time;
+    msi->queued_time = tu_uptime_usecs();
+    MTP_SEND_QUEUE_Add(&mc->send_queue, msi->priority, msi);
+
+    err = USP_ERR_OK;
+
+exit:
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    // If successful, cause the MTP thread to wakeup from select(), so that it sends the USP record
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    if (err == USP_ERR_OK)
+    {
+        MTP_EXEC_MqttWakeup();
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** MQTT_AreAllResponsesSent
+**
+** Determines whether all USP records queued on the MQTT clients have been sent
+**
+** \param   None
+**
+** \return  true if all responses have been sent
+**
+**************************************************************************/
+bool MQTT_AreAllResponsesSent(void)
+{
+    int i;
+    mqtt_client_t *mc;
+    bool all_responses_sent = true;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if ((mc->instance != INVALID) && (AreAllMqttResponsesSent(mc)==false))
+        {
+            all_responses_sent = false;
+            break;
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    return all_responses_sent;
+}
+
+/*********************************************************************//**
+**
+** MQTT_GetMtpStatus
+**
+** Function called to get the value of Device.LocalAgent.MTP.{i}.Status for an MQTT client
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  Status of the MQTT client
+**
+**************************************************************************/
+mtp_status_t MQTT_GetMtpStatus(int instance)
+{
+    mqtt_client_t *mc;
+    mtp_status_t status = kMtpStatus_Down;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    mc = FindMqttClientByInstance(instance);
+    if (mc != NULL)
+    {
+        if (mc->state == kMqttState_Running)
+        {
+            status = kMtpStatus_Up;
+        }
+        else if (mc->retry_count > 0)
+        {
+            status = kMtpStatus_Error;
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    return status;
+}
+
+/*********************************************************************//**
+**
+** MQTT_GetClientStatus
+**
+** Function called to get the value of Device.MQTT.Client.{i}.Status
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  Status of the MQTT client (a string literal)
+**
+**************************************************************************/
+char *MQTT_GetClientStatus(int instance)
+{
+    mqtt_client_t *mc;
+    char *status = "Disabled";
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    mc = FindMqttClientByInstance(instance);
+    if (mc != NULL)
+    {
+        if (mc->state == kMqttState_Running)
+        {
+            status = "Connected";
+        }
+        else if (mc->retry_count == 0)
+        {
+            status = "Connecting";
+        }
+        else
+        {
+            status = (mc->is_broker_unreachable) ? "Error_BrokerUnreachable" : "Error";
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+
+    return status;
+}
+
+/*********************************************************************//**
+**
+** MQTT_GetResponseInformation
+**
+** Function called to get the value of Device.MQTT.Client.{i}.ResponseInformation
+** This is the Response Information returned by the broker in the CONNACK
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+** \param   buf - pointer to buffer in which to return the value
+** \param   len - length of buffer
+**
+** \return  None
+**
+**************************************************************************/
+void MQTT_GetResponseInformation(int instance, char *buf, int len)
+{
+    mqtt_client_t *mc;
+
+    OS_UTILS_LockMutex(&mqtt_access_mutex);
+
+    *buf = '\0';
+    mc = FindMqttClientByInstance(instance);
+    if ((mc != NULL) && (mc->response_information != NULL))
+    {
+        USP_STRNCPY(buf, mc->response_information, len);
+    }
+
+    OS_UTILS_UnlockMutex(&mqtt_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** UpdateMqttClientSockSet
+**
+** Adds the socket of the specified MQTT client to the socket set (if required), and updates the select() timeout
+**
+** \param   mc - pointer to MQTT client
+** \param   set - pointer to socket set structure to update with sockets to wait for activity on
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateMqttClientSockSet(mqtt_client_t *mc, socket_set_t *set, time_t cur_time)
+{
+    int timeout;        // timeout in seconds
+    time_t next_time;
+
+    #define CALC_MQTT_TIMEOUT(res, t) res = (t) - cur_time; if (res < 0) { res = 0; }
+
+    // Perform a scheduled reconnect, once all USP responses queued on this client have been sent
+    // If they have not been sent yet, then check again in a second
+    if (mc->schedule_reconnect == kScheduledAction_Activated)
+    {
+        if ((mc->state != kMqttState_Running) || (AreAllMqttResponsesSent(mc)))
+        {
+            PerformScheduledMqttReconnect(mc);
+        }
+        else
+        {
+            SOCKET_SET_UpdateTimeout(1*SECONDS, set);
+        }
+    }
+
+    switch(mc->state)
+    {
+        case kMqttState_Retrying:
+            CALC_MQTT_TIMEOUT(timeout, mc->retry_time);
+            SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, MTP_RETRY_SLACK, set);
+            break;
+
+        case kMqttState_Connecting:
+            CALC_MQTT_TIMEOUT(timeout, mc->state_timeout);
+            SOCKET_SET_AddSocketToSendTo(mc->socket_fd, timeout*SECONDS, set);
+            break;
+
+        case kMqttState_AwaitingConnack:
+        case kMqttState_Running:
+            // Determine the time at which the connect timeout or keep alive next needs to be serviced
+            timeout = MAX_SOCKET_TIMEOUT_SECONDS;
+            if (mc->state == kMqttState_AwaitingConnack)
+            {
+                CALC_MQTT_TIMEOUT(timeout, mc->state_timeout);
+            }
+            else if (mc->ping_timeout != INVALID_TIME)
+            {
+                CALC_MQTT_TIMEOUT(timeout, mc->ping_timeout);
+            }
+            else if (mc->keep_alive != 0)
+            {
+                next_time = mc->last_tx_time + mc->keep_alive;
+                CALC_MQTT_TIMEOUT(timeout, next_time);
+            }
+
+            // Always receive from the broker (unless the data model thread has a backlog of USP records to process), and also send to it, if there is anything to send
+            // NOTE: If an SSL_write() is waiting for data to be received (eg during a renegotiation), then only receiving is required
+            if ((USP_MEM_IsBudgetUnderPressure(kMemBudget_DmQueue)) && (mc->ssl_write_want != SSL_ERROR_WANT_READ))
+            {
+                SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);
+                SOCKET_SET_UpdateTimeout(MEM_BUDGET_RECHECK_PERIOD, set);
+            }
+            else
+            {
+                SOCKET_SET_AddSocketToReceiveFrom(mc->socket_fd, timeout*SECONDS, set);
+            }
+            if ((IsMqttDataPendingToSend(mc)) && (mc->ssl_write_want != SSL_ERROR_WANT_READ))
+            {
+                SOCKET_SET_AddSocketToSendTo(mc->socket_fd, timeout*SECONDS, set);
+            }
+            break;
+
+        default:
+        case kMqttState_Idle:
+        case kMqttState_ResolvingHost:
+            // Nothing to wait for. In the case of resolving the host, the DNS cache wakes up the MTP thread when the lookup completes
+            break;
+    }
+}
+
+/*********************************************************************//**
+**
+** ProcessMqttClientSocketActivity
+**
+** Processes activity (and timeouts) on the socket of the specified MQTT client
+**
+** \param   mc - pointer to MQTT client
+** \param   set - pointer to socket set structure containing the sockets which need processing
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessMqttClientSocketActivity(mqtt_client_t *mc, socket_set_t *set, time_t cur_time)
+{
+    bool is_ready_to_write;
+
+    switch(mc->state)
+    {
+        case kMqttState_Retrying:
+            if (cur_time >= mc->retry_time)
+            {
+                StartMqttConnection(mc);
+            }
+            break;
+
+        case kMqttState_ResolvingHost:
+            // Continue connecting, if the lookup of the broker's IP address has completed
+            ConnectMqttSocket(mc);
+            break;
+
+        case kMqttState_Connecting:
+            if (SOCKET_SET_IsReadyToWrite(mc->socket_fd, set))
+            {
+                CompleteMqttConnect(mc);
+            }
+            else if (cur_time >= mc->state_timeout)
+            {
+                mc->is_broker_unreachable = true;
+                HandleMqttClientError(mc, "TCP connect timed out");
+            }
+            break;
+
+        case kMqttState_AwaitingConnack:
+        case kMqttState_Running:
+            // Determine whether the socket is ready to write, before reading from it (as reading may close it)
+            is_ready_to_write = (mc->ssl_write_want == SSL_ERROR_WANT_READ) ? SOCKET_SET_IsReadyToRead(mc->socket_fd, set) :
+                                                                              SOCKET_SET_IsReadyToWrite(mc->socket_fd, set);
+
+            if (SOCKET_SET_IsReadyToRead(mc->socket_fd, set))
+            {
+                ReceiveMqttPackets(mc);
+            }
+
+            // Exit if the connection was closed whilst receiving
+            if ((mc->state != kMqttState_AwaitingConnack) && (mc->state != kMqttState_Running))
+            {
+                break;
+            }
+
+            // NOTE: Receiving may have queued packets to send (eg PUBACK, SUBSCRIBE), so attempt to send them even if the
+            // socket was not signalled as ready to write. MqttWritev() copes with the socket not being ready.
+            if (((is_ready_to_write) || (mc->ctrl_len != 0)) && (IsMqttDataPendingToSend(mc)))
+            {
+                TransmitMqttPackets(mc);
+            }
+
+            if (mc->state == kMqttState_AwaitingConnack)
+            {
+                if (time(NULL) >= mc->state_timeout)
+                {
+                    HandleMqttClientError(mc, "CONNACK timed out");
+                }
+            }
+            else if (mc->state == kMqttState_Running)
+            {
+                UpdateMqttKeepAlive(mc, time(NULL));
+            }
+            break;
+
+        default:
+        case kMqttState_Idle:
+            break;
+    }
+}
+
+/*********************************************************************//**
+**
+** StartMqttConnection
+**
+** Starts connecting to the MQTT broker
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void StartMqttConnection(mqtt_client_t *mc)
+{
+    USP_LOG_Info("Attempting to connect to MQTT broker host=%s (port=%d, %s, client_id=%s)", mc->params.broker_address, mc->params.broker_port,
+                 (mc->params.enable_encryption) ? "encrypted" : "unencrypted",
+                 (mc->params.client_id[0] != '\0') ? mc->params.client_id : (mc->assigned_client_id != NULL) ? mc->assigned_client_id : "<assigned by broker>");
+
+    ConnectMqttSocket(mc);
+}
+
+/*********************************************************************//**
+**
+** ConnectMqttSocket
+**
+** Looks up the IP address of the MQTT broker, then starts a non-blocking TCP connect to it
+** If the DNS lookup is still in progress, then the client is left in kMqttState_ResolvingHost,
+** and this function is called again when the MTP thread is woken up by the DNS cache
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void ConnectMqttSocket(mqtt_client_t *mc)
+{
+    int err;
+    bool prefer_ipv6;
+    bool is_pending;
+    nu_ipaddr_t dst;
+    nu_ipaddr_t local_mgmt_addr;
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    sa_family_t family;
+    int one = 1;
+
+    // Exit if unable to determine the IP address of the MQTT broker
+    prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
+    nu_ipaddr_set_zero(&local_mgmt_addr);
+    err = DNS_CACHE_LookupHost(mc->params.broker_address, AF_UNSPEC, prefer_ipv6, &local_mgmt_addr, &dst, &is_pending);
+    if (err != USP_ERR_OK)
+    {
+        mc->is_broker_unreachable = true;
+        HandleMqttClientError(mc, "Unable to resolve host");
+        return;
+    }
+
+    // Exit if the IP address of the MQTT broker is still being looked up. The connect continues when the lookup completes
+    if (is_pending)
+    {
+        mc->state = kMqttState_ResolvingHost;
+        return;
+    }
+
+    // Exit if unable to make a socket address structure to contact the MQTT broker
+    err = nu_ipaddr_to_sockaddr(&dst, mc->params.broker_port, &saddr, &saddr_len);
+    err |= nu_ipaddr_get_family(&dst, &family);
+    if (err != USP_ERR_OK)
+    {
+        HandleMqttClientError(mc, "Unable to convert IP address");
+        return;
+    }
+
+    // Exit if unable to create the socket
+    mc->socket_fd = socket(family, SOCK_STREAM, 0);
+    if (mc->socket_fd == -1)
+    {
+        USP_ERR_ERRNO("socket", errno);
+        mc->socket_fd = INVALID;
+        HandleMqttClientError(mc, "Unable to create socket");
+        return;
+    }
+
+    // Disable Nagle's algorithm, so that small packets (eg PUBACKs and PINGREQs) are not held back waiting for the ACK of a previous packet
+    (void)setsockopt(mc->socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Exit if unable to set the socket as non blocking
+    err = fcntl(mc->socket_fd, F_SETFL, O_NONBLOCK);
+    if (err == -1)
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        HandleMqttClientError(mc, "Unable to set socket as non-blocking");
+        return;
+    }
+
+    // Exit if unable to start connecting to the MQTT broker
+    err = connect(mc->socket_fd, (struct sockaddr *) &saddr, saddr_len);
+    if ((err == -1) && (errno != EINPROGRESS))
+    {
+        USP_ERR_ERRNO("connect", errno);
+        mc->is_broker_unreachable = true;
+        HandleMqttClientError(mc, "Unable to connect");
+        return;
+    }
+
+    // The connect completes when the socket becomes writable
+    mc->state = kMqttState_Connecting;
+    mc->state_timeout = time(NULL) + MQTT_CONNECT_TIMEOUT;
+}
+
+/*********************************************************************//**
+**
+** CompleteMqttConnect
+**
+** Called when the TCP connect to the MQTT broker has completed (successfully or not)
+** Performs the TLS handshake (if required), then starts sending the CONNECT packet
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void CompleteMqttConnect(mqtt_client_t *mc)
+{
+    int err;
+    int so_err = 0;
+    socklen_t so_len = sizeof(so_err);
+
+    // Exit if the TCP connect failed
+    err = getsockopt(mc->socket_fd, SOL_SOCKET, SO_ERROR, &so_err, &so_len);
+    if ((err == -1) || (so_err != 0))
+    {
+        USP_LOG_Error("%s: TCP connect to (host=%s, port=%d) failed (%s)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port, strerror((err == -1) ? errno : so_err));
+        mc->is_broker_unreachable = true;
+        HandleMqttClientError(mc, "TCP connect failed");
+        return;
+    }
+    mc->is_broker_unreachable = false;
+
+    // Perform the TLS handshake (if required), determining the role to use when processing USP messages
+    if (mc->params.enable_encryption)
+    {
+        err = PerformMqttSslConnect(mc);
+        if (err != USP_ERR_OK)
+        {
+            HandleMqttClientError(mc, "TLS handshake failed");
+            return;
+        }
+    }
+    else
+    {
+        mc->role = ROLE_NON_SSL;
+    }
+
+    // Start sending the CONNECT packet. The broker has MQTT_CONNECT_TIMEOUT seconds to respond with CONNACK
+    mc->state = kMqttState_AwaitingConnack;
+    mc->state_timeout = time(NULL) + MQTT_CONNECT_TIMEOUT;
+    QueueMqttConnect(mc);
+    TransmitMqttPackets(mc);
+}
+
+/*********************************************************************//**
+**
+** PerformMqttSslConnect
+**
+** Performs the TLS handshake with the MQTT broker, and determines the role to use for USP messages received on the connection
+** NOTE: As for STOMP, the handshake is performed with the socket temporarily set as blocking
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PerformMqttSslConnect(mqtt_client_t *mc)
+{
+    int sock_opt;
+    int err;
+    X509 *server_cert;
+
+    // Exit if unable to temporarily set the socket as blocking
+    sock_opt = fcntl(mc->socket_fd, F_GETFL);
+    if ((sock_opt == -1) || (fcntl(mc->socket_fd, F_SETFL, sock_opt & ~O_NONBLOCK) == -1))
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to create a new SSL connection
+    mc->ssl = SSL_new(mqtt_ssl_ctx);
+    if (mc->ssl == NULL)
+    {
+        USP_LOG_Error("%s: SSL_new() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Set the pointer to the variable in which to point to the certificate chain collected in the verify callback
+    SSL_set_app_data(mc->ssl, &mc->cert_chain);
+
+    // Send the hostname in the Server Name Indication extension, so that virtual hosted brokers present the right certificate
+    SSL_set_tlsext_host_name(mc->ssl, mc->params.broker_address);
+
+#if OPENSSL_VERSION_NUMBER >= 0x1000200FL // SSL version 1.0.2
+{
+    // Fail the certificate if the broker hostname doesn't match the SubjectAltName (or CommonName) in it
+    X509_VERIFY_PARAM *verify_object;
+    verify_object = SSL_get0_param(mc->ssl);
+    if (verify_object == NULL)
+    {
+        USP_LOG_Error("%s: SSL_get0_param() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    X509_VERIFY_PARAM_set_hostflags(verify_object, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+    X509_VERIFY_PARAM_set1_host(verify_object, mc->params.broker_address, strlen(mc->params.broker_address));
+}
+#endif
+
+    // Exit if unable to attach the socket to our SSL connection
+    err = SSL_set_fd(mc->ssl, mc->socket_fd);
+    if (err != 1)
+    {
+        USP_LOG_Error("%s: SSL_set_fd() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to successfully perform the SSL handshake
+    err = SSL_connect(mc->ssl);
+    if (err != 1)
+    {
+        USP_LOG_ErrorSSL(__FUNCTION__, "SSL_connect() failed", err, SSL_get_error(mc->ssl, err));
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the handshake was successful, but the broker did not provide a certificate
+    server_cert = SSL_get_peer_certificate(mc->ssl);
+    if (server_cert == NULL)
+    {
+        USP_LOG_Error("%s: SSL_get_peer_certificate() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    X509_free(server_cert);
+
+    // Exit if unable to determine the role associated with the trusted root cert
+    if (mc->cert_chain != NULL)
+    {
+        err = DEVICE_SECURITY_GetControllerTrust(mc->cert_chain, &mc->role, &mc->allowed_controllers);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    // Exit if unable to set the socket back as non blocking
+    err = fcntl(mc->socket_fd, F_SETFL, O_NONBLOCK);
+    if (err == -1)
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Allow SSL_write() to write a partial packet ie not block if it cannot write the full packet
+    // Also allow the control packet buffer to be reallocated (to append further packets) whilst an SSL_write() is pending
+    SSL_set_mode(mc->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** QueueMqttConnect
+**
+** Forms the CONNECT packet (MQTT 5.0 section 3.1), and queues it to send
+** If no Client Identifier is configured, the one assigned by the broker on a previous connection is used,
+** so that the broker is able to resume the session
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void QueueMqttConnect(mqtt_client_t *mc)
+{
+    unsigned char *body;
+    unsigned char *p;
+    unsigned char props[32];
+    unsigned char *q;
+    int props_len;
+    char *client_id;
+    int client_id_len;
+    int username_len;
+    int password_len;
+    int body_size;
+    unsigned flags;
+    unsigned keep_alive;
+    unsigned value;
+
+    // Determine the Client Identifier to use
+    client_id = mc->params.client_id;
+    if ((client_id[0] == '\0') && (mc->assigned_client_id != NULL))
+    {
+        client_id = mc->assigned_client_id;
+    }
+    client_id_len = strlen(client_id);
+    username_len = strlen(mc->params.username);
+    password_len = strlen(mc->params.password);
+
+    // Determine the connect flags
+    flags = 0;
+    if (mc->params.clean_start)
+    {
+        flags |= MQTT_CONNECT_FLAG_CLEAN_START;
+    }
+
+    if (username_len > 0)
+    {
+        flags |= MQTT_CONNECT_FLAG_USERNAME;
+    }
+
+    if (password_len > 0)
+    {
+        flags |= MQTT_CONNECT_FLAG_PASSWORD;
+    }
+
+    keep_alive = MIN(mc->params.keep_alive_time, 0xFFFF);
+    mc->keep_alive = keep_alive;    // NOTE: The broker may override this in the CONNACK
+    mc->rx_alias_max = MIN(mc->params.topic_alias_maximum, MAX_MQTT_TOPIC_ALIASES);
+
+    // Form the CONNECT properties
+    q = props;
+    if (mc->params.session_expiry_interval != 0)
+    {
+        value = mc->params.session_expiry_interval;
+        WRITE_BYTE(q, MQTT_PROP_SESSION_EXPIRY);
+        WRITE_4_BYTES(q, value);
+    }
+
+    value = MQTT_RECEIVE_MAXIMUM;
+    WRITE_BYTE(q, MQTT_PROP_RECEIVE_MAXIMUM);
+    WRITE_2_BYTES(q, value);
+
+    value = MAX_MQTT_PACKET_SIZE;
+    WRITE_BYTE(q, MQTT_PROP_MAXIMUM_PACKET_SIZE);
+    WRITE_4_BYTES(q, value);
+
+    if (mc->rx_alias_max != 0)
+    {
+        value = mc->rx_alias_max;
+        WRITE_BYTE(q, MQTT_PROP_TOPIC_ALIAS_MAXIMUM);
+        WRITE_2_BYTES(q, value);
+    }
+
+    // Ask the broker for Response Information, which is used as the agent's topic, if none is configured
+    WRITE_BYTE(q, MQTT_PROP_REQUEST_RESPONSE_INFO);
+    WRITE_BYTE(q, 1);
+    props_len = q - props;
+    USP_ASSERT(props_len <= sizeof(props));
+
+    // Form the CONNECT variable header and payload
+    body_size = 2 + sizeof(MQTT_PROTOCOL_NAME)-1 + 1 + 1 + 2 + MAX_MQTT_FIXED_HEADER_SIZE-1 + props_len +
+                2 + client_id_len + 2 + username_len + 2 + password_len;
+    body = USP_MALLOC(body_size);
+    p = body;
+    p += WriteMqttString(p, MQTT_PROTOCOL_NAME, sizeof(MQTT_PROTOCOL_NAME)-1);
+    WRITE_BYTE(p, MQTT_PROTOCOL_LEVEL);
+    WRITE_BYTE(p, flags);
+    WRITE_2_BYTES(p, keep_alive);
+    p += WriteMqttVarInt(p, props_len);
+    WRITE_N_BYTES(p, props, props_len);
+
+    p += WriteMqttString(p, client_id, client_id_len);
+    if (username_len > 0)
+    {
+        p += WriteMqttString(p, mc->params.username, username_len);
+    }
+
+    if (password_len > 0)
+    {
+        p += WriteMqttString(p, mc->params.password, password_len);
+    }
+
+    QueueMqttControlPacket(mc, MQTT_CONNECT, body, p - body);
+    USP_FREE(body);
+}
+
+/*********************************************************************//**
+**
+** QueueMqttSubscribe
+**
+** Forms a SUBSCRIBE packet (MQTT 5.0 section 3.8) for the agent's topic, and queues it to send
+**
+** \param   mc - pointer to MQTT client
+** \param   topic - topic to subscribe to
+**
+** \return  None
+**
+**************************************************************************/
+void QueueMqttSubscribe(mqtt_client_t *mc, char *topic)
+{
+    unsigned char *body;
+    unsigned char *p;
+    int topic_len;
+    unsigned packet_id;
+
+    topic_len = strlen(topic);
+    packet_id = AllocMqttPacketId(mc);
+    mc->subscribe_packet_id = packet_id;
+
+    body = USP_MALLOC(2 + 1 + 2 + topic_len + 1);
+    p = body;
+    WRITE_2_BYTES(p, packet_id);
+    WRITE_BYTE(p, 0);               // No properties
+    p += WriteMqttString(p, topic, topic_len);
+    WRITE_BYTE(p, 1);               // Subscription options: Maximum QoS 1
+
+    QueueMqttControlPacket(mc, MQTT_SUBSCRIBE, body, p - body);
+    USP_FREE(body);
+}
+
+/*********************************************************************//**
+**
+** QueueMqttUnsubscribe
+**
+** Forms an UNSUBSCRIBE packet (MQTT 5.0 section 3.10), and queues it to send
+** This is used when a resumed session is subscribed to a topic which is no longer the agent's topic
+**
+** \param   mc - pointer to MQTT client
+** \param   topic - topic to unsubscribe from
+**
+** \return  None
+**
+**************************************************************************/
+void QueueMqttUnsubscribe(mqtt_client_t *mc, char *topic)
+{
+    unsigned char *body;
+    unsigned char *p;
+    int topic_len;
+    unsigned packet_id;
+
+    topic_len = strlen(topic);
+    packet_id = AllocMqttPacketId(mc);
+
+    body = USP_MALLOC(2 + 1 + 2 + topic_len);
+    p = body;
+    WRITE_2_BYTES(p, packet_id);
+    WRITE_BYTE(p, 0);               // No properties
+    p += WriteMqttString(p, topic, topic_len);
+
+    QueueMqttControlPacket(mc, MQTT_UNSUBSCRIBE, body, p - body);
+    USP_FREE(body);
+}
+
+/*********************************************************************//**
+**
+** QueueMqttPuback
+**
+** Queues a PUBACK packet (MQTT 5.0 section 3.4), acknowledging a QoS 1 PUBLISH packet received from the broker
+**
+** \param   mc - pointer to MQTT client
+** \param   packet_id - Packet Identifier of the PUBLISH packet to acknowledge
+**
+** \return  None
+**
+**************************************************************************/
+void QueueMqttPuback(mqtt_client_t *mc, unsigned packet_id)
+{
+    unsigned char body[2];
+
+    // NOTE: The reason code and properties are omitted, denoting success
+    STORE_2_BYTES(body, packet_id);
+    QueueMqttControlPacket(mc, MQTT_PUBACK, body, sizeof(body));
+}
+
+/*********************************************************************//**
+**
+** QueueMqttControlPacket
+**
+** Appends a control packet to the buffer of control packets waiting to be sent
+** Control packets are sent in preference to PUBLISH packets carrying USP records, but only between PUBLISH packets
+**
+** \param   mc - pointer to MQTT client
+** \param   type - first byte of the fixed header (packet type and flags)
+** \param   body - pointer to variable header and payload of the packet
+** \param   body_len - length of the variable header and payload of the packet
+**
+** \return  None
+**
+**************************************************************************/
+void QueueMqttControlPacket(mqtt_client_t *mc, int type, unsigned char *body, int body_len)
+{
+    unsigned char *p;
+    int needed;
+    int new_size;
+
+    // Ensure that there is space at the end of the control packet buffer for this packet
+    needed = mc->ctrl_len + MAX_MQTT_FIXED_HEADER_SIZE + body_len;
+    if (needed > mc->ctrl_buf_size)
+    {
+        new_size = MAX(needed, 2*mc->ctrl_buf_size);
+        mc->ctrl_buf = USP_REALLOC(mc->ctrl_buf, new_size);
+        mc->ctrl_buf_size = new_size;
+    }
+
+    p = &mc->ctrl_buf[mc->ctrl_len];
+    WRITE_BYTE(p, type);
+    p += WriteMqttVarInt(p, body_len);
+    if (body_len > 0)
+    {
+        WRITE_N_BYTES(p, body, body_len);
+    }
+    mc->ctrl_len = p - mc->ctrl_buf;
+}
+
+/*********************************************************************//**
+**
+** ReceiveMqttPackets
+**
+** Reads all available bytes from the broker, and handles all complete packets received
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void ReceiveMqttPackets(mqtt_client_t *mc)
+{
+    int err;
+
+    err = ReadIntoMqttRxBuf(mc);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    ProcessMqttRxBuffer(mc);
+}
+
+/*********************************************************************//**
+**
+** ReadIntoMqttRxBuf
+**
+** Reads all available bytes from the connection into the end of the receive buffer
+** The receive buffer grows as needed, to hold the largest packet received
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  USP_ERR_OK if successful (even if no bytes could be read yet), otherwise the connection has been closed
+**
+**************************************************************************/
+int ReadIntoMqttRxBuf(mqtt_client_t *mc)
+{
+    int num_bytes;
+    int needed;
+    int new_size;
+    int ssl_err;
+    bool is_more;
+
+    #define MQTT_RX_MIN_SPACE  (MQTT_RX_BUF_SIZE/4)  // Minimum space to make available at the end of the receive buffer for each read
+    do
+    {
+        // Ensure that there is space at the end of the receive buffer, large enough for the current packet (if known)
+        needed = MAX(mc->rx_len + MQTT_RX_MIN_SPACE, mc->rx_packet_len);
+        if (needed > mc->rx_buf_size)
+        {
+            new_size = MAX(needed, (mc->rx_buf_size == 0) ? MQTT_RX_BUF_SIZE : 2*mc->rx_buf_size);
+            mc->rx_buf = USP_REALLOC(mc->rx_buf, new_size);
+            mc->rx_buf_size = new_size;
+        }
+
+        // Read from the socket (or SSL)
+        is_more = false;
+        if (mc->ssl == NULL)
+        {
+            num_bytes = recv(mc->socket_fd, &mc->rx_buf[mc->rx_len], mc->rx_buf_size - mc->rx_len, 0);
+            if ((num_bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            {
+                return USP_ERR_OK;
+            }
+        }
+        else
+        {
+            num_bytes = SSL_read(mc->ssl, &mc->rx_buf[mc->rx_len], mc->rx_buf_size - mc->rx_len);
+            if (num_bytes <= 0)
+            {
+                // Exit if a renegotiation is in progress - we let the select drive this
+                ssl_err = SSL_get_error(mc->ssl, num_bytes);
+                if ((ssl_err == SSL_ERROR_WANT_READ) || (ssl_err == SSL_ERROR_WANT_WRITE))
+                {
+                    return USP_ERR_OK;
+                }
+            }
+            else
+            {
+                // OpenSSL may have consumed more bytes from the socket than we have read, so keep reading until they have all been read
+                is_more = (SSL_pending(mc->ssl) > 0);
+            }
+        }
+
+        // Exit if the broker has disconnected or an error occurred
+        if (num_bytes <= 0)
+        {
+            HandleMqttClientError(mc, (num_bytes == 0) ? "MQTT broker disconnected" : "Read error");
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        mc->rx_len += num_bytes;
+        mc->ping_timeout = INVALID_TIME;      // Any data received shows that the connection is still alive
+    }
+    while (is_more);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ProcessMqttRxBuffer
+**
+** Parses and handles all complete packets in the receive buffer (MQTT 5.0 section 2.1)
+** Packets are handled in place, then removed from the receive buffer
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void ProcessMqttRxBuffer(mqtt_client_t *mc)
+{
+    int offset = 0;
+    int avail;
+    unsigned char *p;
+    unsigned remaining_len;
+    int hdr_len;
+    int len;
+    int err;
+
+    mc->rx_packet_len = 0;
+    while ((mc->state == kMqttState_AwaitingConnack) || (mc->state == kMqttState_Running))
+    {
+        // Exit if the fixed header has not been received yet
+        avail = mc->rx_len - offset;
+        p = &mc->rx_buf[offset];
+        if (avail < 2)
+        {
+            break;
+        }
+
+        len = ReadMqttVarInt(&p[1], avail-1, &remaining_len);
+        if (len == MQTT_VARINT_INCOMPLETE)
+        {
+            break;
+        }
+
+        if (len < 0)
+        {
+            HandleMqttClientError(mc, "Received malformed Remaining Length");
+            return;
+        }
+
+        // Exit if the broker has sent a packet larger than the Maximum Packet Size that we told it to use
+        hdr_len = 1 + len;
+        if (hdr_len + remaining_len > MAX_MQTT_PACKET_SIZE)
+        {
+            USP_LOG_Error("%s: MQTT broker (host=%s, port=%d) sent a packet >%d bytes long", __FUNCTION__, mc->params.broker_address, mc->params.broker_port, MAX_MQTT_PACKET_SIZE);
+            HandleMqttClientError(mc, "Received packet too long");
+            return;
+        }
+
+        // Exit if the whole packet has not been received yet, noting its length, so that the receive buffer can be sized to hold it
+        if (avail < hdr_len + (int)remaining_len)
+        {
+            mc->rx_packet_len = hdr_len + (int)remaining_len;
+            break;
+        }
+
+        // Handle the packet
+        offset += hdr_len + (int)remaining_len;
+        err = HandleMqttPacket(mc, p[0], &p[hdr_len], (int)remaining_len);
+        if (err != USP_ERR_OK)
+        {
+            return;
+        }
+    }
+
+    // Remove all handled packets from the receive buffer
+    if (((mc->state == kMqttState_AwaitingConnack) || (mc->state == kMqttState_Running)) && (offset > 0))
+    {
+        mc->rx_len -= offset;
+        memmove(mc->rx_buf, &mc->rx_buf[offset], mc->rx_len);
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleMqttPacket
+**
+** Handles a complete packet received from the broker
+**
+** \param   mc - pointer to MQTT client
+** \param   type - first byte of the fixed header (packet type and flags)
+** \param   body - pointer to variable header and payload of the packet (in the receive buffer)
+** \param   body_len - length of the variable header and payload of the packet
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleMqttPacket(mqtt_client_t *mc, int type, unsigned char *body, int body_len)
+{
+    // Exit if the broker sent anything other than CONNACK as its first packet (MQTT 5.0 section 3.2)
+    if ((mc->state == kMqttState_AwaitingConnack) && ((type & 0xF0) != MQTT_CONNACK))
+    {
+        HandleMqttClientError(mc, "Expected CONNACK");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    switch(type & 0xF0)
+    {
+        case MQTT_CONNACK:
+            if (mc->state != kMqttState_AwaitingConnack)
+            {
+                HandleMqttClientError(mc, "Received unexpected CONNACK");
+                return USP_ERR_INTERNAL_ERROR;
+            }
+            return HandleMqttConnack(mc, body, body_len);
+
+        case MQTT_PUBLISH:
+            return HandleMqttPublish(mc, type & 0x0F, body, body_len);
+
+        case MQTT_PUBACK:
+            return HandleMqttPuback(mc, body, body_len);
+
+        case MQTT_SUBACK:
+            return HandleMqttSuback(mc, body, body_len);
+
+        case MQTT_UNSUBACK:
+            // Nothing to do. If the unsubscribe failed, the agent will just receive some unwanted USP records
+            return USP_ERR_OK;
+
+        case MQTT_PINGRESP:
+            mc->ping_timeout = INVALID_TIME;
+            return USP_ERR_OK;
+
+        case MQTT_DISCONNECT:
+            return HandleMqttDisconnect(mc, body, body_len);
+
+        default:
+            // NOTE: QoS 2 and enhanced authentication are not supported, so the broker should never send any other packet types
+            USP_LOG_Error("%s: Received unexpected MQTT packet type 0x%02X", __FUNCTION__, type);
+            HandleMqttClientError(mc, "Protocol error");
+            return USP_ERR_INTERNAL_ERROR;
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleMqttConnack
+**
+** Handles the CONNACK packet (MQTT 5.0 section 3.2), storing the limits set by the broker, and starting the session
+**
+** \param   mc - pointer to MQTT client
+** \param   body - pointer to variable header of the packet (in the receive buffer)
+** \param   body_len - length of the variable header of the packet
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleMqttConnack(mqtt_client_t *mc, unsigned char *body, int body_len)
+{
+    unsigned char *p = body;
+    int len = body_len;
+    unsigned ack_flags;
+    unsigned reason_code;
+    mqtt_props_t props;
+    int err;
+
+    // Exit if the packet is too short
+    if (len < 2)
+    {
+        HandleMqttClientError(mc, "Received malformed CONNACK");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    ack_flags = READ_BYTE(p, len);
+    reason_code = READ_BYTE(p, len);
+
+    // Exit if the broker refused the connection
+    if (reason_code != MQTT_REASON_SUCCESS)
+    {
+        USP_LOG_Error("%s: MQTT broker (host=%s, port=%d) refused the connection (reason code 0x%02X)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port, reason_code);
+        HandleMqttClientError(mc, "Connection refused");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the properties are malformed
+    err = ParseMqttProperties(&p, &len, &props);
+    if (err != USP_ERR_OK)
+    {
+        HandleMqttClientError(mc, "Received malformed CONNACK properties");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Store the limits set by the broker
+    mc->is_session_present = (ack_flags & MQTT_CONNACK_SESSION_PRESENT) ? true : false;
+    mc->send_quota = (props.receive_maximum != 0) ? MIN(props.receive_maximum, MAX_MQTT_INFLIGHT) : MAX_MQTT_INFLIGHT;
+    mc->max_qos = (props.maximum_qos != INVALID) ? props.maximum_qos : 2;
+    mc->max_packet_size = props.maximum_packet_size;
+    mc->tx_alias_max = MIN(props.topic_alias_maximum, MAX_MQTT_TOPIC_ALIASES);
+    if (props.server_keep_alive != INVALID)
+    {
+        mc->keep_alive = props.server_keep_alive;
+    }
+
+    // Store the Client Identifier assigned by the broker, so that it is used to resume the session after a reconnect
+    if (props.assigned_client_id != NULL)
+    {
+        USP_SAFE_FREE(mc->assigned_client_id);
+        mc->assigned_client_id = MqttStrndup(props.assigned_client_id, props.assigned_client_id_len);
+    }
+
+    USP_SAFE_FREE(mc->response_information);
+    if (props.response_information != NULL)
+    {
+        mc->response_information = MqttStrndup(props.response_information, props.response_information_len);
+    }
+
+    mc->state = kMqttState_Running;
+    mc->retry_count = 0;
+    mc->is_broker_unreachable = false;
+    DEVICE_MSG_STATS_RecordBootMilestone(kBootTime_FirstMtpConnected);
+    USP_LOG_Info("Connected to MQTT broker host=%s (port=%d, session %s)", mc->params.broker_address, mc->params.broker_port,
+                 (mc->is_session_present) ? "resumed" : "new");
+
+    StartMqttSession(mc);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** StartMqttSession
+**
+** Subscribes to the agent's topic, unless the session resumed by the broker is already subscribed to it
+** Not resubscribing on a resumed session avoids a storm of SUBSCRIBE packets hitting the broker,
+** when a large number of agents reconnect at the same time (eg after the broker has restarted)
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void StartMqttSession(mqtt_client_t *mc)
+{
+    char *topic;
+    mqtt_send_item_t *msi;
+
+    // If the broker has started a new session, then it is not subscribed to any topic,
+    // and the Packet Identifiers of PUBLISH packets that were not acknowledged in the old session no longer apply
+    if (mc->is_session_present == false)
+    {
+        USP_SAFE_FREE(mc->subscribed_topic);
+        msi = (mqtt_send_item_t *) mc->resend_list.head;
+        while (msi != NULL)
+        {
+            msi->packet_id = 0;
+            msi->is_sent = false;
+            msi = (mqtt_send_item_t *) msi->link.next;
+        }
+    }
+
+    // Determine the topic to subscribe to. If none is configured, then use the Response Information provided by the broker
+    topic = (mc->agent_topic[0] != '\0') ? mc->agent_topic : mc->response_information;
+    USP_SAFE_FREE(mc->response_topic);
+    if ((topic == NULL) || (*topic == '\0'))
+    {
+        USP_LOG_Warning("%s: No topic to subscribe to on MQTT broker host=%s (Device.MQTT.Client.%d). Configure Device.LocalAgent.MTP.{i}.MQTT.ResponseTopicConfigured",
+                        __FUNCTION__, mc->params.broker_address, mc->instance);
+        return;
+    }
+    mc->response_topic = USP_STRDUP(topic);
+
+    // Exit if the resumed session is already subscribed to the topic
+    if ((mc->subscribed_topic != NULL) && (strcmp(mc->subscribed_topic, topic)==0))
+    {
+        USP_LOG_Info("%s: Resumed session is already subscribed to topic %s", __FUNCTION__, topic);
+        return;
+    }
+
+    // Unsubscribe from the topic that the resumed session is subscribed to, if it is no longer the agent's topic
+    if (mc->subscribed_topic != NULL)
+    {
+        QueueMqttUnsubscribe(mc, mc->subscribed_topic);
+        USP_SAFE_FREE(mc->subscribed_topic);
+    }
+
+    // NOTE: subscribed_topic is only set once the broker has acknowledged the subscription
+    QueueMqttSubscribe(mc, topic);
+}
+
+/*********************************************************************//**
+**
+** HandleMqttPublish
+**
+** Handles a PUBLISH packet (MQTT 5.0 section 3.3) received from the broker, passing the USP record it contains to the data model thread
+**
+** \param   mc - pointer to MQTT client
+** \param   flags - flags in the first byte of the fixed header
+** \param   body - pointer to variable header and payload of the packet (in the receive buffer)
+** \param   body_len - length of the variable header and payload of the packet
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleMqttPublish(mqtt_client_t *mc, int flags, unsigned char *body, int body_len)
+{
+    unsigned char *p = body;
+    int len = body_len;
+    int qos;
+    unsigned topic_len;
+    unsigned char *topic;
+    unsigned packet_id = 0;
+    mqtt_props_t props;
+    char **alias;
+    char *response_topic;
+    int err;
+
+    // Exit if the QoS is not supported. The agent subscribes with a maximum QoS of 1, so the broker should never send QoS 2
+    qos = (flags >> MQTT_PUBLISH_QOS_SHIFT) & 0x03;
+    if (qos > 1)
+    {
+        HandleMqttClientError(mc, "Received PUBLISH with unsupported QoS");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the variable header is malformed
+    if (len < 2)
+    {
+        goto malformed;
+    }
+    topic_len = READ_2_BYTES(p, len);
+    if (len < (int)topic_len + ((qos == 1) ? 2 : 0))
+    {
+        goto malformed;
+    }
+    topic = p;
+    p += topic_len;
+    len -= topic_len;
+
+    if (qos == 1)
+    {
+        packet_id = READ_2_BYTES(p, len);
+    }
+
+    err = ParseMqttProperties(&p, &len, &props);
+    if (err != USP_ERR_OK)
+    {
+        goto malformed;
+    }
+
+    // Track the topic aliases used by the broker (MQTT 5.0 section 3.3.2.3.4)
+    // NOTE: The topic itself is not otherwise needed, as the agent only subscribes to a single topic
+    if (props.topic_alias != 0)
+    {
+        if (props.topic_alias > mc->rx_alias_max)
+        {
+            HandleMqttClientError(mc, "Received PUBLISH with invalid Topic Alias");
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        alias = &mc->rx_aliases[props.topic_alias-1];
+        if (topic_len > 0)
+        {
+            USP_SAFE_FREE(*alias);
+            *alias = MqttStrndup(topic, topic_len);
+        }
+        else if (*alias == NULL)
+        {
+            HandleMqttClientError(mc, "Received PUBLISH with unknown Topic Alias");
+            return USP_ERR_INTERNAL_ERROR;
+        }
+    }
+    else if (topic_len == 0)
+    {
+        goto malformed;
+    }
+
+    // Pass the USP record to the data model thread, then acknowledge it
+    // NOTE: The USP record is acknowledged even if it could not be processed, as resending it would not help
+    response_topic = (props.response_topic != NULL) ? MqttStrndup(props.response_topic, props.response_topic_len) : NULL;
+    PostMqttUspRecord(mc, p, len, response_topic);
+    USP_SAFE_FREE(response_topic);
+
+    if (qos == 1)
+    {
+        QueueMqttPuback(mc, packet_id);
+    }
+
+    return USP_ERR_OK;
+
+malformed:
+    HandleMqttClientError(mc, "Received malformed PUBLISH");
+    return USP_ERR_INTERNAL_ERROR;
+}
+
+/*********************************************************************//**
+**
+** HandleMqttPuback
+**
+** Handles a PUBACK packet (MQTT 5.0 section 3.4), freeing the USP record that it acknowledges
+**
+** \param   mc - pointer to MQTT client
+** \param   body - pointer to variable header of the packet (in the receive buffer)
+** \param   body_len - length of the variable header of the packet
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleMqttPuback(mqtt_client_t *mc, unsigned char *body, int body_len)
+{
+    unsigned char *p = body;
+    int len = body_len;
+    unsigned packet_id;
+    unsigned reason_code = MQTT_REASON_SUCCESS;
+    mqtt_send_item_t *msi;
+
+    // Exit if the packet is too short
+    if (len < 2)
+    {
+        HandleMqttClientError(mc, "Received malformed PUBACK");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    packet_id = READ_2_BYTES(p, len);
+    if (len > 0)
+    {
+        reason_code = READ_BYTE(p, len);
+    }
+
+    // Find the USP record that has been acknowledged
+    msi = (mqtt_send_item_t *) mc->inflight.head;
+    while ((msi != NULL) && (msi->packet_id != packet_id))
+    {
+        msi = (mqtt_send_item_t *) msi->link.next;
+    }
+
+    // Exit if the PUBACK does not match any USP record sent. This could occur if the broker acknowledged a resent PUBLISH twice
+    if (msi == NULL)
+    {
+        USP_LOG_Warning("%s: Ignoring PUBACK for unknown packet identifier %u", __FUNCTION__, packet_id);
+        return USP_ERR_OK;
+    }
+
+    // NOTE: The broker rejecting the USP record is not a connection error. The USP record is dropped (as for any other MTP).
+    if (reason_code >= MQTT_REASON_FAILURE)
+    {
+        USP_LOG_Warning("%s: MQTT broker did not accept USP record published to %s (reason code 0x%02X)", __FUNCTION__, msi->topic, reason_code);
+    }
+
+    DLLIST_Unlink(&mc->inflight, msi);
+    mc->num_inflight--;
+    FreeMqttSendItem(msi);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** HandleMqttSuback
+**
+** Handles a SUBACK packet (MQTT 5.0 section 3.9), recording that the session is subscribed to the agent's topic
+**
+** \param   mc - pointer to MQTT client
+** \param   body - pointer to variable header and payload of the packet (in the receive buffer)
+** \param   body_len - length of the variable header and payload of the packet
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleMqttSuback(mqtt_client_t *mc, unsigned char *body, int body_len)
+{
+    unsigned char *p = body;
+    int len = body_len;
+    unsigned packet_id;
+    unsigned reason_code;
+    mqtt_props_t props;
+    int err;
+
+    // Exit if the packet is malformed
+    if (len < 2)
+    {
+        goto malformed;
+    }
+    packet_id = READ_2_BYTES(p, len);
+
+    err = ParseMqttProperties(&p, &len, &props);
+    if ((err != USP_ERR_OK) || (len < 1))
+    {
+        goto malformed;
+    }
+    reason_code = READ_BYTE(p, len);
+
+    // Exit if this is not the response to our SUBSCRIBE
+    if ((packet_id != mc->subscribe_packet_id) || (mc->response_topic == NULL))
+    {
+        return USP_ERR_OK;
+    }
+    mc->subscribe_packet_id = 0;
+
+    // Exit if the broker refused the subscription. Without it, the agent cannot receive any USP records, so reconnect later
+    if (reason_code >= MQTT_REASON_FAILURE)
+    {
+        USP_LOG_Error("%s: MQTT broker (host=%s, port=%d) refused subscription to %s (reason code 0x%02X)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port, mc->response_topic, reason_code);
+        HandleMqttClientError(mc, "Subscription refused");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    USP_SAFE_FREE(mc->subscribed_topic);
+    mc->subscribed_topic = USP_STRDUP(mc->response_topic);
+
+    return USP_ERR_OK;
+
+malformed:
+    HandleMqttClientError(mc, "Received malformed SUBACK");
+    return USP_ERR_INTERNAL_ERROR;
+}
+
+/*********************************************************************//**
+**
+** HandleMqttDisconnect
+**
+** Handles a DISCONNECT packet (MQTT 5.0 section 3.14) sent by the broker
+**
+** \param   mc - pointer to MQTT client
+** \param   body - pointer to variable header of the packet (in the receive buffer)
+** \param   body_len - length of the variable header of the packet
+**
+** \return  USP_ERR_INTERNAL_ERROR, as the connection has been closed
+**
+**************************************************************************/
+int HandleMqttDisconnect(mqtt_client_t *mc, unsigned char *body, int body_len)
+{
+    unsigned reason_code = MQTT_REASON_SUCCESS;
+
+    if (body_len > 0)
+    {
+        reason_code = body[0];
+    }
+
+    USP_LOG_Warning("%s: MQTT broker (host=%s, port=%d) disconnected (reason code 0x%02X)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port, reason_code);
+    HandleMqttClientError(mc, "MQTT broker disconnected");
+    return USP_ERR_INTERNAL_ERROR;
+}
+
+/*********************************************************************//**
+**
+** ParseMqttProperties
+**
+** Parses the properties in a received packet (MQTT 5.0 section 2.2.2), extracting the ones used by this implementation
+** NOTE: If the packet ends before the property length, then this is treated as no properties
+**
+** \param   p_buf - pointer to variable containing pointer to the property length in the receive buffer.
+**                  On return, this is updated to point to the byte after the properties
+** \param   p_len - pointer to variable containing the number of bytes left in the packet. On return, this is updated
+** \param   props - pointer to structure in which to return the properties
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INTERNAL_ERROR if the properties are malformed
+**
+**************************************************************************/
+int ParseMqttProperties(unsigned char **p_buf, int *p_len, mqtt_props_t *props)
+{
+    unsigned char *p = *p_buf;
+    int len = *p_len;
+    unsigned props_len;
+    unsigned char *end;
+    unsigned id;
+    unsigned value;
+    unsigned str_len;
+    unsigned char *str;
+    int n;
+
+    // Types of each property, indexed by property identifier
+    enum { kMqttPropType_Invalid=0, kMqttPropType_Byte, kMqttPropType_TwoByte, kMqttPropType_FourByte,
+           kMqttPropType_VarInt, kMqttPropType_String, kMqttPropType_Binary, kMqttPropType_StringPair };
+    static const unsigned char prop_types[MQTT_PROP_SHARED_SUB+1] =
+    {
+        [MQTT_PROP_PAYLOAD_FORMAT] = kMqttPropType_Byte,
+        [MQTT_PROP_MESSAGE_EXPIRY] = kMqttPropType_FourByte,
+        [MQTT_PROP_CONTENT_TYPE] = kMqttPropType_String,
+        [MQTT_PROP_RESPONSE_TOPIC] = kMqttPropType_String,
+        [MQTT_PROP_CORRELATION_DATA] = kMqttPropType_Binary,
+        [MQTT_PROP_SUBSCRIPTION_ID] = kMqttPropType_VarInt,
+        [MQTT_PROP_SESSION_EXPIRY] = kMqttPropType_FourByte,
+        [MQTT_PROP_ASSIGNED_CLIENT_ID] = kMqttPropType_String,
+        [MQTT_PROP_SERVER_KEEP_ALIVE] = kMqttPropType_TwoByte,
+        [MQTT_PROP_AUTH_METHOD] = kMqttPropType_String,
+        [MQTT_PROP_AUTH_DATA] = kMqttPropType_Binary,
+        [MQTT_PROP_REQUEST_PROBLEM_INFO] = kMqttPropType_Byte,
+        [MQTT_PROP_WILL_DELAY] = kMqttPropType_FourByte,
+        [MQTT_PROP_REQUEST_RESPONSE_INFO] = kMqttPropType_Byte,
+        [MQTT_PROP_RESPONSE_INFO] = kMqttPropType_String,
+        [MQTT_PROP_SERVER_REFERENCE] = kMqttPropType_String,
+        [MQTT_PROP_REASON_STRING] = kMqttPropType_String,
+        [MQTT_PROP_RECEIVE_MAXIMUM] = kMqttPropType_TwoByte,
+        [MQTT_PROP_TOPIC_ALIAS_MAXIMUM] = kMqttPropType_TwoByte,
+        [MQTT_PROP_TOPIC_ALIAS] = kMqttPropType_TwoByte,
+        [MQTT_PROP_MAXIMUM_QOS] = kMqttPropType_Byte,
+        [MQTT_PROP_RETAIN_AVAILABLE] = kMqttPropType_Byte,
+        [MQTT_PROP_USER_PROPERTY] = kMqttPropType_StringPair,
+        [MQTT_PROP_MAXIMUM_PACKET_SIZE] = kMqttPropType_FourByte,
+        [MQTT_PROP_WILDCARD_SUB] = kMqttPropType_Byte,
+        [MQTT_PROP_SUB_ID_AVAILABLE] = kMqttPropType_Byte,
+        [MQTT_PROP_SHARED_SUB] = kMqttPropType_Byte,
+    };
+
+    memset(props, 0, sizeof(mqtt_props_t));
+    props->maximum_qos = INVALID;
+    props->server_keep_alive = INVALID;
+
+    // Exit if there are no properties
+    if (len == 0)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Exit if the property length is malformed, or larger than the rest of the packet
+    n = ReadMqttVarInt(p, len, &props_len);
+    if ((n <= 0) || ((int)props_len > len - n))
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    p += n;
+    len -= n;
+    end = p + props_len;
+
+    while (p < end)
+    {
+        // Exit if the property identifier is unknown
+        id = *p++;
+        if ((id >= NUM_ELEM(prop_types)) || (prop_types[id] == kMqttPropType_Invalid))
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        // Read the value of the property
+        value = 0;
+        str = NULL;
+        str_len = 0;
+        switch(prop_types[id])
+        {
+            case kMqttPropType_Byte:
+                if (end - p < 1)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                value = *p++;
+                break;
+
+            case kMqttPropType_TwoByte:
+                if (end - p < 2)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                value = CONVERT_2_BYTES(p);
+                p += 2;
+                break;
+
+            case kMqttPropType_FourByte:
+                if (end - p < 4)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                value = CONVERT_4_BYTES(p);
+                p += 4;
+                break;
+
+            case kMqttPropType_VarInt:
+                n = ReadMqttVarInt(p, end - p, &value);
+                if (n <= 0)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                p += n;
+                break;
+
+            case kMqttPropType_String:
+            case kMqttPropType_Binary:
+            case kMqttPropType_StringPair:
+                // NOTE: A string pair is two consecutive strings. Only the first string is extracted (but no string pairs are used)
+                if (end - p < 2)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                str_len = CONVERT_2_BYTES(p);
+                if (end - p < 2 + (int)str_len)
+                {
+                    return USP_ERR_INTERNAL_ERROR;
+                }
+                str = p + 2;
+                p += 2 + str_len;
+
+                if (prop_types[id] == kMqttPropType_StringPair)
+                {
+                    if (end - p < 2)
+                    {
+                        return USP_ERR_INTERNAL_ERROR;
+                    }
+                    n = CONVERT_2_BYTES(p);
+                    if (end - p < 2 + n)
+                    {
+                        return USP_ERR_INTERNAL_ERROR;
+                    }
+                    p += 2 + n;
+                }
+                break;
+
+            default:
+                TERMINATE_BAD_CASE(prop_types[id]);
+                break;
+        }
+
+        // Store the properties used by this implementation
+        switch(id)
+        {
+            case MQTT_PROP_SESSION_EXPIRY:
+                props->has_session_expiry = true;
+                props->session_expiry = value;
+                break;
+
+            case MQTT_PROP_RECEIVE_MAXIMUM:
+                props->receive_maximum = value;
+                break;
+
+            case MQTT_PROP_MAXIMUM_QOS:
+                props->maximum_qos = value;
+                break;
+
+            case MQTT_PROP_MAXIMUM_PACKET_SIZE:
+                props->maximum_packet_size = value;
+                break;
+
+            case MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+                props->topic_alias_maximum = value;
+                break;
+
+            case MQTT_PROP_TOPIC_ALIAS:
+                props->topic_alias = value;
+                break;
+
+            case MQTT_PROP_SERVER_KEEP_ALIVE:
+                props->server_keep_alive = value;
+                break;
+
+            case MQTT_PROP_ASSIGNED_CLIENT_ID:
+                props->assigned_client_id = str;
+                props->assigned_client_id_len = str_len;
+                break;
+
+            case MQTT_PROP_RESPONSE_TOPIC:
+                props->response_topic = str;
+                props->response_topic_len = str_len;
+                break;
+
+            case MQTT_PROP_RESPONSE_INFO:
+                props->response_information = str;
+                props->response_information_len = str_len;
+                break;
+
+            case MQTT_PROP_REASON_STRING:
+                props->reason_string = str;
+                props->reason_string_len = str_len;
+                break;
+
+            default:
+                // Other properties are ignored
+                break;
+        }
+    }
+
+    *p_buf = end;
+    *p_len = len - props_len;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** PostMqttUspRecord
+**
+** Passes a USP record received from the broker to the data model thread
+** NOTE: The USP record is copied by DM_EXEC_PostUspRecord(), so it may be handled directly from the receive buffer
+**
+** \param   mc - pointer to MQTT client
+** \param   pbuf - pointer to buffer containing the USP record
+** \param   pbuf_len - length of the USP record
+** \param   response_topic - topic to send the response to (from the Response Topic property), or NULL if not specified
+**
+** \return  None
+**
+**************************************************************************/
+void PostMqttUspRecord(mqtt_client_t *mc, unsigned char *pbuf, int pbuf_len, char *response_topic)
+{
+    mtp_reply_to_t mtp_reply_to = {0};
+    char time_buf[MAX_ISO8601_LEN];
+
+    // Ignore empty PUBLISH packets
+    if (pbuf_len == 0)
+    {
+        USP_LOG_Warning("%s: Ignoring empty PUBLISH from MQTT broker (host=%s, port=%d)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port);
+        return;
+    }
+
+    iso8601_cur_time(time_buf, sizeof(time_buf));
+    USP_LOG_Info("Message received at time %s, from host %s over MQTT", time_buf, mc->params.broker_address);
+
+    // If the controller specified a Response Topic, then the response is sent to it. Otherwise the response is sent to
+    // the topic configured for the controller in Device.LocalAgent.Controller.{i}.MTP.{i}.MQTT.Topic
+    mtp_reply_to.protocol = kMtpProtocol_MQTT;
+    mtp_reply_to.mqtt_instance = mc->instance;
+    mtp_reply_to.mqtt_topic = response_topic;
+    mtp_reply_to.is_reply_to_specified = (response_topic != NULL) ? true : false;
+    DM_EXEC_PostUspRecord(pbuf, pbuf_len, mc->role, mc->allowed_controllers, &mtp_reply_to);
+}
+
+/*********************************************************************//**
+**
+** TransmitMqttPackets
+**
+** Sends queued control packets and PUBLISH packets carrying USP records, until the socket cannot accept any more data
+** PUBLISH packets are sent without copying the USP record: the PUBLISH headers and the USP record are sent using writev()
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void TransmitMqttPackets(mqtt_client_t *mc)
+{
+    struct iovec iov[2];
+    int iovcnt;
+    int num_bytes;
+    int packet_len;
+    bool is_ctrl;
+    mqtt_send_item_t *msi;
+
+    while ((mc->state == kMqttState_AwaitingConnack) || (mc->state == kMqttState_Running))
+    {
+        // Determine what to send next. Control packets go first, unless a PUBLISH packet has already been partially sent
+        // NOTE: If an SSL_write() is pending, then it must be retried with the same data
+        if (mc->ssl_write_want != SSL_ERROR_NONE)
+        {
+            is_ctrl = mc->is_ssl_write_ctrl;
+        }
+        else
+        {
+            is_ctrl = ((mc->ctrl_len != 0) && (mc->tx_sent == 0));
+        }
+
+        iovcnt = 0;
+        if (is_ctrl)
+        {
+            iov[0].iov_base = &mc->ctrl_buf[mc->ctrl_sent];
+            iov[0].iov_len = mc->ctrl_len - mc->ctrl_sent;
+            iovcnt = 1;
+        }
+        else
+        {
+            // Exit if USP records must not be sent yet (the CONNACK has not been received), or there are no more USP records to send
+            if (mc->state != kMqttState_Running)
+            {
+                return;
+            }
+
+            if (mc->cur_msg == NULL)
+            {
+                StartNextMqttPublish(mc);
+                if (mc->cur_msg == NULL)
+                {
+                    return;
+                }
+            }
+
+            // Send the rest of the PUBLISH headers, then the rest of the USP record
+            if (mc->tx_sent < mc->tx_hdr_len)
+            {
+                iov[iovcnt].iov_base = &mc->tx_hdr[mc->tx_sent];
+                iov[iovcnt].iov_len = mc->tx_hdr_len - mc->tx_sent;
+                iovcnt++;
+                iov[iovcnt].iov_base = mc->cur_msg->pbuf;
+                iov[iovcnt].iov_len = mc->cur_msg->pbuf_len;
+                iovcnt++;
+            }
+            else
+            {
+                iov[iovcnt].iov_base = &mc->cur_msg->pbuf[mc->tx_sent - mc->tx_hdr_len];
+                iov[iovcnt].iov_len = mc->cur_msg->pbuf_len - (mc->tx_sent - mc->tx_hdr_len);
+                iovcnt++;
+            }
+        }
+
+        // Exit if nothing could be sent yet. The write will be retried when the socket is ready
+        mc->is_ssl_write_ctrl = is_ctrl;
+        num_bytes = MqttWritev(mc, iov, iovcnt);
+        if (num_bytes == MQTT_IO_PENDING)
+        {
+            return;
+        }
+
+        // Exit if an error occurred
+        if (num_bytes <= 0)
+        {
+            HandleMqttClientError(mc, (num_bytes == 0) ? "MQTT broker disconnected" : "Write error");
+            return;
+        }
+
+        USP_PROBE3(mtp_write, kMtpProtocol_MQTT, mc->params.broker_address, num_bytes);
+        mc->last_tx_time = time(NULL);
+
+        // Exit if the control packets have not been sent entirely
+        if (is_ctrl)
+        {
+            mc->ctrl_sent += num_bytes;
+            if (mc->ctrl_sent < mc->ctrl_len)
+            {
+                return;
+            }
+            mc->ctrl_len = 0;
+            mc->ctrl_sent = 0;
+            continue;
+        }
+
+        // Exit if the PUBLISH packet carrying the USP record has not been sent entirely
+        mc->tx_sent += num_bytes;
+        packet_len = mc->tx_hdr_len + mc->cur_msg->pbuf_len;
+        if (mc->tx_sent < packet_len)
+        {
+            return;
+        }
+
+        // The USP record has been sent. QoS 1 USP records are kept until the broker acknowledges them
+        msi = mc->cur_msg;
+        DEVICE_MSG_STATS_Record(msi->usp_msg_type, kMsgStat_WireSend, msi->send_start_time);
+        mc->cur_msg = NULL;
+        mc->tx_hdr_len = 0;
+        mc->tx_sent = 0;
+        if (msi->qos == 1)
+        {
+            msi->is_sent = true;
+            DLLIST_LinkToTail(&mc->inflight, msi);
+            mc->num_inflight++;
+        }
+        else
+        {
+            FreeMqttSendItem(msi);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** StartNextMqttPublish
+**
+** Selects the next USP record to send, and forms the headers of the PUBLISH packet carrying it
+** USP records which were not acknowledged on a previous connection are sent first, followed by
+** the queued USP records (in send priority order)
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None. mc->cur_msg is left as NULL if there are no USP records which can be sent now
+**
+**************************************************************************/
+void StartNextMqttPublish(mqtt_client_t *mc)
+{
+    mqtt_send_item_t *msi;
+    time_t cur_time;
+    int qos;
+    int err;
+
+    USP_ASSERT(mc->cur_msg == NULL);
+
+    // Exit if the broker's Receive Maximum does not allow any more QoS 1 PUBLISH packets to be sent until some are acknowledged
+    qos = MIN(mc->params.publish_qos, mc->max_qos);
+    if ((qos == 1) && (mc->num_inflight >= mc->send_quota))
+    {
+        return;
+    }
+
+    cur_time = time(NULL);
+    while (1)
+    {
+        msi = (mqtt_send_item_t *) mc->resend_list.head;
+        if (msi != NULL)
+        {
+            DLLIST_Unlink(&mc->resend_list, msi);
+        }
+        else
+        {
+            msi = (mqtt_send_item_t *) MTP_SEND_QUEUE_Pop(&mc->send_queue);
+        }
+
+        // Exit if no more USP records to send
+        if (msi == NULL)
+        {
+            return;
+        }
+
+        // Skip USP records which have expired whilst queued, or which are too large for the broker to accept
+        if (cur_time > msi->expiry_time)
+        {
+            FreeMqttSendItem(msi);
+            continue;
+        }
+
+        err = FormMqttPublishHeader(mc, msi);
+        if (err != USP_ERR_OK)
+        {
+            FreeMqttSendItem(msi);
+            continue;
+        }
+
+        break;
+    }
+
+    // Log the USP record, and record how long it was queued for (only the first time that it is sent)
+    if (msi->send_start_time == 0)
+    {
+        MSG_HANDLER_LogMessageToSend(msi->usp_msg_type, msi->pbuf, msi->pbuf_len, kMtpProtocol_MQTT, mc->params.broker_address, NULL, kMtpContentType_UspRecord);
+        msi->send_start_time = tu_uptime_usecs();
+        DEVICE_MSG_STATS_RecordDuration(msi->usp_msg_type, kMsgStat_SendQueueWait,
+                                        (msi->send_start_time > msi->queued_time) ? msi->send_start_time - msi->queued_time : 0);
+    }
+
+    mc->cur_msg = msi;
+    mc->tx_sent = 0;
+}
+
+/*********************************************************************//**
+**
+** FormMqttPublishHeader
+**
+** Forms the fixed header and variable header of the PUBLISH packet carrying the specified USP record (MQTT 5.0 section 3.3)
+** The USP record itself is not copied. It is sent directly from its buffer, after the headers.
+**
+** \param   mc - pointer to MQTT client
+** \param   msi - pointer to USP record to send
+**
+** \return  USP_ERR_OK if successful, USP_ERR_RESOURCES_EXCEEDED if the PUBLISH packet would be too large for the broker
+**
+**************************************************************************/
+int FormMqttPublishHeader(mqtt_client_t *mc, mqtt_send_item_t *msi)
+{
+    unsigned char *p;
+    int qos;
+    int alias;
+    bool is_new_alias;
+    int topic_len;
+    int content_type_len;
+    int response_topic_len;
+    int props_len;
+    int remaining_len;
+    int packet_len;
+    int hdr_len;
+    unsigned first_byte;
+    unsigned value;
+
+    // Determine the QoS to publish at, and allocate a Packet Identifier for QoS 1
+    // NOTE: USP records being resent on a resumed session keep their original Packet Identifier
+    qos = MIN(mc->params.publish_qos, mc->max_qos);
+    msi->qos = qos;
+    if (qos == 0)
+    {
+        msi->packet_id = 0;
+    }
+    else if (msi->packet_id == 0)
+    {
+        msi->packet_id = AllocMqttPacketId(mc);
+    }
+
+    // Determine whether the topic can be replaced by a topic alias
+    alias = FindMqttTxTopicAlias(mc, msi->topic, &is_new_alias);
+    topic_len = ((alias != 0) && (is_new_alias == false)) ? 0 : strlen(msi->topic);
+
+    // Calculate the size of the PUBLISH packet
+    content_type_len = sizeof(MQTT_USP_CONTENT_TYPE)-1;
+    response_topic_len = (mc->response_topic != NULL) ? strlen(mc->response_topic) : 0;
+    props_len = 3 + content_type_len;
+    props_len += (mc->response_topic != NULL) ? 3 + response_topic_len : 0;
+    props_len += (alias != 0) ? 3 : 0;
+    remaining_len = 2 + topic_len + ((qos == 1) ? 2 : 0) + CalcMqttVarIntLen(props_len) + props_len + msi->pbuf_len;
+    packet_len = 1 + CalcMqttVarIntLen(remaining_len) + remaining_len;
+
+    // Exit if the PUBLISH packet would be larger than the broker accepts
+    if ((remaining_len > MAX_MQTT_REMAINING_LENGTH) || ((mc->max_packet_size != 0) && (packet_len > mc->max_packet_size)))
+    {
+        USP_LOG_Error("%s: Dropping USP record to %s, as the PUBLISH packet (%d bytes) is larger than the MQTT broker accepts (%u bytes)", __FUNCTION__, msi->topic, packet_len, mc->max_packet_size);
+        if (is_new_alias)
+        {
+            USP_SAFE_FREE(mc->tx_aliases[alias-1]);
+        }
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    // Ensure that the header buffer is large enough
+    hdr_len = packet_len - msi->pbuf_len;
+    if (hdr_len > mc->tx_hdr_size)
+    {
+        mc->tx_hdr = USP_REALLOC(mc->tx_hdr, hdr_len);
+        mc->tx_hdr_size = hdr_len;
+    }
+
+    // Write the fixed header. The DUP flag is set if this USP record has been sent before on this session
+    first_byte = MQTT_PUBLISH | (qos << MQTT_PUBLISH_QOS_SHIFT);
+    if ((qos == 1) && (msi->is_sent))
+    {
+        first_byte |= MQTT_PUBLISH_DUP;
+    }
+
+    p = mc->tx_hdr;
+    WRITE_BYTE(p, first_byte);
+    p += WriteMqttVarInt(p, remaining_len);
+
+    // Write the variable header
+    p += WriteMqttString(p, msi->topic, topic_len);
+    if (qos == 1)
+    {
+        value = msi->packet_id;
+        WRITE_2_BYTES(p, value);
+    }
+
+    p += WriteMqttVarInt(p, props_len);
+    WRITE_BYTE(p, MQTT_PROP_CONTENT_TYPE);
+    p += WriteMqttString(p, MQTT_USP_CONTENT_TYPE, content_type_len);
+    if (mc->response_topic != NULL)
+    {
+        WRITE_BYTE(p, MQTT_PROP_RESPONSE_TOPIC);
+        p += WriteMqttString(p, mc->response_topic, response_topic_len);
+    }
+
+    if (alias != 0)
+    {
+        WRITE_BYTE(p, MQTT_PROP_TOPIC_ALIAS);
+        WRITE_2_BYTES(p, alias);
+    }
+
+    mc->tx_hdr_len = p - mc->tx_hdr;
+    USP_ASSERT(mc->tx_hdr_len == hdr_len);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** FindMqttTxTopicAlias
+**
+** Finds the topic alias to use when publishing to the specified topic, allocating a new topic alias if necessary
+** The first PUBLISH to a topic carries both the topic and the new topic alias. Subsequent PUBLISH packets carry just the topic alias.
+**
+** \param   mc - pointer to MQTT client
+** \param   topic - topic being published to
+** \param   is_new - pointer to variable in which to return whether the topic alias has just been allocated
+**
+** \return  Topic alias to use, or 0 if no topic alias is available
+**
+**************************************************************************/
+int FindMqttTxTopicAlias(mqtt_client_t *mc, char *topic, bool *is_new)
+{
+    int i;
+    int free_alias = 0;
+
+    *is_new = false;
+    for (i=0; i<mc->tx_alias_max; i++)
+    {
+        if (mc->tx_aliases[i] == NULL)
+        {
+            if (free_alias == 0)
+            {
+                free_alias = i+1;
+            }
+        }
+        else if (strcmp(mc->tx_aliases[i], topic)==0)
+        {
+            return i+1;
+        }
+    }
+
+    // Exit if all topic aliases are in use. The topic is sent in full.
+    if (free_alias == 0)
+    {
+        return 0;
+    }
+
+    mc->tx_aliases[free_alias-1] = USP_STRDUP(topic);
+    *is_new = true;
+    return free_alias;
+}
+
+/*********************************************************************//**
+**
+** AllocMqttPacketId
+**
+** Allocates a Packet Identifier which is not currently in use on the session
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  Packet Identifier (1-65535)
+**
+**************************************************************************/
+unsigned AllocMqttPacketId(mqtt_client_t *mc)
+{
+    unsigned packet_id;
+
+    do
+    {
+        packet_id = mc->next_packet_id;
+        mc->next_packet_id = (packet_id >= 0xFFFF) ? 1 : packet_id + 1;
+    }
+    while (IsMqttPacketIdInUse(mc, packet_id));
+
+    return packet_id;
+}
+
+/*********************************************************************//**
+**
+** IsMqttPacketIdInUse
+**
+** Determines whether the specified Packet Identifier is in use by the outstanding SUBSCRIBE,
+** or by any USP record which has been sent (or is being resent) but has not been acknowledged yet
+**
+** \param   mc - pointer to MQTT client
+** \param   packet_id - Packet Identifier to check
+**
+** \return  true if the Packet Identifier is in use
+**
+**************************************************************************/
+bool IsMqttPacketIdInUse(mqtt_client_t *mc, unsigned packet_id)
+{
+    mqtt_send_item_t *msi;
+
+    if ((packet_id == mc->subscribe_packet_id) || ((mc->cur_msg != NULL) && (mc->cur_msg->packet_id == packet_id)))
+    {
+        return true;
+    }
+
+    msi = (mqtt_send_item_t *) mc->inflight.head;
+    while (msi != NULL)
+    {
+        if (msi->packet_id == packet_id)
+        {
+            return true;
+        }
+        msi = (mqtt_send_item_t *) msi->link.next;
+    }
+
+    msi = (mqtt_send_item_t *) mc->resend_list.head;
+    while (msi != NULL)
+    {
+        if (msi->packet_id == packet_id)
+        {
+            return true;
+        }
+        msi = (mqtt_send_item_t *) msi->link.next;
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** MqttWritev
+**
+** Sends the specified buffers on the connection to the broker
+** NOTE: Unencrypted connections send all buffers in a single writev() call. OpenSSL has no gather write, so encrypted
+**       connections send only the first buffer, and the caller sends the rest on subsequent calls.
+**
+** \param   mc - pointer to MQTT client
+** \param   iov - array of buffers containing the data to send, in order
+** \param   iovcnt - number of buffers in the array (must be at least 1)
+**
+** \return  >0  Number of bytes sent (which might be less than the number to attempt)
+**          0   indicates that the broker has disconnected
+**          MQTT_IO_PENDING indicates that nothing could be sent yet, and the write must be retried when the socket is ready
+**          <0  indicates that another error has occurred
+**
+**************************************************************************/
+int MqttWritev(mqtt_client_t *mc, struct iovec *iov, int iovcnt)
+{
+    int num_bytes_sent;
+    int err;
+
+    // Perform a simple writev() if connection is not encrypted
+    if (mc->ssl == NULL)
+    {
+        num_bytes_sent = writev(mc->socket_fd, iov, iovcnt);
+        if ((num_bytes_sent == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            return MQTT_IO_PENDING;
+        }
+        return num_bytes_sent;
+    }
+
+    // Exit if the data was sent
+    num_bytes_sent = SSL_write(mc->ssl, iov[0].iov_base, iov[0].iov_len);
+    if (num_bytes_sent > 0)
+    {
+        mc->ssl_write_want = SSL_ERROR_NONE;
+        return num_bytes_sent;
+    }
+
+    // Exit if the SSL_write() needs to be retried once the socket is ready - this is needed if a renegotiation occurs
+    err = SSL_get_error(mc->ssl, num_bytes_sent);
+    if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
+    {
+        mc->ssl_write_want = err;
+        return MQTT_IO_PENDING;
+    }
+
+    // Otherwise an error occurred, or the broker has disconnected
+    USP_LOG_ErrorSSL(__FUNCTION__, "SSL_write() failed", num_bytes_sent, err);
+    mc->ssl_write_want = SSL_ERROR_NONE;
+    return (num_bytes_sent == 0) ? 0 : -1;
+}
+
+/*********************************************************************//**
+**
+** SendMqttDisconnect
+**
+** Attempts to send a DISCONNECT packet (MQTT 5.0 section 3.14) immediately
+** The broker keeps the session (for the Session Expiry Interval), so that it can be resumed when the agent reconnects
+** NOTE: This is called before closing the connection, so sending is best effort only
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void SendMqttDisconnect(mqtt_client_t *mc)
+{
+    unsigned char packet[2] = { MQTT_DISCONNECT, 0 };
+    struct iovec iov;
+
+    // Exit if the DISCONNECT cannot be sent now, because it would corrupt a partially sent packet
+    if ((mc->state != kMqttState_Running) || (mc->ctrl_sent != 0) || (mc->tx_sent != 0) || (mc->ssl_write_want != SSL_ERROR_NONE))
+    {
+        return;
+    }
+
+    iov.iov_base = packet;
+    iov.iov_len = sizeof(packet);
+    (void)MqttWritev(mc, &iov, 1);
+}
+
+/*********************************************************************//**
+**
+** IsMqttDataPendingToSend
+**
+** Determines whether there is a control packet or USP record waiting to be sent, which can be sent now
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  true if there is something to send
+**
+**************************************************************************/
+bool IsMqttDataPendingToSend(mqtt_client_t *mc)
+{
+    return ((mc->ctrl_len != 0) || ((mc->state == kMqttState_Running) && (IsMqttPublishPending(mc))));
+}
+
+/*********************************************************************//**
+**
+** IsMqttPublishPending
+**
+** Determines whether there is a USP record waiting to be sent, which the broker's Receive Maximum allows to be sent now
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  true if a USP record can be sent
+**
+**************************************************************************/
+bool IsMqttPublishPending(mqtt_client_t *mc)
+{
+    int qos;
+
+    if (mc->cur_msg != NULL)
+    {
+        return true;
+    }
+
+    if ((mc->resend_list.head == NULL) && (MTP_SEND_QUEUE_IsEmpty(&mc->send_queue)))
+    {
+        return false;
+    }
+
+    qos = MIN(mc->params.publish_qos, mc->max_qos);
+    return ((qos == 0) || (mc->num_inflight < mc->send_quota));
+}
+
+/*********************************************************************//**
+**
+** AreAllMqttResponsesSent
+**
+** Determines whether all USP records queued on the specified MQTT client have been sent
+** NOTE: USP records waiting to be acknowledged by the broker have been sent
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  true if all responses have been sent
+**
+**************************************************************************/
+bool AreAllMqttResponsesSent(mqtt_client_t *mc)
+{
+    return ((mc->cur_msg == NULL) && (mc->resend_list.head == NULL) && (MTP_SEND_QUEUE_IsEmpty(&mc->send_queue)));
+}
+
+/*********************************************************************//**
+**
+** UpdateMqttKeepAlive
+**
+** Sends a PINGREQ if nothing has been sent to the broker for the keep alive interval (MQTT 5.0 section 3.1.2.10),
+** and fails the connection if nothing has been received in response within a further keep alive interval
+**
+** \param   mc - pointer to MQTT client
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateMqttKeepAlive(mqtt_client_t *mc, time_t cur_time)
+{
+    // Exit if keep alives are disabled
+    if (mc->keep_alive == 0)
+    {
+        mc->ping_timeout = INVALID_TIME;
+        return;
+    }
+
+    // Exit if the broker did not respond to our PINGREQ in time
+    if (mc->ping_timeout != INVALID_TIME)
+    {
+        if (cur_time >= mc->ping_timeout)
+        {
+            HandleMqttClientError(mc, "No response to PINGREQ");
+        }
+        return;
+    }
+
+    // Send a PINGREQ, if nothing has been sent for the keep alive interval
+    if (cur_time >= mc->last_tx_time + mc->keep_alive)
+    {
+        QueueMqttControlPacket(mc, MQTT_PINGREQ, NULL, 0);
+        mc->ping_timeout = cur_time + mc->keep_alive;
+        TransmitMqttPackets(mc);
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleMqttClientError
+**
+** Closes the connection after an error, and schedules a reconnect using the TR-369 retry algorithm
+** USP records queued to send (and those not acknowledged by the broker) are kept, and are sent after the connection has been re-established
+**
+** \param   mc - pointer to MQTT client
+** \param   reason - textual description of the error (used only for debug)
+**
+** \return  None
+**
+**************************************************************************/
+void HandleMqttClientError(mqtt_client_t *mc, char *reason)
+{
+    unsigned wait_time;
+
+    CloseMqttClientSocket(mc);
+
+    mc->retry_count++;
+    wait_time = RETRY_WAIT_CalculateWithSeed(mc->retry_count, mc->params.retry_initial_interval, mc->params.retry_interval_multiplier, &mtp_thread_random_seed);
+    if ((mc->params.retry_max_interval != 0) && (wait_time > mc->params.retry_max_interval))
+    {
+        wait_time = mc->params.retry_max_interval;
+    }
+    mc->state = kMqttState_Retrying;
+    mc->retry_time = time(NULL) + wait_time;
+
+    USP_LOG_Error("%s: %s on MQTT connection to (host=%s, port=%d). Retrying in %u seconds (retry_count=%u)", __FUNCTION__, reason, mc->params.broker_address, mc->params.broker_port, wait_time, mc->retry_count);
+}
+
+/*********************************************************************//**
+**
+** CloseMqttClientSocket
+**
+** Closes the connection, freeing all state associated with it
+** The USP record being sent (if any), and those waiting to be acknowledged, are kept, so that they are resent on the next connection
+** The session state (subscription and assigned Client Identifier) is also kept, so that the session can be resumed
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void CloseMqttClientSocket(mqtt_client_t *mc)
+{
+    mqtt_send_item_t *msi;
+    int i;
+
+    // Move the USP record being sent, then the USP records waiting to be acknowledged, to the front of the resend list, preserving their order
+    if (mc->cur_msg != NULL)
+    {
+        DLLIST_LinkToHead(&mc->resend_list, mc->cur_msg);
+        mc->cur_msg = NULL;
+    }
+
+    msi = (mqtt_send_item_t *) mc->inflight.tail;
+    while (msi != NULL)
+    {
+        DLLIST_Unlink(&mc->inflight, msi);
+        DLLIST_LinkToHead(&mc->resend_list, msi);
+        msi = (mqtt_send_item_t *) mc->inflight.tail;
+    }
+    mc->num_inflight = 0;
+
+    mc->tx_hdr_len = 0;
+    mc->tx_sent = 0;
+    mc->ctrl_len = 0;
+    mc->ctrl_sent = 0;
+    mc->subscribe_packet_id = 0;
+    mc->is_session_present = false;
+
+    // Topic aliases only last for the lifetime of the network connection
+    for (i=0; i<MAX_MQTT_TOPIC_ALIASES; i++)
+    {
+        USP_SAFE_FREE(mc->tx_aliases[i]);
+        USP_SAFE_FREE(mc->rx_aliases[i]);
+    }
+    mc->tx_alias_max = 0;
+    mc->rx_alias_max = 0;
+
+    // Free the SSL object
+    if (mc->ssl != NULL)
+    {
+        SSL_shutdown(mc->ssl);
+        SSL_free(mc->ssl);
+        mc->ssl = NULL;
+    }
+    mc->ssl_write_want = SSL_ERROR_NONE;
+
+    if (mc->cert_chain != NULL)
+    {
+        sk_X509_pop_free(mc->cert_chain, X509_free);
+        mc->cert_chain = NULL;
+    }
+    USP_SAFE_FREE(mc->allowed_controllers);
+
+    // Close the socket
+    if (mc->socket_fd != INVALID)
+    {
+        SOCKET_SET_ForgetSocket(mc->socket_fd);
+        close(mc->socket_fd);
+        mc->socket_fd = INVALID;
+    }
+
+    mc->rx_len = 0;
+    mc->rx_packet_len = 0;
+    mc->ping_timeout = INVALID_TIME;
+}
+
+/*********************************************************************//**
+**
+** PerformScheduledMqttReconnect
+**
+** Reconnects to the broker using the parameters stored when the reconnect was scheduled
+** If the broker or Client Identifier has changed, then the session state is discarded, as it cannot be resumed
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void PerformScheduledMqttReconnect(mqtt_client_t *mc)
+{
+    bool is_new_session;
+
+    SendMqttDisconnect(mc);
+    CloseMqttClientSocket(mc);
+
+    is_new_session = ((strcmp(mc->next_params.broker_address, mc->params.broker_address) != 0) ||
+                      (mc->next_params.broker_port != mc->params.broker_port) ||
+                      (strcmp(mc->next_params.client_id, mc->params.client_id) != 0));
+    if (is_new_session)
+    {
+        USP_SAFE_FREE(mc->assigned_client_id);
+        USP_SAFE_FREE(mc->subscribed_topic);
+    }
+
+    // Move the scheduled parameters into place
+    FreeMqttParams(&mc->params);
+    memcpy(&mc->params, &mc->next_params, sizeof(mqtt_client_params_t));
+    memset(&mc->next_params, 0, sizeof(mqtt_client_params_t));
+    USP_SAFE_FREE(mc->agent_topic);
+    mc->agent_topic = mc->next_agent_topic;
+    mc->next_agent_topic = NULL;
+    mc->schedule_reconnect = kScheduledAction_Off;
+
+    USP_LOG_Info("%s: Reconnecting MQTT client to use new parameters (host=%s, port=%d)", __FUNCTION__, mc->params.broker_address, mc->params.broker_port);
+    mc->state = kMqttState_Retrying;
+    mc->retry_count = 0;
+    mc->retry_time = time(NULL);
+}
+
+/*********************************************************************//**
+**
+** StopMqttClient
+**
+** Closes the connection of the specified MQTT client, frees all USP records queued on it, and marks the slot as unused
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void StopMqttClient(mqtt_client_t *mc)
+{
+    mqtt_send_item_t *msi;
+
+    // NOTE: This moves the USP record being sent, and those waiting to be acknowledged, to the resend list
+    CloseMqttClientSocket(mc);
+
+    // Drain the lists of outstanding USP records to send
+    msi = (mqtt_send_item_t *) mc->resend_list.head;
+    while (msi != NULL)
+    {
+        DLLIST_Unlink(&mc->resend_list, msi);
+        FreeMqttSendItem(msi);
+        msi = (mqtt_send_item_t *) mc->resend_list.head;
+    }
+
+    msi = (mqtt_send_item_t *) MTP_SEND_QUEUE_Pop(&mc->send_queue);
+    while (msi != NULL)
+    {
+        FreeMqttSendItem(msi);
+        msi = (mqtt_send_item_t *) MTP_SEND_QUEUE_Pop(&mc->send_queue);
+    }
+
+    USP_SAFE_FREE(mc->tx_hdr);
+    USP_SAFE_FREE(mc->ctrl_buf);
+    USP_SAFE_FREE(mc->rx_buf);
+    USP_SAFE_FREE(mc->agent_topic);
+    USP_SAFE_FREE(mc->next_agent_topic);
+    USP_SAFE_FREE(mc->assigned_client_id);
+    USP_SAFE_FREE(mc->subscribed_topic);
+    USP_SAFE_FREE(mc->response_information);
+    USP_SAFE_FREE(mc->response_topic);
+    FreeMqttParams(&mc->params);
+    FreeMqttParams(&mc->next_params);
+
+    // Put back to init state
+    memset(mc, 0, sizeof(mqtt_client_t));
+    mc->instance = INVALID;
+    mc->socket_fd = INVALID;
+}
+
+/*********************************************************************//**
+**
+** CopyMqttParams
+**
+** Takes a deep copy of the data model parameters of an MQTT client
+**
+** \param   dest - pointer to structure to copy into
+** \param   src - pointer to structure to copy from
+**
+** \return  None
+**
+**************************************************************************/
+void CopyMqttParams(mqtt_client_params_t *dest, mqtt_client_params_t *src)
+{
+    memcpy(dest, src, sizeof(mqtt_client_params_t));
+    dest->broker_address = USP_STRDUP((src->broker_address != NULL) ? src->broker_address : "");
+    dest->client_id = USP_STRDUP((src->client_id != NULL) ? src->client_id : "");
+    dest->username = USP_STRDUP((src->username != NULL) ? src->username : "");
+    dest->password = USP_STRDUP((src->password != NULL) ? src->password : "");
+}
+
+/*********************************************************************//**
+**
+** FreeMqttParams
+**
+** Frees all memory owned by the data model parameters of an MQTT client
+**
+** \param   mp - pointer to parameters to free
+**
+** \return  None
+**
+**************************************************************************/
+void FreeMqttParams(mqtt_client_params_t *mp)
+{
+    USP_SAFE_FREE(mp->broker_address);
+    USP_SAFE_FREE(mp->client_id);
+    USP_SAFE_FREE(mp->username);
+    USP_SAFE_FREE(mp->password);
+}
+
+/*********************************************************************//**
+**
+** FindUnusedMqttClient
+**
+** Finds an unused MQTT client slot
+**
+** \param   None
+**
+** \return  pointer to free MQTT client, or NULL if none found
+**
+**************************************************************************/
+mqtt_client_t *FindUnusedMqttClient(void)
+{
+    int i;
+    mqtt_client_t *mc;
+
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if (mc->instance == INVALID)
+        {
+            return mc;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** FindMqttClientByInstance
+**
+** Finds an MQTT client by its instance number in Device.MQTT.Client.{i}
+**
+** \param   instance - instance number of the client in Device.MQTT.Client.{i}
+**
+** \return  pointer to matching MQTT client, or NULL if none found
+**
+**************************************************************************/
+mqtt_client_t *FindMqttClientByInstance(int instance)
+{
+    int i;
+    mqtt_client_t *mc;
+
+    for (i=0; i<MAX_MQTT_CLIENTS; i++)
+    {
+        mc = &mqtt_clients[i];
+        if (mc->instance == instance)
+        {
+            return mc;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** RemoveExpiredMqttMessages
+**
+** Removes all expired USP records from the queue of USP records to send
+** NOTE: This mechanism prevents the queue from filling up needlessly if the broker is offline
+**
+** \param   mc - pointer to MQTT client
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveExpiredMqttMessages(mqtt_client_t *mc)
+{
+    int i;
+    time_t cur_time;
+    mqtt_send_item_t *msi;
+    mqtt_send_item_t *next;
+
+    cur_time = time(NULL);
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        msi = (mqtt_send_item_t *) mc->send_queue.queues[i].head;
+        while (msi != NULL)
+        {
+            next = (mqtt_send_item_t *) msi->link.next;
+            if (cur_time > msi->expiry_time)
+            {
+                MTP_SEND_QUEUE_Remove(&mc->send_queue, msi->priority, msi);
+                FreeMqttSendItem(msi);
+            }
+            msi = next;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** FreeMqttSendItem
+**
+** Frees the specified USP record (which must already have been removed from any list that it was in)
+**
+** \param   msi - pointer to USP record to free
+**
+** \return  None
+**
+**************************************************************************/
+void FreeMqttSendItem(mqtt_send_item_t *msi)
+{
+    MTP_SEND_QUEUE_ReleaseBudget(msi->pbuf_len);
+    USP_FREE(msi->pbuf);
+    USP_FREE(msi->topic);
+    USP_FREE(msi);
+}
+
+/*********************************************************************//**
+**
+** IsUspRecordInMqttQueue
+**
+** Determines whether the specified USP record is already queued, waiting to be sent to the specified topic
+** This is used to avoid duplicate records being placed in the queue, which could occur under notification retry conditions
+**
+** \param   mc - pointer to MQTT client
+** \param   topic - topic that the USP record is to be published to
+** \param   pbuf - pointer to buffer containing USP Record to match against
+** \param   pbuf_len - length of buffer containing USP Record to match against
+** \param   digest - hash of the USP Record to match against
+**
+** \return  true if the USP record is already queued
+**
+**************************************************************************/
+bool IsUspRecordInMqttQueue(mqtt_client_t *mc, char *topic, unsigned char *pbuf, int pbuf_len, unsigned digest)
+{
+    int i;
+    mqtt_send_item_t *msi;
+
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        msi = (mqtt_send_item_t *) mc->send_queue.queues[i].head;
+        while (msi != NULL)
+        {
+            if ((msi->digest == digest) && (msi->pbuf_len == pbuf_len) && (memcmp(msi->pbuf, pbuf, pbuf_len)==0) && (strcmp(msi->topic, topic)==0))
+            {
+                return true;
+            }
+            msi = (mqtt_send_item_t *) msi->link.next;
+        }
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** WriteMqttVarInt
+**
+** Writes a Variable Byte Integer (MQTT 5.0 section 1.5.5)
+**
+** \param   buf - pointer to buffer in which to write (at least 4 bytes)
+** \param   value - value to write (at most MAX_MQTT_REMAINING_LENGTH)
+**
+** \return  Number of bytes written
+**
+**************************************************************************/
+int WriteMqttVarInt(unsigned char *buf, unsigned value)
+{
+    int len = 0;
+    unsigned char byte;
+
+    do
+    {
+        byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0)
+        {
+            byte |= 0x80;
+        }
+        buf[len++] = byte;
+    }
+    while (value != 0);
+
+    return len;
+}
+
+/*********************************************************************//**
+**
+** ReadMqttVarInt
+**
+** Reads a Variable Byte Integer (MQTT 5.0 section 1.5.5)
+**
+** \param   buf - pointer to buffer to read from
+** \param   len - number of bytes available in the buffer
+** \param   value - pointer to variable in which to return the value
+**
+** \return  Number of bytes read, MQTT_VARINT_INCOMPLETE if more bytes are needed, or -1 if the Variable Byte Integer is malformed
+**
+**************************************************************************/
+int ReadMqttVarInt(unsigned char *buf, int len, unsigned *value)
+{
+    int i;
+    unsigned result = 0;
+
+    for (i=0; i<4; i++)
+    {
+        if (i >= len)
+        {
+            return MQTT_VARINT_INCOMPLETE;
+        }
+
+        result |= (buf[i] & 0x7F) << (7*i);
+        if ((buf[i] & 0x80) == 0)
+        {
+            *value = result;
+            return i+1;
+        }
+    }
+
+    // A Variable Byte Integer is at most 4 bytes long
+    return -1;
+}
+
+/*********************************************************************//**
+**
+** WriteMqttString
+**
+** Writes a UTF-8 Encoded String (MQTT 5.0 section 1.5.4) ie a 2 byte length followed by the characters
+**
+** \param   buf - pointer to buffer in which to write
+** \param   str - pointer to characters to write
+** \param   len - number of characters to write
+**
+** \return  Number of bytes written
+**
+**************************************************************************/
+int WriteMqttString(unsigned char *buf, char *str, int len)
+{
+    STORE_2_BYTES(buf, len);
+    memcpy(&buf[2], str, len);
+    return 2 + len;
+}
+
+/*********************************************************************//**
+**
+** CalcMqttVarIntLen
+**
+** Calculates the number of bytes needed to encode the specified value as a Variable Byte Integer
+**
+** \param   value - value to encode
+**
+** \return  Number of bytes needed
+**
+**************************************************************************/
+int CalcMqttVarIntLen(unsigned value)
+{
+    if (value < 128)
+    {
+        return 1;
+    }
+
+    if (value < 16384)
+    {
+        return 2;
+    }
+
+    if (value < 2097152)
+    {
+        return 3;
+    }
+
+    return 4;
+}
+
+/*********************************************************************//**
+**
+** MqttStrndup
+**
+** Makes a NULL terminated dynamically allocated copy of a string in a received packet
+**
+** \param   str - pointer to characters of the string
+** \param   len - number of characters in the string
+**
+** \return  pointer to dynamically allocated string
+**
+**************************************************************************/
+char *MqttStrndup(unsigned char *str, int len)
+{
+    char *s;
+
+    s = USP_MALLOC(len+1);
+    memcpy(s, str, len);
+    s[len] = '\0';
+
+    return s;
+}
+
+#endif // ENABLE_MQTT
@@ -0,0 +1,109 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2017-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * \file mqtt.h
+ *
+ * Header file for MQTT 5.0 client connections to MQTT brokers
+ *
+ */
+#ifndef MQTT_H
+#define MQTT_H
+
+#ifdef ENABLE_MQTT
+
+#include "common_defs.h"
+#include "socket_set.h"
+#include "mtp_exec.h"
+#include "usp-msg.pb-c.h"
+
+//------------------------------------------------------------------------------
+// Defines set by the MQTT 5.0 specification and the USP MQTT binding (TR-369)
+#define MQTT_PROTOCOL_NAME  "MQTT"
+#define MQTT_PROTOCOL_LEVEL 5                   // Protocol level of MQTT 5.0 in the CONNECT packet
+#define MAX_MQTT_FIXED_HEADER_SIZE 5            // 1 byte packet type and flags + up to 4 bytes Remaining Length
+#define MAX_MQTT_REMAINING_LENGTH 268435455     // Largest value that can be encoded in the Remaining Length variable byte integer
+#define MQTT_USP_CONTENT_TYPE "application/vnd.bbf.usp.msg"  // Content Type property of PUBLISH packets carrying USP records
+
+//------------------------------------------------------------------------
+// Defines for this implementation (not set by any specification)
+#define MQTT_CONNECT_TIMEOUT    30  // Number of seconds allowed for the TCP connect to the broker, then the CONNACK, to complete
+#define MQTT_RX_BUF_SIZE      4096  // Initial size of the buffer receiving MQTT packets. It grows to hold the largest packet received
+#define MQTT_RECEIVE_MAXIMUM    16  // Maximum number of QoS 1 PUBLISH packets that the broker may send before receiving our PUBACKs
+#define MAX_MQTT_INFLIGHT       32  // Maximum number of QoS 1 PUBLISH packets that the agent sends before waiting for PUBACKs (further limited by the broker's Receive Maximum)
+#define MAX_MQTT_TOPIC_ALIASES  16  // Maximum number of topic aliases in each direction (further limited by Device.MQTT.Client.{i}.TopicAliasMaximum and the broker)
+#define MAX_MQTT_PACKET_SIZE (MAX_USP_MSG_LEN + 4096)   // Maximum Packet Size that the agent accepts from the broker (a USP record plus the PUBLISH headers)
+
+//------------------------------------------------------------------------------
+// Data model parameters for each MQTT client (Device.MQTT.Client.{i})
+typedef struct
+{
+    int instance;                       // Instance of this client in the Device.MQTT.Client.{i} table. Set to INVALID, if this entry is not used.
+    bool enable;
+    char *broker_address;               // Hostname or IP address of the MQTT broker
+    unsigned broker_port;
+    bool enable_encryption;             // Set if TransportProtocol is TLS
+    char *client_id;                    // Client Identifier sent in CONNECT. If empty, the broker assigns one (which is then reused, to resume the session)
+    char *username;
+    char *password;
+    unsigned keep_alive_time;           // in seconds. Maximum time between packets sent to the broker (0 disables PINGREQs)
+    bool clean_start;                   // Set if the broker should discard any existing session when connecting
+    unsigned session_expiry_interval;   // in seconds. Time that the broker keeps the session after the connection is lost
+    unsigned topic_alias_maximum;       // Maximum number of topic aliases that the broker may use when sending to the agent
+    unsigned publish_qos;               // QoS (0 or 1) of the PUBLISH packets sent by the agent
+    unsigned retry_initial_interval;    // in seconds. Minimum wait before the first reconnect attempt
+    unsigned retry_interval_multiplier; // Multiplier (in thousandths) applied to the wait between successive reconnect attempts
+    unsigned retry_max_interval;        // in seconds. Maximum wait between reconnect attempts
+} mqtt_client_params_t;
+
+//------------------------------------------------------------------------------
+// API
+int MQTT_Init(void);
+int MQTT_Start(void);
+void MQTT_Destroy(void);
+int MQTT_EnableClient(mqtt_client_params_t *mp, char *agent_topic);
+void MQTT_DisableClient(int instance);
+void MQTT_ScheduleReconnect(mqtt_client_params_t *mp, char *agent_topic);
+void MQTT_ActivateScheduledActions(void);
+void MQTT_UpdateAllSockSet(socket_set_t *set);
+void MQTT_ProcessAllSocketActivity(socket_set_t *set);
+int MQTT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *topic, unsigned char *pbuf, int pbuf_len, mtp_send_priority_t priority, time_t expiry_time);
+bool MQTT_AreAllResponsesSent(void);
+mtp_status_t MQTT_GetMtpStatus(int instance);
+char *MQTT_GetClientStatus(int instance);
+void MQTT_GetResponseInformation(int instance, char *buf, int len);
+
+#endif // ENABLE_MQTT
+#endif
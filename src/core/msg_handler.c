@@ -40,6 +40,7 @@
  */
 
 #include <string.h>
+#include <time.h>
 
 #include "common_defs.h"
 #include "msg_handler.h"
@@ -47,19 +48,78 @@
 #include "device.h"
 #include "iso8601.h"
 #include "proto_trace.h"
+#include "proto_codec.h"
 #include "text_utils.h"
 #include "usp-record.pb-c.h"
 #include "stomp.h"
+#include "uptime.h"
+#include "usp_probe.h"
+#include "usp_session.h"
 
 //------------------------------------------------------------------------
 // Index of the controller that sent the current USP message being processed
 // This needs to be saved off, in order that it can be used by data model transaction update notify callbacks
-static int cur_msg_controller_instance = INVALID;
+static __thread int cur_msg_controller_instance = INVALID;
 
 //------------------------------------------------------------------------
 // Role to use with current USP message
 // This is saved off before handling each message, as each message handler needs it fairly deeply in its processing
-static combined_role_t cur_msg_combined_role = { ROLE_DEFAULT, ROLE_DEFAULT};
+static __thread combined_role_t cur_msg_combined_role = { ROLE_DEFAULT, ROLE_DEFAULT};
+
+//------------------------------------------------------------------------
+// Controller instance and role determined for the controller that sent the last USP message processed by this thread
+// Consecutive USP messages are usually from the same controller, so this avoids looking up the controller and recalculating
+// its role for every message. The cache is invalid if the generation count differs from DEVICE_CONTROLLER_GetRoleGeneration()
+typedef struct
+{
+    char endpoint_id[MAX_DM_SHORT_VALUE_LEN];   // EndpointID of the controller which sent the USP message
+    ctrust_role_t role;                         // Role passed with the USP message by the MTP
+    mtp_protocol_t protocol;                    // Protocol of the MTP that the USP message was received on
+    unsigned generation;                        // Generation count when this cache entry was filled in, or 0 if it is not valid
+    int instance;                               // Instance number of the controller in Device.LocalAgent.Controller.{i}, or INVALID if not recognised
+    combined_role_t combined_role;              // Combined role to use when processing USP messages from the controller
+} msg_role_cache_t;
+
+static __thread msg_role_cache_t msg_role_cache = { .generation = 0, .instance = INVALID };
+
+//------------------------------------------------------------------------
+// Hash of the serialized USP message currently being processed, and the msg_id of the current request, if its response
+// should be saved in the replay cache (NULL otherwise). Used to detect and answer retransmitted requests
+static __thread unsigned cur_msg_hash = 0;
+static __thread char *cur_msg_replay_id = NULL;
+
+//------------------------------------------------------------------------
+// Response to a modifying USP request, cached in case the controller retransmits the request
+typedef struct
+{
+    char *msg_id;               // msg_id of the request (and response), or NULL if this entry is unused
+    unsigned req_hash;          // Hash of the serialized request. Used to ensure that a request reusing a msg_id is not mistaken for a retransmission
+    Usp__Header__MsgType resp_type; // Type of the cached USP response message
+    unsigned char *buf;         // Serialized USP response message
+    int len;                    // Length of serialized USP response message
+    time_t time_cached;         // Time at which the response was cached
+} replay_entry_t;
+
+//------------------------------------------------------------------------
+// Responses cached for a single controller. Entries are replaced in round robin order
+typedef struct
+{
+    char *endpoint_id;          // Controller that the responses were sent to, or NULL if this cache is unused
+    time_t last_used;           // Time at which a response was last added to this cache. Used to pick a cache to reuse for a new controller
+    int next;                   // Index of the entry to replace next
+    replay_entry_t entries[MSG_REPLAY_CACHE_SIZE];
+} replay_cache_t;
+
+// Array of pointers to the replay caches for controllers. Grown on demand, up to MAX_CONTROLLERS entries
+// Each cache is allocated when a response is first cached for a controller, and freed when the controller is deleted. Unused slots are NULL
+// These are only accessed from the data model thread, as modifying requests are never handled by Get worker threads
+#if MSG_REPLAY_CACHE_SIZE > 0
+static replay_cache_t **replay_caches = NULL;
+static int replay_caches_size = 0;
+#endif
+
+// Minimum number of entries allocated, when the replay cache array is first grown
+#define MIN_REPLAY_CACHES_ALLOC 4
 
 //------------------------------------------------------------------------
 // Array used to convert from an enumeration to it's string representation
@@ -85,6 +145,11 @@ static enum_entry_t usp_msg_types[] = {
     { USP__HEADER__MSG_TYPE__GET_SUPPORTED_PROTO_RESP, "GET_SUPPORTED_PROTO_RESP"}
 };
 
+//------------------------------------------------------------------------
+// Protobuf tags (field number and length-delimited wire type) of the fields encapsulating a USP message in a USP record
+// These are used to serialize a USP message directly into its USP record, without first serializing it to a separate buffer
+#define RECORD_NO_SESSION_CONTEXT_TAG  ((7 << 3) | PROTOBUF_C_WIRE_TYPE_LENGTH_PREFIXED)   // UspRecord__Record.no_session_context
+#define NO_SESSION_CONTEXT_PAYLOAD_TAG ((2 << 3) | PROTOBUF_C_WIRE_TYPE_LENGTH_PREFIXED)   // UspRecord__NoSessionContextRecord.payload
 
 
 //------------------------------------------------------------------------------
@@ -92,6 +157,16 @@ static enum_entry_t usp_msg_types[] = {
 int HandleUspMessage(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 int ValidateUspRecord(UspRecord__Record *rec);
 void CacheControllerRoleForCurMsg(char *endpoint_id, ctrust_role_t role, mtp_protocol_t protocol);
+void CalcControllerRoleForMsg(char *endpoint_id, ctrust_role_t role, mtp_protocol_t protocol, combined_role_t *combined_role);
+int QueueUspMessageInRecord(char *endpoint_id, Usp__Msg *usp, int msg_len, mtp_reply_to_t *mrt);
+void InitUspRecord(UspRecord__Record *rec, char *endpoint_id);
+int CalcVarintLen(unsigned value);
+int WriteVarint(unsigned value, unsigned char *buf);
+bool ReplayCachedResponse(char *endpoint_id, Usp__Msg *usp, mtp_reply_to_t *mrt);
+void CacheResponseForReplay(char *endpoint_id, Usp__Msg *resp);
+int FindReplayCache(char *endpoint_id);
+int AllocReplayCacheSlot(void);
+void FreeReplayCache(int index);
 
 
 /*********************************************************************//**
@@ -113,12 +188,30 @@ int MSG_HANDLER_HandleBinaryRecord(unsigned char *pbuf, int pbuf_len, ctrust_rol
 {
     int err;
     UspRecord__Record *rec;
+    char *endpoint = NULL;
+
+    // Capture the USP record before unpacking it, so that records which fail to unpack are also captured
+    if (mrt->is_reply_to_specified)
+    {
+        endpoint = (mrt->protocol == kMtpProtocol_STOMP) ? mrt->stomp_dest : mrt->coap_host;
+#ifdef ENABLE_MQTT
+        if (mrt->protocol == kMtpProtocol_MQTT)
+        {
+            endpoint = mrt->mqtt_topic;
+        }
+#endif
+    }
+    PROTO_TRACE_CaptureRecord(kProtoCaptureDir_Received, mrt->protocol, endpoint, pbuf, pbuf_len);
 
     // Exit if unable to unpack the USP record
-    rec = usp_record__record__unpack(pbuf_allocator, pbuf_len, pbuf);
+    // NOTE: The record (and the message it contains) are unpacked into the per-message arena, which is freed once the message has been handled
+    // NOTE: The record's payload is not copied - it references the encapsulated USP message within pbuf
+    USP_MEM_MsgArenaBegin();
+    rec = PROTO_CODEC_RECORD_UNPACK_IN_PLACE(pbuf_msg_allocator, pbuf_len, pbuf);
     if (rec == NULL)
     {
         USP_ERR_SetMessage("%s: usp_record__session_record__unpack failed. Ignoring USP Message", __FUNCTION__);
+        USP_MEM_MsgArenaEnd();
         return USP_ERR_RECORD_NOT_PARSED;
     }
 
@@ -132,12 +225,20 @@ int MSG_HANDLER_HandleBinaryRecord(unsigned char *pbuf, int pbuf_len, ctrust_rol
     // Print USP record in human readable form
     PROTO_TRACE_ProtobufMessage(&rec->base);
 
+    // Exit if the record is in a session context, letting the session reorder and reassemble the encapsulated USP messages
+    if (rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT)
+    {
+        err = USP_SESSION_HandleRecord(rec, role, allowed_controllers, mrt);
+        goto exit;
+    }
+
     // Process the encapsulated USP message
     err = MSG_HANDLER_HandleBinaryMessage(rec->no_session_context->payload.data, rec->no_session_context->payload.len, role, allowed_controllers, rec->from_id, mrt);
 
 exit:
     // Free the unpacked USP record
-    usp_record__record__free_unpacked(rec, pbuf_allocator);
+    usp_record__record__free_unpacked(rec, pbuf_msg_allocator);
+    USP_MEM_MsgArenaEnd();
 
     return err;
 }
@@ -164,15 +265,18 @@ int MSG_HANDLER_HandleBinaryMessage(unsigned char *pbuf, int pbuf_len, ctrust_ro
     Usp__Msg *usp;
 
     // Exit if unable to unpack the USP message
-    usp = usp__msg__unpack(pbuf_allocator, pbuf_len, pbuf);
+    USP_MEM_MsgArenaBegin();
+    usp = PROTO_CODEC_MSG_UNPACK(pbuf_msg_allocator, pbuf_len, pbuf);
     if (usp == NULL)
     {
         USP_ERR_SetMessage("%s: usp__msg__unpack failed", __FUNCTION__);
+        USP_MEM_MsgArenaEnd();
         return USP_ERR_MESSAGE_NOT_UNDERSTOOD;
     }
 
     // Set the role that the controller should use when handling this message
     CacheControllerRoleForCurMsg(controller_endpoint, role, mrt->protocol);
+    cur_msg_hash = TEXT_UTILS_CalcBufferHash(pbuf, pbuf_len);
 
     // Print USP message in human readable form
     PROTO_TRACE_ProtobufMessage(&usp->base);
@@ -189,11 +293,82 @@ int MSG_HANDLER_HandleBinaryMessage(unsigned char *pbuf, int pbuf_len, ctrust_ro
 
 exit:
     // Free the unpacked USP message
-    usp__msg__free_unpacked(usp, pbuf_allocator);
+    usp__msg__free_unpacked(usp, pbuf_msg_allocator);
+    USP_MEM_MsgArenaEnd();
 
     return err;
 }
 
+/*********************************************************************//**
+**
+** MSG_HANDLER_IsReadOnlyRecord
+**
+** Determines whether the USP message contained in the specified USP record only reads the data model
+** (ie whether it may be processed by a Get worker thread)
+**
+** \param   pbuf - pointer to buffer containing protobuf encoded USP record
+** \param   pbuf_len - length of protobuf encoded message
+**
+** \return  true if the USP record contains a Get, GetInstances, GetSupportedDM or GetSupportedProtocol request
+**          false otherwise (including if the USP record or message could not be unpacked)
+**
+**************************************************************************/
+bool MSG_HANDLER_IsReadOnlyRecord(unsigned char *pbuf, int pbuf_len)
+{
+    UspRecord__Record *rec;
+    UspRecord__NoSessionContextRecord *ctx;
+    Usp__Msg *usp;
+    bool is_read_only = false;
+
+    // Exit if unable to unpack the USP record
+    // NOTE: The record's payload is not copied - it references the encapsulated USP message within pbuf
+    USP_MEM_MsgArenaBegin();
+    rec = PROTO_CODEC_RECORD_UNPACK_IN_PLACE(pbuf_msg_allocator, pbuf_len, pbuf);
+    if (rec == NULL)
+    {
+        USP_MEM_MsgArenaEnd();
+        return false;
+    }
+
+    // Exit if the record does not contain a (complete) USP message
+    ctx = rec->no_session_context;
+    if ((rec->record_type_case != USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT) || (ctx == NULL) || (ctx->payload.data == NULL))
+    {
+        goto exit;
+    }
+
+    // Exit if unable to unpack the USP message
+    usp = PROTO_CODEC_MSG_UNPACK(pbuf_msg_allocator, ctx->payload.len, ctx->payload.data);
+    if (usp == NULL)
+    {
+        goto exit;
+    }
+
+    if (usp->header != NULL)
+    {
+        switch(usp->header->msg_type)
+        {
+            case USP__HEADER__MSG_TYPE__GET:
+            case USP__HEADER__MSG_TYPE__GET_INSTANCES:
+            case USP__HEADER__MSG_TYPE__GET_SUPPORTED_DM:
+            case USP__HEADER__MSG_TYPE__GET_SUPPORTED_PROTO:
+                is_read_only = true;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    usp__msg__free_unpacked(usp, pbuf_msg_allocator);
+
+exit:
+    usp_record__record__free_unpacked(rec, pbuf_msg_allocator);
+    USP_MEM_MsgArenaEnd();
+
+    return is_read_only;
+}
+
 /*********************************************************************//**
 **
 ** MSG_HANDLER_LogMessageToSend
@@ -217,7 +392,7 @@ void MSG_HANDLER_LogMessageToSend(Usp__Header__MsgType usp_msg_type, unsigned ch
     UspRecord__Record *rec;
     Usp__Msg *usp;
     char buf[MAX_ISO8601_LEN];
-    UspRecord__NoSessionContextRecord *ctx;
+    ProtobufCBinaryData *payload;
 
     // Log the message
     USP_PROTOCOL("\n");
@@ -227,6 +402,12 @@ void MSG_HANDLER_LogMessageToSend(Usp__Header__MsgType usp_msg_type, unsigned ch
                 host,
                 DEVICE_MTP_EnumToString(protocol) );
 
+    // Capture the USP record
+    if (content_type == kMtpContentType_UspRecord)
+    {
+        PROTO_TRACE_CaptureRecord(kProtoCaptureDir_Sent, protocol, host, pbuf, pbuf_len);
+    }
+
     // Exit if protocol trace is not enabled
     if (enable_protocol_trace == false)
     {
@@ -254,22 +435,31 @@ void MSG_HANDLER_LogMessageToSend(Usp__Header__MsgType usp_msg_type, unsigned ch
         return;
     }
 
-    // Exit if no USP message was contained in this record
-    // NOTE: We should never try sending a message with a blank USP message, so this check is just for safety
-    ctx = rec->no_session_context;
-    if ((rec->record_type_case != USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT) ||
-        (ctx->payload.len == 0) || (ctx->payload.data == NULL))
+    // Determine the encapsulated USP message
+    // NOTE: Session context records only contain a complete USP message if it is not segmented. Otherwise only the record is printed
+    payload = NULL;
+    if (rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT)
     {
-        USP_ERR_SetMessage("%s(%d): Unpacked USP Record was incorrect", __FUNCTION__, __LINE__);
-        return;
+        payload = &rec->no_session_context->payload;
+    }
+    else if ((rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT) &&
+             (rec->session_context->payload_sar_state == USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__NONE) &&
+             (rec->session_context->n_payload == 1))
+    {
+        payload = &rec->session_context->payload[0];
     }
 
     // Unpack the encapsulated USP message into a protobuf structure
-    usp = usp__msg__unpack(pbuf_allocator, ctx->payload.len, ctx->payload.data);
-    if (usp == NULL)
+    usp = NULL;
+    if ((payload != NULL) && (payload->len != 0) && (payload->data != NULL))
     {
-        USP_ERR_SetMessage("%s(%d): usp__msg__unpack failed", __FUNCTION__, __LINE__);
-        return;
+        usp = usp__msg__unpack(pbuf_allocator, payload->len, payload->data);
+        if (usp == NULL)
+        {
+            USP_ERR_SetMessage("%s(%d): usp__msg__unpack failed", __FUNCTION__, __LINE__);
+            usp_record__record__free_unpacked(rec, pbuf_allocator);
+            return;
+        }
     }
 
     USP_LOG_Info("to_id=%s\nfrom_id=%s", rec->to_id, rec->from_id);
@@ -284,10 +474,13 @@ void MSG_HANDLER_LogMessageToSend(Usp__Header__MsgType usp_msg_type, unsigned ch
     PROTO_TRACE_ProtobufMessage(&rec->base);
 
     // Print USP message in human readable form
-    PROTO_TRACE_ProtobufMessage(&usp->base);
-    
+    if (usp != NULL)
+    {
+        PROTO_TRACE_ProtobufMessage(&usp->base);
+        usp__msg__free_unpacked(usp, pbuf_allocator);
+    }
+
     // Free the protobuf structures
-    usp__msg__free_unpacked(usp, pbuf_allocator);
     usp_record__record__free_unpacked(rec, pbuf_allocator);
 }
 
@@ -333,6 +526,7 @@ int MSG_HANDLER_QueueMessage(char *endpoint_id, Usp__Msg *usp, mtp_reply_to_t *m
     int pbuf_len;
     int size;
     int err;
+    unsigned long long start_time;
 
     // Exit if parameters not specified
     if ((endpoint_id == NULL) || (usp == NULL))
@@ -341,11 +535,28 @@ int MSG_HANDLER_QueueMessage(char *endpoint_id, Usp__Msg *usp, mtp_reply_to_t *m
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Serialize the USP message into a buffer
-    pbuf_len = usp__msg__get_packed_size(usp);
+    // Save the response in the replay cache, if it is the response to a modifying request currently being handled
+    if ((cur_msg_replay_id != NULL) && (usp->header != NULL) && (usp->header->msg_id != NULL) && (strcmp(usp->header->msg_id, cur_msg_replay_id)==0))
+    {
+        CacheResponseForReplay(endpoint_id, usp);
+    }
+
+    // Exit if the USP message fits in a single USP record, serializing it directly into the USP record
+    // NOTE: This avoids serializing the USP message into a separate buffer, only to copy it into the serialized USP record
+    // NOTE: This is not possible if there is a session context with the controller, as the record must then contain a session context
+    pbuf_len = PROTO_CODEC_MSG_GET_PACKED_SIZE(usp);
+    if (((MAX_USP_RECORD_PAYLOAD_LEN == 0) || (pbuf_len <= MAX_USP_RECORD_PAYLOAD_LEN)) && (USP_SESSION_IsActive(endpoint_id) == false))
+    {
+        err = QueueUspMessageInRecord(endpoint_id, usp, pbuf_len, mrt);
+        return err;
+    }
+
+    // Otherwise serialize the USP message into a buffer, so that it can be sent in the session context (segmented across multiple USP records if necessary)
+    start_time = tu_uptime_usecs();
     pbuf = USP_MALLOC(pbuf_len);
-    size = usp__msg__pack(usp, pbuf);
+    size = PROTO_CODEC_MSG_PACK(usp, pbuf);
     USP_ASSERT(size == pbuf_len);          // If these are not equal, then we may have had a buffer overrun, so terminate
+    DEVICE_MSG_STATS_Record(usp->header->msg_type, kMsgStat_Serialize, start_time);
 
     // Encapsulate this message in a USP record, then queue the record, to send to a controller
     err = MSG_HANDLER_QueueUspRecord(usp->header->msg_type, endpoint_id, pbuf, pbuf_len, usp->header->msg_id, mrt, END_OF_TIME);
@@ -391,27 +602,26 @@ int MSG_HANDLER_QueueUspRecord(Usp__Header__MsgType usp_msg_type, char *endpoint
     }
 
     // Fill in the USP Record structure
-    // NOTE: This is all statically allocated (or owned elsewhere), so no need to free
-    usp_record__record__init(&rec);
-    rec.version = "1.0";
-    rec.to_id = endpoint_id;
-    rec.from_id = DEVICE_LOCAL_AGENT_GetEndpointID();
-    rec.payload_security = USP_RECORD__RECORD__PAYLOAD_SECURITY__PLAINTEXT;
-    rec.mac_signature.data = NULL;
-    rec.mac_signature.len = 0;
-    rec.sender_cert.data = NULL;
-    rec.sender_cert.len = 0;
+    InitUspRecord(&rec, endpoint_id);
     rec.record_type_case = USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT;
 
+    // Exit if the USP message must be sent in a session context, either because it is too large to send in a single USP record
+    // (so must be segmented across multiple USP records), or because there is already a session context with the controller
+    if (((MAX_USP_RECORD_PAYLOAD_LEN > 0) && (pbuf_len > MAX_USP_RECORD_PAYLOAD_LEN)) || (USP_SESSION_IsActive(endpoint_id)))
+    {
+        err = USP_SESSION_QueueMessage(&rec, usp_msg_type, endpoint_id, pbuf, pbuf_len, usp_msg_id, mrt, expiry_time);
+        return err;
+    }
+
     usp_record__no_session_context_record__init(&ctx);
     ctx.payload.data = pbuf;
     ctx.payload.len = pbuf_len;
     rec.no_session_context = &ctx;
 
     // Serialize the protobuf record structure into a buffer
-    len = usp_record__record__get_packed_size(&rec);
+    len = PROTO_CODEC_RECORD_GET_PACKED_SIZE(&rec);
     buf = USP_MALLOC(len);
-    size = usp_record__record__pack(&rec, buf);
+    size = PROTO_CODEC_RECORD_PACK(&rec, buf);
     USP_ASSERT(size == len);          // If these are not equal, then we may have had a buffer overrun, so terminate
 
     // Exit if unable to queue the message, to send to a controller
@@ -426,6 +636,147 @@ int MSG_HANDLER_QueueUspRecord(Usp__Header__MsgType usp_msg_type, char *endpoint
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** QueueUspMessageInRecord
+** 
+** Serializes a USP message directly into a USP record (with no session context), then queues the record, to be sent to a controller
+** The USP message is serialized only once, into its final position within the serialized USP record
+** NOTE: The USP record is serialized as its header fields (packed by protobuf-c), followed by the no_session_context field
+**       which encapsulates the USP message. This is identical to the output of usp_record__record__pack(), because
+**       no_session_context is the last field of the USP record and payload is the only field of the no session context record
+** 
+** \param   endpoint_id - controller to send the message to
+** \param   usp - pointer to protobuf-c structure describing the USP message to send
+** \param   msg_len - length of the serialized USP message (as returned by usp__msg__get_packed_size)
+** \param   mrt - details of where this USP message should be sent
+** 
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int QueueUspMessageInRecord(char *endpoint_id, Usp__Msg *usp, int msg_len, mtp_reply_to_t *mrt)
+{
+    UspRecord__Record rec;
+    unsigned char *buf;
+    int header_len;
+    int ctx_len;
+    int len;
+    int offset;
+    int size;
+    int err;
+    unsigned long long start_time;
+
+    // Determine the length of the serialized USP record
+    // NOTE: The record type is left unset, so that only the header fields of the USP record are serialized by protobuf-c
+    start_time = tu_uptime_usecs();
+    InitUspRecord(&rec, endpoint_id);
+    header_len = PROTO_CODEC_RECORD_GET_PACKED_SIZE(&rec);
+    ctx_len = 1 + CalcVarintLen(msg_len) + msg_len;
+    len = header_len + 1 + CalcVarintLen(ctx_len) + ctx_len;
+
+    // Serialize the header fields of the USP record
+    buf = USP_MALLOC(len);
+    size = PROTO_CODEC_RECORD_PACK(&rec, buf);
+    USP_ASSERT(size == header_len);
+
+    // Serialize the no session context record encapsulating the USP message, followed by the USP message itself
+    offset = header_len;
+    buf[offset++] = RECORD_NO_SESSION_CONTEXT_TAG;
+    offset += WriteVarint(ctx_len, &buf[offset]);
+    buf[offset++] = NO_SESSION_CONTEXT_PAYLOAD_TAG;
+    offset += WriteVarint(msg_len, &buf[offset]);
+    size = PROTO_CODEC_MSG_PACK(usp, &buf[offset]);
+    USP_ASSERT(offset + size == len);          // If these are not equal, then we may have had a buffer overrun, so terminate
+    DEVICE_MSG_STATS_Record(usp->header->msg_type, kMsgStat_Serialize, start_time);
+
+    // Exit if unable to queue the message, to send to a controller
+    // NOTE: If successful, ownership of the buffer passes to the MTP layer. If not successful, buffer is freed here
+    err = DEVICE_CONTROLLER_QueueBinaryMessage(usp->header->msg_type, endpoint_id, buf, len, usp->header->msg_id, mrt, END_OF_TIME);
+    if (err != USP_ERR_OK)
+    {
+        USP_FREE(buf);
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** InitUspRecord
+** 
+** Fills in the header fields of a USP record structure, leaving the record type unset
+** 
+** \param   rec - pointer to USP record structure to fill in
+**                NOTE: All fields are statically allocated (or owned elsewhere), so no need to free
+** \param   endpoint_id - controller to send the record to
+** 
+** \return  None
+**
+**************************************************************************/
+void InitUspRecord(UspRecord__Record *rec, char *endpoint_id)
+{
+    usp_record__record__init(rec);
+    rec->version = "1.0";
+    rec->to_id = endpoint_id;
+    rec->from_id = DEVICE_LOCAL_AGENT_GetEndpointID();
+    rec->payload_security = USP_RECORD__RECORD__PAYLOAD_SECURITY__PLAINTEXT;
+    rec->mac_signature.data = NULL;
+    rec->mac_signature.len = 0;
+    rec->sender_cert.data = NULL;
+    rec->sender_cert.len = 0;
+}
+
+/*********************************************************************//**
+**
+** CalcVarintLen
+** 
+** Calculates the number of bytes needed to serialize the specified value as a protobuf varint
+** 
+** \param   value - value to serialize
+** 
+** \return  number of bytes in the serialized varint
+**
+**************************************************************************/
+int CalcVarintLen(unsigned value)
+{
+    int len = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        len++;
+    }
+
+    return len;
+}
+
+/*********************************************************************//**
+**
+** WriteVarint
+** 
+** Serializes the specified value as a protobuf varint
+** 
+** \param   value - value to serialize
+** \param   buf - pointer to buffer in which to write the varint. This must be at least CalcVarintLen() bytes long
+** 
+** \return  number of bytes written to the buffer
+**
+**************************************************************************/
+int WriteVarint(unsigned value, unsigned char *buf)
+{
+    int len = 0;
+
+    while (value >= 0x80)
+    {
+        buf[len++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (unsigned char)value;
+
+    return len;
+}
+
 /*********************************************************************//**
 **
 ** MSG_HANDLER_GetMsgControllerInstance
@@ -497,6 +848,65 @@ char *MSG_HANDLER_GetMsgControllerEndpointId(void)
     return endpoint_id;
 }
 
+/*********************************************************************//**
+**
+** MSG_HANDLER_DestroyReplayCache
+**
+** Frees all responses cached for replay to retransmitted requests
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MSG_HANDLER_DestroyReplayCache(void)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int i;
+
+    for (i=0; i<replay_caches_size; i++)
+    {
+        FreeReplayCache(i);
+    }
+
+    USP_SAFE_FREE(replay_caches);
+    replay_caches_size = 0;
+#endif
+}
+
+/*********************************************************************//**
+**
+** MSG_HANDLER_FreeControllerReplayCache
+**
+** Frees the responses cached for replay to the specified controller
+** This is called when the controller is deleted, or its EndpointID changes
+**
+** \param   endpoint_id - endpoint_id of the controller
+**
+** \return  None
+**
+**************************************************************************/
+void MSG_HANDLER_FreeControllerReplayCache(char *endpoint_id)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int index;
+
+    // Exit if no endpoint_id, or the controller does not have a replay cache
+    if (endpoint_id == NULL)
+    {
+        return;
+    }
+
+    index = FindReplayCache(endpoint_id);
+    if (index == INVALID)
+    {
+        return;
+    }
+
+    FreeReplayCache(index);
+#endif
+}
+
 /*********************************************************************//**
 **
 ** MSG_HANDLER_UspMsgTypeToString
@@ -530,9 +940,11 @@ int HandleUspMessage(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *m
 {
     int err = USP_ERR_OK;
     char buf[MAX_ISO8601_LEN];
+    unsigned long long start_time;
 
     // Ignore the message if it came from a controller which we do not recognise
-    cur_msg_controller_instance = DEVICE_CONTROLLER_FindInstanceByEndpointId(controller_endpoint);
+    // NOTE: The controller instance was determined by CacheControllerRoleForCurMsg(), which is always called before this function
+    cur_msg_controller_instance = msg_role_cache.instance;
     if (cur_msg_controller_instance == INVALID)
     {
         USP_ERR_SetMessage("%s: Ignoring message from endpoint_id=%s (unknown controller)", __FUNCTION__, controller_endpoint);
@@ -553,6 +965,32 @@ int HandleUspMessage(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *m
                 MSG_HANDLER_UspMsgTypeToString(usp->header->msg_type),
                 iso8601_cur_time(buf, sizeof(buf)) );
 
+    // Record how long the USP record waited before being processed
+    USP_PROBE3(msg_receive, usp->header->msg_type, usp->header->msg_id, controller_endpoint);
+    start_time = tu_uptime_usecs();
+    if (mrt->rx_time != 0)
+    {
+        DEVICE_MSG_STATS_RecordDuration(usp->header->msg_type, kMsgStat_QueueWait, (start_time > mrt->rx_time) ? start_time - mrt->rx_time : 0);
+    }
+
+    // Exit if the message is a retransmission of a modifying request that has already been handled, answering it with the cached response
+    switch(usp->header->msg_type)
+    {
+        case USP__HEADER__MSG_TYPE__SET:
+        case USP__HEADER__MSG_TYPE__ADD:
+        case USP__HEADER__MSG_TYPE__DELETE:
+        case USP__HEADER__MSG_TYPE__OPERATE:
+            if (ReplayCachedResponse(controller_endpoint, usp, mrt))
+            {
+                goto exit;
+            }
+            cur_msg_replay_id = usp->header->msg_id;
+            break;
+
+        default:
+            break;
+    }
+
     // Process the message
     switch(usp->header->msg_type)
     {
@@ -597,8 +1035,13 @@ int HandleUspMessage(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *m
             break;
     }
 
+    // Record how long it took to process the message
+    DEVICE_MSG_STATS_Record(usp->header->msg_type, kMsgStat_Handle, start_time);
+    USP_PROBE2(msg_handled, usp->header->msg_type, usp->header->msg_id);
+
 exit:
     cur_msg_controller_instance = INVALID;
+    cur_msg_replay_id = NULL;
 
     // Activate all STOMP reconnects or scheduled exits, now that we have queued all response messages
     MTP_EXEC_ActivateScheduledActions();
@@ -664,11 +1107,24 @@ int ValidateUspRecord(UspRecord__Record *rec)
         return USP_ERR_SECURE_SESS_NOT_SUPPORTED;
     }
 
-    // Exit if this record contains an End-to-End Session Context (which we don't yet support)
+    // Exit if this record contains an End-to-End Session Context
+    // NOTE: Session context records may have an empty payload (eg if they just request a retransmission)
+    if (rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT)
+    {
+        if (rec->session_context == NULL)
+        {
+            USP_ERR_SetMessage("%s: Ignoring USP record as it does not contain a session context", __FUNCTION__);
+            return USP_ERR_RECORD_FIELD_INVALID;
+        }
+
+        return USP_ERR_OK;
+    }
+
+    // Exit if this record is of an unknown type
     if (rec->record_type_case != USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT)
     {
-        USP_ERR_SetMessage("%s: Ignoring USP record as it contains an End-to-End session context", __FUNCTION__);
-        return USP_ERR_SEG_NOT_SUPPORTED;
+        USP_ERR_SetMessage("%s: Ignoring USP record of unknown record type (%d)", __FUNCTION__, rec->record_type_case);
+        return USP_ERR_RECORD_FIELD_INVALID;
     }
 
     // Exit if this record does not contain a payload
@@ -689,6 +1145,8 @@ int ValidateUspRecord(UspRecord__Record *rec)
 **
 ** Retrieves the role to use for the specified controller, and caches it locally, so that
 ** it may be used subsequently when processing the current message by calling MSG_HANDLER_GetMsgRole()
+** Also determines the instance number of the controller, which is used by HandleUspMessage()
+** NOTE: These are only recalculated if the controller, MTP role or controller table has changed since the last message processed by this thread
 **
 ** \param   endpoint_id - endpoint_id of the controller that has sent the current message being processed
 ** \param   role - Role allowed for this message from the MTP
@@ -698,16 +1156,60 @@ int ValidateUspRecord(UspRecord__Record *rec)
 **
 **************************************************************************/
 void CacheControllerRoleForCurMsg(char *endpoint_id, ctrust_role_t role, mtp_protocol_t protocol)
+{
+    msg_role_cache_t *mrc = &msg_role_cache;
+    unsigned generation;
+
+    // Exit if the role and controller instance determined for the last message processed by this thread are still valid
+    generation = DEVICE_CONTROLLER_GetRoleGeneration();
+    if ((mrc->generation == generation) && (mrc->role == role) && (mrc->protocol == protocol) &&
+        (endpoint_id != NULL) && (strcmp(endpoint_id, mrc->endpoint_id)==0))
+    {
+        cur_msg_combined_role = mrc->combined_role;
+        return;
+    }
+
+    // Otherwise recalculate them
+    mrc->instance = DEVICE_CONTROLLER_FindInstanceByEndpointId(endpoint_id);
+    CalcControllerRoleForMsg(endpoint_id, role, protocol, &mrc->combined_role);
+    cur_msg_combined_role = mrc->combined_role;
+
+    // Mark the cache as valid, if the endpoint_id can be stored in it
+    mrc->generation = 0;
+    if ((endpoint_id != NULL) && (strlen(endpoint_id) < sizeof(mrc->endpoint_id)))
+    {
+        USP_STRNCPY(mrc->endpoint_id, endpoint_id, sizeof(mrc->endpoint_id));
+        mrc->role = role;
+        mrc->protocol = protocol;
+        mrc->generation = generation;
+    }
+}
+
+/*********************************************************************//**
+**
+** CalcControllerRoleForMsg
+**
+** Calculates the combined role to use for USP messages received from the specified controller on the specified MTP
+**
+** \param   endpoint_id - endpoint_id of the controller that has sent the current message being processed
+** \param   role - Role allowed for this message from the MTP
+** \param   protocol - protocol that the message was received on
+** \param   combined_role - pointer to variable in which to return the combined role
+**
+** \return  None - if the controller is not recognised, then it will be granted an appropriately low set of permissions
+**
+**************************************************************************/
+void CalcControllerRoleForMsg(char *endpoint_id, ctrust_role_t role, mtp_protocol_t protocol, combined_role_t *combined_role)
 {
     int err;
 
     // Get the combined role for this endpoint_id
-    err = DEVICE_CONTROLLER_GetCombinedRoleByEndpointId(endpoint_id, &cur_msg_combined_role);
+    err = DEVICE_CONTROLLER_GetCombinedRoleByEndpointId(endpoint_id, combined_role);
     if (err != USP_ERR_OK)
     {
         // If this is an unknown controller, then grant it a limited set of permissions
-        cur_msg_combined_role.inherited = kCTrustRole_Untrusted;
-        cur_msg_combined_role.assigned = INVALID_ROLE;
+        combined_role->inherited = kCTrustRole_Untrusted;
+        combined_role->assigned = INVALID_ROLE;
         return;
     }
 
@@ -716,15 +1218,33 @@ void CacheControllerRoleForCurMsg(char *endpoint_id, ctrust_role_t role, mtp_pro
         case kMtpProtocol_STOMP:
             // If the message was received over STOMP, then the inherited role will have been saved in DEVICE_CONTROLLER
             // when the STOMP handshake completed and will already equal the role passed with the USP message
-            USP_ASSERT(cur_msg_combined_role.inherited == role);
+            USP_ASSERT(combined_role->inherited == role);
             break;
 
 #ifdef ENABLE_COAP
         case kMtpProtocol_CoAP:
             // If the message was not received over STOMP, then the inherited role won't have been saved in DEVICE_CONTROLLER,
             // so override with the role that was passed with the USP message
-            USP_ASSERT(cur_msg_combined_role.inherited == ROLE_DEFAULT);
-            cur_msg_combined_role.inherited = role;
+            USP_ASSERT(combined_role->inherited == ROLE_DEFAULT);
+            combined_role->inherited = role;
+            break;
+#endif
+
+#ifdef ENABLE_WEBSOCKETS
+        case kMtpProtocol_WebSockets:
+            // The inherited role is determined per WebSocket connection (from the controller's TLS certificate chain),
+            // so override with the role that was passed with the USP message
+            USP_ASSERT(combined_role->inherited == ROLE_DEFAULT);
+            combined_role->inherited = role;
+            break;
+#endif
+
+#ifdef ENABLE_MQTT
+        case kMtpProtocol_MQTT:
+            // The inherited role is determined per MQTT client connection (from the broker's TLS certificate chain),
+            // so override with the role that was passed with the USP message
+            USP_ASSERT(combined_role->inherited == ROLE_DEFAULT);
+            combined_role->inherited = role;
             break;
 #endif
 
@@ -734,3 +1254,239 @@ void CacheControllerRoleForCurMsg(char *endpoint_id, ctrust_role_t role, mtp_pro
     }
 }
 
+/*********************************************************************//**
+**
+** ReplayCachedResponse
+**
+** Determines whether the specified request is a retransmission of a request which has already been handled,
+** and if so, queues the cached response to it, instead of handling the request again
+**
+** \param   endpoint_id - endpoint_id of the controller that sent the request
+** \param   usp - pointer to parsed USP request message
+** \param   mrt - details of where the response to this USP message should be sent
+**
+** \return  true if the request was answered from the replay cache
+**
+**************************************************************************/
+bool ReplayCachedResponse(char *endpoint_id, Usp__Msg *usp, mtp_reply_to_t *mrt)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int i, j;
+    replay_cache_t *rc;
+    replay_entry_t *re;
+    time_t cur_time;
+
+    // Exit if the request has no msg_id to match against
+    if (usp->header->msg_id == NULL)
+    {
+        return false;
+    }
+
+    // Exit if the controller has no replay cache
+    i = FindReplayCache(endpoint_id);
+    if (i == INVALID)
+    {
+        return false;
+    }
+
+    cur_time = time(NULL);
+    rc = replay_caches[i];
+    for (j=0; j<MSG_REPLAY_CACHE_SIZE; j++)
+    {
+        // Exit if found the response to a previous identical request with the same msg_id, which has not expired
+        re = &rc->entries[j];
+        if ((re->msg_id != NULL) && (re->req_hash == cur_msg_hash) &&
+            (cur_time - re->time_cached <= MSG_REPLAY_CACHE_PERIOD) && (strcmp(re->msg_id, usp->header->msg_id)==0))
+        {
+            USP_LOG_Info("%s: Replaying cached %s to retransmitted request (msg_id=%s)", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(re->resp_type), re->msg_id);
+            MSG_HANDLER_QueueUspRecord(re->resp_type, endpoint_id, re->buf, re->len, re->msg_id, mrt, END_OF_TIME);
+            return true;
+        }
+    }
+#endif
+
+    // If the code gets here, then the request has not been handled before
+    return false;
+}
+
+/*********************************************************************//**
+**
+** CacheResponseForReplay
+**
+** Saves the response to the modifying request currently being handled, in the replay cache for the controller
+** If the controller has no replay cache, then one is allocated
+**
+** \param   endpoint_id - endpoint_id of the controller that the response is being sent to
+** \param   resp - pointer to protobuf-c structure describing the USP response message
+**
+** \return  None
+**
+**************************************************************************/
+void CacheResponseForReplay(char *endpoint_id, Usp__Msg *resp)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int index;
+    int size;
+    replay_cache_t *rc;
+    replay_entry_t *re;
+
+    // Allocate a replay cache for the controller, if it does not already have one
+    index = FindReplayCache(endpoint_id);
+    if (index == INVALID)
+    {
+        index = AllocReplayCacheSlot();
+        rc = USP_MALLOC(sizeof(replay_cache_t));
+        memset(rc, 0, sizeof(replay_cache_t));
+        rc->endpoint_id = USP_STRDUP(endpoint_id);
+        replay_caches[index] = rc;
+    }
+    rc = replay_caches[index];
+
+    // Replace the oldest response in the cache with this response
+    re = &rc->entries[rc->next];
+    USP_SAFE_FREE(re->msg_id);
+    USP_SAFE_FREE(re->buf);
+
+    re->msg_id = USP_STRDUP(resp->header->msg_id);
+    re->req_hash = cur_msg_hash;
+    re->resp_type = resp->header->msg_type;
+    re->len = PROTO_CODEC_MSG_GET_PACKED_SIZE(resp);
+    re->buf = USP_MALLOC(re->len);
+    size = PROTO_CODEC_MSG_PACK(resp, re->buf);
+    USP_ASSERT(size == re->len);
+    re->time_cached = time(NULL);
+
+    rc->next = (rc->next + 1) % MSG_REPLAY_CACHE_SIZE;
+    rc->last_used = re->time_cached;
+#endif
+}
+
+/*********************************************************************//**
+**
+** FindReplayCache
+**
+** Finds the replay cache for the specified controller
+**
+** \param   endpoint_id - endpoint_id of the controller
+**
+** \return  index of the replay cache in the replay_caches array, or INVALID if the controller has no replay cache
+**
+**************************************************************************/
+int FindReplayCache(char *endpoint_id)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int i;
+    replay_cache_t *rc;
+
+    for (i=0; i<replay_caches_size; i++)
+    {
+        rc = replay_caches[i];
+        if ((rc != NULL) && (strcmp(rc->endpoint_id, endpoint_id)==0))
+        {
+            return i;
+        }
+    }
+#endif
+
+    return INVALID;
+}
+
+/*********************************************************************//**
+**
+** AllocReplayCacheSlot
+**
+** Finds an unused slot in the replay_caches array, growing the array if necessary
+** If the array cannot be grown any further, then the least recently used replay cache is freed, and its slot reused
+**
+** \param   None
+**
+** \return  index of the unused slot in the replay_caches array
+**
+**************************************************************************/
+int AllocReplayCacheSlot(void)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int i;
+    int new_size;
+    int lru = INVALID;
+
+    // Exit if found an unused slot
+    for (i=0; i<replay_caches_size; i++)
+    {
+        if (replay_caches[i] == NULL)
+        {
+            return i;
+        }
+
+        if ((lru == INVALID) || (replay_caches[i]->last_used < replay_caches[lru]->last_used))
+        {
+            lru = i;
+        }
+    }
+
+    // Exit if the array cannot be grown any further, reusing the slot of the least recently used cache
+    // NOTE: This could only occur if controllers had changed their EndpointID without their cache being freed
+    if (replay_caches_size >= MAX_CONTROLLERS)
+    {
+        FreeReplayCache(lru);
+        return lru;
+    }
+
+    // Otherwise grow the array (doubling its size), marking all new slots as unused
+    new_size = (replay_caches_size == 0) ? MIN_REPLAY_CACHES_ALLOC : 2*replay_caches_size;
+    if (new_size > MAX_CONTROLLERS)
+    {
+        new_size = MAX_CONTROLLERS;
+    }
+
+    replay_caches = USP_REALLOC(replay_caches, new_size*sizeof(replay_cache_t *));
+    for (i=replay_caches_size; i<new_size; i++)
+    {
+        replay_caches[i] = NULL;
+    }
+
+    // Return the first of the new slots
+    i = replay_caches_size;
+    replay_caches_size = new_size;
+    return i;
+#else
+    return INVALID;
+#endif
+}
+
+/*********************************************************************//**
+**
+** FreeReplayCache
+**
+** Frees the specified replay cache, and all responses cached in it, marking its slot as unused
+**
+** \param   index - index of the replay cache in the replay_caches array
+**
+** \return  None
+**
+**************************************************************************/
+void FreeReplayCache(int index)
+{
+#if MSG_REPLAY_CACHE_SIZE > 0
+    int i;
+    replay_cache_t *rc;
+    replay_entry_t *re;
+
+    rc = replay_caches[index];
+    if (rc == NULL)
+    {
+        return;
+    }
+
+    for (i=0; i<MSG_REPLAY_CACHE_SIZE; i++)
+    {
+        re = &rc->entries[i];
+        USP_SAFE_FREE(re->msg_id);
+        USP_SAFE_FREE(re->buf);
+    }
+    USP_SAFE_FREE(rc->endpoint_id);
+    USP_FREE(rc);
+
+    replay_caches[index] = NULL;
+#endif
+}
@@ -55,15 +55,19 @@ typedef int (*paramerror_extractor_t)(Usp__Msg *src_msg, Usp__Msg *err_msg);
 // API functions
 int MSG_HANDLER_HandleBinaryRecord(unsigned char *pbuf, int pbuf_len, ctrust_role_t role, char *allowed_controllers, mtp_reply_to_t *mrt);
 int MSG_HANDLER_HandleBinaryMessage(unsigned char *pbuf, int pbuf_len, ctrust_role_t role, char *allowed_controllers, char *controller_endpoint, mtp_reply_to_t *mrt);
+bool MSG_HANDLER_IsReadOnlyRecord(unsigned char *pbuf, int pbuf_len);
 void MSG_HANDLER_LogMessageToSend(Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, mtp_protocol_t protocol, char *host, unsigned char *stomp_header, mtp_content_type_t content_type);
 int MSG_HANDLER_QueueMessage(char *endpoint_id, Usp__Msg *usp, mtp_reply_to_t *mrt);
 int MSG_HANDLER_QueueUspRecord(Usp__Header__MsgType usp_msg_type, char *endpoint_id, unsigned char *pbuf, int pbuf_len, char *usp_msg_id, mtp_reply_to_t *mrt, time_t expiry_time);
 int MSG_HANDLER_GetMsgControllerInstance(void);
 void MSG_HANDLER_GetMsgRole(combined_role_t *combined_role);
 char *MSG_HANDLER_GetMsgControllerEndpointId(void);
+void MSG_HANDLER_DestroyReplayCache(void);
+void MSG_HANDLER_FreeControllerReplayCache(char *endpoint_id);
 
 // Parse message received and handle response
 void MSG_HANDLER_HandleGet(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
+void MSG_HANDLER_CompleteAsyncGet(int request_id, int err_code, char *value);
 void MSG_HANDLER_HandleSet(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 void MSG_HANDLER_HandleAdd(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 void MSG_HANDLER_HandleDelete(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
@@ -71,6 +75,7 @@ void MSG_HANDLER_HandleOperate(Usp__Msg *usp, char *controller_endpoint, mtp_rep
 void MSG_HANDLER_HandleGetSupportedProtocol(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 void MSG_HANDLER_HandleGetInstances(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 void MSG_HANDLER_HandleGetSupportedDM(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
+void MSG_HANDLER_InvalidateGetSupportedDMCache(void);
 void MSG_HANDLER_HandleUnknownMsgType(Usp__Msg *usp, char *controller_endpoint, mtp_reply_to_t *mrt);
 char *MSG_HANDLER_UspMsgTypeToString(int msg_type);
 
@@ -91,6 +96,7 @@ Usp__Msg *MSG_HANDLER_CreateNotifyReq_OperCompleteSuccess(kv_vector_t *output_ar
 Usp__Msg *MSG_HANDLER_CreateNotifyReq_OperCompleteFailure(int err_code, char *err_msg, char *command, char *command_key,
                                                           char *subscription_id, bool send_resp);
 Usp__Msg *MSG_HANDLER_CreateNotifyReq_Event(char *event_name, kv_vector_t *param_values, char *subscription_id, bool send_resp);
+void MSG_HANDLER_ReaddressNotifyReq(Usp__Msg *req, char *subscription_id, bool send_resp);
 
 #endif
 
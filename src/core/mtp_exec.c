@@ -35,7 +35,7 @@
 /**
  * \file mtp_exec.c
  *
- * Main loop for MTP thread dealing with STOMP and CoAP Communications
+ * Main loop for MTP thread dealing with STOMP, CoAP and WebSocket Communications
  *
  */
 #include <string.h>
@@ -52,17 +52,25 @@
 #include "usp_coap.h"
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+#include "wsclient.h"
+#endif
+
+#ifdef ENABLE_MQTT
+#include "mqtt.h"
+#endif
+
 //------------------------------------------------------------------------------
 // Enumeration that is set when a USP Agent stop has been scheduled (for when connections have finished sending and receiving messages)
 scheduled_action_t mtp_exit_scheduled = kScheduledAction_Off;
 
 //------------------------------------------------------------------------------
-// Unix domain socket pair used to implement a wakeup message queue
+// Unix domain socket pairs used to implement a wakeup message queue for each STOMP MTP thread
 // One socket is always used for sending, and the other always used for receiving
-static int mtp_stomp_mq_sockets[2] = {-1, -1};
+static int mtp_stomp_mq_sockets[NUM_STOMP_MTP_THREADS][2];
 
-#define mq_stomp_rx_socket  mtp_stomp_mq_sockets[0]
-#define mq_stomp_tx_socket  mtp_stomp_mq_sockets[1]
+#define mq_stomp_rx_socket(t)  mtp_stomp_mq_sockets[t][0]
+#define mq_stomp_tx_socket(t)  mtp_stomp_mq_sockets[t][1]
 
 //------------------------------------------------------------------------------
 // Flag set to true if the MTP thread has exited
@@ -85,6 +93,36 @@ static int mtp_coap_mq_sockets[2] = {-1, -1};
 bool is_coap_mtp_thread_exited = false;
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+//------------------------------------------------------------------------------
+// Unix domain socket pair used to implement a wakeup message queue for the WebSocket client MTP thread
+// One socket is always used for sending, and the other always used for receiving
+static int mtp_wsclient_mq_sockets[2] = {-1, -1};
+
+#define mq_wsclient_rx_socket  mtp_wsclient_mq_sockets[0]
+#define mq_wsclient_tx_socket  mtp_wsclient_mq_sockets[1]
+
+//------------------------------------------------------------------------------
+// Flag set to true if the MTP thread has exited
+// This gets set after a scheduled exit due to a stop command, Reboot or FactoryReset operation
+bool is_wsclient_mtp_thread_exited = false;
+#endif
+
+#ifdef ENABLE_MQTT
+//------------------------------------------------------------------------------
+// Unix domain socket pair used to implement a wakeup message queue for the MQTT MTP thread
+// One socket is always used for sending, and the other always used for receiving
+static int mtp_mqtt_mq_sockets[2] = {-1, -1};
+
+#define mq_mqtt_rx_socket  mtp_mqtt_mq_sockets[0]
+#define mq_mqtt_tx_socket  mtp_mqtt_mq_sockets[1]
+
+//------------------------------------------------------------------------------
+// Flag set to true if the MTP thread has exited
+// This gets set after a scheduled exit due to a stop command, Reboot or FactoryReset operation
+bool is_mqtt_mtp_thread_exited = false;
+#endif
+
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void UpdateMtpSockSet(socket_set_t *set);
@@ -105,18 +143,42 @@ void ProcessMtpWakeupQueueSocketActivity(socket_set_t *set, int sock);
 int MTP_EXEC_Init(void)
 {
     int err;
+    int i;
 
+    // Exit if unable to initialize the unix domain socket pairs used to implement a wakeup message queue for each STOMP MTP thread
+    for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+    {
+        err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_stomp_mq_sockets[i]);
+        if (err != 0)
+        {
+            USP_ERR_ERRNO("socketpair", errno);
+            return USP_ERR_INTERNAL_ERROR;
+        }
+    }
+
+#ifdef ENABLE_COAP
     // Exit if unable to initialize the unix domain socket pair used to implement a wakeup message queue
-    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_stomp_mq_sockets);
+    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_coap_mq_sockets);
     if (err != 0)
     {
         USP_ERR_ERRNO("socketpair", errno);
         return USP_ERR_INTERNAL_ERROR;
     }
+#endif
 
-#ifdef ENABLE_COAP
-    // Exit if unable to initialize the unix domain socket pair used to implement a wakeup message queue
-    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_coap_mq_sockets);
+#ifdef ENABLE_WEBSOCKETS
+    // Exit if unable to initialize the unix domain socket pair used to implement a wakeup message queue for the WebSocket client
+    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_wsclient_mq_sockets);
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("socketpair", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+#endif
+
+#ifdef ENABLE_MQTT
+    // Exit if unable to initialize the unix domain socket pair used to implement a wakeup message queue for the MQTT clients
+    err = socketpair(AF_UNIX, SOCK_DGRAM, 0, mtp_mqtt_mq_sockets);
     if (err != 0)
     {
         USP_ERR_ERRNO("socketpair", errno);
@@ -131,21 +193,21 @@ int MTP_EXEC_Init(void)
 **
 ** MTP_EXEC_StompWakeup
 **
-** Posts a message on each MTP thread's queue, to cause it to wakeup from the select()
+** Posts a message on the specified STOMP MTP thread's queue, to cause it to wakeup from the select()
 **
-** \param   None
+** \param   stomp_thread - index of the STOMP MTP thread to wakeup
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-void MTP_EXEC_StompWakeup(void)
+void MTP_EXEC_StompWakeup(int stomp_thread)
 {
     #define WAKEUP_MESSAGE 'W'
     char msg = WAKEUP_MESSAGE;
     int bytes_sent;
     
     // Send the message
-    bytes_sent = send(mq_stomp_tx_socket, &msg, sizeof(msg), 0);
+    bytes_sent = send(mq_stomp_tx_socket(stomp_thread), &msg, sizeof(msg), 0);
     if (bytes_sent != sizeof(msg))
     {
         char buf[USP_ERR_MAXLEN];
@@ -182,6 +244,96 @@ void MTP_EXEC_CoapWakeup(void)
 }
 #endif
 
+#ifdef ENABLE_WEBSOCKETS
+/*********************************************************************//**
+**
+** MTP_EXEC_WsclientWakeup
+**
+** Posts a message on the WebSocket client MTP thread's queue, to cause it to wakeup from the select()
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_EXEC_WsclientWakeup(void)
+{
+    char msg = WAKEUP_MESSAGE;
+    int bytes_sent;
+
+    // Send the message
+    bytes_sent = send(mq_wsclient_tx_socket, &msg, sizeof(msg), 0);
+    if (bytes_sent != sizeof(msg))
+    {
+        char buf[USP_ERR_MAXLEN];
+        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        return;
+    }
+}
+#endif
+
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** MTP_EXEC_MqttWakeup
+**
+** Posts a message on the MQTT MTP thread's queue, to cause it to wakeup from the select()
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_EXEC_MqttWakeup(void)
+{
+    char msg = WAKEUP_MESSAGE;
+    int bytes_sent;
+
+    // Send the message
+    bytes_sent = send(mq_mqtt_tx_socket, &msg, sizeof(msg), 0);
+    if (bytes_sent != sizeof(msg))
+    {
+        char buf[USP_ERR_MAXLEN];
+        USP_LOG_Error("%s(%d): send failed : (err=%d) %s", __FUNCTION__, __LINE__, errno, USP_ERR_ToString(errno, buf, sizeof(buf)) );
+        return;
+    }
+}
+#endif
+
+/*********************************************************************//**
+**
+** MTP_EXEC_WakeupAll
+**
+** Posts a message on all MTP threads' queues, to cause them to wakeup from the select()
+** This is used when state that all MTP threads may be waiting on has changed (eg a DNS lookup has completed)
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_EXEC_WakeupAll(void)
+{
+    int i;
+
+    for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+    {
+        MTP_EXEC_StompWakeup(i);
+    }
+
+#ifdef ENABLE_COAP
+    MTP_EXEC_CoapWakeup();
+#endif
+
+#ifdef ENABLE_WEBSOCKETS
+    MTP_EXEC_WsclientWakeup();
+#endif
+
+#ifdef ENABLE_MQTT
+    MTP_EXEC_MqttWakeup();
+#endif
+}
+
 /*********************************************************************//**
 **
 ** MTP_EXEC_ScheduleExit
@@ -216,12 +368,28 @@ void MTP_EXEC_ScheduleExit(void)
 **************************************************************************/
 void MTP_EXEC_ActivateScheduledActions(void)
 {
+    int i;
+
 #ifdef ENABLE_COAP
-    #define either_mtp_exited    (is_stomp_mtp_thread_exited || is_coap_mtp_thread_exited)
+    #define coap_mtp_exited      (is_coap_mtp_thread_exited)
+#else
+    #define coap_mtp_exited      (false)
+#endif
+
+#ifdef ENABLE_WEBSOCKETS
+    #define wsclient_mtp_exited  (is_wsclient_mtp_thread_exited)
+#else
+    #define wsclient_mtp_exited  (false)
+#endif
+
+#ifdef ENABLE_MQTT
+    #define mqtt_mtp_exited      (is_mqtt_mtp_thread_exited)
 #else
-    #define either_mtp_exited    (is_stomp_mtp_thread_exited)
+    #define mqtt_mtp_exited      (false)
 #endif
 
+    #define either_mtp_exited    (is_stomp_mtp_thread_exited || coap_mtp_exited || wsclient_mtp_exited || mqtt_mtp_exited)
+
     // Exit if either MTP thread has already exited (because if they have, there is no need to schedule any further actions)
     if (either_mtp_exited)
     {
@@ -232,23 +400,36 @@ void MTP_EXEC_ActivateScheduledActions(void)
     if (mtp_exit_scheduled == kScheduledAction_Signalled)
     {
         mtp_exit_scheduled = kScheduledAction_Activated;
-        MTP_EXEC_StompWakeup();
+        for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+        {
+            MTP_EXEC_StompWakeup(i);
+        }
 #ifdef ENABLE_COAP
         MTP_EXEC_CoapWakeup();
+#endif
+#ifdef ENABLE_WEBSOCKETS
+        MTP_EXEC_WsclientWakeup();
+#endif
+#ifdef ENABLE_MQTT
+        MTP_EXEC_MqttWakeup();
 #endif
     }
 
     // Activate all scheduled reconnects, if signalled
     STOMP_ActivateScheduledActions();
+#ifdef ENABLE_MQTT
+    MQTT_ActivateScheduledActions();
+#endif
 }
 
 /*********************************************************************//**
 **
 ** MTP_EXEC_StompMain
 **
-** Main loop of MTP thread for STOMP
+** Main loop of an MTP thread for STOMP
+** Each STOMP MTP thread services a subset of the STOMP connections (see NUM_STOMP_MTP_THREADS)
 **
-** \param   args - arguments (currently unused)
+** \param   args - index of this STOMP MTP thread (cast to a pointer)
 **
 ** \return  None
 **
@@ -257,13 +438,14 @@ void *MTP_EXEC_StompMain(void *args)
 {
     int num_sockets;
     socket_set_t set;
+    int stomp_thread = (int)(long)args;
 
     while(FOREVER)
     {
         // Create the set of all sockets to receive/transmit on (with timeout)
         SOCKET_SET_Clear(&set);
-        STOMP_UpdateAllSockSet(&set);
-        SOCKET_SET_AddSocketToReceiveFrom(mq_stomp_rx_socket, MAX_SOCKET_TIMEOUT, &set);
+        STOMP_UpdateAllSockSet(stomp_thread, &set);
+        SOCKET_SET_AddSocketToReceiveFrom(mq_stomp_rx_socket(stomp_thread), MAX_SOCKET_TIMEOUT, &set);
 
         // Wait for read/write activity on sockets or timeout
         num_sockets = SOCKET_SET_Select(&set);
@@ -283,25 +465,29 @@ void *MTP_EXEC_StompMain(void *args)
                 // No controllers with any activity, but we still may need to process a timeout, so fall-through
             default:
                 // Process the wakeup queue
-                ProcessMtpWakeupQueueSocketActivity(&set, mq_stomp_rx_socket);
+                ProcessMtpWakeupQueueSocketActivity(&set, mq_stomp_rx_socket(stomp_thread));
 
-                // Process activity on all STOMP message queues
-                STOMP_ProcessAllSocketActivity(&set);
+                // Process activity on all STOMP message queues serviced by this thread
+                STOMP_ProcessAllSocketActivity(stomp_thread, &set);
                 break;
         }
 
         // Exit this thread, if an exit is scheduled and all responses have been sent
         if (mtp_exit_scheduled == kScheduledAction_Activated)
         {
-            if (STOMP_AreAllResponsesSent())
+            if (STOMP_AreAllResponsesSent(stomp_thread))
             {
-                // Free all memory associated with MTP layer
-                STOMP_Destroy();
+                // Free all memory associated with the STOMP connections serviced by this thread
+                // Exit if other STOMP MTP threads are still running (the last one to exit signals the data model thread)
+                if (STOMP_Destroy(stomp_thread) == false)
+                {
+                    return NULL;
+                }
 
                 // Prevent the data model from making any other changes to the MTP thread
                 is_stomp_mtp_thread_exited = true;
 
-                // Signal the data model thread that this thread has exited
+                // Signal the data model thread that all STOMP MTP threads have exited
                 DM_EXEC_PostMtpThreadExited(STOMP_EXITED);
                 return NULL;
             }
@@ -378,12 +564,146 @@ void *MTP_EXEC_CoapMain(void *args)
 }
 #endif // ENABLE_COAP
 
+#ifdef ENABLE_WEBSOCKETS
+/*********************************************************************//**
+**
+** MTP_EXEC_WsclientMain
+**
+** Main loop of MTP thread for WebSocket client connections
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None
+**
+**************************************************************************/
+void *MTP_EXEC_WsclientMain(void *args)
+{
+    int num_sockets;
+    socket_set_t set;
+
+    while(FOREVER)
+    {
+        // Create the set of all sockets to receive/transmit on (with timeout)
+        SOCKET_SET_Clear(&set);
+        WSCLIENT_UpdateAllSockSet(&set);
+        SOCKET_SET_AddSocketToReceiveFrom(mq_wsclient_rx_socket, MAX_SOCKET_TIMEOUT, &set);
+
+        // Wait for read/write activity on sockets or timeout
+        num_sockets = SOCKET_SET_Select(&set);
+
+        // Process socket activity
+        switch(num_sockets)
+        {
+            case -1:
+                // An unrecoverable error has occurred
+                USP_LOG_Error("%s: Unrecoverable socket select() error. Aborting MTP thread", __FUNCTION__);
+                return NULL;
+                break;
+
+            case 0:
+                // No controllers with any activity, but we still may need to process a timeout, so fall-through
+            default:
+                // Process the wakeup queue
+                ProcessMtpWakeupQueueSocketActivity(&set, mq_wsclient_rx_socket);
+
+                // Process activity on all WebSocket client connections
+                WSCLIENT_ProcessAllSocketActivity(&set);
+                break;
+        }
+
+        // Exit this thread, if an exit is scheduled and all responses have been sent
+        if (mtp_exit_scheduled == kScheduledAction_Activated)
+        {
+            if (WSCLIENT_AreAllResponsesSent())
+            {
+                // Free all memory associated with MTP layer
+                WSCLIENT_Destroy();
+
+                // Prevent the data model from making any other changes to the MTP thread
+                is_wsclient_mtp_thread_exited = true;
+
+                // Signal the data model thread that this thread has exited
+                DM_EXEC_PostMtpThreadExited(WSCLIENT_EXITED);
+                return NULL;
+            }
+        }
+    }
+}
+#endif // ENABLE_WEBSOCKETS
+
+#ifdef ENABLE_MQTT
+/*********************************************************************//**
+**
+** MTP_EXEC_MqttMain
+**
+** Main loop of MTP thread for MQTT client connections
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None
+**
+**************************************************************************/
+void *MTP_EXEC_MqttMain(void *args)
+{
+    int num_sockets;
+    socket_set_t set;
+
+    while(FOREVER)
+    {
+        // Create the set of all sockets to receive/transmit on (with timeout)
+        SOCKET_SET_Clear(&set);
+        MQTT_UpdateAllSockSet(&set);
+        SOCKET_SET_AddSocketToReceiveFrom(mq_mqtt_rx_socket, MAX_SOCKET_TIMEOUT, &set);
+
+        // Wait for read/write activity on sockets or timeout
+        num_sockets = SOCKET_SET_Select(&set);
+
+        // Process socket activity
+        switch(num_sockets)
+        {
+            case -1:
+                // An unrecoverable error has occurred
+                USP_LOG_Error("%s: Unrecoverable socket select() error. Aborting MTP thread", __FUNCTION__);
+                return NULL;
+                break;
+
+            case 0:
+                // No brokers with any activity, but we still may need to process a timeout, so fall-through
+            default:
+                // Process the wakeup queue
+                ProcessMtpWakeupQueueSocketActivity(&set, mq_mqtt_rx_socket);
+
+                // Process activity on all MQTT client connections
+                MQTT_ProcessAllSocketActivity(&set);
+                break;
+        }
+
+        // Exit this thread, if an exit is scheduled and all responses have been sent
+        if (mtp_exit_scheduled == kScheduledAction_Activated)
+        {
+            if (MQTT_AreAllResponsesSent())
+            {
+                // Free all memory associated with MTP layer
+                MQTT_Destroy();
+
+                // Prevent the data model from making any other changes to the MTP thread
+                is_mqtt_mtp_thread_exited = true;
+
+                // Signal the data model thread that this thread has exited
+                DM_EXEC_PostMtpThreadExited(MQTT_EXITED);
+                return NULL;
+            }
+        }
+    }
+}
+#endif // ENABLE_MQTT
+
 /*********************************************************************//**
 **
 ** ProcessMtpWakeupQueueSocketActivity
 **
 ** Processes any activity on the message queue receiving socket
-** NOTE: There are separate sockets for STOMP and CoAP MTP tasks, but both use this function for processing
+** NOTE: There are separate sockets for STOMP, CoAP, WebSocket and MQTT MTP tasks, but all use this function for processing
 **
 ** \param   set - pointer to socket set structure containing sockets with activity on them
 ** \param   sock - socket on which the wakeup message is received
@@ -41,7 +41,7 @@
 #ifndef MTP_EXEC_H
 #define MTP_EXEC_H
 
-#include "vendor_defs.h"  // for ENABLE_COAP
+#include "vendor_defs.h"  // for ENABLE_COAP, ENABLE_WEBSOCKETS and ENABLE_MQTT
 
 //-----------------------------------------------------------------------------------------------
 // Enumeration of Device.LocalAgent.MTP.{i}.Status
@@ -61,6 +61,12 @@ typedef enum
 #ifdef ENABLE_COAP
     kMtpProtocol_CoAP,
 #endif
+#ifdef ENABLE_WEBSOCKETS
+    kMtpProtocol_WebSockets,
+#endif
+#ifdef ENABLE_MQTT
+    kMtpProtocol_MQTT,
+#endif
 
     // The following enumeration should always be the last - it is used to size arrays
     kMtpProtocol_Max
@@ -74,6 +80,22 @@ typedef enum
     kMtpContentType_Text,             // Plain text
 } mtp_content_type_t;
 
+//------------------------------------------------------------------------------
+// Enumeration of the classes of USP message, in order of decreasing priority, used to order the MTP send queues
+// Each class has its own queue, and the queues are drained in a weighted round robin (see mtp_send_queue.c),
+// so that time-critical messages are not held up behind a backlog of less important messages
+typedef enum
+{
+    kMtpSendPriority_Response,          // Responses (and errors) to controller requests
+    kMtpSendPriority_OperComplete,      // OperationComplete notifications
+    kMtpSendPriority_Event,             // Event (eg Boot!), ObjectCreation and ObjectDeletion notifications, and any other USP requests
+    kMtpSendPriority_ValueChange,       // ValueChange notifications
+    kMtpSendPriority_Periodic,          // Periodic! event notifications
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kMtpSendPriority_Max
+} mtp_send_priority_t;
+
 //------------------------------------------------------------------------------
 // Structure containing a count of causes of connectivity failures for a particular MTP (eg STOMP, HTTP)
 typedef struct
@@ -107,18 +129,29 @@ typedef enum
 extern scheduled_action_t mtp_exit_scheduled;
 extern bool is_coap_mtp_thread_exited;
 extern bool is_stomp_mtp_thread_exited;
+extern bool is_wsclient_mtp_thread_exited;
+extern bool is_mqtt_mtp_thread_exited;
 
 //------------------------------------------------------------------------------
 // API functions
 int MTP_EXEC_Init(void);
 void *MTP_EXEC_StompMain(void *args);
 void *MTP_EXEC_CoapMain(void *args);
-void MTP_EXEC_StompWakeup(void);
+void MTP_EXEC_StompWakeup(int stomp_thread);
+void MTP_EXEC_WakeupAll(void);
 void MTP_EXEC_ScheduleExit(void);
 void MTP_EXEC_ActivateScheduledActions(void);
 #ifdef ENABLE_COAP
 void MTP_EXEC_CoapWakeup(void);
 #endif
+#ifdef ENABLE_WEBSOCKETS
+void *MTP_EXEC_WsclientMain(void *args);
+void MTP_EXEC_WsclientWakeup(void);
+#endif
+#ifdef ENABLE_MQTT
+void *MTP_EXEC_MqttMain(void *args);
+void MTP_EXEC_MqttWakeup(void);
+#endif
 //------------------------------------------------------------------------------
 
 #endif
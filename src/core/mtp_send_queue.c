@@ -0,0 +1,323 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file mtp_send_queue.c
+ *
+ * Implements the priority classed send queues used by the MTPs
+ * Each MTP connection holds a separate queue of USP records for each class of USP message (see mtp_send_priority_t)
+ * The queues are drained using a weighted round robin: in each round, up to the weight of each class of USP records
+ * may be sent, with higher priority classes being served first. This ensures that time-critical messages
+ * (eg an OperationComplete notification) are not held up behind a backlog of less important messages
+ * (eg ValueChange notifications), without starving the lower priority classes
+ *
+ */
+#include "common_defs.h"
+#include "mtp_send_queue.h"
+
+//------------------------------------------------------------------------------
+// Number of USP records of each send priority which may be sent in each round of the weighted round robin
+static const int send_priority_weights[kMtpSendPriority_Max] =
+{
+    16,     // kMtpSendPriority_Response
+    8,      // kMtpSendPriority_OperComplete
+    4,      // kMtpSendPriority_Event
+    2,      // kMtpSendPriority_ValueChange
+    1,      // kMtpSendPriority_Periodic
+};
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_Init
+**
+** Initialises the specified send queue
+**
+** \param   sq - pointer to send queue to initialise
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_SEND_QUEUE_Init(mtp_send_queue_t *sq)
+{
+    int i;
+
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        DLLIST_Init(&sq->queues[i]);
+        sq->credits[i] = send_priority_weights[i];
+    }
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_Add
+**
+** Adds the specified item to the tail of the queue for the specified send priority
+**
+** \param   sq - pointer to send queue
+** \param   priority - send priority of the item
+** \param   item - pointer to item to add. NOTE: The item must contain the double_link_t structure at the start of itself
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_SEND_QUEUE_Add(mtp_send_queue_t *sq, mtp_send_priority_t priority, void *item)
+{
+    USP_ASSERT((priority >= 0) && (priority < kMtpSendPriority_Max));
+    DLLIST_LinkToTail(&sq->queues[priority], item);
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_Remove
+**
+** Removes the specified item from the queue for the specified send priority
+**
+** \param   sq - pointer to send queue
+** \param   priority - send priority of the item (ie the queue that the item was added to)
+** \param   item - pointer to item to remove
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_SEND_QUEUE_Remove(mtp_send_queue_t *sq, mtp_send_priority_t priority, void *item)
+{
+    USP_ASSERT((priority >= 0) && (priority < kMtpSendPriority_Max));
+    DLLIST_Unlink(&sq->queues[priority], item);
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_Pop
+**
+** Removes and returns the next item to send from the specified send queue, selecting the send priority using the weighted round robin
+**
+** \param   sq - pointer to send queue
+**
+** \return  pointer to item to send, or NULL if the send queue is empty
+**
+**************************************************************************/
+void *MTP_SEND_QUEUE_Pop(mtp_send_queue_t *sq)
+{
+    int i;
+    unsigned pending_mask;
+    mtp_send_priority_t priority;
+    double_link_t *item;
+
+    // Determine which send priorities have items queued
+    pending_mask = 0;
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        if (sq->queues[i].head != NULL)
+        {
+            pending_mask |= (1 << i);
+        }
+    }
+
+    // Exit if there are no items queued
+    priority = MTP_SEND_QUEUE_SelectPriority(sq->credits, pending_mask);
+    if (priority == kMtpSendPriority_Max)
+    {
+        return NULL;
+    }
+
+    item = sq->queues[priority].head;
+    DLLIST_Unlink(&sq->queues[priority], item);
+    return item;
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_IsEmpty
+**
+** Determines whether there are no items in any of the queues of the specified send queue
+**
+** \param   sq - pointer to send queue
+**
+** \return  true if the send queue is empty
+**
+**************************************************************************/
+bool MTP_SEND_QUEUE_IsEmpty(mtp_send_queue_t *sq)
+{
+    int i;
+
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        if (sq->queues[i].head != NULL)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_ChargeBudget
+**
+** Charges a USP record which is about to be queued on an MTP connection to the MTP send queue memory budget
+** ValueChange and Periodic! notifications are only queued if they fit within the budget, as they are the least important
+** and the most numerous. All other USP records are always queued, as dropping them would break the USP message exchange
+** NOTE: If successful, the caller must call MTP_SEND_QUEUE_ReleaseBudget() when the USP record is freed
+**
+** \param   priority - send priority of the USP record
+** \param   pbuf_len - length of the USP record
+**
+** \return  true if the USP record may be queued, false if it should be dropped
+**
+**************************************************************************/
+bool MTP_SEND_QUEUE_ChargeBudget(mtp_send_priority_t priority, int pbuf_len)
+{
+    if (priority >= kMtpSendPriority_ValueChange)
+    {
+        return USP_MEM_BudgetCharge(kMemBudget_MtpSendQueue, pbuf_len);
+    }
+
+    USP_MEM_BudgetForceCharge(kMemBudget_MtpSendQueue, pbuf_len);
+    return true;
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_ReleaseBudget
+**
+** Releases a USP record (which was charged using MTP_SEND_QUEUE_ChargeBudget) from the MTP send queue memory budget
+**
+** \param   pbuf_len - length of the USP record
+**
+** \return  None
+**
+**************************************************************************/
+void MTP_SEND_QUEUE_ReleaseBudget(int pbuf_len)
+{
+    USP_MEM_BudgetRelease(kMemBudget_MtpSendQueue, pbuf_len);
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_SelectPriority
+**
+** Selects the send priority of the next USP record to send, using the weighted round robin, and consumes a credit for it
+** The highest send priority which has USP records pending and credits remaining is selected.
+** If none of the send priorities with USP records pending have any credits remaining, then the round has finished,
+** and the credits of all send priorities are replenished
+** NOTE: This function is separate from MTP_SEND_QUEUE_Pop() so that it may be used by MTPs which hold all USP records in a single queue
+**
+** \param   credits - array (indexed by send priority) containing the number of credits remaining in the current round
+** \param   pending_mask - bitmask (indexed by send priority) of the send priorities which have USP records pending
+**
+** \return  send priority of the next USP record to send, or kMtpSendPriority_Max if no USP records are pending
+**
+**************************************************************************/
+mtp_send_priority_t MTP_SEND_QUEUE_SelectPriority(int *credits, unsigned pending_mask)
+{
+    int i;
+
+    // Exit if there are no USP records pending
+    if (pending_mask == 0)
+    {
+        return kMtpSendPriority_Max;
+    }
+
+    // Exit if a send priority with USP records pending still has credits remaining in this round
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        if ((pending_mask & (1 << i)) && (credits[i] > 0))
+        {
+            credits[i]--;
+            return i;
+        }
+    }
+
+    // Otherwise start a new round, replenishing the credits, and selecting the highest send priority with USP records pending
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        credits[i] = send_priority_weights[i];
+    }
+
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        if (pending_mask & (1 << i))
+        {
+            credits[i]--;
+            return i;
+        }
+    }
+
+    // The code should never get here, as pending_mask contains at least one send priority
+    TERMINATE_BAD_CASE(pending_mask);
+    return kMtpSendPriority_Max;
+}
+
+/*********************************************************************//**
+**
+** MTP_SEND_QUEUE_CalcPriority
+**
+** Determines the send priority of a USP message
+**
+** \param   usp_msg_type - type of the USP message
+** \param   notify_priority - send priority determined by the subscription code, if the USP message is a notification
+**                            NOTE: If this is not a valid notification priority, then the notification is sent with kMtpSendPriority_Event
+**
+** \return  send priority of the USP message
+**
+**************************************************************************/
+mtp_send_priority_t MTP_SEND_QUEUE_CalcPriority(Usp__Header__MsgType usp_msg_type, mtp_send_priority_t notify_priority)
+{
+    switch(usp_msg_type)
+    {
+        case USP__HEADER__MSG_TYPE__ERROR:
+        case USP__HEADER__MSG_TYPE__GET_RESP:
+        case USP__HEADER__MSG_TYPE__SET_RESP:
+        case USP__HEADER__MSG_TYPE__OPERATE_RESP:
+        case USP__HEADER__MSG_TYPE__ADD_RESP:
+        case USP__HEADER__MSG_TYPE__DELETE_RESP:
+        case USP__HEADER__MSG_TYPE__GET_SUPPORTED_DM_RESP:
+        case USP__HEADER__MSG_TYPE__GET_INSTANCES_RESP:
+        case USP__HEADER__MSG_TYPE__NOTIFY_RESP:
+        case USP__HEADER__MSG_TYPE__GET_SUPPORTED_PROTO_RESP:
+            return kMtpSendPriority_Response;
+
+        case USP__HEADER__MSG_TYPE__NOTIFY:
+            if ((notify_priority > kMtpSendPriority_Response) && (notify_priority < kMtpSendPriority_Max))
+            {
+                return notify_priority;
+            }
+            return kMtpSendPriority_Event;
+
+        default:
+            return kMtpSendPriority_Event;
+    }
+}
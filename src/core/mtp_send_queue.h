@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file mtp_send_queue.h
+ *
+ * Header file for API to the priority classed send queues used by the MTPs
+ *
+ */
+#ifndef MTP_SEND_QUEUE_H
+#define MTP_SEND_QUEUE_H
+
+#include "dllist.h"
+#include "mtp_exec.h"
+#include "usp-msg.pb-c.h"
+
+//------------------------------------------------------------------------------
+// Send queue of an MTP connection, consisting of one queue of USP records for each send priority
+typedef struct
+{
+    double_linked_list_t queues[kMtpSendPriority_Max]; // Queue of USP records for each send priority
+    int credits[kMtpSendPriority_Max];  // Number of USP records of each send priority that may be sent before the credits are replenished
+} mtp_send_queue_t;
+
+//------------------------------------------------------------------------------
+// API functions
+void MTP_SEND_QUEUE_Init(mtp_send_queue_t *sq);
+void MTP_SEND_QUEUE_Add(mtp_send_queue_t *sq, mtp_send_priority_t priority, void *item);
+void MTP_SEND_QUEUE_Remove(mtp_send_queue_t *sq, mtp_send_priority_t priority, void *item);
+void *MTP_SEND_QUEUE_Pop(mtp_send_queue_t *sq);
+bool MTP_SEND_QUEUE_IsEmpty(mtp_send_queue_t *sq);
+bool MTP_SEND_QUEUE_ChargeBudget(mtp_send_priority_t priority, int pbuf_len);
+void MTP_SEND_QUEUE_ReleaseBudget(int pbuf_len);
+mtp_send_priority_t MTP_SEND_QUEUE_SelectPriority(int *credits, unsigned pending_mask);
+mtp_send_priority_t MTP_SEND_QUEUE_CalcPriority(Usp__Header__MsgType usp_msg_type, mtp_send_priority_t notify_priority);
+
+#endif
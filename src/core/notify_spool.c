@@ -0,0 +1,1102 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file notify_spool.c
+ *
+ * Spools Notify USP records to flash, whilst the STOMP connection to the controller is down, or has a backlog of USP records to send
+ * Spooled records are replayed (in order) when the connection is up, and survive a reboot of the agent
+ *
+ * Each controller's spool consists of a sequence of fixed size segment files, which are mapped into memory.
+ * USP records are appended to the last segment, and replayed from the first segment. Records are marked as sent, once they
+ * have been replayed, and a segment file is deleted once all of its records have been sent.
+ * When the maximum number of segments is reached, the oldest segment (and all records it contains) is dropped
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common_defs.h"
+#include "device.h"
+#include "stomp.h"
+#include "sync_timer.h"
+#include "text_utils.h"
+#include "notify_spool.h"
+
+//------------------------------------------------------------------------------
+// Value stored at the start of each segment file, to identify it
+#define NOTIFY_SPOOL_MAGIC 0x4C4F5053       // "SPOL" in a little endian file
+
+//------------------------------------------------------------------------------
+// Suffix of the name of each segment file
+#define NOTIFY_SPOOL_FILE_SUFFIX ".spool"
+
+//------------------------------------------------------------------------------
+// Period (in seconds) at which spooled records are replayed, whilst any are pending
+#define NOTIFY_SPOOL_REPLAY_PERIOD 1
+
+//------------------------------------------------------------------------------
+// Rounds the specified length up to a multiple of 8 bytes
+#define SPOOL_ALIGN(x) (((x) + 7) & ~7)
+
+//------------------------------------------------------------------------------
+// Header at the start of each segment file
+typedef struct
+{
+    uint32_t magic;             // NOTIFY_SPOOL_MAGIC
+    uint32_t header_len;        // Length of this header, including the endpoint_id following it (rounded up to a multiple of 8 bytes)
+    uint32_t seq;               // Sequence number of this segment within the controller's spool
+    uint32_t reserved;
+    // Followed by the endpoint_id of the controller (NULL terminated)
+} spool_segment_hdr_t;
+
+//------------------------------------------------------------------------------
+// Header preceding each record (USP record) in a segment file
+typedef struct
+{
+    uint32_t len;               // Length of this record, including this header (rounded up to a multiple of 8 bytes). Zero marks the end of the written records
+    uint32_t state;             // Whether the record is still to be sent (see spool_record_state_t)
+    int64_t expiry_time;        // Time at which the USP record should no longer be sent
+    uint32_t msg_id_hash;       // Hash of the msg_id of the USP message, used to detect duplicates
+    uint32_t usp_record_len;    // Length of the serialized USP record
+    uint16_t msg_id_len;        // Length of the msg_id of the USP message (including NULL terminator)
+    uint16_t usp_msg_type;      // Type of USP message contained in the USP record
+    uint32_t send_priority;     // Priority with which the USP record is sent, relative to other USP messages queued in the MTP (see mtp_send_priority_t)
+    // Followed by the msg_id (NULL terminated), then the serialized USP record
+} spool_record_hdr_t;
+
+//------------------------------------------------------------------------------
+// State of each record in a segment file
+typedef enum
+{
+    kSpoolRecord_Pending = 1,   // Record has not been sent yet
+    kSpoolRecord_Sent,          // Record has been replayed (or dropped because it expired)
+} spool_record_state_t;
+
+//------------------------------------------------------------------------------
+// Segment file, mapped into memory
+typedef struct spool_segment_tag
+{
+    struct spool_segment_tag *next; // Next (newer) segment in the controller's spool
+    char *path;                 // Path of the segment file
+    unsigned seq;               // Sequence number of this segment within the controller's spool
+    int fd;                     // File descriptor of the segment file
+    unsigned char *base;        // Start of the segment file, mapped into memory
+    int size;                   // Size of the segment file
+    int read_offset;            // Offset of the first record which has not been sent (or write_offset, if all records have been sent)
+    int write_offset;           // Offset at which the next record will be written
+    int num_pending;            // Number of records in this segment which have not been sent
+} spool_segment_t;
+
+//------------------------------------------------------------------------------
+// Spool of records for a single controller
+typedef struct
+{
+    char *endpoint_id;          // Controller to send the spooled records to
+    spool_segment_t *head;      // Oldest segment. Records are replayed from here
+    spool_segment_t *tail;      // Newest segment. Records are appended here
+    int num_segments;
+    int num_pending;            // Number of records in all segments which have not been sent
+    unsigned next_seq;          // Sequence number to allocate to the next segment
+} notify_spool_t;
+
+//------------------------------------------------------------------------------
+// Vector of spools, one for each controller which has had records spooled
+static notify_spool_t *spools = NULL;
+static int num_spools = 0;
+
+//------------------------------------------------------------------------------
+// Counters, used to monitor the spools
+typedef struct
+{
+    unsigned num_spooled;       // Number of records written to the spools
+    unsigned num_duplicates;    // Number of records not written, because a record with the same msg_id was already pending (eg notification retries)
+    unsigned num_replayed;      // Number of records replayed to the MTP
+    unsigned num_expired;       // Number of records discarded when replayed, because they had expired
+    unsigned num_dropped;       // Number of records discarded, because the spool was full or the controller could not be sent to
+} notify_spool_stats_t;
+
+static notify_spool_stats_t spool_stats;
+
+//------------------------------------------------------------------------------
+// Set whilst a spooled record is being replayed, so that NOTIFY_SPOOL_Queue() does not spool it again
+// replay_blocked is set by NOTIFY_SPOOL_Queue() if the record could not be replayed, because the STOMP connection was not ready to send it
+static bool is_replaying = false;
+static bool replay_blocked = false;
+
+//------------------------------------------------------------------------------
+// Time at which spooled records are next replayed, or END_OF_TIME if there are no pending records
+static time_t next_replay_time = END_OF_TIME;
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+bool IsNotifySpoolEnabled(void);
+void NotifySpoolExec(int id);
+void ReplaySpool(notify_spool_t *spool);
+bool IsStompConnReady(int stomp_instance);
+notify_spool_t *FindSpool(char *endpoint_id);
+notify_spool_t *AddSpool(char *endpoint_id);
+bool IsMsgIdInSpool(notify_spool_t *spool, char *usp_msg_id, unsigned msg_id_hash);
+int AppendSpoolRecord(notify_spool_t *spool, Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, char *usp_msg_id, unsigned msg_id_hash, mtp_send_priority_t send_priority, time_t expiry_time);
+spool_segment_t *CreateSpoolSegment(notify_spool_t *spool);
+void LoadSpoolSegment(char *path);
+void InsertSpoolSegment(notify_spool_t *spool, spool_segment_t *seg);
+void RemoveHeadSpoolSegment(notify_spool_t *spool, bool is_dropped);
+void CloseSpoolSegment(spool_segment_t *seg);
+void AdvanceSpoolReadOffset(spool_segment_t *seg);
+void CalcSpoolFilePath(char *endpoint_id, unsigned seq, char *buf, int len);
+void ScheduleSpoolReplay(void);
+
+/*********************************************************************//**
+**
+** NOTIFY_SPOOL_Init
+**
+** Initialises this component, loading all records spooled before the agent was last stopped
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int NOTIFY_SPOOL_Init(void)
+{
+    DIR *dir;
+    struct dirent *entry;
+    int len;
+    int suffix_len;
+    char path[PATH_MAX];
+
+    memset(&spool_stats, 0, sizeof(spool_stats));
+    next_replay_time = END_OF_TIME;
+    SYNC_TIMER_Add(NotifySpoolExec, 0, next_replay_time);
+
+    // Exit if spooling is disabled
+    if (IsNotifySpoolEnabled() == false)
+    {
+        return USP_ERR_OK;
+    }
+
+    // Create the spool directory, if it does not already exist
+    if ((mkdir(NOTIFY_SPOOL_DIR, 0700) != 0) && (errno != EEXIST))
+    {
+        USP_ERR_ERRNO("mkdir", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to read the spool directory
+    dir = opendir(NOTIFY_SPOOL_DIR);
+    if (dir == NULL)
+    {
+        USP_ERR_ERRNO("opendir", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Load all segment files in the spool directory
+    suffix_len = sizeof(NOTIFY_SPOOL_FILE_SUFFIX)-1;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        len = strlen(entry->d_name);
+        if ((len > suffix_len) && (strcmp(&entry->d_name[len-suffix_len], NOTIFY_SPOOL_FILE_SUFFIX)==0))
+        {
+            USP_SNPRINTF(path, sizeof(path), "%s/%s", NOTIFY_SPOOL_DIR, entry->d_name);
+            LoadSpoolSegment(path);
+        }
+    }
+    closedir(dir);
+
+    // Start replaying any records that were loaded
+    ScheduleSpoolReplay();
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** NOTIFY_SPOOL_Destroy
+**
+** Frees all memory used by this component
+** NOTE: The segment files are left on flash, so that any pending records are replayed after the agent restarts
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void NOTIFY_SPOOL_Destroy(void)
+{
+    int i;
+    notify_spool_t *spool;
+    spool_segment_t *seg;
+    spool_segment_t *next;
+
+    for (i=0; i<num_spools; i++)
+    {
+        spool = &spools[i];
+        seg = spool->head;
+        while (seg != NULL)
+        {
+            next = seg->next;
+            CloseSpoolSegment(seg);
+            seg = next;
+        }
+        USP_FREE(spool->endpoint_id);
+    }
+
+    USP_SAFE_FREE(spools);
+    num_spools = 0;
+}
+
+/*********************************************************************//**
+**
+** NOTIFY_SPOOL_Queue
+**
+** Spools the specified Notify USP record, if it cannot be sent immediately on the STOMP connection to the controller
+** This is the case if the STOMP connection is down, or already has NOTIFY_SPOOL_MEMORY_THRESHOLD bytes of USP records queued
+** to send, or if earlier records for the controller are still spooled (so that the order of records is preserved)
+**
+** \param   endpoint_id - controller to send the USP record to
+** \param   stomp_instance - instance number of the STOMP connection in Device.STOMP.Connection.{i}, that the USP record will be sent on
+** \param   usp_msg_type - Type of USP message contained in pbuf
+** \param   pbuf - pointer to buffer containing the serialized USP record
+**                 NOTE: Ownership of this buffer passes to this function, if it returns true
+** \param   pbuf_len - length of buffer containing the serialized USP record
+** \param   usp_msg_id - pointer to string containing the msg_id of the serialized USP Message
+** \param   send_priority - priority with which the USP record is sent, relative to other USP messages queued in the MTP
+** \param   expiry_time - time at which the USP record should no longer be sent
+**
+** \return  true if the USP record has been spooled (or is already spooled), false if the USP record should be queued on the STOMP connection
+**
+**************************************************************************/
+bool NOTIFY_SPOOL_Queue(char *endpoint_id, int stomp_instance, Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, char *usp_msg_id, mtp_send_priority_t send_priority, time_t expiry_time)
+{
+    int err;
+    unsigned msg_id_hash;
+    notify_spool_t *spool;
+
+    // Exit if spooling is disabled
+    if (IsNotifySpoolEnabled() == false)
+    {
+        return false;
+    }
+
+    // If replaying a spooled record, then queue it on the STOMP connection, unless the connection is not ready for it
+    // In which case, the record remains in the spool, and is replayed later
+    if (is_replaying)
+    {
+        if (IsStompConnReady(stomp_instance))
+        {
+            return false;
+        }
+
+        replay_blocked = true;
+        USP_FREE(pbuf);
+        return true;
+    }
+
+    // Exit if the USP record can be sent immediately
+    spool = FindSpool(endpoint_id);
+    if (((spool == NULL) || (spool->num_pending == 0)) && (IsStompConnReady(stomp_instance)))
+    {
+        return false;
+    }
+
+    if (spool == NULL)
+    {
+        spool = AddSpool(endpoint_id);
+    }
+
+    // Exit if the USP record is already spooled. This situation could occur if a notification is being retried
+    msg_id_hash = (unsigned) TEXT_UTILS_CalcHash(usp_msg_id);
+    if (IsMsgIdInSpool(spool, usp_msg_id, msg_id_hash))
+    {
+        spool_stats.num_duplicates++;
+        USP_FREE(pbuf);
+        return true;
+    }
+
+    // Exit if unable to spool the USP record, falling back to queuing it on the STOMP connection
+    err = AppendSpoolRecord(spool, usp_msg_type, pbuf, pbuf_len, usp_msg_id, msg_id_hash, send_priority, expiry_time);
+    if (err != USP_ERR_OK)
+    {
+        return false;
+    }
+
+    spool_stats.num_spooled++;
+    USP_FREE(pbuf);
+    ScheduleSpoolReplay();
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** NOTIFY_SPOOL_Replay
+**
+** Replays pending spooled records to all controllers whose STOMP connection is ready to send them
+** This function is called periodically whilst there are pending records, and when a STOMP connection comes up
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void NOTIFY_SPOOL_Replay(void)
+{
+    int i;
+    notify_spool_t *spool;
+
+    for (i=0; i<num_spools; i++)
+    {
+        spool = &spools[i];
+        if (spool->num_pending > 0)
+        {
+            ReplaySpool(spool);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** NOTIFY_SPOOL_Dump
+**
+** Logs the counters and current occupancy of all spools
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void NOTIFY_SPOOL_Dump(void)
+{
+    int i;
+    notify_spool_t *spool;
+
+    // Exit if spooling is disabled
+    if (IsNotifySpoolEnabled() == false)
+    {
+        return;
+    }
+
+    for (i=0; i<num_spools; i++)
+    {
+        spool = &spools[i];
+        USP_DUMP("Notification spool for %s: %d pending records in %d segments (limit %d)", spool->endpoint_id, spool->num_pending, spool->num_segments, NOTIFY_SPOOL_MAX_SEGMENTS);
+    }
+
+    USP_DUMP("Notification spool counters: spooled=%u, duplicates=%u, replayed=%u, expired=%u, dropped=%u",
+             spool_stats.num_spooled, spool_stats.num_duplicates, spool_stats.num_replayed, spool_stats.num_expired, spool_stats.num_dropped);
+}
+
+/*********************************************************************//**
+**
+** IsNotifySpoolEnabled
+**
+** Determines whether spooling of Notify USP records has been enabled (by setting NOTIFY_SPOOL_DIR)
+**
+** \param   None
+**
+** \return  true if spooling is enabled
+**
+**************************************************************************/
+bool IsNotifySpoolEnabled(void)
+{
+    return (NOTIFY_SPOOL_DIR[0] != '\0') ? true : false;
+}
+
+/*********************************************************************//**
+**
+** NotifySpoolExec
+**
+** Called periodically, whilst there are pending spooled records, to replay them
+**
+** \param   id - (unused) identifier of the sync timer which caused this callback
+**
+** \return  None
+**
+**************************************************************************/
+void NotifySpoolExec(int id)
+{
+    int i;
+    time_t next_time;
+
+    NOTIFY_SPOOL_Replay();
+
+    // Restart the timer, if there are still pending records
+    next_time = END_OF_TIME;
+    for (i=0; i<num_spools; i++)
+    {
+        if (spools[i].num_pending > 0)
+        {
+            next_time = time(NULL) + NOTIFY_SPOOL_REPLAY_PERIOD;
+            break;
+        }
+    }
+
+    next_replay_time = next_time;
+    SYNC_TIMER_Reload(NotifySpoolExec, 0, next_replay_time);
+}
+
+/*********************************************************************//**
+**
+** ReplaySpool
+**
+** Replays pending records from the specified spool (oldest first), until the STOMP connection is not ready to send more,
+** or all records have been replayed
+**
+** \param   spool - pointer to spool to replay
+**
+** \return  None
+**
+**************************************************************************/
+void ReplaySpool(notify_spool_t *spool)
+{
+    int err;
+    time_t cur_time;
+    spool_segment_t *seg;
+    spool_record_hdr_t *rec;
+    unsigned char *buf;
+    char *msg_id;
+    mtp_reply_to_t mtp_reply_to = {0};  // Ensures mtp_reply_to.is_reply_to_specified=false
+
+    cur_time = time(NULL);
+    while (spool->num_pending > 0)
+    {
+        seg = spool->head;
+        USP_ASSERT((seg != NULL) && (seg->read_offset < seg->write_offset));
+        rec = (spool_record_hdr_t *) &seg->base[seg->read_offset];
+        USP_ASSERT(rec->state == kSpoolRecord_Pending);
+        msg_id = (char *) &rec[1];
+
+        if (cur_time >= rec->expiry_time)
+        {
+            // Discard the record, if it has expired
+            spool_stats.num_expired++;
+        }
+        else
+        {
+            // Queue a copy of the spooled USP record on the MTP
+            // NOTE: If successful, ownership of the copy passes to the MTP layer
+            buf = USP_MALLOC(rec->usp_record_len);
+            memcpy(buf, &msg_id[rec->msg_id_len], rec->usp_record_len);
+            is_replaying = true;
+            replay_blocked = false;
+            mtp_reply_to.send_priority = rec->send_priority;
+            err = DEVICE_CONTROLLER_QueueBinaryMessage(rec->usp_msg_type, spool->endpoint_id, buf, rec->usp_record_len, msg_id, &mtp_reply_to, (time_t)rec->expiry_time);
+            is_replaying = false;
+
+            if (err != USP_ERR_OK)
+            {
+                // Discard the record, if it cannot be sent to the controller (eg the controller has been disabled)
+                USP_LOG_Warning("%s: Dropping spooled NotifyRequest with msg_id=%s (%s)", __FUNCTION__, msg_id, USP_ERR_GetMessage());
+                USP_FREE(buf);
+                spool_stats.num_dropped++;
+            }
+            else if (replay_blocked)
+            {
+                // Exit, leaving the record in the spool, if the STOMP connection is not ready to send it
+                return;
+            }
+            else
+            {
+                spool_stats.num_replayed++;
+            }
+        }
+
+        // Mark the record as sent
+        rec->state = kSpoolRecord_Sent;
+        msync(seg->base, seg->size, MS_ASYNC);
+        seg->num_pending--;
+        spool->num_pending--;
+        AdvanceSpoolReadOffset(seg);
+
+        // Delete the segment file, once all of its records have been sent
+        if (seg->num_pending == 0)
+        {
+            RemoveHeadSpoolSegment(spool, false);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** IsStompConnReady
+**
+** Determines whether the specified STOMP connection is ready to queue a notification
+**
+** \param   stomp_instance - instance number of the STOMP connection in Device.STOMP.Connection.{i}
+**
+** \return  true if the STOMP connection is up, and has less than NOTIFY_SPOOL_MEMORY_THRESHOLD bytes of USP records queued to send
+**
+**************************************************************************/
+bool IsStompConnReady(int stomp_instance)
+{
+    if (STOMP_GetMtpStatus(stomp_instance) != kMtpStatus_Up)
+    {
+        return false;
+    }
+
+    return (STOMP_GetQueuedBytes(stomp_instance) < NOTIFY_SPOOL_MEMORY_THRESHOLD) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** FindSpool
+**
+** Finds the spool of the specified controller
+**
+** \param   endpoint_id - controller whose spool is to be found
+**
+** \return  pointer to spool, or NULL if the controller does not have a spool
+**
+**************************************************************************/
+notify_spool_t *FindSpool(char *endpoint_id)
+{
+    int i;
+
+    for (i=0; i<num_spools; i++)
+    {
+        if (strcmp(spools[i].endpoint_id, endpoint_id)==0)
+        {
+            return &spools[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** AddSpool
+**
+** Adds an empty spool for the specified controller
+**
+** \param   endpoint_id - controller to add a spool for
+**
+** \return  pointer to spool
+**
+**************************************************************************/
+notify_spool_t *AddSpool(char *endpoint_id)
+{
+    notify_spool_t *spool;
+
+    spools = USP_REALLOC(spools, (num_spools+1)*sizeof(notify_spool_t));
+    spool = &spools[num_spools];
+    num_spools++;
+
+    memset(spool, 0, sizeof(notify_spool_t));
+    spool->endpoint_id = USP_STRDUP(endpoint_id);
+
+    return spool;
+}
+
+/*********************************************************************//**
+**
+** IsMsgIdInSpool
+**
+** Determines whether a pending record with the specified msg_id is in the specified spool
+**
+** \param   spool - pointer to spool to search
+** \param   usp_msg_id - msg_id of the USP message to find
+** \param   msg_id_hash - hash of usp_msg_id
+**
+** \return  true if the msg_id was found
+**
+**************************************************************************/
+bool IsMsgIdInSpool(notify_spool_t *spool, char *usp_msg_id, unsigned msg_id_hash)
+{
+    int offset;
+    spool_segment_t *seg;
+    spool_record_hdr_t *rec;
+
+    for (seg = spool->head; seg != NULL; seg = seg->next)
+    {
+        for (offset = seg->read_offset; offset < seg->write_offset; offset += rec->len)
+        {
+            rec = (spool_record_hdr_t *) &seg->base[offset];
+            if ((rec->state == kSpoolRecord_Pending) && (rec->msg_id_hash == msg_id_hash) && (strcmp((char *)&rec[1], usp_msg_id)==0))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** AppendSpoolRecord
+**
+** Appends the specified USP record to the specified spool
+** If the spool is full, then the oldest segment of the spool is dropped to make room for it
+**
+** \param   spool - pointer to spool to append the USP record to
+** \param   usp_msg_type - Type of USP message contained in pbuf
+** \param   pbuf - pointer to buffer containing the serialized USP record
+** \param   pbuf_len - length of buffer containing the serialized USP record
+** \param   usp_msg_id - pointer to string containing the msg_id of the serialized USP Message
+** \param   msg_id_hash - hash of usp_msg_id
+** \param   send_priority - priority with which the USP record is sent, relative to other USP messages queued in the MTP
+** \param   expiry_time - time at which the USP record should no longer be sent
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int AppendSpoolRecord(notify_spool_t *spool, Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, char *usp_msg_id, unsigned msg_id_hash, mtp_send_priority_t send_priority, time_t expiry_time)
+{
+    int msg_id_len;
+    int len;
+    int max_len;
+    spool_segment_t *seg;
+    spool_record_hdr_t *rec;
+
+    // Exit if the record is too large to fit in a segment
+    msg_id_len = strlen(usp_msg_id) + 1;
+    len = SPOOL_ALIGN(sizeof(spool_record_hdr_t) + msg_id_len + pbuf_len);
+    max_len = NOTIFY_SPOOL_SEGMENT_SIZE - SPOOL_ALIGN(sizeof(spool_segment_hdr_t) + strlen(spool->endpoint_id) + 1);
+    if ((len > max_len) || (msg_id_len > UINT16_MAX))
+    {
+        USP_LOG_Warning("%s: NotifyRequest with msg_id=%s is too large to spool (%d bytes)", __FUNCTION__, usp_msg_id, len);
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    // Start a new segment, if the record does not fit in the last segment
+    seg = spool->tail;
+    if ((seg == NULL) || (seg->write_offset + len > seg->size))
+    {
+        // Drop the oldest segment, if the spool is full
+        if (spool->num_segments >= NOTIFY_SPOOL_MAX_SEGMENTS)
+        {
+            RemoveHeadSpoolSegment(spool, true);
+        }
+
+        // Exit if unable to create a new segment
+        seg = CreateSpoolSegment(spool);
+        if (seg == NULL)
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+    }
+
+    // Write the msg_id and USP record
+    rec = (spool_record_hdr_t *) &seg->base[seg->write_offset];
+    memcpy(&rec[1], usp_msg_id, msg_id_len);
+    memcpy(((unsigned char *)&rec[1]) + msg_id_len, pbuf, pbuf_len);
+
+    // Mark the end of the written records, if this record is not the last in the segment
+    // NOTE: This may be overwriting a partially written record, which was present when the segment was loaded
+    if (seg->write_offset + len + sizeof(uint32_t) <= seg->size)
+    {
+        *((uint32_t *) &seg->base[seg->write_offset + len]) = 0;
+    }
+
+    // Write the header of the record, writing the length last, so that a partially written record is ignored if the agent stops whilst writing it
+    rec->state = kSpoolRecord_Pending;
+    rec->expiry_time = expiry_time;
+    rec->msg_id_hash = msg_id_hash;
+    rec->usp_record_len = pbuf_len;
+    rec->msg_id_len = msg_id_len;
+    rec->usp_msg_type = usp_msg_type;
+    rec->send_priority = send_priority;
+    __atomic_store_n(&rec->len, len, __ATOMIC_RELEASE);
+    msync(seg->base, seg->size, MS_ASYNC);
+
+    seg->write_offset += len;
+    seg->num_pending++;
+    spool->num_pending++;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** CreateSpoolSegment
+**
+** Creates a new (empty) segment file at the end of the specified spool
+**
+** \param   spool - pointer to spool to add the segment to
+**
+** \return  pointer to new segment, or NULL if an error occurred
+**
+**************************************************************************/
+spool_segment_t *CreateSpoolSegment(notify_spool_t *spool)
+{
+    int fd;
+    unsigned char *base;
+    spool_segment_t *seg;
+    spool_segment_hdr_t *hdr;
+    int endpoint_len;
+    char path[PATH_MAX];
+
+    // Exit if unable to create the segment file
+    CalcSpoolFilePath(spool->endpoint_id, spool->next_seq, path, sizeof(path));
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+    {
+        USP_ERR_ERRNO("open", errno);
+        return NULL;
+    }
+
+    // Exit if unable to size the segment file (the file is zero filled, so the first record's length marks the end of the written records)
+    if (ftruncate(fd, NOTIFY_SPOOL_SEGMENT_SIZE) != 0)
+    {
+        USP_ERR_ERRNO("ftruncate", errno);
+        goto error;
+    }
+
+    // Exit if unable to map the segment file into memory
+    base = mmap(NULL, NOTIFY_SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        USP_ERR_ERRNO("mmap", errno);
+        goto error;
+    }
+
+    // Write the segment header
+    endpoint_len = strlen(spool->endpoint_id) + 1;
+    hdr = (spool_segment_hdr_t *) base;
+    hdr->magic = NOTIFY_SPOOL_MAGIC;
+    hdr->header_len = SPOOL_ALIGN(sizeof(spool_segment_hdr_t) + endpoint_len);
+    hdr->seq = spool->next_seq;
+    memcpy(&hdr[1], spool->endpoint_id, endpoint_len);
+
+    // Add the segment to the end of the spool
+    seg = USP_MALLOC(sizeof(spool_segment_t));
+    memset(seg, 0, sizeof(spool_segment_t));
+    seg->path = USP_STRDUP(path);
+    seg->seq = spool->next_seq;
+    seg->fd = fd;
+    seg->base = base;
+    seg->size = NOTIFY_SPOOL_SEGMENT_SIZE;
+    seg->read_offset = hdr->header_len;
+    seg->write_offset = hdr->header_len;
+    InsertSpoolSegment(spool, seg);
+
+    return seg;
+
+error:
+    close(fd);
+    unlink(path);
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** LoadSpoolSegment
+**
+** Loads the specified segment file (written before the agent was last stopped), adding it to the spool of its controller
+** Segment files which are invalid, or contain no pending records, are deleted
+**
+** \param   path - path of the segment file to load
+**
+** \return  None
+**
+**************************************************************************/
+void LoadSpoolSegment(char *path)
+{
+    int fd;
+    struct stat st;
+    unsigned char *base = MAP_FAILED;
+    spool_segment_hdr_t *hdr;
+    spool_record_hdr_t *rec;
+    spool_segment_t *seg;
+    notify_spool_t *spool;
+    char *endpoint_id;
+    int offset;
+    int num_pending;
+
+    // Exit if unable to open the segment file
+    fd = open(path, O_RDWR);
+    if (fd == -1)
+    {
+        USP_LOG_Warning("%s: Unable to open %s (%s)", __FUNCTION__, path, strerror(errno));
+        return;
+    }
+
+    // Exit if the segment file is not valid
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(spool_segment_hdr_t)) || (st.st_size > INT32_MAX))
+    {
+        goto invalid;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        goto invalid;
+    }
+
+    hdr = (spool_segment_hdr_t *) base;
+    endpoint_id = (char *) &hdr[1];
+    if ((hdr->magic != NOTIFY_SPOOL_MAGIC) || (hdr->header_len > st.st_size) ||
+        (memchr(endpoint_id, '\0', hdr->header_len - sizeof(spool_segment_hdr_t)) == NULL))
+    {
+        goto invalid;
+    }
+
+    // Find the end of the written records, counting those that are pending
+    // NOTE: Any records following an invalid record are ignored (they will be overwritten by new records)
+    num_pending = 0;
+    offset = hdr->header_len;
+    while (offset + (int)sizeof(spool_record_hdr_t) <= st.st_size)
+    {
+        rec = (spool_record_hdr_t *) &base[offset];
+        if ((rec->len < sizeof(spool_record_hdr_t)) || (offset + rec->len > st.st_size) ||
+            (sizeof(spool_record_hdr_t) + rec->msg_id_len + rec->usp_record_len > rec->len) ||
+            (rec->msg_id_len == 0) || (((char *)&rec[1])[rec->msg_id_len-1] != '\0'))
+        {
+            break;
+        }
+
+        if (rec->state == kSpoolRecord_Pending)
+        {
+            num_pending++;
+        }
+        offset += rec->len;
+    }
+
+    // Exit if the segment file contains no pending records
+    if (num_pending == 0)
+    {
+        goto invalid;
+    }
+
+    // Add the segment to the spool of its controller
+    spool = FindSpool(endpoint_id);
+    if (spool == NULL)
+    {
+        spool = AddSpool(endpoint_id);
+    }
+
+    seg = USP_MALLOC(sizeof(spool_segment_t));
+    memset(seg, 0, sizeof(spool_segment_t));
+    seg->path = USP_STRDUP(path);
+    seg->seq = hdr->seq;
+    seg->fd = fd;
+    seg->base = base;
+    seg->size = st.st_size;
+    seg->read_offset = hdr->header_len;
+    seg->write_offset = offset;
+    seg->num_pending = num_pending;
+    AdvanceSpoolReadOffset(seg);
+    InsertSpoolSegment(spool, seg);
+    spool->num_pending += num_pending;
+    return;
+
+invalid:
+    if (base != MAP_FAILED)
+    {
+        munmap(base, st.st_size);
+    }
+    close(fd);
+    unlink(path);
+}
+
+/*********************************************************************//**
+**
+** InsertSpoolSegment
+**
+** Inserts the specified segment into the specified spool, in order of sequence number
+**
+** \param   spool - pointer to spool to add the segment to
+** \param   seg - pointer to segment to add
+**
+** \return  None
+**
+**************************************************************************/
+void InsertSpoolSegment(notify_spool_t *spool, spool_segment_t *seg)
+{
+    spool_segment_t **p;
+
+    // Find the position to insert the segment at (segments are normally added at the end of the spool)
+    p = &spool->head;
+    while ((*p != NULL) && ((*p)->seq < seg->seq))
+    {
+        p = &(*p)->next;
+    }
+
+    seg->next = *p;
+    *p = seg;
+    if (seg->next == NULL)
+    {
+        spool->tail = seg;
+    }
+
+    spool->num_segments++;
+    if (seg->seq >= spool->next_seq)
+    {
+        spool->next_seq = seg->seq + 1;
+    }
+}
+
+/*********************************************************************//**
+**
+** RemoveHeadSpoolSegment
+**
+** Removes the oldest segment from the specified spool, deleting its segment file
+**
+** \param   spool - pointer to spool to remove the oldest segment from
+** \param   is_dropped - set if the segment's pending records are being dropped because the spool is full
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveHeadSpoolSegment(notify_spool_t *spool, bool is_dropped)
+{
+    spool_segment_t *seg;
+
+    seg = spool->head;
+    USP_ASSERT(seg != NULL);
+
+    if ((is_dropped) && (seg->num_pending > 0))
+    {
+        USP_LOG_Warning("%s: Dropping %d spooled NotifyRequests for %s (spool full)", __FUNCTION__, seg->num_pending, spool->endpoint_id);
+        spool_stats.num_dropped += seg->num_pending;
+    }
+    spool->num_pending -= seg->num_pending;
+
+    spool->head = seg->next;
+    if (spool->head == NULL)
+    {
+        spool->tail = NULL;
+    }
+    spool->num_segments--;
+
+    unlink(seg->path);
+    CloseSpoolSegment(seg);
+}
+
+/*********************************************************************//**
+**
+** CloseSpoolSegment
+**
+** Unmaps and closes the specified segment file, and frees the segment
+**
+** \param   seg - pointer to segment to close
+**
+** \return  None
+**
+**************************************************************************/
+void CloseSpoolSegment(spool_segment_t *seg)
+{
+    munmap(seg->base, seg->size);
+    close(seg->fd);
+    USP_FREE(seg->path);
+    USP_FREE(seg);
+}
+
+/*********************************************************************//**
+**
+** AdvanceSpoolReadOffset
+**
+** Moves the read offset of the specified segment past all records which have been sent
+**
+** \param   seg - pointer to segment
+**
+** \return  None
+**
+**************************************************************************/
+void AdvanceSpoolReadOffset(spool_segment_t *seg)
+{
+    spool_record_hdr_t *rec;
+
+    while (seg->read_offset < seg->write_offset)
+    {
+        rec = (spool_record_hdr_t *) &seg->base[seg->read_offset];
+        if (rec->state == kSpoolRecord_Pending)
+        {
+            break;
+        }
+        seg->read_offset += rec->len;
+    }
+}
+
+/*********************************************************************//**
+**
+** CalcSpoolFilePath
+**
+** Calculates the path of the specified segment file of the specified controller's spool
+** The file name is formed from the controller's endpoint_id (with characters which are not alphanumeric replaced),
+** the hash of the endpoint_id (to distinguish endpoint_ids which differ only in replaced characters) and the sequence number
+**
+** \param   endpoint_id - controller whose spool contains the segment
+** \param   seq - sequence number of the segment
+** \param   buf - pointer to buffer in which to return the path
+** \param   len - length of buffer
+**
+** \return  None
+**
+**************************************************************************/
+void CalcSpoolFilePath(char *endpoint_id, unsigned seq, char *buf, int len)
+{
+    int i;
+    char name[65];
+
+    for (i=0; (endpoint_id[i] != '\0') && (i < (int)sizeof(name)-1); i++)
+    {
+        name[i] = IS_ALPHA_NUMERIC(endpoint_id[i]) ? endpoint_id[i] : '_';
+    }
+    name[i] = '\0';
+
+    USP_SNPRINTF(buf, len, "%s/%s-%08x.%08u%s", NOTIFY_SPOOL_DIR, name, (unsigned) TEXT_UTILS_CalcHash(endpoint_id), seq, NOTIFY_SPOOL_FILE_SUFFIX);
+}
+
+/*********************************************************************//**
+**
+** ScheduleSpoolReplay
+**
+** Starts the timer which replays spooled records, if it is not already running
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void ScheduleSpoolReplay(void)
+{
+    if (next_replay_time == END_OF_TIME)
+    {
+        next_replay_time = time(NULL) + NOTIFY_SPOOL_REPLAY_PERIOD;
+        SYNC_TIMER_Reload(NotifySpoolExec, 0, next_replay_time);
+    }
+}
@@ -50,6 +50,12 @@
 #include <ctype.h>
 #include <ifaddrs.h>
 #include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
 
 #include "common_defs.h"
 #include "nu_ipaddr.h"
@@ -949,6 +955,107 @@ exit:
     return result;
 }
 
+/*********************************************************************//**
+**
+** nu_ipaddr_open_addr_change_socket
+**
+** Opens a rtnetlink socket which receives a notification whenever an IPv4 or IPv6 address is added to or removed from
+** any network interface. This allows callers to detect IP address changes without polling nu_ipaddr_has_interface_addr_changed()
+**
+** \param   None
+**
+** \return  socket fd, or INVALID if address change notifications are not available (in which case the caller should poll)
+**
+**************************************************************************/
+int nu_ipaddr_open_addr_change_socket(void)
+{
+#ifdef __linux__
+    int sock;
+    int err;
+    struct sockaddr_nl addr;
+
+    // Exit if unable to create the socket
+    // NOTE: The socket is non-blocking, so that nu_ipaddr_read_addr_change_socket() can drain all pending notifications
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock == -1)
+    {
+        USP_LOG_Warning("%s: Unable to create netlink socket (%s). Polling for IP address changes instead", __FUNCTION__, strerror(errno));
+        return INVALID;
+    }
+
+    // Exit if unable to subscribe to IPv4 and IPv6 address change notifications
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    err = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+    if (err == -1)
+    {
+        USP_LOG_Warning("%s: Unable to bind netlink socket (%s). Polling for IP address changes instead", __FUNCTION__, strerror(errno));
+        close(sock);
+        return INVALID;
+    }
+
+    return sock;
+#else
+    return INVALID;
+#endif
+}
+
+/*********************************************************************//**
+**
+** nu_ipaddr_read_addr_change_socket
+**
+** Reads all pending notifications from a socket opened by nu_ipaddr_open_addr_change_socket()
+**
+** \param   sock - socket to read notifications from
+**
+** \return  true if an IP address has been added or removed (or some notifications were lost), false otherwise
+**
+**************************************************************************/
+bool nu_ipaddr_read_addr_change_socket(int sock)
+{
+#ifdef __linux__
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct nlmsghdr))));
+    struct nlmsghdr *nlh;
+    int len;
+    bool has_changed = false;
+
+    while (FOREVER)
+    {
+        // Exit loop if no more notifications are pending
+        len = recv(sock, buf, sizeof(buf), 0);
+        if (len == -1)
+        {
+            // If the socket's receive buffer overflowed, then notifications have been lost, so assume that an address has changed
+            if (errno == ENOBUFS)
+            {
+                has_changed = true;
+                continue;
+            }
+            break;
+        }
+
+        if (len == 0)
+        {
+            break;
+        }
+
+        // Determine whether the notifications indicate that an IP address was added or removed
+        for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+        {
+            if ((nlh->nlmsg_type == RTM_NEWADDR) || (nlh->nlmsg_type == RTM_DELADDR))
+            {
+                has_changed = true;
+            }
+        }
+    }
+
+    return has_changed;
+#else
+    return false;
+#endif
+}
+
 /*********************************************************************//**
 **
 **  nu_ipaddr_get_ip_supported_families
@@ -1123,23 +1230,10 @@ tw_ulib_diags_lookup_host(const char *host, int acs_family_pref, bool prefer_ipv
     struct addrinfo *addr_list;
     struct addrinfo *iterator;
     struct addrinfo hints;
-    int preferred_family;
-    bool found_a_result = false;
-    int family = AF_INET;
+    nu_ipaddr_t addrs[NU_MAX_HOST_ADDRS];
+    int num_addrs = 0;
     struct sockaddr_in *a;
     struct sockaddr_in6 *a6;
-    bool ipv4_supported;
-    bool ipv6_supported;
-
-    // Determine whether to prefer IPv4 or IPv6 addresses on dual stack CPEs (if we have a choice)
-    if (prefer_ipv6)
-    {
-        preferred_family = AF_INET6;
-    }
-    else
-    {
-        preferred_family = AF_INET;
-    }
 
     // Update ACS preference based on ACS specified local interface IP address (which may be more specific)
     if ((acs_ipaddr_to_bind_to != NULL) && (nu_ipaddr_is_zero(acs_ipaddr_to_bind_to) == false))
@@ -1151,15 +1245,6 @@ tw_ulib_diags_lookup_host(const char *host, int acs_family_pref, bool prefer_ipv
         }
     }
 
-    // Exit if unable to determine which address families are supported by the device
-    // NOTE: In theory, setting getaddrinfo hints to AI_ADDRCONFIG, should filter by supported address family
-    // However, unfortunately that flag does not take into account whether the address is globally routable (for IPv6) as well
-    err = nu_ipaddr_get_ip_supported_families(&ipv4_supported, &ipv6_supported);
-    if (err != USP_ERR_OK)
-    {
-        return err;
-    }
-
     // Initialise the hints to use, when obtaining the IP address of the specified host using getaddrinfo()
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = acs_family_pref; // Only get DNS records of the address family that the ACS prefers
@@ -1172,79 +1257,192 @@ tw_ulib_diags_lookup_host(const char *host, int acs_family_pref, bool prefer_ipv
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Iterate over all results in the linked list, exiting the loop if we have found the preference
-    for (iterator=addr_list;   iterator!=NULL;   iterator=iterator->ai_next)
+    // Convert the results in the linked list into an array of IP addresses, skipping unexpected address families
+    for (iterator=addr_list; (iterator!=NULL) && (num_addrs < NUM_ELEM(addrs)); iterator=iterator->ai_next)
     {
         switch (iterator->ai_family)
         {
             case AF_INET:
-                if (ipv4_supported)
-                {
-                    a = (struct sockaddr_in *) iterator->ai_addr;
-                    err = nu_ipaddr_from_inaddr(&a->sin_addr, dst);
-    
-                    if (err != USP_ERR_OK)
-                    {
-                        USP_ERR_SetMessage("%s(%s): nu_ipaddr_from_inaddr() failed: %s", __FUNCTION__, host, strerror(err));
-                    }
-                    else
-                    {
-                        family = AF_INET;
-                        found_a_result = true;
-                    }
-                }
+                a = (struct sockaddr_in *) iterator->ai_addr;
+                err = nu_ipaddr_from_inaddr(&a->sin_addr, &addrs[num_addrs]);
                 break;
-        
+
             case AF_INET6:
-                if (ipv6_supported)
-                {
-                    a6 = (struct sockaddr_in6 *) iterator->ai_addr;
-                    err = nu_ipaddr_from_in6addr(&a6->sin6_addr, dst);
-    
-                    if (err != USP_ERR_OK)
-                    {
-                        USP_ERR_SetMessage("%s(%s): nu_ipaddr_from_in6addr() failed: %s", __FUNCTION__, host, strerror(err));
-                    }
-                    else
-                    {
-                        family = AF_INET6;
-                        found_a_result = true;
-                    }
-                }
+                a6 = (struct sockaddr_in6 *) iterator->ai_addr;
+                err = nu_ipaddr_from_in6addr(&a6->sin6_addr, &addrs[num_addrs]);
                 break;
 
             default:
-                // Unexpected address family - Skip it
-                continue;
+                err = USP_ERR_INTERNAL_ERROR;
                 break;
         }
 
-        // Exit the loop if we have a result which matches what the ACS prefers
-        if (acs_family_pref != AF_UNSPEC)
+        if (err == USP_ERR_OK)
         {
-            break;
+            num_addrs++;
+        }
+    }
+    (void) freeaddrinfo(addr_list);
+
+    // Choose the IP address to use from the results
+    err = nu_ipaddr_select_host_addr(host, addrs, num_addrs, acs_family_pref, prefer_ipv6, acs_ipaddr_to_bind_to, dst);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+**  nu_ipaddr_select_host_addr
+**
+**  Chooses which of the IP addresses of a host (eg obtained from a DNS lookup) to use when contacting it
+**  This is the first of the addresses ordered by nu_ipaddr_order_host_addrs()
+**
+** \param   host - pointer to string containing hostname that the IP addresses are of (used for debug only)
+** \param   addrs - array of IP addresses of the host, in the order returned by the DNS lookup
+** \param   num_addrs - number of IP addresses in the array
+** \param   acs_family_pref - The address family that the ACS requires for the Hostname resolution (AF_UNSPEC = don't care)
+** \param   prefer_ipv6 - Set to true if we prefer an IPv6 address (and CPE is dual stack, so we have a choice)
+** \param   acs_ipaddr_to_bind_to - IP address that the ACS has specified that should be used to contact the remote host (don't care = NULL or the zero address)
+** \param   dst - pointer to structure in which to return the chosen IP address of the remote host
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int nu_ipaddr_select_host_addr(const char *host, const nu_ipaddr_t *addrs, int num_addrs, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *dst)
+{
+    int err;
+    nu_ipaddr_t ordered[NU_MAX_HOST_ADDRS];
+    int num_ordered;
+
+    err = nu_ipaddr_order_host_addrs(host, addrs, num_addrs, acs_family_pref, prefer_ipv6, acs_ipaddr_to_bind_to, ordered, &num_ordered);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    memcpy(dst, &ordered[0], sizeof(nu_ipaddr_t));
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+**  nu_ipaddr_order_host_addrs
+**
+**  Orders the IP addresses of a host (eg obtained from a DNS lookup) in the order in which they should be tried when contacting it
+**  Addresses are only included if they are allowed by the following :-
+**          1) Which globally routable IP addresses the device has
+**          2) The address family that the ACS requires (acs_family_pref)
+**          3) The local interface IP address that the ACS requires (this may be more specific than the ACS address family
+               in the case of address family=ANY, but CPE only has IPv4 or IPv6 address on the ACS specified interface)
+**  The included addresses are then ordered by interleaving the address families (as described in RFC 8305 section 4),
+**  starting with our dual stack preference, and otherwise keeping the order returned by the DNS lookup
+**
+** \param   host - pointer to string containing hostname that the IP addresses are of (used for debug only)
+** \param   addrs - array of IP addresses of the host, in the order returned by the DNS lookup
+** \param   num_addrs - number of IP addresses in the array. Only the first NU_MAX_HOST_ADDRS addresses are considered
+** \param   acs_family_pref - The address family that the ACS requires for the Hostname resolution (AF_UNSPEC = don't care)
+** \param   prefer_ipv6 - Set to true if we prefer an IPv6 address (and CPE is dual stack, so we have a choice)
+** \param   acs_ipaddr_to_bind_to - IP address that the ACS has specified that should be used to contact the remote host (don't care = NULL or the zero address)
+** \param   ordered - pointer to array (of at least NU_MAX_HOST_ADDRS entries) in which to return the ordered IP addresses
+** \param   num_ordered - pointer to variable in which to return the number of IP addresses in the ordered array
+**
+** \return  USP_ERR_OK if successful (in which case there is at least one ordered address)
+**
+**************************************************************************/
+int nu_ipaddr_order_host_addrs(const char *host, const nu_ipaddr_t *addrs, int num_addrs, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *ordered, int *num_ordered)
+{
+    int i;
+    int err;
+    sa_family_t family;
+    sa_family_t preferred_family;
+    bool ipv4_supported;
+    bool ipv6_supported;
+    const nu_ipaddr_t *preferred[NU_MAX_HOST_ADDRS];
+    const nu_ipaddr_t *other[NU_MAX_HOST_ADDRS];
+    int num_preferred = 0;
+    int num_other = 0;
+    int p, o;
+
+    *num_ordered = 0;
+
+    // Determine whether to prefer IPv4 or IPv6 addresses on dual stack CPEs (if we have a choice)
+    preferred_family = (prefer_ipv6) ? AF_INET6 : AF_INET;
+
+    // Update ACS preference based on ACS specified local interface IP address (which may be more specific)
+    if ((acs_ipaddr_to_bind_to != NULL) && (nu_ipaddr_is_zero(acs_ipaddr_to_bind_to) == false))
+    {
+        err = nu_ipaddr_get_family(acs_ipaddr_to_bind_to, &family);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+        acs_family_pref = family;
+    }
+
+    // Exit if unable to determine which address families are supported by the device
+    // NOTE: In theory, setting getaddrinfo hints to AI_ADDRCONFIG, should filter by supported address family
+    // However, unfortunately that flag does not take into account whether the address is globally routable (for IPv6) as well
+    err = nu_ipaddr_get_ip_supported_families(&ipv4_supported, &ipv6_supported);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Split the allowed addresses into those of the preferred address family and those of the other address family
+    num_addrs = MIN(num_addrs, NU_MAX_HOST_ADDRS);
+    for (i=0; i<num_addrs; i++)
+    {
+        // Skip addresses which are not of the address family that the ACS requires
+        err = nu_ipaddr_get_family(&addrs[i], &family);
+        if ((err != USP_ERR_OK) || ((acs_family_pref != AF_UNSPEC) && (family != acs_family_pref)))
+        {
+            continue;
+        }
+
+        // Skip addresses of an address family that the device does not support
+        if (((family == AF_INET) && (ipv4_supported == false)) ||
+            ((family == AF_INET6) && (ipv6_supported == false)) ||
+            ((family != AF_INET) && (family != AF_INET6)))
+        {
+            continue;
         }
 
-        // If the code gets here, then the ACS doesn't care if we perform the diagnostic over IPv4 or IPv6
-        // In this case, we will use the dual stack preference to determine which we prefer
-        // Exit loop if we have found our preference
         if (family == preferred_family)
         {
-            break;
+            preferred[num_preferred++] = &addrs[i];
+        }
+        else
+        {
+            other[num_other++] = &addrs[i];
         }
     }
 
-    // Exit if no result was found (note if there is no result, we would normally expect the call to getaddrinfo() to fail)
-    if (found_a_result==false)
+    // Exit if no result was found
+    if ((num_preferred == 0) && (num_other == 0))
     {
         USP_ERR_SetMessage("%s(%s): failed to resolve", __FUNCTION__, host);
-        err = USP_ERR_INTERNAL_ERROR;
-        goto exit;
+        return USP_ERR_INTERNAL_ERROR;
     }
-    
-exit:
-    (void) freeaddrinfo(addr_list);
-    return err;
+
+    // Interleave the address families, starting with the preferred address family
+    p = 0;
+    o = 0;
+    while ((p < num_preferred) || (o < num_other))
+    {
+        if (p < num_preferred)
+        {
+            memcpy(&ordered[*num_ordered], preferred[p++], sizeof(nu_ipaddr_t));
+            (*num_ordered)++;
+        }
+
+        if (o < num_other)
+        {
+            memcpy(&ordered[*num_ordered], other[o++], sizeof(nu_ipaddr_t));
+            (*num_ordered)++;
+        }
+    }
+
+    return USP_ERR_OK;
 }
 
 #ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
@@ -59,6 +59,8 @@ typedef struct in6_addr nu_ipaddr_t;
 typedef struct in_addr nu_ipaddr_t;
 #endif /* !IPV6_NUIPADDR */
 
+#define NU_MAX_HOST_ADDRS 8  /* maximum number of IP addresses of a host considered when choosing which one to contact */
+
 #if BYTE_ORDER == BIG_ENDIAN
 #define IP4NETADDR_PRINTF_FMT(_addr)					\
 	(unsigned int)(((_addr) >> 24) & 0xff),				\
@@ -95,11 +97,15 @@ int nu_ipaddr_get_interface_addr_from_dest_addr(nu_ipaddr_t *dest, nu_ipaddr_t *
 int nu_ipaddr_get_interface_addr_from_sock_fd(int sock_fd, char *buf, int bufsiz);
 int nu_ipaddr_get_interface_name_from_src_addr(char *src_addr, char *name, int name_len);
 int nu_ipaddr_has_interface_addr_changed(char *dev, char *expected_addr, bool *has_addr);
+int nu_ipaddr_open_addr_change_socket(void);
+bool nu_ipaddr_read_addr_change_socket(int sock);
 int nu_ipaddr_get_ip_supported_families(bool *ipv4_supported, bool *ipv6_supported);
 bool nu_ipaddr_is_valid_interface(const char *dev);
 char *tw_ulib_diags_family_to_protocol_version(int address_family);
 
 int tw_ulib_diags_lookup_host(const char *host, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *dst);
+int nu_ipaddr_select_host_addr(const char *host, const nu_ipaddr_t *addrs, int num_addrs, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *dst);
+int nu_ipaddr_order_host_addrs(const char *host, const nu_ipaddr_t *addrs, int num_addrs, int acs_family_pref, bool prefer_ipv6, nu_ipaddr_t *acs_ipaddr_to_bind_to, nu_ipaddr_t *ordered, int *num_ordered);
 int tw_ulib_get_dev_ipaddr(const char *dev, char *addr, size_t asiz, bool prefer_ipv6);
 
 #ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
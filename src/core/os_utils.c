@@ -40,16 +40,90 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "common_defs.h"
+#include "os_utils.h"
+#include "kv_vector.h"
+#include "text_utils.h"
+
+//-------------------------------------------------------------------------
+// Scheduling configuration of each class of thread (see OS_UTILS_SetThreadConfig)
+typedef struct
+{
+    bool is_cpus_set;           // Set if the CPU affinity of the threads is configured. If not set, threads inherit the affinity of the thread which created them
+    cpu_set_t cpus;             // CPUs that the threads may run on
+    bool is_policy_set;         // Set if the scheduling policy of the threads is configured. If not set, threads inherit the policy of the thread which created them
+    int policy;                 // Scheduling policy of the threads (eg SCHED_FIFO)
+    int priority;               // Static scheduling priority of the threads (only used by the SCHED_FIFO and SCHED_RR policies)
+    bool is_nice_set;           // Set if the nice value of the threads is configured
+    int nice;                   // Nice value of the threads (only used by the SCHED_OTHER and SCHED_BATCH policies)
+    size_t stack_size;          // Size (in bytes) of the stack of the threads, or 0 to use the default stack size for the class
+} thread_config_t;
+
+static thread_config_t thread_configs[kThreadClass_Max];
+
+// Names of the classes of thread used in the configuration string, and their default stack sizes
+typedef struct
+{
+    char *name;
+    size_t default_stack_size;
+} thread_class_info_t;
+
+static const thread_class_info_t thread_class_info[kThreadClass_Max] =
+{
+    { "dm",        0 },                             // kThreadClass_DataModel
+    { "mtp",       0 },                             // kThreadClass_Mtp
+    { "bdc",       0 },                             // kThreadClass_Bdc
+    { "getworker", 0 },                             // kThreadClass_GetWorker
+    { "task",      TASK_POOL_THREAD_STACK_SIZE },   // kThreadClass_Task
+    { "log",       0 },                             // kThreadClass_Log
+};
+
+// Name used in the configuration string to apply settings to all classes of thread
+#define ALL_THREAD_CLASSES  "all"
+
+// Names of the scheduling policies used in the configuration string
+static const enum_entry_t sched_policies[] =
+{
+    { SCHED_OTHER, "other" },
+    { SCHED_BATCH, "batch" },
+    { SCHED_IDLE,  "idle" },
+    { SCHED_FIFO,  "fifo" },
+    { SCHED_RR,    "rr" },
+};
+
+// Arguments passed to the start routine of a thread created by OS_UTILS_CreateClassThread()
+typedef struct
+{
+    void *(* start_routine)(void *);
+    void *args;
+    thread_class_t thread_class;
+} class_thread_args_t;
 
 //-------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void *ClassThreadMain(void *param);
+int ParseThreadConfigEntry(char *entry);
+int ParseThreadConfigSetting(thread_config_t *tc, char *key, char *value);
+void ApplyThreadConfigSetting(thread_config_t *dest, thread_config_t *src, char *key);
 
 //------------------------------------------------------------------------
 // Handle used to verify that all USP API functions are called only from the USP Core thread (and not a vendor thread)
 pthread_t usp_core_thread;
 
+//------------------------------------------------------------------------
+// Set if this thread is a Get worker thread, which accesses the data model on behalf of the data model thread
+// (whilst the data model thread is prevented from modifying it)
+static __thread bool is_dm_worker_thread = false;
+
 /*********************************************************************//**
 **
 ** OS_UTILS_CreateThread
@@ -63,6 +137,24 @@ pthread_t usp_core_thread;
 **
 **************************************************************************/
 int OS_UTILS_CreateThread(void *(* start_routine)(void *), void *args)
+{
+    return OS_UTILS_CreateThreadWithStackSize(start_routine, args, 0);
+}
+
+/*********************************************************************//**
+**
+** OS_UTILS_CreateThreadWithStackSize
+**
+** Wrapper function to start a POSIX thread, with the specified stack size
+**
+** \param   start_routine - function pointer to the 'main' function for the thread
+** \param   args - pointer to input conditions for the operation
+** \param   stack_size - size (in bytes) of the stack of the thread, or 0 to use the default stack size
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int OS_UTILS_CreateThreadWithStackSize(void *(* start_routine)(void *), void *args, size_t stack_size)
 {
     int err;
     pthread_t thread;
@@ -76,6 +168,18 @@ int OS_UTILS_CreateThread(void *(* start_routine)(void *), void *args)
         return USP_ERR_INTERNAL_ERROR;
     }
 
+    // Exit if unable to set the stack size of the thread
+    if (stack_size != 0)
+    {
+        err = pthread_attr_setstacksize(&attr, stack_size);
+        if (err != 0)
+        {
+            USP_ERR_ERRNO("pthread_attr_setstacksize", err);
+            err = USP_ERR_INTERNAL_ERROR;
+            goto exit;
+        }
+    }
+
     // Exit if unable to create the thread as detached (as we do not need to wait for it to terminate)
     err = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     if (err != 0)
@@ -101,6 +205,148 @@ exit:
     return err;
 }
 
+/*********************************************************************//**
+**
+** OS_UTILS_CreateClassThread
+**
+** Starts a POSIX thread of the specified class, using the stack size, CPU affinity and scheduling policy configured for the class
+**
+** \param   thread_class - class of thread to start
+** \param   start_routine - function pointer to the 'main' function for the thread
+** \param   args - pointer to input conditions for the thread
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int OS_UTILS_CreateClassThread(thread_class_t thread_class, void *(* start_routine)(void *), void *args)
+{
+    int err;
+    size_t stack_size;
+    class_thread_args_t *cta;
+
+    USP_ASSERT((thread_class >= 0) && (thread_class < kThreadClass_Max));
+
+    stack_size = thread_configs[thread_class].stack_size;
+    if (stack_size == 0)
+    {
+        stack_size = thread_class_info[thread_class].default_stack_size;
+    }
+
+    // The scheduling configuration is applied by the new thread itself, as the nice value can only be set for the calling thread
+    cta = USP_MALLOC(sizeof(class_thread_args_t));
+    cta->start_routine = start_routine;
+    cta->args = args;
+    cta->thread_class = thread_class;
+
+    err = OS_UTILS_CreateThreadWithStackSize(ClassThreadMain, cta, stack_size);
+    if (err != USP_ERR_OK)
+    {
+        USP_FREE(cta);
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** OS_UTILS_SetThreadConfig
+**
+** Sets the CPU affinity, scheduling policy and stack size of each class of thread from a configuration string
+** The configuration string consists of entries separated by ';'. Each entry is a thread class name
+** ('dm', 'mtp', 'bdc', 'getworker', 'task', 'log' or 'all'), followed by ':', then a comma separated list of settings:-
+**     cpus=<hex mask>  - CPUs that the threads may run on (eg 0x3 for CPU0 and CPU1)
+**     policy=<name>    - Scheduling policy: 'other', 'batch', 'idle', 'fifo' or 'rr'
+**     priority=<n>     - Static priority for the 'fifo' and 'rr' policies
+**     nice=<n>         - Nice value (-20 to 19) for the 'other' and 'batch' policies
+**     stack=<bytes>    - Stack size. NOTE: This cannot be changed for the data model thread, as it is the main thread
+** eg "all:cpus=0x1;mtp:cpus=0x3,nice=5;task:stack=65536"
+** Entries are applied in order, so settings for a specific class should follow any settings for 'all'
+** NOTE: This must be called before any of the threads are created
+**
+** \param   spec - pointer to configuration string
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INVALID_VALUE if the configuration string could not be parsed
+**
+**************************************************************************/
+int OS_UTILS_SetThreadConfig(char *spec)
+{
+    int err;
+    char *buf;
+    char *entry;
+    char *saveptr;
+
+    memset(thread_configs, 0, sizeof(thread_configs));
+
+    // Iterate over all entries in the configuration string
+    buf = USP_STRDUP(spec);
+    err = USP_ERR_OK;
+    entry = strtok_r(buf, ";", &saveptr);
+    while (entry != NULL)
+    {
+        err = ParseThreadConfigEntry(entry);
+        if (err != USP_ERR_OK)
+        {
+            break;
+        }
+        entry = strtok_r(NULL, ";", &saveptr);
+    }
+
+    USP_FREE(buf);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** OS_UTILS_ApplyThreadConfig
+**
+** Applies the CPU affinity and scheduling policy configured for the specified class of thread to the calling thread
+** Failures are logged, but otherwise ignored, so that the agent still runs (eg if it does not have the privilege to use SCHED_FIFO)
+**
+** \param   thread_class - class of the calling thread
+**
+** \return  None
+**
+**************************************************************************/
+void OS_UTILS_ApplyThreadConfig(thread_class_t thread_class)
+{
+    int err;
+    thread_config_t *tc;
+    struct sched_param param;
+
+    USP_ASSERT((thread_class >= 0) && (thread_class < kThreadClass_Max));
+    tc = &thread_configs[thread_class];
+
+    if (tc->is_cpus_set)
+    {
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &tc->cpus);
+        if (err != 0)
+        {
+            USP_LOG_Warning("%s: pthread_setaffinity_np() failed for '%s' thread (%s)", __FUNCTION__, thread_class_info[thread_class].name, strerror(err));
+        }
+    }
+
+    if (tc->is_policy_set)
+    {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = tc->priority;
+        err = pthread_setschedparam(pthread_self(), tc->policy, &param);
+        if (err != 0)
+        {
+            USP_LOG_Warning("%s: pthread_setschedparam() failed for '%s' thread (%s)", __FUNCTION__, thread_class_info[thread_class].name, strerror(err));
+        }
+    }
+
+    // NOTE: On Linux, the nice value is a per-thread attribute, set using the thread id
+    if (tc->is_nice_set)
+    {
+        err = setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), tc->nice);
+        if (err != 0)
+        {
+            USP_LOG_Warning("%s: setpriority() failed for '%s' thread (%s)", __FUNCTION__, thread_class_info[thread_class].name, strerror(errno));
+        }
+    }
+}
+
 /*********************************************************************//**
 **
 ** OS_UTILS_SetDataModelThread
@@ -119,6 +365,41 @@ void OS_UTILS_SetDataModelThread(void)
     usp_core_thread = pthread_self();
 }
 
+/*********************************************************************//**
+**
+** OS_UTILS_SetDataModelWorkerThread
+**
+** Marks the calling thread as a Get worker thread
+** Get worker threads are treated as the data model thread by OS_UTILS_IsDataModelThread(), as they
+** only read the data model, whilst the data model thread waits for them before modifying it
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void OS_UTILS_SetDataModelWorkerThread(void)
+{
+    is_dm_worker_thread = true;
+}
+
+/*********************************************************************//**
+**
+** OS_UTILS_IsDataModelWorkerThread
+**
+** Returns true if this function is being called from a Get worker thread
+** Get worker threads may only read the data model, so callers use this to avoid modifying it
+**
+** \param   None
+**
+** \return  true if this function is being called from a Get worker thread
+**
+**************************************************************************/
+bool OS_UTILS_IsDataModelWorkerThread(void)
+{
+    return is_dm_worker_thread;
+}
+
 /*********************************************************************//**
 **
 ** OS_UTILS_IsDataModelThread
@@ -138,7 +419,7 @@ bool OS_UTILS_IsDataModelThread(const char *caller, bool print_warning)
 
     // Exit if this function is not being called from the data model thread
     this_thread = pthread_self();
-    if ( ! pthread_equal(this_thread, usp_core_thread))
+    if ( (! pthread_equal(this_thread, usp_core_thread)) && (is_dm_worker_thread == false) )
     {
         if (print_warning)
         {
@@ -224,3 +505,248 @@ void OS_UTILS_UnlockMutex(pthread_mutex_t *mutex)
 {
     pthread_mutex_unlock(mutex);
 }
+
+/*********************************************************************//**
+**
+** ClassThreadMain
+**
+** Start routine of threads created by OS_UTILS_CreateClassThread()
+** Applies the scheduling configuration of the class of thread, then runs the thread's 'main' function
+**
+** \param   param - pointer to arguments of the thread. NOTE: Ownership passes to this function
+**
+** \return  value returned by the thread's 'main' function
+**
+**************************************************************************/
+void *ClassThreadMain(void *param)
+{
+    class_thread_args_t cta;
+
+    memcpy(&cta, param, sizeof(cta));
+    USP_FREE(param);
+
+    OS_UTILS_ApplyThreadConfig(cta.thread_class);
+    return cta.start_routine(cta.args);
+}
+
+/*********************************************************************//**
+**
+** ParseThreadConfigEntry
+**
+** Parses a single entry of the thread configuration string (eg "mtp:cpus=0x3,nice=5")
+**
+** \param   entry - pointer to entry to parse. NOTE: This buffer is modified by this function
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INVALID_VALUE if the entry could not be parsed
+**
+**************************************************************************/
+int ParseThreadConfigEntry(char *entry)
+{
+    int i;
+    int err;
+    char *name;
+    char *setting;
+    char *value;
+    char *saveptr;
+    thread_config_t tc;
+    int thread_class = INVALID;
+
+    // Exit if the entry does not contain a thread class name
+    name = entry;
+    setting = strchr(entry, ':');
+    if (setting == NULL)
+    {
+        USP_ERR_SetMessage("%s: Thread configuration '%s' is missing ':' after the thread class", __FUNCTION__, entry);
+        return USP_ERR_INVALID_VALUE;
+    }
+    *setting++ = '\0';
+
+    // Exit if the thread class name is not known
+    if (strcmp(name, ALL_THREAD_CLASSES) != 0)
+    {
+        for (i=0; i<kThreadClass_Max; i++)
+        {
+            if (strcmp(name, thread_class_info[i].name)==0)
+            {
+                thread_class = i;
+                break;
+            }
+        }
+
+        if (thread_class == INVALID)
+        {
+            USP_ERR_SetMessage("%s: Unknown thread class '%s' in thread configuration", __FUNCTION__, name);
+            return USP_ERR_INVALID_VALUE;
+        }
+    }
+
+    // Iterate over all settings in the entry, parsing them into a temporary config
+    memset(&tc, 0, sizeof(tc));
+    setting = strtok_r(setting, ",", &saveptr);
+    while (setting != NULL)
+    {
+        // Exit if the setting is not of the form key=value
+        value = strchr(setting, '=');
+        if (value == NULL)
+        {
+            USP_ERR_SetMessage("%s: Thread configuration setting '%s' is missing '='", __FUNCTION__, setting);
+            return USP_ERR_INVALID_VALUE;
+        }
+        *value++ = '\0';
+
+        // Exit if unable to parse the setting
+        err = ParseThreadConfigSetting(&tc, setting, value);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+
+        // Apply the setting to the specified class of thread (or all classes)
+        for (i=0; i<kThreadClass_Max; i++)
+        {
+            if ((thread_class == INVALID) || (thread_class == i))
+            {
+                ApplyThreadConfigSetting(&thread_configs[i], &tc, setting);
+            }
+        }
+
+        setting = strtok_r(NULL, ",", &saveptr);
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ParseThreadConfigSetting
+**
+** Parses a single setting of a thread configuration entry into the specified config
+**
+** \param   tc - pointer to config to store the parsed value in
+** \param   key - name of the setting
+** \param   value - value of the setting
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INVALID_VALUE if the setting could not be parsed
+**
+**************************************************************************/
+int ParseThreadConfigSetting(thread_config_t *tc, char *key, char *value)
+{
+    int i;
+    int err;
+    char *endptr;
+    unsigned long long mask;
+    unsigned stack_size;
+
+    if (strcmp(key, "cpus")==0)
+    {
+        // Exit if the CPU mask is not a non-zero hex number
+        errno = 0;
+        mask = strtoull(value, &endptr, 16);
+        if ((*value == '\0') || (*endptr != '\0') || (errno != 0) || (mask == 0))
+        {
+            USP_ERR_SetMessage("%s: Thread configuration cpus=%s is not a valid CPU mask", __FUNCTION__, value);
+            return USP_ERR_INVALID_VALUE;
+        }
+
+        CPU_ZERO(&tc->cpus);
+        for (i=0; i<64; i++)
+        {
+            if (mask & (1ULL << i))
+            {
+                CPU_SET(i, &tc->cpus);
+            }
+        }
+        tc->is_cpus_set = true;
+        return USP_ERR_OK;
+    }
+
+    if (strcmp(key, "policy")==0)
+    {
+        tc->policy = TEXT_UTILS_StringToEnum(value, sched_policies, NUM_ELEM(sched_policies));
+        if (tc->policy == INVALID)
+        {
+            USP_ERR_SetMessage("%s: Thread configuration policy=%s is not a known scheduling policy", __FUNCTION__, value);
+            return USP_ERR_INVALID_VALUE;
+        }
+        tc->is_policy_set = true;
+        return USP_ERR_OK;
+    }
+
+    if (strcmp(key, "priority")==0)
+    {
+        err = TEXT_UTILS_StringToInteger(value, &tc->priority);
+        if ((err != USP_ERR_OK) || (tc->priority < sched_get_priority_min(SCHED_FIFO)) || (tc->priority > sched_get_priority_max(SCHED_FIFO)))
+        {
+            USP_ERR_SetMessage("%s: Thread configuration priority=%s is invalid or out of range", __FUNCTION__, value);
+            return USP_ERR_INVALID_VALUE;
+        }
+        return USP_ERR_OK;
+    }
+
+    if (strcmp(key, "nice")==0)
+    {
+        err = TEXT_UTILS_StringToInteger(value, &tc->nice);
+        if ((err != USP_ERR_OK) || (tc->nice < -20) || (tc->nice > 19))
+        {
+            USP_ERR_SetMessage("%s: Thread configuration nice=%s is invalid or out of range", __FUNCTION__, value);
+            return USP_ERR_INVALID_VALUE;
+        }
+        tc->is_nice_set = true;
+        return USP_ERR_OK;
+    }
+
+    if (strcmp(key, "stack")==0)
+    {
+        err = TEXT_UTILS_StringToUnsigned(value, &stack_size);
+        if ((err != USP_ERR_OK) || (stack_size < PTHREAD_STACK_MIN))
+        {
+            USP_ERR_SetMessage("%s: Thread configuration stack=%s is invalid or less than %d bytes", __FUNCTION__, value, (int)PTHREAD_STACK_MIN);
+            return USP_ERR_INVALID_VALUE;
+        }
+        tc->stack_size = stack_size;
+        return USP_ERR_OK;
+    }
+
+    USP_ERR_SetMessage("%s: Unknown thread configuration setting '%s'", __FUNCTION__, key);
+    return USP_ERR_INVALID_VALUE;
+}
+
+/*********************************************************************//**
+**
+** ApplyThreadConfigSetting
+**
+** Copies a single setting (which has just been parsed) into the config of a class of thread
+**
+** \param   dest - pointer to config of the class of thread
+** \param   src - pointer to config containing the parsed setting
+** \param   key - name of the setting to copy
+**
+** \return  None
+**
+**************************************************************************/
+void ApplyThreadConfigSetting(thread_config_t *dest, thread_config_t *src, char *key)
+{
+    if (strcmp(key, "cpus")==0)
+    {
+        dest->is_cpus_set = true;
+        memcpy(&dest->cpus, &src->cpus, sizeof(cpu_set_t));
+    }
+    else if (strcmp(key, "policy")==0)
+    {
+        dest->is_policy_set = true;
+        dest->policy = src->policy;
+    }
+    else if (strcmp(key, "priority")==0)
+    {
+        dest->priority = src->priority;
+    }
+    else if (strcmp(key, "nice")==0)
+    {
+        dest->is_nice_set = true;
+        dest->nice = src->nice;
+    }
+    else if (strcmp(key, "stack")==0)
+    {
+        dest->stack_size = src->stack_size;
+    }
+}
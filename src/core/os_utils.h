@@ -48,10 +48,31 @@
 #define PRINT_WARNING true
 #define DONT_PRINT_WARNING false
 
+//-------------------------------------------------------------------------
+// Classes of thread which may be given their own CPU affinity, scheduling policy and stack size (see OS_UTILS_SetThreadConfig)
+typedef enum
+{
+    kThreadClass_DataModel,     // Data model thread (the main thread)
+    kThreadClass_Mtp,           // MTP threads (STOMP, CoAP, WebSocket client and MQTT)
+    kThreadClass_Bdc,           // Bulk data collection thread
+    kThreadClass_GetWorker,     // Get worker threads (processing read-only USP messages)
+    kThreadClass_Task,          // Task pool worker threads (eg running asynchronous operations)
+    kThreadClass_Log,           // Thread writing out log messages
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kThreadClass_Max
+} thread_class_t;
+
 //-------------------------------------------------------------------------
 // API functions
 int OS_UTILS_CreateThread(void *(* start_routine)(void *), void *args);
+int OS_UTILS_CreateThreadWithStackSize(void *(* start_routine)(void *), void *args, size_t stack_size);
+int OS_UTILS_CreateClassThread(thread_class_t thread_class, void *(* start_routine)(void *), void *args);
+int OS_UTILS_SetThreadConfig(char *spec);
+void OS_UTILS_ApplyThreadConfig(thread_class_t thread_class);
 void OS_UTILS_SetDataModelThread(void);
+void OS_UTILS_SetDataModelWorkerThread(void);
+bool OS_UTILS_IsDataModelWorkerThread(void);
 bool OS_UTILS_IsDataModelThread(const char *caller, bool print_warning);
 int OS_UTILS_InitMutex(pthread_mutex_t *mutex);
 void OS_UTILS_LockMutex(pthread_mutex_t *mutex);
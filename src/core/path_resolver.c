@@ -51,6 +51,7 @@
 #include "kv_vector.h"
 #include "expr_vector.h"
 #include "text_utils.h"
+#include "usp_probe.h"
 
 
 //-------------------------------------------------------------------------
@@ -65,53 +66,599 @@ typedef struct
                             // If the search path resolves to an object or param which there is no permission for,
                             // then a error will be generated (or the path forgivingly ignored in the case of a get)
     unsigned flags;         // flags controlling resolving of the path eg GET_ALL_INSTANCES
+    resolved_path_cb_t cb;  // callback to pass each resolved path to, or NULL if the resolved paths are returned in sv
+    void *cb_arg;           // argument passed to the callback
+    bool is_dup_possible;   // Set if reference following has been performed, and hence the same path may be resolved more than once
+    str_vector_t cb_paths;  // Paths already passed to the callback by AddPathFound(). Only populated if is_dup_possible is set
+    str_set_t cb_paths_index; // Hash index of cb_paths
+    str_set_t sv_index;     // Hash index of the paths in sv, used to avoid adding the same path to sv more than once
 } resolver_state_t;
 
+//-------------------------------------------------------------------------
+// Cache of the instance numbers of objects that have been looked up whilst resolving wildcards and unique keys
+// The cache is only active whilst processing a single USP message (see PATH_RESOLVER_EnableCache), and is
+// invalidated whenever an object instance is added to or deleted from the data model
+// NOTE: Each thread has its own cache, as USP messages may also be processed by the Get worker threads
+typedef struct
+{
+    char *obj_path;             // Unqualified path of the multi-instance object e.g. 'Device.LocalAgent.Controller.'
+    int path_hash;              // Hash of obj_path, used to speed up lookups
+    int_vector_t iv;            // Instance numbers of the object
+} resolver_cache_entry_t;
+
+static __thread resolver_cache_entry_t *resolver_cache = NULL;
+static __thread int resolver_cache_num_entries = 0;
+static __thread bool is_resolver_cache_enabled = false;
+
+//-------------------------------------------------------------------------
+// Indexes from the values of a unique key (registered with the data model) to the instances of an object having those values
+// These allow unique key addressing (eg 'Device.LocalAgent.Controller.[EndpointID=="xyz"].') to find the matching instance,
+// without reading the unique key parameters of every instance of the object
+// Each index is built the first time that it is needed. All indexes are discarded whenever an object instance is
+// added to or deleted from the data model, or a unique key parameter is set (see PATH_RESOLVER_InvalidateUniqueKeyIndexes)
+// NOTE: Each thread has its own indexes, as USP messages may also be processed by the Get worker threads
+typedef struct
+{
+    int hash;                     // Hash of the values of the unique key parameters of this instance
+    int instance;                 // Instance number of the object, or 0 if this slot is unused
+} unique_key_slot_t;
+
+typedef struct
+{
+    char *obj_path;               // Unqualified path of the multi-instance object e.g. 'Device.LocalAgent.Controller.'
+    int path_hash;                // Hash of obj_path, used to speed up lookups
+    dm_unique_key_t *unique_key;  // Unique key whose values are indexed
+    int table_size;               // Number of slots in the table (always a power of 2)
+    unique_key_slot_t *table;     // Open addressing hash table of the instances of the object, keyed by the hash of their unique key values
+} unique_key_index_t;
+
+static __thread unique_key_index_t *unique_key_indexes = NULL;
+static __thread int num_unique_key_indexes = 0;
+static __thread unsigned unique_key_indexes_generation = 0; // Value of unique_key_generation when this thread's indexes were built
+
+// Incremented whenever the unique key indexes of all threads become stale
+static unsigned unique_key_generation = 0;
+
+//-------------------------------------------------------------------------
+// Argument passed to AddResolvedPath(), when appending the paths resolved from a path expression to a vector (see PATH_RESOLVER_ResolveDevicePathToNodes)
+typedef struct
+{
+    dm_resolved_path_vector_t *rpv;  // Vector to append the resolved paths to
+    int num_existing;                // Number of paths in the vector before the path expression was resolved
+} resolved_path_append_t;
+
+//-------------------------------------------------------------------------
+// Key expression of a unique key search path, compiled once and then evaluated against every instance of the object
+typedef struct
+{
+    dm_compiled_expr_t ce;
+    int value_index;                    // Index of the compiled key holding the value of this key's parameter
+                                        // (ie the first key referencing the same parameter, so that its value is only read once per instance)
+    dm_expr_value_t value;              // Value of the parameter, for the instance currently being evaluated
+} compiled_key_t;
+
 //-------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int ExpandPath(char *resolved, char *unresolved, resolver_state_t *state);
 int ExpandWildcard(char *resolved, char *unresolved, resolver_state_t *state);
 int ResolveReferenceFollow(char *resolved, char *unresolved, resolver_state_t *state);
 int ResolveUniqueKey(char *resolved, char *unresolved, resolver_state_t *state);
-int DoesInstanceMatchUniqueKey(char *object, int instance, expr_vector_t *keys, bool *is_match, resolver_state_t *state);
+int CompileUniqueKeys(char *object, int instance, expr_vector_t *keys, compiled_key_t *compiled_keys, bool *is_permitted, resolver_state_t *state);
+int DoesInstanceMatchUniqueKey(int instance, compiled_key_t *compiled_keys, int num_keys, bool *is_match);
+dm_unique_key_t *FindIndexedUniqueKey(expr_vector_t *keys, compiled_key_t *compiled_keys, int *key_map);
+unique_key_index_t *GetUniqueKeyIndex(char *object, dm_unique_key_t *unique_key, int_vector_t *iv, compiled_key_t *compiled_keys, int *key_map);
+unique_key_index_t *BuildUniqueKeyIndex(char *object, int path_hash, dm_unique_key_t *unique_key, int_vector_t *iv, compiled_key_t *compiled_keys, int *key_map);
+void GetUniqueKeyIndexMatches(unique_key_index_t *index, expr_vector_t *keys, int *key_map, int_vector_t *iv);
+int CalcUniqueKeyHash(char **values, int num_values);
+void FreeUniqueKeyIndexes(void);
+int CompareInstanceNumbers(const void *p1, const void *p2);
 int ResolvePartialPath(char *path, resolver_state_t *state);
 int GetChildParams(char *path, int path_len, dm_node_t *node, dm_instances_t *inst, resolver_state_t *state);
 int GetChildParams_MultiInstanceObject(char *path, int path_len, dm_node_t *node, dm_instances_t *inst, resolver_state_t *state);
 int DoesInstanceMatchExpr(char *object, int instance, char *expr_variable, resolver_state_t *state, bool *is_match);
 int AddPathFound(char *path, resolver_state_t *state);
+int ReportPathFound(char *path, dm_node_t *node, dm_instances_t *inst, resolver_state_t *state);
+int AddResolvedPath(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg);
+int ReportInstancePaths(str_vector_t *sv, resolver_state_t *state);
+int ValidateDevicePath(char *path, resolve_op_t op);
+int ResolvePathWithState(char *path, resolver_state_t *state);
 int CountPathSeparator(char *path);
 int ExpandNextSubPath(char *resolved, char *unresolved, resolver_state_t *state);
-int CheckPathProperties(char *path, resolver_state_t *state, bool *add_to_vector, unsigned *path_properties);
+int CheckPathProperties(char *path, resolver_state_t *state, bool *add_to_vector, unsigned *path_properties, dm_node_t **p_node, dm_instances_t *inst);
+int GetObjectInstances(char *path, int_vector_t *iv);
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_ResolveDevicePath
+**
+** Wrapper around PATH_RESOLVER_ResolvePath() which ensures that the path starts with 'Device.'
+** This function therefore does not allow querying of 'Internal.' database parameters
+** This function should be used by all USP protocol message handlers (since 'Internal.' is not exposed to controllers)
+** However CLI commands can directly use PATH_RESOLVER_ResolvePath()
+**
+** \param   path - pointer to path expression identifying parameters in the data model
+** \param   sv - pointer to string vector to return the resolved paths in
+**               or NULL if we are only interested in whether the expression exists in the schema
+**               NOTE: As this function can be used to append to a string vector, it does not initialise
+**                     the vector, so the caller must initialise the vector.
+**                     Also, the caller must destroy the vector, even if an error is returned
+** \param   op - operation being performed that requires path resolution
+** \param   separator_split - pointer to variable in which to return where to split the resolved paths
+**                            This argument is used to split a path into an object (that required resolution),
+**                            and a sub path which did not require resolution
+**                            NOTE: This argument may be NULL if the caller is not interested in the value
+** \param   combined_role - role to use when performing the resolution. If set to INTERNAL_ROLE, then permissions are ignored (used internally)
+*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+**
+** \return  USP_ERR_OK if successful, or no instances found
+**
+**************************************************************************/
+int PATH_RESOLVER_ResolveDevicePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags)
+{
+    int err;
+
+    // Exit if the path does not start with 'Device.' or is not terminated correctly for the operation
+    err = ValidateDevicePath(path, op);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = PATH_RESOLVER_ResolvePath(path, sv, op, separator_split, combined_role, flags);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_ResolveDevicePathWithCallback
+**
+** Wrapper around PATH_RESOLVER_ResolvePathWithCallback() which ensures that the path starts with 'Device.'
+** This function should be used by USP protocol message handlers which consume the resolved paths one at a time
+**
+** \param   path - pointer to path expression identifying parameters in the data model
+** \param   cb - callback to call for each resolved path
+** \param   cb_arg - argument to pass to the callback
+** \param   op - operation being performed that requires path resolution
+** \param   combined_role - role to use when performing the resolution
+*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+**
+** \return  USP_ERR_OK if successful, or no instances found
+**
+**************************************************************************/
+int PATH_RESOLVER_ResolveDevicePathWithCallback(char *path, resolved_path_cb_t cb, void *cb_arg, resolve_op_t op, combined_role_t *combined_role, unsigned flags)
+{
+    int err;
+
+    // Exit if the path does not start with 'Device.' or is not terminated correctly for the operation
+    err = ValidateDevicePath(path, op);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = PATH_RESOLVER_ResolvePathWithCallback(path, cb, cb_arg, op, combined_role, flags);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_ResolvePath
+**
+** Resolves the specified path expression into a vector of parameter paths which exist in the data model
+** Resolution involves resolving wildcarded, key based addressing, reference following and expression based searching based expressions
+** Resolution takes account of permissions, potentially failing the resolution if sufficient permissions are not available for the specified role
+** NOTE: The string vector is assumed to be initialised before this function is called, allowing this function to append to the list
+**
+** \param   path - pointer to path expression identifying parameters in the data model
+** \param   sv - pointer to string vector to return the resolved paths in
+**               or NULL if we are only interested in whether the expression exists in the schema
+**               NOTE: As this function can be used to append to a string vector, it does not initialise
+**                     the vector, so the caller must initialise the vector.
+**                     Also, the caller must destroy the vector, even if an error is returned
+** \param   op - operation being performed that requires path resolution
+** \param   separator_split - pointer to variable in which to return where to split the resolved paths
+**                            This argument is used to split a path into an object (that required resolution),
+**                            and a sub path which did not require resolution
+**                            NOTE: This argument may be NULL if the caller is not interested in the value
+** \param   combined_role - role to use when performing the resolution
+*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+**
+** \return  USP_ERR_OK if successful, or no instances found
+**
+**************************************************************************/
+int PATH_RESOLVER_ResolvePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags)
+{
+    int err;
+    resolver_state_t state;
+
+    // Set up state variables for resolving the path, then resolve it
+    state.sv = sv;
+    state.op = op;
+    state.separator_count = 0;
+    state.combined_role = combined_role;
+    state.flags = flags;
+    state.cb = NULL;
+    state.cb_arg = NULL;
+    state.is_dup_possible = false;
+    STR_VECTOR_Init(&state.cb_paths);
+    STR_SET_Init(&state.cb_paths_index);
+    STR_SET_Init(&state.sv_index);
+
+    USP_PROBE2(path_resolve_start, path, op);
+    err = ResolvePathWithState(path, &state);
+    USP_PROBE3(path_resolve_end, path, op, err);
+    STR_SET_Destroy(&state.sv_index);
+
+    // Return the point at which to split the path
+    if (separator_split != NULL)
+    {
+        *separator_split = state.separator_count;
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_ResolvePathWithCallback
+**
+** Resolves the specified path expression, calling the specified callback for each resolved path, as soon as it is resolved
+** This avoids the caller having to hold all resolved paths at once in a vector, and allows the caller to use the
+** node and instance numbers of each resolved path, rather than looking them up again from the path
+** NOTE: As with PATH_RESOLVER_ResolvePath(), the same resolved path is not passed to the callback more than once,
+**       but unlike PATH_RESOLVER_ResolvePath(), paths are not checked against those resolved by previous calls
+**
+** \param   path - pointer to path expression identifying parameters in the data model
+** \param   cb - callback to call for each resolved path
+**               If the callback returns an error, then path resolution stops, and this function returns the error
+** \param   cb_arg - argument to pass to the callback
+** \param   op - operation being performed that requires path resolution
+** \param   combined_role - role to use when performing the resolution
+*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+**
+** \return  USP_ERR_OK if successful, or no instances found
+**
+**************************************************************************/
+int PATH_RESOLVER_ResolvePathWithCallback(char *path, resolved_path_cb_t cb, void *cb_arg, resolve_op_t op, combined_role_t *combined_role, unsigned flags)
+{
+    int err;
+    resolver_state_t state;
+
+    // Set up state variables for resolving the path, then resolve it
+    state.sv = NULL;
+    state.op = op;
+    state.separator_count = 0;
+    state.combined_role = combined_role;
+    state.flags = flags;
+    state.cb = cb;
+    state.cb_arg = cb_arg;
+    state.is_dup_possible = false;
+    STR_VECTOR_Init(&state.cb_paths);
+    STR_SET_Init(&state.cb_paths_index);
+    STR_SET_Init(&state.sv_index);
+
+    USP_PROBE2(path_resolve_start, path, op);
+    err = ResolvePathWithState(path, &state);
+    USP_PROBE3(path_resolve_end, path, op, err);
+    STR_VECTOR_Destroy(&state.cb_paths);
+    STR_SET_Destroy(&state.cb_paths_index);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_ResolveDevicePathToNodes
+**
+** Resolves the specified path expression (which must start with 'Device.'), appending the resolved paths,
+** along with their nodes and instance numbers, to a vector
+** This allows the caller to get the values of the resolved parameters, without parsing their paths again
+** NOTE: Paths which are already present in the vector are not added again, allowing many path expressions to be resolved into the same vector
+**
+** \param   path - pointer to path expression identifying parameters in the data model
+** \param   rpv - pointer to vector to append the resolved paths to
+**                NOTE: The caller must initialise the vector (see PATH_RESOLVER_InitResolvedPaths), and destroy it, even if an error is returned
+** \param   op - operation being performed that requires path resolution
+** \param   combined_role - role to use when performing the resolution
+*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+**
+** \return  USP_ERR_OK if successful, or no instances found
+**
+**************************************************************************/
+int PATH_RESOLVER_ResolveDevicePathToNodes(char *path, dm_resolved_path_vector_t *rpv, resolve_op_t op, combined_role_t *combined_role, unsigned flags)
+{
+    resolved_path_append_t rpa;
+
+    rpa.rpv = rpv;
+    rpa.num_existing = rpv->num_entries;
+    return PATH_RESOLVER_ResolveDevicePathWithCallback(path, AddResolvedPath, &rpa, op, combined_role, flags);
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_InitResolvedPaths
+**
+** Initialises a vector of resolved paths
+**
+** \param   rpv - pointer to vector of resolved paths to initialise
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_InitResolvedPaths(dm_resolved_path_vector_t *rpv)
+{
+    rpv->vector = NULL;
+    rpv->num_entries = 0;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_DestroyResolvedPaths
+**
+** Frees all dynamically allocated memory contained in a vector of resolved paths
+**
+** \param   rpv - pointer to vector of resolved paths to destroy
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_DestroyResolvedPaths(dm_resolved_path_vector_t *rpv)
+{
+    int i;
+
+    for (i=0; i < rpv->num_entries; i++)
+    {
+        USP_FREE(rpv->vector[i].path);
+    }
+
+    USP_SAFE_FREE(rpv->vector);
+    rpv->num_entries = 0;
+}
+
+/*********************************************************************//**
+**
+** AddResolvedPath
+**
+** Callback called by the path resolver for each path resolved by PATH_RESOLVER_ResolveDevicePathToNodes()
+** Appends the resolved path, along with its node and instance numbers, to the vector (if not already present)
+**
+** \param   path - full data model path which has been resolved
+** \param   node - pointer to node in the data model schema representing the path
+** \param   inst - pointer to instance numbers of the path
+** \param   separator_split - unused
+** \param   cb_arg - pointer to structure containing the vector of resolved paths to append to
+**
+** \return  USP_ERR_OK always
+**
+**************************************************************************/
+int AddResolvedPath(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg)
+{
+    int i;
+    int new_num_entries;
+    dm_resolved_path_t *rp;
+    resolved_path_append_t *rpa = (resolved_path_append_t *) cb_arg;
+    dm_resolved_path_vector_t *rpv = rpa->rpv;
+
+    // Exit if the path was already in the vector, before this path expression was resolved
+    // NOTE: Paths resolved from the same path expression do not need to be checked, as the path resolver itself
+    //       does not pass the same path to the callback more than once
+    for (i=0; i < rpa->num_existing; i++)
+    {
+        if (strcmp(rpv->vector[i].path, path)==0)
+        {
+            return USP_ERR_OK;
+        }
+    }
+
+    new_num_entries = rpv->num_entries + 1;
+    rpv->vector = USP_REALLOC(rpv->vector, new_num_entries*sizeof(dm_resolved_path_t));
+
+    rp = &rpv->vector[rpv->num_entries];
+    rp->path = USP_STRDUP(path);
+    rp->node = node;
+    memcpy(&rp->inst, inst, sizeof(dm_instances_t));
+
+    rpv->num_entries = new_num_entries;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_EnableCache
+**
+** Enables caching of object instance numbers used during path resolution
+** This is called at the start of processing a USP message containing many path expressions,
+** so that path expressions sharing the same wildcarded prefix do not repeatedly look up the same instance numbers
+** NOTE: PATH_RESOLVER_DisableCache() must be called once the message has been processed
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_EnableCache(void)
+{
+    PATH_RESOLVER_InvalidateCache();
+    is_resolver_cache_enabled = true;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_DisableCache
+**
+** Disables caching of object instance numbers, freeing all cached entries
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_DisableCache(void)
+{
+    PATH_RESOLVER_InvalidateCache();
+    is_resolver_cache_enabled = false;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_InvalidateCache
+**
+** Frees all entries in the cache of object instance numbers
+** This is called whenever an object instance is added to or deleted from the data model
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_InvalidateCache(void)
+{
+    int i;
+
+    // Exit if there is nothing in the cache
+    if (resolver_cache_num_entries == 0)
+    {
+        return;
+    }
+
+    for (i=0; i < resolver_cache_num_entries; i++)
+    {
+        USP_FREE(resolver_cache[i].obj_path);
+        INT_VECTOR_Destroy(&resolver_cache[i].iv);
+    }
+
+    USP_SAFE_FREE(resolver_cache);
+    resolver_cache_num_entries = 0;
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_InvalidateUniqueKeyIndexes
+**
+** Marks the unique key indexes of all threads as stale, causing them to be rebuilt the next time they are used
+** This is called whenever an object instance is added to or deleted from the data model, or a unique key parameter is set
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void PATH_RESOLVER_InvalidateUniqueKeyIndexes(void)
+{
+    __atomic_add_fetch(&unique_key_generation, 1, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** PATH_RESOLVER_FindUniqueKeyInstances
+**
+** Finds the instances of an object whose value of the specified parameter matches the specified value,
+** using the unique key index, if the parameter is registered as a (single parameter) unique key of the object
+** NOTE: Only unique keys which can be indexed are supported (see FindIndexedUniqueKey)
+**
+** \param   object - data model path of the object, including trailing '.' e.g. 'Device.LocalAgent.Controller.'
+** \param   param - name of the unique key parameter, relative to the object instance
+** \param   value - value of the parameter to find
+** \param   matches - pointer to vector in which to return the instance numbers of the matching instances
+**                    NOTE: The caller must initialise and destroy this vector
+** \param   is_indexed - pointer to variable in which to return whether the instances were found using the unique key index
+**                    If false, then the parameter is not an indexed unique key, and the caller must search the instances itself
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PATH_RESOLVER_FindUniqueKeyInstances(char *object, char *param, char *value, int_vector_t *matches, bool *is_indexed)
+{
+    int i;
+    int err;
+    int_vector_t iv;
+    expr_vector_t keys;
+    compiled_key_t ck;
+    dm_unique_key_t *unique_key;
+    unique_key_index_t *index;
+    int key_map[MAX_COMPOUND_KEY_PARAMS];
+    bool is_match;
+
+    *is_indexed = false;
+    INT_VECTOR_Init(&iv);
+    EXPR_VECTOR_Init(&keys);
+
+    // Exit if unable to get the instances of this object
+    err = GetObjectInstances(object, &iv);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if there are no instances of this object, so none can match
+    if (iv.num_entries == 0)
+    {
+        *is_indexed = true;
+        goto exit;
+    }
+
+    // Exit if unable to compile the key expression (using the first instance to locate the parameter)
+    EXPR_VECTOR_Add(&keys, param, kExprOp_Equal, value);
+    err = DATA_MODEL_CompileExpression(object, iv.vector[0], keys.vector[0].param, kExprOp_Equal, keys.vector[0].value, INTERNAL_ROLE, &ck.ce);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+    ck.value_index = 0;
+
+    // Exit if the parameter is not a unique key which can be indexed, or the index could not be built
+    unique_key = FindIndexedUniqueKey(&keys, &ck, key_map);
+    if (unique_key == NULL)
+    {
+        goto exit;
+    }
+
+    index = GetUniqueKeyIndex(object, unique_key, &iv, &ck, key_map);
+    if (index == NULL)
+    {
+        goto exit;
+    }
+
+    // Evaluate only the instances selected by the index, to rule out hash collisions
+    GetUniqueKeyIndexMatches(index, &keys, key_map, &iv);
+    for (i=0; i < iv.num_entries; i++)
+    {
+        err = DoesInstanceMatchUniqueKey(iv.vector[i], &ck, 1, &is_match);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+
+        if (is_match)
+        {
+            INT_VECTOR_Add(matches, iv.vector[i]);
+        }
+    }
+
+    *is_indexed = true;
+    err = USP_ERR_OK;
+
+exit:
+    INT_VECTOR_Destroy(&iv);
+    EXPR_VECTOR_Destroy(&keys);
+    return err;
+}
 
 /*********************************************************************//**
 **
-** PATH_RESOLVER_ResolveDevicePath
+** ValidateDevicePath
 **
-** Wrapper around PATH_RESOLVER_ResolvePath() which ensures that the path starts with 'Device.'
-** This function therefore does not allow querying of 'Internal.' database parameters
-** This function should be used by all USP protocol message handlers (since 'Internal.' is not exposed to controllers)
-** However CLI commands can directly use PATH_RESOLVER_ResolvePath()
+** Checks that the specified path expression starts with 'Device.' and is terminated correctly for the specified operation
+** Paths used by USP protocol message handlers must start with 'Device.' as 'Internal.' is not exposed to controllers
 **
 ** \param   path - pointer to path expression identifying parameters in the data model
-** \param   sv - pointer to string vector to return the resolved paths in
-**               or NULL if we are only interested in whether the expression exists in the schema
-**               NOTE: As this function can be used to append to a string vector, it does not initialise
-**                     the vector, so the caller must initialise the vector.
-**                     Also, the caller must destroy the vector, even if an error is returned
 ** \param   op - operation being performed that requires path resolution
-** \param   separator_split - pointer to variable in which to return where to split the resolved paths
-**                            This argument is used to split a path into an object (that required resolution),
-**                            and a sub path which did not require resolution
-**                            NOTE: This argument may be NULL if the caller is not interested in the value
-** \param   combined_role - role to use when performing the resolution. If set to INTERNAL_ROLE, then permissions are ignored (used internally)
-*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
 **
-** \return  USP_ERR_OK if successful, or no instances found
+** \return  USP_ERR_OK if the path expression is valid
 **
 **************************************************************************/
-int PATH_RESOLVER_ResolveDevicePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags)
+int ValidateDevicePath(char *path, resolve_op_t op)
 {
-    int err;
     int len;
 
     // Exit if the path does not begin with "Device."
@@ -145,42 +692,26 @@ int PATH_RESOLVER_ResolveDevicePath(char *path, str_vector_t *sv, resolve_op_t o
         }
     }
 
-    err = PATH_RESOLVER_ResolvePath(path, sv, op, separator_split, combined_role, flags);
-    return err;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** PATH_RESOLVER_ResolvePath
+** ResolvePathWithState
 **
-** Resolves the specified path expression into a vector of parameter paths which exist in the data model
-** Resolution involves resolving wildcarded, key based addressing, reference following and expression based searching based expressions
-** Resolution takes account of permissions, potentially failing the resolution if sufficient permissions are not available for the specified role
-** NOTE: The string vector is assumed to be initialised before this function is called, allowing this function to append to the list
+** Resolves the specified path expression, using the specified state variables
 **
 ** \param   path - pointer to path expression identifying parameters in the data model
-** \param   sv - pointer to string vector to return the resolved paths in
-**               or NULL if we are only interested in whether the expression exists in the schema
-**               NOTE: As this function can be used to append to a string vector, it does not initialise
-**                     the vector, so the caller must initialise the vector.
-**                     Also, the caller must destroy the vector, even if an error is returned
-** \param   op - operation being performed that requires path resolution
-** \param   separator_split - pointer to variable in which to return where to split the resolved paths
-**                            This argument is used to split a path into an object (that required resolution),
-**                            and a sub path which did not require resolution
-**                            NOTE: This argument may be NULL if the caller is not interested in the value
-** \param   combined_role - role to use when performing the resolution
-*  \param   flags - flags controlling resolving of the path eg GET_ALL_INSTANCES
+** \param   state - pointer to structure containing state variables to use with this resolution
 **
 ** \return  USP_ERR_OK if successful, or no instances found
 **
 **************************************************************************/
-int PATH_RESOLVER_ResolvePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags)
+int ResolvePathWithState(char *path, resolver_state_t *state)
 {
     char resolved[MAX_DM_PATH];
     char unresolved[MAX_DM_PATH];
     int err;
-    resolver_state_t state;
 
     // Exit if path contains any path separators with no intervening objects 
     if (strstr(path, "..") != NULL)
@@ -192,21 +723,9 @@ int PATH_RESOLVER_ResolvePath(char *path, str_vector_t *sv, resolve_op_t op, int
     // Take a copy of the path expression, so that the code below may alter the unresolved buffer
     USP_STRNCPY(unresolved, path, sizeof(unresolved));
 
-    // Set up state variables for resolving the path, then resolve it
+    // Resolve the path
     resolved[0] = '\0';  // Start from an empty string for the resolved portion of the path
-    state.sv = sv;
-    state.op = op;
-    state.separator_count = 0;
-    state.combined_role = combined_role;
-    state.flags = flags;
-
-    err = ExpandPath(resolved, unresolved, &state);
-
-    // Return the point at which to split the path
-    if (separator_split != NULL)
-    {
-        *separator_split = state.separator_count;
-    }
+    err = ExpandPath(resolved, unresolved, state);
 
     return err;
 }
@@ -359,7 +878,7 @@ int ExpandWildcard(char *resolved, char *unresolved, resolver_state_t *state)
     char *p;
 
     // Exit if unable to get the instances of this object
-    err = DATA_MODEL_GetInstances(resolved, &iv);
+    err = GetObjectInstances(resolved, &iv);
     if (err != USP_ERR_OK)
     {
         goto exit;
@@ -422,6 +941,9 @@ int ResolveReferenceFollow(char *resolved, char *unresolved, resolver_state_t *s
     unsigned flags;
     unsigned short permission_bitmask;
 
+    // References may resolve to the same path more than once (eg if a list of references contains duplicates)
+    state->is_dup_possible = true;
+
     // Exit if this is a Bulk Data collection operation, which does not allow reference following
     // (because the alt-name reduction rules in TR-157 do not support it)
     if (state->op == kResolveOp_GetBulkData)
@@ -510,6 +1032,11 @@ int ResolveUniqueKey(char *resolved, char *unresolved, resolver_state_t *state)
     char temp[MAX_DM_PATH];
     bool is_match;
     int instance;
+    compiled_key_t *compiled_keys = NULL;
+    bool is_permitted;
+    dm_unique_key_t *unique_key;
+    unique_key_index_t *index;
+    int key_map[MAX_COMPOUND_KEY_PARAMS];
     expr_op_t valid_ops[] = {kExprOp_Equal, kExprOp_NotEqual, kExprOp_LessThanOrEqual, kExprOp_GreaterThanOrEqual, kExprOp_LessThan, kExprOp_GreaterThan};
 
     // Exit if this is a Bulk Data collection operation, which does not allow unique key addressing
@@ -533,85 +1060,451 @@ int ResolveUniqueKey(char *resolved, char *unresolved, resolver_state_t *state)
     EXPR_VECTOR_Init(&keys);
 
     // Exit if unable to get the instances of this object
-    err = DATA_MODEL_GetInstances(resolved, &iv);
+    err = GetObjectInstances(resolved, &iv);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if there are no instances of this object
+    if (iv.num_entries == 0)
+    {
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Exit if the unique key is too long
+    len = p - unresolved;
+    if (len > MAX_DM_PATH-1)
+    {
+        USP_ERR_SetMessage("%s: Unique Key too long (%s) in search path", __FUNCTION__, unresolved);
+        err = USP_ERR_INVALID_PATH_SYNTAX;
+        goto exit;
+    }
+
+    // Copy the unique key expressions (ie the expression within []) into temp
+    memcpy(temp, unresolved, len);
+    temp[len] = '\0';
+    unresolved = &p[1];
+
+    // If the code gets here, unresolved points to the character after ']', and temp contains the unique key expression
+
+    // Exit if an error occurred whilst parsing the key expressions
+    err = EXPR_VECTOR_SplitExpressions(temp, &keys, "&&", valid_ops, NUM_ELEM(valid_ops), EXPR_FROM_USP);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+    
+    // Exit if no key expressions were found
+    if (keys.num_entries == 0)
+    {
+        USP_ERR_SetMessage("%s: No unique key found in search path before %s", __FUNCTION__, unresolved);
+        err = USP_ERR_INVALID_PATH_SYNTAX;
+        goto exit;
+    }
+
+    // Exit if unable to compile the key expressions
+    // NOTE: The key expressions are compiled once (using the first instance to locate the parameters), rather than for every instance
+    compiled_keys = USP_MALLOC(keys.num_entries*sizeof(compiled_key_t));
+    err = CompileUniqueKeys(resolved, iv.vector[0], &keys, compiled_keys, &is_permitted, state);
     if (err != USP_ERR_OK)
     {
-        goto exit;
+        goto exit;
+    }
+
+    // Exit if not permitted to read the parameters in the unique key. In this case no instances match
+    if (is_permitted == false)
+    {
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // If the key expressions address the object by one of its registered unique keys, then use the unique key index
+    // to determine the instances having matching values, so that only those instances need to be evaluated below
+    unique_key = FindIndexedUniqueKey(&keys, compiled_keys, key_map);
+    if (unique_key != NULL)
+    {
+        index = GetUniqueKeyIndex(resolved, unique_key, &iv, compiled_keys, key_map);
+        if (index != NULL)
+        {
+            GetUniqueKeyIndexMatches(index, &keys, key_map, &iv);
+        }
+    }
+
+    // Iterate over all instances of the object present in the data model
+    for (i=0; i < iv.num_entries; i++)
+    {
+        // Exit if an error occurred whilst trying to determine whether this instance matched the unique key
+        instance = iv.vector[i];
+        err = DoesInstanceMatchUniqueKey(instance, compiled_keys, keys.num_entries, &is_match);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+
+        // If found an instance which matches, continue resolving the path recursively, selecting this instance
+        if (is_match)
+        {
+            USP_SNPRINTF(temp, sizeof(temp), "%s%d", resolved, instance);
+            err = ExpandNextSubPath(temp, unresolved, state);
+            if (err != USP_ERR_OK)
+            {
+                goto exit;
+            }
+        }
+    }
+
+    // If the code gets here, then no matching unique key has been found
+    // It is not a parse error to find no instances of an object.
+    // The caller (USP message handler) will deal with the case of no objects found appropriately.
+    err = USP_ERR_OK;
+
+exit:
+    // Ensure that the key expressions and key-values are deleted
+    // NOTE: This is safe to do again here, even if they have already been deleted in the body of the function
+    INT_VECTOR_Destroy(&iv);
+    STR_VECTOR_Destroy(&key_expressions);
+    EXPR_VECTOR_Destroy(&keys);
+    USP_SAFE_FREE(compiled_keys);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** FindIndexedUniqueKey
+**
+** Determines whether the key expressions address the object by one of its registered unique keys, and
+** whether that unique key can be indexed
+** Only unique keys whose parameters are all string parameters stored in the database are indexed, since only the values
+** of these parameters are known to change solely via the data model (see PATH_RESOLVER_InvalidateUniqueKeyIndexes),
+** and string values are compared exactly (numeric values may have many textual representations eg '1' and '1.0')
+**
+** \param   keys - vector of key expressions that specify the unique key
+** \param   compiled_keys - array of compiled key expressions (one for each key expression)
+** \param   key_map - pointer to array in which to return the index of the key expression for each parameter in the unique key
+**
+** \return  pointer to registered unique key, or NULL if the key expressions cannot be resolved using a unique key index
+**
+**************************************************************************/
+dm_unique_key_t *FindIndexedUniqueKey(expr_vector_t *keys, compiled_key_t *compiled_keys, int *key_map)
+{
+    int i, j, k;
+    dm_compiled_expr_t *ce;
+    dm_node_t *obj_node;
+    dm_unique_key_vector_t *ukv;
+    dm_unique_key_t *unique_key;
+
+    // Exit if any of the key expressions is not an equality test of a string parameter stored in the database
+    for (i=0; i < keys->num_entries; i++)
+    {
+        ce = &compiled_keys[i].ce;
+        if ((ce->op != kExprOp_Equal) || (ce->type != kCompiledExprType_String))
+        {
+            return NULL;
+        }
+
+        switch(ce->node->type)
+        {
+            case kDMNodeType_DBParam_ReadWrite:
+            case kDMNodeType_DBParam_ReadOnly:
+            case kDMNodeType_DBParam_ReadOnlyAuto:
+            case kDMNodeType_DBParam_ReadWriteAuto:
+                break;
+
+            default:
+                return NULL;
+        }
+    }
+
+    // Iterate over all unique keys registered for the object, finding the one whose parameters match those in the key expressions
+    ce = &compiled_keys[0].ce;
+    obj_node = ce->inst.nodes[ce->inst_index];
+    ukv = &obj_node->registered.object_info.unique_keys;
+    for (i=0; i < ukv->num_entries; i++)
+    {
+        unique_key = &ukv->vector[i];
+        for (j=0; (j < MAX_COMPOUND_KEY_PARAMS) && (unique_key->param[j] != NULL); j++)
+        {
+            // Find the key expression referencing this parameter of the unique key
+            key_map[j] = -1;
+            for (k=0; k < keys->num_entries; k++)
+            {
+                if (strcmp(keys->vector[k].param, unique_key->param[j])==0)
+                {
+                    key_map[j] = k;
+                    break;
+                }
+            }
+
+            // Move to next unique key, if this parameter of the unique key is not referenced by the key expressions
+            if (key_map[j] == -1)
+            {
+                break;
+            }
+        }
+
+        // Exit if every parameter of this unique key is referenced by exactly one of the key expressions
+        // NOTE: The parameters in a unique key are all different, so this is the case if the number of parameters match
+        if ((j == keys->num_entries) && ((j == MAX_COMPOUND_KEY_PARAMS) || (unique_key->param[j] == NULL)))
+        {
+            return unique_key;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** GetUniqueKeyIndex
+**
+** Gets the index for the specified unique key of the specified object, building it if it does not already exist
+**
+** \param   object - data model path of object being searched by unique key
+** \param   unique_key - registered unique key to get the index of
+** \param   iv - pointer to vector containing all instance numbers of the object
+** \param   compiled_keys - array of compiled key expressions. Used to read the values of the unique key parameters
+** \param   key_map - array containing the index of the compiled key expression to use for each parameter in the unique key
+**
+** \return  pointer to unique key index, or NULL if the index could not be built
+**
+**************************************************************************/
+unique_key_index_t *GetUniqueKeyIndex(char *object, dm_unique_key_t *unique_key, int_vector_t *iv, compiled_key_t *compiled_keys, int *key_map)
+{
+    int i;
+    int path_hash;
+    unsigned generation;
+    unique_key_index_t *index;
+
+    // Discard all indexes held by this thread, if they are stale
+    generation = __atomic_load_n(&unique_key_generation, __ATOMIC_RELAXED);
+    if (generation != unique_key_indexes_generation)
+    {
+        FreeUniqueKeyIndexes();
+        unique_key_indexes_generation = generation;
+    }
+
+    // Exit if the index has already been built
+    path_hash = TEXT_UTILS_CalcHash(object);
+    for (i=0; i < num_unique_key_indexes; i++)
+    {
+        index = &unique_key_indexes[i];
+        if ((index->path_hash == path_hash) && (index->unique_key == unique_key) && (strcmp(index->obj_path, object)==0))
+        {
+            return index;
+        }
+    }
+
+    return BuildUniqueKeyIndex(object, path_hash, unique_key, iv, compiled_keys, key_map);
+}
+
+/*********************************************************************//**
+**
+** BuildUniqueKeyIndex
+**
+** Builds the index for the specified unique key of the specified object, by reading the unique key parameters of every instance
+**
+** \param   object - data model path of object being searched by unique key
+** \param   path_hash - hash of the data model path of the object
+** \param   unique_key - registered unique key to build the index of
+** \param   iv - pointer to vector containing all instance numbers of the object
+** \param   compiled_keys - array of compiled key expressions. Used to read the values of the unique key parameters
+** \param   key_map - array containing the index of the compiled key expression to use for each parameter in the unique key
+**
+** \return  pointer to unique key index, or NULL if the index could not be built
+**
+**************************************************************************/
+unique_key_index_t *BuildUniqueKeyIndex(char *object, int path_hash, dm_unique_key_t *unique_key, int_vector_t *iv, compiled_key_t *compiled_keys, int *key_map)
+{
+    int i, j;
+    int err;
+    int num_params;
+    int table_size;
+    int hash;
+    int slot;
+    compiled_key_t *ck;
+    char *values[MAX_COMPOUND_KEY_PARAMS];
+    unique_key_slot_t *table;
+    unique_key_index_t *index;
+
+    // Size the table to be at most half full, so that probe sequences are short
+    table_size = 16;
+    while (table_size < 2*iv->num_entries)
+    {
+        table_size *= 2;
+    }
+    table = USP_MALLOC(table_size*sizeof(unique_key_slot_t));
+    memset(table, 0, table_size*sizeof(unique_key_slot_t));
+
+    // Iterate over all instances of the object, adding them to the table
+    num_params = 0;
+    while ((num_params < MAX_COMPOUND_KEY_PARAMS) && (unique_key->param[num_params] != NULL))
+    {
+        num_params++;
+    }
+
+    for (i=0; i < iv->num_entries; i++)
+    {
+        // Exit if unable to get the values of the unique key parameters for this instance
+        // In this case, the instances are evaluated without using the index, which will report the error if necessary
+        for (j=0; j < num_params; j++)
+        {
+            ck = &compiled_keys[ key_map[j] ];
+            // NOTE: The values are hashed as textual strings, so must not be returned in their native type
+            err = DATA_MODEL_GetCompiledExprValue(&ck->ce, iv->vector[i], &ck->value, false);
+            if (err != USP_ERR_OK)
+            {
+                USP_FREE(table);
+                return NULL;
+            }
+            values[j] = ck->value.str;
+        }
+
+        // Add the instance to the first unused slot, starting from the slot selected by the hash
+        hash = CalcUniqueKeyHash(values, num_params);
+        slot = hash & (table_size-1);
+        while (table[slot].instance != 0)
+        {
+            slot = (slot + 1) & (table_size-1);
+        }
+        table[slot].hash = hash;
+        table[slot].instance = iv->vector[i];
+    }
+
+    // Add the index to the indexes held by this thread
+    unique_key_indexes = USP_REALLOC(unique_key_indexes, (num_unique_key_indexes+1)*sizeof(unique_key_index_t));
+    index = &unique_key_indexes[num_unique_key_indexes];
+    index->obj_path = USP_STRDUP(object);
+    index->path_hash = path_hash;
+    index->unique_key = unique_key;
+    index->table_size = table_size;
+    index->table = table;
+    num_unique_key_indexes++;
+
+    return index;
+}
+
+/*********************************************************************//**
+**
+** GetUniqueKeyIndexMatches
+**
+** Uses the specified unique key index to get the instances of the object that may match the key expressions
+** NOTE: The instances returned have unique key values with the same hash as the key expressions, so must still be
+**       evaluated against the key expressions, to rule out hash collisions
+**
+** \param   index - pointer to unique key index to use
+** \param   keys - vector of key expressions that specify the unique key
+** \param   key_map - array containing the index of the key expression for each parameter in the unique key
+** \param   iv - pointer to vector containing all instance numbers of the object. On return, this is replaced
+**               with the instance numbers that may match (in ascending order)
+**
+** \return  None
+**
+**************************************************************************/
+void GetUniqueKeyIndexMatches(unique_key_index_t *index, expr_vector_t *keys, int *key_map, int_vector_t *iv)
+{
+    int j;
+    int hash;
+    int slot;
+    char *values[MAX_COMPOUND_KEY_PARAMS];
+    unique_key_slot_t *table;
+
+    // Calculate the hash of the values in the key expressions, in the order of the parameters in the unique key
+    for (j=0; j < keys->num_entries; j++)
+    {
+        values[j] = keys->vector[ key_map[j] ].value;
     }
+    hash = CalcUniqueKeyHash(values, keys->num_entries);
 
-    // Exit if there are no instances of this object
-    if (iv.num_entries == 0)
+    // Replace the instances with those from all slots with the same hash, starting from the slot selected by the hash
+    INT_VECTOR_Destroy(iv);
+    table = index->table;
+    slot = hash & (index->table_size-1);
+    while (table[slot].instance != 0)
     {
-        err = USP_ERR_OK;
-        goto exit;
+        if (table[slot].hash == hash)
+        {
+            INT_VECTOR_Add(iv, table[slot].instance);
+        }
+        slot = (slot + 1) & (index->table_size-1);
     }
 
-    // Exit if the unique key is too long
-    len = p - unresolved;
-    if (len > MAX_DM_PATH-1)
+    // Ensure that instances are evaluated in the same order as if the index had not been used
+    if (iv->num_entries > 1)
     {
-        USP_ERR_SetMessage("%s: Unique Key too long (%s) in search path", __FUNCTION__, unresolved);
-        err = USP_ERR_INVALID_PATH_SYNTAX;
-        goto exit;
+        qsort(iv->vector, iv->num_entries, sizeof(int), CompareInstanceNumbers);
     }
+}
 
-    // Copy the unique key expressions (ie the expression within []) into temp
-    memcpy(temp, unresolved, len);
-    temp[len] = '\0';
-    unresolved = &p[1];
-
-    // If the code gets here, unresolved points to the character after ']', and temp contains the unique key expression
+/*********************************************************************//**
+**
+** CalcUniqueKeyHash
+**
+** Calculates the hash of the values of the parameters in a unique key
+**
+** \param   values - array of pointers to the values of the parameters in the unique key
+** \param   num_values - number of values in the array
+**
+** \return  hash value
+**
+**************************************************************************/
+int CalcUniqueKeyHash(char **values, int num_values)
+{
+    int i;
+    unsigned hash = 0;
 
-    // Exit if an error occurred whilst parsing the key expressions
-    err = EXPR_VECTOR_SplitExpressions(temp, &keys, "&&", valid_ops, NUM_ELEM(valid_ops), EXPR_FROM_USP);
-    if (err != USP_ERR_OK)
-    {
-        goto exit;
-    }
-    
-    // Exit if no key expressions were found
-    if (keys.num_entries == 0)
+    for (i=0; i < num_values; i++)
     {
-        USP_ERR_SetMessage("%s: No unique key found in search path before %s", __FUNCTION__, unresolved);
-        err = USP_ERR_INVALID_PATH_SYNTAX;
-        goto exit;
+        hash = (hash * 31) + (unsigned)TEXT_UTILS_CalcHash(values[i]);
     }
 
-    // Iterate over all instances of the object present in the data model
-    for (i=0; i < iv.num_entries; i++)
-    {
-        // Exit if an error occurred whilst trying to determine whether this instance matched the unique key
-        instance = iv.vector[i];
-        err = DoesInstanceMatchUniqueKey(resolved, instance, &keys, &is_match, state);
-        if (err != USP_ERR_OK)
-        {
-            goto exit;
-        }
+    return (int)hash;
+}
 
-        // If found an instance which matches, continue resolving the path recursively, selecting this instance
-        if (is_match)
-        {
-            USP_SNPRINTF(temp, sizeof(temp), "%s%d", resolved, instance);
-            err = ExpandNextSubPath(temp, unresolved, state);
-            if (err != USP_ERR_OK)
-            {
-                goto exit;
-            }
-        }
+/*********************************************************************//**
+**
+** FreeUniqueKeyIndexes
+**
+** Frees all unique key indexes held by this thread
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void FreeUniqueKeyIndexes(void)
+{
+    int i;
+
+    for (i=0; i < num_unique_key_indexes; i++)
+    {
+        USP_FREE(unique_key_indexes[i].obj_path);
+        USP_FREE(unique_key_indexes[i].table);
     }
 
-    // If the code gets here, then no matching unique key has been found
-    // It is not a parse error to find no instances of an object.
-    // The caller (USP message handler) will deal with the case of no objects found appropriately.
-    err = USP_ERR_OK;
+    USP_SAFE_FREE(unique_key_indexes);
+    num_unique_key_indexes = 0;
+}
 
-exit:
-    // Ensure that the key expressions and key-values are deleted
-    // NOTE: This is safe to do again here, even if they have already been deleted in the body of the function
-    INT_VECTOR_Destroy(&iv);
-    STR_VECTOR_Destroy(&key_expressions);
-    EXPR_VECTOR_Destroy(&keys);
-    return err;
+/*********************************************************************//**
+**
+** CompareInstanceNumbers
+**
+** qsort comparison function used to sort instance numbers into ascending order
+**
+** \param   p1 - pointer to first instance number to compare
+** \param   p2 - pointer to second instance number to compare
+**
+** \return  negative if the first instance number is the lowest, positive if it is the highest, 0 if they are the same
+**
+**************************************************************************/
+int CompareInstanceNumbers(const void *p1, const void *p2)
+{
+    int a = *((int *)p1);
+    int b = *((int *)p2);
+
+    return (a > b) - (a < b);
 }
 
 /*********************************************************************//**
@@ -727,63 +1620,117 @@ int ResolvePartialPath(char *path, resolver_state_t *state)
 
 /*********************************************************************//**
 **
-** DoesInstanceMatchUniqueKey
+** CompileUniqueKeys
 **
-** Determines whether the specified object instance matches the specified unique key
+** Compiles the key expressions of a unique key, so that they can be efficiently evaluated against every instance of the object
 **
-** \param   object - data model path of object to see if it matches the unique key
-** \param   instance - instance number of the object to see if it matches the unique key
+** \param   object - data model path of object being searched by unique key
+** \param   instance - instance number of any instance of the object. Used to locate the parameters in the key expressions
 ** \param   keys - vector of key expressions that specify the unique key
-** \param   is_match - pointer to boolean in which to return whether this instance matched the unique key
+** \param   compiled_keys - pointer to array (with one entry for each key expression) in which to return the compiled key expressions
+** \param   is_permitted - pointer to boolean in which to return whether the role is permitted to read all parameters in the unique key
+**                         NOTE: This is only returned false for operations which are forgiving of permissions (eg get)
 ** \param   state - pointer to structure containing state variables to use with this resolution
 **
 ** \return  USP_ERR_OK if no errors occurred
 **
 **************************************************************************/
-int DoesInstanceMatchUniqueKey(char *object, int instance, expr_vector_t *keys, bool *is_match, resolver_state_t *state)
+int CompileUniqueKeys(char *object, int instance, expr_vector_t *keys, compiled_key_t *compiled_keys, bool *is_permitted, resolver_state_t *state)
 {
     int err;
-    int i;
+    int i, j;
     expr_comp_t *ec;
-    char path[MAX_DM_PATH];
-    bool result;
-    unsigned short permission_bitmask;
+    compiled_key_t *ck;
 
-    // Assume that this instance does not match
-    *is_match = false;
+    // Assume that we are permitted to read all parameters in the unique key
+    *is_permitted = true;
 
-    // Iterate over all key expressions to match, exiting on the first one which isn't true
     for (i=0; i < keys->num_entries; i++)
     {
-        // Form parameter path of the unique key to check
+        // Exit if unable to compile the key expression
         ec = &keys->vector[i];
-        USP_SNPRINTF(path, sizeof(path), "%s%d.%s", object, instance, ec->param);
-
-        // Exit if unable to determine whether we are allowed to read the unique key
-        err = DATA_MODEL_GetPermissions(path, state->combined_role, &permission_bitmask);
+        ck = &compiled_keys[i];
+        err = DATA_MODEL_CompileExpression(object, instance, ec->param, ec->op, ec->value, state->combined_role, &ck->ce);
         if (err != USP_ERR_OK)
         {
             return err;
         }
-        
+
         // Exit if not permitted to read the parameter in the unique key
-        if ((permission_bitmask & PERMIT_GET) == 0)
+        // NOTE: Permissions are determined by the parameter's node, so are the same for all instances of the object
+        if ((ck->ce.permission_bitmask & PERMIT_GET) == 0)
         {
-            // Get operations are forgiving of permissions, so just give up further resolution here, 
-            // returning that this instance does not match
+            // Get operations are forgiving of permissions, so just give up further resolution here,
+            // returning that no instances match
             // NOTE: BulkData get operations are not forgiving of permissions, so will return an error
             if ((state->op == kResolveOp_Get) || (state->op == kResolveOp_SubsValChange))
             {
+                *is_permitted = false;
                 return USP_ERR_OK;
             }
-        
+
             // Other operations are not forgiving, so return an error
-            USP_ERR_SetMessage("%s: Not permitted to read unique key %s", __FUNCTION__, path);
+            USP_ERR_SetMessage("%s: Not permitted to read unique key %s%d.%s", __FUNCTION__, object, instance, ec->param);
             return USP_ERR_PERMISSION_DENIED;
         }
 
+        // Share the value of the parameter with an earlier key expression referencing the same parameter (eg 'X>1&&X<5')
+        ck->value_index = i;
+        for (j=0; j < i; j++)
+        {
+            if (strcmp(keys->vector[j].param, ec->param)==0)
+            {
+                ck->value_index = j;
+                break;
+            }
+        }
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** DoesInstanceMatchUniqueKey
+**
+** Determines whether the specified object instance matches the specified unique key
+**
+** \param   instance - instance number of the object to see if it matches the unique key
+** \param   compiled_keys - array of compiled key expressions that specify the unique key
+** \param   num_keys - number of compiled key expressions in the array
+** \param   is_match - pointer to boolean in which to return whether this instance matched the unique key
+**
+** \return  USP_ERR_OK if no errors occurred
+**
+**************************************************************************/
+int DoesInstanceMatchUniqueKey(int instance, compiled_key_t *compiled_keys, int num_keys, bool *is_match)
+{
+    int err;
+    int i;
+    compiled_key_t *ck;
+    bool result;
+
+    // Assume that this instance does not match
+    *is_match = false;
+
+    // Iterate over all key expressions to match, exiting on the first one which isn't true
+    for (i=0; i < num_keys; i++)
+    {
+        // Exit if unable to get the value of the parameter in the expression
+        // NOTE: If an earlier key expression references the same parameter, then its value has already been read for this instance
+        // (since all earlier key expressions must have been true to get here), so is not read again
+        ck = &compiled_keys[i];
+        if (ck->value_index == i)
+        {
+            err = DATA_MODEL_GetCompiledExprValue(&ck->ce, instance, &ck->value, true);
+            if (err != USP_ERR_OK)
+            {
+                return err;
+            }
+        }
+
         // Exit if unable to compare the value of the parameter in the expression
-        err = DATA_MODEL_CompareParameterValue(path, ec->op, ec->value, &result);
+        err = DATA_MODEL_EvaluateCompiledExpr(&ck->ce, &compiled_keys[ck->value_index].value, &result);
         if (err != USP_ERR_OK)
         {
             return err;
@@ -923,11 +1870,15 @@ int GetChildParams(char *path, int path_len, dm_node_t *node, dm_instances_t *in
         }
 
 
-        // Add this node, if permissions have allowed it and we are returning a vector
-        if ((add_to_vector) && (state->sv != NULL))
+        // Add this node, if permissions have allowed it and we are returning the resolved paths
+        if (add_to_vector)
         {
             USP_SNPRINTF(&path[path_len], MAX_DM_PATH-path_len, ".%s", child->name);
-            STR_VECTOR_Add(state->sv, path);
+            err = ReportPathFound(path, child, inst, state);
+            if (err != USP_ERR_OK)
+            {
+                return err;
+            }
         }
 
         // Move to next sibling in the data model tree
@@ -1026,9 +1977,14 @@ int AddPathFound(char *path, resolver_state_t *state)
     int err;
     bool add_to_vector;
     unsigned path_properties;
+    str_vector_t *sv;
+    str_vector_t instance_paths;
+    dm_node_t *node;
+    dm_instances_t inst;
 
     // Exit if the path did not match the properties we expected of it
-    err = CheckPathProperties(path, state, &add_to_vector, &path_properties);
+    STR_VECTOR_Init(&instance_paths);
+    err = CheckPathProperties(path, state, &add_to_vector, &path_properties, &node, &inst);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -1040,40 +1996,61 @@ int AddPathFound(char *path, resolver_state_t *state)
         return USP_ERR_OK;
     }
 
-    // Exit if we are just validating the search path, and don't actually want to add the path to the returned vector
-    if (state->sv == NULL)
+    // Exit if we are just validating the search path, and don't actually want to return the path
+    if ((state->sv == NULL) && (state->cb == NULL))
     {
         return USP_ERR_OK;
     }
 
     // Handle a Subscription ReferenceList which just references the name of the multi-instance object (unqualified)
     // NOTE: If it references a single specific object instance then the normal code at the end of the function is run instead
+    // NOTE: If the resolved paths are being passed to a callback, then the instance paths are gathered into a vector first
     if ( ((state->op == kResolveOp_SubsAdd) || (state->op == kResolveOp_SubsDel)) &&
          ((path_properties & PP_IS_OBJECT_INSTANCE) == 0) )
     {
         USP_ASSERT(path_properties & PP_IS_MULTI_INSTANCE_OBJECT);
-        err = DATA_MODEL_GetInstancePaths(path, state->sv, INTERNAL_ROLE);  // NOTE: We can use internal role because we've already checked permissions on this object
-                                                                            //       and we don't want it to check get object instance permissions anyway for subscription add/delete paths
-        return err;
+        sv = (state->cb != NULL) ? &instance_paths : state->sv;
+        err = DATA_MODEL_GetInstancePaths(path, sv, (state->cb != NULL) ? NULL : &state->sv_index, INTERNAL_ROLE);  // NOTE: We can use internal role because we've already checked permissions on this object
+                                                                     //       and we don't want it to check get object instance permissions anyway for subscription add/delete paths
+        goto exit;
     }
 
     // Handle resolving GetInstances
     if (state->op == kResolveOp_Instances)
     {
+        sv = (state->cb != NULL) ? &instance_paths : state->sv;
         if (state->flags & GET_ALL_INSTANCES)
         {
-            err = DATA_MODEL_GetAllInstancePaths(path, state->sv, state->combined_role);
+            err = DATA_MODEL_GetAllInstancePaths(path, sv, state->combined_role);
         }
         else
         {
-            err = DATA_MODEL_GetInstancePaths(path, state->sv, state->combined_role);
+            err = DATA_MODEL_GetInstancePaths(path, sv, (state->cb != NULL) ? NULL : &state->sv_index, state->combined_role);
         }
-        return err;
+        goto exit;
+    }
+
+    // Handle passing the path to a callback
+    if (state->cb != NULL)
+    {
+        // Exit if this path has already been passed to the callback
+        // NOTE: Only reference following can resolve the same path more than once, so the paths
+        //       passed to the callback are only remembered if reference following has been performed
+        if (state->is_dup_possible)
+        {
+            if (STR_SET_AddIfNotExist(&state->cb_paths_index, &state->cb_paths, path) == false)
+            {
+                return USP_ERR_OK;
+            }
+        }
+
+        // NOTE: The node and instance numbers parsed from the path by CheckPathProperties() are passed to the callback
+        return ReportPathFound(path, node, &inst, state);
     }
 
     // Normal execution path below
     // Exit if the path already exists in the vector
-    index = STR_VECTOR_Find(state->sv, path);
+    index = STR_SET_Find(&state->sv_index, state->sv, path);
     if (index != INVALID)
     {        
         return USP_ERR_OK;
@@ -1082,6 +2059,99 @@ int AddPathFound(char *path, resolver_state_t *state)
     // Finally add the single path to the vector
     STR_VECTOR_Add(state->sv, path);
 
+    return USP_ERR_OK;
+
+exit:
+    // Pass the instance paths to the callback (if the paths are being passed to a callback)
+    if ((err == USP_ERR_OK) && (state->cb != NULL))
+    {
+        err = ReportInstancePaths(&instance_paths, state);
+    }
+
+    STR_VECTOR_Destroy(&instance_paths);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** ReportPathFound
+**
+** Returns a path which has been resolved, either by adding it to the vector of resolved paths,
+** or by passing it to the callback (depending on how the path resolver was called)
+**
+** \param   path - resolved path
+** \param   node - pointer to node in the data model schema representing the resolved path
+** \param   inst - pointer to instance numbers of the resolved path
+** \param   state - pointer to structure containing state variables to use with this resolution
+**
+** \return  USP_ERR_OK if path resolution should continue
+**
+**************************************************************************/
+int ReportPathFound(char *path, dm_node_t *node, dm_instances_t *inst, resolver_state_t *state)
+{
+    if (state->cb != NULL)
+    {
+        return state->cb(path, node, inst, state->separator_count, state->cb_arg);
+    }
+
+    if (state->sv != NULL)
+    {
+        STR_VECTOR_Add(state->sv, path);
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ReportInstancePaths
+**
+** Passes each of the specified object instance paths to the callback
+** NOTE: If reference following has been performed, then instance paths already passed to the callback are not passed again
+**
+** \param   sv - pointer to vector containing the object instance paths
+** \param   state - pointer to structure containing state variables to use with this resolution
+**
+** \return  USP_ERR_OK if path resolution should continue
+**
+**************************************************************************/
+int ReportInstancePaths(str_vector_t *sv, resolver_state_t *state)
+{
+    int i;
+    int err;
+    char *path;
+    dm_node_t *node;
+    dm_instances_t inst;
+    bool is_qualified_instance;
+
+    for (i=0; i < sv->num_entries; i++)
+    {
+        // Skip this path if it has already been passed to the callback
+        path = sv->vector[i];
+        if (state->is_dup_possible)
+        {
+            if (STR_SET_AddIfNotExist(&state->cb_paths_index, &state->cb_paths, path) == false)
+            {
+                continue;
+            }
+        }
+
+        // Exit if the path is not in the schema. This should not occur, as the paths were obtained from the data model
+        node = DM_PRIV_GetNodeFromPath(path, &inst, &is_qualified_instance);
+        if (node == NULL)
+        {
+            USP_ERR_SetMessage("%s: Path (%s) does not exist in the schema", __FUNCTION__, path);
+            return USP_ERR_INVALID_PATH;
+        }
+
+        // Exit if the callback requested that path resolution should stop
+        err = state->cb(path, node, &inst, state->separator_count, state->cb_arg);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
     return USP_ERR_OK;
 }
 
@@ -1095,6 +2165,8 @@ int AddPathFound(char *path, resolver_state_t *state)
 ** \param   state - pointer to structure containing state variables to use with this resolution
 ** \param   add_to_vector - pointer to variable in which to return if the path should be added to the vector of resolved objects/parameters
 ** \param   path_properties - pointer to variable in which to return the properties of the resolved object/parameter
+** \param   p_node - pointer to variable in which to return the node in the data model schema representing the path
+** \param   inst - pointer to variable in which to return the instance numbers parsed from the path
 **
 ** \return  USP_ERR_OK if path resolution should continue
 **          
@@ -1102,17 +2174,20 @@ int AddPathFound(char *path, resolver_state_t *state)
 **                continues, even if this path is not suitable for inclusion in the result vector
 **
 **************************************************************************/
-int CheckPathProperties(char *path, resolver_state_t *state, bool *add_to_vector, unsigned *path_properties)
+int CheckPathProperties(char *path, resolver_state_t *state, bool *add_to_vector, unsigned *path_properties, dm_node_t **p_node, dm_instances_t *inst)
 {
     unsigned flags;
     int err;
     unsigned short permission_bitmask;
+    bool is_qualified_instance;
 
     // Assume that the path should be added to the vector
     *add_to_vector = false;
 
     // Exit if the path does not exist in the schema
-    flags = DATA_MODEL_GetPathProperties(path, state->combined_role, &permission_bitmask);
+    // NOTE: The node and instance numbers are returned, so that the caller does not have to parse the path again
+    *p_node = DM_PRIV_GetNodeFromPath(path, inst, &is_qualified_instance);
+    flags = DATA_MODEL_GetNodePathProperties(*p_node, inst, is_qualified_instance, state->combined_role, &permission_bitmask);
     *path_properties = flags;
     if ((flags & PP_EXISTS_IN_SCHEMA)==0)
     {
@@ -1420,18 +2495,73 @@ int CheckPathProperties(char *path, resolver_state_t *state, bool *add_to_vector
 **************************************************************************/
 int CountPathSeparator(char *path)
 {
-    char *p = path;
+    char *p;
     int count = 0;
 
-    // Iterate over all characters in the path, counting the number of '.' characters in the string
-    while (*p != '\0')
+    // Iterate over all '.' characters in the path, counting them
+    // NOTE: strchr() is used, as the C library implementation typically scans more than one character at a time
+    p = strchr(path, '.');
+    while (p != NULL)
+    {
+        count++;
+        p = strchr(p+1, '.');
+    }
+
+    return count;
+}
+
+/*********************************************************************//**
+**
+** GetObjectInstances
+**
+** Gets a vector of instance numbers for the specified object, using the cache if it is enabled
+**
+** \param   path - unqualified path of the multi-instance object
+** \param   iv - pointer to structure in which to return the instance numbers
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int GetObjectInstances(char *path, int_vector_t *iv)
+{
+    int i;
+    int err;
+    int path_hash;
+    resolver_cache_entry_t *entry;
+
+    // If the cache is not enabled, then just get the instances directly from the data model
+    if (is_resolver_cache_enabled == false)
     {
-        if (*p == '.')
+        return DATA_MODEL_GetInstances(path, iv);
+    }
+
+    // Exit if the instances of this object have already been cached
+    path_hash = TEXT_UTILS_CalcHash(path);
+    for (i=0; i < resolver_cache_num_entries; i++)
+    {
+        entry = &resolver_cache[i];
+        if ((entry->path_hash == path_hash) && (strcmp(entry->obj_path, path)==0))
         {
-            count++;
+            INT_VECTOR_Clone(iv, &entry->iv);
+            return USP_ERR_OK;
         }
-        p++;
     }
 
-    return count;
+    // Exit if unable to get the instances from the data model
+    // NOTE: Errors are not cached, as the error message needs to be set each time
+    err = DATA_MODEL_GetInstances(path, iv);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Add the instances to the cache
+    resolver_cache = USP_REALLOC(resolver_cache, (resolver_cache_num_entries+1)*sizeof(resolver_cache_entry_t));
+    entry = &resolver_cache[resolver_cache_num_entries];
+    entry->obj_path = USP_STRDUP(path);
+    entry->path_hash = path_hash;
+    INT_VECTOR_Clone(&entry->iv, iv);
+    resolver_cache_num_entries++;
+
+    return USP_ERR_OK;
 }
@@ -42,6 +42,7 @@
 #define PATH_RESOLVER_H
 
 #include "str_vector.h"
+#include "data_model.h"
 
 // Enumeration determining what we are attempting to resolve with the path expression
 // This affects whether the path is valid, along with which object/parameter paths are returned
@@ -71,9 +72,27 @@ typedef enum
 // Bitmask for the flags argument of PATH_RESOLVER_ResolvePath(). Thse flags control resolving of the path
 #define GET_ALL_INSTANCES 0x0001
 
+//-----------------------------------------------------------------------------------------
+// Callback called by PATH_RESOLVER_ResolvePathWithCallback() for each resolved path
+// The node and instance numbers of the resolved path are passed to the callback, so that it does not have to look them up from the path
+// separator_split denotes where to split the resolved path (see PATH_RESOLVER_ResolvePath)
+// NOTE: The path and instance numbers are only valid for the duration of the callback
+// Returning an error from the callback stops path resolution
+typedef int (*resolved_path_cb_t)(char *path, dm_node_t *node, dm_instances_t *inst, int separator_split, void *cb_arg);
+
 // API
 int PATH_RESOLVER_ResolveDevicePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags);
 int PATH_RESOLVER_ResolvePath(char *path, str_vector_t *sv, resolve_op_t op, int *separator_split, combined_role_t *combined_role, unsigned flags);
+int PATH_RESOLVER_ResolveDevicePathWithCallback(char *path, resolved_path_cb_t cb, void *cb_arg, resolve_op_t op, combined_role_t *combined_role, unsigned flags);
+int PATH_RESOLVER_ResolvePathWithCallback(char *path, resolved_path_cb_t cb, void *cb_arg, resolve_op_t op, combined_role_t *combined_role, unsigned flags);
+int PATH_RESOLVER_ResolveDevicePathToNodes(char *path, dm_resolved_path_vector_t *rpv, resolve_op_t op, combined_role_t *combined_role, unsigned flags);
+void PATH_RESOLVER_InitResolvedPaths(dm_resolved_path_vector_t *rpv);
+void PATH_RESOLVER_DestroyResolvedPaths(dm_resolved_path_vector_t *rpv);
+void PATH_RESOLVER_EnableCache(void);
+void PATH_RESOLVER_DisableCache(void);
+void PATH_RESOLVER_InvalidateCache(void);
+void PATH_RESOLVER_InvalidateUniqueKeyIndexes(void);
+int PATH_RESOLVER_FindUniqueKeyInstances(char *object, char *param, char *value, int_vector_t *matches, bool *is_indexed);
 
 
 
@@ -0,0 +1,3336 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file proto_codec.c
+ *
+ * Specialized serialization and parsing of the most common USP messages and USP records
+ *
+ * protobuf-c serializes and parses every message by walking the field descriptor table of each message type.
+ * The functions in this file instead hard code the fields of the USP message types which are exchanged most often
+ * (Get, GetResp, Set, SetResp, Notify, NotifyResp, Error and the No Session Context USP record), so that the
+ * compiler can inline the encoding of each field. All other message types are handled by protobuf-c.
+ *
+ * The output of the pack functions is byte for byte identical to that of protobuf-c (fields are serialized in
+ * the same order, with the same proto3 rules for omitting fields with default values).
+ * The unpack functions produce structures which are freed by the normal protobuf-c free_unpacked() functions.
+ * If the unpack functions encounter anything unexpected (eg unknown fields, repeated occurrences of a singular field,
+ * or a malformed message), they fall back to protobuf-c, so that the result is always identical to protobuf-c's.
+ *
+ * When packing, the size of each sub message is calculated once, and stored (in pre-order) in a size cache,
+ * which is then read back in the same order when the sub message headers are written. protobuf-c instead
+ * recalculates the size of each sub message at every level of nesting.
+ *
+ * These functions are used by USP Agent if ENABLE_SPECIALIZED_PROTOBUF is defined in vendor_defs.h (see proto_codec.h)
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <protobuf-c/protobuf-c.h>
+
+#include "common_defs.h"
+#include "proto_codec.h"
+
+//------------------------------------------------------------------------------------
+// Wire types used by the fields of the messages handled by this file
+#define WIRE_TYPE_VARINT    0
+#define WIRE_TYPE_FIXED64   1
+#define WIRE_TYPE_LEN       2
+#define WIRE_TYPE_FIXED32   5
+
+// Field numbers of the messages handled by this file are all less than this
+// This means that the tag of each field fits in a single byte
+#define MAX_FIELDS 16
+
+// Forms the tag of a field
+#define TAG(field, wire_type)  ((uint8_t)(((field) << 3) | (wire_type)))
+
+//------------------------------------------------------------------------------------
+// Cache of the sizes of sub messages, filled in when calculating the size of a message to pack, then read back (in the same order) when packing it
+#define NUM_STATIC_SIZES 256
+typedef struct
+{
+    size_t *sizes;                          // Array of sizes of each (sub) message, in pre-order. Points to static_sizes, or to a dynamically allocated array
+    int num_entries;                        // Number of entries in the sizes array, filled in when calculating sizes
+    int max_entries;                        // Number of entries allocated in the sizes array
+    int read_index;                         // Index of the next entry to read, when packing
+    size_t static_sizes[NUM_STATIC_SIZES];  // Initial storage for the sizes array, to avoid a dynamic allocation for small messages
+} codec_sizes_t;
+
+//------------------------------------------------------------------------------------
+// Position within the serialized message being parsed
+typedef struct
+{
+    const uint8_t *p;           // Pointer to the next byte to parse
+    const uint8_t *end;         // Pointer to the byte after the end of the (sub) message being parsed
+} codec_reader_t;
+
+// Settings used whilst unpacking a message
+typedef struct
+{
+    ProtobufCAllocator *allocator;  // Allocator to use for the unpacked structures. NULL = use malloc()
+    bool bytes_in_place;            // Set if bytes fields reference the serialized message, rather than being copied
+} codec_unpack_t;
+
+//------------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+size_t Codec_SizeUnknown(const ProtobufCMessage *msg);
+uint8_t *Codec_PackUnknown(const ProtobufCMessage *msg, uint8_t *p);
+size_t Codec_SizeGeneric(const ProtobufCMessage *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackGeneric(const ProtobufCMessage *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeMapEntry(const ProtobufCMessage *base, const char *key, const char *value, codec_sizes_t *cs);
+uint8_t *Codec_PackMapEntry(const ProtobufCMessage *base, const char *key, const char *value, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeMsg(const Usp__Msg *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackMsg(const Usp__Msg *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeHeader(const Usp__Header *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackHeader(const Usp__Header *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeBody(const Usp__Body *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackBody(const Usp__Body *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeRequest(const Usp__Request *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackRequest(const Usp__Request *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeResponse(const Usp__Response *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackResponse(const Usp__Response *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeError(const Usp__Error *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackError(const Usp__Error *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeErrorParamError(const Usp__Error__ParamError *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackErrorParamError(const Usp__Error__ParamError *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeGet(const Usp__Get *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackGet(const Usp__Get *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeGetResp(const Usp__GetResp *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackGetResp(const Usp__GetResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeRequestedPathResult(const Usp__GetResp__RequestedPathResult *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackRequestedPathResult(const Usp__GetResp__RequestedPathResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeResolvedPathResult(const Usp__GetResp__ResolvedPathResult *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackResolvedPathResult(const Usp__GetResp__ResolvedPathResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeSet(const Usp__Set *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackSet(const Usp__Set *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeUpdateObject(const Usp__Set__UpdateObject *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackUpdateObject(const Usp__Set__UpdateObject *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeUpdateParamSetting(const Usp__Set__UpdateParamSetting *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackUpdateParamSetting(const Usp__Set__UpdateParamSetting *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeSetResp(const Usp__SetResp *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackSetResp(const Usp__SetResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeUpdatedObjectResult(const Usp__SetResp__UpdatedObjectResult *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackUpdatedObjectResult(const Usp__SetResp__UpdatedObjectResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeOperationStatus(const Usp__SetResp__UpdatedObjectResult__OperationStatus *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackOperationStatus(const Usp__SetResp__UpdatedObjectResult__OperationStatus *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeOperationFailure(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackOperationFailure(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeOperationSuccess(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackOperationSuccess(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeUpdatedInstanceFailure(const Usp__SetResp__UpdatedInstanceFailure *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackUpdatedInstanceFailure(const Usp__SetResp__UpdatedInstanceFailure *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeUpdatedInstanceResult(const Usp__SetResp__UpdatedInstanceResult *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackUpdatedInstanceResult(const Usp__SetResp__UpdatedInstanceResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeSetParameterError(const Usp__SetResp__ParameterError *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackSetParameterError(const Usp__SetResp__ParameterError *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeNotify(const Usp__Notify *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackNotify(const Usp__Notify *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeEvent(const Usp__Notify__Event *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackEvent(const Usp__Notify__Event *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeValueChange(const Usp__Notify__ValueChange *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackValueChange(const Usp__Notify__ValueChange *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeNotifyResp(const Usp__NotifyResp *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackNotifyResp(const Usp__NotifyResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeRecord(const UspRecord__Record *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackRecord(const UspRecord__Record *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+size_t Codec_SizeNoSessionContext(const UspRecord__NoSessionContextRecord *msg, codec_sizes_t *cs);
+uint8_t *Codec_PackNoSessionContext(const UspRecord__NoSessionContextRecord *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs);
+void InitSizes(codec_sizes_t *cs);
+void GrowSizes(codec_sizes_t *cs);
+void FreeSizes(codec_sizes_t *cs);
+void *Codec_Alloc(codec_unpack_t *u, size_t size);
+bool Codec_AllocArray(codec_unpack_t *u, unsigned count, size_t elem_size, void *parray);
+bool Codec_CountFields(codec_reader_t r, unsigned *counts);
+bool Codec_GetString(codec_unpack_t *u, codec_reader_t *r, int wire_type, char **pstr);
+bool Codec_GetSingularString(codec_unpack_t *u, codec_reader_t *r, int wire_type, char **pstr);
+bool Codec_GetBytes(codec_unpack_t *u, codec_reader_t *r, int wire_type, ProtobufCBinaryData *bd);
+bool Codec_GetSubMessage(codec_reader_t *r, int wire_type, void *msg, codec_reader_t *sub);
+bool Codec_UnpackGeneric(codec_unpack_t *u, codec_reader_t *r, const ProtobufCMessageDescriptor *desc, void *pmsg);
+bool Codec_UnpackMapEntry(codec_unpack_t *u, codec_reader_t *r, const ProtobufCMessageDescriptor *desc, void *pmsg);
+bool Codec_UnpackMsg(codec_unpack_t *u, codec_reader_t *r, Usp__Msg **pmsg);
+bool Codec_UnpackHeader(codec_unpack_t *u, codec_reader_t *r, Usp__Header **pmsg);
+bool Codec_UnpackBody(codec_unpack_t *u, codec_reader_t *r, Usp__Body **pmsg);
+bool Codec_UnpackRequest(codec_unpack_t *u, codec_reader_t *r, Usp__Request **pmsg);
+bool Codec_UnpackResponse(codec_unpack_t *u, codec_reader_t *r, Usp__Response **pmsg);
+bool Codec_UnpackError(codec_unpack_t *u, codec_reader_t *r, Usp__Error **pmsg);
+bool Codec_UnpackErrorParamError(codec_unpack_t *u, codec_reader_t *r, Usp__Error__ParamError **pmsg);
+bool Codec_UnpackGet(codec_unpack_t *u, codec_reader_t *r, Usp__Get **pmsg);
+bool Codec_UnpackGetResp(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp **pmsg);
+bool Codec_UnpackRequestedPathResult(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp__RequestedPathResult **pmsg);
+bool Codec_UnpackResolvedPathResult(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp__ResolvedPathResult **pmsg);
+bool Codec_UnpackSet(codec_unpack_t *u, codec_reader_t *r, Usp__Set **pmsg);
+bool Codec_UnpackUpdateObject(codec_unpack_t *u, codec_reader_t *r, Usp__Set__UpdateObject **pmsg);
+bool Codec_UnpackUpdateParamSetting(codec_unpack_t *u, codec_reader_t *r, Usp__Set__UpdateParamSetting **pmsg);
+bool Codec_UnpackNotify(codec_unpack_t *u, codec_reader_t *r, Usp__Notify **pmsg);
+bool Codec_UnpackEvent(codec_unpack_t *u, codec_reader_t *r, Usp__Notify__Event **pmsg);
+bool Codec_UnpackValueChange(codec_unpack_t *u, codec_reader_t *r, Usp__Notify__ValueChange **pmsg);
+bool Codec_UnpackNotifyResp(codec_unpack_t *u, codec_reader_t *r, Usp__NotifyResp **pmsg);
+bool Codec_UnpackRecord(codec_unpack_t *u, codec_reader_t *r, UspRecord__Record **pmsg);
+bool Codec_UnpackNoSessionContext(codec_unpack_t *u, codec_reader_t *r, UspRecord__NoSessionContextRecord **pmsg);
+UspRecord__Record *UnpackRecord(ProtobufCAllocator *allocator, size_t len, const uint8_t *data, bool bytes_in_place);
+
+//------------------------------------------------------------------------------------
+// Primitives for calculating the size of fields and for serializing them
+// NOTE: These are static inline, so that they are inlined into the pack and size functions of each message type
+static inline size_t VarintSize(uint64_t value)
+{
+    size_t len = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        len++;
+    }
+
+    return len;
+}
+
+static inline uint8_t *PutVarint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+
+    return p;
+}
+
+// Size of a length delimited field (tag, length and contents)
+static inline size_t LenDelimSize(size_t len)
+{
+    return 1 + VarintSize(len) + len;
+}
+
+static inline uint8_t *PutLenDelim(uint8_t *p, uint8_t tag, const void *data, size_t len)
+{
+    *p++ = tag;
+    p = PutVarint(p, len);
+    memcpy(p, data, len);
+    return p + len;
+}
+
+// Strings which are not repeated are omitted if empty (proto3)
+static inline size_t StringSize(const char *s)
+{
+    return ((s == NULL) || (*s == '\0')) ? 0 : LenDelimSize(strlen(s));
+}
+
+static inline uint8_t *PutString(uint8_t *p, uint8_t tag, const char *s)
+{
+    return ((s == NULL) || (*s == '\0')) ? p : PutLenDelim(p, tag, s, strlen(s));
+}
+
+// Each element of a repeated string is always serialized, even if empty
+static inline size_t RepeatedStringSize(const char *s)
+{
+    return LenDelimSize((s == NULL) ? 0 : strlen(s));
+}
+
+static inline uint8_t *PutRepeatedString(uint8_t *p, uint8_t tag, const char *s)
+{
+    return (s == NULL) ? PutLenDelim(p, tag, "", 0) : PutLenDelim(p, tag, s, strlen(s));
+}
+
+static inline size_t BytesSize(const ProtobufCBinaryData *bd)
+{
+    return (bd->len == 0) ? 0 : LenDelimSize(bd->len);
+}
+
+static inline uint8_t *PutBytes(uint8_t *p, uint8_t tag, const ProtobufCBinaryData *bd)
+{
+    return (bd->len == 0) ? p : PutLenDelim(p, tag, bd->data, bd->len);
+}
+
+static inline size_t Fixed32Size(uint32_t value)
+{
+    return (value == 0) ? 0 : 5;
+}
+
+static inline uint8_t *PutFixed32(uint8_t *p, uint8_t tag, uint32_t value)
+{
+    if (value == 0)
+    {
+        return p;
+    }
+
+    p[0] = tag;
+    p[1] = (uint8_t) value;
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)(value >> 16);
+    p[4] = (uint8_t)(value >> 24);
+    return p + 5;
+}
+
+static inline size_t BoolSize(protobuf_c_boolean value)
+{
+    return (value == 0) ? 0 : 2;
+}
+
+static inline uint8_t *PutBool(uint8_t *p, uint8_t tag, protobuf_c_boolean value)
+{
+    if (value == 0)
+    {
+        return p;
+    }
+
+    p[0] = tag;
+    p[1] = 1;
+    return p + 2;
+}
+
+// Enums are encoded as int32 varints, so negative values are sign extended to 64 bits
+static inline size_t EnumSize(int value)
+{
+    return (value == 0) ? 0 : 1 + VarintSize((uint64_t)(int64_t) value);
+}
+
+static inline uint8_t *PutEnum(uint8_t *p, uint8_t tag, int value)
+{
+    if (value == 0)
+    {
+        return p;
+    }
+
+    *p++ = tag;
+    return PutVarint(p, (uint64_t)(int64_t) value);
+}
+
+// Reserves the next entry in the size cache for a (sub) message, returning its index
+// NOTE: The size cache is not used when only calculating the size of a message (cs=NULL)
+static inline int ReserveSize(codec_sizes_t *cs)
+{
+    if (cs == NULL)
+    {
+        return -1;
+    }
+
+    if (cs->num_entries == cs->max_entries)
+    {
+        GrowSizes(cs);
+    }
+
+    return cs->num_entries++;
+}
+
+static inline size_t RecordSize(codec_sizes_t *cs, int index, size_t size)
+{
+    if (cs != NULL)
+    {
+        cs->sizes[index] = size;
+    }
+
+    return size;
+}
+
+// Reads the size of the next (sub) message to pack from the size cache, and writes its tag and length (unless it is the top level message)
+static inline uint8_t *PutHeader(uint8_t *p, uint8_t tag, codec_sizes_t *cs)
+{
+    size_t size;
+
+    size = cs->sizes[cs->read_index++];
+    if (tag != 0)
+    {
+        *p++ = tag;
+        p = PutVarint(p, size);
+    }
+
+    return p;
+}
+
+//------------------------------------------------------------------------------------
+// Primitives for parsing fields
+static inline bool GetVarint(codec_reader_t *r, uint64_t *value)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    while ((r->p < r->end) && (shift < 64))
+    {
+        b = *r->p++;
+        v |= ((uint64_t)(b & 0x7F)) << shift;
+        if ((b & 0x80) == 0)
+        {
+            *value = v;
+            return true;
+        }
+        shift += 7;
+    }
+
+    return false;
+}
+
+// NOTE: Field numbers larger than any handled by this file are returned as MAX_FIELDS
+static inline bool GetTag(codec_reader_t *r, int *field, int *wire_type)
+{
+    uint64_t tag;
+
+    if (GetVarint(r, &tag) == false)
+    {
+        return false;
+    }
+
+    if ((tag >> 3) == 0)
+    {
+        return false;
+    }
+
+    *field = ((tag >> 3) < MAX_FIELDS) ? (int)(tag >> 3) : MAX_FIELDS;
+    *wire_type = (int)(tag & 7);
+    return true;
+}
+
+static inline bool GetLenDelim(codec_reader_t *r, codec_reader_t *sub)
+{
+    uint64_t len;
+
+    if ((GetVarint(r, &len) == false) || (len > (uint64_t)(r->end - r->p)))
+    {
+        return false;
+    }
+
+    sub->p = r->p;
+    sub->end = r->p + len;
+    r->p += len;
+    return true;
+}
+
+static inline bool GetFixed32(codec_reader_t *r, int wire_type, uint32_t *value)
+{
+    if ((wire_type != WIRE_TYPE_FIXED32) || (r->end - r->p < 4))
+    {
+        return false;
+    }
+
+    *value = (uint32_t)r->p[0] | ((uint32_t)r->p[1] << 8) | ((uint32_t)r->p[2] << 16) | ((uint32_t)r->p[3] << 24);
+    r->p += 4;
+    return true;
+}
+
+static inline bool GetBool(codec_reader_t *r, int wire_type, protobuf_c_boolean *value)
+{
+    uint64_t v;
+
+    if ((wire_type != WIRE_TYPE_VARINT) || (GetVarint(r, &v) == false))
+    {
+        return false;
+    }
+
+    *value = (v != 0);
+    return true;
+}
+
+static inline bool GetEnum(codec_reader_t *r, int wire_type, int *value)
+{
+    uint64_t v;
+
+    if ((wire_type != WIRE_TYPE_VARINT) || (GetVarint(r, &v) == false))
+    {
+        return false;
+    }
+
+    *value = (int)(uint32_t) v;
+    return true;
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_GetMsgPackedSize
+**
+** Calculates the size of the specified USP message, once serialized
+** This is equivalent to usp__msg__get_packed_size()
+**
+** \param   msg - pointer to USP message
+**
+** \return  number of bytes that the serialized USP message occupies
+**
+**************************************************************************/
+size_t PROTO_CODEC_GetMsgPackedSize(const Usp__Msg *msg)
+{
+    return Codec_SizeMsg(msg, NULL);
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_PackMsg
+**
+** Serializes the specified USP message into the specified buffer
+** This is equivalent to usp__msg__pack()
+**
+** \param   msg - pointer to USP message
+** \param   buf - pointer to buffer in which to serialize the message. This must be at least PROTO_CODEC_GetMsgPackedSize() bytes long
+**
+** \return  number of bytes written to the buffer
+**
+**************************************************************************/
+size_t PROTO_CODEC_PackMsg(const Usp__Msg *msg, uint8_t *buf)
+{
+    codec_sizes_t cs;
+    size_t len;
+    uint8_t *p;
+
+    InitSizes(&cs);
+    len = Codec_SizeMsg(msg, &cs);
+    p = Codec_PackMsg(msg, 0, buf, &cs);
+    USP_ASSERT(p == buf + len);
+    FreeSizes(&cs);
+
+    return len;
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_UnpackMsg
+**
+** Parses the specified serialized USP message into a protobuf-c structure
+** This is equivalent to usp__msg__unpack(). The structure must be freed using usp__msg__free_unpacked()
+**
+** \param   allocator - allocator to use for the unpacked structure. NULL = use malloc()
+** \param   len - length of the serialized USP message
+** \param   data - pointer to the serialized USP message
+**
+** \return  pointer to unpacked USP message, or NULL if the message could not be unpacked
+**
+**************************************************************************/
+Usp__Msg *PROTO_CODEC_UnpackMsg(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    codec_unpack_t u;
+    codec_reader_t r;
+    Usp__Msg *msg = NULL;
+
+    u.allocator = allocator;
+    u.bytes_in_place = false;
+    r.p = data;
+    r.end = data + len;
+
+    // Exit if the message was parsed successfully by the specialized code
+    if (Codec_UnpackMsg(&u, &r, &msg))
+    {
+        return msg;
+    }
+
+    // Otherwise free any partially unpacked message, and let protobuf-c parse it (or report it as malformed)
+    usp__msg__free_unpacked(msg, allocator);
+    return usp__msg__unpack(allocator, len, data);
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_GetRecordPackedSize
+**
+** Calculates the size of the specified USP record, once serialized
+** This is equivalent to usp_record__record__get_packed_size()
+**
+** \param   rec - pointer to USP record
+**
+** \return  number of bytes that the serialized USP record occupies
+**
+**************************************************************************/
+size_t PROTO_CODEC_GetRecordPackedSize(const UspRecord__Record *rec)
+{
+    return Codec_SizeRecord(rec, NULL);
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_PackRecord
+**
+** Serializes the specified USP record into the specified buffer
+** This is equivalent to usp_record__record__pack()
+**
+** \param   rec - pointer to USP record
+** \param   buf - pointer to buffer in which to serialize the record. This must be at least PROTO_CODEC_GetRecordPackedSize() bytes long
+**
+** \return  number of bytes written to the buffer
+**
+**************************************************************************/
+size_t PROTO_CODEC_PackRecord(const UspRecord__Record *rec, uint8_t *buf)
+{
+    codec_sizes_t cs;
+    size_t len;
+    uint8_t *p;
+
+    InitSizes(&cs);
+    len = Codec_SizeRecord(rec, &cs);
+    p = Codec_PackRecord(rec, 0, buf, &cs);
+    USP_ASSERT(p == buf + len);
+    FreeSizes(&cs);
+
+    return len;
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_UnpackRecord
+**
+** Parses the specified serialized USP record into a protobuf-c structure
+** This is equivalent to usp_record__record__unpack(). The structure must be freed using usp_record__record__free_unpacked()
+**
+** \param   allocator - allocator to use for the unpacked structure. NULL = use malloc()
+** \param   len - length of the serialized USP record
+** \param   data - pointer to the serialized USP record
+**
+** \return  pointer to unpacked USP record, or NULL if the record could not be unpacked
+**
+**************************************************************************/
+UspRecord__Record *PROTO_CODEC_UnpackRecord(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    return UnpackRecord(allocator, len, data, false);
+}
+
+/*********************************************************************//**
+**
+** PROTO_CODEC_UnpackRecordInPlace
+**
+** Parses the specified serialized USP record into a protobuf-c structure, without copying bytes fields (eg the payload)
+** This is equivalent to protobuf_c_message_unpack_in_place(&usp_record__record__descriptor, ...)
+** NOTE: The serialized USP record must remain valid until the unpacked structure has been freed,
+**       and the allocator must not attempt to free the bytes fields (eg the per-message arena allocator)
+**
+** \param   allocator - allocator to use for the unpacked structure
+** \param   len - length of the serialized USP record
+** \param   data - pointer to the serialized USP record
+**
+** \return  pointer to unpacked USP record, or NULL if the record could not be unpacked
+**
+**************************************************************************/
+UspRecord__Record *PROTO_CODEC_UnpackRecordInPlace(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    return UnpackRecord(allocator, len, data, true);
+}
+
+/*********************************************************************//**
+**
+** UnpackRecord
+**
+** Parses the specified serialized USP record into a protobuf-c structure, falling back to protobuf-c if necessary
+**
+** \param   allocator - allocator to use for the unpacked structure. NULL = use malloc()
+** \param   len - length of the serialized USP record
+** \param   data - pointer to the serialized USP record
+** \param   bytes_in_place - set if bytes fields should reference the serialized record, rather than being copied
+**
+** \return  pointer to unpacked USP record, or NULL if the record could not be unpacked
+**
+**************************************************************************/
+UspRecord__Record *UnpackRecord(ProtobufCAllocator *allocator, size_t len, const uint8_t *data, bool bytes_in_place)
+{
+    codec_unpack_t u;
+    codec_reader_t r;
+    UspRecord__Record *rec = NULL;
+
+    u.allocator = allocator;
+    u.bytes_in_place = bytes_in_place;
+    r.p = data;
+    r.end = data + len;
+
+    // Exit if the record was parsed successfully by the specialized code
+    if (Codec_UnpackRecord(&u, &r, &rec))
+    {
+        return rec;
+    }
+
+    // Otherwise free any partially unpacked record, and let protobuf-c parse it (or report it as malformed)
+    usp_record__record__free_unpacked(rec, allocator);
+    if (bytes_in_place)
+    {
+        return (UspRecord__Record *) protobuf_c_message_unpack_in_place(&usp_record__record__descriptor, allocator, len, data);
+    }
+
+    return usp_record__record__unpack(allocator, len, data);
+}
+
+/*********************************************************************//**
+**
+** InitSizes
+**
+** Initialises a size cache
+**
+** \param   cs - pointer to size cache
+**
+** \return  None
+**
+**************************************************************************/
+void InitSizes(codec_sizes_t *cs)
+{
+    cs->sizes = cs->static_sizes;
+    cs->num_entries = 0;
+    cs->max_entries = NUM_STATIC_SIZES;
+    cs->read_index = 0;
+}
+
+/*********************************************************************//**
+**
+** GrowSizes
+**
+** Doubles the number of entries in a size cache
+**
+** \param   cs - pointer to size cache
+**
+** \return  None
+**
+**************************************************************************/
+void GrowSizes(codec_sizes_t *cs)
+{
+    size_t *sizes;
+
+    if (cs->sizes == cs->static_sizes)
+    {
+        sizes = USP_MALLOC(2 * cs->max_entries * sizeof(size_t));
+        memcpy(sizes, cs->static_sizes, cs->num_entries * sizeof(size_t));
+    }
+    else
+    {
+        sizes = USP_REALLOC(cs->sizes, 2 * cs->max_entries * sizeof(size_t));
+    }
+
+    cs->sizes = sizes;
+    cs->max_entries *= 2;
+}
+
+/*********************************************************************//**
+**
+** FreeSizes
+**
+** Frees any dynamically allocated memory used by a size cache
+**
+** \param   cs - pointer to size cache
+**
+** \return  None
+**
+**************************************************************************/
+void FreeSizes(codec_sizes_t *cs)
+{
+    if (cs->sizes != cs->static_sizes)
+    {
+        USP_FREE(cs->sizes);
+    }
+}
+
+/*********************************************************************//**
+**
+** Codec_SizeUnknown
+**
+** Calculates the size of the unknown fields of a message (which are serialized after the known fields)
+**
+** \param   msg - pointer to message
+**
+** \return  number of bytes occupied by the unknown fields
+**
+**************************************************************************/
+size_t Codec_SizeUnknown(const ProtobufCMessage *msg)
+{
+    size_t size = 0;
+    unsigned i;
+
+    for (i = 0; i < msg->n_unknown_fields; i++)
+    {
+        size += VarintSize((uint64_t)msg->unknown_fields[i].tag << 3) + msg->unknown_fields[i].len;
+    }
+
+    return size;
+}
+
+/*********************************************************************//**
+**
+** Codec_PackUnknown
+**
+** Serializes the unknown fields of a message
+**
+** \param   msg - pointer to message
+** \param   p - pointer to buffer in which to serialize the unknown fields
+**
+** \return  pointer to the byte after the serialized unknown fields
+**
+**************************************************************************/
+uint8_t *Codec_PackUnknown(const ProtobufCMessage *msg, uint8_t *p)
+{
+    const ProtobufCMessageUnknownField *uf;
+    unsigned i;
+
+    for (i = 0; i < msg->n_unknown_fields; i++)
+    {
+        uf = &msg->unknown_fields[i];
+        p = PutVarint(p, ((uint64_t)uf->tag << 3) | uf->wire_type);
+        memcpy(p, uf->data, uf->len);
+        p += uf->len;
+    }
+
+    return p;
+}
+
+/*********************************************************************//**
+**
+** Codec_SizeGeneric / Codec_PackGeneric
+**
+** Calculates the size of, and serializes, a sub message which is not handled by this file, using protobuf-c
+**
+**************************************************************************/
+size_t Codec_SizeGeneric(const ProtobufCMessage *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    return RecordSize(cs, index, protobuf_c_message_get_packed_size(msg));
+}
+
+uint8_t *Codec_PackGeneric(const ProtobufCMessage *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    return p + protobuf_c_message_pack(msg, p);
+}
+
+/*********************************************************************//**
+**
+** Codec_SizeMapEntry / Codec_PackMapEntry
+**
+** Calculates the size of, and serializes, an entry of a map<string, string>
+** All map entry messages have the same layout, so this is used for all of them
+**
+**************************************************************************/
+size_t Codec_SizeMapEntry(const ProtobufCMessage *base, const char *key, const char *value, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(key) + StringSize(value) + Codec_SizeUnknown(base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackMapEntry(const ProtobufCMessage *base, const char *key, const char *value, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), key);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), value);
+    return Codec_PackUnknown(base, p);
+}
+
+//------------------------------------------------------------------------------------
+// Size and pack functions for each message type
+// Each size function reserves an entry in the size cache for its message, before calculating the size of its sub messages.
+// Each pack function reads the entries back in the same order, so the order in which fields are visited must match exactly.
+// Fields are visited in the order of the field descriptors generated by protoc-c (ie the order that protobuf-c packs them in)
+
+size_t Codec_SizeMsg(const Usp__Msg *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+
+    if (msg->header != NULL)
+    {
+        size += LenDelimSize(Codec_SizeHeader(msg->header, cs));
+    }
+
+    if (msg->body != NULL)
+    {
+        size += LenDelimSize(Codec_SizeBody(msg->body, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackMsg(const Usp__Msg *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+
+    if (msg->header != NULL)
+    {
+        p = Codec_PackHeader(msg->header, TAG(1, WIRE_TYPE_LEN), p, cs);
+    }
+
+    if (msg->body != NULL)
+    {
+        p = Codec_PackBody(msg->body, TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeHeader(const Usp__Header *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->msg_id) + EnumSize(msg->msg_type) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackHeader(const Usp__Header *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->msg_id);
+    p = PutEnum(p, TAG(2, WIRE_TYPE_VARINT), msg->msg_type);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeBody(const Usp__Body *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+
+    switch(msg->msg_body_case)
+    {
+        case USP__BODY__MSG_BODY_REQUEST:
+            if (msg->request != NULL)
+            {
+                size += LenDelimSize(Codec_SizeRequest(msg->request, cs));
+            }
+            break;
+
+        case USP__BODY__MSG_BODY_RESPONSE:
+            if (msg->response != NULL)
+            {
+                size += LenDelimSize(Codec_SizeResponse(msg->response, cs));
+            }
+            break;
+
+        case USP__BODY__MSG_BODY_ERROR:
+            if (msg->error != NULL)
+            {
+                size += LenDelimSize(Codec_SizeError(msg->error, cs));
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackBody(const Usp__Body *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+
+    switch(msg->msg_body_case)
+    {
+        case USP__BODY__MSG_BODY_REQUEST:
+            if (msg->request != NULL)
+            {
+                p = Codec_PackRequest(msg->request, TAG(1, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__BODY__MSG_BODY_RESPONSE:
+            if (msg->response != NULL)
+            {
+                p = Codec_PackResponse(msg->response, TAG(2, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__BODY__MSG_BODY_ERROR:
+            if (msg->error != NULL)
+            {
+                p = Codec_PackError(msg->error, TAG(3, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeRequest(const Usp__Request *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    const ProtobufCMessage *generic = NULL;
+
+    switch(msg->req_type_case)
+    {
+        case USP__REQUEST__REQ_TYPE_GET:
+            if (msg->get != NULL)
+            {
+                size += LenDelimSize(Codec_SizeGet(msg->get, cs));
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE_SET:
+            if (msg->set != NULL)
+            {
+                size += LenDelimSize(Codec_SizeSet(msg->set, cs));
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE_NOTIFY:
+            if (msg->notify != NULL)
+            {
+                size += LenDelimSize(Codec_SizeNotify(msg->notify, cs));
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE__NOT_SET:
+            break;
+
+        default:
+            // NOTE: All members of the oneof are pointers at the same location, so any member may be used to access the generic message
+            generic = (const ProtobufCMessage *) msg->get;
+            break;
+    }
+
+    if (generic != NULL)
+    {
+        size += LenDelimSize(Codec_SizeGeneric(generic, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackRequest(const Usp__Request *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+
+    switch(msg->req_type_case)
+    {
+        case USP__REQUEST__REQ_TYPE_GET:
+            if (msg->get != NULL)
+            {
+                p = Codec_PackGet(msg->get, TAG(1, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE_SET:
+            if (msg->set != NULL)
+            {
+                p = Codec_PackSet(msg->set, TAG(4, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE_NOTIFY:
+            if (msg->notify != NULL)
+            {
+                p = Codec_PackNotify(msg->notify, TAG(8, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__REQUEST__REQ_TYPE__NOT_SET:
+            break;
+
+        default:
+            if (msg->get != NULL)
+            {
+                p = Codec_PackGeneric((const ProtobufCMessage *) msg->get, TAG(msg->req_type_case, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeResponse(const Usp__Response *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    const ProtobufCMessage *generic = NULL;
+
+    switch(msg->resp_type_case)
+    {
+        case USP__RESPONSE__RESP_TYPE_GET_RESP:
+            if (msg->get_resp != NULL)
+            {
+                size += LenDelimSize(Codec_SizeGetResp(msg->get_resp, cs));
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE_SET_RESP:
+            if (msg->set_resp != NULL)
+            {
+                size += LenDelimSize(Codec_SizeSetResp(msg->set_resp, cs));
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE_NOTIFY_RESP:
+            if (msg->notify_resp != NULL)
+            {
+                size += LenDelimSize(Codec_SizeNotifyResp(msg->notify_resp, cs));
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE__NOT_SET:
+            break;
+
+        default:
+            // NOTE: All members of the oneof are pointers at the same location, so any member may be used to access the generic message
+            generic = (const ProtobufCMessage *) msg->get_resp;
+            break;
+    }
+
+    if (generic != NULL)
+    {
+        size += LenDelimSize(Codec_SizeGeneric(generic, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackResponse(const Usp__Response *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+
+    switch(msg->resp_type_case)
+    {
+        case USP__RESPONSE__RESP_TYPE_GET_RESP:
+            if (msg->get_resp != NULL)
+            {
+                p = Codec_PackGetResp(msg->get_resp, TAG(1, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE_SET_RESP:
+            if (msg->set_resp != NULL)
+            {
+                p = Codec_PackSetResp(msg->set_resp, TAG(4, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE_NOTIFY_RESP:
+            if (msg->notify_resp != NULL)
+            {
+                p = Codec_PackNotifyResp(msg->notify_resp, TAG(8, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__RESPONSE__RESP_TYPE__NOT_SET:
+            break;
+
+        default:
+            if (msg->get_resp != NULL)
+            {
+                p = Codec_PackGeneric((const ProtobufCMessage *) msg->get_resp, TAG(msg->resp_type_case, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeError(const Usp__Error *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = Fixed32Size(msg->err_code) + StringSize(msg->err_msg);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        size += LenDelimSize(Codec_SizeErrorParamError(msg->param_errs[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackError(const Usp__Error *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutFixed32(p, TAG(1, WIRE_TYPE_FIXED32), msg->err_code);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->err_msg);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        p = Codec_PackErrorParamError(msg->param_errs[i], TAG(3, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeErrorParamError(const Usp__Error__ParamError *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->param_path) + Fixed32Size(msg->err_code) + StringSize(msg->err_msg) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackErrorParamError(const Usp__Error__ParamError *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->param_path);
+    p = PutFixed32(p, TAG(2, WIRE_TYPE_FIXED32), msg->err_code);
+    p = PutString(p, TAG(3, WIRE_TYPE_LEN), msg->err_msg);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeGet(const Usp__Get *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    unsigned i;
+
+    for (i = 0; i < msg->n_param_paths; i++)
+    {
+        size += RepeatedStringSize(msg->param_paths[i]);
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackGet(const Usp__Get *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    for (i = 0; i < msg->n_param_paths; i++)
+    {
+        p = PutRepeatedString(p, TAG(1, WIRE_TYPE_LEN), msg->param_paths[i]);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeGetResp(const Usp__GetResp *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    unsigned i;
+
+    for (i = 0; i < msg->n_req_path_results; i++)
+    {
+        size += LenDelimSize(Codec_SizeRequestedPathResult(msg->req_path_results[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackGetResp(const Usp__GetResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    for (i = 0; i < msg->n_req_path_results; i++)
+    {
+        p = Codec_PackRequestedPathResult(msg->req_path_results[i], TAG(1, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeRequestedPathResult(const Usp__GetResp__RequestedPathResult *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = StringSize(msg->requested_path) + Fixed32Size(msg->err_code) + StringSize(msg->err_msg);
+    for (i = 0; i < msg->n_resolved_path_results; i++)
+    {
+        size += LenDelimSize(Codec_SizeResolvedPathResult(msg->resolved_path_results[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackRequestedPathResult(const Usp__GetResp__RequestedPathResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->requested_path);
+    p = PutFixed32(p, TAG(2, WIRE_TYPE_FIXED32), msg->err_code);
+    p = PutString(p, TAG(3, WIRE_TYPE_LEN), msg->err_msg);
+    for (i = 0; i < msg->n_resolved_path_results; i++)
+    {
+        p = Codec_PackResolvedPathResult(msg->resolved_path_results[i], TAG(4, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeResolvedPathResult(const Usp__GetResp__ResolvedPathResult *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *entry;
+
+    size = StringSize(msg->resolved_path);
+    for (i = 0; i < msg->n_result_params; i++)
+    {
+        entry = msg->result_params[i];
+        size += LenDelimSize(Codec_SizeMapEntry(&entry->base, entry->key, entry->value, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackResolvedPathResult(const Usp__GetResp__ResolvedPathResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *entry;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->resolved_path);
+    for (i = 0; i < msg->n_result_params; i++)
+    {
+        entry = msg->result_params[i];
+        p = Codec_PackMapEntry(&entry->base, entry->key, entry->value, TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeSet(const Usp__Set *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = BoolSize(msg->allow_partial);
+    for (i = 0; i < msg->n_update_objs; i++)
+    {
+        size += LenDelimSize(Codec_SizeUpdateObject(msg->update_objs[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackSet(const Usp__Set *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutBool(p, TAG(1, WIRE_TYPE_VARINT), msg->allow_partial);
+    for (i = 0; i < msg->n_update_objs; i++)
+    {
+        p = Codec_PackUpdateObject(msg->update_objs[i], TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeUpdateObject(const Usp__Set__UpdateObject *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = StringSize(msg->obj_path);
+    for (i = 0; i < msg->n_param_settings; i++)
+    {
+        size += LenDelimSize(Codec_SizeUpdateParamSetting(msg->param_settings[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackUpdateObject(const Usp__Set__UpdateObject *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->obj_path);
+    for (i = 0; i < msg->n_param_settings; i++)
+    {
+        p = Codec_PackUpdateParamSetting(msg->param_settings[i], TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeUpdateParamSetting(const Usp__Set__UpdateParamSetting *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->param) + StringSize(msg->value) + BoolSize(msg->required) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackUpdateParamSetting(const Usp__Set__UpdateParamSetting *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->param);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->value);
+    p = PutBool(p, TAG(3, WIRE_TYPE_VARINT), msg->required);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeSetResp(const Usp__SetResp *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    unsigned i;
+
+    for (i = 0; i < msg->n_updated_obj_results; i++)
+    {
+        size += LenDelimSize(Codec_SizeUpdatedObjectResult(msg->updated_obj_results[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackSetResp(const Usp__SetResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    for (i = 0; i < msg->n_updated_obj_results; i++)
+    {
+        p = Codec_PackUpdatedObjectResult(msg->updated_obj_results[i], TAG(1, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeUpdatedObjectResult(const Usp__SetResp__UpdatedObjectResult *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->requested_path);
+    if (msg->oper_status != NULL)
+    {
+        size += LenDelimSize(Codec_SizeOperationStatus(msg->oper_status, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackUpdatedObjectResult(const Usp__SetResp__UpdatedObjectResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->requested_path);
+    if (msg->oper_status != NULL)
+    {
+        p = Codec_PackOperationStatus(msg->oper_status, TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeOperationStatus(const Usp__SetResp__UpdatedObjectResult__OperationStatus *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+
+    if ((msg->oper_status_case == USP__SET_RESP__UPDATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_FAILURE) && (msg->oper_failure != NULL))
+    {
+        size += LenDelimSize(Codec_SizeOperationFailure(msg->oper_failure, cs));
+    }
+    else if ((msg->oper_status_case == USP__SET_RESP__UPDATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_SUCCESS) && (msg->oper_success != NULL))
+    {
+        size += LenDelimSize(Codec_SizeOperationSuccess(msg->oper_success, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackOperationStatus(const Usp__SetResp__UpdatedObjectResult__OperationStatus *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    if ((msg->oper_status_case == USP__SET_RESP__UPDATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_FAILURE) && (msg->oper_failure != NULL))
+    {
+        p = Codec_PackOperationFailure(msg->oper_failure, TAG(1, WIRE_TYPE_LEN), p, cs);
+    }
+    else if ((msg->oper_status_case == USP__SET_RESP__UPDATED_OBJECT_RESULT__OPERATION_STATUS__OPER_STATUS_OPER_SUCCESS) && (msg->oper_success != NULL))
+    {
+        p = Codec_PackOperationSuccess(msg->oper_success, TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeOperationFailure(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = Fixed32Size(msg->err_code) + StringSize(msg->err_msg);
+    for (i = 0; i < msg->n_updated_inst_failures; i++)
+    {
+        size += LenDelimSize(Codec_SizeUpdatedInstanceFailure(msg->updated_inst_failures[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackOperationFailure(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationFailure *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutFixed32(p, TAG(1, WIRE_TYPE_FIXED32), msg->err_code);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->err_msg);
+    for (i = 0; i < msg->n_updated_inst_failures; i++)
+    {
+        p = Codec_PackUpdatedInstanceFailure(msg->updated_inst_failures[i], TAG(3, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeOperationSuccess(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size = 0;
+    unsigned i;
+
+    for (i = 0; i < msg->n_updated_inst_results; i++)
+    {
+        size += LenDelimSize(Codec_SizeUpdatedInstanceResult(msg->updated_inst_results[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackOperationSuccess(const Usp__SetResp__UpdatedObjectResult__OperationStatus__OperationSuccess *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    for (i = 0; i < msg->n_updated_inst_results; i++)
+    {
+        p = Codec_PackUpdatedInstanceResult(msg->updated_inst_results[i], TAG(1, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeUpdatedInstanceFailure(const Usp__SetResp__UpdatedInstanceFailure *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+
+    size = StringSize(msg->affected_path);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        size += LenDelimSize(Codec_SizeSetParameterError(msg->param_errs[i], cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackUpdatedInstanceFailure(const Usp__SetResp__UpdatedInstanceFailure *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->affected_path);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        p = Codec_PackSetParameterError(msg->param_errs[i], TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeUpdatedInstanceResult(const Usp__SetResp__UpdatedInstanceResult *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+    Usp__SetResp__UpdatedInstanceResult__UpdatedParamsEntry *entry;
+
+    size = StringSize(msg->affected_path);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        size += LenDelimSize(Codec_SizeSetParameterError(msg->param_errs[i], cs));
+    }
+
+    for (i = 0; i < msg->n_updated_params; i++)
+    {
+        entry = msg->updated_params[i];
+        size += LenDelimSize(Codec_SizeMapEntry(&entry->base, entry->key, entry->value, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackUpdatedInstanceResult(const Usp__SetResp__UpdatedInstanceResult *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+    Usp__SetResp__UpdatedInstanceResult__UpdatedParamsEntry *entry;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->affected_path);
+    for (i = 0; i < msg->n_param_errs; i++)
+    {
+        p = Codec_PackSetParameterError(msg->param_errs[i], TAG(2, WIRE_TYPE_LEN), p, cs);
+    }
+
+    for (i = 0; i < msg->n_updated_params; i++)
+    {
+        entry = msg->updated_params[i];
+        p = Codec_PackMapEntry(&entry->base, entry->key, entry->value, TAG(3, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeSetParameterError(const Usp__SetResp__ParameterError *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->param) + Fixed32Size(msg->err_code) + StringSize(msg->err_msg) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackSetParameterError(const Usp__SetResp__ParameterError *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->param);
+    p = PutFixed32(p, TAG(2, WIRE_TYPE_FIXED32), msg->err_code);
+    p = PutString(p, TAG(3, WIRE_TYPE_LEN), msg->err_msg);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeNotify(const Usp__Notify *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    const ProtobufCMessage *generic = NULL;
+
+    size = StringSize(msg->subscription_id) + BoolSize(msg->send_resp);
+    switch(msg->notification_case)
+    {
+        case USP__NOTIFY__NOTIFICATION_EVENT:
+            if (msg->event != NULL)
+            {
+                size += LenDelimSize(Codec_SizeEvent(msg->event, cs));
+            }
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_VALUE_CHANGE:
+            if (msg->value_change != NULL)
+            {
+                size += LenDelimSize(Codec_SizeValueChange(msg->value_change, cs));
+            }
+            break;
+
+        case USP__NOTIFY__NOTIFICATION__NOT_SET:
+            break;
+
+        default:
+            // NOTE: All members of the oneof are pointers at the same location, so any member may be used to access the generic message
+            generic = (const ProtobufCMessage *) msg->event;
+            break;
+    }
+
+    if (generic != NULL)
+    {
+        size += LenDelimSize(Codec_SizeGeneric(generic, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackNotify(const Usp__Notify *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->subscription_id);
+    p = PutBool(p, TAG(2, WIRE_TYPE_VARINT), msg->send_resp);
+    switch(msg->notification_case)
+    {
+        case USP__NOTIFY__NOTIFICATION_EVENT:
+            if (msg->event != NULL)
+            {
+                p = Codec_PackEvent(msg->event, TAG(3, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__NOTIFY__NOTIFICATION_VALUE_CHANGE:
+            if (msg->value_change != NULL)
+            {
+                p = Codec_PackValueChange(msg->value_change, TAG(4, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+
+        case USP__NOTIFY__NOTIFICATION__NOT_SET:
+            break;
+
+        default:
+            if (msg->event != NULL)
+            {
+                p = Codec_PackGeneric((const ProtobufCMessage *) msg->event, TAG(msg->notification_case, WIRE_TYPE_LEN), p, cs);
+            }
+            break;
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeEvent(const Usp__Notify__Event *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+    unsigned i;
+    Usp__Notify__Event__ParamsEntry *entry;
+
+    size = StringSize(msg->obj_path) + StringSize(msg->event_name);
+    for (i = 0; i < msg->n_params; i++)
+    {
+        entry = msg->params[i];
+        size += LenDelimSize(Codec_SizeMapEntry(&entry->base, entry->key, entry->value, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackEvent(const Usp__Notify__Event *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    unsigned i;
+    Usp__Notify__Event__ParamsEntry *entry;
+
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->obj_path);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->event_name);
+    for (i = 0; i < msg->n_params; i++)
+    {
+        entry = msg->params[i];
+        p = Codec_PackMapEntry(&entry->base, entry->key, entry->value, TAG(3, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeValueChange(const Usp__Notify__ValueChange *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->param_path) + StringSize(msg->param_value) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackValueChange(const Usp__Notify__ValueChange *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->param_path);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->param_value);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeNotifyResp(const Usp__NotifyResp *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->subscription_id) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackNotifyResp(const Usp__NotifyResp *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->subscription_id);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeRecord(const UspRecord__Record *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = StringSize(msg->version) + StringSize(msg->to_id) + StringSize(msg->from_id) + EnumSize(msg->payload_security) +
+           BytesSize(&msg->mac_signature) + BytesSize(&msg->sender_cert);
+
+    if ((msg->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT) && (msg->no_session_context != NULL))
+    {
+        size += LenDelimSize(Codec_SizeNoSessionContext(msg->no_session_context, cs));
+    }
+    else if ((msg->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT) && (msg->session_context != NULL))
+    {
+        size += LenDelimSize(Codec_SizeGeneric(&msg->session_context->base, cs));
+    }
+
+    size += Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackRecord(const UspRecord__Record *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutString(p, TAG(1, WIRE_TYPE_LEN), msg->version);
+    p = PutString(p, TAG(2, WIRE_TYPE_LEN), msg->to_id);
+    p = PutString(p, TAG(3, WIRE_TYPE_LEN), msg->from_id);
+    p = PutEnum(p, TAG(4, WIRE_TYPE_VARINT), msg->payload_security);
+    p = PutBytes(p, TAG(5, WIRE_TYPE_LEN), &msg->mac_signature);
+    p = PutBytes(p, TAG(6, WIRE_TYPE_LEN), &msg->sender_cert);
+
+    if ((msg->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT) && (msg->no_session_context != NULL))
+    {
+        p = Codec_PackNoSessionContext(msg->no_session_context, TAG(7, WIRE_TYPE_LEN), p, cs);
+    }
+    else if ((msg->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT) && (msg->session_context != NULL))
+    {
+        p = Codec_PackGeneric(&msg->session_context->base, TAG(8, WIRE_TYPE_LEN), p, cs);
+    }
+
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+size_t Codec_SizeNoSessionContext(const UspRecord__NoSessionContextRecord *msg, codec_sizes_t *cs)
+{
+    int index = ReserveSize(cs);
+    size_t size;
+
+    size = BytesSize(&msg->payload) + Codec_SizeUnknown(&msg->base);
+    return RecordSize(cs, index, size);
+}
+
+uint8_t *Codec_PackNoSessionContext(const UspRecord__NoSessionContextRecord *msg, uint8_t tag, uint8_t *p, codec_sizes_t *cs)
+{
+    p = PutHeader(p, tag, cs);
+    p = PutBytes(p, TAG(2, WIRE_TYPE_LEN), &msg->payload);
+    return Codec_PackUnknown(&msg->base, p);
+}
+
+/*********************************************************************//**
+**
+** Codec_Alloc
+**
+** Allocates memory for an unpacked structure, using the allocator specified by the caller
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory, or NULL if out of memory
+**
+**************************************************************************/
+void *Codec_Alloc(codec_unpack_t *u, size_t size)
+{
+    if (u->allocator == NULL)
+    {
+        return malloc(size);
+    }
+
+    return u->allocator->alloc(u->allocator->allocator_data, size);
+}
+
+/*********************************************************************//**
+**
+** Codec_AllocArray
+**
+** Allocates the array of a repeated field
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   count - number of elements in the array
+** \param   elem_size - size of each element in the array
+** \param   parray - pointer to variable in which to return the pointer to the array (NULL if count is 0)
+**
+** \return  true if successful, false if out of memory
+**
+**************************************************************************/
+bool Codec_AllocArray(codec_unpack_t *u, unsigned count, size_t elem_size, void *parray)
+{
+    void *array = NULL;
+
+    if (count > 0)
+    {
+        array = Codec_Alloc(u, count * elem_size);
+        if (array == NULL)
+        {
+            return false;
+        }
+    }
+
+    *(void **)parray = array;
+    return true;
+}
+
+/*********************************************************************//**
+**
+** Codec_CountFields
+**
+** Counts the number of occurrences of each field in a serialized message
+** This is used to size the arrays of repeated fields, before parsing them
+**
+** \param   r - position of the serialized message (passed by value, so that the caller's position is not changed)
+** \param   counts - array of MAX_FIELDS+1 entries, in which to return the number of occurrences of each field
+**
+** \return  true if successful, false if the message is malformed
+**
+**************************************************************************/
+bool Codec_CountFields(codec_reader_t r, unsigned *counts)
+{
+    int field;
+    int wire_type;
+    uint64_t value;
+    codec_reader_t sub;
+
+    memset(counts, 0, (MAX_FIELDS+1) * sizeof(unsigned));
+    while (r.p < r.end)
+    {
+        if (GetTag(&r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(wire_type)
+        {
+            case WIRE_TYPE_VARINT:
+                if (GetVarint(&r, &value) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case WIRE_TYPE_LEN:
+                if (GetLenDelim(&r, &sub) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case WIRE_TYPE_FIXED32:
+            case WIRE_TYPE_FIXED64:
+                value = (wire_type == WIRE_TYPE_FIXED32) ? 4 : 8;
+                if ((uint64_t)(r.end - r.p) < value)
+                {
+                    return false;
+                }
+                r.p += value;
+                break;
+
+            default:
+                return false;
+                break;
+        }
+
+        counts[field]++;
+    }
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** Codec_GetString
+**
+** Parses a string field, copying it into a NULL terminated string allocated using the caller's allocator
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   r - position of the field's length and contents within the serialized message
+** \param   wire_type - wire type of the field
+** \param   pstr - pointer to variable in which to return the string
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_GetString(codec_unpack_t *u, codec_reader_t *r, int wire_type, char **pstr)
+{
+    codec_reader_t sub;
+    size_t len;
+    char *str;
+
+    if ((wire_type != WIRE_TYPE_LEN) || (GetLenDelim(r, &sub) == false))
+    {
+        return false;
+    }
+
+    len = sub.end - sub.p;
+    str = Codec_Alloc(u, len + 1);
+    if (str == NULL)
+    {
+        return false;
+    }
+
+    memcpy(str, sub.p, len);
+    str[len] = '\0';
+    *pstr = str;
+    return true;
+}
+
+/*********************************************************************//**
+**
+** Codec_GetSingularString
+**
+** Parses a string field which is not repeated
+** NOTE: If the field has already been parsed, then this function fails, so that protobuf-c handles the message instead
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   r - position of the field's length and contents within the serialized message
+** \param   wire_type - wire type of the field
+** \param   pstr - pointer to variable in which to return the string
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_GetSingularString(codec_unpack_t *u, codec_reader_t *r, int wire_type, char **pstr)
+{
+    if (*pstr != protobuf_c_empty_string)
+    {
+        return false;
+    }
+
+    return Codec_GetString(u, r, wire_type, pstr);
+}
+
+/*********************************************************************//**
+**
+** Codec_GetBytes
+**
+** Parses a bytes field, either copying it, or referencing it in the serialized message
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   r - position of the field's length and contents within the serialized message
+** \param   wire_type - wire type of the field
+** \param   bd - pointer to structure in which to return the bytes
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_GetBytes(codec_unpack_t *u, codec_reader_t *r, int wire_type, ProtobufCBinaryData *bd)
+{
+    codec_reader_t sub;
+    size_t len;
+
+    if ((wire_type != WIRE_TYPE_LEN) || (bd->data != NULL) || (GetLenDelim(r, &sub) == false))
+    {
+        return false;
+    }
+
+    len = sub.end - sub.p;
+    bd->len = len;
+    if (len == 0)
+    {
+        return true;
+    }
+
+    if (u->bytes_in_place)
+    {
+        bd->data = (uint8_t *) sub.p;
+        return true;
+    }
+
+    bd->data = Codec_Alloc(u, len);
+    if (bd->data == NULL)
+    {
+        return false;
+    }
+
+    memcpy(bd->data, sub.p, len);
+    return true;
+}
+
+/*********************************************************************//**
+**
+** Codec_GetSubMessage
+**
+** Determines the position of a singular sub message field
+** NOTE: If the field has already been parsed, then this function fails, so that protobuf-c handles (merges) the message instead
+**
+** \param   r - position of the field's length and contents within the serialized message
+** \param   wire_type - wire type of the field
+** \param   msg - current value of the field. This must be NULL for the field to be parsed
+** \param   sub - pointer to variable in which to return the position of the sub message
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_GetSubMessage(codec_reader_t *r, int wire_type, void *msg, codec_reader_t *sub)
+{
+    if ((wire_type != WIRE_TYPE_LEN) || (msg != NULL))
+    {
+        return false;
+    }
+
+    return GetLenDelim(r, sub);
+}
+
+/*********************************************************************//**
+**
+** Codec_UnpackGeneric
+**
+** Unpacks a sub message which is not handled by this file, using protobuf-c
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   r - position of the serialized sub message
+** \param   desc - protobuf-c descriptor of the sub message
+** \param   pmsg - pointer to variable in which to return the unpacked sub message
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_UnpackGeneric(codec_unpack_t *u, codec_reader_t *r, const ProtobufCMessageDescriptor *desc, void *pmsg)
+{
+    ProtobufCMessage *msg;
+
+    if (u->bytes_in_place)
+    {
+        msg = protobuf_c_message_unpack_in_place(desc, u->allocator, r->end - r->p, r->p);
+    }
+    else
+    {
+        msg = protobuf_c_message_unpack(desc, u->allocator, r->end - r->p, r->p);
+    }
+
+    *(ProtobufCMessage **)pmsg = msg;
+    return (msg != NULL);
+}
+
+/*********************************************************************//**
+**
+** Codec_UnpackMapEntry
+**
+** Unpacks an entry of a map<string, string>
+** All map entry messages have the same layout, so this is used for all of them
+**
+** \param   u - pointer to settings used whilst unpacking
+** \param   r - position of the serialized map entry
+** \param   desc - protobuf-c descriptor of the map entry
+** \param   pmsg - pointer to variable in which to return the unpacked map entry
+**
+** \return  true if successful, false otherwise
+**
+**************************************************************************/
+bool Codec_UnpackMapEntry(codec_unpack_t *u, codec_reader_t *r, const ProtobufCMessageDescriptor *desc, void *pmsg)
+{
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry *msg;   // NOTE: Used for all map entry types, which have the same layout
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, desc->sizeof_message);
+    if (msg == NULL)
+    {
+        return false;
+    }
+    protobuf_c_message_init(desc, msg);
+    *(void **)pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->key) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->value) == false)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+// Unpack functions for each message type
+// Each function allocates and initialises its structure, and links it into its parent, before parsing its fields,
+// so that if parsing fails, the partially unpacked message can be freed by protobuf-c's free_unpacked()
+// For the same reason, the number of elements in each repeated field is only incremented as each element is added.
+// Any field which is not handled (including unknown fields) causes the unpack to fail, and fall back to protobuf-c
+
+bool Codec_UnpackMsg(codec_unpack_t *u, codec_reader_t *r, Usp__Msg **pmsg)
+{
+    Usp__Msg *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Msg));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__msg__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if ((Codec_GetSubMessage(r, wire_type, msg->header, &sub) == false) || (Codec_UnpackHeader(u, &sub, &msg->header) == false))
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if ((Codec_GetSubMessage(r, wire_type, msg->body, &sub) == false) || (Codec_UnpackBody(u, &sub, &msg->body) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackHeader(codec_unpack_t *u, codec_reader_t *r, Usp__Header **pmsg)
+{
+    Usp__Header *msg;
+    int field;
+    int wire_type;
+    int value;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Header));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__header__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->msg_id) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (GetEnum(r, wire_type, &value) == false)
+                {
+                    return false;
+                }
+                msg->msg_type = value;
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackBody(codec_unpack_t *u, codec_reader_t *r, Usp__Body **pmsg)
+{
+    Usp__Body *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Body));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__body__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        // Exit if more than one member of the oneof is present (protobuf-c handles this case)
+        if ((field > 3) || (msg->msg_body_case != USP__BODY__MSG_BODY__NOT_SET) || (Codec_GetSubMessage(r, wire_type, NULL, &sub) == false))
+        {
+            return false;
+        }
+
+        msg->msg_body_case = field;
+        switch(field)
+        {
+            case USP__BODY__MSG_BODY_REQUEST:
+                if (Codec_UnpackRequest(u, &sub, &msg->request) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case USP__BODY__MSG_BODY_RESPONSE:
+                if (Codec_UnpackResponse(u, &sub, &msg->response) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case USP__BODY__MSG_BODY_ERROR:
+                if (Codec_UnpackError(u, &sub, &msg->error) == false)
+                {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackRequest(codec_unpack_t *u, codec_reader_t *r, Usp__Request **pmsg)
+{
+    Usp__Request *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+    bool result;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Request));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__request__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        // Exit if more than one member of the oneof is present (protobuf-c handles this case)
+        if ((field > 9) || (msg->req_type_case != USP__REQUEST__REQ_TYPE__NOT_SET) || (Codec_GetSubMessage(r, wire_type, NULL, &sub) == false))
+        {
+            return false;
+        }
+
+        msg->req_type_case = field;
+        switch(field)
+        {
+            case USP__REQUEST__REQ_TYPE_GET:
+                result = Codec_UnpackGet(u, &sub, &msg->get);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_GET_SUPPORTED_DM:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_supported_dm__descriptor, &msg->get_supported_dm);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_GET_INSTANCES:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_instances__descriptor, &msg->get_instances);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_SET:
+                result = Codec_UnpackSet(u, &sub, &msg->set);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_ADD:
+                result = Codec_UnpackGeneric(u, &sub, &usp__add__descriptor, &msg->add);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_DELETE:
+                result = Codec_UnpackGeneric(u, &sub, &usp__delete__descriptor, &msg->delete_);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_OPERATE:
+                result = Codec_UnpackGeneric(u, &sub, &usp__operate__descriptor, &msg->operate);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_NOTIFY:
+                result = Codec_UnpackNotify(u, &sub, &msg->notify);
+                break;
+
+            case USP__REQUEST__REQ_TYPE_GET_SUPPORTED_PROTOCOL:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_supported_protocol__descriptor, &msg->get_supported_protocol);
+                break;
+
+            default:
+                result = false;
+                break;
+        }
+
+        if (result == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackResponse(codec_unpack_t *u, codec_reader_t *r, Usp__Response **pmsg)
+{
+    Usp__Response *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+    bool result;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Response));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__response__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        // Exit if more than one member of the oneof is present (protobuf-c handles this case)
+        if ((field > 9) || (msg->resp_type_case != USP__RESPONSE__RESP_TYPE__NOT_SET) || (Codec_GetSubMessage(r, wire_type, NULL, &sub) == false))
+        {
+            return false;
+        }
+
+        // NOTE: SetResp is unpacked by protobuf-c, as it is only ever received by a controller
+        msg->resp_type_case = field;
+        switch(field)
+        {
+            case USP__RESPONSE__RESP_TYPE_GET_RESP:
+                result = Codec_UnpackGetResp(u, &sub, &msg->get_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_GET_SUPPORTED_DM_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_supported_dmresp__descriptor, &msg->get_supported_dm_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_GET_INSTANCES_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_instances_resp__descriptor, &msg->get_instances_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_SET_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__set_resp__descriptor, &msg->set_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_ADD_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__add_resp__descriptor, &msg->add_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_DELETE_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__delete_resp__descriptor, &msg->delete_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_OPERATE_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__operate_resp__descriptor, &msg->operate_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_NOTIFY_RESP:
+                result = Codec_UnpackNotifyResp(u, &sub, &msg->notify_resp);
+                break;
+
+            case USP__RESPONSE__RESP_TYPE_GET_SUPPORTED_PROTOCOL_RESP:
+                result = Codec_UnpackGeneric(u, &sub, &usp__get_supported_protocol_resp__descriptor, &msg->get_supported_protocol_resp);
+                break;
+
+            default:
+                result = false;
+                break;
+        }
+
+        if (result == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackError(codec_unpack_t *u, codec_reader_t *r, Usp__Error **pmsg)
+{
+    Usp__Error *msg;
+    Usp__Error__ParamError **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Error));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__error__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[3], sizeof(Usp__Error__ParamError *), &msg->param_errs) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (GetFixed32(r, wire_type, &msg->err_code) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->err_msg) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 3:
+                elem = &msg->param_errs[msg->n_param_errs++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) || (Codec_UnpackErrorParamError(u, &sub, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackErrorParamError(codec_unpack_t *u, codec_reader_t *r, Usp__Error__ParamError **pmsg)
+{
+    Usp__Error__ParamError *msg;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Error__ParamError));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__error__param_error__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->param_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (GetFixed32(r, wire_type, &msg->err_code) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 3:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->err_msg) == false)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackGet(codec_unpack_t *u, codec_reader_t *r, Usp__Get **pmsg)
+{
+    Usp__Get *msg;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Get));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__get__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[1], sizeof(char *), &msg->param_paths) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if ((GetTag(r, &field, &wire_type) == false) || (field != 1))
+        {
+            return false;
+        }
+
+        if (Codec_GetString(u, r, wire_type, &msg->param_paths[msg->n_param_paths]) == false)
+        {
+            return false;
+        }
+        msg->n_param_paths++;
+    }
+
+    return true;
+}
+
+bool Codec_UnpackGetResp(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp **pmsg)
+{
+    Usp__GetResp *msg;
+    Usp__GetResp__RequestedPathResult **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__GetResp));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__get_resp__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[1], sizeof(Usp__GetResp__RequestedPathResult *), &msg->req_path_results) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if ((GetTag(r, &field, &wire_type) == false) || (field != 1))
+        {
+            return false;
+        }
+
+        elem = &msg->req_path_results[msg->n_req_path_results++];
+        *elem = NULL;
+        if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) || (Codec_UnpackRequestedPathResult(u, &sub, elem) == false))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackRequestedPathResult(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp__RequestedPathResult **pmsg)
+{
+    Usp__GetResp__RequestedPathResult *msg;
+    Usp__GetResp__ResolvedPathResult **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__GetResp__RequestedPathResult));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__get_resp__requested_path_result__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[4], sizeof(Usp__GetResp__ResolvedPathResult *), &msg->resolved_path_results) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->requested_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (GetFixed32(r, wire_type, &msg->err_code) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 3:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->err_msg) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 4:
+                elem = &msg->resolved_path_results[msg->n_resolved_path_results++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) || (Codec_UnpackResolvedPathResult(u, &sub, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackResolvedPathResult(codec_unpack_t *u, codec_reader_t *r, Usp__GetResp__ResolvedPathResult **pmsg)
+{
+    Usp__GetResp__ResolvedPathResult *msg;
+    Usp__GetResp__ResolvedPathResult__ResultParamsEntry **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__GetResp__ResolvedPathResult));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__get_resp__resolved_path_result__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[2], sizeof(Usp__GetResp__ResolvedPathResult__ResultParamsEntry *), &msg->result_params) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->resolved_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                elem = &msg->result_params[msg->n_result_params++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) ||
+                    (Codec_UnpackMapEntry(u, &sub, &usp__get_resp__resolved_path_result__result_params_entry__descriptor, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackSet(codec_unpack_t *u, codec_reader_t *r, Usp__Set **pmsg)
+{
+    Usp__Set *msg;
+    Usp__Set__UpdateObject **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Set));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__set__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[2], sizeof(Usp__Set__UpdateObject *), &msg->update_objs) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (GetBool(r, wire_type, &msg->allow_partial) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                elem = &msg->update_objs[msg->n_update_objs++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) || (Codec_UnpackUpdateObject(u, &sub, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackUpdateObject(codec_unpack_t *u, codec_reader_t *r, Usp__Set__UpdateObject **pmsg)
+{
+    Usp__Set__UpdateObject *msg;
+    Usp__Set__UpdateParamSetting **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Set__UpdateObject));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__set__update_object__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[2], sizeof(Usp__Set__UpdateParamSetting *), &msg->param_settings) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->obj_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                elem = &msg->param_settings[msg->n_param_settings++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) || (Codec_UnpackUpdateParamSetting(u, &sub, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackUpdateParamSetting(codec_unpack_t *u, codec_reader_t *r, Usp__Set__UpdateParamSetting **pmsg)
+{
+    Usp__Set__UpdateParamSetting *msg;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Set__UpdateParamSetting));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__set__update_param_setting__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->param) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->value) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 3:
+                if (GetBool(r, wire_type, &msg->required) == false)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackNotify(codec_unpack_t *u, codec_reader_t *r, Usp__Notify **pmsg)
+{
+    Usp__Notify *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+    bool result;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Notify));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__notify__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        if (field == 1)
+        {
+            result = Codec_GetSingularString(u, r, wire_type, &msg->subscription_id);
+        }
+        else if (field == 2)
+        {
+            result = GetBool(r, wire_type, &msg->send_resp);
+        }
+        else if ((field > 8) || (msg->notification_case != USP__NOTIFY__NOTIFICATION__NOT_SET) || (Codec_GetSubMessage(r, wire_type, NULL, &sub) == false))
+        {
+            // Exit if more than one member of the oneof is present (protobuf-c handles this case)
+            result = false;
+        }
+        else
+        {
+            msg->notification_case = field;
+            switch(field)
+            {
+                case USP__NOTIFY__NOTIFICATION_EVENT:
+                    result = Codec_UnpackEvent(u, &sub, &msg->event);
+                    break;
+
+                case USP__NOTIFY__NOTIFICATION_VALUE_CHANGE:
+                    result = Codec_UnpackValueChange(u, &sub, &msg->value_change);
+                    break;
+
+                case USP__NOTIFY__NOTIFICATION_OBJ_CREATION:
+                    result = Codec_UnpackGeneric(u, &sub, &usp__notify__object_creation__descriptor, &msg->obj_creation);
+                    break;
+
+                case USP__NOTIFY__NOTIFICATION_OBJ_DELETION:
+                    result = Codec_UnpackGeneric(u, &sub, &usp__notify__object_deletion__descriptor, &msg->obj_deletion);
+                    break;
+
+                case USP__NOTIFY__NOTIFICATION_OPER_COMPLETE:
+                    result = Codec_UnpackGeneric(u, &sub, &usp__notify__operation_complete__descriptor, &msg->oper_complete);
+                    break;
+
+                case USP__NOTIFY__NOTIFICATION_ON_BOARD_REQ:
+                    result = Codec_UnpackGeneric(u, &sub, &usp__notify__on_board_request__descriptor, &msg->on_board_req);
+                    break;
+
+                default:
+                    result = false;
+                    break;
+            }
+        }
+
+        if (result == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackEvent(codec_unpack_t *u, codec_reader_t *r, Usp__Notify__Event **pmsg)
+{
+    Usp__Notify__Event *msg;
+    Usp__Notify__Event__ParamsEntry **elem;
+    codec_reader_t sub;
+    unsigned counts[MAX_FIELDS+1];
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Notify__Event));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__notify__event__init(msg);
+    *pmsg = msg;
+
+    if ((Codec_CountFields(*r, counts) == false) ||
+        (Codec_AllocArray(u, counts[3], sizeof(Usp__Notify__Event__ParamsEntry *), &msg->params) == false))
+    {
+        return false;
+    }
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->obj_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->event_name) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 3:
+                elem = &msg->params[msg->n_params++];
+                *elem = NULL;
+                if ((Codec_GetSubMessage(r, wire_type, NULL, &sub) == false) ||
+                    (Codec_UnpackMapEntry(u, &sub, &usp__notify__event__params_entry__descriptor, elem) == false))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackValueChange(codec_unpack_t *u, codec_reader_t *r, Usp__Notify__ValueChange **pmsg)
+{
+    Usp__Notify__ValueChange *msg;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__Notify__ValueChange));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__notify__value_change__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->param_path) == false)
+                {
+                    return false;
+                }
+                break;
+
+            case 2:
+                if (Codec_GetSingularString(u, r, wire_type, &msg->param_value) == false)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackNotifyResp(codec_unpack_t *u, codec_reader_t *r, Usp__NotifyResp **pmsg)
+{
+    Usp__NotifyResp *msg;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(Usp__NotifyResp));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp__notify_resp__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if ((GetTag(r, &field, &wire_type) == false) || (field != 1))
+        {
+            return false;
+        }
+
+        if (Codec_GetSingularString(u, r, wire_type, &msg->subscription_id) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackRecord(codec_unpack_t *u, codec_reader_t *r, UspRecord__Record **pmsg)
+{
+    UspRecord__Record *msg;
+    codec_reader_t sub;
+    int field;
+    int wire_type;
+    int value;
+    bool result;
+
+    msg = Codec_Alloc(u, sizeof(UspRecord__Record));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp_record__record__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if (GetTag(r, &field, &wire_type) == false)
+        {
+            return false;
+        }
+
+        switch(field)
+        {
+            case 1:
+                result = Codec_GetSingularString(u, r, wire_type, &msg->version);
+                break;
+
+            case 2:
+                result = Codec_GetSingularString(u, r, wire_type, &msg->to_id);
+                break;
+
+            case 3:
+                result = Codec_GetSingularString(u, r, wire_type, &msg->from_id);
+                break;
+
+            case 4:
+                result = GetEnum(r, wire_type, &value);
+                if (result)
+                {
+                    msg->payload_security = value;
+                }
+                break;
+
+            case 5:
+                result = Codec_GetBytes(u, r, wire_type, &msg->mac_signature);
+                break;
+
+            case 6:
+                result = Codec_GetBytes(u, r, wire_type, &msg->sender_cert);
+                break;
+
+            case 7:
+            case 8:
+                // Exit if more than one member of the oneof is present (protobuf-c handles this case)
+                if ((msg->record_type_case != USP_RECORD__RECORD__RECORD_TYPE__NOT_SET) || (Codec_GetSubMessage(r, wire_type, NULL, &sub) == false))
+                {
+                    return false;
+                }
+
+                msg->record_type_case = field;
+                if (field == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT)
+                {
+                    result = Codec_UnpackNoSessionContext(u, &sub, &msg->no_session_context);
+                }
+                else
+                {
+                    result = Codec_UnpackGeneric(u, &sub, &usp_record__session_context_record__descriptor, &msg->session_context);
+                }
+                break;
+
+            default:
+                result = false;
+                break;
+        }
+
+        if (result == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Codec_UnpackNoSessionContext(codec_unpack_t *u, codec_reader_t *r, UspRecord__NoSessionContextRecord **pmsg)
+{
+    UspRecord__NoSessionContextRecord *msg;
+    int field;
+    int wire_type;
+
+    msg = Codec_Alloc(u, sizeof(UspRecord__NoSessionContextRecord));
+    if (msg == NULL)
+    {
+        return false;
+    }
+    usp_record__no_session_context_record__init(msg);
+    *pmsg = msg;
+
+    while (r->p < r->end)
+    {
+        if ((GetTag(r, &field, &wire_type) == false) || (field != 2))
+        {
+            return false;
+        }
+
+        if (Codec_GetBytes(u, r, wire_type, &msg->payload) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
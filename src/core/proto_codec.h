@@ -0,0 +1,81 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file proto_codec.h
+ *
+ * Specialized serialization and parsing of the most common USP messages and USP records
+ *
+ */
+#ifndef PROTO_CODEC_H
+#define PROTO_CODEC_H
+
+#include <protobuf-c/protobuf-c.h>
+
+#include "vendor_defs.h"
+#include "usp-msg.pb-c.h"
+#include "usp-record.pb-c.h"
+
+//------------------------------------------------------------------------------
+// API Functions
+size_t PROTO_CODEC_GetMsgPackedSize(const Usp__Msg *msg);
+size_t PROTO_CODEC_PackMsg(const Usp__Msg *msg, uint8_t *buf);
+Usp__Msg *PROTO_CODEC_UnpackMsg(ProtobufCAllocator *allocator, size_t len, const uint8_t *data);
+size_t PROTO_CODEC_GetRecordPackedSize(const UspRecord__Record *rec);
+size_t PROTO_CODEC_PackRecord(const UspRecord__Record *rec, uint8_t *buf);
+UspRecord__Record *PROTO_CODEC_UnpackRecord(ProtobufCAllocator *allocator, size_t len, const uint8_t *data);
+UspRecord__Record *PROTO_CODEC_UnpackRecordInPlace(ProtobufCAllocator *allocator, size_t len, const uint8_t *data);
+
+//------------------------------------------------------------------------------
+// Functions used by USP Agent to serialize and parse USP messages and USP records
+// These use the specialized code in proto_codec.c if ENABLE_SPECIALIZED_PROTOBUF is defined, otherwise protobuf-c's generic code
+#ifdef ENABLE_SPECIALIZED_PROTOBUF
+#define PROTO_CODEC_MSG_GET_PACKED_SIZE(msg)                    PROTO_CODEC_GetMsgPackedSize(msg)
+#define PROTO_CODEC_MSG_PACK(msg, buf)                          PROTO_CODEC_PackMsg(msg, buf)
+#define PROTO_CODEC_MSG_UNPACK(allocator, len, data)            PROTO_CODEC_UnpackMsg(allocator, len, data)
+#define PROTO_CODEC_RECORD_GET_PACKED_SIZE(rec)                 PROTO_CODEC_GetRecordPackedSize(rec)
+#define PROTO_CODEC_RECORD_PACK(rec, buf)                       PROTO_CODEC_PackRecord(rec, buf)
+#define PROTO_CODEC_RECORD_UNPACK(allocator, len, data)         PROTO_CODEC_UnpackRecord(allocator, len, data)
+#define PROTO_CODEC_RECORD_UNPACK_IN_PLACE(allocator, len, data) PROTO_CODEC_UnpackRecordInPlace(allocator, len, data)
+#else
+#define PROTO_CODEC_MSG_GET_PACKED_SIZE(msg)                    usp__msg__get_packed_size(msg)
+#define PROTO_CODEC_MSG_PACK(msg, buf)                          usp__msg__pack(msg, buf)
+#define PROTO_CODEC_MSG_UNPACK(allocator, len, data)            usp__msg__unpack(allocator, len, data)
+#define PROTO_CODEC_RECORD_GET_PACKED_SIZE(rec)                 usp_record__record__get_packed_size(rec)
+#define PROTO_CODEC_RECORD_PACK(rec, buf)                       usp_record__record__pack(rec, buf)
+#define PROTO_CODEC_RECORD_UNPACK(allocator, len, data)         usp_record__record__unpack(allocator, len, data)
+#define PROTO_CODEC_RECORD_UNPACK_IN_PLACE(allocator, len, data) (UspRecord__Record *) protobuf_c_message_unpack_in_place(&usp_record__record__descriptor, allocator, len, data)
+#endif
+
+#endif
@@ -35,23 +35,86 @@
 /**
  * \file proto_trace.c
  *
- * Functions for pretty printing a USP message in protobuf debug format
+ * Functions for pretty printing a USP message in protobuf debug format,
+ * and for capturing USP records in binary form to a file
+ *
+ * The capture file uses the pcap file format (with a private link type), so that it may be decoded offline
+ * Each record in the capture file consists of a capture_hdr_t, followed by the endpoint (not NUL terminated), followed by the
+ * protobuf encoded USP record. All multi-byte fields are in host byte order (as for the pcap headers)
  *
  */
 
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <protobuf-c/protobuf-c.h>
 
 #include "common_defs.h"
 #include "proto_trace.h"
+#include "os_utils.h"
+#include "usp_api.h"
 
 // Number of spaces to use for each indentation block when printing messages in JSON format
 #define INDENTATION 2
 
+//------------------------------------------------------------------------------------
+// Number of further lines of protocol trace that may be printed for the message currently being printed by this thread
+// This is set to -1 once lines have been dropped, so that the trace can be marked as truncated
+static __thread int trace_lines_left;
+
+//------------------------------------------------------------------------------------
+// Definitions for the pcap file format used by the protocol capture file
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_VERSION_MAJOR  2
+#define PCAP_VERSION_MINOR  4
+#define PCAP_SNAPLEN        0x40000
+#define PCAP_LINKTYPE_USER0 147     // Private use link type, so that the captured records are not misinterpreted as network packets
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_hdr_t;
+
+typedef struct
+{
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_record_hdr_t;
+
+// Header preceding each USP record in the capture file
+typedef struct
+{
+    uint8_t direction;          // proto_capture_dir_t
+    uint8_t protocol;           // mtp_protocol_t of the MTP that the USP record was sent or received on
+    uint16_t endpoint_len;      // Length of the endpoint (hostname or STOMP destination) following this header
+} capture_hdr_t;
+
+//------------------------------------------------------------------------------------
+// State of the protocol capture file
+static bool is_capture_enabled = false;         // Only set at startup, before any threads are started
+static char *capture_file = NULL;               // Name of the capture file
+static char *capture_old_file = NULL;           // Name of the file that the capture file is rotated to, when it is full
+static FILE *capture_fp = NULL;                 // Handle of the capture file, or NULL if it could not be written to
+static int capture_file_size = 0;               // Number of bytes written to the current capture file
+static pthread_mutex_t capture_mutex;           // Serializes writes to the capture file from the data model and MTP threads
+
 //------------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void PrintProtobufCMessageRecursive(ProtobufCMessage *msg, int indent);
 void PrintProtobufFieldRecursive(const ProtobufCFieldDescriptor *fields, void *p_value, int indent);
+int OpenCaptureFile(void);
 
 /*********************************************************************//**
 **
@@ -72,10 +135,274 @@ void PROTO_TRACE_ProtobufMessage(ProtobufCMessage *base)
         return;
     }
 
+    // Print the message, limiting the number of lines printed, as rendering large messages (eg GetSupportedDMResp) is slow
+    trace_lines_left = (MAX_PROTO_TRACE_LINES > 0) ? MAX_PROTO_TRACE_LINES : INT_MAX;
     PrintProtobufCMessageRecursive(base, 0);
+    if (trace_lines_left < 0)
+    {
+        USP_PROTOCOL("... (protocol trace truncated after %d lines)", MAX_PROTO_TRACE_LINES);
+    }
     USP_PROTOCOL("\n");
 }
 
+/*********************************************************************//**
+**
+** PROTO_TRACE_StartCapture
+**
+** Starts capturing all USP records sent and received to the specified file
+** NOTE: This function must be called before any threads are started
+**
+** \param   filename - name of the file to capture the USP records to
+**                     When the file reaches PROTO_CAPTURE_MAX_FILE_SIZE, it is renamed with a '.1' suffix, and a new file started
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PROTO_TRACE_StartCapture(char *filename)
+{
+    int err;
+    int len;
+
+    // Exit if unable to create the mutex protecting the capture file
+    err = OS_UTILS_InitMutex(&capture_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    len = strlen(filename);
+    capture_file = USP_STRDUP(filename);
+    capture_old_file = USP_MALLOC(len + sizeof(".1"));
+    memcpy(capture_old_file, filename, len);
+    memcpy(&capture_old_file[len], ".1", sizeof(".1"));
+
+    // Exit if unable to create the capture file
+    err = OpenCaptureFile();
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    is_capture_enabled = true;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** PROTO_TRACE_CaptureRecord
+**
+** Appends the specified USP record to the protocol capture file (if capture is enabled)
+**
+** \param   dir - whether the USP record was received or sent
+** \param   protocol - MTP on which the USP record was received or sent
+** \param   endpoint - hostname or STOMP destination that the USP record was received from or sent to, or NULL if unknown
+** \param   pbuf - pointer to buffer containing protobuf encoded USP record
+** \param   pbuf_len - length of protobuf encoded USP record
+**
+** \return  None
+**
+**************************************************************************/
+void PROTO_TRACE_CaptureRecord(proto_capture_dir_t dir, mtp_protocol_t protocol, char *endpoint, unsigned char *pbuf, int pbuf_len)
+{
+    struct timeval tv;
+    pcap_record_hdr_t rec_hdr;
+    capture_hdr_t cap_hdr;
+    int endpoint_len;
+    int len;
+    int err;
+
+    // Exit if protocol capture is not enabled
+    if (is_capture_enabled == false)
+    {
+        return;
+    }
+
+    endpoint_len = (endpoint == NULL) ? 0 : strlen(endpoint);
+    if (endpoint_len > UINT16_MAX)
+    {
+        endpoint_len = UINT16_MAX;
+    }
+
+    gettimeofday(&tv, NULL);
+    len = sizeof(cap_hdr) + endpoint_len + pbuf_len;
+    rec_hdr.ts_sec = tv.tv_sec;
+    rec_hdr.ts_usec = tv.tv_usec;
+    rec_hdr.incl_len = len;
+    rec_hdr.orig_len = len;
+
+    cap_hdr.direction = dir;
+    cap_hdr.protocol = protocol;
+    cap_hdr.endpoint_len = endpoint_len;
+
+    OS_UTILS_LockMutex(&capture_mutex);
+
+    // Exit if the capture file could not be written to previously
+    if (capture_fp == NULL)
+    {
+        goto exit;
+    }
+
+    // Rotate the capture file, if this record would take it over its maximum size
+    if ((capture_file_size > sizeof(pcap_file_hdr_t)) && (capture_file_size + sizeof(rec_hdr) + len > PROTO_CAPTURE_MAX_FILE_SIZE))
+    {
+        fclose(capture_fp);
+        capture_fp = NULL;
+        rename(capture_file, capture_old_file);
+
+        // Exit if unable to start a new capture file
+        err = OpenCaptureFile();
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+    }
+
+    // Exit if unable to write the record to the capture file, stopping any further capture
+    if ((fwrite(&rec_hdr, sizeof(rec_hdr), 1, capture_fp) != 1) ||
+        (fwrite(&cap_hdr, sizeof(cap_hdr), 1, capture_fp) != 1) ||
+        ((endpoint_len > 0) && (fwrite(endpoint, endpoint_len, 1, capture_fp) != 1)) ||
+        ((pbuf_len > 0) && (fwrite(pbuf, pbuf_len, 1, capture_fp) != 1)) ||
+        (fflush(capture_fp) != 0))
+    {
+        USP_LOG_Error("%s: Failed to write to protocol capture file %s (%s). Stopping protocol capture", __FUNCTION__, capture_file, strerror(errno));
+        fclose(capture_fp);
+        capture_fp = NULL;
+        goto exit;
+    }
+
+    capture_file_size += sizeof(rec_hdr) + len;
+
+exit:
+    OS_UTILS_UnlockMutex(&capture_mutex);
+}
+
+/*********************************************************************//**
+**
+** PROTO_TRACE_ReadCapture
+**
+** Reads all USP records from the specified protocol capture file (written by PROTO_TRACE_CaptureRecord),
+** calling the specified callback for each one, in the order that they were captured
+**
+** \param   filename - name of the protocol capture file to read
+** \param   callback - function to call for each USP record in the capture file
+** \param   arg - argument to pass to the callback
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PROTO_TRACE_ReadCapture(char *filename, proto_capture_cb_t callback, void *arg)
+{
+    FILE *fp;
+    pcap_file_hdr_t file_hdr;
+    pcap_record_hdr_t rec_hdr;
+    capture_hdr_t cap_hdr;
+    char *endpoint = NULL;
+    unsigned char *pbuf = NULL;
+    int pbuf_len;
+    unsigned long long capture_time;
+    int err = USP_ERR_INTERNAL_ERROR;
+
+    // Exit if unable to open the capture file
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        USP_ERR_ERRNO("fopen", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the file is not a protocol capture file
+    if ((fread(&file_hdr, sizeof(file_hdr), 1, fp) != 1) || (file_hdr.magic != PCAP_MAGIC) || (file_hdr.linktype != PCAP_LINKTYPE_USER0))
+    {
+        USP_ERR_SetMessage("%s: %s is not a protocol capture file", __FUNCTION__, filename);
+        goto exit;
+    }
+
+    // Iterate over all records in the capture file
+    while (fread(&rec_hdr, sizeof(rec_hdr), 1, fp) == 1)
+    {
+        // Exit if the record is truncated or malformed
+        if ((rec_hdr.incl_len < sizeof(cap_hdr)) || (rec_hdr.incl_len > PCAP_SNAPLEN + UINT16_MAX) ||
+            (fread(&cap_hdr, sizeof(cap_hdr), 1, fp) != 1) || (sizeof(cap_hdr) + cap_hdr.endpoint_len > rec_hdr.incl_len))
+        {
+            USP_ERR_SetMessage("%s: Malformed record in protocol capture file %s", __FUNCTION__, filename);
+            goto exit;
+        }
+
+        pbuf_len = rec_hdr.incl_len - sizeof(cap_hdr) - cap_hdr.endpoint_len;
+        endpoint = USP_MALLOC(cap_hdr.endpoint_len + 1);
+        pbuf = USP_MALLOC(pbuf_len + 1);    // Plus 1 to avoid a zero length allocation
+
+        // Exit if the record is truncated
+        if (((cap_hdr.endpoint_len > 0) && (fread(endpoint, cap_hdr.endpoint_len, 1, fp) != 1)) ||
+            ((pbuf_len > 0) && (fread(pbuf, pbuf_len, 1, fp) != 1)))
+        {
+            USP_ERR_SetMessage("%s: Truncated record in protocol capture file %s", __FUNCTION__, filename);
+            goto exit;
+        }
+        endpoint[cap_hdr.endpoint_len] = '\0';
+
+        capture_time = (unsigned long long)rec_hdr.ts_sec * 1000000 + rec_hdr.ts_usec;
+        callback(cap_hdr.direction, cap_hdr.protocol, endpoint, capture_time, pbuf, pbuf_len, arg);
+
+        USP_FREE(endpoint);
+        USP_FREE(pbuf);
+        endpoint = NULL;
+        pbuf = NULL;
+    }
+
+    err = USP_ERR_OK;
+
+exit:
+    USP_SAFE_FREE(endpoint);
+    USP_SAFE_FREE(pbuf);
+    fclose(fp);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** OpenCaptureFile
+**
+** Creates a new protocol capture file, writing the pcap file header to it
+** NOTE: This function must be called with the capture mutex held, or before any threads are started
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int OpenCaptureFile(void)
+{
+    pcap_file_hdr_t file_hdr;
+
+    // Exit if unable to create the capture file
+    capture_fp = fopen(capture_file, "w");
+    if (capture_fp == NULL)
+    {
+        USP_ERR_ERRNO("fopen", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    memset(&file_hdr, 0, sizeof(file_hdr));
+    file_hdr.magic = PCAP_MAGIC;
+    file_hdr.version_major = PCAP_VERSION_MAJOR;
+    file_hdr.version_minor = PCAP_VERSION_MINOR;
+    file_hdr.snaplen = PCAP_SNAPLEN;
+    file_hdr.linktype = PCAP_LINKTYPE_USER0;
+
+    // Exit if unable to write the file header
+    if (fwrite(&file_hdr, sizeof(file_hdr), 1, capture_fp) != 1)
+    {
+        USP_LOG_Error("%s: Failed to write to protocol capture file %s (%s)", __FUNCTION__, capture_file, strerror(errno));
+        fclose(capture_fp);
+        capture_fp = NULL;
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    capture_file_size = sizeof(file_hdr);
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** PrintProtobufCMessageRecursive
@@ -110,6 +437,12 @@ void PrintProtobufCMessageRecursive(ProtobufCMessage *msg, int indent)
     n_fields = msg->descriptor->n_fields;
     for (i=0; i<n_fields; i++)
     {
+        // Exit if the cap on the number of lines printed has been reached
+        if (trace_lines_left < 0)
+        {
+            return;
+        }
+
         fields = &msg->descriptor->fields[i];
         offset = fields->offset;
         p_value = (void *) (((char *)msg) + offset);
@@ -189,6 +522,14 @@ void PrintProtobufFieldRecursive(const ProtobufCFieldDescriptor *fields, void *p
         return;
     }
 
+    // Exit if the cap on the number of lines printed has been reached, marking the trace as truncated
+    if (trace_lines_left <= 0)
+    {
+        trace_lines_left = -1;
+        return;
+    }
+    trace_lines_left--;
+
     switch(fields->type)
     {
         case PROTOBUF_C_TYPE_INT32:      /**< int32 */
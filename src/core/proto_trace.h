@@ -35,7 +35,8 @@
 /**
  * \file proto_trace.h
  *
- * Functions for pretty printing a USP message in protobuf debug format
+ * Functions for pretty printing a USP message in protobuf debug format,
+ * and for capturing USP records in binary form to a file
  *
  */
 #ifndef PROTO_TRACE_H
@@ -43,9 +44,28 @@
 
 #include <protobuf-c/protobuf-c.h>
 
+#include "mtp_exec.h"
+
+//------------------------------------------------------------------------------
+// Enumeration of the direction of a USP record written to the protocol capture file
+typedef enum
+{
+    kProtoCaptureDir_Received,      // USP record was received from a controller
+    kProtoCaptureDir_Sent,          // USP record was sent to a controller
+} proto_capture_dir_t;
+
+//------------------------------------------------------------------------------
+// Callback called by PROTO_TRACE_ReadCapture() for each USP record in a protocol capture file
+// NOTE: The endpoint and pbuf buffers are only valid for the duration of the callback
+typedef void (*proto_capture_cb_t)(proto_capture_dir_t dir, mtp_protocol_t protocol, char *endpoint,
+                                   unsigned long long capture_time, unsigned char *pbuf, int pbuf_len, void *arg);
+
 //------------------------------------------------------------------------------
 // API Functions
 void PROTO_TRACE_ProtobufMessage(ProtobufCMessage *msg);
+int PROTO_TRACE_StartCapture(char *filename);
+void PROTO_TRACE_CaptureRecord(proto_capture_dir_t dir, mtp_protocol_t protocol, char *endpoint, unsigned char *pbuf, int pbuf_len);
+int PROTO_TRACE_ReadCapture(char *filename, proto_capture_cb_t callback, void *arg);
 
 
 #endif
@@ -0,0 +1,594 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file replay.c
+ *
+ * Replays the USP records received from controllers in a protocol capture file (see PROTO_TRACE_StartCapture)
+ * into the data model thread, with either their original timing, or accelerated timing, measuring the latency
+ * of each USP record (the time from posting it to the data model thread, to the time its processing completed)
+ * This allows performance changes to be validated against a real workload, when the agent is run against a
+ * snapshot of the database that the workload was captured with
+ *
+ * NOTE: Responses to the replayed USP records are sent to the controller's configured MTP, as for any other USP message
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "usp-record.pb-c.h"
+#include "msg_handler.h"
+#include "dm_exec.h"
+#include "device.h"
+#include "os_utils.h"
+#include "proto_trace.h"
+#include "uptime.h"
+#include "replay.h"
+
+//------------------------------------------------------------------------------
+// Number of USP message types, used to index the latency statistics. An extra entry is used for USP records
+// whose USP message type could not be determined (eg segmented E2E session context records)
+#define NUM_USP_MSG_TYPES  (USP__HEADER__MSG_TYPE__GET_SUPPORTED_PROTO_RESP + 1)
+#define UNKNOWN_MSG_TYPE   NUM_USP_MSG_TYPES
+
+//------------------------------------------------------------------------------
+// Protocol that USP records are replayed as, if they were not captured on an MTP which takes the controller's role from the USP record
+// NOTE: USP records captured on STOMP cannot be replayed as STOMP, because the role of a STOMP controller is instead taken from
+//       its STOMP connection (which may differ from ROLE_DEFAULT, the role that replayed USP records are posted with)
+//       If no such MTP is compiled in, then replay is not supported (see REPLAY_Init)
+#if defined(ENABLE_WEBSOCKETS)
+#define REPLAY_PROTOCOL  kMtpProtocol_WebSockets
+#elif defined(ENABLE_MQTT)
+#define REPLAY_PROTOCOL  kMtpProtocol_MQTT
+#elif defined(ENABLE_COAP)
+#define REPLAY_PROTOCOL  kMtpProtocol_CoAP
+#else
+#define REPLAY_PROTOCOL  kMtpProtocol_None
+#endif
+
+//------------------------------------------------------------------------------
+// Period (in microseconds) at which the replay thread polls, whilst waiting for the data model thread
+#define REPLAY_POLL_PERIOD  10000
+
+// Time (in seconds) after which the replay thread stops waiting for the remaining replayed USP records to be processed,
+// if none have completed. This occurs if any replayed USP records were dropped by DM_EXEC_PostUspRecord()
+#define REPLAY_COMPLETION_TIMEOUT  60
+
+//------------------------------------------------------------------------------
+// USP record to replay
+typedef struct
+{
+    unsigned char *pbuf;                // Protobuf encoded USP record
+    int pbuf_len;
+    mtp_protocol_t protocol;            // MTP that the USP record was originally received on
+    unsigned long long capture_time;    // Time (in microseconds) at which the USP record was originally received
+    int msg_type;                       // Type of the USP message contained in the USP record, or UNKNOWN_MSG_TYPE
+    char *msg_id;                       // Message ID of the USP message contained in the USP record, or NULL if unknown
+
+    // Following member variables are written by the thread processing the USP record
+    unsigned long long latency;         // Time (in microseconds) from posting the USP record, to its processing completing
+    bool is_handled;                    // Set once the latency has been written
+} replay_record_t;
+
+static replay_record_t *replay_records = NULL;
+static int num_replay_records = 0;
+
+//------------------------------------------------------------------------------
+// State of the replay
+static char *replay_file = NULL;            // Name of the protocol capture file being replayed, or NULL if replay is not enabled
+static unsigned replay_speed = 1;           // Factor to accelerate the original timing by, or 0 to replay as fast as possible
+static unsigned long long replay_start_time = 0;   // Time (from tu_uptime_usecs) at which the first USP record was posted
+static unsigned long long replay_end_time = 0;     // Time (from tu_uptime_usecs) at which the replay completed, or 0 if still in progress
+static int num_posted = 0;                  // Number of USP records posted to the data model thread so far
+static int num_handled = 0;                 // Number of USP records whose processing has completed
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void AddReplayRecord(proto_capture_dir_t dir, mtp_protocol_t protocol, char *endpoint,
+                     unsigned long long capture_time, unsigned char *pbuf, int pbuf_len, void *arg);
+void DetermineReplayMsgType(replay_record_t *rr);
+mtp_protocol_t CalcReplayProtocol(mtp_protocol_t protocol);
+void *ReplayMain(void *args);
+void WaitForReplayCompletion(void);
+void WriteReplayLatencies(void);
+int CompareLatencies(const void *entry1, const void *entry2);
+
+/*********************************************************************//**
+**
+** REPLAY_Init
+**
+** Loads the USP records to replay from the specified protocol capture file
+** NOTE: This function must be called before any threads are started
+**
+** \param   filename - name of the protocol capture file (written using the '-x' option) to replay
+** \param   speed - factor to accelerate the original timing of the USP records by, or 0 to replay as fast as possible
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int REPLAY_Init(char *filename, unsigned speed)
+{
+    int err;
+
+    // Exit if no MTP is compiled in which USP records can be replayed as
+    if (REPLAY_PROTOCOL == kMtpProtocol_None)
+    {
+        USP_ERR_SetMessage("%s: Replay requires the agent to be built with WebSockets, MQTT or CoAP support", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to read the capture file
+    err = PROTO_TRACE_ReadCapture(filename, AddReplayRecord, NULL);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Exit if the capture file did not contain any USP records received from controllers
+    if (num_replay_records == 0)
+    {
+        USP_ERR_SetMessage("%s: No received USP records in %s", __FUNCTION__, filename);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    replay_file = USP_STRDUP(filename);
+    replay_speed = speed;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** REPLAY_Start
+**
+** Starts the thread which replays the USP records, if replay is enabled
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int REPLAY_Start(void)
+{
+    // Exit if replay is not enabled
+    if (replay_file == NULL)
+    {
+        return USP_ERR_OK;
+    }
+
+    return OS_UTILS_CreateClassThread(kThreadClass_Mtp, ReplayMain, NULL);
+}
+
+/*********************************************************************//**
+**
+** REPLAY_RecordHandled
+**
+** Records the latency of a replayed USP record, once its processing has completed
+** NOTE: This function is called by the data model thread, or by a Get worker thread
+**
+** \param   replay_id - identifies the replayed USP record (counts from 1)
+** \param   rx_time - time (from tu_uptime_usecs) at which the USP record was posted to the data model thread
+**
+** \return  None
+**
+**************************************************************************/
+void REPLAY_RecordHandled(unsigned replay_id, unsigned long long rx_time)
+{
+    replay_record_t *rr;
+
+    // Exit if the replay ID is out of range. This should never occur
+    if ((replay_id == 0) || (replay_id > num_replay_records))
+    {
+        return;
+    }
+
+    rr = &replay_records[replay_id-1];
+    rr->latency = tu_uptime_usecs() - rx_time;
+    __atomic_store_n(&rr->is_handled, true, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&num_handled, 1, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************//**
+**
+** REPLAY_Dump
+**
+** Prints the latency statistics of the USP records replayed so far, for each type of USP message
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void REPLAY_Dump(void)
+{
+    int i, j;
+    int count;
+    unsigned long long *latencies;
+    unsigned long long total;
+    unsigned long long elapsed;
+    unsigned long long end_time;
+    replay_record_t *rr;
+
+    if (replay_file == NULL)
+    {
+        USP_DUMP("Replay not enabled");
+        return;
+    }
+
+    end_time = __atomic_load_n(&replay_end_time, __ATOMIC_ACQUIRE);
+    elapsed = (end_time != 0) ? end_time - replay_start_time : tu_uptime_usecs() - replay_start_time;
+    USP_DUMP("Replay of %s (speed=%u): %s", replay_file, replay_speed, (end_time != 0) ? "complete" : "in progress");
+    USP_DUMP("Records: %d  Posted: %d  Handled: %d  Elapsed: %llu ms",
+             num_replay_records, __atomic_load_n(&num_posted, __ATOMIC_ACQUIRE), __atomic_load_n(&num_handled, __ATOMIC_ACQUIRE), elapsed/1000);
+    USP_DUMP("%-26s %8s %10s %10s %10s %10s %10s", "Message type", "Count", "Mean(us)", "Min(us)", "P50(us)", "P99(us)", "Max(us)");
+
+    // Iterate over all USP message types, printing the latency statistics of the handled USP records of that type
+    latencies = USP_MALLOC(num_replay_records * sizeof(unsigned long long));
+    for (i=0; i <= UNKNOWN_MSG_TYPE; i++)
+    {
+        count = 0;
+        total = 0;
+        for (j=0; j < num_replay_records; j++)
+        {
+            rr = &replay_records[j];
+            if ((rr->msg_type == i) && (__atomic_load_n(&rr->is_handled, __ATOMIC_ACQUIRE)))
+            {
+                latencies[count++] = rr->latency;
+                total += rr->latency;
+            }
+        }
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        qsort(latencies, count, sizeof(unsigned long long), CompareLatencies);
+        USP_DUMP("%-26s %8d %10llu %10llu %10llu %10llu %10llu",
+                 (i == UNKNOWN_MSG_TYPE) ? "Unknown" : MSG_HANDLER_UspMsgTypeToString(i), count, total/count,
+                 latencies[0], latencies[(count-1)*50/100], latencies[(count-1)*99/100], latencies[count-1]);
+    }
+
+    USP_FREE(latencies);
+}
+
+/*********************************************************************//**
+**
+** AddReplayRecord
+**
+** Callback called by PROTO_TRACE_ReadCapture() for each USP record in the capture file
+** Only USP records received from controllers are replayed
+**
+** \param   dir - whether the USP record was received or sent
+** \param   protocol - MTP on which the USP record was received or sent
+** \param   endpoint - hostname or STOMP destination that the USP record was received from or sent to (unused)
+** \param   capture_time - time (in microseconds) at which the USP record was captured
+** \param   pbuf - pointer to buffer containing protobuf encoded USP record
+** \param   pbuf_len - length of protobuf encoded USP record
+** \param   arg - unused
+**
+** \return  None
+**
+**************************************************************************/
+void AddReplayRecord(proto_capture_dir_t dir, mtp_protocol_t protocol, char *endpoint,
+                     unsigned long long capture_time, unsigned char *pbuf, int pbuf_len, void *arg)
+{
+    replay_record_t *rr;
+
+    // Exit if this USP record was sent by the agent
+    if (dir != kProtoCaptureDir_Received)
+    {
+        return;
+    }
+
+    replay_records = USP_REALLOC(replay_records, (num_replay_records+1)*sizeof(replay_record_t));
+    rr = &replay_records[num_replay_records];
+    num_replay_records++;
+
+    memset(rr, 0, sizeof(replay_record_t));
+    rr->pbuf = USP_MALLOC(pbuf_len + 1);    // Plus 1 to avoid a zero length allocation
+    memcpy(rr->pbuf, pbuf, pbuf_len);
+    rr->pbuf_len = pbuf_len;
+    rr->protocol = CalcReplayProtocol(protocol);
+    rr->capture_time = capture_time;
+    DetermineReplayMsgType(rr);
+}
+
+/*********************************************************************//**
+**
+** DetermineReplayMsgType
+**
+** Determines the type and message ID of the USP message contained in the specified USP record
+** This is performed when the capture file is loaded, so that it does not affect the timing of the replay
+**
+** \param   rr - pointer to USP record to replay
+**
+** \return  None
+**
+**************************************************************************/
+void DetermineReplayMsgType(replay_record_t *rr)
+{
+    UspRecord__Record *rec;
+    Usp__Msg *usp;
+    ProtobufCBinaryData *payload = NULL;
+
+    rr->msg_type = UNKNOWN_MSG_TYPE;
+    rr->msg_id = NULL;
+
+    // Exit if unable to unpack the USP record
+    rec = usp_record__record__unpack(pbuf_allocator, rr->pbuf_len, rr->pbuf);
+    if (rec == NULL)
+    {
+        return;
+    }
+
+    // Determine the encapsulated USP message
+    // NOTE: Session context records only contain a complete USP message if it is not segmented
+    if (rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_NO_SESSION_CONTEXT)
+    {
+        payload = &rec->no_session_context->payload;
+    }
+    else if ((rec->record_type_case == USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT) &&
+             (rec->session_context->payload_sar_state == USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__NONE) &&
+             (rec->session_context->n_payload == 1))
+    {
+        payload = &rec->session_context->payload[0];
+    }
+
+    if ((payload != NULL) && (payload->len != 0) && (payload->data != NULL))
+    {
+        usp = usp__msg__unpack(pbuf_allocator, payload->len, payload->data);
+        if (usp != NULL)
+        {
+            if ((usp->header != NULL) && (usp->header->msg_type < NUM_USP_MSG_TYPES))
+            {
+                rr->msg_type = usp->header->msg_type;
+                rr->msg_id = USP_STRDUP(usp->header->msg_id);
+            }
+            usp__msg__free_unpacked(usp, pbuf_allocator);
+        }
+    }
+
+    usp_record__record__free_unpacked(rec, pbuf_allocator);
+}
+
+/*********************************************************************//**
+**
+** CalcReplayProtocol
+**
+** Determines the protocol to replay a USP record as, given the protocol that it was captured on
+**
+** \param   protocol - protocol of the MTP that the USP record was captured on
+**
+** \return  protocol to replay the USP record as
+**
+**************************************************************************/
+mtp_protocol_t CalcReplayProtocol(mtp_protocol_t protocol)
+{
+    switch(protocol)
+    {
+#ifdef ENABLE_COAP
+        case kMtpProtocol_CoAP:
+#endif
+#ifdef ENABLE_WEBSOCKETS
+        case kMtpProtocol_WebSockets:
+#endif
+#ifdef ENABLE_MQTT
+        case kMtpProtocol_MQTT:
+#endif
+            return protocol;
+
+        default:
+            // USP records captured on STOMP, or on an MTP not compiled into this agent (or a corrupted capture file)
+            // NOTE: REPLAY_PROTOCOL is never kMtpProtocol_None here, as REPLAY_Init() fails in that case
+            return REPLAY_PROTOCOL;
+    }
+}
+
+/*********************************************************************//**
+**
+** ReplayMain
+**
+** Main loop of the replay thread. Posts each USP record to the data model thread, at its (scaled) original time,
+** then waits for them all to be processed, and writes out their latencies
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None
+**
+**************************************************************************/
+void *ReplayMain(void *args)
+{
+    int i;
+    replay_record_t *rr;
+    mtp_reply_to_t mrt;
+    unsigned long long target_time;
+    unsigned long long cur_time;
+
+    USP_LOG_Info("%s: Replaying %d USP records from %s (speed=%u)", __FUNCTION__, num_replay_records, replay_file, replay_speed);
+    replay_start_time = tu_uptime_usecs();
+
+    for (i=0; i < num_replay_records; i++)
+    {
+        rr = &replay_records[i];
+
+        // Wait until the (scaled) time at which this USP record was originally received
+        if (replay_speed != 0)
+        {
+            target_time = replay_start_time + (rr->capture_time - replay_records[0].capture_time)/replay_speed;
+            cur_time = tu_uptime_usecs();
+            if (target_time > cur_time)
+            {
+                usleep(target_time - cur_time);
+            }
+        }
+
+        // Apply backpressure in the same way as the MTP threads do, so that replayed USP records are not dropped
+        while (USP_MEM_IsBudgetUnderPressure(kMemBudget_DmQueue))
+        {
+            usleep(REPLAY_POLL_PERIOD/10);
+        }
+
+        memset(&mrt, 0, sizeof(mrt));
+        mrt.protocol = rr->protocol;
+        mrt.replay_id = i+1;
+        DM_EXEC_PostUspRecord(rr->pbuf, rr->pbuf_len, ROLE_DEFAULT, NULL, &mrt);
+        __atomic_add_fetch(&num_posted, 1, __ATOMIC_RELEASE);
+    }
+
+    WaitForReplayCompletion();
+    __atomic_store_n(&replay_end_time, tu_uptime_usecs(), __ATOMIC_RELEASE);
+
+    // NOTE: The latency statistics are not dumped from this thread, as the destination of dump output is owned by the CLI server
+    USP_LOG_Info("%s: Replay complete. Use 'obuspa -c dump replay' to show the latency statistics", __FUNCTION__);
+    WriteReplayLatencies();
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** WaitForReplayCompletion
+**
+** Waits until all replayed USP records have been processed, or until no progress has been made for REPLAY_COMPLETION_TIMEOUT seconds
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void WaitForReplayCompletion(void)
+{
+    int handled;
+    int last_handled = -1;
+    unsigned long long last_progress_time = 0;
+    unsigned long long cur_time;
+
+    while (FOREVER)
+    {
+        // Exit if all replayed USP records have been processed
+        handled = __atomic_load_n(&num_handled, __ATOMIC_ACQUIRE);
+        if (handled >= num_replay_records)
+        {
+            return;
+        }
+
+        // Exit if no replayed USP records have completed recently
+        cur_time = tu_uptime_usecs();
+        if (handled != last_handled)
+        {
+            last_handled = handled;
+            last_progress_time = cur_time;
+        }
+        else if (cur_time - last_progress_time > REPLAY_COMPLETION_TIMEOUT*1000000ULL)
+        {
+            USP_LOG_Warning("%s: WARNING: %d replayed USP records did not complete processing", __FUNCTION__, num_replay_records - handled);
+            return;
+        }
+
+        usleep(REPLAY_POLL_PERIOD);
+    }
+}
+
+/*********************************************************************//**
+**
+** WriteReplayLatencies
+**
+** Writes the latency of each replayed USP record to a CSV file named after the capture file, with a '.latency.csv' suffix
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void WriteReplayLatencies(void)
+{
+    char filename[PATH_MAX];
+    FILE *fp;
+    int i;
+    replay_record_t *rr;
+
+    USP_SNPRINTF(filename, sizeof(filename), "%s.latency.csv", replay_file);
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        USP_LOG_Error("%s: Unable to create %s (%s)", __FUNCTION__, filename, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "index,msg_type,msg_id,size,latency_us\n");
+    for (i=0; i < num_replay_records; i++)
+    {
+        rr = &replay_records[i];
+        if (__atomic_load_n(&rr->is_handled, __ATOMIC_ACQUIRE))
+        {
+            fprintf(fp, "%d,%s,%s,%d,%llu\n", i+1, (rr->msg_type == UNKNOWN_MSG_TYPE) ? "Unknown" : MSG_HANDLER_UspMsgTypeToString(rr->msg_type),
+                    (rr->msg_id != NULL) ? rr->msg_id : "", rr->pbuf_len, rr->latency);
+        }
+        else
+        {
+            fprintf(fp, "%d,%s,%s,%d,\n", i+1, (rr->msg_type == UNKNOWN_MSG_TYPE) ? "Unknown" : MSG_HANDLER_UspMsgTypeToString(rr->msg_type),
+                    (rr->msg_id != NULL) ? rr->msg_id : "", rr->pbuf_len);
+        }
+    }
+
+    fclose(fp);
+    USP_LOG_Info("%s: Replay latencies written to %s", __FUNCTION__, filename);
+}
+
+/*********************************************************************//**
+**
+** CompareLatencies
+**
+** qsort() comparison function, used to sort latencies into ascending order
+**
+** \param   entry1 - pointer to first latency to compare
+** \param   entry2 - pointer to second latency to compare
+**
+** \return  -1, 0 or 1 depending on the ordering of the latencies
+**
+**************************************************************************/
+int CompareLatencies(const void *entry1, const void *entry2)
+{
+    unsigned long long l1 = *(const unsigned long long *)entry1;
+    unsigned long long l2 = *(const unsigned long long *)entry2;
+
+    return (l1 > l2) - (l1 < l2);
+}
@@ -101,6 +101,26 @@ void RETRY_WAIT_Init(void)
 **
 **************************************************************************/
 unsigned RETRY_WAIT_Calculate(unsigned retry_count, double m, double k)
+{
+    return RETRY_WAIT_CalculateWithSeed(retry_count, m, k, &dm_thread_random_seed);
+}
+
+/*********************************************************************//**
+**
+**  RETRY_WAIT_CalculateWithSeed
+**
+**  Determines the number of seconds until the specified retry should occur, using the random number generator seed
+**  of the calling thread. This allows threads other than the data model thread to use the TR-157 algorithm
+**
+** \param   retry_count - Number specifying the retry attempt that we want to calculate the delta time to. Counts from 1.
+** \param   m - The minimum wait interval
+** \param   k - The interval multiplier
+** \param   seed - pointer to random number generator seed of the calling thread
+**
+** \return  Number of seconds until the next retry
+**
+**************************************************************************/
+unsigned RETRY_WAIT_CalculateWithSeed(unsigned retry_count, double m, double k, unsigned *seed)
 {
     unsigned min_seconds;
     unsigned max_seconds;
@@ -125,7 +145,7 @@ unsigned RETRY_WAIT_Calculate(unsigned retry_count, double m, double k)
     max_seconds = (unsigned) (m * pow(k/1000, retry_count));
 
     range = max_seconds - min_seconds;
-    random_value = rand_r(&dm_thread_random_seed);
+    random_value = rand_r(seed);
     if (range > 0)
     {
         wait_time = min_seconds + random_value % range;
@@ -140,6 +160,81 @@ unsigned RETRY_WAIT_Calculate(unsigned retry_count, double m, double k)
     return wait_time;
 }
 
+/*********************************************************************//**
+**
+**  RETRY_WAIT_CalculateDecorrelated
+**
+**  Determines the number of seconds until the next retry, using the decorrelated jitter algorithm
+**  Each wait time is chosen randomly between the initial interval and 3 times the previous wait time (limited to the max interval)
+**  Since each wait depends on the previous random wait (rather than on the retry count), the retries of a population
+**  of devices which all lost connection at the same time do not stay synchronized
+**
+** \param   prev_wait - number of seconds waited before the previous retry, or 0 if this is the first retry
+** \param   initial_interval - The minimum wait interval
+** \param   max_interval - The maximum wait interval
+** \param   seed - pointer to random number generator seed of the calling thread
+**
+** \return  Number of seconds until the next retry
+**
+**************************************************************************/
+unsigned RETRY_WAIT_CalculateDecorrelated(unsigned prev_wait, unsigned initial_interval, unsigned max_interval, unsigned *seed)
+{
+    unsigned long long upper;
+    unsigned range;
+    unsigned wait_time;
+
+    // The first retry is based on the initial interval
+    if (prev_wait < initial_interval)
+    {
+        prev_wait = initial_interval;
+    }
+
+    // Calculate the upper bound of the wait time, limiting it to the maximum
+    // NOTE: Calculation performed using 64 bit arithmetic to prevent overflow
+    upper = 3 * (unsigned long long)prev_wait;
+    if (upper > max_interval)
+    {
+        upper = max_interval;
+    }
+
+    // Exit if the maximum is less than the minimum (this is the case if the ACS has misconfigured the retry parameters)
+    if (upper <= initial_interval)
+    {
+        return (unsigned)upper;
+    }
+
+    range = (unsigned)upper - initial_interval;
+    wait_time = initial_interval + rand_r(seed) % (range + 1);
+
+    return wait_time;
+}
+
+/*********************************************************************//**
+**
+**  RETRY_WAIT_ApplyServerHint
+**
+**  Adjusts the calculated retry wait time to take account of a retry hint given by the server
+**  The hint is treated as the minimum time to wait. If it is used, then a random spread of up to a quarter of the hint
+**  is added to it, so that a population of devices given the same hint do not all retry at the same time
+**
+** \param   wait_time - number of seconds until the next retry, as calculated by the retry algorithm
+** \param   hint - number of seconds that the server requested us to wait before retrying, or 0 if no hint was given
+** \param   seed - pointer to random number generator seed of the calling thread
+**
+** \return  Number of seconds until the next retry
+**
+**************************************************************************/
+unsigned RETRY_WAIT_ApplyServerHint(unsigned wait_time, unsigned hint, unsigned *seed)
+{
+    // Exit if the calculated wait time already satisfies the server's hint
+    if (hint <= wait_time)
+    {
+        return wait_time;
+    }
+
+    return hint + rand_r(seed) % (hint/4 + 1);
+}
+
 /*********************************************************************//**
 **
 **  RETRY_WAIT_UseRandomBaseIfUnknownTime
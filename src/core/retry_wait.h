@@ -51,6 +51,15 @@
 
 unsigned RETRY_WAIT_Calculate(unsigned retry_count, double m, double k);
 
+//----------------------------------------------------
+// Enumeration of the algorithms that may be used to calculate the time to wait between connection retries
+typedef enum
+{
+    kRetryAlgorithm_Standard,           // The exponential backoff algorithm defined by the relevant standard (eg TR-181 for STOMP)
+    kRetryAlgorithm_DecorrelatedJitter, // Each wait is chosen randomly between the initial interval and 3 times the previous wait
+                                        // This spreads out the retries of a population of devices, after they all lose connection at the same time
+} retry_algorithm_t;
+
 //----------------------------------------------------
 // Random number generator seeds used by each thread
 extern unsigned dm_thread_random_seed;
@@ -60,6 +69,9 @@ extern unsigned mtp_thread_random_seed;
 // API
 void RETRY_WAIT_Init(void);
 unsigned RETRY_WAIT_Calculate(unsigned retry_count, double m, double k);
+unsigned RETRY_WAIT_CalculateWithSeed(unsigned retry_count, double m, double k, unsigned *seed);
 time_t RETRY_WAIT_UseRandomBaseIfUnknownTime(time_t base);
+unsigned RETRY_WAIT_CalculateDecorrelated(unsigned prev_wait, unsigned initial_interval, unsigned max_interval, unsigned *seed);
+unsigned RETRY_WAIT_ApplyServerHint(unsigned wait_time, unsigned hint, unsigned *seed);
 
 #endif
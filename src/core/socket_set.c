@@ -38,6 +38,14 @@
  * Basic abstraction around read and write socket sets, with a timeout
  * Socket sets are used to implement flow control on a socket
  *
+ * On Linux the socket set is implemented using epoll. Each thread which calls SOCKET_SET_Select() owns an epoll
+ * instance, and sockets stay registered with it across loop iterations. The callers still rebuild their socket set
+ * every iteration (using the same API as the select() implementation), but only the differences from the previous
+ * iteration result in epoll_ctl() calls, and only the sockets with activity are returned by epoll_wait()
+ * NOTE: Because epoll silently drops the registration of a socket when it is closed, code which closes a socket
+ * that has been added to a socket set must call SOCKET_SET_ForgetSocket() before closing it. Otherwise a new socket
+ * reusing the same file descriptor number would be assumed to be already registered
+ *
  */
 
 #include <sys/select.h>
@@ -47,17 +55,88 @@
 
 #include "common_defs.h"
 #include "socket_set.h"
+#include "sync_timer.h"
+#include "uptime.h"
+
+#ifdef SOCKET_SET_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#ifdef SOCKET_SET_USE_EPOLL
+//------------------------------------------------------------------------------
+// Bits stored (per file descriptor) in epoll_state_t fd_flags[]
+#define WANT_READ      0x01     // Socket has been added to receive from, in the current socket set
+#define WANT_WRITE     0x02     // Socket has been added to send to, in the current socket set
+#define REG_READ       0x04     // Socket is registered with epoll for EPOLLIN
+#define REG_WRITE      0x08     // Socket is registered with epoll for EPOLLOUT
+#define READY_READ     0x10     // Socket has data to read, after the last SOCKET_SET_Select()
+#define READY_WRITE    0x20     // Socket is ready to send data on, after the last SOCKET_SET_Select()
+
+#define WANT_MASK      (WANT_READ | WANT_WRITE)
+#define REG_MASK       (REG_READ | REG_WRITE)
+#define READY_MASK     (READY_READ | READY_WRITE)
+
+// Minimum number of file descriptors that fd_flags[] is sized for
+#define MIN_FD_FLAGS_LEN 64
+
+//------------------------------------------------------------------------------
+// Persistent state of the epoll instance used by a thread
+// NOTE: This is per thread (rather than stored in the socket_set_t) because callers build their socket set in a
+// local variable that is not initialised before the first call to SOCKET_SET_Clear(), and each thread only has one loop waiting for socket activity
+typedef struct
+{
+    int epoll_fd;               // epoll instance, or INVALID if not created yet
+    unsigned char *fd_flags;    // Array indexed by file descriptor, containing WANT_XXX, REG_XXX and READY_XXX bits
+    int fd_flags_len;           // Number of entries allocated in fd_flags[]
+
+    int *wanted_fds;            // File descriptors added to the current socket set
+    int num_wanted;
+    int max_wanted;
+
+    int *registered_fds;        // File descriptors currently registered with epoll
+    int num_registered;
+    int max_registered;
+
+    int *ready_fds;             // File descriptors with activity on them, after the last SOCKET_SET_Select()
+    int num_ready;
+
+    struct epoll_event *events; // Buffer used to receive events from epoll_wait()
+    int max_events;
+} epoll_state_t;
+
+static __thread epoll_state_t epoll_state = { INVALID, NULL, 0, NULL, 0, 0, NULL, 0, 0, NULL, 0, NULL, 0 };
+#endif
+
+//------------------------------------------------------------------------------
+// Count of the number of times that threads have woken up from waiting in SOCKET_SET_Select(), in total and in each
+// of the current and previous minutes of uptime. Used to verify that the agent is not waking up unnecessarily when idle
+// NOTE: These are updated atomically, as they are updated by all threads which wait for socket activity
+static unsigned long long wakeups_total = 0;
+static unsigned wakeup_minute[2] = { 0, 0 };    // Minute of uptime (plus one) that each count is for. 0 denotes that the count is unused
+static unsigned wakeup_count[2] = { 0, 0 };
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+#ifdef SOCKET_SET_USE_EPOLL
+void AddSocketToEpollSet(int sock_fd, int timeout, socket_set_t *set, unsigned want);
+void EnsureFdFlags(epoll_state_t *es, int sock_fd);
+void ClearReadyFlags(epoll_state_t *es);
+void SyncEpollRegistrations(epoll_state_t *es);
+int CalcEpollTimeout(socket_set_t *set);
+#else
 void AddSocketToSet(int sock_fd, int timeout, socket_set_t *set, fd_set *fds);
-void UpdateTimeout(int timeout, socket_set_t *set);
+#endif
+void UpdateTimeout(int timeout, int slack, socket_set_t *set);
+void AlignWakeup(socket_set_t *set);
+void CountWakeup(void);
 
+#ifdef SOCKET_SET_USE_EPOLL
 /*********************************************************************//**
 **
 ** SOCKET_SET_Clear
 **
 ** Clears a socket set of all sockets and sets the timeout to the maximum it can be
+** NOTE: Sockets are not deregistered from epoll here. They are only deregistered by SOCKET_SET_Select(), if they have not been re-added
 **
 ** \param   set - pointer to socket set structure to update
 **
@@ -66,13 +145,25 @@ void UpdateTimeout(int timeout, socket_set_t *set);
 **************************************************************************/
 void SOCKET_SET_Clear(socket_set_t *set)
 {
-    // Clear all fdsets
-    set->numfds = -1;
-    FD_ZERO(&set->readfds);
-    FD_ZERO(&set->writefds);
-    FD_ZERO(&set->execfds);
+    epoll_state_t *es = &epoll_state;
+    int i;
+    int fd;
+
+    // Mark all sockets as not wanted in this socket set
+    for (i=0; i < es->num_wanted; i++)
+    {
+        fd = es->wanted_fds[i];
+        es->fd_flags[fd] &= ~WANT_MASK;
+    }
+    es->num_wanted = 0;
+
+    // Ensure that no sockets are indicated as ready to read/write
+    ClearReadyFlags(es);
+
+    set->num_ready = 0;
     set->timeout.tv_sec = INT_MAX;
     set->timeout.tv_usec = 0;
+    set->latest = INT_MAX;
 }
 
 /*********************************************************************//**
@@ -90,7 +181,7 @@ void SOCKET_SET_Clear(socket_set_t *set)
 **************************************************************************/
 void SOCKET_SET_AddSocketToReceiveFrom(int sock_fd, int timeout, socket_set_t *set)
 {
-    AddSocketToSet(sock_fd, timeout, set, &set->readfds);
+    AddSocketToEpollSet(sock_fd, timeout, set, WANT_READ);
 }
 
 /*********************************************************************//**
@@ -108,25 +199,468 @@ void SOCKET_SET_AddSocketToReceiveFrom(int sock_fd, int timeout, socket_set_t *s
 **************************************************************************/
 void SOCKET_SET_AddSocketToSendTo(int sock_fd, int timeout, socket_set_t *set)
 {
-    AddSocketToSet(sock_fd, timeout, set, &set->writefds);
+    AddSocketToEpollSet(sock_fd, timeout, set, WANT_WRITE);
 }
 
 /*********************************************************************//**
 **
-** SOCKET_SET_UpdateTimeout
+** SOCKET_SET_Select
 **
-** Updates the timeout that the select waits for socket activity
-** This function is called to allow timer events to punctuate the socket activity
+** Waits for activity on the socket set, subject to the minimum timeout setup in the socket set
+** Before waiting, the epoll registrations are brought up to date with the sockets in the socket set
+**
+** \param   set - pointer to socket set structure
+**
+** \return  number of sockets that have activity on them
+**          0 if no sockets have activity on them
+**          -1 if an unrecoverable error occurred
+**
+**************************************************************************/
+int SOCKET_SET_Select(socket_set_t *set)
+{
+    epoll_state_t *es = &epoll_state;
+    int num_events;
+    int i;
+    int fd;
+    unsigned events;
+    unsigned char flags;
+    unsigned char ready;
+
+    // Exit if unable to create the epoll instance for this thread
+    if (es->epoll_fd == INVALID)
+    {
+        es->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (es->epoll_fd == INVALID)
+        {
+            USP_ERR_ERRNO("epoll_create1", errno);
+            return -1;
+        }
+    }
+
+    // Ensure that no sockets are indicated as ready to read/write from a previous call
+    ClearReadyFlags(es);
+    set->num_ready = 0;
+
+    // Only register the differences from the socket set of the previous call
+    SyncEpollRegistrations(es);
+
+    // Ensure that the events buffers are large enough to receive an event for all registered sockets
+    if ((es->max_events < es->num_registered) || (es->max_events == 0))
+    {
+        es->max_events = (es->num_registered > 0) ? es->num_registered : 1;
+        es->events = USP_REALLOC(es->events, es->max_events*sizeof(struct epoll_event));
+        es->ready_fds = USP_REALLOC(es->ready_fds, es->max_events*sizeof(int));
+    }
+
+    // Perform the wait, ending it at the same time as the waits of other threads, if the timeout has slack
+    AlignWakeup(set);
+    num_events = epoll_wait(es->epoll_fd, es->events, es->max_events, CalcEpollTimeout(set));
+    CountWakeup();
+
+    // Exit if an error occurred
+    if (num_events == -1)
+    {
+        // If epoll_wait aborted due to a signal, then just ignore the interruption, and get the caller to retry
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+
+        // Otherwise log the error and exit
+        USP_ERR_ERRNO("epoll_wait", errno);
+        return -1;
+    }
+
+    // Mark the sockets with activity on them
+    // NOTE: Errors and hangups are reported as both readable and writable, as select() would do, so that the caller discovers the error
+    for (i=0; i < num_events; i++)
+    {
+        fd = es->events[i].data.fd;
+        events = es->events[i].events;
+        flags = es->fd_flags[fd];
+
+        ready = 0;
+        if ((flags & WANT_READ) && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        {
+            ready |= READY_READ;
+        }
+
+        if ((flags & WANT_WRITE) && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+        {
+            ready |= READY_WRITE;
+        }
+
+        if (ready != 0)
+        {
+            es->fd_flags[fd] |= ready;
+            es->ready_fds[es->num_ready] = fd;
+            es->num_ready++;
+        }
+    }
+
+    set->num_ready = es->num_ready;
+    return es->num_ready;
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_IsReadyToWrite
+**
+** Determines whether the specified socket is ready to transmit data on
+**
+** \param   sock - socket to determine if it is ready to send data on
+** \param   set - pointer to socket set structure
+**
+** \return  Non-zero if the socket is ready to transmit data on, zero if the socket is not ready to transmit data on
+**
+**************************************************************************/
+int SOCKET_SET_IsReadyToWrite(int sock, socket_set_t *set)
+{
+    epoll_state_t *es = &epoll_state;
+
+    USP_ASSERT(sock != INVALID);
+    if ((set->num_ready == 0) || (sock >= es->fd_flags_len))
+    {
+        return 0;
+    }
+
+    return es->fd_flags[sock] & READY_WRITE;
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_IsReadyToRead
+**
+** Determines whether the specified socket has data to read
+**
+** \param   sock - socket to determine if it has data to read
+** \param   set - pointer to socket set structure
+**
+** \return  Non-zero if the socket has data to read, zero if the socket has no data to read
+**
+**************************************************************************/
+int SOCKET_SET_IsReadyToRead(int sock, socket_set_t *set)
+{
+    epoll_state_t *es = &epoll_state;
+
+    USP_ASSERT(sock != INVALID);
+    if ((set->num_ready == 0) || (sock >= es->fd_flags_len))
+    {
+        return 0;
+    }
+
+    return es->fd_flags[sock] & READY_READ;
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_ForgetSocket
+**
+** Deregisters the specified socket from the calling thread's epoll instance
+** This function must be called before closing a socket that has been added to a socket set
+**
+** \param   sock - socket which is about to be closed
 **
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_ForgetSocket(int sock)
+{
+    epoll_state_t *es = &epoll_state;
+    int i;
+
+    // Exit if the socket is not registered with epoll
+    if ((sock == INVALID) || (sock >= es->fd_flags_len) || ((es->fd_flags[sock] & REG_MASK) == 0))
+    {
+        return;
+    }
+
+    // Deregister the socket. NOTE: Any error is ignored, as the socket is about to be closed anyway
+    (void)epoll_ctl(es->epoll_fd, EPOLL_CTL_DEL, sock, NULL);
+    es->fd_flags[sock] &= ~(REG_MASK | READY_MASK);
+
+    // Remove the socket from the array of registered sockets
+    for (i=0; i < es->num_registered; i++)
+    {
+        if (es->registered_fds[i] == sock)
+        {
+            es->registered_fds[i] = es->registered_fds[es->num_registered-1];
+            es->num_registered--;
+            break;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** AddSocketToEpollSet
+**
+** Adds a socket to send/receive from, to the set
+**
+** \param   sock_fd - socket file descriptor to add to the set
 ** \param   timeout - maximum timeout for activity on the socket (in ms)
 ** \param   set - pointer to socket set structure to update
+** \param   want - WANT_READ or WANT_WRITE
 **
 ** \return  None
 **
 **************************************************************************/
-void SOCKET_SET_UpdateTimeout(int timeout, socket_set_t *set)
+void AddSocketToEpollSet(int sock_fd, int timeout, socket_set_t *set, unsigned want)
+{
+    epoll_state_t *es = &epoll_state;
+
+    USP_ASSERT(sock_fd != INVALID);
+    EnsureFdFlags(es, sock_fd);
+
+    // Add the socket to the array of wanted sockets, if this is the first time it has been added to this socket set
+    if ((es->fd_flags[sock_fd] & WANT_MASK) == 0)
+    {
+        if (es->num_wanted == es->max_wanted)
+        {
+            es->max_wanted = (es->max_wanted == 0) ? 8 : 2*es->max_wanted;
+            es->wanted_fds = USP_REALLOC(es->wanted_fds, es->max_wanted*sizeof(int));
+        }
+        es->wanted_fds[es->num_wanted] = sock_fd;
+        es->num_wanted++;
+    }
+
+    es->fd_flags[sock_fd] |= want;
+
+    UpdateTimeout(timeout, 0, set);
+}
+
+/*********************************************************************//**
+**
+** EnsureFdFlags
+**
+** Ensures that the fd_flags[] array is large enough to contain an entry for the specified socket
+**
+** \param   es - pointer to epoll state for this thread
+** \param   sock_fd - socket file descriptor
+**
+** \return  None
+**
+**************************************************************************/
+void EnsureFdFlags(epoll_state_t *es, int sock_fd)
 {
-    UpdateTimeout(timeout, set);
+    int new_len;
+
+    // Exit if the array is already large enough
+    if (sock_fd < es->fd_flags_len)
+    {
+        return;
+    }
+
+    new_len = (es->fd_flags_len == 0) ? MIN_FD_FLAGS_LEN : es->fd_flags_len;
+    while (new_len <= sock_fd)
+    {
+        new_len *= 2;
+    }
+
+    es->fd_flags = USP_REALLOC(es->fd_flags, new_len);
+    memset(&es->fd_flags[es->fd_flags_len], 0, new_len - es->fd_flags_len);
+    es->fd_flags_len = new_len;
+}
+
+/*********************************************************************//**
+**
+** ClearReadyFlags
+**
+** Marks all sockets as not being ready to read/write
+**
+** \param   es - pointer to epoll state for this thread
+**
+** \return  None
+**
+**************************************************************************/
+void ClearReadyFlags(epoll_state_t *es)
+{
+    int i;
+    int fd;
+
+    for (i=0; i < es->num_ready; i++)
+    {
+        fd = es->ready_fds[i];
+        es->fd_flags[fd] &= ~READY_MASK;
+    }
+    es->num_ready = 0;
+}
+
+/*********************************************************************//**
+**
+** SyncEpollRegistrations
+**
+** Updates the epoll registrations to match the sockets in the current socket set
+** Only sockets which have been added, removed, or whose read/write interest has changed result in an epoll_ctl() call
+**
+** \param   es - pointer to epoll state for this thread
+**
+** \return  None
+**
+**************************************************************************/
+void SyncEpollRegistrations(epoll_state_t *es)
+{
+    int i;
+    int fd;
+    int op;
+    int err;
+    unsigned char flags;
+    unsigned char reg;
+    struct epoll_event ev;
+
+    // Register all sockets whose interest has changed since the previous call
+    for (i=0; i < es->num_wanted; i++)
+    {
+        fd = es->wanted_fds[i];
+        flags = es->fd_flags[fd];
+        reg = ((flags & WANT_READ) ? REG_READ : 0) | ((flags & WANT_WRITE) ? REG_WRITE : 0);
+
+        // Skip if the socket is already registered for the same events
+        if ((flags & REG_MASK) == reg)
+        {
+            continue;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((reg & REG_READ) ? EPOLLIN : 0) | ((reg & REG_WRITE) ? EPOLLOUT : 0);
+        ev.data.fd = fd;
+
+        op = ((flags & REG_MASK) == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        err = epoll_ctl(es->epoll_fd, op, fd, &ev);
+
+        // Recover if the socket was closed (and the file descriptor reused) without calling SOCKET_SET_ForgetSocket()
+        if ((err == -1) && (op == EPOLL_CTL_MOD) && (errno == ENOENT))
+        {
+            err = epoll_ctl(es->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        // Skip this socket if unable to register it
+        if (err == -1)
+        {
+            USP_ERR_ERRNO("epoll_ctl", errno);
+            continue;
+        }
+
+        // Add the socket to the array of registered sockets, if it was not registered before
+        if ((flags & REG_MASK) == 0)
+        {
+            if (es->num_registered == es->max_registered)
+            {
+                es->max_registered = (es->max_registered == 0) ? 8 : 2*es->max_registered;
+                es->registered_fds = USP_REALLOC(es->registered_fds, es->max_registered*sizeof(int));
+            }
+            es->registered_fds[es->num_registered] = fd;
+            es->num_registered++;
+        }
+
+        es->fd_flags[fd] = (flags & ~REG_MASK) | reg;
+    }
+
+    // Deregister all sockets which are no longer in the socket set
+    i = 0;
+    while (i < es->num_registered)
+    {
+        fd = es->registered_fds[i];
+        if ((es->fd_flags[fd] & WANT_MASK) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        // NOTE: Any error is ignored, as the socket may have already been closed (which removes it from epoll)
+        (void)epoll_ctl(es->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        es->fd_flags[fd] &= ~REG_MASK;
+        es->registered_fds[i] = es->registered_fds[es->num_registered-1];
+        es->num_registered--;
+    }
+}
+
+/*********************************************************************//**
+**
+** CalcEpollTimeout
+**
+** Converts the timeout in the socket set into the millisecond timeout used by epoll_wait()
+**
+** \param   set - pointer to socket set structure
+**
+** \return  timeout in milliseconds
+**
+**************************************************************************/
+int CalcEpollTimeout(socket_set_t *set)
+{
+    long long timeout_ms;
+
+    timeout_ms = (long long)set->timeout.tv_sec * 1000 + (set->timeout.tv_usec + 999) / 1000;
+    if (timeout_ms > INT_MAX)
+    {
+        timeout_ms = INT_MAX;
+    }
+    else if (timeout_ms < 0)
+    {
+        timeout_ms = 0;
+    }
+
+    return (int)timeout_ms;
+}
+
+#else
+/*********************************************************************//**
+**
+** SOCKET_SET_Clear
+**
+** Clears a socket set of all sockets and sets the timeout to the maximum it can be
+**
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_Clear(socket_set_t *set)
+{
+    // Clear all fdsets
+    set->numfds = -1;
+    FD_ZERO(&set->readfds);
+    FD_ZERO(&set->writefds);
+    FD_ZERO(&set->execfds);
+    set->timeout.tv_sec = INT_MAX;
+    set->timeout.tv_usec = 0;
+    set->latest = INT_MAX;
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_AddSocketToReceiveFrom
+**
+** Adds a socket to receive from, to the set
+**
+** \param   sock_fd - socket file descriptor to add to the set
+** \param   timeout - maximum timeout for activity on the socket (in ms)
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_AddSocketToReceiveFrom(int sock_fd, int timeout, socket_set_t *set)
+{
+    AddSocketToSet(sock_fd, timeout, set, &set->readfds);
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_AddSocketToSendTo
+**
+** Adds a socket to send to, to the set
+**
+** \param   sock_fd - socket file descriptor to add to the set
+** \param   timeout - maximum timeout for activity on the socket (in ms)
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_AddSocketToSendTo(int sock_fd, int timeout, socket_set_t *set)
+{
+    AddSocketToSet(sock_fd, timeout, set, &set->writefds);
 }
 
 /*********************************************************************//**
@@ -146,8 +680,10 @@ int SOCKET_SET_Select(socket_set_t *set)
 {
     int num_sockets;
 
-    // Perform the select
+    // Perform the select, ending it at the same time as the waits of other threads, if the timeout has slack
+    AlignWakeup(set);
     num_sockets = select(set->numfds+1, &set->readfds, &set->writefds, &set->execfds, &set->timeout);
+    CountWakeup();
 
     // Exit if an error occurred
     if (num_sockets == -1)
@@ -212,6 +748,23 @@ int SOCKET_SET_IsReadyToRead(int sock, socket_set_t *set)
     return FD_ISSET(sock, &set->readfds);
 }
 
+/*********************************************************************//**
+**
+** SOCKET_SET_ForgetSocket
+**
+** Called before closing a socket that has been added to a socket set
+** Nothing needs to be done for the select() implementation, as the socket set is rebuilt every iteration
+**
+** \param   sock - socket which is about to be closed
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_ForgetSocket(int sock)
+{
+    (void)sock;
+}
+
 /*********************************************************************//**
 **
 ** AddSocketToSet
@@ -236,7 +789,91 @@ void AddSocketToSet(int sock_fd, int timeout, socket_set_t *set, fd_set *fds)
         set->numfds = sock_fd;
     }
 
-    UpdateTimeout(timeout, set);
+    UpdateTimeout(timeout, 0, set);
+}
+
+#endif
+
+/*********************************************************************//**
+**
+** SOCKET_SET_UpdateTimeout
+**
+** Updates the timeout that the select waits for socket activity
+** This function is called to allow timer events to punctuate the socket activity
+**
+** \param   timeout - maximum timeout for activity on the socket (in ms)
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_UpdateTimeout(int timeout, socket_set_t *set)
+{
+    UpdateTimeout(timeout, 0, set);
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_UpdateTimeoutWithSlack
+**
+** Updates the timeout that the select waits for socket activity, with a timer event that tolerates being handled late
+** The select may wait for longer than the timeout (by up to the slack), in order to coalesce this timer event with
+** other timer events (of this and other threads), reducing the number of times that the process wakes up
+**
+** \param   timeout - maximum timeout for activity on the socket (in ms)
+** \param   slack - maximum time (in ms) that the timeout may be extended by
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void SOCKET_SET_UpdateTimeoutWithSlack(int timeout, int slack, socket_set_t *set)
+{
+    UpdateTimeout(timeout, slack, set);
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_GetWakeups
+**
+** Returns the number of times that threads have woken up from waiting for socket activity, since the agent started
+**
+** \param   None
+**
+** \return  number of wakeups
+**
+**************************************************************************/
+unsigned long long SOCKET_SET_GetWakeups(void)
+{
+    return __atomic_load_n(&wakeups_total, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** SOCKET_SET_GetWakeupsPerMinute
+**
+** Returns the number of times that threads woke up from waiting for socket activity, during the last complete minute of uptime
+**
+** \param   None
+**
+** \return  number of wakeups in the last minute, or 0 if the agent has not been running for a complete minute yet
+**
+**************************************************************************/
+unsigned SOCKET_SET_GetWakeupsPerMinute(void)
+{
+    unsigned prev_minute;
+    int slot;
+
+    // Exit if the previous minute is the one before the agent started
+    // NOTE: Minutes are counted from one (see CountWakeup), so the number of the previous minute is the number of complete minutes
+    prev_minute = tu_uptime_secs()/60;
+    slot = prev_minute % 2;
+    if ((prev_minute == 0) || (__atomic_load_n(&wakeup_minute[slot], __ATOMIC_RELAXED) != prev_minute))
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&wakeup_count[slot], __ATOMIC_RELAXED);
 }
 
 /*********************************************************************//**
@@ -246,15 +883,17 @@ void AddSocketToSet(int sock_fd, int timeout, socket_set_t *set, fd_set *fds)
 ** Updates the timeout used by the select to be the least of all specified timeouts
 **
 ** \param   timeout - maximum timeout for activity on the socket (in ms)
+** \param   slack - maximum time (in ms) that the timeout may be extended by, in order to coalesce wakeups
 ** \param   set - pointer to socket set structure to update
 **
 ** \return  None
 **
 **************************************************************************/
-void UpdateTimeout(int timeout, socket_set_t *set)
+void UpdateTimeout(int timeout, int slack, socket_set_t *set)
 {
     int period_sec;
     int period_usec;
+    long long latest;
 
     // Update the timeout for activity on any socket
     // Convert period from ms into seconds and us
@@ -268,4 +907,84 @@ void UpdateTimeout(int timeout, socket_set_t *set)
         set->timeout.tv_sec = period_sec;
         set->timeout.tv_usec = period_usec;
     }
-}
\ No newline at end of file
+
+    // Replace the latest time to wait until, if this timeout (plus its slack) must be handled before it
+    latest = (long long)timeout + ((slack > 0) ? slack : 0);
+    if (latest < set->latest)
+    {
+        set->latest = (int)latest;
+    }
+}
+
+/*********************************************************************//**
+**
+** AlignWakeup
+**
+** Extends the timeout of the socket set (within the slack given to it) so that it ends on the latest multiple of
+** WAKEUP_ALIGNMENT_PERIOD since the epoch. As all threads use the same time grid, their timer wakeups are aligned.
+** If there is no multiple within the slack, the timeout is extended to the end of the slack, coalescing as many timer events as possible
+**
+** \param   set - pointer to socket set structure to update
+**
+** \return  None
+**
+**************************************************************************/
+void AlignWakeup(socket_set_t *set)
+{
+    long long timeout;
+    long long cur_time;
+    long long wakeup_time;
+
+    // Exit if the timeout has no slack
+    timeout = (long long)set->timeout.tv_sec * 1000 + (set->timeout.tv_usec + 999) / 1000;
+    if (set->latest <= timeout)
+    {
+        return;
+    }
+
+    // Determine the time at which to wake up
+    cur_time = SYNC_TIMER_TimeMs();
+    wakeup_time = cur_time + set->latest;
+#if WAKEUP_ALIGNMENT_PERIOD > 0
+    if ((wakeup_time / WAKEUP_ALIGNMENT_PERIOD) * WAKEUP_ALIGNMENT_PERIOD >= cur_time + timeout)
+    {
+        wakeup_time = (wakeup_time / WAKEUP_ALIGNMENT_PERIOD) * WAKEUP_ALIGNMENT_PERIOD;
+    }
+#endif
+
+    set->timeout.tv_sec = (wakeup_time - cur_time) / 1000;
+    set->timeout.tv_usec = ((wakeup_time - cur_time) % 1000) * 1000;
+}
+
+/*********************************************************************//**
+**
+** CountWakeup
+**
+** Counts a wakeup of the calling thread from waiting for socket activity
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void CountWakeup(void)
+{
+    unsigned minute;
+    unsigned count_minute;
+    int slot;
+
+    __atomic_fetch_add(&wakeups_total, 1, __ATOMIC_RELAXED);
+
+    // Restart the count for this minute, if the slot contains the count for an earlier minute
+    // NOTE: A wakeup counted by another thread at the instant that the count is restarted may be lost. This is acceptable for a statistic
+    minute = tu_uptime_secs()/60 + 1;
+    slot = minute % 2;
+    count_minute = __atomic_load_n(&wakeup_minute[slot], __ATOMIC_RELAXED);
+    if ((count_minute != minute) &&
+        (__atomic_compare_exchange_n(&wakeup_minute[slot], &count_minute, minute, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)))
+    {
+        __atomic_store_n(&wakeup_count[slot], 0, __ATOMIC_RELAXED);
+    }
+
+    __atomic_fetch_add(&wakeup_count[slot], 1, __ATOMIC_RELAXED);
+}
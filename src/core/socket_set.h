@@ -43,6 +43,13 @@
 
 #include <sys/select.h>
 
+//------------------------------------------------------------------------------
+// On Linux, socket sets are implemented using epoll, which keeps sockets registered with the kernel across
+// successive calls to SOCKET_SET_Select(). Define SOCKET_SET_USE_SELECT to revert to the portable select() implementation
+#if defined(__linux__) && !defined(SOCKET_SET_USE_SELECT)
+#define SOCKET_SET_USE_EPOLL
+#endif
+
 //------------------------------------------------------------------------------
 // Maximum socket timeout that the code uses - 1 hour in milliseconds
 #define MAX_SOCKET_TIMEOUT_SECONDS 3600
@@ -52,11 +59,16 @@
 // Socket set structure
 typedef struct
 {
+#ifdef SOCKET_SET_USE_EPOLL
+    int num_ready;      // Number of sockets with activity on them, after SOCKET_SET_Select()
+#else
     int numfds;
     fd_set readfds;
     fd_set writefds;
     fd_set execfds;
+#endif
     struct timeval timeout;
+    int latest;         // Latest time (in ms) that the wait may be extended to, in order to coalesce timer events (see SOCKET_SET_UpdateTimeoutWithSlack)
 } socket_set_t;
 
 //------------------------------------------------------------------------------
@@ -65,8 +77,12 @@ void SOCKET_SET_Clear(socket_set_t *set);
 void SOCKET_SET_AddSocketToReceiveFrom(int sock_fd, int timeout, socket_set_t *set);
 void SOCKET_SET_AddSocketToSendTo(int sock_fd, int timeout, socket_set_t *set);
 void SOCKET_SET_UpdateTimeout(int timeout, socket_set_t *set);
+void SOCKET_SET_UpdateTimeoutWithSlack(int timeout, int slack, socket_set_t *set);
 int SOCKET_SET_IsReadyToWrite(int sock, socket_set_t *set);
 int SOCKET_SET_IsReadyToRead(int sock, socket_set_t *set);
 int SOCKET_SET_Select(socket_set_t *set);
+void SOCKET_SET_ForgetSocket(int sock);
+unsigned long long SOCKET_SET_GetWakeups(void);
+unsigned SOCKET_SET_GetWakeupsPerMinute(void);
 
 #endif
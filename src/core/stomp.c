@@ -45,9 +45,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <math.h>
 #include <net/if.h>
@@ -65,6 +67,7 @@
 #include "stomp.h"
 #include "usp-msg.pb-c.h"
 #include "mtp_exec.h"
+#include "mtp_send_queue.h"
 #include "msg_handler.h"
 #include "proto_trace.h"
 #include "data_model.h"
@@ -72,24 +75,35 @@
 #include "text_utils.h"
 #include "device.h"
 #include "nu_ipaddr.h"
+#include "dns_cache.h"
 #include "os_utils.h"
 #include "dm_exec.h"
 #include "nu_macaddr.h"
 #include "retry_wait.h"
+#include "uptime.h"
+#include "usp_probe.h"
+#include "usp_compress.h"
+#include "str_vector.h"
 
 
 //------------------------------------------------------------------------------
 // General definitions used in code
 #define EMPTY_BODY ""
 
+#define STOMP_HANDSHAKE_TIMEOUT 30 // Total time allowed to perform the STOMP handshake sequence (ie STOMP, CONNECTED, SUBSCRIBE frames)
+
 #define BBF_STOMP_CONTENT_TYPE        "application/vnd.bbf.usp.msg"
 #define BBF_STOMP_ERROR_CONTENT_TYPE  "application/vnd.bbf.usp.error"
 
+// Header which the STOMP server may include in an ERROR frame, containing the number of seconds it would like us to wait before reconnecting
+#define STOMP_RETRY_AFTER_HEADER      "retry-after:"
+
 //------------------------------------------------------------------------------
 // State of a STOMP connection
 typedef enum
 {
     kStompState_Idle,                       // Not yet connected
+    kStompState_ResolvingHost,              // Waiting for the (asynchronous) lookup of the IP address of the STOMP server to complete
     kStompState_SendingStompFrame,          // TCP connected to the STOMP server and currently sending the initial STOMP frame
     kStompState_AwaitingConnectedFrame,     // Awaiting the response to the STOMP frame, the CONNECTED frame
     kStompState_SendingSubscribeFrame,      // Sending the subscribe frame, to subscribe to this Agent's queue
@@ -104,6 +118,7 @@ typedef enum
 char *state_names[kStompState_Max] =
 {
     "Idle",                     // kStompState_Idle
+    "ResolvingHost",            // kStompState_ResolvingHost
     "SendingStompFrame",        // kStompState_SendingStompFrame
     "AwaitingConnectedFrame",   // kStompState_AwaitingConnectedFrame
     "SendingSubscribeFrame",    // kStompState_SendingSubscribeFrame
@@ -125,6 +140,10 @@ enum_entry_t stomp_failure_strings[] =
     { kStompFailure_OtherError, "Error"},
 };
 
+//------------------------------------------------------------------------------
+// Value returned by StompWrite() if the write could not complete yet, and must be retried once the socket is ready
+#define STOMP_WRITE_PENDING  (-2)
+
 //------------------------------------------------------------------------------
 // Definition of flags for schedule_resubscribe
 #define SCHEDULE_UNSUBSCRIBE  0x00000001
@@ -146,6 +165,7 @@ typedef struct
     unsigned incoming_heartbeat_period;  // in ms. NOTE: the negotiated heartbeat_period is stored in seconds
     unsigned outgoing_heartbeat_period;  // in ms
     stomp_retry_params_t retry;         // Parameters associated with retrying the connection
+    stomp_tcp_params_t tcp;             // TCP socket options to apply to the connection
     char *provisionned_queue;           // Name of stomp queue to subscribe to (in Device.LocalAgent.MTP.{i}.STOMP.Destination)
                                         // NOTE This may be NULL or blank, because the queue may be provisionned by the controller in the CONNECTED frame
 
@@ -155,6 +175,8 @@ typedef struct
     time_t  stomp_handshake_timeout;   // Absolute Time by which the STOMP connection should have performed initial STOMP handshake (ie STOMP, CONNECTED, SUBSCRIBE frame sequence)
     int retry_count;        // Number of times that the connection has been tried, and has failed. Starts from 0.
     time_t retry_time;      // If state is kStompState_Retrying, then this is the unix time at which the retry should be attempted
+    unsigned last_retry_wait;   // Number of seconds waited before the last retry (before applying any server hint). Used by the decorrelated jitter retry algorithm
+    unsigned server_retry_hint; // Number of seconds that the server requested (in an ERROR frame) that we wait before reconnecting. 0 if no hint was given
     stomp_failure_t failure_code; // If the STOMP connection fails, this gets set to the last cause of failure
     scheduled_action_t  schedule_reconnect;  // Sets whether a STOMP reconnect is scheduled after the send queue has cleared
     unsigned  schedule_resubscribe;  // Sets whether a STOMP UNSUBSCRIBE/SUBSCRIBE is scheduled after the current STOMP frame has been sent
@@ -163,6 +185,16 @@ typedef struct
     SSL *ssl;               // SSL used for this STOMP connection
     STACK_OF(X509) *cert_chain; // Full SSL certificate chain for the STOMP connection, collected in the SSL verify callback
 
+    SSL_SESSION *tls_session;   // TLS session (or session ticket) received from the server, used to resume the session when reconnecting. NULL if none.
+                                // NOTE: This is kept across reconnects, and only freed if the connection is disabled, or the session cannot be resumed
+    char *tls_session_host;     // Host and port of the server with which the last full TLS handshake was performed (ie the server that tls_session is valid for)
+    int tls_session_port;
+    ctrust_role_t tls_session_role;        // Role determined from the server's certificate chain in the last full TLS handshake
+    char *tls_session_allowed_controllers; // Allowed controllers determined from the server's certificate chain in the last full TLS handshake
+                                           // NOTE: These are needed because the certificate chain is not verified (and hence not collected) when a session is resumed
+    unsigned tls_full_handshakes;    // Number of TLS handshakes which required a full handshake (ie performed certificate verification)
+    unsigned tls_resumed_handshakes; // Number of TLS handshakes which resumed a previous session
+
     char *allowed_controllers; // pattern describing the endpoint_id of controllers which is granted access to this agent
     ctrust_role_t role;     // role granted by the CA cert in the chain of trust with the STOMP broker
 
@@ -176,18 +208,34 @@ typedef struct
 
     time_t last_received_time; // Last time at which a heartbeat or a USP message was received from the server, or INVALID_TIME if nothing received yet (eg connection is in retrying state)
 
-    unsigned char *rxframe;   // pointer to buffer, used to concatenate message fragments until a complete message has been received
-    int rxframe_msglen;       // number of message bytes copied into rxframe
-    int rxframe_maxlen;       // size of rxframe allocated 
+    unsigned char *rxframe_buf; // pointer to buffer, used to concatenate message fragments until a complete message has been received
+                              // This buffer is kept for the lifetime of the connection. Frames are parsed and handled in place, without being copied.
+    unsigned char *rxframe;   // pointer to the start of the first unprocessed byte in rxframe_buf (ie the start of the current frame)
+    int rxframe_msglen;       // number of unprocessed message bytes in rxframe_buf, starting at rxframe
+    int rxframe_maxlen;       // size of rxframe_buf allocated
+    int rxframe_scanned;      // number of bytes (starting at rxframe) already searched for the end of the current frame's headers (or NULL terminator)
     int rxframe_frame_len;    // Total number of bytes for the entire message (calculated using content-length: header and bytes received in message headers)
     int rxframe_header_len;   // Number of bytes in the STOP header. This is all bytes before the body, including COMMAND and the blank line separating the header from the body
 
     unsigned char *txframe;   // Variables representing the current STOMP frame being transmitted
     int txframe_len;
-    int txframe_sent_count;
-    bool txframe_contains_usp_record; // Set if the current frame being transmitted contains the USP record at the head of the send queue
-
-    double_linked_list_t usp_record_send_queue;    // Queue of USP records to send on this STOMP connection
+    int txframe_sent_count;   // Number of bytes of the frame sent so far (counting txframe, then txframe_body, then its NULL terminator)
+    unsigned char *txframe_body; // Body of the current SEND frame, or NULL if the whole frame is in txframe. If non NULL, this points to the pbuf
+                                 // of the USP record at the head of the send queue (it is not owned by txframe), and is sent after txframe,
+                                 // followed by the STOMP frame NULL terminator. This avoids copying the USP record into the frame.
+    int txframe_body_len;
+    int txframe_num_usp_records; // Number of USP records (starting at the head of the send queue) contained in the current frame(s) being transmitted.
+                                 // Small SEND frames are coalesced, so txframe may contain more than one SEND frame.
+    unsigned long long txframe_start_time; // Time (in microseconds, from tu_uptime_usecs()) at which the USP records in the current frame(s) started to be sent
+
+    int ssl_write_want;       // Set if the last SSL_write() could not complete (eg because of an SSL renegotiation) and must be retried with the same arguments.
+                              // SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE, denoting the socket activity to wait for before retrying. SSL_ERROR_NONE otherwise.
+    time_t ssl_write_timeout; // Absolute time by which the pending SSL_write() must have completed, otherwise the connection is retried
+
+    double_linked_list_t usp_record_send_queue;    // Queue of USP records to send next on this STOMP connection. USP records are framed (and coalesced) from the head of this queue.
+                                                   // This queue is refilled from usp_record_pending_queue (in send priority order) whenever it becomes empty
+    mtp_send_queue_t usp_record_pending_queue;     // Queues (one for each send priority) of USP records waiting to be moved to usp_record_send_queue
+    int usp_record_send_queue_bytes;               // Sum of the sizes of the USP records in usp_record_send_queue and usp_record_pending_queue
 
     stomp_conn_params_t next_conn_params;  // Connection parameters to use, the next time that a reconnect occurs
     char *next_provisionned_queue;         // Agent queue name to use, the next time that a reconnect occurs
@@ -195,6 +243,9 @@ typedef struct
     char mgmt_ip_addr[NU_IPADDRSTRLEN]; // IP address of device's source address providing this STOMP connection
     char mgmt_if_name[IFNAMSIZ];        // Name of network interface providing this STOMP connection
 
+    str_vector_t deflate_dests; // STOMP destinations of controllers which have indicated (using the 'usp-accept-encoding:deflate' header)
+                                // that they accept compressed USP records. This is relearnt on each connection.
+
 
 } stomp_connection_t;
 
@@ -210,27 +261,56 @@ typedef struct
     Usp__Header__MsgType usp_msg_type;  // Type of USP message contained within pbuf (if content_type==kStompContentType_UspRecord)
     unsigned char *pbuf;    // content of STOMP frame to send
     int pbuf_len;           // Length of content to send
+    unsigned char *deflated; // Compressed content of STOMP frame to send, or NULL if the content is sent uncompressed (see DeflateStompSendItem)
+    int deflated_len;       // Length of compressed content to send
     mtp_content_type_t content_type; // Type of content stored in pbuf
     char *controller_queue; // Name of the STOMP queue to send this message to
     char *agent_queue;      // Name of the STOMP queue used by this agent
     char *err_id_header;    // Value of 'usp-err-id' STOMP header to put in the STOMP frame
     time_t expiry_time;     // Time at which this message should be removed from the queue
+    unsigned long long queued_time; // Time (in microseconds, from tu_uptime_usecs()) at which this message was added to the queue
+    mtp_send_priority_t priority;   // Send priority of this message
+    bool is_pending;        // Set if this message is in usp_record_pending_queue, rather than usp_record_send_queue
 } stomp_send_item_t;
 
+// Body of the SEND frame carrying the specified USP record (ie the compressed USP record, if it has been compressed)
+#define STOMP_SEND_BODY(queued_msg)      (((queued_msg)->deflated != NULL) ? (queued_msg)->deflated : (queued_msg)->pbuf)
+#define STOMP_SEND_BODY_LEN(queued_msg)  (((queued_msg)->deflated != NULL) ? (queued_msg)->deflated_len : (queued_msg)->pbuf_len)
+
 //------------------------------------------------------------------------------
-// Variables associated with determining whether the Management IP address has changed (used by UpdateMgmtInterface)
-static time_t next_mgmt_if_poll_time = 0;   // Absolute time at which to next poll for IP address change
+// State of each MTP thread servicing STOMP connections
+// The STOMP connection slots are shared out between the threads: slot i is serviced by thread (i % NUM_STOMP_MTP_THREADS)
+typedef struct
+{
+    pthread_mutex_t access_mutex;   // Mutex used to protect access to the STOMP connections serviced by this thread
+    bool is_exited;                 // Set once this thread has exited, after freeing all of its STOMP connections
+
+    // Variables associated with determining whether the Management IP address has changed (used by UpdateMgmtInterface)
+    bool mgmt_if_first_time;        // Set until the Management IP address has been polled for the first time
+    time_t next_mgmt_if_poll_time;  // Absolute time at which to next poll for IP address change. Only used if addr_change_sock is INVALID
+    int addr_change_sock;           // Netlink socket notifying IP address changes, or INVALID if the IP address must be polled instead
+    bool is_addr_changed;           // Set if addr_change_sock has notified that an IP address has changed since it was last checked
 #ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
-char last_mgmt_ip_addr[NU_IPADDRSTRLEN] = { 0 };
+    char last_mgmt_ip_addr[NU_IPADDRSTRLEN];
 #endif
+} stomp_thread_t;
+
+static stomp_thread_t stomp_threads[NUM_STOMP_MTP_THREADS];
+
+// Index of the MTP thread servicing the specified STOMP connection
+#define STOMP_CONN_THREAD(sc)  ( (int)((sc) - stomp_connections) % NUM_STOMP_MTP_THREADS )
+
+// Mutex used to protect the count of STOMP MTP threads which have exited
+static pthread_mutex_t stomp_exit_mutex;
+static int num_stomp_threads_exited = 0;
 
 //------------------------------------------------------------------------------------
 // The SSL context for STOMP (created for use with TLS)
 SSL_CTX *stomp_ssl_ctx = NULL;
 
-//------------------------------------------------------------------------------------
-// Mutex used to protect access to this component
-static pthread_mutex_t stomp_access_mutex;
+//------------------------------------------------------------------------------
+// Index of the SSL ex_data used to store a pointer to the STOMP connection that each SSL belongs to (used by StompNewTlsSessionCallback)
+static int stomp_ssl_conn_index = -1;
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
@@ -239,9 +319,15 @@ void ProcessStompConnectionSocketActivity(stomp_connection_t *sc, socket_set_t *
 int CalcTimeoutToStompHandshakeFailure(stomp_connection_t *sc);
 void UpdateAgentHeartbeat(stomp_connection_t *sc);
 int TransmitStompMessage(stomp_connection_t *sc);
+void TransmitQueuedStompMessages(stomp_connection_t *sc);
 void ReceiveStompMessage(stomp_connection_t *sc);
-int ReceiveStompMessageInner(stomp_connection_t *sc, unsigned char *buf, int num_bytes);
+int ReceiveStompMessageInner(stomp_connection_t *sc, int num_bytes);
+unsigned char *ReserveStompRxSpace(stomp_connection_t *sc, int *space);
 int StompWrite(stomp_connection_t *sc, unsigned char *buf, int bytes_to_attempt);
+int StompWritev(stomp_connection_t *sc, struct iovec *iov, int iovcnt);
+int GetUnsentStompFrame(stomp_connection_t *sc, struct iovec *iov);
+void AddStompSocketToSendTo(stomp_connection_t *sc, int timeout, socket_set_t *set);
+bool IsStompSocketReadyToSend(stomp_connection_t *sc, socket_set_t *set);
 int IsStompMsgComplete(stomp_connection_t *sc, int *msg_size);
 int ParseStompHeaders(stomp_connection_t *sc, int *header_size);
 void RemoveReceivedHeartBeats(stomp_connection_t *sc);
@@ -255,29 +341,44 @@ void ParseConnectedFrame(stomp_connection_t *sc, unsigned char *msg, int msg_len
 bool GetStompHeaderValue(char *header, unsigned char *msg, int msg_len, char *buf, int len);
 void HandleStompSocketError(stomp_connection_t *sc, stomp_failure_t failure_code);
 unsigned CalculateStompRetryWaitTime(unsigned retry_count, double interval, double multiplier);
+void ParseStompRetryHint(stomp_connection_t *sc, int msg_size);
 int StartSendingFrame_STOMP(stomp_connection_t *sc);
 int StartSendingFrame_SUBSCRIBE(stomp_connection_t *sc);
-int StartSendingFrame_SEND(stomp_connection_t *sc, char *controller_queue, char *agent_queue, Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header);
+int StartSendingFrame_SEND(stomp_connection_t *sc, stomp_send_item_t *queued_msg);
+int FormStompSendHeaders(stomp_connection_t *sc, stomp_send_item_t *queued_msg, unsigned char **p_buf, int *p_len);
+void LogStompSendFrame(stomp_connection_t *sc, stomp_send_item_t *queued_msg, unsigned char *headers, int headers_len);
+void DeflateStompSendItem(stomp_connection_t *sc, stomp_send_item_t *queued_msg);
 int StartSendingFrame_UNSUBSCRIBE(stomp_connection_t *sc);
 char *AddrInfoToStr(struct addrinfo *addr, char *buf, int len);
 void UpdateNextHeartbeatTime(stomp_connection_t *sc);
-int UpdateMgmtInterface(void);
-void UpdateWANInterface(bool is_first_time);
-stomp_connection_t *FindStompConnByInst(int instance);
+int UpdateMgmtInterface(int stomp_thread);
+void UpdateWANInterface(int stomp_thread, bool is_first_time);
+stomp_connection_t *FindStompConnByInst(int instance, bool *is_exited);
 void StartStompConnection(stomp_connection_t *sc);
+void ConnectStompSocket(stomp_connection_t *sc);
+int RaceStompConnects(stomp_connection_t *sc, nu_ipaddr_t *addrs, int num_addrs, nu_ipaddr_t *local_mgmt_addr);
+int StartStompConnectAttempt(stomp_connection_t *sc, nu_ipaddr_t *dst, nu_ipaddr_t *local_mgmt_addr);
+void ApplyStompTcpOptions(stomp_connection_t *sc, int sock);
+void SetStompSocketOption(int sock, int level, int option, char *option_name, int value);
 void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages);
 void InitStompConnection(stomp_connection_t *sc);
 int PerformStompSslConnect(stomp_connection_t *sc);
+int StompNewTlsSessionCallback(SSL *ssl, SSL_SESSION *session);
+void SaveStompTlsSessionTrust(stomp_connection_t *sc);
+void ForgetStompTlsSession(stomp_connection_t *sc);
 stomp_connection_t *FindUnusedStompConn(void);
+void UnlockStompConn(stomp_connection_t *sc);
 void CopyStompConnParamsToNext(stomp_connection_t *sc, stomp_conn_params_t *sp, char *stomp_queue);
 void CopyStompConnParamsFromNext(stomp_connection_t *sc);
 char *AllocateStringIfChanged(char *cur_str, char *new_str);
 void LogNoPasswordWarning(stomp_connection_t *sc);
 void EscapeStompHeader(char *src, char *dest, int dest_len);
-void HandleStompSourceIPAddrChanges(void);
+void HandleStompSourceIPAddrChanges(int stomp_thread);
 bool IsUspRecordInStompQueue(stomp_connection_t *sc, unsigned char *pbuf, int pbuf_len);
 void RemoveExpiredStompMessages(stomp_connection_t *sc);
 void RemoveStompQueueItem(stomp_connection_t *sc, stomp_send_item_t *queued_msg);
+void ScheduleStompMessages(stomp_connection_t *sc);
+bool IsStompSendQueueEmpty(stomp_connection_t *sc);
 int HandleStompRunningState(stomp_connection_t *sc, socket_set_t *set);
 int GetNextStompMsgToSend(stomp_connection_t *sc);
 
@@ -307,8 +408,23 @@ int STOMP_Init(void)
         sc->schedule_reconnect = kScheduledAction_Off;
     }
 
-    // Exit if unable to create mutex protecting access to this subsystem
-    err = OS_UTILS_InitMutex(&stomp_access_mutex);
+    // Exit if unable to create the mutexes protecting access to the STOMP connections serviced by each thread
+    for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+    {
+        err = OS_UTILS_InitMutex(&stomp_threads[i].access_mutex);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+        stomp_threads[i].is_exited = false;
+        stomp_threads[i].mgmt_if_first_time = true;
+        stomp_threads[i].next_mgmt_if_poll_time = 0;
+        stomp_threads[i].addr_change_sock = INVALID;
+        stomp_threads[i].is_addr_changed = false;
+    }
+
+    // Exit if unable to create mutex protecting the count of exited threads
+    err = OS_UTILS_InitMutex(&stomp_exit_mutex);
     if (err != USP_ERR_OK)
     {
         return err;
@@ -321,19 +437,21 @@ int STOMP_Init(void)
 **
 ** STOMP_Destroy
 **
-** Frees all memory associated with this component and closes all sockets
+** Frees all memory associated with the STOMP connections serviced by the specified MTP thread and closes their sockets
+** This is called by each STOMP MTP thread as it exits. The last thread to exit also frees the memory shared by all threads.
 **
-** \param   None
+** \param   stomp_thread - index of the STOMP MTP thread which is exiting
 **
-** \return  None
+** \return  true if this was the last STOMP MTP thread to exit
 **
 **************************************************************************/
-void STOMP_Destroy(void)
+bool STOMP_Destroy(int stomp_thread)
 {
     int i;
     stomp_connection_t *sc;
+    bool is_last;
 
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if (sc->instance != INVALID)
@@ -342,11 +460,33 @@ void STOMP_Destroy(void)
         }
     }
 
+    // Prevent the data model from making any other changes to the STOMP connections serviced by this thread
+    OS_UTILS_LockMutex(&stomp_threads[stomp_thread].access_mutex);
+    stomp_threads[stomp_thread].is_exited = true;
+    if (stomp_threads[stomp_thread].addr_change_sock != INVALID)
+    {
+        close(stomp_threads[stomp_thread].addr_change_sock);
+        stomp_threads[stomp_thread].addr_change_sock = INVALID;
+    }
+    OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
+
+    // Exit if other STOMP MTP threads are still running
+    OS_UTILS_LockMutex(&stomp_exit_mutex);
+    num_stomp_threads_exited++;
+    is_last = (num_stomp_threads_exited == NUM_STOMP_MTP_THREADS);
+    OS_UTILS_UnlockMutex(&stomp_exit_mutex);
+    if (is_last == false)
+    {
+        return false;
+    }
+
     // Free the OpenSSL context
     if (stomp_ssl_ctx != NULL)
     {
         SSL_CTX_free(stomp_ssl_ctx);
     }
+
+    return true;
 }
 
 /*********************************************************************//**
@@ -362,41 +502,55 @@ void STOMP_Destroy(void)
 **************************************************************************/
 int STOMP_Start(void)
 {
-    int err;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
+    int i;
 
-    // Store the initial IP address for the management interface
-    UpdateMgmtInterface();
+    // Store the initial IP address for the management interface, and subscribe to notifications of it changing
+    for (i=0; i<NUM_STOMP_MTP_THREADS; i++)
+    {
+        OS_UTILS_LockMutex(&stomp_threads[i].access_mutex);
+        stomp_threads[i].addr_change_sock = nu_ipaddr_open_addr_change_socket();
+        UpdateMgmtInterface(i);
+        OS_UTILS_UnlockMutex(&stomp_threads[i].access_mutex);
+    }
 
-    // Create the SSL context with trust store and client cert loaded
+    // Exit if unable to create the SSL context with trust store and client cert loaded
+    // NOTE: The SSL context is shared by all STOMP MTP threads. It is created before the threads are started, and not modified afterwards
     stomp_ssl_ctx = DEVICE_SECURITY_CreateSSLContext(SSLv23_client_method(), SSL_VERIFY_PEER, DEVICE_SECURITY_TrustCertVerifyCallback);
     if (stomp_ssl_ctx == NULL)
     {
-        err = USP_ERR_INTERNAL_ERROR;
-        goto exit;
+        return USP_ERR_INTERNAL_ERROR;
     }
 
-    // If code gets here then it was successful
-    err = USP_ERR_OK;
+    // Exit if unable to allocate the index used to associate each SSL with its STOMP connection
+    stomp_ssl_conn_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    if (stomp_ssl_conn_index == -1)
+    {
+        USP_LOG_Error("%s: SSL_get_ex_new_index() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
 
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
-    return err;
+    // Enable client side TLS session caching, so that reconnects can resume the previous session, avoiding a full handshake
+    // NOTE: Sessions are stored per STOMP connection (by StompNewTlsSessionCallback), rather than in OpenSSL's internal cache,
+    //       so that a session is only ever offered to the server that it was negotiated with
+    SSL_CTX_set_session_cache_mode(stomp_ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(stomp_ssl_ctx, StompNewTlsSessionCallback);
+
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
 ** STOMP_UpdateAllSockSet
 **
-** Updates the set of all STOMP socket fds to read/write from
+** Updates the set of all STOMP socket fds (serviced by the specified MTP thread) to read/write from
 **
+** \param   stomp_thread - index of the STOMP MTP thread calling this function
 ** \param   set - pointer to socket set structure to update with sockets to wait for activity on
 **
 ** \return  None
 **
 **************************************************************************/
-void STOMP_UpdateAllSockSet(socket_set_t *set)
+void STOMP_UpdateAllSockSet(int stomp_thread, socket_set_t *set)
 {
     int i;
     stomp_connection_t *sc;
@@ -405,22 +559,26 @@ void STOMP_UpdateAllSockSet(socket_set_t *set)
     time_t cur_time;
     time_t expected_heartbeat_time;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
+    OS_UTILS_LockMutex(&stomp_threads[stomp_thread].access_mutex);
 
     // Exit if MTP thread has exited
     // NOTE: This check is not strictly ncessary, as only the MTP thread should be calling this function
-    if (is_stomp_mtp_thread_exited)
+    if (stomp_threads[stomp_thread].is_exited)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
+        OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
         return;
     }
 
-    // Determine whether IP address has changed (if time to poll it)
-    timeout = UpdateMgmtInterface();
-    SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);
+    // Determine whether IP address has changed (if notified of a change, or time to poll it)
+    timeout = UpdateMgmtInterface(stomp_thread);
+    SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, MGMT_IF_POLL_SLACK, set);
+    if (stomp_threads[stomp_thread].addr_change_sock != INVALID)
+    {
+        SOCKET_SET_AddSocketToReceiveFrom(stomp_threads[stomp_thread].addr_change_sock, MAX_SOCKET_TIMEOUT, set);
+    }
 
-    // Iterate over all STOMP connections, updating the ones that are enabled    
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    // Iterate over all STOMP connections serviced by this thread, updating the ones that are enabled
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if (sc->instance != INVALID)
@@ -428,7 +586,7 @@ void STOMP_UpdateAllSockSet(socket_set_t *set)
             // Determine if all responses have been sent on this connection, and update whether they have been sent on all connections
             // NOTE: For the receive buffer, Rabbit MQ adds a redundant newline padding at the end of each stomp frame.
             // Therefore a single line feed in the receive buffer is still an empty buffer
-            responses_sent = ((sc->usp_record_send_queue.head == NULL) && 
+            responses_sent = ((IsStompSendQueueEmpty(sc)) && 
                               (sc->txframe == NULL) && 
                               ( (sc->rxframe_msglen==0) || ((sc->rxframe_msglen==1) && (sc->rxframe[0] == '\n')) )
                              );
@@ -468,7 +626,7 @@ void STOMP_UpdateAllSockSet(socket_set_t *set)
                 {
                     // Otherwise, update timeout, so that it at least occurs when the STOMP server heartbeat timeout would fire
                     timeout = (int)(expected_heartbeat_time - cur_time);
-                    SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);
+                    SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, STOMP_SERVER_HEARTBEAT_SLACK, set);
                 }
             }
 
@@ -477,39 +635,40 @@ void STOMP_UpdateAllSockSet(socket_set_t *set)
         }
     }
 
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
 }
 
 /*********************************************************************//**
 **
 ** STOMP_AreAllResponsesSent
 **
-** Determines whether all responses have been sent, and that there are no outstanding incoming messages
+** Determines whether all responses have been sent, and that there are no outstanding incoming messages,
+** on the STOMP connections serviced by the specified MTP thread
 **
-** \param   None
+** \param   stomp_thread - index of the STOMP MTP thread calling this function
 **
 ** \return  true if all responses have been sent
 **
 **************************************************************************/
-bool STOMP_AreAllResponsesSent(void)
+bool STOMP_AreAllResponsesSent(int stomp_thread)
 {
     int i;
     stomp_connection_t *sc;
     bool responses_sent;
     bool all_responses_sent = true;  // Assume that all responses have been sent on all connections
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
+    OS_UTILS_LockMutex(&stomp_threads[stomp_thread].access_mutex);
 
     // Exit if MTP thread has exited
     // NOTE: This check is not strictly ncessary, as only the MTP thread should be calling this function
-    if (is_stomp_mtp_thread_exited)
+    if (stomp_threads[stomp_thread].is_exited)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
+        OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
         return true;
     }
 
-    // Iterate over all STOMP connections,
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    // Iterate over all STOMP connections serviced by this thread
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if (sc->instance != INVALID)
@@ -517,7 +676,7 @@ bool STOMP_AreAllResponsesSent(void)
             // Determine if all responses have been sent on this connection, and update whether they have been sent on all connections
             // NOTE: For the receive buffer, Rabbit MQ adds a redundant newline padding at the end of each stomp frame.
             // Therefore a single line feed in the receive buffer is still an empty buffer
-            responses_sent = ((sc->usp_record_send_queue.head == NULL) && 
+            responses_sent = ((IsStompSendQueueEmpty(sc)) && 
                               (sc->txframe == NULL) && 
                               ( (sc->rxframe_msglen==0) || ((sc->rxframe_msglen==1) && (sc->rxframe[0] == '\n')) )
                              );
@@ -528,7 +687,7 @@ bool STOMP_AreAllResponsesSent(void)
         }
     }
 
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
 
     return all_responses_sent;
 }
@@ -537,30 +696,42 @@ bool STOMP_AreAllResponsesSent(void)
 **
 ** STOMP_ProcessAllSocketActivity
 **
-** Processes the socket for the specified controller
+** Processes the sockets of the STOMP connections serviced by the specified MTP thread
 **
+** \param   stomp_thread - index of the STOMP MTP thread calling this function
 ** \param   set - pointer to socket set structure containing the sockets which need processing
 **
 ** \return  Nothing
 **
 **************************************************************************/
-void STOMP_ProcessAllSocketActivity(socket_set_t *set)
+void STOMP_ProcessAllSocketActivity(int stomp_thread, socket_set_t *set)
 {
     int i;
     stomp_connection_t *sc;
+    stomp_thread_t *st;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
+    OS_UTILS_LockMutex(&stomp_threads[stomp_thread].access_mutex);
 
     // Exit if MTP thread has exited
     // NOTE: This check is not strictly ncessary, as only the MTP thread should be calling this function
-    if (is_stomp_mtp_thread_exited)
+    if (stomp_threads[stomp_thread].is_exited)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
+        OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
         return;
     }
 
-    // Iterate over all STOMP connections, processing activity on the ones that are enabled    
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    // Read any notifications of IP address changes. These are acted on by UpdateMgmtInterface()
+    st = &stomp_threads[stomp_thread];
+    if ((st->addr_change_sock != INVALID) && (SOCKET_SET_IsReadyToRead(st->addr_change_sock, set)))
+    {
+        if (nu_ipaddr_read_addr_change_socket(st->addr_change_sock))
+        {
+            st->is_addr_changed = true;
+        }
+    }
+
+    // Iterate over all STOMP connections serviced by this thread, processing activity on the ones that are enabled
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if ((sc->instance != INVALID) && (sc->socket_fd != INVALID))
@@ -569,7 +740,7 @@ void STOMP_ProcessAllSocketActivity(socket_set_t *set)
         }
     }
 
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    OS_UTILS_UnlockMutex(&stomp_threads[stomp_thread].access_mutex);
 }
 
 /*********************************************************************//**
@@ -586,36 +757,37 @@ void STOMP_ProcessAllSocketActivity(socket_set_t *set)
 ** \param   pbuf_len - length of buffer containing protobuf binary message
 ** \param   content_type - Type of content in the pbuf buffer
 ** \param   err_id_header - pointer to string containing the STOMP usp-err-id header
+** \param   priority - send priority of the USP message (selects the queue that the USP message is added to)
 ** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
 int STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, 
-                             unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header, time_t expiry_time)
+                             unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header, mtp_send_priority_t priority, time_t expiry_time)
 {
     stomp_connection_t *sc;
     stomp_send_item_t *send_item;
     int err;
     bool is_duplicate;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return USP_ERR_OK;
-    }
+    bool is_exited;
+    int stomp_thread;
 
     // Exit if unable to find the specified STOMP connection
-    sc = FindStompConnByInst(instance);
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
+        // Exit if MTP thread has exited
+        if (is_exited)
+        {
+            return USP_ERR_OK;
+        }
+
         USP_LOG_Error("%s: No internal STOMP connection matching Device.STOMP.Connection.%d", __FUNCTION__, instance);
-        err = USP_ERR_INTERNAL_ERROR;
-        goto exit;
+        return USP_ERR_INTERNAL_ERROR;
     }
+    stomp_thread = STOMP_CONN_THREAD(sc);
 
     // Do not add this message to the queue, if it is already present in the queue
     // This situation could occur if a notify is being retried to be sent, but is already held up in the queue pending sending
@@ -632,28 +804,44 @@ int STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, ch
         RemoveExpiredStompMessages(sc);
     }
 
+    // Exit if the MTP send queues have used up their memory budget, and this message is a low priority notification
+    // NOTE: Ownership of pbuf has passed to this code, so it must be freed here
+    if (MTP_SEND_QUEUE_ChargeBudget(priority, pbuf_len) == false)
+    {
+        USP_LOG_Warning("%s: MTP send queue memory budget exceeded. Dropping %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(usp_msg_type));
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
     // Add the item to the queue
     send_item = USP_MALLOC(sizeof(stomp_send_item_t));
     send_item->usp_msg_type = usp_msg_type;
     send_item->pbuf = pbuf;
     send_item->pbuf_len = pbuf_len;
+    send_item->deflated = NULL;
+    send_item->deflated_len = 0;
     send_item->controller_queue = USP_STRDUP(controller_queue);
     send_item->agent_queue = USP_STRDUP(agent_queue);
     send_item->content_type = content_type;
     send_item->err_id_header = USP_STRDUP(err_id_header);
     send_item->expiry_time = expiry_time;
+    send_item->queued_time = tu_uptime_usecs();
+    send_item->priority = priority;
+    send_item->is_pending = true;
 
-    DLLIST_LinkToTail(&sc->usp_record_send_queue, send_item);
+    MTP_SEND_QUEUE_Add(&sc->usp_record_pending_queue, priority, send_item);
+    sc->usp_record_send_queue_bytes += pbuf_len;
     err = USP_ERR_OK;
 
 exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 
     // If successful, cause the MTP thread to wakeup from select().
     // We do this outside of the mutex lock to avoid an unnecessary task switch
     if (err == USP_ERR_OK)
     {
-        MTP_EXEC_StompWakeup();
+        MTP_EXEC_StompWakeup(stomp_thread);
     }
 
     return err;
@@ -676,54 +864,49 @@ exit:
 int STOMP_EnableConnection(stomp_conn_params_t *sp, char *stomp_queue)
 {
     stomp_connection_t *sc;
-    int err;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return USP_ERR_OK;
-    }
+    bool is_exited;
+    int stomp_thread;
 
     // Create this STOMP connection, if not already started
     // NOTE: If the code is correct, then the STOMP connection for the specified instance should never exist when this function is called
-    sc = FindStompConnByInst(sp->instance);
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(sp->instance, &is_exited);
     if (sc == NULL)
     {
+        // Exit if MTP thread has exited
+        if (is_exited)
+        {
+            return USP_ERR_OK;
+        }
+
         // Exit if run out of stomp connection slots
         // NOTE: Caller should have already ensured this
         sc = FindUnusedStompConn();
         if (sc == NULL)
         {
             USP_LOG_Error("%s: No more STOMP connections allowed", __FUNCTION__);
-            err = USP_ERR_INTERNAL_ERROR;
-            goto exit;
+            return USP_ERR_INTERNAL_ERROR;
         }
     }
+    stomp_thread = STOMP_CONN_THREAD(sc);
 
     // Copy across the connection parameters to use when starting the connection
     CopyStompConnParamsToNext(sc, sp, stomp_queue);
 
 
     sc->retry_count = 0;
+    sc->last_retry_wait = 0;
+    sc->server_retry_hint = 0;
     sc->failure_code = kStompFailure_None;
 
     StartStompConnection(sc);
-    err = USP_ERR_OK;
-
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 
-    // If successful, cause the MTP thread to wakeup from select().
+    // Since successful, cause the MTP thread to wakeup from select().
     // We do this outside of the mutex lock to avoid an unnecessary task switch
-    if (err == USP_ERR_OK)
-    {
-        MTP_EXEC_StompWakeup();
-    }
+    MTP_EXEC_StompWakeup(stomp_thread);
 
-    return err;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
@@ -743,30 +926,34 @@ int STOMP_DisableConnection(int instance, bool purge_queued_messages)
 {
     stomp_connection_t *sc;
     stomp_conn_params_t *np;
-    int err;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return USP_ERR_OK;
-    }
+    bool is_exited;
+    int stomp_thread;
 
     // Exit if unable to find this connection
     // NOTE: This could occur if the connection has already been disabled
-    sc = FindStompConnByInst(instance);
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
+        // Exit if MTP thread has exited
+        if (is_exited)
+        {
+            return USP_ERR_OK;
+        }
+
         USP_LOG_Error("%s: Unable to find STOMP connection for instance=%d", __FUNCTION__, instance);
-        err = USP_ERR_INTERNAL_ERROR;
-        goto exit;
+        return USP_ERR_INTERNAL_ERROR;
     }
+    stomp_thread = STOMP_CONN_THREAD(sc);
 
     // Stop this connection, freeing all state variables
     StopStompConnection(sc, purge_queued_messages);
 
+    // Free any saved TLS session, as it should not be resumed by whichever connection next uses this slot
+    ForgetStompTlsSession(sc);
+    sc->tls_full_handshakes = 0;
+    sc->tls_resumed_handshakes = 0;
+
     // Free the parameters describing the current connection
     USP_SAFE_FREE(sc->host);
     USP_SAFE_FREE(sc->username);
@@ -789,6 +976,7 @@ int STOMP_DisableConnection(int instance, bool purge_queued_messages)
     sc->incoming_heartbeat_period = 0;
     sc->outgoing_heartbeat_period = 0;
     memset(&sc->retry, 0, sizeof(sc->retry));
+    memset(&sc->tcp, 0, sizeof(sc->tcp));
 
     np->port = 0;
     np->enable_encryption = false;
@@ -796,23 +984,18 @@ int STOMP_DisableConnection(int instance, bool purge_queued_messages)
     np->incoming_heartbeat_period = 0;
     np->outgoing_heartbeat_period = 0;
     memset(&np->retry, 0, sizeof(np->retry));
+    memset(&np->tcp, 0, sizeof(np->tcp));
 
 
     // Mark this slot as not in use
     sc->instance = INVALID;
-    err = USP_ERR_OK;
-
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 
-    // If successful, cause the MTP thread to wakeup from select().
+    // Since successful, cause the MTP thread to wakeup from select().
     // We do this outside of the mutex lock to avoid an unnecessary task switch
-    if (err == USP_ERR_OK)
-    {
-        MTP_EXEC_StompWakeup();
-    }
+    MTP_EXEC_StompWakeup(stomp_thread);
 
-    return err;
+    return USP_ERR_OK;
 }
 
 /*********************************************************************//**
@@ -831,23 +1014,18 @@ exit:
 **************************************************************************/
 void STOMP_ScheduleReconnect(stomp_conn_params_t *sp, char *stomp_queue)
 {
-    stomp_connection_t *sc = NULL;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return;
-    }
+    stomp_connection_t *sc;
+    bool is_exited;
+    int stomp_thread;
 
-    // Exit if unable to find the specified STOMP connection
-    sc = FindStompConnByInst(sp->instance);
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(sp->instance, &is_exited);
     if (sc == NULL)
     {
-        goto exit;
+        return;
     }
+    stomp_thread = STOMP_CONN_THREAD(sc);
 
     // Copy across the connection parameters to use after the reconnect
     CopyStompConnParamsToNext(sc, sp, stomp_queue);
@@ -859,16 +1037,11 @@ void STOMP_ScheduleReconnect(stomp_conn_params_t *sp, char *stomp_queue)
     // No need to perform a resubscribe, if we're reconnecting anyway
     // NOTE: The resubscribe flags could have been set if the agent queue was changed in the same USP set transaction as the other STOMP parameters
     sc->schedule_resubscribe = 0;
+    UnlockStompConn(sc);
 
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
-
-    // If successful, cause the MTP thread to wakeup from select().
+    // Since successful, cause the MTP thread to wakeup from select().
     // We do this outside of the mutex lock to avoid an unnecessary task switch
-    if (sc != NULL)
-    {
-        MTP_EXEC_StompWakeup();
-    }
+    MTP_EXEC_StompWakeup(stomp_thread);
 }
 
 /*********************************************************************//**
@@ -887,29 +1060,34 @@ exit:
 void STOMP_ActivateScheduledActions(void)
 {
     int i;
+    int t;
     stomp_connection_t *sc;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
+    // Iterate over all STOMP MTP threads
+    for (t=0; t<NUM_STOMP_MTP_THREADS; t++)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return;
-    }
+        OS_UTILS_LockMutex(&stomp_threads[t].access_mutex);
 
-    // Iterate over all STOMP connections, activating all reconnects which have been signalled
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
-    {
-        sc = &stomp_connections[i];
-        if (sc->schedule_reconnect == kScheduledAction_Signalled)
+        // Skip this thread if it has exited
+        if (stomp_threads[t].is_exited)
         {
-            sc->schedule_reconnect = kScheduledAction_Activated;
-            MTP_EXEC_StompWakeup();
+            OS_UTILS_UnlockMutex(&stomp_threads[t].access_mutex);
+            continue;
+        }
+
+        // Iterate over all STOMP connections serviced by this thread, activating all reconnects which have been signalled
+        for (i=t; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
+        {
+            sc = &stomp_connections[i];
+            if (sc->schedule_reconnect == kScheduledAction_Signalled)
+            {
+                sc->schedule_reconnect = kScheduledAction_Activated;
+                MTP_EXEC_StompWakeup(t);
+            }
         }
-    }
 
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+        OS_UTILS_UnlockMutex(&stomp_threads[t].access_mutex);
+    }
 }
 
 /*********************************************************************//**
@@ -928,23 +1106,17 @@ void STOMP_ActivateScheduledActions(void)
 void STOMP_ScheduleResubscribe(int instance, char *stomp_queue)
 {
     stomp_connection_t *sc;
+    bool is_exited;
+    int stomp_thread;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return;
-    }
-
-    // Exit if this stomp connection is not currently enabled
-    sc = FindStompConnByInst(instance);
+    // Exit if this stomp connection is not currently enabled (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
         return;
     }
+    stomp_thread = STOMP_CONN_THREAD(sc);
 
     // Store the new agent queue to use
     // NOTE: It is safe to change the agent queue immediately because we will perform a resubscribe immediately after the current USP message has been sent
@@ -961,11 +1133,11 @@ void STOMP_ScheduleResubscribe(int instance, char *stomp_queue)
         }
     }
     
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 
     // Since successful, cause the MTP thread to wakeup from select().
     // We do this outside of the mutex lock to avoid an unnecessary task switch
-    MTP_EXEC_StompWakeup();
+    MTP_EXEC_StompWakeup(stomp_thread);
 }
 
 /*********************************************************************//**
@@ -983,28 +1155,20 @@ void STOMP_ScheduleResubscribe(int instance, char *stomp_queue)
 void STOMP_UpdateRetryParams(int instance, stomp_retry_params_t *retry_params)
 {
     stomp_connection_t *sc;
+    bool is_exited;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return;
-    }
-
-    // Exit if unable to find the specified STOMP connection
-    sc = FindStompConnByInst(instance);
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
-        goto exit;
+        return;
     }
 
     // Copy across the connection parameters to use during a retry
     memcpy(&sc->retry, retry_params, sizeof(stomp_retry_params_t));
 
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 }
 
 /*********************************************************************//**
@@ -1022,38 +1186,88 @@ mtp_status_t STOMP_GetMtpStatus(int instance)
 {
     stomp_connection_t *sc;
     mtp_status_t status;
+    bool is_exited;
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: This could occur if Device.STOMP.Connection.{i} is disabled
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
+    if (sc == NULL)
     {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
         return kMtpStatus_Down;
     }
 
-    // Exit if unable to find the specified STOMP connection
-    // NOTE: This could occur if Device.STOMP.Connection.{i} is disabled
-    sc = FindStompConnByInst(instance);
+    // Determine whether the connection is up and running
+    status = (sc->state == kStompState_Running) ? kMtpStatus_Up : kMtpStatus_Down;
+
+    UnlockStompConn(sc);
+    return status;
+}
+
+/*********************************************************************//**
+**
+** STOMP_GetQueuedBytes
+**
+** Function called to get the number of bytes of USP records queued to send on the specified STOMP connection
+**
+** \param   instance - instance number of the connection in Device.STOMP.Connection.{i}
+**
+** \return  Sum of the sizes of the queued USP records, or 0 if the STOMP connection could not be found
+**
+**************************************************************************/
+int STOMP_GetQueuedBytes(int instance)
+{
+    stomp_connection_t *sc;
+    int queued_bytes;
+    bool is_exited;
+
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
-        status = kMtpStatus_Down;
-        goto exit;
+        return 0;
     }
 
-    // Exit if connection is not yet up and running
-    if (sc->state != kStompState_Running)
+    queued_bytes = sc->usp_record_send_queue_bytes;
+
+    UnlockStompConn(sc);
+    return queued_bytes;
+}
+
+/*********************************************************************//**
+**
+** STOMP_GetTlsHandshakeStats
+**
+** Function called to get the count of full and resumed TLS handshakes for a STOMP connection
+** These allow the TLS session resumption rate to be determined
+**
+** \param   instance - instance number of the connection in Device.STOMP.Connection.{i}
+** \param   full - pointer to variable in which to return the number of full TLS handshakes
+** \param   resumed - pointer to variable in which to return the number of TLS handshakes which resumed a previous session
+**
+** \return  None
+**
+**************************************************************************/
+void STOMP_GetTlsHandshakeStats(int instance, unsigned *full, unsigned *resumed)
+{
+    stomp_connection_t *sc;
+    bool is_exited;
+
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    *full = 0;
+    *resumed = 0;
+    sc = FindStompConnByInst(instance, &is_exited);
+    if (sc == NULL)
     {
-        status = kMtpStatus_Down;
-        goto exit;
+        return;
     }
 
-    // Connection is up and running
-    status = kMtpStatus_Up;
+    *full = sc->tls_full_handshakes;
+    *resumed = sc->tls_resumed_handshakes;
 
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
-    return status;
+    UnlockStompConn(sc);
 }
 
 /*********************************************************************//**
@@ -1075,21 +1289,20 @@ char *STOMP_GetConnectionStatus(int instance, time_t *last_change_date)
     char *status;
     time_t last_change = 0;
     stomp_connection_t *sc;
-
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        OS_UTILS_UnlockMutex(&stomp_access_mutex);
-        return "Connecting";
-    }
+    bool is_exited;
 
     // Exit if unable to find the specified STOMP connection
     // NOTE: This could occur if Device.STOMP.Connection.{i} is disabled
-    sc = FindStompConnByInst(instance);
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
+        // Exit if MTP thread has exited
+        if (is_exited)
+        {
+            return "Connecting";
+        }
+
         status = "Disabled";
         goto exit;
     }
@@ -1103,6 +1316,7 @@ char *STOMP_GetConnectionStatus(int instance, time_t *last_change_date)
     
         default:
         case kStompState_Idle:
+        case kStompState_ResolvingHost:
         case kStompState_SendingStompFrame:
         case kStompState_AwaitingConnectedFrame:
         case kStompState_SendingSubscribeFrame:
@@ -1116,6 +1330,7 @@ char *STOMP_GetConnectionStatus(int instance, time_t *last_change_date)
         USP_ASSERT(sc->state != kStompState_Running);
         status = TEXT_UTILS_EnumToString(sc->failure_code, stomp_failure_strings, NUM_ELEM(stomp_failure_strings));
     }
+    UnlockStompConn(sc);
 
 exit:
     // Save last change date, if required
@@ -1124,7 +1339,6 @@ exit:
         *last_change_date = last_change;
     }
 
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
     return status;
 }
 
@@ -1145,23 +1359,17 @@ exit:
 void STOMP_GetDestinationFromServer(int instance, char *buf, int len)
 {
     stomp_connection_t *sc;
+    bool is_exited;
 
     // Set default return value
     *buf = '\0';
 
-    OS_UTILS_LockMutex(&stomp_access_mutex);
-
-    // Exit if MTP thread has exited
-    if (is_stomp_mtp_thread_exited)
-    {
-        goto exit;
-    }
-
-    // Exit if unable to find the specified STOMP connection
-    sc = FindStompConnByInst(instance);
+    // Exit if unable to find the specified STOMP connection (or MTP thread has exited)
+    // NOTE: If found, the STOMP connection is returned locked
+    sc = FindStompConnByInst(instance, &is_exited);
     if (sc == NULL)
     {
-        goto exit;
+        return;
     }
 
     // Determine the name of the queue to subscribe to
@@ -1170,8 +1378,7 @@ void STOMP_GetDestinationFromServer(int instance, char *buf, int len)
         USP_STRNCPY(buf, sc->subscribe_dest, len);
     }
     
-exit:
-    OS_UTILS_UnlockMutex(&stomp_access_mutex);
+    UnlockStompConn(sc);
 }
 
 /*********************************************************************//**
@@ -1179,7 +1386,8 @@ exit:
 ** StartStompConnection
 **
 ** TCP Connects to the specified STOMP connection
-** On exit, the state will be either kStompState_SendingStompFrame (success) or kStompState_Retrying (failure)
+** On exit, the state will be either kStompState_SendingStompFrame (success), kStompState_ResolvingHost (DNS lookup in progress)
+** or kStompState_Retrying (failure)
 **
 ** \param   sc - pointer to STOMP connection
 **
@@ -1188,20 +1396,6 @@ exit:
 **************************************************************************/
 void StartStompConnection(stomp_connection_t *sc)
 {
-    int err;
-    char buf[NU_IPADDRSTRLEN];
-    bool prefer_ipv6;
-    nu_ipaddr_t dst;
-    struct sockaddr_storage saddr;
-    socklen_t saddr_len;
-    sa_family_t family;
-    fd_set writefds;
-    struct timeval timeout;
-    int num_sockets;
-    int so_err;
-    socklen_t so_len = sizeof(so_err);
-    nu_ipaddr_t local_mgmt_addr;
-    stomp_failure_t stomp_err = kStompFailure_OtherError;
     char *mgmt_interface = "any";   // Used only for debug purposes
 
     // Copy across the next connection parameters to use into the working state
@@ -1218,18 +1412,53 @@ void StartStompConnection(stomp_connection_t *sc)
     // Initialise state
     InitStompConnection(sc);    
 
-    // Get the preference for IPv4 or IPv6, if dual stack
-    prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
-
-#ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
-    // Exit if no WAN address available yet
-    if (*last_mgmt_ip_addr == '\0')
-    {
-        USP_LOG_Warning("%s: Cannot connect, WAN interface is down, or has no IP address", __FUNCTION__);
-        goto exit;
-    }
+    ConnectStompSocket(sc);
+}
 
-    // Exit if unable to convert the WAN address
+/*********************************************************************//**
+**
+** ConnectStompSocket
+**
+** Looks up the IP address of the STOMP server, then TCP connects to it
+** If the DNS lookup is still in progress, then the connection is left in kStompState_ResolvingHost,
+** and this function is called again when the MTP thread is woken up by the DNS cache
+** On exit, the state will be either kStompState_SendingStompFrame (success), kStompState_ResolvingHost (DNS lookup in progress)
+** or kStompState_Retrying (failure)
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void ConnectStompSocket(stomp_connection_t *sc)
+{
+    int err;
+    char buf[NU_IPADDRSTRLEN];
+    bool prefer_ipv6;
+    bool is_pending;
+    nu_ipaddr_t addrs[NU_MAX_HOST_ADDRS];
+    int num_addrs;
+    int index;
+    nu_ipaddr_t dst;
+    nu_ipaddr_t local_mgmt_addr;
+    stomp_failure_t stomp_err = kStompFailure_OtherError;
+#ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
+    char *last_mgmt_ip_addr;
+#endif
+
+    // Get the preference for IPv4 or IPv6, if dual stack
+    prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
+
+#ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
+    // Exit if no WAN address available yet
+    last_mgmt_ip_addr = stomp_threads[STOMP_CONN_THREAD(sc)].last_mgmt_ip_addr;
+    if (*last_mgmt_ip_addr == '\0')
+    {
+        USP_LOG_Warning("%s: Cannot connect, WAN interface is down, or has no IP address", __FUNCTION__);
+        goto exit;
+    }
+
+    // Exit if unable to convert the WAN address
     err = nu_ipaddr_from_str(last_mgmt_ip_addr, &local_mgmt_addr);
     if (err != USP_ERR_OK)
     {
@@ -1241,35 +1470,260 @@ void StartStompConnection(stomp_connection_t *sc)
     nu_ipaddr_set_zero(&local_mgmt_addr);
 #endif
 
-    // Exit if unable to determine the IP address of the STOMP server
-    err = tw_ulib_diags_lookup_host(sc->host, AF_UNSPEC, prefer_ipv6, &local_mgmt_addr, &dst);
+    // Exit if unable to determine the IP addresses of the STOMP server
+    err = DNS_CACHE_LookupHostAddrs(sc->host, AF_UNSPEC, prefer_ipv6, &local_mgmt_addr, addrs, &num_addrs, &is_pending);
     if (err != USP_ERR_OK)
     {
         stomp_err = kStompFailure_ServerDNS;
         goto exit;
     }
 
-    // Exit if unable to make a socket address structure to contact the STOMP server
-    err = nu_ipaddr_to_sockaddr(&dst, sc->port, &saddr, &saddr_len);
+    // Exit if the IP address of the STOMP server is still being looked up. The connect continues when the lookup completes
+    if (is_pending)
+    {
+        sc->state = kStompState_ResolvingHost;
+        stomp_err = kStompFailure_None;
+        goto exit;
+    }
+
+    // Exit if unable to connect to any of the IP addresses of the STOMP server
+    index = RaceStompConnects(sc, addrs, num_addrs, &local_mgmt_addr);
+    if (index == INVALID)
+    {
+        stomp_err = kStompFailure_Connect;
+        goto exit;
+    }
+    memcpy(&dst, &addrs[index], sizeof(dst));
+
+    // Perform the SSL handshake (if required), determining the role to use when processing USP messages
+    if (sc->enable_encryption)
+    {
+        err = PerformStompSslConnect(sc);
+        if (err != USP_ERR_OK)
+        {
+            stomp_err = kStompFailure_Authentication;
+            goto exit;
+        }
+    }
+    else
+    {
+        // If encryption is off, then use the Non SSL role
+        sc->role = ROLE_NON_SSL;
+    }
+
+    // Update the address used to connect to the controller
+    err = nu_ipaddr_get_interface_addr_from_sock_fd(sc->socket_fd, sc->mgmt_ip_addr, sizeof(sc->mgmt_ip_addr));
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Update the interface used to connect to the controller
+    err = nu_ipaddr_get_interface_name_from_src_addr(sc->mgmt_ip_addr, sc->mgmt_if_name, sizeof(sc->mgmt_if_name));
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+#ifndef CONNECT_ONLY_OVER_WAN_INTERFACE
+#endif
+
+    USP_LOG_Info("Connected to %s (host=%s, port=%d) from interface=%s", nu_ipaddr_str(&dst, buf, sizeof(buf)), sc->host, sc->port, sc->mgmt_if_name);
+
+    // Exit if unable to queue the initial STOMP frame for sending
+    err = StartSendingFrame_STOMP(sc);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
+
+    // If the code gets here, we have successfully set up state to start sending initial frame
+    // NOTE: The STOMP handshake timeout is restarted here, so that it does not include the time taken by the DNS lookup
+    sc->state = kStompState_SendingStompFrame;
+    sc->stomp_handshake_timeout = time(NULL) + STOMP_HANDSHAKE_TIMEOUT;
+    stomp_err = kStompFailure_None;
+
+exit:
+    // Wind back state
+    if (stomp_err != kStompFailure_None)
+    {
+        USP_LOG_Error("ERROR: STOMP failed whilst attempting to connect to (host=%s, port=%d)", sc->host, sc->port);
+        HandleStompSocketError(sc, stomp_err);
+    }
+}
+
+/*********************************************************************//**
+**
+** RaceStompConnects
+**
+** TCP connects to the first of the STOMP server's IP addresses to accept the connection, using the
+** 'Happy Eyeballs' algorithm (RFC 8305 section 5). Connection attempts are started in the order of the addresses,
+** with the next attempt being started after STOMP_CONNECT_ATTEMPT_DELAY_MS if no attempt has completed by then
+** (or immediately if all attempts so far have failed). The first attempt to complete is kept, and all others are abandoned.
+** This avoids waiting for STOMP_CONNECT_TIMEOUT, if the path to one of the addresses (eg IPv6) is black-holed
+** On success, sc->socket_fd is set to the connected (non-blocking) socket
+**
+** \param   sc - pointer to STOMP connection
+** \param   addrs - IP addresses of the STOMP server, in the order in which they should be tried
+** \param   num_addrs - number of IP addresses (at most NU_MAX_HOST_ADDRS)
+** \param   local_mgmt_addr - IP address of the local interface to connect from (the zero address denotes any interface)
+**
+** \return  index of the address that was connected to, or INVALID if unable to connect to any of them
+**
+**************************************************************************/
+int RaceStompConnects(stomp_connection_t *sc, nu_ipaddr_t *addrs, int num_addrs, nu_ipaddr_t *local_mgmt_addr)
+{
+    int i;
+    int socks[NU_MAX_HOST_ADDRS];
+    int num_started = 0;
+    int num_active;
+    int max_fd;
+    int winner = INVALID;
+    int num_sockets;
+    int so_err;
+    socklen_t so_len;
+    fd_set writefds;
+    struct timeval timeout;
+    uint64_t cur_time;
+    uint64_t end_time;
+    uint64_t wait_time;
+    char buf[NU_IPADDRSTRLEN];
+
+    end_time = tu_uptime_usecs() + (uint64_t)STOMP_CONNECT_TIMEOUT*1000000;
+    while (winner == INVALID)
+    {
+        // Start the next connection attempt (if there are any more addresses to try)
+        if (num_started < num_addrs)
+        {
+            socks[num_started] = StartStompConnectAttempt(sc, &addrs[num_started], local_mgmt_addr);
+            num_started++;
+        }
+
+        // Determine the sockets of the connection attempts which are still in progress
+        FD_ZERO(&writefds);
+        num_active = 0;
+        max_fd = 0;
+        for (i=0; i<num_started; i++)
+        {
+            if (socks[i] != INVALID)
+            {
+                FD_SET(socks[i], &writefds);
+                max_fd = MAX(max_fd, socks[i]);
+                num_active++;
+            }
+        }
+
+        // If no attempts are in progress, then start the next attempt immediately, or exit the loop if all attempts have failed
+        if (num_active == 0)
+        {
+            if (num_started == num_addrs)
+            {
+                USP_LOG_Error("%s: async connect failed", __FUNCTION__);
+                break;
+            }
+            continue;
+        }
+
+        // Exit loop if the connect timed out
+        cur_time = tu_uptime_usecs();
+        if (cur_time >= end_time)
+        {
+            USP_LOG_Error("%s: connect timed out", __FUNCTION__);
+            break;
+        }
+
+        // Wait for any attempt to complete, or until it is time to start the next attempt
+        wait_time = end_time - cur_time;
+        if (num_started < num_addrs)
+        {
+            wait_time = MIN(wait_time, (uint64_t)STOMP_CONNECT_ATTEMPT_DELAY_MS*1000);
+        }
+        timeout.tv_sec = wait_time / 1000000;
+        timeout.tv_usec = wait_time % 1000000;
+        num_sockets = select(max_fd + 1, NULL, &writefds, NULL, &timeout);
+        if (num_sockets <= 0)
+        {
+            continue;
+        }
+
+        // Determine whether any of the attempts have completed, abandoning those which failed
+        for (i=0; i<num_started; i++)
+        {
+            if ((socks[i] != INVALID) && (FD_ISSET(socks[i], &writefds)))
+            {
+                so_len = sizeof(so_err);
+                if ((getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &so_err, &so_len) == 0) && (so_err == 0))
+                {
+                    winner = i;
+                    break;
+                }
+
+                USP_LOG_Warning("%s: connect to %s failed (%s)", __FUNCTION__, nu_ipaddr_str(&addrs[i], buf, sizeof(buf)), strerror(so_err));
+                close(socks[i]);
+                socks[i] = INVALID;
+            }
+        }
+    }
+
+    // Abandon all other connection attempts
+    for (i=0; i<num_started; i++)
+    {
+        if ((i != winner) && (socks[i] != INVALID))
+        {
+            close(socks[i]);
+        }
+    }
+
+    if (winner != INVALID)
+    {
+        sc->socket_fd = socks[winner];
+    }
+
+    return winner;
+}
+
+/*********************************************************************//**
+**
+** StartStompConnectAttempt
+**
+** Starts a non-blocking TCP connect to one of the IP addresses of the STOMP server
+**
+** \param   sc - pointer to STOMP connection
+** \param   dst - IP address of the STOMP server to connect to
+** \param   local_mgmt_addr - IP address of the local interface to connect from (the zero address denotes any interface)
+**
+** \return  socket of the connection attempt, or INVALID if the attempt failed immediately
+**
+**************************************************************************/
+int StartStompConnectAttempt(stomp_connection_t *sc, nu_ipaddr_t *dst, nu_ipaddr_t *local_mgmt_addr)
+{
+    int err;
+    int sock;
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    sa_family_t family;
+
+    // Exit if unable to make a socket address structure to contact the STOMP server
+    err = nu_ipaddr_to_sockaddr(dst, sc->port, &saddr, &saddr_len);
+    if (err != USP_ERR_OK)
+    {
+        return INVALID;
+    }
     
     // Exit if unable to determine which address family to use to contact the STOMP server
-    // NOTE: This shouldn't fail if tw_ulib_diags_lookup_host() is correct
-    err = nu_ipaddr_get_family(&dst, &family);
+    // NOTE: This shouldn't fail if nu_ipaddr_order_host_addrs() is correct
+    err = nu_ipaddr_get_family(dst, &family);
     if (err != USP_ERR_OK)
     {
-        goto exit;
+        return INVALID;
     }
 
     // Exit if unable to create the socket
-    sc->socket_fd = socket(family, SOCK_STREAM, 0);
-    if (sc->socket_fd == -1)
+    sock = socket(family, SOCK_STREAM, 0);
+    if (sock == -1)
     {
         USP_ERR_ERRNO("socket", errno);
-        goto exit;
+        return INVALID;
     }
 
 #ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
@@ -1278,14 +1732,14 @@ void StartStompConnection(stomp_connection_t *sc)
     socklen_t waddr_len;
 
     // Create a sockaddr structure containing our local WAN interface that we want to bind to
-    err = nu_ipaddr_to_sockaddr(&local_mgmt_addr, 0, &waddr, &waddr_len);
+    err = nu_ipaddr_to_sockaddr(local_mgmt_addr, 0, &waddr, &waddr_len);
     if (err != USP_ERR_OK)
     {
         goto exit;
     }
 
     // Exit if unable to bind to our local WAN interface
-    err = bind(sc->socket_fd, (struct sockaddr *)&waddr, waddr_len);
+    err = bind(sock, (struct sockaddr *)&waddr, waddr_len);
     if (err == -1)
     {
         USP_ERR_ERRNO("bind", errno);
@@ -1294,9 +1748,13 @@ void StartStompConnection(stomp_connection_t *sc)
 }
 #endif
 
+    // Apply the TCP socket options configured for this connection
+    // NOTE: This must be done before connecting, as the socket buffer sizes determine the TCP window scale negotiated in the SYN
+    ApplyStompTcpOptions(sc, sock);
+
     // Exit if unable to set the socket as non blocking
     // We do this before connecting so that we can timeout on connect taking too long
-    err = fcntl(sc->socket_fd, F_SETFL, O_NONBLOCK);
+    err = fcntl(sock, F_SETFL, O_NONBLOCK);
     if (err == -1)
     {
         USP_ERR_ERRNO("fcntl", errno);
@@ -1305,98 +1763,98 @@ void StartStompConnection(stomp_connection_t *sc)
     
     // Exit if unable to connect to the STOMP server
     // NOTE: The connect is performed in non-blocking mode
-    err = connect(sc->socket_fd, (struct sockaddr *) &saddr, saddr_len);
+    err = connect(sock, (struct sockaddr *) &saddr, saddr_len);
     if ((err == -1) && (errno != EINPROGRESS))
     {
         USP_ERR_ERRNO("connect", errno);
-        stomp_err = kStompFailure_Connect;
         goto exit;
     }
 
-    // Set up arguments for the select() call
-    FD_ZERO(&writefds);
-    FD_SET(sc->socket_fd, &writefds);
-    timeout.tv_sec = STOMP_CONNECT_TIMEOUT;
-    timeout.tv_usec = 0;
+    return sock;
 
-    // Exit if the connect timed out
-    num_sockets = select(sc->socket_fd + 1, NULL, &writefds, NULL, &timeout);
-    if (num_sockets == 0)
-    {
-        USP_LOG_Error("%s: connect timed out", __FUNCTION__);
-        stomp_err = kStompFailure_Connect;
-        goto exit;
-    }
+exit:
+    close(sock);
+    return INVALID;
+}
 
-    // Exit if unable to determine whether the connect was successful or not
-    err = getsockopt(sc->socket_fd, SOL_SOCKET, SO_ERROR, &so_err, &so_len);
-    if (err == -1)
-    {
-        USP_ERR_ERRNO("getsockopt", errno);
-        stomp_err = kStompFailure_Connect;
-        goto exit;
-    }
+/*********************************************************************//**
+**
+** ApplyStompTcpOptions
+**
+** Applies the TCP socket options configured in Device.STOMP.Connection.{i}.X_ARRIS-COM_TCP* to the socket of a connection attempt
+** NOTE: Failure to apply an option is not fatal - the connection continues with the kernel default for that option
+**
+** \param   sc - pointer to STOMP connection
+** \param   sock - socket to apply the options to
+**
+** \return  None
+**
+**************************************************************************/
+void ApplyStompTcpOptions(stomp_connection_t *sc, int sock)
+{
+    stomp_tcp_params_t *tp = &sc->tcp;
 
-    // Exit if connect was not successful
-    if (so_err != 0)
+    // Disable Nagle's algorithm, so that small frames (eg notifications) are not held back waiting for the ACK of a previous frame
+    if (tp->no_delay)
     {
-        USP_LOG_Error("%s: async connect failed", __FUNCTION__);
-        stomp_err = kStompFailure_Connect;
-        goto exit;
+        SetStompSocketOption(sock, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
     }
 
-    // Perform the SSL handshake (if required), determining the role to use when processing USP messages
-    if (sc->enable_encryption)
+#ifdef TCP_USER_TIMEOUT
+    if (tp->user_timeout != 0)
     {
-        err = PerformStompSslConnect(sc);
-        if (err != USP_ERR_OK)
-        {
-            stomp_err = kStompFailure_Authentication;
-            goto exit;
-        }
-    }
-    else
-    {
-        // If encryption is off, then use the Non SSL role
-        sc->role = ROLE_NON_SSL;
+        SetStompSocketOption(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, "TCP_USER_TIMEOUT", tp->user_timeout);
     }
+#endif
 
-    // Update the address used to connect to the controller
-    err = nu_ipaddr_get_interface_addr_from_sock_fd(sc->socket_fd, sc->mgmt_ip_addr, sizeof(sc->mgmt_ip_addr));
-    if (err != USP_ERR_OK)
+    if (tp->enable_keepalive)
     {
-        goto exit;
+        SetStompSocketOption(sock, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+#ifdef TCP_KEEPIDLE
+        SetStompSocketOption(sock, IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE", tp->keepalive_idle);
+#endif
+#ifdef TCP_KEEPINTVL
+        SetStompSocketOption(sock, IPPROTO_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL", tp->keepalive_interval);
+#endif
+#ifdef TCP_KEEPCNT
+        SetStompSocketOption(sock, IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT", tp->keepalive_count);
+#endif
     }
 
-    // Update the interface used to connect to the controller
-    err = nu_ipaddr_get_interface_name_from_src_addr(sc->mgmt_ip_addr, sc->mgmt_if_name, sizeof(sc->mgmt_if_name));
-    if (err != USP_ERR_OK)
+    if (tp->send_buffer_size != 0)
     {
-        goto exit;
+        SetStompSocketOption(sock, SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", tp->send_buffer_size);
     }
 
-#ifndef CONNECT_ONLY_OVER_WAN_INTERFACE
-#endif
-
-    USP_LOG_Info("Connected to %s (host=%s, port=%d) from interface=%s", nu_ipaddr_str(&dst, buf, sizeof(buf)), sc->host, sc->port, sc->mgmt_if_name);
-
-    // Exit if unable to queue the initial STOMP frame for sending
-    err = StartSendingFrame_STOMP(sc);
-    if (err != USP_ERR_OK)
+    if (tp->receive_buffer_size != 0)
     {
-        goto exit;
+        SetStompSocketOption(sock, SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", tp->receive_buffer_size);
     }
+}
 
-    // If the code gets here, we have successfully set up state to start sending initial frame
-    sc->state = kStompState_SendingStompFrame;
-    stomp_err = kStompFailure_None;
+/*********************************************************************//**
+**
+** SetStompSocketOption
+**
+** Sets an integer socket option, logging a warning if this failed
+**
+** \param   sock - socket to set the option on
+** \param   level - protocol level of the option (eg SOL_SOCKET, IPPROTO_TCP)
+** \param   option - option to set
+** \param   option_name - name of the option (used for logging)
+** \param   value - value to set the option to
+**
+** \return  None
+**
+**************************************************************************/
+void SetStompSocketOption(int sock, int level, int option, char *option_name, int value)
+{
+    int err;
 
-exit:
-    // Wind back state
-    if (stomp_err != kStompFailure_None)
+    err = setsockopt(sock, level, option, &value, sizeof(value));
+    if (err == -1)
     {
-        USP_LOG_Error("ERROR: STOMP failed whilst attempting to connect to (host=%s, port=%d)", sc->host, sc->port);
-        HandleStompSocketError(sc, stomp_err);
+        USP_LOG_Warning("%s: Unable to set %s=%d (%s)", __FUNCTION__, option_name, value, strerror(errno));
     }
 }
 
@@ -1414,6 +1872,8 @@ exit:
 **************************************************************************/
 void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
 {
+    int i;
+
     USP_LOG_Info("Disconnecting from (host=%s, port=%d)", sc->host, sc->port);
 
 
@@ -1436,6 +1896,7 @@ void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
     // Close the socket
     if (sc->socket_fd != -1)
     {
+        SOCKET_SET_ForgetSocket(sc->socket_fd);
         close(sc->socket_fd);
     }
 
@@ -1445,6 +1906,7 @@ void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
     USP_SAFE_FREE(sc->allowed_controllers);
     sc->role = ROLE_DEFAULT;
     USP_SAFE_FREE(sc->subscribe_dest);
+    STR_VECTOR_Destroy(&sc->deflate_dests);
     sc->agent_heartbeat_period = 0;
     sc->server_heartbeat_period = 0;
     sc->next_heartbeat_time = INVALID_TIME;
@@ -1453,9 +1915,11 @@ void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
     sc->mgmt_if_name[0] = '\0';
 
     // Free any partially received message
-    USP_SAFE_FREE(sc->rxframe);
+    USP_SAFE_FREE(sc->rxframe_buf);
+    sc->rxframe = NULL;
     sc->rxframe_maxlen = 0;
     sc->rxframe_msglen = 0;
+    sc->rxframe_scanned = 0;
     sc->rxframe_frame_len = 0;
     sc->rxframe_header_len = INVALID;
 
@@ -1463,6 +1927,9 @@ void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
     USP_SAFE_FREE(sc->txframe);
     sc->txframe_len = 0;
     sc->txframe_sent_count = 0;
+    sc->txframe_body = NULL;
+    sc->txframe_body_len = 0;
+    sc->txframe_num_usp_records = 0;
 
     // Purge all queued USP messages if required
     if (purge_queued_messages)
@@ -1471,6 +1938,14 @@ void StopStompConnection(stomp_connection_t *sc, bool purge_queued_messages)
         {
             RemoveStompQueueItem(sc, (stomp_send_item_t *) sc->usp_record_send_queue.head);
         }
+
+        for (i=0; i<kMtpSendPriority_Max; i++)
+        {
+            while (sc->usp_record_pending_queue.queues[i].head != NULL)
+            {
+                RemoveStompQueueItem(sc, (stomp_send_item_t *) sc->usp_record_pending_queue.queues[i].head);
+            }
+        }
     }
         
     sc->state = kStompState_Idle;
@@ -1494,7 +1969,6 @@ void InitStompConnection(stomp_connection_t *sc)
     cur_time = time(NULL);
     sc->state = kStompState_Idle;
     sc->retry_time = 0;
-    #define STOMP_HANDSHAKE_TIMEOUT 30 // Total time allowed to perform the STOMP handshake sequence (ie STOMP, CONNECTED, SUBSCRIBE frames)
     sc->stomp_handshake_timeout = cur_time + STOMP_HANDSHAKE_TIMEOUT;
     sc->schedule_resubscribe = 0;
     
@@ -1504,22 +1978,30 @@ void InitStompConnection(stomp_connection_t *sc)
     sc->role = ROLE_DEFAULT;
     sc->subscribe_dest = NULL;
     sc->allowed_controllers = NULL;
+    STR_VECTOR_Init(&sc->deflate_dests);
 
     sc->agent_heartbeat_period = 0;
     sc->server_heartbeat_period = 0;
     sc->next_heartbeat_time = INVALID_TIME;
     sc->last_received_time = INVALID_TIME;
 
+    sc->rxframe_buf = NULL;
     sc->rxframe = NULL;
     sc->rxframe_msglen = 0;
     sc->rxframe_maxlen = 0;
+    sc->rxframe_scanned = 0;
     sc->rxframe_frame_len = 0;
     sc->rxframe_header_len = INVALID;
 
     sc->txframe = NULL;
     sc->txframe_len = 0;
     sc->txframe_sent_count = 0;
-    sc->txframe_contains_usp_record = false;
+    sc->txframe_body = NULL;
+    sc->txframe_body_len = 0;
+    sc->txframe_num_usp_records = 0;
+
+    sc->ssl_write_want = SSL_ERROR_NONE;
+    sc->ssl_write_timeout = INVALID_TIME;
 
     // Store the time at which we started connecting, unless we want to preserve the time at which an error first occurred
     if (sc->failure_code == kStompFailure_None)
@@ -1574,6 +2056,20 @@ int PerformStompSslConnect(stomp_connection_t *sc)
 
     // Set the pointer to the variable in which to point to the certificate chain collected in the verify callback
     SSL_set_app_data(sc->ssl, &sc->cert_chain);
+    SSL_set_ex_data(sc->ssl, stomp_ssl_conn_index, sc);
+
+    // Offer the TLS session from the last connection to the server, if it was with the same server
+    if (sc->tls_session != NULL)
+    {
+        if ((sc->tls_session_host != NULL) && (strcmp(sc->tls_session_host, sc->host)==0) && (sc->tls_session_port == sc->port))
+        {
+            SSL_set_session(sc->ssl, sc->tls_session);
+        }
+        else
+        {
+            ForgetStompTlsSession(sc);
+        }
+    }
 
 #if OPENSSL_VERSION_NUMBER >= 0x1000200FL // SSL version 1.0.2
 {
@@ -1607,11 +2103,13 @@ int PerformStompSslConnect(stomp_connection_t *sc)
     }
 
     // Exit if unable to successfully perform the SSL handshake
+    // NOTE: The saved TLS session is forgotten if the handshake fails, in case it was the cause of the failure
     err = SSL_connect(sc->ssl);
     if (err != 1)
     {
         int ssl_err = SSL_get_error(sc->ssl, err);
         USP_LOG_ErrorSSL(__FUNCTION__, "SSL_connect() failed", err, ssl_err);
+        ForgetStompTlsSession(sc);
         return USP_ERR_INTERNAL_ERROR;
     }
 
@@ -1627,15 +2125,35 @@ int PerformStompSslConnect(stomp_connection_t *sc)
 
     X509_free(server_cert);
 
-    // If we have a certificate chain, then determine which role to allow for controllers on this STOMP connection
-    if (sc->cert_chain != NULL)
+    if (SSL_session_reused(sc->ssl))
+    {
+        // The previous session was resumed, so the server's certificate chain was not verified again in this handshake
+        // Instead use the role determined from the certificate chain when the session was established
+        sc->tls_resumed_handshakes++;
+        sc->role = sc->tls_session_role;
+        if (sc->tls_session_allowed_controllers != NULL)
+        {
+            sc->allowed_controllers = USP_STRDUP(sc->tls_session_allowed_controllers);
+        }
+        USP_LOG_Debug("%s: Resumed TLS session with (host=%s, port=%d)", __FUNCTION__, sc->host, sc->port);
+    }
+    else
     {
-        // Exit if unable to determine the role associated with the trusted root cert
-        err = DEVICE_SECURITY_GetControllerTrust(sc->cert_chain, &sc->role, &sc->allowed_controllers);
-        if (err != USP_ERR_OK)
+        // If we have a certificate chain, then determine which role to allow for controllers on this STOMP connection
+        sc->tls_full_handshakes++;
+        if (sc->cert_chain != NULL)
         {
-            return err;
+            // Exit if unable to determine the role associated with the trusted root cert
+            err = DEVICE_SECURITY_GetControllerTrust(sc->cert_chain, &sc->role, &sc->allowed_controllers);
+            if (err != USP_ERR_OK)
+            {
+                ForgetStompTlsSession(sc);
+                return err;
+            }
         }
+
+        // Save the role, so that it can be reused if this session is resumed
+        SaveStompTlsSessionTrust(sc);
     }
 
     // Exit if unable to set the socket back as non blocking
@@ -1653,6 +2171,98 @@ int PerformStompSslConnect(stomp_connection_t *sc)
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** StompNewTlsSessionCallback
+**
+** Called by OpenSSL when a new TLS session (or TLS 1.3 session ticket) has been received from the server
+** The session is saved in the STOMP connection, so that it can be resumed the next time that the connection is (re)started
+**
+** \param   ssl - pointer to SSL connection on which the session was received
+** \param   session - pointer to new session
+**
+** \return  1 if the session has been saved (taking ownership of the reference to it), 0 otherwise
+**
+**************************************************************************/
+int StompNewTlsSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    stomp_connection_t *sc;
+
+    // Exit if unable to determine which STOMP connection this SSL belongs to
+    sc = SSL_get_ex_data(ssl, stomp_ssl_conn_index);
+    if (sc == NULL)
+    {
+        return 0;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x1010100FL // SSL version 1.1.1
+    // Exit if this session cannot be used to resume a connection
+    if (SSL_SESSION_is_resumable(session) == 0)
+    {
+        return 0;
+    }
+#endif
+
+    // Replace any previously saved session with this one
+    if (sc->tls_session != NULL)
+    {
+        SSL_SESSION_free(sc->tls_session);
+    }
+    sc->tls_session = session;
+
+    return 1;
+}
+
+/*********************************************************************//**
+**
+** SaveStompTlsSessionTrust
+**
+** Saves the server and the controller trust determined from the server's certificate chain after a full TLS handshake
+** These are used if a subsequent connection resumes the TLS session
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None
+**
+**************************************************************************/
+void SaveStompTlsSessionTrust(stomp_connection_t *sc)
+{
+    sc->tls_session_host = AllocateStringIfChanged(sc->tls_session_host, sc->host);
+    sc->tls_session_port = sc->port;
+    sc->tls_session_role = sc->role;
+
+    USP_SAFE_FREE(sc->tls_session_allowed_controllers);
+    if (sc->allowed_controllers != NULL)
+    {
+        sc->tls_session_allowed_controllers = USP_STRDUP(sc->allowed_controllers);
+    }
+}
+
+/*********************************************************************//**
+**
+** ForgetStompTlsSession
+**
+** Frees the saved TLS session of the specified STOMP connection, so that the next connection performs a full TLS handshake
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None
+**
+**************************************************************************/
+void ForgetStompTlsSession(stomp_connection_t *sc)
+{
+    if (sc->tls_session != NULL)
+    {
+        SSL_SESSION_free(sc->tls_session);
+        sc->tls_session = NULL;
+    }
+
+    USP_SAFE_FREE(sc->tls_session_host);
+    USP_SAFE_FREE(sc->tls_session_allowed_controllers);
+    sc->tls_session_port = 0;
+    sc->tls_session_role = ROLE_DEFAULT;
+}
+
 /*********************************************************************//**
 **
 ** UpdateStompConnectionSockSet
@@ -1685,6 +2295,21 @@ void UpdateStompConnectionSockSet(stomp_connection_t *sc, socket_set_t *set)
         }
     }
 
+    // If an SSL_write() is waiting to be retried, then abort and retry the connection if it has taken too long to complete
+    if (sc->ssl_write_want != SSL_ERROR_NONE)
+    {
+        cur_time = time(NULL);
+        if (cur_time >= sc->ssl_write_timeout)
+        {
+            USP_LOG_Error("%s: SSL_write() timed out (in state=%s) on connection to (host=%s, port=%d)", __FUNCTION__, state_names[sc->state], sc->host, sc->port);
+            HandleStompSocketError(sc, kStompFailure_Timeout);
+        }
+        else
+        {
+            SOCKET_SET_UpdateTimeout((sc->ssl_write_timeout - cur_time)*SECONDS, set);
+        }
+    }
+
     // Determine what to do based on the state of the STOMP connection state machine
     switch(sc->state)
     {
@@ -1692,9 +2317,19 @@ void UpdateStompConnectionSockSet(stomp_connection_t *sc, socket_set_t *set)
             // Do nothing
             break;
 
+        case kStompState_ResolvingHost:
+            // Continue connecting, if the lookup of the IP address of the STOMP server has completed
+            // NOTE: The DNS cache wakes up this thread when the lookup completes
+            ConnectStompSocket(sc);
+            if (sc->state == kStompState_SendingStompFrame)
+            {
+                SOCKET_SET_AddSocketToSendTo(sc->socket_fd, 0, set);
+            }
+            break;
+
         case kStompState_SendingStompFrame:
             timeout = CalcTimeoutToStompHandshakeFailure(sc);
-            SOCKET_SET_AddSocketToSendTo(sc->socket_fd, timeout*SECONDS, set);
+            AddStompSocketToSendTo(sc, timeout, set);
             break;
 
         case kStompState_AwaitingConnectedFrame:
@@ -1704,7 +2339,7 @@ void UpdateStompConnectionSockSet(stomp_connection_t *sc, socket_set_t *set)
 
         case kStompState_SendingSubscribeFrame:
             timeout = CalcTimeoutToStompHandshakeFailure(sc);
-            SOCKET_SET_AddSocketToSendTo(sc->socket_fd, timeout*SECONDS, set);
+            AddStompSocketToSendTo(sc, timeout, set);
             break;
             
         case kStompState_Running:
@@ -1733,7 +2368,7 @@ void UpdateStompConnectionSockSet(stomp_connection_t *sc, socket_set_t *set)
             else
             {
                 // Wait until it's time to retry
-                SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);   // Retry in 5 seconds time
+                SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, MTP_RETRY_SLACK, set);
             }
             break;
 
@@ -1764,7 +2399,9 @@ int HandleStompRunningState(stomp_connection_t *sc, socket_set_t *set)
     time_t cur_time;
 
     // If not currently transmitting a frame, then see if there are any more to send
-    if (sc->txframe == NULL)
+    // NOTE: If there is no frame, but an SSL_write() is pending, then it is for a heartbeat. In this case, the heartbeat must
+    // complete before starting the next frame, as OpenSSL requires that the SSL_write() is retried with exactly the same arguments
+    if ((sc->txframe == NULL) && (sc->ssl_write_want == SSL_ERROR_NONE))
     {
         // Exit if unable to form the next message because unable to get agent or controller queue name
         err = GetNextStompMsgToSend(sc);
@@ -1787,13 +2424,22 @@ int HandleStompRunningState(stomp_connection_t *sc, socket_set_t *set)
         }
     }
 
-    // Always listening, in this state
-    SOCKET_SET_AddSocketToReceiveFrom(sc->socket_fd, timeout*SECONDS, set);
+    // Always listening in this state, unless the data model thread has a backlog of USP records to process (backpressure)
+    // NOTE: The time to the next heartbeat is added separately, so that it may be coalesced with other timer events
+    if (USP_MEM_IsBudgetUnderPressure(kMemBudget_DmQueue))
+    {
+        SOCKET_SET_UpdateTimeout(MEM_BUDGET_RECHECK_PERIOD, set);
+    }
+    else
+    {
+        SOCKET_SET_AddSocketToReceiveFrom(sc->socket_fd, MAX_SOCKET_TIMEOUT, set);
+    }
+    SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, STOMP_AGENT_HEARTBEAT_SLACK, set);
 
     // Want to transmit message (or heartbeat) if one is pending
-    if ((sc->txframe != NULL) || (timeout == 0))
+    if ((sc->txframe != NULL) || (timeout == 0) || (sc->ssl_write_want != SSL_ERROR_NONE))
     {
-        SOCKET_SET_AddSocketToSendTo(sc->socket_fd, timeout*SECONDS, set);
+        AddStompSocketToSendTo(sc, timeout, set);
     }
 
     return USP_ERR_OK;
@@ -1829,15 +2475,16 @@ int GetNextStompMsgToSend(stomp_connection_t *sc)
     }
     else
     {
-        // First remove all expired messages from the queue
+        // First remove all expired messages from the queue, then refill the send queue (if it is empty) in send priority order
         RemoveExpiredStompMessages(sc);
+        ScheduleStompMessages(sc);
 
         // Start sending the message at the head of the send queue, if ready to accept a new message to send
         // NOTE: Message will be removed from send queue when it has been sent out successfully
         queued_msg = (stomp_send_item_t *) sc->usp_record_send_queue.head;
         if (queued_msg != NULL)
         {
-            err = StartSendingFrame_SEND(sc, queued_msg->controller_queue, queued_msg->agent_queue, queued_msg->usp_msg_type, queued_msg->pbuf, queued_msg->pbuf_len, queued_msg->content_type, queued_msg->err_id_header);
+            err = StartSendingFrame_SEND(sc, queued_msg);
         }
     }
     
@@ -1862,11 +2509,12 @@ void ProcessStompConnectionSocketActivity(stomp_connection_t *sc, socket_set_t *
     switch(sc->state)
     {
         case kStompState_Idle:
+        case kStompState_ResolvingHost:
             // Do nothing
             break;
 
         case kStompState_SendingStompFrame:
-            if (SOCKET_SET_IsReadyToWrite(sc->socket_fd, set))
+            if (IsStompSocketReadyToSend(sc, set))
             {
                 TransmitStompMessage(sc);
             }
@@ -1881,7 +2529,7 @@ void ProcessStompConnectionSocketActivity(stomp_connection_t *sc, socket_set_t *
             break;
 
         case kStompState_SendingSubscribeFrame:
-            if (SOCKET_SET_IsReadyToWrite(sc->socket_fd, set))
+            if (IsStompSocketReadyToSend(sc, set))
             {
                 USP_ASSERT(sc->txframe != NULL);
                 TransmitStompMessage(sc);
@@ -1900,12 +2548,12 @@ void ProcessStompConnectionSocketActivity(stomp_connection_t *sc, socket_set_t *
                 return;
             }
 
-            if (SOCKET_SET_IsReadyToWrite(sc->socket_fd, set))
+            if (IsStompSocketReadyToSend(sc, set))
             {
                 if (sc->txframe != NULL)
                 {
-                    // Send a message (if we have one to send)  
-                    TransmitStompMessage(sc);
+                    // Send messages (if we have any to send)
+                    TransmitQueuedStompMessages(sc);
                 }
                 else
                 {
@@ -1993,6 +2641,12 @@ void UpdateAgentHeartbeat(stomp_connection_t *sc)
     #define HEARTBEAT_STR "\n"
     num_bytes_sent = StompWrite(sc, (unsigned char *)HEARTBEAT_STR, sizeof(HEARTBEAT_STR)-1);
 
+    // Exit if the heartbeat could not be sent yet. It will be retried when the socket is ready
+    if (num_bytes_sent == STOMP_WRITE_PENDING)
+    {
+        return;
+    }
+
     // Exit if an error occurred
     if (num_bytes_sent < 0)
     {
@@ -2014,6 +2668,57 @@ void UpdateAgentHeartbeat(stomp_connection_t *sc)
     UpdateNextHeartbeatTime(sc);
 }
 
+/*********************************************************************//**
+**
+** TransmitQueuedStompMessages
+**
+** Sends the current frame, then carries on forming and sending the next frames in the send queue,
+** until the socket's send buffer is full (or a maximum number of frames have been sent)
+** This fills the send window on each writable socket event, rather than sending only one frame per call to select()
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None (any errors that occur are handled internally)
+**
+**************************************************************************/
+void TransmitQueuedStompMessages(stomp_connection_t *sc)
+{
+    int err;
+    int count = 0;
+
+    #define STOMP_MAX_FRAMES_PER_WRITE_EVENT  16     // Maximum number of frames to send before servicing other sockets
+    while (true)
+    {
+        // Exit if the current frame has not been sent out entirely (because the socket's send buffer is full), or an error occurred
+        TransmitStompMessage(sc);
+        count++;
+        if ((sc->socket_fd == INVALID) || (sc->state != kStompState_Running) || (sc->txframe != NULL) || (sc->ssl_write_want != SSL_ERROR_NONE))
+        {
+            return;
+        }
+
+        // Exit if there are no more messages to send, or sent enough frames for this socket event
+        if ((IsStompSendQueueEmpty(sc)) || (count >= STOMP_MAX_FRAMES_PER_WRITE_EVENT))
+        {
+            return;
+        }
+
+        // Exit if unable to form the next message because unable to get agent or controller queue name
+        err = GetNextStompMsgToSend(sc);
+        if (err != USP_ERR_OK)
+        {
+            HandleStompSocketError(sc, kStompFailure_Misconfigured);
+            return;
+        }
+
+        // Exit if there was no next message to send (eg because all remaining messages had expired)
+        if (sc->txframe == NULL)
+        {
+            return;
+        }
+    }
+}
+
 /*********************************************************************//**
 **
 ** TransmitStompMessage
@@ -2027,16 +2732,28 @@ void UpdateAgentHeartbeat(stomp_connection_t *sc)
 **************************************************************************/
 int TransmitStompMessage(stomp_connection_t *sc)
 {
+    stomp_send_item_t *queued_msg;
     int num_bytes_sent;
-    unsigned char *buf;
-    int bytes_to_attempt;
+    struct iovec iov[3];
+    int iovcnt;
+    int frame_len;
 
     // Determine what to send
-    buf = &sc->txframe[ sc->txframe_sent_count ];
-    bytes_to_attempt = sc->txframe_len - sc->txframe_sent_count;
+    iovcnt = GetUnsentStompFrame(sc, iov);
+    frame_len = sc->txframe_len;
+    if (sc->txframe_body != NULL)
+    {
+        frame_len += sc->txframe_body_len + 1;  // Plus 1 for the NULL terminator following the body
+    }
 
     // Attempt to send the rest of the frame
-    num_bytes_sent = StompWrite(sc, buf, bytes_to_attempt);
+    num_bytes_sent = StompWritev(sc, iov, iovcnt);
+
+    // Exit if nothing could be sent yet. The write will be retried when the socket is ready
+    if (num_bytes_sent == STOMP_WRITE_PENDING)
+    {
+        return USP_ERR_OK;
+    }
 
     // Exit if an error occurred
     if (num_bytes_sent < 0)
@@ -2058,11 +2775,12 @@ int TransmitStompMessage(stomp_connection_t *sc)
     // If something was sent, we don't need to send out a heartbeat for some time to come
     if (num_bytes_sent > 0)
     {
+        USP_PROBE3(mtp_write, kMtpProtocol_STOMP, sc->host, num_bytes_sent);
         UpdateNextHeartbeatTime(sc);
     }
 
     // Exit if the frame has not been sent out entirely
-    if (sc->txframe_sent_count + num_bytes_sent < sc->txframe_len)
+    if (sc->txframe_sent_count + num_bytes_sent < frame_len)
     {
         sc->txframe_sent_count += num_bytes_sent;
         return USP_ERR_OK;
@@ -2072,11 +2790,21 @@ int TransmitStompMessage(stomp_connection_t *sc)
     USP_FREE(sc->txframe);
     sc->txframe = NULL;
     sc->txframe_len = 0;
+    sc->txframe_body = NULL;
+    sc->txframe_body_len = 0;
 
-    // Also, if it contained an embedded USP message, then remove that from the send queue
-    if (sc->txframe_contains_usp_record)
+    // Also, if it contained embedded USP messages, then remove those from the send queue, recording how long they took to send
+    while (sc->txframe_num_usp_records > 0)
     {
-        RemoveStompQueueItem(sc, (stomp_send_item_t *) sc->usp_record_send_queue.head);
+        queued_msg = (stomp_send_item_t *) sc->usp_record_send_queue.head;
+        if (queued_msg->content_type == kMtpContentType_UspRecord)
+        {
+            DEVICE_MSG_STATS_RecordDuration(queued_msg->usp_msg_type, kMsgStat_SendQueueWait,
+                                            (sc->txframe_start_time > queued_msg->queued_time) ? sc->txframe_start_time - queued_msg->queued_time : 0);
+            DEVICE_MSG_STATS_Record(queued_msg->usp_msg_type, kMsgStat_WireSend, sc->txframe_start_time);
+        }
+        RemoveStompQueueItem(sc, queued_msg);
+        sc->txframe_num_usp_records--;
     }
 
     // Move to next state (if required)
@@ -2091,14 +2819,17 @@ int TransmitStompMessage(stomp_connection_t *sc)
             sc->failure_code = kStompFailure_None;  // The reason this is set here is that we don't want to change the previous Connection.{i}.Status until it becomes successful
             sc->last_status_change = time(NULL);
             sc->retry_count = 0;        // Since successful, reset the retry count
+            sc->last_retry_wait = 0;
 
             // Notify the data model of the role to use for controllers connected to this STOMP connection
             // This will also unblock the Boot! event, subscriptions, and restarting of operations
             DM_EXEC_PostStompHandshakeComplete(sc->instance, sc->role, sc->allowed_controllers);
+            DEVICE_MSG_STATS_RecordBootMilestone(kBootTime_FirstMtpConnected);
             break;
 
         default:            
         case kStompState_Idle:
+        case kStompState_ResolvingHost:
         case kStompState_AwaitingConnectedFrame:
         case kStompState_Running:
         case kStompState_Retrying:
@@ -2125,16 +2856,19 @@ int TransmitStompMessage(stomp_connection_t *sc)
 **************************************************************************/
 void ReceiveStompMessage(stomp_connection_t *sc)
 {
-    unsigned char buf[1024];
+    unsigned char *buf;
+    int space;
     int num_bytes;
     int bytes_pending;
     int err;
     int ssl_err;
 
     // Perform a simple recv() if connection is not encrypted
+    // NOTE: Data is read directly into the end of the receive buffer
     if (sc->enable_encryption == false)
     {
-        num_bytes = recv(sc->socket_fd, buf, sizeof(buf), 0);
+        buf = ReserveStompRxSpace(sc, &space);
+        num_bytes = recv(sc->socket_fd, buf, space, 0);
 
         // Exit if an error occurred
         if (num_bytes < 0)
@@ -2152,7 +2886,7 @@ void ReceiveStompMessage(stomp_connection_t *sc)
             return;
         }
 
-        ReceiveStompMessageInner(sc, buf, num_bytes);
+        ReceiveStompMessageInner(sc, num_bytes);
         return;
     }
 
@@ -2163,7 +2897,8 @@ void ReceiveStompMessage(stomp_connection_t *sc)
     while (bytes_pending > 0)
     {
         // Read from SSL
-        num_bytes = SSL_read(sc->ssl, buf, sizeof(buf));
+        buf = ReserveStompRxSpace(sc, &space);
+        num_bytes = SSL_read(sc->ssl, buf, space);
 
         // Determine if there was any error
         ssl_err = SSL_get_error(sc->ssl, num_bytes);
@@ -2187,7 +2922,7 @@ void ReceiveStompMessage(stomp_connection_t *sc)
                 }
 
                 // Exit if an error occurred when attempting to concatenate the bytes read to the end of the receive buffer
-                err = ReceiveStompMessageInner(sc, buf, num_bytes);
+                err = ReceiveStompMessageInner(sc, num_bytes);
                 if (err != USP_ERR_OK)
                 {
                     return;
@@ -2228,24 +2963,85 @@ void ReceiveStompMessage(stomp_connection_t *sc)
 
 }
 
+/*********************************************************************//**
+**
+** ReserveStompRxSpace
+**
+** Ensures that there is space at the end of the receive buffer to read more data into
+** The space used by frames which have already been processed is reclaimed by moving the current (partially received)
+** frame down to the start of the buffer. This is only done when the space left at the end of the buffer runs low,
+** so that the cost of moving data is amortised over the frames received, rather than being paid after every frame.
+**
+** \param   sc - pointer to STOMP connection
+** \param   space - pointer to variable in which to return the number of bytes available at the returned pointer
+**
+** \return  pointer to the end of the data in the receive buffer, at which more data may be read
+**
+**************************************************************************/
+unsigned char *ReserveStompRxSpace(stomp_connection_t *sc, int *space)
+{
+    int free_space;
+    int new_len;
+
+    // Allocate the receive buffer, if not already allocated
+    #define STOMP_RX_BUF_INITIAL_SIZE  8192     // Initial size of the receive buffer
+    #define STOMP_RX_BUF_MIN_SPACE     4096     // Minimum space to make available at the end of the receive buffer for each read
+    if (sc->rxframe_buf == NULL)
+    {
+        sc->rxframe_buf = USP_MALLOC(STOMP_RX_BUF_INITIAL_SIZE);
+        sc->rxframe_maxlen = STOMP_RX_BUF_INITIAL_SIZE;
+        sc->rxframe = sc->rxframe_buf;
+        sc->rxframe_msglen = 0;
+    }
+
+    // Exit if there is enough space at the end of the receive buffer already
+    free_space = sc->rxframe_maxlen - (int)(sc->rxframe - sc->rxframe_buf) - sc->rxframe_msglen;
+    if (free_space >= STOMP_RX_BUF_MIN_SPACE)
+    {
+        *space = free_space;
+        return &sc->rxframe[sc->rxframe_msglen];
+    }
+
+    // Reclaim the space used by frames which have already been processed
+    if (sc->rxframe != sc->rxframe_buf)
+    {
+        memmove(sc->rxframe_buf, sc->rxframe, sc->rxframe_msglen);
+        sc->rxframe = sc->rxframe_buf;
+        free_space = sc->rxframe_maxlen - sc->rxframe_msglen;
+    }
+
+    // Increase the size of the receive buffer, if there is still not enough space
+    // If the length of the current frame is known (from its content-length header), size the buffer to hold it all, to avoid repeated reallocation
+    if (free_space < STOMP_RX_BUF_MIN_SPACE)
+    {
+        new_len = MAX(2*sc->rxframe_maxlen, sc->rxframe_msglen + STOMP_RX_BUF_MIN_SPACE);
+        new_len = MAX(new_len, sc->rxframe_frame_len);
+        sc->rxframe_buf = USP_REALLOC(sc->rxframe_buf, new_len);
+        sc->rxframe_maxlen = new_len;
+        sc->rxframe = sc->rxframe_buf;
+        free_space = sc->rxframe_maxlen - sc->rxframe_msglen;
+    }
+
+    *space = free_space;
+    return &sc->rxframe[sc->rxframe_msglen];
+}
+
 /*********************************************************************//**
 **
 ** ReceiveStompMessageInner
 **
 ** Called for each message fragment received from the socket or SSL.
-** This function concatenates the fragments together into a receive buffer,
-** then detects STOMP frames in the receive buffer and removes STOMP frames from it
+** The fragment has already been read into the end of the receive buffer (see ReserveStompRxSpace).
+** This function then detects STOMP frames in the receive buffer and processes them in place
 **
 ** \param   sc - pointer to STOMP connection
-** \param   buf - pointer to buffer containing the message fragment
 ** \param   num_bytes - number of bytes in the message fragment
 **
 ** \return  USP_ERR_OK if no error occurred
 **
 **************************************************************************/
-int ReceiveStompMessageInner(stomp_connection_t *sc, unsigned char *buf, int num_bytes)
+int ReceiveStompMessageInner(stomp_connection_t *sc, int num_bytes)
 {
-    int new_len;
     int msg_size;
     int err;
 
@@ -2258,27 +3054,16 @@ int ReceiveStompMessageInner(stomp_connection_t *sc, unsigned char *buf, int num
     // Log the time at which the last message fragment was received (this is an alternative to receiving the STOMP server heartbeat)
     sc->last_received_time = time(NULL);
 
-    // Increase size of rx buffer, if required
-    new_len = sc->rxframe_msglen + num_bytes;
+    // Add the fragment to the unprocessed data in the receive buffer
+    sc->rxframe_msglen += num_bytes;
 
     // Prevent rogue controllers from crashing agent by setting an arbitrary message size limit
-    if (new_len > MAX_USP_MSG_LEN)
+    if (sc->rxframe_msglen > MAX_USP_MSG_LEN)
     {
         USP_LOG_Error("ERROR: STOMP Connection to (host %s, port %d) receiving a message >%d bytes long. Closing connection.", sc->host, sc->port, MAX_USP_MSG_LEN);
         HandleStompSocketError(sc, kStompFailure_OtherError);
         return USP_ERR_INTERNAL_ERROR;
     }
-    
-    if (new_len > sc->rxframe_maxlen)
-    {
-        // Increase receive buffer size
-        sc->rxframe = USP_REALLOC(sc->rxframe, new_len);
-        sc->rxframe_maxlen = new_len;
-    }
-
-    // Copy into the receive buffer
-    memcpy(&sc->rxframe[sc->rxframe_msglen], buf, num_bytes);
-    sc->rxframe_msglen = new_len;
 
     // Exit if an error occurred whilst parsing the STOMP header
     err = IsStompMsgComplete(sc, &msg_size);   // NOTE: rxframe can contain more than one message, hence the need to use msg_size rather than rxframe_msglen
@@ -2312,6 +3097,7 @@ int ReceiveStompMessageInner(stomp_connection_t *sc, unsigned char *buf, int num
 ** StompWrite
 **
 ** Attempt to send the specified data to the STOMP server
+** See StompWritev() for details
 **
 ** \param   sc - pointer to STOMP connection
 ** \param   buf - pointer to buffer containing data to send
@@ -2319,63 +3105,192 @@ int ReceiveStompMessageInner(stomp_connection_t *sc, unsigned char *buf, int num
 **
 ** \return  >0  Number of bytes sent (which might be less than the number to attempt)
 **          0   indicates that the STOMP server has disconnected
+**          STOMP_WRITE_PENDING indicates that nothing could be sent yet, and the write must be retried when the socket is ready
 **          <0  indicates that another error has occurred
 **
 **************************************************************************/
 int StompWrite(stomp_connection_t *sc, unsigned char *buf, int bytes_to_attempt)
 {
-    int num_bytes_sent = 0;
+    struct iovec iov;
+
+    iov.iov_base = buf;
+    iov.iov_len = bytes_to_attempt;
+    return StompWritev(sc, &iov, 1);
+}
+
+/*********************************************************************//**
+**
+** StompWritev
+**
+** Attempt to send the specified (scattered) data to the STOMP server
+** This function never blocks. If an SSL_write() cannot complete (eg because an SSL renegotiation is in progress),
+** then the socket activity it is waiting for is recorded, and the caller must call this function again, with exactly
+** the same arguments, once the socket is ready (see AddStompSocketToSendTo and IsStompSocketReadyToSend)
+** NOTE: Unencrypted connections send all buffers in a single writev() call. OpenSSL has no gather write, so encrypted
+**       connections send only the first buffer, and the caller sends the rest on subsequent calls.
+**
+** \param   sc - pointer to STOMP connection
+** \param   iov - array of buffers containing the data to send, in order
+** \param   iovcnt - number of buffers in the array (must be at least 1)
+**
+** \return  >0  Number of bytes sent (which might be less than the number to attempt)
+**          0   indicates that the STOMP server has disconnected
+**          STOMP_WRITE_PENDING indicates that nothing could be sent yet, and the write must be retried when the socket is ready
+**          <0  indicates that another error has occurred
+**
+**************************************************************************/
+int StompWritev(stomp_connection_t *sc, struct iovec *iov, int iovcnt)
+{
+    int num_bytes_sent;
     int err;
-    int retry_count;
 
-    // Perform a simple send() if connection is not encrypted
+    // Perform a simple writev() if connection is not encrypted
     if (sc->enable_encryption == false)
     {
-        num_bytes_sent = send(sc->socket_fd, buf, bytes_to_attempt, 0);
-        goto exit;
+        num_bytes_sent = writev(sc->socket_fd, iov, iovcnt);
+        if ((num_bytes_sent == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            return STOMP_WRITE_PENDING;
+        }
+        return num_bytes_sent;
+    }
+
+    // Exit if the data was sent
+    num_bytes_sent = SSL_write(sc->ssl, iov[0].iov_base, iov[0].iov_len);
+    if (num_bytes_sent > 0)
+    {
+        sc->ssl_write_want = SSL_ERROR_NONE;
+        return num_bytes_sent;
     }
 
-    // Code below is complex because a renegotiation could occur, and open SSL requires that we retry the EXACT same SSL call
-    // We cope with this by retrying the SSL call until the retry has completed (or failed)
-    // This code blocks until the retry has completed, or the retry has timed out
-    #define ONE_SECOND_IN_MICROSECONDS (1000000)
-    #define SSL_RETRY_SLEEP (ONE_SECOND_IN_MICROSECONDS/20)             // Retry 20 times a second
-    #define SSL_RETRY_TIMEOUT  (5*ONE_SECOND_IN_MICROSECONDS)           // Retry for upto 5 seconds
-    #define MAX_SSL_RETRY_COUNT  (SSL_RETRY_TIMEOUT/SSL_RETRY_SLEEP)
-    err = SSL_ERROR_WANT_WRITE;
-    retry_count = 0;
-    while ( (retry_count < MAX_SSL_RETRY_COUNT) && 
-            ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE)) )
+    // Exit if the SSL_write() needs to be retried once the socket is ready - this is needed if a renegotiation occurs
+    err = SSL_get_error(sc->ssl, num_bytes_sent);
+    if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
     {
-        // Try sending
-        num_bytes_sent = SSL_write(sc->ssl, buf, bytes_to_attempt);
-        if (num_bytes_sent > 0)
+        // Start the retry timeout, if this is the first time this SSL_write() has needed to be retried
+        #define SSL_RETRY_TIMEOUT  5           // Number of seconds allowed for an SSL_write() retry to complete
+        if (sc->ssl_write_want == SSL_ERROR_NONE)
         {
-            break;
+            sc->ssl_write_timeout = time(NULL) + SSL_RETRY_TIMEOUT;
         }
+        sc->ssl_write_want = err;
+        return STOMP_WRITE_PENDING;
+    }
 
-        // Determine whether to retry this call until the write has occurred - this is needed if a renegotiation occurs
-        err = SSL_get_error(sc->ssl, num_bytes_sent);
-        USP_LOG_ErrorSSL(__FUNCTION__, "SSL_write() failed", num_bytes_sent, err);
-        usleep(SSL_RETRY_SLEEP);
-        retry_count++;
+    // Otherwise an error occurred, or the STOMP server has disconnected (after logging failure codes)
+    USP_LOG_ErrorSSL(__FUNCTION__, "SSL_write() failed", num_bytes_sent, err);
+    sc->ssl_write_want = SSL_ERROR_NONE;
+    return (num_bytes_sent == 0) ? 0 : -1;
+}
 
-        // Exit if STOMP server has disconnected (after logging failure codes)
-        if (num_bytes_sent==0)
-        {
-            break;
-        }
+/*********************************************************************//**
+**
+** GetUnsentStompFrame
+**
+** Fills in an array of buffers describing the part of the current STOMP frame which has not been sent yet
+**
+** \param   sc - pointer to STOMP connection
+** \param   iov - array of (at least 3) buffers to fill in
+**
+** \return  Number of buffers filled in
+**
+**************************************************************************/
+int GetUnsentStompFrame(stomp_connection_t *sc, struct iovec *iov)
+{
+    static char terminator[] = "";     // STOMP frame NULL terminator, sent after txframe_body
+    int offset;
+    int iovcnt = 0;
+
+    // Add the rest of the frame headers (or the whole of the frame, if it has no separate body)
+    offset = sc->txframe_sent_count;
+    if (offset < sc->txframe_len)
+    {
+        iov[iovcnt].iov_base = &sc->txframe[offset];
+        iov[iovcnt].iov_len = sc->txframe_len - offset;
+        iovcnt++;
+        offset = 0;
+    }
+    else
+    {
+        offset -= sc->txframe_len;
     }
 
-    // Log an error if retry timed out
-    if (retry_count == MAX_SSL_RETRY_COUNT)
+    // Exit if the frame has no separate body
+    if (sc->txframe_body == NULL)
     {
-        USP_LOG_Error("%s: SSL Renegotiation timed out", __FUNCTION__);
+        return iovcnt;
     }
 
-exit:
-    return num_bytes_sent;
-}    
+    // Add the rest of the body
+    if (offset < sc->txframe_body_len)
+    {
+        iov[iovcnt].iov_base = &sc->txframe_body[offset];
+        iov[iovcnt].iov_len = sc->txframe_body_len - offset;
+        iovcnt++;
+        offset = 0;
+    }
+    else
+    {
+        offset -= sc->txframe_body_len;
+    }
+
+    // Add the NULL terminator following the body
+    USP_ASSERT(offset == 0);
+    iov[iovcnt].iov_base = terminator;
+    iov[iovcnt].iov_len = 1;
+    iovcnt++;
+
+    return iovcnt;
+}
+
+/*********************************************************************//**
+**
+** AddStompSocketToSendTo
+**
+** Adds the STOMP connection's socket to the socket set, in order to send on it
+** NOTE: If an SSL_write() is waiting for data to be received (eg during a renegotiation), then the socket is
+**       added to the set of sockets to receive from instead, since SSL_write() cannot progress until then
+**
+** \param   sc - pointer to STOMP connection
+** \param   timeout - number of seconds to wait for the socket to become ready
+** \param   set - pointer to socket set structure to update with sockets to wait for activity on
+**
+** \return  None
+**
+**************************************************************************/
+void AddStompSocketToSendTo(stomp_connection_t *sc, int timeout, socket_set_t *set)
+{
+    if (sc->ssl_write_want == SSL_ERROR_WANT_READ)
+    {
+        SOCKET_SET_AddSocketToReceiveFrom(sc->socket_fd, timeout*SECONDS, set);
+    }
+    else
+    {
+        SOCKET_SET_AddSocketToSendTo(sc->socket_fd, timeout*SECONDS, set);
+    }
+}
+
+/*********************************************************************//**
+**
+** IsStompSocketReadyToSend
+**
+** Determines whether the STOMP connection's socket is ready for the next (or retried) write
+**
+** \param   sc - pointer to STOMP connection
+** \param   set - pointer to socket set structure containing sockets with activity on them
+**
+** \return  true if StompWrite() should be called
+**
+**************************************************************************/
+bool IsStompSocketReadyToSend(stomp_connection_t *sc, socket_set_t *set)
+{
+    if (sc->ssl_write_want == SSL_ERROR_WANT_READ)
+    {
+        return SOCKET_SET_IsReadyToRead(sc->socket_fd, set);
+    }
+
+    return SOCKET_SET_IsReadyToWrite(sc->socket_fd, set);
+}
 
 /*********************************************************************//**
 **
@@ -2452,8 +3367,10 @@ int IsStompMsgComplete(stomp_connection_t *sc, int *msg_size)
     }
     
     // Otherwise, if the "content-length:" header was not received, then the frame is terminated by NULL
-    p = sc->rxframe;
-    for (i=0; i<len; i++)
+    // NOTE: Bytes which have already been searched (when previous fragments of this frame were received) are not searched again
+    i = sc->rxframe_scanned;
+    p = &sc->rxframe[i];
+    for ( ; i<len; i++)
     {
         if (*p++ == '\0')
         {
@@ -2463,6 +3380,7 @@ int IsStompMsgComplete(stomp_connection_t *sc, int *msg_size)
     }
 
     // If the code gets here, then no full frame has been received
+    sc->rxframe_scanned = len;
     *msg_size = 0;
     return USP_ERR_OK;
 }
@@ -2533,9 +3451,12 @@ int ParseStompHeaders(stomp_connection_t *sc, int *header_size)
     int err;
     
     // Determine if we have read all stomp headers
+    // NOTE: Bytes which have already been searched (when previous fragments of this frame were received) are not searched again,
+    // apart from the last 2, which could form the start of the blank line terminating the headers
     header_len = INVALID;
-    p = sc->rxframe;
-    for (i=0; i<len; i++)
+    i = MAX(sc->rxframe_scanned - 2, 0);
+    p = &sc->rxframe[i];
+    for ( ; i<len; i++)
     {
         // Detect the end of all stomp headers (denoted by a blank line)
         // Code is complicated by the fact we have to deal with optional carriage return character
@@ -2555,12 +3476,14 @@ int ParseStompHeaders(stomp_connection_t *sc, int *header_size)
     // Exit if we do not have all of the stomp headers for this frame yet
     if (header_len == INVALID)
     {
+        sc->rxframe_scanned = len;
         *header_size = INVALID;
         return USP_ERR_OK;
     }
 
     // Since we have all stomp headers, see if any of them is "content-length:"
     *header_size = header_len;
+    sc->rxframe_scanned = header_len;
     err = ParseContentLengthHeader(sc, &content_len);
     if (err != USP_ERR_OK)
     {
@@ -2614,7 +3537,8 @@ int ParseContentLengthHeader(stomp_connection_t *sc, int *content_length)
     *content_length = 0;
 
     // Exit if no "content-length:" header was found
-    is_present = GetStompHeaderValue("content-length:", sc->rxframe, sc->rxframe_msglen, buf, sizeof(buf));
+    // NOTE: Only the headers of the current frame are searched, as the receive buffer may also contain subsequent frames
+    is_present = GetStompHeaderValue("content-length:", sc->rxframe, sc->rxframe_header_len, buf, sizeof(buf));
     if (is_present == false)
     {
         return USP_ERR_OK;
@@ -2656,6 +3580,7 @@ void HandleStompMessage(stomp_connection_t *sc, int msg_size)
             break;
 
         case kStompState_Idle:
+        case kStompState_ResolvingHost:
         case kStompState_SendingStompFrame:
         case kStompState_SendingSubscribeFrame:
             // Code should never get here
@@ -2700,6 +3625,7 @@ void HandleRxMsg_AwaitingConnectedFrameState(stomp_connection_t *sc, int msg_siz
     {
         USP_LOG_Error("%s: Received unexpected STOMP frame on connection to (host %s, port %d): Expected CONNECTED.", __FUNCTION__, sc->host, sc->port);
         USP_LOG_Info("Got frame:- %s", sc->rxframe);
+        ParseStompRetryHint(sc, msg_size);
         HandleStompSocketError(sc, kStompFailure_Authentication);
         return;
     }
@@ -2747,6 +3673,10 @@ void HandleRxMsg_RunningState(stomp_connection_t *sc, int msg_size)
     char time_buf[MAX_ISO8601_LEN];
     mtp_reply_to_t mtp_reply_to = {0};
     char err_id_header[MAX_STOMP_HEADER_VALUE_LEN];
+    char encoding[64];
+    unsigned char *inflated;
+    int inflated_len;
+    int err;
 
     // Exit if this is not the expected MESSAGE frame
     if (IsFrame("MESSAGE", sc->rxframe, msg_size) == false)
@@ -2760,6 +3690,7 @@ void HandleRxMsg_RunningState(stomp_connection_t *sc, int msg_size)
 
         USP_LOG_Error("%s: Received frame other than MESSAGE from (host %s, port %d): Scheduling reconnect.", __FUNCTION__, sc->host, sc->port);
         USP_LOG_Info("Got frame:- %s", sc->rxframe);
+        ParseStompRetryHint(sc, msg_size);
         HandleStompSocketError(sc, kStompFailure_OtherError);
         return;
     }
@@ -2777,6 +3708,13 @@ void HandleRxMsg_RunningState(stomp_connection_t *sc, int msg_size)
         mtp_reply_to.is_reply_to_specified = true;
         mtp_reply_to.stomp_dest = reply_to_dest;
         mtp_reply_to.stomp_instance = sc->instance;
+
+        // Note whether the controller accepts compressed USP records at its reply-to destination
+        if ((GetStompHeaderValue("usp-accept-encoding:", sc->rxframe, msg_size, encoding, sizeof(encoding))) &&
+            (strstr(encoding, "deflate") != NULL) && (STR_VECTOR_Find(&sc->deflate_dests, reply_to_dest) == INVALID))
+        {
+            STR_VECTOR_Add(&sc->deflate_dests, reply_to_dest);
+        }
     }
 
     // Check the content-type
@@ -2829,6 +3767,28 @@ void HandleRxMsg_RunningState(stomp_connection_t *sc, int msg_size)
     USP_LOG_Info("Message received at time %s, from host %s over STOMP", time_buf, sc->host);
     USP_PROTOCOL("%s", &sc->rxframe[offset]);
 
+    // Exit if the USP record is compressed, decompressing it before sending it to the data model thread for processing
+    is_present = GetStompHeaderValue("content-encoding:", sc->rxframe, msg_size, encoding, sizeof(encoding));
+    if ((is_present) && (encoding[0] != '\0') && (strcmp(encoding, "identity") != 0))
+    {
+        if (strcmp(encoding, "deflate") != 0)
+        {
+            USP_LOG_Error("%s: Ignoring STOMP frame with unsupported content-encoding (=%s) on connection to (host %s, port %d)", __FUNCTION__, encoding, sc->host, sc->port);
+            return;
+        }
+
+        err = USP_COMPRESS_Inflate(pbuf, pbuf_len, false, &inflated, &inflated_len);
+        if (err != USP_ERR_OK)
+        {
+            USP_LOG_Error("%s: Ignoring STOMP frame which could not be decompressed on connection to (host %s, port %d): %s", __FUNCTION__, sc->host, sc->port, USP_ERR_GetMessage());
+            return;
+        }
+
+        DM_EXEC_PostUspRecord(inflated, inflated_len, sc->role, sc->allowed_controllers, &mtp_reply_to);
+        USP_FREE(inflated);
+        return;
+    }
+
     // Send the USP Record to the data model thread for processing
     DM_EXEC_PostUspRecord(pbuf, pbuf_len, sc->role, sc->allowed_controllers, &mtp_reply_to);
 }
@@ -2847,27 +3807,28 @@ void HandleRxMsg_RunningState(stomp_connection_t *sc, int msg_size)
 **************************************************************************/
 void RemoveMessageFromRxBuf(stomp_connection_t *sc, int msg_size)
 {
-    int new_size;
-
     USP_ASSERT(sc->rxframe != NULL);
     USP_ASSERT(msg_size > 0);
     USP_ASSERT(sc->rxframe_msglen >= msg_size);
 
     // Remove this message from the head of the buffer, now that we have processed it
-    new_size = sc->rxframe_msglen - msg_size;
-    if (new_size == 0)
-    {
-        // No other messages in the buffer, so just free it
-        USP_FREE(sc->rxframe);
-        sc->rxframe = NULL;
-        sc->rxframe_msglen = 0;
-        sc->rxframe_maxlen = 0;
-    }
-    else
+    // NOTE: The remaining data is not moved. It is only moved if more space is needed at the end of the buffer (see ReserveStompRxSpace)
+    sc->rxframe += msg_size;
+    sc->rxframe_msglen -= msg_size;
+    sc->rxframe_scanned = 0;
+
+    // If no other messages are in the buffer, then start the next one at the beginning of the buffer
+    if (sc->rxframe_msglen == 0)
     {
-        // Move the next message in the buffer down to the start of the buffer
-        memmove(&sc->rxframe[0], &sc->rxframe[msg_size], new_size);
-        sc->rxframe_msglen = new_size;
+        // Free the buffer if it has grown large (because of a large message), rather than holding onto the memory until disconnect
+        #define STOMP_RX_BUF_MAX_RETAINED_SIZE  (64*1024)
+        if (sc->rxframe_maxlen > STOMP_RX_BUF_MAX_RETAINED_SIZE)
+        {
+            USP_FREE(sc->rxframe_buf);
+            sc->rxframe_buf = NULL;
+            sc->rxframe_maxlen = 0;
+        }
+        sc->rxframe = sc->rxframe_buf;
     }
 }
 
@@ -3074,18 +4035,84 @@ void HandleStompSocketError(stomp_connection_t *sc, stomp_failure_t failure_code
     sc->retry_count++;
 
     // Calculate time until next retry
-    wait_time = CalculateStompRetryWaitTime(sc->retry_count, sc->retry.initial_interval, sc->retry.interval_multiplier);
+    if (sc->retry.algorithm == kRetryAlgorithm_DecorrelatedJitter)
+    {
+        wait_time = RETRY_WAIT_CalculateDecorrelated(sc->last_retry_wait, sc->retry.initial_interval, sc->retry.max_interval, &mtp_thread_random_seed);
+    }
+    else
+    {
+        wait_time = CalculateStompRetryWaitTime(sc->retry_count, sc->retry.initial_interval, sc->retry.interval_multiplier);
+    }
 
     // Limit the retry time to the maximum
     if (wait_time > sc->retry.max_interval)
     {
         wait_time = sc->retry.max_interval;
     }
+    sc->last_retry_wait = wait_time;
+
+    // Wait for at least as long as the server requested, if it sent a retry hint
+    // NOTE: The server's hint is allowed to exceed the max interval, as the server knows best when it is able to accept connections
+    if (sc->server_retry_hint != 0)
+    {
+        wait_time = RETRY_WAIT_ApplyServerHint(wait_time, sc->server_retry_hint, &mtp_thread_random_seed);
+        sc->server_retry_hint = 0;
+    }
 
     USP_LOG_Info("Retrying STOMP connection to (host %s, port %d) in %d seconds (retry_count=%d).", sc->host, sc->port, wait_time, sc->retry_count);
     sc->retry_time = time(NULL) + wait_time;
 }
 
+/*********************************************************************//**
+**
+** ParseStompRetryHint
+**
+** If the received frame is an ERROR frame, extracts the number of seconds that the server would like us to wait before reconnecting
+** NOTE: The retry hint is not part of the STOMP standard, so is only expected from brokers which have been configured to send it
+**
+** \param   sc - pointer to STOMP connection
+** \param   msg_size - size of message (including any terminator)
+**
+** \return  None
+**
+**************************************************************************/
+void ParseStompRetryHint(stomp_connection_t *sc, int msg_size)
+{
+    char buf[32];
+    unsigned hint;
+    bool is_present;
+    int err;
+
+    // Exit if this is not an ERROR frame
+    if (IsFrame("ERROR", sc->rxframe, msg_size) == false)
+    {
+        return;
+    }
+
+    // Exit if the ERROR frame does not contain a retry hint
+    is_present = GetStompHeaderValue(STOMP_RETRY_AFTER_HEADER, sc->rxframe, msg_size, buf, sizeof(buf));
+    if (is_present == false)
+    {
+        return;
+    }
+
+    // Exit if the retry hint is not a valid number of seconds
+    err = TEXT_UTILS_StringToUnsigned(buf, &hint);
+    if (err != USP_ERR_OK)
+    {
+        USP_LOG_Warning("%s: Ignoring invalid STOMP %s header ('%s') from (host %s, port %d)", __FUNCTION__, STOMP_RETRY_AFTER_HEADER, buf, sc->host, sc->port);
+        return;
+    }
+
+    // Limit the retry hint, so that a misbehaving server cannot prevent the agent from reconnecting for an excessive time
+    if (hint > MAX_STOMP_SERVER_RETRY_HINT)
+    {
+        hint = MAX_STOMP_SERVER_RETRY_HINT;
+    }
+
+    sc->server_retry_hint = hint;
+}
+
 /*********************************************************************//**
 **
 **  CalculateStompRetryWaitTime
@@ -3198,7 +4225,7 @@ int StartSendingFrame_STOMP(stomp_connection_t *sc)
     sc->txframe = buf;
     sc->txframe_len = len;
     sc->txframe_sent_count = 0;
-    sc->txframe_contains_usp_record = false;
+    sc->txframe_num_usp_records = 0;
 
     return USP_ERR_OK;
 }
@@ -3262,7 +4289,7 @@ int StartSendingFrame_SUBSCRIBE(stomp_connection_t *sc)
     sc->txframe = buf;
     sc->txframe_len = len;
     sc->txframe_sent_count = 0;
-    sc->txframe_contains_usp_record = false;
+    sc->txframe_num_usp_records = 0;
 
     return USP_ERR_OK;
 }
@@ -3271,29 +4298,139 @@ int StartSendingFrame_SUBSCRIBE(stomp_connection_t *sc)
 **
 ** StartSendingFrame_SEND
 **
-** Creates the SEND message frame, and sets up state to transmit it
+** Creates the SEND message frame for the USP record at the head of the send queue, and sets up state to transmit it
+** Large USP records are sent directly from the send queue (without being copied into the frame).
+** Small USP records are copied into the frame, and the small USP records following them in the send queue are
+** coalesced into the same buffer (as separate SEND frames), so that a burst of notifications is sent with
+** a single write (and hence in a single TLS record for encrypted connections), rather than one write per frame
 **
 ** \param   sc - pointer to STOMP connection
-** \param   controller_queue - name of STOMP queue to send this message to
-** \param   agent_queue - name of agent's STOMP queue configured for this connection in the data model
-** \param   usp_msg_type - Type of USP message contained in pbuf. This is used for debug logging when the message is sent by the MTP.
-** \param   pbuf - pointer to buffer containing message in binary format
-** \param   pbuf_len - length of protobuf message buffer
-** \param   content_type - type of content in the pbuf buffer
-** \param   err_id_header - pointer to buffer containing the value of the 'usp-err-id' STOMP header to put in the message
+** \param   queued_msg - pointer to USP record at the head of the send queue
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int StartSendingFrame_SEND(stomp_connection_t *sc, char *controller_queue, char *agent_queue, Usp__Header__MsgType usp_msg_type, unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header)
+int StartSendingFrame_SEND(stomp_connection_t *sc, stomp_send_item_t *queued_msg)
+{
+    int err;
+    unsigned char *buf;
+    int len;
+    unsigned char *headers;
+    int headers_len;
+    int num_usp_records;
+    stomp_send_item_t *next_msg;
+
+    // Exit if unable to form the STOMP headers for the USP record at the head of the queue
+    sc->txframe_start_time = tu_uptime_usecs();
+    DeflateStompSendItem(sc, queued_msg);
+    err = FormStompSendHeaders(sc, queued_msg, &buf, &len);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+    LogStompSendFrame(sc, queued_msg, buf, len);
+
+    // If the USP record is large, then send its body directly from the send queue
+    // NOTE: The NULL terminator for the STOMP frame is sent after the body, so is not included in txframe_len
+    #define STOMP_COALESCE_MAX_BODY_LEN  4096      // Maximum size of a USP record which may be coalesced with others into a single write
+    #define STOMP_COALESCE_MAX_LEN       16384     // Maximum size of a buffer of coalesced SEND frames (the maximum TLS record payload)
+    USP_ASSERT(sc->txframe == NULL);
+    if (STOMP_SEND_BODY_LEN(queued_msg) > STOMP_COALESCE_MAX_BODY_LEN)
+    {
+        sc->txframe = buf;
+        sc->txframe_len = len;
+        sc->txframe_sent_count = 0;
+        sc->txframe_body = STOMP_SEND_BODY(queued_msg);
+        sc->txframe_body_len = STOMP_SEND_BODY_LEN(queued_msg);
+        sc->txframe_num_usp_records = 1;
+        return USP_ERR_OK;
+    }
+
+    // Otherwise copy the body and NULL terminator into the frame buffer
+    buf = USP_REALLOC(buf, len + STOMP_SEND_BODY_LEN(queued_msg) + 1);
+    memcpy(&buf[len], STOMP_SEND_BODY(queued_msg), STOMP_SEND_BODY_LEN(queued_msg));
+    len += STOMP_SEND_BODY_LEN(queued_msg);
+    buf[len++] = '\0';
+    num_usp_records = 1;
+
+    // Append the SEND frames for the following small USP records in the send queue, whilst they fit in the buffer
+    next_msg = (stomp_send_item_t *) queued_msg->link.next;
+    while (next_msg != NULL)
+    {
+        // Exit loop if this USP record is too large to coalesce
+        DeflateStompSendItem(sc, next_msg);
+        if (STOMP_SEND_BODY_LEN(next_msg) > STOMP_COALESCE_MAX_BODY_LEN)
+        {
+            break;
+        }
+
+        // Exit loop if unable to form the STOMP headers. The error will be handled when this USP record reaches the head of the queue
+        err = FormStompSendHeaders(sc, next_msg, &headers, &headers_len);
+        if (err != USP_ERR_OK)
+        {
+            break;
+        }
+
+        // Exit loop if this frame would make the buffer too large
+        if (len + headers_len + STOMP_SEND_BODY_LEN(next_msg) + 1 > STOMP_COALESCE_MAX_LEN)
+        {
+            USP_FREE(headers);
+            break;
+        }
+        LogStompSendFrame(sc, next_msg, headers, headers_len);
+
+        buf = USP_REALLOC(buf, len + headers_len + STOMP_SEND_BODY_LEN(next_msg) + 1);
+        memcpy(&buf[len], headers, headers_len);
+        len += headers_len;
+        memcpy(&buf[len], STOMP_SEND_BODY(next_msg), STOMP_SEND_BODY_LEN(next_msg));
+        len += STOMP_SEND_BODY_LEN(next_msg);
+        buf[len++] = '\0';
+        USP_FREE(headers);
+
+        num_usp_records++;
+        next_msg = (stomp_send_item_t *) next_msg->link.next;
+    }
+
+    // Save the frame(s) to transmit
+    sc->txframe = buf;
+    sc->txframe_len = len;
+    sc->txframe_sent_count = 0;
+    sc->txframe_body = NULL;
+    sc->txframe_body_len = 0;
+    sc->txframe_num_usp_records = num_usp_records;
+
+    // NOTE: Errors are not returned for the coalesced USP records. They are only detected when the head USP record is sent
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** FormStompSendHeaders
+**
+** Forms the STOMP headers (including the blank line separating them from the body) of the SEND frame for the specified USP record
+** NOTE: The body of the frame is not copied into the buffer. The caller is responsible for sending it
+**
+** \param   sc - pointer to STOMP connection
+** \param   queued_msg - pointer to USP record in the send queue
+** \param   p_buf - pointer to variable in which to return a dynamically allocated buffer containing the STOMP headers
+** \param   p_len - pointer to variable in which to return the number of bytes of STOMP headers in the buffer
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INTERNAL_ERROR if unable to get agent or controller queue name
+**
+**************************************************************************/
+int FormStompSendHeaders(stomp_connection_t *sc, stomp_send_item_t *queued_msg, unsigned char **p_buf, int *p_len)
 {
     unsigned char *buf;
-    int len;                    // Total number of bytes in the entire STOMP frame including NULL terminator
+    int len;                    // Total number of bytes in the STOMP headers, including the NULL terminator used whilst forming them
     int body_offset;            // Offset from the start of the STOMP message (in bytes) to the message's body (which will contain the google protocol buf encoded USP message)
     char content_length[16];    // Temporary string containing the content length digits
     char *content_type_str;
+    char *controller_queue;
+    char *agent_queue;
+    char *content_encoding_str;
 
     // Exit if unable to get the name of the controller's queue on this connection
+    controller_queue = queued_msg->controller_queue;
     if ((controller_queue == NULL) || (*controller_queue == '\0'))
     {
         USP_LOG_Error("%s: Unable to get controller queue name for Device.STOMP.Connection.%d. Retrying", __FUNCTION__, sc->instance);
@@ -3301,6 +4438,7 @@ int StartSendingFrame_SEND(stomp_connection_t *sc, char *controller_queue, char
     }
 
     // Determine the name of this agent's STOMP queue
+    agent_queue = queued_msg->agent_queue;
     if (sc->subscribe_dest != NULL)
     {
         // Override the queue configured in the data model with the queue given in the subscribe-dest STOMP header
@@ -3314,54 +4452,114 @@ int StartSendingFrame_SEND(stomp_connection_t *sc, char *controller_queue, char
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    content_type_str = (content_type==kMtpContentType_UspRecord) ? BBF_STOMP_CONTENT_TYPE : BBF_STOMP_ERROR_CONTENT_TYPE;
+    content_type_str = (queued_msg->content_type==kMtpContentType_UspRecord) ? BBF_STOMP_CONTENT_TYPE : BBF_STOMP_ERROR_CONTENT_TYPE;
+
+    content_encoding_str = (queued_msg->deflated != NULL) ? "content-encoding:deflate\n" : "";
 
-    // Determine the size of the USP message
-    USP_SNPRINTF(content_length, sizeof(content_length), "%d", pbuf_len);
+    // Determine the size of the USP message (as sent)
+    USP_SNPRINTF(content_length, sizeof(content_length), "%d", STOMP_SEND_BODY_LEN(queued_msg));
 
+    // NOTE: Every SEND frame indicates that the agent accepts compressed USP records, so that the controller may compress the USP records that it sends
     #define SEND_FRAME_FORMAT   "SEND\n" \
                                 "content-length:%s\n" \
                                 "content-type:%s\n"   \
+                                "%s"                  \
+                                "usp-accept-encoding:deflate\n" \
                                 "usp-err-id:%s\n"     \
                                 "reply-to-dest:%s\n"  \
                                 "destination:%s"
 
-    // Allocate buffer to store the frame in
+    // Allocate buffer to store the frame headers in
     #define STOMP_BODY_SEPARATOR "\n\n"
-    USP_ASSERT(err_id_header != NULL);
+    USP_ASSERT(queued_msg->err_id_header != NULL);
     len = sizeof(SEND_FRAME_FORMAT) + 
           strlen(content_length) + 
           strlen(content_type_str) + 
-          strlen(err_id_header) +
+          strlen(content_encoding_str) +
+          strlen(queued_msg->err_id_header) +
           strlen(agent_queue) + 
-          strlen(controller_queue) - 10 + // Minus 10 to remove all "%s" from the frame
-          sizeof(STOMP_BODY_SEPARATOR)-1 + // Minus 1 to not include NULL terminator in STOMP_BODY_SEPARATOR
-          pbuf_len;
+          strlen(controller_queue) - 12 + // Minus 12 to remove all "%s" from the frame
+          sizeof(STOMP_BODY_SEPARATOR)-1; // Minus 1 to not include NULL terminator in STOMP_BODY_SEPARATOR
     buf = USP_MALLOC(len);
 
     // Form the STOMP headers
-    body_offset = USP_SNPRINTF((char *)buf, len, SEND_FRAME_FORMAT, content_length, content_type_str, err_id_header, agent_queue, controller_queue);
-
-    MSG_HANDLER_LogMessageToSend(usp_msg_type, pbuf, pbuf_len, kMtpProtocol_STOMP, sc->host, buf, content_type);
+    body_offset = USP_SNPRINTF((char *)buf, len, SEND_FRAME_FORMAT, content_length, content_type_str, content_encoding_str, queued_msg->err_id_header, agent_queue, controller_queue);
 
-    // Form the STOMP body
+    // Add the blank line separating the STOMP headers from the body
     memcpy(&buf[body_offset], STOMP_BODY_SEPARATOR, sizeof(STOMP_BODY_SEPARATOR)-1);
     body_offset += 2;
-    memcpy(&buf[body_offset], pbuf, pbuf_len);
+    USP_ASSERT(body_offset == len - 1);
 
-    // Terminate the STOMP message
-    buf[len-1] = '\0';
-
-    // Save the frame to transmit
-    USP_ASSERT(sc->txframe == NULL);
-    sc->txframe = buf;
-    sc->txframe_len = len;
-    sc->txframe_sent_count = 0;
-    sc->txframe_contains_usp_record = true;
+    *p_buf = buf;
+    *p_len = body_offset;
 
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** LogStompSendFrame
+**
+** Logs the USP record contained in a SEND frame, as it is being sent
+**
+** \param   sc - pointer to STOMP connection
+** \param   queued_msg - pointer to USP record in the send queue
+** \param   headers - pointer to buffer containing the STOMP headers of the SEND frame (as formed by FormStompSendHeaders)
+** \param   headers_len - number of bytes of STOMP headers in the buffer (including the blank line terminating them)
+**
+** \return  None
+**
+**************************************************************************/
+void LogStompSendFrame(stomp_connection_t *sc, stomp_send_item_t *queued_msg, unsigned char *headers, int headers_len)
+{
+    // Temporarily terminate the STOMP headers before the blank line, so that they can be logged as a string
+    headers[headers_len-2] = '\0';
+    MSG_HANDLER_LogMessageToSend(queued_msg->usp_msg_type, queued_msg->pbuf, queued_msg->pbuf_len, kMtpProtocol_STOMP, sc->host, headers, queued_msg->content_type);
+    headers[headers_len-2] = '\n';
+}
+
+/*********************************************************************//**
+**
+** DeflateStompSendItem
+**
+** Compresses the specified USP record (if it is large enough), if the controller accepts compressed USP records
+** The compressed USP record is kept alongside the uncompressed USP record (which is still used for logging and duplicate detection)
+** NOTE: If the USP record does not compress, then it is sent uncompressed
+**
+** \param   sc - pointer to STOMP connection
+** \param   queued_msg - pointer to USP record in the send queue
+**
+** \return  None
+**
+**************************************************************************/
+void DeflateStompSendItem(stomp_connection_t *sc, stomp_send_item_t *queued_msg)
+{
+    int err;
+
+    // Exit if the USP record has already been compressed, or should not be compressed
+    if ((queued_msg->deflated != NULL) || (USP_COMPRESSION_THRESHOLD == 0) || (queued_msg->pbuf_len < USP_COMPRESSION_THRESHOLD) ||
+        (queued_msg->content_type != kMtpContentType_UspRecord) || (queued_msg->controller_queue == NULL))
+    {
+        return;
+    }
+
+    // Exit if the controller has not indicated that it accepts compressed USP records
+    if (STR_VECTOR_Find(&sc->deflate_dests, queued_msg->controller_queue) == INVALID)
+    {
+        return;
+    }
+
+    // Exit if the USP record did not compress
+    err = USP_COMPRESS_Deflate(queued_msg->pbuf, queued_msg->pbuf_len, false, &queued_msg->deflated, &queued_msg->deflated_len);
+    if (err != USP_ERR_OK)
+    {
+        queued_msg->deflated = NULL;
+        return;
+    }
+
+    USP_LOG_Debug("%s: Compressed %s (%d bytes) to %d bytes", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(queued_msg->usp_msg_type), queued_msg->pbuf_len, queued_msg->deflated_len);
+}
+
 /*********************************************************************//**
 **
 ** StartSendingFrame_UNSUBSCRIBE
@@ -3399,7 +4597,7 @@ int StartSendingFrame_UNSUBSCRIBE(stomp_connection_t *sc)
     sc->txframe = buf;
     sc->txframe_len = len;
     sc->txframe_sent_count = 0;
-    sc->txframe_contains_usp_record = false;
+    sc->txframe_num_usp_records = 0;
 
     return USP_ERR_OK;
 }
@@ -3588,42 +4786,58 @@ void UpdateNextHeartbeatTime(stomp_connection_t *sc)
 **
 ** UpdateMgmtInterface
 **
-** Called to determine whether the IP address used for any of the STOMP connections has changed
-** NOTE: This function only checks the IP address periodically
+** Called to determine whether the IP address used for any of the STOMP connections (serviced by the specified MTP thread) has changed
+** NOTE: This function only checks the IP address after a netlink notification that an IP address has changed,
+**       or periodically if netlink notifications are not available
 **
-** \param   None
+** \param   stomp_thread - index of the STOMP MTP thread whose connections should be checked
 **
 ** \return  Number of seconds remaining until next time to poll the WAN interface for IP address change
 **
 **************************************************************************/
-int UpdateMgmtInterface(void)
+int UpdateMgmtInterface(int stomp_thread)
 {
     time_t cur_time;
     int timeout;
-    static bool is_first_time = true; // The first time this function is called, it just sets up the IP address and next_mgmt_if_poll_time
+    stomp_thread_t *st;
 
     // Exit if it's not yet time to poll the IP address
+    // NOTE: The first time this function is called, it just sets up the IP address and next_mgmt_if_poll_time
+    st = &stomp_threads[stomp_thread];
     cur_time = time(NULL);
-    if (is_first_time == false)
+    if (st->mgmt_if_first_time == false)
     {
-        timeout = next_mgmt_if_poll_time - cur_time;
-        if (timeout > 0)
+        if (st->addr_change_sock != INVALID)
         {
-            goto exit;
+            // Exit if not notified of any IP address change
+            timeout = MAX_SOCKET_TIMEOUT_SECONDS;
+            if (st->is_addr_changed == false)
+            {
+                goto exit;
+            }
+        }
+        else
+        {
+            timeout = st->next_mgmt_if_poll_time - cur_time;
+            if (timeout > 0)
+            {
+                goto exit;
+            }
         }
     }
 
 #ifdef CONNECT_ONLY_OVER_WAN_INTERFACE
-    UpdateWANInterface(is_first_time);
+    UpdateWANInterface(stomp_thread, st->mgmt_if_first_time);
 #else
-    HandleStompSourceIPAddrChanges();
+    HandleStompSourceIPAddrChanges(stomp_thread);
 #endif
 
-    // Set next time to poll for IP address change
+    // Set next time to poll for IP address change (if not notified of IP address changes)
     #define MGMT_IP_ADDR_POLL_PERIOD 5
-    timeout = MGMT_IP_ADDR_POLL_PERIOD;
-    next_mgmt_if_poll_time = cur_time + timeout;
-    is_first_time = false;
+    timeout = (st->addr_change_sock != INVALID) ? MAX_SOCKET_TIMEOUT_SECONDS : MGMT_IP_ADDR_POLL_PERIOD;
+    st->next_mgmt_if_poll_time = cur_time + timeout;
+    st->mgmt_if_first_time = false;
+    st->is_addr_changed = false;
 
 exit:
     return timeout;
@@ -3636,18 +4850,24 @@ exit:
 ** UpdateWANInterface
 **
 ** Called to determine whether the IP address of the WAN interface has changed
+** This restarts the STOMP connections serviced by the specified MTP thread, if the IP address has changed
 **
+** \param   stomp_thread - index of the STOMP MTP thread whose connections should be restarted
 ** \param   is_first_time - Set if it is the first time this function is called.
 **                          The first time the function is called, it just updates the state of the system, it doesn't log that the IP address has changed
 **
 ** \return  None
 **
 **************************************************************************/
-void UpdateWANInterface(bool is_first_time)
+void UpdateWANInterface(int stomp_thread, bool is_first_time)
 {
     int i;
     stomp_connection_t *sc;
     char cur_mgmt_ip_addr[NU_IPADDRSTRLEN];
+    char *last_mgmt_ip_addr;
+    #define last_mgmt_ip_addr_len  (sizeof(stomp_threads[0].last_mgmt_ip_addr))
+
+    last_mgmt_ip_addr = stomp_threads[stomp_thread].last_mgmt_ip_addr;
 
     // Get the current IP address    
     tw_ulib_dev_get_live_wan_address(cur_mgmt_ip_addr, sizeof(cur_mgmt_ip_addr));
@@ -3655,7 +4875,7 @@ void UpdateWANInterface(bool is_first_time)
     // If this is the first time, then just update the state of the system with the IP address found, then exit
     if (is_first_time)
     {
-        USP_STRNCPY(last_mgmt_ip_addr, cur_mgmt_ip_addr, sizeof(last_mgmt_ip_addr));
+        USP_STRNCPY(last_mgmt_ip_addr, cur_mgmt_ip_addr, last_mgmt_ip_addr_len);
         return;
     }
 
@@ -3666,12 +4886,12 @@ void UpdateWANInterface(bool is_first_time)
     }
     
     // Store off the new IP address, this is needed for StartStompConnection()
-    USP_STRNCPY(last_mgmt_ip_addr, cur_mgmt_ip_addr, sizeof(last_mgmt_ip_addr));
+    USP_STRNCPY(last_mgmt_ip_addr, cur_mgmt_ip_addr, last_mgmt_ip_addr_len);
 
 
-    // Iterate over all STOMP connections, stopping and restarting the ones that are enabled  
+    // Iterate over all STOMP connections serviced by this thread, stopping and restarting the ones that are enabled
     USP_LOG_Warning("Mgmt IP Address changed to %s. Restarting all STOMP connections.", cur_mgmt_ip_addr);
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if (sc->instance != INVALID)
@@ -3688,14 +4908,14 @@ void UpdateWANInterface(bool is_first_time)
 **
 ** HandleStompSourceIPAddrChanges
 **
-** Restarts all STOMP connections whose IP address has changed
+** Restarts all STOMP connections (serviced by the specified MTP thread) whose IP address has changed
 **
-** \param   None
+** \param   stomp_thread - index of the STOMP MTP thread whose connections should be checked
 **
 ** \return  None
 **
 **************************************************************************/
-void HandleStompSourceIPAddrChanges(void)
+void HandleStompSourceIPAddrChanges(int stomp_thread)
 {
     int i;
     stomp_connection_t *sc;
@@ -3705,7 +4925,7 @@ void HandleStompSourceIPAddrChanges(void)
     // Iterate over all STOMP connections, restarting any whose IP address has changed
     // NOTE: If the STOMP connection failed, then it will be retried by the retry mechanism.
     //       This code does NOT detect interfaces going up and then retrying the connection
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    for (i=stomp_thread; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
     {
         sc = &stomp_connections[i];
         if ((sc->instance != INVALID) && (sc->mgmt_if_name[0] != '\0') && (sc->mgmt_ip_addr[0] != '\0'))
@@ -3759,6 +4979,7 @@ void CopyStompConnParamsToNext(stomp_connection_t *sc, stomp_conn_params_t *sp,
     np->retry.initial_interval = sp->retry.initial_interval;
     np->retry.interval_multiplier = sp->retry.interval_multiplier;
     np->retry.max_interval = sp->retry.max_interval;
+    memcpy(&np->tcp, &sp->tcp, sizeof(np->tcp));
 }
 
 /*********************************************************************//**
@@ -3794,6 +5015,7 @@ void CopyStompConnParamsFromNext(stomp_connection_t *sc)
     sc->retry.initial_interval = np->retry.initial_interval;
     sc->retry.interval_multiplier = np->retry.interval_multiplier;
     sc->retry.max_interval = np->retry.max_interval;
+    memcpy(&sc->tcp, &np->tcp, sizeof(sc->tcp));
 
 }
 
@@ -3837,28 +5059,48 @@ char *AllocateStringIfChanged(char *cur_str, char *new_str)
 **
 ** FindStompConnByInst
 **
-** Finds a STOMP connection by it's data model instance number
+** Finds a STOMP connection by it's data model instance number, and locks the mutex of the MTP thread servicing it
+** The caller must call UnlockStompConn() once it has finished accessing the STOMP connection
 ** NOTE: It isssible for this function to return NULL under normal circumstances if the connection is disabled
 **
 ** \param   instance - instance number of the STOMP connection in the data model
+** \param   is_exited - pointer to variable in which to return whether any STOMP MTP thread has exited
+**                      This is only relevant if the STOMP connection was not found (as it may have been freed by the exited thread)
 **
-** \return  pointer to slot, or NULL if slot was not found
+** \return  pointer to slot (locked), or NULL if slot was not found (in which case no mutex is left locked)
 **
 **************************************************************************/
-stomp_connection_t *FindStompConnByInst(int instance)
+stomp_connection_t *FindStompConnByInst(int instance, bool *is_exited)
 {
     int i;
+    int t;
     stomp_connection_t *sc;
 
-    // Iterate over all STOMP connections
-    for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
+    // Iterate over all STOMP MTP threads
+    *is_exited = false;
+    for (t=0; t<NUM_STOMP_MTP_THREADS; t++)
     {
-        // Exit if found a stomp connection that matches the instance number
-        sc = &stomp_connections[i];
-        if (sc->instance == instance)
+        OS_UTILS_LockMutex(&stomp_threads[t].access_mutex);
+
+        if (stomp_threads[t].is_exited)
         {
-            return sc;
+            *is_exited = true;
+        }
+        else
+        {
+            // Iterate over all STOMP connections serviced by this thread
+            for (i=t; i<MAX_STOMP_CONNECTIONS; i+=NUM_STOMP_MTP_THREADS)
+            {
+                // Exit if found a stomp connection that matches the instance number (leaving the mutex locked)
+                sc = &stomp_connections[i];
+                if (sc->instance == instance)
+                {
+                    return sc;
+                }
+            }
         }
+
+        OS_UTILS_UnlockMutex(&stomp_threads[t].access_mutex);
     }
 
     // If the code gets here, then no matching slot was found
@@ -3869,27 +5111,33 @@ stomp_connection_t *FindStompConnByInst(int instance)
 **
 ** FindUnusedStompConn
 **
-** Finds the first free stomp connection slot
+** Finds the first free stomp connection slot, and locks the mutex of the MTP thread servicing it
+** The caller must call UnlockStompConn() once it has finished accessing the STOMP connection
+** NOTE: Consecutive slots are serviced by different MTP threads, so connections are spread evenly across the threads
 **
 ** \param   None
 **
-** \return  Pointer to first free slot, or NULL if no slot was found
+** \return  Pointer to first free slot (locked), or NULL if no slot was found
 **
 **************************************************************************/
 stomp_connection_t *FindUnusedStompConn(void)
 {
     int i;
+    int t;
     stomp_connection_t *sc;
 
     // Iterate over all STOMP connections
     for (i=0; i<MAX_STOMP_CONNECTIONS; i++)
     {
-        // Exit if found an unused slot
+        // Exit if found an unused slot, serviced by a thread which has not exited (leaving the mutex locked)
         sc = &stomp_connections[i];
-        if (sc->instance == INVALID)
+        t = STOMP_CONN_THREAD(sc);
+        OS_UTILS_LockMutex(&stomp_threads[t].access_mutex);
+        if ((sc->instance == INVALID) && (stomp_threads[t].is_exited == false))
         {
             return sc;
         }
+        OS_UTILS_UnlockMutex(&stomp_threads[t].access_mutex);
     }
 
     // If the code gets here, then no free slot has been found
@@ -3897,6 +5145,23 @@ stomp_connection_t *FindUnusedStompConn(void)
     return NULL;
 }
 
+/*********************************************************************//**
+**
+** UnlockStompConn
+**
+** Unlocks the mutex of the MTP thread servicing the specified STOMP connection
+** (locked by FindStompConnByInst() or FindUnusedStompConn())
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None
+**
+**************************************************************************/
+void UnlockStompConn(stomp_connection_t *sc)
+{
+    OS_UTILS_UnlockMutex(&stomp_threads[STOMP_CONN_THREAD(sc)].access_mutex);
+}
+
 /*********************************************************************//**
 **
 ** RemoveExpiredStompMessages
@@ -3911,23 +5176,31 @@ stomp_connection_t *FindUnusedStompConn(void)
 **************************************************************************/
 void RemoveExpiredStompMessages(stomp_connection_t *sc)
 {
+    int i;
     time_t cur_time;
+    double_linked_list_t *list;
     stomp_send_item_t *queued_msg;
     stomp_send_item_t *next_msg;
 
     USP_ASSERT(sc->txframe == NULL);    // This function must not remove the current frame being transmitted whilst is is being transmitted
 
+    // Iterate over all queues of USP records
+    // NOTE: Index INVALID denotes usp_record_send_queue, the other indexes denote the pending queue of that send priority
     cur_time = time(NULL);
-    queued_msg = (stomp_send_item_t *) sc->usp_record_send_queue.head;
-    while (queued_msg != NULL)
+    for (i=INVALID; i<kMtpSendPriority_Max; i++)
     {
-        next_msg = (stomp_send_item_t *) queued_msg->link.next;
-        if (cur_time > queued_msg->expiry_time)
+        list = (i == INVALID) ? &sc->usp_record_send_queue : &sc->usp_record_pending_queue.queues[i];
+        queued_msg = (stomp_send_item_t *) list->head;
+        while (queued_msg != NULL)
         {
-            RemoveStompQueueItem(sc, queued_msg);
-        }
+            next_msg = (stomp_send_item_t *) queued_msg->link.next;
+            if (cur_time > queued_msg->expiry_time)
+            {
+                RemoveStompQueueItem(sc, queued_msg);
+            }
 
-        queued_msg = next_msg;
+            queued_msg = next_msg;
+        }
     }
 }
 
@@ -3951,13 +5224,80 @@ void RemoveStompQueueItem(stomp_connection_t *sc, stomp_send_item_t *queued_msg)
     USP_FREE(queued_msg->controller_queue);
     USP_FREE(queued_msg->agent_queue);
     USP_FREE(queued_msg->pbuf);
+    USP_SAFE_FREE(queued_msg->deflated);
     USP_FREE(queued_msg->err_id_header);
 
     // Remove the specified item from the queue, and free the item itself
-    DLLIST_Unlink(&sc->usp_record_send_queue, queued_msg);
+    sc->usp_record_send_queue_bytes -= queued_msg->pbuf_len;
+    MTP_SEND_QUEUE_ReleaseBudget(queued_msg->pbuf_len);
+    if (queued_msg->is_pending)
+    {
+        MTP_SEND_QUEUE_Remove(&sc->usp_record_pending_queue, queued_msg->priority, queued_msg);
+    }
+    else
+    {
+        DLLIST_Unlink(&sc->usp_record_send_queue, queued_msg);
+    }
     USP_FREE(queued_msg);
 }
 
+/*********************************************************************//**
+**
+** ScheduleStompMessages
+**
+** Refills the (empty) send queue with USP records from the pending queues, selecting them in send priority order
+** using the weighted round robin. USP records are moved until the total moved would fill a buffer of coalesced SEND frames,
+** so that small notifications may still be coalesced into a single write, whilst a higher priority USP record
+** which is queued later only has to wait for the USP records already in the send queue to be sent
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  None
+**
+**************************************************************************/
+void ScheduleStompMessages(stomp_connection_t *sc)
+{
+    int len;
+    stomp_send_item_t *queued_msg;
+
+    // Exit if the send queue still contains USP records to send
+    if (sc->usp_record_send_queue.head != NULL)
+    {
+        return;
+    }
+
+    len = 0;
+    while (len < STOMP_COALESCE_MAX_LEN)
+    {
+        // Exit loop if there are no more pending USP records
+        queued_msg = (stomp_send_item_t *) MTP_SEND_QUEUE_Pop(&sc->usp_record_pending_queue);
+        if (queued_msg == NULL)
+        {
+            break;
+        }
+
+        queued_msg->is_pending = false;
+        DLLIST_LinkToTail(&sc->usp_record_send_queue, queued_msg);
+        len += queued_msg->pbuf_len;
+    }
+}
+
+/*********************************************************************//**
+**
+** IsStompSendQueueEmpty
+**
+** Determines whether there are no USP records queued to send on the specified STOMP connection
+**
+** \param   sc - pointer to STOMP connection
+**
+** \return  true if there are no USP records in either the send queue or the pending queues
+**
+**************************************************************************/
+bool IsStompSendQueueEmpty(stomp_connection_t *sc)
+{
+    return ((sc->usp_record_send_queue.head == NULL) && (MTP_SEND_QUEUE_IsEmpty(&sc->usp_record_pending_queue)));
+}
+
 /*********************************************************************//**
 **
 ** IsUspRecordInStompQueue
@@ -3974,20 +5314,27 @@ void RemoveStompQueueItem(stomp_connection_t *sc, stomp_send_item_t *queued_msg)
 **************************************************************************/
 bool IsUspRecordInStompQueue(stomp_connection_t *sc, unsigned char *pbuf, int pbuf_len)
 {
+    int i;
+    double_linked_list_t *list;
     stomp_send_item_t *queued_msg;
 
-    // Iterate over USP Records in the STOMP queue
-    queued_msg = (stomp_send_item_t *) sc->usp_record_send_queue.head;
-    while (queued_msg != NULL)
+    // Iterate over USP Records in all of the STOMP queues
+    // NOTE: Index INVALID denotes usp_record_send_queue, the other indexes denote the pending queue of that send priority
+    for (i=INVALID; i<kMtpSendPriority_Max; i++)
     {
-        // Exit if the USP record is already in the queue
-        if ((queued_msg->pbuf_len == pbuf_len) && (memcmp(queued_msg->pbuf, pbuf, pbuf_len)==0))
+        list = (i == INVALID) ? &sc->usp_record_send_queue : &sc->usp_record_pending_queue.queues[i];
+        queued_msg = (stomp_send_item_t *) list->head;
+        while (queued_msg != NULL)
         {
-             return true;
-        }
+            // Exit if the USP record is already in the queue
+            if ((queued_msg->pbuf_len == pbuf_len) && (memcmp(queued_msg->pbuf, pbuf, pbuf_len)==0))
+            {
+                 return true;
+            }
 
-        // Move to next message in the queue
-        queued_msg = (stomp_send_item_t *) queued_msg->link.next;
+            // Move to next message in the queue
+            queued_msg = (stomp_send_item_t *) queued_msg->link.next;
+        }
     }
  
     // If the code gets here, then the USP record is not in the queue
@@ -47,6 +47,7 @@
 #include "dllist.h"
 #include "socket_set.h"
 #include "mtp_exec.h"
+#include "retry_wait.h"
 #include "usp-msg.pb-c.h"
 
 //------------------------------------------------------------------------------
@@ -56,8 +57,24 @@ typedef struct
     unsigned initial_interval;
     unsigned interval_multiplier;
     unsigned max_interval;
+    retry_algorithm_t algorithm;
 } stomp_retry_params_t;
 
+//------------------------------------------------------------------------------
+// TCP socket options applied to each stomp connection (Device.STOMP.Connection.{i}.X_ARRIS-COM_TCP*)
+// NOTE: A value of 0 for user_timeout or the buffer sizes denotes that the kernel default is used
+typedef struct
+{
+    bool no_delay;                  // Whether Nagle's algorithm is disabled (TCP_NODELAY)
+    unsigned user_timeout;          // in ms. Maximum time that transmitted data may remain unacknowledged before the connection is dropped (TCP_USER_TIMEOUT)
+    bool enable_keepalive;          // Whether TCP keepalive probes are sent (SO_KEEPALIVE)
+    unsigned keepalive_idle;        // in seconds. Time that the connection must be idle before keepalive probes are sent (TCP_KEEPIDLE)
+    unsigned keepalive_interval;    // in seconds. Time between keepalive probes (TCP_KEEPINTVL)
+    unsigned keepalive_count;       // Number of unacknowledged keepalive probes before the connection is dropped (TCP_KEEPCNT)
+    unsigned send_buffer_size;      // in bytes (SO_SNDBUF)
+    unsigned receive_buffer_size;   // in bytes (SO_RCVBUF)
+} stomp_tcp_params_t;
+
 //------------------------------------------------------------------------------
 // Data model parameters for each stomp connection
 typedef struct
@@ -74,24 +91,27 @@ typedef struct
     unsigned incoming_heartbeat_period;  // in ms. NOTE: the negotiated heartbeat_period is stored in seconds
     unsigned outgoing_heartbeat_period;  // in ms
     stomp_retry_params_t retry;      // parameters associated with retrying the connection after a failure
+    stomp_tcp_params_t tcp;          // TCP socket options to apply to the connection
 } stomp_conn_params_t;
 
 //------------------------------------------------------------------------------
 // API
 int STOMP_Init(void);
-void STOMP_Destroy(void);
+bool STOMP_Destroy(int stomp_thread);
 int STOMP_Start(void);
-void STOMP_UpdateAllSockSet(socket_set_t *set);
-bool STOMP_AreAllResponsesSent(void);
-void STOMP_ProcessAllSocketActivity(socket_set_t *set);
-int STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header, time_t expiry_time);
+void STOMP_UpdateAllSockSet(int stomp_thread, socket_set_t *set);
+bool STOMP_AreAllResponsesSent(int stomp_thread);
+void STOMP_ProcessAllSocketActivity(int stomp_thread, socket_set_t *set);
+int STOMP_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int instance, char *controller_queue, char *agent_queue, unsigned char *pbuf, int pbuf_len, mtp_content_type_t content_type, char *err_id_header, mtp_send_priority_t priority, time_t expiry_time);
 int STOMP_EnableConnection(stomp_conn_params_t *sp, char *stomp_queue);
 int STOMP_DisableConnection(int instance, bool purge_queued_messages);
 void STOMP_ScheduleReconnect(stomp_conn_params_t *sp, char *stomp_queue);
 void STOMP_ActivateScheduledActions(void);
 void STOMP_ScheduleResubscribe(int instance, char *stomp_queue);
 mtp_status_t STOMP_GetMtpStatus(int instance);
+int STOMP_GetQueuedBytes(int instance);
 char *STOMP_GetConnectionStatus(int instance, time_t *last_change_date);
+void STOMP_GetTlsHandshakeStats(int instance, unsigned *full, unsigned *resumed);
 void STOMP_UpdateRetryParams(int instance, stomp_retry_params_t *retry_params);
 void STOMP_GetDestinationFromServer(int instance, char *buf, int len);
 
@@ -48,7 +48,20 @@
 //------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int PtrToNaturalStrCmp(const void *arg1, const void *arg2);
-int NaturalStrCmp(char *s1, char *s2);
+void SyncStrSet(str_set_t *ss, void *keys, int stride, int num_entries);
+void ResizeStrSet(str_set_t *ss, void *keys, int stride, int num_indexed, int table_size);
+void InsertStrSetEntry(str_set_t *ss, char *key, int index);
+unsigned CalcStrSetSlot(str_set_t *ss, char *str);
+
+//------------------------------------------------------------------------
+// Initial number of slots in a string set's hash table. The table is doubled in size whenever it becomes half full
+#define STR_SET_INITIAL_SIZE 64
+
+// Arrays with fewer entries than this are searched linearly, rather than building a hash table for them
+#define STR_SET_MIN_ENTRIES 16
+
+// Macro returning the key of the specified element of an array indexed by a string set
+#define STR_SET_KEY(keys, stride, i)  ( *(char **)((char *)(keys) + (i)*(stride)) )
 
 
 /*********************************************************************//**
@@ -117,15 +130,61 @@ void STR_VECTOR_Clone(str_vector_t *sv, char **src_vector, int src_num_entries)
 **
 **************************************************************************/
 void STR_VECTOR_Add(str_vector_t *sv, char *str)
+{
+    STR_VECTOR_AddAllocated(sv, USP_STRDUP(str));
+}
+
+/*********************************************************************//**
+**
+** STR_VECTOR_AddAllocated
+**
+** Adds a string into the vector of strings, where the string has already been dynamically allocated by the caller
+** The vector takes ownership of the string, avoiding the copy made by STR_VECTOR_Add()
+**
+** \param   sv - pointer to structure to add the string to
+** \param   str - pointer to dynamically allocated string to attach
+**
+** \return  None
+**
+**************************************************************************/
+void STR_VECTOR_AddAllocated(str_vector_t *sv, char *str)
 {
     int new_num_entries;
 
+    // Grow the array geometrically, so that building a vector of n strings requires only O(log n) reallocations
     new_num_entries = sv->num_entries + 1;
-    sv->vector = USP_REALLOC(sv->vector, new_num_entries*sizeof(char *));
-    sv->vector[ sv->num_entries ] = USP_STRDUP(str);
+    sv->vector = USP_RESERVE(sv->vector, new_num_entries*sizeof(char *), VECTOR_GROWTH_FACTOR*new_num_entries*sizeof(char *));
+    sv->vector[ sv->num_entries ] = str;
     sv->num_entries = new_num_entries;
 }
 
+/*********************************************************************//**
+**
+** STR_VECTOR_Reserve
+**
+** Ensures that the vector has room for the specified number of additional strings, without reallocating
+** This is used before adding a known number of strings, so that the array is allocated once at its final size
+**
+** \param   sv - pointer to structure to reserve room in
+** \param   num_extra - number of strings which are about to be added to the vector
+**
+** \return  None
+**
+**************************************************************************/
+void STR_VECTOR_Reserve(str_vector_t *sv, int num_extra)
+{
+    int size;
+
+    // Exit if there is nothing to reserve
+    if (num_extra <= 0)
+    {
+        return;
+    }
+
+    size = (sv->num_entries + num_extra)*sizeof(char *);
+    sv->vector = USP_RESERVE(sv->vector, size, size);
+}
+
 /*********************************************************************//**
 **
 ** STR_VECTOR_Add_IfNotExist
@@ -335,91 +394,307 @@ void STR_VECTOR_Sort(str_vector_t *sv)
 
 /*********************************************************************//**
 **
-** PtrToNaturalStrCmp
+** STR_SET_Init
 **
-** This function is used by STR_VECTOR_Sort() to determine the order of elements in the vector being sorted
+** Initialises a string set structure
+** NOTE: No memory is allocated until the set is first used
 **
-** \param   arg1 - pointer to an entry in the vector
-** \param   arg2 - pointer to another entry in the vector
+** \param   ss - pointer to structure to initialise
 **
-** \return  Index of the string within the vector, or INVALID, if no match found
+** \return  None
 **
 **************************************************************************/
-int PtrToNaturalStrCmp(const void *arg1, const void *arg2)
+void STR_SET_Init(str_set_t *ss)
 {
-    // qsort passes in pointers to the elements in the array to be compared
-    // Hence we need to dereference the elements to get to the strings they point to
-    char **p_s1 = (char **)arg1;
-    char **p_s2 = (char **)arg2;
-    char *s1;
-    char *s2;
+    ss->slots = NULL;
+    ss->table_size = 0;
+    ss->num_indexed = 0;
+}
 
-    s1 = *p_s1;
-    s2 = *p_s2;
-    
-    return NaturalStrCmp(s1, s2);
+/*********************************************************************//**
+**
+** STR_SET_Find
+**
+** Finds the specified string within the vector, using the hash index, and returns its position in the vector
+** This is equivalent to STR_VECTOR_Find(), but takes constant time, rather than time proportional to the size of the vector
+**
+** \param   ss - pointer to hash index of the vector
+** \param   sv - pointer to vector containing strings to match against
+** \param   str - pointer to string to find in the vector
+**
+** \return  Index of the string within the vector, or INVALID, if no match found
+**
+**************************************************************************/
+int STR_SET_Find(str_set_t *ss, str_vector_t *sv, char *str)
+{
+    return STR_SET_FindKey(ss, sv->vector, sizeof(char *), sv->num_entries, str);
 }
 
 /*********************************************************************//**
 **
-** NaturalStrCmp
+** STR_SET_AddIfNotExist
 **
-** Compare 2 strings accounting correctly for natural numbers ie '2' comes before '11'
-** This is used to sort path names correctly with instance numbers in them
+** Adds a string into a vector of strings, if the string is not already present in the vector
+** This is equivalent to STR_VECTOR_Add_IfNotExist(), but uses the hash index to determine whether the string is present
 **
-** \param   s1 - pointer to first string
-** \param   s2 - pointer to another entry in the vector
+** \param   ss - pointer to hash index of the vector
+** \param   sv - pointer to structure to add the string to
+** \param   str - pointer to string to copy
 **
-** \return  0 if strings are identical
-**          negative number if s1 comes before s2
-**          positive number if s1 comes after s2
+** \return  true if the string was added, false if it was already present in the vector
 **
 **************************************************************************/
-int NaturalStrCmp(char *s1, char *s2)
+bool STR_SET_AddIfNotExist(str_set_t *ss, str_vector_t *sv, char *str)
 {
-    char c1, c2;
-    int num_digits_s1;
-    int num_digits_s2;
-    int delta;
+    int index;
 
-    // Skip all characters which are the same
-    while(true)
+    // Exit if string is already present in the vector
+    index = STR_SET_Find(ss, sv, str);
+    if (index != INVALID)
     {
-        c1 = *s1;
-        c2 = *s2;
+        return false;
+    }
+
+    // Add the string to the vector. It is added to the index the next time the index is used
+    STR_VECTOR_Add(sv, str);
+    return true;
+}
 
-        // Exit if reached the end of either string
-        if ((c1 == '\0') || (c2 == '\0'))
+/*********************************************************************//**
+**
+** STR_SET_FindKey
+**
+** Finds the specified string within an array of structures containing string keys, using the hash index of the array
+** This is the generic form of STR_SET_Find(), which is also used to index the keys of a key-value vector
+** NOTE: Small arrays are searched linearly, with the hash table only being built once the array becomes large enough to benefit
+**
+** \param   ss - pointer to hash index of the array
+** \param   keys - pointer to the key (string pointer) in the first element of the array
+** \param   stride - size (in bytes) of each element of the array
+** \param   num_entries - number of elements in the array
+** \param   str - pointer to string to find in the array
+**
+** \return  Index of the element whose key matches the string, or INVALID, if no match found
+**
+**************************************************************************/
+int STR_SET_FindKey(str_set_t *ss, void *keys, int stride, int num_entries, char *str)
+{
+    int i;
+    unsigned slot;
+    unsigned mask;
+    int index;
+
+    // Search small arrays linearly
+    if (num_entries < STR_SET_MIN_ENTRIES)
+    {
+        for (i=0; i < num_entries; i++)
         {
-            // NOTE: The following comparision puts s1 before s2, if s1 terminates before s2 (and vice versa)
-            return (int)c1 - (int)c2;
+            if (strcmp(STR_SET_KEY(keys, stride, i), str)==0)
+            {
+                return i;
+            }
         }
+        return INVALID;
+    }
+
+    // Ensure that all keys in the array are in the index
+    SyncStrSet(ss, keys, stride, num_entries);
 
-        // Exit if the characters do not match
-        if (c1 != c2)
+    // Probe the hash table until we find the string, or an unused slot
+    mask = ss->table_size - 1;
+    slot = CalcStrSetSlot(ss, str);
+    while (ss->slots[slot] != INVALID)
+    {
+        // Exit if found a key that matches
+        index = ss->slots[slot];
+        if (strcmp(STR_SET_KEY(keys, stride, index), str)==0)
         {
-            break;
+            return index;
         }
+        slot = (slot + 1) & mask;
+    }
 
-        // As characters match, move to next characters
-        s1++;
-        s2++;
+    // If the code gets here, no string was found
+    return INVALID;
+}
+
+/*********************************************************************//**
+**
+** STR_SET_Destroy
+**
+** Deallocates all memory associated with the string set
+** NOTE: This does not free the string vector which the set indexes
+**
+** \param   ss - pointer to structure to destroy all dynmically allocated memory it contains
+**
+** \return  None
+**
+**************************************************************************/
+void STR_SET_Destroy(str_set_t *ss)
+{
+    USP_SAFE_FREE(ss->slots);
+    STR_SET_Init(ss);
+}
+
+/*********************************************************************//**
+**
+** SyncStrSet
+**
+** Adds all keys which have been appended to the array since the index was last used, to the index
+** NOTE: If the array has shrunk since the index was last used, then the index is rebuilt from scratch
+**
+** \param   ss - pointer to hash index of the array
+** \param   keys - pointer to the key in the first element of the array
+** \param   stride - size (in bytes) of each element of the array
+** \param   num_entries - number of elements in the array
+**
+** \return  None
+**
+**************************************************************************/
+void SyncStrSet(str_set_t *ss, void *keys, int stride, int num_entries)
+{
+    int table_size;
+
+    // Exit if the index is already up to date
+    if (ss->num_indexed == num_entries)
+    {
+        return;
+    }
+
+    // Size the hash table, so that it is never more than half full
+    table_size = (ss->table_size == 0) ? STR_SET_INITIAL_SIZE : ss->table_size;
+    while (num_entries*2 > table_size)
+    {
+        table_size *= 2;
     }
 
-    // If the code gets here, then we have reached a character which is different
-    // Determine the number of digits in the rest of the string (this may be 0 if the first character is not a digit)
-    num_digits_s1 = TEXT_UTILS_CountConsecutiveDigits(s1);
-    num_digits_s2 = TEXT_UTILS_CountConsecutiveDigits(s2);
+    // Rebuild the index if the hash table's size needs changing, or if entries have been removed from the array since it was last used
+    if ((table_size != ss->table_size) || (num_entries < ss->num_indexed))
+    {
+        ResizeStrSet(ss, keys, stride, MIN(ss->num_indexed, num_entries), table_size);
+    }
+
+    // Add all keys which have not yet been indexed
+    while (ss->num_indexed < num_entries)
+    {
+        InsertStrSetEntry(ss, STR_SET_KEY(keys, stride, ss->num_indexed), ss->num_indexed);
+        ss->num_indexed++;
+    }
+}
+
+/*********************************************************************//**
+**
+** ResizeStrSet
+**
+** Reallocates the hash table of the index, re-indexing the specified number of keys at the start of the array
+**
+** \param   ss - pointer to hash index of the array
+** \param   keys - pointer to the key in the first element of the array
+** \param   stride - size (in bytes) of each element of the array
+** \param   num_indexed - number of elements at the start of the array to re-index
+** \param   table_size - new number of slots in the hash table. This must be a power of 2
+**
+** \return  None
+**
+**************************************************************************/
+void ResizeStrSet(str_set_t *ss, void *keys, int stride, int num_indexed, int table_size)
+{
+    int i;
+
+    USP_SAFE_FREE(ss->slots);
+    ss->slots = USP_MALLOC(table_size*sizeof(int));
+    ss->table_size = table_size;
+    for (i=0; i < table_size; i++)
+    {
+        ss->slots[i] = INVALID;
+    }
+
+    for (i=0; i < num_indexed; i++)
+    {
+        InsertStrSetEntry(ss, STR_SET_KEY(keys, stride, i), i);
+    }
+    ss->num_indexed = num_indexed;
+}
+
+/*********************************************************************//**
+**
+** InsertStrSetEntry
+**
+** Adds the position of the specified key in the array to the hash table
+** NOTE: The caller must ensure that there is at least one unused slot in the hash table
+**
+** \param   ss - pointer to hash index of the array
+** \param   key - pointer to key to index
+** \param   index - position of the key in the array
+**
+** \return  None
+**
+**************************************************************************/
+void InsertStrSetEntry(str_set_t *ss, char *key, int index)
+{
+    unsigned slot;
+    unsigned mask;
 
-    // Determine if the number of digits in s1 is greater than in s2 (if so, s1 comes after s2)
-    delta = num_digits_s1 - num_digits_s2;
-    if (delta != 0)
+    mask = ss->table_size - 1;
+    slot = CalcStrSetSlot(ss, key);
+    while (ss->slots[slot] != INVALID)
     {
-        return delta;
+        slot = (slot + 1) & mask;
     }
 
-    // If the code gets here, then the strings contain either no digits, or the same number of digits,
-    // so just compare the characters (this also works if the characters are digits)
-    return (int)c1 - (int)c2;
+    ss->slots[slot] = index;
+}
+
+/*********************************************************************//**
+**
+** CalcStrSetSlot
+**
+** Calculates the slot in the hash table at which to start probing for the specified string
+** NOTE: The hash is mixed before masking, because the low bits of the FNV hash of the similar paths stored in
+**       string vectors (eg differing only in their trailing instance number) are poorly distributed
+**
+** \param   ss - pointer to hash index
+** \param   str - pointer to string to calculate the slot of
+**
+** \return  slot in the hash table
+**
+**************************************************************************/
+unsigned CalcStrSetSlot(str_set_t *ss, char *str)
+{
+    unsigned hash;
+
+    hash = (unsigned) TEXT_UTILS_CalcHash(str);
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return hash & (ss->table_size - 1);
+}
+
+/*********************************************************************//**
+**
+** PtrToNaturalStrCmp
+**
+** This function is used by STR_VECTOR_Sort() to determine the order of elements in the vector being sorted
+**
+** \param   arg1 - pointer to an entry in the vector
+** \param   arg2 - pointer to another entry in the vector
+**
+** \return  Index of the string within the vector, or INVALID, if no match found
+**
+**************************************************************************/
+int PtrToNaturalStrCmp(const void *arg1, const void *arg2)
+{
+    // qsort passes in pointers to the elements in the array to be compared
+    // Hence we need to dereference the elements to get to the strings they point to
+    char **p_s1 = (char **)arg1;
+    char **p_s2 = (char **)arg2;
+    char *s1;
+    char *s2;
+
+    s1 = *p_s1;
+    s2 = *p_s2;
+    
+    return TEXT_UTILS_NaturalStrCmp(s1, s2);
 }
 
@@ -43,14 +43,23 @@
 #define STR_VECTOR_H
 
 //-----------------------------------------------------------------------------------------
-// String vector type
+// NOTE: The string vector type is defined in usp_api.h, as it is also used by the vendor API
+#include "usp_api.h"
+
+//-----------------------------------------------------------------------------------------
+// Hash index over the strings in a string vector (or the keys in a key-value vector), used to speed up membership tests on large vectors
+// NOTE: The index holds the positions of the strings in the vector, rather than copies of the strings.
+//       Strings appended to the vector by any means (eg STR_VECTOR_Add) are indexed the next time the index is used,
+//       but the index is only valid whilst the existing entries in the vector are not reordered or replaced.
+//       The index should be destroyed whenever the vector is destroyed
 typedef struct
 {
-    char **vector;
-    int num_entries;
-} str_vector_t;
+    int *slots;             // Hash table containing the position of each indexed string in the vector, or INVALID for an unused slot
+    int table_size;         // Number of slots in the hash table (always a power of 2), or 0 if the table has not been allocated yet
+    int num_indexed;        // Number of strings at the start of the vector which have been added to the hash table
+} str_set_t;
 
-//-----------------------------------------------------------------------------------------
+// NOTE: kv_vector.h is included after str_set_t is defined, because the key-value vector API uses it
 #include "kv_vector.h"
 
 //-----------------------------------------------------------------------------------------
@@ -58,6 +67,8 @@ typedef struct
 void STR_VECTOR_Init(str_vector_t *sv);
 void STR_VECTOR_Clone(str_vector_t *sv, char **src_vector, int src_num_entries);
 void STR_VECTOR_Add(str_vector_t *sv, char *str);
+void STR_VECTOR_AddAllocated(str_vector_t *sv, char *str);
+void STR_VECTOR_Reserve(str_vector_t *sv, int num_extra);
 void STR_VECTOR_Add_IfNotExist(str_vector_t *sv, char *str);
 int STR_VECTOR_Find(str_vector_t *sv, char *str);
 void STR_VECTOR_Destroy(str_vector_t *sv);
@@ -66,4 +77,12 @@ void STR_VECTOR_ConvertToKeyValueVector(str_vector_t *sv, kv_vector_t *kvv);
 bool STR_VECTOR_Compare(str_vector_t *sv1, str_vector_t *sv2);
 void STR_VECTOR_Sort(str_vector_t *sv);
 
+//-----------------------------------------------------------------------------------------
+// String Set API
+void STR_SET_Init(str_set_t *ss);
+int STR_SET_Find(str_set_t *ss, str_vector_t *sv, char *str);
+bool STR_SET_AddIfNotExist(str_set_t *ss, str_vector_t *sv, char *str);
+int STR_SET_FindKey(str_set_t *ss, void *keys, int stride, int num_entries, char *str);
+void STR_SET_Destroy(str_set_t *ss);
+
 #endif
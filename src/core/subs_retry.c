@@ -49,10 +49,20 @@
 #include "device.h"
 #include "sync_timer.h"
 #include "retry_wait.h"
+#include "text_utils.h"
+
+//------------------------------------------------------------------------
+// Number of (one second) slots in the timer wheel holding messages by their next retry time (must be a power of 2)
+// Messages due to be retried more than this number of seconds in the future share slots with messages due sooner
+#define SUBS_RETRY_WHEEL_SLOTS 256
+
+//------------------------------------------------------------------------
+// Minimum number of chains in each of the msg_id and source tables (must be a power of 2)
+#define SUBS_RETRY_MIN_TABLE_SIZE 64
 
 //------------------------------------------------------------------------
 // Structure containing NotifyRequest message to retry sending and associated state machine
-typedef struct
+typedef struct subs_retry_tag
 {
     int instance;               // Instance number of subscription that generated this message in Device.LocalAgent.Subscription.{i}
     char *msg_id;               // message_id allocated by this agent to uniquely identify this message
@@ -63,6 +73,7 @@ typedef struct
                                 // NOTE: This value might be NULL if the type of subscription cannot generate multiple messages
     unsigned char *pbuf;        // pointer to serialized USP message
     int  pbuf_len;              // length of serialized USP message
+    mtp_send_priority_t send_priority; // priority with which the message is sent, relative to other USP messages queued in the MTP
 
     time_t retry_expiry_time;   // Expiry time for this message
     int retry_count;            // Count of number of times this message will have been retried when next_retry_time has been reached (and the message retried)
@@ -70,17 +81,54 @@ typedef struct
     unsigned interval_multiplier;// Interval multiplier parameter for RETRY_WAIT calculation
 
     time_t next_retry_time;     // Time at which the message should next be retried to be sent
+
+    unsigned msg_id_hash;       // hash of msg_id, selecting the chain in the msg_id table
+    unsigned source_hash;       // hash of instance and differentiator, selecting the chain in the source table
+    struct subs_retry_tag *msg_id_next;     // next entry in the same chain of the msg_id table
+    struct subs_retry_tag *source_next;     // next entry in the same chain of the source table
+    struct subs_retry_tag *wheel_prev;      // previous entry in the same slot of the timer wheel
+    struct subs_retry_tag *wheel_next;      // next entry in the same slot of the timer wheel
+    struct subs_retry_tag *age_prev;        // previous (older) entry in the list of all entries
+    struct subs_retry_tag *age_next;        // next (newer) entry in the list of all entries
 } subs_retry_t;
 
 //------------------------------------------------------------------------
-// Array of subscription messages that should receive a response from the controller, or be retried
+// All subscription messages that should receive a response from the controller, or be retried
+// Each entry is indexed by msg_id (to find the entry matching a NotifyResponse), by subscription instance and differentiator
+// (to find an entry that a new notification replaces), by next retry time (in the timer wheel), and by age (oldest first)
 typedef struct
 {
-    int num_entries;
-    subs_retry_t *vector;
-} subs_retry_vector_t;
+    int num_entries;            // Number of messages awaiting a NotifyResponse
+    int memory_in_use;          // Sum of the sizes of the serialized USP messages
+    subs_retry_t *oldest;       // Head of the list of all entries, ordered by the time that they were added
+    subs_retry_t *newest;       // Tail of the list of all entries
+
+    int table_size;             // Number of chains in each of the msg_id and source tables. Always a power of 2
+    subs_retry_t **msg_id_table;
+    subs_retry_t **source_table;
 
-static subs_retry_vector_t subs_retry;
+    subs_retry_t *wheel[SUBS_RETRY_WHEEL_SLOTS];  // Entries, by next_retry_time modulo the number of slots
+    time_t wheel_time;          // Time (in seconds) of the last slot of the timer wheel to have been processed
+} subs_retry_store_t;
+
+static subs_retry_store_t subs_retry;
+
+//------------------------------------------------------------------------
+// Counters, used to monitor the subs retry store
+typedef struct
+{
+    unsigned num_added;         // Number of messages added to the store
+    unsigned num_replaced;      // Number of messages replaced by a later message from the same subscription for the same differentiator
+    unsigned num_acknowledged;  // Number of messages removed from the store because a NotifyResponse was received
+    unsigned num_resent;        // Number of times that a message has been resent
+    unsigned num_expired;       // Number of messages removed from the store because their retry period expired
+    unsigned num_dropped;       // Number of messages dropped from the store because it was full, oldest first
+    unsigned num_aborted;       // Number of messages removed from the store because their subscription or controller was deleted or disabled
+    int max_entries;            // High water mark of the number of messages in the store
+    int max_memory;             // High water mark of the memory used by serialized USP messages in the store
+} subs_retry_stats_t;
+
+static subs_retry_stats_t subs_retry_stats;
 
 //------------------------------------------------------------------------
 // Time at which first message to be retried, is to be retried
@@ -89,17 +137,24 @@ static time_t first_retry_time = END_OF_TIME;
 //------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void SubsRetryExec(int id);
+void ProcessSubsRetryWheelSlot(int slot, time_t cur_time);
 subs_retry_t *FindRetryEntry(int instance, char *differentiator);
 time_t CalcNextSubsRetryTime(subs_retry_t *sr);
+void UpdateFirstRetryTime(time_t cur_time);
+void InsertSubsRetryEntry(subs_retry_t *sr);
+void RemoveSubsRetryEntry(subs_retry_t *sr);
 void DestroySubsRetryEntry(subs_retry_t *sr);
-void UpdateFirstRetryTime(void);
-void GarbageCollectSubsRetry(void);
+void AddToSubsRetryWheel(subs_retry_t *sr);
+void RemoveFromSubsRetryWheel(subs_retry_t *sr);
+void ResizeSubsRetryTables(int new_size);
+unsigned CalcSubsRetrySourceHash(int instance, char *differentiator);
+void DropOldestSubsRetryEntries(int pbuf_len);
 
 /*********************************************************************//**
 **
 ** SUBS_RETRY_Init
 **
-** Initialises the vector of subscriptions to retry
+** Initialises the store of subscription notifications to retry
 **
 ** \param   None
 **
@@ -108,9 +163,12 @@ void GarbageCollectSubsRetry(void);
 **************************************************************************/
 void SUBS_RETRY_Init(void)
 {
-    subs_retry.num_entries = 0;
-    subs_retry.vector = NULL;
+    memset(&subs_retry, 0, sizeof(subs_retry));
+    memset(&subs_retry_stats, 0, sizeof(subs_retry_stats));
+    subs_retry.wheel_time = time(NULL);
+    ResizeSubsRetryTables(SUBS_RETRY_MIN_TABLE_SIZE);
     SYNC_TIMER_Add(SubsRetryExec, 0, END_OF_TIME);
+    SYNC_TIMER_SetSlack(SubsRetryExec, 0, SUBS_RETRY_SLACK);
 }
 
 /*********************************************************************//**
@@ -126,20 +184,20 @@ void SUBS_RETRY_Init(void)
 **************************************************************************/
 void SUBS_RETRY_Stop(void)
 {
-    int i;
     subs_retry_t *sr;
+    subs_retry_t *next;
 
-    for (i=0; i<subs_retry.num_entries; i++)
+    sr = subs_retry.oldest;
+    while (sr != NULL)
     {
-        sr = &subs_retry.vector[i];
-        USP_SAFE_FREE(sr->msg_id);
-        USP_SAFE_FREE(sr->subscription_id);
-        USP_SAFE_FREE(sr->dest_endpoint);
-        USP_SAFE_FREE(sr->differentiator);
-        USP_SAFE_FREE(sr->pbuf);
+        next = sr->age_next;
+        DestroySubsRetryEntry(sr);
+        sr = next;
     }
 
-    USP_SAFE_FREE(subs_retry.vector);
+    USP_SAFE_FREE(subs_retry.msg_id_table);
+    USP_SAFE_FREE(subs_retry.source_table);
+    memset(&subs_retry, 0, sizeof(subs_retry));
 }
 
 /*********************************************************************//**
@@ -158,16 +216,16 @@ void SUBS_RETRY_Stop(void)
 ** \param   pbuf - pointer to serialized USP message
 **                 NOTE: Ownership of the serialized USP message passes to this module
 ** \param   pbuf_len - length of protobuf binary message
+** \param   send_priority - priority with which the message is sent, relative to other USP messages queued in the MTP
 ** \param   retry_expiry_time - time at which retrying to send this message should stop
 **
 ** \return  None
 **
 **************************************************************************/
 void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *dest_endpoint, char *differentiator, 
-                    unsigned char *pbuf, int pbuf_len, time_t retry_expiry_time)
+                    unsigned char *pbuf, int pbuf_len, mtp_send_priority_t send_priority, time_t retry_expiry_time)
 {
     int err;
-    int new_num_entries;
     subs_retry_t *sr;
     unsigned min_wait_interval;
     unsigned interval_multiplier;
@@ -181,31 +239,28 @@ void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *des
         if (sr != NULL)
         {
             USP_LOG_Warning("%s: Aborting sending subscription_id=%s because controller is disabled or deleted", __FUNCTION__, subscription_id);
-            DestroySubsRetryEntry(sr);
-            GarbageCollectSubsRetry();
+            RemoveSubsRetryEntry(sr);
+            subs_retry_stats.num_aborted++;
             return;
         }
     }
 
     // See if this retry needs to replace an existing retry
     // This could be the case if a NotifyResponse has not been received, and the parameter's value has changed again
+    // NOTE: The replacing message is treated as the newest message in the store
     sr = FindRetryEntry(instance, differentiator);
-    if (sr == NULL)
+    if (sr != NULL)
     {
-        // Add new retry entry
-        new_num_entries = subs_retry.num_entries + 1;
-        subs_retry.vector = USP_REALLOC(subs_retry.vector, new_num_entries*sizeof(subs_retry_t));
-        sr = &subs_retry.vector[ subs_retry.num_entries ];
-        subs_retry.num_entries = new_num_entries;
-    }
-    else
-    {
-        // Replace an existing entry. First free memory associated with current entry - but leave the entry allocated, 
-        // as we will replace it
-        DestroySubsRetryEntry(sr);
+        RemoveSubsRetryEntry(sr);
+        subs_retry_stats.num_replaced++;
     }
+
+    // Drop the oldest messages, if the store would otherwise exceed its limits
+    DropOldestSubsRetryEntries(pbuf_len);
     
     // Fill in this entry
+    sr = USP_MALLOC(sizeof(subs_retry_t));
+    memset(sr, 0, sizeof(subs_retry_t));
     sr->instance = instance;
     sr->msg_id = USP_STRDUP(msg_id);
     sr->subscription_id = USP_STRDUP(subscription_id);
@@ -221,6 +276,7 @@ void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *des
 
     sr->pbuf = pbuf;
     sr->pbuf_len = pbuf_len;
+    sr->send_priority = send_priority;
    
     sr->retry_expiry_time = retry_expiry_time;
     sr->retry_count = 1;
@@ -230,8 +286,15 @@ void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *des
     sr->next_retry_time = CalcNextSubsRetryTime(sr);
     USP_LOG_Info("Retrying sending notification (retry_count=%d) in %d seconds.", sr->retry_count, (int)(sr->next_retry_time-time(NULL)) );
 
-    // Update time until next retry is sent
-    UpdateFirstRetryTime();
+    InsertSubsRetryEntry(sr);
+    subs_retry_stats.num_added++;
+
+    // Bring forward the time until the next retry is sent, if this message is the first to be retried
+    if (sr->next_retry_time < first_retry_time)
+    {
+        first_retry_time = sr->next_retry_time;
+        SYNC_TIMER_Reload(SubsRetryExec, 0, first_retry_time);
+    }
 }
 
 /*********************************************************************//**
@@ -249,25 +312,26 @@ void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *des
 **************************************************************************/
 void SUBS_RETRY_Remove(char *msg_id, char *subscription_id)
 {
-    int i;
+    unsigned hash;
     subs_retry_t *sr;
 
-    // Iterate over all retry entries, finding the first entry that matches the one the controller is responding to
-    for (i=0; i < subs_retry.num_entries; i++)
+    // Iterate over all retry entries with the same msg_id hash, finding the first entry that matches the one the controller is responding to
+    hash = (unsigned) TEXT_UTILS_CalcHash(msg_id);
+    sr = subs_retry.msg_id_table[hash & (subs_retry.table_size-1)];
+    while (sr != NULL)
     {
-        sr = &subs_retry.vector[i];
-        if ((strcmp(sr->msg_id, msg_id) == 0) &&
+        if ((sr->msg_id_hash == hash) &&
+            (strcmp(sr->msg_id, msg_id) == 0) &&
             (strcmp(sr->subscription_id, subscription_id)==0))
         {
             // Remove this entry. We have had a response from the controller, so do not have to retry it anymore
+            // NOTE: The timer is not restarted. If it fires before the next retry, no messages will be due, and it will be restarted then
             USP_LOG_Info("%s: Removing Notification retry for msg_id=%s (NotifyResponse received)", __FUNCTION__, msg_id);
-            DestroySubsRetryEntry(sr);
-            GarbageCollectSubsRetry();
-
-            // Update time until next retry is sent
-            UpdateFirstRetryTime();
+            RemoveSubsRetryEntry(sr);
+            subs_retry_stats.num_acknowledged++;
             return;
         }
+        sr = sr->msg_id_next;
     }
 
     // If the code gets here, no matching NotifyRequest has been found to cancel, so just log this fact
@@ -288,26 +352,43 @@ void SUBS_RETRY_Remove(char *msg_id, char *subscription_id)
 **************************************************************************/
 void SUBS_RETRY_Delete(int instance)
 {
-    int i;
     subs_retry_t *sr;
+    subs_retry_t *next;
 
     // Iterate over all retries, removing all entries which were generated by the subscription
-    for (i=0; i < subs_retry.num_entries; i++)
+    sr = subs_retry.oldest;
+    while (sr != NULL)
     {
-        sr = &subs_retry.vector[i];
+        next = sr->age_next;
         if (sr->instance == instance)
         {
-            // Mark this entry for deletion
             USP_LOG_Info("%s: Removing Notification retry for msg_id=%s (Subscription deleted)", __FUNCTION__, sr->msg_id);
-            DestroySubsRetryEntry(sr);
+            RemoveSubsRetryEntry(sr);
+            subs_retry_stats.num_aborted++;
         }
+        sr = next;
     }
+}
 
-    // Remove all entries marked for deletion
-    GarbageCollectSubsRetry();
-
-    // Update time until next retry is sent
-    UpdateFirstRetryTime();
+/*********************************************************************//**
+**
+** SUBS_RETRY_Dump
+**
+** Logs the counters and current occupancy of the store of messages to retry
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void SUBS_RETRY_Dump(void)
+{
+    USP_DUMP("Notification retry store: %d messages (max %d, limit %d), %d bytes (max %d, limit %d)",
+             subs_retry.num_entries, subs_retry_stats.max_entries, SUBS_RETRY_MAX_MSGS,
+             subs_retry.memory_in_use, subs_retry_stats.max_memory, SUBS_RETRY_MAX_MEMORY);
+    USP_DUMP("Notification retry counters: added=%u, replaced=%u, acknowledged=%u, resent=%u, expired=%u, dropped=%u, aborted=%u",
+             subs_retry_stats.num_added, subs_retry_stats.num_replaced, subs_retry_stats.num_acknowledged, subs_retry_stats.num_resent,
+             subs_retry_stats.num_expired, subs_retry_stats.num_dropped, subs_retry_stats.num_aborted);
 }
 
 /*********************************************************************//**
@@ -326,88 +407,145 @@ void SUBS_RETRY_Delete(int instance)
 void SubsRetryExec(int id)
 {
     int i;
-    subs_retry_t *sr;
+    int num_slots;
     time_t cur_time;
-    char buf[MAX_ISO8601_LEN];
-    mtp_reply_to_t mtp_reply_to = {0};  // Ensures mtp_reply_to.is_reply_to_specified=false
     
     cur_time = time(NULL);
     USP_ASSERT(cur_time >= first_retry_time);
 
-    // Iterate over all retry entries, retrying all of those for which it is time to retry
-    // Also calculate the time until the next retry should occur
-    for (i=0; i < subs_retry.num_entries; i++)
+    // Determine the number of slots in the timer wheel to process. This is all slots from the last slot processed
+    // (which may have had entries added to it since) up to the current time, limited to a single revolution of the wheel
+    if (cur_time < subs_retry.wheel_time)
+    {
+        subs_retry.wheel_time = cur_time;   // Time has gone backwards
+    }
+
+    num_slots = SUBS_RETRY_WHEEL_SLOTS;
+    if (cur_time - subs_retry.wheel_time < SUBS_RETRY_WHEEL_SLOTS)
+    {
+        num_slots = (int)(cur_time - subs_retry.wheel_time) + 1;
+    }
+
+    // Retry all messages in those slots, for which it is time to retry
+    for (i=num_slots-1; i>=0; i--)
+    {
+        ProcessSubsRetryWheelSlot((int)((cur_time - i) & (SUBS_RETRY_WHEEL_SLOTS-1)), cur_time);
+    }
+    subs_retry.wheel_time = cur_time;
+
+    // Restart the timer to cause this function to be called again when the next retry should occur
+    UpdateFirstRetryTime(cur_time);
+}
+
+/*********************************************************************//**
+**
+** ProcessSubsRetryWheelSlot
+**
+** Retries sending all messages in the specified slot of the timer wheel which are due to be retried
+** Messages in the slot which are not yet due (because they are due in a later revolution of the wheel) are left in the slot
+**
+** \param   slot - slot in the timer wheel to process
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessSubsRetryWheelSlot(int slot, time_t cur_time)
+{
+    subs_retry_t *sr;
+    subs_retry_t *next;
+    char buf[MAX_ISO8601_LEN];
+    mtp_reply_to_t mtp_reply_to = {0};  // Ensures mtp_reply_to.is_reply_to_specified=false
+
+    // Detach all entries from the slot, adding them back to the wheel when their next retry time has been calculated
+    sr = subs_retry.wheel[slot];
+    subs_retry.wheel[slot] = NULL;
+    while (sr != NULL)
     {
-        // Mark this retry entry for deletion if it has reached the time where we give up retrying
-        sr = &subs_retry.vector[i];
-        if (cur_time >= sr->retry_expiry_time)
+        next = sr->wheel_next;
+        sr->wheel_prev = NULL;
+        sr->wheel_next = NULL;
+
+        if (cur_time < sr->next_retry_time)
+        {
+            // Not yet time to retry this message
+            AddToSubsRetryWheel(sr);
+        }
+        else if (cur_time >= sr->retry_expiry_time)
         {
+            // Remove this retry entry if it has reached the time where we give up retrying
             USP_LOG_Info("%s: Removing Notification retry for msg_id=%s (retry period expired at %s)", __FUNCTION__, sr->msg_id, iso8601_cur_time(buf, sizeof(buf)) );
-            DestroySubsRetryEntry(sr);
+            RemoveSubsRetryEntry(sr);
+            subs_retry_stats.num_expired++;
         }
         else
         {
-            // Determine if it is time to try resending the message
-            if (cur_time >= sr->next_retry_time)
+            // Try resending the saved serialized USP message
+            mtp_reply_to.send_priority = sr->send_priority;
+            MSG_HANDLER_QueueUspRecord(USP__HEADER__MSG_TYPE__NOTIFY, sr->dest_endpoint, sr->pbuf, sr->pbuf_len, sr->msg_id, &mtp_reply_to, sr->retry_expiry_time);
+            subs_retry_stats.num_resent++;
+
+            // Calculate next time until this message is retried
+            sr->retry_count++;
+            sr->next_retry_time = CalcNextSubsRetryTime(sr);
+
+            // Remove this retry entry if the next retry is after the expiry time
+            if (sr->next_retry_time >= sr->retry_expiry_time)
+            {
+                USP_LOG_Info("%s: Removing Notification retry for msg_id=%s (next retry would be after expiry time)", __FUNCTION__, sr->msg_id);
+                RemoveSubsRetryEntry(sr);
+                subs_retry_stats.num_expired++;
+            }
+            else
             {
-                // Try resending the saved serialized USP message
-                MSG_HANDLER_QueueUspRecord(USP__HEADER__MSG_TYPE__NOTIFY, sr->dest_endpoint, sr->pbuf, sr->pbuf_len, sr->msg_id, &mtp_reply_to, sr->retry_expiry_time);
-
-                // Calculate next time until this message is retried
-                sr->retry_count++;
-                sr->next_retry_time = CalcNextSubsRetryTime(sr);
-
-                // Mark this retry entry for deletion if the next retry is after the expiry time
-                if (sr->next_retry_time >= sr->retry_expiry_time)
-                {
-                    USP_LOG_Info("%s: Removing Notification retry for msg_id=%s (next retry would be after expiry time)", __FUNCTION__, sr->msg_id);
-                    DestroySubsRetryEntry(sr);
-                }
-                else
-                {
-                    USP_LOG_Info("%s: Retrying to send NotifyRequest with msg_id=%s. Next retry [%d] in %d seconds.", iso8601_cur_time(buf, sizeof(buf)), sr->msg_id, sr->retry_count, (int)(sr->next_retry_time-cur_time) );
-                }
+                USP_LOG_Info("%s: Retrying to send NotifyRequest with msg_id=%s. Next retry [%d] in %d seconds.", iso8601_cur_time(buf, sizeof(buf)), sr->msg_id, sr->retry_count, (int)(sr->next_retry_time-cur_time) );
+                AddToSubsRetryWheel(sr);
             }
         }
-    }
-
-    // Now remove all entries in the vector which have been marked for deletion
-    GarbageCollectSubsRetry();
 
-    // Restart the timer to cause this function to be called again when the next retry should occur
-    UpdateFirstRetryTime();
+        sr = next;
+    }
 }
 
 /*********************************************************************//**
 **
 ** FindRetryEntry
 **
-** Finds the entry in the retry vector which matches the specified incoming message
+** Finds the entry in the retry store which matches the specified incoming message
 **
 ** \param   instance - Instance number of Subscription in Device.LocalAgent.Subscription.{i}
 ** \param   differentiator - string used to differentiate multiple messages being generated from the same subscription
 **                           eg for a value change subscription, multiple messages are differentiated by data model path
 **                           NOTE: This value might be NULL if the type of subscription cannot generate multiple messages
 **
-** \return  None
+** \return  pointer to matching entry, or NULL if no match was found
 **
 **************************************************************************/
 subs_retry_t *FindRetryEntry(int instance, char *differentiator)
 {
-    int i;
+    unsigned hash;
     subs_retry_t *sr;
 
-    // Iterate over all retries, finding the one which matches the incoming message
-    for (i=0; i < subs_retry.num_entries; i++)
+    // Iterate over all retries with the same source hash, finding the one which matches the incoming message
+    hash = CalcSubsRetrySourceHash(instance, differentiator);
+    sr = subs_retry.source_table[hash & (subs_retry.table_size-1)];
+    while (sr != NULL)
     {
-        sr = &subs_retry.vector[i];
-        if (sr->instance == instance)
+        if ((sr->source_hash == hash) && (sr->instance == instance))
         {
-            if ((sr->differentiator == NULL) || (strcmp(sr->differentiator, differentiator)==0))
+            if ((sr->differentiator == differentiator) || 
+                ((sr->differentiator != NULL) && (differentiator != NULL) && (strcmp(sr->differentiator, differentiator)==0)))
             {
                 return sr;
             }
         }
+        sr = sr->source_next;
+    }
+
+    // Otherwise see if there is an entry for the subscription without a differentiator (these match any incoming message)
+    if (differentiator != NULL)
+    {
+        return FindRetryEntry(instance, NULL);
     }
 
     // If the code gets here, then no match was found
@@ -446,26 +584,30 @@ time_t CalcNextSubsRetryTime(subs_retry_t *sr)
 ** UpdateFirstRetryTime
 **
 ** Updates the time at which the first retry should fire
+** This is the time of the first occupied slot of the timer wheel. If the entries in that slot are due in a later
+** revolution of the wheel, then the timer fires early, and is restarted after finding that no messages are due
 **
-** \param   None
+** \param   cur_time - current time
 **
 ** \return  None
 **
 **************************************************************************/
-void UpdateFirstRetryTime(void)
+void UpdateFirstRetryTime(time_t cur_time)
 {
     int i;
-    subs_retry_t *sr;
     time_t first;
 
-    // Iterate over all retry entries, finding the first time that any of them fire
+    // Iterate over all slots in the timer wheel, following the current time, finding the first occupied slot
     first = END_OF_TIME;
-    for (i=0; i < subs_retry.num_entries; i++)
+    if (subs_retry.num_entries > 0)
     {
-        sr = &subs_retry.vector[i];
-        if (sr->next_retry_time < first)
+        for (i=1; i <= SUBS_RETRY_WHEEL_SLOTS; i++)
         {
-            first = sr->next_retry_time;
+            if (subs_retry.wheel[ (cur_time + i) & (SUBS_RETRY_WHEEL_SLOTS-1) ] != NULL)
+            {
+                first = cur_time + i;
+                break;
+            }
         }
     }
 
@@ -474,11 +616,134 @@ void UpdateFirstRetryTime(void)
     SYNC_TIMER_Reload(SubsRetryExec, 0, first_retry_time);
 }
 
+/*********************************************************************//**
+**
+** InsertSubsRetryEntry
+**
+** Adds the specified entry to the store, as its newest entry
+**
+** \param   sr - pointer to entry to add
+**
+** \return  None
+**
+**************************************************************************/
+void InsertSubsRetryEntry(subs_retry_t *sr)
+{
+    unsigned mask;
+
+    // Grow the tables, if there are more entries than chains
+    if (subs_retry.num_entries >= subs_retry.table_size)
+    {
+        ResizeSubsRetryTables(2*subs_retry.table_size);
+    }
+
+    // Add to the msg_id and source tables
+    mask = subs_retry.table_size - 1;
+    sr->msg_id_hash = (unsigned) TEXT_UTILS_CalcHash(sr->msg_id);
+    sr->msg_id_next = subs_retry.msg_id_table[sr->msg_id_hash & mask];
+    subs_retry.msg_id_table[sr->msg_id_hash & mask] = sr;
+
+    sr->source_hash = CalcSubsRetrySourceHash(sr->instance, sr->differentiator);
+    sr->source_next = subs_retry.source_table[sr->source_hash & mask];
+    subs_retry.source_table[sr->source_hash & mask] = sr;
+
+    // Add to the end of the list of all entries
+    sr->age_prev = subs_retry.newest;
+    sr->age_next = NULL;
+    if (subs_retry.newest != NULL)
+    {
+        subs_retry.newest->age_next = sr;
+    }
+    else
+    {
+        subs_retry.oldest = sr;
+    }
+    subs_retry.newest = sr;
+
+    AddToSubsRetryWheel(sr);
+
+    // Update occupancy
+    subs_retry.num_entries++;
+    subs_retry.memory_in_use += sr->pbuf_len;
+    USP_MEM_BudgetForceCharge(kMemBudget_SubsRetry, sr->pbuf_len);
+    if (subs_retry.num_entries > subs_retry_stats.max_entries)
+    {
+        subs_retry_stats.max_entries = subs_retry.num_entries;
+    }
+
+    if (subs_retry.memory_in_use > subs_retry_stats.max_memory)
+    {
+        subs_retry_stats.max_memory = subs_retry.memory_in_use;
+    }
+}
+
+/*********************************************************************//**
+**
+** RemoveSubsRetryEntry
+**
+** Removes the specified entry from the store, and frees it
+**
+** \param   sr - pointer to entry to remove
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveSubsRetryEntry(subs_retry_t *sr)
+{
+    unsigned mask;
+    subs_retry_t **p;
+
+    // Remove from the msg_id and source tables
+    mask = subs_retry.table_size - 1;
+    p = &subs_retry.msg_id_table[sr->msg_id_hash & mask];
+    while (*p != sr)
+    {
+        p = &(*p)->msg_id_next;
+    }
+    *p = sr->msg_id_next;
+
+    p = &subs_retry.source_table[sr->source_hash & mask];
+    while (*p != sr)
+    {
+        p = &(*p)->source_next;
+    }
+    *p = sr->source_next;
+
+    // Remove from the list of all entries
+    if (sr->age_prev != NULL)
+    {
+        sr->age_prev->age_next = sr->age_next;
+    }
+    else
+    {
+        subs_retry.oldest = sr->age_next;
+    }
+
+    if (sr->age_next != NULL)
+    {
+        sr->age_next->age_prev = sr->age_prev;
+    }
+    else
+    {
+        subs_retry.newest = sr->age_prev;
+    }
+
+    RemoveFromSubsRetryWheel(sr);
+
+    // Update occupancy
+    subs_retry.num_entries--;
+    subs_retry.memory_in_use -= sr->pbuf_len;
+    USP_MEM_BudgetRelease(kMemBudget_SubsRetry, sr->pbuf_len);
+
+    DestroySubsRetryEntry(sr);
+}
+
 /*********************************************************************//**
 **
 ** DestroySubsRetryEntry
 **
-** Frees all memory associated with a retry entry, and marks it for deletion
+** Frees all memory associated with a retry entry
+** NOTE: The entry must already have been removed from the store
 **
 ** \param   sr - pointer to entry to free all memory of
 **
@@ -493,49 +758,151 @@ void DestroySubsRetryEntry(subs_retry_t *sr)
     USP_FREE(sr->dest_endpoint);
     USP_SAFE_FREE(sr->differentiator);
     USP_FREE(sr->pbuf);
+    USP_FREE(sr);
+}
 
-    // Mark entry for deletion
-    memset(sr, 0, sizeof(subs_retry_t));
-    sr->instance = INVALID;
+/*********************************************************************//**
+**
+** AddToSubsRetryWheel
+**
+** Adds the specified entry to the slot of the timer wheel for its next retry time
+**
+** \param   sr - pointer to entry to add
+**
+** \return  None
+**
+**************************************************************************/
+void AddToSubsRetryWheel(subs_retry_t *sr)
+{
+    int slot;
+
+    slot = (int)(sr->next_retry_time & (SUBS_RETRY_WHEEL_SLOTS-1));
+    sr->wheel_prev = NULL;
+    sr->wheel_next = subs_retry.wheel[slot];
+    if (sr->wheel_next != NULL)
+    {
+        sr->wheel_next->wheel_prev = sr;
+    }
+    subs_retry.wheel[slot] = sr;
 }
 
 /*********************************************************************//**
 **
-** GarbageCollectSubsRetry
+** RemoveFromSubsRetryWheel
 **
-** Removes all entries in the subs_retry vector which have been marked for deletion
-** NOTE: All dynamically allocated memory that they referenced will already have been destroyed (by DestroySubsRetryEntry), 
-**       so we do not have to do it here
+** Removes the specified entry from the timer wheel
+** NOTE: The entry may have already been detached from its slot (see ProcessSubsRetryWheelSlot), in which case this function does nothing
 **
-** \param   msg_id - string identifying the NotifyRequest message sent by this agent, that the controller is responding to
-** \param   subscription_id - string set by the controller in Device.LocalAgent.Subscription.{i].ID
+** \param   sr - pointer to entry to remove
 **
 ** \return  None
 **
 **************************************************************************/
-void GarbageCollectSubsRetry(void)
+void RemoveFromSubsRetryWheel(subs_retry_t *sr)
 {
-    int i, j;
+    int slot;
+
+    slot = (int)(sr->next_retry_time & (SUBS_RETRY_WHEEL_SLOTS-1));
+    if (sr->wheel_prev != NULL)
+    {
+        sr->wheel_prev->wheel_next = sr->wheel_next;
+    }
+    else if (subs_retry.wheel[slot] == sr)
+    {
+        subs_retry.wheel[slot] = sr->wheel_next;
+    }
+
+    if (sr->wheel_next != NULL)
+    {
+        sr->wheel_next->wheel_prev = sr->wheel_prev;
+    }
+
+    sr->wheel_prev = NULL;
+    sr->wheel_next = NULL;
+}
+
+/*********************************************************************//**
+**
+** ResizeSubsRetryTables
+**
+** Reallocates the msg_id and source tables with the specified number of chains, and adds all entries in the store to them
+**
+** \param   new_size - new number of chains in each table. This must be a power of 2
+**
+** \return  None
+**
+**************************************************************************/
+void ResizeSubsRetryTables(int new_size)
+{
+    unsigned mask;
     subs_retry_t *sr;
-    
-    // Remove all entries in the vector which have been marked for deletion by DestroySubsRetryEntry()
-    // Iterate over all subscriptions, compacting the vector (Garbage collecting)
-    j = 0;
-    for (i=0; i < subs_retry.num_entries; i++)
+
+    USP_SAFE_FREE(subs_retry.msg_id_table);
+    USP_SAFE_FREE(subs_retry.source_table);
+    subs_retry.msg_id_table = USP_MALLOC(new_size*sizeof(subs_retry_t *));
+    subs_retry.source_table = USP_MALLOC(new_size*sizeof(subs_retry_t *));
+    memset(subs_retry.msg_id_table, 0, new_size*sizeof(subs_retry_t *));
+    memset(subs_retry.source_table, 0, new_size*sizeof(subs_retry_t *));
+    subs_retry.table_size = new_size;
+
+    // Add all entries to the new tables, using their stored hashes
+    mask = new_size - 1;
+    for (sr = subs_retry.oldest; sr != NULL; sr = sr->age_next)
     {
-        sr = &subs_retry.vector[i];
-        if (sr->instance != INVALID)
-        {
-            // Copy down later entries in the array, over ones which have been removed
-            if (j < i)
-            {
-                memcpy(&subs_retry.vector[j], sr, sizeof(subs_retry_t));
-            }
-            j++;
-        }
+        sr->msg_id_next = subs_retry.msg_id_table[sr->msg_id_hash & mask];
+        subs_retry.msg_id_table[sr->msg_id_hash & mask] = sr;
+        sr->source_next = subs_retry.source_table[sr->source_hash & mask];
+        subs_retry.source_table[sr->source_hash & mask] = sr;
     }
+}
 
-    // Store the number of valid entries left in the vector
-    subs_retry.num_entries = j;
+/*********************************************************************//**
+**
+** CalcSubsRetrySourceHash
+**
+** Calculates the hash of the subscription and differentiator which generated a message
+**
+** \param   instance - Instance number of Subscription in Device.LocalAgent.Subscription.{i}
+** \param   differentiator - string used to differentiate multiple messages being generated from the same subscription, or NULL
+**
+** \return  hash value
+**
+**************************************************************************/
+unsigned CalcSubsRetrySourceHash(int instance, char *differentiator)
+{
+    unsigned hash;
+
+    hash = ((unsigned)instance) * 2654435761u;
+    if (differentiator != NULL)
+    {
+        hash ^= (unsigned) TEXT_UTILS_CalcHash(differentiator);
+    }
+
+    return hash;
 }
 
+/*********************************************************************//**
+**
+** DropOldestSubsRetryEntries
+**
+** Drops the oldest messages in the store, until there is room to add a message of the specified size
+** If the message is larger than SUBS_RETRY_MAX_MEMORY, then all messages are dropped, and the message is still added
+**
+** \param   pbuf_len - size of the serialized USP message that is going to be added
+**
+** \return  None
+**
+**************************************************************************/
+void DropOldestSubsRetryEntries(int pbuf_len)
+{
+    subs_retry_t *sr;
+
+    while ((subs_retry.oldest != NULL) && 
+           ((subs_retry.num_entries >= SUBS_RETRY_MAX_MSGS) || (subs_retry.memory_in_use + pbuf_len > SUBS_RETRY_MAX_MEMORY)))
+    {
+        sr = subs_retry.oldest;
+        USP_LOG_Warning("%s: Dropping Notification retry for msg_id=%s (retry store full)", __FUNCTION__, sr->msg_id);
+        RemoveSubsRetryEntry(sr);
+        subs_retry_stats.num_dropped++;
+    }
+}
@@ -42,13 +42,15 @@
 #define SUBS_RETRY_H
 
 #include "usp-msg.pb-c.h"
+#include "mtp_exec.h"
 
 void SUBS_RETRY_Init(void);
 void SUBS_RETRY_Stop(void);
 void SUBS_RETRY_Add(int instance, char *msg_id, char *subscription_id, char *dest_endpoint, char *differentiator, 
-                    unsigned char *pbuf, int pbuf_len, time_t retry_expiry_time);
+                    unsigned char *pbuf, int pbuf_len, mtp_send_priority_t send_priority, time_t retry_expiry_time);
 void SUBS_RETRY_Remove(char *msg_id, char *subscription_id);
 void SUBS_RETRY_Delete(int instance);
+void SUBS_RETRY_Dump(void);
 
 
 #endif
@@ -46,6 +46,7 @@
 #include "iso8601.h"
 #include "text_utils.h"
 #include "device.h"
+#include "path_resolver.h"
 
 /*********************************************************************//**
 **
@@ -163,8 +164,60 @@ void SUBS_VECTOR_DestroySubscriber(subs_t *sub)
     USP_SAFE_FREE(sub->subscription_id);
 
     STR_VECTOR_Destroy(&sub->path_expressions);
-    KV_VECTOR_Destroy(&sub->last_values);
+    SUBS_VECTOR_DestroyValueDigests(&sub->last_values);
+    KV_VECTOR_Destroy(&sub->coalesced_changes);
+    STR_SET_Destroy(&sub->coalesced_changes_index);
     STR_VECTOR_Destroy(&sub->resolved_paths);
+    STR_SET_Destroy(&sub->resolved_paths_index);
+    SUBS_VECTOR_DestroyResolvedParams(sub);
+}
+
+/*********************************************************************//**
+**
+** SUBS_VECTOR_DestroyResolvedParams
+**
+** Frees the cache of parameters referenced by the specified value change subscription
+** This causes the subscription's path expressions to be resolved again, the next time that it is polled
+**
+** \param   sub - pointer to subscription
+**
+** eturn  None
+**
+**************************************************************************/
+void SUBS_VECTOR_DestroyResolvedParams(subs_t *sub)
+{
+    if (sub->resolved_params != NULL)
+    {
+        PATH_RESOLVER_DestroyResolvedPaths(sub->resolved_params);
+        USP_FREE(sub->resolved_params);
+        sub->resolved_params = NULL;
+    }
+
+    sub->resolved_params_generation = 0;
+}
+
+/*********************************************************************//**
+**
+** SUBS_VECTOR_DestroyValueDigests
+**
+** Frees all memory allocated to the specified vector of value digests, leaving it empty
+**
+** \param   vdv - pointer to vector of value digests
+**
+** \return  None
+**
+**************************************************************************/
+void SUBS_VECTOR_DestroyValueDigests(value_digest_vector_t *vdv)
+{
+    int i;
+
+    for (i=0; i < vdv->num_entries; i++)
+    {
+        USP_FREE(vdv->vector[i].path);
+    }
+
+    USP_SAFE_FREE(vdv->vector);
+    vdv->num_entries = 0;
 }
 
 /*********************************************************************//**
@@ -301,7 +354,7 @@ void SUBS_VECTOR_Dump(subs_vector_t *suv)
         // Log all last values
         for (j=0; j < sub->last_values.num_entries; j++)
         {
-            USP_DUMP("last_values[%d] %s => %s", j, sub->last_values.vector[j].key, sub->last_values.vector[j].value);
+            USP_DUMP("last_values[%d] %s => hash=%016llx, len=%d", j, sub->last_values.vector[j].path, (unsigned long long)sub->last_values.vector[j].hash, sub->last_values.vector[j].len);
         }
         USP_DUMP("-");
 
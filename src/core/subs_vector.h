@@ -43,6 +43,7 @@
 #define SUBS_VECTOR_H
 
 #include <time.h>
+#include <stdint.h>
 
 #include "common_defs.h"
 #include "str_vector.h"
@@ -63,6 +64,24 @@ typedef enum
     kSubNotifyType_Max                  // This should always be the last value in this enumeration. It is used to statically size arrays based on one entry for each active enumeration
 } subs_notify_t;
 
+//------------------------------------------------------------------------------
+// Digest of the value of a parameter referenced by a value change subscription
+// This allows changes to the value of the parameter to be detected without holding a copy of its value
+typedef struct
+{
+    char *path;                         // Path of the parameter
+    uint64_t hash;                      // 64 bit hash of the value of the parameter (see TEXT_UTILS_CalcHash64)
+    int len;                            // Length of the value of the parameter
+} value_digest_t;
+
+//------------------------------------------------------------------------------
+// Vector of value digests
+typedef struct
+{
+    int num_entries;
+    value_digest_t *vector;
+} value_digest_vector_t;
+
 //------------------------------------------------------------------------------
 // Element of subscription vector
 typedef struct
@@ -76,8 +95,20 @@ typedef struct
     subs_notify_t notify_type;          // Device.LocalAgent.Subscription.{i}.NotifType
     time_t expiry_time;                 // Time at which this subscription should be stopped and removed from the DB
     unsigned retry_expiry_period;       // Device.LocalAgent.Subscription.{i}.NotifExpiration
-    kv_vector_t last_values;            // List of parameters+values from last time that the subscription was polled (if the subscription is a value change subscription)
+    value_digest_vector_t last_values;  // List of parameters+digests of their values from last time that the subscription was polled (if the subscription is a value change subscription)
+    unsigned poll_period;               // Device.LocalAgent.Subscription.{i}.<VALUE_CHANGE_POLL_PERIOD_PARAM>. Period (in seconds) between value change polls. 0=use default.
+    time_t next_poll_time;              // Time at which this subscription is next due to be polled for value change, or 0 if it has not been scheduled yet
+    unsigned coalesce_window;           // Device.LocalAgent.Subscription.{i}.<VALUE_CHANGE_COALESCE_WINDOW_PARAM>. Period (in seconds) over which value changes are coalesced. 0=disabled.
+    kv_vector_t coalesced_changes;      // Parameters+values which have changed value, and are waiting for the coalescing window to expire before being notified
+    str_set_t coalesced_changes_index;  // Hash index of the parameter paths in coalesced_changes
+    time_t coalesce_send_time;          // Time at which the coalesced value changes should be notified
     str_vector_t resolved_paths;       // Used to cache the resolved paths of an object deletion subscription before the object has been deleted from the data model
+    str_set_t resolved_paths_index;     // Hash index of resolved_paths, used when matching object deletions against resolved_paths
+    bool is_deletion_resolved;          // Set if resolved_paths has been resolved for the object deletions in the current USP message
+    struct dm_resolved_path_vector_tag *resolved_params; // Cache of the parameters (and their nodes and instances) referenced by a value change subscription, or NULL if not cached
+    unsigned resolved_params_generation;  // Generation of the data model's object instances (see DM_INST_VECTOR_GetGeneration) when resolved_params was cached
+    ctrust_role_t resolved_params_inherited_role; // Roles of the recipient controller used when resolving resolved_params
+    ctrust_role_t resolved_params_assigned_role;
 } subs_t;
 
 //------------------------------------------------------------------------------
@@ -95,6 +126,8 @@ void SUBS_VECTOR_Add(subs_vector_t *sv, subs_t *sub);
 void SUBS_VECTOR_Remove(subs_vector_t *sv, subs_t *sub);
 void SUBS_VECTOR_Destroy(subs_vector_t *sv);
 void SUBS_VECTOR_DestroySubscriber(subs_t *sub);
+void SUBS_VECTOR_DestroyValueDigests(value_digest_vector_t *vdv);
+void SUBS_VECTOR_DestroyResolvedParams(subs_t *sub);
 subs_t *SUBS_VECTOR_GetSubsByInstance(subs_vector_t *suv, int instance);
 void SUBS_VECTOR_MarkSubscriptionForDeletion(subs_t *sub);
 void SUBS_VECTOR_GarbageCollectSubscriptions(subs_vector_t *suv);
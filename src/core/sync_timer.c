@@ -37,12 +37,15 @@
  *
  * Implements a basic repeating timer mechanism
  * Each timer has a period and a callback. The callback is called
+ * Timers are held in a binary min-heap, ordered by the time at which they should next fire
  *
  */
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <limits.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "common_defs.h"
 #include "sync_timer.h"
@@ -53,31 +56,53 @@
 typedef struct
 {
     bool       enabled;         // Cleared after a timeout has fired, to prevent it firing again until an updated time has been registered
-    time_t     next_timeout;    // time at which this timer should next fire
+    long long  next_timeout;    // time (in milliseconds since the epoch) at which this timer should next fire
     timer_cb_t timer_cb;        // function to call when timer period has expired.
     int        id;              // unique identifier for this callback (allocated by caller of this library) within the namespace of the callback
+    int        lookup_index;    // index of the slot in the lookup table which references this timer
+    int        slack;           // Maximum time (in ms) by which this timer may be delayed, so that its wakeup can be coalesced with others
 } sync_timer_t;
 
 //--------------------------------------------------------------------------------------
-// Structure containing a dynamic array of timers
+// Structure containing a dynamic array of timers, organised as a binary min-heap ordered by the time at which each timer should next fire
+// Timers which are not enabled are ordered after all enabled timers. Hence the first entry is always the next timer to fire.
 typedef struct
 {
     int num_entries;
+    int num_allocated;          // Number of entries allocated in the vector
     sync_timer_t *vector;
 } timer_vector_t;
 
 static timer_vector_t sync_timers;
 
 //--------------------------------------------------------------------------------------
-// Variable that is always updated to reflect the time at which the next timer should fire
-static time_t first_sync_timer_time;
+// Open addressing hash table used to find the index of a timer in the heap, given its callback and id
+// Each slot contains the index of a timer in the heap, or LOOKUP_EMPTY if the slot is unused
+static int *timer_lookup = NULL;
+static int timer_lookup_size = 0;       // Number of slots in the table (always a power of 2)
 
+#define LOOKUP_EMPTY (-1)
 
+// Minimum number of slots allocated in the lookup table. The table is resized to keep it at most half full.
+#define TIMER_LOOKUP_MIN_SIZE 64
+
+//--------------------------------------------------------------------------------------
+// Timer key used for timers which are not enabled, so that they are ordered after all enabled timers in the heap
+#define DISABLED_TIMEOUT LLONG_MAX
 
 //------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int FindSyncTimer(timer_cb_t timer_cb, int id);
-void UpdateFirstSyncTimerTime(void);
+unsigned CalcTimerHash(timer_cb_t timer_cb, int id);
+void AddToTimerLookup(int heap_index);
+void RemoveFromTimerLookup(int lookup_index);
+void ResizeTimerLookup(int new_size);
+void RemoveTimerFromHeap(int index);
+void SiftUp(int index);
+void SiftDown(int index);
+void SwapTimers(int index1, int index2);
+long long TimerKey(sync_timer_t *st);
+long long CalcLatestTimeout(int index, long long latest);
 
 /*********************************************************************//**
 **
@@ -94,7 +119,9 @@ void SYNC_TIMER_Init(void)
 {
     sync_timers.vector = NULL;
     sync_timers.num_entries = 0;
-    first_sync_timer_time = END_OF_TIME;
+    sync_timers.num_allocated = 0;
+    timer_lookup = NULL;
+    timer_lookup_size = 0;
 }
 
 /*********************************************************************//**
@@ -111,7 +138,10 @@ void SYNC_TIMER_Init(void)
 void SYNC_TIMER_Destroy(void)
 {
     USP_SAFE_FREE(sync_timers.vector);
-
+    USP_SAFE_FREE(timer_lookup);
+    sync_timers.num_entries = 0;
+    sync_timers.num_allocated = 0;
+    timer_lookup_size = 0;
 }
 
 /*********************************************************************//**
@@ -129,7 +159,24 @@ void SYNC_TIMER_Destroy(void)
 **************************************************************************/
 int SYNC_TIMER_Add(timer_cb_t timer_cb, int id, time_t callback_time)
 {
-    int new_num_entries;
+    return SYNC_TIMER_AddMs(timer_cb, id, ((long long)callback_time)*1000);
+}
+
+/*********************************************************************//**
+**
+** SYNC_TIMER_AddMs
+**
+** Adds a new timer which will callback the specified function at the specified time (with millisecond resolution)
+**
+** \param   timer_cb - callback function to call when timer expires - This also identifies a namespace for the id
+** \param   id - unique identifier for this sync timer, within the namespace of the callback
+** \param   callback_time_ms - absolute time (in milliseconds since the epoch) at which the callback should fire
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int SYNC_TIMER_AddMs(timer_cb_t timer_cb, int id, long long callback_time_ms)
+{
     sync_timer_t *st;
     int index;
 
@@ -148,19 +195,32 @@ int SYNC_TIMER_Add(timer_cb_t timer_cb, int id, time_t callback_time)
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Add this timer to the vector
-    new_num_entries = sync_timers.num_entries + 1;
-    sync_timers.vector = USP_REALLOC(sync_timers.vector, new_num_entries*sizeof(sync_timer_t));
-    st = &sync_timers.vector[ sync_timers.num_entries ];
+    // Increase the size of the vector, if required
+    if (sync_timers.num_entries == sync_timers.num_allocated)
+    {
+        sync_timers.num_allocated = (sync_timers.num_allocated == 0) ? 8 : 2*sync_timers.num_allocated;
+        sync_timers.vector = USP_REALLOC(sync_timers.vector, sync_timers.num_allocated*sizeof(sync_timer_t));
+    }
+
+    // Increase the size of the lookup table, if it would be more than half full
+    if (2*(sync_timers.num_entries+1) > timer_lookup_size)
+    {
+        ResizeTimerLookup((timer_lookup_size == 0) ? TIMER_LOOKUP_MIN_SIZE : 2*timer_lookup_size);
+    }
+
+    // Add this timer to the end of the heap
+    index = sync_timers.num_entries;
+    st = &sync_timers.vector[index];
     st->timer_cb = timer_cb;
     st->id = id;
-    st->next_timeout = callback_time;
+    st->next_timeout = callback_time_ms;
     st->enabled = true;
+    st->slack = 0;
+    sync_timers.num_entries++;
+    AddToTimerLookup(index);
 
-    sync_timers.num_entries = new_num_entries;
-
-    // Update the time at which the next timer should fire
-    UpdateFirstSyncTimerTime();
+    // Move the timer to its correct position in the heap
+    SiftUp(index);
 
     return USP_ERR_OK;
 }
@@ -179,6 +239,24 @@ int SYNC_TIMER_Add(timer_cb_t timer_cb, int id, time_t callback_time)
 **
 **************************************************************************/
 int SYNC_TIMER_Reload(timer_cb_t timer_cb, int id, time_t callback_time)
+{
+    return SYNC_TIMER_ReloadMs(timer_cb, id, ((long long)callback_time)*1000);
+}
+
+/*********************************************************************//**
+**
+** SYNC_TIMER_ReloadMs
+**
+** Restarts the specified timer with a new time to fire (with millisecond resolution)
+**
+** \param   timer_cb - callback function to call when timer expires - This also identifies a namespace for the id
+** \param   id - unique identifier for this sync timer, within the namespace of the callback
+** \param   callback_time_ms - absolute time (in milliseconds since the epoch) at which the callback should fire
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int SYNC_TIMER_ReloadMs(timer_cb_t timer_cb, int id, long long callback_time_ms)
 {
     sync_timer_t *st;
     int index;
@@ -194,30 +272,33 @@ int SYNC_TIMER_Reload(timer_cb_t timer_cb, int id, time_t callback_time)
     // Reload the timer
     st = &sync_timers.vector[index];
     st->enabled = true;
-    st->next_timeout = callback_time;
+    st->next_timeout = callback_time_ms;
 
-    // Update the time at which the next timer should fire
-    UpdateFirstSyncTimerTime();
+    // Move the timer to its correct position in the heap
+    SiftUp(index);
+    SiftDown(index);
 
     return USP_ERR_OK;
 }
 
 /*********************************************************************//**
 **
-** SYNC_TIMER_Remove
+** SYNC_TIMER_SetSlack
 **
-** Removes the specified timer
+** Sets the maximum time by which the specified timer may fire late
+** Threads waiting for socket activity use this slack to coalesce the wakeups for several timers into one (see SYNC_TIMER_LatestTimeToNext)
+** NOTE: The slack is retained when the timer is reloaded
 **
 ** \param   timer_cb - callback function to call when timer expires - This also identifies a namespace for the id
 ** \param   id - unique identifier for this sync timer, within the namespace of the callback
+** \param   slack_ms - maximum time (in ms) by which the timer may be delayed. 0 if the timer should fire on time
 **
 ** \return  USP_ERR_OK if successful
 **
 **************************************************************************/
-int SYNC_TIMER_Remove(timer_cb_t timer_cb, int id)
+int SYNC_TIMER_SetSlack(timer_cb_t timer_cb, int id, int slack_ms)
 {
     int index;
-    int num_to_move;
 
     // Exit if timer could not be found
     index = FindSyncTimer(timer_cb, id);
@@ -227,16 +308,37 @@ int SYNC_TIMER_Remove(timer_cb_t timer_cb, int id)
         return USP_ERR_INTERNAL_ERROR;
     }
 
-    // Remove this timer from the vector, by moving down the rest of the timers in the array
-    num_to_move = sync_timers.num_entries - 1 - index;
-    if (num_to_move > 0)
+    // NOTE: The position of the timer in the heap does not change, as the heap is ordered by the time at which timers should fire
+    sync_timers.vector[index].slack = (slack_ms > 0) ? slack_ms : 0;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** SYNC_TIMER_Remove
+**
+** Removes the specified timer
+**
+** \param   timer_cb - callback function to call when timer expires - This also identifies a namespace for the id
+** \param   id - unique identifier for this sync timer, within the namespace of the callback
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int SYNC_TIMER_Remove(timer_cb_t timer_cb, int id)
+{
+    int index;
+
+    // Exit if timer could not be found
+    index = FindSyncTimer(timer_cb, id);
+    if (index == INVALID)
     {
-        memmove(&sync_timers.vector[index], &sync_timers.vector[index+1], num_to_move*sizeof(sync_timer_t));
+        USP_ERR_SetMessage("%s: Unable to find timer registered with callback=%p, id=%d", __FUNCTION__, timer_cb, id);
+        return USP_ERR_INTERNAL_ERROR;
     }
-    sync_timers.num_entries--;
 
-    // Update the time at which the next timer should fire
-    UpdateFirstSyncTimerTime();
+    RemoveTimerFromHeap(index);
 
     return USP_ERR_OK;
 }
@@ -249,32 +351,107 @@ int SYNC_TIMER_Remove(timer_cb_t timer_cb, int id)
 **
 ** \param   None
 **
-** \return  time in seconds until next timer should fire
+** \return  time in ms until next timer should fire
 **
 **************************************************************************/
 int SYNC_TIMER_TimeToNext(void)
 {
-    time_t cur_time;
-    int delta;
+    sync_timer_t *st;
+    long long delta;
+
+    // Exit with largest delay possible, if there are no enabled timers
+    // NOTE: The first timer in the heap is always the next to fire
+    st = &sync_timers.vector[0];
+    if ((sync_timers.num_entries == 0) || (st->enabled == false))
+    {
+        return INT_MAX;
+    }
     
     // Calculate the time delta from now to the time at which the first timer should fire
-    cur_time = time(NULL);
-    delta = first_sync_timer_time - cur_time;
+    delta = st->next_timeout - SYNC_TIMER_TimeMs();
+
+    // If the first sync time should already have fired, then just return a zero delay
+    if (delta < 0)
+    {
+        delta = 0;
+    }
+
+    // Exit with largest delay possible, if actual delay wanted is larger than that
+    if (delta > INT_MAX)
+    {
+        return INT_MAX;
+    }
+
+    return (int) delta;
+}
+
+/*********************************************************************//**
+**
+** SYNC_TIMER_LatestTimeToNext
+**
+** Returns the latest time (in ms) that the next timer(s) may be delayed until, taking into account the slack of each timer
+** Waiting for any time between SYNC_TIMER_TimeToNext() and this time, fires the next timer without making any timer later than it tolerates
+**
+** \param   None
+**
+** \return  time in ms until the timers must be fired
+**
+**************************************************************************/
+int SYNC_TIMER_LatestTimeToNext(void)
+{
+    long long delta;
+
+    // Exit with largest delay possible, if there are no enabled timers
+    if ((sync_timers.num_entries == 0) || (sync_timers.vector[0].enabled == false))
+    {
+        return INT_MAX;
+    }
 
-    // If the first sync time should already have fired, then just return a zero second delay
+    // Calculate the time delta from now to the earliest time that any timer's slack expires
+    delta = CalcLatestTimeout(0, DISABLED_TIMEOUT) - SYNC_TIMER_TimeMs();
+
+    // If the slack of a timer has already expired, then just return a zero delay
     if (delta < 0)
     {
         delta = 0;
     }
 
     // Exit with largest delay possible, if actual delay wanted is larger than that
-    if (delta > (INT_MAX/1000))
+    if (delta > INT_MAX)
     {
         return INT_MAX;
     }
 
-    // Return time in ms
-    return delta * 1000;
+    return (int) delta;
+}
+
+/*********************************************************************//**
+**
+** SYNC_TIMER_TimeMs
+**
+** Returns the current time in milliseconds since the epoch
+** This is the time base used by SYNC_TIMER_AddMs() and SYNC_TIMER_ReloadMs()
+** NOTE: On Linux, time() reads the coarse realtime clock, which may lag gettimeofday() by up to a scheduler tick.
+**       The coarse clock is used here so that a timer set for time T (in seconds) never fires whilst time() still returns T-1
+**
+** \param   None
+**
+** \return  current time in milliseconds
+**
+**************************************************************************/
+long long SYNC_TIMER_TimeMs(void)
+{
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ((long long)ts.tv_sec)*1000 + (ts.tv_nsec/1000000);
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000 + (tv.tv_usec/1000);
+#endif
 }
 
 /*********************************************************************//**
@@ -291,36 +468,49 @@ int SYNC_TIMER_TimeToNext(void)
 void SYNC_TIMER_Execute(void)
 {
     int i;
-    time_t cur_time;
+    int index;
+    long long cur_time;
     sync_timer_t *st;
-    timer_cb_t timer_cb;
+    int num_fired;
+    sync_timer_t *fired;
 
     // Exit if it is not yet time for any of the timers to fire
-    cur_time = time(NULL);
-    if (cur_time < first_sync_timer_time)
+    cur_time = SYNC_TIMER_TimeMs();
+    st = &sync_timers.vector[0];
+    if ((sync_timers.num_entries == 0) || (st->enabled == false) || (cur_time < st->next_timeout))
     {
         return;
     }
 
-    // Iterate over all timers
-    for (i=0; i < sync_timers.num_entries; i++)
+    // Mark all timers which should fire as fired, taking a copy of them
+    // NOTE: The callbacks are not called until all timers which should fire have been determined,
+    // because the callbacks may add, reload or remove timers (modifying the heap)
+    fired = USP_MALLOC(sync_timers.num_entries*sizeof(sync_timer_t));
+    num_fired = 0;
+    while ((sync_timers.num_entries > 0) && (st->enabled) && (cur_time >= st->next_timeout))
+    {
+        // Mark the timer as fired, if the callback wants the timer to continue, then it can call SYNC_TIMER_Reload()
+        memcpy(&fired[num_fired], st, sizeof(sync_timer_t));
+        num_fired++;
+        st->enabled = false;
+        SiftDown(0);
+    }
+
+    // Call the registered callback of all timers which fired
+    for (i=0; i < num_fired; i++)
     {
-        // Determine if this timer should fire
-        st = &sync_timers.vector[i];
-        if ((st->enabled) && (cur_time >= st->next_timeout))
+        // Skip this timer if it has been removed or reloaded by the callback of a timer which fired before it
+        index = FindSyncTimer(fired[i].timer_cb, fired[i].id);
+        if ((index == INVALID) || (sync_timers.vector[index].enabled))
         {
-            // Mark the timer as fired, if the callback wants the timer to continue, then it can call SYNC_TIMER_Reload()
-            st->enabled = false;
-    
-            // Call the registered callback
-            timer_cb = st->timer_cb;
-            USP_ASSERT(timer_cb != NULL)
-            timer_cb(st->id);
+            continue;
         }
+
+        USP_ASSERT(fired[i].timer_cb != NULL)
+        fired[i].timer_cb(fired[i].id);
     }
 
-    // Update the time at which the next timer should fire
-    UpdateFirstSyncTimerTime();
+    USP_FREE(fired);
 }
 
 /*********************************************************************//**
@@ -340,10 +530,28 @@ void SYNC_TIMER_Execute(void)
 **************************************************************************/
 void *SYNC_TIMER_PRIV_GetVector(int *allocated_size)
 {
-    *allocated_size = sync_timers.num_entries * sizeof(timer_vector_t);
+    *allocated_size = sync_timers.num_allocated * sizeof(sync_timer_t);
     return sync_timers.vector;
 }
 
+/*********************************************************************//**
+**
+** SYNC_TIMER_PRIV_GetLookup
+**
+** Gets information about the dynamically allocated sync timers lookup table
+** This information is necessary to make meminfo collection work correctly (see SYNC_TIMER_PRIV_GetVector)
+**
+** \param   allocated_size - pointer to variable in which to return the size of the lookup table
+**
+** \return  pointer to memory allocated for the lookup table
+**
+**************************************************************************/
+void *SYNC_TIMER_PRIV_GetLookup(int *allocated_size)
+{
+    *allocated_size = timer_lookup_size * sizeof(int);
+    return timer_lookup;
+}
+
 /*********************************************************************//**
 **
 ** FindSyncTimer
@@ -352,22 +560,34 @@ void *SYNC_TIMER_PRIV_GetVector(int *allocated_size)
 **
 ** \param   timer_cb - callback function identifying the timer to reload
 **
-** \return  index of matching timer, or INVALID if no match was found
+** \return  index of matching timer in the heap, or INVALID if no match was found
 **
 **************************************************************************/
 int FindSyncTimer(timer_cb_t timer_cb, int id)
 {
-    int i;
+    unsigned mask;
+    unsigned slot;
+    int index;
     sync_timer_t *st;
+
+    // Exit if no timers have been added yet
+    if (timer_lookup == NULL)
+    {
+        return INVALID;
+    }
     
-    // Iterate over all timers
-    for (i=0; i < sync_timers.num_entries; i++)
+    // Iterate over all slots which could contain the timer (using linear probing)
+    mask = timer_lookup_size - 1;
+    slot = CalcTimerHash(timer_cb, id) & mask;
+    while (timer_lookup[slot] != LOOKUP_EMPTY)
     {
-        st = &sync_timers.vector[i];
+        index = timer_lookup[slot];
+        st = &sync_timers.vector[index];
         if ((st->timer_cb == timer_cb) && (st->id == id))
         {
-            return i;
+            return index;
         }
+        slot = (slot + 1) & mask;
     }
 
     // If the code gets here, then no match was found
@@ -376,38 +596,309 @@ int FindSyncTimer(timer_cb_t timer_cb, int id)
 
 /*********************************************************************//**
 **
-** UpdateFirstSyncTimerTime
+** CalcTimerHash
 **
-** Updates the time at which the first timer should fire
+** Calculates the hash used to look up a timer, given its callback and id
 **
-** \param   None
+** \param   timer_cb - callback function identifying the timer
+** \param   id - unique identifier for the timer, within the namespace of the callback
+**
+** \return  hash of the timer
+**
+**************************************************************************/
+unsigned CalcTimerHash(timer_cb_t timer_cb, int id)
+{
+    unsigned hash;
+
+    hash = (unsigned)(uintptr_t)timer_cb;
+    hash ^= (unsigned)id * 2654435761u;     // Knuth's multiplicative hash
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/*********************************************************************//**
+**
+** AddToTimerLookup
+**
+** Adds the specified timer to the lookup table
+** NOTE: The caller must ensure that the lookup table has a free slot
+**
+** \param   heap_index - index of the timer in the heap
 **
 ** \return  None
 **
 **************************************************************************/
-void UpdateFirstSyncTimerTime(void)
+void AddToTimerLookup(int heap_index)
 {
-    int i;
+    unsigned mask;
+    unsigned slot;
     sync_timer_t *st;
-    time_t first;
-    
-    // Iterate over all timers
-    first = END_OF_TIME;
+
+    // Find a free slot in the table (using linear probing)
+    st = &sync_timers.vector[heap_index];
+    mask = timer_lookup_size - 1;
+    slot = CalcTimerHash(st->timer_cb, st->id) & mask;
+    while (timer_lookup[slot] != LOOKUP_EMPTY)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    timer_lookup[slot] = heap_index;
+    st->lookup_index = slot;
+}
+
+/*********************************************************************//**
+**
+** RemoveFromTimerLookup
+**
+** Removes the specified slot from the lookup table
+** Subsequent entries in the same probe sequence are moved back, so that they can still be found
+**
+** \param   lookup_index - slot in the lookup table to remove
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveFromTimerLookup(int lookup_index)
+{
+    unsigned mask;
+    unsigned hole;
+    unsigned slot;
+    unsigned home;
+    sync_timer_t *st;
+
+    mask = timer_lookup_size - 1;
+    hole = lookup_index;
+    timer_lookup[hole] = LOOKUP_EMPTY;
+
+    // Iterate over all subsequent entries in the probe sequence
+    slot = (hole + 1) & mask;
+    while (timer_lookup[slot] != LOOKUP_EMPTY)
+    {
+        // Move this entry into the hole, if the hole lies between its home slot and its current slot
+        st = &sync_timers.vector[ timer_lookup[slot] ];
+        home = CalcTimerHash(st->timer_cb, st->id) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            timer_lookup[hole] = timer_lookup[slot];
+            timer_lookup[slot] = LOOKUP_EMPTY;
+            st->lookup_index = hole;
+            hole = slot;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+}
+
+/*********************************************************************//**
+**
+** ResizeTimerLookup
+**
+** Reallocates the lookup table with the specified number of slots, rehashing all timers into it
+**
+** \param   new_size - number of slots in the new table (must be a power of 2)
+**
+** \return  None
+**
+**************************************************************************/
+void ResizeTimerLookup(int new_size)
+{
+    int i;
+
+    timer_lookup = USP_REALLOC(timer_lookup, new_size*sizeof(int));
+    timer_lookup_size = new_size;
+    for (i=0; i < new_size; i++)
+    {
+        timer_lookup[i] = LOOKUP_EMPTY;
+    }
+
     for (i=0; i < sync_timers.num_entries; i++)
     {
-        // Skip this timer if it is not enabled
-        st = &sync_timers.vector[i];
-        if (st->enabled == false)
+        AddToTimerLookup(i);
+    }
+}
+
+/*********************************************************************//**
+**
+** RemoveTimerFromHeap
+**
+** Removes the timer at the specified index from the heap
+**
+** \param   index - index of the timer in the heap
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveTimerFromHeap(int index)
+{
+    int last;
+
+    RemoveFromTimerLookup(sync_timers.vector[index].lookup_index);
+
+    // Exit if the timer was the last in the heap - nothing else to do
+    last = sync_timers.num_entries - 1;
+    sync_timers.num_entries--;
+    if (index == last)
+    {
+        return;
+    }
+
+    // Move the last timer into the position vacated, then move it to its correct position in the heap
+    memcpy(&sync_timers.vector[index], &sync_timers.vector[last], sizeof(sync_timer_t));
+    timer_lookup[ sync_timers.vector[index].lookup_index ] = index;
+    SiftUp(index);
+    SiftDown(index);
+}
+
+/*********************************************************************//**
+**
+** SiftUp
+**
+** Moves the specified timer up the heap, until its parent fires before it
+**
+** \param   index - index of the timer in the heap
+**
+** \return  None
+**
+**************************************************************************/
+void SiftUp(int index)
+{
+    int parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1)/2;
+        if (TimerKey(&sync_timers.vector[parent]) <= TimerKey(&sync_timers.vector[index]))
         {
-            continue;
+            break;
+        }
+
+        SwapTimers(index, parent);
+        index = parent;
+    }
+}
+
+/*********************************************************************//**
+**
+** SiftDown
+**
+** Moves the specified timer down the heap, until both its children fire after it
+**
+** \param   index - index of the timer in the heap
+**
+** \return  None
+**
+**************************************************************************/
+void SiftDown(int index)
+{
+    int child;
+    int smallest;
+
+    while (FOREVER)
+    {
+        // Determine which of this timer and its children fires first
+        smallest = index;
+        child = 2*index + 1;
+        if ((child < sync_timers.num_entries) && (TimerKey(&sync_timers.vector[child]) < TimerKey(&sync_timers.vector[smallest])))
+        {
+            smallest = child;
         }
 
-        // Update the time at which the first timer fires
-        if (st->next_timeout < first)
+        child++;
+        if ((child < sync_timers.num_entries) && (TimerKey(&sync_timers.vector[child]) < TimerKey(&sync_timers.vector[smallest])))
         {
-            first = st->next_timeout;
+            smallest = child;
         }
+
+        // Exit if this timer fires before both its children
+        if (smallest == index)
+        {
+            return;
+        }
+
+        SwapTimers(index, smallest);
+        index = smallest;
     }
+}
+
+/*********************************************************************//**
+**
+** SwapTimers
+**
+** Swaps the position of two timers in the heap, updating the lookup table
+**
+** \param   index1 - index of first timer in the heap
+** \param   index2 - index of second timer in the heap
+**
+** \return  None
+**
+**************************************************************************/
+void SwapTimers(int index1, int index2)
+{
+    sync_timer_t temp;
+    sync_timer_t *st1;
+    sync_timer_t *st2;
+
+    st1 = &sync_timers.vector[index1];
+    st2 = &sync_timers.vector[index2];
+    memcpy(&temp, st1, sizeof(sync_timer_t));
+    memcpy(st1, st2, sizeof(sync_timer_t));
+    memcpy(st2, &temp, sizeof(sync_timer_t));
+
+    timer_lookup[st1->lookup_index] = index1;
+    timer_lookup[st2->lookup_index] = index2;
+}
+
+/*********************************************************************//**
+**
+** TimerKey
+**
+** Returns the key used to order the specified timer in the heap
+**
+** \param   st - pointer to timer
+**
+** \return  time at which the timer should fire, or DISABLED_TIMEOUT if the timer is not enabled
+**
+**************************************************************************/
+long long TimerKey(sync_timer_t *st)
+{
+    return (st->enabled) ? st->next_timeout : DISABLED_TIMEOUT;
+}
+
+/*********************************************************************//**
+**
+** CalcLatestTimeout
+**
+** Calculates the earliest time at which the slack of any timer in the specified subtree of the heap expires
+** NOTE: Subtrees whose root fires after the latest time found so far are not searched, as none of their timers can reduce it.
+**       Hence only the timers which fire before the slack of the next timer expires are visited
+**
+** \param   index - index of the timer in the heap at the root of the subtree
+** \param   latest - earliest time (in ms since the epoch) at which the slack of a timer expires, found so far
+**
+** \return  earliest time (in ms since the epoch) at which the slack of a timer expires
+**
+**************************************************************************/
+long long CalcLatestTimeout(int index, long long latest)
+{
+    sync_timer_t *st;
+
+    // Exit if no timer in this subtree fires before the latest time found so far
+    // NOTE: This also skips all disabled timers, as their key is DISABLED_TIMEOUT
+    if ((index >= sync_timers.num_entries) || (TimerKey(&sync_timers.vector[index]) >= latest))
+    {
+        return latest;
+    }
+
+    st = &sync_timers.vector[index];
+    if (st->next_timeout + st->slack < latest)
+    {
+        latest = st->next_timeout + st->slack;
+    }
+
+    latest = CalcLatestTimeout(2*index + 1, latest);
+    latest = CalcLatestTimeout(2*index + 2, latest);
 
-    first_sync_timer_time = first;
+    return latest;
 }
@@ -53,10 +53,16 @@ typedef void (*timer_cb_t)(int id);
 void SYNC_TIMER_Init(void);
 void SYNC_TIMER_Destroy(void);
 int SYNC_TIMER_Add(timer_cb_t timer_cb, int id, time_t callback_time);
+int SYNC_TIMER_AddMs(timer_cb_t timer_cb, int id, long long callback_time_ms);
 int SYNC_TIMER_Reload(timer_cb_t timer_cb, int id, time_t callback_time);
+int SYNC_TIMER_ReloadMs(timer_cb_t timer_cb, int id, long long callback_time_ms);
+int SYNC_TIMER_SetSlack(timer_cb_t timer_cb, int id, int slack_ms);
 int SYNC_TIMER_Remove(timer_cb_t timer_cb, int id);
 int SYNC_TIMER_TimeToNext(void);
+int SYNC_TIMER_LatestTimeToNext(void);
+long long SYNC_TIMER_TimeMs(void);
 void SYNC_TIMER_Execute(void);
 void *SYNC_TIMER_PRIV_GetVector(int *allocated_size);
+void *SYNC_TIMER_PRIV_GetLookup(int *allocated_size);
 
 #endif
@@ -0,0 +1,335 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file task_pool.c
+ *
+ * Implements a bounded pool of worker threads which run tasks queued by USP_TASK_Queue()
+ * Typically the tasks are the bodies of asynchronous operations. Running them on a shared pool of threads
+ * (rather than starting a thread for each operation) bounds the number of threads (and thread stacks) in use,
+ * when many asynchronous operations are requested at the same time (eg diagnostics across many interfaces)
+ * Worker threads are only started when a task is queued and all existing worker threads are busy
+ * Queued tasks are started in order of priority, then in the order that they were queued
+ *
+ */
+#include <string.h>
+#include <pthread.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "os_utils.h"
+#include "task_pool.h"
+
+//------------------------------------------------------------------------------
+// Task waiting to be run by a worker thread
+typedef struct task_tag
+{
+    struct task_tag *next;
+    usp_task_cb_t task_cb;
+    void *arg;
+} task_t;
+
+//------------------------------------------------------------------------------
+// Queue of tasks for each priority
+typedef struct
+{
+    task_t *head;
+    task_t *tail;
+} task_queue_t;
+
+static task_queue_t task_queues[kUspTaskPriority_Max];
+
+//------------------------------------------------------------------------------
+// Mutex protecting the task queues and counts, and condition variable which is signalled when a task has been queued
+static pthread_mutex_t task_pool_mutex;
+static pthread_cond_t task_available_cond;
+static bool is_task_pool_initialised = false;
+
+static int num_queued_tasks = 0;    // Number of tasks waiting in the task queues
+static int num_worker_threads = 0;  // Number of worker threads which have been started
+static int num_idle_threads = 0;    // Number of worker threads waiting for a task to run
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void *TaskPoolWorkerMain(void *args);
+task_t *PopHighestPriorityTask(void);
+
+/*********************************************************************//**
+**
+** TASK_POOL_Init
+**
+** Initialises the functionality in this module
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int TASK_POOL_Init(void)
+{
+    int err;
+
+    memset(task_queues, 0, sizeof(task_queues));
+
+    // Exit if unable to create the mutex and condition variable used to pass tasks to the worker threads
+    err = OS_UTILS_InitMutex(&task_pool_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    err = pthread_cond_init(&task_available_cond, NULL);
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("pthread_cond_init", err);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    is_task_pool_initialised = true;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_TASK_Queue
+**
+** Queues a task to be run by the pool of worker threads
+** This function may be called from any thread, and never blocks waiting for the task to run
+**
+** \param   task_cb - function to call on a worker thread to run the task
+** \param   arg - argument to pass to task_cb. Ownership of any memory it points to passes to the task
+** \param   priority - priority of the task. Queued tasks of higher priority are started before those of lower priority
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_RESOURCES_EXCEEDED if too many tasks are already waiting to run
+**
+**************************************************************************/
+int USP_TASK_Queue(usp_task_cb_t task_cb, void *arg, usp_task_priority_t priority)
+{
+    int err;
+    task_t *task;
+    task_queue_t *tq;
+    bool start_thread;
+    bool is_no_threads;
+
+    USP_ASSERT(task_cb != NULL);
+
+    // Exit if the task pool has not been initialised
+    if (is_task_pool_initialised == false)
+    {
+        USP_ERR_SetMessage("%s: Task pool has not been initialised", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    if (((int)priority < 0) || (priority >= kUspTaskPriority_Max))
+    {
+        priority = kUspTaskPriority_Normal;
+    }
+
+    // Exit if too many tasks are already waiting to run
+    OS_UTILS_LockMutex(&task_pool_mutex);
+    if (num_queued_tasks >= MAX_QUEUED_TASKS)
+    {
+        OS_UTILS_UnlockMutex(&task_pool_mutex);
+        USP_ERR_SetMessage("%s: Unable to queue task (%d tasks already waiting to run)", __FUNCTION__, MAX_QUEUED_TASKS);
+        return USP_ERR_RESOURCES_EXCEEDED;
+    }
+
+    // Determine whether another worker thread is needed to run the task (ie all worker threads are busy running other tasks)
+    start_thread = ((num_queued_tasks >= num_idle_threads) && (num_worker_threads < NUM_TASK_POOL_THREADS));
+    if (start_thread)
+    {
+        num_worker_threads++;
+    }
+    OS_UTILS_UnlockMutex(&task_pool_mutex);
+
+    // Start another worker thread, if needed
+    // If this fails, the task still runs once an existing worker thread becomes free
+    if (start_thread)
+    {
+        err = OS_UTILS_CreateClassThread(kThreadClass_Task, TaskPoolWorkerMain, NULL);
+        if (err != USP_ERR_OK)
+        {
+            OS_UTILS_LockMutex(&task_pool_mutex);
+            num_worker_threads--;
+            is_no_threads = (num_worker_threads == 0);
+            OS_UTILS_UnlockMutex(&task_pool_mutex);
+
+            // Exit if there are no worker threads to run the task
+            if (is_no_threads)
+            {
+                return USP_ERR_INTERNAL_ERROR;
+            }
+        }
+    }
+
+    // Add the task to the tail of the queue for its priority, and wake up an idle worker thread to run it
+    task = USP_MALLOC(sizeof(task_t));
+    task->next = NULL;
+    task->task_cb = task_cb;
+    task->arg = arg;
+
+    OS_UTILS_LockMutex(&task_pool_mutex);
+    tq = &task_queues[priority];
+    if (tq->tail == NULL)
+    {
+        tq->head = task;
+    }
+    else
+    {
+        tq->tail->next = task;
+    }
+    tq->tail = task;
+    num_queued_tasks++;
+    pthread_cond_signal(&task_available_cond);
+    OS_UTILS_UnlockMutex(&task_pool_mutex);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** TASK_POOL_Dump
+**
+** Logs the current state of the pool of worker threads (for debug)
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void TASK_POOL_Dump(void)
+{
+    int i;
+    int threads;
+    int busy;
+    int queued;
+    int per_priority[kUspTaskPriority_Max];
+    task_t *task;
+
+    OS_UTILS_LockMutex(&task_pool_mutex);
+    threads = num_worker_threads;
+    busy = num_worker_threads - num_idle_threads;
+    queued = num_queued_tasks;
+    for (i=0; i<kUspTaskPriority_Max; i++)
+    {
+        per_priority[i] = 0;
+        for (task = task_queues[i].head; task != NULL; task = task->next)
+        {
+            per_priority[i]++;
+        }
+    }
+    OS_UTILS_UnlockMutex(&task_pool_mutex);
+
+    USP_DUMP("Task pool: %d of %d worker threads started (%d busy)", threads, NUM_TASK_POOL_THREADS, busy);
+    USP_DUMP("Queued tasks: %d (max %d) [high=%d, normal=%d, low=%d]", queued, MAX_QUEUED_TASKS,
+             per_priority[kUspTaskPriority_High], per_priority[kUspTaskPriority_Normal], per_priority[kUspTaskPriority_Low]);
+}
+
+/*********************************************************************//**
+**
+** TaskPoolWorkerMain
+**
+** Main loop of a worker thread in the task pool
+** Each worker thread runs queued tasks, one at a time, highest priority first
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None, this thread never exits
+**
+**************************************************************************/
+void *TaskPoolWorkerMain(void *args)
+{
+    task_t *task;
+
+    while(FOREVER)
+    {
+        // Wait for a task to run, then remove it from its queue
+        OS_UTILS_LockMutex(&task_pool_mutex);
+        num_idle_threads++;
+        while (num_queued_tasks == 0)
+        {
+            pthread_cond_wait(&task_available_cond, &task_pool_mutex);
+        }
+        num_idle_threads--;
+        task = PopHighestPriorityTask();
+        OS_UTILS_UnlockMutex(&task_pool_mutex);
+
+        // Run the task
+        task->task_cb(task->arg);
+        USP_FREE(task);
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** PopHighestPriorityTask
+**
+** Removes the highest priority (and then oldest) task from the task queues
+** NOTE: This function must be called with the task pool mutex held, and there must be at least one task queued
+**
+** \param   None
+**
+** \return  pointer to task removed from the task queues
+**
+**************************************************************************/
+task_t *PopHighestPriorityTask(void)
+{
+    int i;
+    task_t *task;
+    task_queue_t *tq;
+
+    for (i=0; i<kUspTaskPriority_Max; i++)
+    {
+        tq = &task_queues[i];
+        if (tq->head != NULL)
+        {
+            task = tq->head;
+            tq->head = task->next;
+            if (tq->head == NULL)
+            {
+                tq->tail = NULL;
+            }
+            num_queued_tasks--;
+            return task;
+        }
+    }
+
+    // The code should never get here, as there is always at least one task queued
+    USP_ASSERT(false);
+    return NULL;
+}
@@ -0,0 +1,191 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file text_hash.c
+ *
+ * Implements the hash functions used to key strings (eg data model paths and names)
+ * NOTE: These functions are kept separate from the rest of text_utils.c, and have no dependencies other than
+ *       the C library, so that they may also be linked into build time tools (eg obuspa_schemac) which
+ *       precompute hashes that must match those calculated by the agent
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "text_hash.h"
+
+/*********************************************************************//**
+**
+** TEXT_UTILS_CalcHash
+**
+** Implements a 32 bit hash of the specified string
+** Implemented using the FNV1a algorithm
+**
+** \param   s - pointer to string to calculate the hash of
+**
+** \return  hash value
+**
+**************************************************************************/
+int TEXT_UTILS_CalcHash(char *s)
+{
+    unsigned hash = TEXT_UTILS_HASH_INIT;
+
+    while (*s != '\0')
+    {
+        hash = TEXT_UTILS_HASH_ADD(hash, *s);
+        s++;
+    }
+
+    return (int)hash;
+}
+
+/*********************************************************************//**
+**
+** TEXT_UTILS_CalcHash64
+**
+** Implements a 64 bit hash of the specified string
+** Implemented using the FNV1a algorithm
+** NOTE: This is used where a hash must stand in for the string itself (so must make collisions vanishingly unlikely)
+**
+** \param   s - pointer to string to calculate the hash of
+**
+** \return  hash value
+**
+**************************************************************************/
+uint64_t TEXT_UTILS_CalcHash64(char *s)
+{
+    #define OFFSET_BASIS_64 (0xCBF29CE484222325ULL)
+    #define FNV_PRIME_64 (0x100000001B3ULL)
+    uint64_t hash = OFFSET_BASIS_64;
+
+    while (*s != '\0')
+    {
+        hash = hash ^ ((unsigned char)*s);
+        hash = hash * FNV_PRIME_64;
+        s++;
+    }
+
+    return hash;
+}
+
+/*********************************************************************//**
+**
+** TEXT_UTILS_CalcWordHash64
+**
+** Implements a 64 bit hash of the specified string, consuming the string a 64 bit word at a time
+** The mixing steps are those of MurmurHash3, and the words are always read as little endian,
+** so that the hash value is the same on all platforms (it may be stored persistently)
+** NOTE: This is faster than TEXT_UTILS_CalcHash64() for all but the shortest strings, but gives different hash values
+**
+** \param   s - pointer to string to calculate the hash of
+**
+** \return  hash value
+**
+**************************************************************************/
+uint64_t TEXT_UTILS_CalcWordHash64(char *s)
+{
+    #define ROTL64(x, n)  (((x) << (n)) | ((x) >> (64-(n))))
+    #define WORD_HASH_C1 (0x87C37B91114253D5ULL)
+    #define WORD_HASH_C2 (0x4CF5AD432745937FULL)
+    unsigned char *p = (unsigned char *)s;
+    size_t len;
+    size_t remaining;
+    uint64_t hash;
+    uint64_t word;
+    int i;
+
+    len = strlen(s);
+    hash = len;
+
+    // Mix in all whole words of the string
+    for (remaining = len; remaining >= sizeof(uint64_t); remaining -= sizeof(uint64_t))
+    {
+        memcpy(&word, p, sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        word = __builtin_bswap64(word);
+#endif
+        word = ROTL64(word * WORD_HASH_C1, 31) * WORD_HASH_C2;
+        hash = ROTL64(hash ^ word, 27) * 5 + 0x52DCE729;
+        p += sizeof(uint64_t);
+    }
+
+    // Mix in the trailing bytes of the string (if any)
+    if (remaining > 0)
+    {
+        word = 0;
+        for (i = remaining-1; i >= 0; i--)
+        {
+            word = (word << 8) | p[i];
+        }
+        word = ROTL64(word * WORD_HASH_C1, 31) * WORD_HASH_C2;
+        hash = hash ^ word;
+    }
+
+    // Final avalanche, so that all bits of the hash depend on all bits of the string
+    hash = hash ^ (hash >> 33);
+    hash = hash * 0xFF51AFD7ED558CCDULL;
+    hash = hash ^ (hash >> 33);
+    hash = hash * 0xC4CEB9FE1A85EC53ULL;
+    hash = hash ^ (hash >> 33);
+
+    return hash;
+}
+
+/*********************************************************************//**
+**
+** TEXT_UTILS_CalcBufferHash
+**
+** Implements a 32 bit hash of the specified binary buffer
+** Implemented using the FNV1a algorithm
+**
+** \param   buf - pointer to buffer to calculate the hash of
+** \param   len - number of bytes in the buffer
+**
+** \return  hash value
+**
+**************************************************************************/
+unsigned TEXT_UTILS_CalcBufferHash(unsigned char *buf, int len)
+{
+    unsigned hash = TEXT_UTILS_HASH_INIT;
+    int i;
+
+    for (i=0; i<len; i++)
+    {
+        hash = TEXT_UTILS_HASH_ADD(hash, buf[i]);
+    }
+
+    return hash;
+}
@@ -0,0 +1,59 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file text_hash.h
+ *
+ * Header file for the hash functions used to key strings (see text_hash.c)
+ *
+ */
+#ifndef TEXT_HASH_H
+#define TEXT_HASH_H
+
+#include <stdint.h>
+
+//-------------------------------------------------------------------------
+// Steps of the 32 bit FNV hash implemented by TEXT_UTILS_CalcHash()
+// These are exposed so that callers can calculate the hash of a string incrementally, whilst scanning it for other purposes
+#define TEXT_UTILS_HASH_INIT  (0x811C9DC5)
+#define TEXT_UTILS_HASH_ADD(hash, c)  (((hash) * 0x1000193) ^ (c))
+
+//-------------------------------------------------------------------------
+// API functions
+int TEXT_UTILS_CalcHash(char *s);
+uint64_t TEXT_UTILS_CalcHash64(char *s);
+uint64_t TEXT_UTILS_CalcWordHash64(char *s);
+unsigned TEXT_UTILS_CalcBufferHash(unsigned char *buf, int len);
+
+#endif
@@ -40,6 +40,7 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "common_defs.h"
@@ -50,34 +51,33 @@
 //-------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 
+//-------------------------------------------------------------------------
+// Table converting an ASCII character to the value of the hexadecimal digit it represents, plus 1
+// NOTE: Values are offset by 1, so that all characters which are not hexadecimal digits (including the NULL terminator) map to 0
+#define HEX_DIGIT(c, v)  [(unsigned char)(c)] = (v)+1
+static const unsigned char hex_digit_values[256] =
+{
+    HEX_DIGIT('0', 0), HEX_DIGIT('1', 1), HEX_DIGIT('2', 2), HEX_DIGIT('3', 3), HEX_DIGIT('4', 4),
+    HEX_DIGIT('5', 5), HEX_DIGIT('6', 6), HEX_DIGIT('7', 7), HEX_DIGIT('8', 8), HEX_DIGIT('9', 9),
+    HEX_DIGIT('A', 10), HEX_DIGIT('B', 11), HEX_DIGIT('C', 12), HEX_DIGIT('D', 13), HEX_DIGIT('E', 14), HEX_DIGIT('F', 15),
+    HEX_DIGIT('a', 10), HEX_DIGIT('b', 11), HEX_DIGIT('c', 12), HEX_DIGIT('d', 13), HEX_DIGIT('e', 14), HEX_DIGIT('f', 15),
+};
 
-/*********************************************************************//**
-**
-** TEXT_UTILS_CalcHash
-**
-** Implements a 32 bit hash of the specified string
-** Implemented using the FNV1a algorithm
-**
-** \param   s - pointer to string to calculate the hash of
-**
-** \return  hash value
-**
-**************************************************************************/
-int TEXT_UTILS_CalcHash(char *s)
+//-------------------------------------------------------------------------
+// Table of the characters which are not percent encoded by TEXT_UTILS_PercentEncodeString()
+// This contains the characters matching IS_ALPHA_NUMERIC(), plus '.' and '~'
+static const bool is_unreserved_char[256] =
 {
-    #define OFFSET_BASIS (0x811C9DC5)
-    #define FNV_PRIME (0x1000193)
-    unsigned hash = OFFSET_BASIS;
+    ['a' ... 'z'] = true,
+    ['A' ... 'Z'] = true,
+    ['0' ... '9'] = true,
+    ['_'] = true, ['-'] = true, ['.'] = true, ['~'] = true,
+};
 
-    while (*s != '\0')
-    {
-        hash = hash * FNV_PRIME;
-        hash = hash ^ (*s);
-        s++;
-    }
+//-------------------------------------------------------------------------
+// Characters which represent each of the values 0-15 in a hexadecimal ASCII string
+static const char hex_digits[] = "0123456789ABCDEF";
 
-    return (int)hash;
-}
 
 /*********************************************************************//**
 **
@@ -344,8 +344,7 @@ int TEXT_UTILS_StringToBinary(char *str, unsigned char *buf, int len, int *bytes
     int num_nibbles;    // Number of 4 bit nibbles (hex characters) in the string
     int num_bytes;
     int i;
-    char *p;
-    char c;
+    unsigned char *p;
     int hi_nibble;
     int lo_nibble;
 
@@ -365,29 +364,23 @@ int TEXT_UTILS_StringToBinary(char *str, unsigned char *buf, int len, int *bytes
         return USP_ERR_INVALID_TYPE;
     }
 
-    p = str;
+    p = (unsigned char *)str;
     for (i=0; i<num_bytes; i++)
     {
-        // Exit if unable to convert high nibble in a byte
-        c = *p++;
-        hi_nibble = TEXT_UTILS_HexDigitToValue(c);
-        if (hi_nibble == INVALID)
+        // Exit if unable to convert either nibble in a byte
+        // NOTE: The nibbles are looked up in a table (offset by 1) to avoid the comparisons in TEXT_UTILS_HexDigitToValue()
+        hi_nibble = hex_digit_values[p[0]];
+        lo_nibble = hex_digit_values[p[1]];
+        if ((hi_nibble == 0) || (lo_nibble == 0))
         {
-            USP_ERR_SetMessage("%s: ASCII hexadecimal string contains invalid character '%c' (code=0x%02x)", __FUNCTION__, c, c);
-            return USP_ERR_INVALID_TYPE;
-        }
-
-        // Exit if unable to convert low nibble in a byte
-        c = *p++;
-        lo_nibble = TEXT_UTILS_HexDigitToValue(c);
-        if (lo_nibble == INVALID)
-        {
-            USP_ERR_SetMessage("%s: ASCII hexadecimal string contains invalid character '%c' (code=0x%02x)", __FUNCTION__, c, c);
+            p += (hi_nibble == 0) ? 0 : 1;
+            USP_ERR_SetMessage("%s: ASCII hexadecimal string contains invalid character '%c' (code=0x%02x)", __FUNCTION__, *p, *p);
             return USP_ERR_INVALID_TYPE;
         }
 
         // Pack nibbles into a byte and write to return buffer
-        buf[i] = (unsigned char)( (hi_nibble << 4) + lo_nibble );
+        buf[i] = (unsigned char)( ((hi_nibble-1) << 4) + (lo_nibble-1) );
+        p += 2;
     }
 
     *bytes_written = num_bytes;
@@ -876,48 +869,41 @@ char *TEXT_UTILS_TrimBuffer(char *buf)
 **************************************************************************/
 void TEXT_UTILS_PercentEncodeString(char *src, char *dst, int dst_len, char safe_char)
 {
-    char c;
-    bool is_unreserved;
-    int num_required;
+    unsigned char c;
 
     // Reserve space in the destination buffer for a trailing NULL terminator
     USP_ASSERT(dst_len > 0);    
     dst_len--;
     
-    c = *src++;
+    c = (unsigned char) *src++;
     while (c != '\0')
     {
-        // Determine if character is a unreserved character
-        is_unreserved =  IS_ALPHA_NUMERIC(c) || (c=='.') || (c=='~');
-
-        // Override for safe character, this is always left unencoded
-        if (c == safe_char)
+        if ((is_unreserved_char[c]) || (c == (unsigned char)safe_char))
         {
-            is_unreserved = true;
-        }
-
-        // Exit loop if there is not enough space for the (potentially escaped) character in the output buffer
-        num_required = (is_unreserved) ? 1 : 3;
-        if (dst_len < num_required)
-        {
-            goto exit;
-        }
-
-        if (is_unreserved)
-        {
-            // Unreserved characters do not have to be percent encoded
+            // Unreserved characters (and the safe character) do not have to be percent encoded
+            // Exit loop if there is not enough space for the character in the output buffer
+            if (dst_len < 1)
+            {
+                goto exit;
+            }
             *dst++ = c;
+            dst_len--;
         }
         else
         {
+            // Exit loop if there is not enough space for the escaped character in the output buffer
+            if (dst_len < 3)
+            {
+                goto exit;
+            }
             *dst++ = '%';
-            *dst++ = TEXT_UTILS_ValueToHexDigit( BITS(7, 4, c));
-            *dst++ = TEXT_UTILS_ValueToHexDigit( BITS(3, 0, c));
+            *dst++ = hex_digits[ BITS(7, 4, c) ];
+            *dst++ = hex_digits[ BITS(3, 0, c) ];
+            dst_len -= 3;
         }
 
-        // Decrement space left in the output buffer and move to next input character
-        dst_len -= num_required;
-        c = *src++;
+        // Move to next input character
+        c = (unsigned char) *src++;
     }
 
 exit:
@@ -939,59 +925,46 @@ exit:
 **************************************************************************/
 char *TEXT_UTILS_PercentDecodeString(char *buf)
 {
-    char c;
     char *src;
     char *dest;
-    char hex1, hex2;
+    char *next;
     int digit1, digit2;
-    char unescaped;
+    int run_len;
 
-    src = buf;
-    dest = buf;
-    c = *src;
-    while (c != '\0')
+    // Exit if the string does not contain any percent escaped characters (the usual case), leaving it unchanged
+    src = strchr(buf, '%');
+    if (src == NULL)
     {
-        if (c == '%')
-        {
-            // Exit if string ends in a trailing '%' without a 2 digit trailing hex number following
-            src++;
-            hex1 = *src++;
-            if (hex1 == '\0')
-            {
-                return NULL;
-            }
-
-            hex2 = *src++;
-            if (hex2 == '\0')
-            {
-                return NULL;
-            }
-
-            // Exit if not a valid hex number            
-            digit1 = TEXT_UTILS_HexDigitToValue(hex1);
-            digit2 = TEXT_UTILS_HexDigitToValue(hex2);
-            if ((digit1 == INVALID) || (digit2==INVALID))
-            {
-                return NULL;
-            }
+        return buf;
+    }
 
-            unescaped = (char)(16*digit1 + digit2);
-            *dest++ = unescaped;
-        }
-        else
+    // Iterate over all percent escaped characters, with src pointing to the '%' of each one
+    dest = src;
+    while (src != NULL)
+    {
+        // Exit if a 2 digit hex number does not follow the '%'
+        // NOTE: The table maps the NULL terminator to 0 (invalid), so this also exits if the string ends after the '%'
+        digit1 = hex_digit_values[ (unsigned char)src[1] ];
+        if (digit1 == 0)
         {
-            // Copy down characters
-            if (dest != src)
-            {
-                *dest = *src;
-            }
+            return NULL;
+        }
 
-            // Move to next character
-            src++;
-            dest++;
+        digit2 = hex_digit_values[ (unsigned char)src[2] ];
+        if (digit2 == 0)
+        {
+            return NULL;
         }
 
-        c = *src;
+        *dest++ = (char)(16*(digit1-1) + (digit2-1));
+        src += 3;
+
+        // Copy down all characters up to the next percent escaped character (or the end of the string)
+        next = strchr(src, '%');
+        run_len = (next != NULL) ? next - src : strlen(src);
+        memmove(dest, src, run_len);
+        dest += run_len;
+        src = next;
     }
 
     // If the code gets here, we have stepped through all characters in the string converting them
@@ -1110,23 +1083,8 @@ bool TEXT_UTILS_IsSymbol(char *buf)
 **************************************************************************/
 int TEXT_UTILS_HexDigitToValue(char c)
 {
-    if (IS_NUMERIC(c))
-    {
-        return c - '0';
-    }
-
-    if ((c >= 'A') && (c <= 'F'))
-    {
-        return c - 'A' + 10;
-    }
-
-    if ((c >= 'a') && (c <= 'f'))
-    {
-        return c - 'a' + 10;
-    }
-
-    // If the code gets here, unable to convert the character
-    return INVALID;
+    // NOTE: Characters which cannot be converted map to 0 in the table, and hence return INVALID
+    return (int)hex_digit_values[(unsigned char)c] - 1;
 }
 
 /*********************************************************************//**
@@ -1172,16 +1130,16 @@ char TEXT_UTILS_ValueToHexDigit(int nibble)
 **************************************************************************/
 void TEXT_UTILS_PathToSchemaForm(char *path, char *buf, int len)
 {
-    char c;
+    int run_len;
 
-    c = *path;
-    while (c != '\0')
+    #define INSTANCE_SEPARATOR "{i}"
+    #define INSTANCE_SEPARATOR_LEN (sizeof(INSTANCE_SEPARATOR)-1)       // Minus 1 to not include NULL terminator
+
+    while (*path != '\0')
     {
-        if (IS_NUMERIC(c))
+        if (IS_NUMERIC(*path))
         {
             // Replace number with schema instance separator in the output buffer
-            #define INSTANCE_SEPARATOR "{i}"
-            #define INSTANCE_SEPARATOR_LEN (sizeof(INSTANCE_SEPARATOR)-1)       // Minus 1 to not include NULL terminator
             memcpy(buf, INSTANCE_SEPARATOR, INSTANCE_SEPARATOR_LEN);
             buf += INSTANCE_SEPARATOR_LEN;
             len -= INSTANCE_SEPARATOR_LEN;
@@ -1191,10 +1149,15 @@ void TEXT_UTILS_PathToSchemaForm(char *path, char *buf, int len)
         }
         else
         {
-            // Copy character into output buffer
-            *buf++ = c;
-            len--;
-            path ++;
+            // Copy all characters up to the next number into the output buffer, in one go
+            // NOTE: The copy is truncated so that there is always enough space left for an instance separator and a NULL terminator
+            run_len = strcspn(path, "0123456789");
+            run_len = MIN(run_len, len - (int)INSTANCE_SEPARATOR_LEN);
+            run_len = MAX(run_len, 0);
+            memcpy(buf, path, run_len);
+            buf += run_len;
+            len -= run_len;
+            path += run_len;
         }
 
         // Exit if not enough space for output
@@ -1202,14 +1165,75 @@ void TEXT_UTILS_PathToSchemaForm(char *path, char *buf, int len)
         {
             goto exit;
         }
-
-        c = *path;
     }
 
 exit:
     *buf = '\0';        // Ensure buffer is zero terminated
 }
 
+/*********************************************************************//**
+**
+** TEXT_UTILS_NaturalStrCmp
+**
+** Compare 2 strings accounting correctly for natural numbers ie '2' comes before '11'
+** This is used to sort path names correctly with instance numbers in them
+**
+** \param   s1 - pointer to first string
+** \param   s2 - pointer to second string
+**
+** \return  0 if strings are identical
+**          negative number if s1 comes before s2
+**          positive number if s1 comes after s2
+**
+**************************************************************************/
+int TEXT_UTILS_NaturalStrCmp(char *s1, char *s2)
+{
+    char c1, c2;
+    int num_digits_s1;
+    int num_digits_s2;
+    int delta;
+
+    // Skip all characters which are the same
+    while(true)
+    {
+        c1 = *s1;
+        c2 = *s2;
+
+        // Exit if reached the end of either string
+        if ((c1 == '\0') || (c2 == '\0'))
+        {
+            // NOTE: The following comparision puts s1 before s2, if s1 terminates before s2 (and vice versa)
+            return (int)c1 - (int)c2;
+        }
+
+        // Exit if the characters do not match
+        if (c1 != c2)
+        {
+            break;
+        }
+
+        // As characters match, move to next characters
+        s1++;
+        s2++;
+    }
+
+    // If the code gets here, then we have reached a character which is different
+    // Determine the number of digits in the rest of the string (this may be 0 if the first character is not a digit)
+    num_digits_s1 = TEXT_UTILS_CountConsecutiveDigits(s1);
+    num_digits_s2 = TEXT_UTILS_CountConsecutiveDigits(s2);
+
+    // Determine if the number of digits in s1 is greater than in s2 (if so, s1 comes after s2)
+    delta = num_digits_s1 - num_digits_s2;
+    if (delta != 0)
+    {
+        return delta;
+    }
+
+    // If the code gets here, then the strings contain either no digits, or the same number of digits,
+    // so just compare the characters (this also works if the characters are digits)
+    return (int)c1 - (int)c2;
+}
+
 /*********************************************************************//**
 **
 ** TEXT_UTILS_CountConsecutiveDigits
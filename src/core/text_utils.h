@@ -41,12 +41,14 @@
 #ifndef TEXT_UTILS_H
 #define TEXT_UTILS_H
 
+#include <stdint.h>
+
 #include "str_vector.h"
 #include "nu_ipaddr.h"
+#include "text_hash.h"
 
 //-------------------------------------------------------------------------
 // API functions
-int TEXT_UTILS_CalcHash(char *s);
 int TEXT_UTILS_StringToUnsigned(char *str, unsigned *value);
 int TEXT_UTILS_StringToInteger(char *str, int *value);
 int TEXT_UTILS_StringToUnsignedLongLong(char *str, unsigned long long *value);
@@ -72,6 +74,7 @@ int TEXT_UTILS_HexDigitToValue(char c);
 char TEXT_UTILS_ValueToHexDigit(int nibble);
 void TEXT_UTILS_PathToSchemaForm(char *path, char *buf, int len);
 int TEXT_UTILS_CountConsecutiveDigits(char *s);
+int TEXT_UTILS_NaturalStrCmp(char *s1, char *s2);
 char *TEXT_UTILS_StrDupWithTrailingDot(char *path);
 int TEXT_UTILS_KeyValueFromString(char *buf, char **key, char **value);
 
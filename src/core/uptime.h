@@ -46,5 +46,6 @@
 
 uint32_t tu_uptime_msecs(void);
 uint32_t tu_uptime_secs(void);
+uint64_t tu_uptime_usecs(void);
 
 #endif
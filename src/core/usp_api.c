@@ -46,6 +46,7 @@
 #include "iso8601.h"
 #include "os_utils.h"
 #include "device.h"
+#include "msg_handler.h"
 
 /*********************************************************************//**
 **
@@ -143,6 +144,29 @@ int USP_DM_InformInstance(char *path)
     return DATA_MODEL_NotifyInstanceAdded(path);
 }
 
+/*********************************************************************//**
+**
+** USP_DM_RefreshInstance
+**
+** Notifies USP Agent core that an instance of a vendor controlled object is present
+** This function must only be called from within the object's refresh instances callback (see USP_REGISTER_Object_RefreshInstances)
+**
+** \param   path - path of the object instance which is present
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_DM_RefreshInstance(char *path)
+{
+    // Exit if this function is not being called from the data model thread
+    if (OS_UTILS_IsDataModelThread(__FUNCTION__, PRINT_WARNING)==false)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return DATA_MODEL_RefreshInstance(path);
+}
+
 /*********************************************************************//**
 **
 ** USP_DM_GetInstances
@@ -152,6 +176,7 @@ int USP_DM_InformInstance(char *path)
 **
 ** \param   path - path of the object
 ** \param   iv - pointer to structure in which to return the instance numbers
+**               NOTE: The caller must free this structure using USP_DM_DestroyInstances()
 **
 ** \return  USP_ERR_OK if successful
 **
@@ -167,6 +192,22 @@ int USP_DM_GetInstances(char *path, int_vector_t *iv)
     return DATA_MODEL_GetInstances(path, iv);
 }
 
+/*********************************************************************//**
+**
+** USP_DM_DestroyInstances
+**
+** Frees the vector of instance numbers returned by USP_DM_GetInstances()
+**
+** \param   iv - pointer to structure containing the instance numbers
+**
+** \return  None
+**
+**************************************************************************/
+void USP_DM_DestroyInstances(int_vector_t *iv)
+{
+    INT_VECTOR_Destroy(iv);
+}
+
 /*********************************************************************//**
 **
 ** USP_ARG_Create
@@ -293,6 +334,25 @@ char *USP_ARG_Get(kv_vector_t *kvv, char *key, char *default_value)
     return KV_VECTOR_Get(kvv, key, default_value, 0);
 }
 
+/*********************************************************************//**
+**
+** USP_ARG_Replace
+**
+** Replaces the value associated with the specified key
+** This is useful in get group vendor hooks, for returning the value of each parameter in the group
+**
+** \param   kvv - pointer to key-value pair vector structure
+** \param   key - pointer to name of key to replace the value of
+** \param   value - pointer to new value to copy into the vector
+**
+** \return  true if the key was found (and hence its value replaced), false otherwise
+**
+**************************************************************************/
+bool USP_ARG_Replace(kv_vector_t *kvv, char *key, char *value)
+{
+    return KV_VECTOR_Replace(kvv, key, value);
+}
+
 /*********************************************************************//**
 **
 ** USP_ARG_GetUnsigned
@@ -511,6 +571,7 @@ int USP_DM_AddControllerTrustPermission(ctrust_role_t role, char *path, unsigned
 
     // Apply the permissions
     DM_PRIV_ApplyPermissions(node, role, permission_bitmask);
+    MSG_HANDLER_InvalidateGetSupportedDMCache();
 
     // Add the permissions used to the permissions table
     return DEVICE_CTRUST_AddPermissions(role, path, permission_bitmask);
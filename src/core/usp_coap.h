@@ -63,8 +63,14 @@
 
 //------------------------------------------------------------------------
 // Defines for this implementation (not set by any RFC)
-#define COAP_CLIENT_PAYLOAD_TX_SIZE  MAX_COAP_PAYLOAD_SIZE   // Maximum size of payload that we will send
-#define COAP_CLIENT_PAYLOAD_RX_SIZE  MAX_COAP_PAYLOAD_SIZE   // Maximum size of payload that we would like to receive
+#define COAP_CLIENT_PAYLOAD_TX_SIZE  COAP_BLOCK_SIZE   // Maximum size of payload that we will send
+#define COAP_CLIENT_PAYLOAD_RX_SIZE  COAP_BLOCK_SIZE   // Maximum size of payload that we would like to receive
+
+#if (COAP_BLOCK_SIZE < 16) || (COAP_BLOCK_SIZE > MAX_COAP_PAYLOAD_SIZE) || ((COAP_BLOCK_SIZE & (COAP_BLOCK_SIZE-1)) != 0)
+#error "COAP_BLOCK_SIZE must be a power of 2 between 16 and 1024"
+#endif
+
+#define COAP_SERVER_RX_BATCH_SIZE 8  // Maximum number of CoAP PDUs that our CoAP server reads from an unencrypted session in a single recvmmsg() call
 
 #define MAX_COAP_URI_PATH  128      // Maximum size of buffer containing the URI path received in the PDU
 #define MAX_COAP_URI_QUERY 128      // Maximum size of URI query received in the PDU
@@ -0,0 +1,230 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file usp_compress.c
+ *
+ * Implements compression (deflate) of USP records sent over STOMP and WebSocket, and decompression of received USP records
+ * STOMP carries deflated USP records in zlib format (RFC1950), signalled by a 'content-encoding:deflate' header.
+ * WebSocket carries them as raw deflate data (RFC1951) using the permessage-deflate extension (RFC7692), with each
+ * message compressed independently (no context takeover) and the trailing empty sync flush block removed.
+ *
+ */
+#include <string.h>
+#include <zlib.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "usp_compress.h"
+
+//------------------------------------------------------------------------------
+// Empty deflate block terminating each sync flush, which is removed from the end of each permessage-deflate message (RFC7692 section 7.2.1)
+static unsigned char sync_flush_trailer[] = { 0x00, 0x00, 0xFF, 0xFF };
+
+/*********************************************************************//**
+**
+** USP_COMPRESS_Deflate
+**
+** Compresses the specified buffer
+**
+** \param   in - pointer to buffer to compress
+** \param   in_len - number of bytes in the buffer to compress
+** \param   is_raw - set if the output should be raw deflate data in permessage-deflate format (WebSocket),
+**                   rather than in zlib format (STOMP)
+** \param   p_out - pointer to variable in which to return a dynamically allocated buffer containing the compressed data
+** \param   p_out_len - pointer to variable in which to return the number of bytes of compressed data
+**
+** \return  USP_ERR_OK if successful, USP_ERR_INTERNAL_ERROR if the data could not be compressed (or did not get any smaller)
+**
+**************************************************************************/
+int USP_COMPRESS_Deflate(unsigned char *in, int in_len, bool is_raw, unsigned char **p_out, int *p_out_len)
+{
+    z_stream strm;
+    unsigned char *out;
+    int max_len;
+    int out_len;
+    int zerr;
+
+    // Exit if unable to initialise zlib
+    memset(&strm, 0, sizeof(strm));
+    zerr = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (is_raw) ? -MAX_WBITS : MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (zerr != Z_OK)
+    {
+        USP_ERR_SetMessage("%s: deflateInit2() failed (err=%d)", __FUNCTION__, zerr);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Compress all of the input in one go
+    // NOTE: The output buffer is sized for the worst case, plus the empty block added by a sync flush
+    max_len = deflateBound(&strm, in_len) + 16;
+    out = USP_MALLOC(max_len);
+    strm.next_in = in;
+    strm.avail_in = in_len;
+    strm.next_out = out;
+    strm.avail_out = max_len;
+    zerr = deflate(&strm, (is_raw) ? Z_SYNC_FLUSH : Z_FINISH);
+    out_len = max_len - strm.avail_out;
+    deflateEnd(&strm);
+
+    // Exit if compression failed
+    if ((zerr != ((is_raw) ? Z_OK : Z_STREAM_END)) || (strm.avail_in != 0))
+    {
+        USP_ERR_SetMessage("%s: deflate() failed (err=%d)", __FUNCTION__, zerr);
+        USP_FREE(out);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Remove the sync flush trailer (permessage-deflate only)
+    if (is_raw)
+    {
+        USP_ASSERT((out_len >= sizeof(sync_flush_trailer)) && (memcmp(&out[out_len - sizeof(sync_flush_trailer)], sync_flush_trailer, sizeof(sync_flush_trailer))==0));
+        out_len -= sizeof(sync_flush_trailer);
+    }
+
+    // Exit if the data did not compress (eg because it was already compressed)
+    if (out_len >= in_len)
+    {
+        USP_FREE(out);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    *p_out = out;
+    *p_out_len = out_len;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_COMPRESS_Inflate
+**
+** Decompresses the specified buffer
+** NOTE: To prevent rogue controllers from exhausting memory, the decompressed data is limited to MAX_USP_MSG_LEN bytes
+**
+** \param   in - pointer to buffer containing the compressed data
+** \param   in_len - number of bytes of compressed data
+** \param   is_raw - set if the input is raw deflate data in permessage-deflate format (WebSocket),
+**                   rather than in zlib format (STOMP)
+** \param   p_out - pointer to variable in which to return a dynamically allocated buffer containing the decompressed data
+** \param   p_out_len - pointer to variable in which to return the number of bytes of decompressed data
+**
+** \return  USP_ERR_OK if successful, USP_ERR_RECORD_NOT_PARSED if the data could not be decompressed
+**
+**************************************************************************/
+int USP_COMPRESS_Inflate(unsigned char *in, int in_len, bool is_raw, unsigned char **p_out, int *p_out_len)
+{
+    z_stream strm;
+    unsigned char *buf = NULL;
+    unsigned char *out = NULL;
+    int out_size;
+    int zerr;
+
+    // Exit if unable to initialise zlib
+    memset(&strm, 0, sizeof(strm));
+    zerr = inflateInit2(&strm, (is_raw) ? -MAX_WBITS : MAX_WBITS);
+    if (zerr != Z_OK)
+    {
+        USP_ERR_SetMessage("%s: inflateInit2() failed (err=%d)", __FUNCTION__, zerr);
+        return USP_ERR_RECORD_NOT_PARSED;
+    }
+
+    // Restore the sync flush trailer removed by the sender (permessage-deflate only)
+    if (is_raw)
+    {
+        buf = USP_MALLOC(in_len + sizeof(sync_flush_trailer));
+        memcpy(buf, in, in_len);
+        memcpy(&buf[in_len], sync_flush_trailer, sizeof(sync_flush_trailer));
+        in = buf;
+        in_len += sizeof(sync_flush_trailer);
+    }
+
+    // Decompress, growing the output buffer as necessary
+    out_size = MIN(4*in_len + 256, MAX_USP_MSG_LEN);
+    out = USP_MALLOC(out_size);
+    strm.next_in = in;
+    strm.avail_in = in_len;
+    strm.next_out = out;
+    strm.avail_out = out_size;
+    while (1)
+    {
+        zerr = inflate(&strm, Z_SYNC_FLUSH);
+        if (zerr == Z_STREAM_END)
+        {
+            break;
+        }
+
+        // Exit if the compressed data was corrupt
+        if ((zerr != Z_OK) && (zerr != Z_BUF_ERROR))
+        {
+            USP_ERR_SetMessage("%s: inflate() failed (err=%d)", __FUNCTION__, zerr);
+            goto error;
+        }
+
+        // Exit loop if all input has been decompressed
+        if ((strm.avail_in == 0) && (strm.avail_out != 0))
+        {
+            // Exit if the zlib stream was truncated
+            if (is_raw == false)
+            {
+                USP_ERR_SetMessage("%s: Compressed data was truncated", __FUNCTION__);
+                goto error;
+            }
+            break;
+        }
+
+        // Exit if the decompressed data would be too large
+        if (out_size >= MAX_USP_MSG_LEN)
+        {
+            USP_ERR_SetMessage("%s: Decompressed data is larger than MAX_USP_MSG_LEN (%d bytes)", __FUNCTION__, MAX_USP_MSG_LEN);
+            goto error;
+        }
+
+        // Grow the output buffer
+        out = USP_REALLOC(out, MIN(2*out_size, MAX_USP_MSG_LEN));
+        strm.next_out = &out[out_size];
+        strm.avail_out = MIN(2*out_size, MAX_USP_MSG_LEN) - out_size;
+        out_size = MIN(2*out_size, MAX_USP_MSG_LEN);
+    }
+
+    *p_out = out;
+    *p_out_len = out_size - strm.avail_out;
+    inflateEnd(&strm);
+    USP_SAFE_FREE(buf);
+    return USP_ERR_OK;
+
+error:
+    inflateEnd(&strm);
+    USP_FREE(out);
+    USP_SAFE_FREE(buf);
+    return USP_ERR_RECORD_NOT_PARSED;
+}
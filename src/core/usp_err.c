@@ -63,11 +63,56 @@
 
 //------------------------------------------------------------------------------------
 // Buffer to hold error message
-static char usp_error[USP_ERR_MAXLEN] = { 0 };
+static __thread char usp_error[USP_ERR_MAXLEN] = { 0 };
+
+//------------------------------------------------------------------------------------
+// Error message whose formatting has been deferred until it is needed (by USP_ERR_GetMessage)
+// Many error messages are discarded without ever being read (eg when resolving paths with permissions filtered out),
+// so if the error message is not going to be logged, the format string and its arguments are just captured.
+// The format string and string arguments are copied, as they may not exist by the time that the message is formatted
+#define MAX_DEFERRED_ERR_ARGS 12
+
+typedef enum
+{
+    kDeferredArg_Int,           // int (or smaller integer type, promoted to int)
+    kDeferredArg_Long,          // long or size_t
+    kDeferredArg_LongLong,      // long long
+    kDeferredArg_Double,        // double (or float, promoted to double)
+    kDeferredArg_Pointer,       // pointer (%p)
+    kDeferredArg_String,        // string (%s), copied into the deferred error's string buffer
+} deferred_arg_type_t;
+
+typedef struct
+{
+    deferred_arg_type_t type;
+    union
+    {
+        int i;
+        long l;
+        long long ll;
+        double d;
+        void *p;
+        int str_offset;         // Offset of the copied string in strbuf, or INVALID if the argument was NULL
+    } value;
+} deferred_arg_t;
+
+typedef struct
+{
+    char *fmt;                  // printf style format of the deferred error message (copied into strbuf), or NULL if no error message is deferred
+    int num_args;
+    deferred_arg_t args[MAX_DEFERRED_ERR_ARGS];
+    int strbuf_len;             // Number of bytes used in strbuf
+    char strbuf[USP_ERR_MAXLEN];
+} deferred_err_t;
+
+static __thread deferred_err_t deferred_err = { 0 };
 
 //--------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void SegFaultHandler(int sig);
+bool CaptureDeferredMessage(char *fmt, va_list ap);
+void RenderDeferredMessage(void);
+char *ParseFormatSpec(char *p, deferred_arg_type_t *type);
 
 /*********************************************************************//**
 **
@@ -104,9 +149,31 @@ void USP_ERR_SetMessage(char *fmt, ...)
     char *buf_to_use = usp_error;
     int buf_len = sizeof(usp_error);
     char local_buf[USP_ERR_MAXLEN];
-    
+    bool is_dm_thread;
+    bool is_captured;
+
+    // Exit if the error message is not going to be logged, deferring formatting of it until it is read
+    // NOTE: Messages set by threads other than the data model thread are never read, so need not be captured at all
+    is_dm_thread = OS_UTILS_IsDataModelThread(__FUNCTION__, DONT_PRINT_WARNING);
+    if ((usp_log_level < kLogLevel_Error) && (enable_callstack_debug == false))
+    {
+        if (is_dm_thread == false)
+        {
+            return;
+        }
+
+        va_start(ap, fmt);
+        is_captured = CaptureDeferredMessage(fmt, ap);
+        va_end(ap);
+        if (is_captured)
+        {
+            return;
+        }
+    }
+    deferred_err.fmt = NULL;
+
     // Write the message into a local buffer, if this function is not being called from the data model thread
-    if (OS_UTILS_IsDataModelThread(__FUNCTION__, DONT_PRINT_WARNING)==false)
+    if (is_dm_thread == false)
     {
         buf_to_use = local_buf;
         buf_len = sizeof(local_buf);
@@ -237,6 +304,7 @@ void USP_ERR_SetMessage_Errno(const char *func, int line, const char *failed_fun
 void USP_ERR_ClearMessage(void)
 {
     usp_error[0] = '\0';
+    deferred_err.fmt = NULL;
 }
 
 /*********************************************************************//**
@@ -255,7 +323,7 @@ void USP_ERR_ReplaceEmptyMessage(char *fmt, ...)
     va_list ap;
 
     // Exit if stored USP error messsage is not empty
-    if (usp_error[0] != '\0')
+    if ((usp_error[0] != '\0') || (deferred_err.fmt != NULL))
     {
         return;
     }
@@ -285,6 +353,12 @@ void USP_ERR_ReplaceEmptyMessage(char *fmt, ...)
 **************************************************************************/
 char *USP_ERR_GetMessage(void)
 {
+    // Format the error message, if it was deferred
+    if (deferred_err.fmt != NULL)
+    {
+        RenderDeferredMessage();
+    }
+
     return usp_error;
 }
 
@@ -303,7 +377,11 @@ void USP_ERR_Terminate(char *fmt, ...)
 {
     va_list ap;
     
+    // Write out all pending log messages, and log the cause of exit synchronously, as abort() does not call atexit() handlers
+    USP_LOG_StopAsync();
+
     // Log the cause of exit
+    deferred_err.fmt = NULL;
     va_start(ap, fmt);
     vsnprintf(usp_error, sizeof(usp_error), fmt, ap);
     usp_error[sizeof(usp_error)-1] = '\0';
@@ -370,8 +448,285 @@ void USP_ERR_Terminate_OnAssert(const char *func, int line, char *statement)
 **************************************************************************/
 void SegFaultHandler(int sig)
 {
+    USP_LOG_StopAsync();
     USP_LOG_Error("ERROR: Segmentation Fault");
     USP_LOG_Callstack();
     abort();    // call abort() rather than exit() so that a core dump is created
 }
 
+/*********************************************************************//**
+**
+** CaptureDeferredMessage
+**
+** Captures the format and arguments of an error message, so that it can be formatted later, if it is read
+**
+** \param   fmt - printf style format
+** \param   ap - arguments for the printf style format
+**
+** \return  true if the error message was captured, false if the format is not supported (so the message must be formatted immediately)
+**
+**************************************************************************/
+bool CaptureDeferredMessage(char *fmt, va_list ap)
+{
+    char *p;
+    char *s;
+    int len;
+    deferred_arg_t *arg;
+    deferred_err_t *de = &deferred_err;
+
+    de->fmt = NULL;
+    de->num_args = 0;
+    de->strbuf_len = 0;
+
+    // Exit if the format string does not fit in the string buffer
+    // NOTE: The format string is copied, as it is not necessarily a string literal
+    len = strlen(fmt) + 1;
+    if (len > sizeof(de->strbuf))
+    {
+        return false;
+    }
+    memcpy(de->strbuf, fmt, len);
+    de->strbuf_len = len;
+
+    p = de->strbuf;
+    while (*p != '\0')
+    {
+        // Skip literal characters (and escaped '%')
+        if (*p != '%')
+        {
+            p++;
+            continue;
+        }
+
+        if (p[1] == '%')
+        {
+            p += 2;
+            continue;
+        }
+
+        // Exit if the conversion specifier is not supported, or there are too many arguments
+        if (de->num_args >= MAX_DEFERRED_ERR_ARGS)
+        {
+            return false;
+        }
+
+        arg = &de->args[de->num_args];
+        p = ParseFormatSpec(p, &arg->type);
+        if (p == NULL)
+        {
+            return false;
+        }
+
+        // Capture the argument
+        switch(arg->type)
+        {
+            case kDeferredArg_Int:
+                arg->value.i = va_arg(ap, int);
+                break;
+
+            case kDeferredArg_Long:
+                arg->value.l = va_arg(ap, long);
+                break;
+
+            case kDeferredArg_LongLong:
+                arg->value.ll = va_arg(ap, long long);
+                break;
+
+            case kDeferredArg_Double:
+                arg->value.d = va_arg(ap, double);
+                break;
+
+            case kDeferredArg_Pointer:
+                arg->value.p = va_arg(ap, void *);
+                break;
+
+            case kDeferredArg_String:
+                // Exit if the string does not fit in the string buffer
+                s = va_arg(ap, char *);
+                if (s == NULL)
+                {
+                    arg->value.str_offset = INVALID;
+                    break;
+                }
+
+                len = strlen(s) + 1;
+                if (de->strbuf_len + len > sizeof(de->strbuf))
+                {
+                    return false;
+                }
+
+                memcpy(&de->strbuf[de->strbuf_len], s, len);
+                arg->value.str_offset = de->strbuf_len;
+                de->strbuf_len += len;
+                break;
+        }
+
+        de->num_args++;
+    }
+
+    // If the code gets here, then all arguments have been captured
+    de->fmt = de->strbuf;
+    usp_error[0] = '\0';
+    return true;
+}
+
+/*********************************************************************//**
+**
+** RenderDeferredMessage
+**
+** Formats the deferred error message into the USP error message buffer
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void RenderDeferredMessage(void)
+{
+    char *p;
+    char *spec;
+    char spec_buf[32];
+    int spec_len;
+    int len = 0;
+    int i = 0;
+    deferred_arg_t *arg;
+    deferred_arg_type_t type;
+    deferred_err_t *de = &deferred_err;
+    char *str;
+
+    p = de->fmt;
+    while ((*p != '\0') && (len < sizeof(usp_error)-1))
+    {
+        // Copy literal characters (and escaped '%')
+        if (*p != '%')
+        {
+            usp_error[len++] = *p++;
+            continue;
+        }
+
+        if (p[1] == '%')
+        {
+            usp_error[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Extract the conversion specification, so that it can be applied to just its own argument
+        spec = p;
+        p = ParseFormatSpec(p, &type);
+        USP_ASSERT((p != NULL) && (i < de->num_args));
+        spec_len = p - spec;
+        USP_ASSERT(spec_len < sizeof(spec_buf));
+        memcpy(spec_buf, spec, spec_len);
+        spec_buf[spec_len] = '\0';
+
+        // Format the argument
+        arg = &de->args[i++];
+        switch(arg->type)
+        {
+            case kDeferredArg_Int:
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, arg->value.i);
+                break;
+
+            case kDeferredArg_Long:
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, arg->value.l);
+                break;
+
+            case kDeferredArg_LongLong:
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, arg->value.ll);
+                break;
+
+            case kDeferredArg_Double:
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, arg->value.d);
+                break;
+
+            case kDeferredArg_Pointer:
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, arg->value.p);
+                break;
+
+            case kDeferredArg_String:
+                str = (arg->value.str_offset == INVALID) ? NULL : &de->strbuf[arg->value.str_offset];
+                len += snprintf(&usp_error[len], sizeof(usp_error)-len, spec_buf, str);
+                break;
+        }
+    }
+
+    // Terminate the message, truncating it if it did not fit in the buffer
+    if (len > sizeof(usp_error)-1)
+    {
+        len = sizeof(usp_error)-1;
+    }
+    usp_error[len] = '\0';
+    de->fmt = NULL;
+}
+
+/*********************************************************************//**
+**
+** ParseFormatSpec
+**
+** Parses a printf style conversion specification, determining the type of argument that it consumes
+** Only the conversion specifications which can be deferred are supported (eg '*' width and precision and '%n' are not)
+**
+** \param   p - pointer to the '%' starting the conversion specification
+** \param   type - pointer to variable in which to return the type of argument consumed by the conversion specification
+**
+** \return  pointer to the character after the conversion specification, or NULL if the conversion specification is not supported
+**
+**************************************************************************/
+char *ParseFormatSpec(char *p, deferred_arg_type_t *type)
+{
+    int num_l = 0;
+    bool is_size = false;
+
+    // Skip the '%', flags, field width and precision
+    p++;
+    while ((*p != '\0') && (strchr("-+ #0123456789.", *p) != NULL))
+    {
+        p++;
+    }
+
+    // Parse the length modifier
+    while ((*p == 'l') || (*p == 'h') || (*p == 'z'))
+    {
+        num_l += (*p == 'l') ? 1 : 0;
+        is_size |= (*p == 'z');
+        p++;
+    }
+
+    // Determine the type of argument from the conversion specifier
+    switch(*p)
+    {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            *type = (num_l >= 2) ? kDeferredArg_LongLong : ((num_l == 1) || (is_size)) ? kDeferredArg_Long : kDeferredArg_Int;
+            break;
+
+        case 'f':
+        case 'g':
+        case 'e':
+            *type = kDeferredArg_Double;
+            break;
+
+        case 'p':
+            *type = kDeferredArg_Pointer;
+            break;
+
+        case 's':
+            if (num_l != 0)
+            {
+                return NULL;        // Wide strings are not supported
+            }
+            *type = kDeferredArg_String;
+            break;
+
+        default:
+            return NULL;
+    }
+
+    return p+1;
+}
@@ -46,6 +46,8 @@
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <dlfcn.h>
 #include <openssl/err.h>
 
@@ -55,6 +57,7 @@
 #include "cli.h"
 #include "usp_api.h"
 #include "data_model.h"  // for vendor_hook_callbacks
+#include "os_utils.h"
 
 //------------------------------------------------------------------------------------
 // File to send logging output to
@@ -65,10 +68,54 @@ static FILE *log_fd;
 log_level_t usp_log_level = kLogLevel_Error;    // Verbosity level
 bool enable_protocol_trace = false;             // Whether protocol tracing should be sent out or not
 
+#if LOG_RING_SIZE > 0
+//------------------------------------------------------------------------------------
+// Ring of log messages written by a single thread (the thread logging), and read by the logger thread
+// NOTE: The ring is lock-free, because it only ever has one writer, and one reader at a time (serialised by log_drain_mutex)
+typedef struct log_ring_tag
+{
+    struct log_ring_tag *next;      // Next ring in the list of all rings
+    bool is_in_use;                 // Set if a thread is writing to this ring. The rings of threads which have exited are reused by new threads
+    unsigned head;                  // Total number of bytes ever written to the ring. Only modified by the writer
+    unsigned tail;                  // Total number of bytes ever read from the ring. Only modified by the reader
+    unsigned num_dropped;           // Number of log messages dropped since last reported, because the ring was full
+    unsigned char buf[LOG_RING_SIZE];
+} log_ring_t;
+
+//------------------------------------------------------------------------------------
+// Header of each log message in a ring. This is followed by the characters of the log message (without NULL terminator)
+typedef struct
+{
+    unsigned seq;                   // Sequence number of the log message. Used to write out the messages from all rings in the order they were logged
+    unsigned len;                   // Number of characters in the log message
+} log_record_hdr_t;
+
+//------------------------------------------------------------------------------------
+// State of asynchronous logging
+static log_ring_t *log_rings = NULL;            // Linked list of all log rings. Rings are only ever added to this list, never removed
+static __thread log_ring_t *cur_thread_ring = NULL; // Log ring which the current thread writes to, or NULL if it has not logged yet
+static __thread bool is_draining = false;       // Set if the current thread is reading the log rings
+static unsigned log_seq = 0;                    // Sequence number of the last log message written to a ring
+static bool is_log_async = false;               // Set if log messages are being written to the log rings (rather than logged synchronously)
+static sem_t log_sem;                           // Posted after each log message is written to a ring, to wake up the logger thread
+static pthread_mutex_t log_drain_mutex = PTHREAD_MUTEX_INITIALIZER;  // Serialises reading of the log rings (by the logger thread and USP_LOG_Flush)
+static pthread_key_t log_ring_key;              // Used to release a thread's log ring when the thread exits
+#endif
+
 //------------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void LogMessage(char *str);
 void LogMessageToFile(FILE *fd, char *str);
 void CloseLog(void);
+#if LOG_RING_SIZE > 0
+void *LoggerThreadMain(void *args);
+bool WriteLogRing(char *str);
+log_ring_t *GetThreadLogRing(void);
+void ReleaseLogRing(void *arg);
+void DrainLogRings(void);
+void CopyToLogRing(log_ring_t *ring, unsigned offset, void *src, int len);
+void CopyFromLogRing(log_ring_t *ring, unsigned offset, void *dest, int len);
+#endif
 
 /*********************************************************************//**
 **
@@ -415,7 +462,7 @@ void USP_LOG_Puts(log_type_t log_type, char *str)
             }
             else
             {    
-                LogMessageToFile(log_fd, str);
+                LogMessage(str);
             }
             break;
 
@@ -427,19 +474,51 @@ void USP_LOG_Puts(log_type_t log_type, char *str)
             }
             else
             {
-                LogMessageToFile(log_fd, str);
+                LogMessage(str);
             }
             break;
 
         case kLogType_Protocol:
             if (enable_protocol_trace)
             {
-                LogMessageToFile(log_fd, str);
+                LogMessage(str);
             }
             break;
     }
 }    
 
+/*********************************************************************//**
+**
+** LogMessage
+**
+** Logs the specified message to the current log destination
+** If asynchronous logging has been started, then the message is written to the current thread's log ring,
+** to be written out by the logger thread. Otherwise the message is written out immediately.
+**
+** \param   str - pointer to string to log
+**
+** \return  None
+**
+**************************************************************************/
+void LogMessage(char *str)
+{
+#if LOG_RING_SIZE > 0
+    bool is_written;
+
+    // Exit if the message was written to the current thread's log ring
+    if (__atomic_load_n(&is_log_async, __ATOMIC_ACQUIRE))
+    {
+        is_written = WriteLogRing(str);
+        if (is_written)
+        {
+            return;
+        }
+    }
+#endif
+
+    LogMessageToFile(log_fd, str);
+}
+
 /*********************************************************************//**
 **
 ** LogMessageToFile
@@ -500,6 +579,392 @@ void CloseLog(void)
     log_fd = NULL;
 }
 
+/*********************************************************************//**
+**
+** USP_LOG_StartAsync
+**
+** Starts the logger thread, after which log messages are written out asynchronously by the logger thread
+** This prevents slow log destinations (eg flash or serial consoles) from delaying the threads which log
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_LOG_StartAsync(void)
+{
+#if LOG_RING_SIZE > 0
+    int err;
+
+    // Exit if unable to create the key used to release a thread's log ring, when the thread exits
+    err = pthread_key_create(&log_ring_key, ReleaseLogRing);
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("pthread_key_create", err);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to create the semaphore used to wake up the logger thread
+    err = sem_init(&log_sem, 0, 0);
+    if (err != 0)
+    {
+        USP_ERR_ERRNO("sem_init", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to start the logger thread
+    err = OS_UTILS_CreateClassThread(kThreadClass_Log, LoggerThreadMain, NULL);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    // Ensure that all log messages are written out before exiting
+    atexit(USP_LOG_StopAsync);
+    __atomic_store_n(&is_log_async, true, __ATOMIC_RELEASE);
+#endif
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_LOG_Flush
+**
+** Writes out all log messages which have been written to the log rings, but not yet written out by the logger thread
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_LOG_Flush(void)
+{
+#if LOG_RING_SIZE > 0
+    // Exit if called whilst writing out the log rings (eg from a log message vendor hook)
+    if (is_draining)
+    {
+        return;
+    }
+
+    OS_UTILS_LockMutex(&log_drain_mutex);
+    DrainLogRings();
+    OS_UTILS_UnlockMutex(&log_drain_mutex);
+#endif
+}
+
+/*********************************************************************//**
+**
+** USP_LOG_StopAsync
+**
+** Reverts to synchronous logging, after writing out all log messages in the log rings
+** This is called before USP Agent exits, so that no log messages are lost
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_LOG_StopAsync(void)
+{
+#if LOG_RING_SIZE > 0
+    // Exit if asynchronous logging has not been started
+    if (__atomic_exchange_n(&is_log_async, false, __ATOMIC_ACQ_REL) == false)
+    {
+        return;
+    }
+
+    USP_LOG_Flush();
+#endif
+}
+
+#if LOG_RING_SIZE > 0
+/*********************************************************************//**
+**
+** LoggerThreadMain
+**
+** Main loop of the logger thread, which writes out the log messages written to the log rings
+**
+** \param   args - arguments (currently unused)
+**
+** \return  None - this code should not exit the loop
+**
+**************************************************************************/
+void *LoggerThreadMain(void *args)
+{
+    int err;
+
+    while (1)
+    {
+        // Wait until a log message has been written to a log ring
+        err = sem_wait(&log_sem);
+        if (err != 0)
+        {
+            continue;       // Interrupted by a signal
+        }
+
+        // Consume all other posts, as all log messages written so far are written out together
+        // NOTE: Any messages written after this will post the semaphore again, so will not be missed
+        while (sem_trywait(&log_sem) == 0)
+        {
+            ; // Intentionally empty
+        }
+
+        USP_LOG_Flush();
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** WriteLogRing
+**
+** Writes the specified log message into the current thread's log ring, to be written out by the logger thread
+** If the log ring is full, then the log message is dropped (and counted)
+**
+** \param   str - pointer to string to log
+**
+** \return  true if the log message was written to (or dropped from) the log ring,
+**          false if the caller should write out the log message itself (eg if it is too large to fit in a log ring)
+**
+**************************************************************************/
+bool WriteLogRing(char *str)
+{
+    log_ring_t *ring;
+    log_record_hdr_t hdr;
+    unsigned size;
+    unsigned head;
+    unsigned tail;
+
+    // Exit if the message could never fit in a log ring
+    hdr.len = strlen(str);
+    size = sizeof(hdr) + hdr.len;
+    if (size > LOG_RING_SIZE)
+    {
+        return false;
+    }
+
+    // Exit if unable to get a log ring for this thread
+    ring = GetThreadLogRing();
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    // Exit if there is no room in the log ring, dropping the log message
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (size > LOG_RING_SIZE - (head - tail))
+    {
+        __atomic_add_fetch(&ring->num_dropped, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    // Write the log message into the log ring, then make it visible to the logger thread
+    hdr.seq = __atomic_add_fetch(&log_seq, 1, __ATOMIC_RELAXED);
+    CopyToLogRing(ring, head, &hdr, sizeof(hdr));
+    CopyToLogRing(ring, head + sizeof(hdr), str, hdr.len);
+    __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+
+    sem_post(&log_sem);
+    return true;
+}
+
+/*********************************************************************//**
+**
+** GetThreadLogRing
+**
+** Gets the log ring of the current thread, allocating it (or reusing the log ring of a thread which has exited) if necessary
+** NOTE: Log rings are allocated using malloc() rather than USP_MALLOC(), as they exist for the lifetime of the executable
+**       and should not be reported as memory leaks
+**
+** \param   None
+**
+** \return  pointer to log ring, or NULL if out of memory
+**
+**************************************************************************/
+log_ring_t *GetThreadLogRing(void)
+{
+    log_ring_t *ring;
+    bool expected;
+
+    // Exit if this thread already has a log ring
+    if (cur_thread_ring != NULL)
+    {
+        return cur_thread_ring;
+    }
+
+    // Reuse the log ring of a thread which has exited, if possible
+    ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+    while (ring != NULL)
+    {
+        expected = false;
+        if (__atomic_compare_exchange_n(&ring->is_in_use, &expected, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            goto exit;
+        }
+        ring = ring->next;
+    }
+
+    // Otherwise allocate a new log ring, and add it to the list of log rings
+    ring = malloc(sizeof(log_ring_t));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+    ring->is_in_use = true;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->num_dropped = 0;
+    ring->next = __atomic_load_n(&log_rings, __ATOMIC_RELAXED);
+    while (__atomic_compare_exchange_n(&log_rings, &ring->next, ring, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED) == false)
+    {
+        ; // Intentionally empty. ring->next has been updated with the current head of the list
+    }
+
+exit:
+    // Ensure that the log ring is released for reuse when this thread exits
+    cur_thread_ring = ring;
+    pthread_setspecific(log_ring_key, ring);
+    return ring;
+}
+
+/*********************************************************************//**
+**
+** ReleaseLogRing
+**
+** Called when a thread which has logged exits, to allow its log ring to be reused by a new thread
+** NOTE: Any log messages remaining in the log ring are still written out by the logger thread
+**
+** \param   arg - pointer to the log ring of the exiting thread
+**
+** \return  None
+**
+**************************************************************************/
+void ReleaseLogRing(void *arg)
+{
+    log_ring_t *ring = (log_ring_t *) arg;
+
+    cur_thread_ring = NULL;
+    __atomic_store_n(&ring->is_in_use, false, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************//**
+**
+** DrainLogRings
+**
+** Writes out all log messages in the log rings, in the order that they were logged
+** NOTE: The caller must hold log_drain_mutex
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void DrainLogRings(void)
+{
+    static char msg[LOG_RING_SIZE];     // Buffer into which each log message is copied. Protected by log_drain_mutex
+    log_ring_t *ring;
+    log_ring_t *next_ring;
+    log_record_hdr_t hdr;
+    log_record_hdr_t next_hdr = {0};
+    unsigned num_dropped;
+
+    is_draining = true;
+    while (1)
+    {
+        // Find the log ring containing the earliest logged message
+        next_ring = NULL;
+        ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+        while (ring != NULL)
+        {
+            // Report any log messages dropped from this log ring
+            num_dropped = __atomic_exchange_n(&ring->num_dropped, 0, __ATOMIC_RELAXED);
+            if (num_dropped > 0)
+            {
+                USP_SNPRINTF(msg, sizeof(msg), "WARNING: %u log messages were dropped, because the log ring was full", num_dropped);
+                LogMessageToFile(log_fd, msg);
+            }
+
+            if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail)
+            {
+                CopyFromLogRing(ring, ring->tail, &hdr, sizeof(hdr));
+                if ((next_ring == NULL) || ((int)(hdr.seq - next_hdr.seq) < 0))
+                {
+                    next_ring = ring;
+                    next_hdr = hdr;
+                }
+            }
+            ring = ring->next;
+        }
+
+        // Exit if all log rings are empty
+        if (next_ring == NULL)
+        {
+            break;
+        }
+
+        // Copy the log message out of the log ring, freeing its space for the writer, then write it out
+        CopyFromLogRing(next_ring, next_ring->tail + sizeof(next_hdr), msg, next_hdr.len);
+        msg[next_hdr.len] = '\0';
+        __atomic_store_n(&next_ring->tail, next_ring->tail + sizeof(next_hdr) + next_hdr.len, __ATOMIC_RELEASE);
+        LogMessageToFile(log_fd, msg);
+    }
+    is_draining = false;
+}
+
+/*********************************************************************//**
+**
+** CopyToLogRing
+**
+** Copies the specified data into a log ring, wrapping around the end of the ring's buffer if necessary
+**
+** \param   ring - pointer to log ring to copy the data into
+** \param   offset - total number of bytes written to the log ring before this data
+** \param   src - pointer to data to copy
+** \param   len - number of bytes to copy
+**
+** \return  None
+**
+**************************************************************************/
+void CopyToLogRing(log_ring_t *ring, unsigned offset, void *src, int len)
+{
+    unsigned index;
+    int first_len;
+
+    index = offset % LOG_RING_SIZE;
+    first_len = MIN(len, LOG_RING_SIZE - index);
+    memcpy(&ring->buf[index], src, first_len);
+    memcpy(ring->buf, (unsigned char *)src + first_len, len - first_len);
+}
+
+/*********************************************************************//**
+**
+** CopyFromLogRing
+**
+** Copies data out of a log ring, wrapping around the end of the ring's buffer if necessary
+**
+** \param   ring - pointer to log ring to copy the data from
+** \param   offset - total number of bytes read from the log ring before this data
+** \param   dest - pointer to buffer in which to copy the data
+** \param   len - number of bytes to copy
+**
+** \return  None
+**
+**************************************************************************/
+void CopyFromLogRing(log_ring_t *ring, unsigned offset, void *dest, int len)
+{
+    unsigned index;
+    int first_len;
+
+    index = offset % LOG_RING_SIZE;
+    first_len = MIN(len, LOG_RING_SIZE - index);
+    memcpy(dest, &ring->buf[index], first_len);
+    memcpy((unsigned char *)dest + first_len, ring->buf, len - first_len);
+}
+#endif
+
 /*********************************************************************//**
 **
 ** USP_SNPRINTF
@@ -67,6 +67,9 @@ typedef enum
 // API
 void USP_LOG_Init(void);
 int USP_LOG_SetFile(char *file);
+int USP_LOG_StartAsync(void);
+void USP_LOG_Flush(void);
+void USP_LOG_StopAsync(void);
 void USP_LOG_Callstack(void);
 void USP_LOG_HexBuffer(char *title, unsigned char *buf, int len);
 void USP_LOG_String(log_type_t log_type, char *str);
@@ -42,6 +42,7 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
@@ -88,14 +89,122 @@ bool print_leak_report = false;
 int baseline_memory_usage = INVALID;
 
 static minfo_t *minfo = NULL;
+
+//------------------------------------------------------------------------------------
+// Sampling heap profiler. Unlike the meminfo collection above (which records every allocation and its full callstack),
+// the profiler records only a sample of allocations (on average 1 in mem_profile_rate), so that it is cheap enough to leave running.
+// Sampled allocations are stored in a hash table keyed by pointer, and aggregated per call site (function and line number)
+// NOTE: The tables used by the profiler are allocated using malloc() directly, so that they are not themselves profiled
+typedef struct
+{
+    void *ptr;              // Pointer returned to the caller. NULL indicates an unused slot in the table
+    int size;               // Size of the allocation
+    int site;               // Index of the call site (in mem_profile_sites[]) which made the allocation
+} mprof_alloc_t;
+
+typedef struct
+{
+    const char *func;       // Name of the function which made the allocation
+    int line;               // Line number in the function which made the allocation
+    unsigned num_allocs;    // Number of sampled allocations made by this call site
+    long long total_bytes;  // Total number of bytes in sampled allocations made by this call site
+    int live_allocs;        // Number of sampled allocations made by this call site which have not been freed yet
+    long long live_bytes;   // Number of bytes in sampled allocations made by this call site which have not been freed yet
+} mprof_site_t;
+
+static pthread_mutex_t mem_profile_mutex;               // Protects access to all profiler state below, except mem_profile_rate
+static int mem_profile_rate = 0;                        // Average number of allocations per sampled allocation. 0=profiler disabled
+
+static mprof_alloc_t *mem_profile_allocs = NULL;        // Hash table of sampled allocations that are still live, using open addressing
+static int mem_profile_allocs_size = 0;                 // Number of slots in mem_profile_allocs[] (always a power of 2)
+static int mem_profile_allocs_used = 0;                 // Number of used slots in mem_profile_allocs[]
+
+static mprof_site_t *mem_profile_sites = NULL;          // Array of call sites which have made sampled allocations
+static int mem_profile_num_sites = 0;                   // Number of entries in mem_profile_sites[]
+static int *mem_profile_site_index = NULL;              // Hash table (keyed by function and line) of indexes into mem_profile_sites[]. INVALID=unused slot
+static int mem_profile_site_index_size = 0;             // Number of slots in mem_profile_site_index[] (always a power of 2)
+
+// Number of allocations which must be made by this thread before the next one is sampled
+// The countdown is per thread, so that unsampled allocations do not need to take the mutex
+static __thread int mem_profile_countdown = 0;
+static __thread unsigned mem_profile_rand = 0;
+
+// Initial number of slots in the profiler hash tables
+#define MEM_PROFILE_MIN_TABLE_SIZE 1024
+
+//------------------------------------------------------------------------------------
+// Arena used to allocate the protobuf structures unpacked from the USP record currently being handled
+// Unpacking a USP record allocates a large number of small objects (sub-messages, strings and repeated field arrays)
+// Allocating these from an arena, then freeing them all in one go once the message has been handled, avoids malloc churn
+// NOTE: Each thread has its own arena, as USP records may also be handled by the Get worker threads
+typedef struct msg_arena_block_tag
+{
+    struct msg_arena_block_tag *next;   // Next block in the list of blocks allocated for the current message
+    int size;                           // Number of bytes available in data[]
+    int used;                           // Number of bytes of data[] that have been allocated
+    char data[];
+} msg_arena_block_t;
+
+static __thread msg_arena_block_t *msg_arena = NULL;   // Block currently being allocated from (head of linked list of all blocks)
+static __thread int msg_arena_depth = 0;               // Number of nested calls to USP_MEM_MsgArenaBegin() that have not been ended
+
+//------------------------------------------------------------------------------------
+// Number of bytes currently allocated through the functions in this file, and the maximum number of bytes that has been allocated
+// These are always collected (unlike the meminfo above), so that the memory high-water mark of a long running agent is known
+// NOTE: The usable size of each allocation is counted (rather than the size requested), as the size requested is not known when freeing
+static long long mem_in_use = 0;
+static long long mem_high_water_mark = 0;
+
+//------------------------------------------------------------------------------------
+// Memory budgets for the data queued in the message pipeline (see mem_budget_t)
+// NOTE: Budgets are charged and released by the data model thread, the MTP threads and the Get worker threads, so all counters are accessed atomically
+typedef struct
+{
+    char *name;             // Name of the budget, used by USP_MEM_PrintBudgets()
+    long long quota;        // Maximum number of bytes that may be charged to this budget (using USP_MEM_BudgetCharge). 0=unlimited
+    long long used;         // Number of bytes currently charged to this budget
+    long long peak;         // Maximum number of bytes that have been charged to this budget at any one time
+    unsigned rejected;      // Number of charges refused because a quota would have been exceeded
+} mem_budget_info_t;
+
+static mem_budget_info_t mem_budgets[kMemBudget_Max] =
+{
+    { "DmQueue",      MEM_BUDGET_DM_QUEUE,                  0, 0, 0 },    // kMemBudget_DmQueue
+    { "MtpSendQueue", MEM_BUDGET_MTP_SEND_QUEUE,            0, 0, 0 },    // kMemBudget_MtpSendQueue
+    { "SubsRetry",    SUBS_RETRY_MAX_MEMORY,                0, 0, 0 },    // kMemBudget_SubsRetry
+    { "BulkData",     BULKDATA_MAX_RETAINED_REPORTS_MEMORY, 0, 0, 0 },    // kMemBudget_BulkData
+};
+
+static mem_budget_info_t mem_budget_total = { "Total", MEM_BUDGET_TOTAL, 0, 0, 0 };
+
+// Size of each block allocated for the arena. Allocations larger than this get a block to themselves.
+#define MSG_ARENA_BLOCK_SIZE (16*1024)
+
+// Alignment of each allocation made from the arena
+#define MSG_ARENA_ALIGN (sizeof(void *))
+
 //------------------------------------------------------------------------------------
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 void *Protobuf_Alloc(void *allocator_data, size_t size);
 void Protobuf_Free(void *allocator_data, void *pointer);
+void *MsgArena_Alloc(void *allocator_data, size_t size);
+void MsgArena_Free(void *allocator_data, void *pointer);
 minfo_t *FindFreeMemInfo(void);
 minfo_t *FindMemInfoByPtr(void *ptr);
 void PrintMemInfoEntry(minfo_t *mi, char *str, int index);
 void GetCallers(char **callers, int num_callers);
+void MemProfile_Alloc(const char *func, int line, void *ptr, int size);
+void MemProfile_Free(void *ptr);
+bool MemProfile_IsSampled(void);
+int MemProfile_FindSite(const char *func, int line);
+void MemProfile_InsertAlloc(void *ptr, int size, int site);
+void MemProfile_Reset(void);
+unsigned MemProfile_HashPtr(void *ptr);
+int MemProfile_CompareSites(const void *entry1, const void *entry2);
+void MemUsage_Add(void *ptr);
+void MemUsage_Remove(void *ptr);
+void MemBudget_Add(mem_budget_info_t *mb, int size);
+bool MemBudget_IsAbovePercent(mem_budget_info_t *mb, int percent);
 
 //------------------------------------------------------------------------------------
 // Structure defining functions used to allocate and free memory associated with protocol buffers
@@ -110,6 +219,18 @@ static ProtobufCAllocator protobuf_allocator =
 // Pointer to protobuf allocator which is externally visible
 void *pbuf_allocator = (void *)&protobuf_allocator;
 
+// Structure defining functions used to allocate and free memory from the per-message arena
+// NOTE: Only protobuf structures which are unpacked (and freed) within a USP_MEM_MsgArenaBegin/End pair may use this allocator
+static ProtobufCAllocator msg_arena_allocator =
+{
+    MsgArena_Alloc,
+    MsgArena_Free,
+    NULL   // Opaque pointer passed to above 2 functions. Currently unused by those functions.
+};
+
+// Pointer to per-message arena protobuf allocator which is externally visible
+void *pbuf_msg_allocator = (void *)&msg_arena_allocator;
+
 /*********************************************************************//**
 **
 ** Protobuf_Alloc
@@ -149,6 +270,121 @@ void Protobuf_Free(void *allocator_data, void *pointer)
     USP_FREE(pointer);
 }
 
+/*********************************************************************//**
+**
+** MsgArena_Alloc
+**
+** Allocates memory from the per-message arena, used when unpacking a received protocol buffer message
+** This function will terminate USP Agent, if out of memory
+**
+** \param   allocator_data - (UNUSED) opaque pointer passed into this function (defined in msg_arena_allocator)
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *MsgArena_Alloc(void *allocator_data, size_t size)
+{
+    msg_arena_block_t *block;
+    int block_size;
+    void *ptr;
+
+    USP_ASSERT(msg_arena_depth > 0);
+
+    // Round up the size, so that all allocations from the arena are suitably aligned
+    size = (size + MSG_ARENA_ALIGN - 1) & ~(MSG_ARENA_ALIGN - 1);
+
+    // Allocate a new block, if there is not enough space left in the current block
+    block = msg_arena;
+    if ((block == NULL) || (block->used + size > block->size))
+    {
+        block_size = MAX(size, MSG_ARENA_BLOCK_SIZE);
+        block = USP_MALLOC(sizeof(msg_arena_block_t) + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = msg_arena;
+        msg_arena = block;
+    }
+
+    ptr = &block->data[block->used];
+    block->used += size;
+
+    return ptr;
+}
+
+/*********************************************************************//**
+**
+** MsgArena_Free
+**
+** Frees memory allocated from the per-message arena
+** This function does nothing, as all memory in the arena is freed by USP_MEM_MsgArenaEnd()
+**
+** \param   allocator_data - (UNUSED) opaque pointer passed into this function (defined in msg_arena_allocator)
+** \param   pointer - (UNUSED) pointer to memory allocated from the arena
+**
+** \return  None
+**
+**************************************************************************/
+void MsgArena_Free(void *allocator_data, void *pointer)
+{
+    // Intentionally empty
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_MsgArenaBegin
+**
+** Starts the scope of the per-message arena. Protobuf structures may be unpacked using pbuf_msg_allocator until
+** the matching call to USP_MEM_MsgArenaEnd()
+** NOTE: Calls to this function may be nested. The memory is only freed when the outermost scope ends.
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_MsgArenaBegin(void)
+{
+    msg_arena_depth++;
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_MsgArenaEnd
+**
+** Ends the scope of the per-message arena, freeing all memory allocated from it (if this is the outermost scope)
+** NOTE: After this call, no pointers to memory allocated from the arena may be used
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_MsgArenaEnd(void)
+{
+    msg_arena_block_t *block;
+    msg_arena_block_t *next;
+
+    USP_ASSERT(msg_arena_depth > 0);
+    msg_arena_depth--;
+
+    // Exit if there is still an outer scope using the arena
+    if (msg_arena_depth > 0)
+    {
+        return;
+    }
+
+    // Free all blocks in the arena
+    block = msg_arena;
+    while (block != NULL)
+    {
+        next = block->next;
+        USP_FREE(block);
+        block = next;
+    }
+    msg_arena = NULL;
+}
+
 /*********************************************************************//**
 **
 ** USP_MEM_Init
@@ -175,6 +411,13 @@ int USP_MEM_Init(void)
         return err;
     }
 
+    // Exit if unable to create mutex protecting access to the heap profiler
+    err = OS_UTILS_InitMutex(&mem_profile_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
     return USP_ERR_OK;
 }
 
@@ -202,6 +445,7 @@ void *USP_MEM_Malloc(const char *func, int line, int size)
     {
         USP_ERR_Terminate("%s (%d): malloc(%d bytes) failed", func, line, size);
     }
+    MemUsage_Add(ptr);
 
     // Collect memory info, if enabled
     if (collect_memory_info)
@@ -226,6 +470,12 @@ void *USP_MEM_Malloc(const char *func, int line, int size)
         }
         OS_UTILS_UnlockMutex(&mem_access_mutex);
     }
+
+    // Sample the allocation, if heap profiling is enabled
+    if (mem_profile_rate != 0)
+    {
+        MemProfile_Alloc(func, line, ptr, size);
+    }
     
     return ptr;
 }
@@ -247,7 +497,15 @@ void USP_MEM_Free(const char *func, int line, void *ptr)
 {
     minfo_t *mi;
     
+    // Remove the allocation from the heap profile, if it was sampled
+    // NOTE: This must be done before freeing the memory, as after that, the address may be reused by another thread's allocation
+    if (mem_profile_rate != 0)
+    {
+        MemProfile_Free(ptr);
+    }
+
     // Free the memory
+    MemUsage_Remove(ptr);
     free(ptr);
 
 #ifndef __clang_analyzer__
@@ -291,12 +549,20 @@ void *USP_MEM_Realloc(const char *func, int line, void *ptr, int size)
     minfo_t *mi;
     void *new_ptr;
 
+    // Remove the current allocation from the heap profile, if it was sampled (the reallocation is sampled afresh below)
+    if (mem_profile_rate != 0)
+    {
+        MemProfile_Free(ptr);
+    }
+
     // Terminate if out of memory
+    MemUsage_Remove(ptr);
     new_ptr = realloc(ptr, size);
     if (new_ptr == NULL)
     {
         USP_ERR_Terminate("%s (%d): realloc(%d bytes) failed", func, line, size);
     }
+    MemUsage_Add(new_ptr);
 
 #ifndef __clang_analyzer__
     // Clang static analyser goes wrong here because the ptr in meminfo is just an address used as a key; ptr is not owned by meminfo
@@ -324,9 +590,48 @@ void *USP_MEM_Realloc(const char *func, int line, void *ptr, int size)
     }
 #endif
 
+    // Sample the reallocation, if heap profiling is enabled
+    if (mem_profile_rate != 0)
+    {
+        MemProfile_Alloc(func, line, new_ptr, size);
+    }
+
     return new_ptr;
 }
 
+/*********************************************************************//**
+**
+** USP_MEM_Reserve
+**
+** Ensures that a dynamically allocated buffer is at least min_size bytes, reallocating it to size bytes if it is not
+** This allows arrays to be grown geometrically (by passing a size larger than min_size) without having to store the
+** capacity of the array alongside it, as the capacity is obtained from the allocator
+** NOTE: If the allocator's usable size is not available, then the buffer is always reallocated to min_size bytes
+**
+** \param   func - name of caller
+** \param   line - line number of caller
+** \param   ptr - pointer to current buffer, or NULL if the buffer has not been allocated yet
+** \param   min_size - minimum number of bytes that the buffer must hold
+** \param   size - number of bytes to reallocate the buffer to, if it is smaller than min_size
+**
+** \return  pointer to buffer (which may have moved)
+**
+**************************************************************************/
+void *USP_MEM_Reserve(const char *func, int line, void *ptr, int min_size, int size)
+{
+#ifdef HAVE_MALLOC_H
+    // Exit if the buffer is already large enough
+    if ((ptr != NULL) && (malloc_usable_size(ptr) >= (size_t)min_size))
+    {
+        return ptr;
+    }
+
+    return USP_MEM_Realloc(func, line, ptr, MAX(size, min_size));
+#else
+    return USP_MEM_Realloc(func, line, ptr, min_size);
+#endif
+}
+
 /*********************************************************************//**
 **
 ** USP_MEM_Strdup
@@ -359,6 +664,7 @@ void *USP_MEM_Strdup(const char *func, int line, void *ptr)
     {
         USP_ERR_Terminate("%s (%d): strdup(%d bytes) failed", func, line, (int)strlen(ptr)+1);
     }
+    MemUsage_Add(new_ptr);
 
 
     // Collect memory info, if enabled
@@ -384,9 +690,188 @@ void *USP_MEM_Strdup(const char *func, int line, void *ptr)
         OS_UTILS_UnlockMutex(&mem_access_mutex);
     }
 
+    // Sample the allocation, if heap profiling is enabled
+    if (mem_profile_rate != 0)
+    {
+        MemProfile_Alloc(func, line, new_ptr, strlen(ptr) + 1);
+    }
+
     return new_ptr;
 }
 
+/*********************************************************************//**
+**
+** USP_MEM_GetInUse
+**
+** Returns the number of bytes currently allocated through the USP_MEM wrapper functions
+**
+** \param   None
+**
+** \return  number of bytes currently allocated, or 0 if this is not known on this platform
+**
+**************************************************************************/
+long long USP_MEM_GetInUse(void)
+{
+    return __atomic_load_n(&mem_in_use, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_GetHighWaterMark
+**
+** Returns the maximum number of bytes that have been allocated at any one time through the USP_MEM wrapper functions
+**
+** \param   None
+**
+** \return  maximum number of bytes allocated, or 0 if this is not known on this platform
+**
+**************************************************************************/
+long long USP_MEM_GetHighWaterMark(void)
+{
+    return __atomic_load_n(&mem_high_water_mark, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_BudgetCharge
+**
+** Charges the specified number of bytes to the specified memory budget, if this would not exceed either
+** the quota of the budget or the total quota of all budgets
+** NOTE: If successful, the caller must later call USP_MEM_BudgetRelease() with the same size
+**
+** \param   budget - memory budget to charge
+** \param   size - number of bytes to charge
+**
+** \return  true if the bytes were charged, false if the charge was refused (in which case the caller should drop the data)
+**
+**************************************************************************/
+bool USP_MEM_BudgetCharge(mem_budget_t budget, int size)
+{
+    mem_budget_info_t *mb;
+    long long used;
+    long long total;
+
+    USP_ASSERT((budget >= 0) && (budget < kMemBudget_Max));
+    mb = &mem_budgets[budget];
+
+    // Exit if this charge would exceed the quota of the budget
+    // NOTE: The bytes are added first then removed if over quota, so that concurrent charges cannot both pass the check
+    used = __atomic_add_fetch(&mb->used, (long long)size, __ATOMIC_RELAXED);
+    if ((mb->quota != 0) && (used > mb->quota))
+    {
+        __atomic_sub_fetch(&mb->used, (long long)size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mb->rejected, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    // Exit if this charge would exceed the total quota of all budgets
+    total = __atomic_add_fetch(&mem_budget_total.used, (long long)size, __ATOMIC_RELAXED);
+    if ((mem_budget_total.quota != 0) && (total > mem_budget_total.quota))
+    {
+        __atomic_sub_fetch(&mem_budget_total.used, (long long)size, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&mb->used, (long long)size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mb->rejected, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mem_budget_total.rejected, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    // Update the peaks, now that the charge has been accepted
+    MemBudget_Add(mb, 0);
+    MemBudget_Add(&mem_budget_total, 0);
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_BudgetForceCharge
+**
+** Charges the specified number of bytes to the specified memory budget, regardless of its quota
+** This is used for data which must not be dropped (eg USP responses), or which is limited by its own cap
+** NOTE: The caller must later call USP_MEM_BudgetRelease() with the same size
+**
+** \param   budget - memory budget to charge
+** \param   size - number of bytes to charge
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_BudgetForceCharge(mem_budget_t budget, int size)
+{
+    USP_ASSERT((budget >= 0) && (budget < kMemBudget_Max));
+    MemBudget_Add(&mem_budgets[budget], size);
+    MemBudget_Add(&mem_budget_total, size);
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_BudgetRelease
+**
+** Releases bytes previously charged to the specified memory budget
+**
+** \param   budget - memory budget to release the bytes from
+** \param   size - number of bytes to release
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_BudgetRelease(mem_budget_t budget, int size)
+{
+    USP_ASSERT((budget >= 0) && (budget < kMemBudget_Max));
+    __atomic_sub_fetch(&mem_budgets[budget].used, (long long)size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mem_budget_total.used, (long long)size, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_IsBudgetUnderPressure
+**
+** Determines whether the specified memory budget (or the total of all budgets) is close to its quota
+** This is used to apply backpressure before data has to be dropped (eg an MTP thread stops reading from its socket)
+**
+** \param   budget - memory budget to check
+**
+** \return  true if more than MEM_BUDGET_PRESSURE_PERCENT of either quota is in use
+**
+**************************************************************************/
+bool USP_MEM_IsBudgetUnderPressure(mem_budget_t budget)
+{
+    USP_ASSERT((budget >= 0) && (budget < kMemBudget_Max));
+
+    if (MemBudget_IsAbovePercent(&mem_budgets[budget], MEM_BUDGET_PRESSURE_PERCENT))
+    {
+        return true;
+    }
+
+    return MemBudget_IsAbovePercent(&mem_budget_total, MEM_BUDGET_PRESSURE_PERCENT);
+}
+
+/*********************************************************************//**
+**
+** USP_MEM_PrintBudgets
+**
+** Prints the counters of all memory budgets
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_PrintBudgets(void)
+{
+    int i;
+    mem_budget_info_t *mb;
+
+    USP_DUMP("%-14s %12s %12s %12s %10s", "budget", "used", "peak", "quota", "rejected");
+    for (i=0; i<=kMemBudget_Max; i++)
+    {
+        mb = (i < kMemBudget_Max) ? &mem_budgets[i] : &mem_budget_total;
+        USP_DUMP("%-14s %12lld %12lld %12lld %10u", mb->name,
+                 __atomic_load_n(&mb->used, __ATOMIC_RELAXED), __atomic_load_n(&mb->peak, __ATOMIC_RELAXED),
+                 mb->quota, __atomic_load_n(&mb->rejected, __ATOMIC_RELAXED));
+    }
+}
+
 /*********************************************************************//**
 **
 ** USP_MEM_StartCollection
@@ -427,6 +912,12 @@ void USP_MEM_StartCollection(void)
     mi->ptr = SYNC_TIMER_PRIV_GetVector(&mi->size);
     mi->func = sync_timer_add_str;
 
+    // The sync timer lookup table is also reallocated when timers are added
+    mi = FindFreeMemInfo();
+    USP_ASSERT(mi != NULL);
+    mi->ptr = SYNC_TIMER_PRIV_GetLookup(&mi->size);
+    mi->func = sync_timer_add_str;
+
     OS_UTILS_UnlockMutex(&mem_access_mutex);
 }
 
@@ -611,56 +1102,165 @@ int USP_MEM_PrintAll(void)
 
 /*********************************************************************//**
 **
-** PrintMemInfoEntry
+** USP_MEM_SetProfileRate
 **
-** Prints an individual meminfo entry
+** Enables or disables the sampling heap profiler
+** Any profile collected so far is discarded
 **
-** \param   mi - pointer to memory info entry to print out
-** \param   str - string to prefix the debug printout
-** \param   index - index of the entry in the minfo[] array
+** \param   rate - average number of allocations per sampled allocation (1=sample all allocations). 0=disable the profiler
 **
 ** \return  None
 **
 **************************************************************************/
-void PrintMemInfoEntry(minfo_t *mi, char *str, int index)
+void USP_MEM_SetProfileRate(int rate)
 {
-    int i;
-    char *func;
-    
-    USP_LOG_Info("%s [%d] %p size=%d %s (line number:%d)", str, index, mi->ptr, mi->size, mi->func, mi->line);
-    for (i=0; i<NUM_ELEM(mi->callers); i++)
+    OS_UTILS_LockMutex(&mem_profile_mutex);
+    MemProfile_Reset();
+
+    // Allocate the profiler tables, if the profiler is being enabled
+    if (rate > 0)
     {
-        func = mi->callers[i];
-        if (func != NULL)
+        mem_profile_allocs_size = MEM_PROFILE_MIN_TABLE_SIZE;
+        mem_profile_allocs = calloc(mem_profile_allocs_size, sizeof(mprof_alloc_t));
+        mem_profile_site_index_size = MEM_PROFILE_MIN_TABLE_SIZE;
+        mem_profile_site_index = malloc(mem_profile_site_index_size * sizeof(int));
+        if ((mem_profile_allocs == NULL) || (mem_profile_site_index == NULL))
         {
-            USP_LOG_Info("   %s", func);
+            USP_ERR_Terminate("%s: Unable to allocate heap profiler tables", __FUNCTION__);
         }
+        memset(mem_profile_site_index, 0xFF, mem_profile_site_index_size * sizeof(int));     // Sets all entries to INVALID
     }
+
+    mem_profile_rate = (rate > 0) ? rate : 0;
+    OS_UTILS_UnlockMutex(&mem_profile_mutex);
 }
 
 /*********************************************************************//**
 **
-** FindFreeMemInfo
+** USP_MEM_GetProfileRate
 **
-** Finds a free entry in the minfo array
+** Returns the sampling rate of the heap profiler
 **
 ** \param   None
 **
-** \return  Pointer to entry in the array
+** \return  average number of allocations per sampled allocation, or 0 if the profiler is disabled
 **
 **************************************************************************/
-minfo_t *FindFreeMemInfo(void)
+int USP_MEM_GetProfileRate(void)
 {
-    int i;
-    minfo_t *mi;
+    return mem_profile_rate;
+}
 
-    for (i=0; i<MAX_MINFO_ENTRIES; i++)
-    {
-        mi = &minfo[i];
-        if (mi->ptr == NULL)
-        {
-            return mi;
-        }
+/*********************************************************************//**
+**
+** USP_MEM_PrintProfile
+**
+** Prints out the heap profile, aggregated by call site, in order of decreasing live memory
+** NOTE: The figures printed are estimates, obtained by scaling the sampled figures by the sampling rate
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_MEM_PrintProfile(void)
+{
+    int i;
+    int rate;
+    mprof_site_t *sites;
+    mprof_site_t *ms;
+    int num_sites;
+    long long live_bytes = 0;
+    int live_allocs = 0;
+
+    // Exit if the profiler is not enabled
+    rate = mem_profile_rate;
+    if (rate == 0)
+    {
+        USP_DUMP("Heap profiler is not enabled");
+        return;
+    }
+
+    // Take a copy of the call sites, so that the mutex is not held whilst printing
+    OS_UTILS_LockMutex(&mem_profile_mutex);
+    num_sites = mem_profile_num_sites;
+    sites = malloc(MAX(num_sites, 1) * sizeof(mprof_site_t));
+    if (sites == NULL)
+    {
+        USP_ERR_Terminate("%s: Unable to allocate heap profile copy", __FUNCTION__);
+    }
+    memcpy(sites, mem_profile_sites, num_sites * sizeof(mprof_site_t));
+    OS_UTILS_UnlockMutex(&mem_profile_mutex);
+
+    qsort(sites, num_sites, sizeof(mprof_site_t), MemProfile_CompareSites);
+
+    USP_DUMP("Heap profile (sampling 1 in %d allocations). All figures are estimates:-", rate);
+    USP_DUMP("%12s %10s %12s %14s  %s", "live_bytes", "live_num", "total_num", "total_bytes", "call site");
+    for (i=0; i<num_sites; i++)
+    {
+        ms = &sites[i];
+        USP_DUMP("%12lld %10lld %12lld %14lld  %s (line %d)", ms->live_bytes * rate, (long long)ms->live_allocs * rate,
+                                                             (long long)ms->num_allocs * rate, ms->total_bytes * rate, ms->func, ms->line);
+        live_bytes += ms->live_bytes;
+        live_allocs += ms->live_allocs;
+    }
+    USP_DUMP("Total: %lld live bytes in %lld live allocations, from %d call sites", live_bytes * rate, (long long)live_allocs * rate, num_sites);
+
+    free(sites);
+}
+
+/*********************************************************************//**
+**
+** PrintMemInfoEntry
+**
+** Prints an individual meminfo entry
+**
+** \param   mi - pointer to memory info entry to print out
+** \param   str - string to prefix the debug printout
+** \param   index - index of the entry in the minfo[] array
+**
+** \return  None
+**
+**************************************************************************/
+void PrintMemInfoEntry(minfo_t *mi, char *str, int index)
+{
+    int i;
+    char *func;
+    
+    USP_LOG_Info("%s [%d] %p size=%d %s (line number:%d)", str, index, mi->ptr, mi->size, mi->func, mi->line);
+    for (i=0; i<NUM_ELEM(mi->callers); i++)
+    {
+        func = mi->callers[i];
+        if (func != NULL)
+        {
+            USP_LOG_Info("   %s", func);
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** FindFreeMemInfo
+**
+** Finds a free entry in the minfo array
+**
+** \param   None
+**
+** \return  Pointer to entry in the array
+**
+**************************************************************************/
+minfo_t *FindFreeMemInfo(void)
+{
+    int i;
+    minfo_t *mi;
+
+    for (i=0; i<MAX_MINFO_ENTRIES; i++)
+    {
+        mi = &minfo[i];
+        if (mi->ptr == NULL)
+        {
+            return mi;
+        }
     }
 
     // If the code gets here, then the minfo array was full
@@ -753,3 +1353,509 @@ void GetCallers(char **callers, int num_callers)
     }
 }
 
+/*********************************************************************//**
+**
+** MemProfile_Alloc
+**
+** Called for every allocation whilst the heap profiler is enabled. Records the allocation if it is selected for sampling.
+**
+** \param   func - name of caller
+** \param   line - line number of caller
+** \param   ptr - pointer to the memory which has been allocated
+** \param   size - number of bytes allocated
+**
+** \return  None
+**
+**************************************************************************/
+void MemProfile_Alloc(const char *func, int line, void *ptr, int size)
+{
+    int site;
+    mprof_site_t *ms;
+
+    // Exit if this allocation is not sampled
+    if (MemProfile_IsSampled() == false)
+    {
+        return;
+    }
+
+    OS_UTILS_LockMutex(&mem_profile_mutex);
+
+    // Exit if the profiler was disabled by another thread, whilst we were waiting for the mutex
+    if (mem_profile_rate == 0)
+    {
+        goto exit;
+    }
+
+    // Update the per call site aggregates
+    site = MemProfile_FindSite(func, line);
+    ms = &mem_profile_sites[site];
+    ms->num_allocs++;
+    ms->total_bytes += size;
+    ms->live_allocs++;
+    ms->live_bytes += size;
+
+    // Record the allocation, so that the call site's live figures can be updated when it is freed
+    MemProfile_InsertAlloc(ptr, size, site);
+
+exit:
+    OS_UTILS_UnlockMutex(&mem_profile_mutex);
+}
+
+/*********************************************************************//**
+**
+** MemProfile_Free
+**
+** Called for every free whilst the heap profiler is enabled. Removes the allocation from the profile, if it was sampled.
+** Deletion uses backward shifting, so that the hash table does not need tombstones
+**
+** \param   ptr - pointer to the memory which is being freed
+**
+** \return  None
+**
+**************************************************************************/
+void MemProfile_Free(void *ptr)
+{
+    unsigned mask;
+    unsigned i;
+    unsigned j;
+    unsigned home;
+    mprof_alloc_t *ma;
+    mprof_site_t *ms;
+
+    // Exit if nothing to free
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    OS_UTILS_LockMutex(&mem_profile_mutex);
+
+    // Exit if the profiler was disabled by another thread, or there are no sampled allocations
+    if ((mem_profile_rate == 0) || (mem_profile_allocs_used == 0))
+    {
+        goto exit;
+    }
+
+    // Exit if this allocation was not sampled
+    mask = mem_profile_allocs_size - 1;
+    i = MemProfile_HashPtr(ptr) & mask;
+    while (mem_profile_allocs[i].ptr != ptr)
+    {
+        if (mem_profile_allocs[i].ptr == NULL)
+        {
+            goto exit;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // Update the live figures of the call site which made the allocation
+    ma = &mem_profile_allocs[i];
+    ms = &mem_profile_sites[ma->site];
+    ms->live_allocs--;
+    ms->live_bytes -= ma->size;
+
+    // Remove the entry, shifting back any following entries in the same cluster which could occupy the vacated slot
+    j = i;
+    while (FOREVER)
+    {
+        mem_profile_allocs[i].ptr = NULL;
+        do
+        {
+            j = (j + 1) & mask;
+            if (mem_profile_allocs[j].ptr == NULL)
+            {
+                mem_profile_allocs_used--;
+                goto exit;
+            }
+            home = MemProfile_HashPtr(mem_profile_allocs[j].ptr) & mask;
+        } while ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j)));
+
+        mem_profile_allocs[i] = mem_profile_allocs[j];
+        i = j;
+    }
+
+exit:
+    OS_UTILS_UnlockMutex(&mem_profile_mutex);
+}
+
+/*********************************************************************//**
+**
+** MemProfile_IsSampled
+**
+** Determines whether the current allocation should be sampled
+** The gap between sampled allocations is randomised (uniformly, with mean equal to the sampling rate),
+** to avoid aliasing with allocation patterns which repeat with a fixed period
+**
+** \param   None
+**
+** \return  true if the current allocation should be sampled
+**
+**************************************************************************/
+bool MemProfile_IsSampled(void)
+{
+    int rate;
+
+    // Exit if this thread still has allocations to skip before the next sample
+    if (--mem_profile_countdown > 0)
+    {
+        return false;
+    }
+
+    // Exit if sampling all allocations
+    rate = mem_profile_rate;
+    if (rate <= 1)
+    {
+        return true;
+    }
+
+    // Seed this thread's random number generator on first use
+    if (mem_profile_rand == 0)
+    {
+        mem_profile_rand = (unsigned)(uintptr_t)&mem_profile_countdown | 1;
+    }
+
+    // Xorshift random number generator, used to choose the gap to the next sampled allocation (in the range 1..2*rate-1)
+    mem_profile_rand ^= mem_profile_rand << 13;
+    mem_profile_rand ^= mem_profile_rand >> 17;
+    mem_profile_rand ^= mem_profile_rand << 5;
+    mem_profile_countdown = 1 + (mem_profile_rand % (2*rate - 1));
+
+    return true;
+}
+
+/*********************************************************************//**
+**
+** MemProfile_FindSite
+**
+** Returns the index of the specified call site in mem_profile_sites[], adding it if it does not already exist
+** NOTE: Call sites are keyed by the address of the function name (__FUNCTION__), rather than its contents, for speed
+**
+** \param   func - name of caller
+** \param   line - line number of caller
+**
+** \return  index of the call site in mem_profile_sites[]
+**
+**************************************************************************/
+int MemProfile_FindSite(const char *func, int line)
+{
+    unsigned mask;
+    unsigned i;
+    int index;
+    int *new_index;
+    int new_size;
+    mprof_site_t *new_sites;
+    mprof_site_t *ms;
+
+    // Exit if the call site already exists
+    mask = mem_profile_site_index_size - 1;
+    i = (MemProfile_HashPtr((void *)func) + line * 0x9E3779B1U) & mask;
+    while ((index = mem_profile_site_index[i]) != INVALID)
+    {
+        ms = &mem_profile_sites[index];
+        if ((ms->func == func) && (ms->line == line))
+        {
+            return index;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // Add the new call site
+    index = mem_profile_num_sites;
+    new_sites = realloc(mem_profile_sites, (index + 1) * sizeof(mprof_site_t));
+    if (new_sites == NULL)
+    {
+        USP_ERR_Terminate("%s: Unable to grow heap profiler call site table", __FUNCTION__);
+    }
+    mem_profile_sites = new_sites;
+    mem_profile_num_sites++;
+    ms = &mem_profile_sites[index];
+    memset(ms, 0, sizeof(mprof_site_t));
+    ms->func = func;
+    ms->line = line;
+    mem_profile_site_index[i] = index;
+
+    // Exit if the call site index does not need to grow (it is kept at most half full)
+    if (mem_profile_num_sites*2 <= mem_profile_site_index_size)
+    {
+        return index;
+    }
+
+    // Rebuild the call site index with double the number of slots
+    new_size = mem_profile_site_index_size * 2;
+    new_index = malloc(new_size * sizeof(int));
+    if (new_index == NULL)
+    {
+        USP_ERR_Terminate("%s: Unable to grow heap profiler call site index", __FUNCTION__);
+    }
+    memset(new_index, 0xFF, new_size * sizeof(int));
+    mask = new_size - 1;
+    for (index=0; index < mem_profile_num_sites; index++)
+    {
+        ms = &mem_profile_sites[index];
+        i = (MemProfile_HashPtr((void *)ms->func) + ms->line * 0x9E3779B1U) & mask;
+        while (new_index[i] != INVALID)
+        {
+            i = (i + 1) & mask;
+        }
+        new_index[i] = index;
+    }
+
+    free(mem_profile_site_index);
+    mem_profile_site_index = new_index;
+    mem_profile_site_index_size = new_size;
+
+    return mem_profile_num_sites - 1;
+}
+
+/*********************************************************************//**
+**
+** MemProfile_InsertAlloc
+**
+** Adds the specified allocation to the hash table of sampled allocations, growing the table if necessary
+**
+** \param   ptr - pointer to the memory which has been allocated
+** \param   size - number of bytes allocated
+** \param   site - index of the call site which made the allocation
+**
+** \return  None
+**
+**************************************************************************/
+void MemProfile_InsertAlloc(void *ptr, int size, int site)
+{
+    unsigned mask;
+    unsigned i;
+    int j;
+    mprof_alloc_t *old_allocs;
+    int old_size;
+    mprof_alloc_t *ma;
+
+    // Grow the table if it would become more than half full
+    if ((mem_profile_allocs_used + 1)*2 > mem_profile_allocs_size)
+    {
+        old_allocs = mem_profile_allocs;
+        old_size = mem_profile_allocs_size;
+        mem_profile_allocs_size = old_size * 2;
+        mem_profile_allocs = calloc(mem_profile_allocs_size, sizeof(mprof_alloc_t));
+        if (mem_profile_allocs == NULL)
+        {
+            USP_ERR_Terminate("%s: Unable to grow heap profiler allocation table", __FUNCTION__);
+        }
+
+        mask = mem_profile_allocs_size - 1;
+        for (j=0; j<old_size; j++)
+        {
+            ma = &old_allocs[j];
+            if (ma->ptr != NULL)
+            {
+                i = MemProfile_HashPtr(ma->ptr) & mask;
+                while (mem_profile_allocs[i].ptr != NULL)
+                {
+                    i = (i + 1) & mask;
+                }
+                mem_profile_allocs[i] = *ma;
+            }
+        }
+        free(old_allocs);
+    }
+
+    // Find the slot for the allocation
+    mask = mem_profile_allocs_size - 1;
+    i = MemProfile_HashPtr(ptr) & mask;
+    while ((mem_profile_allocs[i].ptr != NULL) && (mem_profile_allocs[i].ptr != ptr))
+    {
+        i = (i + 1) & mask;
+    }
+
+    // If the address is already present (because it was freed without the profiler seeing it), then discard the stale entry
+    ma = &mem_profile_allocs[i];
+    if (ma->ptr == ptr)
+    {
+        mem_profile_sites[ma->site].live_allocs--;
+        mem_profile_sites[ma->site].live_bytes -= ma->size;
+    }
+    else
+    {
+        mem_profile_allocs_used++;
+    }
+
+    ma->ptr = ptr;
+    ma->size = size;
+    ma->site = site;
+}
+
+/*********************************************************************//**
+**
+** MemProfile_Reset
+**
+** Frees all tables used by the heap profiler
+** NOTE: Caller must hold mem_profile_mutex
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void MemProfile_Reset(void)
+{
+    free(mem_profile_allocs);
+    mem_profile_allocs = NULL;
+    mem_profile_allocs_size = 0;
+    mem_profile_allocs_used = 0;
+
+    free(mem_profile_sites);
+    mem_profile_sites = NULL;
+    mem_profile_num_sites = 0;
+
+    free(mem_profile_site_index);
+    mem_profile_site_index = NULL;
+    mem_profile_site_index_size = 0;
+}
+
+/*********************************************************************//**
+**
+** MemProfile_HashPtr
+**
+** Calculates a hash of the specified pointer, for use as the starting slot in the profiler hash tables
+**
+** \param   ptr - pointer to hash
+**
+** \return  hash of the pointer
+**
+**************************************************************************/
+unsigned MemProfile_HashPtr(void *ptr)
+{
+    unsigned long long key;
+
+    // Fibonacci hashing. Low bits of heap addresses are mostly zero due to alignment, so take the upper bits of the product
+    key = (unsigned long long)(uintptr_t)ptr;
+    return (unsigned)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/*********************************************************************//**
+**
+** MemProfile_CompareSites
+**
+** qsort() comparison function used to order call sites by decreasing live bytes (then by decreasing total bytes)
+**
+** \param   entry1 - pointer to first call site to compare
+** \param   entry2 - pointer to second call site to compare
+**
+** \return  negative if entry1 should be printed before entry2, positive if after, 0 if equal
+**
+**************************************************************************/
+int MemProfile_CompareSites(const void *entry1, const void *entry2)
+{
+    const mprof_site_t *ms1 = entry1;
+    const mprof_site_t *ms2 = entry2;
+
+    if (ms1->live_bytes != ms2->live_bytes)
+    {
+        return (ms1->live_bytes > ms2->live_bytes) ? -1 : 1;
+    }
+
+    if (ms1->total_bytes != ms2->total_bytes)
+    {
+        return (ms1->total_bytes > ms2->total_bytes) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** MemUsage_Add
+**
+** Adds the specified allocation to the count of memory in use, updating the high-water mark
+**
+** \param   ptr - pointer to memory which has just been allocated
+**
+** \return  None
+**
+**************************************************************************/
+void MemUsage_Add(void *ptr)
+{
+#ifdef HAVE_MALLOC_H
+    long long in_use;
+    long long hwm;
+
+    in_use = __atomic_add_fetch(&mem_in_use, (long long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+
+    // Update the high-water mark, retrying if another thread updated it concurrently
+    hwm = __atomic_load_n(&mem_high_water_mark, __ATOMIC_RELAXED);
+    while ((in_use > hwm) && (__atomic_compare_exchange_n(&mem_high_water_mark, &hwm, in_use, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false))
+    {
+        // NOTE: The failed compare-exchange has updated hwm to the current value of the high-water mark
+    }
+#endif
+}
+
+/*********************************************************************//**
+**
+** MemUsage_Remove
+**
+** Removes the specified allocation from the count of memory in use
+** NOTE: This must be called before the memory is freed
+**
+** \param   ptr - pointer to memory which is about to be freed (may be NULL)
+**
+** \return  None
+**
+**************************************************************************/
+void MemUsage_Remove(void *ptr)
+{
+#ifdef HAVE_MALLOC_H
+    if (ptr != NULL)
+    {
+        __atomic_sub_fetch(&mem_in_use, (long long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+/*********************************************************************//**
+**
+** MemBudget_Add
+**
+** Adds the specified number of bytes to the specified memory budget, updating its peak
+**
+** \param   mb - pointer to memory budget
+** \param   size - number of bytes to add (may be 0, to just update the peak)
+**
+** \return  None
+**
+**************************************************************************/
+void MemBudget_Add(mem_budget_info_t *mb, int size)
+{
+    long long used;
+    long long peak;
+
+    used = __atomic_add_fetch(&mb->used, (long long)size, __ATOMIC_RELAXED);
+
+    // Update the peak, retrying if another thread updated it concurrently
+    peak = __atomic_load_n(&mb->peak, __ATOMIC_RELAXED);
+    while ((used > peak) && (__atomic_compare_exchange_n(&mb->peak, &peak, used, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false))
+    {
+        // NOTE: The failed compare-exchange has updated peak to the current value of the peak
+    }
+}
+
+/*********************************************************************//**
+**
+** MemBudget_IsAbovePercent
+**
+** Determines whether more than the specified percentage of the quota of the specified memory budget is in use
+**
+** \param   mb - pointer to memory budget
+** \param   percent - percentage of the quota to compare against
+**
+** \return  true if more than the percentage of the quota is in use, false if not (or the budget is unlimited)
+**
+**************************************************************************/
+bool MemBudget_IsAbovePercent(mem_budget_info_t *mb, int percent)
+{
+    if (mb->quota == 0)
+    {
+        return false;
+    }
+
+    return (__atomic_load_n(&mb->used, __ATOMIC_RELAXED) * 100 > mb->quota * percent);
+}
@@ -47,14 +47,33 @@
 #define USP_FREE(x)                 USP_MEM_Free(__FUNCTION__, __LINE__, x)
 #define USP_SAFE_FREE(x)            if (x != NULL) { USP_MEM_Free(__FUNCTION__, __LINE__, x); x = NULL; }
 #define USP_REALLOC(x, y)           USP_MEM_Realloc(__FUNCTION__, __LINE__, x, y)
+#define USP_RESERVE(x, y, z)        USP_MEM_Reserve(__FUNCTION__, __LINE__, x, y, z)
 #define USP_STRDUP(x)               USP_MEM_Strdup(__FUNCTION__, __LINE__, x)
 
+//------------------------------------------------------------------------------------
+// Memory budgets. Each budget accounts for the memory held by one class of queued data, and has its own quota (see vendor_defs.h)
+// All budgets are also counted against an overall quota (MEM_BUDGET_TOTAL)
+typedef enum
+{
+    kMemBudget_DmQueue,         // USP records posted by the MTP threads, waiting to be processed by the data model thread
+    kMemBudget_MtpSendQueue,    // USP records queued on the MTP connections, waiting to be sent
+    kMemBudget_SubsRetry,       // NotifyRequests awaiting a NotifyResponse (see subs_retry.c)
+    kMemBudget_BulkData,        // Bulk data reports retained for sending (see device_bulkdata.c)
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kMemBudget_Max
+} mem_budget_t;
+
+// Period (in ms) at which an MTP thread which has stopped reading from its socket (because of memory pressure) re-checks the budgets
+#define MEM_BUDGET_RECHECK_PERIOD  100
+
 //------------------------------------------------------------------------------------
 // Functions wrapping memory allocation
 int USP_MEM_Init(void);
 void *USP_MEM_Malloc(const char *func, int line, int size);
 void USP_MEM_Free(const char *func, int line, void *ptr);
 void *USP_MEM_Realloc(const char *func, int line, void *ptr, int size);
+void *USP_MEM_Reserve(const char *func, int line, void *ptr, int min_size, int size);
 void *USP_MEM_Strdup(const char *func, int line, void *ptr);
 void USP_MEM_StartCollection(void);
 void USP_MEM_StopCollection(void);
@@ -62,9 +81,24 @@ void USP_MEM_Print(void);
 void USP_MEM_PrintSummary(void);
 void USP_MEM_PrintLeakReport(void);
 int USP_MEM_PrintAll(void);
+void USP_MEM_SetProfileRate(int rate);
+int USP_MEM_GetProfileRate(void);
+void USP_MEM_PrintProfile(void);
+void USP_MEM_MsgArenaBegin(void);
+void USP_MEM_MsgArenaEnd(void);
+long long USP_MEM_GetInUse(void);
+long long USP_MEM_GetHighWaterMark(void);
+bool USP_MEM_BudgetCharge(mem_budget_t budget, int size);
+void USP_MEM_BudgetForceCharge(mem_budget_t budget, int size);
+void USP_MEM_BudgetRelease(mem_budget_t budget, int size);
+bool USP_MEM_IsBudgetUnderPressure(mem_budget_t budget);
+void USP_MEM_PrintBudgets(void);
 void MAIN_Stop(void);
 
 // Pointer to structure containing the protocol buffer allocator function
 extern void *pbuf_allocator;
 
+// Pointer to structure containing the protocol buffer allocator function for the per-message arena (see USP_MEM_MsgArenaBegin)
+extern void *pbuf_msg_allocator;
+
 #endif
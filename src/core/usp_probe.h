@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file usp_probe.h
+ *
+ * Macros defining static probe points on the hot paths of USP Agent
+ * When ENABLE_USDT_PROBES is defined (see vendor_defs.h), each probe point is compiled as a USDT (SystemTap SDT) probe
+ * in the 'obuspa' provider, which may be attached to at runtime using perf, bpftrace, SystemTap or LTTng (eg 'bpftrace -l usdt:./obuspa:*')
+ * A USDT probe compiles to a single nop instruction, so it has negligible overhead when nothing is attached to it.
+ * When ENABLE_USDT_PROBES is not defined, the probe points compile to nothing.
+ *
+ */
+#ifndef USP_PROBE_H
+#define USP_PROBE_H
+
+#include "vendor_defs.h"  // for ENABLE_USDT_PROBES
+
+#ifdef ENABLE_USDT_PROBES
+#include <sys/sdt.h>
+
+#define USP_PROBE(name)                 DTRACE_PROBE(obuspa, name)
+#define USP_PROBE1(name, a)             DTRACE_PROBE1(obuspa, name, a)
+#define USP_PROBE2(name, a, b)          DTRACE_PROBE2(obuspa, name, a, b)
+#define USP_PROBE3(name, a, b, c)       DTRACE_PROBE3(obuspa, name, a, b, c)
+#else
+#define USP_PROBE(name)
+#define USP_PROBE1(name, a)
+#define USP_PROBE2(name, a, b)
+#define USP_PROBE3(name, a, b, c)
+#endif
+
+//------------------------------------------------------------------------------
+// List of probe points, and their arguments
+// msg_receive           - (int msg_type, char *msg_id, char *from_endpoint)  USP message received, before it is processed
+// msg_handled           - (int msg_type, char *msg_id)                       USP message has been processed
+// path_resolve_start    - (char *path, int op)                               Path resolution has started
+// path_resolve_end      - (char *path, int op, int err)                      Path resolution has finished
+// vendor_get_entry      - (char *path)                                       Vendor get parameter callback is about to be called
+// vendor_get_exit       - (char *path, int err)                              Vendor get parameter callback has returned
+// vendor_set_entry      - (char *path, char *value)                          Vendor set parameter callback is about to be called
+// vendor_set_exit       - (char *path, int err)                              Vendor set parameter callback has returned
+// db_get                - (char *path, int err)                              Parameter has been read from the database
+// db_set                - (char *path, char *value, int err)                 Parameter has been written to the database (secure values are obfuscated)
+// notify_send           - (int subs_instance, int notify_type, char *path)   Notification is being sent
+// mtp_write             - (int protocol, char *host, int num_bytes)          MTP has written bytes to its socket
+
+#endif
@@ -40,18 +40,47 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 
 #include "common_defs.h"
 #include "dllist.h"
 #include "data_model.h"
 #include "dm_access.h"
 #include "dm_inst_vector.h"
+#include "path_resolver.h"
 
 //------------------------------------------------------------------------------
 // Structure containing vendor hook callback functions which are used by the core agent data model
 // NOTE: As this structure is registered early in the bootup, it is safe to be indexed from multiple threads subsequently
 vendor_hook_cb_t vendor_hook_callbacks = { NULL };
 
+//------------------------------------------------------------------------------
+// Arrays of get and set callbacks for each group of vendor parameters (see USP_REGISTER_GroupVendorHooks)
+dm_get_group_cb_t group_get_callbacks[MAX_VENDOR_PARAM_GROUPS] = { NULL };
+dm_set_group_cb_t group_set_callbacks[MAX_VENDOR_PARAM_GROUPS] = { NULL };
+
+//------------------------------------------------------------------------------
+// Staged vendor registrations (see USP_REGISTER_StagedInit)
+// Each is prepared on its own thread (eg querying hardware capabilities), whilst the rest of the schema is registered
+typedef struct
+{
+    dm_staged_prepare_cb_t prepare_cb;
+    dm_staged_register_cb_t register_cb;
+    void *context;          // Context returned by the prepare callback, which is passed to the register callback
+    int err;                // Error code returned by the prepare callback
+    pthread_t thread;       // Thread on which the prepare callback is running
+    bool is_thread_started; // Set if the prepare callback is running on its own thread (rather than having been called directly)
+} staged_init_t;
+
+static staged_init_t staged_inits[MAX_STAGED_INITS];
+static int num_staged_inits = 0;
+
+//------------------------------------------------------------------------------
+// Shared memory regions containing vendor statistics (see USP_REGISTER_SharedMemStats)
+// The parameters registered with each region point to its entry in this array
+static usp_shm_region_t shm_stats_regions[MAX_SHM_STATS_REGIONS];
+static int num_shm_stats_regions = 0;
+
 //------------------------------------------------------------------------------
 // Commonly used strings
 static char *usp_err_invalid_param_str = "%s: Invalid parameters";
@@ -69,6 +98,139 @@ typedef int (*generic_cb_t)(void);
 // Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
 int ValidateAliasParam(dm_req_t *req, char *value);
 int ValidateParamUniqueness(dm_req_t *req, char *value);
+void *StagedInitThreadMain(void *args);
+void RegisterStaticNodeInfo(const usp_static_node_t *sn, dm_node_t *node, dm_node_t **nodes);
+void RegisterStaticUniqueKeys(const usp_static_node_t *sn, dm_node_t *node, dm_node_t **nodes);
+int ValidateShmStatsParam(usp_shm_region_t *region, usp_shm_param_t *param);
+
+/*********************************************************************//**
+**
+** USP_REGISTER_StagedInit
+**
+** Registers a vendor module whose registration is split into two stages, so that time consuming preparation
+** (eg querying hardware capabilities) may be performed in parallel with the registration of the rest of the schema
+** The prepare callback is started immediately on its own thread. It must not call any USP API functions (other than logging).
+** Once VENDOR_Init() has returned, the register callback is called on the data model thread (in the order that the
+** staged registrations were registered), after its prepare callback has completed. It should then call the USP_REGISTER_XXX() functions.
+**
+** \param   prepare_cb - callback called on its own thread to prepare the registration. It returns a context which is passed to register_cb
+** \param   register_cb - callback called on the data model thread to register the schema fragment
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_REGISTER_StagedInit(dm_staged_prepare_cb_t prepare_cb, dm_staged_register_cb_t register_cb)
+{
+    staged_init_t *si;
+    int err;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, "undefined");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are incorrect
+    if ((prepare_cb == NULL) || (register_cb == NULL))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if too many staged registrations
+    if (num_staged_inits >= MAX_STAGED_INITS)
+    {
+        USP_ERR_SetMessage("%s: Too many staged registrations. Increase MAX_STAGED_INITS", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    si = &staged_inits[num_staged_inits];
+    memset(si, 0, sizeof(staged_init_t));
+    si->prepare_cb = prepare_cb;
+    si->register_cb = register_cb;
+    num_staged_inits++;
+
+    // Start the prepare callback on its own thread
+    // NOTE: If unable to start the thread, then the prepare callback is called directly instead
+    err = pthread_create(&si->thread, NULL, StagedInitThreadMain, si);
+    if (err != 0)
+    {
+        USP_LOG_Warning("%s: pthread_create() failed (err=%d). Preparing staged registration serially", __FUNCTION__, err);
+        StagedInitThreadMain(si);
+        return USP_ERR_OK;
+    }
+    si->is_thread_started = true;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_CompleteStagedInits
+**
+** Waits for the prepare callback of each staged registration to complete, then calls its register callback
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_REGISTER_CompleteStagedInits(void)
+{
+    int i;
+    int err = USP_ERR_OK;
+    staged_init_t *si;
+
+    // NOTE: All threads are joined, even if an error occurs, so that none are left running
+    for (i=0; i<num_staged_inits; i++)
+    {
+        si = &staged_inits[i];
+        if (si->is_thread_started)
+        {
+            pthread_join(si->thread, NULL);
+            si->is_thread_started = false;
+        }
+
+        // Skip if a previous staged registration has failed, or this one failed to prepare
+        if (err != USP_ERR_OK)
+        {
+            continue;
+        }
+
+        if (si->err != USP_ERR_OK)
+        {
+            USP_LOG_Error("%s: prepare callback of staged registration %d failed (err=%d)", __FUNCTION__, i+1, si->err);
+            err = si->err;
+            continue;
+        }
+
+        err = si->register_cb(si->context);
+    }
+
+    num_staged_inits = 0;
+    return err;
+}
+
+/*********************************************************************//**
+**
+** StagedInitThreadMain
+**
+** Main function of the thread which calls the prepare callback of a staged registration
+**
+** \param   args - pointer to staged registration to prepare
+**
+** \return  NULL
+**
+**************************************************************************/
+void *StagedInitThreadMain(void *args)
+{
+    staged_init_t *si = (staged_init_t *) args;
+
+    si->err = si->prepare_cb(&si->context);
+
+    return NULL;
+}
 
 /*********************************************************************//**
 **
@@ -473,6 +635,151 @@ int USP_REGISTER_VendorParam_ReadOnly(char *path, dm_get_value_cb_t get_cb, unsi
     info->get_cb = get_cb;
     info->set_cb = NULL;
     info->type_flags = type_flags;
+    info->group_id = NON_GROUPED;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_GroupedVendorParam_ReadOnly
+**
+** Registers a read only vendor parameter, whose value is obtained by the get callback of the group that it belongs to
+** When the values of many parameters are required at the same time (eg by a get request, value change polling or bulk data collection),
+** all parameters in the same group are obtained using a single call to the group's get callback
+**
+** \param   group_id - group that the parameter belongs to. The group's get callback is registered using USP_REGISTER_GroupVendorHooks()
+** \param   path - full data model path for the parameter
+** \param   type_flags - type of the parameter
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_GroupedVendorParam_ReadOnly(int group_id, char *path, unsigned type_flags)
+{
+    dm_node_t *node;
+    dm_param_info_t *info;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((path == NULL) || (group_id < 0) || (group_id >= MAX_VENDOR_PARAM_GROUPS))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Add this path to the data model
+    node = DM_PRIV_AddSchemaPath(path, kDMNodeType_VendorParam_ReadOnly, 0);
+    if (node == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Save registered info into the data model
+    info = &node->registered.param_info;
+    memset(info, 0, sizeof(dm_param_info_t));
+    info->get_cb = NULL;
+    info->set_cb = NULL;
+    info->type_flags = type_flags;
+    info->group_id = group_id;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_GroupedVendorParam_ReadWrite
+**
+** Registers a read-write vendor parameter, whose value is obtained and set by the callbacks of the group that it belongs to
+** Sets of grouped parameters are deferred until the transaction is committed. At that point, all pending sets
+** of parameters in the same group are applied using a single call to the group's set callback
+**
+** \param   group_id - group that the parameter belongs to. The group's callbacks are registered using USP_REGISTER_GroupVendorHooks()
+** \param   path - full data model path for the parameter
+** \param   type_flags - type of the parameter
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_GroupedVendorParam_ReadWrite(int group_id, char *path, unsigned type_flags)
+{
+    dm_node_t *node;
+    dm_param_info_t *info;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((path == NULL) || (group_id < 0) || (group_id >= MAX_VENDOR_PARAM_GROUPS))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Add this path to the data model
+    node = DM_PRIV_AddSchemaPath(path, kDMNodeType_VendorParam_ReadWrite, 0);
+    if (node == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Save registered info into the data model
+    info = &node->registered.param_info;
+    memset(info, 0, sizeof(dm_param_info_t));
+    info->get_cb = NULL;
+    info->set_cb = NULL;
+    info->type_flags = type_flags;
+    info->group_id = group_id;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_GroupVendorHooks
+**
+** Registers the get and set callbacks for a group of vendor parameters (see USP_REGISTER_GroupedVendorParam_ReadOnly/ReadWrite)
+** The get callback is passed a key-value vector containing the paths of the parameters to get (as keys)
+** The value of each parameter is initially an empty string. The callback must replace it with the value of the parameter
+** (eg using USP_ARG_Replace()), without adding or removing entries from the vector
+** The set callback is passed a key-value vector containing the paths and new values of all parameters in the group
+** which were set in the transaction being committed
+**
+** \param   group_id - group to register the callbacks for
+** \param   get_group_cb - callback called to get the values of parameters in the group
+** \param   set_group_cb - callback called to set the values of parameters in the group. This may be NULL if all parameters in the group are read only
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_GroupVendorHooks(int group_id, dm_get_group_cb_t get_group_cb, dm_set_group_cb_t set_group_cb)
+{
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, "undefined");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are incorrect
+    if ((get_group_cb == NULL) || (group_id < 0) || (group_id >= MAX_VENDOR_PARAM_GROUPS))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    group_get_callbacks[group_id] = get_group_cb;
+    group_set_callbacks[group_id] = set_group_cb;
     return USP_ERR_OK;
 }
 
@@ -526,6 +833,272 @@ int USP_REGISTER_VendorParam_ReadWrite(char *path, dm_get_value_cb_t get_cb, dm_
     info->set_cb = set_cb;
     info->notify_set_cb = notify_set_cb;
     info->type_flags = type_flags;
+    info->group_id = NON_GROUPED;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_VendorParam_CachePeriod
+**
+** Registers that the value returned by the get callback of a vendor parameter may be cached for the specified period
+** This is useful for parameters which are expensive to read, and which are read many times in quick succession
+** (eg by a get request, bulk data collection and value change polling)
+** The cached value of a parameter is discarded when the parameter is set, or signalled by USP_SIGNAL_ValueChanged()
+** NOTE: This function must be called after the parameter has been registered by USP_REGISTER_VendorParam_ReadOnly()
+**       or USP_REGISTER_VendorParam_ReadWrite(). Grouped vendor parameters are not cached.
+**
+** \param   path - full data model path for the parameter
+** \param   cache_period - number of milliseconds for which the value of the parameter may be cached
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_VendorParam_CachePeriod(char *path, int cache_period)
+{
+    dm_node_t *node;
+    dm_param_info_t *info;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((path == NULL) || (cache_period < 0))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to find this parameter in the data model
+    #define ASSUMED_VENDOR_PARAM_TYPE  kDMNodeType_VendorParam_ReadOnly
+    node = DM_PRIV_AddSchemaPath(path, ASSUMED_VENDOR_PARAM_TYPE, SUPPRESS_PRE_EXISTANCE_ERR | SUPPRESS_LAST_TYPE_CHECK);
+    if (node == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Because we suppressed the type check of the last node, check here that it is a vendor parameter with its own get callback
+    info = &node->registered.param_info;
+    if (((node->type != kDMNodeType_VendorParam_ReadOnly) && (node->type != kDMNodeType_VendorParam_ReadWrite)) ||
+        (info->group_id != NON_GROUPED) || (info->get_cb == NULL))
+    {
+        USP_ERR_SetMessage("%s: Expected %s to be a registered (non grouped) vendor parameter", __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    info->cache_period = cache_period;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_VendorParam_AsyncGet
+**
+** Registers a callback which Get requests use to start getting the value of a vendor parameter asynchronously
+** The callback must not block. It returns USP_ERR_OK to indicate that the value is pending, and the vendor later
+** returns the value by calling USP_SIGNAL_GetValueComplete() with the request_id passed to the callback (from any thread)
+** This allows the values of many parameters (eg each requiring an IPC round trip) to be obtained concurrently,
+** with the Get response being sent once all values have been returned (or ASYNC_GET_TIMEOUT has elapsed)
+** NOTE: This function must be called after the parameter has been registered by USP_REGISTER_VendorParam_ReadOnly()
+**       or USP_REGISTER_VendorParam_ReadWrite(). The parameter's get callback is still used in all other cases
+**       (eg value change polling, bulk data collection, search expressions, and Get requests processed by the Get worker threads)
+**
+** \param   path - full data model path for the parameter
+** \param   async_get_cb - callback called to start getting the value of the parameter
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_VendorParam_AsyncGet(char *path, dm_async_get_cb_t async_get_cb)
+{
+    dm_node_t *node;
+    dm_param_info_t *info;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((path == NULL) || (async_get_cb == NULL))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to find this parameter in the data model
+    node = DM_PRIV_AddSchemaPath(path, ASSUMED_VENDOR_PARAM_TYPE, SUPPRESS_PRE_EXISTANCE_ERR | SUPPRESS_LAST_TYPE_CHECK);
+    if (node == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Because we suppressed the type check of the last node, check here that it is a vendor parameter with its own get callback
+    info = &node->registered.param_info;
+    if (((node->type != kDMNodeType_VendorParam_ReadOnly) && (node->type != kDMNodeType_VendorParam_ReadWrite)) ||
+        (info->group_id != NON_GROUPED) || (info->get_cb == NULL))
+    {
+        USP_ERR_SetMessage("%s: Expected %s to be a registered (non grouped) vendor parameter", __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    info->async_get_cb = async_get_cb;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_REGISTER_SharedMemStats
+**
+** Registers read only vendor parameters whose values are read directly from a shared memory region written by a vendor process
+** (eg interface and WiFi counters maintained by a statistics daemon), instead of calling a get callback
+** This makes reading the parameters (eg by bulk data collection and value change polling) a memory load, rather than a sysfs read or IPC
+** Consistency of the values is ensured by the seqlock protocol described with usp_shm_region_t
+** NOTE: The vendor is responsible for mapping the region (eg using shm_open() and mmap()) before calling this function
+**
+** \param   region - pointer to structure describing the layout of the shared memory region. This is copied by this function
+** \param   params - pointer to array of parameters whose values are stored in each record of the region
+** \param   num_params - number of parameters in the array
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_SharedMemStats(usp_shm_region_t *region, usp_shm_param_t *params, int num_params)
+{
+    int i;
+    int err;
+    dm_node_t *node;
+    dm_param_info_t *info;
+    usp_shm_region_t *sr;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, "undefined");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((region == NULL) || (region->base == NULL) || (params == NULL) || (num_params <= 0))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the sequence number or records lie outside of the region
+    if ((region->seq_offset < 0) || ((region->seq_offset % sizeof(unsigned)) != 0) || (region->seq_offset + (int)sizeof(unsigned) > region->size) ||
+        (region->records_offset < 0) || (region->record_size <= 0) || (region->num_records <= 0) ||
+        (region->records_offset + (long long)region->num_records * region->record_size > region->size))
+    {
+        USP_ERR_SetMessage("%s: Layout of shared memory region is invalid", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if no more regions can be registered
+    if (num_shm_stats_regions >= MAX_SHM_STATS_REGIONS)
+    {
+        USP_ERR_SetMessage("%s: Too many shared memory regions registered. Increase MAX_SHM_STATS_REGIONS", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if any of the parameters do not fit within a record
+    for (i=0; i<num_params; i++)
+    {
+        err = ValidateShmStatsParam(region, &params[i]);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    sr = &shm_stats_regions[num_shm_stats_regions];
+    memcpy(sr, region, sizeof(usp_shm_region_t));
+    num_shm_stats_regions++;
+
+    // Register all parameters as read only vendor parameters, which are read from the region
+    for (i=0; i<num_params; i++)
+    {
+        node = DM_PRIV_AddSchemaPath(params[i].path, kDMNodeType_VendorParam_ReadOnly, 0);
+        if (node == NULL)
+        {
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        info = &node->registered.param_info;
+        memset(info, 0, sizeof(dm_param_info_t));
+        info->type_flags = params[i].type_flags;
+        info->group_id = NON_GROUPED;
+        info->shm_region = sr;
+        info->shm_offset = params[i].offset;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ValidateShmStatsParam
+**
+** Validates that the value of the specified parameter can be read from each record of the specified shared memory region
+**
+** \param   region - pointer to structure describing the layout of the shared memory region
+** \param   param - pointer to parameter to validate
+**
+** \return  USP_ERR_OK if the parameter is valid
+**
+**************************************************************************/
+int ValidateShmStatsParam(usp_shm_region_t *region, usp_shm_param_t *param)
+{
+    int size;
+
+    // Exit if the path is not defined
+    if (param->path == NULL)
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Determine the size of the value stored in shared memory
+    switch(param->type_flags & ~DM_PUSH_NOTIFIED)
+    {
+        case DM_UINT:
+            size = sizeof(uint32_t);
+            break;
+
+        case DM_ULONG:
+            size = sizeof(uint64_t);
+            break;
+
+        case DM_INT:
+            size = sizeof(int32_t);
+            break;
+
+        case DM_BOOL:
+            size = sizeof(uint8_t);
+            break;
+
+        default:
+            USP_ERR_SetMessage("%s: Unsupported type (0x%x) for shared memory parameter %s", __FUNCTION__, param->type_flags, param->path);
+            return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the value is not within the record, or is not naturally aligned (which is necessary for the value to be read in a single load)
+    if ((param->offset < 0) || (param->offset + size > region->record_size) ||
+        ((((uintptr_t)region->base + region->records_offset + param->offset) % size) != 0) || ((region->record_size % size) != 0))
+    {
+        USP_ERR_SetMessage("%s: Offset of shared memory parameter %s is invalid or misaligned", __FUNCTION__, param->path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
     return USP_ERR_OK;
 }
 
@@ -750,6 +1323,64 @@ int USP_REGISTER_Object(char *path, dm_validate_add_cb_t validate_add_cb, dm_add
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** USP_REGISTER_Object_RefreshInstances
+**
+** Registers a callback which is called to read the instances of a vendor controlled top level multi-instance object
+** (and all of its child objects). The callback is not called at startup. Instead it is called the first time
+** that the object is accessed by a USP message after the instances have become stale (ie after the expiry_period
+** that the callback returned the last time that it was called). This is useful for vendor tables whose instances
+** change often, and are expensive to keep synchronised using USP_SIGNAL_ObjectAdded/Deleted()
+** NOTE: This function must be called after the object has been registered by USP_REGISTER_Object()
+** NOTE: Object creation and deletion notifications are not generated for instances added or removed by a refresh
+**
+** \param   path - full data model path for the top level multi-instance object
+** \param   refresh_instances_cb - callback called to read the instances of the object
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_Object_RefreshInstances(char *path, dm_refresh_instances_cb_t refresh_instances_cb)
+{
+    dm_node_t *node;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((path == NULL) || (refresh_instances_cb == NULL))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to find this multi-instance object in the data model
+    node = DM_PRIV_AddSchemaPath(path, kDMNodeType_Object_MultiInstance, SUPPRESS_PRE_EXISTANCE_ERR);
+    if (node == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the object is not a top level multi-instance object
+    // (the instance vector containing the instances of the object and its children is held by the top level object)
+    if (node->order != 1)
+    {
+        USP_ERR_SetMessage("%s: Object %s is not a top level multi-instance object", __FUNCTION__, path);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    node->registered.object_info.refresh_instances_cb = refresh_instances_cb;
+    DM_INST_VECTOR_RegisterRefresh(node);
+
+    return USP_ERR_OK;
+}
+
 /*********************************************************************//**
 **
 ** USP_REGISTER_Object_UniqueKey
@@ -824,6 +1455,7 @@ int USP_REGISTER_Object_UniqueKey(char *path, char **params, int num_params)
         }
 
         unique_key.param[i] = child->name; // Using child->name instead of strdup(params[i]) saves memory
+        child->registered.param_info.is_unique_key = true;
     }
 
     // Add this unique key to the data model
@@ -1147,6 +1779,72 @@ int USP_REGISTER_EventArguments(char *path, char **event_arg_names, int num_even
     return USP_ERR_OK;
 }
 
+/*********************************************************************//**
+**
+** USP_REGISTER_StaticSchema
+**
+** Registers all nodes in a static schema table (generated at build time by obuspa_schemac)
+** This is equivalent to calling the USP_REGISTER_XXX() function corresponding to each node in the table, but is faster,
+** because the table contains the nodes already arranged into a tree, with the hashes of each node precomputed
+**
+** \param   schema - pointer to static schema table to register
+**
+** \return  USP_ERR_OK if successful
+**          USP_ERR_INTERNAL_ERROR if any other error occurred
+**
+**************************************************************************/
+int USP_REGISTER_StaticSchema(const usp_static_schema_t *schema)
+{
+    int i;
+    int err;
+    dm_node_t **nodes = NULL;
+    bool *pre_existing = NULL;
+
+    // Exit if this function is not being called from within VENDOR_Init()
+    if (is_executing_within_dm_init == false)
+    {
+        USP_ERR_SetMessage(usp_err_bad_scope_str, __FUNCTION__, "static schema");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if input parameters are not defined
+    if ((schema == NULL) || (schema->nodes == NULL) || (schema->num_nodes < 1))
+    {
+        USP_ERR_SetMessage(usp_err_invalid_param_str, __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to add the nodes of the table to the data model
+    nodes = USP_MALLOC(schema->num_nodes*sizeof(dm_node_t *));
+    pre_existing = USP_MALLOC(schema->num_nodes*sizeof(bool));
+    err = DM_PRIV_AddStaticSchema(schema, nodes, pre_existing);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Save registered info into the data model for each node that was added
+    // NOTE: This is performed after all nodes have been added, as NumEntries parameters and unique keys refer to other nodes in the table
+    for (i=0; i < schema->num_nodes; i++)
+    {
+        if (pre_existing[i] == false)
+        {
+            RegisterStaticNodeInfo(&schema->nodes[i], nodes[i], nodes);
+        }
+
+        // Unique keys are added even to objects which already existed, as they may be formed from parameters added by this table (eg Alias)
+        if (schema->nodes[i].num_unique_keys > 0)
+        {
+            RegisterStaticUniqueKeys(&schema->nodes[i], nodes[i], nodes);
+        }
+    }
+
+exit:
+    USP_FREE(nodes);
+    USP_FREE(pre_existing);
+    return err;
+}
+
 /*********************************************************************//**
 **
 ** ValidateAliasParam
@@ -1211,6 +1909,8 @@ int ValidateAliasParam(dm_req_t *req, char *value)
 ** ValidateParamUniqueness
 **
 ** Convenience function to validate that the parameter is unique within the table
+** If the parameter is registered as a unique key of the table, then the unique key index is used to find any instance
+** with the same value, rather than reading the parameter from every instance of the table
 **
 ** \param   req - pointer to structure identifying the path
 ** \param   value - new value of the parameter for this instance which the controller would like to set
@@ -1228,8 +1928,10 @@ int ValidateParamUniqueness(dm_req_t *req, char *value)
     int req_instance;
     char *param_name;
     char table_path[MAX_DM_PATH];
+    char obj_path[MAX_DM_PATH];
     char path[MAX_DM_PATH];
     char buf[MAX_DM_SHORT_VALUE_LEN];    
+    bool is_indexed;
 
     INT_VECTOR_Init(&iv);
 
@@ -1249,7 +1951,33 @@ int ValidateParamUniqueness(dm_req_t *req, char *value)
     USP_ASSERT(req->inst->order > 0);
     req_instance = req->inst->instances[ req->inst->order-1];
 
-    // Exit if unable to get the instance numbers associated with the parent table
+    // Exit if unable to look up the value in the unique key index
+    USP_SNPRINTF(obj_path, sizeof(obj_path), "%s.", table_path);
+    err = PATH_RESOLVER_FindUniqueKeyInstances(obj_path, param_name, value, &iv, &is_indexed);
+    if (err != USP_ERR_OK)
+    {
+        goto exit;
+    }
+
+    // Exit if the unique key index was used, and found another instance with the same value
+    if (is_indexed)
+    {
+        for (i=0; i < iv.num_entries; i++)
+        {
+            instance = iv.vector[i];
+            if (instance != req_instance)
+            {
+                USP_ERR_SetMessage("%s: The value for %s (%s) is not unique (already used by instance %d)", __FUNCTION__, req->path, value, instance);
+                err = USP_ERR_INVALID_ARGUMENTS;
+                goto exit;
+            }
+        }
+
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Otherwise, exit if unable to get the instance numbers associated with the parent table
     err = DATA_MODEL_GetInstances(table_path, &iv);
     if (err != USP_ERR_OK)
     {
@@ -1278,7 +2006,8 @@ int ValidateParamUniqueness(dm_req_t *req, char *value)
         if (strcmp(buf, value) == 0)
         {
             USP_ERR_SetMessage("%s: The value for %s (%s) is not unique (already used by instance %d)", __FUNCTION__, req->path, value, instance);
-            return USP_ERR_INVALID_ARGUMENTS;
+            err = USP_ERR_INVALID_ARGUMENTS;
+            goto exit;
         }
     }
 
@@ -1290,4 +2019,161 @@ exit:
     return err;
 }
 
+/*********************************************************************//**
+**
+** RegisterStaticNodeInfo
+**
+** Saves the registered info of a node in a static schema table into the data model
+** This performs the same function as the corresponding USP_REGISTER_XXX() function
+**
+** \param   sn - pointer to node in static schema table
+** \param   node - pointer to data model node created for the node in the table
+** \param   nodes - array of data model nodes created for each node in the table
+**
+** \return  None
+**
+**************************************************************************/
+void RegisterStaticNodeInfo(const usp_static_node_t *sn, dm_node_t *node, dm_node_t **nodes)
+{
+    dm_param_info_t *info;
+    dm_object_info_t *obj_info;
+    dm_oper_info_t *oper_info;
+
+    info = &node->registered.param_info;
+    switch(sn->type)
+    {
+        case kStaticNode_Object_SingleInstance:
+            break;
+
+        case kStaticNode_Object_MultiInstance:
+            obj_info = &node->registered.object_info;
+            memset(obj_info, 0, sizeof(dm_object_info_t));
+            obj_info->validate_add_cb = sn->cb.object.validate_add_cb;
+            obj_info->add_cb = sn->cb.object.add_cb;
+            obj_info->notify_add_cb = sn->cb.object.notify_add_cb;
+            obj_info->validate_del_cb = sn->cb.object.validate_del_cb;
+            obj_info->del_cb = sn->cb.object.del_cb;
+            obj_info->notify_del_cb = sn->cb.object.notify_del_cb;
+            DM_INST_VECTOR_Init(&obj_info->inst_vector);
+            break;
+
+        case kStaticNode_Param_Constant:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->default_value = USP_STRDUP(sn->value);
+            info->type_flags = sn->type_flags;
+            break;
+
+        case kStaticNode_Param_NumEntries:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->table_node = nodes[sn->table];
+            info->type_flags = DM_UINT;
+            break;
+
+        case kStaticNode_DBParam_ReadWrite:
+        case kStaticNode_DBParam_ReadOnly:
+        case kStaticNode_DBParam_Secure:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->default_value = USP_STRDUP((sn->value != NULL) ? sn->value : "");
+            info->validator_cb = sn->cb.param.validator_cb;
+            info->notify_set_cb = sn->cb.param.notify_set_cb;
+            info->type_flags = (sn->type == kStaticNode_DBParam_Secure) ? DM_STRING : sn->type_flags;
+            break;
+
+        case kStaticNode_DBParam_ReadOnlyAuto:
+        case kStaticNode_DBParam_ReadWriteAuto:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->default_value = USP_STRDUP("");
+            info->get_cb = sn->cb.param.get_cb;
+            info->validator_cb = sn->cb.param.validator_cb;
+            info->notify_set_cb = sn->cb.param.notify_set_cb;
+            info->type_flags = sn->type_flags;
+            break;
+
+        case kStaticNode_DBParam_Alias:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->default_value = USP_STRDUP("");
+            info->get_cb = DM_ACCESS_PopulateAliasParam;
+            info->validator_cb = ValidateAliasParam;
+            info->notify_set_cb = sn->cb.param.notify_set_cb;
+            info->type_flags = DM_STRING;
+            break;
+
+        case kStaticNode_VendorParam_ReadOnly:
+        case kStaticNode_VendorParam_ReadWrite:
+            memset(info, 0, sizeof(dm_param_info_t));
+            info->get_cb = sn->cb.param.get_cb;
+            info->set_cb = sn->cb.param.set_cb;
+            info->notify_set_cb = sn->cb.param.notify_set_cb;
+            info->type_flags = sn->type_flags;
+            info->group_id = NON_GROUPED;
+            break;
+
+        case kStaticNode_SyncOperation:
+        case kStaticNode_AsyncOperation:
+            oper_info = &node->registered.oper_info;
+            memset(oper_info, 0, sizeof(dm_oper_info_t));
+            oper_info->sync_oper_cb = sn->cb.oper.sync_oper_cb;
+            oper_info->async_oper_cb = sn->cb.oper.async_oper_cb;
+            oper_info->restart_cb = sn->cb.oper.restart_cb;
+            if (sn->num_input_args > 0)
+            {
+                STR_VECTOR_Clone(&oper_info->input_args, sn->input_args, sn->num_input_args);
+            }
+
+            if (sn->num_output_args > 0)
+            {
+                STR_VECTOR_Clone(&oper_info->output_args, sn->output_args, sn->num_output_args);
+            }
+            break;
+
+        case kStaticNode_Event:
+            if (sn->num_input_args > 0)
+            {
+                STR_VECTOR_Clone(&node->registered.event_info.event_args, sn->input_args, sn->num_input_args);
+            }
+            break;
+
+        default:
+            TERMINATE_BAD_CASE(sn->type);
+            break;
+    }
+}
+
+/*********************************************************************//**
+**
+** RegisterStaticUniqueKeys
+**
+** Adds the unique keys of a multi-instance object in a static schema table into the data model
+** This performs the same function as USP_REGISTER_Object_UniqueKey()
+**
+** \param   sn - pointer to node in static schema table
+** \param   node - pointer to data model node of the multi-instance object
+** \param   nodes - array of data model nodes created for each node in the table
+**
+** \return  None
+**
+**************************************************************************/
+void RegisterStaticUniqueKeys(const usp_static_node_t *sn, dm_node_t *node, dm_node_t **nodes)
+{
+    int i;
+    int j;
+    const usp_static_unique_key_t *key;
+    dm_node_t *child;
+    dm_unique_key_t unique_key;
+
+    for (i=0; i < sn->num_unique_keys; i++)
+    {
+        key = &sn->unique_keys[i];
+        USP_ASSERT(key->num_params <= MAX_COMPOUND_KEY_PARAMS);
 
+        memset(&unique_key, 0, sizeof(unique_key));
+        for (j=0; j < key->num_params; j++)
+        {
+            child = nodes[ key->params[j] ];
+            unique_key.param[j] = child->name;
+            child->registered.param_info.is_unique_key = true;
+        }
+
+        DM_PRIV_AddUniqueKey(node, &unique_key);
+    }
+}
@@ -0,0 +1,1033 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file usp_session.c
+ *
+ * Implements USP Session Context records (TR-369 End to End Session Context)
+ * Each controller has at most one session context with the agent. The session is started either by the controller
+ * (when it sends a Session Context record) or by the agent (when it first segments a USP message to the controller).
+ * Once started, all USP records sent to the controller are sent in the session context:
+ *   - Each record carries an incrementing sequence_id, and the expected_id of the next record from the controller
+ *   - USP messages larger than MAX_USP_RECORD_PAYLOAD_LEN are segmented across records (payload SAR state)
+ *   - Sent records are retained until the controller acknowledges them (using its expected_id), so that they can be
+ *     selectively retransmitted if the controller requests them (using retransmit_id)
+ * Received records are processed in sequence_id order. Records received out of order are held until the missing
+ * records arrive, and the agent requests retransmission of just the first missing record.
+ *
+ */
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common_defs.h"
+#include "usp_api.h"
+#include "os_utils.h"
+#include "dllist.h"
+#include "msg_handler.h"
+#include "usp_session.h"
+#include "proto_codec.h"
+
+//------------------------------------------------------------------------------
+// USP record sent in a session, retained in case the controller requests its retransmission
+typedef struct
+{
+    double_link_t link;         // Doubly linked list pointers. These must always be first in this structure
+    uint64_t sequence_id;       // sequence_id of this record
+    Usp__Header__MsgType usp_msg_type; // Type of USP message contained in (a segment of) this record. Used for debug logging
+    char *usp_msg_id;           // msg_id of the USP message contained in this record. Used by the STOMP usp-err-id header
+    unsigned char *buf;         // Serialized USP record
+    int len;                    // Length of serialized USP record
+} tx_record_t;
+
+//------------------------------------------------------------------------------
+// USP record received out of order, held until all records before it in the session have been received
+typedef struct
+{
+    double_link_t link;         // Doubly linked list pointers. These must always be first in this structure
+    uint64_t sequence_id;       // sequence_id of this record
+    UspRecord__SessionContextRecord__PayloadSARState sar_state; // Payload segmentation state of this record
+    unsigned char *payload;     // Payload contained in this record (all payload elements concatenated), or NULL if empty
+    int payload_len;
+} rx_record_t;
+
+//------------------------------------------------------------------------------
+// State of a session context with a controller
+typedef struct
+{
+    char *endpoint_id;          // Controller that this session is with, or NULL if this slot is unused
+    uint64_t session_id;
+    uint64_t last_tx_sequence_id; // sequence_id of the last record sent in this session
+    uint64_t rx_expected_id;    // sequence_id of the next record expected from the controller
+    uint64_t retransmit_requested_id; // sequence_id of the last record that the agent requested the controller to retransmit (0 if none)
+    double_linked_list_t tx_retained; // List of sent records (tx_record_t), in sequence_id order
+    int num_tx_retained;
+    double_linked_list_t rx_pending; // List of records received out of order (rx_record_t), in sequence_id order
+    int num_rx_pending;
+    unsigned char *reassembly_buf; // Segments of the USP message currently being received, or NULL if not receiving a segmented message
+    int reassembly_len;
+    time_t last_activity_time;  // Time at which a record was last sent or received in this session
+} usp_session_t;
+
+static usp_session_t usp_sessions[MAX_USP_SESSIONS];
+
+//------------------------------------------------------------------------------
+// Mutex protecting the sessions. Records are sent in sessions by the data model thread and the Get worker threads
+static pthread_mutex_t usp_session_mutex;
+
+//------------------------------------------------------------------------------
+// Vector of USP messages which have been completely received, and are ready to be handled
+typedef struct
+{
+    unsigned char *buf;
+    int len;
+} rx_msg_t;
+
+typedef struct
+{
+    rx_msg_t *vector;
+    int num_entries;
+} rx_msg_vector_t;
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+usp_session_t *FindUspSession(char *endpoint_id);
+usp_session_t *StartUspSession(char *endpoint_id, uint64_t session_id);
+void EndUspSession(usp_session_t *us);
+uint64_t AllocUspSessionId(void);
+int QueueSessionRecord(usp_session_t *us, UspRecord__Record *rec, Usp__Header__MsgType usp_msg_type, char *endpoint_id, char *usp_msg_id, mtp_reply_to_t *mrt, time_t expiry_time);
+void AcknowledgeTxRecords(usp_session_t *us, uint64_t expected_id);
+void RetransmitTxRecord(usp_session_t *us, uint64_t sequence_id, char *endpoint_id, mtp_reply_to_t *mrt);
+void RequestRetransmit(usp_session_t *us, UspRecord__Record *template_rec, mtp_reply_to_t *mrt);
+void HoldRxRecord(usp_session_t *us, UspRecord__SessionContextRecord *ctx);
+void ProcessRxPayload(usp_session_t *us, UspRecord__SessionContextRecord__PayloadSARState sar_state, unsigned char *payload, int payload_len, rx_msg_vector_t *msgs);
+void ProcessRxPendingRecords(usp_session_t *us, rx_msg_vector_t *msgs);
+void AppendReassembly(usp_session_t *us, unsigned char *data, int len);
+void AddRxMsg(rx_msg_vector_t *msgs, unsigned char *buf, int len);
+void ConcatPayloads(UspRecord__SessionContextRecord *ctx, unsigned char **p_payload, int *p_payload_len);
+
+/*********************************************************************//**
+**
+** USP_SESSION_Init
+**
+** Initialises the functionality in this module
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SESSION_Init(void)
+{
+    int err;
+
+    memset(usp_sessions, 0, sizeof(usp_sessions));
+
+    // Exit if unable to create the mutex protecting the sessions
+    err = OS_UTILS_InitMutex(&usp_session_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** USP_SESSION_Destroy
+**
+** Frees all memory used by this module
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void USP_SESSION_Destroy(void)
+{
+    int i;
+    usp_session_t *us;
+
+    OS_UTILS_LockMutex(&usp_session_mutex);
+
+    for (i=0; i<MAX_USP_SESSIONS; i++)
+    {
+        us = &usp_sessions[i];
+        if (us->endpoint_id != NULL)
+        {
+            EndUspSession(us);
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&usp_session_mutex);
+}
+
+/*********************************************************************//**
+**
+** USP_SESSION_IsActive
+**
+** Determines whether there is a session context with the specified controller
+** If there is, then all USP records sent to the controller must be sent in the session context
+**
+** \param   endpoint_id - controller to send a USP record to
+**
+** \return  true if there is a session context with the controller
+**
+**************************************************************************/
+bool USP_SESSION_IsActive(char *endpoint_id)
+{
+    usp_session_t *us;
+
+    OS_UTILS_LockMutex(&usp_session_mutex);
+    us = FindUspSession(endpoint_id);
+    OS_UTILS_UnlockMutex(&usp_session_mutex);
+
+    return (us != NULL) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** USP_SESSION_HandleRecord
+**
+** Processes a received USP Session Context record, then handles all USP messages which have been completely received as a result
+** NOTE: The USP messages are handled after the mutex has been released, as handling them queues records in the session
+**
+** \param   rec - pointer to protobuf structure describing the received USP record (which has already been validated)
+** \param   role - Role allowed for this message
+** \param   allowed_controllers - URN pattern containing the endpoint_id of allowed controllers
+** \param   mrt - details of where response to this USP record should be sent
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SESSION_HandleRecord(UspRecord__Record *rec, ctrust_role_t role, char *allowed_controllers, mtp_reply_to_t *mrt)
+{
+    UspRecord__SessionContextRecord *ctx;
+    usp_session_t *us;
+    rx_msg_vector_t msgs;
+    unsigned char *payload;
+    int payload_len;
+    int err = USP_ERR_OK;
+    int i;
+
+    ctx = rec->session_context;
+    msgs.vector = NULL;
+    msgs.num_entries = 0;
+
+    // Exit if the record does not identify the controller that the session is with
+    if (rec->from_id == NULL)
+    {
+        USP_ERR_SetMessage("%s: Ignoring USP record as from_id is blank", __FUNCTION__);
+        return USP_ERR_RECORD_FIELD_INVALID;
+    }
+
+    OS_UTILS_LockMutex(&usp_session_mutex);
+
+    // Start a new session, if the controller has started one
+    // NOTE: This discards any previous session with the controller, including any records retained for retransmission
+    us = FindUspSession(rec->from_id);
+    if ((us == NULL) || (us->session_id != ctx->session_id))
+    {
+        if (us != NULL)
+        {
+            USP_LOG_Info("%s: Controller %s replaced USP session %llu with %llu", __FUNCTION__, rec->from_id, (unsigned long long)us->session_id, (unsigned long long)ctx->session_id);
+            EndUspSession(us);
+        }
+
+        us = StartUspSession(rec->from_id, ctx->session_id);
+    }
+    us->last_activity_time = time(NULL);
+
+    // Free all records that the controller has acknowledged, then retransmit the record requested by the controller (if any)
+    AcknowledgeTxRecords(us, ctx->expected_id);
+    if (ctx->retransmit_id != 0)
+    {
+        RetransmitTxRecord(us, ctx->retransmit_id, rec->from_id, mrt);
+    }
+
+    // Exit if the record has already been received (it is a retransmission that the agent did not ask for)
+    if (ctx->sequence_id < us->rx_expected_id)
+    {
+        USP_LOG_Warning("%s: Ignoring duplicate USP record (session_id=%llu, sequence_id=%llu)", __FUNCTION__, (unsigned long long)ctx->session_id, (unsigned long long)ctx->sequence_id);
+        goto exit;
+    }
+
+    // Exit if the record has been received out of order, holding onto it, and asking the controller to retransmit the first missing record
+    if (ctx->sequence_id > us->rx_expected_id)
+    {
+        HoldRxRecord(us, ctx);
+        RequestRetransmit(us, rec, mrt);
+        goto exit;
+    }
+
+    // Process this record, followed by any held records which follow on from it
+    ConcatPayloads(ctx, &payload, &payload_len);
+    ProcessRxPayload(us, ctx->payload_sar_state, payload, payload_len, &msgs);
+    USP_SAFE_FREE(payload);
+    us->rx_expected_id++;
+    ProcessRxPendingRecords(us, &msgs);
+
+exit:
+    OS_UTILS_UnlockMutex(&usp_session_mutex);
+
+    // Handle all USP messages which have been completely received
+    for (i=0; i < msgs.num_entries; i++)
+    {
+        err = MSG_HANDLER_HandleBinaryMessage(msgs.vector[i].buf, msgs.vector[i].len, role, allowed_controllers, rec->from_id, mrt);
+        USP_FREE(msgs.vector[i].buf);
+    }
+    USP_SAFE_FREE(msgs.vector);
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** USP_SESSION_QueueMessage
+**
+** Queues a serialized USP message in the session context with the specified controller (starting one if necessary)
+** USP messages larger than MAX_USP_RECORD_PAYLOAD_LEN are segmented across multiple USP records
+**
+** \param   rec - pointer to USP record structure, with all fields apart from the record type already filled in (used as a template for each record)
+** \param   usp_msg_type - Type of USP message contained in pbuf. This is used for debug logging when the message is sent by the MTP.
+** \param   endpoint_id - controller to send the message to
+** \param   pbuf - pointer to buffer containing serialized USP message
+**                 NOTE: Ownership of the serialized USP message stays with the caller
+** \param   pbuf_len - length of protobuf encoded USP message
+** \param   usp_msg_id - pointer to string containing the msg_id of the serialized USP Message
+** \param   mrt - details of where this USP response message should be sent
+** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int USP_SESSION_QueueMessage(UspRecord__Record *rec, Usp__Header__MsgType usp_msg_type, char *endpoint_id, unsigned char *pbuf, int pbuf_len, char *usp_msg_id, mtp_reply_to_t *mrt, time_t expiry_time)
+{
+    UspRecord__Record seg_rec;
+    UspRecord__SessionContextRecord ctx;
+    ProtobufCBinaryData payload;
+    usp_session_t *us;
+    int num_records = 0;
+    int offset;
+    int segment_len;
+    int max_segment_len;
+    int err = USP_ERR_OK;
+
+    OS_UTILS_LockMutex(&usp_session_mutex);
+
+    // Start a session with the controller, if one does not already exist
+    us = FindUspSession(endpoint_id);
+    if (us == NULL)
+    {
+        us = StartUspSession(endpoint_id, AllocUspSessionId());
+    }
+    us->last_activity_time = time(NULL);
+
+    usp_record__session_context_record__init(&ctx);
+    ctx.session_id = us->session_id;
+    ctx.n_payload = 1;
+    ctx.payload = &payload;
+    seg_rec = *rec;
+    seg_rec.record_type_case = USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT;
+    seg_rec.session_context = &ctx;
+
+    // Exit if the USP message fits in a single record
+    max_segment_len = (MAX_USP_RECORD_PAYLOAD_LEN > 0) ? MAX_USP_RECORD_PAYLOAD_LEN : pbuf_len;
+    if (pbuf_len <= max_segment_len)
+    {
+        ctx.payload_sar_state = USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__NONE;
+        ctx.payloadrec_sar_state = USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__NONE;
+        payload.data = pbuf;
+        payload.len = pbuf_len;
+        err = QueueSessionRecord(us, &seg_rec, usp_msg_type, endpoint_id, usp_msg_id, mrt, expiry_time);
+        goto exit;
+    }
+
+    // Iterate over all segments of the USP message, queueing a USP record containing each one
+    offset = 0;
+    while (offset < pbuf_len)
+    {
+        // Determine the segment of the USP message to send in this record
+        segment_len = MIN(pbuf_len - offset, max_segment_len);
+        if (offset == 0)
+        {
+            ctx.payload_sar_state = USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__BEGIN;
+        }
+        else if (offset + segment_len < pbuf_len)
+        {
+            ctx.payload_sar_state = USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__INPROCESS;
+        }
+        else
+        {
+            ctx.payload_sar_state = USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__COMPLETE;
+        }
+
+        // NOTE: The USP message is the only payload element in each record, so the payload and the payload element are segmented identically
+        ctx.payloadrec_sar_state = ctx.payload_sar_state;
+        payload.data = &pbuf[offset];
+        payload.len = segment_len;
+
+        // Exit if unable to queue the record
+        // NOTE: Any segments which have already been queued are still sent. The controller will discard the incomplete message.
+        err = QueueSessionRecord(us, &seg_rec, usp_msg_type, endpoint_id, usp_msg_id, mrt, expiry_time);
+        if (err != USP_ERR_OK)
+        {
+            goto exit;
+        }
+
+        offset += segment_len;
+        num_records++;
+    }
+
+    USP_LOG_Info("Segmented %s message (%d bytes) across %d USP records", MSG_HANDLER_UspMsgTypeToString(usp_msg_type), pbuf_len, num_records);
+
+exit:
+    OS_UTILS_UnlockMutex(&usp_session_mutex);
+    return err;
+}
+
+/*********************************************************************//**
+**
+** QueueSessionRecord
+**
+** Assigns the next sequence_id of the session to the specified Session Context record, serializes it,
+** retains a copy (for retransmission), then queues it to be sent to the controller
+** NOTE: This function must be called with the mutex held, so that records are queued in sequence_id order
+**
+** \param   us - pointer to session to send the record in
+** \param   rec - pointer to USP record structure to send. The session context and payload have already been filled in.
+** \param   usp_msg_type - Type of USP message contained in the record. This is used for debug logging when the message is sent by the MTP.
+** \param   endpoint_id - controller to send the record to
+** \param   usp_msg_id - pointer to string containing the msg_id of the USP Message contained in the record, or NULL if not applicable
+** \param   mrt - details of where this USP record should be sent
+** \param   expiry_time - time at which the USP record should be removed from the MTP send queue
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int QueueSessionRecord(usp_session_t *us, UspRecord__Record *rec, Usp__Header__MsgType usp_msg_type, char *endpoint_id, char *usp_msg_id, mtp_reply_to_t *mrt, time_t expiry_time)
+{
+    UspRecord__SessionContextRecord *ctx;
+    tx_record_t *tx;
+    unsigned char *buf;
+    int len;
+    int size;
+    int err;
+
+    // Fill in the sequencing fields of the session context
+    ctx = rec->session_context;
+    ctx->sequence_id = us->last_tx_sequence_id + 1;
+    ctx->expected_id = us->rx_expected_id;
+
+    // Serialize the protobuf record structure into a buffer
+    len = PROTO_CODEC_RECORD_GET_PACKED_SIZE(rec);
+    buf = USP_MALLOC(len);
+    size = PROTO_CODEC_RECORD_PACK(rec, buf);
+    USP_ASSERT(size == len);          // If these are not equal, then we may have had a buffer overrun, so terminate
+
+    // Retain a copy of the record, in case the controller requests it to be retransmitted
+    tx = USP_MALLOC(sizeof(tx_record_t));
+    memset(tx, 0, sizeof(tx_record_t));
+    tx->sequence_id = ctx->sequence_id;
+    tx->usp_msg_type = usp_msg_type;
+    tx->usp_msg_id = USP_STRDUP(usp_msg_id);
+    tx->buf = USP_MALLOC(len);
+    memcpy(tx->buf, buf, len);
+    tx->len = len;
+
+    // Exit if unable to queue the record, to send to a controller
+    // NOTE: If successful, ownership of the buffer passes to the MTP layer. If not successful, buffer is freed here
+    err = DEVICE_CONTROLLER_QueueBinaryMessage(usp_msg_type, endpoint_id, buf, len, usp_msg_id, mrt, expiry_time);
+    if (err != USP_ERR_OK)
+    {
+        USP_FREE(buf);
+        USP_SAFE_FREE(tx->usp_msg_id);
+        USP_FREE(tx->buf);
+        USP_FREE(tx);
+        return err;
+    }
+
+    // The sequence_id is only consumed if the record was queued, so that the controller does not see a gap in the sequence
+    us->last_tx_sequence_id = ctx->sequence_id;
+
+    // Discard the oldest retained record, if the limit of retained records has been reached
+    if (us->num_tx_retained >= MAX_USP_SESSION_RETAINED_RECORDS)
+    {
+        AcknowledgeTxRecords(us, ((tx_record_t *)us->tx_retained.head)->sequence_id + 1);
+    }
+
+    DLLIST_LinkToTail(&us->tx_retained, tx);
+    us->num_tx_retained++;
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** AcknowledgeTxRecords
+**
+** Frees all retained records which the controller has received
+**
+** \param   us - pointer to session
+** \param   expected_id - sequence_id of the next record that the controller expects. All records before this have been received.
+**
+** \return  None
+**
+**************************************************************************/
+void AcknowledgeTxRecords(usp_session_t *us, uint64_t expected_id)
+{
+    tx_record_t *tx;
+
+    tx = (tx_record_t *) us->tx_retained.head;
+    while ((tx != NULL) && (tx->sequence_id < expected_id))
+    {
+        DLLIST_Unlink(&us->tx_retained, tx);
+        us->num_tx_retained--;
+        USP_SAFE_FREE(tx->usp_msg_id);
+        USP_FREE(tx->buf);
+        USP_FREE(tx);
+
+        tx = (tx_record_t *) us->tx_retained.head;
+    }
+}
+
+/*********************************************************************//**
+**
+** RetransmitTxRecord
+**
+** Retransmits the specified retained record, as requested by the controller
+** NOTE: The record is resent unaltered (ie with its original expected_id). This is harmless, as expected_id only ever acknowledges records.
+**
+** \param   us - pointer to session
+** \param   sequence_id - sequence_id of the record to retransmit
+** \param   endpoint_id - controller to send the record to
+** \param   mrt - details of where the record should be sent (ie the MTP that the retransmission request was received on)
+**
+** \return  None
+**
+**************************************************************************/
+void RetransmitTxRecord(usp_session_t *us, uint64_t sequence_id, char *endpoint_id, mtp_reply_to_t *mrt)
+{
+    tx_record_t *tx;
+    unsigned char *buf;
+    int err;
+
+    // Exit if the record is no longer retained
+    tx = (tx_record_t *) us->tx_retained.head;
+    while ((tx != NULL) && (tx->sequence_id != sequence_id))
+    {
+        tx = (tx_record_t *) tx->link.next;
+    }
+
+    if (tx == NULL)
+    {
+        USP_LOG_Warning("%s: Unable to retransmit USP record (session_id=%llu, sequence_id=%llu) as it is no longer retained", __FUNCTION__, (unsigned long long)us->session_id, (unsigned long long)sequence_id);
+        return;
+    }
+
+    // Queue a copy of the record (ownership of the copy passes to the MTP layer)
+    buf = USP_MALLOC(tx->len);
+    memcpy(buf, tx->buf, tx->len);
+    err = DEVICE_CONTROLLER_QueueBinaryMessage(tx->usp_msg_type, endpoint_id, buf, tx->len, tx->usp_msg_id, mrt, END_OF_TIME);
+    if (err != USP_ERR_OK)
+    {
+        USP_FREE(buf);
+        return;
+    }
+
+    USP_LOG_Info("%s: Retransmitting USP record (session_id=%llu, sequence_id=%llu)", __FUNCTION__, (unsigned long long)us->session_id, (unsigned long long)sequence_id);
+}
+
+/*********************************************************************//**
+**
+** RequestRetransmit
+**
+** Asks the controller to retransmit the first missing record in the session, by sending it a record with retransmit_id set
+** The request is only sent once for each missing record, to avoid every out of order record generating a request
+**
+** \param   us - pointer to session
+** \param   template_rec - pointer to the received USP record (its to_id and from_id are swapped for the request)
+** \param   mrt - details of where the request should be sent
+**
+** \return  None
+**
+**************************************************************************/
+void RequestRetransmit(usp_session_t *us, UspRecord__Record *template_rec, mtp_reply_to_t *mrt)
+{
+    UspRecord__Record rec;
+    UspRecord__SessionContextRecord ctx;
+
+    // Exit if the missing record has already been requested
+    if (us->retransmit_requested_id == us->rx_expected_id)
+    {
+        return;
+    }
+    us->retransmit_requested_id = us->rx_expected_id;
+
+    // Fill in a USP record with an empty payload, which just requests the retransmission
+    usp_record__record__init(&rec);
+    rec.version = template_rec->version;
+    rec.to_id = template_rec->from_id;
+    rec.from_id = template_rec->to_id;
+    rec.payload_security = USP_RECORD__RECORD__PAYLOAD_SECURITY__PLAINTEXT;
+    rec.record_type_case = USP_RECORD__RECORD__RECORD_TYPE_SESSION_CONTEXT;
+    rec.session_context = &ctx;
+
+    usp_record__session_context_record__init(&ctx);
+    ctx.session_id = us->session_id;
+    ctx.retransmit_id = us->rx_expected_id;
+
+    USP_LOG_Info("%s: Requesting retransmission of USP record (session_id=%llu, sequence_id=%llu)", __FUNCTION__, (unsigned long long)us->session_id, (unsigned long long)us->rx_expected_id);
+
+    // NOTE: Errors are ignored. If the request is not sent, then the controller will retransmit the missing record after its own timeout
+    (void) QueueSessionRecord(us, &rec, USP__HEADER__MSG_TYPE__ERROR, rec.to_id, NULL, mrt, END_OF_TIME);
+}
+
+/*********************************************************************//**
+**
+** HoldRxRecord
+**
+** Holds onto a record received out of order, until all records before it have been received
+** Records are held in sequence_id order. If the limit of held records has been reached, the record is discarded
+** (it will be requested again, once the records before it have been received)
+**
+** \param   us - pointer to session
+** \param   ctx - pointer to session context of the received record
+**
+** \return  None
+**
+**************************************************************************/
+void HoldRxRecord(usp_session_t *us, UspRecord__SessionContextRecord *ctx)
+{
+    rx_record_t *rx;
+    rx_record_t *cur;
+
+    // Find the position in the list at which to insert the record, exiting if the record is already held
+    cur = (rx_record_t *) us->rx_pending.head;
+    while ((cur != NULL) && (cur->sequence_id < ctx->sequence_id))
+    {
+        cur = (rx_record_t *) cur->link.next;
+    }
+
+    if ((cur != NULL) && (cur->sequence_id == ctx->sequence_id))
+    {
+        return;
+    }
+
+    // Exit if the limit of held records has been reached
+    if (us->num_rx_pending >= MAX_USP_SESSION_PENDING_RECORDS)
+    {
+        USP_LOG_Warning("%s: Discarding out of order USP record (session_id=%llu, sequence_id=%llu)", __FUNCTION__, (unsigned long long)ctx->session_id, (unsigned long long)ctx->sequence_id);
+        return;
+    }
+
+    // Copy the payload of the record, as the received record is freed once it has been processed
+    rx = USP_MALLOC(sizeof(rx_record_t));
+    memset(rx, 0, sizeof(rx_record_t));
+    rx->sequence_id = ctx->sequence_id;
+    rx->sar_state = ctx->payload_sar_state;
+    ConcatPayloads(ctx, &rx->payload, &rx->payload_len);
+
+    if (cur == NULL)
+    {
+        DLLIST_LinkToTail(&us->rx_pending, rx);
+    }
+    else
+    {
+        DLLIST_InsertLinkBefore(cur, &us->rx_pending, rx);
+    }
+    us->num_rx_pending++;
+}
+
+/*********************************************************************//**
+**
+** ProcessRxPendingRecords
+**
+** Processes all held records which now follow on in sequence from the records already received
+**
+** \param   us - pointer to session
+** \param   msgs - pointer to vector in which to add all USP messages completely received
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessRxPendingRecords(usp_session_t *us, rx_msg_vector_t *msgs)
+{
+    rx_record_t *rx;
+
+    rx = (rx_record_t *) us->rx_pending.head;
+    while ((rx != NULL) && (rx->sequence_id <= us->rx_expected_id))
+    {
+        if (rx->sequence_id == us->rx_expected_id)
+        {
+            ProcessRxPayload(us, rx->sar_state, rx->payload, rx->payload_len, msgs);
+            us->rx_expected_id++;
+        }
+
+        DLLIST_Unlink(&us->rx_pending, rx);
+        us->num_rx_pending--;
+        USP_SAFE_FREE(rx->payload);
+        USP_FREE(rx);
+
+        rx = (rx_record_t *) us->rx_pending.head;
+    }
+}
+
+/*********************************************************************//**
+**
+** ProcessRxPayload
+**
+** Processes the payload of the next record in the session, reassembling segmented USP messages
+**
+** \param   us - pointer to session
+** \param   sar_state - payload segmentation state of the record
+** \param   payload - pointer to payload of the record, or NULL if the record has no payload
+** \param   payload_len - length of the payload
+** \param   msgs - pointer to vector in which to add the USP message, if it has been completely received
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessRxPayload(usp_session_t *us, UspRecord__SessionContextRecord__PayloadSARState sar_state, unsigned char *payload, int payload_len, rx_msg_vector_t *msgs)
+{
+    switch(sar_state)
+    {
+        case USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__NONE:
+            // Exit if the record does not contain a USP message (eg it just requested a retransmission)
+            if (payload_len == 0)
+            {
+                return;
+            }
+
+            if (us->reassembly_buf != NULL)
+            {
+                USP_LOG_Warning("%s: Discarding incomplete segmented USP message (session_id=%llu)", __FUNCTION__, (unsigned long long)us->session_id);
+                USP_SAFE_FREE(us->reassembly_buf);
+                us->reassembly_len = 0;
+            }
+
+            AppendReassembly(us, payload, payload_len);
+            break;
+
+        case USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__BEGIN:
+            if (us->reassembly_buf != NULL)
+            {
+                USP_LOG_Warning("%s: Discarding incomplete segmented USP message (session_id=%llu)", __FUNCTION__, (unsigned long long)us->session_id);
+                USP_SAFE_FREE(us->reassembly_buf);
+                us->reassembly_len = 0;
+            }
+
+            AppendReassembly(us, payload, payload_len);
+            return;
+
+        case USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__INPROCESS:
+        case USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__COMPLETE:
+            // Exit if this segment does not follow on from a begin segment
+            if (us->reassembly_buf == NULL)
+            {
+                USP_LOG_Warning("%s: Discarding USP message segment received without its first segment (session_id=%llu)", __FUNCTION__, (unsigned long long)us->session_id);
+                return;
+            }
+
+            AppendReassembly(us, payload, payload_len);
+            if (sar_state == USP_RECORD__SESSION_CONTEXT_RECORD__PAYLOAD_SARSTATE__INPROCESS)
+            {
+                return;
+            }
+            break;
+
+        default:
+            USP_LOG_Warning("%s: Ignoring USP record with unknown payload_sar_state (%d)", __FUNCTION__, sar_state);
+            return;
+    }
+
+    // Exit if the USP message was discarded because it was too large
+    if (us->reassembly_buf == NULL)
+    {
+        return;
+    }
+
+    // If the code gets here, then the USP message has been completely received, so pass ownership of it to the vector
+    AddRxMsg(msgs, us->reassembly_buf, us->reassembly_len);
+    us->reassembly_buf = NULL;
+    us->reassembly_len = 0;
+}
+
+/*********************************************************************//**
+**
+** AppendReassembly
+**
+** Appends a segment to the USP message being reassembled, discarding the USP message if it becomes too large
+**
+** \param   us - pointer to session
+** \param   data - pointer to segment to append
+** \param   len - length of segment to append
+**
+** \return  None
+**
+**************************************************************************/
+void AppendReassembly(usp_session_t *us, unsigned char *data, int len)
+{
+    // Exit if the USP message would be too large, discarding it
+    if (us->reassembly_len + len > MAX_USP_MSG_LEN)
+    {
+        USP_LOG_Error("%s: Discarding segmented USP message, as it is larger than MAX_USP_MSG_LEN (%d bytes)", __FUNCTION__, MAX_USP_MSG_LEN);
+        USP_SAFE_FREE(us->reassembly_buf);
+        us->reassembly_len = 0;
+        return;
+    }
+
+    // NOTE: A buffer is always allocated (even for a zero length segment), as a non-NULL buffer indicates that reassembly is in progress
+    us->reassembly_buf = USP_REALLOC(us->reassembly_buf, us->reassembly_len + len + 1);
+    if (len > 0)
+    {
+        memcpy(&us->reassembly_buf[us->reassembly_len], data, len);
+    }
+    us->reassembly_len += len;
+}
+
+/*********************************************************************//**
+**
+** AddRxMsg
+**
+** Adds a completely received USP message to the vector of USP messages to handle
+**
+** \param   msgs - pointer to vector to add to
+** \param   buf - pointer to buffer containing the serialized USP message. Ownership of this buffer passes to the vector
+** \param   len - length of the serialized USP message
+**
+** \return  None
+**
+**************************************************************************/
+void AddRxMsg(rx_msg_vector_t *msgs, unsigned char *buf, int len)
+{
+    msgs->vector = USP_REALLOC(msgs->vector, (msgs->num_entries+1)*sizeof(rx_msg_t));
+    msgs->vector[msgs->num_entries].buf = buf;
+    msgs->vector[msgs->num_entries].len = len;
+    msgs->num_entries++;
+}
+
+/*********************************************************************//**
+**
+** ConcatPayloads
+**
+** Copies all payload elements in the specified session context record into a single buffer
+**
+** \param   ctx - pointer to session context of the received record
+** \param   p_payload - pointer to variable in which to return a dynamically allocated buffer containing the payload, or NULL if the record has no payload
+** \param   p_payload_len - pointer to variable in which to return the length of the payload
+**
+** \return  None
+**
+**************************************************************************/
+void ConcatPayloads(UspRecord__SessionContextRecord *ctx, unsigned char **p_payload, int *p_payload_len)
+{
+    unsigned char *payload = NULL;
+    int len = 0;
+    int i;
+
+    for (i=0; i < ctx->n_payload; i++)
+    {
+        if (ctx->payload[i].len > 0)
+        {
+            payload = USP_REALLOC(payload, len + ctx->payload[i].len);
+            memcpy(&payload[len], ctx->payload[i].data, ctx->payload[i].len);
+            len += ctx->payload[i].len;
+        }
+    }
+
+    *p_payload = payload;
+    *p_payload_len = len;
+}
+
+/*********************************************************************//**
+**
+** FindUspSession
+**
+** Finds the session with the specified controller, ending it if it has expired
+** NOTE: This function must be called with the mutex held
+**
+** \param   endpoint_id - controller whose session is to be found
+**
+** \return  pointer to session, or NULL if there is no session with the controller
+**
+**************************************************************************/
+usp_session_t *FindUspSession(char *endpoint_id)
+{
+    int i;
+    usp_session_t *us;
+    time_t cur_time;
+
+    cur_time = time(NULL);
+    for (i=0; i<MAX_USP_SESSIONS; i++)
+    {
+        us = &usp_sessions[i];
+        if ((us->endpoint_id != NULL) && (strcmp(us->endpoint_id, endpoint_id)==0))
+        {
+            // Exit if the session has expired, ending it
+            if (cur_time - us->last_activity_time > USP_SESSION_EXPIRY_PERIOD)
+            {
+                USP_LOG_Info("%s: USP session %llu with %s expired", __FUNCTION__, (unsigned long long)us->session_id, us->endpoint_id);
+                EndUspSession(us);
+                return NULL;
+            }
+
+            return us;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** StartUspSession
+**
+** Starts a session with the specified controller
+** If all session slots are in use, the least recently active session is ended to make room
+** NOTE: This function must be called with the mutex held
+**
+** \param   endpoint_id - controller to start the session with
+** \param   session_id - identifier of the session
+**
+** \return  pointer to session
+**
+**************************************************************************/
+usp_session_t *StartUspSession(char *endpoint_id, uint64_t session_id)
+{
+    int i;
+    usp_session_t *us;
+    usp_session_t *oldest = NULL;
+
+    // Find a free slot, or the least recently active session
+    for (i=0; i<MAX_USP_SESSIONS; i++)
+    {
+        us = &usp_sessions[i];
+        if (us->endpoint_id == NULL)
+        {
+            oldest = us;
+            break;
+        }
+
+        if ((oldest == NULL) || (us->last_activity_time < oldest->last_activity_time))
+        {
+            oldest = us;
+        }
+    }
+
+    us = oldest;
+    if (us->endpoint_id != NULL)
+    {
+        EndUspSession(us);
+    }
+
+    us->endpoint_id = USP_STRDUP(endpoint_id);
+    us->session_id = session_id;
+    us->last_tx_sequence_id = 0;
+    us->rx_expected_id = 1;
+    us->retransmit_requested_id = 0;
+    DLLIST_Init(&us->tx_retained);
+    us->num_tx_retained = 0;
+    DLLIST_Init(&us->rx_pending);
+    us->num_rx_pending = 0;
+    us->reassembly_buf = NULL;
+    us->reassembly_len = 0;
+    us->last_activity_time = time(NULL);
+
+    USP_LOG_Info("%s: Started USP session %llu with %s", __FUNCTION__, (unsigned long long)session_id, endpoint_id);
+
+    return us;
+}
+
+/*********************************************************************//**
+**
+** EndUspSession
+**
+** Ends the specified session, freeing all records retained or held by it
+** NOTE: This function must be called with the mutex held
+**
+** \param   us - pointer to session to end
+**
+** \return  None
+**
+**************************************************************************/
+void EndUspSession(usp_session_t *us)
+{
+    rx_record_t *rx;
+
+    // Free all retained records
+    AcknowledgeTxRecords(us, UINT64_MAX);
+
+    // Free all held records
+    rx = (rx_record_t *) us->rx_pending.head;
+    while (rx != NULL)
+    {
+        DLLIST_Unlink(&us->rx_pending, rx);
+        USP_SAFE_FREE(rx->payload);
+        USP_FREE(rx);
+        rx = (rx_record_t *) us->rx_pending.head;
+    }
+    us->num_rx_pending = 0;
+
+    USP_SAFE_FREE(us->reassembly_buf);
+    us->reassembly_len = 0;
+    USP_SAFE_FREE(us->endpoint_id);
+}
+
+/*********************************************************************//**
+**
+** AllocUspSessionId
+**
+** Allocates an identifier for a session started by the agent
+** NOTE: The first session_id is seeded from the current time, to make it unlikely to match a session_id used before the agent restarted
+** NOTE: This function must be called with the mutex held
+**
+** \param   None
+**
+** \return  session_id
+**
+**************************************************************************/
+uint64_t AllocUspSessionId(void)
+{
+    static uint64_t last_session_id = 0;
+
+    if (last_session_id == 0)
+    {
+        last_session_id = ((uint64_t)time(NULL)) << 16;
+    }
+
+    last_session_id++;
+    return last_session_id;
+}
@@ -0,0 +1,2775 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2017-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * \file wsclient.c
+ *
+ * Implements the WebSocket MTP (RFC6455), with the agent acting as a WebSocket client which connects to each controller
+ * Each controller MTP using WebSocket has a single persistent full-duplex connection, which carries USP records
+ * in both directions as binary frames. USP records are sent directly from the buffer queued by the data model thread
+ * (they are masked in place rather than copied into a frame), and received USP records are passed to the data model
+ * thread directly from the receive buffer. Ping/Pong control frames are used to keep the connection alive through
+ * NAT and firewall state, and to detect a controller that has gone away. If the controller accepts the
+ * permessage-deflate extension, large USP records are compressed in both directions.
+ *
+ */
+
+#ifdef ENABLE_WEBSOCKETS  // NOTE: This isn't strictly necessary as this file is not included in the build if WebSockets is disabled
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <openssl/x509v3.h>
+
+#include "common_defs.h"
+#include "wsclient.h"
+#include "usp_api.h"
+#include "msg_handler.h"
+#include "os_utils.h"
+#include "dllist.h"
+#include "mtp_send_queue.h"
+#include "mtp_exec.h"
+#include "dm_exec.h"
+#include "retry_wait.h"
+#include "text_utils.h"
+#include "nu_ipaddr.h"
+#include "dns_cache.h"
+#include "iso8601.h"
+#include "device.h"
+#include "uptime.h"
+#include "usp_probe.h"
+#include "usp_compress.h"
+
+//------------------------------------------------------------------------
+// WebSocket frame opcodes (RFC6455 section 5.2)
+#define WS_OPCODE_CONTINUATION  0x0
+#define WS_OPCODE_TEXT          0x1
+#define WS_OPCODE_BINARY        0x2
+#define WS_OPCODE_CLOSE         0x8
+#define WS_OPCODE_PING          0x9
+#define WS_OPCODE_PONG          0xA
+
+//------------------------------------------------------------------------
+// Bit in the first byte of a frame header denoting that the message is compressed (RSV1, used by permessage-deflate RFC7692 section 6)
+// NOTE: This is ORed with the opcode passed to WriteWsFrameHeader()
+#define WS_FRAME_RSV1           0x40
+
+//------------------------------------------------------------------------
+// Extension offered in the upgrade request, to allow USP records to be compressed in both directions
+// NOTE: Each message is compressed independently (no context takeover), so that no compression state is kept between messages
+#define WS_DEFLATE_EXTENSION    "permessage-deflate"
+#define WS_DEFLATE_OFFER        WS_DEFLATE_EXTENSION "; client_no_context_takeover; server_no_context_takeover"
+
+//------------------------------------------------------------------------
+// WebSocket close status codes (RFC6455 section 7.4.1)
+#define WS_CLOSE_NORMAL             1000
+#define WS_CLOSE_PROTOCOL_ERROR     1002
+#define WS_CLOSE_UNSUPPORTED_DATA   1003
+#define WS_CLOSE_MESSAGE_TOO_BIG    1009
+
+//------------------------------------------------------------------------
+// Return value of WsWritev() and WsRead() denoting that the operation could not progress yet, and must be retried when the socket is ready
+#define WS_IO_PENDING   (-2)
+
+//------------------------------------------------------------------------
+// State of a WebSocket client connection
+typedef enum
+{
+    kWsState_Idle,                  // Client slot is not in use
+    kWsState_ResolvingHost,         // Waiting for the (asynchronous) DNS lookup of the controller's hostname to complete
+    kWsState_Connecting,            // Waiting for the (non-blocking) TCP connect to the controller to complete
+    kWsState_SendingHandshake,      // Sending the HTTP upgrade request
+    kWsState_AwaitingHandshake,     // Waiting for the HTTP 101 response to the upgrade request
+    kWsState_Running,               // WebSocket connection is up, and USP records are being exchanged
+    kWsState_Retrying,              // Waiting until retry_time before reconnecting
+} ws_state_t;
+
+//------------------------------------------------------------------------------
+// USP Record to send in the queue
+typedef struct
+{
+    double_link_t link;     // Doubly linked list pointers. These must always be first in this structure
+    Usp__Header__MsgType usp_msg_type;  // Type of USP message contained within pbuf
+    unsigned char *pbuf;    // Protobuf format USP record to send. NOTE: Whilst being sent, this is masked in place (see StartWsUspRecordFrame)
+    int pbuf_len;           // Length of protobuf USP record to send
+    unsigned digest;        // Hash of the USP record. Used to speed up detection of duplicate USP records in the queue
+    mtp_send_priority_t priority;       // Send priority of this USP record
+    time_t expiry_time;     // Time at which this USP record should be removed from the queue
+    unsigned long long queued_time;     // Time (in microseconds, from tu_uptime_usecs()) at which this USP record was added to the queue
+    unsigned long long send_start_time; // Time (in microseconds, from tu_uptime_usecs()) at which this USP record started to be sent
+} ws_send_item_t;
+
+//------------------------------------------------------------------------
+// Structure representing a WebSocket client connection to a controller
+typedef struct
+{
+    int cont_instance;           // Instance number of the controller in Device.LocalAgent.Controller.{i}, or INVALID if this slot is unused
+    int mtp_instance;            // Instance number of the MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+    char *endpoint_id;           // Endpoint ID of the controller (used only for debug)
+    wsclient_config_t config;    // Configuration of the connection
+
+    ws_state_t state;            // Current state of the connection
+    unsigned retry_count;        // Number of times that the connection has been tried, and has failed. Reset to 0 when the WebSocket handshake succeeds
+    time_t retry_time;           // If state is kWsState_Retrying, the time at which the reconnect should be attempted
+    time_t state_timeout;        // Absolute time by which the TCP connect or the WebSocket handshake must complete
+
+    int socket_fd;               // Socket of the connection, or INVALID if not connected
+    SSL *ssl;                    // SSL object of the connection, or NULL if the connection is not encrypted
+    STACK_OF(X509) *cert_chain;  // Full SSL certificate chain of the controller, collected in the SSL verify callback
+    ctrust_role_t role;          // Role granted by the CA cert in the chain of trust with the controller
+    char *allowed_controllers;   // Pattern describing the endpoint_id of controllers which are granted access to this agent by the CA cert
+    int ssl_write_want;          // Set to SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE if the last SSL_write() must be retried with the same arguments. SSL_ERROR_NONE otherwise
+
+    char ws_key[32];             // Base64 encoded Sec-WebSocket-Key sent in the upgrade request
+    bool is_deflate_negotiated;  // Set if the server accepted the permessage-deflate extension, so USP records may be compressed in both directions
+    char *handshake;             // HTTP upgrade request being sent (only valid in kWsState_SendingHandshake)
+    int handshake_len;
+    int handshake_sent;          // Number of bytes of the HTTP upgrade request sent so far
+
+    mtp_send_queue_t send_queue; // Queues (one for each send priority) of USP records waiting to be sent
+    ws_send_item_t *cur_msg;     // USP record currently being sent (removed from send_queue), or NULL if none
+                                 // NOTE: This is kept across reconnects, so that it is resent from the start on the new connection
+    unsigned char tx_hdr[MAX_WS_FRAME_HEADER_SIZE]; // Frame header of the binary frame carrying cur_msg
+    int tx_hdr_len;              // Length of tx_hdr, or 0 if the frame carrying cur_msg has not been started yet (and cur_msg is not masked)
+    int tx_sent;                 // Number of bytes of the frame carrying cur_msg (header then payload) sent so far
+    unsigned char *tx_deflated;  // Compressed copy of cur_msg which is sent instead of it (masked in place), or NULL if cur_msg is sent uncompressed
+    int tx_deflated_len;
+
+    unsigned char ctrl_frame[MAX_WS_FRAME_HEADER_SIZE + MAX_WS_CONTROL_PAYLOAD]; // Control frame (Ping, Pong or Close) waiting to be sent
+    int ctrl_frame_len;          // Length of ctrl_frame, or 0 if no control frame is waiting to be sent
+    int ctrl_sent;               // Number of bytes of ctrl_frame sent so far
+
+    unsigned char *rx_buf;       // Buffer containing bytes received from the controller which have not been processed yet. Frames are processed in place.
+    int rx_buf_size;             // Size of rx_buf allocated
+    int rx_len;                  // Number of unprocessed bytes in rx_buf
+    int rx_frame_len;            // Total length of the (partially received) frame at the start of rx_buf, or 0 if not known yet
+
+    unsigned char *rx_msg;       // Buffer used to reassemble a fragmented USP record, or NULL if a fragmented USP record is not being received
+    int rx_msg_len;              // Number of bytes of the fragmented USP record received so far
+    bool rx_msg_is_deflated;     // Set if the fragmented USP record is compressed
+
+    time_t last_rx_time;         // Time at which data was last received from the controller
+    time_t ping_timeout;         // Absolute time by which a Pong (or any other data) must be received in response to our Ping, or INVALID_TIME if no Ping is outstanding
+} wsclient_t;
+
+// Payload of the binary frame carrying the USP record currently being sent (ie the compressed USP record, if it has been compressed)
+#define WS_TX_BODY(wc)      (((wc)->tx_deflated != NULL) ? (wc)->tx_deflated : (wc)->cur_msg->pbuf)
+#define WS_TX_BODY_LEN(wc)  (((wc)->tx_deflated != NULL) ? (wc)->tx_deflated_len : (wc)->cur_msg->pbuf_len)
+
+static wsclient_t wsclients[MAX_WEBSOCKET_CLIENTS];
+
+//------------------------------------------------------------------------------
+// SSL context for WebSocket connections (used only for encrypted connections)
+static SSL_CTX *wsclient_ssl_ctx = NULL;
+
+//------------------------------------------------------------------------------
+// Mutex used to protect access to this component
+static pthread_mutex_t ws_access_mutex;
+
+//------------------------------------------------------------------------------
+// Forward declarations. Note these are not static, because we need them in the symbol table for USP_LOG_Callstack() to show them
+void StartWsConnection(wsclient_t *wc);
+void ConnectWsSocket(wsclient_t *wc);
+void CompleteWsConnect(wsclient_t *wc);
+int PerformWsSslConnect(wsclient_t *wc);
+int StartWsHandshake(wsclient_t *wc);
+void SendWsHandshake(wsclient_t *wc);
+void ReceiveWsHandshakeResponse(wsclient_t *wc);
+int ValidateWsHandshakeResponse(wsclient_t *wc, char *response);
+bool GetHttpHeaderValue(char *response, char *name, char *buf, int len);
+void CalcWsAcceptKey(char *ws_key, char *buf, int len);
+void ReceiveWsFrames(wsclient_t *wc);
+int ReadIntoWsRxBuf(wsclient_t *wc);
+void ProcessWsRxBuffer(wsclient_t *wc);
+int ValidateWsExtensions(wsclient_t *wc, char *extensions);
+int HandleWsFrame(wsclient_t *wc, int opcode, bool fin, bool is_deflated, unsigned char *payload, int payload_len);
+void PostWsUspRecord(wsclient_t *wc, unsigned char *pbuf, int pbuf_len, bool is_deflated);
+void QueueWsControlFrame(wsclient_t *wc, int opcode, unsigned char *payload, int payload_len);
+void QueueWsCloseFrame(wsclient_t *wc, unsigned status_code);
+void TransmitWsFrames(wsclient_t *wc);
+void StartNextWsUspRecord(wsclient_t *wc);
+void StartWsUspRecordFrame(wsclient_t *wc);
+int WriteWsFrameHeader(unsigned char *buf, int opcode, int payload_len, unsigned char *mask);
+void MaskWsPayload(unsigned char *buf, int len, unsigned char *mask);
+void GenerateWsRandomBytes(unsigned char *buf, int len);
+int WsWritev(wsclient_t *wc, struct iovec *iov, int iovcnt);
+bool IsWsDataPendingToSend(wsclient_t *wc);
+void UpdateWsKeepAlive(wsclient_t *wc, time_t cur_time);
+void UpdateWsClientSockSet(wsclient_t *wc, socket_set_t *set, time_t cur_time);
+void ProcessWsClientSocketActivity(wsclient_t *wc, socket_set_t *set, time_t cur_time);
+void HandleWsClientError(wsclient_t *wc, char *reason);
+void CloseWsClientSocket(wsclient_t *wc);
+void ResetWsRxState(wsclient_t *wc);
+void StopWsClient(wsclient_t *wc);
+void CopyWsConfig(wsclient_config_t *dest, wsclient_config_t *src);
+void FreeWsConfig(wsclient_config_t *config);
+wsclient_t *FindUnusedWsClient(void);
+wsclient_t *FindWsClientByInstance(int cont_instance, int mtp_instance);
+void RemoveExpiredWsMessages(wsclient_t *wc);
+void FreeWsSendItem(ws_send_item_t *wsi);
+bool IsUspRecordInWsQueue(wsclient_t *wc, unsigned char *pbuf, int pbuf_len, unsigned digest);
+
+/*********************************************************************//**
+**
+** WSCLIENT_Init
+**
+** Initialises this component
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int WSCLIENT_Init(void)
+{
+    int i;
+    wsclient_t *wc;
+    int err;
+
+    // Mark all WebSocket client slots as unused
+    memset(wsclients, 0, sizeof(wsclients));
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        wc->cont_instance = INVALID;
+        wc->socket_fd = INVALID;
+    }
+
+    // Exit if unable to create mutex protecting access to this subsystem
+    err = OS_UTILS_InitMutex(&ws_access_mutex);
+    if (err != USP_ERR_OK)
+    {
+        return err;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_Start
+**
+** Creates the SSL context used by this module
+**
+** \param   None
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int WSCLIENT_Start(void)
+{
+    // Create the TLS client SSL context with trust store and client cert loaded
+    wsclient_ssl_ctx = DEVICE_SECURITY_CreateSSLContext(SSLv23_client_method(), SSL_VERIFY_PEER, DEVICE_SECURITY_TrustCertVerifyCallback);
+    if (wsclient_ssl_ctx == NULL)
+    {
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_Destroy
+**
+** Frees all memory used by this component
+** Called from the WebSocket MTP thread, when it exits
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void WSCLIENT_Destroy(void)
+{
+    int i;
+    wsclient_t *wc;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    // Free all WebSocket clients
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if (wc->cont_instance != INVALID)
+        {
+            // Attempt to let the controller know that we are going away (it does not matter if this fails)
+            if (wc->state == kWsState_Running)
+            {
+                QueueWsCloseFrame(wc, WS_CLOSE_NORMAL);
+            }
+
+            StopWsClient(wc);
+        }
+    }
+
+    if (wsclient_ssl_ctx != NULL)
+    {
+        SSL_CTX_free(wsclient_ssl_ctx);
+        wsclient_ssl_ctx = NULL;
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_StartClient
+**
+** Starts a WebSocket client connection to the specified controller
+** NOTE: The connection is made by the WebSocket MTP thread, not by the caller
+**
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+** \param   endpoint_id - endpoint of controller (used only for debug)
+** \param   config - pointer to structure containing the configuration of the connection
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int WSCLIENT_StartClient(int cont_instance, int mtp_instance, char *endpoint_id, wsclient_config_t *config)
+{
+    wsclient_t *wc;
+    int err = USP_ERR_OK;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_wsclient_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return USP_ERR_OK;
+    }
+
+    USP_ASSERT(FindWsClientByInstance(cont_instance, mtp_instance)==NULL);
+
+    // Exit if unable to find a free WebSocket client slot
+    wc = FindUnusedWsClient();
+    if (wc == NULL)
+    {
+        USP_LOG_Error("%s: Out of WebSocket clients for controller endpoint %s (Device.LocalAgent.Controller.%d.MTP.%d.WebSocket)", __FUNCTION__, endpoint_id, cont_instance, mtp_instance);
+        err = USP_ERR_RESOURCES_EXCEEDED;
+        goto exit;
+    }
+
+    wc->cont_instance = cont_instance;
+    wc->mtp_instance = mtp_instance;
+    wc->endpoint_id = USP_STRDUP(endpoint_id);
+    CopyWsConfig(&wc->config, config);
+    wc->socket_fd = INVALID;
+    wc->ssl_write_want = SSL_ERROR_NONE;
+    wc->ping_timeout = INVALID_TIME;
+    MTP_SEND_QUEUE_Init(&wc->send_queue);
+
+    // Connect as soon as the MTP thread wakes up
+    wc->state = kWsState_Retrying;
+    wc->retry_count = 0;
+    wc->retry_time = time(NULL);
+
+exit:
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that it starts the connection
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    if (err == USP_ERR_OK)
+    {
+        MTP_EXEC_WsclientWakeup();
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_StopClient
+**
+** Stops the specified WebSocket client, discarding all USP records queued to send on it
+** NOTE: It is safe to call this function, if the client has already been stopped
+**
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+**
+** \return  None
+**
+**************************************************************************/
+void WSCLIENT_StopClient(int cont_instance, int mtp_instance)
+{
+    wsclient_t *wc;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_wsclient_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return;
+    }
+
+    // Exit if the client has already been stopped - nothing more to do
+    wc = FindWsClientByInstance(cont_instance, mtp_instance);
+    if (wc == NULL)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return;
+    }
+
+    USP_LOG_Info("%s: Stopping WebSocket client [controller_instance=%d, mtp_instance=%d]", __FUNCTION__, cont_instance, mtp_instance);
+    StopWsClient(wc);
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that it stops waiting on the closed socket
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    MTP_EXEC_WsclientWakeup();
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_UpdateConfig
+**
+** Called when the configuration of a WebSocket client has changed
+** If the parameters used to connect have changed, the client reconnects using the new configuration
+** USP records queued to send are kept, and are sent on the new connection
+**
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+** \param   config - pointer to structure containing the new configuration of the connection
+**
+** \return  None
+**
+**************************************************************************/
+void WSCLIENT_UpdateConfig(int cont_instance, int mtp_instance, wsclient_config_t *config)
+{
+    wsclient_t *wc;
+    bool is_reconnect;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_wsclient_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return;
+    }
+
+    // Exit if the client is not running - the new configuration will be used when it is started
+    wc = FindWsClientByInstance(cont_instance, mtp_instance);
+    if (wc == NULL)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return;
+    }
+
+    // Determine whether the connection needs to be restarted to use the new configuration
+    // NOTE: Changes to the keep alive interval and retry parameters take effect without reconnecting
+    is_reconnect = ((strcmp(config->host, wc->config.host) != 0) ||
+                    (config->port != wc->config.port) ||
+                    (strcmp(config->path, wc->config.path) != 0) ||
+                    (config->enable_encryption != wc->config.enable_encryption));
+
+    FreeWsConfig(&wc->config);
+    CopyWsConfig(&wc->config, config);
+
+    if (is_reconnect)
+    {
+        USP_LOG_Info("%s: Reconnecting WebSocket client to use new configuration (host=%s, port=%d)", __FUNCTION__, wc->config.host, wc->config.port);
+        CloseWsClientSocket(wc);
+        wc->state = kWsState_Retrying;
+        wc->retry_count = 0;
+        wc->retry_time = time(NULL);
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    // Cause the MTP thread to wakeup from select() so that timeouts get recalculated based on the new configuration
+    MTP_EXEC_WsclientWakeup();
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_GetRetryCount
+**
+** Gets the number of times that the specified WebSocket client has failed to connect since it was last connected
+** This is used by Device.LocalAgent.Controller.{i}.MTP.{i}.WebSocket.CurrentRetryCount
+**
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+**
+** \return  Number of retries, or 0 if the client is not running
+**
+**************************************************************************/
+unsigned WSCLIENT_GetRetryCount(int cont_instance, int mtp_instance)
+{
+    wsclient_t *wc;
+    unsigned retry_count = 0;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    wc = FindWsClientByInstance(cont_instance, mtp_instance);
+    if (wc != NULL)
+    {
+        retry_count = wc->retry_count;
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    return retry_count;
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_UpdateAllSockSet
+**
+** Updates the set of all WebSocket client socket fds to read/write from
+**
+** \param   set - pointer to socket set structure to update with sockets to wait for activity on
+**
+** \return  None
+**
+**************************************************************************/
+void WSCLIENT_UpdateAllSockSet(socket_set_t *set)
+{
+    int i;
+    wsclient_t *wc;
+    time_t cur_time;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    cur_time = time(NULL);
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if (wc->cont_instance != INVALID)
+        {
+            UpdateWsClientSockSet(wc, set, cur_time);
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_ProcessAllSocketActivity
+**
+** Processes the sockets of all WebSocket clients
+**
+** \param   set - pointer to socket set structure containing the sockets which need processing
+**
+** \return  None
+**
+**************************************************************************/
+void WSCLIENT_ProcessAllSocketActivity(socket_set_t *set)
+{
+    int i;
+    wsclient_t *wc;
+    time_t cur_time;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    cur_time = time(NULL);
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if (wc->cont_instance != INVALID)
+        {
+            ProcessWsClientSocketActivity(wc, set, cur_time);
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_QueueBinaryMessage
+**
+** Function called to queue a USP record to send to the specified controller (over WebSocket)
+**
+** \param   usp_msg_type - Type of USP message contained in pbuf. This is used for debug logging when the message is sent by the MTP.
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+** \param   pbuf - pointer to buffer containing binary protobuf USP record. Ownership of this buffer passes to this code, if successful
+** \param   pbuf_len - length of buffer containing protobuf binary USP record
+** \param   mrt - pointer to structure containing the send priority of the USP message
+** \param   expiry_time - time at which the USP message should be removed from the MTP send queue
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int WSCLIENT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int cont_instance, int mtp_instance, unsigned char *pbuf, int pbuf_len, mtp_reply_to_t *mrt, time_t expiry_time)
+{
+    wsclient_t *wc;
+    ws_send_item_t *wsi;
+    unsigned digest;
+    int err;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    // Exit if MTP thread has exited
+    if (is_wsclient_mtp_thread_exited)
+    {
+        OS_UTILS_UnlockMutex(&ws_access_mutex);
+        return USP_ERR_OK;
+    }
+
+    // Exit if unable to find the WebSocket client for this controller MTP
+    wc = FindWsClientByInstance(cont_instance, mtp_instance);
+    if (wc == NULL)
+    {
+        USP_ERR_SetMessage("%s: No WebSocket client for controller=%d (mtp=%d)", __FUNCTION__, cont_instance, mtp_instance);
+        err = USP_ERR_INTERNAL_ERROR;
+        goto exit;
+    }
+
+    // Do not add this USP record to the queue, if it is already present in the queue
+    // This situation could occur if a notify is being retried to be sent, but is already held up in the queue pending sending
+    // NOTE: Ownership of pbuf has passed to this code, so it must be freed here
+    digest = TEXT_UTILS_CalcBufferHash(pbuf, pbuf_len);
+    if (IsUspRecordInWsQueue(wc, pbuf, pbuf_len, digest))
+    {
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Remove any queued USP records that have expired
+    RemoveExpiredWsMessages(wc);
+
+    // Exit if the MTP send queues have used up their memory budget, and this USP record is a low priority notification
+    if (MTP_SEND_QUEUE_ChargeBudget(mrt->send_priority, pbuf_len) == false)
+    {
+        USP_LOG_Warning("%s: MTP send queue memory budget exceeded. Dropping %s message", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(usp_msg_type));
+        USP_FREE(pbuf);
+        err = USP_ERR_OK;
+        goto exit;
+    }
+
+    // Add the USP record to the queue for its send priority
+    wsi = USP_MALLOC(sizeof(ws_send_item_t));
+    memset(wsi, 0, sizeof(ws_send_item_t));
+    wsi->usp_msg_type = usp_msg_type;
+    wsi->pbuf = pbuf;
+    wsi->pbuf_len = pbuf_len;
+    wsi->digest = digest;
+    wsi->priority = mrt->send_priority;
+    wsi->expiry_time = expiry_time;
+    wsi->queued_time = tu_uptime_usecs();
+    MTP_SEND_QUEUE_Add(&wc->send_queue, wsi->priority, wsi);
+
+    err = USP_ERR_OK;
+
+exit:
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    // If successful, cause the MTP thread to wakeup from select(), so that it sends the USP record
+    // We do this outside of the mutex lock to avoid an unnecessary task switch
+    if (err == USP_ERR_OK)
+    {
+        MTP_EXEC_WsclientWakeup();
+    }
+
+    return err;
+}
+
+/*********************************************************************//**
+**
+** WSCLIENT_AreAllResponsesSent
+**
+** Determines whether all USP records queued on the WebSocket clients have been sent
+**
+** \param   None
+**
+** \return  true if all responses have been sent
+**
+**************************************************************************/
+bool WSCLIENT_AreAllResponsesSent(void)
+{
+    int i;
+    wsclient_t *wc;
+    bool all_responses_sent = true;
+
+    OS_UTILS_LockMutex(&ws_access_mutex);
+
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if ((wc->cont_instance != INVALID) && ((wc->cur_msg != NULL) || (MTP_SEND_QUEUE_IsEmpty(&wc->send_queue)==false)))
+        {
+            all_responses_sent = false;
+            break;
+        }
+    }
+
+    OS_UTILS_UnlockMutex(&ws_access_mutex);
+
+    return all_responses_sent;
+}
+
+/*********************************************************************//**
+**
+** UpdateWsClientSockSet
+**
+** Adds the socket of the specified WebSocket client to the socket set (if required), and updates the select() timeout
+**
+** \param   wc - pointer to WebSocket client
+** \param   set - pointer to socket set structure to update with sockets to wait for activity on
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateWsClientSockSet(wsclient_t *wc, socket_set_t *set, time_t cur_time)
+{
+    int timeout;        // timeout in seconds
+    time_t next_time;
+
+    #define CALC_WS_TIMEOUT(res, t) res = (t) - cur_time; if (res < 0) { res = 0; }
+
+    switch(wc->state)
+    {
+        case kWsState_Retrying:
+            CALC_WS_TIMEOUT(timeout, wc->retry_time);
+            SOCKET_SET_UpdateTimeoutWithSlack(timeout*SECONDS, MTP_RETRY_SLACK, set);
+            break;
+
+        case kWsState_Connecting:
+        case kWsState_SendingHandshake:
+            CALC_WS_TIMEOUT(timeout, wc->state_timeout);
+            SOCKET_SET_AddSocketToSendTo(wc->socket_fd, timeout*SECONDS, set);
+            break;
+
+        case kWsState_AwaitingHandshake:
+            CALC_WS_TIMEOUT(timeout, wc->state_timeout);
+            SOCKET_SET_AddSocketToReceiveFrom(wc->socket_fd, timeout*SECONDS, set);
+            break;
+
+        case kWsState_Running:
+            // Determine the time at which the keep alive next needs to be serviced
+            timeout = MAX_SOCKET_TIMEOUT_SECONDS;
+            if (wc->ping_timeout != INVALID_TIME)
+            {
+                CALC_WS_TIMEOUT(timeout, wc->ping_timeout);
+            }
+            else if (wc->config.keep_alive_interval != 0)
+            {
+                next_time = wc->last_rx_time + wc->config.keep_alive_interval;
+                CALC_WS_TIMEOUT(timeout, next_time);
+            }
+
+            // Always receive from the controller (unless the data model thread has a backlog of USP records to process), and also send to it, if there is anything to send
+            // NOTE: If an SSL_write() is waiting for data to be received (eg during a renegotiation), then only receiving is required
+            if ((USP_MEM_IsBudgetUnderPressure(kMemBudget_DmQueue)) && (wc->ssl_write_want != SSL_ERROR_WANT_READ))
+            {
+                SOCKET_SET_UpdateTimeout(timeout*SECONDS, set);
+                SOCKET_SET_UpdateTimeout(MEM_BUDGET_RECHECK_PERIOD, set);
+            }
+            else
+            {
+                SOCKET_SET_AddSocketToReceiveFrom(wc->socket_fd, timeout*SECONDS, set);
+            }
+            if ((IsWsDataPendingToSend(wc)) && (wc->ssl_write_want != SSL_ERROR_WANT_READ))
+            {
+                SOCKET_SET_AddSocketToSendTo(wc->socket_fd, timeout*SECONDS, set);
+            }
+            break;
+
+        default:
+        case kWsState_Idle:
+        case kWsState_ResolvingHost:
+            // Nothing to wait for. In the case of resolving the host, the DNS cache wakes up the MTP thread when the lookup completes
+            break;
+    }
+}
+
+/*********************************************************************//**
+**
+** ProcessWsClientSocketActivity
+**
+** Processes activity (and timeouts) on the socket of the specified WebSocket client
+**
+** \param   wc - pointer to WebSocket client
+** \param   set - pointer to socket set structure containing the sockets which need processing
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void ProcessWsClientSocketActivity(wsclient_t *wc, socket_set_t *set, time_t cur_time)
+{
+    bool is_ready_to_write;
+
+    switch(wc->state)
+    {
+        case kWsState_Retrying:
+            if (cur_time >= wc->retry_time)
+            {
+                StartWsConnection(wc);
+            }
+            break;
+
+        case kWsState_ResolvingHost:
+            // Continue connecting, if the lookup of the controller's IP address has completed
+            ConnectWsSocket(wc);
+            break;
+
+        case kWsState_Connecting:
+            if (SOCKET_SET_IsReadyToWrite(wc->socket_fd, set))
+            {
+                CompleteWsConnect(wc);
+            }
+            else if (cur_time >= wc->state_timeout)
+            {
+                HandleWsClientError(wc, "TCP connect timed out");
+            }
+            break;
+
+        case kWsState_SendingHandshake:
+            if (SOCKET_SET_IsReadyToWrite(wc->socket_fd, set))
+            {
+                SendWsHandshake(wc);
+            }
+            else if (cur_time >= wc->state_timeout)
+            {
+                HandleWsClientError(wc, "WebSocket handshake timed out");
+            }
+            break;
+
+        case kWsState_AwaitingHandshake:
+            if (SOCKET_SET_IsReadyToRead(wc->socket_fd, set))
+            {
+                ReceiveWsHandshakeResponse(wc);
+            }
+            else if (cur_time >= wc->state_timeout)
+            {
+                HandleWsClientError(wc, "WebSocket handshake timed out");
+            }
+            break;
+
+        case kWsState_Running:
+            // Determine whether the socket is ready to write, before reading from it (as reading may close it)
+            is_ready_to_write = (wc->ssl_write_want == SSL_ERROR_WANT_READ) ? SOCKET_SET_IsReadyToRead(wc->socket_fd, set) :
+                                                                              SOCKET_SET_IsReadyToWrite(wc->socket_fd, set);
+
+            if (SOCKET_SET_IsReadyToRead(wc->socket_fd, set))
+            {
+                ReceiveWsFrames(wc);
+            }
+
+            // Exit if the connection was closed whilst receiving
+            if (wc->state != kWsState_Running)
+            {
+                break;
+            }
+
+            if ((is_ready_to_write) && (IsWsDataPendingToSend(wc)))
+            {
+                TransmitWsFrames(wc);
+            }
+
+            if (wc->state == kWsState_Running)
+            {
+                UpdateWsKeepAlive(wc, time(NULL));
+            }
+            break;
+
+        default:
+        case kWsState_Idle:
+            break;
+    }
+}
+
+/*********************************************************************//**
+**
+** StartWsConnection
+**
+** Starts connecting to the controller's WebSocket server
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void StartWsConnection(wsclient_t *wc)
+{
+    USP_LOG_Info("Attempting to connect to WebSocket server host=%s (port=%d, path=%s, %s)", wc->config.host, wc->config.port, wc->config.path,
+                 (wc->config.enable_encryption) ? "encrypted" : "unencrypted");
+
+    ConnectWsSocket(wc);
+}
+
+/*********************************************************************//**
+**
+** ConnectWsSocket
+**
+** Looks up the IP address of the controller's WebSocket server, then starts a non-blocking TCP connect to it
+** If the DNS lookup is still in progress, then the client is left in kWsState_ResolvingHost,
+** and this function is called again when the MTP thread is woken up by the DNS cache
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void ConnectWsSocket(wsclient_t *wc)
+{
+    int err;
+    bool prefer_ipv6;
+    bool is_pending;
+    nu_ipaddr_t dst;
+    nu_ipaddr_t local_mgmt_addr;
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    sa_family_t family;
+    int one = 1;
+
+    // Exit if unable to determine the IP address of the WebSocket server
+    prefer_ipv6 = DEVICE_LOCAL_AGENT_GetDualStackPreference();
+    nu_ipaddr_set_zero(&local_mgmt_addr);
+    err = DNS_CACHE_LookupHost(wc->config.host, AF_UNSPEC, prefer_ipv6, &local_mgmt_addr, &dst, &is_pending);
+    if (err != USP_ERR_OK)
+    {
+        HandleWsClientError(wc, "Unable to resolve host");
+        return;
+    }
+
+    // Exit if the IP address of the WebSocket server is still being looked up. The connect continues when the lookup completes
+    if (is_pending)
+    {
+        wc->state = kWsState_ResolvingHost;
+        return;
+    }
+
+    // Exit if unable to make a socket address structure to contact the WebSocket server
+    err = nu_ipaddr_to_sockaddr(&dst, wc->config.port, &saddr, &saddr_len);
+    err |= nu_ipaddr_get_family(&dst, &family);
+    if (err != USP_ERR_OK)
+    {
+        HandleWsClientError(wc, "Unable to convert IP address");
+        return;
+    }
+
+    // Exit if unable to create the socket
+    wc->socket_fd = socket(family, SOCK_STREAM, 0);
+    if (wc->socket_fd == -1)
+    {
+        USP_ERR_ERRNO("socket", errno);
+        wc->socket_fd = INVALID;
+        HandleWsClientError(wc, "Unable to create socket");
+        return;
+    }
+
+    // Disable Nagle's algorithm, so that small frames (eg notifications and Pongs) are not held back waiting for the ACK of a previous frame
+    (void)setsockopt(wc->socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Exit if unable to set the socket as non blocking
+    err = fcntl(wc->socket_fd, F_SETFL, O_NONBLOCK);
+    if (err == -1)
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        HandleWsClientError(wc, "Unable to set socket as non-blocking");
+        return;
+    }
+
+    // Exit if unable to start connecting to the WebSocket server
+    err = connect(wc->socket_fd, (struct sockaddr *) &saddr, saddr_len);
+    if ((err == -1) && (errno != EINPROGRESS))
+    {
+        USP_ERR_ERRNO("connect", errno);
+        HandleWsClientError(wc, "Unable to connect");
+        return;
+    }
+
+    // The connect completes when the socket becomes writable
+    wc->state = kWsState_Connecting;
+    wc->state_timeout = time(NULL) + WSCLIENT_CONNECT_TIMEOUT;
+}
+
+/*********************************************************************//**
+**
+** CompleteWsConnect
+**
+** Called when the TCP connect to the WebSocket server has completed (successfully or not)
+** Performs the TLS handshake (if required), then starts sending the WebSocket upgrade request
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If the connection failed, it will be retried later
+**
+**************************************************************************/
+void CompleteWsConnect(wsclient_t *wc)
+{
+    int err;
+    int so_err = 0;
+    socklen_t so_len = sizeof(so_err);
+
+    // Exit if the TCP connect failed
+    err = getsockopt(wc->socket_fd, SOL_SOCKET, SO_ERROR, &so_err, &so_len);
+    if ((err == -1) || (so_err != 0))
+    {
+        USP_LOG_Error("%s: TCP connect to (host=%s, port=%d) failed (%s)", __FUNCTION__, wc->config.host, wc->config.port, strerror((err == -1) ? errno : so_err));
+        HandleWsClientError(wc, "TCP connect failed");
+        return;
+    }
+
+    // Perform the TLS handshake (if required), determining the role to use when processing USP messages
+    if (wc->config.enable_encryption)
+    {
+        err = PerformWsSslConnect(wc);
+        if (err != USP_ERR_OK)
+        {
+            HandleWsClientError(wc, "TLS handshake failed");
+            return;
+        }
+    }
+    else
+    {
+        wc->role = ROLE_NON_SSL;
+    }
+
+    // Exit if unable to form the WebSocket upgrade request
+    err = StartWsHandshake(wc);
+    if (err != USP_ERR_OK)
+    {
+        HandleWsClientError(wc, "Unable to form WebSocket upgrade request");
+        return;
+    }
+}
+
+/*********************************************************************//**
+**
+** PerformWsSslConnect
+**
+** Performs the TLS handshake with the WebSocket server, and determines the role to use for USP messages received on the connection
+** NOTE: As for STOMP, the handshake is performed with the socket temporarily set as blocking
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int PerformWsSslConnect(wsclient_t *wc)
+{
+    int sock_opt;
+    int err;
+    X509 *server_cert;
+
+    // Exit if unable to temporarily set the socket as blocking
+    sock_opt = fcntl(wc->socket_fd, F_GETFL);
+    if ((sock_opt == -1) || (fcntl(wc->socket_fd, F_SETFL, sock_opt & ~O_NONBLOCK) == -1))
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to create a new SSL connection
+    wc->ssl = SSL_new(wsclient_ssl_ctx);
+    if (wc->ssl == NULL)
+    {
+        USP_LOG_Error("%s: SSL_new() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Set the pointer to the variable in which to point to the certificate chain collected in the verify callback
+    SSL_set_app_data(wc->ssl, &wc->cert_chain);
+
+    // Send the hostname in the Server Name Indication extension, so that virtual hosted WebSocket servers present the right certificate
+    SSL_set_tlsext_host_name(wc->ssl, wc->config.host);
+
+#if OPENSSL_VERSION_NUMBER >= 0x1000200FL // SSL version 1.0.2
+{
+    // Fail the certificate if the WebSocket server hostname doesn't match the SubjectAltName (or CommonName) in it
+    X509_VERIFY_PARAM *verify_object;
+    verify_object = SSL_get0_param(wc->ssl);
+    if (verify_object == NULL)
+    {
+        USP_LOG_Error("%s: SSL_get0_param() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    X509_VERIFY_PARAM_set_hostflags(verify_object, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+    X509_VERIFY_PARAM_set1_host(verify_object, wc->config.host, strlen(wc->config.host));
+}
+#endif
+
+    // Exit if unable to attach the socket to our SSL connection
+    err = SSL_set_fd(wc->ssl, wc->socket_fd);
+    if (err != 1)
+    {
+        USP_LOG_Error("%s: SSL_set_fd() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if unable to successfully perform the SSL handshake
+    err = SSL_connect(wc->ssl);
+    if (err != 1)
+    {
+        USP_LOG_ErrorSSL(__FUNCTION__, "SSL_connect() failed", err, SSL_get_error(wc->ssl, err));
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the handshake was successful, but the server did not provide a certificate
+    server_cert = SSL_get_peer_certificate(wc->ssl);
+    if (server_cert == NULL)
+    {
+        USP_LOG_Error("%s: SSL_get_peer_certificate() failed", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+    X509_free(server_cert);
+
+    // Exit if unable to determine the role associated with the trusted root cert
+    if (wc->cert_chain != NULL)
+    {
+        err = DEVICE_SECURITY_GetControllerTrust(wc->cert_chain, &wc->role, &wc->allowed_controllers);
+        if (err != USP_ERR_OK)
+        {
+            return err;
+        }
+    }
+
+    // Exit if unable to set the socket back as non blocking
+    err = fcntl(wc->socket_fd, F_SETFL, O_NONBLOCK);
+    if (err == -1)
+    {
+        USP_ERR_ERRNO("fcntl", errno);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Allow SSL_write() to write a partial frame ie not block if it cannot write the full frame
+    SSL_set_mode(wc->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** StartWsHandshake
+**
+** Forms the HTTP upgrade request (RFC6455 section 4.1), and starts sending it
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  USP_ERR_OK if successful
+**
+**************************************************************************/
+int StartWsHandshake(wsclient_t *wc)
+{
+    unsigned char nonce[16];
+    char host_buf[MAX_DM_SHORT_VALUE_LEN+2];
+    char *path;
+    int len;
+
+    // Generate the random key, which the server must hash into Sec-WebSocket-Accept
+    GenerateWsRandomBytes(nonce, sizeof(nonce));
+    EVP_EncodeBlock((unsigned char *)wc->ws_key, nonce, sizeof(nonce));
+
+    // IPv6 literal addresses must be enclosed in square brackets in the Host header
+    if (strchr(wc->config.host, ':') != NULL)
+    {
+        USP_SNPRINTF(host_buf, sizeof(host_buf), "[%s]", wc->config.host);
+    }
+    else
+    {
+        USP_STRNCPY(host_buf, wc->config.host, sizeof(host_buf));
+    }
+
+    // The request URI must be absolute
+    path = wc->config.path;
+    #define WS_HANDSHAKE_FORMAT "GET %s%s HTTP/1.1\r\n" \
+                                "Host: %s:%d\r\n" \
+                                "Upgrade: websocket\r\n" \
+                                "Connection: Upgrade\r\n" \
+                                "Sec-WebSocket-Key: %s\r\n" \
+                                "Sec-WebSocket-Version: 13\r\n" \
+                                "Sec-WebSocket-Protocol: " WEBSOCKET_SUBPROTOCOL "\r\n" \
+                                "Sec-WebSocket-Extensions: " WS_DEFLATE_OFFER "\r\n" \
+                                "\r\n"
+    len = strlen(WS_HANDSHAKE_FORMAT) + strlen(path) + strlen(host_buf) + strlen(wc->ws_key) + 16;
+    wc->handshake = USP_MALLOC(len);
+    wc->handshake_len = USP_SNPRINTF(wc->handshake, len, WS_HANDSHAKE_FORMAT, (*path == '/') ? "" : "/", path, host_buf, wc->config.port, wc->ws_key);
+    wc->handshake_sent = 0;
+    wc->is_deflate_negotiated = false;
+
+    USP_PROTOCOL("%s: Sending WebSocket upgrade request to (host=%s, port=%d)\n%s", __FUNCTION__, wc->config.host, wc->config.port, wc->handshake);
+
+    wc->state = kWsState_SendingHandshake;
+    wc->state_timeout = time(NULL) + WSCLIENT_HANDSHAKE_TIMEOUT;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** SendWsHandshake
+**
+** Sends (the rest of) the HTTP upgrade request
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void SendWsHandshake(wsclient_t *wc)
+{
+    struct iovec iov;
+    int num_bytes;
+
+    iov.iov_base = &wc->handshake[wc->handshake_sent];
+    iov.iov_len = wc->handshake_len - wc->handshake_sent;
+    num_bytes = WsWritev(wc, &iov, 1);
+
+    // Exit if nothing could be sent yet
+    if (num_bytes == WS_IO_PENDING)
+    {
+        return;
+    }
+
+    // Exit if an error occurred
+    if (num_bytes <= 0)
+    {
+        HandleWsClientError(wc, "Unable to send WebSocket upgrade request");
+        return;
+    }
+
+    // Exit if the request has not been sent entirely
+    wc->handshake_sent += num_bytes;
+    if (wc->handshake_sent < wc->handshake_len)
+    {
+        return;
+    }
+
+    // The request has been sent, so wait for the response
+    USP_FREE(wc->handshake);
+    wc->handshake = NULL;
+    wc->state = kWsState_AwaitingHandshake;
+}
+
+/*********************************************************************//**
+**
+** ReceiveWsHandshakeResponse
+**
+** Reads the HTTP response to the upgrade request, and if it is complete, validates it
+** On success the connection moves to kWsState_Running. Any frames received directly after the response are processed.
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void ReceiveWsHandshakeResponse(wsclient_t *wc)
+{
+    int err;
+    char response[MAX_WS_HANDSHAKE_RESPONSE+1];
+    char *end;
+    int response_len;
+    char buf[NU_IPADDRSTRLEN];
+
+    // Exit if unable to read from the connection
+    err = ReadIntoWsRxBuf(wc);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    // Exit if the end of the HTTP response header has not been received yet
+    // NOTE: The response is copied, so that it can be NULL terminated without overwriting any frames that follow it
+    response_len = MIN(wc->rx_len, MAX_WS_HANDSHAKE_RESPONSE);
+    memcpy(response, wc->rx_buf, response_len);
+    response[response_len] = '\0';
+    end = strstr(response, "\r\n\r\n");
+    if (end == NULL)
+    {
+        if (wc->rx_len >= MAX_WS_HANDSHAKE_RESPONSE)
+        {
+            HandleWsClientError(wc, "WebSocket upgrade response too long");
+        }
+        return;
+    }
+    end[2] = '\0';        // Terminate the response after the last header (including its CRLF)
+    response_len = (end - response) + 4;
+
+    USP_PROTOCOL("%s: Received WebSocket upgrade response from (host=%s, port=%d)\n%s", __FUNCTION__, wc->config.host, wc->config.port, response);
+
+    // Exit if the response did not accept the upgrade
+    err = ValidateWsHandshakeResponse(wc, response);
+    if (err != USP_ERR_OK)
+    {
+        HandleWsClientError(wc, "WebSocket upgrade rejected");
+        return;
+    }
+
+    // Remove the response from the receive buffer, leaving any frames which followed it
+    wc->rx_len -= response_len;
+    memmove(wc->rx_buf, &wc->rx_buf[response_len], wc->rx_len);
+
+    // The connection is now up
+    wc->state = kWsState_Running;
+    wc->retry_count = 0;
+    wc->last_rx_time = time(NULL);
+    DEVICE_MSG_STATS_RecordBootMilestone(kBootTime_FirstMtpConnected);
+    wc->ping_timeout = INVALID_TIME;
+    err = nu_ipaddr_get_interface_addr_from_sock_fd(wc->socket_fd, buf, sizeof(buf));
+    USP_LOG_Info("Connected to WebSocket server (host=%s, port=%d) from %s", wc->config.host, wc->config.port, (err == USP_ERR_OK) ? buf : "unknown address");
+
+    // Process any frames received with the response
+    ProcessWsRxBuffer(wc);
+}
+
+/*********************************************************************//**
+**
+** ValidateWsHandshakeResponse
+**
+** Validates the HTTP response to the upgrade request (RFC6455 section 4.1)
+**
+** \param   wc - pointer to WebSocket client
+** \param   response - NULL terminated HTTP response header
+**
+** \return  USP_ERR_OK if the server accepted the upgrade to a USP WebSocket connection
+**
+**************************************************************************/
+int ValidateWsHandshakeResponse(wsclient_t *wc, char *response)
+{
+    char value[128];
+    char expected_accept[64];
+    char *p;
+
+    // Exit if the status is not '101 Switching Protocols'
+    if ((strncmp(response, "HTTP/1.1 101", 12) != 0) || ((response[12] != ' ') && (response[12] != '\r')))
+    {
+        USP_LOG_Error("%s: WebSocket server (host=%s, port=%d) did not switch protocols", __FUNCTION__, wc->config.host, wc->config.port);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the Upgrade header is missing or incorrect
+    if ((GetHttpHeaderValue(response, "Upgrade", value, sizeof(value)) == false) || (strcasecmp(value, "websocket") != 0))
+    {
+        USP_LOG_Error("%s: Missing or incorrect Upgrade header", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the Connection header is missing or incorrect
+    // NOTE: The Connection header may contain a list of tokens, so is converted to lowercase before searching for the 'upgrade' token
+    if (GetHttpHeaderValue(response, "Connection", value, sizeof(value)) == false)
+    {
+        value[0] = '\0';
+    }
+
+    for (p = value; *p != '\0'; p++)
+    {
+        *p = tolower((unsigned char)*p);
+    }
+
+    if (strstr(value, "upgrade") == NULL)
+    {
+        USP_LOG_Error("%s: Missing or incorrect Connection header", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the server did not prove that it received our Sec-WebSocket-Key
+    CalcWsAcceptKey(wc->ws_key, expected_accept, sizeof(expected_accept));
+    if ((GetHttpHeaderValue(response, "Sec-WebSocket-Accept", value, sizeof(value)) == false) || (strcmp(value, expected_accept) != 0))
+    {
+        USP_LOG_Error("%s: Missing or incorrect Sec-WebSocket-Accept header", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the server did not select the USP sub-protocol
+    if ((GetHttpHeaderValue(response, "Sec-WebSocket-Protocol", value, sizeof(value)) == false) || (strcmp(value, WEBSOCKET_SUBPROTOCOL) != 0))
+    {
+        USP_LOG_Error("%s: WebSocket server did not select the '%s' sub-protocol", __FUNCTION__, WEBSOCKET_SUBPROTOCOL);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Exit if the server selected an extension which was not offered
+    if (GetHttpHeaderValue(response, "Sec-WebSocket-Extensions", value, sizeof(value)) == true)
+    {
+        return ValidateWsExtensions(wc, value);
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ValidateWsExtensions
+**
+** Validates the extensions selected by the server in the response to the upgrade request
+** Only the permessage-deflate extension is offered, so only it may be selected (RFC7692 section 7.1)
+**
+** \param   wc - pointer to WebSocket client
+** \param   extensions - value of the Sec-WebSocket-Extensions header in the response. NOTE: This buffer is modified by this function
+**
+** \return  USP_ERR_OK if the server selected the permessage-deflate extension with acceptable parameters
+**
+**************************************************************************/
+int ValidateWsExtensions(wsclient_t *wc, char *extensions)
+{
+    char *param;
+    char *saveptr;
+    bool is_server_no_context_takeover = false;
+
+    // Exit if the server selected an extension other than permessage-deflate (or selected more than one extension)
+    param = strtok_r(extensions, ";", &saveptr);
+    param = (param != NULL) ? TEXT_UTILS_TrimBuffer(param) : "";
+    if ((strcmp(param, WS_DEFLATE_EXTENSION) != 0) || (strchr(saveptr, ',') != NULL))
+    {
+        USP_LOG_Error("%s: WebSocket server selected an extension which was not offered (%s)", __FUNCTION__, param);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    // Check the parameters of the extension
+    param = strtok_r(NULL, ";", &saveptr);
+    while (param != NULL)
+    {
+        param = TEXT_UTILS_TrimBuffer(param);
+        if (strcmp(param, "server_no_context_takeover") == 0)
+        {
+            is_server_no_context_takeover = true;
+        }
+        else if ((strcmp(param, "client_no_context_takeover") != 0) && (strncmp(param, "server_max_window_bits", 22) != 0))
+        {
+            // NOTE: client_max_window_bits is rejected, as it was not offered. server_max_window_bits is accepted, as any window size can be decompressed
+            USP_LOG_Error("%s: WebSocket server selected an unsupported %s parameter (%s)", __FUNCTION__, WS_DEFLATE_EXTENSION, param);
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        param = strtok_r(NULL, ";", &saveptr);
+    }
+
+    // Exit if the server did not agree to compress each message independently
+    if (is_server_no_context_takeover == false)
+    {
+        USP_LOG_Error("%s: WebSocket server did not accept server_no_context_takeover", __FUNCTION__);
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    wc->is_deflate_negotiated = true;
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** GetHttpHeaderValue
+**
+** Gets the value of the specified header from an HTTP response
+** NOTE: Header names are matched case insensitively, and leading and trailing whitespace is removed from the value
+**
+** \param   response - NULL terminated HTTP response header, with lines separated by CRLF
+** \param   name - name of header to find (without the trailing ':')
+** \param   buf - buffer in which to return the value of the header
+** \param   len - length of buffer in which to return the value of the header
+**
+** \return  true if the header was present
+**
+**************************************************************************/
+bool GetHttpHeaderValue(char *response, char *name, char *buf, int len)
+{
+    char *line;
+    char *value;
+    char *end;
+    int name_len;
+    int value_len;
+
+    name_len = strlen(name);
+    line = strstr(response, "\r\n");    // Skip the status line
+    while ((line != NULL) && (line[2] != '\0'))
+    {
+        line += 2;
+        end = strstr(line, "\r\n");
+        if (end == NULL)
+        {
+            end = line + strlen(line);
+        }
+
+        if ((strncasecmp(line, name, name_len) == 0) && (line[name_len] == ':'))
+        {
+            // Trim leading and trailing whitespace from the value, then copy it into the return buffer
+            value = &line[name_len+1];
+            while ((value < end) && ((*value == ' ') || (*value == '\t')))
+            {
+                value++;
+            }
+
+            while ((end > value) && ((end[-1] == ' ') || (end[-1] == '\t')))
+            {
+                end--;
+            }
+
+            value_len = MIN(end - value, len-1);
+            memcpy(buf, value, value_len);
+            buf[value_len] = '\0';
+            return true;
+        }
+
+        line = strstr(line, "\r\n");
+    }
+
+    return false;
+}
+
+/*********************************************************************//**
+**
+** CalcWsAcceptKey
+**
+** Calculates the expected value of the Sec-WebSocket-Accept header in the response to our upgrade request
+**
+** \param   ws_key - Base64 encoded Sec-WebSocket-Key sent in the upgrade request
+** \param   buf - buffer in which to return the expected value of Sec-WebSocket-Accept
+** \param   len - length of buffer in which to return the expected value (at least 29 bytes)
+**
+** \return  None
+**
+**************************************************************************/
+void CalcWsAcceptKey(char *ws_key, char *buf, int len)
+{
+    char concat[64];
+    unsigned char digest[SHA_DIGEST_LENGTH];
+
+    USP_ASSERT(len > 4*((SHA_DIGEST_LENGTH+2)/3));
+    USP_SNPRINTF(concat, sizeof(concat), "%s%s", ws_key, WEBSOCKET_GUID);
+    SHA1((unsigned char *)concat, strlen(concat), digest);
+    EVP_EncodeBlock((unsigned char *)buf, digest, sizeof(digest));
+}
+
+/*********************************************************************//**
+**
+** ReceiveWsFrames
+**
+** Reads from the WebSocket connection, and processes all complete frames received
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void ReceiveWsFrames(wsclient_t *wc)
+{
+    int err;
+
+    err = ReadIntoWsRxBuf(wc);
+    if (err != USP_ERR_OK)
+    {
+        return;
+    }
+
+    ProcessWsRxBuffer(wc);
+}
+
+/*********************************************************************//**
+**
+** ReadIntoWsRxBuf
+**
+** Reads all available bytes from the connection into the end of the receive buffer
+** The receive buffer grows as needed, to hold the largest frame received
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  USP_ERR_OK if successful (even if no bytes could be read yet), otherwise the connection has been closed
+**
+**************************************************************************/
+int ReadIntoWsRxBuf(wsclient_t *wc)
+{
+    int num_bytes;
+    int needed;
+    int new_size;
+    int ssl_err;
+    bool is_more;
+
+    #define WS_RX_MIN_SPACE  (WSCLIENT_RX_BUF_SIZE/4)  // Minimum space to make available at the end of the receive buffer for each read
+    do
+    {
+        // Ensure that there is space at the end of the receive buffer, large enough for the current frame (if known)
+        needed = MAX(wc->rx_len + WS_RX_MIN_SPACE, wc->rx_frame_len);
+        if (needed > wc->rx_buf_size)
+        {
+            new_size = MAX(needed, (wc->rx_buf_size == 0) ? WSCLIENT_RX_BUF_SIZE : 2*wc->rx_buf_size);
+            wc->rx_buf = USP_REALLOC(wc->rx_buf, new_size);
+            wc->rx_buf_size = new_size;
+        }
+
+        // Read from the socket (or SSL)
+        is_more = false;
+        if (wc->ssl == NULL)
+        {
+            num_bytes = recv(wc->socket_fd, &wc->rx_buf[wc->rx_len], wc->rx_buf_size - wc->rx_len, 0);
+            if ((num_bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            {
+                return USP_ERR_OK;
+            }
+        }
+        else
+        {
+            num_bytes = SSL_read(wc->ssl, &wc->rx_buf[wc->rx_len], wc->rx_buf_size - wc->rx_len);
+            if (num_bytes <= 0)
+            {
+                // Exit if a renegotiation is in progress - we let the select drive this
+                ssl_err = SSL_get_error(wc->ssl, num_bytes);
+                if ((ssl_err == SSL_ERROR_WANT_READ) || (ssl_err == SSL_ERROR_WANT_WRITE))
+                {
+                    return USP_ERR_OK;
+                }
+            }
+            else
+            {
+                // OpenSSL may have consumed more bytes from the socket than we have read, so keep reading until they have all been read
+                is_more = (SSL_pending(wc->ssl) > 0);
+            }
+        }
+
+        // Exit if the controller has disconnected or an error occurred
+        if (num_bytes <= 0)
+        {
+            HandleWsClientError(wc, (num_bytes == 0) ? "WebSocket server disconnected" : "Read error");
+            return USP_ERR_INTERNAL_ERROR;
+        }
+
+        wc->rx_len += num_bytes;
+        wc->last_rx_time = time(NULL);
+        wc->ping_timeout = INVALID_TIME;      // Any data received shows that the connection is still alive
+    }
+    while (is_more);
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** ProcessWsRxBuffer
+**
+** Parses and handles all complete frames in the receive buffer (RFC6455 section 5.2)
+** Frames are handled in place, then removed from the receive buffer
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void ProcessWsRxBuffer(wsclient_t *wc)
+{
+    int offset = 0;
+    int avail;
+    unsigned char *p;
+    bool fin;
+    int opcode;
+    bool is_masked;
+    int hdr_len;
+    unsigned long long payload_len;
+    unsigned char *payload;
+    int err;
+
+    wc->rx_frame_len = 0;
+    while (wc->state == kWsState_Running)
+    {
+        // Exit if the fixed part of the frame header has not been received yet
+        avail = wc->rx_len - offset;
+        p = &wc->rx_buf[offset];
+        if (avail < 2)
+        {
+            break;
+        }
+
+        // Exit if any reserved bits are set (RSV1 is allowed if permessage-deflate has been negotiated)
+        if ((p[0] & ((wc->is_deflate_negotiated) ? 0x30 : 0x70)) != 0)
+        {
+            QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+            HandleWsClientError(wc, "Received frame with reserved bits set");
+            return;
+        }
+
+        fin = (p[0] & 0x80) ? true : false;
+        opcode = p[0] & 0x0F;
+        is_masked = (p[1] & 0x80) ? true : false;
+        payload_len = p[1] & 0x7F;
+        hdr_len = 2;
+
+        // Determine the length of the payload from the extended payload length (if present)
+        if (payload_len == 126)
+        {
+            hdr_len = 4;
+            if (avail < hdr_len)
+            {
+                break;
+            }
+            payload_len = (p[2] << 8) | p[3];
+        }
+        else if (payload_len == 127)
+        {
+            hdr_len = 10;
+            if (avail < hdr_len)
+            {
+                break;
+            }
+            payload_len = ((unsigned long long)p[2] << 56) | ((unsigned long long)p[3] << 48) |
+                          ((unsigned long long)p[4] << 40) | ((unsigned long long)p[5] << 32) |
+                          ((unsigned long long)p[6] << 24) | ((unsigned long long)p[7] << 16) |
+                          ((unsigned long long)p[8] << 8)  | (unsigned long long)p[9];
+        }
+
+        // Exit if the server masked the frame (RFC6455 section 5.1 requires the client to close the connection)
+        if (is_masked)
+        {
+            QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+            HandleWsClientError(wc, "Received masked frame");
+            return;
+        }
+
+        // Prevent rogue controllers from crashing agent by setting an arbitrary message size limit
+        if (payload_len > MAX_USP_MSG_LEN)
+        {
+            USP_LOG_Error("%s: WebSocket server (host=%s, port=%d) sent a frame >%d bytes long", __FUNCTION__, wc->config.host, wc->config.port, MAX_USP_MSG_LEN);
+            QueueWsCloseFrame(wc, WS_CLOSE_MESSAGE_TOO_BIG);
+            HandleWsClientError(wc, "Received frame too long");
+            return;
+        }
+
+        // Exit if the whole frame has not been received yet, noting its length, so that the receive buffer can be sized to hold it
+        if (avail < hdr_len + (int)payload_len)
+        {
+            wc->rx_frame_len = hdr_len + (int)payload_len;
+            break;
+        }
+
+        // Handle the frame
+        payload = &p[hdr_len];
+        offset += hdr_len + (int)payload_len;
+        err = HandleWsFrame(wc, opcode, fin, (p[0] & WS_FRAME_RSV1) ? true : false, payload, (int)payload_len);
+        if (err != USP_ERR_OK)
+        {
+            return;
+        }
+    }
+
+    // Remove all handled frames from the receive buffer
+    if ((wc->state == kWsState_Running) && (offset > 0))
+    {
+        wc->rx_len -= offset;
+        memmove(wc->rx_buf, &wc->rx_buf[offset], wc->rx_len);
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleWsFrame
+**
+** Handles a complete frame received from the controller
+**
+** \param   wc - pointer to WebSocket client
+** \param   opcode - opcode of the frame
+** \param   fin - set if this is the final fragment of a message
+** \param   is_deflated - set if the RSV1 bit of the frame was set (denoting a compressed message, if in the first frame of a data message)
+** \param   payload - pointer to payload of the frame (in the receive buffer)
+** \param   payload_len - length of the payload of the frame
+**
+** \return  USP_ERR_OK if the connection is still up
+**
+**************************************************************************/
+int HandleWsFrame(wsclient_t *wc, int opcode, bool fin, bool is_deflated, unsigned char *payload, int payload_len)
+{
+    unsigned status_code;
+
+    // Exit if a control frame was fragmented or too long (RFC6455 section 5.5), or was marked as compressed (RFC7692 section 6.1)
+    if ((opcode & 0x8) && ((fin == false) || (payload_len > MAX_WS_CONTROL_PAYLOAD) || (is_deflated)))
+    {
+        QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+        HandleWsClientError(wc, "Received invalid control frame");
+        return USP_ERR_INTERNAL_ERROR;
+    }
+
+    switch(opcode)
+    {
+        case WS_OPCODE_BINARY:
+            // Exit if the previous fragmented USP record has not been completed
+            if (wc->rx_msg != NULL)
+            {
+                QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+                HandleWsClientError(wc, "Received new message before end of fragmented message");
+                return USP_ERR_INTERNAL_ERROR;
+            }
+
+            // Handle the common case of an unfragmented USP record directly from the receive buffer
+            if (fin)
+            {
+                PostWsUspRecord(wc, payload, payload_len, is_deflated);
+                break;
+            }
+
+            // Otherwise start reassembling the fragmented USP record
+            wc->rx_msg = USP_MALLOC(MAX(payload_len, 1));
+            memcpy(wc->rx_msg, payload, payload_len);
+            wc->rx_msg_len = payload_len;
+            wc->rx_msg_is_deflated = is_deflated;
+            break;
+
+        case WS_OPCODE_CONTINUATION:
+            // Exit if there is no fragmented USP record to continue, or the continuation frame was marked as compressed (RFC7692 section 6.1)
+            if ((wc->rx_msg == NULL) || (is_deflated))
+            {
+                QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+                HandleWsClientError(wc, "Received unexpected continuation frame");
+                return USP_ERR_INTERNAL_ERROR;
+            }
+
+            // Exit if the reassembled USP record would be too long
+            if (wc->rx_msg_len + payload_len > MAX_USP_MSG_LEN)
+            {
+                QueueWsCloseFrame(wc, WS_CLOSE_MESSAGE_TOO_BIG);
+                HandleWsClientError(wc, "Received fragmented message too long");
+                return USP_ERR_INTERNAL_ERROR;
+            }
+
+            // Append this fragment
+            wc->rx_msg = USP_REALLOC(wc->rx_msg, MAX(wc->rx_msg_len + payload_len, 1));
+            memcpy(&wc->rx_msg[wc->rx_msg_len], payload, payload_len);
+            wc->rx_msg_len += payload_len;
+
+            // Post the USP record, if this was the final fragment
+            if (fin)
+            {
+                PostWsUspRecord(wc, wc->rx_msg, wc->rx_msg_len, wc->rx_msg_is_deflated);
+                USP_FREE(wc->rx_msg);
+                wc->rx_msg = NULL;
+                wc->rx_msg_len = 0;
+            }
+            break;
+
+        case WS_OPCODE_TEXT:
+            // USP records are always carried in binary frames (TR-369 WebSocket binding)
+            QueueWsCloseFrame(wc, WS_CLOSE_UNSUPPORTED_DATA);
+            HandleWsClientError(wc, "Received text frame");
+            return USP_ERR_INTERNAL_ERROR;
+            break;
+
+        case WS_OPCODE_PING:
+            // Respond with a Pong containing the same payload
+            QueueWsControlFrame(wc, WS_OPCODE_PONG, payload, payload_len);
+            break;
+
+        case WS_OPCODE_PONG:
+            // Nothing to do. Receiving the Pong has already cleared the keep alive timeout
+            break;
+
+        case WS_OPCODE_CLOSE:
+            // Echo the status code back to the controller, then reconnect
+            status_code = (payload_len >= 2) ? (unsigned)((payload[0] << 8) | payload[1]) : WS_CLOSE_NORMAL;
+            USP_LOG_Warning("%s: WebSocket server (host=%s, port=%d) closed the connection (status=%u)", __FUNCTION__, wc->config.host, wc->config.port, status_code);
+            QueueWsCloseFrame(wc, status_code);
+            HandleWsClientError(wc, "Connection closed by WebSocket server");
+            return USP_ERR_INTERNAL_ERROR;
+            break;
+
+        default:
+            QueueWsCloseFrame(wc, WS_CLOSE_PROTOCOL_ERROR);
+            HandleWsClientError(wc, "Received frame with unknown opcode");
+            return USP_ERR_INTERNAL_ERROR;
+            break;
+    }
+
+    return USP_ERR_OK;
+}
+
+/*********************************************************************//**
+**
+** PostWsUspRecord
+**
+** Sends a USP record received from the controller to the data model thread for processing
+**
+** \param   wc - pointer to WebSocket client
+** \param   pbuf - pointer to buffer containing the USP record
+** \param   pbuf_len - length of the USP record
+** \param   is_deflated - set if the USP record is compressed (permessage-deflate)
+**
+** \return  None
+**
+**************************************************************************/
+void PostWsUspRecord(wsclient_t *wc, unsigned char *pbuf, int pbuf_len, bool is_deflated)
+{
+    mtp_reply_to_t mtp_reply_to = {0};
+    char time_buf[MAX_ISO8601_LEN];
+    unsigned char *inflated = NULL;
+    int inflated_len;
+    int err;
+
+    // Ignore empty frames
+    if (pbuf_len == 0)
+    {
+        USP_LOG_Warning("%s: Ignoring empty binary frame from WebSocket server (host=%s, port=%d)", __FUNCTION__, wc->config.host, wc->config.port);
+        return;
+    }
+
+    // Exit if unable to decompress the USP record
+    if (is_deflated)
+    {
+        err = USP_COMPRESS_Inflate(pbuf, pbuf_len, true, &inflated, &inflated_len);
+        if (err != USP_ERR_OK)
+        {
+            USP_LOG_Error("%s: Ignoring message from WebSocket server (host=%s, port=%d) which could not be decompressed: %s", __FUNCTION__, wc->config.host, wc->config.port, USP_ERR_GetMessage());
+            return;
+        }
+        pbuf = inflated;
+        pbuf_len = inflated_len;
+    }
+
+    iso8601_cur_time(time_buf, sizeof(time_buf));
+    USP_LOG_Info("Message received at time %s, from host %s over WebSocket", time_buf, wc->config.host);
+
+    // Responses are always sent back over this controller's WebSocket connection, so no reply-to is specified
+    mtp_reply_to.protocol = kMtpProtocol_WebSockets;
+    DM_EXEC_PostUspRecord(pbuf, pbuf_len, wc->role, wc->allowed_controllers, &mtp_reply_to);
+    USP_SAFE_FREE(inflated);
+}
+
+/*********************************************************************//**
+**
+** QueueWsControlFrame
+**
+** Queues a control frame to send to the controller
+** Control frames are sent in preference to USP records, but only between frames carrying USP records
+** NOTE: If a control frame is already partially sent, then the new control frame is dropped. This is allowed for Pongs
+**       (RFC6455 section 5.5.3 only requires a Pong to the most recent Ping), and a Ping will be resent if needed
+**
+** \param   wc - pointer to WebSocket client
+** \param   opcode - opcode of the control frame
+** \param   payload - pointer to payload of the control frame
+** \param   payload_len - length of the payload of the control frame (at most MAX_WS_CONTROL_PAYLOAD)
+**
+** \return  None
+**
+**************************************************************************/
+void QueueWsControlFrame(wsclient_t *wc, int opcode, unsigned char *payload, int payload_len)
+{
+    unsigned char mask[4];
+    int hdr_len;
+
+    USP_ASSERT(payload_len <= MAX_WS_CONTROL_PAYLOAD);
+
+    // Exit if a control frame is already being sent
+    if ((wc->ctrl_frame_len != 0) && (wc->ctrl_sent != 0))
+    {
+        return;
+    }
+
+    // Form the (masked) control frame
+    GenerateWsRandomBytes(mask, sizeof(mask));
+    hdr_len = WriteWsFrameHeader(wc->ctrl_frame, opcode, payload_len, mask);
+    memcpy(&wc->ctrl_frame[hdr_len], payload, payload_len);
+    MaskWsPayload(&wc->ctrl_frame[hdr_len], payload_len, mask);
+    wc->ctrl_frame_len = hdr_len + payload_len;
+    wc->ctrl_sent = 0;
+}
+
+/*********************************************************************//**
+**
+** QueueWsCloseFrame
+**
+** Queues a Close frame to send to the controller, and attempts to send it immediately
+** NOTE: This is called before closing the connection, so sending is best effort only
+**
+** \param   wc - pointer to WebSocket client
+** \param   status_code - status code to send in the Close frame
+**
+** \return  None
+**
+**************************************************************************/
+void QueueWsCloseFrame(wsclient_t *wc, unsigned status_code)
+{
+    unsigned char payload[2];
+    struct iovec iov;
+
+    STORE_2_BYTES(payload, status_code);
+    wc->ctrl_frame_len = 0;     // The Close frame replaces any other control frame waiting to be sent
+    QueueWsControlFrame(wc, WS_OPCODE_CLOSE, payload, sizeof(payload));
+
+    // Exit if the Close frame cannot be sent now, because it would corrupt a partially sent frame
+    if ((wc->ctrl_frame_len == 0) || (wc->ctrl_sent != 0) || (wc->tx_sent != 0))
+    {
+        return;
+    }
+
+    iov.iov_base = wc->ctrl_frame;
+    iov.iov_len = wc->ctrl_frame_len;
+    (void)WsWritev(wc, &iov, 1);
+}
+
+/*********************************************************************//**
+**
+** TransmitWsFrames
+**
+** Sends queued control frames and USP records, until the socket cannot accept any more data
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. If an error occurred, the connection will be retried later
+**
+**************************************************************************/
+void TransmitWsFrames(wsclient_t *wc)
+{
+    struct iovec iov[2];
+    int iovcnt;
+    int num_bytes;
+    int frame_len;
+    bool is_ctrl;
+
+    while (wc->state == kWsState_Running)
+    {
+        // Determine what to send next. Control frames go first, unless a frame carrying a USP record has already been partially sent
+        iovcnt = 0;
+        is_ctrl = ((wc->ctrl_frame_len != 0) && (wc->tx_sent == 0));
+        if (is_ctrl)
+        {
+            iov[0].iov_base = &wc->ctrl_frame[wc->ctrl_sent];
+            iov[0].iov_len = wc->ctrl_frame_len - wc->ctrl_sent;
+            iovcnt = 1;
+        }
+        else
+        {
+            // Exit if there are no more USP records to send
+            if (wc->cur_msg == NULL)
+            {
+                StartNextWsUspRecord(wc);
+                if (wc->cur_msg == NULL)
+                {
+                    return;
+                }
+            }
+            else if (wc->tx_hdr_len == 0)
+            {
+                // USP record was being sent when the connection was lost, so send it again from the start
+                StartWsUspRecordFrame(wc);
+            }
+
+            // Send the rest of the frame header, then the rest of the (masked in place) USP record
+            if (wc->tx_sent < wc->tx_hdr_len)
+            {
+                iov[iovcnt].iov_base = &wc->tx_hdr[wc->tx_sent];
+                iov[iovcnt].iov_len = wc->tx_hdr_len - wc->tx_sent;
+                iovcnt++;
+                iov[iovcnt].iov_base = WS_TX_BODY(wc);
+                iov[iovcnt].iov_len = WS_TX_BODY_LEN(wc);
+                iovcnt++;
+            }
+            else
+            {
+                iov[iovcnt].iov_base = &WS_TX_BODY(wc)[wc->tx_sent - wc->tx_hdr_len];
+                iov[iovcnt].iov_len = WS_TX_BODY_LEN(wc) - (wc->tx_sent - wc->tx_hdr_len);
+                iovcnt++;
+            }
+        }
+
+        // Exit if nothing could be sent yet. The write will be retried when the socket is ready
+        num_bytes = WsWritev(wc, iov, iovcnt);
+        if (num_bytes == WS_IO_PENDING)
+        {
+            return;
+        }
+
+        // Exit if an error occurred
+        if (num_bytes <= 0)
+        {
+            HandleWsClientError(wc, (num_bytes == 0) ? "WebSocket server disconnected" : "Write error");
+            return;
+        }
+
+        USP_PROBE3(mtp_write, kMtpProtocol_WebSockets, wc->config.host, num_bytes);
+
+        // Exit if the control frame has not been sent entirely
+        if (is_ctrl)
+        {
+            wc->ctrl_sent += num_bytes;
+            if (wc->ctrl_sent < wc->ctrl_frame_len)
+            {
+                return;
+            }
+            wc->ctrl_frame_len = 0;
+            wc->ctrl_sent = 0;
+            continue;
+        }
+
+        // Exit if the frame carrying the USP record has not been sent entirely
+        wc->tx_sent += num_bytes;
+        frame_len = wc->tx_hdr_len + WS_TX_BODY_LEN(wc);
+        if (wc->tx_sent < frame_len)
+        {
+            return;
+        }
+
+        // The USP record has been sent, so free it
+        DEVICE_MSG_STATS_Record(wc->cur_msg->usp_msg_type, kMsgStat_WireSend, wc->cur_msg->send_start_time);
+        FreeWsSendItem(wc->cur_msg);
+        wc->cur_msg = NULL;
+        USP_SAFE_FREE(wc->tx_deflated);
+        wc->tx_hdr_len = 0;
+        wc->tx_sent = 0;
+    }
+}
+
+/*********************************************************************//**
+**
+** StartNextWsUspRecord
+**
+** Selects the next USP record to send (in send priority order), and starts sending it
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None. wc->cur_msg is left as NULL if there are no USP records to send
+**
+**************************************************************************/
+void StartNextWsUspRecord(wsclient_t *wc)
+{
+    ws_send_item_t *wsi;
+    time_t cur_time;
+
+    USP_ASSERT(wc->cur_msg == NULL);
+
+    // Skip USP records which have expired whilst queued
+    cur_time = time(NULL);
+    wsi = (ws_send_item_t *) MTP_SEND_QUEUE_Pop(&wc->send_queue);
+    while ((wsi != NULL) && (cur_time > wsi->expiry_time))
+    {
+        FreeWsSendItem(wsi);
+        wsi = (ws_send_item_t *) MTP_SEND_QUEUE_Pop(&wc->send_queue);
+    }
+
+    // Exit if no more USP records to send
+    if (wsi == NULL)
+    {
+        return;
+    }
+
+    // Log the USP record (before it is masked), and record how long it was queued for
+    MSG_HANDLER_LogMessageToSend(wsi->usp_msg_type, wsi->pbuf, wsi->pbuf_len, kMtpProtocol_WebSockets, wc->config.host, NULL, kMtpContentType_UspRecord);
+    wsi->send_start_time = tu_uptime_usecs();
+    DEVICE_MSG_STATS_RecordDuration(wsi->usp_msg_type, kMsgStat_SendQueueWait,
+                                    (wsi->send_start_time > wsi->queued_time) ? wsi->send_start_time - wsi->queued_time : 0);
+
+    wc->cur_msg = wsi;
+    StartWsUspRecordFrame(wc);
+}
+
+/*********************************************************************//**
+**
+** StartWsUspRecordFrame
+**
+** Forms the header of the binary frame carrying the current USP record, and masks the USP record in place
+** This avoids copying the USP record into a separate frame buffer
+** If permessage-deflate has been negotiated, large USP records are compressed, and the compressed copy is sent (and masked) instead
+** NOTE: If the connection is lost before the frame has been sent, the USP record is unmasked again (see CloseWsClientSocket)
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None
+**
+**************************************************************************/
+void StartWsUspRecordFrame(wsclient_t *wc)
+{
+    unsigned char mask[4];
+    int opcode = WS_OPCODE_BINARY;
+    int err;
+
+    // Compress the USP record, if it is large enough
+    // NOTE: If the USP record does not compress, then it is sent uncompressed
+    USP_ASSERT(wc->tx_deflated == NULL);
+    if ((wc->is_deflate_negotiated) && (USP_COMPRESSION_THRESHOLD > 0) && (wc->cur_msg->pbuf_len >= USP_COMPRESSION_THRESHOLD))
+    {
+        err = USP_COMPRESS_Deflate(wc->cur_msg->pbuf, wc->cur_msg->pbuf_len, true, &wc->tx_deflated, &wc->tx_deflated_len);
+        if (err == USP_ERR_OK)
+        {
+            opcode |= WS_FRAME_RSV1;
+            USP_LOG_Debug("%s: Compressed %s (%d bytes) to %d bytes", __FUNCTION__, MSG_HANDLER_UspMsgTypeToString(wc->cur_msg->usp_msg_type), wc->cur_msg->pbuf_len, wc->tx_deflated_len);
+        }
+        else
+        {
+            wc->tx_deflated = NULL;
+        }
+    }
+
+    GenerateWsRandomBytes(mask, sizeof(mask));
+    wc->tx_hdr_len = WriteWsFrameHeader(wc->tx_hdr, opcode, WS_TX_BODY_LEN(wc), mask);
+    MaskWsPayload(WS_TX_BODY(wc), WS_TX_BODY_LEN(wc), mask);
+    wc->tx_sent = 0;
+}
+
+/*********************************************************************//**
+**
+** WriteWsFrameHeader
+**
+** Writes the header of an unfragmented, masked frame (RFC6455 section 5.2)
+**
+** \param   buf - buffer in which to write the frame header (at least MAX_WS_FRAME_HEADER_SIZE bytes)
+** \param   opcode - opcode of the frame (ORed with WS_FRAME_RSV1 if the frame carries a compressed message)
+** \param   payload_len - length of the payload of the frame
+** \param   mask - 4 byte masking key
+**
+** \return  Number of bytes written
+**
+**************************************************************************/
+int WriteWsFrameHeader(unsigned char *buf, int opcode, int payload_len, unsigned char *mask)
+{
+    unsigned char *p = buf;
+
+    WRITE_BYTE(p, (0x80 | opcode));       // FIN bit set
+    if (payload_len < 126)
+    {
+        WRITE_BYTE(p, (0x80 | payload_len));      // MASK bit set
+    }
+    else if (payload_len <= 0xFFFF)
+    {
+        WRITE_BYTE(p, (0x80 | 126));
+        WRITE_2_BYTES(p, payload_len);
+    }
+    else
+    {
+        WRITE_BYTE(p, (0x80 | 127));
+        WRITE_4_BYTES(p, 0);
+        WRITE_4_BYTES(p, payload_len);
+    }
+
+    WRITE_N_BYTES(p, mask, 4);
+
+    return p - buf;
+}
+
+/*********************************************************************//**
+**
+** MaskWsPayload
+**
+** Masks (or unmasks) the payload of a frame in place (RFC6455 section 5.3)
+**
+** \param   buf - pointer to payload to mask
+** \param   len - length of payload to mask
+** \param   mask - 4 byte masking key
+**
+** \return  None
+**
+**************************************************************************/
+void MaskWsPayload(unsigned char *buf, int len, unsigned char *mask)
+{
+    int i;
+
+    for (i=0; i<len; i++)
+    {
+        buf[i] ^= mask[i & 3];
+    }
+}
+
+/*********************************************************************//**
+**
+** GenerateWsRandomBytes
+**
+** Generates random bytes for the masking key of a frame and the Sec-WebSocket-Key
+** RFC6455 requires these to be unpredictable, so OpenSSL's random number generator is used in preference
+**
+** \param   buf - buffer in which to return the random bytes
+** \param   len - number of random bytes to generate
+**
+** \return  None
+**
+**************************************************************************/
+void GenerateWsRandomBytes(unsigned char *buf, int len)
+{
+    int i;
+
+    if (RAND_bytes(buf, len) == 1)
+    {
+        return;
+    }
+
+    for (i=0; i<len; i++)
+    {
+        buf[i] = rand_r(&mtp_thread_random_seed) & 0xFF;
+    }
+}
+
+/*********************************************************************//**
+**
+** WsWritev
+**
+** Attempt to send the specified (scattered) data to the WebSocket server
+** This function never blocks. If an SSL_write() cannot complete (eg because an SSL renegotiation is in progress),
+** then the socket activity it is waiting for is recorded, and the caller must call this function again with the same data
+** NOTE: Unencrypted connections send all buffers in a single writev() call. OpenSSL has no gather write, so encrypted
+**       connections send only the first buffer, and the caller sends the rest on subsequent calls.
+**
+** \param   wc - pointer to WebSocket client
+** \param   iov - array of buffers containing the data to send, in order
+** \param   iovcnt - number of buffers in the array (must be at least 1)
+**
+** \return  >0  Number of bytes sent (which might be less than the number to attempt)
+**          0   indicates that the WebSocket server has disconnected
+**          WS_IO_PENDING indicates that nothing could be sent yet, and the write must be retried when the socket is ready
+**          <0  indicates that another error has occurred
+**
+**************************************************************************/
+int WsWritev(wsclient_t *wc, struct iovec *iov, int iovcnt)
+{
+    int num_bytes_sent;
+    int err;
+
+    // Perform a simple writev() if connection is not encrypted
+    if (wc->ssl == NULL)
+    {
+        num_bytes_sent = writev(wc->socket_fd, iov, iovcnt);
+        if ((num_bytes_sent == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            return WS_IO_PENDING;
+        }
+        return num_bytes_sent;
+    }
+
+    // Exit if the data was sent
+    num_bytes_sent = SSL_write(wc->ssl, iov[0].iov_base, iov[0].iov_len);
+    if (num_bytes_sent > 0)
+    {
+        wc->ssl_write_want = SSL_ERROR_NONE;
+        return num_bytes_sent;
+    }
+
+    // Exit if the SSL_write() needs to be retried once the socket is ready - this is needed if a renegotiation occurs
+    err = SSL_get_error(wc->ssl, num_bytes_sent);
+    if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
+    {
+        wc->ssl_write_want = err;
+        return WS_IO_PENDING;
+    }
+
+    // Otherwise an error occurred, or the WebSocket server has disconnected
+    USP_LOG_ErrorSSL(__FUNCTION__, "SSL_write() failed", num_bytes_sent, err);
+    wc->ssl_write_want = SSL_ERROR_NONE;
+    return (num_bytes_sent == 0) ? 0 : -1;
+}
+
+/*********************************************************************//**
+**
+** IsWsDataPendingToSend
+**
+** Determines whether there is a control frame or USP record waiting to be sent
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  true if there is something to send
+**
+**************************************************************************/
+bool IsWsDataPendingToSend(wsclient_t *wc)
+{
+    return ((wc->ctrl_frame_len != 0) || (wc->cur_msg != NULL) || (MTP_SEND_QUEUE_IsEmpty(&wc->send_queue)==false));
+}
+
+/*********************************************************************//**
+**
+** UpdateWsKeepAlive
+**
+** Sends a Ping if nothing has been received from the controller for the keep alive interval,
+** and fails the connection if nothing has been received in response to the Ping within a further keep alive interval
+**
+** \param   wc - pointer to WebSocket client
+** \param   cur_time - current time
+**
+** \return  None
+**
+**************************************************************************/
+void UpdateWsKeepAlive(wsclient_t *wc, time_t cur_time)
+{
+    // Exit if keep alives are disabled
+    if (wc->config.keep_alive_interval == 0)
+    {
+        wc->ping_timeout = INVALID_TIME;
+        return;
+    }
+
+    // Exit if the controller did not respond to our Ping in time
+    if (wc->ping_timeout != INVALID_TIME)
+    {
+        if (cur_time >= wc->ping_timeout)
+        {
+            HandleWsClientError(wc, "No response to WebSocket Ping");
+        }
+        return;
+    }
+
+    // Send a Ping, if nothing has been received for the keep alive interval
+    if (cur_time >= wc->last_rx_time + wc->config.keep_alive_interval)
+    {
+        QueueWsControlFrame(wc, WS_OPCODE_PING, NULL, 0);
+        wc->ping_timeout = cur_time + wc->config.keep_alive_interval;
+        TransmitWsFrames(wc);
+    }
+}
+
+/*********************************************************************//**
+**
+** HandleWsClientError
+**
+** Closes the connection after an error, and schedules a reconnect using the TR-369 retry algorithm
+** USP records queued to send are kept, and are sent after the connection has been re-established
+**
+** \param   wc - pointer to WebSocket client
+** \param   reason - textual description of the error (used only for debug)
+**
+** \return  None
+**
+**************************************************************************/
+void HandleWsClientError(wsclient_t *wc, char *reason)
+{
+    unsigned wait_time;
+
+    CloseWsClientSocket(wc);
+
+    wc->retry_count++;
+    wait_time = RETRY_WAIT_CalculateWithSeed(wc->retry_count, wc->config.retry_min_wait_interval, wc->config.retry_interval_multiplier, &mtp_thread_random_seed);
+    wc->state = kWsState_Retrying;
+    wc->retry_time = time(NULL) + wait_time;
+
+    USP_LOG_Error("%s: %s on WebSocket connection to (host=%s, port=%d). Retrying in %u seconds (retry_count=%u)", __FUNCTION__, reason, wc->config.host, wc->config.port, wait_time, wc->retry_count);
+}
+
+/*********************************************************************//**
+**
+** CloseWsClientSocket
+**
+** Closes the connection, freeing all state associated with it
+** The USP record being sent (if any) is unmasked and kept, so that it is sent again from the start on the next connection
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None
+**
+**************************************************************************/
+void CloseWsClientSocket(wsclient_t *wc)
+{
+    // Restore the USP record being sent to its unmasked state
+    // NOTE: If it was compressed, the compressed copy is discarded instead, as the next connection may not negotiate compression
+    if ((wc->cur_msg != NULL) && (wc->tx_hdr_len != 0) && (wc->tx_deflated == NULL))
+    {
+        MaskWsPayload(wc->cur_msg->pbuf, wc->cur_msg->pbuf_len, &wc->tx_hdr[wc->tx_hdr_len-4]);
+    }
+    USP_SAFE_FREE(wc->tx_deflated);
+    wc->tx_deflated_len = 0;
+    wc->tx_hdr_len = 0;
+    wc->tx_sent = 0;
+    wc->ctrl_frame_len = 0;
+    wc->ctrl_sent = 0;
+
+    // Free the SSL object
+    if (wc->ssl != NULL)
+    {
+        SSL_shutdown(wc->ssl);
+        SSL_free(wc->ssl);
+        wc->ssl = NULL;
+    }
+    wc->ssl_write_want = SSL_ERROR_NONE;
+
+    if (wc->cert_chain != NULL)
+    {
+        sk_X509_pop_free(wc->cert_chain, X509_free);
+        wc->cert_chain = NULL;
+    }
+    USP_SAFE_FREE(wc->allowed_controllers);
+
+    // Close the socket
+    if (wc->socket_fd != INVALID)
+    {
+        SOCKET_SET_ForgetSocket(wc->socket_fd);
+        close(wc->socket_fd);
+        wc->socket_fd = INVALID;
+    }
+
+    USP_SAFE_FREE(wc->handshake);
+    wc->handshake_len = 0;
+    wc->handshake_sent = 0;
+
+    ResetWsRxState(wc);
+    wc->ping_timeout = INVALID_TIME;
+}
+
+/*********************************************************************//**
+**
+** ResetWsRxState
+**
+** Discards all data received on the connection which has not been processed yet
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None
+**
+**************************************************************************/
+void ResetWsRxState(wsclient_t *wc)
+{
+    wc->rx_len = 0;
+    wc->rx_frame_len = 0;
+    USP_SAFE_FREE(wc->rx_msg);
+    wc->rx_msg_len = 0;
+    wc->rx_msg_is_deflated = false;
+}
+
+/*********************************************************************//**
+**
+** StopWsClient
+**
+** Closes the connection of the specified WebSocket client, frees all USP records queued on it, and marks the slot as unused
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None
+**
+**************************************************************************/
+void StopWsClient(wsclient_t *wc)
+{
+    ws_send_item_t *wsi;
+
+    CloseWsClientSocket(wc);
+
+    // Drain the queue of outstanding USP records to send
+    if (wc->cur_msg != NULL)
+    {
+        FreeWsSendItem(wc->cur_msg);
+    }
+
+    wsi = (ws_send_item_t *) MTP_SEND_QUEUE_Pop(&wc->send_queue);
+    while (wsi != NULL)
+    {
+        FreeWsSendItem(wsi);
+        wsi = (ws_send_item_t *) MTP_SEND_QUEUE_Pop(&wc->send_queue);
+    }
+
+    USP_SAFE_FREE(wc->rx_buf);
+    USP_SAFE_FREE(wc->endpoint_id);
+    FreeWsConfig(&wc->config);
+
+    // Put back to init state
+    memset(wc, 0, sizeof(wsclient_t));
+    wc->cont_instance = INVALID;
+    wc->socket_fd = INVALID;
+}
+
+/*********************************************************************//**
+**
+** CopyWsConfig
+**
+** Takes a deep copy of the configuration of a WebSocket client
+**
+** \param   dest - pointer to structure to copy into
+** \param   src - pointer to structure to copy from
+**
+** \return  None
+**
+**************************************************************************/
+void CopyWsConfig(wsclient_config_t *dest, wsclient_config_t *src)
+{
+    memcpy(dest, src, sizeof(wsclient_config_t));
+    dest->host = USP_STRDUP((src->host != NULL) ? src->host : "");
+    dest->path = USP_STRDUP((src->path != NULL) ? src->path : "");
+}
+
+/*********************************************************************//**
+**
+** FreeWsConfig
+**
+** Frees all memory owned by the configuration of a WebSocket client
+**
+** \param   config - pointer to configuration to free
+**
+** \return  None
+**
+**************************************************************************/
+void FreeWsConfig(wsclient_config_t *config)
+{
+    USP_SAFE_FREE(config->host);
+    USP_SAFE_FREE(config->path);
+}
+
+/*********************************************************************//**
+**
+** FindUnusedWsClient
+**
+** Finds an unused WebSocket client slot
+**
+** \param   None
+**
+** \return  pointer to free WebSocket client, or NULL if none found
+**
+**************************************************************************/
+wsclient_t *FindUnusedWsClient(void)
+{
+    int i;
+    wsclient_t *wc;
+
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if (wc->cont_instance == INVALID)
+        {
+            return wc;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** FindWsClientByInstance
+**
+** Finds a WebSocket client by the instance numbers of its controller MTP
+**
+** \param   cont_instance -  Instance number of the controller in Device.LocalAgent.Controller.{i}
+** \param   mtp_instance -   Instance number of this MTP in Device.LocalAgent.Controller.{i}.MTP.{i}
+**
+** \return  pointer to matching WebSocket client, or NULL if none found
+**
+**************************************************************************/
+wsclient_t *FindWsClientByInstance(int cont_instance, int mtp_instance)
+{
+    int i;
+    wsclient_t *wc;
+
+    for (i=0; i<MAX_WEBSOCKET_CLIENTS; i++)
+    {
+        wc = &wsclients[i];
+        if ((wc->cont_instance == cont_instance) && (wc->mtp_instance == mtp_instance))
+        {
+            return wc;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** RemoveExpiredWsMessages
+**
+** Removes all expired USP records from the queue of USP records to send
+** NOTE: This mechanism prevents the queue from filling up needlessly if the controller is offline
+**
+** \param   wc - pointer to WebSocket client
+**
+** \return  None
+**
+**************************************************************************/
+void RemoveExpiredWsMessages(wsclient_t *wc)
+{
+    int i;
+    time_t cur_time;
+    ws_send_item_t *wsi;
+    ws_send_item_t *next;
+
+    cur_time = time(NULL);
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        wsi = (ws_send_item_t *) wc->send_queue.queues[i].head;
+        while (wsi != NULL)
+        {
+            next = (ws_send_item_t *) wsi->link.next;
+            if (cur_time > wsi->expiry_time)
+            {
+                MTP_SEND_QUEUE_Remove(&wc->send_queue, wsi->priority, wsi);
+                FreeWsSendItem(wsi);
+            }
+            wsi = next;
+        }
+    }
+}
+
+/*********************************************************************//**
+**
+** FreeWsSendItem
+**
+** Frees the specified USP record (which must already have been removed from the send queue)
+**
+** \param   wsi - pointer to USP record to free
+**
+** \return  None
+**
+**************************************************************************/
+void FreeWsSendItem(ws_send_item_t *wsi)
+{
+    MTP_SEND_QUEUE_ReleaseBudget(wsi->pbuf_len);
+    USP_FREE(wsi->pbuf);
+    USP_FREE(wsi);
+}
+
+/*********************************************************************//**
+**
+** IsUspRecordInWsQueue
+**
+** Determines whether the specified USP record is already queued, waiting to be sent
+** This is used to avoid duplicate records being placed in the queue, which could occur under notification retry conditions
+** NOTE: The USP record currently being sent is not checked, as it may be masked
+**
+** \param   wc - pointer to WebSocket client
+** \param   pbuf - pointer to buffer containing USP Record to match against
+** \param   pbuf_len - length of buffer containing USP Record to match against
+** \param   digest - hash of the USP Record to match against (calculated by TEXT_UTILS_CalcBufferHash)
+**
+** \return  true if the USP record is already queued
+**
+**************************************************************************/
+bool IsUspRecordInWsQueue(wsclient_t *wc, unsigned char *pbuf, int pbuf_len, unsigned digest)
+{
+    int i;
+    ws_send_item_t *wsi;
+
+    for (i=0; i<kMtpSendPriority_Max; i++)
+    {
+        wsi = (ws_send_item_t *) wc->send_queue.queues[i].head;
+        while (wsi != NULL)
+        {
+            // NOTE: The digest is compared first, so that the full record only needs to be compared if it is very likely to match
+            if ((wsi->digest == digest) && (wsi->pbuf_len == pbuf_len) && (memcmp(wsi->pbuf, pbuf, pbuf_len)==0))
+            {
+                return true;
+            }
+
+            wsi = (ws_send_item_t *) wsi->link.next;
+        }
+    }
+
+    return false;
+}
+
+#endif // ENABLE_WEBSOCKETS
@@ -0,0 +1,93 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2016-2019  CommScope, Inc
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file wsclient.h
+ *
+ * Header file for WebSocket client connections to controllers
+ *
+ */
+#ifndef WSCLIENT_H
+#define WSCLIENT_H
+
+#ifdef ENABLE_WEBSOCKETS
+
+#include "common_defs.h"
+#include "socket_set.h"
+#include "usp-msg.pb-c.h"
+#include "device.h"             // for mtp_reply_to_t
+
+//------------------------------------------------------------------------------
+// Defines set by RFC6455 and the USP WebSocket binding (TR-369)
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"   // Appended to Sec-WebSocket-Key, to form Sec-WebSocket-Accept
+#define WEBSOCKET_SUBPROTOCOL "v1.usp"                          // Sec-WebSocket-Protocol used by USP
+#define MAX_WS_FRAME_HEADER_SIZE 14     // Maximum size of a WebSocket frame header (2 bytes + 8 bytes extended length + 4 bytes masking key)
+#define MAX_WS_CONTROL_PAYLOAD 125      // Maximum size of the payload of a WebSocket control frame (Ping, Pong, Close)
+
+//------------------------------------------------------------------------
+// Defines for this implementation (not set by any RFC)
+#define WSCLIENT_CONNECT_TIMEOUT    30  // Number of seconds allowed for the TCP connect to the controller to complete
+#define WSCLIENT_HANDSHAKE_TIMEOUT  30  // Number of seconds allowed for the controller to respond to the WebSocket upgrade request
+#define MAX_WS_HANDSHAKE_RESPONSE 4096  // Maximum size of the HTTP response to the WebSocket upgrade request
+#define WSCLIENT_RX_BUF_SIZE      4096  // Initial size of the buffer receiving WebSocket frames. It grows to hold the largest frame received
+
+//------------------------------------------------------------------------------
+// Structure containing the configuration of a WebSocket connection to a controller (Device.LocalAgent.Controller.{i}.MTP.{i}.WebSocket)
+typedef struct
+{
+    char *host;                         // Hostname or IP address of the controller's WebSocket server
+    unsigned port;                      // Port of the controller's WebSocket server
+    char *path;                         // Path of the USP endpoint on the controller's WebSocket server
+    bool enable_encryption;             // Set if the connection uses TLS (wss://)
+    unsigned keep_alive_interval;       // Number of seconds of inactivity on the connection before a WebSocket Ping is sent (0 disables Pings)
+    unsigned retry_min_wait_interval;   // Minimum number of seconds to wait before the first reconnect attempt
+    unsigned retry_interval_multiplier; // Multiplier (in thousandths) applied to the wait between successive reconnect attempts
+} wsclient_config_t;
+
+//------------------------------------------------------------------------------
+// API
+int WSCLIENT_Init(void);
+int WSCLIENT_Start(void);
+void WSCLIENT_Destroy(void);
+int WSCLIENT_StartClient(int cont_instance, int mtp_instance, char *endpoint_id, wsclient_config_t *config);
+void WSCLIENT_StopClient(int cont_instance, int mtp_instance);
+void WSCLIENT_UpdateConfig(int cont_instance, int mtp_instance, wsclient_config_t *config);
+unsigned WSCLIENT_GetRetryCount(int cont_instance, int mtp_instance);
+void WSCLIENT_UpdateAllSockSet(socket_set_t *set);
+void WSCLIENT_ProcessAllSocketActivity(socket_set_t *set);
+int WSCLIENT_QueueBinaryMessage(Usp__Header__MsgType usp_msg_type, int cont_instance, int mtp_instance, unsigned char *pbuf, int pbuf_len, mtp_reply_to_t *mrt, time_t expiry_time);
+bool WSCLIENT_AreAllResponsesSent(void);
+
+#endif // ENABLE_WEBSOCKETS
+#endif
@@ -62,13 +62,23 @@ typedef struct
 } kv_vector_t;
 
 //-----------------------------------------------------------------------------------------
-// Fixed-sized vector containing instance numbers
+// Vector containing instance numbers
+// NOTE: The vector is dynamically allocated. Vendor code must free it using USP_DM_DestroyInstances()
 typedef struct
 {
-    short vector[MAX_DM_INSTANCES];
+    int *vector;
     int num_entries;
 } int_vector_t;
 
+//-----------------------------------------------------------------------------------------
+// String vector type
+// NOTE: Functions taking a string vector as an argument (eg USP_SIGNAL_ObjectsAdded) copy the strings, so ownership remains with the caller
+typedef struct
+{
+    char **vector;
+    int num_entries;
+} str_vector_t;
+
 //-------------------------------------------------------------------------
 // Enumeration of expression operators
 typedef enum
@@ -260,6 +270,9 @@ typedef enum
 //-------------------------------------------------------------------------
 // Typedefs for data model callback functions
 typedef int (*dm_get_value_cb_t)(dm_req_t *req, char *buf, int len);
+typedef int (*dm_async_get_cb_t)(dm_req_t *req, int request_id);
+typedef int (*dm_get_group_cb_t)(int group_id, kv_vector_t *params);
+typedef int (*dm_set_group_cb_t)(int group_id, kv_vector_t *params);
 typedef int (*dm_set_value_cb_t)(dm_req_t *req, char *buf);
 typedef int (*dm_add_cb_t)(dm_req_t *req);
 typedef int (*dm_del_cb_t)(dm_req_t *req);
@@ -273,10 +286,59 @@ typedef int (*dm_notify_add_cb_t)(dm_req_t *req);
 typedef int (*dm_validate_del_cb_t)(dm_req_t *req);
 typedef int (*dm_notify_del_cb_t)(dm_req_t *req);
 
+// Callback used by USP_REGISTER_Object_RefreshInstances()
+// It must call USP_DM_RefreshInstance() for every instance of the object (and its child objects) which currently exists,
+// and may set expiry_period to the number of seconds for which these instances remain valid (default 0 ie re-read for every message)
+typedef int (*dm_refresh_instances_cb_t)(char *path, int *expiry_period);
+
 typedef int (*dm_sync_oper_cb_t)(dm_req_t *req, char *command_key, kv_vector_t *input_args, kv_vector_t *output_args);
 typedef int (*dm_async_oper_cb_t)(dm_req_t *req, kv_vector_t *input_args, int instance);
 typedef int (*dm_async_restart_cb_t)(dm_req_t *req, int instance, bool *is_restart, int *err_code, char *err_msg, int err_msg_len, kv_vector_t *output_args);
 
+// Callbacks used by USP_REGISTER_StagedInit()
+// The prepare callback is called on its own thread, and must not call any USP API functions (other than logging)
+// The register callback is called on the data model thread, and may call the USP_REGISTER_XXX() functions
+typedef int (*dm_staged_prepare_cb_t)(void **p_context);
+typedef int (*dm_staged_register_cb_t)(void *context);
+
+//-------------------------------------------------------------------------
+// Shared memory region containing statistics counters written by a vendor process, which the agent reads directly (see USP_REGISTER_SharedMemStats)
+// The region contains a 32 bit sequence number followed by an array of fixed size records, one for each instance of the object containing the counters
+// The sequence number implements a seqlock: The writer must increment it (making it odd) before updating any record, and increment it again
+// (making it even) once the update is complete, with release memory ordering. Readers retry if the sequence number was odd, or changed during the read
+typedef struct
+{
+    void *base;             // Address at which the region is mapped into the agent's address space (eg by mmap()). It must remain mapped whilst the agent runs
+    int size;               // Size of the region (in bytes)
+    int seq_offset;         // Offset of the 32 bit sequence number from the start of the region. Must be 4 byte aligned
+    int records_offset;     // Offset of the record for instance number 1 from the start of the region. Records for instance 2,3,... follow contiguously
+    int record_size;        // Size of each record (in bytes)
+    int num_records;        // Number of records in the region
+} usp_shm_region_t;
+
+// Parameter whose value is read from each record of a shared memory statistics region
+typedef struct
+{
+    char *path;             // Schema path of the parameter eg 'Device.WiFi.Radio.{i}.Stats.BytesSent'. The last instance number in the path selects the record
+    unsigned type_flags;    // Type of the value: DM_UINT (32 bit), DM_ULONG (64 bit), DM_INT (32 bit) or DM_BOOL (8 bit). May be combined with DM_PUSH_NOTIFIED
+    int offset;             // Offset of the value from the start of the record. Must be aligned to the size of the value
+} usp_shm_param_t;
+
+//-------------------------------------------------------------------------
+// Task run by the core pool of worker threads (see USP_TASK_Queue). Ownership of arg passes to the task
+typedef void (*usp_task_cb_t)(void *arg);
+
+// Priority of a task queued by USP_TASK_Queue(). Queued tasks of higher priority are started first
+typedef enum
+{
+    kUspTaskPriority_High,
+    kUspTaskPriority_Normal,
+    kUspTaskPriority_Low,
+
+    // The following enumeration should always be the last - it is used to size arrays
+    kUspTaskPriority_Max
+} usp_task_priority_t;
+
 //-------------------------------------------------------------------------
 // Typedefs for core vendor hook callbacks
 
@@ -363,6 +425,103 @@ typedef struct
 #define DM_UINT         0x00000010
 #define DM_ULONG        0x00000020
 
+// Flag which may be combined with the type of a vendor parameter, to indicate that the vendor signals all changes to its value
+// using USP_SIGNAL_ValueChanged(). Parameters registered with this flag are not polled by value change subscriptions.
+#define DM_PUSH_NOTIFIED 0x00010000
+
+//-------------------------------------------------------------------------
+// Types of node in a static schema table (see USP_REGISTER_StaticSchema)
+// Each corresponds to one of the USP_REGISTER_XXX() functions below
+typedef enum
+{
+    kStaticNode_Object_SingleInstance,
+    kStaticNode_Object_MultiInstance,       // USP_REGISTER_Object()
+    kStaticNode_Param_Constant,             // USP_REGISTER_Param_Constant()
+    kStaticNode_Param_NumEntries,           // USP_REGISTER_Param_NumEntries()
+    kStaticNode_DBParam_ReadWrite,          // USP_REGISTER_DBParam_ReadWrite()
+    kStaticNode_DBParam_ReadOnly,           // USP_REGISTER_DBParam_ReadOnly()
+    kStaticNode_DBParam_Secure,             // USP_REGISTER_DBParam_Secure()
+    kStaticNode_DBParam_ReadOnlyAuto,       // USP_REGISTER_DBParam_ReadOnlyAuto()
+    kStaticNode_DBParam_ReadWriteAuto,      // USP_REGISTER_DBParam_ReadWriteAuto()
+    kStaticNode_DBParam_Alias,              // USP_REGISTER_DBParam_Alias()
+    kStaticNode_VendorParam_ReadOnly,       // USP_REGISTER_VendorParam_ReadOnly()
+    kStaticNode_VendorParam_ReadWrite,      // USP_REGISTER_VendorParam_ReadWrite()
+    kStaticNode_SyncOperation,              // USP_REGISTER_SyncOperation()
+    kStaticNode_AsyncOperation,             // USP_REGISTER_AsyncOperation()
+    kStaticNode_Event,                      // USP_REGISTER_Event()
+} usp_static_node_type_t;
+
+//-------------------------------------------------------------------------
+// Unique key of a multi-instance object in a static schema table
+typedef struct
+{
+    const int *params;          // Indexes (in the schema table) of the parameters making up the key
+    int num_params;
+} usp_static_unique_key_t;
+
+//-------------------------------------------------------------------------
+// Node of a static schema table
+// NOTE: Static schema tables are not intended to be written by hand. They are generated at build time from a schema file
+//       by obuspa_schemac, which lists the nodes depth first (so that parents always precede their children), and
+//       precomputes the hashes which the data model would otherwise calculate for each node at startup
+typedef struct
+{
+    char *name;                 // Last segment of the schema path eg 'Enable'
+    char *path;                 // Schema path of the node eg 'Device.LocalAgent.Controller.{i}.Enable'
+    usp_static_node_type_t type;
+    bool is_implicit;           // Set if this object was not declared in the schema file, but exists because it is in the path to a node which was
+                                // Implicit objects may already have been registered (eg by the core agent) before the table is registered
+    int parent;                 // Index of the parent node in the table, or -1 for the first node (which must be 'Device' or 'Internal')
+    int num_children;           // Number of child nodes in the table
+    int name_hash;              // TEXT_UTILS_CalcHash() of the name
+    long long db_hash32;        // Hash of the schema path in each of the database hash formats (only for parameters stored in the database)
+    long long db_hash64;
+    unsigned type_flags;
+    char *value;                // Default value of database parameters, or value of constant parameters
+    int table;                  // Index of the table whose number of entries is given by a NumEntries parameter
+    char **input_args;          // Input arguments of operations, or arguments of events
+    int num_input_args;
+    char **output_args;         // Output arguments of operations
+    int num_output_args;
+    const usp_static_unique_key_t *unique_keys; // Unique keys of multi-instance objects. NOTE: The unique key of Alias parameters is included here
+    int num_unique_keys;
+    union
+    {
+        struct
+        {
+            dm_get_value_cb_t get_cb;
+            dm_set_value_cb_t set_cb;
+            dm_validate_value_cb_t validator_cb;
+            dm_notify_set_cb_t notify_set_cb;
+        } param;
+
+        struct
+        {
+            dm_validate_add_cb_t validate_add_cb;
+            dm_add_cb_t add_cb;
+            dm_notify_add_cb_t notify_add_cb;
+            dm_validate_del_cb_t validate_del_cb;
+            dm_del_cb_t del_cb;
+            dm_notify_del_cb_t notify_del_cb;
+        } object;
+
+        struct
+        {
+            dm_sync_oper_cb_t sync_oper_cb;
+            dm_async_oper_cb_t async_oper_cb;
+            dm_async_restart_cb_t restart_cb;
+        } oper;
+    } cb;
+} usp_static_node_t;
+
+//-------------------------------------------------------------------------
+// Static schema table, as generated by obuspa_schemac
+typedef struct
+{
+    const usp_static_node_t *nodes;
+    int num_nodes;
+} usp_static_schema_t;
+
 //-------------------------------------------------------------------------
 // Functions to register the data model
 // These functions may only be called during startup (which for vendor code, means within VENDOR_Init())
@@ -371,6 +530,8 @@ int USP_REGISTER_DBParam_ReadWrite(char *path, char *value, dm_validate_value_cb
 int USP_REGISTER_Param_NumEntries(char *path, char *table_path);
 int USP_REGISTER_VendorParam_ReadOnly(char *path, dm_get_value_cb_t get_cb, unsigned type_flags);
 int USP_REGISTER_VendorParam_ReadWrite(char *path, dm_get_value_cb_t get_cb, dm_set_value_cb_t set_cb, dm_notify_set_cb_t notify_set_cb, unsigned type_flags);
+int USP_REGISTER_VendorParam_CachePeriod(char *path, int cache_period);
+int USP_REGISTER_VendorParam_AsyncGet(char *path, dm_async_get_cb_t async_get_cb);
 int USP_REGISTER_DBParam_ReadOnlyAuto(char *path, dm_get_value_cb_t get_cb, unsigned type_flags);
 int USP_REGISTER_DBParam_ReadWriteAuto(char *path, dm_get_value_cb_t get_cb, dm_validate_value_cb_t validator_cb, 
                                       dm_notify_set_cb_t notify_set_cb, unsigned type_flags);
@@ -380,12 +541,19 @@ int USP_REGISTER_DBParam_Secure(char *path, char *value, dm_validate_value_cb_t
 int USP_REGISTER_Object(char *path, dm_validate_add_cb_t validate_add_cb, dm_add_cb_t add_cb, dm_notify_add_cb_t notify_add_cb,
                                    dm_validate_del_cb_t validate_del_cb, dm_del_cb_t del_cb, dm_notify_del_cb_t notify_del_cb);
 int USP_REGISTER_Object_UniqueKey(char *path, char **params, int num_params);
+int USP_REGISTER_Object_RefreshInstances(char *path, dm_refresh_instances_cb_t refresh_instances_cb);
 int USP_REGISTER_SyncOperation(char *path, dm_sync_oper_cb_t sync_oper_cb);
 int USP_REGISTER_AsyncOperation(char *path, dm_async_oper_cb_t async_oper_cb, dm_async_restart_cb_t restart_cb);
 int USP_REGISTER_OperationArguments(char *path, char **input_arg_names, int num_input_arg_names, char **output_arg_names, int num_output_arg_names);
 int USP_REGISTER_Event(char *path);
 int USP_REGISTER_EventArguments(char *path, char **event_arg_names, int num_event_arg_names);
 int USP_REGISTER_CoreVendorHooks(vendor_hook_cb_t *callbacks);
+int USP_REGISTER_GroupedVendorParam_ReadOnly(int group_id, char *path, unsigned type_flags);
+int USP_REGISTER_GroupedVendorParam_ReadWrite(int group_id, char *path, unsigned type_flags);
+int USP_REGISTER_GroupVendorHooks(int group_id, dm_get_group_cb_t get_group_cb, dm_set_group_cb_t set_group_cb);
+int USP_REGISTER_StagedInit(dm_staged_prepare_cb_t prepare_cb, dm_staged_register_cb_t register_cb);
+int USP_REGISTER_StaticSchema(const usp_static_schema_t *schema);
+int USP_REGISTER_SharedMemStats(usp_shm_region_t *region, usp_shm_param_t *params, int num_params);
 
 //------------------------------------------------------------------------------
 // Functions that may be called from vendor hooks to access the data model
@@ -395,7 +563,9 @@ int USP_DM_GetParameterValue(char *path, char *buf, int len);
 int USP_DM_SetParameterValue(char *path, char *new_value);
 int USP_DM_DeleteInstance(char *path);
 int USP_DM_InformInstance(char *path);
+int USP_DM_RefreshInstance(char *path);
 int USP_DM_GetInstances(char *path, int_vector_t *iv);
+void USP_DM_DestroyInstances(int_vector_t *iv);
 int USP_DM_RegisterRoleName(ctrust_role_t role, char *name);
 int USP_DM_AddControllerTrustPermission(ctrust_role_t role, char *path, unsigned short permission_bitmask);
 
@@ -406,6 +576,15 @@ int USP_SIGNAL_DataModelEvent(char *event_name, kv_vector_t *output_args);
 int USP_SIGNAL_OperationStatus(int instance, char *status);
 int USP_SIGNAL_ObjectAdded(char *path);
 int USP_SIGNAL_ObjectDeleted(char *path);
+int USP_SIGNAL_ObjectsAdded(str_vector_t *paths);
+int USP_SIGNAL_ObjectsDeleted(str_vector_t *paths);
+int USP_SIGNAL_ValueChanged(char *path, char *value);
+int USP_SIGNAL_GetValueComplete(int request_id, int err_code, char *value);
+
+//------------------------------------------------------------------------------
+// Function to run a task (eg the thread implementing an asynchronous operation) on the core pool of worker threads
+// This may be called from any thread
+int USP_TASK_Queue(usp_task_cb_t task_cb, void *arg, usp_task_priority_t priority);
 
 //------------------------------------------------------------------------------
 // Functions for argument list data structure
@@ -416,6 +595,7 @@ void USP_ARG_AddUnsigned(kv_vector_t *kvv, char *key, unsigned value);
 void USP_ARG_AddBool(kv_vector_t *kvv, char *key, bool value);
 void USP_ARG_AddDateTime(kv_vector_t *kvv, char *key, time_t value);
 char *USP_ARG_Get(kv_vector_t *kvv, char *key, char *default_value);
+bool USP_ARG_Replace(kv_vector_t *kvv, char *key, char *value);
 int USP_ARG_GetUnsigned(kv_vector_t *kvv, char *key, unsigned default_value, unsigned *value);
 int USP_ARG_GetUnsignedWithinRange(kv_vector_t *kvv, char *key, unsigned default_value, unsigned min, unsigned max, unsigned *value);
 int USP_ARG_GetBool(kv_vector_t *kvv, char *key, bool default_value, bool *value);
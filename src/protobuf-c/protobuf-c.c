@@ -2104,11 +2104,18 @@ struct _ScannedMember {
 	uint32_t tag;              /**< Field tag. */
 	uint8_t wire_type;         /**< Field type. */
 	uint8_t length_prefix_len; /**< Prefix length. */
+	uint8_t bytes_in_place;    /**< Bytes fields reference the serialised message. */
 	const ProtobufCFieldDescriptor *field; /**< Field descriptor. */
 	size_t len;                /**< Field length. */
 	const uint8_t *data;       /**< Pointer to field data. */
 };
 
+static ProtobufCMessage *
+message_unpack(const ProtobufCMessageDescriptor *desc,
+	       ProtobufCAllocator *allocator,
+	       size_t len, const uint8_t *data,
+	       protobuf_c_boolean bytes_in_place);
+
 static inline uint32_t
 scan_length_prefixed_data(size_t len, const uint8_t *data,
 			  size_t *prefix_len_out)
@@ -2577,7 +2584,9 @@ parse_required_member(ScannedMember *scanned_member,
 		{
 			do_free(allocator, bd->data);
 		}
-		if (len - pref_len > 0) {
+		if (len - pref_len > 0 && scanned_member->bytes_in_place) {
+			bd->data = (uint8_t *) data + pref_len;
+		} else if (len - pref_len > 0) {
 			bd->data = do_alloc(allocator, len - pref_len);
 			if (bd->data == NULL)
 				return FALSE;
@@ -2599,10 +2608,11 @@ parse_required_member(ScannedMember *scanned_member,
 			return FALSE;
 
 		def_mess = scanned_member->field->default_value;
-		subm = protobuf_c_message_unpack(scanned_member->field->descriptor,
-						 allocator,
-						 len - pref_len,
-						 data + pref_len);
+		subm = message_unpack(scanned_member->field->descriptor,
+				      allocator,
+				      len - pref_len,
+				      data + pref_len,
+				      scanned_member->bytes_in_place);
 
 		if (maybe_clear &&
 		    *pmessage != NULL &&
@@ -3014,6 +3024,23 @@ ProtobufCMessage *
 protobuf_c_message_unpack(const ProtobufCMessageDescriptor *desc,
 			  ProtobufCAllocator *allocator,
 			  size_t len, const uint8_t *data)
+{
+	return message_unpack(desc, allocator, len, data, FALSE);
+}
+
+ProtobufCMessage *
+protobuf_c_message_unpack_in_place(const ProtobufCMessageDescriptor *desc,
+				   ProtobufCAllocator *allocator,
+				   size_t len, const uint8_t *data)
+{
+	return message_unpack(desc, allocator, len, data, TRUE);
+}
+
+static ProtobufCMessage *
+message_unpack(const ProtobufCMessageDescriptor *desc,
+	       ProtobufCAllocator *allocator,
+	       size_t len, const uint8_t *data,
+	       protobuf_c_boolean bytes_in_place)
 {
 	ProtobufCMessage *rv;
 	size_t rem = len;
@@ -3117,6 +3144,7 @@ protobuf_c_message_unpack(const ProtobufCMessageDescriptor *desc,
 		tmp.field = field;
 		tmp.data = at;
 		tmp.length_prefix_len = 0;
+		tmp.bytes_in_place = bytes_in_place;
 
 		switch (wire_type) {
 		case PROTOBUF_C_WIRE_TYPE_VARINT: {
@@ -958,6 +958,42 @@ protobuf_c_message_unpack(
 	size_t len,
 	const uint8_t *data);
 
+/**
+ * Unpack a serialised message into an in-memory representation, without
+ * copying the contents of `bytes` fields.
+ *
+ * This is the same as protobuf_c_message_unpack(), except that the `data`
+ * member of each `bytes` field points into the serialised message, rather than
+ * at a copy allocated using the allocator. This avoids copying embedded
+ * serialised messages (for example the payload of a record).
+ *
+ * The serialised message must persist (unchanged) for the lifetime of the
+ * unpacked message. Because the `bytes` fields were not allocated using the
+ * allocator, the allocator's `free` function must ignore pointers which it did
+ * not allocate (for example an arena allocator, whose memory is released all
+ * at once).
+ *
+ * \param descriptor
+ *      The message descriptor.
+ * \param allocator
+ *      `ProtobufCAllocator` to use for memory allocation.
+ * \param len
+ *      Length in bytes of the serialised message.
+ * \param data
+ *      Pointer to the serialised message.
+ * \return
+ *      An unpacked message object.
+ * \retval NULL
+ *      If an error occurred during unpacking.
+ */
+PROTOBUF_C__API
+ProtobufCMessage *
+protobuf_c_message_unpack_in_place(
+	const ProtobufCMessageDescriptor *descriptor,
+	ProtobufCAllocator *allocator,
+	size_t len,
+	const uint8_t *data);
+
 /**
  * Free an unpacked message object.
  *
@@ -0,0 +1,1589 @@
+/*
+ *
+ * Copyright (C) 2019, Broadband Forum
+ * Copyright (C) 2019  CommScope, Inc
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file obuspa_schemac.c
+ *
+ * Schema compiler, run at build time to convert a schema file into a static schema table
+ * The generated C file is compiled into the agent, and registered from VENDOR_Init() using USP_REGISTER_StaticSchema().
+ * This avoids the cost (at every startup) of parsing the path of each node, walking the data model tree to find its
+ * parent, calculating the hashes of its name and path, and interning its name and path strings, which is incurred
+ * when each node is registered using the USP_REGISTER_XXX() functions. The generated table lists the nodes depth first
+ * (with the children of each node sorted by name), and contains the precomputed hashes and child counts.
+ * NOTE: The hashes are calculated by the same code as the agent uses (text_hash.c), so this program must be rebuilt
+ *       whenever that changes. When cross compiling, this program must be built for the build host, not the target.
+ *
+ * Usage:
+ *    obuspa_schemac -o vendor_schema.c -n vendor_schema vendor_schema.json
+ * Then in the vendor code:
+ *    extern const usp_static_schema_t vendor_schema;
+ *    err = USP_REGISTER_StaticSchema(&vendor_schema);
+ *
+ * The schema file is a JSON object containing an array of the nodes to register. Example:
+ *    {
+ *      "nodes": [
+ *        { "path": "Device.Example.{i}", "type": "object", "add": "Example_Add", "del": "Example_Del", "unique_keys": [ ["Name"] ] },
+ *        { "path": "Device.Example.{i}.Alias", "type": "alias" },
+ *        { "path": "Device.Example.{i}.Name", "type": "db_rw", "value_type": "string", "default": "", "validate": "Example_ValidateName" },
+ *        { "path": "Device.Example.{i}.Status", "type": "vendor_ro", "value_type": "string", "get": "Example_GetStatus" },
+ *        { "path": "Device.Example.{i}.Reset()", "type": "sync_operation", "operate": "Example_Reset", "input_args": [ "Delay" ] },
+ *        { "path": "Device.Example.{i}.Alarm!", "type": "event", "args": [ "Severity" ] },
+ *        { "path": "Device.ExampleNumberOfEntries", "type": "num_entries", "table": "Device.Example.{i}" }
+ *      ]
+ *    }
+ *
+ * Node types, and the USP_REGISTER_XXX() function that each is equivalent to:
+ *   object          - USP_REGISTER_Object() if the path ends in '{i}', otherwise a single instance object
+ *   constant        - USP_REGISTER_Param_Constant()
+ *   num_entries     - USP_REGISTER_Param_NumEntries()
+ *   db_rw, db_ro, db_secure, db_ro_auto, db_rw_auto, alias
+ *                   - USP_REGISTER_DBParam_ReadWrite/ReadOnly/Secure/ReadOnlyAuto/ReadWriteAuto/Alias()
+ *   vendor_ro, vendor_rw
+ *                   - USP_REGISTER_VendorParam_ReadOnly/ReadWrite()
+ *   sync_operation, async_operation
+ *                   - USP_REGISTER_SyncOperation/AsyncOperation() and USP_REGISTER_OperationArguments()
+ *   event           - USP_REGISTER_Event() and USP_REGISTER_EventArguments()
+ *
+ * Other members of each node (only those relevant to the node's type are allowed):
+ *   value_type      - string, datetime, bool, int, unsigned or ulong (default string)
+ *   push_notified   - true if the vendor signals all changes to the parameter's value (DM_PUSH_NOTIFIED)
+ *   default         - default value of database parameters
+ *   value           - value of constant parameters
+ *   table           - schema path of the table counted by a num_entries parameter
+ *   unique_keys     - array of unique keys of a multi-instance object, each an array of parameter names
+ *   input_args, output_args, args
+ *                   - arguments of operations and events
+ *   get, set, validate, notify_set, validate_add, add, notify_add, validate_del, del, notify_del, operate, restart
+ *                   - names of the callback functions
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "text_hash.h"
+
+//------------------------------------------------------------------------------
+// Default name of the generated static schema table (if not given on the command line)
+#define DEFAULT_SCHEMA_NAME         "static_schema"
+
+// Maximum number of parameters in a compound unique key. NOTE: This must match MAX_COMPOUND_KEY_PARAMS in vendor_defs.h
+#define MAX_KEY_PARAMS              4
+
+// String used in schema paths to denote a multi-instance object
+#define MULTI_SEPARATOR             "{i}"
+
+//------------------------------------------------------------------------------
+// Types of node, indexing node_types[]
+typedef enum
+{
+    kNodeType_SingleObject,
+    kNodeType_MultiObject,
+    kNodeType_Constant,
+    kNodeType_NumEntries,
+    kNodeType_DbRw,
+    kNodeType_DbRo,
+    kNodeType_DbSecure,
+    kNodeType_DbRoAuto,
+    kNodeType_DbRwAuto,
+    kNodeType_Alias,
+    kNodeType_VendorRo,
+    kNodeType_VendorRw,
+    kNodeType_SyncOperation,
+    kNodeType_AsyncOperation,
+    kNodeType_Event,
+
+    kNodeType_Max
+} node_type_t;
+
+#define TYPE_BIT(t)  (1 << (t))
+#define PARAM_TYPES  (TYPE_BIT(kNodeType_Constant) | TYPE_BIT(kNodeType_NumEntries) | DB_TYPES | VENDOR_TYPES)
+#define DB_TYPES     (TYPE_BIT(kNodeType_DbRw) | TYPE_BIT(kNodeType_DbRo) | TYPE_BIT(kNodeType_DbSecure) | \
+                      TYPE_BIT(kNodeType_DbRoAuto) | TYPE_BIT(kNodeType_DbRwAuto) | TYPE_BIT(kNodeType_Alias))
+#define VENDOR_TYPES (TYPE_BIT(kNodeType_VendorRo) | TYPE_BIT(kNodeType_VendorRw))
+#define OPER_TYPES   (TYPE_BIT(kNodeType_SyncOperation) | TYPE_BIT(kNodeType_AsyncOperation))
+#define TYPED_PARAM_TYPES (TYPE_BIT(kNodeType_Constant) | TYPE_BIT(kNodeType_DbRw) | TYPE_BIT(kNodeType_DbRo) | \
+                           TYPE_BIT(kNodeType_DbRoAuto) | TYPE_BIT(kNodeType_DbRwAuto) | VENDOR_TYPES)
+
+// Name of each type of node in the schema file, and in the generated code (usp_static_node_type_t)
+typedef struct
+{
+    char *name;
+    char *enum_name;
+} node_type_info_t;
+
+static const node_type_info_t node_types[kNodeType_Max] =
+{
+    { "object",          "kStaticNode_Object_SingleInstance" },     // kNodeType_SingleObject
+    { "object",          "kStaticNode_Object_MultiInstance" },      // kNodeType_MultiObject
+    { "constant",        "kStaticNode_Param_Constant" },            // kNodeType_Constant
+    { "num_entries",     "kStaticNode_Param_NumEntries" },          // kNodeType_NumEntries
+    { "db_rw",           "kStaticNode_DBParam_ReadWrite" },         // kNodeType_DbRw
+    { "db_ro",           "kStaticNode_DBParam_ReadOnly" },          // kNodeType_DbRo
+    { "db_secure",       "kStaticNode_DBParam_Secure" },            // kNodeType_DbSecure
+    { "db_ro_auto",      "kStaticNode_DBParam_ReadOnlyAuto" },      // kNodeType_DbRoAuto
+    { "db_rw_auto",      "kStaticNode_DBParam_ReadWriteAuto" },     // kNodeType_DbRwAuto
+    { "alias",           "kStaticNode_DBParam_Alias" },             // kNodeType_Alias
+    { "vendor_ro",       "kStaticNode_VendorParam_ReadOnly" },      // kNodeType_VendorRo
+    { "vendor_rw",       "kStaticNode_VendorParam_ReadWrite" },     // kNodeType_VendorRw
+    { "sync_operation",  "kStaticNode_SyncOperation" },             // kNodeType_SyncOperation
+    { "async_operation", "kStaticNode_AsyncOperation" },            // kNodeType_AsyncOperation
+    { "event",           "kStaticNode_Event" },                     // kNodeType_Event
+};
+
+//------------------------------------------------------------------------------
+// Callbacks which may be named in the schema file
+typedef struct
+{
+    char *key;              // Member of the node in the schema file
+    char *member;           // Member of usp_static_node_t in the generated code
+    char *prototype;        // Prototype of the callback function (printf format, taking the function name)
+    unsigned allowed;       // Bitmask of node types for which this callback may be given
+    unsigned required;      // Bitmask of node types for which this callback must be given
+} callback_info_t;
+
+static const callback_info_t callbacks[] =
+{
+    { "get",          ".cb.param.get_cb",          "int %s(dm_req_t *req, char *buf, int len);",
+      TYPE_BIT(kNodeType_DbRoAuto) | TYPE_BIT(kNodeType_DbRwAuto) | VENDOR_TYPES,
+      TYPE_BIT(kNodeType_DbRoAuto) | TYPE_BIT(kNodeType_DbRwAuto) | VENDOR_TYPES },
+    { "set",          ".cb.param.set_cb",          "int %s(dm_req_t *req, char *buf);",
+      TYPE_BIT(kNodeType_VendorRw), TYPE_BIT(kNodeType_VendorRw) },
+    { "validate",     ".cb.param.validator_cb",    "int %s(dm_req_t *req, char *value);",
+      TYPE_BIT(kNodeType_DbRw) | TYPE_BIT(kNodeType_DbSecure) | TYPE_BIT(kNodeType_DbRwAuto), 0 },
+    { "notify_set",   ".cb.param.notify_set_cb",   "int %s(dm_req_t *req, char *value);",
+      TYPE_BIT(kNodeType_DbRw) | TYPE_BIT(kNodeType_DbSecure) | TYPE_BIT(kNodeType_DbRwAuto) | TYPE_BIT(kNodeType_Alias) | TYPE_BIT(kNodeType_VendorRw), 0 },
+    { "validate_add", ".cb.object.validate_add_cb", "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "add",          ".cb.object.add_cb",          "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "notify_add",   ".cb.object.notify_add_cb",   "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "validate_del", ".cb.object.validate_del_cb", "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "del",          ".cb.object.del_cb",          "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "notify_del",   ".cb.object.notify_del_cb",   "int %s(dm_req_t *req);", TYPE_BIT(kNodeType_MultiObject), 0 },
+    { "operate",      ".cb.oper.sync_oper_cb",      "int %s(dm_req_t *req, char *command_key, kv_vector_t *input_args, kv_vector_t *output_args);",
+      TYPE_BIT(kNodeType_SyncOperation), TYPE_BIT(kNodeType_SyncOperation) },
+    { "operate",      ".cb.oper.async_oper_cb",     "int %s(dm_req_t *req, kv_vector_t *input_args, int instance);",
+      TYPE_BIT(kNodeType_AsyncOperation), TYPE_BIT(kNodeType_AsyncOperation) },
+    { "restart",      ".cb.oper.restart_cb",        "int %s(dm_req_t *req, int instance, bool *is_restart, int *err_code, char *err_msg, int err_msg_len, kv_vector_t *output_args);",
+      TYPE_BIT(kNodeType_AsyncOperation), 0 },
+};
+
+#define NUM_CALLBACKS  ((int)(sizeof(callbacks)/sizeof(callbacks[0])))
+
+//------------------------------------------------------------------------------
+// Other members of a node in the schema file, and the node types for which they are allowed
+typedef struct
+{
+    char *key;
+    unsigned allowed;
+} member_info_t;
+
+static const member_info_t members[] =
+{
+    { "path",          0xFFFFFFFF },
+    { "type",          0xFFFFFFFF },
+    { "value_type",    TYPED_PARAM_TYPES },
+    { "push_notified", VENDOR_TYPES },
+    { "default",       TYPE_BIT(kNodeType_DbRw) | TYPE_BIT(kNodeType_DbRo) | TYPE_BIT(kNodeType_DbSecure) },
+    { "value",         TYPE_BIT(kNodeType_Constant) },
+    { "table",         TYPE_BIT(kNodeType_NumEntries) },
+    { "unique_keys",   TYPE_BIT(kNodeType_MultiObject) },
+    { "input_args",    OPER_TYPES },
+    { "output_args",   OPER_TYPES },
+    { "args",          TYPE_BIT(kNodeType_Event) },
+};
+
+#define NUM_MEMBERS  ((int)(sizeof(members)/sizeof(members[0])))
+
+//------------------------------------------------------------------------------
+// Value types of parameters, and the corresponding type_flags in the generated code
+typedef struct
+{
+    char *name;
+    char *flag;
+} value_type_info_t;
+
+static const value_type_info_t value_types[] =
+{
+    { "string",   "DM_STRING" },
+    { "datetime", "DM_DATETIME" },
+    { "bool",     "DM_BOOL" },
+    { "int",      "DM_INT" },
+    { "unsigned", "DM_UINT" },
+    { "ulong",    "DM_ULONG" },
+};
+
+#define NUM_VALUE_TYPES  ((int)(sizeof(value_types)/sizeof(value_types[0])))
+
+//------------------------------------------------------------------------------
+// Node of the schema tree built from the schema file
+typedef struct gen_node_tag
+{
+    char *name;                     // Last segment of the schema path
+    char *path;                     // Schema path
+    node_type_t type;
+    bool is_implicit;               // Set if the node was not declared in the schema file, but is in the path to a node that was
+    JsonNode *json;                 // Declaration of the node in the schema file, or NULL if the node is implicit
+    struct gen_node_tag *parent;
+    struct gen_node_tag **children;
+    int num_children;
+    int index;                      // Index of the node in the generated table
+    struct gen_node_tag *table;     // Table counted by a NumEntries parameter
+    struct gen_node_tag **keys;     // Parameters making up each unique key. Each key occupies MAX_KEY_PARAMS entries
+    int *key_lens;                  // Number of parameters in each unique key
+    int num_keys;
+} gen_node_t;
+
+//------------------------------------------------------------------------------
+// Root of the schema tree, and the nodes in the order that they are output
+static gen_node_t *root = NULL;
+static gen_node_t **ordered_nodes = NULL;
+static int num_nodes = 0;
+
+// Callback functions named in the schema file, for which prototypes are output (each is output only once)
+static char **cb_names = NULL;
+static int num_cb_names = 0;
+
+//------------------------------------------------------------------------------
+// Forward declarations
+void Usage(void);
+char *ReadFile(char *filename);
+int AddNodes(JsonNode *nodes);
+int AddNode(JsonNode *decl);
+int ParseNodeType(JsonNode *decl, char *path, node_type_t *type);
+int CheckMembers(JsonNode *decl, char *path, node_type_t type);
+gen_node_t *FindChild(gen_node_t *parent, char *name);
+gen_node_t *CreateNode(gen_node_t *parent, char *name, int name_len, node_type_t type);
+gen_node_t *FindNodeFromPath(char *path);
+gen_node_t *MultiInstanceAncestor(gen_node_t *node);
+int ResolveReferences(gen_node_t *node);
+int ResolveUniqueKeys(gen_node_t *node);
+void AddUniqueKey(gen_node_t *node, gen_node_t **params, int num_params);
+void OrderNodes(gen_node_t *node);
+int CompareNodeNames(const void *p1, const void *p2);
+int WriteSchema(FILE *fp, char *name, char *src_filename);
+void WritePrototypes(FILE *fp, gen_node_t *node);
+void WriteArgs(FILE *fp, char *name, gen_node_t *node, char *key, char *suffix);
+void WriteUniqueKeys(FILE *fp, char *name, gen_node_t *node);
+void WriteNode(FILE *fp, char *name, gen_node_t *node);
+void WriteString(FILE *fp, char *str);
+char *GetString(JsonNode *decl, char *key);
+bool IsDbParam(gen_node_t *node);
+void *SchemacMalloc(int size);
+void *SchemacRealloc(void *ptr, int size);
+char *SchemacStrdup(char *str);
+
+/*********************************************************************//**
+**
+** main
+**
+** Main function of the schema compiler
+**
+** \param   argc - Number of command line arguments
+** \param   argv - Array of pointers to command line argument strings
+**
+** \return  0 if the static schema table was generated successfully, otherwise 1
+**
+**************************************************************************/
+int main(int argc, char *argv[])
+{
+    char *out_filename = NULL;
+    char *name = DEFAULT_SCHEMA_NAME;
+    char *text;
+    JsonNode *schema;
+    JsonNode *nodes;
+    FILE *fp;
+    int opt;
+    int err;
+
+    while ((opt = getopt(argc, argv, "o:n:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'o':
+                out_filename = optarg;
+                break;
+
+            case 'n':
+                name = optarg;
+                break;
+
+            default:
+                Usage();
+                return 1;
+        }
+    }
+
+    // Exit if the schema file was not specified
+    if ((optind != argc-1) || (out_filename == NULL))
+    {
+        Usage();
+        return 1;
+    }
+
+    // Exit if unable to read the schema file
+    text = ReadFile(argv[optind]);
+    if (text == NULL)
+    {
+        return 1;
+    }
+
+    // Exit if the schema file is not valid JSON, or does not contain an array of nodes
+    schema = json_decode(text);
+    free(text);
+    if (schema == NULL)
+    {
+        fprintf(stderr, "ERROR: %s is not a valid JSON file\n", argv[optind]);
+        return 1;
+    }
+
+    nodes = json_find_member(schema, "nodes");
+    if ((nodes == NULL) || (nodes->tag != JSON_ARRAY))
+    {
+        fprintf(stderr, "ERROR: %s does not contain an array of nodes\n", argv[optind]);
+        return 1;
+    }
+
+    // Exit if unable to build the schema tree from the schema file
+    err = AddNodes(nodes);
+    if (err != 0)
+    {
+        return 1;
+    }
+
+    // Sort the children of each node and number the nodes depth first
+    OrderNodes(root);
+
+    // Exit if any NumEntries tables or unique keys could not be resolved
+    err = ResolveReferences(root);
+    if (err != 0)
+    {
+        return 1;
+    }
+
+    // Exit if unable to write the generated file
+    fp = fopen(out_filename, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to open %s for writing\n", out_filename);
+        return 1;
+    }
+
+    err = WriteSchema(fp, name, argv[optind]);
+    if ((fclose(fp) != 0) || (err != 0))
+    {
+        fprintf(stderr, "ERROR: Failed to write %s\n", out_filename);
+        remove(out_filename);
+        return 1;
+    }
+
+    json_delete(schema);
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** Usage
+**
+** Prints the command line options of this program
+**
+** \param   None
+**
+** \return  None
+**
+**************************************************************************/
+void Usage(void)
+{
+    printf("Usage: obuspa_schemac -o output.c [-n name] schema.json\n");
+    printf("  -o file   C file to write the static schema table to\n");
+    printf("  -n name   Name of the generated usp_static_schema_t variable (default '%s')\n", DEFAULT_SCHEMA_NAME);
+}
+
+/*********************************************************************//**
+**
+** ReadFile
+**
+** Reads the whole of the specified file into a dynamically allocated, NULL terminated buffer
+**
+** \param   filename - name of the file to read
+**
+** \return  pointer to buffer containing the file contents, or NULL if the file could not be read
+**
+**************************************************************************/
+char *ReadFile(char *filename)
+{
+    FILE *fp;
+    char *buf;
+    long len;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to open %s\n", filename);
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = SchemacMalloc(len+1);
+    if ((len < 0) || (fread(buf, 1, len, fp) != (size_t)len))
+    {
+        fprintf(stderr, "ERROR: Unable to read %s\n", filename);
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    buf[len] = '\0';
+
+    fclose(fp);
+    return buf;
+}
+
+/*********************************************************************//**
+**
+** AddNodes
+**
+** Adds all nodes declared in the schema file to the schema tree
+**
+** \param   nodes - JSON array of node declarations
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int AddNodes(JsonNode *nodes)
+{
+    JsonNode *decl;
+    int err;
+
+    json_foreach(decl, nodes)
+    {
+        err = AddNode(decl);
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    // Exit if the schema file did not declare any nodes
+    if (root == NULL)
+    {
+        fprintf(stderr, "ERROR: Schema file does not declare any nodes\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** AddNode
+**
+** Adds the node declared in the schema file to the schema tree, adding any objects in its path which have not been added yet
+**
+** \param   decl - JSON object declaring the node
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int AddNode(JsonNode *decl)
+{
+    char *path;
+    char *seg;
+    char *end;
+    int len;
+    node_type_t type;
+    node_type_t seg_type;
+    gen_node_t *parent = NULL;
+    gen_node_t *node = NULL;
+    int err;
+
+    // Exit if the node does not have a path
+    path = GetString(decl, "path");
+    if (path == NULL)
+    {
+        fprintf(stderr, "ERROR: Node declared without a path\n");
+        return -1;
+    }
+
+    // Exit if the node's type is invalid
+    err = ParseNodeType(decl, path, &type);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    // Iterate over all segments in the path, finding or adding the node for each
+    seg = path;
+    while (*seg != '\0')
+    {
+        // Exit if the path contains an empty segment
+        end = strchr(seg, '.');
+        len = (end == NULL) ? (int)strlen(seg) : (int)(end - seg);
+        if (len == 0)
+        {
+            fprintf(stderr, "ERROR: Path %s contains an empty segment\n", path);
+            return -1;
+        }
+
+        // Determine the type of the node for this segment. All segments apart from the last are objects
+        seg_type = ((end != NULL) && (strncmp(end+1, MULTI_SEPARATOR, sizeof(MULTI_SEPARATOR)-1) == 0)) ? kNodeType_MultiObject : kNodeType_SingleObject;
+        if ((end == NULL) || ((seg_type == kNodeType_MultiObject) && (end[sizeof(MULTI_SEPARATOR)] == '\0')))
+        {
+            // This is the last segment in the path
+            if ((type == kNodeType_SingleObject) || (type == kNodeType_MultiObject))
+            {
+                type = seg_type;
+            }
+            else if (seg_type == kNodeType_MultiObject)
+            {
+                fprintf(stderr, "ERROR: Path %s of %s must not end in '%s'\n", path, node_types[type].name, MULTI_SEPARATOR);
+                return -1;
+            }
+            seg_type = type;
+        }
+
+        if (parent == NULL)
+        {
+            // First segment in the path. This must be the root of the schema tree
+            if ((strncmp(seg, "Device", len) != 0) && (strncmp(seg, "Internal", len) != 0))
+            {
+                fprintf(stderr, "ERROR: Path %s does not start with 'Device' or 'Internal'\n", path);
+                return -1;
+            }
+
+            if (root == NULL)
+            {
+                root = CreateNode(NULL, seg, len, kNodeType_SingleObject);
+            }
+            else if ((strncmp(seg, root->name, len) != 0) || (root->name[len] != '\0'))
+            {
+                fprintf(stderr, "ERROR: Path %s is not under '%s'. All nodes in the schema file must have the same root\n", path, root->name);
+                return -1;
+            }
+            node = root;
+        }
+        else
+        {
+            node = FindChild(parent, seg);
+            if (node == NULL)
+            {
+                node = CreateNode(parent, seg, len, seg_type);
+            }
+            else if (node->type != seg_type)
+            {
+                fprintf(stderr, "ERROR: Path segment '%s' of %s has conflicting types (%s and %s)\n",
+                                 node->name, path, node_types[node->type].name, node_types[seg_type].name);
+                return -1;
+            }
+        }
+
+        // Move to the next segment, skipping the multi-instance separator
+        parent = node;
+        seg += len;
+        if (*seg == '.')
+        {
+            seg++;
+        }
+
+        if (strncmp(seg, MULTI_SEPARATOR, sizeof(MULTI_SEPARATOR)-1) == 0)
+        {
+            seg += sizeof(MULTI_SEPARATOR)-1;
+            if (*seg == '.')
+            {
+                seg++;
+            }
+        }
+    }
+
+    // Exit if the node has already been declared, or is the root node
+    if ((node->is_implicit == false) || (node == root))
+    {
+        fprintf(stderr, "ERROR: Path %s is declared more than once\n", path);
+        return -1;
+    }
+
+    // Exit if the path of an operation or event is malformed
+    len = strlen(node->name);
+    if ( ((type == kNodeType_SyncOperation) || (type == kNodeType_AsyncOperation)) &&
+         ((len < 3) || (strcmp(&node->name[len-2], "()") != 0)) )
+    {
+        fprintf(stderr, "ERROR: Path %s is not an operation (missing '()')\n", path);
+        return -1;
+    }
+
+    if ((type == kNodeType_Event) && ((len < 2) || (node->name[len-1] != '!')))
+    {
+        fprintf(stderr, "ERROR: Path %s is not an event (missing '!')\n", path);
+        return -1;
+    }
+
+    // Exit if any of the node's members are not valid for its type
+    err = CheckMembers(decl, path, type);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    node->is_implicit = false;
+    node->json = decl;
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** ParseNodeType
+**
+** Determines the type of the node from its declaration in the schema file
+** NOTE: Objects are returned as single instance. Whether an object is multi-instance is determined later, from its path
+**
+** \param   decl - JSON object declaring the node
+** \param   path - schema path of the node
+** \param   type - pointer to variable in which to return the type of the node
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int ParseNodeType(JsonNode *decl, char *path, node_type_t *type)
+{
+    char *name;
+    int i;
+
+    name = GetString(decl, "type");
+    if (name == NULL)
+    {
+        fprintf(stderr, "ERROR: Node %s declared without a type\n", path);
+        return -1;
+    }
+
+    for (i=0; i<kNodeType_Max; i++)
+    {
+        if (strcmp(name, node_types[i].name) == 0)
+        {
+            *type = i;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "ERROR: Node %s has unknown type '%s'\n", path, name);
+    return -1;
+}
+
+/*********************************************************************//**
+**
+** CheckMembers
+**
+** Checks that all members of the node's declaration are valid for its type, and that all required callbacks are present
+**
+** \param   decl - JSON object declaring the node
+** \param   path - schema path of the node
+** \param   type - type of the node
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int CheckMembers(JsonNode *decl, char *path, node_type_t type)
+{
+    JsonNode *member;
+    unsigned type_bit;
+    bool is_valid;
+    char *value;
+    int i;
+
+    type_bit = TYPE_BIT(type);
+
+    // Exit if the declaration is not a JSON object
+    if (decl->tag != JSON_OBJECT)
+    {
+        fprintf(stderr, "ERROR: Node %s is not declared as a JSON object\n", path);
+        return -1;
+    }
+
+    json_foreach(member, decl)
+    {
+        is_valid = false;
+        for (i=0; i<NUM_MEMBERS; i++)
+        {
+            if ((strcmp(member->key, members[i].key) == 0) && (members[i].allowed & type_bit))
+            {
+                is_valid = true;
+            }
+        }
+
+        for (i=0; i<NUM_CALLBACKS; i++)
+        {
+            if ((strcmp(member->key, callbacks[i].key) == 0) && (callbacks[i].allowed & type_bit))
+            {
+                // Exit if the callback is not named by a string
+                if (member->tag != JSON_STRING)
+                {
+                    fprintf(stderr, "ERROR: Callback '%s' of %s must be a string\n", member->key, path);
+                    return -1;
+                }
+                is_valid = true;
+            }
+        }
+
+        // Exit if this member is not valid for this type of node
+        if (is_valid == false)
+        {
+            fprintf(stderr, "ERROR: '%s' is not valid for %s (%s)\n", member->key, path, node_types[type].name);
+            return -1;
+        }
+    }
+
+    // Exit if any required callbacks are missing
+    for (i=0; i<NUM_CALLBACKS; i++)
+    {
+        if ((callbacks[i].required & type_bit) && (GetString(decl, callbacks[i].key) == NULL))
+        {
+            fprintf(stderr, "ERROR: %s (%s) requires a '%s' callback\n", path, node_types[type].name, callbacks[i].key);
+            return -1;
+        }
+    }
+
+    // Exit if a constant has no value
+    if ((type == kNodeType_Constant) && (GetString(decl, "value") == NULL))
+    {
+        fprintf(stderr, "ERROR: %s (%s) requires a value\n", path, node_types[type].name);
+        return -1;
+    }
+
+    // Exit if a NumEntries parameter does not name its table
+    if ((type == kNodeType_NumEntries) && (GetString(decl, "table") == NULL))
+    {
+        fprintf(stderr, "ERROR: %s (%s) requires a table\n", path, node_types[type].name);
+        return -1;
+    }
+
+    // Exit if the value type is not known
+    value = GetString(decl, "value_type");
+    if (value != NULL)
+    {
+        for (i=0; i<NUM_VALUE_TYPES; i++)
+        {
+            if (strcmp(value, value_types[i].name) == 0)
+            {
+                break;
+            }
+        }
+
+        if (i == NUM_VALUE_TYPES)
+        {
+            fprintf(stderr, "ERROR: %s has unknown value_type '%s'\n", path, value);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** FindChild
+**
+** Finds the child of the specified node whose name matches the path segment
+**
+** \param   parent - node whose children to search
+** \param   seg - pointer to path segment. This is terminated by '.' or NULL terminator
+**
+** \return  pointer to child node, or NULL if no child matches
+**
+**************************************************************************/
+gen_node_t *FindChild(gen_node_t *parent, char *seg)
+{
+    gen_node_t *child;
+    int len;
+    int i;
+
+    len = strcspn(seg, ".");
+    for (i=0; i < parent->num_children; i++)
+    {
+        child = parent->children[i];
+        if ((strncmp(child->name, seg, len) == 0) && (child->name[len] == '\0'))
+        {
+            return child;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** CreateNode
+**
+** Creates a node in the schema tree. The node is implicit until its declaration is found
+**
+** \param   parent - parent of the node, or NULL if creating the root node
+** \param   name - pointer to name of the node (not NULL terminated)
+** \param   name_len - number of characters in the name
+** \param   type - type of the node
+**
+** \return  pointer to created node
+**
+**************************************************************************/
+gen_node_t *CreateNode(gen_node_t *parent, char *name, int name_len, node_type_t type)
+{
+    gen_node_t *node;
+    int len;
+
+    node = SchemacMalloc(sizeof(gen_node_t));
+    memset(node, 0, sizeof(gen_node_t));
+    node->name = SchemacMalloc(name_len+1);
+    memcpy(node->name, name, name_len);
+    node->name[name_len] = '\0';
+    node->type = type;
+    node->is_implicit = true;
+    node->parent = parent;
+
+    // Form the schema path of the node, in the same way as DM_PRIV_AddSchemaPath()
+    if (parent == NULL)
+    {
+        node->path = SchemacStrdup(node->name);
+    }
+    else
+    {
+        len = strlen(parent->path) + 1 + name_len + 1 + sizeof(MULTI_SEPARATOR);
+        node->path = SchemacMalloc(len);
+        snprintf(node->path, len, "%s.%s%s", parent->path, node->name, (type == kNodeType_MultiObject) ? "." MULTI_SEPARATOR : "");
+
+        parent->children = SchemacRealloc(parent->children, (parent->num_children+1)*sizeof(gen_node_t *));
+        parent->children[parent->num_children] = node;
+        parent->num_children++;
+    }
+
+    return node;
+}
+
+/*********************************************************************//**
+**
+** FindNodeFromPath
+**
+** Finds the node in the schema tree with the specified schema path
+**
+** \param   path - schema path of the node eg 'Device.Example.{i}'
+**
+** \return  pointer to node, or NULL if no node has the specified path
+**
+**************************************************************************/
+gen_node_t *FindNodeFromPath(char *path)
+{
+    int i;
+    gen_node_t *node;
+
+    for (i=0; i < num_nodes; i++)
+    {
+        node = ordered_nodes[i];
+        if (strcmp(node->path, path) == 0)
+        {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************//**
+**
+** MultiInstanceAncestor
+**
+** Returns the nearest multi-instance object which is the specified node or an ancestor of it
+**
+** \param   node - node to start searching from
+**
+** \return  pointer to multi-instance object, or NULL if there is none in the path to the node
+**
+**************************************************************************/
+gen_node_t *MultiInstanceAncestor(gen_node_t *node)
+{
+    while ((node != NULL) && (node->type != kNodeType_MultiObject))
+    {
+        node = node->parent;
+    }
+
+    return node;
+}
+
+/*********************************************************************//**
+**
+** ResolveReferences
+**
+** Resolves the tables counted by NumEntries parameters, and the parameters making up unique keys
+** NOTE: This function is recursive
+**
+** \param   node - node to resolve the references of (along with all of its descendants)
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int ResolveReferences(gen_node_t *node)
+{
+    gen_node_t *table;
+    char *table_path;
+    int err;
+    int i;
+
+    if (node->type == kNodeType_NumEntries)
+    {
+        // Exit if the table does not exist, or is not a multi-instance object with the same parent as the parameter
+        table_path = GetString(node->json, "table");
+        table = FindNodeFromPath(table_path);
+        if ((table == NULL) || (table->type != kNodeType_MultiObject))
+        {
+            fprintf(stderr, "ERROR: Table %s (of %s) is not a multi-instance object in the schema file\n", table_path, node->path);
+            return -1;
+        }
+
+        if (MultiInstanceAncestor(table->parent) != MultiInstanceAncestor(node))
+        {
+            fprintf(stderr, "ERROR: Table %s must have same parent as %s\n", table_path, node->path);
+            return -1;
+        }
+        node->table = table;
+    }
+
+    if (node->type == kNodeType_MultiObject)
+    {
+        err = ResolveUniqueKeys(node);
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    // The Alias parameter is a unique key of its parent table
+    if (node->type == kNodeType_Alias)
+    {
+        if ((node->parent->type != kNodeType_MultiObject) || (strcmp(node->name, "Alias") != 0))
+        {
+            fprintf(stderr, "ERROR: Alias parameter %s must be named 'Alias' and be a child of a multi-instance object\n", node->path);
+            return -1;
+        }
+
+        AddUniqueKey(node->parent, &node, 1);
+    }
+
+    for (i=0; i < node->num_children; i++)
+    {
+        err = ResolveReferences(node->children[i]);
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** ResolveUniqueKeys
+**
+** Resolves the parameters making up each unique key declared for a multi-instance object
+**
+** \param   node - multi-instance object
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int ResolveUniqueKeys(gen_node_t *node)
+{
+    JsonNode *keys;
+    JsonNode *key;
+    JsonNode *param;
+    gen_node_t *params[MAX_KEY_PARAMS];
+    gen_node_t *child;
+    int num_params;
+
+    // Exit if the object has no unique keys
+    keys = (node->json == NULL) ? NULL : json_find_member(node->json, "unique_keys");
+    if (keys == NULL)
+    {
+        return 0;
+    }
+
+    if (keys->tag != JSON_ARRAY)
+    {
+        fprintf(stderr, "ERROR: unique_keys of %s must be an array of arrays of parameter names\n", node->path);
+        return -1;
+    }
+
+    json_foreach(key, keys)
+    {
+        // Exit if the key is not an array of between 1 and MAX_KEY_PARAMS parameter names
+        num_params = 0;
+        if ((key->tag != JSON_ARRAY) || (key->children.head == NULL))
+        {
+            fprintf(stderr, "ERROR: unique_keys of %s must be an array of arrays of parameter names\n", node->path);
+            return -1;
+        }
+
+        json_foreach(param, key)
+        {
+            if ((param->tag != JSON_STRING) || (num_params == MAX_KEY_PARAMS))
+            {
+                fprintf(stderr, "ERROR: Unique key of %s must contain between 1 and %d parameter names\n", node->path, MAX_KEY_PARAMS);
+                return -1;
+            }
+
+            // Exit if the parameter is not a child parameter of the object
+            child = FindChild(node, param->string_);
+            if ((child == NULL) || ((TYPE_BIT(child->type) & PARAM_TYPES) == 0))
+            {
+                fprintf(stderr, "ERROR: Parameter '%s' in unique key is not a child parameter of '%s'\n", param->string_, node->path);
+                return -1;
+            }
+            params[num_params++] = child;
+        }
+
+        AddUniqueKey(node, params, num_params);
+    }
+
+    return 0;
+}
+
+/*********************************************************************//**
+**
+** AddUniqueKey
+**
+** Adds a unique key to a multi-instance object
+**
+** \param   node - multi-instance object
+** \param   params - array of parameters making up the key
+** \param   num_params - number of parameters in the key
+**
+** \return  None
+**
+**************************************************************************/
+void AddUniqueKey(gen_node_t *node, gen_node_t **params, int num_params)
+{
+    node->keys = SchemacRealloc(node->keys, (node->num_keys+1)*MAX_KEY_PARAMS*sizeof(gen_node_t *));
+    node->key_lens = SchemacRealloc(node->key_lens, (node->num_keys+1)*sizeof(int));
+    memcpy(&node->keys[node->num_keys*MAX_KEY_PARAMS], params, num_params*sizeof(gen_node_t *));
+    node->key_lens[node->num_keys] = num_params;
+    node->num_keys++;
+}
+
+/*********************************************************************//**
+**
+** OrderNodes
+**
+** Sorts the children of each node by name, and numbers the nodes depth first (so that parents precede their children)
+** NOTE: This function is recursive
+**
+** \param   node - node to number (along with all of its descendants)
+**
+** \return  None
+**
+**************************************************************************/
+void OrderNodes(gen_node_t *node)
+{
+    int i;
+
+    if (node == root)
+    {
+        num_nodes = 0;
+    }
+
+    qsort(node->children, node->num_children, sizeof(gen_node_t *), CompareNodeNames);
+
+    node->index = num_nodes;
+    ordered_nodes = SchemacRealloc(ordered_nodes, (num_nodes+1)*sizeof(gen_node_t *));
+    ordered_nodes[num_nodes] = node;
+    num_nodes++;
+
+    for (i=0; i < node->num_children; i++)
+    {
+        OrderNodes(node->children[i]);
+    }
+}
+
+/*********************************************************************//**
+**
+** CompareNodeNames
+**
+** qsort comparison function used to sort the children of a node by name
+**
+** \param   p1 - pointer to first node pointer to compare
+** \param   p2 - pointer to second node pointer to compare
+**
+** \return  <0, 0 or >0 depending on the ordering of the names
+**
+**************************************************************************/
+int CompareNodeNames(const void *p1, const void *p2)
+{
+    gen_node_t *n1 = *(gen_node_t **)p1;
+    gen_node_t *n2 = *(gen_node_t **)p2;
+
+    return strcmp(n1->name, n2->name);
+}
+
+/*********************************************************************//**
+**
+** WriteSchema
+**
+** Writes the C file containing the static schema table
+**
+** \param   fp - file to write to
+** \param   name - name of the usp_static_schema_t variable to generate
+** \param   src_filename - name of the schema file (used in the comment at the start of the generated file)
+**
+** \return  0 if successful, otherwise -1
+**
+**************************************************************************/
+int WriteSchema(FILE *fp, char *name, char *src_filename)
+{
+    gen_node_t *node;
+    int i;
+
+    fprintf(fp, "/*\n * Static schema table generated by obuspa_schemac from %s. DO NOT EDIT.\n", src_filename);
+    fprintf(fp, " * Register it from VENDOR_Init() using:\n");
+    fprintf(fp, " *    extern const usp_static_schema_t %s;\n", name);
+    fprintf(fp, " *    USP_REGISTER_StaticSchema(&%s);\n */\n\n", name);
+
+    fprintf(fp, "#include <stdlib.h>\n#include <stdbool.h>\n\n");
+    fprintf(fp, "#include \"usp_err_codes.h\"\n#include \"vendor_defs.h\"\n#include \"vendor_api.h\"\n#include \"usp_api.h\"\n\n");
+
+    // Write the prototypes of all callbacks
+    fprintf(fp, "//------------------------------------------------------------------------------\n// Callbacks\n");
+    for (i=0; i < num_nodes; i++)
+    {
+        WritePrototypes(fp, ordered_nodes[i]);
+    }
+
+    // Write the arguments of operations and events, and the unique keys of objects
+    fprintf(fp, "\n//------------------------------------------------------------------------------\n// Arguments and unique keys\n");
+    for (i=0; i < num_nodes; i++)
+    {
+        node = ordered_nodes[i];
+        WriteArgs(fp, name, node, (node->type == kNodeType_Event) ? "args" : "input_args", "in");
+        WriteArgs(fp, name, node, "output_args", "out");
+        WriteUniqueKeys(fp, name, node);
+    }
+
+    // Write the table of nodes
+    fprintf(fp, "\n//------------------------------------------------------------------------------\n// Nodes\n");
+    fprintf(fp, "static const usp_static_node_t %s_nodes[%d] =\n{\n", name, num_nodes);
+    for (i=0; i < num_nodes; i++)
+    {
+        WriteNode(fp, name, ordered_nodes[i]);
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "const usp_static_schema_t %s = { %s_nodes, %d };\n", name, name, num_nodes);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+/*********************************************************************//**
+**
+** WritePrototypes
+**
+** Writes the prototypes of the callbacks named by the specified node, which have not already been written
+**
+** \param   fp - file to write to
+** \param   node - node whose callbacks to write the prototypes of
+**
+** \return  None
+**
+**************************************************************************/
+void WritePrototypes(FILE *fp, gen_node_t *node)
+{
+    const callback_info_t *cb;
+    char *cb_name;
+    int i;
+    int j;
+
+    for (i=0; i < NUM_CALLBACKS; i++)
+    {
+        // Skip if this callback is not named by the node
+        cb = &callbacks[i];
+        cb_name = (node->json == NULL) ? NULL : GetString(node->json, cb->key);
+        if ((cb_name == NULL) || ((cb->allowed & TYPE_BIT(node->type)) == 0))
+        {
+            continue;
+        }
+
+        // Skip if the prototype has already been written
+        for (j=0; j < num_cb_names; j++)
+        {
+            if (strcmp(cb_names[j], cb_name) == 0)
+            {
+                break;
+            }
+        }
+
+        if (j < num_cb_names)
+        {
+            continue;
+        }
+
+        cb_names = SchemacRealloc(cb_names, (num_cb_names+1)*sizeof(char *));
+        cb_names[num_cb_names++] = cb_name;
+        fprintf(fp, cb->prototype, cb_name);
+        fprintf(fp, "\n");
+    }
+}
+
+/*********************************************************************//**
+**
+** WriteArgs
+**
+** Writes the array containing the specified arguments of an operation or event (if it has any)
+**
+** \param   fp - file to write to
+** \param   name - name of the static schema table
+** \param   node - operation or event
+** \param   key - member of the node's declaration containing the array of arguments
+** \param   suffix - suffix of the name of the array to write
+**
+** \return  None
+**
+**************************************************************************/
+void WriteArgs(FILE *fp, char *name, gen_node_t *node, char *key, char *suffix)
+{
+    JsonNode *args;
+    JsonNode *arg;
+
+    args = (node->json == NULL) ? NULL : json_find_member(node->json, key);
+    if ((args == NULL) || (args->tag != JSON_ARRAY) || (args->children.head == NULL))
+    {
+        return;
+    }
+
+    fprintf(fp, "static char *%s_args_%d_%s[] = { ", name, node->index, suffix);
+    json_foreach(arg, args)
+    {
+        if (arg->tag == JSON_STRING)
+        {
+            WriteString(fp, arg->string_);
+            fprintf(fp, ", ");
+        }
+    }
+    fprintf(fp, "};\n");
+}
+
+/*********************************************************************//**
+**
+** WriteUniqueKeys
+**
+** Writes the arrays containing the unique keys of a multi-instance object (if it has any)
+**
+** \param   fp - file to write to
+** \param   name - name of the static schema table
+** \param   node - multi-instance object
+**
+** \return  None
+**
+**************************************************************************/
+void WriteUniqueKeys(FILE *fp, char *name, gen_node_t *node)
+{
+    gen_node_t **key;
+    int i;
+    int j;
+
+    if (node->num_keys == 0)
+    {
+        return;
+    }
+
+    for (i=0; i < node->num_keys; i++)
+    {
+        key = &node->keys[i*MAX_KEY_PARAMS];
+        fprintf(fp, "static const int %s_key_%d_%d[] = { ", name, node->index, i);
+        for (j=0; j < node->key_lens[i]; j++)
+        {
+            fprintf(fp, "%d, ", key[j]->index);
+        }
+        fprintf(fp, "};\n");
+    }
+
+    fprintf(fp, "static const usp_static_unique_key_t %s_keys_%d[] = { ", name, node->index);
+    for (i=0; i < node->num_keys; i++)
+    {
+        fprintf(fp, "{ %s_key_%d_%d, %d }, ", name, node->index, i, node->key_lens[i]);
+    }
+    fprintf(fp, "};\n");
+}
+
+/*********************************************************************//**
+**
+** WriteNode
+**
+** Writes the entry in the table of nodes for the specified node
+**
+** \param   fp - file to write to
+** \param   name - name of the static schema table
+** \param   node - node to write
+**
+** \return  None
+**
+**************************************************************************/
+void WriteNode(FILE *fp, char *name, gen_node_t *node)
+{
+    JsonNode *json = node->json;
+    char *value;
+    char *cb_name;
+    JsonNode *member;
+    uint64_t hash32;
+    uint64_t hash64;
+    int i;
+
+    fprintf(fp, "    {   // [%d]\n", node->index);
+    fprintf(fp, "        .name = ");
+    WriteString(fp, node->name);
+    fprintf(fp, ", .path = ");
+    WriteString(fp, node->path);
+    fprintf(fp, ",\n        .type = %s, .is_implicit = %s, .parent = %d, .num_children = %d,\n",
+                node_types[node->type].enum_name, (node->is_implicit) ? "true" : "false",
+                (node->parent == NULL) ? -1 : node->parent->index, node->num_children);
+
+    // Precomputed hashes. These must be calculated in the same way as CreateNode() and DM_PRIV_CalcDbHash() in data_model.c
+    fprintf(fp, "        .name_hash = (int)0x%08XU,\n", (unsigned)TEXT_UTILS_CalcHash(node->name));
+    if (IsDbParam(node))
+    {
+        hash32 = (uint64_t)(int64_t)TEXT_UTILS_CalcHash(node->path);      // NOTE: The 32 bit hash is sign extended
+        hash64 = TEXT_UTILS_CalcWordHash64(node->path);
+        fprintf(fp, "        .db_hash32 = (long long)0x%016llXULL, .db_hash64 = (long long)0x%016llXULL,\n",
+                    (unsigned long long)hash32, (unsigned long long)hash64);
+    }
+
+    // Type of parameter
+    if (TYPE_BIT(node->type) & TYPED_PARAM_TYPES)
+    {
+        value = GetString(json, "value_type");
+        for (i=0; i<NUM_VALUE_TYPES; i++)
+        {
+            if ((value != NULL) && (strcmp(value, value_types[i].name) == 0))
+            {
+                break;
+            }
+        }
+
+        member = json_find_member(json, "push_notified");
+        fprintf(fp, "        .type_flags = %s%s,\n", (i < NUM_VALUE_TYPES) ? value_types[i].flag : "DM_STRING",
+                    ((member != NULL) && (member->tag == JSON_BOOL) && (member->bool_)) ? " | DM_PUSH_NOTIFIED" : "");
+    }
+
+    // Default value of DB parameters, and value of constant parameters
+    value = (json == NULL) ? NULL : GetString(json, (node->type == kNodeType_Constant) ? "value" : "default");
+    if (value != NULL)
+    {
+        fprintf(fp, "        .value = ");
+        WriteString(fp, value);
+        fprintf(fp, ",\n");
+    }
+
+    if (node->table != NULL)
+    {
+        fprintf(fp, "        .table = %d,\n", node->table->index);
+    }
+
+    // Arguments of operations and events
+    member = (json == NULL) ? NULL : json_find_member(json, (node->type == kNodeType_Event) ? "args" : "input_args");
+    if ((member != NULL) && (member->tag == JSON_ARRAY) && (member->children.head != NULL))
+    {
+        fprintf(fp, "        .input_args = %s_args_%d_in, .num_input_args = (int)(sizeof(%s_args_%d_in)/sizeof(char *)),\n",
+                    name, node->index, name, node->index);
+    }
+
+    member = (json == NULL) ? NULL : json_find_member(json, "output_args");
+    if ((member != NULL) && (member->tag == JSON_ARRAY) && (member->children.head != NULL))
+    {
+        fprintf(fp, "        .output_args = %s_args_%d_out, .num_output_args = (int)(sizeof(%s_args_%d_out)/sizeof(char *)),\n",
+                    name, node->index, name, node->index);
+    }
+
+    if (node->num_keys > 0)
+    {
+        fprintf(fp, "        .unique_keys = %s_keys_%d, .num_unique_keys = %d,\n", name, node->index, node->num_keys);
+    }
+
+    // Callbacks
+    for (i=0; i < NUM_CALLBACKS; i++)
+    {
+        cb_name = (json == NULL) ? NULL : GetString(json, callbacks[i].key);
+        if ((cb_name != NULL) && (callbacks[i].allowed & TYPE_BIT(node->type)))
+        {
+            fprintf(fp, "        %s = %s,\n", callbacks[i].member, cb_name);
+        }
+    }
+
+    fprintf(fp, "    },\n");
+}
+
+/*********************************************************************//**
+**
+** WriteString
+**
+** Writes the specified string as a C string literal
+**
+** \param   fp - file to write to
+** \param   str - string to write
+**
+** \return  None
+**
+**************************************************************************/
+void WriteString(FILE *fp, char *str)
+{
+    unsigned char c;
+
+    fputc('"', fp);
+    while (*str != '\0')
+    {
+        c = (unsigned char) *str++;
+        if ((c == '"') || (c == '\\'))
+        {
+            fprintf(fp, "\\%c", c);
+        }
+        else if ((c < 0x20) || (c >= 0x7F))
+        {
+            fprintf(fp, "\\%03o", c);   // NOTE: Octal escapes are always 3 digits, so cannot merge with following characters
+        }
+        else
+        {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/*********************************************************************//**
+**
+** GetString
+**
+** Gets the value of a string member of a JSON object
+**
+** \param   decl - JSON object
+** \param   key - name of the member to get
+**
+** \return  pointer to value of the member, or NULL if the member does not exist or is not a string
+**
+**************************************************************************/
+char *GetString(JsonNode *decl, char *key)
+{
+    JsonNode *member;
+
+    member = json_find_member(decl, key);
+    if ((member == NULL) || (member->tag != JSON_STRING))
+    {
+        return NULL;
+    }
+
+    return member->string_;
+}
+
+/*********************************************************************//**
+**
+** IsDbParam
+**
+** Determines whether the specified node is a parameter stored in the database (and hence needs a database hash)
+**
+** \param   node - node to test
+**
+** \return  true if the node is a DB parameter
+**
+**************************************************************************/
+bool IsDbParam(gen_node_t *node)
+{
+    return (TYPE_BIT(node->type) & DB_TYPES) ? true : false;
+}
+
+/*********************************************************************//**
+**
+** SchemacMalloc
+**
+** Wrapper around malloc() that terminates this program if out of memory
+**
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *SchemacMalloc(int size)
+{
+    return SchemacRealloc(NULL, size);
+}
+
+/*********************************************************************//**
+**
+** SchemacRealloc
+**
+** Wrapper around realloc() that terminates this program if out of memory
+**
+** \param   ptr - pointer to memory to reallocate, or NULL
+** \param   size - number of bytes to allocate
+**
+** \return  pointer to allocated memory
+**
+**************************************************************************/
+void *SchemacRealloc(void *ptr, int size)
+{
+    void *new_ptr;
+
+    new_ptr = realloc(ptr, (size > 0) ? size : 1);
+    if (new_ptr == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        exit(1);
+    }
+
+    return new_ptr;
+}
+
+/*********************************************************************//**
+**
+** SchemacStrdup
+**
+** Wrapper around strdup() that terminates this program if out of memory
+**
+** \param   str - string to duplicate
+**
+** \return  pointer to duplicated string
+**
+**************************************************************************/
+char *SchemacStrdup(char *str)
+{
+    char *new_str;
+
+    new_str = SchemacMalloc(strlen(str)+1);
+    strcpy(new_str, str);
+
+    return new_str;
+}